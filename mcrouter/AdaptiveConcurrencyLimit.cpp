@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "AdaptiveConcurrencyLimit.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* Weight of the new limit and of the new latency sample */
+const double kLimitSmoothing = 0.2;
+const double kLatencySmoothing = 0.1;
+/* Multiplicative decrease on drops */
+const double kDropBackoff = 0.9;
+/* Initial limit, before there are any samples */
+const double kInitialLimit = 32;
+
+}  // anonymous namespace
+
+constexpr double AdaptiveConcurrencyLimit::kTolerance;
+constexpr size_t AdaptiveConcurrencyLimit::kBaselineWindow;
+
+AdaptiveConcurrencyLimit::AdaptiveConcurrencyLimit(size_t minLimit,
+                                                   size_t maxLimit)
+    : minLimit_(std::max<size_t>(minLimit, 1)),
+      maxLimit_(std::max(minLimit_, static_cast<double>(maxLimit))),
+      limit_(std::min(std::max(kInitialLimit, minLimit_), maxLimit_)) {
+  assert(minLimit >= 1);
+}
+
+void AdaptiveConcurrencyLimit::onSample(int64_t latencyUs,
+                                        size_t outstanding) {
+  latencyUs = std::max<int64_t>(latencyUs, 1);
+
+  if (windowSamples_ == 0 || latencyUs < windowMinUs_) {
+    windowMinUs_ = latencyUs;
+  }
+  ++windowSamples_;
+  baselineUs_ = prevWindowMinUs_ == 0
+    ? windowMinUs_
+    : std::min(windowMinUs_, prevWindowMinUs_);
+  if (windowSamples_ == kBaselineWindow) {
+    // Forget older minimums, so the baseline follows the destination if it
+    // becomes slower permanently
+    prevWindowMinUs_ = windowMinUs_;
+    windowSamples_ = 0;
+  }
+
+  smoothedUs_ = smoothedUs_ == 0.0
+    ? latencyUs
+    : smoothedUs_ * (1 - kLatencySmoothing) + latencyUs * kLatencySmoothing;
+
+  auto gradient = std::min(
+    1.0, std::max(0.5, baselineUs_ * kTolerance / smoothedUs_));
+  auto newLimit = limit_ * gradient + std::sqrt(limit_);
+  if (newLimit > limit_ && outstanding * 2 < limit_) {
+    // Not using the current limit, there's no evidence we can handle more
+    return;
+  }
+  limit_ = limit_ * (1 - kLimitSmoothing) + newLimit * kLimitSmoothing;
+  limit_ = std::min(std::max(limit_, minLimit_), maxLimit_);
+}
+
+void AdaptiveConcurrencyLimit::onDrop() {
+  limit_ = std::max(limit_ * kDropBackoff, minLimit_);
+}
+
+}}}  // facebook::memcache::mcrouter
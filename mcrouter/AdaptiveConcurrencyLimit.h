@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Limit on the number of outstanding requests to a destination that adapts
+ * to the destination's latency (gradient algorithm).
+ *
+ * The baseline is the lowest latency seen over the last kBaselineWindow
+ * samples, i.e. latency without queueing. After each sample the limit moves
+ * towards limit * gradient + sqrt(limit), where gradient is
+ * baseline * kTolerance / (smoothed latency), clamped to [0.5, 1]. So the
+ * limit grows while latency stays close to the baseline, and shrinks
+ * as soon as requests start to queue up. Timeouts and load shedding replies
+ * shrink the limit multiplicatively.
+ *
+ * Not thread safe.
+ */
+class AdaptiveConcurrencyLimit {
+ public:
+  /* Latency up to this many times the baseline is considered healthy */
+  static constexpr double kTolerance = 1.5;
+  static constexpr size_t kBaselineWindow = 1000;
+
+  /**
+   * @param minLimit  the limit never goes below this, must be at least 1
+   * @param maxLimit  the limit never goes above this
+   */
+  AdaptiveConcurrencyLimit(size_t minLimit, size_t maxLimit);
+
+  /**
+   * Current limit on outstanding requests.
+   */
+  size_t limit() const {
+    return static_cast<size_t>(limit_);
+  }
+
+  /**
+   * Baseline latency, 0 if there were no samples yet.
+   */
+  int64_t baselineUs() const {
+    return baselineUs_;
+  }
+
+  /**
+   * Latency of a request that got a reply from the destination.
+   *
+   * @param outstanding  number of outstanding requests when it was sent,
+   *                     the limit isn't raised from samples of requests
+   *                     sent far below the limit.
+   */
+  void onSample(int64_t latencyUs, size_t outstanding);
+
+  /**
+   * Request that timed out or was refused by the overloaded destination.
+   */
+  void onDrop();
+
+ private:
+  const double minLimit_;
+  const double maxLimit_;
+  double limit_;
+
+  int64_t baselineUs_{0};
+  /* Minimum of the current and the previous window */
+  int64_t windowMinUs_{0};
+  int64_t prevWindowMinUs_{0};
+  size_t windowSamples_{0};
+
+  double smoothedUs_{0.0};
+};
+
+}}}  // facebook::memcache::mcrouter
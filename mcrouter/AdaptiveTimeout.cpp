@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "AdaptiveTimeout.h"
+
+#include <algorithm>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t AdaptiveTimeout::kWindowSamples;
+
+void AdaptiveTimeout::onSample(int64_t latencyUs) {
+  window_.insertSample(std::max<int64_t>(latencyUs, 0));
+  if (window_.count() >= kWindowSamples) {
+    p99Us_ = window_.quantile(0.99);
+    window_ = LatencyHistogram();
+  }
+}
+
+std::chrono::milliseconds AdaptiveTimeout::timeout(
+    const AdaptiveTimeoutSettings& settings,
+    std::chrono::milliseconds staticTimeout) const {
+
+  if (!settings.enabled() || p99Us_ == 0) {
+    return staticTimeout;
+  }
+  auto max = settings.max.count() != 0 ? settings.max : staticTimeout;
+  auto min = std::min(settings.min, max);
+  /* rounded up, a timeout of 0 would mean no timeout */
+  auto adaptive = std::chrono::milliseconds(
+    (p99Us_ * settings.pct / 100 + 999) / 1000);
+  return std::min(std::max(adaptive, min), max);
+}
+
+}}}  // facebook::memcache::mcrouter
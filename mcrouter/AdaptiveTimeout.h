@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "mcrouter/LatencyHistogram.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Adaptive timeouts of a pool, see --target-adaptive-timeout-pct and
+ * the pool's "adaptive_timeout".
+ */
+struct AdaptiveTimeoutSettings {
+  /* Timeout in percent of the destination's recent p99, 0 disables */
+  uint32_t pct{0};
+  std::chrono::milliseconds min{0};
+  /* 0 means the pool's server timeout */
+  std::chrono::milliseconds max{0};
+
+  bool enabled() const {
+    return pct != 0;
+  }
+};
+
+/**
+ * Request timeout of a destination that follows its latency:
+ * pct% of the p99 latency of the last complete window of kWindowSamples
+ * replies, clamped to [min, max]. Until the first window is complete,
+ * the static timeout is used.
+ *
+ * Timed out requests count as samples too (with the latency they were
+ * given up at), so the timeout grows back if the destination slows down
+ * for good instead of cutting off more and more of its replies.
+ *
+ * Not thread safe.
+ */
+class AdaptiveTimeout {
+ public:
+  static constexpr size_t kWindowSamples = 1000;
+
+  void onSample(int64_t latencyUs);
+
+  /**
+   * p99 latency of the last complete window, 0 if there is none yet.
+   */
+  uint64_t p99Us() const {
+    return p99Us_;
+  }
+
+  /**
+   * @param staticTimeout  timeout from the options and pool config, also
+   *                       the upper bound unless settings.max is set.
+   */
+  std::chrono::milliseconds timeout(
+    const AdaptiveTimeoutSettings& settings,
+    std::chrono::milliseconds staticTimeout) const;
+
+ private:
+  LatencyHistogram window_;
+  uint64_t p99Us_{0};
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,151 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "AsynclogFormat.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <folly/Bits.h>
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/Format.h>
+#include <folly/json.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+template <class T>
+void appendInt(std::string& out, T value) {
+  value = folly::Endian::little(value);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendString(std::string& out, folly::StringPiece str) {
+  if (str.size() > std::numeric_limits<uint16_t>::max()) {
+    throw std::runtime_error("asynclog field is too long");
+  }
+  appendInt<uint16_t>(out, str.size());
+  out.append(str.data(), str.size());
+}
+
+template <class T>
+T parseInt(folly::StringPiece& data) {
+  if (data.size() < sizeof(T)) {
+    throw std::runtime_error("asynclog record is truncated");
+  }
+  T value;
+  std::memcpy(&value, data.data(), sizeof(T));
+  data.advance(sizeof(T));
+  return folly::Endian::little(value);
+}
+
+folly::StringPiece parseString(folly::StringPiece& data) {
+  auto size = parseInt<uint16_t>(data);
+  if (data.size() < size) {
+    throw std::runtime_error("asynclog record is truncated");
+  }
+  auto str = data.subpiece(0, size);
+  data.advance(size);
+  return str;
+}
+
+}  // anonymous namespace
+
+constexpr size_t AsynclogFormat::kMagicSize;
+const char AsynclogFormat::kBinaryMagic[kMagicSize + 1] = "MCASB1\n";
+
+std::string AsynclogFormat::jsonLine(const AsynclogRecord& record,
+                                     folly::StringPiece routerName,
+                                     bool version2) {
+  folly::dynamic json = {};
+  if (version2) {
+    json = folly::dynamic::object;
+    json["f"] = routerName.str();
+    json["h"] = folly::sformat("[{}]:{}", record.host, record.port);
+    json["p"] = record.pool.str();
+    json["k"] = record.key.str();
+  } else {
+    /* ["host", port, escaped_command] */
+    json.push_back(record.host.str());
+    json.push_back(record.port);
+    json.push_back(folly::sformat("delete {}\r\n", record.key));
+  }
+
+  folly::dynamic jsonOut = {};
+  jsonOut.push_back(version2 ? "AS2.0" : "AS1.0");
+  jsonOut.push_back(1e-3 * record.timestampMs);
+  jsonOut.push_back(std::string("C"));
+  jsonOut.push_back(json);
+
+  return folly::to<std::string>(folly::toJson(jsonOut), "\n");
+}
+
+void AsynclogFormat::appendHeader(std::string& out,
+                                  folly::StringPiece routerName) {
+  out.append(kBinaryMagic, kMagicSize);
+  appendString(out, routerName);
+}
+
+void AsynclogFormat::appendRecord(std::string& out,
+                                  const AsynclogRecord& record) {
+  auto sizePos = out.size();
+  appendInt<uint32_t>(out, 0);
+  appendInt<uint64_t>(out, record.timestampMs);
+  appendInt<uint16_t>(out, record.port);
+  appendString(out, record.host);
+  appendString(out, record.pool);
+  appendString(out, record.key);
+
+  auto size = folly::Endian::little<uint32_t>(
+    out.size() - sizePos - sizeof(uint32_t));
+  std::memcpy(&out[sizePos], &size, sizeof(size));
+}
+
+bool AsynclogFormat::isBinary(folly::StringPiece data) {
+  return data.size() >= kMagicSize &&
+    std::memcmp(data.data(), kBinaryMagic, kMagicSize) == 0;
+}
+
+folly::StringPiece AsynclogFormat::parseHeader(folly::StringPiece& data) {
+  if (!isBinary(data)) {
+    throw std::runtime_error("not a binary asynclog");
+  }
+  data.advance(kMagicSize);
+  return parseString(data);
+}
+
+bool AsynclogFormat::parseRecord(folly::StringPiece& data,
+                                 AsynclogRecord& record) {
+  uint32_t size;
+  if (data.size() < sizeof(size)) {
+    return false;
+  }
+  std::memcpy(&size, data.data(), sizeof(size));
+  size = folly::Endian::little(size);
+  if (data.size() - sizeof(size) < size) {
+    return false;
+  }
+
+  auto body = data.subpiece(sizeof(size), size);
+  record.timestampMs = parseInt<uint64_t>(body);
+  record.port = parseInt<uint16_t>(body);
+  record.host = parseString(body);
+  record.pool = parseString(body);
+  record.key = parseString(body);
+  if (!body.empty()) {
+    throw std::runtime_error("asynclog record has trailing bytes");
+  }
+  data.advance(sizeof(size) + size);
+  return true;
+}
+
+}}} // facebook::memcache::mcrouter
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * A failed delete recorded in the asynclog.
+ */
+struct AsynclogRecord {
+  uint64_t timestampMs{0};
+  folly::StringPiece host;
+  uint16_t port{0};
+  folly::StringPiece pool;
+  folly::StringPiece key;
+};
+
+/**
+ * Encoding of asynclog spool files.
+ *
+ * The text format is one JSON array per line:
+ *   ["AS1.0", 1289416829.836, "C", ["10.0.0.1", 11302, "delete foo\r\n"]]
+ * or with --use-asynclog-version2
+ *   ["AS2.0", 1289416829.836, "C", {"f":"flavor","h":"[10.0.0.1]:11302",
+ *                                   "p":"pool_name","k":"foo"}]
+ *
+ * The binary format (written with --asynclog-batch) is a header followed by
+ * length prefixed records, all integers are little endian:
+ *   header: magic (8 bytes) | u16 size | router name
+ *   record: u32 size of the rest | u64 timestamp ms | u16 port |
+ *           u16 size | host | u16 size | pool | u16 size | key
+ * A record cut short by a crash is detected by its size and ignored.
+ */
+class AsynclogFormat {
+ public:
+  static constexpr size_t kMagicSize = 8;
+  static const char kBinaryMagic[kMagicSize + 1];
+
+  /**
+   * @return text format line of the record, including the trailing '\n'.
+   */
+  static std::string jsonLine(const AsynclogRecord& record,
+                              folly::StringPiece routerName,
+                              bool version2);
+
+  static void appendHeader(std::string& out, folly::StringPiece routerName);
+
+  static void appendRecord(std::string& out, const AsynclogRecord& record);
+
+  /**
+   * @return true if data starts with the binary format magic.
+   */
+  static bool isBinary(folly::StringPiece data);
+
+  /**
+   * Parses the header from the beginning of data, data is advanced past it.
+   *
+   * @return router name
+   * @throws std::runtime_error if data doesn't start with a valid header
+   */
+  static folly::StringPiece parseHeader(folly::StringPiece& data);
+
+  /**
+   * Parses a record from the beginning of data, data is advanced past it.
+   * Record fields point into data.
+   *
+   * @return false if data doesn't contain a complete record
+   * @throws std::runtime_error if the record is malformed
+   */
+  static bool parseRecord(folly::StringPiece& data, AsynclogRecord& record);
+};
+
+}}} // facebook::memcache::mcrouter
@@ -0,0 +1,342 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "AsynclogReplayer.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/FileUtil.h>
+#include <folly/json.h>
+#include <folly/Memory.h>
+#include <folly/MoveWrapper.h>
+
+#include "mcrouter/AsynclogFormat.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/network/AsyncMcClient.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/**
+ * Parses a text format line into host, port and key.
+ *
+ * @throws std::exception if the line is malformed
+ */
+void parseJsonLine(folly::StringPiece line, std::string& host, uint16_t& port,
+                   std::string& key) {
+  auto json = folly::parseJson(line);
+  const auto& entry = json[3];
+  if (json[0] == "AS2.0") {
+    /* {"h":"[host]:port","k":"key",...} */
+    auto hostPortStr = entry["h"].asString();
+    folly::StringPiece hostPort(hostPortStr);
+    auto pos = hostPort.rfind("]:");
+    if (hostPort.empty() || hostPort[0] != '[' ||
+        pos == folly::StringPiece::npos) {
+      throw std::runtime_error("invalid destination");
+    }
+    host = hostPort.subpiece(1, pos - 1).str();
+    port = folly::to<uint16_t>(hostPort.subpiece(pos + 2));
+    key = folly::to<std::string>(entry["k"].asString());
+  } else {
+    /* ["host", port, "delete key\r\n"] */
+    host = folly::to<std::string>(entry[0].asString());
+    port = folly::to<uint16_t>(entry[1].asInt());
+    auto commandStr = entry[2].asString();
+    folly::StringPiece command(commandStr);
+    if (!command.removePrefix("delete ") || !command.removeSuffix("\r\n")) {
+      throw std::runtime_error("not a delete command");
+    }
+    key = command.str();
+  }
+}
+
+}  // anonymous namespace
+
+AsynclogReplayer::SpoolFile::SpoolFile(const std::string& p)
+    : path(p),
+      mapping(p.c_str()) {
+  auto range = mapping.range();
+  data = folly::StringPiece(reinterpret_cast<const char*>(range.data()),
+                            range.size());
+  binary = AsynclogFormat::isBinary(data);
+  if (binary) {
+    auto rest = data;
+    routerName = AsynclogFormat::parseHeader(rest).str();
+    readOffset = data.size() - rest.size();
+  }
+}
+
+AsynclogReplayer::AsynclogReplayer(Options opts)
+    : opts_(std::move(opts)) {
+}
+
+AsynclogReplayer::~AsynclogReplayer() {
+}
+
+bool AsynclogReplayer::run(const std::vector<std::string>& files) {
+  for (const auto& path : files) {
+    files_.push_back(folly::make_unique<SpoolFile>(path));
+  }
+  loadCheckpoint();
+
+  readMore();
+  if (!finished()) {
+    scheduleCheckpoint();
+    eventBase_.loopForever();
+  }
+  saveCheckpoint();
+
+  for (auto& it : destinations_) {
+    it.second->client->closeNow();
+  }
+  eventBase_.loopOnce(EVLOOP_NONBLOCK);
+
+  return stats_.failed == 0;
+}
+
+void AsynclogReplayer::loadCheckpoint() {
+  if (opts_.checkpointPath.empty()) {
+    return;
+  }
+  std::string contents;
+  if (!folly::readFile(opts_.checkpointPath.c_str(), contents)) {
+    /* First run */
+    return;
+  }
+  auto json = folly::parseJson(contents);
+  for (auto& file : files_) {
+    auto it = json.find(file->path);
+    if (it == json.items().end()) {
+      continue;
+    }
+    auto offset = static_cast<size_t>(it->second.asInt());
+    if (offset > file->data.size()) {
+      throw std::runtime_error(folly::to<std::string>(
+        "checkpoint of ", file->path, " is past the end of the file"));
+    }
+    file->readOffset = std::max(file->readOffset, offset);
+  }
+}
+
+void AsynclogReplayer::saveCheckpoint() {
+  if (opts_.checkpointPath.empty()) {
+    return;
+  }
+  folly::dynamic json = folly::dynamic::object;
+  for (const auto& file : files_) {
+    json[file->path] = file->checkpoint();
+  }
+  auto tmpPath = opts_.checkpointPath + ".tmp";
+  auto contents = folly::to<std::string>(folly::toJson(json));
+  if (!folly::writeFile(contents, tmpPath.c_str()) ||
+      ::rename(tmpPath.c_str(), opts_.checkpointPath.c_str()) != 0) {
+    PLOG(ERROR) << "Can't write checkpoint " << opts_.checkpointPath;
+  }
+}
+
+void AsynclogReplayer::scheduleCheckpoint() {
+  if (opts_.checkpointPath.empty()) {
+    return;
+  }
+  eventBase_.runAfterDelay([this]() {
+      saveCheckpoint();
+      scheduleCheckpoint();
+    },
+    opts_.checkpointInterval.count());
+}
+
+void AsynclogReplayer::readMore() {
+  if (reading_) {
+    return;
+  }
+  reading_ = true;
+
+  std::vector<Destination*> touched;
+  while (queued_ < opts_.maxQueued && nextFile_ < files_.size()) {
+    auto& file = *files_[nextFile_];
+    if (auto destination = readRecord(file)) {
+      touched.push_back(destination);
+    } else if (file.eof) {
+      ++nextFile_;
+    }
+  }
+  reading_ = false;
+
+  for (auto destination : touched) {
+    pump(*destination);
+  }
+}
+
+AsynclogReplayer::Destination*
+AsynclogReplayer::readRecord(SpoolFile& file) {
+  auto offset = file.readOffset;
+  auto rest = file.data.subpiece(offset);
+  if (rest.empty()) {
+    file.eof = true;
+    return nullptr;
+  }
+
+  std::string host;
+  uint16_t port;
+  std::string key;
+  if (file.binary) {
+    AsynclogRecord record;
+    try {
+      if (!AsynclogFormat::parseRecord(rest, record)) {
+        LOG(WARNING) << file.path << ": truncated record at offset " << offset;
+        file.eof = true;
+        return nullptr;
+      }
+    } catch (const std::exception& e) {
+      /* Can't find the next record, keep the checkpoint here */
+      LOG(ERROR) << file.path << ": malformed record at offset " << offset
+                 << ": " << e.what();
+      ++stats_.malformed;
+      file.pending.insert(offset);
+      file.eof = true;
+      return nullptr;
+    }
+    file.readOffset = file.data.size() - rest.size();
+    host = record.host.str();
+    port = record.port;
+    key = record.key.str();
+  } else {
+    auto eol = rest.find('\n');
+    if (eol == folly::StringPiece::npos) {
+      LOG(WARNING) << file.path << ": truncated line at offset " << offset;
+      file.eof = true;
+      return nullptr;
+    }
+    file.readOffset += eol + 1;
+    try {
+      parseJsonLine(rest.subpiece(0, eol), host, port, key);
+    } catch (const std::exception& e) {
+      LOG(ERROR) << file.path << ": skipping malformed line at offset "
+                 << offset << ": " << e.what();
+      ++stats_.malformed;
+      return nullptr;
+    }
+  }
+
+  auto& destination = getDestination(host, port);
+  file.pending.insert(offset);
+  destination.queue.push_back(
+    folly::make_unique<Item>(file, offset, destination, key));
+  ++queued_;
+  return &destination;
+}
+
+AsynclogReplayer::Destination&
+AsynclogReplayer::getDestination(folly::StringPiece host, uint16_t port) {
+  auto name = folly::to<std::string>("[", host, "]:", port);
+  auto& destination = destinations_[name];
+  if (!destination) {
+    destination = folly::make_unique<Destination>();
+    ConnectionOptions options(host, port, opts_.protocol);
+    options.sendTimeout = opts_.timeout;
+    options.writeTimeout = opts_.timeout;
+    destination->client =
+      folly::make_unique<AsyncMcClient>(eventBase_, std::move(options));
+    if (opts_.maxRatePerDestination > 0) {
+      destination->tokenBucket.emplace(
+        opts_.maxRatePerDestination,
+        std::max<double>(1, opts_.maxInflightPerDestination),
+        TokenBucket::defaultClockNow());
+    }
+  }
+  return *destination;
+}
+
+void AsynclogReplayer::pump(Destination& destination) {
+  auto maxInflight = std::max<size_t>(1, opts_.maxInflightPerDestination);
+  while (destination.inflight < maxInflight && !destination.queue.empty()) {
+    if (destination.tokenBucket &&
+        !destination.tokenBucket->consume(1, TokenBucket::defaultClockNow())) {
+      if (!destination.wakeupScheduled) {
+        destination.wakeupScheduled = true;
+        auto delayMs = std::max(1, static_cast<int>(
+          1000 / opts_.maxRatePerDestination));
+        eventBase_.runAfterDelay([this, &destination]() {
+            destination.wakeupScheduled = false;
+            pump(destination);
+          },
+          delayMs);
+      }
+      return;
+    }
+    auto item = std::move(destination.queue.front());
+    destination.queue.pop_front();
+    send(std::move(item));
+  }
+}
+
+void AsynclogReplayer::send(std::unique_ptr<Item> item) {
+  auto& destination = item->destination;
+  auto& request = item->request;
+  ++destination.inflight;
+  ++item->attempts;
+
+  auto itemWrapper = folly::makeMoveWrapper(std::move(item));
+  destination.client->send(
+    request, McOperation<mc_op_delete>(),
+    [this, itemWrapper] (McReply&& reply) mutable {
+      auto result = reply.result();
+      complete(std::move(*itemWrapper),
+               result == mc_res_deleted || result == mc_res_notfound);
+    },
+    RequestPriority::ASYNCLOG_REPLAY);
+}
+
+void AsynclogReplayer::complete(std::unique_ptr<Item> item, bool delivered) {
+  auto& destination = item->destination;
+  --destination.inflight;
+
+  if (delivered) {
+    ++stats_.delivered;
+    item->file.pending.erase(item->offset);
+    --queued_;
+  } else if (item->attempts < opts_.maxAttempts) {
+    ++stats_.retried;
+    auto itemWrapper = folly::makeMoveWrapper(std::move(item));
+    eventBase_.runAfterDelay([this, itemWrapper]() mutable {
+        auto& dest = (*itemWrapper)->destination;
+        dest.queue.push_front(std::move(*itemWrapper));
+        pump(dest);
+      },
+      opts_.retryDelay.count());
+  } else {
+    ++stats_.failed;
+    LOG(ERROR) << item->file.path << ": giving up on delete of "
+               << item->request.fullKey() << " at offset " << item->offset;
+    --queued_;
+  }
+
+  readMore();
+  pump(destination);
+
+  if (finished()) {
+    eventBase_.terminateLoopSoon();
+  }
+}
+
+bool AsynclogReplayer::finished() const {
+  return nextFile_ == files_.size() && queued_ == 0;
+}
+
+}}} // facebook::memcache::mcrouter
@@ -0,0 +1,188 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/MemoryMapping.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/mc/protocol.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/TokenBucket.h"
+
+namespace facebook { namespace memcache {
+
+class AsyncMcClient;
+
+namespace mcrouter {
+
+/**
+ * Redelivers deletes spooled by AsynclogRoute (text or binary format, see
+ * AsynclogFormat) to their destinations.
+ *
+ * Spool files are memory mapped and read ahead up to Options::maxQueued
+ * records. Records are sharded by destination, every destination has its
+ * own connection with a limit on outstanding deletes and an optional rate
+ * limit. Failed deletes are retried a few times.
+ *
+ * Progress is saved in a checkpoint file: for every spool file the offset
+ * before which all records were delivered. Records that ultimately failed
+ * keep the checkpoint from moving past them, so that a rerun retries them.
+ * Replaying the same delete twice is harmless.
+ */
+class AsynclogReplayer {
+ public:
+  struct Options {
+    /* Deletes sent to one destination and waiting for a reply */
+    size_t maxInflightPerDestination{16};
+
+    /* Deletes per second sent to one destination, 0 means no limit */
+    double maxRatePerDestination{0};
+
+    /* Records read ahead from the spool files */
+    size_t maxQueued{100000};
+
+    std::chrono::milliseconds timeout{1000};
+
+    /* Attempts per record, and the delay before a retry */
+    size_t maxAttempts{3};
+    std::chrono::milliseconds retryDelay{1000};
+
+    mc_protocol_t protocol{mc_ascii_protocol};
+
+    /* Empty means no checkpoints */
+    std::string checkpointPath;
+    std::chrono::milliseconds checkpointInterval{1000};
+  };
+
+  struct Stats {
+    size_t delivered{0};
+    size_t retried{0};
+    size_t failed{0};
+    size_t malformed{0};
+  };
+
+  explicit AsynclogReplayer(Options opts);
+  ~AsynclogReplayer();
+
+  /**
+   * Replays the files (skipping the part already done according to the
+   * checkpoint), blocks until all records are delivered or failed.
+   *
+   * @return true if all records were delivered
+   * @throws std::runtime_error if a file can't be mapped or the checkpoint
+   *         can't be read
+   */
+  bool run(const std::vector<std::string>& files);
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  struct SpoolFile {
+    std::string path;
+    folly::MemoryMapping mapping;
+    folly::StringPiece data;
+    bool binary{false};
+    std::string routerName;
+    /* Everything before this offset was queued */
+    size_t readOffset{0};
+    /* Offsets of records queued or in flight, or that failed */
+    std::set<size_t> pending;
+    /* All complete records were read */
+    bool eof{false};
+
+    explicit SpoolFile(const std::string& p);
+
+    /**
+     * @return offset before which all records were delivered
+     */
+    size_t checkpoint() const {
+      return pending.empty() ? readOffset : *pending.begin();
+    }
+  };
+
+  struct Destination;
+
+  struct Item {
+    SpoolFile& file;
+    const size_t offset;
+    Destination& destination;
+    McRequest request;
+    size_t attempts{0};
+
+    Item(SpoolFile& f, size_t off, Destination& d, folly::StringPiece key)
+        : file(f), offset(off), destination(d), request(key) {
+    }
+  };
+
+  struct Destination {
+    std::unique_ptr<AsyncMcClient> client;
+    std::deque<std::unique_ptr<Item>> queue;
+    size_t inflight{0};
+    folly::Optional<TokenBucket> tokenBucket;
+    bool wakeupScheduled{false};
+  };
+
+  /* Must outlive the clients */
+  folly::EventBase eventBase_;
+  const Options opts_;
+  Stats stats_;
+
+  std::vector<std::unique_ptr<SpoolFile>> files_;
+  /* Next file to read records from */
+  size_t nextFile_{0};
+  /* Records queued or in flight */
+  size_t queued_{0};
+  bool reading_{false};
+
+  std::unordered_map<std::string, std::unique_ptr<Destination>> destinations_;
+
+  void loadCheckpoint();
+  void saveCheckpoint();
+  void scheduleCheckpoint();
+
+  /**
+   * Reads records until maxQueued are queued or all files are read.
+   */
+  void readMore();
+
+  /**
+   * Parses the record at file.readOffset and queues it.
+   * @return destination of the record, nullptr if nothing was queued
+   */
+  Destination* readRecord(SpoolFile& file);
+
+  Destination& getDestination(folly::StringPiece host, uint16_t port);
+
+  /**
+   * Sends queued deletes of the destination as the limits allow.
+   */
+  void pump(Destination& destination);
+  void send(std::unique_ptr<Item> item);
+  void complete(std::unique_ptr<Item> item, bool delivered);
+
+  /**
+   * @return true if everything has been replayed
+   */
+  bool finished() const;
+};
+
+}}} // facebook::memcache::mcrouter
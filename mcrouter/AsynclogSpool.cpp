@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "AsynclogSpool.h"
+
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/Memory.h>
+#include <folly/ScopeGuard.h>
+
+#include "mcrouter/async.h"
+#include "mcrouter/AsynclogFormat.h"
+#include "mcrouter/awriter.h"
+#include "mcrouter/lib/MemoryAccounting.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/McrouterLogFailure.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/stats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+AsynclogSpool::AsynclogSpool(proxy_t& proxy)
+    : proxy_(proxy),
+      sealCallback_(*this) {
+}
+
+AsynclogSpool::~AsynclogSpool() {
+  sealCallback_.cancelLoopCallback();
+  if (current_ && current_->records > 0) {
+    sealed_.insertHead(current_.release());
+  }
+  writeSealed();
+}
+
+bool AsynclogSpool::add(folly::StringPiece host, uint16_t port,
+                        folly::StringPiece pool, folly::StringPiece key) {
+  AsynclogRecord record;
+  record.timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  record.host = host;
+  record.port = port;
+  record.pool = pool;
+  record.key = key;
+
+  if (!current_) {
+    current_ = folly::make_unique<Batch>();
+  }
+  auto oldSize = current_->data.size();
+  AsynclogFormat::appendRecord(current_->data, record);
+  auto recordSize = current_->data.size() - oldSize;
+
+  if (pendingBytes_ + recordSize >
+      proxy_.opts.asynclog_batch_max_pending_bytes) {
+    current_->data.resize(oldSize);
+    stat_incr(proxy_.stats, asynclog_batch_dropped_stat, 1);
+    return false;
+  }
+  pendingBytes_ += recordSize;
+  MemoryAccounting::add(MemoryTag::kAsynclog, recordSize);
+  ++current_->records;
+
+  if (!sealCallback_.isLoopCallbackScheduled()) {
+    proxy_.eventBase->runInLoop(&sealCallback_, /* thisIteration */ true);
+  }
+  return true;
+}
+
+void AsynclogSpool::seal() {
+  if (!current_ || current_->records == 0) {
+    return;
+  }
+  if (sealed_.insertHead(current_.release())) {
+    /* The list was empty, so no write is scheduled */
+    auto res = proxy_.router->asyncWriter().run([this]() {
+      writeSealed();
+    });
+    if (!res) {
+      logFailure(proxy_.router, memcache::failure::Category::kOutOfResources,
+                 "Could not enqueue asynclog batch");
+      dropSealed();
+    }
+  }
+}
+
+void AsynclogSpool::writeSealed() {
+  std::vector<std::unique_ptr<Batch>> batches;
+  size_t records = 0;
+  size_t bytes = 0;
+  sealed_.sweep([&](Batch* batch) {
+    records += batch->records;
+    bytes += batch->data.size();
+    batches.emplace_back(batch);
+  });
+  if (batches.empty()) {
+    return;
+  }
+  SCOPE_EXIT {
+    pendingBytes_ -= bytes;
+    MemoryAccounting::sub(MemoryTag::kAsynclog, bytes);
+  };
+
+  auto fd = asynclog_open(&proxy_);
+  if (!fd) {
+    logFailure(proxy_.router, memcache::failure::Category::kSystemError,
+               "asynclog_open() failed ({} records dropped)", records);
+    stat_incr(proxy_.stats, asynclog_batch_dropped_stat, records);
+    return;
+  }
+
+  std::string header;
+  struct stat st;
+  if (fstat(fd->fd(), &st) == 0 && st.st_size == 0) {
+    AsynclogFormat::appendHeader(header, proxy_.opts.router_name);
+  }
+
+  std::vector<struct iovec> iovs;
+  iovs.reserve(batches.size() + 1);
+  if (!header.empty()) {
+    iovs.push_back({&header[0], header.size()});
+  }
+  for (auto& batch : batches) {
+    iovs.push_back({&batch->data[0], batch->data.size()});
+  }
+
+  bool success = true;
+  for (size_t i = 0; i < iovs.size() && success; i += IOV_MAX) {
+    auto count = std::min<size_t>(IOV_MAX, iovs.size() - i);
+    size_t expected = 0;
+    for (size_t j = i; j < i + count; ++j) {
+      expected += iovs[j].iov_len;
+    }
+    auto written = folly::writevFull(fd->fd(), iovs.data() + i, count);
+    success = written >= 0 && size_t(written) == expected;
+  }
+  if (success && proxy_.opts.asynclog_batch_fdatasync &&
+      ::fdatasync(fd->fd()) != 0) {
+    success = false;
+  }
+
+  if (!success) {
+    logFailure(proxy_.router, memcache::failure::Category::kSystemError,
+               "Error writing asynclog batch ({} records): {}",
+               records, strerror(errno));
+    stat_incr(proxy_.stats, asynclog_batch_dropped_stat, records);
+    return;
+  }
+  stat_incr(proxy_.stats, asynclog_requests_stat, records);
+  stat_incr(proxy_.stats, asynclog_batch_writes_stat, 1);
+}
+
+void AsynclogSpool::dropSealed() {
+  size_t records = 0;
+  size_t bytes = 0;
+  sealed_.sweep([&](Batch* batch) {
+    records += batch->records;
+    bytes += batch->data.size();
+    delete batch;
+  });
+  pendingBytes_ -= bytes;
+  MemoryAccounting::sub(MemoryTag::kAsynclog, bytes);
+  stat_incr(proxy_.stats, asynclog_batch_dropped_stat, records);
+}
+
+}}} // facebook::memcache::mcrouter
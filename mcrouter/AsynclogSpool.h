@@ -0,0 +1,97 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/fbi/cpp/AtomicLinkedList.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class proxy_t;
+
+/**
+ * Batched asynclog spooling of a proxy (see --asynclog-batch).
+ *
+ * Records are appended in the binary format (see AsynclogFormat) to a batch
+ * owned by the proxy thread, without waiting for the disk. At the end of the
+ * event loop iteration the batch is moved to a lock-free list, and the
+ * awriter thread writes all batches it finds there with one writev() and a
+ * single fdatasync().
+ *
+ * Records still in memory are lost if the process crashes, bounded by
+ * --asynclog-batch-max-pending-bytes.
+ */
+class AsynclogSpool {
+ public:
+  explicit AsynclogSpool(proxy_t& proxy);
+
+  /**
+   * Writes out the remaining records from the calling thread.
+   * The awriter must be stopped at this point.
+   */
+  ~AsynclogSpool();
+
+  /**
+   * Queues a failed delete. Must be called from the proxy thread.
+   *
+   * @return false if the record was dropped because too much data is waiting
+   *         to be written already
+   */
+  bool add(folly::StringPiece host, uint16_t port,
+           folly::StringPiece pool, folly::StringPiece key);
+
+ private:
+  struct Batch {
+    AtomicLinkedListHook<Batch> hook;
+    std::string data;
+    size_t records{0};
+  };
+
+  class SealCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit SealCallback(AsynclogSpool& spool) : spool_(spool) {}
+    void runLoopCallback() noexcept override {
+      spool_.seal();
+    }
+   private:
+    AsynclogSpool& spool_;
+  };
+
+  proxy_t& proxy_;
+  /* Proxy thread only */
+  std::unique_ptr<Batch> current_;
+  SealCallback sealCallback_;
+
+  /* Batches waiting for the awriter */
+  AtomicLinkedList<Batch, &Batch::hook> sealed_;
+  /* Bytes of all the batches not written yet, including current_ */
+  std::atomic<size_t> pendingBytes_{0};
+
+  /**
+   * Hands the current batch to the awriter.
+   */
+  void seal();
+
+  /**
+   * Writes all sealed batches to the spool file. Called on the awriter thread.
+   */
+  void writeSealed();
+
+  void dropSealed();
+};
+
+}}} // facebook::memcache::mcrouter
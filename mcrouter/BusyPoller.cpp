@@ -0,0 +1,53 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "BusyPoller.h"
+
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/stats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+BusyPoller::BusyPoller(proxy_t& proxy, std::chrono::microseconds spinTime)
+    : proxy_(proxy),
+      spinTime_(spinTime) {
+}
+
+void BusyPoller::loopOnce() {
+  auto& eventBase = *proxy_.eventBase;
+  if (spinTime_.count() == 0) {
+    mcrouterLoopOnce(&eventBase);
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + spinTime_;
+  auto fibersRun = proxy_.fiberManager.fibersRunTotal();
+  bool foundWork = false;
+  auto now = start;
+  do {
+    eventBase.loopOnce(EVLOOP_NONBLOCK);
+    now = std::chrono::steady_clock::now();
+    foundWork = proxy_.fiberManager.fibersRunTotal() != fibersRun;
+  } while (!foundWork && now < deadline);
+
+  stat_incr(proxy_.stats, busy_poll_spin_time_us_stat,
+            std::chrono::duration_cast<std::chrono::microseconds>(
+              now - start).count());
+  if (foundWork) {
+    stat_incr(proxy_.stats, busy_poll_wakeups_avoided_stat, 1);
+    return;
+  }
+  mcrouterLoopOnce(&eventBase);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class proxy_t;
+
+/**
+ * Runs event loop iterations of a proxy, polling the loop without blocking
+ * for up to spinTime before going to sleep in epoll (see --busy-poll-us).
+ *
+ * Work is detected through the proxy's fiber manager: incoming requests
+ * (from the request queue or client sockets) and replies from destinations
+ * all run or resume fibers. If work shows up while spinning, the wakeup
+ * is counted as avoided.
+ */
+class BusyPoller {
+ public:
+  /**
+   * @param spinTime  0 disables spinning, loopOnce() then just blocks.
+   */
+  BusyPoller(proxy_t& proxy, std::chrono::microseconds spinTime);
+
+  /**
+   * Runs event loop iterations until some work is done, or a single
+   * blocking iteration once spinTime has passed without any.
+   */
+  void loopOnce();
+
+ private:
+  proxy_t& proxy_;
+  const std::chrono::microseconds spinTime_;
+};
+
+}}}  // facebook::memcache::mcrouter
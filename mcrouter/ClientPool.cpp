@@ -16,8 +16,9 @@
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
-ClientPool::ClientPool(std::string name)
-  : name_(std::move(name)) {
+ClientPool::ClientPool(std::string name, PoolSettings settings)
+  : name_(std::move(name)),
+    settings_(std::move(settings)) {
 }
 
 void ClientPool::setWeights(folly::dynamic weights) {
@@ -26,12 +26,13 @@ namespace facebook { namespace memcache { namespace mcrouter {
  */
 class ClientPool {
  public:
-  explicit ClientPool(std::string name);
+  ClientPool(std::string name, PoolSettings settings);
 
   /**
    * Creates and adds new client to list of clients
    *
-   * @param args  Arguments for ProxyClientCommon constructor
+   * @param args  Arguments for ProxyClientCommon constructor: access point,
+   *              use ssl, qos
    *
    * @return  Created client
    */
@@ -47,6 +48,10 @@ class ClientPool {
     return name_;
   }
 
+  const PoolSettings& getSettings() const {
+    return settings_;
+  }
+
   const std::vector<std::shared_ptr<ProxyClientCommon>>& getClients() const {
     return clients_;
   }
@@ -58,6 +63,7 @@ class ClientPool {
   std::vector<std::shared_ptr<ProxyClientCommon>> clients_;
   std::unique_ptr<folly::dynamic> weights_;
   std::string name_;
+  PoolSettings settings_;
 };
 
 }}}  // facebook::memcache::mcrouter
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ClientTracker.h"
+
+#include "mcrouter/lib/network/AsyncMcServerWorker.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t ClientTracker::kTopTalkersCapacity;
+
+ClientTracker::ClientTracker(size_t sampleRate)
+    : sampleRate_(sampleRate),
+      countdown_(sampleRate),
+      talkers_(kTopTalkersCapacity) {
+}
+
+void ClientTracker::addSample(const McServerSession& session) {
+  const auto& address = session.peerAddress();
+  auto host = address.empty() ? std::string("(unknown)")
+                              : address.getAddressStr();
+  std::lock_guard<std::mutex> lock(lock_);
+  talkers_.add(host);
+}
+
+void ClientTracker::updateConnections(const AsyncMcServerWorker& worker) {
+  std::vector<Connection> connections;
+  connections.reserve(worker.sessions().size());
+  for (const auto& session : worker.sessions()) {
+    const auto& address = session.peerAddress();
+    connections.push_back(Connection{
+      address.empty() ? std::string("(unknown)") : address.describe(),
+      session.stats()});
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  connections_ = std::move(connections);
+}
+
+std::vector<ClientTracker::Connection> ClientTracker::connections() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return connections_;
+}
+
+std::vector<SpaceSaving::Item> ClientTracker::topTalkers(size_t n) const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return talkers_.top(n);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mcrouter/HotKeyTracker.h"
+#include "mcrouter/lib/network/McServerSession.h"
+
+namespace facebook { namespace memcache {
+
+class AsyncMcServerWorker;
+
+namespace mcrouter {
+
+/**
+ * Client connections of one standalone server thread: a snapshot of
+ * the per-connection stats, refreshed by the server loop, and sampled
+ * heavy hitters over client hosts (see --top-talkers-sample-rate),
+ * which also remember clients that disconnected.
+ *
+ * Only the server thread updates the tracker; everything is guarded
+ * by a mutex so that ServiceInfo on any proxy can merge all of them.
+ */
+class ClientTracker {
+ public:
+  static constexpr size_t kTopTalkersCapacity = 64;
+
+  struct Connection {
+    /* host:port */
+    std::string peer;
+    McServerSession::Stats stats;
+  };
+
+  /**
+   * @param sampleRate  one of every sampleRate requests is attributed
+   *                    to its client host, 0 disables top talkers
+   */
+  explicit ClientTracker(size_t sampleRate);
+
+  void onRequest(const McServerSession& session) {
+    if (sampleRate_ == 0 || --countdown_ > 0) {
+      return;
+    }
+    countdown_ = sampleRate_;
+    addSample(session);
+  }
+
+  /**
+   * Replaces the snapshot with the sessions of worker.
+   * Must be called on the worker's thread.
+   */
+  void updateConnections(const AsyncMcServerWorker& worker);
+
+  std::vector<Connection> connections() const;
+
+  std::vector<SpaceSaving::Item> topTalkers(size_t n) const;
+
+  size_t sampleRate() const {
+    return sampleRate_;
+  }
+
+ private:
+  const size_t sampleRate_;
+  size_t countdown_;
+
+  mutable std::mutex lock_;
+  std::vector<Connection> connections_;
+  SpaceSaving talkers_;
+
+  void addSample(const McServerSession& session);
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -13,6 +13,8 @@
 
 #include <folly/dynamic.h>
 #include <folly/FileUtil.h>
+#include <folly/io/Compression.h>
+#include <folly/io/IOBuf.h>
 #include <folly/Memory.h>
 
 #include "mcrouter/config.h"
@@ -158,12 +160,48 @@ bool ConfigApi::FileInfo::checkMd5Changed() {
   return md5 != previousHash;
 }
 
+size_t ConfigApi::compressConfigStr(folly::StringPiece config) {
+  configStrSize_ = config.size();
+  configStrMd5_ = Md5Hash(config);
+  auto buf = folly::IOBuf::copyBuffer(config.data(), config.size());
+  try {
+    configStr_ = folly::io::getCodec(folly::io::CodecType::ZSTD)
+      ->compress(buf.get());
+    configStrCompressed_ = true;
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "Can not compress --config-str, keeping it as is: "
+                 << e.what();
+    configStr_ = std::move(buf);
+    configStrCompressed_ = false;
+  }
+  return configStr_->computeChainDataLength();
+}
+
+bool ConfigApi::hasConfigStr() const {
+  return !opts_.config_str.empty() || configStr_ != nullptr;
+}
+
 bool ConfigApi::getConfigFile(std::string& contents) {
   if (!opts_.config_str.empty()) {
     // explicit config, no automatic reload
     contents = opts_.config_str;
     return true;
   }
+  if (configStr_) {
+    std::unique_ptr<folly::IOBuf> config;
+    try {
+      config = configStrCompressed_
+        ? folly::io::getCodec(folly::io::CodecType::ZSTD)
+            ->uncompress(configStr_.get(), configStrSize_)
+        : configStr_->clone();
+    } catch (const std::exception& e) {
+      logFailure(memcache::failure::Category::kOther,
+                 "Can not uncompress --config-str: {}", e.what());
+      return false;
+    }
+    contents = config->moveToFbString().toStdString();
+    return true;
+  }
   if (!opts_.config_file.empty()) {
     return get(ConfigType::ConfigFile, opts_.config_file, contents);
   }
@@ -258,6 +296,8 @@ folly::dynamic ConfigApi::getConfigSourcesInfo() {
   // we have config_str, write its hash
   if (!opts_.config_str.empty()) {
     reply_val[kMcrouterConfigKey] = Md5Hash(opts_.config_str);
+  } else if (configStr_) {
+    reply_val[kMcrouterConfigKey] = configStrMd5_;
   }
 
   std::lock_guard<std::mutex> lock(fileInfoMutex_);
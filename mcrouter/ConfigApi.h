@@ -12,6 +12,7 @@
 #include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -19,8 +20,11 @@
 
 #include "mcrouter/CallbackPool.h"
 
+#include <folly/Range.h>
+
 namespace folly {
 class dynamic;
+class IOBuf;
 }
 
 namespace facebook { namespace memcache {
@@ -91,6 +95,21 @@ class ConfigApi {
    */
   virtual bool getConfigFile(std::string& config);
 
+  /**
+   * Takes over --config-str, which the options this ConfigApi was created
+   * with no longer have (see --compress-config-str). Keeps a single zstd
+   * compressed copy, uncompressed by every getConfigFile().
+   *
+   * @return bytes taken by the copy (the whole config if zstd is
+   *         not available)
+   */
+  size_t compressConfigStr(folly::StringPiece config);
+
+  /**
+   * @return true if the config is a string (--config-str) rather than a file
+   */
+  bool hasConfigStr() const;
+
   /**
    * @return dynamic object with information about files used in configuration.
    */
@@ -146,6 +165,12 @@ class ConfigApi {
 
   bool isFirstConfig_{true};
 
+  /// set by compressConfigStr()
+  std::unique_ptr<folly::IOBuf> configStr_;
+  bool configStrCompressed_{false};
+  size_t configStrSize_{0};
+  std::string configStrMd5_;
+
   void configThreadRun();
 };
 
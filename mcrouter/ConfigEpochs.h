@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * RCU-style handle to the config of a single thread.
+ *
+ * Every config set with update() starts a new epoch. Requests pin the
+ * current epoch and hold a plain pointer to its config. A config is
+ * released once it's no longer current and all requests pinned to it
+ * and to older epochs are unpinned.
+ *
+ * Not thread-safe: all calls must come from the owning thread, so pinning
+ * is a plain counter increment instead of an atomic refcount.
+ */
+template <class T>
+class ConfigEpochs {
+ public:
+  /**
+   * Makes config current. Requests pinned from now on will see it.
+   */
+  void update(std::shared_ptr<const T> config) {
+    epochs_.emplace_back(nextEpoch_++, std::move(config));
+    reclaim();
+  }
+
+  /**
+   * Pins the current epoch.
+   *
+   * @param config  set to the current config, valid until unpin(epoch)
+   * @return epoch to pass to unpin()
+   */
+  uint64_t pin(const T*& config) {
+    assert(!epochs_.empty());
+    auto& cur = epochs_.back();
+    ++cur.pinned;
+    config = cur.config.get();
+    return cur.epoch;
+  }
+
+  void unpin(uint64_t epoch) {
+    assert(!epochs_.empty() && epoch >= epochs_.front().epoch);
+    auto& e = epochs_[epoch - epochs_.front().epoch];
+    assert(e.pinned > 0);
+    --e.pinned;
+    reclaim();
+  }
+
+  const T* current() const {
+    return epochs_.empty() ? nullptr : epochs_.back().config.get();
+  }
+
+  /**
+   * Number of configs still alive, including the current one
+   */
+  size_t numEpochs() const {
+    return epochs_.size();
+  }
+
+ private:
+  struct Epoch {
+    Epoch(uint64_t e, std::shared_ptr<const T> c)
+        : epoch(e),
+          config(std::move(c)) {
+    }
+
+    uint64_t epoch;
+    std::shared_ptr<const T> config;
+    size_t pinned{0};
+  };
+
+  /* Epochs are contiguous so that unpin() can index into the deque */
+  std::deque<Epoch> epochs_;
+  uint64_t nextEpoch_{0};
+
+  void reclaim() {
+    while (epochs_.size() > 1 && epochs_.front().pinned == 0) {
+      epochs_.pop_front();
+    }
+  }
+};
+
+}}}  // facebook::memcache::mcrouter
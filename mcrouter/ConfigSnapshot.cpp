@@ -0,0 +1,298 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ConfigSnapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <glog/logging.h>
+
+#include <folly/FileUtil.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/options.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+const char kMagic[] = "MCRSNAP1";
+const size_t kMagicSize = sizeof(kMagic) - 1;
+
+enum Tag : uint8_t {
+  kNull = 0,
+  kFalse = 1,
+  kTrue = 2,
+  kInt = 3,
+  kDouble = 4,
+  kString = 5,
+  kArray = 6,
+  kObject = 7,
+};
+
+void writeVarint(uint64_t value, std::string& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+uint64_t readVarint(folly::StringPiece& data) {
+  uint64_t value = 0;
+  for (size_t shift = 0; shift < 64; shift += 7) {
+    if (data.empty()) {
+      throw std::runtime_error("Config snapshot: truncated varint");
+    }
+    auto byte = static_cast<uint8_t>(data[0]);
+    data.advance(1);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  throw std::runtime_error("Config snapshot: invalid varint");
+}
+
+void writeString(folly::StringPiece str, std::string& out) {
+  writeVarint(str.size(), out);
+  out.append(str.data(), str.size());
+}
+
+folly::StringPiece readString(folly::StringPiece& data) {
+  auto size = readVarint(data);
+  if (size > data.size()) {
+    throw std::runtime_error("Config snapshot: truncated string");
+  }
+  auto str = data.subpiece(0, size);
+  data.advance(size);
+  return str;
+}
+
+void serializeTo(const folly::dynamic& json, std::string& out) {
+  switch (json.type()) {
+    case folly::dynamic::NULLT:
+      out.push_back(kNull);
+      break;
+    case folly::dynamic::BOOL:
+      out.push_back(json.getBool() ? kTrue : kFalse);
+      break;
+    case folly::dynamic::INT64: {
+      auto value = json.getInt();
+      out.push_back(kInt);
+      // zigzag, so small negative numbers are short too
+      writeVarint((static_cast<uint64_t>(value) << 1) ^
+                  static_cast<uint64_t>(value >> 63), out);
+      break;
+    }
+    case folly::dynamic::DOUBLE: {
+      // snapshots are read on the host that wrote them, no byte swapping
+      double value = json.asDouble();
+      out.push_back(kDouble);
+      out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+      break;
+    }
+    case folly::dynamic::STRING:
+      out.push_back(kString);
+      writeString(json.stringPiece(), out);
+      break;
+    case folly::dynamic::ARRAY:
+      out.push_back(kArray);
+      writeVarint(json.size(), out);
+      for (const auto& it : json) {
+        serializeTo(it, out);
+      }
+      break;
+    case folly::dynamic::OBJECT:
+      out.push_back(kObject);
+      writeVarint(json.size(), out);
+      for (const auto& it : json.items()) {
+        serializeTo(it.first, out);
+        serializeTo(it.second, out);
+      }
+      break;
+  }
+}
+
+}  // anonymous namespace
+
+std::string ConfigSnapshot::RecordingImportResolver::import(
+    folly::StringPiece path) {
+  auto contents = resolver_.import(path);
+  imports_.emplace_back(path.str(), contents);
+  return contents;
+}
+
+ConfigSnapshot::ConfigSnapshot(
+    std::string path,
+    folly::StringPiece jsonC,
+    const std::unordered_map<std::string, folly::dynamic>& globalParams)
+    : path_(std::move(path)) {
+
+  std::vector<std::pair<std::string, const folly::dynamic*>> globals;
+  for (const auto& it : globalParams) {
+    globals.emplace_back(it.first, &it.second);
+  }
+  std::sort(globals.begin(), globals.end());
+
+  std::string inputs;
+  writeString(jsonC, inputs);
+  writeVarint(globals.size(), inputs);
+  for (const auto& it : globals) {
+    writeString(it.first, inputs);
+    serializeTo(*it.second, inputs);
+  }
+  baseHash_ = Md5Hash(inputs);
+}
+
+std::string ConfigSnapshot::filePath(const McrouterOptions& opts) {
+  if (opts.config_snapshot_dir.empty()) {
+    return "";
+  }
+  boost::filesystem::path path(opts.config_snapshot_dir);
+  path /= "libmcrouter." + opts.service_name + "." + opts.router_name +
+    ".config_snapshot";
+  return path.string();
+}
+
+std::string ConfigSnapshot::inputsHash(const Imports& imports) const {
+  std::string inputs = baseHash_;
+  for (const auto& it : imports) {
+    writeString(it.first, inputs);
+    writeString(it.second, inputs);
+  }
+  return Md5Hash(inputs);
+}
+
+folly::Optional<folly::dynamic>
+ConfigSnapshot::load(ImportResolverIf& importResolver) const {
+  std::string contents;
+  if (!folly::readFile(path_.c_str(), contents)) {
+    return folly::none;
+  }
+
+  try {
+    folly::StringPiece data(contents);
+    if (!data.startsWith(folly::StringPiece(kMagic, kMagicSize))) {
+      throw std::runtime_error("Config snapshot: invalid header");
+    }
+    data.advance(kMagicSize);
+    auto hash = readString(data);
+
+    /* Imports are cheap compared to parsing and preprocessing, and
+       ConfigApi needs them to track imported files for reconfiguration. */
+    Imports imports;
+    auto nImports = readVarint(data);
+    for (uint64_t i = 0; i < nImports; ++i) {
+      auto path = readString(data).str();
+      auto importContents = importResolver.import(path);
+      imports.emplace_back(std::move(path), std::move(importContents));
+    }
+    if (hash != inputsHash(imports)) {
+      VLOG(1) << "Config snapshot " << path_ << " is outdated";
+      return folly::none;
+    }
+
+    auto config = deserialize(data);
+    if (!data.empty() || !config.isObject()) {
+      throw std::runtime_error("Config snapshot: unexpected data");
+    }
+    return std::move(config);
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "Can not load config snapshot " << path_ << ": "
+                 << e.what();
+    return folly::none;
+  }
+}
+
+bool ConfigSnapshot::save(const folly::dynamic& config,
+                          const Imports& imports) const {
+  std::string out(kMagic, kMagicSize);
+  writeString(inputsHash(imports), out);
+  writeVarint(imports.size(), out);
+  for (const auto& it : imports) {
+    writeString(it.first, out);
+  }
+  serializeTo(config, out);
+
+  try {
+    boost::filesystem::create_directories(
+      boost::filesystem::path(path_).parent_path());
+  } catch (const std::exception& e) {
+    LOG(WARNING) << "Can not create directory for config snapshot " << path_
+                 << ": " << e.what();
+    return false;
+  }
+  if (!atomicallyWriteFileToDisk(out, path_)) {
+    LOG(WARNING) << "Can not write config snapshot " << path_;
+    return false;
+  }
+  return true;
+}
+
+std::string ConfigSnapshot::serialize(const folly::dynamic& json) {
+  std::string out;
+  serializeTo(json, out);
+  return out;
+}
+
+folly::dynamic ConfigSnapshot::deserialize(folly::StringPiece& data) {
+  if (data.empty()) {
+    throw std::runtime_error("Config snapshot: truncated value");
+  }
+  auto tag = static_cast<uint8_t>(data[0]);
+  data.advance(1);
+  switch (tag) {
+    case kNull:
+      return nullptr;
+    case kFalse:
+      return false;
+    case kTrue:
+      return true;
+    case kInt: {
+      auto value = readVarint(data);
+      return static_cast<int64_t>((value >> 1) ^ -(value & 1));
+    }
+    case kDouble: {
+      double value;
+      if (data.size() < sizeof(value)) {
+        throw std::runtime_error("Config snapshot: truncated double");
+      }
+      std::memcpy(&value, data.data(), sizeof(value));
+      data.advance(sizeof(value));
+      return value;
+    }
+    case kString:
+      return readString(data).str();
+    case kArray: {
+      auto size = readVarint(data);
+      folly::dynamic result = {};
+      for (uint64_t i = 0; i < size; ++i) {
+        result.push_back(deserialize(data));
+      }
+      return result;
+    }
+    case kObject: {
+      auto size = readVarint(data);
+      folly::dynamic result = folly::dynamic::object();
+      for (uint64_t i = 0; i < size; ++i) {
+        auto key = deserialize(data);
+        result.insert(std::move(key), deserialize(data));
+      }
+      return result;
+    }
+    default:
+      throw std::runtime_error("Config snapshot: unknown type tag");
+  }
+}
+
+}}} // facebook::memcache::mcrouter
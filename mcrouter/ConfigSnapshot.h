@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/Optional.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/config/ImportResolverIf.h"
+
+namespace facebook { namespace memcache {
+
+class McrouterOptions;
+
+namespace mcrouter {
+
+/**
+ * Binary snapshot of the preprocessed config on disk, so that restarts with
+ * unchanged config skip JSON parsing and macro expansion.
+ *
+ * The snapshot stores a hash of all the preprocessor inputs: config text,
+ * global params and contents of all imported files. The paths of imported
+ * files are stored as well, on load they are imported again and the snapshot
+ * is used only if the hash matches.
+ */
+class ConfigSnapshot {
+ public:
+  /// (path, contents) of imported files, in order they were imported
+  typedef std::vector<std::pair<std::string, std::string>> Imports;
+
+  /**
+   * Forwards imports to another resolver and records them.
+   */
+  class RecordingImportResolver : public ImportResolverIf {
+   public:
+    explicit RecordingImportResolver(ImportResolverIf& resolver)
+        : resolver_(resolver) {
+    }
+
+    std::string import(folly::StringPiece path) override;
+
+    const Imports& imports() const {
+      return imports_;
+    }
+
+   private:
+    ImportResolverIf& resolver_;
+    Imports imports_;
+  };
+
+  /**
+   * @param path snapshot file
+   * @param jsonC config text
+   * @param globalParams global params of the preprocessor
+   */
+  ConfigSnapshot(std::string path,
+                 folly::StringPiece jsonC,
+                 const std::unordered_map<std::string, folly::dynamic>&
+                   globalParams);
+
+  /**
+   * @return snapshot file of the router, empty string if snapshots are
+   *         disabled.
+   */
+  static std::string filePath(const McrouterOptions& opts);
+
+  /**
+   * @return preprocessed config from the snapshot, none if there's no
+   *         snapshot, it's corrupted, or inputs have changed.
+   */
+  folly::Optional<folly::dynamic> load(ImportResolverIf& importResolver) const;
+
+  /**
+   * Atomically replaces the snapshot file.
+   *
+   * @param imports imports made while preprocessing config
+   * @return true on success
+   */
+  bool save(const folly::dynamic& config, const Imports& imports) const;
+
+  /**
+   * Compact binary encoding of JSON value.
+   */
+  static std::string serialize(const folly::dynamic& json);
+
+  /**
+   * Decodes value encoded with serialize() from the beginning of data,
+   * data is advanced past it.
+   *
+   * @throws std::runtime_error if data is malformed
+   */
+  static folly::dynamic deserialize(folly::StringPiece& data);
+
+ private:
+  const std::string path_;
+  /// hash of config and global params
+  std::string baseHash_;
+
+  std::string inputsHash(const Imports& imports) const;
+};
+
+}}} // facebook::memcache::mcrouter
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ConfigValidator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
+
+#include "mcrouter/ConfigApi.h"
+#include "mcrouter/lib/MemoryAccounting.h"
+#include "mcrouter/mcrouter_config.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyConfig.h"
+#include "mcrouter/ProxyConfigBuilder.h"
+#include "mcrouter/ProxyDestinationMap.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+ConfigValidationResult validateConfig(std::string name,
+                                      const McrouterOptions& opts) {
+  ConfigValidationResult result;
+  result.name = std::move(name);
+
+  auto proxyOpts = opts;
+  proxyOpts.num_proxies = 1;
+  /* destinations are never created, don't attach to the shared registry */
+  proxyOpts.share_destinations_across_instances = false;
+  /* always preprocess, a snapshot would hide errors in macros and imports */
+  proxyOpts.config_snapshot_dir = "";
+
+  auto start = std::chrono::steady_clock::now();
+  auto allocatedBefore = MemoryAccounting::threadAllocatedBytes();
+  try {
+    auto configApi = createConfigApi(proxyOpts);
+    std::string config;
+    if (!configApi->getConfigFile(config)) {
+      result.error = "Can not read config file";
+      return result;
+    }
+
+    proxy_t proxy(nullptr, nullptr, proxyOpts);
+    proxy.destinationMap->disableDestinations();
+    ProxyConfigBuilder builder(proxyOpts, configApi.get(), config);
+    auto proxyConfig = builder.buildConfig(&proxy);
+
+    result.memoryBytes =
+      MemoryAccounting::threadAllocatedBytes() - allocatedBefore;
+    result.valid = true;
+  } catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  result.buildTime = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - start);
+  return result;
+}
+
+std::vector<ConfigValidationResult> validateConfigs(
+    const std::vector<std::pair<std::string, McrouterOptions>>& flavors,
+    size_t maxThreads) {
+  std::vector<ConfigValidationResult> results(flavors.size());
+  std::atomic<size_t> next{0};
+  auto worker = [&flavors, &results, &next]() {
+    size_t i;
+    while ((i = next.fetch_add(1)) < flavors.size()) {
+      results[i] = validateConfig(flavors[i].first, flavors[i].second);
+    }
+  };
+
+  auto nthreads = std::min(std::max<size_t>(maxThreads, 1), flavors.size());
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < nthreads; ++t) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return results;
+}
+
+}}}  // facebook::memcache::mcrouter
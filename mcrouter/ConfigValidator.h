@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mcrouter/options.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+struct ConfigValidationResult {
+  /* Flavor (or config file) the config came from */
+  std::string name;
+  bool valid{false};
+  /* Why the config is invalid */
+  std::string error;
+  /* Preprocessing and building route handles */
+  std::chrono::microseconds buildTime{0};
+  /* Allocated while building, 0 without jemalloc */
+  int64_t memoryBytes{0};
+};
+
+/**
+ * Checks that the config of opts can be loaded, without starting a router:
+ * the config is preprocessed and its route handles are built once, for a
+ * single proxy with no event base, and no destinations (hence no sockets)
+ * are created for its pools.
+ *
+ * Failures logged while building (see McrouterLogFailure.h) only make the
+ * config invalid if a failure handler throws, like --validate-config's.
+ */
+ConfigValidationResult validateConfig(std::string name,
+                                      const McrouterOptions& opts);
+
+/**
+ * validateConfig() for every flavor, on up to maxThreads threads at once,
+ * each flavor on a single thread.
+ *
+ * @return  results in the order of flavors
+ */
+std::vector<ConfigValidationResult> validateConfigs(
+  const std::vector<std::pair<std::string, McrouterOptions>>& flavors,
+  size_t maxThreads);
+
+}}}  // facebook::memcache::mcrouter
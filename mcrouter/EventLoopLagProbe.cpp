@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "EventLoopLagProbe.h"
+
+#include <algorithm>
+
+#include "mcrouter/config.h"
+#include "mcrouter/LatencyHistogram.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+EventLoopLagProbe::EventLoopLagProbe(folly::EventBase& eventBase,
+                                     std::chrono::milliseconds interval,
+                                     LatencyHistogram& lagUs,
+                                     std::atomic<uint64_t>* lastLagUs)
+    : folly::AsyncTimeout(&eventBase),
+      interval_(interval),
+      lagUs_(lagUs),
+      lastLagUs_(lastLagUs),
+      destructionCallback_(*this) {
+  eventBase.runOnDestruction(&destructionCallback_);
+  schedule();
+}
+
+void EventLoopLagProbe::schedule() {
+  deadlineUs_ = nowUs() + interval_.count() * 1000;
+  scheduleTimeout(interval_.count());
+}
+
+void EventLoopLagProbe::timeoutExpired() noexcept {
+  auto lag = std::max<int64_t>(nowUs() - deadlineUs_, 0);
+  lagUs_.insertSample(lag);
+  if (lastLagUs_) {
+    lastLagUs_->store(lag, std::memory_order_relaxed);
+  }
+  schedule();
+}
+
+void EventLoopLagProbe::DestructionCallback::runLoopCallback() noexcept {
+  probe_.cancelTimeout();
+  probe_.detachEventBase();
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,64 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class LatencyHistogram;
+
+/**
+ * Measures event loop lag: a timer is scheduled every interval and the
+ * time between its deadline and when it actually runs is recorded.
+ * A thread busy with long callbacks or fiber loops is late on the timer
+ * by as much as it's late reading new requests and replies.
+ *
+ * Timers have millisecond granularity, so lag below ~1ms is noise.
+ * The probe may outlive the event base, it stops when the event base is
+ * destroyed.
+ */
+class EventLoopLagProbe : private folly::AsyncTimeout {
+ public:
+  /**
+   * @param lagUs      receives one sample per interval, must outlive the probe
+   * @param lastLagUs  if not null, set to the latest sample (for readers on
+   *                   other threads), must outlive the probe
+   */
+  EventLoopLagProbe(folly::EventBase& eventBase,
+                    std::chrono::milliseconds interval,
+                    LatencyHistogram& lagUs,
+                    std::atomic<uint64_t>* lastLagUs = nullptr);
+
+ private:
+  class DestructionCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit DestructionCallback(EventLoopLagProbe& probe) : probe_(probe) {}
+    void runLoopCallback() noexcept override;
+   private:
+    EventLoopLagProbe& probe_;
+  };
+
+  const std::chrono::milliseconds interval_;
+  LatencyHistogram& lagUs_;
+  std::atomic<uint64_t>* lastLagUs_;
+  int64_t deadlineUs_{0};
+  DestructionCallback destructionCallback_;
+
+  void schedule();
+  void timeoutExpired() noexcept override;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -9,11 +9,13 @@
  */
 #include "FileObserver.h"
 
+#include <chrono>
 #include <memory>
+#include <stdexcept>
 
 #include <glog/logging.h>
 
-#include "mcrouter/FileDataProvider.h"
+#include "mcrouter/InotifyWatcher.h"
 #include "mcrouter/PeriodicTaskScheduler.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -28,16 +30,23 @@ static void checkAndExecuteFallbackOnError(
 
 bool FileObserver::startObserving(const std::string& filePath,
                                   PeriodicTaskScheduler& taskScheduler,
-                                  uint32_t pollPeriodMs,
                                   uint32_t sleepBeforeUpdateMs,
                                   std::function<void(std::string)> onUpdate,
                                   std::function<void()> fallbackOnError) {
 
-  std::shared_ptr<FileDataProvider> provider;
+  auto watcher = InotifyWatcher::get();
+  uint64_t id;
   try {
-    provider = std::make_shared<FileDataProvider>(filePath);
-
-    onUpdate(provider->load());
+    if (!watcher) {
+      throw std::runtime_error("InotifyWatcher is not available");
+    }
+    id = watcher->watch(
+      filePath,
+      std::chrono::milliseconds(sleepBeforeUpdateMs),
+      std::move(onUpdate),
+      [fallbackOnError]() {
+        checkAndExecuteFallbackOnError(fallbackOnError);
+      });
   } catch (const std::exception& e) {
     VLOG(0) << "Can not start watching " << filePath <<
                " for modifications: " << e.what();
@@ -46,23 +55,9 @@ bool FileObserver::startObserving(const std::string& filePath,
   }
 
   VLOG(0) << "Watching " << filePath << " for modifications.";
-  taskScheduler.scheduleTask(
-    /* tmo_ms = */ pollPeriodMs,
-    [onUpdate, fallbackOnError, sleepBeforeUpdateMs, provider]
-    (PeriodicTaskScheduler& scheduler) {
-      try {
-        if (!provider->hasUpdate()) {
-          return;
-        }
-
-        scheduler.sleepThread(sleepBeforeUpdateMs);
-        onUpdate(provider->load());
-      } catch (...) {
-        checkAndExecuteFallbackOnError(fallbackOnError);
-        throw;
-      }
-    }
-  );
+  taskScheduler.onShutdown([watcher, id]() {
+    watcher->unwatch(id);
+  });
   return true;
 }
 
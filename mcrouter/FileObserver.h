@@ -20,21 +20,21 @@ class PeriodicTaskScheduler;
 class FileObserver {
  public:
   /**
-   * Starts a periodic thread that watches the given file path for changes.
+   * Watches the given file path for changes with the process-wide
+   * InotifyWatcher. The watch is stopped by taskScheduler.shutdownAllTasks().
    *
    * @param filePath path to the file to watch (can be a symlink)
-   * @param pollPeriodMs how much to wait between asking inotify if
-   *        any updates happened
-   * @param sleepAfterUpdateMs how much to wait before calling onUpdate
-   *        once an inotify event happens (as a crude protection against
-   *        partial writes race condition).
-   * @param onUpdate callback function to call when there is a update seen
+   * @param sleepBeforeUpdateMs how long the file must stay unchanged after
+   *        an inotify event before onUpdate is called (as a crude protection
+   *        against partial writes race condition). Bursts of events within
+   *        this time result in a single update.
+   * @param onUpdate callback function to call when there is a update seen,
+   *        not called if the file was rewritten with the same contents
    * @param fallbackOnError function to call if inotify calls fails
    * @return true on success, false on failure
    */
   static bool startObserving(const std::string& filePath,
                              PeriodicTaskScheduler& taskScheduler,
-                             uint32_t pollPeriodMs,
                              uint32_t sleepBeforeUpdateMs,
                              std::function<void(std::string)> onUpdate,
                              std::function<void()> fallbackOnError = nullptr);
@@ -0,0 +1,123 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HotKeyTracker.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/ProxyRequestContext.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr uint64_t SpaceSaving::kDecaySamples;
+
+SpaceSaving::SpaceSaving(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {
+}
+
+void SpaceSaving::add(folly::StringPiece key) {
+  ++total_;
+  auto it = counters_.find(key);
+  if (it != counters_.end()) {
+    ++it->second.count;
+  } else if (counters_.size() < capacity_) {
+    counters_.emplace(key, Counter{1, 0});
+  } else {
+    /* capacity_ is small and we only see sampled requests, so a linear
+       scan for the minimum is cheaper than maintaining an ordered index */
+    auto min = counters_.begin();
+    for (auto cur = counters_.begin(); cur != counters_.end(); ++cur) {
+      if (cur->second.count < min->second.count) {
+        min = cur;
+      }
+    }
+    auto count = min->second.count;
+    counters_.erase(min);
+    counters_.emplace(key, Counter{count + 1, count});
+  }
+
+  if (++sinceDecay_ >= kDecaySamples) {
+    decay();
+  }
+}
+
+void SpaceSaving::decay() {
+  sinceDecay_ = 0;
+  total_ /= 2;
+  for (auto it = counters_.begin(); it != counters_.end(); ) {
+    it->second.count /= 2;
+    it->second.error /= 2;
+    if (it->second.count == 0) {
+      it = counters_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+uint64_t SpaceSaving::estimate(folly::StringPiece key) const {
+  auto it = counters_.find(key);
+  return it == counters_.end() ? 0 : it->second.count;
+}
+
+std::vector<SpaceSaving::Item> SpaceSaving::top(size_t n) const {
+  std::vector<Item> items;
+  items.reserve(counters_.size());
+  for (const auto& it : counters_) {
+    items.push_back(Item{it.first.str(), it.second.count, it.second.error});
+  }
+  n = std::min(n, items.size());
+  std::partial_sort(items.begin(), items.begin() + n, items.end(),
+                    [](const Item& a, const Item& b) {
+                      return a.count > b.count;
+                    });
+  items.resize(n);
+  return items;
+}
+
+HotKeyTracker::HotKeyTracker(size_t sampleRate, size_t capacity)
+    : sampleRate_(std::max<size_t>(sampleRate, 1)),
+      countdown_(sampleRate_),
+      keys_(capacity),
+      prefixes_(capacity) {
+}
+
+void HotKeyTracker::addSample(folly::StringPiece keyWithoutRoute,
+                              folly::StringPiece routingPrefix) {
+  std::lock_guard<std::mutex> lock(lock_);
+  keys_.add(keyWithoutRoute);
+  prefixes_.add(routingPrefix);
+}
+
+bool HotKeyTracker::isHot(folly::StringPiece keyWithoutRoute,
+                          double minShare) const {
+  /* The summaries only change on this thread */
+  auto total = keys_.total();
+  return total > 0 && keys_.estimate(keyWithoutRoute) >= minShare * total;
+}
+
+std::vector<SpaceSaving::Item> HotKeyTracker::topKeys(size_t n) const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return keys_.top(n);
+}
+
+std::vector<SpaceSaving::Item> HotKeyTracker::topPrefixes(size_t n) const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return prefixes_.top(n);
+}
+
+bool isHotKey(const ProxyMcRequest& req, double minShare) {
+  auto& tracker = req.context().proxy().hotKeys;
+  return !tracker || tracker->isHot(req.keyWithoutRoute(), minShare);
+}
+
+}}}  // facebook::memcache::mcrouter
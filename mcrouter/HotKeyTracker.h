@@ -0,0 +1,137 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <folly/experimental/StringKeyedUnorderedMap.h>
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class ProxyMcRequest;
+
+/**
+ * Space-Saving heavy hitter summary: keeps at most `capacity` counters,
+ * a key that isn't tracked replaces the one with the smallest count
+ * (and inherits it as its error). Any key with a true share of the
+ * samples above 1 / capacity is guaranteed to be tracked.
+ *
+ * Counts are halved every kDecaySamples samples, so that keys which
+ * stopped being hot eventually go away.
+ */
+class SpaceSaving {
+ public:
+  static constexpr uint64_t kDecaySamples = 1 << 16;
+
+  struct Item {
+    std::string key;
+    /* Overestimate of the number of samples of key */
+    uint64_t count;
+    /* count - error is an underestimate */
+    uint64_t error;
+  };
+
+  explicit SpaceSaving(size_t capacity);
+
+  void add(folly::StringPiece key);
+
+  /**
+   * @return estimated number of samples of key, 0 if it's not tracked
+   */
+  uint64_t estimate(folly::StringPiece key) const;
+
+  /**
+   * Number of samples since the last decay (halved on decay too)
+   */
+  uint64_t total() const {
+    return total_;
+  }
+
+  /**
+   * @return up to n tracked keys, most frequent first
+   */
+  std::vector<Item> top(size_t n) const;
+
+ private:
+  struct Counter {
+    uint64_t count;
+    uint64_t error;
+  };
+
+  const size_t capacity_;
+  folly::StringKeyedUnorderedMap<Counter> counters_;
+  uint64_t total_{0};
+  uint64_t sinceDecay_{0};
+
+  void decay();
+};
+
+/**
+ * Sampled heavy hitters of one proxy, over keys (without routing prefix)
+ * and over routing prefixes, see --hot-keys-sample-rate.
+ *
+ * Only the proxy thread adds samples. The mutex only guards the summaries
+ * against readers on other threads (ServiceInfo on any proxy merges all of
+ * them), so isHot(), which only runs on the proxy thread, doesn't take it.
+ */
+class HotKeyTracker {
+ public:
+  HotKeyTracker(size_t sampleRate, size_t capacity);
+
+  /**
+   * Records one of every sampleRate requests.
+   */
+  void onRequest(folly::StringPiece keyWithoutRoute,
+                 folly::StringPiece routingPrefix) {
+    if (--countdown_ > 0) {
+      return;
+    }
+    countdown_ = sampleRate_;
+    addSample(keyWithoutRoute, routingPrefix);
+  }
+
+  /**
+   * Must be called on the proxy thread.
+   *
+   * @return true if key's estimated share of sampled requests
+   *         is at least minShare
+   */
+  bool isHot(folly::StringPiece keyWithoutRoute, double minShare) const;
+
+  std::vector<SpaceSaving::Item> topKeys(size_t n) const;
+  std::vector<SpaceSaving::Item> topPrefixes(size_t n) const;
+
+ private:
+  const size_t sampleRate_;
+  size_t countdown_;
+
+  mutable std::mutex lock_;
+  SpaceSaving keys_;
+  SpaceSaving prefixes_;
+
+  void addSample(folly::StringPiece keyWithoutRoute,
+                 folly::StringPiece routingPrefix);
+};
+
+/**
+ * Hot key check for routes (overload of the customization point in
+ * mcrouter/lib/HotKeys.h).
+ *
+ * @return true if the proxy doesn't track hot keys, or if req's key
+ *         is at least minShare of the proxy's sampled requests
+ */
+bool isHotKey(const ProxyMcRequest& req, double minShare);
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,127 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HotRestartState.h"
+
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/json.h>
+
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyDestination.h"
+#include "mcrouter/ProxyDestinationMap.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+const char* const kUp = "up";
+const char* const kSoftTko = "tko";
+const char* const kHardTko = "hard_tko";
+
+using DestinationList = std::vector<std::pair<std::string, const char*>>;
+
+void collect(ProxyDestinationMap& map, DestinationList& out) {
+  map.foreachDestination([&out](const ProxyDestination& destination) {
+    const auto& tko = destination.shared->tko;
+    if (tko.isHardTko()) {
+      out.emplace_back(destination.destinationKey, kHardTko);
+    } else if (tko.isSoftTko()) {
+      out.emplace_back(destination.destinationKey, kSoftTko);
+    } else if (destination.state() == ProxyDestinationState::kUp) {
+      out.emplace_back(destination.destinationKey, kUp);
+    }
+  });
+}
+
+}  // anonymous namespace
+
+std::string HotRestartState::snapshot(McrouterInstance& router,
+                                      std::chrono::milliseconds timeout) {
+  std::vector<std::shared_ptr<std::promise<DestinationList>>> promises;
+  std::vector<std::future<DestinationList>> futures;
+  for (size_t i = 0; i < router.numProxies(); ++i) {
+    auto proxy = router.getProxy(i);
+    if (proxy == nullptr || proxy->eventBase == nullptr) {
+      continue;
+    }
+    /* shared, the proxy may answer after we stopped waiting */
+    auto promise = std::make_shared<std::promise<DestinationList>>();
+    futures.push_back(promise->get_future());
+    proxy->eventBase->runInEventBaseThread([proxy, promise]() {
+      DestinationList destinations;
+      collect(*proxy->destinationMap, destinations);
+      promise->set_value(std::move(destinations));
+    });
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  folly::dynamic destinations = folly::dynamic::object();
+  for (auto& future : futures) {
+    if (future.wait_until(deadline) != std::future_status::ready) {
+      LOG(WARNING) << "Hot restart: a proxy didn't report its destinations";
+      continue;
+    }
+    for (const auto& it : future.get()) {
+      /* TKO in any proxy wins, destinations may be shared */
+      auto jstate = destinations.get_ptr(it.first);
+      if (jstate == nullptr || jstate->asString() == kUp) {
+        destinations[it.first] = it.second;
+      }
+    }
+  }
+  folly::dynamic json = folly::dynamic::object("destinations",
+                                               std::move(destinations));
+  return folly::toJson(json).toStdString();
+}
+
+HotRestartState::HotRestartState(folly::StringPiece json) {
+  try {
+    auto parsed = folly::parseJson(json);
+    auto jdestinations = parsed.get_ptr("destinations");
+    if (jdestinations == nullptr || !jdestinations->isObject()) {
+      LOG(ERROR) << "Hot restart: no destinations in the state";
+      return;
+    }
+    for (const auto& it : jdestinations->items()) {
+      if (!it.second.isString()) {
+        continue;
+      }
+      auto state = it.second.stringPiece();
+      Destination destination;
+      if (state == kUp) {
+        destination = Destination::kUp;
+      } else if (state == kSoftTko) {
+        destination = Destination::kSoftTko;
+      } else if (state == kHardTko) {
+        destination = Destination::kHardTko;
+      } else {
+        continue;
+      }
+      destinations_.emplace(it.first.asString().toStdString(), destination);
+    }
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "Hot restart: invalid state: " << e.what();
+    destinations_.clear();
+  }
+}
+
+const HotRestartState::Destination*
+HotRestartState::find(const std::string& destinationKey) const {
+  auto it = destinations_.find(destinationKey);
+  return it == destinations_.end() ? nullptr : &it->second;
+}
+
+}}}  // facebook::memcache::mcrouter
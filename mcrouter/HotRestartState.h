@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class McrouterInstance;
+
+/**
+ * Destination state a process hands over to the one replacing it during
+ * a hot restart (see lib/network/HotRestart.h), serialized as JSON:
+ *
+ *   {"destinations": {"<destination key>": "up" | "tko" | "hard_tko"}}
+ *
+ * Only destinations that were connected or TKO are included, so the new
+ * process pre-connects to the destinations in use instead of every one
+ * in the config.
+ */
+class HotRestartState {
+ public:
+  enum class Destination {
+    kUp,
+    kSoftTko,
+    kHardTko
+  };
+
+  /**
+   * Collects the state of all proxies, in their threads. Proxies that
+   * don't answer within timeout are left out.
+   */
+  static std::string snapshot(McrouterInstance& router,
+                              std::chrono::milliseconds timeout);
+
+  HotRestartState() = default;
+
+  /**
+   * Malformed state is logged and ignored.
+   */
+  explicit HotRestartState(folly::StringPiece json);
+
+  /**
+   * @return state of destinationKey, nullptr if it's not in the snapshot
+   */
+  const Destination* find(const std::string& destinationKey) const;
+
+  size_t size() const {
+    return destinations_.size();
+  }
+
+ private:
+  std::unordered_map<std::string, Destination> destinations_;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,399 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "InotifyWatcher.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <boost/filesystem/convenience.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <glog/logging.h>
+
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/Singleton.h>
+#include <folly/SpookyHashV2.h>
+#include <folly/ThreadName.h>
+
+using boost::filesystem::complete;
+using boost::filesystem::path;
+using boost::filesystem::read_symlink;
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+folly::Singleton<InotifyWatcher> gInotifyWatcher;
+
+/* Same events as FileDataProvider, plus writes being finished */
+const uint32_t kInotifyMask =
+  IN_MODIFY | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF | IN_DONT_FOLLOW;
+
+const size_t kInotifyBufSize = 16 * 1024;
+
+std::string readContents(const std::string& filePath) {
+  std::string result;
+  if (!folly::readFile(filePath.data(), result)) {
+    throw std::runtime_error(
+      folly::format("Can not read file '{}'", filePath).str());
+  }
+  return result;
+}
+
+uint64_t contentsHash(const std::string& contents) {
+  return folly::hash::SpookyHashV2::Hash64(contents.data(), contents.size(),
+                                           /* seed */ 0);
+}
+
+}  // anonymous namespace
+
+std::shared_ptr<InotifyWatcher> InotifyWatcher::get() {
+  return gInotifyWatcher.get_weak().lock();
+}
+
+InotifyWatcher::InotifyWatcher() {
+  start();
+}
+
+InotifyWatcher::~InotifyWatcher() {
+  stop();
+}
+
+void InotifyWatcher::start() {
+  inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  PLOG_IF(ERROR, inotifyFd_ < 0) << "Failed to initialize inotify";
+  wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  PCHECK(wakeFd_ >= 0);
+  pid_ = getpid();
+  shutdown_ = false;
+  thread_ = std::thread([this]() {
+    folly::setThreadName("mcrtr-inotify");
+    run();
+  });
+}
+
+void InotifyWatcher::stop() {
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    shutdown_ = true;
+  }
+  wake();
+  if (thread_.joinable()) {
+    if (pid_ == getpid()) {
+      thread_.join();
+    } else {
+      thread_.detach();
+    }
+  }
+  if (inotifyFd_ >= 0) {
+    close(inotifyFd_);
+    inotifyFd_ = -1;
+  }
+  close(wakeFd_);
+}
+
+void InotifyWatcher::restartIfForked() {
+  if (pid_ == getpid()) {
+    return;
+  }
+  thread_.detach();
+  if (inotifyFd_ >= 0) {
+    close(inotifyFd_);
+  }
+  close(wakeFd_);
+  watches_.clear();
+  wdWatches_.clear();
+  start();
+}
+
+uint64_t InotifyWatcher::watch(const std::string& filePath,
+                               std::chrono::milliseconds settle,
+                               std::function<void(std::string)> onChange,
+                               std::function<void()> onError) {
+  restartIfForked();
+  if (filePath.empty()) {
+    throw std::runtime_error("File path empty");
+  }
+  if (inotifyFd_ < 0) {
+    throw std::runtime_error("inotify is not available");
+  }
+
+  std::unique_lock<std::mutex> cbLock(callbackMutex_, std::defer_lock);
+  if (std::this_thread::get_id() != thread_.get_id()) {
+    cbLock.lock();
+  }
+
+  uint64_t id;
+  std::string contents;
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    id = nextId_++;
+    Watch watch;
+    watch.path = filePath;
+    watch.settle = settle;
+    watch.onChange = onChange;
+    watch.onError = std::move(onError);
+    /* Watch before reading, so that no change can be missed */
+    addWatches(id, watch);
+    try {
+      contents = readContents(filePath);
+    } catch (...) {
+      removeWatches(id, watch);
+      throw;
+    }
+    watch.hash = contentsHash(contents);
+    watches_.emplace(id, std::move(watch));
+  }
+
+  try {
+    onChange(std::move(contents));
+  } catch (...) {
+    std::lock_guard<std::mutex> lck(mutex_);
+    auto it = watches_.find(id);
+    if (it != watches_.end()) {
+      removeWatches(id, it->second);
+      watches_.erase(it);
+    }
+    throw;
+  }
+  return id;
+}
+
+void InotifyWatcher::unwatch(uint64_t id) {
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    auto it = watches_.find(id);
+    if (it == watches_.end()) {
+      return;
+    }
+    removeWatches(id, it->second);
+    watches_.erase(it);
+  }
+  if (std::this_thread::get_id() != thread_.get_id()) {
+    /* Wait for callbacks that might still be running */
+    std::lock_guard<std::mutex> cbLock(callbackMutex_);
+  }
+}
+
+void InotifyWatcher::addWatches(uint64_t id, Watch& watch) {
+  std::vector<int> wds;
+  /* Chained symlinks: watch every link and the final file */
+  path link(watch.path);
+  while (true) {
+    int wd = inotify_add_watch(inotifyFd_, link.string().data(), kInotifyMask);
+    if (wd < 0) {
+      throw std::runtime_error(
+        folly::format("Can not add inotify watch for '{}'",
+                      link.string()).str());
+    }
+    wds.push_back(wd);
+    boost::system::error_code ec;
+    auto file = read_symlink(link, ec);
+    if (file.empty()) {
+      break;
+    }
+    file = complete(file, link.parent_path());
+    std::swap(link, file);
+  }
+
+  for (auto wd : wds) {
+    auto& ids = wdWatches_[wd];
+    if (std::find(ids.begin(), ids.end(), id) == ids.end()) {
+      ids.push_back(id);
+    }
+  }
+  auto old = std::move(watch.wds);
+  watch.wds = std::move(wds);
+  for (auto wd : old) {
+    if (std::find(watch.wds.begin(), watch.wds.end(), wd) != watch.wds.end()) {
+      continue;
+    }
+    auto it = wdWatches_.find(wd);
+    if (it == wdWatches_.end()) {
+      continue;
+    }
+    auto& ids = it->second;
+    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+    if (ids.empty()) {
+      inotify_rm_watch(inotifyFd_, wd);
+      wdWatches_.erase(it);
+    }
+  }
+}
+
+void InotifyWatcher::removeWatches(uint64_t id, Watch& watch) {
+  for (auto wd : watch.wds) {
+    auto it = wdWatches_.find(wd);
+    if (it == wdWatches_.end()) {
+      continue;
+    }
+    auto& ids = it->second;
+    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+    if (ids.empty()) {
+      /* Fails harmlessly if the kernel already dropped the watch */
+      inotify_rm_watch(inotifyFd_, wd);
+      wdWatches_.erase(it);
+    }
+  }
+  watch.wds.clear();
+}
+
+void InotifyWatcher::wake() {
+  uint64_t val = 1;
+  auto ret = write(wakeFd_, &val, sizeof(val));
+  (void)ret;
+}
+
+void InotifyWatcher::run() {
+  int timeoutMs = -1;
+  while (true) {
+    struct pollfd fds[2];
+    fds[0].fd = inotifyFd_;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = wakeFd_;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    auto ret = ::poll(fds, 2, timeoutMs);
+    if (ret < 0 && errno != EINTR) {
+      PLOG(ERROR) << "poll on inotify failed";
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (fds[1].revents & POLLIN) {
+      uint64_t val;
+      auto len = read(wakeFd_, &val, sizeof(val));
+      (void)len;
+    }
+    {
+      std::lock_guard<std::mutex> lck(mutex_);
+      if (shutdown_) {
+        return;
+      }
+      if (fds[0].revents & POLLIN) {
+        readEvents();
+      }
+    }
+    timeoutMs = fireDue();
+  }
+}
+
+void InotifyWatcher::readEvents() {
+  char buf[kInotifyBufSize]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
+  auto now = std::chrono::steady_clock::now();
+  auto markPending = [now](Watch& watch) {
+    /* Restarts the settle time on every event */
+    watch.pending = true;
+    watch.deadline = now + watch.settle;
+  };
+
+  while (true) {
+    auto len = read(inotifyFd_, buf, sizeof(buf));
+    if (len <= 0) {
+      /* EAGAIN: no more events */
+      return;
+    }
+    for (char* p = buf; p < buf + len; ) {
+      auto event = reinterpret_cast<const struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        /* Lost events, reload everything */
+        for (auto& it : watches_) {
+          markPending(it.second);
+        }
+        continue;
+      }
+      auto wdIt = wdWatches_.find(event->wd);
+      if (wdIt == wdWatches_.end()) {
+        continue;
+      }
+      for (auto id : wdIt->second) {
+        auto it = watches_.find(id);
+        if (it != watches_.end()) {
+          markPending(it->second);
+        }
+      }
+      if (event->mask & IN_IGNORED) {
+        /* The kernel dropped the watch (file deleted), the wd may be
+           reused. The watches are added again once they're due. */
+        wdWatches_.erase(wdIt);
+      }
+    }
+  }
+}
+
+int InotifyWatcher::fireDue() {
+  std::lock_guard<std::mutex> cbLock(callbackMutex_);
+
+  std::vector<std::pair<std::function<void(std::string)>, std::string>>
+    changes;
+  std::vector<std::function<void()>> errors;
+  int timeoutMs = -1;
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = watches_.begin(); it != watches_.end(); ) {
+      auto& watch = it->second;
+      if (!watch.pending) {
+        ++it;
+        continue;
+      }
+      if (watch.deadline > now) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          watch.deadline - now).count() + 1;
+        timeoutMs = timeoutMs < 0 ? left : std::min<int>(timeoutMs, left);
+        ++it;
+        continue;
+      }
+
+      watch.pending = false;
+      try {
+        /* The file might have been replaced, or a link changed */
+        addWatches(it->first, watch);
+        auto contents = readContents(watch.path);
+        auto hash = contentsHash(contents);
+        if (hash != watch.hash) {
+          watch.hash = hash;
+          changes.emplace_back(watch.onChange, std::move(contents));
+        }
+        ++it;
+      } catch (const std::exception& e) {
+        LOG(ERROR) << "Stopped watching " << watch.path << ": " << e.what();
+        if (watch.onError) {
+          errors.push_back(watch.onError);
+        }
+        removeWatches(it->first, watch);
+        it = watches_.erase(it);
+      }
+    }
+  }
+
+  for (auto& change : changes) {
+    try {
+      change.first(std::move(change.second));
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "File update callback failed: " << e.what();
+    }
+  }
+  for (auto& onError : errors) {
+    onError();
+  }
+  return timeoutMs;
+}
+
+}}}  // facebook::memcache::mcrouter
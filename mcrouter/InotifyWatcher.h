@@ -0,0 +1,124 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Process-wide file watcher: one thread blocked on a single inotify fd for
+ * all watched files, so idle files cost no wakeups.
+ *
+ * Events are coalesced: a file is only read once it has been quiet for the
+ * watch's settle time, and the callback only fires if the contents hash
+ * differs from the last delivered contents.
+ *
+ * Like FileDataProvider, both symlinks and the files they point to
+ * are watched.
+ */
+class InotifyWatcher {
+ public:
+  /**
+   * @return the watcher, null during process shutdown
+   */
+  static std::shared_ptr<InotifyWatcher> get();
+
+  InotifyWatcher();
+  ~InotifyWatcher();
+
+  /**
+   * Starts watching filePath. Reads the file and calls onChange with its
+   * contents before returning; later onChange calls come from the watcher
+   * thread, never concurrently with each other.
+   *
+   * @param settle    how long the file must not change before it's read
+   * @param onError   called (and the watch is dropped) if the file
+   *                  can't be read or watched after a change, may be null
+   * @return          id for unwatch()
+   * @throw           std::runtime_error if the file can't be read or
+   *                  watched, nothing is called then
+   */
+  uint64_t watch(const std::string& filePath,
+                 std::chrono::milliseconds settle,
+                 std::function<void(std::string)> onChange,
+                 std::function<void()> onError = nullptr);
+
+  /**
+   * Stops watching. Once this returns, callbacks of the watch are not
+   * running and won't be called again (unless called from a callback).
+   */
+  void unwatch(uint64_t id);
+
+ private:
+  struct Watch {
+    std::string path;
+    std::chrono::milliseconds settle;
+    std::function<void(std::string)> onChange;
+    std::function<void()> onError;
+    std::vector<int> wds;
+    uint64_t hash{0};
+    bool pending{false};
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  /* Held while calling callbacks, taken before mutex_ */
+  std::mutex callbackMutex_;
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, Watch> watches_;
+  /* Watches use the same wd if they watch the same file */
+  std::unordered_map<int, std::vector<uint64_t>> wdWatches_;
+  uint64_t nextId_{1};
+  bool shutdown_{false};
+
+  int inotifyFd_{-1};
+  int wakeFd_{-1};
+  pid_t pid_{0};
+  std::thread thread_;
+
+  void start();
+  void stop();
+  /* If we're the child of a fork(), the thread doesn't exist anymore */
+  void restartIfForked();
+
+  void run();
+  void wake();
+
+  /**
+   * Reads pending inotify events and marks their watches as pending.
+   * Called with mutex_ held.
+   */
+  void readEvents();
+
+  /**
+   * (Re)adds inotify watches for the file and its symlinks.
+   * Called with mutex_ held.
+   */
+  void addWatches(uint64_t id, Watch& watch);
+  void removeWatches(uint64_t id, Watch& watch);
+
+  /**
+   * Reloads due watches, with callbackMutex_ held.
+   * @return time until the next pending watch is due, -1 if none
+   */
+  int fireDue();
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include <folly/Format.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+inline void relaxedAdd(uint64_t& counter, uint64_t delta) {
+  __atomic_store_n(&counter,
+                   __atomic_load_n(&counter, __ATOMIC_RELAXED) + delta,
+                   __ATOMIC_RELAXED);
+}
+
+inline uint64_t relaxedLoad(const uint64_t& counter) {
+  return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+}  // anonymous namespace
+
+constexpr size_t LatencyHistogram::kSubBucketBits;
+constexpr size_t LatencyHistogram::kSubBuckets;
+constexpr size_t LatencyHistogram::kMaxValueBits;
+constexpr uint64_t LatencyHistogram::kMaxValue;
+constexpr size_t LatencyHistogram::kNumBuckets;
+
+size_t LatencyHistogram::bucketIndex(uint64_t value) {
+  value = std::min(value, kMaxValue);
+  if (value < kSubBuckets) {
+    return value;
+  }
+  // Position of the highest bit, >= kSubBucketBits here.
+  size_t msb = 63 - __builtin_clzll(value);
+  size_t shift = msb - kSubBucketBits;
+  // Top kSubBucketBits bits below the highest one select the sub-bucket.
+  auto sub = (value >> shift) & (kSubBuckets - 1);
+  return (shift + 1) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t idx) {
+  assert(idx < kNumBuckets);
+  if (idx < kSubBuckets) {
+    return idx;
+  }
+  size_t shift = idx / kSubBuckets - 1;
+  uint64_t sub = idx % kSubBuckets;
+  return ((kSubBuckets + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::insertSample(uint64_t value) {
+  relaxedAdd(buckets_[bucketIndex(value)], 1);
+  relaxedAdd(count_, 1);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    buckets_[i] += relaxedLoad(other.buckets_[i]);
+  }
+  count_ += relaxedLoad(other.count_);
+}
+
+uint64_t LatencyHistogram::count() const {
+  return relaxedLoad(count_);
+}
+
+uint64_t LatencyHistogram::bucketCount(size_t idx) const {
+  assert(idx < kNumBuckets);
+  return relaxedLoad(buckets_[idx]);
+}
+
+uint64_t LatencyHistogram::quantile(double q) const {
+  auto total = count();
+  if (total == 0) {
+    return 0;
+  }
+  q = std::max(0.0, std::min(1.0, q));
+  auto rank = std::max<uint64_t>(1, std::ceil(q * total));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    seen += relaxedLoad(buckets_[i]);
+    if (seen >= rank) {
+      return bucketUpperBound(i);
+    }
+  }
+  // count_ and buckets_ are read at slightly different moments.
+  return bucketUpperBound(kNumBuckets - 1);
+}
+
+std::string LatencyHistogram::toString() const {
+  return folly::format("count:{} p50:{} p90:{} p99:{} p999:{}",
+                       count(), quantile(0.5), quantile(0.9), quantile(0.99),
+                       quantile(0.999)).str();
+}
+
+}}}  // facebook::memcache::mcrouter
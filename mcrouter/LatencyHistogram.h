@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Fixed-bucket log-linear histogram of latencies (in microseconds).
+ *
+ * Every power of two range [2^k, 2^(k+1)) is split into kSubBuckets equal
+ * buckets, so the relative error of any reported quantile is below
+ * 1 / kSubBuckets. Values above kMaxValue are counted in the last bucket.
+ *
+ * Only the owner thread is supposed to call insertSample(); counters are
+ * updated with relaxed atomics, so other threads may read (an approximate
+ * snapshot of) the histogram at any time.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr size_t kSubBucketBits = 3;
+  static constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+  static constexpr size_t kMaxValueBits = 30;
+  static constexpr uint64_t kMaxValue = (1ULL << kMaxValueBits) - 1;
+  static constexpr size_t kNumBuckets =
+    kSubBuckets * (kMaxValueBits - kSubBucketBits + 1);
+
+  void insertSample(uint64_t value);
+
+  /**
+   * Adds all samples of other histogram into this one.
+   */
+  void merge(const LatencyHistogram& other);
+
+  uint64_t count() const;
+
+  /**
+   * @return  number of samples in bucket idx
+   */
+  uint64_t bucketCount(size_t idx) const;
+
+  /**
+   * @param q  quantile in [0, 1].
+   * @return   upper bound of the bucket containing the q-quantile,
+   *           0 if there are no samples.
+   */
+  uint64_t quantile(double q) const;
+
+  /**
+   * @return  "count:N p50:X p90:X p99:X p999:X" summary.
+   */
+  std::string toString() const;
+
+  static size_t bucketIndex(uint64_t value);
+  static uint64_t bucketUpperBound(size_t idx);
+
+ private:
+  uint64_t buckets_[kNumBuckets] = {0};
+  uint64_t count_{0};
+};
+
+}}}  // facebook::memcache::mcrouter
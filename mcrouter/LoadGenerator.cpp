@@ -0,0 +1,478 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "LoadGenerator.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/Format.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/IOBuf.h>
+#include <folly/json.h>
+#include <folly/Memory.h>
+#include <folly/String.h>
+
+#include "mcrouter/lib/fibers/EventBaseLoopController.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/AsyncMcClient.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<folly::StringPiece> splitSpec(folly::StringPiece spec, char sep) {
+  std::vector<folly::StringPiece> parts;
+  folly::split(sep, spec, parts);
+  return parts;
+}
+
+template <class T>
+T parseNumber(folly::StringPiece s, folly::StringPiece what) {
+  try {
+    return folly::to<T>(s);
+  } catch (const std::exception&) {
+    throw std::invalid_argument(folly::sformat("invalid {}: '{}'", what, s));
+  }
+}
+
+double parseShare(folly::StringPiece s, folly::StringPiece what) {
+  auto share = parseNumber<double>(s, what);
+  if (share < 0 || share > 1) {
+    throw std::invalid_argument(folly::sformat("{} is not in [0, 1]", what));
+  }
+  return share;
+}
+
+size_t uniformIndex(std::mt19937_64& rng, size_t from, size_t to) {
+  return std::uniform_int_distribution<size_t>(from, to)(rng);
+}
+
+}  // anonymous namespace
+
+KeyDistribution::KeyDistribution(folly::StringPiece spec, size_t numKeys)
+    : numKeys_(numKeys) {
+  if (numKeys_ == 0) {
+    throw std::invalid_argument("number of keys is 0");
+  }
+  auto parts = splitSpec(spec, ':');
+  if (parts[0] == "uniform" && parts.size() == 1) {
+    type_ = Type::UNIFORM;
+  } else if (parts[0] == "zipf" && parts.size() == 2) {
+    type_ = Type::ZIPF;
+    auto exponent = parseNumber<double>(parts[1], "zipf exponent");
+    cdf_.resize(numKeys_);
+    double sum = 0;
+    for (size_t i = 0; i < numKeys_; ++i) {
+      sum += 1 / std::pow(i + 1, exponent);
+      cdf_[i] = sum;
+    }
+    for (auto& p : cdf_) {
+      p /= sum;
+    }
+  } else if (parts[0] == "hotset" && parts.size() == 3) {
+    type_ = Type::HOTSET;
+    auto keyShare = parseShare(parts[1], "hot key share");
+    hotShare_ = parseShare(parts[2], "hot request share");
+    hotKeys_ = std::min(numKeys_, std::max<size_t>(1, keyShare * numKeys_));
+  } else {
+    throw std::invalid_argument(
+      folly::sformat("invalid key distribution '{}'", spec));
+  }
+}
+
+size_t KeyDistribution::operator()(std::mt19937_64& rng) {
+  switch (type_) {
+    case Type::UNIFORM:
+      break;
+    case Type::ZIPF: {
+      auto p = std::uniform_real_distribution<double>(0, 1)(rng);
+      auto it = std::lower_bound(cdf_.begin(), cdf_.end(), p);
+      return std::min<size_t>(it - cdf_.begin(), numKeys_ - 1);
+    }
+    case Type::HOTSET:
+      if (hotKeys_ == numKeys_ ||
+          std::bernoulli_distribution(hotShare_)(rng)) {
+        return uniformIndex(rng, 0, hotKeys_ - 1);
+      }
+      return uniformIndex(rng, hotKeys_, numKeys_ - 1);
+  }
+  return uniformIndex(rng, 0, numKeys_ - 1);
+}
+
+constexpr size_t ValueSizeDistribution::kMaxValueSize;
+
+ValueSizeDistribution::ValueSizeDistribution(folly::StringPiece spec) {
+  auto parts = splitSpec(spec, ':');
+  if (parts.size() == 1) {
+    type_ = Type::FIXED;
+    min_ = max_ = parseNumber<size_t>(parts[0], "value size");
+  } else if (parts[0] == "uniform" && parts.size() == 3) {
+    type_ = Type::UNIFORM;
+    min_ = parseNumber<size_t>(parts[1], "min value size");
+    max_ = parseNumber<size_t>(parts[2], "max value size");
+    if (min_ > max_) {
+      throw std::invalid_argument("min value size is above max value size");
+    }
+  } else if (parts[0] == "lognormal" && parts.size() == 3) {
+    type_ = Type::LOGNORMAL;
+    auto median = parseNumber<double>(parts[1], "median value size");
+    auto sigma = parseNumber<double>(parts[2], "value size sigma");
+    if (median <= 0 || sigma < 0) {
+      throw std::invalid_argument(
+        folly::sformat("invalid value size distribution '{}'", spec));
+    }
+    lognormal_ = std::lognormal_distribution<double>(std::log(median), sigma);
+    max_ = kMaxValueSize;
+  } else {
+    throw std::invalid_argument(
+      folly::sformat("invalid value size distribution '{}'", spec));
+  }
+  if (max_ > kMaxValueSize) {
+    throw std::invalid_argument(
+      folly::sformat("value size is above {}", kMaxValueSize));
+  }
+}
+
+size_t ValueSizeDistribution::operator()(std::mt19937_64& rng) {
+  switch (type_) {
+    case Type::FIXED:
+      break;
+    case Type::UNIFORM:
+      return uniformIndex(rng, min_, max_);
+    case Type::LOGNORMAL:
+      return std::min<double>(std::round(lognormal_(rng)), max_);
+  }
+  return min_;
+}
+
+OperationMix::OperationMix(folly::StringPiece spec) {
+  std::vector<double> weights;
+  for (auto item : splitSpec(spec, ',')) {
+    auto parts = splitSpec(item, ':');
+    if (parts.size() != 2) {
+      throw std::invalid_argument(
+        folly::sformat("invalid operation mix '{}'", spec));
+    }
+    if (parts[0] == "get") {
+      ops_.push_back(mc_op_get);
+    } else if (parts[0] == "set") {
+      ops_.push_back(mc_op_set);
+    } else if (parts[0] == "delete") {
+      ops_.push_back(mc_op_delete);
+    } else {
+      throw std::invalid_argument(
+        folly::sformat("unsupported operation '{}'", parts[0]));
+    }
+    auto weight = parseNumber<double>(parts[1], "operation weight");
+    if (weight < 0) {
+      throw std::invalid_argument("operation weight is negative");
+    }
+    weights.push_back(weight);
+  }
+  if (std::none_of(weights.begin(), weights.end(),
+                   [](double w) { return w > 0; })) {
+    throw std::invalid_argument("all operation weights are 0");
+  }
+  dist_ = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+}
+
+mc_op_t OperationMix::operator()(std::mt19937_64& rng) {
+  return ops_[dist_(rng)];
+}
+
+void LoadGenerator::Results::merge(const Results& other) {
+  for (const auto& it : other.latencyUs) {
+    latencyUs[it.first].merge(it.second);
+  }
+  for (const auto& it : other.results) {
+    results[it.first] += it.second;
+  }
+  requests += other.requests;
+  elapsed = std::max(elapsed, other.elapsed);
+}
+
+std::string LoadGenerator::Results::toString() const {
+  auto seconds = elapsed.count() / 1e6;
+  auto out = folly::sformat("requests: {} in {:.2f}s ({:.0f}/s)\n",
+                            requests, seconds,
+                            seconds > 0 ? requests / seconds : 0.0);
+  out += "results:";
+  for (const auto& it : results) {
+    folly::toAppend(' ', it.first, ':', it.second, &out);
+  }
+  out += '\n';
+  for (const auto& it : latencyUs) {
+    folly::toAppend("latency_us ", it.first, ": ", it.second.toString(), '\n',
+                    &out);
+  }
+  return out;
+}
+
+std::string LoadGenerator::Results::toJson() const {
+  auto seconds = elapsed.count() / 1e6;
+  folly::dynamic resultsJson = folly::dynamic::object;
+  for (const auto& it : results) {
+    resultsJson[it.first] = it.second;
+  }
+  folly::dynamic latencyJson = folly::dynamic::object;
+  for (const auto& it : latencyUs) {
+    const auto& histogram = it.second;
+    latencyJson[it.first] = folly::dynamic::object
+      ("count", histogram.count())
+      ("p50", histogram.quantile(0.5))
+      ("p90", histogram.quantile(0.9))
+      ("p99", histogram.quantile(0.99))
+      ("p999", histogram.quantile(0.999));
+  }
+  folly::dynamic json = folly::dynamic::object
+    ("requests", requests)
+    ("elapsed_us", elapsed.count())
+    ("qps", seconds > 0 ? requests / seconds : 0.0)
+    ("results", std::move(resultsJson))
+    ("latency_us", std::move(latencyJson));
+  return folly::toPrettyJson(json).toStdString();
+}
+
+/**
+ * One thread: an event base, its fiber manager and connections.
+ */
+class LoadGenerator::Worker {
+ public:
+  Worker(const Options& opts, size_t id)
+      : opts_(opts),
+        fm_(folly::make_unique<EventBaseLoopController>()),
+        rng_(opts.seed + id),
+        keys_(opts.keyDistribution, opts.numKeys),
+        valueSizes_(opts.valueSize),
+        ops_(opts.operations) {
+    dynamic_cast<EventBaseLoopController&>(fm_.loopController()).
+      attachEventBase(eventBase_);
+    for (size_t i = 0; i < std::max<size_t>(1, opts_.connectionsPerThread);
+         ++i) {
+      ConnectionOptions options(opts_.host, opts_.port, opts_.protocol);
+      options.writeTimeout = opts_.timeout;
+      clients_.push_back(
+        folly::make_unique<AsyncMcClient>(eventBase_, std::move(options)));
+    }
+    if (std::find(ops_.operations().begin(), ops_.operations().end(),
+                  mc_op_set) != ops_.operations().end()) {
+      value_.assign(ValueSizeDistribution::kMaxValueSize, 'v');
+    }
+    if (opts_.rate > 0) {
+      meanIntervalUs_ = 1e6 * std::max<size_t>(1, opts_.threads) / opts_.rate;
+      arrivals_ = std::exponential_distribution<double>(1 / meanIntervalUs_);
+    }
+  }
+
+  Results run() {
+    auto start = Clock::now();
+    measureFrom_ = start + opts_.warmup;
+    end_ = measureFrom_ + opts_.duration;
+
+    if (opts_.rate > 0) {
+      nextSend_ = start;
+      pump();
+    } else {
+      for (auto& client : clients_) {
+        for (size_t i = 0; i < std::max<size_t>(1, opts_.concurrency); ++i) {
+          ++inFlight_;
+          auto& c = *client;
+          fm_.addTask([this, &c]() {
+            while (Clock::now() < end_) {
+              sendOne(c, Clock::now());
+            }
+            if (--inFlight_ == 0) {
+              eventBase_.terminateLoopSoon();
+            }
+          });
+        }
+      }
+    }
+
+    eventBase_.loopForever();
+    while (fm_.hasTasks()) {
+      eventBase_.loopOnce();
+    }
+
+    Results results;
+    for (auto op : ops_.operations()) {
+      results.latencyUs[mc_op_to_string(op)].merge(latencyUs_[op]);
+    }
+    results.latencyUs["all"] = allLatencyUs_;
+    for (size_t res = 0; res < mc_nres; ++res) {
+      if (resultCounts_[res] != 0) {
+        results.results[mc_res_to_string(static_cast<mc_res_t>(res))] =
+          resultCounts_[res];
+      }
+    }
+    results.requests = requests_;
+    results.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::min(Clock::now(), end_) - measureFrom_);
+    return results;
+  }
+
+ private:
+  const Options& opts_;
+  /* Must outlive the clients */
+  folly::EventBase eventBase_;
+  FiberManager fm_;
+  std::vector<std::unique_ptr<AsyncMcClient>> clients_;
+  size_t nextClient_{0};
+
+  std::mt19937_64 rng_;
+  KeyDistribution keys_;
+  ValueSizeDistribution valueSizes_;
+  OperationMix ops_;
+  /* Sets send prefixes of this */
+  std::string value_;
+
+  Clock::time_point measureFrom_;
+  Clock::time_point end_;
+  size_t inFlight_{0};
+
+  /* Open loop */
+  double meanIntervalUs_{0};
+  std::exponential_distribution<double> arrivals_;
+  Clock::time_point nextSend_;
+  bool pumpScheduled_{false};
+
+  std::array<LatencyHistogram, mc_nops> latencyUs_;
+  LatencyHistogram allLatencyUs_;
+  std::array<uint64_t, mc_nres> resultCounts_{{0}};
+  uint64_t requests_{0};
+
+  Clock::duration nextInterval() {
+    auto us = opts_.poisson ? arrivals_(rng_) : meanIntervalUs_;
+    return std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double, std::micro>(us));
+  }
+
+  /**
+   * Open loop: starts all requests scheduled until now, as the limit on
+   * requests in flight allows, and schedules itself for the next one.
+   */
+  void pump() {
+    auto now = Clock::now();
+    while (nextSend_ <= now && nextSend_ < end_ &&
+           inFlight_ < std::max<size_t>(1, opts_.maxInFlightPerThread)) {
+      auto scheduled = nextSend_;
+      nextSend_ += nextInterval();
+      ++inFlight_;
+      auto& client = *clients_[nextClient_++ % clients_.size()];
+      fm_.addTask([this, &client, scheduled]() {
+        sendOne(client, scheduled);
+        --inFlight_;
+        pump();
+      });
+    }
+
+    if (nextSend_ >= end_) {
+      if (inFlight_ == 0) {
+        eventBase_.terminateLoopSoon();
+      }
+      return;
+    }
+    if (inFlight_ >= std::max<size_t>(1, opts_.maxInFlightPerThread) ||
+        pumpScheduled_) {
+      /* A completed request calls pump() */
+      return;
+    }
+
+    pumpScheduled_ = true;
+    auto pumpCallback = [this]() {
+      pumpScheduled_ = false;
+      pump();
+    };
+    auto delayMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+      nextSend_ - now).count();
+    if (delayMs > 1) {
+      eventBase_.runAfterDelay(std::move(pumpCallback), delayMs - 1);
+    } else {
+      /* Spin on the loop for sub-millisecond precision */
+      eventBase_.runInLoop(std::move(pumpCallback));
+    }
+  }
+
+  void sendOne(AsyncMcClient& client, Clock::time_point scheduled) {
+    McRequest req(folly::to<std::string>(opts_.keyPrefix, keys_(rng_)));
+    auto op = ops_(rng_);
+    switch (op) {
+      case mc_op_set:
+        req.setValue(folly::IOBuf(folly::IOBuf::WRAP_BUFFER, value_.data(),
+                                  valueSizes_(rng_)));
+        record(op, scheduled,
+               client.sendSync(req, McOperation<mc_op_set>(), opts_.timeout));
+        break;
+      case mc_op_delete:
+        record(op, scheduled,
+               client.sendSync(req, McOperation<mc_op_delete>(),
+                               opts_.timeout));
+        break;
+      default:
+        record(op, scheduled,
+               client.sendSync(req, McOperation<mc_op_get>(), opts_.timeout));
+        break;
+    }
+  }
+
+  void record(mc_op_t op, Clock::time_point scheduled, const McReply& reply) {
+    if (scheduled < measureFrom_) {
+      return;
+    }
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - scheduled).count();
+    latencyUs_[op].insertSample(latency);
+    allLatencyUs_.insertSample(latency);
+    ++resultCounts_[reply.result()];
+    ++requests_;
+  }
+};
+
+LoadGenerator::LoadGenerator(Options opts)
+    : opts_(std::move(opts)) {
+  /* Throw here rather than on the worker threads */
+  KeyDistribution keys(opts_.keyDistribution, opts_.numKeys);
+  ValueSizeDistribution valueSizes(opts_.valueSize);
+  OperationMix ops(opts_.operations);
+}
+
+LoadGenerator::Results LoadGenerator::run() {
+  auto numThreads = std::max<size_t>(1, opts_.threads);
+  std::vector<Results> results(numThreads);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < numThreads; ++i) {
+    threads.emplace_back([this, &results, i]() {
+      Worker worker(opts_, i);
+      results[i] = worker.run();
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  Results total;
+  for (const auto& r : results) {
+    total.merge(r);
+  }
+  return total;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,209 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <folly/Range.h>
+
+#include "mcrouter/LatencyHistogram.h"
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/mc/protocol.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Picks key indexes in [0, numKeys) for LoadGenerator.
+ *
+ * Specs:
+ *   "uniform"
+ *   "zipf:S"      index i is picked with probability ~ 1 / (i + 1)^S
+ *   "hotset:F:P"  share P of the requests go to the first share F of the
+ *                 keys, uniformly within the hot and the cold keys
+ *
+ * zipf keeps a table of 8 bytes per key.
+ */
+class KeyDistribution {
+ public:
+  /**
+   * @throws std::invalid_argument on a malformed spec
+   */
+  KeyDistribution(folly::StringPiece spec, size_t numKeys);
+
+  size_t operator()(std::mt19937_64& rng);
+
+ private:
+  enum class Type {
+    UNIFORM,
+    ZIPF,
+    HOTSET,
+  };
+
+  Type type_{Type::UNIFORM};
+  size_t numKeys_;
+  size_t hotKeys_{0};
+  double hotShare_{0};
+  /* zipf: cdf_[i] is the probability of picking an index <= i */
+  std::vector<double> cdf_;
+};
+
+/**
+ * Picks value sizes of LoadGenerator sets, at most kMaxValueSize.
+ *
+ * Specs:
+ *   "N"                     always N bytes
+ *   "uniform:MIN:MAX"
+ *   "lognormal:MEDIAN:SIGMA"
+ */
+class ValueSizeDistribution {
+ public:
+  static constexpr size_t kMaxValueSize = 1 << 20;
+
+  /**
+   * @throws std::invalid_argument on a malformed spec
+   */
+  explicit ValueSizeDistribution(folly::StringPiece spec);
+
+  size_t operator()(std::mt19937_64& rng);
+
+ private:
+  enum class Type {
+    FIXED,
+    UNIFORM,
+    LOGNORMAL,
+  };
+
+  Type type_{Type::FIXED};
+  size_t min_{0};
+  size_t max_{0};
+  std::lognormal_distribution<double> lognormal_;
+};
+
+/**
+ * Picks operations by weight, e.g. "get:90,set:9,delete:1".
+ * Supported operations are get, set and delete.
+ */
+class OperationMix {
+ public:
+  /**
+   * @throws std::invalid_argument on a malformed spec
+   */
+  explicit OperationMix(folly::StringPiece spec);
+
+  mc_op_t operator()(std::mt19937_64& rng);
+
+  const std::vector<mc_op_t>& operations() const {
+    return ops_;
+  }
+
+ private:
+  std::vector<mc_op_t> ops_;
+  std::discrete_distribution<size_t> dist_;
+};
+
+/**
+ * Sends memcache load to one server (or mcrouter) through AsyncMcClient,
+ * from several threads with several connections each.
+ *
+ * Open loop (rate > 0): requests are scheduled at a fixed total rate, with
+ * Poisson or evenly spaced arrivals, independently of how fast replies
+ * come back. Latency is measured from the time a request was scheduled,
+ * not sent, so requests delayed by a slow server (or by the limit on
+ * requests in flight) are counted with the delay, i.e. latencies are
+ * corrected for coordinated omission.
+ *
+ * Closed loop (rate 0): every connection keeps concurrency requests in
+ * flight, each sent as soon as the previous one got its reply. This finds
+ * the maximum throughput; latencies are then just service times.
+ *
+ * Every request is a fiber on the thread's FiberManager.
+ */
+class LoadGenerator {
+ public:
+  struct Options {
+    std::string host{"localhost"};
+    uint16_t port{5000};
+    mc_protocol_t protocol{mc_ascii_protocol};
+
+    size_t threads{1};
+    size_t connectionsPerThread{1};
+
+    /* Requests per second over all threads, 0 means closed loop */
+    double rate{0};
+    /* Open loop: exponential rather than fixed intervals between requests */
+    bool poisson{true};
+    /* Open loop: requests in flight per thread, later ones wait
+       (and their latency grows) */
+    size_t maxInFlightPerThread{10000};
+    /* Closed loop: requests in flight per connection */
+    size_t concurrency{1};
+
+    /* Replies before the warmup ends are not counted */
+    std::chrono::milliseconds warmup{0};
+    std::chrono::milliseconds duration{10000};
+    std::chrono::milliseconds timeout{1000};
+
+    std::string keyPrefix{"loadgen:"};
+    size_t numKeys{100000};
+    std::string keyDistribution{"uniform"};
+    std::string valueSize{"100"};
+    std::string operations{"get:90,set:10"};
+
+    uint64_t seed{0};
+  };
+
+  struct Results {
+    /* By operation name, and "all" */
+    std::map<std::string, LatencyHistogram> latencyUs;
+    /* Replies by result name */
+    std::map<std::string, uint64_t> results;
+    uint64_t requests{0};
+    /* Length of the measured part of the run */
+    std::chrono::microseconds elapsed{0};
+
+    void merge(const Results& other);
+
+    /**
+     * @return multiline human readable summary
+     */
+    std::string toString() const;
+
+    /**
+     * @return the same as a JSON object: requests, elapsed_us, qps,
+     *         results and latency_us (count and percentiles by operation)
+     */
+    std::string toJson() const;
+  };
+
+  /**
+   * @throws std::invalid_argument if a distribution spec is malformed
+   */
+  explicit LoadGenerator(Options opts);
+
+  /**
+   * Runs the load for warmup + duration, then waits for outstanding
+   * replies (up to the timeout). Blocks.
+   */
+  Results run();
+
+ private:
+  class Worker;
+
+  const Options opts_;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -9,7 +9,12 @@
  */
 #include "McrouterClient.h"
 
+#include <algorithm>
+
+#include <folly/io/async/EventBase.h>
+
 #include "mcrouter/lib/fbi/asox_queue.h"
+#include "mcrouter/McrouterCompletionQueue.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyRequestContext.h"
@@ -58,6 +63,59 @@ bool precheckRequest(ProxyRequestContext& preq) {
 }
 
 size_t McrouterClient::send(const mcrouter_msg_t* requests, size_t nreqs) {
+  return sendImpl(requests, nreqs, /* haveCredits= */ false);
+}
+
+size_t McrouterClient::trySend(const mcrouter_msg_t* requests, size_t nreqs) {
+  if (maxOutstanding_ == 0) {
+    return send(requests, nreqs);
+  }
+  auto n = tryAcquireCredits(nreqs);
+  if (n < nreqs) {
+    sendReadyWanted_.store(true);
+    /* Credits returned before flushCredits() could see the flag */
+    n += tryAcquireCredits(nreqs - n);
+  }
+  return sendImpl(requests, n, /* haveCredits= */ true);
+}
+
+size_t McrouterClient::tryAcquireCredits(size_t n) {
+  size_t acquired = 0;
+  while (acquired < n) {
+    auto got = counting_sem_lazy_nonblocking(&outstandingReqsSem_,
+                                             n - acquired);
+    if (got <= 0) {
+      break;
+    }
+    acquired += got;
+  }
+  return acquired;
+}
+
+void McrouterClient::returnCredit() {
+  if (maxOutstanding_ == 0) {
+    return;
+  }
+  ++pendingCredits_;
+  if (!creditCallback_.isLoopCallbackScheduled()) {
+    /* Keep the client alive until the callback runs */
+    incref();
+    proxy_->eventBase->runInLoop(&creditCallback_);
+  }
+}
+
+void McrouterClient::flushCredits() {
+  counting_sem_post(&outstandingReqsSem_, pendingCredits_);
+  pendingCredits_ = 0;
+  if (sendReadyWanted_.load() && sendReadyWanted_.exchange(false) &&
+      onSendReady_ && !disconnected_) {
+    onSendReady_();
+  }
+  decref();
+}
+
+size_t McrouterClient::sendImpl(const mcrouter_msg_t* requests, size_t nreqs,
+                                bool haveCredits) {
   if (nreqs == 0) {
     return 0;
   }
@@ -76,7 +134,8 @@ size_t McrouterClient::send(const mcrouter_msg_t* requests, size_t nreqs) {
     }
   }
 
-  __sync_fetch_and_add(&stats_.nreq, nreqs);
+  __sync_fetch_and_add(&stats_.send.nreq, nreqs);
+  auto sendUs = nowUs();
   for (size_t i = 0; i < nreqs; i++) {
     auto preq = ProxyRequestContext::create(
       *proxy_,
@@ -85,30 +144,87 @@ size_t McrouterClient::send(const mcrouter_msg_t* requests, size_t nreqs) {
         prq.requester_->onReply(prq);
       },
       requests[i].context);
-    preq->requester_ = incref();
+    prepareRequest(*preq, *requests[i].req, sendUs, requests[i].deadline,
+                   requests[i].cancellation);
     if (requests[i].saved_request.hasValue()) {
       preq->savedRequest_.emplace(
         std::move(*requests[i].saved_request));
     }
 
-    __sync_fetch_and_add(&stats_.op_count[requests[i].req->op], 1);
-    __sync_fetch_and_add(&stats_.op_value_bytes[requests[i].req->op],
-                         requests[i].req->value.len);
-    __sync_fetch_and_add(&stats_.op_key_bytes[requests[i].req->op],
-                         requests[i].req->key.len);
-
     entries[i].data = preq.release();
     entries[i].nbytes = sizeof(ProxyRequestContext*);
     entries[i].priority = 0;
     entries[i].type = request_type_request;
   }
 
-  if (router_->opts().standalone) {
+  enqueueRequests(entries, nreqs, haveCredits);
+
+  if (entries != scratch) {
+    free(entries);
+  }
+
+  return nreqs;
+}
+
+bool McrouterClient::send(
+    McRequest&& request,
+    mc_op_t op,
+    ReplyCallback callback,
+    std::chrono::milliseconds deadline,
+    std::shared_ptr<const std::atomic<bool>> cancellation) {
+  assert(!isZombie_);
+
+  __sync_fetch_and_add(&stats_.send.nreq, 1);
+  auto preq = ProxyRequestContext::create(
+    *proxy_,
+    std::move(request),
+    op,
+    [] (ProxyRequestContext& prq) {
+      prq.requester_->onReply(prq);
+    },
+    /* context= */ nullptr);
+  preq->replyCallback_ = std::move(callback);
+  auto msg = preq->savedRequest_->dependentMsg(op);
+  prepareRequest(*preq, *msg, nowUs(), deadline, std::move(cancellation));
+
+  asox_queue_entry_t entry;
+  entry.data = preq.release();
+  entry.nbytes = sizeof(ProxyRequestContext*);
+  entry.priority = 0;
+  entry.type = request_type_request;
+  enqueueRequests(&entry, 1, /* haveCredits= */ false);
+  return true;
+}
+
+void McrouterClient::prepareRequest(
+    ProxyRequestContext& preq,
+    const mc_msg_t& req,
+    int64_t sendUs,
+    std::chrono::milliseconds deadline,
+    std::shared_ptr<const std::atomic<bool>> cancellation) {
+  preq.requester_ = incref();
+  preq.createdUs_ = sendUs;
+  preq.setDeadline(deadline.count() > 0
+    ? deadline
+    : std::chrono::milliseconds(proxy_->opts.request_deadline_ms));
+  preq.cancellation_ = std::move(cancellation);
+
+  __sync_fetch_and_add(&stats_.send.op_count[req.op], 1);
+  __sync_fetch_and_add(&stats_.send.op_value_bytes[req.op], req.value.len);
+  __sync_fetch_and_add(&stats_.send.op_key_bytes[req.op], req.key.len);
+}
+
+void McrouterClient::enqueueRequests(asox_queue_entry_t* entries,
+                                     size_t nreqs,
+                                     bool haveCredits) {
+  if (router_->opts().standalone || sameThread_) {
     /*
      * Skip the extra asox queue hop and directly call the queue callback,
-     * since we're standalone and thus staying in the same thread
+     * since we're standalone (or a same-thread client) and thus staying
+     * in the same thread
      */
-    if (maxOutstanding_ == 0) {
+    assert(!sameThread_ || proxy_->eventBase->isInEventBaseThread());
+    if (maxOutstanding_ == 0 || haveCredits) {
       for (int i = 0; i < nreqs; i++) {
         requestReady(proxy_->request_queue, &entries[i], proxy_);
       }
@@ -129,29 +245,22 @@ size_t McrouterClient::send(const mcrouter_msg_t* requests, size_t nreqs) {
         i = n;
       }
     }
-  } else if (maxOutstanding_ == 0) {
-    asox_queue_multi_enqueue(proxy_->request_queue, entries, nreqs);
+  } else if (maxOutstanding_ == 0 || haveCredits) {
+    proxy_->enqueueEntries(entries, nreqs);
   } else {
     size_t i = 0;
     size_t n = 0;
 
     while (i < nreqs) {
       n += counting_sem_lazy_wait(&outstandingReqsSem_, nreqs - n);
-      asox_queue_multi_enqueue(proxy_->request_queue, &entries[i],
-                               n - i);
+      proxy_->enqueueEntries(&entries[i], n - i);
       i = n;
     }
   }
-
-  if (entries != scratch) {
-    free(entries);
-  }
-
-  return nreqs;
 }
 
 folly::EventBase* McrouterClient::getBase() const {
-  if (router_->opts().standalone) {
+  if (router_->opts().standalone || sameThread_) {
     return proxy_->eventBase;
   } else {
     return nullptr;
@@ -166,7 +275,8 @@ McrouterClient::McrouterClient(
     router_(router),
     callbacks_(callbacks),
     arg_(arg),
-    maxOutstanding_(maxOutstanding) {
+    maxOutstanding_(maxOutstanding),
+    creditCallback_(*this) {
 
   static std::atomic<uint64_t> nextClientId(0ULL);
   clientId_ = nextClientId++;
@@ -183,33 +293,43 @@ McrouterClient::McrouterClient(
 
   {
     std::lock_guard<std::mutex> guard(router_->nextProxyMutex_);
-    assert(router_->nextProxy_ < router_->opts().num_proxies);
-    proxy_ = router_->getProxy(router_->nextProxy_);
-    router_->nextProxy_ =
-      (router_->nextProxy_ + 1) % router_->opts().num_proxies;
+    /* the router may have been shrunk since nextProxy_ was picked */
+    auto numActive = router_->numActiveProxies();
+    auto index = router_->nextProxy_ % numActive;
+    proxy_ = router_->getProxy(index);
+    router_->nextProxy_ = (index + 1) % numActive;
   }
 }
 
 void McrouterClient::onReply(ProxyRequestContext& preq) {
-  mcrouter_msg_t router_reply;
-
-  // Don't increment refcounts, because these are transient stack
-  // references, and are guaranteed to be shorted lived than router_entry's
-  // reference.  This is a premature optimization.
-  router_reply.req = const_cast<mc_msg_t*>(preq.origReq().get());
-  router_reply.reply = std::move(preq.reply_.value());
-  router_reply.context = preq.context_;
-
-  if (router_reply.reply.result() == mc_res_timeout ||
-      router_reply.reply.result() == mc_res_connect_timeout) {
-    __sync_fetch_and_add(&stats_.ntmo, 1);
+  const auto& reply = preq.reply_.value();
+  if (reply.result() == mc_res_timeout ||
+      reply.result() == mc_res_connect_timeout) {
+    __sync_fetch_and_add(&stats_.reply.ntmo, 1);
   }
 
-  __sync_fetch_and_add(&stats_.op_value_bytes[preq.origReq()->op],
-                       router_reply.reply.value().length());
-
-  if (LIKELY(callbacks_.on_reply && !disconnected_)) {
-      callbacks_.on_reply(&router_reply, arg_);
+  __sync_fetch_and_add(&stats_.reply.op_value_bytes[preq.origReq()->op],
+                       reply.value().length());
+
+  if (preq.replyCallback_ && !disconnected_) {
+    preq.replyCallback_(std::move(preq.reply_.value()));
+  } else if (completionQueue_ && !disconnected_) {
+    mcrouter_completion_t completion;
+    completion.req = preq.origReq().clone();
+    completion.reply = std::move(preq.reply_.value());
+    completion.context = preq.context_;
+    completionQueue_->push(std::move(completion));
+  } else if (LIKELY(callbacks_.on_reply && !disconnected_)) {
+    mcrouter_msg_t router_reply;
+
+    // Don't increment refcounts, because these are transient stack
+    // references, and are guaranteed to be shorted lived than router_entry's
+    // reference.  This is a premature optimization.
+    router_reply.req = const_cast<mc_msg_t*>(preq.origReq().get());
+    router_reply.reply = std::move(preq.reply_.value());
+    router_reply.context = preq.context_;
+
+    callbacks_.on_reply(&router_reply, arg_);
   } else if (callbacks_.on_cancel && disconnected_) {
     // This should be called for all canceled requests, when cancellation is
     // implemented properly.
@@ -234,7 +354,7 @@ void McrouterClient::disconnect() {
   entry.priority = 0;
   entry.data = this;
   entry.nbytes = sizeof(*this);
-  asox_queue_enqueue(proxy_->request_queue, &entry);
+  proxy_->enqueueEntries(&entry, 1);
 }
 
 void McrouterClient::cleanup() {
@@ -278,15 +398,16 @@ McrouterClient::getStatsHelper(bool clear) {
   }
 
   std::unordered_map<std::string, int64_t> ret;
-  ret["nreq"] = fetch_func(&stats_.nreq);
+  ret["nreq"] = fetch_func(&stats_.send.nreq);
   for (int op = 0; op < mc_nops; op++) {
     std::string op_name = mc_op_to_string((mc_op_t)op);
-    ret[op_name + "_count"] = fetch_func(&stats_.op_count[op]);
-    ret[op_name + "_key_bytes"] = fetch_func(&stats_.op_key_bytes[op]);
-    ret[op_name + "_value_bytes"] = fetch_func(
-      &stats_.op_value_bytes[op]);
+    ret[op_name + "_count"] = fetch_func(&stats_.send.op_count[op]);
+    ret[op_name + "_key_bytes"] = fetch_func(&stats_.send.op_key_bytes[op]);
+    ret[op_name + "_value_bytes"] =
+      fetch_func(&stats_.send.op_value_bytes[op]) +
+      fetch_func(&stats_.reply.op_value_bytes[op]);
   }
-  ret["ntmo"] = fetch_func(&stats_.ntmo);
+  ret["ntmo"] = fetch_func(&stats_.reply.ntmo);
 
   return ret;
 }
@@ -302,6 +423,8 @@ void McrouterClient::requestReady(asox_queue_t q,
     auto client = preq->requester_;
 
     client->numPending_++;
+    proxy->requestQueueLagUs.insertSample(
+      std::max<int64_t>(nowUs() - preq->createdUs_, 0));
 
     if (precheckRequest(*preq)) {
       return;
@@ -323,6 +446,10 @@ void McrouterClient::requestReady(asox_queue_t q,
     auto client = (McrouterClient*) entry->data;
     client->disconnected_ = true;
     if (client->numPending_ == 0) client->cleanup();
+  } else if (entry->type == request_type_forwarded_request) {
+    ((proxy_t*)arg)->onForwardedRequest((ProxyRequestContext*)entry->data);
+  } else if (entry->type == request_type_forwarded_reply) {
+    ((proxy_t*)arg)->onForwardedReply((ProxyRequestContext*)entry->data);
   } else if (entry->type == request_type_router_shutdown) {
     /*
      * No-op. We just wanted to wake this event base up so that
@@ -9,7 +9,13 @@
  */
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+
 #include <folly/detail/CacheLocality.h>
+#include <folly/io/async/EventBase.h>
 #include <folly/IntrusiveList.h>
 #include <folly/Optional.h>
 
@@ -23,23 +29,36 @@ using asox_queue_t = asox_queue_s*;
 class asox_queue_entry_s;
 using asox_queue_entry_t = asox_queue_entry_s;
 
-namespace folly {
-class EventBase;
-}
-
 namespace facebook { namespace memcache { namespace mcrouter {
 
+/**
+ * Client counters, in one cache line aligned block per writing thread so
+ * that senders and the proxy thread don't bounce cache lines on every
+ * request. Counters split across blocks are summed on read.
+ */
 struct mcrouter_client_stats_t {
-  uint32_t nreq;              // number of requests
-  uint32_t op_count[mc_nops]; // number of requests for certain op
-  uint32_t op_key_bytes[mc_nops]; // request key bytes
-  uint32_t op_value_bytes[mc_nops]; // request + reply value bytes
-  uint32_t ntmo;              // number of timeouts
-  uint32_t nlocal_errors;     // number of local errors
-  uint32_t nremote_errors;    // number of remote errors
+  /* Updated by the threads calling send() */
+  struct SendStats {
+    uint32_t nreq;              // number of requests
+    uint32_t op_count[mc_nops]; // number of requests for certain op
+    uint32_t op_key_bytes[mc_nops]; // request key bytes
+    uint32_t op_value_bytes[mc_nops]; // request value bytes
+  };
+
+  /* Updated by the proxy thread */
+  struct ReplyStats {
+    uint32_t op_value_bytes[mc_nops]; // reply value bytes
+    uint32_t ntmo;              // number of timeouts
+    uint32_t nlocal_errors;     // number of local errors
+    uint32_t nremote_errors;    // number of remote errors
+  };
+
+  SendStats FOLLY_ALIGN_TO_AVOID_FALSE_SHARING send;
+  ReplyStats FOLLY_ALIGN_TO_AVOID_FALSE_SHARING reply;
 };
 
 class McrouterClient;
+class McrouterCompletionQueue;
 class McrouterInstance;
 class proxy_t;
 class ProxyRequestContext;
@@ -49,6 +68,12 @@ struct mcrouter_msg_t {
   McReply reply{mc_res_unknown};
   void* context;
   folly::Optional<McRequest> saved_request;
+  /* Total time mcrouter may spend on this request,
+     zero means use the request_deadline_ms option */
+  std::chrono::milliseconds deadline{0};
+  /* If set, becomes true once the requester is gone (see
+     ProxyRequestContext::clientGone()) */
+  std::shared_ptr<const std::atomic<bool>> cancellation;
 };
 
 typedef void (mcrouter_on_reply_t)(mcrouter_msg_t* router_req,
@@ -94,9 +119,51 @@ class McrouterClient {
   size_t send(const mcrouter_msg_t* requests, size_t nreqs);
 
   /**
-   * Returns the mcrouter managed event base that runs the callbacks.
-   * Returns nullptr in sync or standalone mode, as mcrouter doesn't create
-   * its own event bases.
+   * Like send(), but never blocks on maximum_outstanding_requests:
+   * only as many requests as fit under the limit are sent (a prefix of
+   * the array). If not all did, the send ready callback is called once
+   * requests complete and some of them would fit again.
+   *
+   * @returns number of requests sent
+   */
+  size_t trySend(const mcrouter_msg_t* requests, size_t nreqs);
+
+  /**
+   * Called on the proxy thread with the reply to a request sent with
+   * send(McRequest&&, ...), even if a completion queue is set. Not called
+   * if the client was disconnected meanwhile (on_cancel is called instead,
+   * with a null request context).
+   */
+  using ReplyCallback = std::function<void(McReply&&)>;
+
+  /**
+   * Asynchronously send a request without going through mc_msg_t:
+   * the client takes ownership of the request, which is routed as is
+   * (with no copy) and the reply is moved into `callback'.
+   *
+   * @param deadline      Total time mcrouter may spend on this request,
+   *                      zero means use the request_deadline_ms option
+   * @param cancellation  See mcrouter_msg_t::cancellation
+   *
+   * @returns true if the request was sent
+   */
+  bool send(McRequest&& request, mc_op_t op, ReplyCallback callback,
+            std::chrono::milliseconds deadline = std::chrono::milliseconds(0),
+            std::shared_ptr<const std::atomic<bool>> cancellation = nullptr);
+
+  /**
+   * Callback for trySend(), called on the proxy thread. Set it before
+   * sending any requests.
+   */
+  void setSendReadyCallback(std::function<void()> callback) {
+    onSendReady_ = std::move(callback);
+  }
+
+  /**
+   * Returns the event base that runs the callbacks in standalone mode and
+   * for same-thread clients (see McrouterInstance::createSameThreadClient()).
+   * Returns nullptr otherwise, since mcrouter doesn't expose the
+   * event bases of its own proxy threads.
    */
   folly::EventBase* getBase() const;
 
@@ -136,6 +203,16 @@ class McrouterClient {
     return clientId_;
   }
 
+  /**
+   * Deliver replies into `queue' instead of calling on_reply on the proxy
+   * thread (on_cancel and on_disconnect are still called). The queue is
+   * owned by the caller, must outlive the client and must not be shared
+   * with other clients. Set it before sending any requests.
+   */
+  void setCompletionQueue(McrouterCompletionQueue* queue) {
+    completionQueue_ = queue;
+  }
+
   /**
    * Override default proxy assignment.
    */
@@ -149,6 +226,8 @@ class McrouterClient {
   mcrouter_client_callbacks_t callbacks_;
   void* arg_;
 
+  McrouterCompletionQueue* completionQueue_{nullptr};
+
   proxy_t* proxy_{nullptr};
 
   mcrouter_client_stats_t stats_;
@@ -157,9 +236,35 @@ class McrouterClient {
   const unsigned int maxOutstanding_;
   counting_sem_t outstandingReqsSem_;
 
+  /**
+   * Completed requests don't post to outstandingReqsSem_ one by one,
+   * the proxy thread collects their credits and returns them in bulk
+   * at the end of its event loop iteration.
+   */
+  class CreditCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit CreditCallback(McrouterClient& client) : client_(client) {}
+    void runLoopCallback() noexcept override {
+      client_.flushCredits();
+    }
+   private:
+    McrouterClient& client_;
+  };
+  CreditCallback creditCallback_;
+  // only updated by mcrouter thread
+  int32_t pendingCredits_{0};
+
+  std::function<void()> onSendReady_;
+  // set by trySend() when it ran out of credits
+  std::atomic<bool> sendReadyWanted_{false};
+
   // whether the routing thread has received disconnect notification.
   bool disconnected_{false};
 
+  // if true, send() is only called on the proxy's event base thread
+  // and dispatches requests directly, see createSameThreadClient().
+  bool sameThread_{false};
+
   // only updated by mcrouter thread, so we don't need any fancy atomic refcount
   int numPending_{0};
 
@@ -181,6 +286,27 @@ class McrouterClient {
     void *arg,
     size_t maximum_outstanding);
 
+  size_t sendImpl(const mcrouter_msg_t* requests, size_t nreqs,
+                  bool haveCredits);
+  /**
+   * Common part of the send() variants once the context exists:
+   * counts the request (`req' as sent, before any of the rewrites
+   * ProxyRequestContext does) and sets up the fields McrouterClient owns.
+   */
+  void prepareRequest(ProxyRequestContext& preq, const mc_msg_t& req,
+                      int64_t sendUs,
+                      std::chrono::milliseconds deadline,
+                      std::shared_ptr<const std::atomic<bool>> cancellation);
+  /**
+   * Hands the contexts in `entries' to the proxy, waiting for credits
+   * unless haveCredits.
+   */
+  void enqueueRequests(asox_queue_entry_t* entries, size_t nreqs,
+                       bool haveCredits);
+  size_t tryAcquireCredits(size_t n);
+  void returnCredit();
+  void flushCredits();
+
   void onReply(ProxyRequestContext& preq);
   void disconnect();
   void cleanup();
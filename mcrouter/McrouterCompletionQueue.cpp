@@ -0,0 +1,119 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "McrouterCompletionQueue.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <folly/Bits.h>
+#include <glog/logging.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+McrouterCompletionQueue::McrouterCompletionQueue(size_t capacity)
+    : slots_(folly::nextPowTwo(std::max<size_t>(capacity, 1))),
+      mask_(slots_.size() - 1) {
+  fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  PCHECK(fd_ != -1);
+}
+
+McrouterCompletionQueue::~McrouterCompletionQueue() {
+  close(fd_);
+}
+
+void McrouterCompletionQueue::push(mcrouter_completion_t&& completion) {
+  if (!hasOverflow_.load(std::memory_order_acquire)) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) <= mask_) {
+      slots_[tail & mask_] = std::move(completion);
+      tail_.store(tail + 1, std::memory_order_release);
+      notify();
+      return;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(overflowMutex_);
+    overflow_.push_back(std::move(completion));
+    hasOverflow_.store(true, std::memory_order_release);
+  }
+  notify();
+}
+
+void McrouterCompletionQueue::notify() {
+  /* Pairs with the fence in poll(): either we see the consumer going idle,
+     or the consumer sees our completion. */
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (consumerIdle_.load(std::memory_order_relaxed) &&
+      consumerIdle_.exchange(false, std::memory_order_relaxed)) {
+    uint64_t val = 1;
+    PCHECK(write(fd_, &val, sizeof(val)) == sizeof(val));
+  }
+}
+
+size_t McrouterCompletionQueue::poll(mcrouter_completion_t* out, size_t n) {
+  consumerIdle_.store(false, std::memory_order_relaxed);
+
+  size_t polled = 0;
+  while (polled < n) {
+    polled += pollRing(out + polled, n - polled);
+    if (polled < n && hasOverflow_.load(std::memory_order_acquire)) {
+      polled += pollOverflow(out + polled, n - polled);
+    }
+    if (polled == n) {
+      break;
+    }
+
+    /* Out of completions: reset the eventfd and ask for a wakeup.
+       EAGAIN is expected if the eventfd wasn't signalled. */
+    uint64_t val;
+    auto ret = read(fd_, &val, sizeof(val));
+    (void)ret;
+    consumerIdle_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (tail_.load(std::memory_order_acquire) ==
+          head_.load(std::memory_order_relaxed) &&
+        !hasOverflow_.load(std::memory_order_acquire)) {
+      break;
+    }
+    consumerIdle_.store(false, std::memory_order_relaxed);
+  }
+  return polled;
+}
+
+size_t McrouterCompletionQueue::pollRing(mcrouter_completion_t* out,
+                                         size_t n) {
+  auto head = head_.load(std::memory_order_relaxed);
+  auto tail = tail_.load(std::memory_order_acquire);
+  size_t polled = 0;
+  for (; head != tail && polled < n; ++head, ++polled) {
+    out[polled] = std::move(slots_[head & mask_]);
+  }
+  head_.store(head, std::memory_order_release);
+  return polled;
+}
+
+size_t McrouterCompletionQueue::pollOverflow(mcrouter_completion_t* out,
+                                             size_t n) {
+  std::lock_guard<std::mutex> lock(overflowMutex_);
+  size_t polled = 0;
+  while (!overflow_.empty() && polled < n) {
+    out[polled++] = std::move(overflow_.front());
+    overflow_.pop_front();
+  }
+  if (overflow_.empty()) {
+    hasOverflow_.store(false, std::memory_order_release);
+  }
+  return polled;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <folly/detail/CacheLocality.h>
+
+#include "mcrouter/lib/McMsgRef.h"
+#include "mcrouter/lib/McReply.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * A reply delivered through a McrouterCompletionQueue.
+ */
+struct mcrouter_completion_t {
+  McMsgRef req;
+  McReply reply{mc_res_unknown};
+  void* context{nullptr};
+};
+
+/**
+ * Caller-owned single producer, single consumer queue of completed
+ * requests, an alternative to the on_reply callback for embedders that
+ * consume replies on their own threads (see
+ * McrouterClient::setCompletionQueue()).
+ *
+ * The producer is the proxy thread of the client, so a queue must not be
+ * shared between clients. The consumer is woken up through fd(), but only
+ * once per batch: after a notification no further eventfd writes happen
+ * until poll() finds the queue empty.
+ *
+ * Completions that don't fit (capacity should normally be at least the
+ * client's maximum_outstanding_requests) are kept in an unbounded
+ * overflow list, so the proxy thread never waits for the consumer.
+ */
+class McrouterCompletionQueue {
+ public:
+  /**
+   * @param capacity  rounded up to a power of two
+   */
+  explicit McrouterCompletionQueue(size_t capacity);
+  ~McrouterCompletionQueue();
+
+  McrouterCompletionQueue(const McrouterCompletionQueue&) = delete;
+  McrouterCompletionQueue& operator=(const McrouterCompletionQueue&) = delete;
+
+  /**
+   * Eventfd that becomes readable when there are completions to poll().
+   * poll() resets it, there's no need to read it.
+   */
+  int fd() const {
+    return fd_;
+  }
+
+  /**
+   * Consumer side: moves up to n oldest completions into out.
+   * Keep calling until it returns less than n, then wait for fd().
+   * @return number of completions moved
+   */
+  size_t poll(mcrouter_completion_t* out, size_t n);
+
+  /**
+   * Producer side, called from the proxy thread.
+   */
+  void push(mcrouter_completion_t&& completion);
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  std::vector<mcrouter_completion_t> slots_;
+  const uint64_t mask_;
+  int fd_;
+
+  std::atomic<uint64_t> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING head_{0};
+  std::atomic<uint64_t> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING tail_{0};
+  /* Set by the consumer when it needs an eventfd wakeup */
+  std::atomic<bool> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING consumerIdle_{true};
+
+  /* While set, the producer appends to overflow_ to preserve ordering */
+  std::atomic<bool> hasOverflow_{false};
+  std::mutex overflowMutex_;
+  std::deque<mcrouter_completion_t> overflow_;
+
+  size_t pollRing(mcrouter_completion_t* out, size_t n);
+  size_t pollOverflow(mcrouter_completion_t* out, size_t n);
+  void notify();
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -9,17 +9,21 @@
  */
 #include "McrouterInstance.h"
 
+#include <algorithm>
+
 #include <boost/filesystem/operations.hpp>
 
 #include <folly/DynamicConverter.h>
 #include <folly/experimental/Singleton.h>
+#include <folly/io/async/EventBase.h>
 #include <folly/json.h>
 #include <folly/MapUtil.h>
 
 #include "mcrouter/awriter.h"
 #include "mcrouter/FileObserver.h"
 #include "mcrouter/lib/fbi/cpp/LogFailure.h"
-#include "mcrouter/lib/fbi/timer.h"
+#include "mcrouter/lib/JemallocArenas.h"
+#include "mcrouter/lib/network/SSLHandshakePool.h"
 #include "mcrouter/McrouterLogFailure.h"
 #include "mcrouter/McrouterLogger.h"
 #include "mcrouter/proxy.h"
@@ -27,6 +31,10 @@
 #include "mcrouter/ProxyConfigBuilder.h"
 #include "mcrouter/ProxyThread.h"
 #include "mcrouter/RuntimeVarsData.h"
+#include "mcrouter/StageProfiler.h"
+#include "mcrouter/StatsExporter.h"
+#include "mcrouter/TenantQuotas.h"
+#include "mcrouter/TraceExporter.h"
 #include "mcrouter/ThreadUtil.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -41,14 +49,19 @@ class McrouterManager {
     freeAllMcrouters();
   }
 
-  McrouterInstance* mcrouterGetCreate(folly::StringPiece persistence_id,
-                                      const McrouterOptions& options) {
+  McrouterInstance* mcrouterGetCreate(
+    folly::StringPiece persistence_id,
+    const McrouterOptions& options,
+    const std::vector<folly::EventBase*>& evbs) {
+
     std::lock_guard<std::mutex> lg(mutex_);
 
     auto mcrouter = folly::get_default(mcrouters_, persistence_id.str(),
                                        nullptr);
     if (!mcrouter) {
-      mcrouter = McrouterInstance::create(options);
+      mcrouter = McrouterInstance::create(options,
+                                          /* spawnProxyThreads= */ true,
+                                          evbs);
       if (mcrouter) {
         mcrouters_[persistence_id.str()] = mcrouter;
       }
@@ -99,12 +112,29 @@ bool isValidRouterName(folly::StringPiece name) {
   return true;
 }
 
+/* With --compress-config-str, ConfigApi keeps the only copy of the config
+   string instead of the options of the router and of every proxy */
+McrouterOptions withoutCompressedConfigStr(McrouterOptions opts) {
+  if (opts.compress_config_str) {
+    opts.config_str.clear();
+  }
+  return opts;
+}
+
 }  // anonymous namespace
 
 McrouterInstance* McrouterInstance::init(folly::StringPiece persistence_id,
                                          const McrouterOptions& options) {
+  return init(persistence_id, options, std::vector<folly::EventBase*>());
+}
+
+McrouterInstance* McrouterInstance::init(
+  folly::StringPiece persistence_id,
+  const McrouterOptions& options,
+  const std::vector<folly::EventBase*>& evbs) {
+
   if (auto manager = gMcrouterManager.get_weak().lock()) {
-    return manager->mcrouterGetCreate(persistence_id, options);
+    return manager->mcrouterGetCreate(persistence_id, options, evbs);
   }
 
   return nullptr;
@@ -118,8 +148,11 @@ McrouterInstance* McrouterInstance::get(folly::StringPiece persistence_id) {
   return nullptr;
 }
 
-McrouterInstance* McrouterInstance::create(const McrouterOptions& input_options,
-                                           bool spawnProxyThreads) {
+McrouterInstance* McrouterInstance::create(
+  const McrouterOptions& input_options,
+  bool spawnProxyThreads,
+  const std::vector<folly::EventBase*>& evbs) {
+
   if (!isValidRouterName(input_options.service_name) ||
       !isValidRouterName(input_options.router_name)) {
     throw std::runtime_error(
@@ -145,7 +178,7 @@ McrouterInstance* McrouterInstance::create(const McrouterOptions& input_options,
   auto jsonStr = folly::json::serialize(dict, jsonOpts);
   failure::setServiceContext(router->routerName(), jsonStr.toStdString());
 
-  if (!router->spinUp(spawnProxyThreads)) {
+  if (!router->spinUp(spawnProxyThreads, evbs)) {
     router->tearDown();
     return nullptr;
   }
@@ -170,11 +203,54 @@ McrouterClient::Pointer McrouterInstance::createClient(
                        max_outstanding));
 }
 
-bool McrouterInstance::spinUp(bool spawnProxyThreads) {
+McrouterClient::Pointer McrouterInstance::createSameThreadClient(
+  mcrouter_client_callbacks_t callbacks,
+  void* arg,
+  size_t max_outstanding) {
+
+  proxy_t* proxy = nullptr;
+  for (const auto& p : proxies_) {
+    if (p->eventBase && p->eventBase->isInEventBaseThread()) {
+      proxy = p.get();
+      break;
+    }
+  }
+  if (proxy == nullptr) {
+    throw std::runtime_error(
+      "Same-thread clients must be created on a proxy event base thread");
+  }
+
+  auto client = createClient(callbacks, arg, max_outstanding);
+  client->setProxy(proxy);
+  client->sameThread_ = true;
+  return client;
+}
+
+bool McrouterInstance::spinUp(bool spawnProxyThreads,
+                              const std::vector<folly::EventBase*>& evbs) {
+  try {
+    threadCpus_ = getThreadAffinityCpus(opts_);
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "Failed to get thread affinity: " << e.what();
+    return false;
+  }
+
+  if (!evbs.empty() && evbs.size() != opts_.num_proxies) {
+    LOG(ERROR) << "Got " << evbs.size() << " event bases for "
+               << opts_.num_proxies << " proxies";
+    return false;
+  }
+  if (!evbs.empty()) {
+    spawnProxyThreads = false;
+  }
+
+  if (!opts_.standalone && spawnProxyThreads) {
+    proxyThreads_.reserve(std::max(opts_.num_proxies, opts_.max_proxies));
+  }
   for (size_t i = 0; i < opts_.num_proxies; i++) {
     try {
-      auto proxy =
-        folly::make_unique<proxy_t>(this, nullptr, opts_);
+      auto proxy = folly::make_unique<proxy_t>(
+        this, evbs.empty() ? nullptr : evbs[i], opts_, i);
       if (!opts_.standalone && spawnProxyThreads) {
         proxyThreads_.emplace_back(
           folly::make_unique<ProxyThread>(std::move(proxy)));
@@ -186,6 +262,8 @@ bool McrouterInstance::spinUp(bool spawnProxyThreads) {
       return false;
     }
   }
+  numProxies_.store(opts_.num_proxies, std::memory_order_release);
+  numActiveProxies_.store(opts_.num_proxies, std::memory_order_release);
 
   if (!reconfigure()) {
     LOG(ERROR) << "Failed to configure proxies";
@@ -199,8 +277,8 @@ bool McrouterInstance::spinUp(bool spawnProxyThreads) {
    * Specifically, we'll run them under proxy servers in main()
    */
   if (!opts_.standalone && spawnProxyThreads) {
-    for (auto& pt : proxyThreads_) {
-      auto rc = pt->spawn();
+    for (size_t i = 0; i < proxyThreads_.size(); ++i) {
+      auto rc = proxyThreads_[i]->spawn(proxyThreadCpus(i));
       if (!rc) {
         LOG(ERROR) << "Failed to start proxy thread";
         return false;
@@ -263,14 +341,69 @@ McrouterInstance::getStartupOpts() const {
 }
 
 proxy_t* McrouterInstance::getProxy(size_t index) const {
+  if (index >= numProxies()) {
+    return nullptr;
+  }
   if (!proxies_.empty()) {
     assert(proxyThreads_.empty());
-    return index < proxies_.size() ? proxies_[index].get() : nullptr;
+    return proxies_[index].get();
   } else {
     assert(proxies_.empty());
-    return index < proxyThreads_.size() ?
-                   &proxyThreads_[index]->proxy() : nullptr;
+    return &proxyThreads_[index]->proxy();
+  }
+}
+
+bool McrouterInstance::resizeProxies(size_t n) {
+  std::lock_guard<std::mutex> lg(configReconfigLock_);
+
+  if (n == 0 || n > std::max(opts_.num_proxies, opts_.max_proxies)) {
+    LOG(ERROR) << "Can not resize to " << n << " proxies, --max-proxies is "
+               << opts_.max_proxies;
+    return false;
+  }
+  if (proxyThreads_.empty() || !proxies_.empty()) {
+    LOG(ERROR) << "Only routers running their own proxy threads can be "
+                  "resized";
+    return false;
+  }
+  if (opts_.proxy_key_affinity || opts_.proxy_offload_threshold > 0) {
+    LOG(ERROR) << "Routers with --proxy-key-affinity or "
+                  "--proxy-offload-threshold can not be resized";
+    return false;
+  }
+
+  /* capacity was reserved in spinUp(), so appending doesn't move
+     the proxies other threads may be looking at */
+  while (proxyThreads_.size() < n) {
+    auto index = proxyThreads_.size();
+    try {
+      auto proxy = folly::make_unique<proxy_t>(this, nullptr, opts_, index);
+      auto proxyThread = folly::make_unique<ProxyThread>(std::move(proxy));
+
+      auto anyConfig =
+        std::dynamic_pointer_cast<ProxyConfig>(getProxy(0)->getConfig());
+      ProxyConfigBuilder builder(opts_, configApi_.get(), lastConfig_,
+                                 anyConfig.get());
+      proxy_config_swap(&proxyThread->proxy(),
+                        builder.buildConfig(&proxyThread->proxy(), nullptr));
+
+      if (!proxyThread->spawn(proxyThreadCpus(index))) {
+        LOG(ERROR) << "Failed to start proxy thread";
+        return false;
+      }
+      proxyThreads_.push_back(std::move(proxyThread));
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Failed to add proxy: " << e.what();
+      return false;
+    }
+    numProxies_.store(proxyThreads_.size(), std::memory_order_release);
   }
+
+  std::lock_guard<std::mutex> guard(nextProxyMutex_);
+  numActiveProxies_.store(n, std::memory_order_release);
+  VLOG(1) << "resized to " << n << " active proxies out of "
+          << proxyThreads_.size();
+  return true;
 }
 
 std::string McrouterInstance::routerName() const {
@@ -332,16 +465,38 @@ void McrouterInstance::tearDown() {
 }
 
 McrouterInstance::McrouterInstance(const McrouterOptions& input_options) :
-    opts_(options::substituteTemplates(input_options)),
+    opts_(withoutCompressedConfigStr(
+            options::substituteTemplates(input_options))),
     pid_(getpid()),
     configApi_(createConfigApi(opts_)),
     startupLock_(opts_.num_proxies + 1),
     asyncWriter_(folly::make_unique<AsyncWriter>()),
     statsLogWriter_(folly::make_unique<AsyncWriter>(
                       opts_.stats_async_queue_length)) {
-  fb_timer_set_cycle_timer_func(
-    []() -> uint64_t { return nowUs(); },
-    1.0);
+  if (!opts_.shared_tko_table.empty()) {
+    sharedTkoTable_ = SharedTkoTable::open(opts_.shared_tko_table);
+  }
+  if (opts_.ssl_handshake_threads > 0) {
+    sslHandshakePool_ =
+      folly::make_unique<SSLHandshakePool>(opts_.ssl_handshake_threads);
+  }
+  if (input_options.compress_config_str &&
+      !input_options.config_str.empty()) {
+    auto config = options::substituteTemplates(input_options.config_str);
+    auto bytes = configApi_->compressConfigStr(config);
+    /* one copy in the options of the router and of every proxy */
+    LOG(INFO) << "--compress-config-str: keeping " << bytes << " bytes "
+              << "instead of " << config.size() * (opts_.num_proxies + 1)
+              << " bytes of config string";
+  }
+  if (!opts_.proxy_tenant_quotas.empty()) {
+    try {
+      tenantQuotas_ =
+        folly::make_unique<TenantQuotas>(opts_.proxy_tenant_quotas);
+    } catch (const std::invalid_argument& e) {
+      LOG(ERROR) << "Ignoring --proxy-tenant-quotas: " << e.what();
+    }
+  }
 }
 
 /* Needed here for forward declared unique_ptr destruction */
@@ -366,18 +521,41 @@ void McrouterInstance::spawnAuxiliaryThreads() {
   startObservingRuntimeVarsFile();
   spawnStatUpdaterThread();
   spawnStatLoggerThread();
+  startStatsExporter();
+  startTraceExporter();
+  startStageProfiler();
+  startThreadArenasPurger();
+  startSharedTkoHeartbeat();
 }
 
 void McrouterInstance::startAwriterThreads() {
+  auto cpus = threadCpus_;
+  auto setAffinity = [cpus]() {
+    setThreadAffinity(pthread_self(), cpus);
+  };
+
   if (!opts_.asynclog_disable) {
     if (!asyncWriter_->start("mcrtr-awriter")) {
       throw std::runtime_error("failed to spawn mcrouter awriter thread");
     }
+    if (!cpus.empty()) {
+      asyncWriter_->run(setAffinity);
+    }
   }
 
   if (!statsLogWriter_->start("mcrtr-statsw")) {
     throw std::runtime_error("failed to spawn mcrouter stats writer thread");
   }
+  if (!cpus.empty()) {
+    statsLogWriter_->run(setAffinity);
+  }
+}
+
+std::vector<int> McrouterInstance::proxyThreadCpus(size_t index) const {
+  if (threadCpus_.empty()) {
+    return {};
+  }
+  return { threadCpus_[index % threadCpus_.size()] };
 }
 
 void McrouterInstance::startObservingRuntimeVarsFile() {
@@ -395,7 +573,6 @@ void McrouterInstance::startObservingRuntimeVarsFile() {
   FileObserver::startObserving(
     opts_.runtime_vars_file,
     taskScheduler_,
-    opts_.file_observer_poll_period_ms,
     opts_.file_observer_sleep_before_update_ms,
     std::move(onUpdate)
   );
@@ -403,7 +580,7 @@ void McrouterInstance::startObservingRuntimeVarsFile() {
 
 void* McrouterInstance::statUpdaterThreadRun(void* arg) {
   auto router = reinterpret_cast<McrouterInstance*>(arg);
-  if (router->opts_.num_proxies == 0) {
+  if (router->numProxies() == 0) {
     return nullptr;
   }
 
@@ -425,31 +602,28 @@ void* McrouterInstance::statUpdaterThreadRun(void* arg) {
       }
     }
 
-    // to avoid inconsistence among proxies, we lock all mutexes together
-    for (size_t i = 0; i < router->opts_.num_proxies; ++i) {
-      router->getProxy(i)->stats_lock.lock();
-    }
-
-    for (size_t i = 0; i < router->opts_.num_proxies; ++i) {
+    // Proxies keep updating their stats while we do this, the exchange
+    // below makes sure no increment is lost.
+    for (size_t i = 0; i < router->numProxies(); ++i) {
       auto proxy = router->getProxy(i);
       if (proxy->num_bins_used < BIN_NUM) {
-        ++proxy->num_bins_used;
+        __atomic_store_n(&proxy->num_bins_used, proxy->num_bins_used + 1,
+                         __ATOMIC_RELAXED);
       }
 
       for(int j = 0; j < num_stats; ++j) {
         if (proxy->stats[j].group & rate_stats) {
-          proxy->stats_num_within_window[j] -= proxy->stats_bin[j][idx];
-          proxy->stats_bin[j][idx] = proxy->stats[j].data.uint64;
-          proxy->stats_num_within_window[j] += proxy->stats_bin[j][idx];
-          proxy->stats[j].data.uint64 = 0;
+          auto count = __atomic_exchange_n(&proxy->stats[j].data.uint64, 0,
+                                           __ATOMIC_RELAXED);
+          auto numWithinWindow = proxy->stats_num_within_window[j] -
+            proxy->stats_bin[j][idx] + count;
+          proxy->stats_bin[j][idx] = count;
+          __atomic_store_n(&proxy->stats_num_within_window[j], numWithinWindow,
+                           __ATOMIC_RELAXED);
         }
       }
     }
 
-    for (size_t i = 0; i < router->opts_.num_proxies; ++i) {
-      router->getProxy(i)->stats_lock.unlock();
-    }
-
     idx = (idx + 1) % BIN_NUM;
   }
   return nullptr;
@@ -459,7 +633,7 @@ void McrouterInstance::spawnStatUpdaterThread() {
   auto rc = spawnThread(&statUpdaterThreadHandle_,
                         &statUpdaterThreadStack_,
                         &McrouterInstance::statUpdaterThreadRun,
-                        this, wantRealtimeThreads());
+                        this, wantRealtimeThreads(), threadCpus_);
   if (!rc) {
     throw std::runtime_error("failed to spawn mcrouter stat updater thread");
   }
@@ -472,6 +646,60 @@ void McrouterInstance::spawnStatLoggerThread() {
   mcrouterLogger_->start();
 }
 
+void McrouterInstance::startStatsExporter() {
+  statsExporter_ = folly::make_unique<StatsExporter>(this);
+  statsExporter_->start();
+}
+
+void McrouterInstance::startTraceExporter() {
+  traceExporter_ = folly::make_unique<TraceExporter>(this);
+  traceExporter_->start();
+}
+
+void McrouterInstance::startStageProfiler() {
+  if (opts_.stage_profiler_interval_ms == 0) {
+    return;
+  }
+  taskScheduler_.scheduleTask(
+    opts_.stage_profiler_interval_ms,
+    [this](PeriodicTaskScheduler&) {
+      for (size_t i = 0; i < numProxies(); ++i) {
+        auto proxy = getProxy(i);
+        if (proxy && proxy->stageProfiler) {
+          proxy->stageProfiler->sample();
+        }
+      }
+    });
+}
+
+void McrouterInstance::startThreadArenasPurger() {
+  if (!opts_.thread_arenas || opts_.thread_arenas_purge_interval_ms == 0) {
+    return;
+  }
+  taskScheduler_.scheduleTask(
+    opts_.thread_arenas_purge_interval_ms,
+    [](PeriodicTaskScheduler&) {
+      JemallocArenas::purge();
+    });
+}
+
+void McrouterInstance::startSharedTkoHeartbeat() {
+  if (!sharedTkoTable_) {
+    return;
+  }
+  taskScheduler_.scheduleTask(
+    SharedTkoTable::kHeartbeatInterval.count(),
+    [this](PeriodicTaskScheduler&) {
+      sharedTkoTable_->heartbeat();
+    });
+}
+
+void McrouterInstance::setSpanSink(std::unique_ptr<SpanSinkIf> sink) {
+  if (traceExporter_) {
+    traceExporter_->setSink(std::move(sink));
+  }
+}
+
 void McrouterInstance::shutdownAndJoinAuxiliaryThreads() {
   shutdownLock_.shutdownOnce(
     [this]() {
@@ -497,6 +725,14 @@ void McrouterInstance::joinAuxiliaryThreads() {
     mcrouterLogger_->stop();
   }
 
+  if (statsExporter_) {
+    statsExporter_->stop();
+  }
+
+  if (traceExporter_) {
+    traceExporter_->stop();
+  }
+
   if (statUpdaterThreadStack_) {
     free(statUpdaterThreadStack_);
     statUpdaterThreadStack_ = nullptr;
@@ -543,15 +779,27 @@ bool McrouterInstance::reconfigure() {
 bool McrouterInstance::configure(folly::StringPiece input) {
   std::vector<std::shared_ptr<ProxyConfig>> newConfigs;
   try {
+    // current configs (nullptr before the first configuration),
+    // unchanged parts of them are reused
+    std::vector<std::shared_ptr<ProxyConfig>> oldConfigs(numProxies());
+    if (!opts_.disable_incremental_reload) {
+      for (size_t i = 0; i < oldConfigs.size(); i++) {
+        oldConfigs[i] =
+          std::dynamic_pointer_cast<ProxyConfig>(getProxy(i)->getConfig());
+      }
+    }
+
     // assume default_route, default_region and default_cluster are same for
     // each proxy
     ProxyConfigBuilder builder(
       opts_,
       configApi_.get(),
-      input);
+      input,
+      !oldConfigs.empty() ? oldConfigs[0].get() : nullptr);
 
-    for (size_t i = 0; i < opts_.num_proxies; i++) {
-      newConfigs.push_back(builder.buildConfig(getProxy(i)));
+    for (size_t i = 0; i < oldConfigs.size(); i++) {
+      newConfigs.push_back(builder.buildConfig(
+        getProxy(i), oldConfigs[i].get()));
     }
   } catch (const std::exception& e) {
     logFailure(this, failure::Category::kInvalidConfig,
@@ -559,12 +807,13 @@ bool McrouterInstance::configure(folly::StringPiece input) {
     return false;
   }
 
-  for (size_t i = 0; i < opts_.num_proxies; i++) {
+  for (size_t i = 0; i < newConfigs.size(); i++) {
     proxy_config_swap(getProxy(i), newConfigs[i]);
   }
+  lastConfig_ = input.str();
 
   VLOG_IF(0, !opts_.constantly_reload_configs) <<
-      "reconfigured " << opts_.num_proxies << " proxies with " <<
+      "reconfigured " << newConfigs.size() << " proxies with " <<
       newConfigs[0]->getClients().size() << " clients (" <<
       newConfigs[0]->getConfigMd5Digest() << ")";
 
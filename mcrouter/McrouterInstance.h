@@ -9,9 +9,12 @@
  */
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <folly/Range.h>
 
@@ -24,14 +27,23 @@
 #include "mcrouter/options.h"
 #include "mcrouter/pclient.h"
 #include "mcrouter/PeriodicTaskScheduler.h"
+#include "mcrouter/SharedTkoTable.h"
 #include "mcrouter/TkoCounters.h"
 
-namespace facebook { namespace memcache { namespace mcrouter {
+namespace facebook { namespace memcache {
+
+class SSLHandshakePool;
+
+namespace mcrouter {
 
 class AsyncWriter;
 class McrouterManager;
 class ProxyThread;
 class RuntimeVarsData;
+class SpanSinkIf;
+class StatsExporter;
+class TenantQuotas;
+class TraceExporter;
 using ObservableRuntimeVars =
   Observable<std::shared_ptr<const RuntimeVarsData>>;
 
@@ -54,6 +66,20 @@ class McrouterInstance {
   static McrouterInstance* init(folly::StringPiece persistence_id,
                                 const McrouterOptions& options);
 
+  /**
+   * Same-thread embedded mode: same as above, but instead of spawning
+   * proxy threads, proxy i is driven by evbs[i] (evbs.size() must be equal
+   * to options.num_proxies). The caller runs the event base loops, and
+   * clients created with createSameThreadClient() dispatch requests to the
+   * proxy synchronously, without crossing threads.
+   *
+   * The event bases must not be looping yet while the instance is created,
+   * and must outlive it (see freeAllMcrouters()).
+   */
+  static McrouterInstance* init(folly::StringPiece persistence_id,
+                                const McrouterOptions& options,
+                                const std::vector<folly::EventBase*>& evbs);
+
   /**
    * If an instance with the given persistence_id already exists,
    * returns a pointer to it. Otherwise returns nullptr.
@@ -86,6 +112,20 @@ class McrouterInstance {
                                        void* client_context,
                                        size_t maximum_outstanding_requests);
 
+  /**
+   * Same as createClient(), but for instances in same-thread embedded mode.
+   * Must be called on the thread running one of the event bases passed to
+   * init(): all requests are routed by that event base's proxy, send() must
+   * only be called on that thread and routes the requests right away.
+   * Callbacks are called on the same thread.
+   *
+   * @throw std::runtime_error  If not called on a proxy event base thread.
+   */
+  McrouterClient::Pointer createSameThreadClient(
+    mcrouter_client_callbacks_t callbacks,
+    void* client_context,
+    size_t maximum_outstanding_requests);
+
   const McrouterOptions& opts() const {
     return opts_;
   }
@@ -119,11 +159,61 @@ class McrouterInstance {
   }
 
   /**
-   * @return  nullptr if index is >= opts.num_proxies,
+   * @return  CPUs mcrouter threads should run on (see --thread-affinity),
+   *   empty if there's no restriction.
+   */
+  const std::vector<int>& threadCpus() const {
+    return threadCpus_;
+  }
+
+  /**
+   * @return  CPU proxy thread with given index should be pinned to,
+   *   empty if there's no restriction.
+   */
+  std::vector<int> proxyThreadCpus(size_t index) const;
+
+  /**
+   * @return  nullptr if index is >= numProxies(),
    *   pointer to the proxy otherwise.
    */
   proxy_t* getProxy(size_t index) const;
 
+  /**
+   * @return  number of proxies, opts.num_proxies unless resizeProxies()
+   *   added some. Proxies live as long as the instance, so getProxy(i) stays
+   *   valid for any i below it.
+   */
+  size_t numProxies() const {
+    return numProxies_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @return  number of proxies new clients are assigned to (the first ones),
+   *   the others are draining.
+   */
+  size_t numActiveProxies() const {
+    return numActiveProxies_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Changes the number of proxies new clients are assigned to, without
+   * a restart.
+   *
+   * Growing reactivates drained proxies first, then spawns new proxy
+   * threads (up to --max-proxies) configured with the current config.
+   * Shrinking drains the last proxies: they get no new clients, but keep
+   * serving the clients already assigned to them, as well as their waiting
+   * requests, and stay configured. Connections of their destinations close
+   * once idle (see --reset-inactive-connection-interval).
+   *
+   * Only supported in embedded mode with proxy threads, and without
+   * --proxy-key-affinity or --proxy-offload-threshold, which spread
+   * requests over a fixed set of proxies.
+   *
+   * @return  false if the router can't be resized to n proxies.
+   */
+  bool resizeProxies(size_t n);
+
   /**
    * @return  servers that recently received error replies.
    *   Format: {
@@ -133,6 +223,12 @@ class McrouterInstance {
    */
   std::unordered_map<std::string, std::pair<bool, size_t>> getSuspectServers();
 
+  /**
+   * Replaces where spans of traced requests go (see --trace-sample-rate),
+   * by default they're appended to --trace-export-file.
+   */
+  void setSpanSink(std::unique_ptr<SpanSinkIf> sink);
+
   pid_t pid() const {
     return pid_;
   }
@@ -178,6 +274,21 @@ class McrouterInstance {
     return *statsLogWriter_;
   }
 
+  /**
+   * Runs handshakes of SSL destinations, null unless
+   * --ssl-handshake-threads is set.
+   */
+  SSLHandshakePool* sslHandshakePool() {
+    return sslHandshakePool_.get();
+  }
+
+  /**
+   * Quotas of --proxy-tenant-quotas, null if none are set.
+   */
+  TenantQuotas* tenantQuotas() {
+    return tenantQuotas_.get();
+  }
+
  private:
   const McrouterOptions opts_;
 
@@ -186,6 +297,12 @@ class McrouterInstance {
   std::mutex nextProxyMutex_;
   unsigned int nextProxy_{0};
 
+  /* See numProxies() and numActiveProxies(). Proxies are only added under
+     configReconfigLock_, numActiveProxies_ is only changed under
+     nextProxyMutex_ as well. */
+  std::atomic<size_t> numProxies_{0};
+  std::atomic<size_t> numActiveProxies_{0};
+
   std::unique_ptr<ConfigApi> configApi_;
   CallbackPool<> onReconfigureSuccess_;
 
@@ -197,6 +314,10 @@ class McrouterInstance {
   // Lock to get before regenerating config structure
   std::mutex configReconfigLock_;
 
+  // Last config successfully applied, which proxies added by
+  // resizeProxies() start with
+  std::string lastConfig_;
+
   // Stat updater thread updates rate stat windows for each proxy
   pthread_t statUpdaterThreadHandle_{0};
   void* statUpdaterThreadStack_{nullptr};
@@ -225,6 +346,14 @@ class McrouterInstance {
   // Total number of boxes marked as TKO.
   TkoCounters tkoCounters_;
 
+  // TKO state shared with other processes, null unless
+  // --shared-tko-table is set. Must outlive pclientOwner_.
+  std::unique_ptr<SharedTkoTable> sharedTkoTable_;
+
+  std::unique_ptr<SSLHandshakePool> sslHandshakePool_;
+
+  std::unique_ptr<TenantQuotas> tenantQuotas_;
+
   ProxyClientOwner pclientOwner_;
 
   // Stores data for runtime variables.
@@ -238,6 +367,16 @@ class McrouterInstance {
    */
   std::unique_ptr<McrouterLogger> mcrouterLogger_;
 
+  /**
+   * Serves stats in OpenMetrics format if opts->stats_export_port is set
+   */
+  std::unique_ptr<StatsExporter> statsExporter_;
+
+  /**
+   * Exports spans of traced requests if opts->trace_sample_rate is set
+   */
+  std::unique_ptr<TraceExporter> traceExporter_;
+
   /*
    * Asynchronous writer.
    */
@@ -257,18 +396,21 @@ class McrouterInstance {
   std::unordered_map<std::string, std::string> additionalStartupOpts_;
 
   /**
-   * Exactly one of these vectors will contain opts.num_proxies elements,
+   * Exactly one of these vectors will contain numProxies() elements,
    * others will be empty.
    *
-   * Standalone/sync mode: we don't startup proxy threads, so Mcrouter
-   * owns the proxies directly.
+   * Standalone/sync and same-thread embedded modes: we don't startup proxy
+   * threads, so Mcrouter owns the proxies directly.
    *
    * Embedded mode: Mcrouter owns ProxyThreads, which managed the lifetime
-   * of proxies on their own threads.
+   * of proxies on their own threads. Capacity is reserved for --max-proxies
+   * up front, so that getProxy() may run while resizeProxies() appends.
    */
   std::vector<std::unique_ptr<proxy_t>> proxies_;
   std::vector<std::unique_ptr<ProxyThread>> proxyThreads_;
 
+  std::vector<int> threadCpus_;
+
   /**
    * Create a new mcrouter instance.
    * @return  Pointer to the newly brought up instance or nullptr
@@ -276,14 +418,22 @@ class McrouterInstance {
    * @throw runtime_error  If no valid instance can be constructed from
    *   the provided options.
    */
-  static McrouterInstance* create(const McrouterOptions& input_options,
-                                  bool spawnProxyThreads = true);
+  static McrouterInstance* create(
+    const McrouterOptions& input_options,
+    bool spawnProxyThreads = true,
+    const std::vector<folly::EventBase*>& evbs =
+      std::vector<folly::EventBase*>());
 
   explicit McrouterInstance(const McrouterOptions& input_options);
 
   ~McrouterInstance();
 
-  bool spinUp(bool spawnProxyThreads);
+  /**
+   * @param evbs  If not empty, proxies are attached to these event bases
+   *              instead of running on their own threads.
+   */
+  bool spinUp(bool spawnProxyThreads,
+              const std::vector<folly::EventBase*>& evbs);
   void tearDown();
 
   void startAwriterThreads();
@@ -298,6 +448,11 @@ class McrouterInstance {
   static void* statUpdaterThreadRun(void* arg);
   void spawnStatUpdaterThread();
   void spawnStatLoggerThread();
+  void startStatsExporter();
+  void startTraceExporter();
+  void startStageProfiler();
+  void startThreadArenasPurger();
+  void startSharedTkoHeartbeat();
   void startObservingRuntimeVarsFile();
   void onClientDestroyed();
 
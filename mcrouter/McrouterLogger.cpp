@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <ctime>
 #include <string>
 
 #include <boost/filesystem/operations.hpp>
@@ -22,18 +23,19 @@
 #include <folly/json.h>
 #include <folly/ThreadName.h>
 
-#include "mcrouter/lib/fbi/asox_timer.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/fbi/debug.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/McrouterLogFailure.h"
 #include "mcrouter/stats.h"
+#include "mcrouter/ThreadUtil.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
 namespace {
 
 const char* kStatsSfx = "stats";
+const char* kStatsDeltaSfx = "stats_delta";
 const char* kStatsStartupOptionsSfx = "startup_options";
 const char* kConfigSourcesInfoFileName = "config_sources_info";
 
@@ -106,6 +108,41 @@ void write_stats_file(const McrouterOptions& opts,
   write_file(opts, suffix, statsString);
 }
 
+/**
+ * Adds stat to jstats under "<stats key>.<name>" if it's logged to disk.
+ */
+void add_logged_stat(const McrouterOptions& opts,
+                     const std::string& prefix,
+                     const stat_t& stat,
+                     folly::dynamic& jstats) {
+  if (opts.logging_rtt_outlier_threshold_us == 0 &&
+      (stat.group & outlier_stats)) {
+    // outlier detection is disabled
+    return;
+  }
+  if (!(stat.group & ods_stats)) {
+    return;
+  }
+
+  auto key = prefix + stat.name.str();
+  switch (stat.type) {
+    case stat_uint64:
+      jstats[key] = stat.data.uint64;
+      break;
+
+    case stat_int64:
+      jstats[key] = stat.data.int64;
+      break;
+
+    case stat_double:
+      jstats[key] = stat.data.dbl;
+      break;
+
+    default:
+      break;
+  }
+}
+
 void write_stats_to_disk(const McrouterOptions& opts,
                          const std::vector<stat_t>& stats) {
   try {
@@ -113,31 +150,7 @@ void write_stats_to_disk(const McrouterOptions& opts,
     folly::dynamic jstats = folly::dynamic::object;
 
     for (size_t i = 0; i < stats.size(); ++i) {
-      if (opts.logging_rtt_outlier_threshold_us == 0 &&
-          (stats[i].group & outlier_stats)) {
-        // outlier detection is disabled
-        continue;
-      }
-      if (stats[i].group & ods_stats) {
-        auto key = prefix + stats[i].name.str();
-
-        switch (stats[i].type) {
-          case stat_uint64:
-            jstats[key] = stats[i].data.uint64;
-            break;
-
-          case stat_int64:
-            jstats[key] = stats[i].data.int64;
-            break;
-
-          case stat_double:
-            jstats[key] = stats[i].data.dbl;
-            break;
-
-          default:
-            continue;
-        }
-      }
+      add_logged_stat(opts, prefix, stats[i], jstats);
     }
 
     write_stats_file(opts, kStatsSfx, jstats);
@@ -146,12 +159,48 @@ void write_stats_to_disk(const McrouterOptions& opts,
   }
 }
 
-void write_config_sources_info_to_disk(McrouterInstance* router) {
-  auto config_info_json = router->configApi().getConfigSourcesInfo();
+/**
+ * Appends one line with the changed stats to the delta file:
+ *   {"checkpoint":false,"time":<unix time>,"stats":{"<key>":value,...}}
+ * A checkpoint starts the file over, so it only ever holds the last
+ * checkpoint and the deltas since.
+ */
+void write_stats_delta_to_disk(const McrouterOptions& opts,
+                               const std::vector<stat_t>& stats,
+                               const std::vector<size_t>& changed,
+                               bool checkpoint) {
+  try {
+    if (!ensure_dir_exists_and_writeable(opts.stats_root)) {
+      return;
+    }
+
+    std::string prefix = get_stats_key(opts) + ".";
+    folly::dynamic jstats = folly::dynamic::object;
+    for (auto i : changed) {
+      add_logged_stat(opts, prefix, stats[i], jstats);
+    }
+    folly::dynamic line = folly::dynamic::object
+      ("checkpoint", checkpoint)
+      ("time", static_cast<int64_t>(time(nullptr)))
+      ("stats", std::move(jstats));
+    auto str = folly::toJson(line).toStdString() + "\n";
+
+    auto path = stats_file_path(opts, kStatsDeltaSfx);
+    if (checkpoint) {
+      atomicallyWriteFileToDisk(str, path);
+    } else {
+      appendStringToFile(str, path);
+    }
+  } catch (...) {
+    // Do nothing
+  }
+}
 
+void write_config_sources_info_to_disk(const McrouterOptions& opts,
+                                       const folly::dynamic& config_info_json) {
   try {
-    boost::filesystem::path path(router->opts().stats_root);
-    path /= get_stats_key(router->opts()) + "." + kConfigSourcesInfoFileName;
+    boost::filesystem::path path(opts.stats_root);
+    path /= get_stats_key(opts) + "." + kConfigSourcesInfoFileName;
     atomicallyWriteFileToDisk(
       folly::toPrettyJson(config_info_json).toStdString(),
       path.string());
@@ -166,6 +215,7 @@ McrouterLogger::McrouterLogger(McrouterInstance* router,
   std::unique_ptr<AdditionalLoggerIf> additionalLogger)
     : router_(router),
       additionalLogger_(std::move(additionalLogger)),
+      statsDelta_(router->opts().stats_logging_checkpoint_interval),
       pid_(getpid()) {
 }
 
@@ -196,6 +246,7 @@ bool McrouterLogger::start() {
     loggerThread_ = std::thread(
         std::bind(&McrouterLogger::loggerThreadRun, this));
     folly::setThreadName(loggerThread_.native_handle(), threadName);
+    setThreadAffinity(loggerThread_.native_handle(), router_->threadCpus());
   } catch (const std::system_error& e) {
     running_ = false;
     logFailure(router_, memcache::failure::Category::kSystemError,
@@ -268,16 +319,33 @@ void McrouterLogger::log() {
     }
   }
 
-  write_stats_to_disk(router_->opts(), stats);
-  write_config_sources_info_to_disk(router_);
+  const auto& opts = router_->opts();
+  auto configInfo = router_->configApi().getConfigSourcesInfo();
+  if (opts.stats_logging_checkpoint_interval == 0) {
+    write_stats_to_disk(opts, stats);
+    write_config_sources_info_to_disk(opts, configInfo);
+    if (additionalLogger_) {
+      additionalLogger_->log(stats);
+    }
+  } else {
+    std::vector<size_t> changed;
+    bool checkpoint = statsDelta_.update(stats, changed);
+    if (checkpoint) {
+      write_stats_to_disk(opts, stats);
+    }
+    write_stats_delta_to_disk(opts, stats, changed, checkpoint);
+    if (checkpoint || configInfo != lastConfigSourcesInfo_) {
+      write_config_sources_info_to_disk(opts, configInfo);
+      lastConfigSourcesInfo_ = std::move(configInfo);
+    }
+    if (additionalLogger_) {
+      additionalLogger_->logDelta(stats, changed, checkpoint);
+    }
+  }
 
   for (const auto& filepath : touchStatsFilepaths_) {
     touchFile(filepath);
   }
-
-  if (additionalLogger_) {
-    additionalLogger_->log(stats);
-  }
 }
 
 }}}  // facebook::memcache::mcrouter
@@ -17,6 +17,10 @@
 #include <thread>
 #include <vector>
 
+#include <folly/dynamic.h>
+
+#include "mcrouter/StatsDelta.h"
+
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class McrouterInstance;
@@ -27,6 +31,21 @@ public:
   virtual ~AdditionalLoggerIf() {}
 
   virtual void log(const std::vector<stat_t>& stats) = 0;
+
+  /**
+   * Called instead of log() if --stats-logging-checkpoint-interval is set.
+   *
+   * @param changed     indices into stats of the numeric stats that changed
+   *                    since the previous call (all of them on checkpoints)
+   * @param checkpoint  true every stats_logging_checkpoint_interval calls
+   *
+   * By default forwards all stats to log().
+   */
+  virtual void logDelta(const std::vector<stat_t>& stats,
+                        const std::vector<size_t>& changed,
+                        bool checkpoint) {
+    log(stats);
+  }
 };
 
 class McrouterLogger {
@@ -74,6 +93,13 @@ class McrouterLogger {
    */
   std::vector<std::string> touchStatsFilepaths_;
 
+  /**
+   * Last logged stats and config sources info, see
+   * --stats-logging-checkpoint-interval
+   */
+  StatsDelta statsDelta_;
+  folly::dynamic lastConfigSourcesInfo_{nullptr};
+
   pid_t pid_;
   std::thread loggerThread_;
   std::mutex loggerThreadMutex_;
@@ -0,0 +1,160 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "OutlierDetector.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+template <class T>
+T median(std::vector<T> values) {
+  auto mid = values.begin() + values.size() / 2;
+  std::nth_element(values.begin(), mid, values.end());
+  return *mid;
+}
+
+}  // anonymous namespace
+
+constexpr double OutlierDetector::kLatencyQuantile;
+constexpr size_t OutlierDetector::kMinPeers;
+
+void OutlierDetector::Member::clear(size_t window) {
+  requests[window] = 0;
+  errors[window] = 0;
+  latency[window] = LatencyHistogram();
+}
+
+OutlierDetector::OutlierDetector(size_t size, Options options)
+    : options_(std::move(options)),
+      members_(size) {
+}
+
+bool OutlierDetector::isEjected(size_t idx, int64_t nowUs) {
+  auto& member = members_[idx];
+  if (member.ejectedUntilUs == 0) {
+    return false;
+  }
+  if (nowUs < member.ejectedUntilUs) {
+    return true;
+  }
+  member.ejectedUntilUs = 0;
+  member.clear(0);
+  member.clear(1);
+  --numEjected_;
+  return false;
+}
+
+size_t OutlierDetector::onReply(size_t idx, bool error, int64_t latencyUs,
+                                int64_t nowUs) {
+  auto& member = members_[idx];
+  if (member.ejectedUntilUs == 0) {
+    ++member.requests[current_];
+    if (error) {
+      ++member.errors[current_];
+    }
+    member.latency[current_].insertSample(std::max<int64_t>(latencyUs, 0));
+  }
+
+  if (nextEvaluationUs_ == 0) {
+    nextEvaluationUs_ = nowUs + options_.intervalUs;
+    return 0;
+  }
+  if (nowUs < nextEvaluationUs_) {
+    return 0;
+  }
+  nextEvaluationUs_ = nowUs + options_.intervalUs;
+  auto ejected = evaluate(nowUs);
+
+  current_ ^= 1;
+  for (auto& m : members_) {
+    m.clear(current_);
+  }
+  return ejected;
+}
+
+size_t OutlierDetector::evaluate(int64_t nowUs) {
+  struct Candidate {
+    size_t idx;
+    double errorRate;
+    uint64_t latencyUs;
+  };
+  std::vector<Candidate> candidates;
+  for (size_t i = 0; i < members_.size(); ++i) {
+    if (isEjected(i, nowUs)) {
+      continue;
+    }
+    auto& member = members_[i];
+    auto requests = member.requests[0] + member.requests[1];
+    if (requests < options_.minRequests || requests == 0) {
+      continue;
+    }
+    LatencyHistogram latency = member.latency[0];
+    latency.merge(member.latency[1]);
+    candidates.push_back({
+      i,
+      static_cast<double>(member.errors[0] + member.errors[1]) / requests,
+      latency.quantile(kLatencyQuantile)
+    });
+  }
+  if (candidates.size() < kMinPeers) {
+    return 0;
+  }
+
+  /* Small pools can still eject one destination */
+  auto maxEjected = static_cast<size_t>(
+    members_.size() * options_.maxEjectedFraction);
+  if (options_.maxEjectedFraction > 0) {
+    maxEjected = std::max<size_t>(maxEjected, 1);
+  }
+  if (numEjected_ >= maxEjected) {
+    return 0;
+  }
+
+  std::vector<double> errorRates;
+  std::vector<uint64_t> latencies;
+  for (const auto& c : candidates) {
+    errorRates.push_back(c.errorRate);
+    latencies.push_back(c.latencyUs);
+  }
+  auto maxErrorRate = median(std::move(errorRates)) + options_.errorRateMargin;
+  auto maxLatencyUs = median(std::move(latencies)) * options_.latencyRatio;
+
+  /* How far over the limits a destination is, ejection order */
+  std::vector<std::pair<double, size_t>> outliers;
+  for (const auto& c : candidates) {
+    auto score = std::max(
+      maxErrorRate > 0 ? c.errorRate / maxErrorRate : 0.0,
+      maxLatencyUs > 0 ? c.latencyUs / maxLatencyUs : 0.0);
+    if (score > 1.0) {
+      outliers.emplace_back(score, c.idx);
+    }
+  }
+  std::sort(outliers.begin(), outliers.end(),
+            [](const std::pair<double, size_t>& a,
+               const std::pair<double, size_t>& b) {
+              return a.first > b.first;
+            });
+
+  size_t ejected = 0;
+  for (const auto& outlier : outliers) {
+    if (numEjected_ >= maxEjected) {
+      break;
+    }
+    members_[outlier.second].ejectedUntilUs = nowUs + options_.ejectionUs;
+    ++numEjected_;
+    ++ejected;
+  }
+  return ejected;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mcrouter/LatencyHistogram.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Ejects destinations of a pool that are much slower or fail much more often
+ * than their peers ("gray failures" that never reach the TKO threshold).
+ *
+ * Every interval the error rate and the kLatencyQuantile latency of each
+ * destination over the last two intervals are compared to the medians of
+ * the pool. A destination is an outlier if its error rate is more than
+ * errorRateMargin above the median, or its latency is more than latencyRatio
+ * times the median. Outliers are ejected for ejectionUs, worst first, as long
+ * as at most maxEjectedFraction of the pool (but at least one destination,
+ * unless the fraction is 0) is ejected. Once the ejection expires, the
+ * destination has to collect minRequests again before it can be judged.
+ *
+ * Not thread safe.
+ */
+class OutlierDetector {
+ public:
+  static constexpr double kLatencyQuantile = 0.99;
+  /* Outliers are only meaningful if there are enough peers to compare to */
+  static constexpr size_t kMinPeers = 3;
+
+  struct Options {
+    int64_t intervalUs{1000000};
+    /* Destinations with fewer requests in the window aren't judged */
+    uint64_t minRequests{100};
+    double errorRateMargin{0.1};
+    double latencyRatio{3.0};
+    double maxEjectedFraction{0.1};
+    int64_t ejectionUs{30000000};
+  };
+
+  OutlierDetector(size_t size, Options options);
+
+  size_t size() const {
+    return members_.size();
+  }
+
+  /**
+   * @return true if destination idx is currently ejected
+   */
+  bool isEjected(size_t idx, int64_t nowUs);
+
+  /**
+   * Result of a request sent to destination idx.
+   *
+   * @return number of destinations ejected by this call
+   */
+  size_t onReply(size_t idx, bool error, int64_t latencyUs, int64_t nowUs);
+
+  size_t numEjected() const {
+    return numEjected_;
+  }
+
+ private:
+  struct Member {
+    uint64_t requests[2] = {0, 0};
+    uint64_t errors[2] = {0, 0};
+    LatencyHistogram latency[2];
+    /* 0 if not ejected */
+    int64_t ejectedUntilUs{0};
+
+    void clear(size_t window);
+  };
+
+  const Options options_;
+  std::vector<Member> members_;
+  size_t numEjected_{0};
+  /* Index of the window being filled, the other one is the previous */
+  size_t current_{0};
+  int64_t nextEvaluationUs_{0};
+
+  size_t evaluate(int64_t nowUs);
+};
+
+}}}  // facebook::memcache::mcrouter
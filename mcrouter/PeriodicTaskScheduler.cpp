@@ -37,10 +37,17 @@ void PeriodicTaskScheduler::scheduleTask(
 PeriodicTaskScheduler::PeriodicTaskScheduler()
   : shutdown_(false) {}
 
+void PeriodicTaskScheduler::onShutdown(std::function<void()> func) {
+  shutdownCallbacks_.push_back(std::move(func));
+}
+
 void PeriodicTaskScheduler::shutdownAllTasks() {
   if (shutdown_.exchange(true)) {
     throw std::runtime_error("Received a second call on shutdownAllTasks.");
   }
+  for (auto& func : shutdownCallbacks_) {
+    func();
+  }
   cv_.notify_all();
   for (auto& task: tasks_) {
     task->t.join();
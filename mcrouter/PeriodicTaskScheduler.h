@@ -11,6 +11,7 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -34,6 +35,13 @@ class PeriodicTaskScheduler {
   void scheduleTask(int32_t tmo_ms,
                     std::function<void(PeriodicTaskScheduler&)> func);
 
+  /**
+   * Registers func to be called by shutdownAllTasks() before the threads are
+   * joined. Ties work that doesn't run on the scheduler's own threads
+   * (see FileObserver) to the scheduler's lifetime.
+   */
+  void onShutdown(std::function<void()> func);
+
   /**
    * Notifies all threads to shutdown and joins them.
    * Can only be called once. Upon exit all threads are guaranteed
@@ -69,6 +77,7 @@ class PeriodicTaskScheduler {
   std::condition_variable cv_;
   std::atomic_bool shutdown_;
   std::vector<std::unique_ptr<TaskThread>> tasks_;
+  std::vector<std::function<void()>> shutdownCallbacks_;
   void schedulerThreadRun(TaskThread& task);
 };
 
@@ -9,10 +9,17 @@
  */
 #include "PoolFactory.h"
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <string>
+#include <thread>
+
 #include <folly/json.h>
 
 #include "mcrouter/ClientPool.h"
 #include "mcrouter/ConfigApi.h"
+#include "mcrouter/lib/config/JsonParser.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/McrouterLogFailure.h"
 #include "mcrouter/options.h"
@@ -38,8 +45,12 @@ mc_protocol_t parseProtocol(const folly::dynamic& obj, mc_protocol_t def) {
     auto str = jprotocol->stringPiece();
     if (equalStr("ascii", str, folly::asciiCaseInsensitive)) {
       return mc_ascii_protocol;
+    } else if (equalStr("binary", str, folly::asciiCaseInsensitive)) {
+      return mc_binary_protocol;
     } else if (equalStr("umbrella", str, folly::asciiCaseInsensitive)) {
       return mc_umbrella_protocol;
+    } else if (equalStr("meta", str, folly::asciiCaseInsensitive)) {
+      return mc_ascii_meta_protocol;
     } else {
       logFailure(memcache::failure::Category::kInvalidConfig,
                  "Unknown protocol '{}'", str);
@@ -48,24 +59,112 @@ mc_protocol_t parseProtocol(const folly::dynamic& obj, mc_protocol_t def) {
   return def;
 }
 
+/**
+ * What a client used to take on top of what it takes now: a copy of the
+ * pool settings and of its destination key, 32 bit key ids instead of
+ * pointers to the interned keys, and a 64 bit index.
+ */
+int64_t clientBytesSaved(const ProxyClientCommon& client) {
+  static const size_t kInlineChars = std::string().capacity();
+  int64_t saved = sizeof(PoolSettings) - sizeof(const PoolSettings*);
+  saved += sizeof(std::string) - sizeof(const std::string*);
+  if (client.destination_key.size() > kInlineChars) {
+    saved += client.destination_key.size() + 1;
+  }
+  saved += sizeof(size_t) - sizeof(client.indexInPool);
+  saved -= 2 * (sizeof(void*) - sizeof(uint32_t));
+  return saved;
+}
+
 }  // anonymous namespace
 
 PoolFactory::PoolFactory(const folly::dynamic& config,
                          ConfigApi& configApi,
-                         const McrouterOptions& opts)
+                         const McrouterOptions& opts,
+                         const PoolFactory* previous)
   : configApi_(configApi),
     opts_(opts) {
 
   checkLogic(config.isObject(), "config is not an object");
-  if (auto jpools = config.get_ptr("pools")) {
-    checkLogic(jpools->isObject(), "config: 'pools' is not an object");
+  auto jpools = config.get_ptr("pools");
+  if (!jpools) {
+    return;
+  }
+  checkLogic(jpools->isObject(), "config: 'pools' is not an object");
+
+  struct Task {
+    std::string name;
+    const folly::dynamic* json;
+    bool reusable;
+    JsonFingerprint fingerprint;
+    std::shared_ptr<ClientPool> pool;
+    std::exception_ptr error;
+  };
+  std::vector<Task> tasks;
+  tasks.reserve(jpools->size());
+  for (const auto& it : jpools->items()) {
+    Task task{it.first.stringPiece().str(), &it.second, false,
+              JsonFingerprint(), nullptr, nullptr};
+    // pools that are (partially) fetched from ConfigApi may change without
+    // any change of the config
+    if (it.second.isObject() && !it.second.count("inherit")) {
+      task.reusable = true;
+      task.fingerprint = jsonFingerprint(it.second);
+      if (previous) {
+        auto prevIt = previous->fingerprints_.find(task.name);
+        if (prevIt != previous->fingerprints_.end() &&
+            prevIt->second == task.fingerprint) {
+          task.pool = previous->pools_.at(task.name);
+        }
+      }
+    }
+    tasks.push_back(std::move(task));
+  }
+
+  std::atomic<size_t> next{0};
+  auto worker = [this, &tasks, &next]() {
+    for (auto i = next++; i < tasks.size(); i = next++) {
+      auto& task = tasks[i];
+      if (task.pool) {
+        continue;
+      }
+      try {
+        auto resolved = resolvePool(task.name, *task.json);
+        task.pool = buildPool(task.name,
+                              resolved.isNull() ? *task.json : resolved);
+      } catch (...) {
+        task.error = std::current_exception();
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(opts_.config_pool_threads, tasks.size());
+       ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
 
-    for (const auto& it : jpools->items()) {
-      parsePool(it.first.stringPiece().str(), it.second);
+  // in config order, so that clients() and the error don't depend on timing
+  for (auto& task : tasks) {
+    if (task.error) {
+      std::rethrow_exception(task.error);
+    }
+    addPool(task.name, std::move(task.pool));
+    if (task.reusable) {
+      fingerprints_.emplace(std::move(task.name), task.fingerprint);
     }
   }
 }
 
+std::shared_ptr<ClientPool>
+PoolFactory::findPool(const std::string& name) const {
+  auto it = pools_.find(name);
+  return it == pools_.end() ? nullptr : it->second;
+}
+
 std::shared_ptr<ClientPool>
 PoolFactory::parsePool(const folly::dynamic& json) {
   checkLogic(json.isString() || json.isObject(),
@@ -86,30 +185,56 @@ PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
     return seenPoolIt->second;
   }
 
+  auto resolved = resolvePool(name, json);
+  auto pool = buildPool(name, resolved.isNull() ? json : resolved);
+  addPool(name, pool);
+  return pool;
+}
+
+void PoolFactory::addPool(const std::string& name,
+                          std::shared_ptr<ClientPool> pool) {
+  for (const auto& client : pool->getClients()) {
+    savedBytes_ += clientBytesSaved(*client);
+  }
+  clients_.insert(clients_.end(), pool->getClients().begin(),
+                  pool->getClients().end());
+  pools_.emplace(name, std::move(pool));
+}
+
+folly::dynamic PoolFactory::resolvePool(const std::string& name,
+                                        const folly::dynamic& json) const {
   if (json.isString()) {
     // get the pool from ConfigApi
     std::string jsonStr;
     checkLogic(configApi_.get(ConfigType::Pool, name, jsonStr),
                "Can not read pool: {}", name);
-    return parsePool(name, parseJsonString(jsonStr));
-  } else {
-    // one day we may add inheriting from local pool
-    if (auto jinherit = json.get_ptr("inherit")) {
-      checkLogic(jinherit->isString(),
-                 "Pool {}: inherit is not a string", name);
-      auto path = jinherit->stringPiece().str();
-      std::string jsonStr;
-      checkLogic(configApi_.get(ConfigType::Pool, path, jsonStr),
-                 "Can not read pool from: {}", path);
-      auto newJson = parseJsonString(jsonStr);
-      for (auto& it : json.items()) {
-        newJson.insert(it.first, it.second);
-      }
-      newJson.erase("inherit");
-      return parsePool(name, newJson);
-    }
+    auto newJson = parseJsonWithComments(jsonStr);
+    auto resolved = resolvePool(name, newJson);
+    return resolved.isNull() ? std::move(newJson) : std::move(resolved);
   }
 
+  // one day we may add inheriting from local pool
+  auto jinherit = json.get_ptr("inherit");
+  if (!jinherit) {
+    return nullptr;
+  }
+  checkLogic(jinherit->isString(), "Pool {}: inherit is not a string", name);
+  auto path = jinherit->stringPiece().str();
+  std::string jsonStr;
+  checkLogic(configApi_.get(ConfigType::Pool, path, jsonStr),
+             "Can not read pool from: {}", path);
+  auto newJson = parseJsonWithComments(jsonStr);
+  for (auto& it : json.items()) {
+    newJson.insert(it.first, it.second);
+  }
+  newJson.erase("inherit");
+  auto resolved = resolvePool(name, newJson);
+  return resolved.isNull() ? std::move(newJson) : std::move(resolved);
+}
+
+std::shared_ptr<ClientPool>
+PoolFactory::buildPool(const std::string& name,
+                       const folly::dynamic& json) const {
   // pool_locality
   std::chrono::milliseconds timeout{opts_.server_timeout_ms};
   if (auto jlocality = json.get_ptr("pool_locality")) {
@@ -189,6 +314,36 @@ PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
     }
   }
 
+  AdaptiveTimeoutSettings adaptiveTimeout;
+  adaptiveTimeout.pct = opts_.target_adaptive_timeout_pct;
+  adaptiveTimeout.min =
+    std::chrono::milliseconds(opts_.target_adaptive_timeout_min_ms);
+  adaptiveTimeout.max =
+    std::chrono::milliseconds(opts_.target_adaptive_timeout_max_ms);
+  if (auto jadaptive = json.get_ptr("adaptive_timeout")) {
+    if (jadaptive->isBool() && !jadaptive->getBool()) {
+      adaptiveTimeout.pct = 0;
+    } else {
+      checkLogic(jadaptive->isObject(),
+                 "Pool {}: adaptive_timeout is not an object or false", name);
+      auto parseInt = [&jadaptive, &name](const char* key, int64_t def) {
+        auto jvalue = jadaptive->get_ptr(key);
+        if (!jvalue) {
+          return def;
+        }
+        checkLogic(jvalue->isInt() && jvalue->getInt() >= 0,
+                   "Pool {}: adaptive_timeout {} is not a non-negative int",
+                   name, key);
+        return jvalue->getInt();
+      };
+      adaptiveTimeout.pct = parseInt("p99_pct", adaptiveTimeout.pct);
+      adaptiveTimeout.min = std::chrono::milliseconds(
+        parseInt("min_ms", adaptiveTimeout.min.count()));
+      adaptiveTimeout.max = std::chrono::milliseconds(
+        parseInt("max_ms", adaptiveTimeout.max.count()));
+    }
+  }
+
   auto protocol = parseProtocol(json, mc_ascii_protocol);
 
   bool keep_routing_prefix = false;
@@ -214,11 +369,33 @@ PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
     useSsl = juseSsl->getBool();
   }
 
+  size_t connections = 1;
+  if (auto jconnections = json.get_ptr("connections_per_destination")) {
+    checkLogic(jconnections->isInt() && jconnections->getInt() > 0,
+               "Pool {}: connections_per_destination is not a positive int",
+               name);
+    connections = jconnections->getInt();
+  }
+
+  bool spareConnection = false;
+  if (auto jspare = json.get_ptr("spare_connection")) {
+    checkLogic(jspare->isBool(), "Pool {}: spare_connection is not a bool",
+               name);
+    spareConnection = jspare->getBool();
+  }
+
   // servers
   auto jservers = json.get_ptr("servers");
   checkLogic(jservers, "Pool {}: servers not found", name);
   checkLogic(jservers->isArray(), "Pool {}: servers is not an array", name);
-  auto clientPool = std::make_shared<ClientPool>(name);
+  PoolSettings settings;
+  settings.server_timeout = timeout;
+  settings.adaptiveTimeout = adaptiveTimeout;
+  settings.keep_routing_prefix = keep_routing_prefix;
+  settings.deleteTime = deleteTime;
+  settings.connections = connections;
+  settings.spareConnection = spareConnection;
+  auto clientPool = std::make_shared<ClientPool>(name, std::move(settings));
   for (size_t i = 0; i < jservers->size(); ++i) {
     const auto& server = jservers->at(i);
     AccessPoint ap;
@@ -257,15 +434,7 @@ PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
                  "Pool {}: invalid server #{}", name, i);
     }
 
-    auto client = clientPool->emplaceClient(
-      timeout,
-      std::move(ap),
-      keep_routing_prefix,
-      serverUseSsl,
-      serverQos,
-      deleteTime);
-
-    clients_.push_back(std::move(client));
+    clientPool->emplaceClient(std::move(ap), serverUseSsl, serverQos);
   } // servers
 
   // weights
@@ -273,7 +442,6 @@ PoolFactory::parsePool(const std::string& name, const folly::dynamic& json) {
     clientPool->setWeights(*jweights);
   }
 
-  pools_.emplace(name, clientPool);
   return clientPool;
 }
 
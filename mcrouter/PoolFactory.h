@@ -9,11 +9,14 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "mcrouter/lib/config/JsonFingerprint.h"
+
 namespace folly {
 class dynamic;
 }
@@ -38,9 +41,16 @@ class PoolFactory {
    * @param configApi API to fetch pools from files. Should be
    *                  reference once we'll remove 'routerless' mode.
    * @param mcOpts mcrouter options for parsing.
+   * @param previous factory of the previous config. Pools from config
+   *                 'pools' property that didn't change are reused from it.
+   *
+   * Pools from config 'pools' property are built on up to
+   * opts.config_pool_threads threads; the result (and the error, if any)
+   * is the same as if they were built one at a time.
    */
   PoolFactory(const folly::dynamic& config, ConfigApi& configApi,
-              const McrouterOptions& opts);
+              const McrouterOptions& opts,
+              const PoolFactory* previous = nullptr);
 
   /**
    * Parses a single pool from given json blob.
@@ -49,6 +59,11 @@ class PoolFactory {
    */
   std::shared_ptr<ClientPool> parsePool(const folly::dynamic& jpool);
 
+  /**
+   * @return pool with given name if it was already parsed, nullptr otherwise.
+   */
+  std::shared_ptr<ClientPool> findPool(const std::string& name) const;
+
   /**
    * @return All clients created.
    */
@@ -56,14 +71,41 @@ class PoolFactory {
     return clients_;
   }
 
+  /**
+   * @return  bytes all clients would take on top of what they take,
+   *          without PoolSettings shared by their pool and interned keys.
+   */
+  int64_t clientBytesSaved() const {
+    return savedBytes_;
+  }
+
  private:
   std::unordered_map<std::string, std::shared_ptr<ClientPool>> pools_;
   std::vector<std::shared_ptr<const ProxyClientCommon>> clients_;
+  int64_t savedBytes_{0};
+  /// pool name -> fingerprint of its JSON, for pools that can be reused
+  std::unordered_map<std::string, JsonFingerprint> fingerprints_;
   ConfigApi& configApi_;
   const McrouterOptions& opts_;
 
   std::shared_ptr<ClientPool>
   parsePool(const std::string& name, const folly::dynamic& jpool);
+
+  /**
+   * @return  JSON of the pool read from ConfigApi (if jpool is a string) and
+   *          with 'inherit' applied, nullptr if jpool needs neither.
+   */
+  folly::dynamic resolvePool(const std::string& name,
+                             const folly::dynamic& jpool) const;
+
+  /**
+   * Builds the pool and its clients from resolved JSON. Doesn't modify the
+   * factory, so that pools can be built from several threads.
+   */
+  std::shared_ptr<ClientPool>
+  buildPool(const std::string& name, const folly::dynamic& jpool) const;
+
+  void addPool(const std::string& name, std::shared_ptr<ClientPool> pool);
 };
 
 }}} // facebook::memcache::mcrouter
@@ -0,0 +1,44 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "PoolTkoTracker.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+PoolTkoTracker::PoolTkoTracker(std::string name,
+                               size_t thresholdPct,
+                               size_t samplePct)
+    : name_(std::move(name)),
+      thresholdPct_(thresholdPct),
+      sampleStride_(100 / std::max<size_t>(std::min<size_t>(samplePct, 100),
+                                           1)) {
+}
+
+bool PoolTkoTracker::onTko() {
+  tko_.fetch_add(1, std::memory_order_relaxed);
+  return tickets_.fetch_add(1, std::memory_order_relaxed) % sampleStride_ == 0;
+}
+
+void PoolTkoTracker::onTkoEnd(bool recovered) {
+  tko_.fetch_sub(1, std::memory_order_relaxed);
+  if (recovered) {
+    recoveries_.fetch_add(1, std::memory_order_release);
+  }
+}
+
+bool PoolTkoTracker::mostlyDead() const {
+  auto poolSize = size();
+  return thresholdPct_ != 0 && poolSize != 0 &&
+         tkoCount() * 100 >= poolSize * thresholdPct_;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * TKO state of a whole pool, shared by the proxies of a router
+ * (see ProxyClientOwner::getPoolTkoTracker()).
+ *
+ * Counts the pool's destinations that are TKO, i.e. the ones with a
+ * responsible ProxyDestination sending probes (one per destination and
+ * process, see TkoTracker). Once at least thresholdPct of the pool is TKO,
+ * the pool is mostly dead (e.g. a whole rack went down): only the sampled
+ * destinations need to keep probing and the others can extrapolate from
+ * them. Every destination that comes back bumps recoveries(), so that
+ * the ones not probing find out.
+ */
+class PoolTkoTracker {
+ public:
+  /**
+   * @param thresholdPct  share of TKO destinations that makes the pool
+   *                      mostly dead, 0 means never
+   * @param samplePct     share of TKO destinations that are sampled
+   */
+  PoolTkoTracker(std::string name, size_t thresholdPct, size_t samplePct);
+
+  const std::string& name() const {
+    return name_;
+  }
+
+  /**
+   * Number of destinations in the pool, as of the latest config.
+   */
+  void updateSize(size_t size) {
+    size_.store(size, std::memory_order_relaxed);
+  }
+
+  size_t size() const {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * A destination of the pool was marked TKO.
+   *
+   * @return  true if it's sampled: it should keep probing while the pool
+   *          is mostly dead. The first of every 100 / samplePct TKO
+   *          destinations is.
+   */
+  bool onTko();
+
+  /**
+   * A destination marked TKO stopped probing.
+   *
+   * @param recovered  true if it was because of a successful probe
+   */
+  void onTkoEnd(bool recovered);
+
+  size_t tkoCount() const {
+    return tko_.load(std::memory_order_relaxed);
+  }
+
+  bool mostlyDead() const;
+
+  /**
+   * Number of destinations that recovered since creation.
+   */
+  uint64_t recoveries() const {
+    return recoveries_.load(std::memory_order_acquire);
+  }
+
+ private:
+  const std::string name_;
+  const size_t thresholdPct_;
+  const size_t sampleStride_;
+
+  std::atomic<size_t> size_{0};
+  std::atomic<size_t> tko_{0};
+  std::atomic<uint64_t> tickets_{0};
+  std::atomic<uint64_t> recoveries_{0};
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -9,6 +9,9 @@
  */
 #include "ProxyClientCommon.h"
 
+#include <mutex>
+#include <unordered_map>
+
 #include <folly/Format.h>
 
 #include "mcrouter/ClientPool.h"
@@ -16,31 +19,53 @@
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+namespace {
+
+struct KeyTable {
+  std::mutex mutex;
+  /* node based, entries never move */
+  std::unordered_map<std::string, uint32_t> ids;
+  size_t bytes{0};
+};
+
+KeyTable& keyTable() {
+  static auto table = new KeyTable();
+  return *table;
+}
+
+/* Ids are never reused, the table only grows with distinct destinations */
+const std::pair<const std::string, uint32_t>* internKey(std::string key) {
+  auto& table = keyTable();
+  std::lock_guard<std::mutex> lck(table.mutex);
+  auto res = table.ids.emplace(std::move(key), table.ids.size() + 1);
+  if (res.second) {
+    table.bytes += res.first->first.size();
+  }
+  return &*res.first;
+}
+
+}  // anonymous namespace
+
 ProxyClientCommon::ProxyClientCommon(const ClientPool& pool_,
-                                     std::chrono::milliseconds timeout,
                                      AccessPoint ap_,
-                                     int keep_routing_prefix_,
                                      bool useSsl_,
-                                     uint64_t qos_,
-                                     int deleteTime_)
+                                     uint64_t qos_)
     : pool(pool_),
+      settings(pool.getSettings()),
       ap(std::move(ap_)),
-      destination_key(ap.toHostPortString()),
-      keep_routing_prefix(keep_routing_prefix_),
-      server_timeout(std::move(timeout)),
+      destination_key(internKey(ap.toHostPortString())->first),
       indexInPool(pool.getClients().size()),
       useSsl(useSsl_),
       qos(qos_),
-      deleteTime(deleteTime_) {
+      key_(internKey(ap.toString())),
+      keyWithTimeout_(internKey(folly::sformat(
+        "{}-{}", key_->first, settings.server_timeout.count()))) {
 }
 
-std::string ProxyClientCommon::genProxyDestinationKey(
-    bool include_timeout) const {
-  if (include_timeout) {
-    return folly::sformat("{}-{}", ap.toString(), server_timeout.count());
-  } else {
-    return ap.toString();
-  }
+size_t ProxyClientCommon::internedKeyBytes() {
+  auto& table = keyTable();
+  std::lock_guard<std::mutex> lck(table.mutex);
+  return table.bytes;
 }
 
 }}}  // facebook::memcache::mcrouter
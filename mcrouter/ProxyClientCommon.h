@@ -10,41 +10,83 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <string>
+#include <utility>
 
+#include "mcrouter/AdaptiveTimeout.h"
 #include "mcrouter/lib/network/AccessPoint.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class ClientPool;
 
+/**
+ * Settings of all servers of a pool, stored once in its ClientPool.
+ */
+struct PoolSettings {
+  std::chrono::milliseconds server_timeout{0};
+  /// Tightens server_timeout to the destination's latency if enabled
+  AdaptiveTimeoutSettings adaptiveTimeout;
+
+  int keep_routing_prefix{0};
+
+  int deleteTime{0};
+
+  /// Number of connections to open to the destination
+  size_t connections{1};
+
+  /// Keep an extra established connection to swap in when one fails
+  bool spareConnection{false};
+};
+
 struct ProxyClientCommon {
   const ClientPool& pool;
+  /// Owned by pool
+  const PoolSettings& settings;
   const AccessPoint ap;
 
-  /// Always the same for a given (host, port)
-  const std::string destination_key;
-
-  const int keep_routing_prefix;
-  const std::chrono::milliseconds server_timeout;
+  /// Always the same for a given (host, port), interned
+  const std::string& destination_key;
 
-  const size_t indexInPool;
+  const uint32_t indexInPool;
   const bool useSsl;
 
   const uint64_t qos;
 
-  const int deleteTime;
+  /**
+   * Key of the destination: ap, with server_timeout if include_timeout.
+   * Interned process-wide, so that every proxy's destinations refer to the
+   * same string instead of copying it.
+   */
+  const std::string& proxyDestinationKey(bool include_timeout) const {
+    return include_timeout ? keyWithTimeout_->first : key_->first;
+  }
+
+  /**
+   * proxyDestinationKey() interned to a process-wide id: equal ids mean
+   * equal keys. Computed once per client, so that looking up destinations
+   * at config build doesn't need to format and hash strings.
+   */
+  uint32_t proxyDestinationKeyId(bool include_timeout) const {
+    return include_timeout ? keyWithTimeout_->second : key_->second;
+  }
 
-  std::string genProxyDestinationKey(bool include_timeout) const;
+  /**
+   * @return  bytes of all interned destination keys, never freed
+   */
+  static size_t internedKeyBytes();
 
  private:
+  typedef std::pair<const std::string, uint32_t> InternedKey;
+
+  const InternedKey* const key_;
+  const InternedKey* const keyWithTimeout_;
+
   ProxyClientCommon(const ClientPool& pool,
-                    std::chrono::milliseconds timeout,
                     AccessPoint ap,
-                    int keep_routing_prefix,
                     bool useSsl,
-                    uint64_t qos,
-                    int deleteTime);
+                    uint64_t qos);
 
   friend class ClientPool;
 };
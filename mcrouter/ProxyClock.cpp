@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ProxyClock.h"
+
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/ProxyRequestContext.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+ProxyClock::ProxyClock(folly::EventBase& eventBase)
+    : eventBase_(&eventBase),
+      destructionCallback_(*this) {
+  eventBase.runOnDestruction(&destructionCallback_);
+}
+
+void ProxyClock::update() {
+  nowUs_ = mcrouter::nowUs();
+  nowWallSec_ = mcrouter::nowWallSec();
+  if (eventBase_) {
+    valid_ = true;
+    eventBase_->runInLoop(this, /* thisIteration */ true);
+  }
+}
+
+void ProxyClock::DestructionCallback::runLoopCallback() noexcept {
+  clock_.eventBase_ = nullptr;
+  clock_.valid_ = false;
+  clock_.cancelLoopCallback();
+}
+
+double coarseNowSec(const ProxyMcRequest& req) {
+  auto& clock = req.context().proxy().clock;
+  return clock ? clock->nowSec() : nowSec();
+}
+
+time_t coarseNowWallSec(const ProxyMcRequest& req) {
+  auto& clock = req.context().proxy().clock;
+  return clock ? clock->nowWallSec() : nowWallSec();
+}
+
+}}}  // facebook::memcache::mcrouter
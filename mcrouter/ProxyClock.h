@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/config.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class ProxyMcRequest;
+
+/**
+ * Coarse clock of a proxy thread: the first read in an event loop
+ * iteration reads the system clocks, later reads until the end of the
+ * iteration return the same time.
+ *
+ * Good enough for per-request decisions with millisecond or coarser
+ * granularity (migration phases, rate limits), not for measuring latency:
+ * use nowUs() for that.
+ *
+ * May outlive the event base, it reads the system clocks every time once
+ * the event base is destroyed. Must only be used from the event base thread.
+ */
+class ProxyClock : private folly::EventBase::LoopCallback {
+ public:
+  explicit ProxyClock(folly::EventBase& eventBase);
+
+  /**
+   * Coarse nowUs()
+   */
+  int64_t nowUs() {
+    refresh();
+    return nowUs_;
+  }
+
+  /**
+   * Coarse nowSec()
+   */
+  double nowSec() {
+    return nowUs() / 1000000.0;
+  }
+
+  /**
+   * Coarse nowWallSec()
+   */
+  time_t nowWallSec() {
+    refresh();
+    return nowWallSec_;
+  }
+
+ private:
+  class DestructionCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit DestructionCallback(ProxyClock& clock) : clock_(clock) {}
+    void runLoopCallback() noexcept override;
+   private:
+    ProxyClock& clock_;
+  };
+
+  /* null once the event base is destroyed */
+  folly::EventBase* eventBase_;
+  DestructionCallback destructionCallback_;
+  bool valid_{false};
+  int64_t nowUs_{0};
+  time_t nowWallSec_{0};
+
+  void refresh() {
+    if (!valid_) {
+      update();
+    }
+  }
+
+  void update();
+
+  /* End of the loop iteration */
+  void runLoopCallback() noexcept override {
+    valid_ = false;
+  }
+};
+
+/**
+ * Coarse time for a request: from the ProxyClock of its proxy
+ * if it has one, from the system clocks otherwise.
+ */
+template <class Request>
+double coarseNowSec(const Request& req) {
+  return nowSec();
+}
+
+template <class Request>
+time_t coarseNowWallSec(const Request& req) {
+  return nowWallSec();
+}
+
+double coarseNowSec(const ProxyMcRequest& req);
+time_t coarseNowWallSec(const ProxyMcRequest& req);
+
+}}}  // facebook::memcache::mcrouter
@@ -9,11 +9,15 @@
  */
 #include "ProxyConfig.h"
 
+#include <algorithm>
+
 #include <folly/Conv.h>
 #include <folly/dynamic.h>
 #include <folly/json.h>
+#include <glog/logging.h>
 
 #include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/MemoryAccounting.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/routes/McRouteHandleProvider.h"
 #include "mcrouter/PoolFactory.h"
@@ -48,12 +52,20 @@ void addRouteSelector(const folly::dynamic& aliases,
 ProxyConfig::ProxyConfig(proxy_t* proxy,
                          const folly::dynamic& json,
                          std::string configMd5Digest,
-                         std::shared_ptr<PoolFactory> poolFactory)
+                         std::shared_ptr<PoolFactory> poolFactory,
+                         SharedConfigObjects& sharedObjects,
+                         const JsonFingerprints* fingerprints,
+                         const ProxyConfig* previous)
   : poolFactory_(std::move(poolFactory)),
     configMd5Digest_(std::move(configMd5Digest)) {
+  auto allocatedBefore = MemoryAccounting::threadAllocatedBytes();
+  auto destinationsBefore =
+    MemoryAccounting::threadBytes(MemoryTag::kDestinations);
 
-  McRouteHandleProvider provider(proxy, *proxy->destinationMap, *poolFactory_);
-  RouteHandleFactory<McrouterRouteHandleIf> factory(provider);
+  McRouteHandleProvider provider(proxy, *proxy->destinationMap, *poolFactory_,
+                                 sharedObjects);
+  RouteHandleFactory<McrouterRouteHandleIf> factory(
+    provider, fingerprints, previous ? previous->routeHandleCache_ : nullptr);
 
   checkLogic(json.isObject(), "Config is not an object");
 
@@ -87,9 +99,30 @@ ProxyConfig::ProxyConfig(proxy_t* proxy,
   }
 
 
+  VLOG_IF(1, fingerprints && previous) << "reused " <<
+    factory.reusedCount() << " route handle subtrees";
+  VLOG_IF(1, factory.sharedCount() > 0) << "shared " <<
+    factory.sharedCount() << " identical route handle subtrees";
+  VLOG_IF(1, factory.collapsedCount() > 0) << "collapsed " <<
+    factory.collapsedCount() << " no-op route handles";
+  collapsedRouteHandles_ = factory.collapsedCount();
+  routeHandleCache_ = factory.releaseCache();
   asyncLogRoutes_ = provider.releaseAsyncLogRoutes();
+  lazySubtrees_ = provider.releaseLazySubtrees(factory);
   proxyRoute_ = std::make_shared<ProxyRoute>(proxy, routeSelectors);
   serviceInfo_ = std::make_shared<ServiceInfo>(proxy, *this);
+
+  /* Destinations created by this config are accounted on their own.
+     Subtrees reused from the previous config are not included. */
+  memoryBytes_ = std::max<int64_t>(0,
+    MemoryAccounting::threadAllocatedBytes() - allocatedBefore -
+    (MemoryAccounting::threadBytes(MemoryTag::kDestinations) -
+     destinationsBefore));
+  MemoryAccounting::add(MemoryTag::kConfig, memoryBytes_);
+}
+
+ProxyConfig::~ProxyConfig() {
+  MemoryAccounting::sub(MemoryTag::kConfig, memoryBytes_);
 }
 
 McrouterRouteHandlePtr
@@ -102,4 +135,8 @@ ProxyConfig::getClients() const {
   return poolFactory_->clients();
 }
 
+int64_t ProxyConfig::clientBytesSaved() const {
+  return poolFactory_->clientBytesSaved();
+}
+
 }}} // facebook::memcache::mcrouter
@@ -15,6 +15,7 @@
 
 #include <folly/Range.h>
 
+#include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/ProxyConfigIf.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 
@@ -24,11 +25,13 @@ class dynamic;
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+class LazySubtrees;
 class PoolFactory;
 class ProxyClientCommon;
 class ProxyGenericPool;
 class ProxyRoute;
 class ServiceInfo;
+class SharedConfigObjects;
 class proxy_t;
 
 /**
@@ -54,22 +57,53 @@ class ProxyConfig : public ProxyConfigIf {
   McrouterRouteHandlePtr
   getRouteHandleForAsyncLog(const std::string& asyncLogName) const override;
 
+  size_t collapsedRouteHandles() const override {
+    return collapsedRouteHandles_;
+  }
+
+  int64_t clientBytesSaved() const override;
+
+  /**
+   * Bytes allocated while building this config, destinations excluded.
+   */
+  int64_t memoryBytes() const {
+    return memoryBytes_;
+  }
+
+  ~ProxyConfig() override;
+
  private:
+  typedef RouteHandleFactory<McrouterRouteHandleIf>::Cache RouteHandleCache;
+
   std::shared_ptr<ProxyRoute> proxyRoute_;
   std::shared_ptr<ServiceInfo> serviceInfo_;
   std::shared_ptr<PoolFactory> poolFactory_;
   std::string configMd5Digest_;
   std::unordered_map<std::string, McrouterRouteHandlePtr> asyncLogRoutes_;
+  /// builds the targets of LazyRoutes on first use
+  std::shared_ptr<LazySubtrees> lazySubtrees_;
+  size_t collapsedRouteHandles_{0};
+  /// route handles that may be reused by the next config
+  std::shared_ptr<const RouteHandleCache> routeHandleCache_;
+  /// allocated while building this config, see MemoryTag::kConfig
+  int64_t memoryBytes_{0};
 
   /**
    * Parses config and creates ProxyRoute
    *
    * @param jsonC config in format of JSON with comments and templates
+   * @param sharedObjects objects shared with configs of other proxies.
+   * @param fingerprints of json. If not nullptr, unchanged route handles
+   *                     are reused from the previous config.
+   * @param previous config of the same proxy, may be nullptr.
    */
   ProxyConfig(proxy_t* proxy,
               const folly::dynamic& json,
               std::string configMd5Digest,
-              std::shared_ptr<PoolFactory> poolFactory);
+              std::shared_ptr<PoolFactory> poolFactory,
+              SharedConfigObjects& sharedObjects,
+              const JsonFingerprints* fingerprints = nullptr,
+              const ProxyConfig* previous = nullptr);
 
   friend class ProxyConfigBuilder;
 };
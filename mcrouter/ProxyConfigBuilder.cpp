@@ -10,8 +10,10 @@
 #include "ProxyConfigBuilder.h"
 
 #include <folly/json.h>
+#include <folly/Memory.h>
 
 #include "mcrouter/ConfigApi.h"
+#include "mcrouter/ConfigSnapshot.h"
 #include "mcrouter/lib/config/ConfigPreprocessor.h"
 #include "mcrouter/lib/fbi/cpp/globals.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
@@ -25,21 +27,52 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 ProxyConfigBuilder::ProxyConfigBuilder(const McrouterOptions& opts,
                                        ConfigApi* configApi,
-                                       folly::StringPiece jsonC)
+                                       folly::StringPiece jsonC,
+                                       const ProxyConfig* previous,
+                                       ConfigPreprocessor::Stats*
+                                         preprocessorStats)
     : json_(nullptr) {
 
   McImportResolver importResolver(configApi);
-  json_ = ConfigPreprocessor::getConfigWithoutMacros(
-    jsonC,
-    importResolver,
-    {
-      { "default-route", opts.default_route.str() },
-      { "default-region", opts.default_route.getRegion().str() },
-      { "default-cluster", opts.default_route.getCluster().str() },
-      { "hostid", globals::hostid() },
-    });
-
-  poolFactory_ = std::make_shared<PoolFactory>(json_, *configApi, opts);
+  std::unordered_map<std::string, folly::dynamic> globalParams = {
+    { "default-route", opts.default_route.str() },
+    { "default-region", opts.default_route.getRegion().str() },
+    { "default-cluster", opts.default_route.getCluster().str() },
+    { "hostid", globals::hostid() },
+  };
+
+  // stats are collected only while preprocessing, skip the snapshot then
+  std::unique_ptr<ConfigSnapshot> snapshot;
+  auto snapshotPath = ConfigSnapshot::filePath(opts);
+  if (!snapshotPath.empty() && preprocessorStats == nullptr) {
+    snapshot = folly::make_unique<ConfigSnapshot>(std::move(snapshotPath),
+                                                  jsonC, globalParams);
+    if (auto json = snapshot->load(importResolver)) {
+      json_ = std::move(*json);
+    }
+  }
+
+  if (json_.isNull()) {
+    ConfigSnapshot::RecordingImportResolver recorder(importResolver);
+    json_ = ConfigPreprocessor::getConfigWithoutMacros(
+      jsonC,
+      recorder,
+      std::move(globalParams),
+      /* nestedLimit */ 250,
+      opts.config_preprocessor_threads,
+      preprocessorStats);
+    if (snapshot) {
+      snapshot->save(json_, recorder.imports());
+    }
+  }
+
+  poolFactory_ = std::make_shared<PoolFactory>(
+    json_, *configApi, opts,
+    previous ? previous->poolFactory_.get() : nullptr);
+  sharedObjects_ = folly::make_unique<SharedConfigObjects>();
+  if (!opts.disable_incremental_reload) {
+    fingerprints_ = folly::make_unique<JsonFingerprints>(json_);
+  }
 
   configMd5Digest_ = Md5Hash(jsonC);
 }
@@ -49,9 +82,11 @@ folly::dynamic ProxyConfigBuilder::preprocessedConfig() const {
 }
 
 std::shared_ptr<ProxyConfig>
-ProxyConfigBuilder::buildConfig(proxy_t* proxy) const {
+ProxyConfigBuilder::buildConfig(proxy_t* proxy,
+                                const ProxyConfig* previous) const {
   return std::shared_ptr<ProxyConfig>(
-    new ProxyConfig(proxy, json_, configMd5Digest_, poolFactory_));
+    new ProxyConfig(proxy, json_, configMd5Digest_, poolFactory_,
+                    *sharedObjects_, fingerprints_.get(), previous));
 }
 
 }}} // facebook::memcache::mcrouter
@@ -16,7 +16,10 @@
 #include <folly/dynamic.h>
 #include <folly/Range.h>
 
+#include "mcrouter/lib/config/ConfigPreprocessor.h"
+#include "mcrouter/lib/config/JsonFingerprint.h"
 #include "mcrouter/options.h"
+#include "mcrouter/SharedConfigObjects.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -28,16 +31,34 @@ class proxy_t;
 
 class ProxyConfigBuilder {
  public:
+  /**
+   * @param previous if not nullptr, pools and route handles that didn't
+   *                 change are reused from this config.
+   * @param preprocessorStats if not nullptr, macro expansion statistics
+   *                          are added to it.
+   */
   ProxyConfigBuilder(const McrouterOptions& opts,
                      ConfigApi* configApi,
-                     folly::StringPiece jsonC);
+                     folly::StringPiece jsonC,
+                     const ProxyConfig* previous = nullptr,
+                     ConfigPreprocessor::Stats* preprocessorStats = nullptr);
 
-  std::shared_ptr<ProxyConfig> buildConfig(proxy_t* proxy) const;
+  /**
+   * @param previous if not nullptr, route handles that didn't change
+   *                 are reused from this config. Should be the current
+   *                 config of the same proxy.
+   */
+  std::shared_ptr<ProxyConfig>
+  buildConfig(proxy_t* proxy, const ProxyConfig* previous = nullptr) const;
 
   folly::dynamic preprocessedConfig() const;
  private:
   folly::dynamic json_;
+  /// nullptr if incremental reload is disabled
+  std::unique_ptr<JsonFingerprints> fingerprints_;
   std::shared_ptr<PoolFactory> poolFactory_;
+  /// shared by configs of all proxies
+  std::unique_ptr<SharedConfigObjects> sharedObjects_;
   std::string configMd5Digest_;
 };
 
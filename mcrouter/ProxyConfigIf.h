@@ -9,6 +9,7 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -38,6 +39,17 @@ class ProxyConfigIf {
   virtual std::shared_ptr<McrouterRouteHandleIf>
   getRouteHandleForAsyncLog(const std::string& asynclogName) const = 0;
 
+  /**
+   * @return number of no-op route handles left out of the route tree
+   */
+  virtual size_t collapsedRouteHandles() const = 0;
+
+  /**
+   * @return bytes the clients of the config's pools take less than they
+   *         would with per-server copies of pool settings and keys
+   */
+  virtual int64_t clientBytesSaved() const = 0;
+
   virtual ~ProxyConfigIf() {}
 };
 
@@ -21,8 +21,48 @@ ProxyDestination::send(const Request& request, McOperation<Op>,
   FBI_ASSERT(proxy->magic == proxy_magic);
 
   proxy->destinationMap->markAsActive(*this);
-  auto reply = getAsyncMcClient().sendSync(request, McOperation<Op>(), timeout);
-  onReply(reply, req_ctx);
+  auto outstanding = ++outstanding_;
+  /* The counter is cumulative (and carried over by clones), only the copies
+     made while sending to this destination are accounted here */
+  auto bytesCopiedBefore = request.valueBytesCopied();
+  auto reply = getAsyncMcClient().sendSync(request, McOperation<Op>(), timeout,
+                                           req_ctx.cancellation,
+                                           req_ctx.priority);
+  --outstanding_;
+  onSendReply(reply, request.valueBytesCopied() - bytesCopiedBefore, req_ctx,
+              outstanding);
+  return reply;
+}
+
+template <int Op, class Request>
+ProxyDestination::PendingSend<Op, Request>
+ProxyDestination::startSend(const Request& request, McOperation<Op>,
+                            DestinationRequestCtx& req_ctx,
+                            std::chrono::milliseconds timeout) {
+  FBI_ASSERT(proxy->magic == proxy_magic);
+
+  proxy->destinationMap->markAsActive(*this);
+  PendingSend<Op, Request> pending;
+  pending.outstanding = ++outstanding_;
+  pending.valueBytesCopied = request.valueBytesCopied();
+  pending.request = getAsyncMcClient().startSync(request, McOperation<Op>(),
+                                                 timeout,
+                                                 req_ctx.cancellation,
+                                                 req_ctx.priority);
+  return pending;
+}
+
+template <int Op, class Request>
+typename ReplyType<McOperation<Op>, Request>::type
+ProxyDestination::finishSend(PendingSend<Op, Request> pending,
+                             const Request& request,
+                             DestinationRequestCtx& req_ctx) {
+  /* The client is kept alive by the request, even if this destination
+     reconnected in the meantime */
+  auto reply = AsyncMcClient::waitSync(std::move(pending.request));
+  --outstanding_;
+  onSendReply(reply, request.valueBytesCopied() - pending.valueBytesCopied,
+              req_ctx, pending.outstanding);
   return reply;
 }
 
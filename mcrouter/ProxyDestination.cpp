@@ -9,20 +9,32 @@
  */
 #include "ProxyDestination.h"
 
+#include <stdlib.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <new>
+
 #include <folly/Conv.h>
 #include <folly/Memory.h>
 
+#include "mcrouter/ClientPool.h"
 #include "mcrouter/config-impl.h"
 #include "mcrouter/config.h"
-#include "mcrouter/lib/fbi/asox_timer.h"
 #include "mcrouter/lib/fbi/nstring.h"
-#include "mcrouter/lib/fbi/timer.h"
 #include "mcrouter/lib/fbi/util.h"
 #include "mcrouter/lib/fibers/Fiber.h"
+#include "mcrouter/lib/MemoryAccounting.h"
 #include "mcrouter/lib/network/AsyncMcClient.h"
+#include "mcrouter/lib/network/KernelTls.h"
 #include "mcrouter/lib/network/ThreadLocalSSLContextProvider.h"
+#include "mcrouter/McrouterInstance.h"
 #include "mcrouter/pclient.h"
+#include "mcrouter/PoolTkoTracker.h"
+#include "mcrouter/proxy.h"
 #include "mcrouter/ProxyClientCommon.h"
+#include "mcrouter/ProxyDestinationRegistry.h"
 #include "mcrouter/routes/DestinationRoute.h"
 #include "mcrouter/stats.h"
 #include "mcrouter/TkoTracker.h"
@@ -39,10 +51,10 @@ constexpr double kProbeJitterDelta = kProbeJitterMax - kProbeJitterMin;
 static_assert(kProbeJitterMax >= kProbeJitterMin,
               "ProbeJitterMax should be greater or equal tham ProbeJitterMin");
 
-void on_probe_timer(const asox_timer_t timer, void* arg) {
-  ProxyDestination* pdstn = (ProxyDestination*)arg;
-  pdstn->on_timer(timer);
-}
+/* Send queue weights with --target-priority-lanes, by RequestPriority */
+constexpr std::array<uint32_t, kNumRequestPriorities> kPriorityWeights{{
+  8, 4, 2, 1, 1
+}};
 
 stat_name_t getStatName(ProxyDestinationState st) {
   switch (st) {
@@ -67,7 +79,11 @@ void ProxyDestination::schedule_next_probe() {
   FBI_ASSERT(!proxy->opts.disable_tko_tracking);
 
   int delay_ms = probe_delay_next_ms;
-  if (probe_delay_next_ms < 2) {
+  if (poolTko_ && poolTko_->mostlyDead()) {
+    /* Sampled destinations probe at a steady pace, the others only
+       check if one of them recovered, without backing off */
+    delay_ms = proxy->opts.probe_delay_initial_ms;
+  } else if (probe_delay_next_ms < 2) {
     // int(1 * 1.5) == 1, so advance it to 2 first
     probe_delay_next_ms = 2;
   } else {
@@ -83,24 +99,20 @@ void ProxyDestination::schedule_next_probe() {
   uint64_t delay_us = (double)delay_ms * 1000 * (1.0 + tmo_jitter_pct);
   FBI_ASSERT(delay_us > 0);
 
-  timeval_t delay;
-  delay.tv_sec = (delay_us / 1000000);
-  delay.tv_usec = (delay_us % 1000000);
-
-  FBI_ASSERT(probe_timer == nullptr);
-  probe_timer = asox_add_timer(proxy->eventBase->getLibeventBase(), delay,
-                               on_probe_timer, this);
+  FBI_ASSERT(!probeTimer_.isScheduled());
+  if (!timerWheel_) {
+    timerWheel_ = TimerWheel::get(*proxy->eventBase);
+  }
+  timerWheel_->scheduleTimeout(probeTimer_,
+                               std::chrono::milliseconds(delay_us / 1000));
 }
 
-void ProxyDestination::on_timer(const asox_timer_t timer) {
+void ProxyDestination::on_timer() {
   // This assert checks for use-after-free
   FBI_ASSERT(proxy->magic == proxy_magic);
-  FBI_ASSERT(timer == probe_timer);
-  asox_remove_timer(timer);
-  probe_timer = nullptr;
   if (sending_probes) {
     // Note that the previous probe might still be in flight
-    if (!probe_req) {
+    if (!probe_req && should_send_probe()) {
       auto mutReq = createMcMsgRef();
       mutReq->op = mc_op_version;
       probe_req = folly::make_unique<McRequest>(std::move(mutReq));
@@ -125,19 +137,48 @@ void ProxyDestination::on_timer(const asox_timer_t timer) {
   }
 }
 
+bool ProxyDestination::should_send_probe() {
+  auto now = nowUs();
+  if (poolTko_ && !probeSampled_ && poolTko_->mostlyDead()) {
+    auto recoveries = poolTko_->recoveries();
+    if (recoveries != poolRecoveriesSeen_) {
+      /* Others came back, so are we likely to */
+      poolRecoveriesSeen_ = recoveries;
+      probe_delay_next_ms = proxy->opts.probe_delay_initial_ms;
+    } else if (now - lastProbeUs_ <
+               int64_t(proxy->opts.probe_delay_max_ms) * 1000) {
+      stat_incr(proxy->stats, tko_probes_skipped_stat, 1);
+      return false;
+    }
+  }
+  lastProbeUs_ = now;
+  stat_incr(proxy->stats, tko_probes_sent_stat, 1);
+  return true;
+}
+
 void ProxyDestination::start_sending_probes() {
   FBI_ASSERT(!sending_probes);
   sending_probes = true;
   probe_delay_next_ms = proxy->opts.probe_delay_initial_ms;
+  if (proxy->opts.pool_probe_sample_threshold_pct != 0) {
+    poolTko_ = proxy->router->pclientOwner().getPoolTkoTracker(
+      poolName_, proxy->opts.pool_probe_sample_threshold_pct,
+      proxy->opts.pool_probe_sample_pct);
+    poolTko_->updateSize(poolSize_);
+    probeSampled_ = poolTko_->onTko();
+    poolRecoveriesSeen_ = poolTko_->recoveries();
+    lastProbeUs_ = nowUs();
+  }
   schedule_next_probe();
 }
 
-void ProxyDestination::stop_sending_probes() {
+void ProxyDestination::stop_sending_probes(bool recovered) {
   probesSent_ = 0;
   sending_probes = false;
-  if (probe_timer) {
-    asox_remove_timer(probe_timer);
-    probe_timer = nullptr;
+  probeTimer_.cancelTimeout();
+  if (poolTko_) {
+    poolTko_->onTkoEnd(recovered);
+    poolTko_.reset();
   }
 }
 
@@ -146,7 +187,7 @@ void ProxyDestination::unmark_tko(const McReply& reply) {
   shared->tko.recordSuccess(this);
   if (sending_probes) {
     onTkoEvent(TkoLogEvent::UnMarkTko, reply.result());
-    stop_sending_probes();
+    stop_sending_probes(/* recovered= */ true);
   }
 }
 
@@ -178,23 +219,77 @@ void ProxyDestination::handle_tko(const McReply& reply, bool is_probe_req) {
   }
 }
 
+void ProxyDestination::onSendReply(const McReply& reply,
+                                   size_t bytesCopied,
+                                   DestinationRequestCtx& destreqCtx,
+                                   size_t outstanding) {
+  if (bytesCopied != 0) {
+    stat_incr(proxy->stats, value_bytes_copied_stat, bytesCopied);
+  }
+  if (reply.result() == mc_res_aborted && destreqCtx.cancellation &&
+      destreqCtx.cancellation->load(std::memory_order_relaxed)) {
+    /* dropped before it was written, says nothing about the destination */
+    stat_incr(proxy->stats, destination_cancelled_sends_stat, 1);
+    destreqCtx.cancelled = true;
+    destreqCtx.endTime = nowUs();
+    return;
+  }
+  onReply(reply, destreqCtx, outstanding);
+}
+
 void ProxyDestination::onReply(const McReply& reply,
-                               DestinationRequestCtx& destreqCtx) {
+                               DestinationRequestCtx& destreqCtx,
+                               size_t outstanding) {
   FBI_ASSERT(proxy->magic == proxy_magic);
 
-  handle_tko(reply, false);
+  // A timeout shorter than the server timeout says nothing about the
+  // health of the destination
+  bool deadlineTimeout =
+    destreqCtx.deadlineClamped && reply.result() == mc_res_timeout;
+  if (!deadlineTimeout) {
+    handle_tko(reply, false);
+  }
 
   stats_.results[reply.result()]++;
   destreqCtx.endTime = nowUs();
 
   int64_t latency = destreqCtx.endTime - destreqCtx.startTime;
   stats_.avgLatency.insertSample(latency);
+  stats_.latencyUs.insertSample(std::max<int64_t>(latency, 0));
+
+  if (adaptiveTimeout_ && !deadlineTimeout &&
+      (reply.result() == mc_res_timeout || !reply.isError())) {
+    adaptiveTimeout_->onSample(latency);
+  }
+
+  if (concurrencyLimit_ && !deadlineTimeout) {
+    auto result = reply.result();
+    if (result == mc_res_timeout || result == mc_res_busy ||
+        result == mc_res_try_again) {
+      concurrencyLimit_->onDrop();
+    } else if (!reply.isError()) {
+      concurrencyLimit_->onSample(latency, outstanding);
+    }
+  }
 }
 
-void ProxyDestination::on_up() {
+void ProxyDestination::on_up(size_t connection) {
   FBI_ASSERT(proxy->magic == proxy_magic);
-  FBI_ASSERT(stats_.state != ProxyDestinationState::kUp);
 
+  auto& conn = connectionAt(connection);
+  FBI_ASSERT(!conn.up);
+  conn.up = true;
+  stats_.connectUs.insertSample(conn.client->getLastConnectLatency().count());
+  if (connection == kSpareConnection) {
+    return;
+  }
+  ++connectionsUp_;
+  connectSpare();
+
+  if (stats_.state == ProxyDestinationState::kUp) {
+    // another connection is already up
+    return;
+  }
   setState(ProxyDestinationState::kUp);
 
   VLOG(1) << "server " << pdstnKey << " up (" <<
@@ -202,56 +297,148 @@ void ProxyDestination::on_up() {
       stat_get_uint64(proxy->stats, num_servers_stat) << ")";
 }
 
-void ProxyDestination::on_down() {
+void ProxyDestination::on_down(size_t connection) {
   FBI_ASSERT(proxy->magic == proxy_magic);
 
+  if (connection == kSpareConnection) {
+    // opened again once a regular connection comes up
+    spare_.up = false;
+    return;
+  }
+
+  auto& conn = connections_[connection];
+  if (conn.up) {
+    conn.up = false;
+    --connectionsUp_;
+  }
+
+  if (!resetting && spare_.up) {
+    // The spare takes over, the failed client becomes the spare and
+    // reconnects in the background.
+    std::swap(conn.client, spare_.client);
+    spare_.up = false;
+    conn.up = true;
+    ++connectionsUp_;
+    VLOG(1) << "server " << pdstnKey << " connection #" << connection
+            << " replaced by the spare";
+    connectSpare();
+  }
+
   if (resetting) {
-    VLOG(1) << "server " << pdstnKey << " inactive (" <<
-        stat_get_uint64(proxy->stats, num_servers_up_stat) << " of " <<
-        stat_get_uint64(proxy->stats, num_servers_stat) << ")";
-    setState(ProxyDestinationState::kClosed);
+    if (connectionsUp_ == 0 &&
+        stats_.state != ProxyDestinationState::kClosed) {
+      VLOG(1) << "server " << pdstnKey << " inactive (" <<
+          stat_get_uint64(proxy->stats, num_servers_up_stat) << " of " <<
+          stat_get_uint64(proxy->stats, num_servers_stat) << ")";
+      setState(ProxyDestinationState::kClosed);
+    }
   } else {
-    VLOG(1) << "server " << pdstnKey << " down (" <<
-        stat_get_uint64(proxy->stats, num_servers_up_stat) << " of " <<
-        stat_get_uint64(proxy->stats, num_servers_stat) << ")";
-    setState(ProxyDestinationState::kDown);
+    if (connectionsUp_ == 0) {
+      VLOG(1) << "server " << pdstnKey << " down (" <<
+          stat_get_uint64(proxy->stats, num_servers_up_stat) << " of " <<
+          stat_get_uint64(proxy->stats, num_servers_stat) << ")";
+      setState(ProxyDestinationState::kDown);
+    } else {
+      VLOG(1) << "server " << pdstnKey << " connection #" << connection
+              << " down";
+    }
+    // failure of any connection counts against the whole destination
     handle_tko(McReply(mc_res_connect_error),
                /* is_probe_req= */ false);
   }
 }
 
 size_t ProxyDestination::getPendingRequestCount() const {
-  return client_ ? client_->getPendingRequestCount() : 0;
+  size_t count = 0;
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      count += conn.client->getPendingRequestCount();
+    }
+  }
+  return count;
 }
 
 size_t ProxyDestination::getInflightRequestCount() const {
-  return client_ ? client_->getInflightRequestCount() : 0;
+  size_t count = 0;
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      count += conn.client->getInflightRequestCount();
+    }
+  }
+  return count;
 }
 
 std::pair<uint64_t, uint64_t> ProxyDestination::getBatchingStat() const {
-  return client_ ? client_->getBatchingStat() : std::make_pair(0UL, 0UL);
+  std::pair<uint64_t, uint64_t> stat(0, 0);
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      auto batch = conn.client->getBatchingStat();
+      stat.first += batch.first;
+      stat.second += batch.second;
+    }
+  }
+  return stat;
+}
+
+WriteBatchHistogram ProxyDestination::getWriteBatchHistogram() const {
+  WriteBatchHistogram histogram{};
+  for (const auto& conn : connections_) {
+    if (conn.client) {
+      const auto& batches = conn.client->getWriteBatchHistogram();
+      for (size_t i = 0; i < histogram.size(); ++i) {
+        histogram[i] += batches[i];
+      }
+    }
+  }
+  return histogram;
 }
 
+constexpr size_t ProxyDestination::kCacheLineSize;
+constexpr size_t ProxyDestination::kSpareConnection;
+
 std::shared_ptr<ProxyDestination> ProxyDestination::create(
     proxy_t* proxy,
     const ProxyClientCommon& ro,
-    std::string pdstnKey) {
+    const std::string& pdstnKey,
+    uint32_t pdstnKeyId) {
 
   auto ptr = std::shared_ptr<ProxyDestination>(
-    new ProxyDestination(proxy, ro, std::move(pdstnKey)));
+    new ProxyDestination(proxy, ro, pdstnKey, pdstnKeyId));
   ptr->selfPtr_ = ptr;
   return ptr;
 }
 
+void* ProxyDestination::operator new(size_t size) {
+  void* mem = nullptr;
+  if (posix_memalign(&mem, kCacheLineSize, size) != 0) {
+    throw std::bad_alloc();
+  }
+  return mem;
+}
+
+void ProxyDestination::operator delete(void* ptr) {
+  free(ptr);
+}
+
 ProxyDestination::~ProxyDestination() {
+  MemoryAccounting::sub(MemoryTag::kDestinations, memoryBytes());
+  if (registry) {
+    registry->remove(*this);
+  }
   shared->removeDestination(this);
   if (proxy->destinationMap) {
     proxy->destinationMap->removeDestination(*this);
   }
 
-  if (client_) {
-    client_->setStatusCallbacks(nullptr, nullptr);
-    client_->closeNow();
+  for (auto& conn : connections_) {
+    if (conn.client) {
+      conn.client->setStatusCallbacks(nullptr, nullptr);
+      conn.client->closeNow();
+    }
+  }
+  if (spare_.client) {
+    spare_.client->setStatusCallbacks(nullptr, nullptr);
+    spare_.client->closeNow();
   }
 
   if (sending_probes) {
@@ -265,21 +452,51 @@ ProxyDestination::~ProxyDestination() {
 
 ProxyDestination::ProxyDestination(proxy_t* proxy_,
                                    const ProxyClientCommon& ro_,
-                                   std::string pdstnKey_)
+                                   const std::string& pdstnKey_,
+                                   uint32_t pdstnKeyId_)
   : proxy(proxy_),
+    proxy_magic(proxy->magic),
+    connections_(std::max<size_t>(ro_.settings.connections, 1)),
+    shortestTimeout(ro_.settings.server_timeout),
     accessPoint(ro_.ap),
     destinationKey(ro_.destination_key),
-    shortestTimeout(ro_.server_timeout),
-    pdstnKey(std::move(pdstnKey_)),
-    proxy_magic(proxy->magic),
+    pdstnKey(pdstnKey_),
+    pdstnKeyId(pdstnKeyId_),
     use_ssl(ro_.useSsl),
     qos(ro_.qos),
     stats_(proxy_->opts),
-    poolName_(ro_.pool.getName()) {
+    poolName_(ro_.pool.getName()),
+    poolSize_(ro_.pool.getClients().size()) {
 
   static uint64_t next_magic = 0x12345678900000LL;
   magic = __sync_fetch_and_add(&next_magic, 1);
   stat_incr(proxy->stats, num_servers_new_stat, 1);
+  MemoryAccounting::add(MemoryTag::kDestinations, memoryBytes());
+  spareConnection_ = ro_.settings.spareConnection;
+
+  if (proxy->opts.target_adaptive_concurrency) {
+    concurrencyLimit_ = folly::make_unique<AdaptiveConcurrencyLimit>(
+      proxy->opts.target_adaptive_concurrency_min,
+      proxy->opts.target_adaptive_concurrency_max);
+  }
+}
+
+std::chrono::milliseconds ProxyDestination::requestTimeout(
+    const ProxyClientCommon& client) {
+  const auto& settings = client.settings;
+  if (!settings.adaptiveTimeout.enabled()) {
+    return settings.server_timeout;
+  }
+  if (!adaptiveTimeout_) {
+    adaptiveTimeout_ = folly::make_unique<AdaptiveTimeout>();
+  }
+  return adaptiveTimeout_->timeout(settings.adaptiveTimeout,
+                                   settings.server_timeout);
+}
+
+void ProxyDestination::updatePool(const ClientPool& pool) {
+  poolName_ = pool.getName();
+  poolSize_ = pool.getClients().size();
 }
 
 ProxyDestinationState ProxyDestination::state() const {
@@ -296,24 +513,57 @@ const ProxyDestinationStats& ProxyDestination::stats() const {
 bool ProxyDestination::may_send() {
   FBI_ASSERT(proxy->magic == proxy_magic);
 
-  return !shared->tko.isTko();
+  return !shared->tko.isTko() && !shared->tko.isTkoElsewhere();
 }
 
 void ProxyDestination::resetInactive() {
   FBI_ASSERT(proxy->magic == proxy_magic);
 
-  // No need to reset non-existing client.
-  if (client_) {
-    resetting = 1;
-    client_->closeNow();
-    client_.reset();
-    resetting = 0;
+  resetting = 1;
+  for (auto& conn : connections_) {
+    // No need to reset non-existing client.
+    if (conn.client) {
+      conn.client->closeNow();
+      conn.client.reset();
+    }
   }
+  if (spare_.client) {
+    spare_.client->closeNow();
+    spare_.client.reset();
+  }
+  resetting = 0;
 }
 
-void ProxyDestination::initializeAsyncMcClient() {
+void ProxyDestination::warmup() {
+  FBI_ASSERT(proxy->magic == proxy_magic);
+
+  // connected by regular traffic in the meantime, or known to be down
+  if (stats_.state != ProxyDestinationState::kNew || !may_send()) {
+    return;
+  }
+  auto mutReq = createMcMsgRef();
+  mutReq->op = mc_op_version;
+  McRequest req(std::move(mutReq));
+  proxy->destinationMap->markAsActive(*this);
+  // connection failures are handled in on_down
+  getAsyncMcClient().sendSync(req, McOperation<mc_op_version>(),
+                              shortestTimeout);
+}
+
+void ProxyDestination::inheritTko() {
+  if (proxy->opts.disable_tko_tracking || sending_probes) {
+    return;
+  }
+  if (shared->tko.recordHardFailure(this)) {
+    onTkoEvent(TkoLogEvent::MarkHardTko, mc_res_connect_error);
+    start_sending_probes();
+  }
+}
+
+void ProxyDestination::initializeAsyncMcClient(size_t connection) {
   CHECK(proxy->eventBase);
-  assert(!client_);
+  auto& client = connectionAt(connection).client;
+  assert(!client);
 
   ConnectionOptions options(accessPoint);
   auto& opts = proxy->opts;
@@ -322,6 +572,19 @@ void ProxyDestination::initializeAsyncMcClient() {
   options.tcpKeepAliveIdle = opts.keepalive_idle_s;
   options.tcpKeepAliveInterval = opts.keepalive_interval_s;
   options.writeTimeout = shortestTimeout;
+  options.maxWriteIovs = opts.target_max_write_iovs;
+  options.maxWriteBytes = opts.target_max_write_bytes;
+  options.writeCorkWindow =
+    std::chrono::microseconds(opts.target_write_cork_window_us);
+  options.useIoUring = opts.io_uring;
+  options.busyPoll = std::chrono::microseconds(opts.busy_poll_us);
+  options.tcpFastOpen = opts.tcp_fast_open;
+  options.readBufferPool = proxy->targetReadBuffers.get();
+  options.maxOutstandingBytes = opts.target_max_outstanding_bytes;
+  options.sharedOutstandingBytes = &proxy->targetOutstandingBytes;
+  if (opts.target_priority_lanes) {
+    options.priorityWeights = kPriorityWeights;
+  }
   if (proxy->opts.enable_qos) {
     options.enableQoS = true;
     options.qos = qos;
@@ -333,33 +596,110 @@ void ProxyDestination::initializeAsyncMcClient() {
                !opts.pem_ca_path.empty(),
                "Some of ssl key paths are not set!");
     options.sslContextProvider = [&opts] {
-      return getSSLContext(opts.pem_cert_path, opts.pem_key_path,
-                           opts.pem_ca_path);
+      auto context = getSSLContext(opts.pem_cert_path, opts.pem_key_path,
+                                   opts.pem_ca_path);
+      if (context && opts.ssl_kernel_tls) {
+        enableKernelTls(*context);
+      }
+      return context;
     };
+    if (proxy->router) {
+      options.sslHandshakePool = proxy->router->sslHandshakePool();
+    }
   }
 
-  client_ = folly::make_unique<AsyncMcClient>(*proxy->eventBase,
-                                              std::move(options));
+  client = folly::make_unique<AsyncMcClient>(*proxy->eventBase,
+                                             std::move(options));
 
-  client_->setStatusCallbacks(
-    [this] () mutable {
-      on_up();
+  auto clientPtr = client.get();
+  client->setStatusCallbacks(
+    [this, clientPtr] () mutable {
+      on_up(connectionOf(clientPtr));
     },
-    [this] (const folly::AsyncSocketException&) mutable {
-      on_down();
+    [this, clientPtr] (const folly::AsyncSocketException&) mutable {
+      on_down(connectionOf(clientPtr));
     });
 
   if (opts.target_max_inflight_requests > 0) {
-    client_->setThrottle(opts.target_max_inflight_requests,
-                         opts.target_max_pending_requests);
+    client->setThrottle(opts.target_max_inflight_requests,
+                        opts.target_max_pending_requests);
+  }
+}
+
+size_t ProxyDestination::pickConnection() const {
+  /* Connections that are not open count as idle. Ties go to the lower
+     index, so extra connections are opened only when the open ones are
+     busy. */
+  size_t best = 0;
+  size_t bestLoad = std::numeric_limits<size_t>::max();
+  for (size_t i = 0; i < connections_.size(); ++i) {
+    const auto& client = connections_[i].client;
+    auto load = client ? client->getPendingRequestCount() +
+                         client->getInflightRequestCount()
+                       : 0;
+    if (load < bestLoad) {
+      best = i;
+      bestLoad = load;
+      if (load == 0) {
+        break;
+      }
+    }
+  }
+  return best;
+}
+
+size_t ProxyDestination::connectionOf(const AsyncMcClient* client) const {
+  for (size_t i = 0; i < connections_.size(); ++i) {
+    if (connections_[i].client.get() == client) {
+      return i;
+    }
+  }
+  FBI_ASSERT(spare_.client.get() == client);
+  return kSpareConnection;
+}
+
+void ProxyDestination::connectSpare() {
+  if (!spareConnection_ || spare_.up || spareConnecting_ || !may_send()) {
+    return;
+  }
+  if (!spare_.client) {
+    initializeAsyncMcClient(kSpareConnection);
+  }
+  spareConnecting_ = true;
+  auto selfPtr = selfPtr_;
+  proxy->fiberManager.addTask([selfPtr]() {
+    auto pdstn = selfPtr.lock();
+    if (pdstn == nullptr) {
+      return;
+    }
+    // closed by resetInactive() in the meantime
+    if (pdstn->spare_.client) {
+      auto mutReq = createMcMsgRef();
+      mutReq->op = mc_op_version;
+      McRequest req(std::move(mutReq));
+      // connection failures are handled in on_down
+      pdstn->spare_.client->sendSync(req, McOperation<mc_op_version>(),
+                                     pdstn->shortestTimeout);
+    }
+    pdstn->spareConnecting_ = false;
+  });
+}
+
+void ProxyDestination::updateSpareConnection(bool spare) {
+  if (spare && !spareConnection_) {
+    spareConnection_ = true;
+    if (connectionsUp_ > 0) {
+      connectSpare();
+    }
   }
 }
 
 AsyncMcClient& ProxyDestination::getAsyncMcClient() {
-  if (!client_) {
-    initializeAsyncMcClient();
+  auto connection = pickConnection();
+  if (!connections_[connection].client) {
+    initializeAsyncMcClient(connection);
   }
-  return *client_;
+  return *connections_[connection].client;
 }
 
 void ProxyDestination::onTkoEvent(TkoLogEvent event, mc_res_t result) const {
@@ -421,10 +761,32 @@ void ProxyDestination::updateShortestTimeout(
   }
   if (shortestTimeout.count() == 0 || shortestTimeout > timeout) {
     shortestTimeout = timeout;
-    if (client_) {
-      client_->updateWriteTimeout(shortestTimeout);
+    for (auto& conn : connections_) {
+      if (conn.client) {
+        conn.client->updateWriteTimeout(shortestTimeout);
+      }
+    }
+    if (spare_.client) {
+      spare_.client->updateWriteTimeout(shortestTimeout);
     }
   }
 }
 
+void ProxyDestination::moveToProxy(proxy_t& newProxy) {
+  FBI_ASSERT(registry);
+  FBI_ASSERT(newProxy.eventBase == proxy->eventBase);
+  FBI_ASSERT(stateList_ == nullptr);
+
+  stat_decr(proxy->stats, getStatName(stats_.state), 1);
+  stat_incr(newProxy.stats, getStatName(stats_.state), 1);
+  proxy = &newProxy;
+  proxy_magic = newProxy.magic;
+}
+
+void ProxyDestination::updateConnectionCount(size_t count) {
+  if (count > connections_.size()) {
+    connections_.resize(count);
+  }
+}
+
 }}}  // facebook::memcache::mcrouter
@@ -14,19 +14,22 @@
 #include <atomic>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <folly/IntrusiveList.h>
 
+#include "mcrouter/AdaptiveConcurrencyLimit.h"
+#include "mcrouter/AdaptiveTimeout.h"
 #include "mcrouter/lib/network/AccessPoint.h"
 #include "mcrouter/lib/network/AsyncMcClient.h"
+#include "mcrouter/lib/network/TimerWheel.h"
 #include "mcrouter/config.h"
 #include "mcrouter/ExponentialSmoothData.h"
+#include "mcrouter/LatencyHistogram.h"
 #include "mcrouter/lib/McMsgRef.h"
 #include "mcrouter/lib/McOperation.h"
 #include "mcrouter/TkoLog.h"
 
-using asox_timer_t = void*;
-
 namespace facebook { namespace memcache {
 
 class McReply;
@@ -34,11 +37,14 @@ class McRequest;
 
 namespace mcrouter {
 
+class ClientPool;
 class DestinationRequestCtx;
 class ProxyClientCommon;
 class ProxyClientOwner;
 class ProxyClientShared;
 class ProxyDestinationMap;
+class ProxyDestinationRegistry;
+class PoolTkoTracker;
 class dynamic_stat_t;
 class proxy_t;
 
@@ -54,6 +60,9 @@ enum class ProxyDestinationState {
 struct ProxyDestinationStats {
   ProxyDestinationState state{ProxyDestinationState::kNew};
   ExponentialSmoothData avgLatency;
+  LatencyHistogram latencyUs;
+  /// time to establish connection (including SSL handshake)
+  LatencyHistogram connectUs;
   uint64_t results[mc_nres] = {0};
 
   explicit ProxyDestinationStats(const McrouterOptions& opts);
@@ -61,17 +70,51 @@ struct ProxyDestinationStats {
 
 struct ProxyDestination {
   static const uint64_t kDeadBeef = 0xdeadbeefdeadbeefULL;
+  static constexpr size_t kCacheLineSize = 64;
+
+  /* Fields used by every request come first, in the first two cache lines
+     (destinations are allocated cache line aligned, see operator new).
+     Strings, probe state and stats only used on replies follow. */
 
   proxy_t* proxy{nullptr}; ///< for convenience
-  const AccessPoint accessPoint;
-  const std::string destinationKey;///< always the same for a given (host, port)
+  uint64_t proxy_magic{0}; ///< to allow asserts that proxy is still alive
+
+  std::shared_ptr<ProxyClientShared> shared;
+
+ private:
+  struct Connection {
+    std::unique_ptr<AsyncMcClient> client;
+    bool up{false};
+  };
+  /* Connections are opened on demand, see pickConnection().
+     TKO and stats are tracked for the destination as a whole. */
+  std::vector<Connection> connections_;
+
+  /* Requests sent and waiting for reply, including queued ones */
+  size_t outstanding_{0};
+  std::unique_ptr<AdaptiveConcurrencyLimit> concurrencyLimit_;
+  /* Created once a pool with adaptive timeouts sends here */
+  std::unique_ptr<AdaptiveTimeout> adaptiveTimeout_;
+
+  /* Position in ProxyDestinationMap's list of active destinations */
+  void* stateList_{nullptr};
+  folly::IntrusiveListHook stateListHook_;
+  uint64_t activeEpoch_{0};
+
+ public:
   // Shortest timeout among all ProxyClientCommon's using this destination
   std::chrono::milliseconds shortestTimeout{0};
-  const std::string pdstnKey;///< consists of ap, server_timeout
+
+  const AccessPoint accessPoint;
+  /// always the same for a given (host, port), interned
+  const std::string& destinationKey;
+  /// consists of ap, server_timeout, interned (see ProxyClientCommon)
+  const std::string& pdstnKey;
+  const uint32_t pdstnKeyId;///< interned pdstnKey, see ProxyClientCommon
   uint64_t magic{0}; ///< to allow asserts that pdstn is still alive
-  const uint64_t proxy_magic{0}; ///< to allow asserts that proxy is still alive
 
-  std::shared_ptr<ProxyClientShared> shared;
+  /// Set if shared between McrouterInstances, must outlive shared
+  std::shared_ptr<ProxyDestinationRegistry> registry;
 
   const bool use_ssl{false};
 
@@ -79,18 +122,76 @@ struct ProxyDestination {
 
   static std::shared_ptr<ProxyDestination> create(proxy_t* proxy,
                                                   const ProxyClientCommon& ro,
-                                                  std::string pdstnKey);
+                                                  const std::string& pdstnKey,
+                                                  uint32_t pdstnKeyId);
 
   ~ProxyDestination();
 
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr);
+
+  /**
+   * Starts loading the fields used by send() into the CPU cache, so that
+   * callers can overlap that with their own work before sending.
+   */
+  void prefetch() const {
+    __builtin_prefetch(this);
+    __builtin_prefetch(reinterpret_cast<const char*>(this) + kCacheLineSize);
+  }
+
   // This is a blocking call that will return reply, once it's ready.
   template <int Op, class Request>
   typename ReplyType<McOperation<Op>, Request>::type
   send(const Request& request, McOperation<Op>, DestinationRequestCtx& req_ctx,
        uint64_t senderId, std::chrono::milliseconds timeout);
+
+  /**
+   * A request started by startSend(), see finishSend().
+   */
+  template <int Op, class Request>
+  struct PendingSend {
+    AsyncMcClient::SyncRequest<McOperation<Op>, Request> request;
+    /* Outstanding requests when it was sent, see onReply() */
+    size_t outstanding{0};
+    /* request.valueBytesCopied() before it was sent */
+    size_t valueBytesCopied{0};
+  };
+
+  /**
+   * send() in two steps, so that one fiber can have requests to several
+   * destinations in flight (see AsyncMcClient::startSync()): startSend()
+   * returns right away, finishSend() blocks until the reply is in.
+   * Every started request must be finished, with request and req_ctx
+   * alive until then.
+   */
+  template <int Op, class Request>
+  PendingSend<Op, Request>
+  startSend(const Request& request, McOperation<Op>,
+            DestinationRequestCtx& req_ctx, std::chrono::milliseconds timeout);
+
+  template <int Op, class Request>
+  typename ReplyType<McOperation<Op>, Request>::type
+  finishSend(PendingSend<Op, Request> pending, const Request& request,
+             DestinationRequestCtx& req_ctx);
   // returns true if okay to send req using this client
   bool may_send();
 
+  /**
+   * @return false if a request must be refused to keep the number
+   *         of outstanding requests within the adaptive limit
+   *         (see --target-adaptive-concurrency).
+   */
+  bool underConcurrencyLimit() const {
+    return !concurrencyLimit_ || outstanding_ < concurrencyLimit_->limit();
+  }
+
+  /**
+   * Current adaptive concurrency limit, 0 if it's disabled.
+   */
+  size_t concurrencyLimit() const {
+    return concurrencyLimit_ ? concurrencyLimit_->limit() : 0;
+  }
+
   /**
    * Returns one of the four states that the server could be in:
    * new, up, closed or total knockout (tko): means we're out for the count,
@@ -106,11 +207,33 @@ struct ProxyDestination {
 
   void resetInactive();
 
-  void on_up();
-  void on_down();
+  /**
+   * Connects to the destination if it never connected before, by sending
+   * a version request. Must be called from a fiber of the proxy thread,
+   * blocks until the reply.
+   */
+  void warmup();
+
+  /**
+   * Marks the destination hard TKO and starts probing it, because it was
+   * TKO in the process this one replaced (see HotRestartState). The first
+   * successful probe unmarks it, soft TKO included.
+   */
+  void inheritTko();
+
+  /* Index of the spare connection, see updateSpareConnection() */
+  static constexpr size_t kSpareConnection = static_cast<size_t>(-1);
+
+  /**
+   * Status callbacks of the connection with given index. The destination
+   * is up while at least one of its connections (not counting the spare)
+   * is up.
+   */
+  void on_up(size_t connection);
+  void on_down(size_t connection);
 
   // on probe timer
-  void on_timer(const asox_timer_t timer);
+  void on_timer();
 
   size_t getPendingRequestCount() const;
   size_t getInflightRequestCount() const;
@@ -122,23 +245,85 @@ struct ProxyDestination {
    */
   std::pair<uint64_t, uint64_t> getBatchingStat() const;
 
+  /**
+   * See AsyncMcClient::getWriteBatchHistogram.
+   * All zeros if there's no open client.
+   */
+  WriteBatchHistogram getWriteBatchHistogram() const;
+
   void updateShortestTimeout(std::chrono::milliseconds timeout);
 
-  void updatePoolName(std::string poolName) {
-    poolName_ = std::move(poolName);
+  /**
+   * Timeout of requests to this destination from client: its server
+   * timeout, tightened to recent latency if client's pool has adaptive
+   * timeouts (see AdaptiveTimeout).
+   */
+  std::chrono::milliseconds requestTimeout(const ProxyClientCommon& client);
+
+  /**
+   * Number of connections requests are striped over. Pools sharing
+   * the destination may ask for different numbers, the largest one is used.
+   */
+  size_t connectionCount() const {
+    return connections_.size();
   }
 
+  void updateConnectionCount(size_t count);
+
+  /**
+   * If set, an extra connection is kept established (opened once a regular
+   * connection comes up) but not used for requests: when a connection
+   * fails, the spare takes its place right away, so the requests that
+   * follow don't wait for a handshake. Pools sharing the destination may
+   * ask for different settings, the spare is kept if any of them asks.
+   */
+  void updateSpareConnection(bool spare);
+
+  /**
+   * Pool the destination is reported (and probed) as a part of.
+   * Pools sharing the destination may call this, the last one wins.
+   */
+  void updatePool(const ClientPool& pool);
+
+  /**
+   * Hand over a shared destination to another proxy running on the same
+   * event base (see ProxyDestinationRegistry).
+   */
+  void moveToProxy(proxy_t& newProxy);
+
  private:
-  std::unique_ptr<AsyncMcClient> client_;
+  size_t connectionsUp_{0};
+
+  /* See updateSpareConnection() */
+  Connection spare_;
+  bool spareConnection_{false};
+  bool spareConnecting_{false};
 
   ProxyDestinationStats stats_;
 
   int probe_delay_next_ms{0};
   bool sending_probes{false};
   std::unique_ptr<McRequest> probe_req;
-  asox_timer_t probe_timer{nullptr};
+  class ProbeTimer : public TimerWheel::Callback {
+   public:
+    explicit ProbeTimer(ProxyDestination& pdstn) : pdstn_(pdstn) {}
+    void timeoutExpired() noexcept override {
+      pdstn_.on_timer();
+    }
+   private:
+    ProxyDestination& pdstn_;
+  };
+  /* Wheel of the proxy's event base, must outlive probeTimer_ */
+  std::shared_ptr<TimerWheel> timerWheel_;
+  ProbeTimer probeTimer_{*this};
   size_t probesSent_{0};
   std::string poolName_;
+  size_t poolSize_{0};
+  /* While sending probes, if --pool-probe-sample-threshold-pct is set */
+  std::shared_ptr<PoolTkoTracker> poolTko_;
+  bool probeSampled_{false};
+  uint64_t poolRecoveriesSeen_{0};
+  int64_t lastProbeUs_{0};
 
   char resetting{0}; // If 1 when inside on_down, the call was due to a forced
                      // mc_client_reset and not a remote connection failure.
@@ -149,27 +334,61 @@ struct ProxyDestination {
   char marked_tko{0};
 
   void start_sending_probes();
-  void stop_sending_probes();
+  /**
+   * @param recovered  true if a probe succeeded
+   */
+  void stop_sending_probes(bool recovered = false);
 
   void schedule_next_probe();
+  /* False if the pool is mostly dead and other destinations probe for us */
+  bool should_send_probe();
 
   void handle_tko(const McReply& reply, bool is_probe_req);
   void unmark_tko(const McReply& reply);
 
-  // Process tko, stats and duration timer.
-  void onReply(const McReply& reply, DestinationRequestCtx& destreqCtx);
+  // Process tko, stats, duration timer and concurrency limit.
+  // outstanding is the number of outstanding requests when it was sent.
+  void onReply(const McReply& reply, DestinationRequestCtx& destreqCtx,
+               size_t outstanding);
 
+  // Common part for send()/finishSend() once the reply is in: stats for the
+  // bytesCopied value bytes coalesced by the send, then onReply() unless the
+  // request was cancelled before being written.
+  void onSendReply(const McReply& reply, size_t bytesCopied,
+                   DestinationRequestCtx& destreqCtx, size_t outstanding);
+
+  /**
+   * @return client of the connection with fewest outstanding requests,
+   *         opening the connection if needed.
+   */
   AsyncMcClient& getAsyncMcClient();
-  void initializeAsyncMcClient();
+  size_t pickConnection() const;
+  void initializeAsyncMcClient(size_t connection);
+
+  Connection& connectionAt(size_t index) {
+    return index == kSpareConnection ? spare_ : connections_[index];
+  }
+  /**
+   * @return index of the connection client belongs to (clients move from
+   *         one to another when the spare is swapped in)
+   */
+  size_t connectionOf(const AsyncMcClient* client) const;
+
+  /* Opens the spare connection, unless it's up or being opened */
+  void connectSpare();
 
   ProxyDestination(proxy_t* proxy,
                    const ProxyClientCommon& ro,
-                   std::string pdstnKey);
+                   const std::string& pdstnKey,
+                   uint32_t pdstnKeyId);
 
   void onTkoEvent(TkoLogEvent event, mc_res_t result) const;
 
-  void* stateList_{nullptr};
-  folly::IntrusiveListHook stateListHook_;
+  /* Reported to MemoryAccounting; the buffers of the clients are accounted
+     by their parsers. */
+  size_t memoryBytes() const {
+    return sizeof(*this) + connections_.capacity() * sizeof(Connection);
+  }
 
   std::weak_ptr<ProxyDestination> selfPtr_;
 
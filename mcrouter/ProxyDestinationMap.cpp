@@ -9,27 +9,48 @@
  */
 #include "ProxyDestinationMap.h"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <vector>
+
 #include <folly/io/async/EventBase.h>
 #include <folly/Memory.h>
 
 #include "mcrouter/ClientPool.h"
-#include "mcrouter/lib/fbi/asox_timer.h"
-#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/HotRestartState.h"
+#include "mcrouter/lib/network/TimerWheel.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/ProxyDestination.h"
+#include "mcrouter/ProxyDestinationRegistry.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
-namespace {
+constexpr uint64_t ProxyDestinationMap::kResetEpochs;
 
-void onResetTimer(const asox_timer_t timer, void* arg) {
-  auto map = reinterpret_cast<ProxyDestinationMap*>(arg);
-  map->resetAllInactive();
-}
+/**
+ * Calls resetAllInactive() once per epoch.
+ */
+class ProxyDestinationMap::ResetTimer : public TimerWheel::Callback {
+ public:
+  ResetTimer(ProxyDestinationMap& map, TimerWheel& wheel,
+             std::chrono::milliseconds interval)
+    : map_(map), wheel_(wheel), interval_(interval) {
+    wheel_.scheduleTimeout(*this, interval_);
+  }
+
+  void timeoutExpired() noexcept override {
+    wheel_.scheduleTimeout(*this, interval_);
+    map_.resetAllInactive();
+  }
 
-} // namespace
+ private:
+  ProxyDestinationMap& map_;
+  TimerWheel& wheel_;
+  const std::chrono::milliseconds interval_;
+};
 
 struct ProxyDestinationMap::StateList {
   using List = folly::IntrusiveList<ProxyDestination,
@@ -37,31 +58,51 @@ struct ProxyDestinationMap::StateList {
   List list;
 };
 
+struct ProxyDestinationMap::WarmupState {
+  std::deque<std::weak_ptr<ProxyDestination>> queue;
+  /// queued destinations plus the ones being connected right now
+  std::atomic<size_t> pending{0};
+  size_t workers{0};
+};
+
 ProxyDestinationMap::ProxyDestinationMap(proxy_t* proxy)
   : proxy_(proxy),
     active_(folly::make_unique<StateList>()),
-    inactive_(folly::make_unique<StateList>()),
-    resetTimer_(nullptr) {
+    warmup_(std::make_shared<WarmupState>()) {
+  if (proxy_->opts.share_destinations_across_instances) {
+    registry_ = ProxyDestinationRegistry::get();
+    if (registry_) {
+      registry_->attach(*proxy_);
+    }
+  }
 }
 
 std::shared_ptr<ProxyDestination>
 ProxyDestinationMap::fetch(const ProxyClientCommon& client) {
-  auto key = client.genProxyDestinationKey(
-    !proxy_->router->opts().same_connection_any_timeout);
+  if (destinationsDisabled_) {
+    return nullptr;
+  }
+  if (registry_) {
+    return registry_->fetch(*proxy_, client);
+  }
+
+  auto includeTimeout = !proxy_->router->opts().same_connection_any_timeout;
+  auto keyId = client.proxyDestinationKeyId(includeTimeout);
   std::shared_ptr<ProxyDestination> destination;
   {
     std::lock_guard<std::mutex> lck(destinationsLock_);
 
-    auto it = destinations_.find(key);
-    if (it != destinations_.end()) {
-      destination = it->second.lock();
-    }
+    auto& entry = destinations_[keyId];
+    destination = entry.lock();
     if (!destination) {
-      destination = ProxyDestination::create(proxy_, client, key);
-      destinations_[std::move(key)] = destination;
+      destination = ProxyDestination::create(
+        proxy_, client, client.proxyDestinationKey(includeTimeout), keyId);
+      entry = destination;
     } else {
-      destination->updatePoolName(client.pool.getName());
-      destination->updateShortestTimeout(client.server_timeout);
+      destination->updatePool(client.pool);
+      destination->updateShortestTimeout(client.settings.server_timeout);
+      destination->updateConnectionCount(client.settings.connections);
+      destination->updateSpareConnection(client.settings.spareConnection);
     }
   }
 
@@ -72,54 +113,157 @@ ProxyDestinationMap::fetch(const ProxyClientCommon& client) {
         *destination,
         proxy_->router->opts().failures_until_tko,
         proxy_->router->opts().maximum_soft_tkos,
-        proxy_->router->tkoCounters_);
+        proxy_->router->tkoCounters_,
+        proxy_->router->sharedTkoTable_.get());
   }
 
   return destination;
 }
 
+void ProxyDestinationMap::adopt(
+  std::shared_ptr<ProxyDestination> destination) {
+  std::lock_guard<std::mutex> lck(destinationsLock_);
+  destinations_[destination->pdstnKeyId] = std::move(destination);
+}
+
 void ProxyDestinationMap::removeDestination(ProxyDestination& destination) {
   if (destination.stateList_ == active_.get()) {
     active_->list.erase(StateList::List::s_iterator_to(destination));
-  } else if (destination.stateList_ == inactive_.get()) {
-    inactive_->list.erase(StateList::List::s_iterator_to(destination));
+    destination.stateList_ = nullptr;
   }
   {
     std::lock_guard<std::mutex> lck(destinationsLock_);
-    destinations_.erase(destination.pdstnKey);
+    auto it = destinations_.find(destination.pdstnKeyId);
+    /* The entry may already point to a newer destination */
+    if (it != destinations_.end() && it->second.expired()) {
+      destinations_.erase(it);
+    }
   }
 }
 
 void ProxyDestinationMap::markAsActive(ProxyDestination& destination) {
   if (destination.stateList_ == active_.get()) {
-    return;
-  }
-  if (destination.stateList_ == inactive_.get()) {
-    inactive_->list.erase(StateList::List::s_iterator_to(destination));
+    if (destination.activeEpoch_ == epoch_) {
+      return;
+    }
+    active_->list.erase(StateList::List::s_iterator_to(destination));
   }
   active_->list.push_back(destination);
   destination.stateList_ = active_.get();
+  destination.activeEpoch_ = epoch_;
 }
 
 void ProxyDestinationMap::resetAllInactive() {
-  for (auto& it : inactive_->list) {
-    it.resetInactive();
-    it.stateList_ = nullptr;
+  ++epoch_;
+  auto& list = active_->list;
+  while (!list.empty() && epoch_ - list.front().activeEpoch_ > kResetEpochs) {
+    auto& destination = list.front();
+    list.pop_front();
+    destination.stateList_ = nullptr;
+    destination.resetInactive();
   }
-  inactive_->list.clear();
-  active_.swap(inactive_);
 }
 
 void ProxyDestinationMap::setResetTimer(std::chrono::milliseconds interval) {
   assert(interval.count() > 0);
-  auto delay = to<timeval_t>((unsigned int)interval.count());
-  resetTimer_ = asox_add_timer(proxy_->eventBase->getLibeventBase(), delay,
-                               onResetTimer, this);
+  if (!timerWheel_) {
+    timerWheel_ = TimerWheel::get(*proxy_->eventBase);
+  }
+  std::chrono::milliseconds epoch(
+    std::max<int64_t>(interval.count() / kResetEpochs, 1));
+  resetTimer_ = folly::make_unique<ResetTimer>(*this, *timerWheel_, epoch);
+}
+
+void ProxyDestinationMap::warmup(size_t concurrency) {
+  {
+    std::lock_guard<std::mutex> lck(destinationsLock_);
+    for (const auto& it : destinations_) {
+      auto destination = it.second.lock();
+      if (destination &&
+          destination->state() == ProxyDestinationState::kNew) {
+        warmup_->queue.push_back(destination);
+        ++warmup_->pending;
+      }
+    }
+  }
+
+  startWarmupWorkers(concurrency);
+}
+
+void ProxyDestinationMap::takeOver(const HotRestartState& state,
+                                   size_t concurrency) {
+  std::vector<std::shared_ptr<ProxyDestination>> tko;
+  {
+    std::lock_guard<std::mutex> lck(destinationsLock_);
+    for (const auto& it : destinations_) {
+      auto destination = it.second.lock();
+      if (!destination ||
+          destination->state() != ProxyDestinationState::kNew) {
+        continue;
+      }
+      auto previous = state.find(destination->destinationKey);
+      if (previous == nullptr) {
+        continue;
+      }
+      if (*previous == HotRestartState::Destination::kUp) {
+        warmup_->queue.push_back(destination);
+        ++warmup_->pending;
+      } else {
+        tko.push_back(std::move(destination));
+      }
+    }
+  }
+  /* outside of the lock, TKO may close connections */
+  for (auto& destination : tko) {
+    destination->inheritTko();
+  }
+
+  startWarmupWorkers(concurrency);
+}
+
+void ProxyDestinationMap::foreachDestination(
+    std::function<void(const ProxyDestination&)> f) {
+  std::lock_guard<std::mutex> lck(destinationsLock_);
+  for (const auto& it : destinations_) {
+    if (auto destination = it.second.lock()) {
+      f(*destination);
+    }
+  }
+}
+
+void ProxyDestinationMap::startWarmupWorkers(size_t concurrency) {
+  // workers only run in the proxy thread, so the queue needs no locking
+  auto state = warmup_;
+  while (state->workers < concurrency && !state->queue.empty()) {
+    ++state->workers;
+    proxy_->fiberManager.addTask([state]() {
+      while (!state->queue.empty()) {
+        auto destination = state->queue.front().lock();
+        state->queue.pop_front();
+        if (destination) {
+          destination->warmup();
+        }
+        --state->pending;
+      }
+      --state->workers;
+    });
+  }
+}
+
+size_t ProxyDestinationMap::warmupPending() const {
+  return warmup_->pending.load();
 }
 
 ProxyDestinationMap::~ProxyDestinationMap() {
-  if (resetTimer_ != nullptr) {
-    asox_remove_timer(resetTimer_);
+  resetTimer_.reset();
+  if (registry_) {
+    /* Destinations handed over to other proxies must not point
+       to our lists */
+    for (auto& it : active_->list) {
+      it.stateList_ = nullptr;
+    }
+    active_->list.clear();
+    registry_->detach(*proxy_);
   }
 }
 
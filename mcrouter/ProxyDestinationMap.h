@@ -10,18 +10,24 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 
-using asox_timer_t = void*;
+namespace facebook { namespace memcache {
 
-namespace facebook { namespace memcache { namespace mcrouter {
+class TimerWheel;
 
+namespace mcrouter {
+
+class HotRestartState;
 class ProxyClientCommon;
 class ProxyDestination;
+class ProxyDestinationRegistry;
 class proxy_t;
 
 /**
@@ -37,6 +43,10 @@ class proxy_t;
  * opened connection to this destination and there were requests during last
  * reset_inactive_connection_interval ms routed to this destination.
  * 'Inactive' means there were no requests and connection may be closed.
+ *
+ * Active destinations are kept in a list ordered by the epoch (a fraction of
+ * the reset interval) they were last used in, so that resetting inactive
+ * connections only looks at the stale head of the list.
  */
 class ProxyDestinationMap {
  public:
@@ -45,46 +55,112 @@ class ProxyDestinationMap {
   /**
    * If ProxyDestination is already stored in this object - returns it;
    * otherwise creates a new one.
+   *
+   * With --share-destinations-across-instances destinations come from
+   * the process-wide ProxyDestinationRegistry instead, and only the ones
+   * owned by this proxy are stored here.
    */
   std::shared_ptr<ProxyDestination> fetch(const ProxyClientCommon& client);
 
+  /**
+   * From now on fetch() returns nullptr, for proxies that only build configs
+   * to validate them (see ConfigValidator): no destinations, and so no
+   * sockets, are created for their pools.
+   */
+  void disableDestinations() {
+    destinationsDisabled_ = true;
+  }
+
+  /**
+   * Start managing a shared destination owned by this proxy.
+   */
+  void adopt(std::shared_ptr<ProxyDestination> destination);
+
   /**
    * Remove destination from both active and inactive lists
    */
   void removeDestination(ProxyDestination& destination);
 
   /**
-   * Mark destination as 'active', so it won't be closed on next
-   * resetAllInactive call
+   * Mark destination as 'active', so it won't be closed until it's unused
+   * for a whole reset interval. O(1), and only touches the list once per
+   * epoch for each destination.
    */
   void markAsActive(ProxyDestination& destination);
 
   /**
-   * Close all 'inactive' destinations i.e. destinations which weren't marked
-   * 'active' after last removeAllInactive call.
+   * Start a new epoch and close all 'inactive' destinations i.e.
+   * destinations which weren't marked 'active' during the last
+   * kResetEpochs epochs.
    */
   void resetAllInactive();
 
   /**
    * Set timer which resets inactive connections.
-   * @param interval timer interval, should be greater than zero.
+   * @param interval how long a destination has to be unused before its
+   *        connections are closed, should be greater than zero.
+   *        The timer fires kResetEpochs times per interval.
    */
   void setResetTimer(std::chrono::milliseconds interval);
 
+  static constexpr uint64_t kResetEpochs = 4;
+
+  /**
+   * Connect to all destinations that never connected, with at most
+   * `concurrency` connection attempts at a time, so that the first
+   * requests don't pay connection latency. Must be called from the proxy
+   * thread, destinations are connected in background fibers.
+   */
+  void warmup(size_t concurrency);
+
+  /**
+   * @return number of destinations that are waiting for or in the middle of
+   *         warmup. Zero means warmup is complete. Thread-safe.
+   */
+  size_t warmupPending() const;
+
+  /**
+   * Takes over the destination state of the process this one replaces
+   * during a hot restart: destinations TKO there start TKO here (and this
+   * proxy probes them), the ones connected there are connected to like
+   * warmup() does. Must be called from the proxy thread.
+   */
+  void takeOver(const HotRestartState& state, size_t concurrency);
+
+  /**
+   * Calls f for every destination. Must be called from the proxy thread.
+   */
+  void foreachDestination(std::function<void(const ProxyDestination&)> f);
+
   ~ProxyDestinationMap();
 
  private:
   struct StateList;
+  struct WarmupState;
+  class ResetTimer;
 
   proxy_t* proxy_;
-  std::unordered_map<std::string, std::weak_ptr<ProxyDestination>>
+  bool destinationsDisabled_{false};
+  /// keyed by interned pdstnKey
+  std::unordered_map<uint32_t, std::weak_ptr<ProxyDestination>>
     destinations_;
   std::mutex destinationsLock_;
 
+  /// ordered by ProxyDestination::activeEpoch_, oldest first
   std::unique_ptr<StateList> active_;
-  std::unique_ptr<StateList> inactive_;
+  uint64_t epoch_{0};
+
+  /// shared with warmup fibers, which may outlive this object
+  std::shared_ptr<WarmupState> warmup_;
+
+  void startWarmupWorkers(size_t concurrency);
+
+  /// wheel of the proxy's event base, must outlive resetTimer_
+  std::shared_ptr<TimerWheel> timerWheel_;
+  std::unique_ptr<ResetTimer> resetTimer_;
 
-  asox_timer_t resetTimer_;
+  /// null unless destinations are shared across instances
+  std::shared_ptr<ProxyDestinationRegistry> registry_;
 };
 
 }}} // facebook::memcache::mcrouter
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ProxyDestinationRegistry.h"
+
+#include <algorithm>
+
+#include <folly/Singleton.h>
+
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyClientCommon.h"
+#include "mcrouter/ProxyDestination.h"
+#include "mcrouter/ProxyDestinationMap.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+folly::Singleton<ProxyDestinationRegistry> gProxyDestinationRegistry;
+
+}  // anonymous namespace
+
+std::shared_ptr<ProxyDestinationRegistry> ProxyDestinationRegistry::get() {
+  return gProxyDestinationRegistry.get_weak().lock();
+}
+
+void ProxyDestinationRegistry::attach(proxy_t& proxy) {
+  std::lock_guard<std::mutex> lck(mutex_);
+  proxies_.push_back(&proxy);
+}
+
+void ProxyDestinationRegistry::detach(proxy_t& proxy) {
+  std::vector<std::pair<std::shared_ptr<ProxyDestination>, proxy_t*>> moved;
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    proxies_.erase(std::remove(proxies_.begin(), proxies_.end(), &proxy),
+                   proxies_.end());
+
+    auto heir = std::find_if(
+      proxies_.begin(), proxies_.end(),
+      [&proxy](const proxy_t* other) {
+        return other->eventBase == proxy.eventBase;
+      });
+
+    for (auto it = destinations_.begin(); it != destinations_.end(); ) {
+      auto destination = it->second.lock();
+      if (!destination || destination->proxy != &proxy) {
+        ++it;
+        continue;
+      }
+      if (heir == proxies_.end()) {
+        /* Nobody else can use it, don't let a new proxy on the same
+           event base pick up a destination of a dying proxy */
+        it = destinations_.erase(it);
+      } else {
+        moved.emplace_back(std::move(destination), *heir);
+        ++it;
+      }
+    }
+  }
+
+  for (auto& it : moved) {
+    it.first->moveToProxy(*it.second);
+    it.second->destinationMap->adopt(it.first);
+  }
+}
+
+std::shared_ptr<ProxyDestination> ProxyDestinationRegistry::fetch(
+  proxy_t& proxy,
+  const ProxyClientCommon& client) {
+
+  Key key(proxy.eventBase, client.proxyDestinationKeyId(false));
+  std::shared_ptr<ProxyDestination> destination;
+  bool created = false;
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    auto& entry = destinations_[key];
+    destination = entry.lock();
+    if (!destination) {
+      destination = ProxyDestination::create(
+        &proxy, client, client.proxyDestinationKey(false), key.second);
+      destination->registry = shared_from_this();
+      entry = destination;
+      created = true;
+    }
+  }
+
+  if (created) {
+    proxy.destinationMap->adopt(destination);
+    pclientOwner_.updateProxyClientShared(
+        *destination,
+        proxy.opts.failures_until_tko,
+        proxy.opts.maximum_soft_tkos,
+        tkoCounters_,
+        /* sharedTkoTable */ nullptr);
+  } else {
+    destination->updatePool(client.pool);
+    destination->updateShortestTimeout(client.settings.server_timeout);
+    destination->updateConnectionCount(client.settings.connections);
+    destination->updateSpareConnection(client.settings.spareConnection);
+  }
+
+  return destination;
+}
+
+void ProxyDestinationRegistry::remove(ProxyDestination& destination) {
+  std::lock_guard<std::mutex> lck(mutex_);
+  auto it = destinations_.find(
+    Key(destination.proxy->eventBase, destination.pdstnKeyId));
+  if (it == destinations_.end()) {
+    return;
+  }
+  /* The entry may already point to a newer destination */
+  auto current = it->second.lock();
+  if (!current || current.get() == &destination) {
+    destinations_.erase(it);
+  }
+}
+
+}}}  // facebook::memcache::mcrouter
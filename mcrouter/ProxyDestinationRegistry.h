@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "mcrouter/pclient.h"
+#include "mcrouter/TkoCounters.h"
+
+namespace folly {
+class EventBase;
+}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class ProxyClientCommon;
+class ProxyDestination;
+class proxy_t;
+
+/**
+ * Process-wide registry of ProxyDestinations shared between
+ * McrouterInstances (--share-destinations-across-instances).
+ *
+ * AsyncMcClient connections can only be used from the thread of their
+ * EventBase, so destinations are keyed by the proxy's EventBase plus the
+ * untimed destination key: proxies of different instances running on the
+ * same event base (see McrouterInstance::init() with caller-provided event
+ * bases) end up with the same connections and the same TKO state.
+ *
+ * A shared destination is owned by the proxy that created it: stats,
+ * options and inactive connection resets come from the owner. When the
+ * owner goes away, ownership is handed over to another proxy on the same
+ * event base that is still attached.
+ *
+ * TKO tracking of shared destinations uses the registry's own counters and
+ * doesn't use --shared-tko-table.
+ */
+class ProxyDestinationRegistry
+    : public std::enable_shared_from_this<ProxyDestinationRegistry> {
+ public:
+  /**
+   * @return the registry, null during process shutdown
+   */
+  static std::shared_ptr<ProxyDestinationRegistry> get();
+
+  /**
+   * Called when a proxy that shares destinations is created/destroyed.
+   * detach() hands over destinations owned by the proxy, so it must be
+   * called from the proxy's event base thread.
+   */
+  void attach(proxy_t& proxy);
+  void detach(proxy_t& proxy);
+
+  /**
+   * Returns the destination for this client on proxy's event base, creating
+   * one owned by proxy if there's none.
+   */
+  std::shared_ptr<ProxyDestination> fetch(proxy_t& proxy,
+                                          const ProxyClientCommon& client);
+
+  /**
+   * Forget the destination, called when it's destroyed.
+   */
+  void remove(ProxyDestination& destination);
+
+  const TkoCounters& tkoCounters() const {
+    return tkoCounters_;
+  }
+
+ private:
+  /* Event base and interned untimed destination key */
+  using Key = std::pair<folly::EventBase*, uint32_t>;
+
+  std::mutex mutex_;
+  std::map<Key, std::weak_ptr<ProxyDestination>> destinations_;
+  std::vector<proxy_t*> proxies_;
+
+  TkoCounters tkoCounters_;
+  ProxyClientOwner pclientOwner_;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -25,12 +25,20 @@ class ProxyMcReply : public McReplyBase {
   explicit ProxyMcReply(Args&&... args)
     : McReplyBase(std::forward<Args>(args)...) {}
   /* implicit */ ProxyMcReply(McReplyBase reply);
-  void setDestination(std::shared_ptr<const ProxyClientCommon> dest);
+  void setDestination(const ProxyClientCommon* dest) {
+    dest_ = dest;
+  }
+
   /**
    * Returns the destination that this reply was received from.
    * The value is only set when an error reply was received.
+   *
+   * Not refcounted: clients are owned by the config, which stays alive
+   * while the request is pinned to it (see ConfigEpochs).
    */
-  std::shared_ptr<const ProxyClientCommon> getDestination() const;
+  const ProxyClientCommon* getDestination() const {
+    return dest_;
+  }
 
   /**
    * Creates new McReply objects and moves all data into it.
@@ -38,7 +46,7 @@ class ProxyMcReply : public McReplyBase {
   static McReply moveToMcReply(ProxyMcReply&& proxyMcReply);
 
  private:
-  std::shared_ptr<const ProxyClientCommon> dest_;
+  const ProxyClientCommon* dest_{nullptr};
 };
 
 }}}
@@ -9,14 +9,28 @@
  */
 #include "ProxyMcRequest.h"
 
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyRequestContext.h"
+#include "mcrouter/stats.h"
+
 namespace facebook { namespace memcache { namespace mcrouter {
 
 ProxyMcRequest ProxyMcRequest::clone() const {
   ProxyMcRequest req(McRequestWithContext<ProxyRequestContext>::clone());
   req.reqClass_ = reqClass_;
+  req.backgroundPriority_ = backgroundPriority_;
+  req.cancelled_ = cancelled_;
   return req;
 }
 
+void ProxyMcRequest::cancel() {
+  if (cancelled_) {
+    *cancelled_ = true;
+  } else {
+    cancelled_ = std::make_shared<bool>(true);
+  }
+}
+
 folly::StringPiece ProxyMcRequest::getRequestClassString() const {
   switch (reqClass_) {
     case RequestClass::NORMAL:
@@ -29,4 +43,125 @@ folly::StringPiece ProxyMcRequest::getRequestClassString() const {
   CHECK(false) << "Unknown request class";
 }
 
+void setBackgroundPriority(ProxyMcRequest& req, RequestPriority priority) {
+  req.setPriority(priority);
+}
+
+std::shared_ptr<ProxyMcRequest> makeSharedRequest(const ProxyMcRequest& parent,
+                                                  ProxyMcRequest req) {
+  return parent.context().makeShared<ProxyMcRequest>(std::move(req));
+}
+
+void enableCancellation(ProxyMcRequest& req) {
+  if (!req.cancelled_) {
+    req.cancelled_ = std::make_shared<bool>(false);
+  }
+}
+
+bool detachSubRequests(ProxyMcRequest& req, size_t count) {
+  auto& proxy = req.context().proxy();
+  stat_incr(proxy.stats, subrequests_abandoned_stat, count);
+  auto limit = proxy.opts.max_detached_subrequests;
+  if (limit != 0 && proxy.detachedSubRequests + count > limit) {
+    stat_incr(proxy.stats, subrequests_cancelled_stat, count);
+    req.cancel();
+    return false;
+  }
+  proxy.detachedSubRequests += count;
+  stat_incr(proxy.stats, subrequests_detached_stat, count);
+  req.detachCounted_ = true;
+  return true;
+}
+
+void detachedSubRequestDone(const ProxyMcRequest& req) {
+  if (!req.detachCounted_) {
+    return;
+  }
+  auto& proxy = req.context().proxy();
+  --proxy.detachedSubRequests;
+  stat_decr(proxy.stats, subrequests_detached_stat, 1);
+}
+
+void enableSharedSerialization(const ProxyMcRequest& req) {
+  if (req.context().proxy().opts.share_serialized_requests) {
+    req.enableSharedSerialization();
+  }
+}
+
+void negativeCacheEvent(const ProxyMcRequest& req, NegativeCacheEvent event) {
+  auto& proxy = req.context().proxy();
+  switch (event) {
+    case NegativeCacheEvent::HIT:
+      stat_incr(proxy.stats, negative_cache_hits_stat, 1);
+      break;
+    case NegativeCacheEvent::FALSE_POSITIVE:
+      stat_incr(proxy.stats, negative_cache_false_positives_stat, 1);
+      break;
+  }
+}
+
+void speculativeLookupEvent(const ProxyMcRequest& req,
+                            SpeculativeLookupEvent event) {
+  auto& proxy = req.context().proxy();
+  switch (event) {
+    case SpeculativeLookupEvent::SENT:
+      stat_incr(proxy.stats, speculative_lookups_stat, 1);
+      break;
+    case SpeculativeLookupEvent::WASTED:
+      stat_incr(proxy.stats, speculative_lookups_wasted_stat, 1);
+      break;
+  }
+}
+
+void replicationEvent(const ProxyMcRequest& req,
+                      ReplicationEvent event,
+                      int64_t lagUs) {
+  auto& proxy = req.context().proxy();
+  switch (event) {
+    case ReplicationEvent::QUEUED:
+      stat_incr(proxy.stats, replication_queued_stat, 1);
+      stat_incr(proxy.stats, replication_queue_depth_stat, 1);
+      break;
+    case ReplicationEvent::DROPPED:
+      stat_incr(proxy.stats, replication_dropped_stat, 1);
+      break;
+    case ReplicationEvent::RETRIED:
+      stat_incr(proxy.stats, replication_retries_stat, 1);
+      break;
+    case ReplicationEvent::DONE:
+      stat_decr(proxy.stats, replication_queue_depth_stat, 1);
+      proxy.replicationLagUs.insertSample(lagUs);
+      break;
+    case ReplicationEvent::FAILED:
+      stat_incr(proxy.stats, replication_failed_stat, 1);
+      stat_decr(proxy.stats, replication_queue_depth_stat, 1);
+      break;
+  }
+}
+
+void failoverPrimaryRequest(const ProxyMcRequest& req) {
+  auto& proxy = req.context().proxy();
+  if (proxy.failoverBudget) {
+    proxy.failoverBudget->onRequest();
+  }
+}
+
+bool failoverAllowed(const ProxyMcRequest& req) {
+  /* A failover attempt couldn't finish before the deadline anyway,
+     so it doesn't take from the budget either */
+  if (requestDeadlineExceeded(req)) {
+    return false;
+  }
+  auto& proxy = req.context().proxy();
+  if (!proxy.failoverBudget || proxy.failoverBudget->tryRetry()) {
+    return true;
+  }
+  stat_incr(proxy.stats, failover_budget_exhausted_stat, 1);
+  return false;
+}
+
+bool requestDeadlineExceeded(const ProxyMcRequest& req) {
+  return req.context().deadlineExceeded();
+}
+
 }}}  // facebook::memcache::mcrouter
@@ -9,8 +9,17 @@
  */
 #pragma once
 
+#include <memory>
+
+#include <folly/Optional.h>
+
 #include "mcrouter/config.h"
 #include "mcrouter/lib/McRequestWithContext.h"
+#include "mcrouter/lib/MissRateTracker.h"
+#include "mcrouter/lib/NegativeCache.h"
+#include "mcrouter/lib/ReplicationQueue.h"
+#include "mcrouter/lib/RequestPriority.h"
+#include "mcrouter/lib/RetryBudget.h"
 #include "mcrouter/lib/Operation.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -43,10 +52,108 @@ class ProxyMcRequest : public McRequestWithContext<ProxyRequestContext> {
   }
   folly::StringPiece getRequestClassString() const;
 
+  void setPriority(RequestPriority priority) {
+    backgroundPriority_ = priority;
+  }
+  /**
+   * Send queue lane of the request (see ConnectionOptions::priorityWeights):
+   * SHADOW for shadow requests, the priority marked with
+   * setBackgroundPriority() if any, foreground otherwise.
+   */
+  template <class Operation>
+  RequestPriority getPriority(Operation) const {
+    if (reqClass_ == RequestClass::SHADOW) {
+      return RequestPriority::SHADOW;
+    }
+    if (backgroundPriority_) {
+      return *backgroundPriority_;
+    }
+    return foregroundPriority(Operation());
+  }
+
+  /**
+   * Marks the request and the clones that share its cancellation state
+   * (see enableCancellation()) as not needed anymore: they are not sent
+   * to any destination.
+   */
+  void cancel();
+  bool isCancelled() const {
+    return cancelled_ && *cancelled_;
+  }
+
  private:
   RequestClass reqClass_{RequestClass::NORMAL};
+  folly::Optional<RequestPriority> backgroundPriority_;
+  /* Shared with clones, null unless cancellation is enabled */
+  std::shared_ptr<bool> cancelled_;
+  /* Subrequests made from this request count against
+     --max-detached-subrequests */
+  bool detachCounted_{false};
+
+  friend void enableCancellation(ProxyMcRequest& req);
+  friend bool detachSubRequests(ProxyMcRequest& req, size_t count);
+  friend void detachedSubRequestDone(const ProxyMcRequest& req);
 };
 
+/**
+ * Counts NegativeCacheRoute hits and false positives in proxy stats.
+ */
+void negativeCacheEvent(const ProxyMcRequest& req, NegativeCacheEvent event);
+
+/**
+ * Counts speculative MissFailoverRoute lookups, and the ones whose reply
+ * wasn't needed, in proxy stats.
+ */
+void speculativeLookupEvent(const ProxyMcRequest& req,
+                            SpeculativeLookupEvent event);
+
+/**
+ * Background request hook (overload of the customization point in
+ * mcrouter/lib/RequestPriority.h), see ProxyMcRequest::getPriority().
+ */
+void setBackgroundPriority(ProxyMcRequest& req, RequestPriority priority);
+
+/**
+ * Counts ReplicationQueueRoute events in proxy stats, records the lag
+ * of replicated copies in proxy_t::replicationLagUs.
+ */
+void replicationEvent(const ProxyMcRequest& req,
+                      ReplicationEvent event,
+                      int64_t lagUs);
+
+/**
+ * Failover retry budget hooks (overloads of the customization points in
+ * mcrouter/lib/RetryBudget.h), see --failover-retry-budget-pct.
+ * Failovers are never allowed past the request deadline.
+ */
+void failoverPrimaryRequest(const ProxyMcRequest& req);
+bool failoverAllowed(const ProxyMcRequest& req);
+bool requestDeadlineExceeded(const ProxyMcRequest& req);
+
+/**
+ * Creates a shared copy of a request that outlives the current route call
+ * (e.g. for shadow or async subrequests).
+ * For ProxyMcRequests the copy is allocated from the arena of the
+ * request context of `parent`.
+ */
+template <class Request>
+std::shared_ptr<Request> makeSharedRequest(const Request& /* parent */,
+                                           Request req) {
+  return std::make_shared<Request>(std::move(req));
+}
+
+std::shared_ptr<ProxyMcRequest> makeSharedRequest(const ProxyMcRequest& parent,
+                                                  ProxyMcRequest req);
+
+/**
+ * Detached subrequest hooks (overloads of the customization points in
+ * mcrouter/lib/SubRequests.h), limited by --max-detached-subrequests.
+ */
+void enableCancellation(ProxyMcRequest& req);
+bool detachSubRequests(ProxyMcRequest& req, size_t count);
+void detachedSubRequestDone(const ProxyMcRequest& req);
+void enableSharedSerialization(const ProxyMcRequest& req);
+
 } // mcrouter
 
 template <typename Operation>
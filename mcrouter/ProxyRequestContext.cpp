@@ -9,6 +9,8 @@
  */
 #include "ProxyRequestContext.h"
 
+#include <algorithm>
+
 #include <folly/Memory.h>
 
 #include "mcrouter/config.h"
@@ -29,7 +31,31 @@ ProxyRequestContext::ProxyRequestContext(
       reqComplete_(reqComplete),
       logger_(&pr),
       additionalLogger_(&pr) {
+  setOrigReq(std::move(req));
+  counter_add(&proxy_.requestContextsOutstanding, 1);
+}
+
+ProxyRequestContext::ProxyRequestContext(
+  proxy_t& pr,
+  McRequest&& req,
+  mc_op_t op,
+  void (*enqReply)(ProxyRequestContext& preq),
+  void* context,
+  void (*reqComplete)(ProxyRequestContext& preq))
+    : proxy_(pr),
+      savedRequest_(std::move(req)),
+      context_(context),
+      enqueueReply_(enqReply),
+      reqComplete_(reqComplete),
+      logger_(&pr),
+      additionalLogger_(&pr) {
+  /* Points into savedRequest_ (which doesn't move again), so it's only
+     taken once the request is in place */
+  setOrigReq(savedRequest_->dependentMsg(op));
+  counter_add(&proxy_.requestContextsOutstanding, 1);
+}
 
+void ProxyRequestContext::setOrigReq(McMsgRef req) {
   static const char* const kInternalGetPrefix = "__mcrouter__.";
 
   if (req->op == mc_op_get && !strncmp(req->key.str, kInternalGetPrefix,
@@ -44,16 +70,26 @@ ProxyRequestContext::ProxyRequestContext(
   } else {
     origReq_ = std::move(req);
   }
-
-  stat_incr_safe(proxy_.stats, proxy_request_num_outstanding_stat);
 }
 
 ProxyRequestContext::~ProxyRequestContext() {
   assert(replied_);
+  if (traceId_) {
+    traceSpan(SpanKind::kRequest, nullptr, "", createdUs_, nowUs());
+  }
+
   if (reqComplete_) {
     reqComplete_(*this);
   }
 
+  if (config_) {
+    proxy_.configEpochs.unpin(configEpoch_);
+  }
+
+  if (tenant_) {
+    TenantQuotas::release(*tenant_);
+  }
+
   if (processing_) {
     --proxy_.numRequestsProcessing_;
     stat_decr(proxy_.stats, proxy_reqs_processing_stat, 1);
@@ -61,13 +97,35 @@ ProxyRequestContext::~ProxyRequestContext() {
   }
 
   if (requester_) {
-    if (requester_->maxOutstanding_ != 0) {
-      counting_sem_post(&requester_->outstandingReqsSem_, 1);
-    }
+    requester_->returnCredit();
     requester_->decref();
   }
 
-  stat_decr_safe(proxy_.stats, proxy_request_num_outstanding_stat);
+  counter_add(&proxy_.requestContextsOutstanding, -1);
+
+  if (arena_) {
+    arena_->decref();
+  }
+}
+
+std::shared_ptr<ProxyRequestContext> ProxyRequestContext::process(
+  std::unique_ptr<ProxyRequestContext> preq) {
+
+  preq->configEpoch_ = preq->proxy_.configEpochs.pin(preq->config_);
+  if (!preq->arena_) {
+    preq->arena_ = RequestArena::create(preq->proxy_.requestArenaPool);
+  }
+  auto& arena = *preq->arena_;
+  return std::shared_ptr<ProxyRequestContext>(
+    preq.release(),
+    /* Note: we want to delete on main context here since the destructor
+       can do complicated things, like finalize stats entry and
+       destroy a stale config.  There might not be enough stack space
+       for these operations. */
+    [] (ProxyRequestContext* ctx) {
+      fiber::runInMainContext([ctx]{ delete ctx; });
+    },
+    RequestArenaAllocator<ProxyRequestContext>(arena));
 }
 
 uint64_t ProxyRequestContext::senderId() const {
@@ -79,11 +137,36 @@ uint64_t ProxyRequestContext::senderId() const {
   return id;
 }
 
+void ProxyRequestContext::setDeadline(std::chrono::milliseconds timeout) {
+  deadlineUs_ = timeout.count() > 0 ? nowUs() + timeout.count() * 1000 : 0;
+}
+
+folly::Optional<std::chrono::microseconds>
+ProxyRequestContext::remainingTime() const {
+  if (deadlineUs_ == 0 || replied_) {
+    return folly::none;
+  }
+  return std::chrono::microseconds(
+    std::max<int64_t>(deadlineUs_ - nowUs(), 0));
+}
+
+bool ProxyRequestContext::deadlineExceeded() const {
+  auto remaining = remainingTime();
+  return remaining && *remaining < std::chrono::milliseconds(1);
+}
+
 void ProxyRequestContext::onRequestRefused(const ProxyMcRequest& request,
                                            const ProxyMcReply& reply) {
   logger_.logError(request, reply);
 }
 
+void ProxyRequestContext::traceSpan(SpanKind kind, const char* name,
+                                    folly::StringPiece detail,
+                                    int64_t startUs, int64_t endUs) const {
+  assert(traceId_ != 0 && proxy_.tracer);
+  proxy_.tracer->record(traceId_, kind, name, detail, startUs, endUs);
+}
+
 void ProxyRequestContext::sendReply(McReply newReply) {
   if (replied_) {
     return;
@@ -92,7 +175,13 @@ void ProxyRequestContext::sendReply(McReply newReply) {
   replied_ = true;
 
   if (LIKELY(enqueueReply_ != nullptr)) {
-    enqueueReply_(*this);
+    if (traceId_) {
+      auto startUs = nowUs();
+      enqueueReply_(*this);
+      traceSpan(SpanKind::kClientWrite, nullptr, "", startUs, nowUs());
+    } else {
+      enqueueReply_(*this);
+    }
   }
 
   stat_incr(proxy_.stats, request_replied_stat, 1);
@@ -9,12 +9,20 @@
  */
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
 
+#include <folly/Optional.h>
+
 #include "mcrouter/config.h"
 #include "mcrouter/config-impl.h"
 #include "mcrouter/ProxyConfigIf.h"
 #include "mcrouter/ProxyRequestLogger.h"
+#include "mcrouter/RequestArena.h"
+#include "mcrouter/RequestTracer.h"
+#include "mcrouter/TenantQuotas.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -47,24 +55,12 @@ public:
 
   /**
    * Internally converts the context into one ready to route.
-   * Config pointer is saved to keep the config alive, and
+   * The current config of the proxy is pinned to keep it alive, and
    * ownership is changed to shared so that all subrequests
    * keep track of this context.
    */
   static std::shared_ptr<ProxyRequestContext> process(
-    std::unique_ptr<ProxyRequestContext> preq,
-    std::shared_ptr<const ProxyConfigIf> config) {
-    preq->config_ = std::move(config);
-    return std::shared_ptr<ProxyRequestContext>(
-      preq.release(),
-      /* Note: we want to delete on main context here since the destructor
-         can do complicated things, like finalize stats entry and
-         destroy a stale config.  There might not be enough stack space
-         for these operations. */
-      [] (ProxyRequestContext* ctx) {
-        fiber::runInMainContext([ctx]{ delete ctx; });
-      });
-  }
+    std::unique_ptr<ProxyRequestContext> preq);
 
   ~ProxyRequestContext();
 
@@ -86,6 +82,52 @@ public:
     return failoverDisabled_;
   }
 
+  /**
+   * @return true if the client connection of this request is gone, so
+   *         nobody will see the reply. Gets not sent out yet are dropped
+   *         then, writes still go through.
+   */
+  bool clientGone() const {
+    return cancellation_ && cancellation_->load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Flag behind clientGone(), null if the requester can't cancel.
+   */
+  const std::atomic<bool>* cancellation() const {
+    return cancellation_.get();
+  }
+
+  /**
+   * @return nonzero id if this request was sampled by proxy().tracer
+   */
+  uint64_t traceId() const {
+    return traceId_;
+  }
+
+  /**
+   * Records a span of this request. Must only be called if traceId() != 0.
+   */
+  void traceSpan(SpanKind kind, const char* name, folly::StringPiece detail,
+                 int64_t startUs, int64_t endUs) const;
+  /**
+   * Sets the deadline of this request to timeout from now.
+   * Zero timeout means no deadline.
+   */
+  void setDeadline(std::chrono::milliseconds timeout);
+
+  /**
+   * @return time left until the deadline, none if the request has no
+   *         deadline or was already replied to (e.g. async requests).
+   */
+  folly::Optional<std::chrono::microseconds> remainingTime() const;
+
+  /**
+   * @return true if there's not enough time left to send another
+   *         request to a destination
+   */
+  bool deadlineExceeded() const;
+
   /**
    * Called once a reply is received to record a stats sample if required.
    */
@@ -96,7 +138,7 @@ public:
                        const int64_t startTimeUs,
                        const int64_t endTimeUs,
                        Operation) {
-    logger_.log(request, reply, startTimeUs, endTimeUs, Operation());
+    logger_.log(pclient, request, reply, startTimeUs, endTimeUs, Operation());
     additionalLogger_.log(
       pclient, request, reply, startTimeUs, endTimeUs, Operation());
   }
@@ -118,6 +160,20 @@ public:
    */
   void sendReply(McReply newReply);
 
+  /**
+   * Like std::make_shared, but allocates from this request's arena
+   * (if it has one, i.e. once the request is being processed).
+   * Use for objects that don't outlive this request's subrequests.
+   */
+  template <class T, class... Args>
+  std::shared_ptr<T> makeShared(Args&&... args) {
+    if (arena_) {
+      return std::allocate_shared<T>(RequestArenaAllocator<T>(*arena_),
+                                     std::forward<Args>(args)...);
+    }
+    return std::make_shared<T>(std::forward<Args>(args)...);
+  }
+
  private:
   proxy_t& proxy_;
   McMsgRef origReq_;
@@ -125,6 +181,12 @@ public:
   folly::Optional<McRequest> savedRequest_;
   bool replied_{false};
   bool failoverDisabled_{false};
+  /* Absolute deadline in us since epoch, 0 if none */
+  int64_t deadlineUs_{0};
+  /* See traceId() */
+  uint64_t traceId_{0};
+  /* When the client sent the request, set by McrouterClient::send() */
+  int64_t createdUs_{0};
 
   /** If true, this is currently being processed by a proxy and
       we want to notify we're done on destruction. */
@@ -132,6 +194,20 @@ public:
 
   McrouterClient* requester_{nullptr};
   void* context_{nullptr};
+  /* If set, gets the reply instead of the client callbacks, see
+     McrouterClient::send(McRequest&&, ...) */
+  std::function<void(McReply&&)> replyCallback_;
+  /* See clientGone() */
+  std::shared_ptr<const std::atomic<bool>> cancellation_;
+  /* Tenant the request is charged to until it's destroyed, if any
+     (see --proxy-tenant-quotas) */
+  TenantQuotas::Tenant* tenant_{nullptr};
+
+  /**
+   * Allocated from the proxy's pool in process(); holds the shared_ptr
+   * control block of this context and anything created with makeShared().
+   */
+  RequestArena* arena_{nullptr};
 
   /**
    * The function that will be called when the reply is ready
@@ -145,7 +221,9 @@ public:
    */
   void (*reqComplete_)(ProxyRequestContext& preq){nullptr};
 
-  std::shared_ptr<const ProxyConfigIf> config_;
+  /* Pinned in proxy_.configEpochs while set */
+  const ProxyConfigIf* config_{nullptr};
+  uint64_t configEpoch_{0};
 
   ProxyRequestLogger logger_;
   AdditionalProxyRequestLogger additionalLogger_;
@@ -157,6 +235,20 @@ public:
     void* context,
     void (*reqComplete)(ProxyRequestContext& preq) = nullptr);
 
+  /**
+   * Takes ownership of the request, the mc_msg_t view routing works on
+   * (origReq()) refers to its buffers instead of a copy.
+   */
+  ProxyRequestContext(
+    proxy_t& pr,
+    McRequest&& req,
+    mc_op_t op,
+    void (*enqReply)(ProxyRequestContext& preq),
+    void* context,
+    void (*reqComplete)(ProxyRequestContext& preq) = nullptr);
+
+  void setOrigReq(McMsgRef req);
+
   ProxyRequestContext(const ProxyRequestContext&) = delete;
   ProxyRequestContext(ProxyRequestContext&&) noexcept = delete;
   ProxyRequestContext& operator=(const ProxyRequestContext&) = delete;
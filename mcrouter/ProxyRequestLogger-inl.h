@@ -7,154 +7,68 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <algorithm>
+#include <limits>
+
 #include "mcrouter/lib/McOperation.h"
 #include "mcrouter/proxy.h"
+#include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/ProxyMcReply.h"
 #include "mcrouter/ProxyMcRequest.h"
-#include "mcrouter/stats.h"
+#include "mcrouter/RequestStatsBuffer.h"
+#include "mcrouter/RttOutlierTracker.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
 namespace {
 
-#define REQUEST_CLASS_STATS(proxy, OP, SUFFIX, reqClass)                       \
-    do{ switch (reqClass) {                                                    \
-        case RequestClass::NORMAL:                                             \
-          stat_incr(proxy.stats, cmd_ ## OP ## _ ## SUFFIX ## _stat, 1);       \
-          stat_incr(proxy.stats, cmd_ ## OP ## _ ## SUFFIX ## _count_stat, 1); \
-          break;                                                               \
-        case RequestClass::FAILOVER:                                           \
-          stat_incr(proxy.stats,                                               \
-                    cmd_ ## OP ## _ ## SUFFIX ## _failover_stat, 1);           \
-          stat_incr(proxy.stats,                                               \
-                    cmd_ ## OP ## _ ## SUFFIX ## _failover_count_stat, 1);     \
-          break;                                                               \
-        case RequestClass::SHADOW:                                             \
-          stat_incr(proxy.stats,                                               \
-                    cmd_ ## OP ## _ ## SUFFIX ## _shadow_stat, 1);             \
-          stat_incr(proxy.stats,                                               \
-                    cmd_ ## OP ## _ ## SUFFIX ## _shadow_count_stat, 1);       \
-          break;                                                               \
-        }                                                                      \
-        stat_incr(proxy.stats, cmd_ ## OP ## _ ## SUFFIX ## _all_stat, 1);     \
-        stat_incr(proxy.stats,                                                 \
-                  cmd_ ## OP ## _ ## SUFFIX ## _all_count_stat, 1);            \
-    } while(0)
-
-template <int operation>
-inline void logOutlier(proxy_t& proxy, McOperation<operation>,
-                       RequestClass reqClass) {
-  switch (operation) {
-    case mc_op_get:
-      REQUEST_CLASS_STATS(proxy, get, outlier, reqClass);
-      break;
-    case mc_op_set:
-      REQUEST_CLASS_STATS(proxy, set, outlier, reqClass);
-      break;
-    case mc_op_delete:
-      REQUEST_CLASS_STATS(proxy, delete, outlier, reqClass);
-      break;
-    default:
-      REQUEST_CLASS_STATS(proxy, other, outlier, reqClass);
-      break;
-  }
-}
-
-template <int operation>
-inline void logRequestClass(proxy_t& proxy, McOperation<operation>,
-                            RequestClass reqClass) {
-  switch (operation) {
-    case mc_op_get:
-      REQUEST_CLASS_STATS(proxy, get, out, reqClass);
-      break;
-    case mc_op_metaget:
-      REQUEST_CLASS_STATS(proxy, meta, out, reqClass);
-      break;
-    case mc_op_add:
-      REQUEST_CLASS_STATS(proxy, add, out, reqClass);
-      break;
-    case mc_op_cas:
-      REQUEST_CLASS_STATS(proxy, cas, out, reqClass);
-      break;
-    case mc_op_gets:
-      REQUEST_CLASS_STATS(proxy, gets, out, reqClass);
-      break;
-    case mc_op_replace:
-      REQUEST_CLASS_STATS(proxy, replace, out, reqClass);
-      break;
-    case mc_op_set:
-      REQUEST_CLASS_STATS(proxy, set, out, reqClass);
-      break;
-    case mc_op_incr:
-      REQUEST_CLASS_STATS(proxy, incr, out, reqClass);
-      break;
-    case mc_op_decr:
-      REQUEST_CLASS_STATS(proxy, decr, out, reqClass);
-      break;
-    case mc_op_delete:
-      REQUEST_CLASS_STATS(proxy, delete, out, reqClass);
-      break;
-    case mc_op_lease_set:
-      REQUEST_CLASS_STATS(proxy, lease_set, out, reqClass);
-      break;
-    case mc_op_lease_get:
-      REQUEST_CLASS_STATS(proxy, lease_get, out, reqClass);
-      break;
-    default:
-      REQUEST_CLASS_STATS(proxy, other, out, reqClass);
-      break;
-  }
-}
-
-#define REQUEST_CLASS_ERROR_STATS(proxy, ERROR, reqClass)                      \
-    do{ switch (reqClass) {                                                    \
-          case RequestClass::NORMAL:                                           \
-            stat_incr(proxy->stats, result_ ## ERROR ## _stat, 1);             \
-            stat_incr(proxy->stats, result_ ## ERROR ## _count_stat, 1);       \
-            break;                                                             \
-          case RequestClass::FAILOVER:                                         \
-            stat_incr(proxy->stats, result_ ## ERROR ## _failover_stat, 1);    \
-            stat_incr(proxy->stats,                                            \
-                      result_ ## ERROR ## _failover_count_stat, 1);            \
-            break;                                                             \
-          case RequestClass::SHADOW:                                           \
-            stat_incr(proxy->stats, result_ ## ERROR ## _shadow_stat, 1);      \
-            stat_incr(proxy->stats, result_ ## ERROR ## _shadow_count_stat, 1);\
-            break;                                                             \
-        }                                                                      \
-        stat_incr(proxy->stats, result_ ## ERROR ## _all_stat, 1);             \
-        stat_incr(proxy->stats, result_ ## ERROR ## _all_count_stat, 1);       \
-      } while(0)
-
-}
-
-void ProxyRequestLogger::logError(const ProxyMcRequest& req,
-                                  const McReplyBase& reply) {
+inline uint8_t errorBits(const McReplyBase& reply) {
+  uint8_t bits = 0;
   if (reply.isError()) {
-    REQUEST_CLASS_ERROR_STATS(proxy_, error, req.getRequestClass());
+    bits |= RequestStatsBuffer::kError;
   }
   if (reply.isConnectError()) {
-    REQUEST_CLASS_ERROR_STATS(proxy_, connect_error, req.getRequestClass());
+    bits |= RequestStatsBuffer::kConnectError;
   }
   if (reply.isConnectTimeout()) {
-    REQUEST_CLASS_ERROR_STATS(proxy_, connect_timeout, req.getRequestClass());
+    bits |= RequestStatsBuffer::kConnectTimeout;
   }
   if (reply.isDataTimeout()) {
-    REQUEST_CLASS_ERROR_STATS(proxy_, data_timeout, req.getRequestClass());
+    bits |= RequestStatsBuffer::kDataTimeout;
   }
   if (reply.isRedirect()) {
-    REQUEST_CLASS_ERROR_STATS(proxy_, busy, req.getRequestClass());
+    bits |= RequestStatsBuffer::kBusy;
   }
   if (reply.isTko()) {
-    REQUEST_CLASS_ERROR_STATS(proxy_, tko, req.getRequestClass());
+    bits |= RequestStatsBuffer::kTko;
   }
   if (reply.isLocalError()) {
-    REQUEST_CLASS_ERROR_STATS(proxy_, local_error, req.getRequestClass());
+    bits |= RequestStatsBuffer::kLocalError;
+  }
+  return bits;
+}
+
+}
+
+void ProxyRequestLogger::logError(const ProxyMcRequest& req,
+                                  const McReplyBase& reply) {
+  auto errors = errorBits(reply);
+  if (errors == 0) {
+    return;
   }
+  RequestStatsBuffer::Record record;
+  record.durationUs = 0;
+  record.op = mc_op_unknown;
+  record.requestClass = static_cast<uint8_t>(req.getRequestClass());
+  record.errors = errors;
+  record.outlier = false;
+  record.errorsOnly = true;
+  proxy_->requestStats->append(record);
 }
 
 template <class Operation>
-void ProxyRequestLogger::log(const ProxyMcRequest& request,
+void ProxyRequestLogger::log(const ProxyClientCommon& pclient,
+                             const ProxyMcRequest& request,
                              const ProxyMcReply& reply,
                              const int64_t startTimeUs,
                              const int64_t endTimeUs,
@@ -164,12 +78,19 @@ void ProxyRequestLogger::log(const ProxyMcRequest& request,
   bool isOutlier = proxy_->opts.logging_rtt_outlier_threshold_us > 0 &&
     durationUs >= proxy_->opts.logging_rtt_outlier_threshold_us;
 
-  logError(request, reply);
-  logRequestClass(*proxy_, Operation(), request.getRequestClass());
-  proxy_->durationUs.insertSample(durationUs);
+  RequestStatsBuffer::Record record;
+  record.durationUs = std::min<int64_t>(
+    std::max<int64_t>(durationUs, 0), std::numeric_limits<uint32_t>::max());
+  record.op = Operation::mc_op;
+  record.requestClass = static_cast<uint8_t>(request.getRequestClass());
+  record.errors = errorBits(reply);
+  record.outlier = isOutlier;
+  record.errorsOnly = false;
+  proxy_->requestStats->append(record);
 
-  if (isOutlier) {
-    logOutlier(*proxy_, Operation(), request.getRequestClass());
+  if (isOutlier && proxy_->rttOutliers) {
+    proxy_->rttOutliers->add(request.fullKey(), pclient.ap.toHostPortString(),
+                             Operation::mc_op, durationUs);
   }
 }
 
@@ -12,9 +12,14 @@
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class proxy_t;
+struct ProxyClientCommon;
 class ProxyMcReply;
 class ProxyMcRequest;
 
+/**
+ * Accounts replies in the proxy stats. Replies are only recorded in the
+ * proxy's RequestStatsBuffer here, and folded into the stats in batches.
+ */
 class ProxyRequestLogger {
  public:
   explicit ProxyRequestLogger(proxy_t* proxy)
@@ -22,7 +27,8 @@ class ProxyRequestLogger {
   }
 
   template <class Operation>
-  void log(const ProxyMcRequest& request,
+  void log(const ProxyClientCommon& pclient,
+           const ProxyMcRequest& request,
            const ProxyMcReply& reply,
            const int64_t startTimeUs,
            const int64_t endTimeUs,
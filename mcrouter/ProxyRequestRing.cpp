@@ -0,0 +1,191 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ProxyRequestRing.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+#include <folly/Bits.h>
+#include <glog/logging.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t ProxyRequestRing::kCacheLineSize;
+
+ProxyRequestRing::ProxyRequestRing(folly::EventBase& evb,
+                                   size_t capacity,
+                                   size_t maxBatch,
+                                   int priority,
+                                   const asox_queue_callbacks_t* callbacks,
+                                   void* arg)
+    : folly::EventHandler(&evb),
+      evb_(evb),
+      maxBatch_(std::max<size_t>(maxBatch, 1)),
+      callbacks_(callbacks),
+      arg_(arg) {
+  auto size = folly::nextPowTwo(std::max<size_t>(capacity, 2));
+  mask_ = size - 1;
+
+  void* mem = nullptr;
+  CHECK(posix_memalign(&mem, kCacheLineSize, size * sizeof(Slot)) == 0);
+  slots_ = static_cast<Slot*>(mem);
+  for (uint64_t i = 0; i < size; ++i) {
+    new (&slots_[i].seq) std::atomic<uint64_t>(i);
+  }
+
+  fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  CHECK(fd_ != -1);
+  changeHandlerFD(fd_);
+  event_priority_set(getEvent(), priority);
+  registerHandler(EV_READ | EV_PERSIST);
+}
+
+ProxyRequestRing::~ProxyRequestRing() {
+  unregisterHandler();
+  cancelLoopCallback();
+
+  while (isPublished(head_)) {
+    auto& slot = slots_[head_ & mask_];
+    auto entry = slot.entry;
+    slot.seq.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    if (callbacks_->on_elem_sweep) {
+      callbacks_->on_elem_sweep(nullptr, &entry, arg_);
+    }
+  }
+
+  close(fd_);
+  free(slots_);
+}
+
+void ProxyRequestRing::enqueue(const asox_queue_entry_t* entries, size_t n) {
+  size_t i = 0;
+  while (i < n) {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    auto k = std::min<uint64_t>(n - i, mask_ + 1);
+    /* The consumer frees slots in order, so if the last slot of the range
+       is free in this lap, all of them are. */
+    while (k > 0 &&
+           slots_[(pos + k - 1) & mask_].seq.load(std::memory_order_acquire) !=
+           pos + k - 1) {
+      k /= 2;
+    }
+
+    if (k == 0) {
+      auto seq = slots_[pos & mask_].seq.load(std::memory_order_acquire);
+      if (seq < pos) {
+        /* Full */
+        if (evb_.isInEventBaseThread()) {
+          drain();
+        } else {
+          std::this_thread::yield();
+        }
+      }
+      continue;
+    }
+
+    if (!tail_.compare_exchange_weak(pos, pos + k,
+                                     std::memory_order_relaxed)) {
+      continue;
+    }
+
+    for (uint64_t j = 0; j < k; ++j) {
+      auto& slot = slots_[(pos + j) & mask_];
+      slot.entry = entries[i + j];
+      slot.seq.store(pos + j + 1, std::memory_order_release);
+    }
+    i += k;
+  }
+
+  notify();
+}
+
+bool ProxyRequestRing::tryEnqueue(const asox_queue_entry_t& entry) {
+  auto pos = tail_.load(std::memory_order_relaxed);
+  while (true) {
+    auto seq = slots_[pos & mask_].seq.load(std::memory_order_acquire);
+    if (seq == pos) {
+      if (tail_.compare_exchange_weak(pos, pos + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (seq < pos) {
+      /* Full */
+      return false;
+    } else {
+      /* Another producer took the slot */
+      pos = tail_.load(std::memory_order_relaxed);
+    }
+  }
+
+  auto& slot = slots_[pos & mask_];
+  slot.entry = entry;
+  slot.seq.store(pos + 1, std::memory_order_release);
+
+  notify();
+  return true;
+}
+
+void ProxyRequestRing::notify() {
+  /* Pairs with the fence in drain(): either we see the consumer going idle,
+     or the consumer sees our entries. */
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (consumerIdle_.load(std::memory_order_relaxed) &&
+      consumerIdle_.exchange(false, std::memory_order_relaxed)) {
+    uint64_t val = 1;
+    PCHECK(write(fd_, &val, sizeof(val)) == sizeof(val));
+  }
+}
+
+void ProxyRequestRing::drain() {
+  consumerIdle_.store(false, std::memory_order_relaxed);
+
+  size_t processed = 0;
+  while (processed < maxBatch_) {
+    if (!isPublished(head_)) {
+      consumerIdle_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!isPublished(head_)) {
+        return;
+      }
+      consumerIdle_.store(false, std::memory_order_relaxed);
+    }
+
+    auto& slot = slots_[head_ & mask_];
+    auto entry = slot.entry;
+    slot.seq.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    callbacks_->on_elem_ready(nullptr, &entry, arg_);
+    ++processed;
+  }
+
+  if (!isLoopCallbackScheduled()) {
+    evb_.runInLoop(this);
+  }
+}
+
+void ProxyRequestRing::handlerReady(uint16_t events) noexcept {
+  uint64_t val;
+  /* EAGAIN is expected, we might have been woken up spuriously */
+  auto ret = read(fd_, &val, sizeof(val));
+  (void)ret;
+  drain();
+}
+
+void ProxyRequestRing::runLoopCallback() noexcept {
+  drain();
+}
+
+}}}  // facebook::memcache::mcrouter
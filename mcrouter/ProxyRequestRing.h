@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+
+#include "mcrouter/lib/fbi/asox_queue.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Bounded lock-free multi-producer single-consumer queue of asox queue
+ * entries. Can be used instead of asox_queue to hand requests from client
+ * threads to a proxy thread (see proxy_request_ring_size option).
+ *
+ * Producers claim ranges of slots with a CAS on the tail and publish every
+ * slot through its sequence number; slots are cache line sized, so producers
+ * and the consumer don't share lines unless they touch the same entry.
+ *
+ * The consumer is woken up through an eventfd, but only after it announced
+ * that it ran out of entries. While it's draining the ring (at most
+ * maxBatch entries per event loop iteration) enqueues make no syscalls.
+ */
+class ProxyRequestRing : private folly::EventHandler,
+                         private folly::EventBase::LoopCallback {
+ public:
+  /**
+   * @param capacity   Rounded up to a power of two.
+   * @param maxBatch   Maximum number of entries dispatched per
+   *                   event loop iteration.
+   * @param priority   Libevent priority of the wakeup event.
+   * @param callbacks  Same semantics as with asox_queue (queue argument
+   *                   is always nullptr).
+   */
+  ProxyRequestRing(folly::EventBase& evb,
+                   size_t capacity,
+                   size_t maxBatch,
+                   int priority,
+                   const asox_queue_callbacks_t* callbacks,
+                   void* arg);
+
+  /**
+   * Passes all entries still in the ring to the sweep callback.
+   * Must not race with enqueue().
+   */
+  ~ProxyRequestRing();
+
+  ProxyRequestRing(const ProxyRequestRing&) = delete;
+  ProxyRequestRing& operator=(const ProxyRequestRing&) = delete;
+
+  /**
+   * Thread-safe. Entries of one call are dispatched in order.
+   * Waits while the ring is full (if called on the consumer thread,
+   * drains the ring instead of waiting).
+   */
+  void enqueue(const asox_queue_entry_t* entries, size_t n);
+
+  /**
+   * Thread-safe. Never waits.
+   * @return false if the ring is full, the entry is not enqueued then.
+   */
+  bool tryEnqueue(const asox_queue_entry_t& entry);
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  struct Slot {
+    std::atomic<uint64_t> seq;
+    asox_queue_entry_t entry;
+    char padding[kCacheLineSize -
+                 (sizeof(std::atomic<uint64_t>) + sizeof(asox_queue_entry_t)) %
+                 kCacheLineSize];
+  };
+
+  folly::EventBase& evb_;
+  const size_t maxBatch_;
+  const asox_queue_callbacks_t* callbacks_;
+  void* arg_;
+  int fd_;
+  uint64_t mask_;
+  Slot* slots_;
+
+  char padding0_[kCacheLineSize];
+  std::atomic<uint64_t> tail_{0};
+  char padding1_[kCacheLineSize];
+  /* Only accessed by the consumer */
+  uint64_t head_{0};
+  char padding2_[kCacheLineSize];
+  /* Set by the consumer when it needs an eventfd wakeup */
+  std::atomic<bool> consumerIdle_{true};
+  char padding3_[kCacheLineSize];
+
+  /**
+   * Dispatches up to maxBatch entries. If there might be more,
+   * schedules itself for the next loop iteration.
+   */
+  void drain();
+
+  /* Wakes up the consumer if it's idle, called after publishing entries */
+  void notify();
+
+  bool isPublished(uint64_t pos) const {
+    return slots_[pos & mask_].seq.load(std::memory_order_acquire) == pos + 1;
+  }
+
+  void handlerReady(uint16_t events) noexcept override final;
+  void runLoopCallback() noexcept override final;
+};
+
+}}}  // facebook::memcache::mcrouter
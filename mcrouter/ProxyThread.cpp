@@ -11,7 +11,9 @@
 
 #include <folly/io/async/EventBase.h>
 
+#include "mcrouter/BusyPoller.h"
 #include "mcrouter/config.h"
+#include "mcrouter/lib/JemallocArenas.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ThreadUtil.h"
@@ -27,22 +29,23 @@ ProxyThread::ProxyThread(std::unique_ptr<proxy_t> pr)
   proxy_->attachEventBase(&evb_);
 }
 
-bool ProxyThread::spawn() {
+bool ProxyThread::spawn(const std::vector<int>& cpus) {
   return spawnThread(&thread_handle,
                      &thread_stack,
                      proxyThreadRunHandler, this,
-                     proxy_->router->wantRealtimeThreads());
+                     proxy_->router->wantRealtimeThreads(),
+                     cpus);
 }
 
 void ProxyThread::stopAndJoin() {
   if (thread_handle && proxy_->router->pid() == getpid()) {
-    FBI_ASSERT(proxy_->request_queue != nullptr);
+    FBI_ASSERT(proxy_->request_queue != nullptr || proxy_->requestRing);
     asox_queue_entry_t entry;
     entry.type = request_type_router_shutdown;
     entry.priority = 0;
     entry.data = nullptr;
     entry.nbytes = 0;
-    asox_queue_enqueue(proxy_->request_queue, &entry);
+    proxy_->enqueueEntries(&entry, 1);
     {
       std::unique_lock<std::mutex> lk(mux);
       isSafeToDeleteProxy = true;
@@ -58,9 +61,14 @@ void ProxyThread::stopAndJoin() {
 void ProxyThread::proxyThreadRun() {
   FBI_ASSERT(proxy_->router != nullptr);
   mcrouterSetThreadName(pthread_self(), proxy_->router->opts(), "mcrpxy");
+  if (proxy_->router->opts().thread_arenas) {
+    JemallocArenas::bindThreadToNewArena();
+  }
 
+  BusyPoller poller(*proxy_,
+                    std::chrono::microseconds(proxy_->opts.busy_poll_us));
   while (!proxy_->router->shutdownStarted()) {
-    mcrouterLoopOnce(proxy_->eventBase);
+    poller.loopOnce();
   }
 
   while (proxy_->fiberManager.hasTasks()) {
@@ -12,6 +12,7 @@
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include <folly/io/async/EventBase.h>
 
@@ -30,8 +31,13 @@ class ProxyThread {
 
   /**
    * Spawns a new proxy thread for execution.
+   *
+   * @param cpus  if not empty, the thread is pinned to these CPUs. Memory
+   *              is allocated on first use, so fiber stacks and other
+   *              allocations of the proxy thread end up on the local
+   *              NUMA node.
    */
-  bool spawn();
+  bool spawn(const std::vector<int>& cpus = std::vector<int>());
 
   proxy_t& proxy() { return *proxy_; }
   folly::EventBase& eventBase() { return evb_; }
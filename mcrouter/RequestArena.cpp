@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RequestArena.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+constexpr size_t kAlignment = alignof(std::max_align_t);
+
+size_t alignUp(size_t size) {
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+}  // anonymous namespace
+
+constexpr size_t RequestArenaPool::kBlockSize;
+constexpr size_t RequestArena::kMaxAllocSize;
+
+RequestArenaPool::RequestArenaPool(size_t maxFreeBlocks)
+    : maxFreeBlocks_(maxFreeBlocks) {
+}
+
+RequestArenaPool::~RequestArenaPool() {
+  for (auto block : freeBlocks_) {
+    ::operator delete(block);
+  }
+}
+
+void* RequestArenaPool::getBlock() {
+  if (freeBlocks_.empty()) {
+    return ::operator new(kBlockSize);
+  }
+  auto block = freeBlocks_.back();
+  freeBlocks_.pop_back();
+  return block;
+}
+
+void RequestArenaPool::putBlock(void* block) {
+  if (freeBlocks_.size() < maxFreeBlocks_) {
+    freeBlocks_.push_back(block);
+  } else {
+    ::operator delete(block);
+  }
+}
+
+RequestArena* RequestArena::create(RequestArenaPool& pool) {
+  auto block = new (pool.getBlock()) Block{nullptr};
+  auto storage = reinterpret_cast<char*>(block) + alignUp(sizeof(Block));
+  return new (storage) RequestArena(pool, block);
+}
+
+RequestArena::RequestArena(RequestArenaPool& pool, Block* firstBlock)
+    : pool_(pool),
+      blocks_(firstBlock) {
+  cur_ = reinterpret_cast<char*>(this) + alignUp(sizeof(RequestArena));
+  end_ = reinterpret_cast<char*>(firstBlock) + RequestArenaPool::kBlockSize;
+}
+
+void* RequestArena::allocate(size_t size) {
+  size = alignUp(size);
+  if (size > kMaxAllocSize) {
+    auto p = ::operator new(size);
+    ++refs_;
+    return p;
+  }
+  if (cur_ + size > end_) {
+    auto block = new (pool_.getBlock()) Block{blocks_};
+    blocks_ = block;
+    cur_ = reinterpret_cast<char*>(block) + alignUp(sizeof(Block));
+    end_ = reinterpret_cast<char*>(block) + RequestArenaPool::kBlockSize;
+  }
+  auto p = cur_;
+  cur_ += size;
+  ++refs_;
+  return p;
+}
+
+void RequestArena::deallocate(void* p, size_t size) {
+  if (alignUp(size) > kMaxAllocSize) {
+    ::operator delete(p);
+  }
+  decref();
+}
+
+void RequestArena::release() {
+  assert(refs_ == 0);
+  // This object lives in the last block of the list, don't touch it after
+  // giving the blocks back.
+  auto& pool = pool_;
+  auto block = blocks_;
+  this->~RequestArena();
+  while (block) {
+    auto next = block->next;
+    pool.putBlock(block);
+    block = next;
+  }
+}
+
+}}}  // facebook::memcache::mcrouter
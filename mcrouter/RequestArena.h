@@ -0,0 +1,150 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Free list of fixed size memory blocks used by RequestArenas.
+ * One per proxy.
+ *
+ * Note: not thread-safe.
+ */
+class RequestArenaPool {
+ public:
+  static constexpr size_t kBlockSize = 2048;
+
+  /**
+   * @param maxFreeBlocks  Blocks returned beyond this are freed.
+   */
+  explicit RequestArenaPool(size_t maxFreeBlocks = 1024);
+  ~RequestArenaPool();
+
+  RequestArenaPool(const RequestArenaPool&) = delete;
+  RequestArenaPool& operator=(const RequestArenaPool&) = delete;
+
+  void* getBlock();
+  void putBlock(void* block);
+
+  size_t numFreeBlocks() const {
+    return freeBlocks_.size();
+  }
+
+ private:
+  const size_t maxFreeBlocks_;
+  std::vector<void*> freeBlocks_;
+};
+
+/**
+ * Bump allocator for objects that live as long as one proxy request.
+ *
+ * Memory comes in blocks from RequestArenaPool and is returned there
+ * all at once. The arena is reference counted: the owner holds one
+ * reference and every allocation holds another one, so memory is released
+ * only after the owner is gone and everything allocated was deallocated.
+ * This allows e.g. shared_ptr control blocks to live in the arena even if
+ * they're destroyed after the owner.
+ *
+ * Allocations bigger than kMaxAllocSize go directly to operator new
+ * (but still hold a reference).
+ *
+ * Note: not thread-safe, must only be used on the thread of its pool.
+ */
+class RequestArena {
+ public:
+  static constexpr size_t kMaxAllocSize = RequestArenaPool::kBlockSize / 4;
+
+  /**
+   * Creates a new arena (in the first block it takes from the pool),
+   * with a reference count of one.
+   */
+  static RequestArena* create(RequestArenaPool& pool);
+
+  void* allocate(size_t size);
+  void deallocate(void* p, size_t size);
+
+  void incref() {
+    ++refs_;
+  }
+
+  void decref() {
+    if (--refs_ == 0) {
+      release();
+    }
+  }
+
+  RequestArena(const RequestArena&) = delete;
+  RequestArena& operator=(const RequestArena&) = delete;
+
+ private:
+  struct Block {
+    Block* next;
+  };
+
+  RequestArenaPool& pool_;
+  Block* blocks_;
+  char* cur_;
+  char* end_;
+  size_t refs_{1};
+
+  RequestArena(RequestArenaPool& pool, Block* firstBlock);
+  ~RequestArena() = default;
+
+  void release();
+};
+
+/**
+ * Standard allocator interface to RequestArena.
+ */
+template <class T>
+class RequestArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit RequestArenaAllocator(RequestArena& arena) : arena_(&arena) {
+  }
+
+  template <class U>
+  /* implicit */ RequestArenaAllocator(const RequestArenaAllocator<U>& other)
+      : arena_(other.arena_) {
+  }
+
+  T* allocate(size_t n) {
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "RequestArena doesn't support overaligned types");
+    return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    arena_->deallocate(p, n * sizeof(T));
+  }
+
+  template <class U>
+  bool operator==(const RequestArenaAllocator<U>& other) const {
+    return arena_ == other.arena_;
+  }
+
+  template <class U>
+  bool operator!=(const RequestArenaAllocator<U>& other) const {
+    return arena_ != other.arena_;
+  }
+
+ private:
+  RequestArena* arena_;
+
+  template <class U>
+  friend class RequestArenaAllocator;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RequestPriorities.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <folly/Conv.h>
+#include <folly/String.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t RequestPriorities::kNumClasses;
+const size_t RequestPriorities::kWeights[kNumClasses] = { 8, 4, 2, 1 };
+
+namespace {
+
+size_t parseClass(folly::StringPiece str) {
+  size_t cls;
+  try {
+    cls = folly::to<size_t>(str);
+  } catch (const std::exception& e) {
+    throw std::invalid_argument("invalid priority class '" + str.str() + "'");
+  }
+  if (cls >= RequestPriorities::kNumClasses) {
+    throw std::invalid_argument(folly::to<std::string>(
+      "priority class ", cls, " is out of range [0, ",
+      RequestPriorities::kNumClasses, ")"));
+  }
+  return cls;
+}
+
+}  // anonymous namespace
+
+RequestPriorities::RequestPriorities(folly::StringPiece spec,
+                                     size_t defaultClass)
+    : defaultClass_(defaultClass) {
+  if (defaultClass_ >= kNumClasses) {
+    throw std::invalid_argument(folly::to<std::string>(
+      "default priority class ", defaultClass_, " is out of range"));
+  }
+
+  std::vector<folly::StringPiece> entries;
+  folly::split(',', spec, entries, /* ignoreEmpty */ true);
+  for (auto entry : entries) {
+    auto pos = entry.rfind(':');
+    if (pos == folly::StringPiece::npos || pos == 0) {
+      throw std::invalid_argument("expected prefix:class, got '" +
+                                  entry.str() + "'");
+    }
+    prefixes_.emplace_back(entry.subpiece(0, pos).str(),
+                           parseClass(entry.subpiece(pos + 1)));
+  }
+  std::stable_sort(prefixes_.begin(), prefixes_.end(),
+    [](const std::pair<std::string, size_t>& a,
+       const std::pair<std::string, size_t>& b) {
+      return a.first.size() > b.first.size();
+    });
+}
+
+size_t RequestPriorities::classOf(folly::StringPiece key) const {
+  for (const auto& it : prefixes_) {
+    if (key.startsWith(it.first)) {
+      return it.second;
+    }
+  }
+  return defaultClass_;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Priority classes of requests waiting for the proxy to start processing
+ * them (see --proxy-queue-priorities). Class 0 is the most important one.
+ *
+ * Requests are classified by the longest configured prefix of their key
+ * (including the routing prefix).
+ */
+class RequestPriorities {
+ public:
+  static constexpr size_t kNumClasses = 4;
+
+  /**
+   * Number of requests of each class dequeued per round while all classes
+   * have requests waiting.
+   */
+  static const size_t kWeights[kNumClasses];
+
+  /**
+   * @param spec  comma separated list of "prefix:class" pairs,
+   *              e.g. "/region/critical/:0,batch:3".
+   * @param defaultClass  class of keys without a matching prefix.
+   * @throws std::invalid_argument on invalid spec or class
+   */
+  RequestPriorities(folly::StringPiece spec, size_t defaultClass);
+
+  size_t classOf(folly::StringPiece key) const;
+
+ private:
+  /* Sorted by decreasing prefix length */
+  std::vector<std::pair<std::string, size_t>> prefixes_;
+  size_t defaultClass_;
+};
+
+}}}  // facebook::memcache::mcrouter
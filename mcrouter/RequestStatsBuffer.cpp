@@ -0,0 +1,218 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RequestStatsBuffer.h"
+
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/stats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+static_assert(mc_nops <= 256, "Record::op is a byte");
+
+namespace {
+
+const size_t kNumClasses = 3;
+
+#define REQUEST_CLASS_STATS(proxy, OP, SUFFIX, reqClass, n)                    \
+    do{ switch (reqClass) {                                                    \
+        case RequestClass::NORMAL:                                             \
+          stat_incr(proxy.stats, cmd_ ## OP ## _ ## SUFFIX ## _stat, n);       \
+          stat_incr(proxy.stats, cmd_ ## OP ## _ ## SUFFIX ## _count_stat, n); \
+          break;                                                               \
+        case RequestClass::FAILOVER:                                           \
+          stat_incr(proxy.stats,                                               \
+                    cmd_ ## OP ## _ ## SUFFIX ## _failover_stat, n);           \
+          stat_incr(proxy.stats,                                               \
+                    cmd_ ## OP ## _ ## SUFFIX ## _failover_count_stat, n);     \
+          break;                                                               \
+        case RequestClass::SHADOW:                                             \
+          stat_incr(proxy.stats,                                               \
+                    cmd_ ## OP ## _ ## SUFFIX ## _shadow_stat, n);             \
+          stat_incr(proxy.stats,                                               \
+                    cmd_ ## OP ## _ ## SUFFIX ## _shadow_count_stat, n);       \
+          break;                                                               \
+        }                                                                      \
+        stat_incr(proxy.stats, cmd_ ## OP ## _ ## SUFFIX ## _all_stat, n);     \
+        stat_incr(proxy.stats,                                                 \
+                  cmd_ ## OP ## _ ## SUFFIX ## _all_count_stat, n);            \
+    } while(0)
+
+void logOutliers(proxy_t& proxy, size_t op, RequestClass reqClass,
+                 int64_t n) {
+  switch (op) {
+    case mc_op_get:
+      REQUEST_CLASS_STATS(proxy, get, outlier, reqClass, n);
+      break;
+    case mc_op_set:
+      REQUEST_CLASS_STATS(proxy, set, outlier, reqClass, n);
+      break;
+    case mc_op_delete:
+      REQUEST_CLASS_STATS(proxy, delete, outlier, reqClass, n);
+      break;
+    default:
+      REQUEST_CLASS_STATS(proxy, other, outlier, reqClass, n);
+      break;
+  }
+}
+
+void logRequestClass(proxy_t& proxy, size_t op, RequestClass reqClass,
+                     int64_t n) {
+  switch (op) {
+    case mc_op_get:
+      REQUEST_CLASS_STATS(proxy, get, out, reqClass, n);
+      break;
+    case mc_op_metaget:
+      REQUEST_CLASS_STATS(proxy, meta, out, reqClass, n);
+      break;
+    case mc_op_add:
+      REQUEST_CLASS_STATS(proxy, add, out, reqClass, n);
+      break;
+    case mc_op_cas:
+      REQUEST_CLASS_STATS(proxy, cas, out, reqClass, n);
+      break;
+    case mc_op_gets:
+      REQUEST_CLASS_STATS(proxy, gets, out, reqClass, n);
+      break;
+    case mc_op_replace:
+      REQUEST_CLASS_STATS(proxy, replace, out, reqClass, n);
+      break;
+    case mc_op_set:
+      REQUEST_CLASS_STATS(proxy, set, out, reqClass, n);
+      break;
+    case mc_op_incr:
+      REQUEST_CLASS_STATS(proxy, incr, out, reqClass, n);
+      break;
+    case mc_op_decr:
+      REQUEST_CLASS_STATS(proxy, decr, out, reqClass, n);
+      break;
+    case mc_op_delete:
+      REQUEST_CLASS_STATS(proxy, delete, out, reqClass, n);
+      break;
+    case mc_op_lease_set:
+      REQUEST_CLASS_STATS(proxy, lease_set, out, reqClass, n);
+      break;
+    case mc_op_lease_get:
+      REQUEST_CLASS_STATS(proxy, lease_get, out, reqClass, n);
+      break;
+    default:
+      REQUEST_CLASS_STATS(proxy, other, out, reqClass, n);
+      break;
+  }
+}
+
+#define REQUEST_CLASS_ERROR_STATS(proxy, ERROR, reqClass, n)                   \
+    do{ switch (reqClass) {                                                    \
+          case RequestClass::NORMAL:                                           \
+            stat_incr(proxy.stats, result_ ## ERROR ## _stat, n);              \
+            stat_incr(proxy.stats, result_ ## ERROR ## _count_stat, n);        \
+            break;                                                             \
+          case RequestClass::FAILOVER:                                         \
+            stat_incr(proxy.stats, result_ ## ERROR ## _failover_stat, n);     \
+            stat_incr(proxy.stats,                                             \
+                      result_ ## ERROR ## _failover_count_stat, n);            \
+            break;                                                             \
+          case RequestClass::SHADOW:                                           \
+            stat_incr(proxy.stats, result_ ## ERROR ## _shadow_stat, n);       \
+            stat_incr(proxy.stats, result_ ## ERROR ## _shadow_count_stat, n); \
+            break;                                                             \
+        }                                                                      \
+        stat_incr(proxy.stats, result_ ## ERROR ## _all_stat, n);              \
+        stat_incr(proxy.stats, result_ ## ERROR ## _all_count_stat, n);        \
+      } while(0)
+
+/* kind is the index of the bit in RequestStatsBuffer::ErrorBits */
+void logErrors(proxy_t& proxy, size_t kind, RequestClass reqClass,
+               int64_t n) {
+  switch (kind) {
+    case 0:
+      REQUEST_CLASS_ERROR_STATS(proxy, error, reqClass, n);
+      break;
+    case 1:
+      REQUEST_CLASS_ERROR_STATS(proxy, connect_error, reqClass, n);
+      break;
+    case 2:
+      REQUEST_CLASS_ERROR_STATS(proxy, connect_timeout, reqClass, n);
+      break;
+    case 3:
+      REQUEST_CLASS_ERROR_STATS(proxy, data_timeout, reqClass, n);
+      break;
+    case 4:
+      REQUEST_CLASS_ERROR_STATS(proxy, busy, reqClass, n);
+      break;
+    case 5:
+      REQUEST_CLASS_ERROR_STATS(proxy, tko, reqClass, n);
+      break;
+    case 6:
+      REQUEST_CLASS_ERROR_STATS(proxy, local_error, reqClass, n);
+      break;
+  }
+}
+
+}  // anonymous namespace
+
+void RequestStatsBuffer::flush() {
+  if (isLoopCallbackScheduled()) {
+    cancelLoopCallback();
+  }
+  if (size_ == 0) {
+    return;
+  }
+
+  uint32_t requests[mc_nops][kNumClasses] = {};
+  uint32_t outliers[mc_nops][kNumClasses] = {};
+  uint32_t errors[kNumErrorKinds][kNumClasses] = {};
+  for (size_t i = 0; i < size_; ++i) {
+    const auto& record = records_[i];
+    for (size_t kind = 0; kind < kNumErrorKinds; ++kind) {
+      if (record.errors & (1 << kind)) {
+        ++errors[kind][record.requestClass];
+      }
+    }
+    if (record.errorsOnly) {
+      continue;
+    }
+    ++requests[record.op][record.requestClass];
+    if (record.outlier) {
+      ++outliers[record.op][record.requestClass];
+    }
+    proxy_.durationUs.insertSample(record.durationUs);
+    proxy_.durationUsByOp[record.op].insertSample(record.durationUs);
+  }
+  size_ = 0;
+
+  for (size_t cls = 0; cls < kNumClasses; ++cls) {
+    auto reqClass = static_cast<RequestClass>(cls);
+    for (size_t op = 0; op < mc_nops; ++op) {
+      if (requests[op][cls] != 0) {
+        logRequestClass(proxy_, op, reqClass, requests[op][cls]);
+      }
+      if (outliers[op][cls] != 0) {
+        logOutliers(proxy_, op, reqClass, outliers[op][cls]);
+      }
+    }
+    for (size_t kind = 0; kind < kNumErrorKinds; ++kind) {
+      if (errors[kind][cls] != 0) {
+        logErrors(proxy_, kind, reqClass, errors[kind][cls]);
+      }
+    }
+  }
+}
+
+void RequestStatsBuffer::scheduleFlush() {
+  if (proxy_.eventBase == nullptr) {
+    flush();
+    return;
+  }
+  proxy_.eventBase->runInLoop(this);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/io/async/EventBase.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class proxy_t;
+
+/**
+ * Replies of one proxy waiting to be accounted in its stats (see
+ * ProxyRequestLogger). Logging a reply only appends a compact record;
+ * records are folded into the stats at the end of the event loop
+ * iteration, or once the buffer is full, so that each stat slot is
+ * updated once per batch instead of once per reply.
+ *
+ * Only used on the proxy thread.
+ */
+class RequestStatsBuffer : public folly::EventBase::LoopCallback {
+ public:
+  static constexpr size_t kCapacity = 256;
+
+  /* Kinds of error replies, see McReplyBase::isError() and friends */
+  enum ErrorBits : uint8_t {
+    kError = 1 << 0,
+    kConnectError = 1 << 1,
+    kConnectTimeout = 1 << 2,
+    kDataTimeout = 1 << 3,
+    kBusy = 1 << 4,
+    kTko = 1 << 5,
+    kLocalError = 1 << 6,
+  };
+  static constexpr size_t kNumErrorKinds = 7;
+
+  struct Record {
+    /* Clamped to [0, UINT32_MAX] */
+    uint32_t durationUs;
+    /* mc_op_t */
+    uint8_t op;
+    /* RequestClass */
+    uint8_t requestClass;
+    /* ErrorBits */
+    uint8_t errors;
+    bool outlier : 1;
+    /* Replies refused before reaching a destination only count errors */
+    bool errorsOnly : 1;
+  };
+
+  explicit RequestStatsBuffer(proxy_t& proxy)
+    : proxy_(proxy) {
+  }
+
+  void append(const Record& record) {
+    if (size_ == kCapacity) {
+      flush();
+    }
+    records_[size_++] = record;
+    if (size_ == 1) {
+      scheduleFlush();
+    }
+  }
+
+  /**
+   * Folds all buffered records into the proxy stats.
+   */
+  void flush();
+
+  void runLoopCallback() noexcept override {
+    flush();
+  }
+
+ private:
+  proxy_t& proxy_;
+  size_t size_{0};
+  Record records_[kCapacity];
+
+  void scheduleFlush();
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RequestTracer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <folly/Bits.h>
+#include <folly/Random.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/ProxyRequestContext.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t Span::kMaxDetailLength;
+
+const char* spanKindName(SpanKind kind) {
+  switch (kind) {
+    case SpanKind::kClientRead:
+      return "client_read";
+    case SpanKind::kQueueWait:
+      return "queue_wait";
+    case SpanKind::kRoute:
+      return "route";
+    case SpanKind::kDestination:
+      return "destination";
+    case SpanKind::kClientWrite:
+      return "client_write";
+    case SpanKind::kRequest:
+      return "request";
+  }
+  return "unknown";
+}
+
+SpanRing::SpanRing(size_t capacity)
+    : slots_(folly::nextPowTwo(std::max<size_t>(capacity, 1))),
+      mask_(slots_.size() - 1) {
+}
+
+RequestTracer::RequestTracer(size_t sampleRate, size_t ringSize)
+    : sampleRate_(std::max<size_t>(sampleRate, 1)),
+      countdown_(sampleRate_),
+      ring_(ringSize) {
+}
+
+void RequestTracer::record(uint64_t traceId, SpanKind kind, const char* name,
+                           folly::StringPiece detail, int64_t startUs,
+                           int64_t endUs) {
+  Span span;
+  span.traceId = traceId;
+  span.startUs = startUs;
+  span.endUs = endUs;
+  span.name = name;
+  span.kind = kind;
+  auto len = std::min(detail.size(), Span::kMaxDetailLength);
+  memcpy(span.detail, detail.data(), len);
+  span.detail[len] = '\0';
+  ring_.push(span);
+}
+
+uint64_t RequestTracer::newTraceId() {
+  uint64_t id;
+  do {
+    id = folly::Random::rand64();
+  } while (id == 0);
+  return id;
+}
+
+RouteSpan::RouteSpan(const ProxyRequestContext& ctx, const char* route)
+    : ctx_(ctx.traceId() != 0 ? &ctx : nullptr),
+      route_(route),
+      profile_(ctx.proxy().stageProfiler.get(), route) {
+  if (ctx_) {
+    startUs_ = nowUs();
+  }
+}
+
+RouteSpan::RouteSpan(RouteSpan&& other) noexcept
+    : ctx_(other.ctx_),
+      route_(other.route_),
+      startUs_(other.startUs_),
+      profile_(std::move(other.profile_)) {
+  other.ctx_ = nullptr;
+}
+
+RouteSpan::~RouteSpan() {
+  if (ctx_) {
+    ctx_->traceSpan(SpanKind::kRoute, route_, "", startUs_, nowUs());
+  }
+}
+
+RouteSpan startRouteSpan(const ProxyMcRequest& req, const char* route) {
+  return RouteSpan(req.context(), route);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,189 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <folly/detail/CacheLocality.h>
+#include <folly/Range.h>
+
+#include "mcrouter/StageProfiler.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class ProxyMcRequest;
+class ProxyRequestContext;
+
+enum class SpanKind : uint8_t {
+  /* Request creation (client read) until a proxy picked it up */
+  kClientRead,
+  /* Time spent in the proxy's waiting requests queue */
+  kQueueWait,
+  /* One route handle's route() call, name is the mangled route type */
+  kRoute,
+  /* Destination send until reply, detail is the destination key */
+  kDestination,
+  /* Handing the reply back to the client */
+  kClientWrite,
+  /* Whole lifetime of the request, including async subrequests */
+  kRequest,
+};
+
+const char* spanKindName(SpanKind kind);
+
+/**
+ * One timed step of a traced request.
+ * Timestamps are from nowUs(), i.e. monotonic and only comparable
+ * within the process.
+ */
+struct Span {
+  static constexpr size_t kMaxDetailLength = 39;
+
+  uint64_t traceId;
+  int64_t startUs;
+  int64_t endUs;
+  /* Static string or nullptr */
+  const char* name;
+  SpanKind kind;
+  /* Truncated copy of detail, nul terminated */
+  char detail[kMaxDetailLength + 1];
+};
+
+/**
+ * Bounded single producer, single consumer queue of spans.
+ * Spans pushed while the ring is full are dropped (and counted), so the
+ * producer never waits for the consumer.
+ */
+class SpanRing {
+ public:
+  /**
+   * @param capacity  rounded up to a power of two
+   */
+  explicit SpanRing(size_t capacity);
+
+  /**
+   * Producer side.
+   * @return false if the ring was full and span was dropped
+   */
+  bool push(const Span& span) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) > mask_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    slots_[head & mask_] = span;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Consumer side: appends all spans pushed so far to out.
+   * @return number of spans appended
+   */
+  size_t drain(std::vector<Span>& out) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    auto head = head_.load(std::memory_order_acquire);
+    for (auto i = tail; i != head; ++i) {
+      out.push_back(slots_[i & mask_]);
+    }
+    tail_.store(head, std::memory_order_release);
+    return head - tail;
+  }
+
+  size_t capacity() const {
+    return mask_ + 1;
+  }
+
+  /**
+   * Number of spans dropped because the ring was full
+   */
+  uint64_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::vector<Span> slots_;
+  const size_t mask_;
+  std::atomic<uint64_t> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING head_{0};
+  std::atomic<uint64_t> FOLLY_ALIGN_TO_AVOID_FALSE_SHARING tail_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+/**
+ * Samples requests of one proxy for tracing (see --trace-sample-rate)
+ * and collects their spans for the TraceExporter.
+ *
+ * sample() and record() must be called from the proxy thread, the
+ * exporter drains ring() from its own thread.
+ */
+class RequestTracer {
+ public:
+  RequestTracer(size_t sampleRate, size_t ringSize);
+
+  /**
+   * Traces one of every sampleRate requests.
+   * @return trace id for a sampled request, 0 otherwise
+   */
+  uint64_t sample() {
+    if (--countdown_ > 0) {
+      return 0;
+    }
+    countdown_ = sampleRate_;
+    return newTraceId();
+  }
+
+  void record(uint64_t traceId, SpanKind kind, const char* name,
+              folly::StringPiece detail, int64_t startUs, int64_t endUs);
+
+  SpanRing& ring() {
+    return ring_;
+  }
+
+ private:
+  const size_t sampleRate_;
+  size_t countdown_;
+  SpanRing ring_;
+
+  uint64_t newTraceId();
+};
+
+/**
+ * Records a kRoute span for the lifetime of this object if the request
+ * is traced, see startRouteSpan(). Also marks the route handle as running
+ * for the proxy's StageProfiler, if any.
+ */
+class RouteSpan {
+ public:
+  RouteSpan(const ProxyRequestContext& ctx, const char* route);
+  RouteSpan(RouteSpan&& other) noexcept;
+  ~RouteSpan();
+
+  RouteSpan(const RouteSpan&) = delete;
+  RouteSpan& operator=(const RouteSpan&) = delete;
+  RouteSpan& operator=(RouteSpan&&) = delete;
+
+ private:
+  /* nullptr if the request isn't traced */
+  const ProxyRequestContext* ctx_;
+  const char* route_;
+  int64_t startUs_{0};
+  ProfileRouteScope profile_;
+};
+
+/**
+ * Route handle tracing hook (overload of the customization point in
+ * mcrouter/lib/RouteTracing.h).
+ */
+RouteSpan startRouteSpan(const ProxyMcRequest& req, const char* route);
+
+}}}  // facebook::memcache::mcrouter
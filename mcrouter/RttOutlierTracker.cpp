@@ -0,0 +1,44 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RttOutlierTracker.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t RttOutlierTracker::kMaxKeyPrefix;
+
+RttOutlierTracker::RttOutlierTracker(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {
+}
+
+void RttOutlierTracker::add(folly::StringPiece key, std::string destination,
+                            mc_op_t op, int64_t durationUs) {
+  Outlier outlier{key.subpiece(0, kMaxKeyPrefix).str(), std::move(destination),
+                  op, durationUs, time(nullptr)};
+
+  std::lock_guard<std::mutex> lock(lock_);
+  if (outliers_.size() < capacity_) {
+    outliers_.push_back(std::move(outlier));
+  } else {
+    outliers_[next_] = std::move(outlier);
+    next_ = (next_ + 1) % capacity_;
+  }
+}
+
+std::vector<RttOutlierTracker::Outlier> RttOutlierTracker::outliers() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::vector<Outlier> result(outliers_.begin() + next_, outliers_.end());
+  result.insert(result.end(), outliers_.begin(), outliers_.begin() + next_);
+  return result;
+}
+
+}}}  // facebook::memcache::mcrouter
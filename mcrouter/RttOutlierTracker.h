@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <folly/Range.h>
+
+#include "mcrouter/lib/mc/msg.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Details of the latest RTT outliers of one proxy (replies slower than
+ * --logging-rtt-outlier-threshold-us), see --rtt-outlier-samples.
+ *
+ * Only the proxy thread adds outliers; they're guarded by a mutex so that
+ * ServiceInfo on any proxy can read all of them.
+ */
+class RttOutlierTracker {
+ public:
+  /* Longer keys are cut */
+  static constexpr size_t kMaxKeyPrefix = 32;
+
+  struct Outlier {
+    std::string keyPrefix;
+    /* host:port */
+    std::string destination;
+    mc_op_t op;
+    int64_t durationUs;
+    time_t time;
+  };
+
+  explicit RttOutlierTracker(size_t capacity);
+
+  void add(folly::StringPiece key, std::string destination, mc_op_t op,
+           int64_t durationUs);
+
+  /**
+   * @return the latest outliers, oldest first
+   */
+  std::vector<Outlier> outliers() const;
+
+ private:
+  const size_t capacity_;
+
+  mutable std::mutex lock_;
+  /* Circular once full, next_ is the oldest */
+  std::vector<Outlier> outliers_;
+  size_t next_{0};
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -9,7 +9,10 @@
  */
 #include "ServiceInfo.h"
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
+#include <limits>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -19,18 +22,28 @@
 #include <folly/Range.h>
 
 #include "mcrouter/config-impl.h"
+#include "mcrouter/ClientTracker.h"
 #include "mcrouter/config.h"
+#include "mcrouter/HotKeyTracker.h"
+#include "mcrouter/lib/config/ConfigPreprocessor.h"
 #include "mcrouter/lib/fbi/cpp/globals.h"
+#include "mcrouter/lib/MemoryAccounting.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/options.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/ProxyConfigBuilder.h"
 #include "mcrouter/ProxyConfigIf.h"
+#include "mcrouter/ProxyDestinationMap.h"
 #include "mcrouter/ProxyMcRequest.h"
 #include "mcrouter/ProxyRequestContext.h"
+#include "mcrouter/RequestPriorities.h"
 #include "mcrouter/routes/McOpList.h"
 #include "mcrouter/routes/ProxyRoute.h"
+#include "mcrouter/RttOutlierTracker.h"
+#include "mcrouter/StageProfiler.h"
+#include "mcrouter/stats.h"
+#include "mcrouter/TenantQuotas.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -199,11 +212,13 @@ ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(proxy_t* proxy,
 
   commands_.emplace("config",
     [this] (const std::vector<folly::StringPiece>& args) {
-      if (proxy_->opts.config_str.empty()) {
+      auto& configApi = proxy_->router->configApi();
+      std::string config;
+      if (!configApi.hasConfigStr() || !configApi.getConfigFile(config)) {
         return std::string(
           R"({"error": "config is loaded from file and not available"})");
       }
-      return std::string(proxy_->opts.config_str);
+      return config;
     }
   );
 
@@ -262,7 +277,7 @@ ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(proxy_t* proxy,
   */
 
   commands_.emplace("route_handles",
-    [this] (const std::vector<folly::StringPiece>& args) {
+    [this, &config] (const std::vector<folly::StringPiece>& args) {
       if (args.size() != 2) {
         throw std::runtime_error("route_handles: 2 args expected");
       }
@@ -271,8 +286,14 @@ ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(proxy_t* proxy,
       auto ctx = std::make_shared<RecordingContext>(nullptr);
       RecordingMcRequest req(ctx, key.str());
 
-      return routeHandlesCommandHelper(op, req, proxyRoute_,
-                                       McOpList::LastItem());
+      auto tree = routeHandlesCommandHelper(op, req, proxyRoute_,
+                                            McOpList::LastItem());
+      /* Layers removed from the whole config, not just from this tree */
+      if (auto collapsed = config.collapsedRouteHandles()) {
+        tree.append(folly::to<std::string>(
+          "(", collapsed, " no-op route handles collapsed)\n"));
+      }
+      return tree;
     }
   );
 
@@ -292,20 +313,46 @@ ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(proxy_t* proxy,
     }
   );
 
+  /*
+   * preprocessed_config       -- config with all macros expanded
+   * preprocessed_config stats -- number of calls and time spent in
+   *                              expansion of every macro
+   */
   commands_.emplace("preprocessed_config",
     [this] (const std::vector<folly::StringPiece>& args) {
+      bool withStats = false;
+      if (args.size() == 1 && args[0] == "stats") {
+        withStats = true;
+      } else if (!args.empty()) {
+        throw std::runtime_error("preprocessed_config: 0 args or 'stats'"
+                                 " expected");
+      }
       std::string confFile;
       if (!proxy_->router->configApi().getConfigFile(confFile)) {
         throw std::runtime_error("can not load config");
       }
+      ConfigPreprocessor::Stats stats;
       ProxyConfigBuilder builder(proxy_->opts,
                                  &proxy_->router->configApi(),
-                                 confFile);
+                                 confFile,
+                                 nullptr,
+                                 withStats ? &stats : nullptr);
       folly::json::serialization_opts jsonOpts;
       jsonOpts.pretty_formatting = true;
       jsonOpts.sort_keys = true;
-      return folly::json::serialize(builder.preprocessedConfig(),
-                                    jsonOpts).toStdString();
+      if (!withStats) {
+        return folly::json::serialize(builder.preprocessedConfig(),
+                                      jsonOpts).toStdString();
+      }
+      folly::dynamic result = folly::dynamic::object();
+      for (const auto& it : stats) {
+        result[it.first] = folly::dynamic::object
+          ("calls", it.second.calls)
+          ("memoized", it.second.memoized)
+          ("time_us", std::chrono::duration_cast<std::chrono::microseconds>(
+            it.second.time).count());
+      }
+      return folly::json::serialize(result, jsonOpts).toStdString();
     }
   );
 
@@ -314,6 +361,417 @@ ServiceInfo::ServiceInfoImpl::ServiceInfoImpl(proxy_t* proxy,
       return folly::to<std::string>(globals::hostid());
     }
   );
+
+  /*
+   * latency           -- request duration summaries for all operations
+   * latency(op)       -- request duration summary for given operation
+   * latency(pdstnKey) -- latency summary for given destination
+   */
+  commands_.emplace("latency",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (args.size() > 1) {
+        throw std::runtime_error("latency: 0 or 1 args expected");
+      }
+
+      std::string str;
+      if (args.empty()) {
+        for (int op = 0; op < mc_nops; ++op) {
+          auto hist = stats_aggregate_op_latency(proxy_->router,
+                                                 static_cast<mc_op_t>(op));
+          if (hist.count() > 0) {
+            str.append(folly::to<std::string>(
+              mc_op_to_string(static_cast<mc_op_t>(op)), " ",
+              hist.toString(), "\n"));
+          }
+        }
+        return str;
+      }
+
+      auto op = mc_op_from_string(args[0].str().c_str());
+      if (op != mc_op_unknown) {
+        return stats_aggregate_op_latency(proxy_->router, op).toString();
+      }
+      auto destinations = stats_aggregate_destination_latency(proxy_->router);
+      auto it = destinations.find(args[0].str());
+      if (it == destinations.end()) {
+        throw std::runtime_error("latency: unknown op or destination " +
+                                 args[0].str());
+      }
+      return it->second.toString();
+    }
+  );
+
+  /*
+   * queue_latency -- summaries of time spent in proxy queues for each
+   *                  priority class with queued requests
+   *                  (see --proxy-max-inflight-requests)
+   */
+  commands_.emplace("queue_latency",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (!args.empty()) {
+        throw std::runtime_error("queue_latency: no args expected");
+      }
+      std::string str;
+      for (size_t i = 0; i < RequestPriorities::kNumClasses; ++i) {
+        auto hist = stats_aggregate_queue_latency(proxy_->router, i);
+        if (hist.count() > 0) {
+          str.append(folly::to<std::string>(
+            "class", i, " ", hist.toString(), "\n"));
+        }
+      }
+      return str;
+    }
+  );
+
+  /*
+   * tenant_quotas -- for each tenant of --proxy-tenant-quotas: requests
+   *                  in flight, admitted and refused for each quota
+   *                  since startup
+   */
+  commands_.emplace("tenant_quotas",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (!args.empty()) {
+        throw std::runtime_error("tenant_quotas: no args expected");
+      }
+      auto quotas = proxy_->router ? proxy_->router->tenantQuotas() : nullptr;
+      if (quotas == nullptr) {
+        return std::string();
+      }
+      std::string str;
+      for (const auto& tenant : quotas->tenants()) {
+        str.append(folly::to<std::string>(
+          tenant->prefix,
+          " inflight=", tenant->inflight.load(),
+          " admitted=", tenant->admitted.load(),
+          " over_requests=", tenant->overRequests.load(),
+          " over_bytes=", tenant->overBytes.load(),
+          " over_inflight=", tenant->overInflight.load(), "\n"));
+      }
+      return str;
+    }
+  );
+
+  /*
+   * hot_keys             -- 20 most frequent keys (without routing prefix)
+   *                         sampled by --hot-keys-sample-rate
+   * hot_keys(prefixes)   -- same for routing prefixes
+   * hot_keys([prefixes,]n) -- top n instead of 20
+   *
+   * Summaries of all proxies are merged; counts are estimated requests
+   * (sampled count times the sample rate), error bounds their overestimate.
+   */
+  commands_.emplace("hot_keys",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (!proxy_->hotKeys) {
+        throw std::runtime_error("hot_keys: --hot-keys-sample-rate not set");
+      }
+      bool prefixes = !args.empty() && args[0] == "prefixes";
+      if (args.size() > (prefixes ? 2 : 1)) {
+        throw std::runtime_error("hot_keys: too many args");
+      }
+      size_t n = 20;
+      if (args.size() == (prefixes ? 2 : 1)) {
+        n = folly::to<size_t>(args.back());
+      }
+
+      std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> merged;
+      for (size_t i = 0; i < proxy_->router->numProxies(); ++i) {
+        auto& tracker = proxy_->router->getProxy(i)->hotKeys;
+        auto items = prefixes
+          ? tracker->topPrefixes(proxy_->opts.hot_keys_capacity)
+          : tracker->topKeys(proxy_->opts.hot_keys_capacity);
+        for (const auto& item : items) {
+          auto& counts = merged[item.key];
+          counts.first += item.count;
+          counts.second += item.error;
+        }
+      }
+      std::vector<std::pair<std::string, std::pair<uint64_t, uint64_t>>>
+        sorted(merged.begin(), merged.end());
+      std::sort(sorted.begin(), sorted.end(),
+                [](const decltype(sorted)::value_type& a,
+                   const decltype(sorted)::value_type& b) {
+                  return a.second.first > b.second.first;
+                });
+
+      std::string str;
+      auto rate = proxy_->opts.hot_keys_sample_rate;
+      for (size_t i = 0; i < std::min(n, sorted.size()); ++i) {
+        const auto& key = sorted[i].first;
+        str.append(folly::to<std::string>(
+          key.empty() ? "(none)" : key,
+          " count:", sorted[i].second.first * rate,
+          " error:", sorted[i].second.second * rate, "\n"));
+      }
+      return str;
+    }
+  );
+
+  /*
+   * rtt_outliers     -- latest rtt outliers of all proxies, most recent
+   *                     first, see --rtt-outlier-samples
+   * rtt_outliers(n)  -- at most n of them
+   */
+  commands_.emplace("rtt_outliers",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (!proxy_->rttOutliers) {
+        throw std::runtime_error(
+          "rtt_outliers: --rtt-outlier-samples or "
+          "--logging-rtt-outlier-threshold-us not set");
+      }
+      if (args.size() > 1) {
+        throw std::runtime_error("rtt_outliers: 0 or 1 args expected");
+      }
+      size_t n = args.empty() ? std::numeric_limits<size_t>::max()
+                              : folly::to<size_t>(args[0]);
+
+      std::vector<RttOutlierTracker::Outlier> outliers;
+      for (size_t i = 0; i < proxy_->router->numProxies(); ++i) {
+        auto proxyOutliers =
+          proxy_->router->getProxy(i)->rttOutliers->outliers();
+        /* newest first, as after sorting */
+        outliers.insert(outliers.end(), proxyOutliers.rbegin(),
+                        proxyOutliers.rend());
+      }
+      std::stable_sort(outliers.begin(), outliers.end(),
+                       [](const RttOutlierTracker::Outlier& a,
+                          const RttOutlierTracker::Outlier& b) {
+                         return a.time > b.time;
+                       });
+
+      std::string str;
+      for (size_t i = 0; i < std::min(n, outliers.size()); ++i) {
+        const auto& outlier = outliers[i];
+        str.append(folly::to<std::string>(
+          outlier.time, " ", mc_op_to_string(outlier.op),
+          " ", outlier.keyPrefix,
+          " destination:", outlier.destination,
+          " duration_us:", outlier.durationUs, "\n"));
+      }
+      return str;
+    }
+  );
+
+  /*
+   * clients     -- 20 client connections with the most requests, over all
+   *                server threads (refreshed every second)
+   * clients(n)  -- top n instead of 20
+   *
+   * Only available in the standalone server.
+   */
+  commands_.emplace("clients",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (!proxy_->clientTracker) {
+        throw std::runtime_error("clients: not a standalone server");
+      }
+      if (args.size() > 1) {
+        throw std::runtime_error("clients: 0 or 1 args expected");
+      }
+      size_t n = args.empty() ? 20 : folly::to<size_t>(args[0]);
+
+      std::vector<ClientTracker::Connection> connections;
+      for (size_t i = 0; i < proxy_->router->numProxies(); ++i) {
+        auto threadConnections =
+          proxy_->router->getProxy(i)->clientTracker->connections();
+        connections.insert(connections.end(),
+                           threadConnections.begin(),
+                           threadConnections.end());
+      }
+      n = std::min(n, connections.size());
+      std::partial_sort(connections.begin(), connections.begin() + n,
+                        connections.end(),
+                        [](const ClientTracker::Connection& a,
+                           const ClientTracker::Connection& b) {
+                          return a.stats.requests > b.stats.requests;
+                        });
+
+      std::string str;
+      for (size_t i = 0; i < n; ++i) {
+        const auto& stats = connections[i].stats;
+        str.append(folly::to<std::string>(
+          connections[i].peer,
+          " requests:", stats.requests,
+          " bytes_in:", stats.bytesIn,
+          " bytes_out:", stats.bytesOut,
+          " max_in_flight:", stats.maxInFlight,
+          " avg_latency_us:", static_cast<uint64_t>(stats.avgLatencyUs()),
+          "\n"));
+      }
+      return str;
+    }
+  );
+
+  /*
+   * top_talkers     -- 20 client hosts with the most requests, sampled by
+   *                    --top-talkers-sample-rate (including closed
+   *                    connections)
+   * top_talkers(n)  -- top n instead of 20
+   *
+   * Counts are estimated requests, error bounds their overestimate,
+   * as for hot_keys.
+   */
+  commands_.emplace("top_talkers",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (!proxy_->clientTracker ||
+          proxy_->clientTracker->sampleRate() == 0) {
+        throw std::runtime_error(
+          "top_talkers: --top-talkers-sample-rate not set");
+      }
+      if (args.size() > 1) {
+        throw std::runtime_error("top_talkers: 0 or 1 args expected");
+      }
+      size_t n = args.empty() ? 20 : folly::to<size_t>(args[0]);
+
+      std::unordered_map<std::string, std::pair<uint64_t, uint64_t>> merged;
+      for (size_t i = 0; i < proxy_->router->numProxies(); ++i) {
+        auto& tracker = proxy_->router->getProxy(i)->clientTracker;
+        for (const auto& item :
+               tracker->topTalkers(ClientTracker::kTopTalkersCapacity)) {
+          auto& counts = merged[item.key];
+          counts.first += item.count;
+          counts.second += item.error;
+        }
+      }
+      std::vector<std::pair<std::string, std::pair<uint64_t, uint64_t>>>
+        sorted(merged.begin(), merged.end());
+      std::sort(sorted.begin(), sorted.end(),
+                [](const decltype(sorted)::value_type& a,
+                   const decltype(sorted)::value_type& b) {
+                  return a.second.first > b.second.first;
+                });
+
+      std::string str;
+      auto rate = proxy_->clientTracker->sampleRate();
+      for (size_t i = 0; i < std::min(n, sorted.size()); ++i) {
+        str.append(folly::to<std::string>(
+          sorted[i].first,
+          " count:", sorted[i].second.first * rate,
+          " error:", sorted[i].second.second * rate, "\n"));
+      }
+      return str;
+    }
+  );
+
+  /*
+   * stage_profile -- samples of --stage-profiler-interval-ms over all
+   *                  proxies, one "route;route;...;stage count" line per
+   *                  path of route handles and stage (as taken by
+   *                  flamegraph.pl), most samples first. Stages outside
+   *                  of route handles have no route prefix.
+   */
+  commands_.emplace("stage_profile",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (!proxy_->stageProfiler) {
+        throw std::runtime_error(
+          "stage_profile: --stage-profiler-interval-ms not set");
+      }
+      if (!args.empty()) {
+        throw std::runtime_error("stage_profile: no args expected");
+      }
+
+      std::unordered_map<std::string, uint64_t> merged;
+      for (size_t i = 0; i < proxy_->router->numProxies(); ++i) {
+        auto& profiler = proxy_->router->getProxy(i)->stageProfiler;
+        for (const auto& entry : profiler->entries()) {
+          std::string path;
+          for (auto route : entry.routes) {
+            path.append(shortRouteName(route));
+            path.push_back(';');
+          }
+          path.append(StageProfiler::stageName(entry.stage));
+          merged[path] += entry.samples;
+        }
+      }
+      std::vector<std::pair<std::string, uint64_t>> sorted(merged.begin(),
+                                                           merged.end());
+      std::sort(sorted.begin(), sorted.end(),
+                [](const std::pair<std::string, uint64_t>& a,
+                   const std::pair<std::string, uint64_t>& b) {
+                  return a.second > b.second;
+                });
+
+      std::string str;
+      for (const auto& it : sorted) {
+        str.append(folly::to<std::string>(it.first, " ", it.second, "\n"));
+      }
+      return str;
+    }
+  );
+
+  /*
+   * connect_latency           -- connect time summary for all destinations
+   * connect_latency(pdstnKey) -- connect time summary for given destination
+   */
+  commands_.emplace("connect_latency",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      if (args.size() > 1) {
+        throw std::runtime_error("connect_latency: 0 or 1 args expected");
+      }
+
+      auto destinations =
+        stats_aggregate_destination_connect_latency(proxy_->router);
+      if (args.empty()) {
+        LatencyHistogram hist;
+        for (const auto& it : destinations) {
+          hist.merge(it.second);
+        }
+        return hist.toString();
+      }
+      auto it = destinations.find(args[0].str());
+      if (it == destinations.end()) {
+        throw std::runtime_error("connect_latency: unknown destination " +
+                                 args[0].str());
+      }
+      return it->second.toString();
+    }
+  );
+
+  /*
+   * memory -- bytes of long lived allocations by subsystem, one
+   *           "name bytes" line each, see MemoryAccounting. Followed by
+   *           the bytes of interned destination keys and the bytes saved
+   *           by sharing pool settings and keys among the config's clients,
+   *           not included in the total.
+   */
+  commands_.emplace("memory",
+    [&config] (const std::vector<folly::StringPiece>& args) {
+      if (!args.empty()) {
+        throw std::runtime_error("memory: no args expected");
+      }
+      auto totals = MemoryAccounting::totals();
+      int64_t sum = 0;
+      std::string str;
+      for (size_t i = 0; i < MemoryAccounting::kNumTags; ++i) {
+        auto bytes = std::max<int64_t>(0, totals[i]);
+        sum += bytes;
+        str.append(folly::to<std::string>(
+          MemoryAccounting::tagName(static_cast<MemoryTag>(i)), " ", bytes,
+          "\n"));
+      }
+      str.append(folly::to<std::string>("total ", sum, "\n"));
+      str.append(folly::to<std::string>(
+        "interned_keys ", ProxyClientCommon::internedKeyBytes(), "\n"));
+      str.append(folly::to<std::string>(
+        "config_clients_saved ", config.clientBytesSaved(), "\n"));
+      return str;
+    }
+  );
+
+  /*
+   * warmup -- "ready" if all destinations were connected to (or tried to),
+   *           see --destination-warmup-concurrency,
+   *           "pending:N" with the number of destinations left otherwise
+   */
+  commands_.emplace("warmup",
+    [this] (const std::vector<folly::StringPiece>& args) {
+      size_t pending = 0;
+      for (size_t i = 0; i < proxy_->router->numProxies(); ++i) {
+        pending += proxy_->router->getProxy(i)->destinationMap->warmupPending();
+      }
+      return pending == 0 ? std::string("ready")
+                          : folly::to<std::string>("pending:", pending);
+    }
+  );
 }
 
 void ServiceInfo::ServiceInfoImpl::handleRouteCommand(
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <typeindex>
+#include <unordered_map>
+
+#include "mcrouter/lib/config/JsonFingerprint.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Objects parsed from config that don't depend on the proxy they are used
+ * by (and are safe to use from multiple threads), e.g. shard splits.
+ * Each object is created once per config and shared by route handles
+ * of all proxies, instead of creating a copy for each proxy.
+ *
+ * Objects are keyed by their type and the fingerprint of the JSON they are
+ * created from.
+ */
+class SharedConfigObjects {
+ public:
+  /**
+   * @param create  callable returning std::shared_ptr<T>
+   *
+   * @return object of type T created from JSON equal to json, or the result
+   *         of create() if there's none yet.
+   */
+  template <class T, class Create>
+  std::shared_ptr<T> get(const folly::dynamic& json, Create&& create) {
+    // typeid ignores cv-qualifiers, so T and const T would collide
+    Key key{jsonFingerprint(json), std::type_index(typeid(T*))};
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = objects_.find(key);
+    if (it != objects_.end()) {
+      return std::const_pointer_cast<T>(
+        std::static_pointer_cast<const T>(it->second));
+    }
+    std::shared_ptr<T> obj = create();
+    objects_.emplace(key, obj);
+    return obj;
+  }
+
+ private:
+  struct Key {
+    JsonFingerprint fingerprint;
+    std::type_index type;
+
+    bool operator==(const Key& other) const {
+      return fingerprint == other.fingerprint && type == other.type;
+    }
+  };
+
+  struct KeyHasher {
+    size_t operator()(const Key& key) const {
+      return JsonFingerprintHasher()(key.fingerprint) ^ key.type.hash_code();
+    }
+  };
+
+  std::unordered_map<Key, std::shared_ptr<const void>, KeyHasher>
+    objects_;
+  std::mutex lock_;
+};
+
+}}}  // facebook::memcache::mcrouter
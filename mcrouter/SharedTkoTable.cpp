@@ -0,0 +1,262 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "SharedTkoTable.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+
+#include <glog/logging.h>
+
+#include <folly/Hash.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+struct SharedTkoTable::Header {
+  std::atomic<uint64_t> magic;
+  std::atomic<uint64_t> numProcesses;
+  std::atomic<uint64_t> numEntries;
+};
+
+struct SharedTkoTable::Process {
+  /* Bumped every time the slot is taken */
+  std::atomic<uint64_t> generation;
+  /* Steady clock time of the last heartbeat, 0 if the slot is free */
+  std::atomic<int64_t> heartbeatMs;
+};
+
+struct SharedTkoTable::SharedEntry {
+  std::atomic<uint64_t> keyHash;
+  /* owner << 1 | hard, 0 if not TKO */
+  std::atomic<uint64_t> owner;
+};
+
+namespace {
+
+const uint64_t kMagic = 0x6d63744b4f746232ULL;  // "mctKOtb2"
+const uint64_t kProcessBits = 10;
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) &&
+              sizeof(std::atomic<int64_t>) == sizeof(int64_t),
+              "atomics in shared memory must have no extra state");
+static_assert((1ULL << kProcessBits) == SharedTkoTable::kMaxProcesses,
+              "process slot must fit in kProcessBits");
+
+/* CLOCK_MONOTONIC on Linux, the same for all processes on the host */
+int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Sets a header field of a new table.
+ *
+ * @return false if the table was created with a different value
+ */
+bool initField(std::atomic<uint64_t>& field, uint64_t value) {
+  uint64_t cur = 0;
+  return field.compare_exchange_strong(cur, value) || cur == value;
+}
+
+}  // anonymous namespace
+
+constexpr uint64_t SharedTkoTable::kNumEntries;
+constexpr uint64_t SharedTkoTable::kMaxProcesses;
+constexpr size_t SharedTkoTable::kMaxProbes;
+constexpr std::chrono::milliseconds SharedTkoTable::kHeartbeatInterval;
+constexpr std::chrono::milliseconds SharedTkoTable::kOwnerTimeout;
+
+void SharedTkoTable::Entry::mark(bool hard) const {
+  auto owner = table_->owner_;
+  auto value = (owner << 1) | (hard ? 1 : 0);
+  auto cur = entry_->owner.load();
+  do {
+    if (cur != 0 && (cur >> 1) != owner && table_->ownerAlive(cur >> 1)) {
+      /* Another process is responsible */
+      return;
+    }
+  } while (!entry_->owner.compare_exchange_weak(cur, value));
+}
+
+void SharedTkoTable::Entry::unmark() const {
+  auto owner = table_->owner_;
+  auto cur = entry_->owner.load();
+  while ((cur >> 1) == owner && !entry_->owner.compare_exchange_weak(cur, 0)) {
+  }
+}
+
+bool SharedTkoTable::Entry::markedHere() const {
+  return (entry_->owner.load(std::memory_order_relaxed) >> 1) ==
+         table_->owner_;
+}
+
+bool SharedTkoTable::Entry::markedElsewhere() const {
+  auto cur = entry_->owner.load(std::memory_order_relaxed);
+  if (cur == 0 || (cur >> 1) == table_->owner_) {
+    return false;
+  }
+  if (table_->ownerAlive(cur >> 1)) {
+    return true;
+  }
+  /* The owner died without clearing its TKO */
+  entry_->owner.compare_exchange_strong(cur, 0);
+  return false;
+}
+
+bool SharedTkoTable::Entry::isHard() const {
+  return entry_->owner.load(std::memory_order_relaxed) & 1;
+}
+
+std::unique_ptr<SharedTkoTable>
+SharedTkoTable::open(const std::string& path,
+                     std::chrono::milliseconds ownerTimeout) {
+  auto size = sizeof(Header) + kMaxProcesses * sizeof(Process) +
+              kNumEntries * sizeof(SharedEntry);
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    LOG(ERROR) << "Can't open shared TKO table " << path << ": "
+               << strerror(errno);
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (static_cast<size_t>(st.st_size) < size && ftruncate(fd, size) != 0)) {
+    LOG(ERROR) << "Can't resize shared TKO table " << path << ": "
+               << strerror(errno);
+    ::close(fd);
+    return nullptr;
+  }
+
+  auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Can't map shared TKO table " << path << ": "
+               << strerror(errno);
+    return nullptr;
+  }
+
+  std::unique_ptr<SharedTkoTable> table(
+    new SharedTkoTable(data, size, ownerTimeout));
+  /* A new file is all zeroes; the first process to map it sets the header.
+     The layout has to be exactly the one mapped here, so the process slots
+     and entries are all within the mapping. */
+  auto& header = table->header();
+  if (!initField(header.magic, kMagic) ||
+      !initField(header.numProcesses, kMaxProcesses) ||
+      !initField(header.numEntries, kNumEntries)) {
+    LOG(ERROR) << "Shared TKO table " << path << " has unknown format";
+    return nullptr;
+  }
+  if (!table->claimProcess()) {
+    LOG(ERROR) << "Shared TKO table " << path << " has no free process slot";
+    return nullptr;
+  }
+  return table;
+}
+
+SharedTkoTable::SharedTkoTable(void* data, size_t size,
+                               std::chrono::milliseconds ownerTimeout)
+    : data_(data),
+      size_(size),
+      ownerTimeout_(ownerTimeout) {
+}
+
+SharedTkoTable::~SharedTkoTable() {
+  if (process_) {
+    auto heartbeat = lastHeartbeatMs_;
+    process_->heartbeatMs.compare_exchange_strong(heartbeat, 0);
+  }
+  munmap(data_, size_);
+}
+
+SharedTkoTable::Entry SharedTkoTable::entry(folly::StringPiece key) {
+  /* 0 marks free entries */
+  auto hash = folly::hash::fnv64_buf(key.data(), key.size()) | 1;
+  for (size_t i = 0; i < kMaxProbes; ++i) {
+    auto& e = entries()[(hash + i) % kNumEntries];
+    uint64_t cur = 0;
+    if (e.keyHash.compare_exchange_strong(cur, hash) || cur == hash) {
+      return Entry(*this, e);
+    }
+  }
+  LOG(ERROR) << "Shared TKO table is full, " << key << " won't be shared";
+  return Entry();
+}
+
+void SharedTkoTable::heartbeat() {
+  if (lastHeartbeatMs_ == 0) {
+    return;
+  }
+  auto heartbeat = lastHeartbeatMs_;
+  auto now = nowMs();
+  if (!process_->heartbeatMs.compare_exchange_strong(heartbeat, now)) {
+    /* We were too slow and another process took the slot, our TKOs look
+       like those of a dead process from now on */
+    LOG(ERROR) << "Shared TKO table: lost process slot, "
+               << "TKOs of this process are no longer shared";
+    lastHeartbeatMs_ = 0;
+    return;
+  }
+  lastHeartbeatMs_ = now;
+}
+
+bool SharedTkoTable::claimProcess() {
+  auto now = nowMs();
+  for (uint64_t i = 0; i < kMaxProcesses; ++i) {
+    auto& process = processes()[i];
+    auto heartbeat = process.heartbeatMs.load();
+    if (heartbeat != 0 && now - heartbeat <= ownerTimeout_.count()) {
+      continue;
+    }
+    if (process.heartbeatMs.compare_exchange_strong(heartbeat, now)) {
+      /* Entries marked by the previous user of the slot are dead now */
+      auto generation = process.generation.fetch_add(1) + 1;
+      owner_ = (generation << kProcessBits) | i;
+      process_ = &process;
+      lastHeartbeatMs_ = now;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SharedTkoTable::ownerAlive(uint64_t owner) const {
+  auto& process = processes()[owner & (kMaxProcesses - 1)];
+  if (process.generation.load() != (owner >> kProcessBits)) {
+    return false;
+  }
+  /* Compared to our own heartbeat, so that no clock is read here */
+  auto heartbeat = process.heartbeatMs.load(std::memory_order_relaxed);
+  return heartbeat != 0 &&
+         process_->heartbeatMs.load(std::memory_order_relaxed) - heartbeat <=
+           ownerTimeout_.count();
+}
+
+SharedTkoTable::Header& SharedTkoTable::header() const {
+  return *static_cast<Header*>(data_);
+}
+
+SharedTkoTable::Process* SharedTkoTable::processes() const {
+  return reinterpret_cast<Process*>(static_cast<char*>(data_) +
+                                    sizeof(Header));
+}
+
+SharedTkoTable::SharedEntry* SharedTkoTable::entries() const {
+  return reinterpret_cast<SharedEntry*>(
+    reinterpret_cast<char*>(processes()) + kMaxProcesses * sizeof(Process));
+}
+
+}}}  // facebook::memcache::mcrouter
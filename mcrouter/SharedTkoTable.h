@@ -0,0 +1,157 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * TKO state shared by all mcrouter processes on a host through a memory
+ * mapped file (e.g. in /dev/shm).
+ *
+ * Every process that opens the table takes a process slot and keeps its
+ * heartbeat up to date (see heartbeat()). The table has an entry per
+ * destination key. While a destination is TKO in one process, the entry
+ * holds the slot and the generation of the slot of that process. That process
+ * is the only one sending probes and clears the entry once a probe succeeds.
+ * Other processes don't send requests to the destination while the owner is
+ * alive, that is while the slot still has the same generation and its
+ * heartbeat is less than ownerTimeout behind theirs. Entries of processes
+ * that died are cleared by the first process to notice, slots are reused
+ * once their heartbeat is stale.
+ *
+ * All updates are lock-free CAS, entries are never removed.
+ */
+class SharedTkoTable {
+  /* Layout of an entry in the mapped file */
+  struct SharedEntry;
+
+ public:
+  static constexpr uint64_t kNumEntries = 65536;
+  static constexpr uint64_t kMaxProcesses = 1024;
+  /* Entries tried for a key before giving up */
+  static constexpr size_t kMaxProbes = 64;
+  static constexpr std::chrono::milliseconds kHeartbeatInterval{1000};
+  static constexpr std::chrono::milliseconds kOwnerTimeout{10000};
+
+  /**
+   * Entry of one destination, as seen by the process which opened the table.
+   * A default constructed Entry refers to no entry, TKOs aren't shared.
+   */
+  class Entry {
+   public:
+    Entry() = default;
+
+    explicit operator bool() const {
+      return entry_ != nullptr;
+    }
+
+    /**
+     * Mark TKO by this process, unless another process did already.
+     */
+    void mark(bool hard) const;
+
+    /**
+     * Clear TKO if it was marked by this process.
+     */
+    void unmark() const;
+
+    /**
+     * @return true if destination is TKO in this process
+     */
+    bool markedHere() const;
+
+    /**
+     * @return true if destination is TKO in another live process
+     */
+    bool markedElsewhere() const;
+
+    bool isHard() const;
+
+    bool operator==(const Entry& other) const {
+      return entry_ == other.entry_;
+    }
+
+    bool operator!=(const Entry& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    const SharedTkoTable* table_{nullptr};
+    SharedEntry* entry_{nullptr};
+
+    Entry(const SharedTkoTable& table, SharedEntry& entry)
+        : table_(&table),
+          entry_(&entry) {
+    }
+
+    friend class SharedTkoTable;
+  };
+
+  /**
+   * Maps the table at path, creating it if needed, and takes a process slot.
+   *
+   * @param ownerTimeout  processes whose heartbeat is this much behind
+   *                      are considered dead
+   * @return nullptr on failure (logged)
+   */
+  static std::unique_ptr<SharedTkoTable> open(
+    const std::string& path,
+    std::chrono::milliseconds ownerTimeout = kOwnerTimeout);
+
+  /**
+   * Releases the process slot, TKOs of this process are cleared
+   * by the next process that reads them.
+   */
+  ~SharedTkoTable();
+
+  /**
+   * @return entry of destinationKey, Entry() if the table is too full
+   */
+  Entry entry(folly::StringPiece destinationKey);
+
+  /**
+   * Tells other processes this one is alive, should be called every
+   * kHeartbeatInterval.
+   */
+  void heartbeat();
+
+ private:
+  struct Header;
+  struct Process;
+
+  void* data_;
+  size_t size_;
+  const std::chrono::milliseconds ownerTimeout_;
+  Process* process_{nullptr};
+  /* generation << kProcessBits | process slot, never 0 */
+  uint64_t owner_{0};
+  /* Only used by heartbeat(), 0 once the slot was lost */
+  int64_t lastHeartbeatMs_{0};
+
+  SharedTkoTable(void* data, size_t size,
+                 std::chrono::milliseconds ownerTimeout);
+
+  bool claimProcess();
+  bool ownerAlive(uint64_t owner) const;
+
+  Header& header() const;
+  Process* processes() const;
+  SharedEntry* entries() const;
+};
+
+}}}  // facebook::memcache::mcrouter
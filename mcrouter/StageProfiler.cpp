@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "StageProfiler.h"
+
+#include <algorithm>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t StageProfiler::kMaxNodes;
+
+StageProfiler::Node::Node(const Node* p, const char* r)
+    : parent(p),
+      route(r) {
+  for (auto& count : samples) {
+    count.store(0, std::memory_order_relaxed);
+  }
+}
+
+StageProfiler::StageProfiler() {
+  nodes_.emplace_back(nullptr, nullptr);
+  root_ = &nodes_.front();
+}
+
+uintptr_t StageProfiler::enterRoute(uintptr_t current, const char* route) {
+  auto node = reinterpret_cast<Node*>(current & ~kProfileStageMask);
+  if (node == nullptr) {
+    node = root_;
+  }
+
+  Node* child = nullptr;
+  for (const auto& it : node->children) {
+    if (it.first == route) {
+      child = it.second;
+      break;
+    }
+  }
+  if (child == nullptr) {
+    std::lock_guard<std::mutex> lock(nodesMutex_);
+    if (nodes_.size() >= kMaxNodes) {
+      child = node;
+    } else {
+      nodes_.emplace_back(node, route);
+      child = &nodes_.back();
+      node->children.emplace_back(route, child);
+    }
+  }
+  return reinterpret_cast<uintptr_t>(child) |
+         static_cast<uintptr_t>(ProfileStage::kRoute);
+}
+
+void StageProfiler::sample() {
+  /* Pairs with the release in ProfileRouteScope, so that a new node
+     is seen initialized */
+  auto word = slot_.load(std::memory_order_acquire);
+  auto node = reinterpret_cast<Node*>(word & ~kProfileStageMask);
+  if (node == nullptr) {
+    node = root_;
+  }
+  auto stage = word & kProfileStageMask;
+  if (stage < kNumProfileStages) {
+    node->samples[stage].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+std::vector<StageProfiler::Entry> StageProfiler::entries() const {
+  std::vector<Entry> entries;
+  std::lock_guard<std::mutex> lock(nodesMutex_);
+  for (const auto& node : nodes_) {
+    for (size_t stage = 0; stage < kNumProfileStages; ++stage) {
+      auto samples = node.samples[stage].load(std::memory_order_relaxed);
+      if (samples == 0) {
+        continue;
+      }
+      Entry entry;
+      for (auto cur = &node; cur->route != nullptr; cur = cur->parent) {
+        entry.routes.push_back(cur->route);
+      }
+      std::reverse(entry.routes.begin(), entry.routes.end());
+      entry.stage = static_cast<ProfileStage>(stage);
+      entry.samples = samples;
+      entries.push_back(std::move(entry));
+    }
+  }
+  return entries;
+}
+
+const char* StageProfiler::stageName(ProfileStage stage) {
+  switch (stage) {
+    case ProfileStage::kOther:
+      return "other";
+    case ProfileStage::kParse:
+      return "parse";
+    case ProfileStage::kRoute:
+      return "route";
+    case ProfileStage::kSerialize:
+      return "serialize";
+    case ProfileStage::kWrite:
+      return "write";
+  }
+  return "unknown";
+}
+
+ProfileRouteScope::ProfileRouteScope(StageProfiler* profiler,
+                                     const char* route) {
+  if (profiler == nullptr) {
+    return;
+  }
+  slot_ = &profiler->slot();
+  prev_ = slot_->load(std::memory_order_relaxed);
+  slot_->store(profiler->enterRoute(prev_, route), std::memory_order_release);
+}
+
+ProfileRouteScope::ProfileRouteScope(ProfileRouteScope&& other) noexcept
+    : slot_(other.slot_),
+      prev_(other.prev_) {
+  other.slot_ = nullptr;
+}
+
+ProfileRouteScope::~ProfileRouteScope() {
+  if (slot_ != nullptr) {
+    slot_->store(prev_, std::memory_order_relaxed);
+  }
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mcrouter/lib/ProfileStage.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Sampling profiler of one proxy thread, see --stage-profiler-interval-ms.
+ *
+ * The proxy thread keeps a word in slot() up to date (it is its
+ * threadProfileSlot() and the FiberManager's profile slot): the stage it is
+ * in (see ProfileStage.h) and, while a route handle runs, the node of the
+ * path of route handles that led to it. Entering a route handle is a lookup
+ * among the children of the current node; nodes are never freed, so the
+ * sampling thread can follow the pointer in the word without locking.
+ *
+ * sample() runs on the sampling thread and counts the current node and
+ * stage of the word, so the cost on the proxy thread doesn't depend on the
+ * sampling rate.
+ */
+class StageProfiler {
+ public:
+  /* Paths beyond this many nodes are counted towards their parent */
+  static constexpr size_t kMaxNodes = 10000;
+
+  struct Entry {
+    /* Route handles from the outermost, mangled type names */
+    std::vector<const char*> routes;
+    ProfileStage stage;
+    uint64_t samples;
+  };
+
+  StageProfiler();
+
+  std::atomic<uintptr_t>& slot() {
+    return slot_;
+  }
+
+  /**
+   * @return word for running route under the path in word current.
+   *         Proxy thread only.
+   */
+  uintptr_t enterRoute(uintptr_t current, const char* route);
+
+  /**
+   * Counts the current word. Sampling thread only.
+   */
+  void sample();
+
+  /**
+   * @return all node and stage pairs with samples. Any thread.
+   */
+  std::vector<Entry> entries() const;
+
+  /**
+   * Name of a stage as printed by entries' users
+   */
+  static const char* stageName(ProfileStage stage);
+
+ private:
+  struct Node {
+    Node(const Node* p, const char* r);
+
+    const Node* const parent;
+    /* nullptr for the root */
+    const char* const route;
+    /* Only accessed on the proxy thread */
+    std::vector<std::pair<const char*, Node*>> children;
+    /* Only incremented by the sampling thread */
+    std::array<std::atomic<uint64_t>, kNumProfileStages> samples;
+  };
+  static_assert(alignof(Node) > kProfileStageMask,
+                "Low bits of a node pointer hold the stage");
+
+  std::atomic<uintptr_t> slot_{0};
+
+  /* Guards growing nodes_; node fields other than children are
+     immutable or atomic */
+  mutable std::mutex nodesMutex_;
+  std::deque<Node> nodes_;
+  Node* root_;
+};
+
+/**
+ * Marks route as the current route handle of the thread's StageProfiler
+ * for the lifetime of this object.
+ */
+class ProfileRouteScope {
+ public:
+  /**
+   * @param profiler  nullptr if the proxy isn't profiled (a no-op)
+   */
+  ProfileRouteScope(StageProfiler* profiler, const char* route);
+  ProfileRouteScope(ProfileRouteScope&& other) noexcept;
+  ~ProfileRouteScope();
+
+  ProfileRouteScope(const ProfileRouteScope&) = delete;
+  ProfileRouteScope& operator=(const ProfileRouteScope&) = delete;
+  ProfileRouteScope& operator=(ProfileRouteScope&&) = delete;
+
+ private:
+  std::atomic<uintptr_t>* slot_{nullptr};
+  uintptr_t prev_{0};
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "StatsDelta.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "mcrouter/stats.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+bool isNumeric(const stat_t& stat) {
+  return stat.type == stat_uint64 || stat.type == stat_int64 ||
+         stat.type == stat_double;
+}
+
+uint64_t rawBits(const stat_t& stat) {
+  uint64_t bits;
+  static_assert(sizeof(stat.data.dbl) == sizeof(bits), "double is not 8 bytes");
+  if (stat.type == stat_double) {
+    memcpy(&bits, &stat.data.dbl, sizeof(bits));
+  } else {
+    bits = stat.data.uint64;
+  }
+  return bits;
+}
+
+}  // anonymous namespace
+
+StatsDelta::StatsDelta(size_t checkpointInterval)
+    : checkpointInterval_(std::max<size_t>(checkpointInterval, 1)) {
+}
+
+bool StatsDelta::update(const std::vector<stat_t>& stats,
+                        std::vector<size_t>& changed) {
+  bool checkpoint = updates_++ % checkpointInterval_ == 0 ||
+                    last_.size() != stats.size();
+  last_.resize(stats.size());
+
+  changed.clear();
+  for (size_t i = 0; i < stats.size(); ++i) {
+    if (!isNumeric(stats[i])) {
+      continue;
+    }
+    auto bits = rawBits(stats[i]);
+    if (checkpoint || bits != last_[i]) {
+      changed.push_back(i);
+      last_[i] = bits;
+    }
+  }
+  return checkpoint;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,50 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+struct stat_t;
+
+/**
+ * Remembers the last logged value of every numeric stat, so that periodic
+ * stats logging only has to report the stats that changed since.
+ *
+ * Every checkpointInterval-th update is a checkpoint that reports all
+ * numeric stats, so a reader can start from any checkpoint and apply the
+ * following deltas.
+ */
+class StatsDelta {
+ public:
+  /**
+   * @param checkpointInterval  0 is the same as 1 (every update is full)
+   */
+  explicit StatsDelta(size_t checkpointInterval);
+
+  /**
+   * @param stats    current values, same layout on every call
+   * @param changed  set to indices of numeric stats that changed since
+   *                 the last update (all of them on checkpoints)
+   * @return true if this update is a checkpoint
+   */
+  bool update(const std::vector<stat_t>& stats, std::vector<size_t>& changed);
+
+ private:
+  const size_t checkpointInterval_;
+  size_t updates_{0};
+  /* Raw bits of the last value of every stat */
+  std::vector<uint64_t> last_;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,202 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "StatsExporter.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <glog/logging.h>
+
+#include <folly/Conv.h>
+#include <folly/ThreadName.h>
+
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/McrouterLogFailure.h"
+#include "mcrouter/stats.h"
+#include "mcrouter/ThreadUtil.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* Scrapers that don't read or write within this time are dropped */
+const int kClientTimeoutSec = 1;
+
+bool writeAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    auto n = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+}  // anonymous namespace
+
+StatsExporter::StatsExporter(McrouterInstance* router)
+    : router_(router),
+      snapshot_(std::make_shared<const std::string>()),
+      pid_(getpid()) {
+}
+
+StatsExporter::~StatsExporter() {
+  stop();
+}
+
+bool StatsExporter::start() {
+  auto port = router_->opts().stats_export_port;
+  if (running_ || port == 0) {
+    return false;
+  }
+
+  listenFd_ = ::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd_ < 0) {
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not create stats export socket: {}", strerror(errno));
+    return false;
+  }
+  int on = 1;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  sockaddr_in6 addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin6_family = AF_INET6;
+  addr.sin6_addr = in6addr_any;
+  addr.sin6_port = htons(port);
+  if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr),
+             sizeof(addr)) != 0 ||
+      ::listen(listenFd_, SOMAXCONN) != 0) {
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not listen on stats export port {}: {}",
+               port, strerror(errno));
+    ::close(listenFd_);
+    listenFd_ = -1;
+    return false;
+  }
+
+  refresh();
+
+  running_ = true;
+  try {
+    refreshThread_ = std::thread(
+      std::bind(&StatsExporter::refreshThreadRun, this));
+    folly::setThreadName(refreshThread_.native_handle(), "mcrtr-stats-exp");
+    setThreadAffinity(refreshThread_.native_handle(), router_->threadCpus());
+    listenThread_ = std::thread(
+      std::bind(&StatsExporter::listenThreadRun, this));
+    folly::setThreadName(listenThread_.native_handle(), "mcrtr-stats-http");
+    setThreadAffinity(listenThread_.native_handle(), router_->threadCpus());
+  } catch (const std::system_error& e) {
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not start StatsExporter threads: {}", e.what());
+    stop();
+  }
+
+  return running_;
+}
+
+void StatsExporter::stop() {
+  if (listenFd_ < 0) {
+    return;
+  }
+
+  {
+    /* Under the mutex, so the refresher can't miss the notification
+       between checking running_ and waiting */
+    std::lock_guard<std::mutex> lock(refreshMutex_);
+    running_ = false;
+    refreshCv_.notify_all();
+  }
+  /* Wakes up the listener if it's blocked in accept() */
+  ::shutdown(listenFd_, SHUT_RDWR);
+  for (auto t : { &refreshThread_, &listenThread_ }) {
+    if (t->joinable()) {
+      if (getpid() == pid_) {
+        t->join();
+      } else {
+        t->detach();
+      }
+    }
+  }
+  ::close(listenFd_);
+  listenFd_ = -1;
+}
+
+void StatsExporter::refresh() {
+  snapshot_.set(
+    std::make_shared<const std::string>(stats_openmetrics(router_)));
+}
+
+void StatsExporter::refreshThreadRun() {
+  while (running_) {
+    {
+      std::unique_lock<std::mutex> lock(refreshMutex_);
+      refreshCv_.wait_for(
+        lock,
+        std::chrono::milliseconds(router_->opts().stats_export_interval_ms),
+        [this]() { return !running_; });
+    }
+    if (running_) {
+      refresh();
+    }
+  }
+}
+
+void StatsExporter::listenThreadRun() {
+  while (running_) {
+    int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EINTR && errno != ECONNABORTED && running_) {
+        LOG(ERROR) << "Stats export accept failed: " << strerror(errno);
+        /* Don't spin if we're out of file descriptors */
+        usleep(100000);
+      }
+      continue;
+    }
+    serve(fd);
+    ::close(fd);
+  }
+}
+
+void StatsExporter::serve(int fd) {
+  timeval tv{kClientTimeoutSec, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  /* The request itself doesn't matter, but the scraper must see it read */
+  char request[4096];
+  if (::recv(fd, request, sizeof(request), 0) <= 0) {
+    return;
+  }
+
+  auto body = snapshot();
+  auto header = folly::to<std::string>(
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: application/openmetrics-text; version=1.0.0; "
+    "charset=utf-8\r\n"
+    "Content-Length: ", body->size(), "\r\n"
+    "Connection: close\r\n\r\n");
+  if (writeAll(fd, header.data(), header.size())) {
+    writeAll(fd, body->data(), body->size());
+  }
+}
+
+}}}  // facebook::memcache::mcrouter
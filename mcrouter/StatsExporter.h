@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "mcrouter/lib/fbi/cpp/AtomicSharedPtr.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class McrouterInstance;
+
+/**
+ * Serves stats to scrapers without going through the proxies.
+ *
+ * A refresher thread renders all stats in OpenMetrics text format (see
+ * stats_openmetrics()) every opts.stats_export_interval_ms. A listener
+ * thread answers every connection on opts.stats_export_port with the last
+ * snapshot as an HTTP/1.0 response, regardless of the request path.
+ * Scrapes only copy a string, so monitoring load doesn't depend on the
+ * number of stats and never reaches request handling.
+ */
+class StatsExporter {
+ public:
+  explicit StatsExporter(McrouterInstance* router);
+
+  ~StatsExporter();
+
+  /**
+   * Binds the port and starts both threads.
+   *
+   * @return false if the exporter is disabled or couldn't start (logged)
+   */
+  bool start();
+
+  /**
+   * Stops and joins both threads. Blocking.
+   */
+  void stop();
+
+  /**
+   * @return last rendered snapshot, empty before the first refresh
+   */
+  std::shared_ptr<const std::string> snapshot() {
+    return snapshot_.get();
+  }
+
+  /**
+   * Renders a new snapshot now.
+   */
+  void refresh();
+
+ private:
+  McrouterInstance* router_;
+  AtomicSharedPtr<std::string> snapshot_;
+
+  int listenFd_{-1};
+  pid_t pid_;
+  std::atomic<bool> running_{false};
+  std::thread refreshThread_;
+  std::thread listenThread_;
+  std::mutex refreshMutex_;
+  std::condition_variable refreshCv_;
+
+  void refreshThreadRun();
+  void listenThreadRun();
+  void serve(int fd);
+};
+
+}}}  // facebook::memcache::mcrouter
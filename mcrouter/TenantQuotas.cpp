@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "TenantQuotas.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include <folly/Conv.h>
+#include <folly/Memory.h>
+#include <folly/String.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+template <class T>
+T parseLimit(folly::StringPiece str, folly::StringPiece entry) {
+  try {
+    return folly::to<T>(str);
+  } catch (const std::exception& e) {
+    throw std::invalid_argument("invalid quota '" + str.str() + "' in '" +
+                                entry.str() + "'");
+  }
+}
+
+/* Splits off the part after the last ':' */
+folly::StringPiece popField(folly::StringPiece& rest,
+                            folly::StringPiece entry) {
+  auto pos = rest.rfind(':');
+  if (pos == folly::StringPiece::npos) {
+    throw std::invalid_argument(
+      "expected prefix:requests_per_sec:bytes_per_sec:max_inflight, got '" +
+      entry.str() + "'");
+  }
+  auto field = rest.subpiece(pos + 1);
+  rest = rest.subpiece(0, pos);
+  return field;
+}
+
+}  // anonymous namespace
+
+TenantQuotas::TenantQuotas(folly::StringPiece spec) {
+  std::vector<folly::StringPiece> entries;
+  folly::split(',', spec, entries, /* ignoreEmpty */ true);
+
+  std::vector<std::pair<std::string, size_t>> items;
+  for (auto entry : entries) {
+    /* the prefix itself may contain ':' */
+    auto rest = entry;
+    auto maxInflight = popField(rest, entry);
+    auto bytesPerSec = popField(rest, entry);
+    auto requestsPerSec = popField(rest, entry);
+    if (rest.empty()) {
+      throw std::invalid_argument("empty tenant prefix in '" + entry.str() +
+                                  "'");
+    }
+
+    auto tenant = folly::make_unique<Tenant>();
+    tenant->prefix = rest.str();
+    tenant->requestsPerSec = parseLimit<double>(requestsPerSec, entry);
+    tenant->bytesPerSec = parseLimit<double>(bytesPerSec, entry);
+    tenant->maxInflight = parseLimit<size_t>(maxInflight, entry);
+    if (tenant->requestsPerSec < 0 || tenant->bytesPerSec < 0) {
+      throw std::invalid_argument("negative quota in '" + entry.str() + "'");
+    }
+    items.emplace_back(tenant->prefix, tenants_.size());
+    tenants_.push_back(std::move(tenant));
+  }
+  index_ = PrefixMap<size_t>(std::move(items));
+}
+
+TenantQuotas::Verdict TenantQuotas::admit(Tenant& tenant, size_t bytes) {
+  if (tenant.maxInflight != 0 && ++tenant.inflight > tenant.maxInflight) {
+    --tenant.inflight;
+    ++tenant.overInflight;
+    return Verdict::kOverInflight;
+  }
+
+  auto now = DynamicAtomicTokenBucket::defaultClockNow();
+  auto verdict = Verdict::kAdmitted;
+  if (tenant.requestsPerSec > 0 &&
+      !tenant.requests.consume(1, tenant.requestsPerSec,
+                               std::max(tenant.requestsPerSec, 1.0), now)) {
+    ++tenant.overRequests;
+    verdict = Verdict::kOverRequests;
+  } else if (tenant.bytesPerSec > 0) {
+    auto burst = std::max(tenant.bytesPerSec, 1.0);
+    /* Requests bigger than the burst would never fit, they take the whole
+       bucket instead */
+    if (!tenant.bytes.consume(std::min<double>(bytes, burst),
+                              tenant.bytesPerSec, burst, now)) {
+      ++tenant.overBytes;
+      verdict = Verdict::kOverBytes;
+    }
+  }
+
+  if (verdict != Verdict::kAdmitted) {
+    release(tenant);
+    return verdict;
+  }
+  ++tenant.admitted;
+  return verdict;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/Range.h>
+
+#include "mcrouter/AtomicTokenBucket.h"
+#include "mcrouter/lib/fbi/cpp/PrefixMap.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Throughput quotas of tenants sharing a router (see --proxy-tenant-quotas),
+ * shared by all of its proxies.
+ *
+ * Tenants are told apart by the longest configured prefix of the key
+ * (including the routing prefix). Keys without a matching prefix have no
+ * quota.
+ */
+class TenantQuotas {
+ public:
+  enum class Verdict {
+    kAdmitted,
+    kOverRequests,
+    kOverBytes,
+    kOverInflight,
+  };
+
+  struct Tenant {
+    std::string prefix;
+    /* Limits, 0 means unlimited */
+    double requestsPerSec{0};
+    double bytesPerSec{0};
+    size_t maxInflight{0};
+
+    /* Allow bursts of up to a second worth of the rates */
+    DynamicAtomicTokenBucket requests;
+    DynamicAtomicTokenBucket bytes;
+    std::atomic<size_t> inflight{0};
+
+    std::atomic<uint64_t> admitted{0};
+    std::atomic<uint64_t> overRequests{0};
+    std::atomic<uint64_t> overBytes{0};
+    std::atomic<uint64_t> overInflight{0};
+  };
+
+  /**
+   * @param spec  comma separated list of
+   *              "prefix:requests_per_sec:bytes_per_sec:max_inflight",
+   *              0 means unlimited, e.g. "/region/batch/:5000:0:200".
+   * @throws std::invalid_argument on invalid spec
+   */
+  explicit TenantQuotas(folly::StringPiece spec);
+
+  /**
+   * @return tenant the key belongs to, nullptr if it has no quota
+   */
+  Tenant* tenantOf(folly::StringPiece key) const {
+    auto index = index_.findPrefix(key);
+    return index ? tenants_[*index].get() : nullptr;
+  }
+
+  /**
+   * Charges a request of `bytes' (key and value) to the tenant.
+   * Once admitted, the request counts as inflight until release().
+   */
+  static Verdict admit(Tenant& tenant, size_t bytes);
+
+  static void release(Tenant& tenant) {
+    if (tenant.maxInflight != 0) {
+      --tenant.inflight;
+    }
+  }
+
+  const std::vector<std::unique_ptr<Tenant>>& tenants() const {
+    return tenants_;
+  }
+
+ private:
+  std::vector<std::unique_ptr<Tenant>> tenants_;
+  /* Indexes into tenants_ */
+  PrefixMap<size_t> index_;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -9,17 +9,66 @@
  */
 #include "ThreadUtil.h"
 
+#include <sched.h>
 #include <sys/capability.h>
 #include <sys/resource.h>
 #include <sys/time.h>
 
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
 #include <folly/Format.h>
+#include <folly/String.h>
 #include <folly/ThreadName.h>
 
 #include "mcrouter/options.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+namespace {
+
+cpu_set_t toCpuSet(const std::vector<int>& cpus) {
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (auto cpu : cpus) {
+    CPU_SET(cpu, &cpuSet);
+  }
+  return cpuSet;
+}
+
+std::string readSysFile(const std::string& path) {
+  std::string contents;
+  if (!folly::readFile(path.c_str(), contents)) {
+    throw std::runtime_error("Can not read " + path);
+  }
+  return folly::trimWhitespace(contents).str();
+}
+
+/**
+ * @return first CPU of every physical core among given CPUs
+ */
+std::vector<int> onePerCore(const std::vector<int>& cpus) {
+  std::set<std::pair<int, int>> seenCores;
+  std::vector<int> result;
+  for (auto cpu : cpus) {
+    auto topology = folly::sformat("/sys/devices/system/cpu/cpu{}/topology/",
+                                   cpu);
+    auto package = folly::to<int>(readSysFile(topology +
+                                              "physical_package_id"));
+    auto core = folly::to<int>(readSysFile(topology + "core_id"));
+    if (seenCores.emplace(package, core).second) {
+      result.push_back(cpu);
+    }
+  }
+  return result;
+}
+
+}  // anonymous namespace
+
 void mcrouterSetThreadName(pthread_t tid,
                            const McrouterOptions& opts,
                            folly::StringPiece prefix) {
@@ -30,7 +79,8 @@ void mcrouterSetThreadName(pthread_t tid,
 }
 
 bool spawnThread(pthread_t* thread_handle, void** stack,
-                 void* (thread_run)(void*), void* arg, int realtime) {
+                 void* (thread_run)(void*), void* arg, int realtime,
+                 const std::vector<int>& cpus) {
   /* Default thread stack size if RLIMIT_STACK is unlimited */
   static constexpr size_t DEFAULT_STACK_SIZE = 8192 * 1024;
 
@@ -58,6 +108,13 @@ bool spawnThread(pthread_t* thread_handle, void** stack,
     cap_free(cap_p);
   }
 
+  if (!cpus.empty()) {
+    auto cpuSet = toCpuSet(cpus);
+    if (pthread_attr_setaffinity_np(&attr, sizeof(cpuSet), &cpuSet) != 0) {
+      LOG(WARNING) << "Unable to set thread affinity";
+    }
+  }
+
   int rc = pthread_create(thread_handle, &attr, thread_run, arg);
   pthread_attr_destroy(&attr);
 
@@ -70,4 +127,66 @@ bool spawnThread(pthread_t* thread_handle, void** stack,
   return true;
 }
 
+bool setThreadAffinity(pthread_t tid, const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return true;
+  }
+  auto cpuSet = toCpuSet(cpus);
+  if (pthread_setaffinity_np(tid, sizeof(cpuSet), &cpuSet) != 0) {
+    LOG(WARNING) << "Unable to set thread affinity";
+    return false;
+  }
+  return true;
+}
+
+std::vector<int> parseCpuList(folly::StringPiece list) {
+  std::vector<folly::StringPiece> ranges;
+  folly::split(',', folly::trimWhitespace(list), ranges);
+  std::vector<int> cpus;
+  for (auto range : ranges) {
+    range = folly::trimWhitespace(range);
+    if (range.empty()) {
+      continue;
+    }
+    try {
+      auto dash = range.find('-');
+      auto from = folly::to<int>(range.subpiece(0, dash));
+      auto to = dash == folly::StringPiece::npos
+        ? from : folly::to<int>(range.subpiece(dash + 1));
+      if (from < 0 || to < from || to >= CPU_SETSIZE) {
+        throw std::invalid_argument("invalid range");
+      }
+      for (auto cpu = from; cpu <= to; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    } catch (const std::exception& e) {
+      throw std::invalid_argument("Invalid CPU list '" + list.str() + "': " +
+                                  e.what());
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+std::vector<int> getThreadAffinityCpus(const McrouterOptions& opts) {
+  folly::StringPiece affinity(opts.thread_affinity);
+  if (!affinity.removePrefix("nic:")) {
+    return parseCpuList(affinity);
+  }
+
+  auto node = folly::to<int>(readSysFile(
+    folly::sformat("/sys/class/net/{}/device/numa_node", affinity)));
+  // -1 if the device is not attached to a particular node
+  auto cpuList = node < 0
+    ? readSysFile("/sys/devices/system/cpu/online")
+    : readSysFile(folly::sformat("/sys/devices/system/node/node{}/cpulist",
+                                 node));
+  auto cpus = onePerCore(parseCpuList(cpuList));
+  if (cpus.empty()) {
+    throw std::runtime_error("No CPUs found for " + opts.thread_affinity);
+  }
+  return cpus;
+}
+
 }}} // facebook::memcache::mcrouter
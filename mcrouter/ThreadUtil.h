@@ -11,6 +11,8 @@
 
 #include <pthread.h>
 
+#include <vector>
+
 #include <folly/Range.h>
 
 namespace facebook { namespace memcache {
@@ -21,9 +23,36 @@ namespace mcrouter {
 
 /*
  * Utility functions for launching threads and setting thread names.
+ *
+ * @param cpus  if not empty, the thread is restricted to these CPUs
  */
 bool spawnThread(pthread_t* thread_handle, void** stack,
-                 void* (thread_run)(void*), void* arg, int realtime);
+                 void* (thread_run)(void*), void* arg, int realtime,
+                 const std::vector<int>& cpus = std::vector<int>());
+
+/**
+ * Restricts the thread to given CPUs, noop if cpus is empty.
+ *
+ * @return true on success
+ */
+bool setThreadAffinity(pthread_t tid, const std::vector<int>& cpus);
+
+/**
+ * Parses CPU list in /sys/devices/system/cpu format, e.g. "0-3,8,10-11".
+ *
+ * @throws std::invalid_argument if the list is malformed
+ */
+std::vector<int> parseCpuList(folly::StringPiece list);
+
+/**
+ * CPUs for mcrouter threads according to --thread-affinity:
+ * either an explicit CPU list, or "nic:<interface>" for one CPU per
+ * physical core of the NUMA node the network interface is attached to.
+ *
+ * @return CPUs sorted by id, empty if affinity is not set
+ * @throws std::runtime_error if CPUs can't be determined
+ */
+std::vector<int> getThreadAffinityCpus(const McrouterOptions& opts);
 
 void mcrouterSetThreadName(pthread_t tid,
                            const McrouterOptions& opts,
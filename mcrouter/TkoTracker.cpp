@@ -13,6 +13,7 @@
 
 #include <glog/logging.h>
 
+#include "mcrouter/lib/RouteHandleLiveness.h"
 #include "mcrouter/ProxyDestination.h"
 #include "mcrouter/TkoCounters.h"
 
@@ -20,10 +21,12 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 TkoTracker::TkoTracker(size_t tkoThreshold,
                        size_t maxSoftTkos,
-                       TkoCounters& globalTkoCounters)
+                       TkoCounters& globalTkoCounters,
+                       SharedTkoTable::Entry sharedEntry)
   : tkoThreshold_(tkoThreshold),
     maxSoftTkos_(maxSoftTkos),
-    globalTkos_(globalTkoCounters) {
+    globalTkos_(globalTkoCounters),
+    sharedEntry_(sharedEntry) {
   }
 
 bool TkoTracker::isHardTko() const {
@@ -112,7 +115,14 @@ bool TkoTracker::recordSoftFailure(ProxyDestination* pdstn) {
       }
     }
   } while (!sumFailures_.compare_exchange_weak(curSumFailures, value));
-  return value == pdstnAddr;
+  if (value != pdstnAddr) {
+    return false;
+  }
+  bumpRouteLivenessEpoch();
+  if (sharedEntry_) {
+    sharedEntry_.mark(false);
+  }
+  return true;
 }
 
 bool TkoTracker::recordHardFailure(ProxyDestination* pdstn) {
@@ -129,6 +139,9 @@ bool TkoTracker::recordHardFailure(ProxyDestination* pdstn) {
     sumFailures_ |= 1;
     decrementSoftTkoCount();
     ++globalTkos_.hardTkos;
+    if (sharedEntry_) {
+      sharedEntry_.mark(true);
+    }
     /* We've already been marked responsible */
     return false;
   }
@@ -136,7 +149,11 @@ bool TkoTracker::recordHardFailure(ProxyDestination* pdstn) {
   // If the call below succeeds we marked the box TKO and took responsibility.
   bool success = setSumFailures(reinterpret_cast<uintptr_t>(pdstn) | 1);
   if (success) {
+    bumpRouteLivenessEpoch();
     ++globalTkos_.hardTkos;
+    if (sharedEntry_) {
+      sharedEntry_.mark(true);
+    }
   }
   return success;
 }
@@ -156,7 +173,11 @@ void TkoTracker::recordSuccess(ProxyDestination* pdstn) {
     if (isHardTko()) {
       --globalTkos_.hardTkos;
     }
+    if (sharedEntry_) {
+      sharedEntry_.unmark();
+    }
     sumFailures_ = 0;
+    bumpRouteLivenessEpoch();
   } else {
     setSumFailures(0);
   }
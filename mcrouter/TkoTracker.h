@@ -12,6 +12,8 @@
 #include <atomic>
 #include <mutex>
 
+#include "mcrouter/SharedTkoTable.h"
+
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class ProxyDestination;
@@ -39,6 +41,10 @@ class TkoCounters;
  * proxy (the one sending probes) can change its TKO state. Once we are in TKO
  * the responsible thread effectively has a mutex over all state in TkoTracker,
  * and so races aren't possible.
+ *
+ * With a SharedTkoTable entry, TKOs are also published to other mcrouter
+ * processes on the host, and isTkoElsewhere() tells if another process
+ * has the destination marked TKO (and is responsible for probing it).
  */
 class TkoTracker {
  public:
@@ -48,10 +54,13 @@ class TkoTracker {
    * @param maxSoftTkos the maximum number of concurrent soft TKOs allowed in
    *        the router
    * @param globalTkoStats number of TKO destination for current router
+   * @param sharedEntry entry of the destination in the shared TKO table,
+   *        empty if TKOs aren't shared with other processes
    */
   TkoTracker(size_t tkoThreshold,
              size_t maxSoftTkos,
-             TkoCounters& globalTkoCounters);
+             TkoCounters& globalTkoCounters,
+             SharedTkoTable::Entry sharedEntry = SharedTkoTable::Entry());
 
   /**
    * @return Is the destination currently marked Hard TKO?
@@ -70,6 +79,13 @@ class TkoTracker {
     return sumFailures_ > tkoThreshold_;
   }
 
+  /**
+   * @return Is the destination marked TKO by another mcrouter process?
+   */
+  bool isTkoElsewhere() const {
+    return sharedEntry_ && sharedEntry_.markedElsewhere();
+  }
+
   /**
    * @return current number of consecutive failures.
    *         This is basically a number of recordHardFailure/recordSoftFailure
@@ -135,6 +151,7 @@ class TkoTracker {
   const size_t tkoThreshold_;
   const size_t maxSoftTkos_;
   TkoCounters& globalTkos_;
+  const SharedTkoTable::Entry sharedEntry_;
   /* sumFailures_ is used for a few things depending on the state of the
      destination. For a destination that is not TKO, it tracks the number of
      consecutive soft failures to a destination.
@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "TraceExporter.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <glog/logging.h>
+
+#include <folly/dynamic.h>
+#include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/json.h>
+#include <folly/Memory.h>
+#include <folly/ThreadName.h>
+
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/McrouterLogFailure.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/stats.h"
+#include "mcrouter/ThreadUtil.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+FileSpanSink::FileSpanSink(McrouterInstance* router, std::string path)
+    : router_(router),
+      path_(std::move(path)) {
+  fd_ = folly::openNoInt(path_.c_str(),
+                         O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0664);
+  if (fd_ < 0) {
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not open trace export file {}: {}",
+               path_, strerror(errno));
+  }
+}
+
+FileSpanSink::~FileSpanSink() {
+  if (fd_ >= 0) {
+    folly::closeNoInt(fd_);
+  }
+}
+
+void FileSpanSink::write(size_t proxyId, const std::vector<Span>& spans) {
+  if (fd_ < 0) {
+    return;
+  }
+
+  std::string out;
+  for (const auto& span : spans) {
+    auto name = span.kind == SpanKind::kRoute
+      ? shortRouteName(span.name)
+      : std::string(span.name ? span.name : "");
+    folly::dynamic line = folly::dynamic::object
+      ("trace_id", folly::sformat("{:016x}", span.traceId))
+      ("proxy", proxyId)
+      ("kind", spanKindName(span.kind))
+      ("name", name)
+      ("detail", span.detail)
+      ("start_us", span.startUs)
+      ("duration_us", span.endUs - span.startUs);
+    out.append(folly::toJson(line).toStdString());
+    out.push_back('\n');
+  }
+
+  auto written = folly::writeFull(fd_, out.data(), out.size());
+  if (written < 0 || size_t(written) < out.size()) {
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Error writing spans to {}: {}", path_, strerror(errno));
+  }
+}
+
+TraceExporter::TraceExporter(McrouterInstance* router)
+    : router_(router),
+      pid_(getpid()) {
+}
+
+TraceExporter::~TraceExporter() {
+  stop();
+}
+
+void TraceExporter::setSink(std::unique_ptr<SpanSinkIf> sink) {
+  std::lock_guard<std::mutex> lock(sinkMutex_);
+  sink_ = std::move(sink);
+}
+
+bool TraceExporter::start() {
+  const auto& opts = router_->opts();
+  if (running_ || opts.trace_sample_rate == 0) {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sinkMutex_);
+    if (!sink_ && !opts.trace_export_file.empty()) {
+      sink_ = folly::make_unique<FileSpanSink>(router_,
+                                               opts.trace_export_file);
+    }
+  }
+
+  running_ = true;
+  try {
+    thread_ = std::thread(std::bind(&TraceExporter::threadRun, this));
+    folly::setThreadName(thread_.native_handle(), "mcrtr-trace-exp");
+    setThreadAffinity(thread_.native_handle(), router_->threadCpus());
+  } catch (const std::system_error& e) {
+    running_ = false;
+    logFailure(router_, memcache::failure::Category::kSystemError,
+               "Can not start TraceExporter thread: {}", e.what());
+  }
+
+  return running_;
+}
+
+void TraceExporter::stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+
+  running_ = false;
+  threadCv_.notify_all();
+  if (getpid() == pid_) {
+    thread_.join();
+    exportSpans();
+  } else {
+    thread_.detach();
+  }
+}
+
+void TraceExporter::exportSpans() {
+  std::lock_guard<std::mutex> lock(sinkMutex_);
+  uint64_t dropped = 0;
+  for (size_t i = 0; i < router_->numProxies(); ++i) {
+    auto proxy = router_->getProxy(i);
+    if (!proxy || !proxy->tracer) {
+      continue;
+    }
+    auto& tracer = proxy->tracer;
+    dropped += tracer->ring().dropped();
+
+    buffer_.clear();
+    /* Without a sink spans are still drained, so the rings don't fill up */
+    if (tracer->ring().drain(buffer_) != 0 && sink_) {
+      sink_->write(i, buffer_);
+    }
+  }
+
+  if (dropped > dropped_) {
+    LOG(WARNING) << "Dropped " << dropped - dropped_ << " trace spans, "
+                 << "the exporter doesn't keep up with --trace-sample-rate "
+                 << "(increase --trace-ring-size)";
+    dropped_ = dropped;
+  }
+}
+
+void TraceExporter::threadRun() {
+  while (running_) {
+    {
+      std::unique_lock<std::mutex> lock(threadMutex_);
+      threadCv_.wait_for(
+        lock,
+        std::chrono::milliseconds(router_->opts().trace_export_interval_ms),
+        [this]() { return !running_; });
+    }
+    if (running_) {
+      exportSpans();
+    }
+  }
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mcrouter/RequestTracer.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+class McrouterInstance;
+
+/**
+ * Destination of exported spans.
+ */
+class SpanSinkIf {
+ public:
+  /**
+   * Called from the exporter thread with the spans collected from one
+   * proxy since the last call. Spans of a trace are in order of completion.
+   */
+  virtual void write(size_t proxyId, const std::vector<Span>& spans) = 0;
+
+  virtual ~SpanSinkIf() {}
+};
+
+/**
+ * Appends spans to a file, one JSON object per line:
+ *   {"trace_id":"<hex>","proxy":0,"kind":"route","name":"AllSyncRoute",
+ *    "detail":"","start_us":...,"duration_us":...}
+ */
+class FileSpanSink : public SpanSinkIf {
+ public:
+  explicit FileSpanSink(McrouterInstance* router, std::string path);
+  ~FileSpanSink();
+
+  void write(size_t proxyId, const std::vector<Span>& spans) override;
+
+ private:
+  McrouterInstance* router_;
+  const std::string path_;
+  int fd_{-1};
+};
+
+/**
+ * Drains the span rings of all proxies (see RequestTracer) every
+ * opts.trace_export_interval_ms and hands the spans to a sink, so that
+ * tracing never blocks or formats anything on proxy threads.
+ *
+ * The sink is a FileSpanSink for opts.trace_export_file unless one was
+ * set with setSink().
+ */
+class TraceExporter {
+ public:
+  explicit TraceExporter(McrouterInstance* router);
+
+  ~TraceExporter();
+
+  /**
+   * Replaces the sink, can be called at any time.
+   */
+  void setSink(std::unique_ptr<SpanSinkIf> sink);
+
+  /**
+   * Starts the exporter thread.
+   *
+   * @return false if tracing is disabled or the thread couldn't start
+   */
+  bool start();
+
+  /**
+   * Exports remaining spans, stops and joins the thread. Blocking.
+   */
+  void stop();
+
+  /**
+   * Drains all proxies into the sink now.
+   */
+  void exportSpans();
+
+ private:
+  McrouterInstance* router_;
+
+  std::mutex sinkMutex_;
+  std::unique_ptr<SpanSinkIf> sink_;
+  std::vector<Span> buffer_;
+  uint64_t dropped_{0};
+
+  pid_t pid_;
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+  std::mutex threadMutex_;
+  std::condition_variable threadCv_;
+
+  void threadRun();
+};
+
+}}}  // facebook::memcache::mcrouter
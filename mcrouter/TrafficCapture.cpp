@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "TrafficCapture.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include <folly/Conv.h>
+#include <folly/SpookyHashV2.h>
+
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/TrafficCaptureFormat.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+constexpr size_t TrafficCapture::kNumSegments;
+constexpr size_t TrafficCapture::kMinSegmentSize;
+
+TrafficCapture::TrafficCapture(const std::string& path, size_t maxBytes,
+                               size_t sampleRate)
+    : segmentSize_(std::max(kMinSegmentSize,
+                            (maxBytes + kNumSegments - 1) / kNumSegments)),
+      sampleRate_(std::max<size_t>(1, sampleRate)) {
+  auto fileSize = segmentSize_ * kNumSegments;
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error(folly::to<std::string>(
+      "can't open traffic capture file ", path, ": ", strerror(errno)));
+  }
+  if (ftruncate(fd_, fileSize) != 0) {
+    auto err = errno;
+    close(fd_);
+    throw std::runtime_error(folly::to<std::string>(
+      "can't size traffic capture file ", path, ": ", strerror(err)));
+  }
+  auto data = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd_, 0);
+  if (data == MAP_FAILED) {
+    auto err = errno;
+    close(fd_);
+    throw std::runtime_error(folly::to<std::string>(
+      "can't map traffic capture file ", path, ": ", strerror(err)));
+  }
+  data_ = static_cast<char*>(data);
+  buffer_.reserve(TrafficCaptureFormat::kMaxRecordSize);
+  TrafficCaptureFormat::writeSegmentHeader(data_, seq_, 0);
+}
+
+TrafficCapture::~TrafficCapture() {
+  munmap(data_, segmentSize_ * kNumSegments);
+  close(fd_);
+}
+
+void TrafficCapture::add(const McMsgRef& msg) {
+  if (sampleRate_ > 1 &&
+      folly::hash::SpookyHashV2::Hash64(msg->key.str, msg->key.len, 0) %
+      sampleRate_ != 0) {
+    return;
+  }
+
+  McRequest req(msg.clone());
+  TrafficCaptureRecord record;
+  record.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  record.op = msg->op;
+  record.valueSize = msg->value.len;
+  record.flags = msg->flags;
+  record.exptime = msg->exptime;
+  record.routingPrefix = req.routingPrefix();
+  record.key = req.keyWithoutRoute();
+
+  buffer_.clear();
+  TrafficCaptureFormat::appendRecord(buffer_, record);
+  if (TrafficCaptureFormat::kSegmentHeaderSize + used_ + buffer_.size() >
+      segmentSize_) {
+    nextSegment();
+  }
+  auto segment = data_ + segment_ * segmentSize_;
+  std::memcpy(segment + TrafficCaptureFormat::kSegmentHeaderSize + used_,
+              buffer_.data(), buffer_.size());
+  used_ += buffer_.size();
+  /* Only now is the record covered by the header */
+  TrafficCaptureFormat::writeSegmentHeader(segment, seq_, used_);
+  ++records_;
+}
+
+void TrafficCapture::nextSegment() {
+  segment_ = (segment_ + 1) % kNumSegments;
+  ++seq_;
+  used_ = 0;
+  TrafficCaptureFormat::writeSegmentHeader(data_ + segment_ * segmentSize_,
+                                           seq_, 0);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "mcrouter/lib/McMsgRef.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Sampled capture of the requests a proxy receives (see
+ * --traffic-capture-file), for replay with mcrouter_traffic_replay.
+ *
+ * Requests are sampled by key, so the captured stream of a sampled key is
+ * complete. Records (see TrafficCaptureFormat) go to a file of fixed size
+ * that is mapped into memory and used as a ring of segments: once all
+ * segments are full, the oldest one is overwritten. Adding a record costs
+ * a memcpy and no system calls; the kernel writes the pages back.
+ *
+ * Not thread safe, each proxy has its own file.
+ */
+class TrafficCapture {
+ public:
+  static constexpr size_t kNumSegments = 16;
+  static constexpr size_t kMinSegmentSize = 64 * 1024;
+
+  /**
+   * Creates (or truncates) the file at path.
+   *
+   * @param maxBytes  size of the file, rounded up to kNumSegments segments
+   *                  of at least kMinSegmentSize
+   * @param sampleRate  capture one of every sampleRate keys
+   * @throws std::runtime_error if the file can't be created
+   */
+  TrafficCapture(const std::string& path, size_t maxBytes, size_t sampleRate);
+
+  ~TrafficCapture();
+
+  TrafficCapture(const TrafficCapture&) = delete;
+  TrafficCapture& operator=(const TrafficCapture&) = delete;
+
+  /**
+   * Captures the request if its key is sampled.
+   */
+  void add(const McMsgRef& req);
+
+  /**
+   * @return number of records written so far (including overwritten ones)
+   */
+  uint64_t records() const {
+    return records_;
+  }
+
+ private:
+  int fd_{-1};
+  char* data_{nullptr};
+  size_t segmentSize_{0};
+  size_t sampleRate_;
+
+  /* Segment being filled, and its sequence number */
+  size_t segment_{0};
+  uint64_t seq_{1};
+  size_t used_{0};
+
+  uint64_t records_{0};
+  std::string buffer_;
+
+  void nextSegment();
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,141 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "TrafficCaptureFormat.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <folly/Bits.h>
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* Keys and routing prefixes are truncated to this */
+const size_t kMaxStringSize = 255;
+
+template <class T>
+void appendInt(std::string& out, T value) {
+  value = folly::Endian::little(value);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendString(std::string& out, folly::StringPiece str) {
+  auto size = std::min(str.size(), kMaxStringSize);
+  appendInt<uint16_t>(out, size);
+  out.append(str.data(), size);
+}
+
+template <class T>
+void writeInt(char* out, T value) {
+  value = folly::Endian::little(value);
+  std::memcpy(out, &value, sizeof(value));
+}
+
+template <class T>
+T parseInt(folly::StringPiece& data) {
+  if (data.size() < sizeof(T)) {
+    throw std::runtime_error("traffic capture record is truncated");
+  }
+  T value;
+  std::memcpy(&value, data.data(), sizeof(T));
+  data.advance(sizeof(T));
+  return folly::Endian::little(value);
+}
+
+folly::StringPiece parseString(folly::StringPiece& data) {
+  auto size = parseInt<uint16_t>(data);
+  if (data.size() < size) {
+    throw std::runtime_error("traffic capture record is truncated");
+  }
+  auto str = data.subpiece(0, size);
+  data.advance(size);
+  return str;
+}
+
+}  // anonymous namespace
+
+constexpr size_t TrafficCaptureFormat::kMagicSize;
+constexpr size_t TrafficCaptureFormat::kSegmentHeaderSize;
+constexpr size_t TrafficCaptureFormat::kMaxRecordSize;
+const char TrafficCaptureFormat::kSegmentMagic[kMagicSize + 1] = "MCCAPS1\n";
+
+void TrafficCaptureFormat::appendRecord(std::string& out,
+                                        const TrafficCaptureRecord& record) {
+  auto sizePos = out.size();
+  appendInt<uint16_t>(out, 0);
+  appendInt<uint8_t>(out, record.op);
+  appendInt<uint8_t>(out, 0);
+  appendInt<uint32_t>(out, record.valueSize);
+  appendInt<uint64_t>(out, record.flags);
+  appendInt<uint32_t>(out, record.exptime);
+  appendInt<uint64_t>(out, record.timestampUs);
+  appendString(out, record.routingPrefix);
+  appendString(out, record.key);
+
+  writeInt<uint16_t>(&out[sizePos], out.size() - sizePos - sizeof(uint16_t));
+}
+
+void TrafficCaptureFormat::writeSegmentHeader(char* out, uint64_t seq,
+                                              uint32_t used) {
+  std::memcpy(out, kSegmentMagic, kMagicSize);
+  writeInt<uint64_t>(out + kMagicSize, seq);
+  writeInt<uint32_t>(out + kMagicSize + sizeof(uint64_t), used);
+  writeInt<uint32_t>(out + kMagicSize + sizeof(uint64_t) + sizeof(uint32_t),
+                     0);
+}
+
+uint64_t TrafficCaptureFormat::parseSegment(folly::StringPiece segment,
+                                            folly::StringPiece& records) {
+  if (segment.size() < kSegmentHeaderSize ||
+      std::memcmp(segment.data(), kSegmentMagic, kMagicSize) != 0) {
+    return 0;
+  }
+  segment.advance(kMagicSize);
+  auto seq = parseInt<uint64_t>(segment);
+  auto used = parseInt<uint32_t>(segment);
+  parseInt<uint32_t>(segment);
+  if (used > segment.size()) {
+    return 0;
+  }
+  records = segment.subpiece(0, used);
+  return seq;
+}
+
+bool TrafficCaptureFormat::parseRecord(folly::StringPiece& data,
+                                       TrafficCaptureRecord& record) {
+  if (data.empty()) {
+    return false;
+  }
+  auto body = data;
+  auto size = parseInt<uint16_t>(body);
+  if (body.size() < size) {
+    throw std::runtime_error("traffic capture record is truncated");
+  }
+  body = body.subpiece(0, size);
+
+  auto op = parseInt<uint8_t>(body);
+  record.op = op < mc_nops ? static_cast<mc_op_t>(op) : mc_op_unknown;
+  parseInt<uint8_t>(body);
+  record.valueSize = parseInt<uint32_t>(body);
+  record.flags = parseInt<uint64_t>(body);
+  record.exptime = parseInt<uint32_t>(body);
+  record.timestampUs = parseInt<uint64_t>(body);
+  record.routingPrefix = parseString(body);
+  record.key = parseString(body);
+  if (!body.empty()) {
+    throw std::runtime_error("traffic capture record has trailing bytes");
+  }
+  data.advance(sizeof(uint16_t) + size);
+  return true;
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <folly/Range.h>
+
+#include "mcrouter/lib/mc/msg.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * A request captured by TrafficCapture. Values are not captured,
+ * only their size.
+ */
+struct TrafficCaptureRecord {
+  /* Wall clock time the request was received, in microseconds */
+  uint64_t timestampUs{0};
+  mc_op_t op{mc_op_unknown};
+  uint32_t valueSize{0};
+  uint64_t flags{0};
+  uint32_t exptime{0};
+  folly::StringPiece routingPrefix;
+  /* Without the routing prefix */
+  folly::StringPiece key;
+};
+
+/**
+ * Encoding of traffic capture files.
+ *
+ * A file is a ring of fixed size segments, every segment is a header
+ * followed by records; all integers are little endian:
+ *   segment: magic (8 bytes) | u64 sequence number | u32 size of records |
+ *            u32 unused | records
+ *   record:  u16 size of the rest | u8 op | u8 unused | u32 value size |
+ *            u64 flags | u32 exptime | u64 timestamp us |
+ *            u16 size | routing prefix | u16 size | key
+ * Segments are written in sequence number order; a segment with sequence
+ * number 0 is unused. The size of records in the header only covers
+ * complete records.
+ */
+class TrafficCaptureFormat {
+ public:
+  static constexpr size_t kMagicSize = 8;
+  static const char kSegmentMagic[kMagicSize + 1];
+  static constexpr size_t kSegmentHeaderSize = 24;
+
+  /**
+   * Largest encoded record, longer keys and prefixes are truncated.
+   */
+  static constexpr size_t kMaxRecordSize = 2 + 26 + 2 * (2 + 255);
+
+  static void appendRecord(std::string& out,
+                           const TrafficCaptureRecord& record);
+
+  /**
+   * Fills in the header of the segment at out
+   * (kSegmentHeaderSize bytes).
+   */
+  static void writeSegmentHeader(char* out, uint64_t seq, uint32_t used);
+
+  /**
+   * Parses the header of a segment.
+   *
+   * @param records  set to the complete records of the segment
+   * @return sequence number, 0 if the segment is unused or invalid
+   */
+  static uint64_t parseSegment(folly::StringPiece segment,
+                               folly::StringPiece& records);
+
+  /**
+   * Parses a record from the beginning of data, data is advanced past it.
+   * Record fields point into data.
+   *
+   * @return false if data is empty
+   * @throws std::runtime_error if the record is malformed
+   */
+  static bool parseRecord(folly::StringPiece& data,
+                          TrafficCaptureRecord& record);
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,336 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "TrafficReplayer.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/fibers/EventBaseLoopController.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/AsyncMcClient.h"
+#include "mcrouter/TrafficCapture.h"
+#include "mcrouter/TrafficCaptureFormat.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/* Longest synthesized value */
+const size_t kMaxValueSize = 1024 * 1024;
+
+bool replayable(mc_op_t op) {
+  switch (op) {
+    case mc_op_get:
+    case mc_op_gets:
+    case mc_op_metaget:
+    case mc_op_lease_get:
+    case mc_op_set:
+    case mc_op_add:
+    case mc_op_replace:
+    case mc_op_append:
+    case mc_op_prepend:
+    case mc_op_lease_set:
+    case mc_op_delete:
+    case mc_op_incr:
+    case mc_op_decr:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // anonymous namespace
+
+/**
+ * State of one run: the event base, its fiber manager and connections.
+ */
+class TrafficReplayer::Replay {
+ public:
+  Replay(const Options& opts, const std::vector<Request>& requests)
+      : opts_(opts),
+        requests_(requests),
+        fm_(folly::make_unique<EventBaseLoopController>()) {
+    dynamic_cast<EventBaseLoopController&>(fm_.loopController()).
+      attachEventBase(eventBase_);
+    for (size_t i = 0; i < std::max<size_t>(1, opts_.connections); ++i) {
+      ConnectionOptions options(opts_.host, opts_.port, opts_.protocol);
+      options.writeTimeout = opts_.timeout;
+      clients_.push_back(
+        folly::make_unique<AsyncMcClient>(eventBase_, std::move(options)));
+    }
+    uint32_t maxValueSize = 0;
+    for (const auto& req : requests_) {
+      maxValueSize = std::max(maxValueSize, req.valueSize);
+    }
+    value_.assign(std::min<size_t>(maxValueSize, kMaxValueSize), 'v');
+  }
+
+  LoadGenerator::Results run() {
+    start_ = Clock::now();
+    if (!requests_.empty()) {
+      pump();
+      eventBase_.loopForever();
+    }
+    while (fm_.hasTasks()) {
+      eventBase_.loopOnce();
+    }
+
+    LoadGenerator::Results results;
+    for (size_t op = 0; op < mc_nops; ++op) {
+      if (latencyUs_[op].count() != 0) {
+        results.latencyUs[mc_op_to_string(static_cast<mc_op_t>(op))].merge(
+          latencyUs_[op]);
+      }
+    }
+    results.latencyUs["all"] = allLatencyUs_;
+    for (size_t res = 0; res < mc_nres; ++res) {
+      if (resultCounts_[res] != 0) {
+        results.results[mc_res_to_string(static_cast<mc_res_t>(res))] =
+          resultCounts_[res];
+      }
+    }
+    if (skipped_ != 0) {
+      results.results["skipped"] = skipped_;
+    }
+    results.requests = sent_;
+    results.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - start_);
+    return results;
+  }
+
+ private:
+  const Options& opts_;
+  const std::vector<Request>& requests_;
+  /* Must outlive the clients */
+  folly::EventBase eventBase_;
+  FiberManager fm_;
+  std::vector<std::unique_ptr<AsyncMcClient>> clients_;
+  size_t nextClient_{0};
+  /* Values are prefixes of this */
+  std::string value_;
+
+  Clock::time_point start_;
+  size_t next_{0};
+  size_t inFlight_{0};
+  bool pumpScheduled_{false};
+
+  std::array<LatencyHistogram, mc_nops> latencyUs_;
+  LatencyHistogram allLatencyUs_;
+  std::array<uint64_t, mc_nres> resultCounts_{{0}};
+  uint64_t sent_{0};
+  uint64_t skipped_{0};
+
+  Clock::time_point due(const Request& req) const {
+    auto us = (req.timestampUs - requests_.front().timestampUs) /
+      std::max(opts_.speed, 1e-9);
+    return start_ + std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double, std::micro>(us));
+  }
+
+  /**
+   * Starts all requests due by now, as the limit on requests in flight
+   * allows, and schedules itself for the next one.
+   */
+  void pump() {
+    auto now = Clock::now();
+    auto maxInFlight = std::max<size_t>(1, opts_.maxInFlight);
+    while (next_ < requests_.size() && inFlight_ < maxInFlight) {
+      const auto& req = requests_[next_];
+      auto scheduled = due(req);
+      if (scheduled > now) {
+        break;
+      }
+      ++next_;
+      if (!replayable(req.op)) {
+        ++skipped_;
+        continue;
+      }
+      ++inFlight_;
+      auto& client = *clients_[nextClient_++ % clients_.size()];
+      fm_.addTask([this, &client, &req, scheduled]() {
+        sendOne(client, req, scheduled);
+        --inFlight_;
+        pump();
+      });
+    }
+
+    if (next_ == requests_.size()) {
+      if (inFlight_ == 0) {
+        eventBase_.terminateLoopSoon();
+      }
+      return;
+    }
+    if (inFlight_ >= maxInFlight || pumpScheduled_) {
+      /* A completed request calls pump() */
+      return;
+    }
+
+    pumpScheduled_ = true;
+    auto pumpCallback = [this]() {
+      pumpScheduled_ = false;
+      pump();
+    };
+    auto delayMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+      due(requests_[next_]) - now).count();
+    if (delayMs > 1) {
+      eventBase_.runAfterDelay(std::move(pumpCallback), delayMs - 1);
+    } else {
+      /* Spin on the loop for sub-millisecond precision */
+      eventBase_.runInLoop(std::move(pumpCallback));
+    }
+  }
+
+  template <class Operation>
+  void send(AsyncMcClient& client, const McRequest& req, mc_op_t op,
+            Clock::time_point scheduled, Operation) {
+    auto reply = client.sendSync(req, Operation(), opts_.timeout);
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - scheduled).count();
+    latencyUs_[op].insertSample(latency);
+    allLatencyUs_.insertSample(latency);
+    ++resultCounts_[reply.result()];
+    ++sent_;
+  }
+
+  void sendOne(AsyncMcClient& client, const Request& r,
+               Clock::time_point scheduled) {
+    McRequest req(r.key);
+    req.setFlags(r.flags);
+    req.setExptime(r.exptime);
+    if (r.valueSize != 0) {
+      req.setValue(folly::IOBuf(
+        folly::IOBuf::WRAP_BUFFER, value_.data(),
+        std::min<size_t>(r.valueSize, value_.size())));
+    }
+
+    switch (r.op) {
+      case mc_op_get:
+        send(client, req, r.op, scheduled, McOperation<mc_op_get>());
+        break;
+      case mc_op_gets:
+        send(client, req, r.op, scheduled, McOperation<mc_op_gets>());
+        break;
+      case mc_op_metaget:
+        send(client, req, r.op, scheduled, McOperation<mc_op_metaget>());
+        break;
+      case mc_op_lease_get:
+        send(client, req, r.op, scheduled, McOperation<mc_op_lease_get>());
+        break;
+      case mc_op_set:
+      case mc_op_lease_set:
+        send(client, req, r.op, scheduled, McOperation<mc_op_set>());
+        break;
+      case mc_op_add:
+        send(client, req, r.op, scheduled, McOperation<mc_op_add>());
+        break;
+      case mc_op_replace:
+        send(client, req, r.op, scheduled, McOperation<mc_op_replace>());
+        break;
+      case mc_op_append:
+        send(client, req, r.op, scheduled, McOperation<mc_op_append>());
+        break;
+      case mc_op_prepend:
+        send(client, req, r.op, scheduled, McOperation<mc_op_prepend>());
+        break;
+      case mc_op_delete:
+        send(client, req, r.op, scheduled, McOperation<mc_op_delete>());
+        break;
+      case mc_op_incr:
+        req.setDelta(1);
+        send(client, req, r.op, scheduled, McOperation<mc_op_incr>());
+        break;
+      case mc_op_decr:
+        req.setDelta(1);
+        send(client, req, r.op, scheduled, McOperation<mc_op_decr>());
+        break;
+      default:
+        break;
+    }
+  }
+};
+
+std::vector<TrafficReplayer::Request>
+TrafficReplayer::readCapture(const std::string& path) {
+  std::string data;
+  if (!folly::readFile(path.c_str(), data)) {
+    throw std::runtime_error(folly::to<std::string>("can't read ", path));
+  }
+  if (data.empty() || data.size() % TrafficCapture::kNumSegments != 0) {
+    throw std::runtime_error(folly::to<std::string>(
+      path, " is not a traffic capture file"));
+  }
+
+  auto segmentSize = data.size() / TrafficCapture::kNumSegments;
+  std::map<uint64_t, folly::StringPiece> segments;
+  for (size_t i = 0; i < TrafficCapture::kNumSegments; ++i) {
+    folly::StringPiece records;
+    auto seq = TrafficCaptureFormat::parseSegment(
+      folly::StringPiece(data).subpiece(i * segmentSize, segmentSize),
+      records);
+    if (seq != 0) {
+      segments[seq] = records;
+    }
+  }
+
+  std::vector<Request> requests;
+  for (auto& it : segments) {
+    auto records = it.second;
+    TrafficCaptureRecord record;
+    while (TrafficCaptureFormat::parseRecord(records, record)) {
+      Request req;
+      req.timestampUs = record.timestampUs;
+      req.op = record.op;
+      req.valueSize = record.valueSize;
+      req.flags = record.flags;
+      req.exptime = record.exptime;
+      req.key = folly::to<std::string>(record.routingPrefix, record.key);
+      requests.push_back(std::move(req));
+    }
+  }
+  return requests;
+}
+
+TrafficReplayer::TrafficReplayer(Options opts,
+                                 const std::vector<std::string>& files)
+    : opts_(std::move(opts)) {
+  for (const auto& file : files) {
+    auto requests = readCapture(file);
+    requests_.insert(requests_.end(),
+                     std::make_move_iterator(requests.begin()),
+                     std::make_move_iterator(requests.end()));
+  }
+  /* Wall clock timestamps, a file may not be in order if the clock moved */
+  std::stable_sort(requests_.begin(), requests_.end(),
+                   [](const Request& a, const Request& b) {
+                     return a.timestampUs < b.timestampUs;
+                   });
+}
+
+LoadGenerator::Results TrafficReplayer::run() {
+  Replay replay(opts_, requests_);
+  return replay.run();
+}
+
+}}}  // facebook::memcache::mcrouter
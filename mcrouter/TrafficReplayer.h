@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/mc/protocol.h"
+#include "mcrouter/LoadGenerator.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Replays files written by TrafficCapture against a memcache server
+ * (usually an mcrouter), with the captured timing between requests scaled
+ * by a speed factor. Values are synthesized with the captured sizes.
+ *
+ * The replay is open loop: a request is sent when it is due, regardless of
+ * outstanding replies (up to maxInFlight), and its latency is measured from
+ * when it was due, so a slow server doesn't slow down the replay.
+ *
+ * Lease-sets are replayed as sets, since lease tokens aren't captured;
+ * operations without a key are skipped.
+ */
+class TrafficReplayer {
+ public:
+  struct Options {
+    std::string host{"localhost"};
+    uint16_t port{5000};
+    mc_protocol_t protocol{mc_ascii_protocol};
+    size_t connections{1};
+
+    /* 2 replays twice as fast as captured */
+    double speed{1.0};
+    size_t maxInFlight{10000};
+    std::chrono::milliseconds timeout{1000};
+  };
+
+  struct Request {
+    uint64_t timestampUs{0};
+    mc_op_t op{mc_op_unknown};
+    uint32_t valueSize{0};
+    uint64_t flags{0};
+    uint32_t exptime{0};
+    /* With the routing prefix */
+    std::string key;
+  };
+
+  /**
+   * Reads the records of a capture file, oldest first.
+   *
+   * @throws std::runtime_error if the file can't be read or is malformed
+   */
+  static std::vector<Request> readCapture(const std::string& path);
+
+  /**
+   * Reads and merges the capture files (e.g. of all proxies).
+   *
+   * @throws std::runtime_error if a file can't be read or is malformed
+   */
+  TrafficReplayer(Options opts, const std::vector<std::string>& files);
+
+  size_t requests() const {
+    return requests_.size();
+  }
+
+  /**
+   * Replays all requests and waits for their replies. Blocks.
+   *
+   * Results::requests counts sent requests, skipped ones are in
+   * Results::results["skipped"].
+   */
+  LoadGenerator::Results run();
+
+ private:
+  class Replay;
+
+  const Options opts_;
+  std::vector<Request> requests_;
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -30,37 +30,28 @@
 #include <folly/Conv.h>
 #include <folly/File.h>
 #include <folly/FileUtil.h>
-#include <folly/json.h>
 #include <folly/ThreadName.h>
 
+#include "mcrouter/AsynclogFormat.h"
 #include "mcrouter/awriter.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
-#include "mcrouter/lib/fibers/EventBaseLoopController.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/McrouterLogFailure.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/stats.h"
 
-#define ASYNCLOG_MAGIC  "AS1.0"
-#define ASYNCLOG_MAGIC2  "AS2.0"
-
-using folly::dynamic;
-
 namespace facebook { namespace memcache { namespace mcrouter {
 
 AsyncWriter::AsyncWriter(size_t maxQueueSize)
     : maxQueueSize_(maxQueueSize),
       pid_(getpid()),
-      fiberManager_(folly::make_unique<EventBaseLoopController>()),
       eventBase_(/* enableTimeMeasurement */ false) {
-  auto& c = fiberManager_.loopController();
-  dynamic_cast<EventBaseLoopController&>(c).attachEventBase(eventBase_);
 }
 
 AsyncWriter::~AsyncWriter() {
   stop();
-  assert(!fiberManager_.hasTasks());
+  assert(queue_.empty());
 }
 
 void AsyncWriter::stop() {
@@ -81,9 +72,7 @@ void AsyncWriter::stop() {
       thread_.detach();
     }
   } else {
-    while (fiberManager_.hasTasks()) {
-      fiberManager_.loopUntilNoReady();
-    }
+    drain();
   }
 }
 
@@ -98,9 +87,8 @@ bool AsyncWriter::start(folly::StringPiece threadName) {
       // will return after terminateLoopSoon is called
       eventBase_.loopForever();
 
-      while (fiberManager_.hasTasks()) {
-        fiberManager_.loopUntilNoReady();
-      }
+      // nothing is queued after stop(), run what's left
+      drain();
     });
     folly::setThreadName(thread_.native_handle(), threadName);
   } catch (const std::system_error& e) {
@@ -127,16 +115,29 @@ bool AsyncWriter::run(std::function<void()> f) {
     } while (!queueSize_.compare_exchange_weak(size, size + 1));
   }
 
-  auto fWrapper = folly::makeMoveWrapper(std::move(f));
-  fiberManager_.addTaskRemote([this, fWrapper]() {
-    fiberManager_.runInMainContext([fWrapper]() {
-      (*fWrapper)();
+  if (queue_.insertHead(new Task(std::move(f)))) {
+    /* The writer took everything queued before, and may be asleep.
+       If the thread isn't started yet, this runs once it is. */
+    eventBase_.runInEventBaseThread([this]() {
+      drain();
     });
+  }
+  return true;
+}
+
+void AsyncWriter::drain() {
+  queue_.sweep([this](Task* task) {
+    try {
+      task->func();
+    } catch (const std::exception& e) {
+      logFailure(memcache::failure::Category::kOther,
+                 "Exception in AsyncWriter function: {}", e.what());
+    }
+    delete task;
     if (maxQueueSize_ != 0) {
       --queueSize_;
     }
   });
-  return true;
 }
 
 bool awriter_queue(AsyncWriter* w, awriter_entry_t *e) {
@@ -158,7 +159,7 @@ static std::shared_ptr<folly::File> countedfd_new(int fd) {
 }
 
 /** Opens the asynchronous request store.  */
-static std::shared_ptr<folly::File> asynclog_open(proxy_t *proxy) {
+std::shared_ptr<folly::File> asynclog_open(proxy_t *proxy) {
   char path[PATH_MAX + 1];
   time_t now = time(nullptr);
   pid_t tid = syscall(SYS_gettid);
@@ -287,26 +288,9 @@ epilogue:
 
 /** Adds an asynchronous request to the event log. */
 void asynclog_delete(proxy_t* proxy,
-                     std::shared_ptr<const ProxyClientCommon> pclient,
+                     const ProxyClientCommon& pclient,
                      folly::StringPiece key,
                      folly::StringPiece poolName) {
-  dynamic json = {};
-  const auto& host = pclient->ap.getHost();
-  const auto& port = pclient->ap.getPort();
-
-  if (proxy->opts.use_asynclog_version2) {
-    json = dynamic::object;
-    json["f"] = proxy->opts.router_name;
-    json["h"] = folly::sformat("[{}]:{}", host, port);
-    json["p"] = poolName.str();
-    json["k"] = key.str();
-  } else {
-    /* ["host", port, escaped_command] */
-    json.push_back(host);
-    json.push_back(port);
-    json.push_back(folly::sformat("delete {}\r\n", key));
-  }
-
   auto fd = asynclog_open(proxy);
   if (!fd) {
     logFailure(proxy->router, memcache::failure::Category::kSystemError,
@@ -315,28 +299,19 @@ void asynclog_delete(proxy_t* proxy,
     return;
   }
 
-  // ["AS1.0", 1289416829.836, "C", ["10.0.0.1", 11302, "delete foo\r\n"]]
-  // OR ["AS2.0", 1289416829.836, "C", {"f":"flavor","h":"[10.0.0.1]:11302",
-  //                                    "p":"pool_name","k":"foo\r\n"}]
-  dynamic jsonOut = {};
-  if (proxy->opts.use_asynclog_version2) {
-    jsonOut.push_back(ASYNCLOG_MAGIC2);
-  } else {
-    jsonOut.push_back(ASYNCLOG_MAGIC);
-  }
-
   struct timeval timestamp;
   CHECK(gettimeofday(&timestamp, nullptr) == 0);
 
-  auto timestamp_ms =
+  AsynclogRecord record;
+  record.timestampMs =
     facebook::memcache::to<std::chrono::milliseconds>(timestamp).count();
+  record.host = pclient.ap.getHost();
+  record.port = pclient.ap.getPort();
+  record.pool = poolName;
+  record.key = key;
 
-  jsonOut.push_back(1e-3 * timestamp_ms);
-  jsonOut.push_back(std::string("C"));
-
-  jsonOut.push_back(json);
-
-  auto jstr = folly::toJson(jsonOut) + "\n";
+  auto jstr = AsynclogFormat::jsonLine(record, proxy->opts.router_name,
+                                       proxy->opts.use_asynclog_version2);
 
   ssize_t size = folly::writeFull(fd->fd(), jstr.data(), jstr.size());
   if (size == -1 || size_t(size) < jstr.size()) {
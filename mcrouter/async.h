@@ -13,18 +13,31 @@
 
 #include <folly/Range.h>
 
+namespace folly {
+class File;
+}
+
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class proxy_t;
 class ProxyClientCommon;
 
+/**
+ * Opens (or reuses) the asynclog spool file of the proxy, a new file is
+ * started every DEFAULT_ASYNCLOG_LIFETIME seconds.
+ * Must only be called from the awriter thread.
+ *
+ * @return nullptr on failure (logged)
+ */
+std::shared_ptr<folly::File> asynclog_open(proxy_t* proxy);
+
 /**
  * Appends a 'delete' request entry to the asynclog.
  * This call blocks until the entry is written to the file
  * or an error occurs.
  */
 void asynclog_delete(proxy_t* proxy,
-                     std::shared_ptr<const ProxyClientCommon> pclient,
+                     const ProxyClientCommon& pclient,
                      folly::StringPiece key,
                      folly::StringPiece poolName);
 
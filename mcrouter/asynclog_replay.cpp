@@ -0,0 +1,197 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/**
+ * Replays asynclog spool files.
+ *
+ *   mcrouter_asynclog_replay [--v1] FILE...
+ *
+ * converts binary spool files (written with --asynclog-batch) to the text
+ * format on stdout, for external replay tools. Output is in the version 2
+ * format unless --v1 is given. A record cut short at the end of a file is
+ * skipped with a warning.
+ *
+ *   mcrouter_asynclog_replay --send [OPTIONS] FILE...
+ *
+ * redelivers the deletes of text or binary spool files itself,
+ * see AsynclogReplayer.
+ */
+
+#include <getopt.h>
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+
+#include "mcrouter/AsynclogFormat.h"
+#include "mcrouter/AsynclogReplayer.h"
+
+using facebook::memcache::mcrouter::AsynclogFormat;
+using facebook::memcache::mcrouter::AsynclogRecord;
+using facebook::memcache::mcrouter::AsynclogReplayer;
+
+namespace {
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [--v1] FILE...\n"
+          "       %s --send [OPTIONS] FILE...\n"
+          "\n"
+          "Send options:\n"
+          "  --concurrency N      deletes in flight per destination (16)\n"
+          "  --rate N             deletes per second per destination,\n"
+          "                       0 is unlimited (0)\n"
+          "  --timeout-ms N       timeout of one delete (1000)\n"
+          "  --attempts N         attempts per record (3)\n"
+          "  --protocol P         ascii or umbrella (ascii)\n"
+          "  --checkpoint FILE    save and resume progress in FILE\n",
+          argv0, argv0);
+}
+
+/**
+ * @return true on success
+ */
+bool replayFile(const std::string& path, bool version2) {
+  std::string contents;
+  if (!folly::readFile(path.c_str(), contents)) {
+    fprintf(stderr, "%s: can't read: %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+
+  folly::StringPiece data(contents);
+  try {
+    auto routerName = AsynclogFormat::parseHeader(data);
+    AsynclogRecord record;
+    while (AsynclogFormat::parseRecord(data, record)) {
+      auto line = AsynclogFormat::jsonLine(record, routerName, version2);
+      if (fwrite(line.data(), 1, line.size(), stdout) != line.size()) {
+        fprintf(stderr, "error writing to stdout: %s\n", strerror(errno));
+        return false;
+      }
+    }
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s: %s\n", path.c_str(), e.what());
+    return false;
+  }
+
+  if (!data.empty()) {
+    fprintf(stderr, "%s: skipped %zu bytes of a truncated record\n",
+            path.c_str(), data.size());
+  }
+  return true;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  enum {
+    kV1 = 256,
+    kSend,
+    kConcurrency,
+    kRate,
+    kTimeoutMs,
+    kAttempts,
+    kProtocol,
+    kCheckpoint,
+    kHelp,
+  };
+  static const struct option longOptions[] = {
+    {"v1", no_argument, nullptr, kV1},
+    {"send", no_argument, nullptr, kSend},
+    {"concurrency", required_argument, nullptr, kConcurrency},
+    {"rate", required_argument, nullptr, kRate},
+    {"timeout-ms", required_argument, nullptr, kTimeoutMs},
+    {"attempts", required_argument, nullptr, kAttempts},
+    {"protocol", required_argument, nullptr, kProtocol},
+    {"checkpoint", required_argument, nullptr, kCheckpoint},
+    {"help", no_argument, nullptr, kHelp},
+    {nullptr, 0, nullptr, 0},
+  };
+
+  bool version2 = true;
+  bool sendMode = false;
+  AsynclogReplayer::Options opts;
+  try {
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+      switch (c) {
+        case kV1:
+          version2 = false;
+          break;
+        case kSend:
+          sendMode = true;
+          break;
+        case kConcurrency:
+          opts.maxInflightPerDestination = folly::to<size_t>(optarg);
+          break;
+        case kRate:
+          opts.maxRatePerDestination = folly::to<double>(optarg);
+          break;
+        case kTimeoutMs:
+          opts.timeout = std::chrono::milliseconds(folly::to<int64_t>(optarg));
+          break;
+        case kAttempts:
+          opts.maxAttempts = folly::to<size_t>(optarg);
+          break;
+        case kProtocol:
+          opts.protocol = mc_string_to_protocol(optarg);
+          if (opts.protocol == mc_unknown_protocol) {
+            fprintf(stderr, "unknown protocol %s\n", optarg);
+            return 1;
+          }
+          break;
+        case kCheckpoint:
+          opts.checkpointPath = optarg;
+          break;
+        case kHelp:
+          usage(argv[0]);
+          return 0;
+        default:
+          usage(argv[0]);
+          return 1;
+      }
+    }
+  } catch (const std::exception& e) {
+    fprintf(stderr, "invalid option value: %s\n", e.what());
+    return 1;
+  }
+
+  std::vector<std::string> files(argv + optind, argv + argc);
+  if (files.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (sendMode) {
+    try {
+      AsynclogReplayer replayer(std::move(opts));
+      bool success = replayer.run(files);
+      const auto& stats = replayer.stats();
+      fprintf(stderr,
+              "delivered %zu, retried %zu, failed %zu, malformed %zu\n",
+              stats.delivered, stats.retried, stats.failed, stats.malformed);
+      return success ? 0 : 1;
+    } catch (const std::exception& e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+  }
+
+  bool success = true;
+  for (const auto& file : files) {
+    success = replayFile(file, version2) && success;
+  }
+  return success ? 0 : 1;
+}
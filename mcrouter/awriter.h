@@ -20,9 +20,9 @@
 #include <folly/io/async/EventBase.h>
 #include <folly/Range.h>
 
-#include "mcrouter/lib/fbi/queue.h"
+#include "mcrouter/lib/fbi/cpp/AtomicLinkedList.h"
 #include "mcrouter/lib/fbi/cpp/sfrlock.h"
-#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/fbi/queue.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -40,6 +40,14 @@ struct awriter_entry_t {
   const awriter_callbacks_t *callbacks;
 };
 
+/**
+ * Runs functions on a thread of its own, in the order they were queued.
+ *
+ * Queued functions are kept in a lock-free list. The writer thread takes
+ * all of them at once and runs them back to back; producers only wake it
+ * up when the list was empty, i.e. when the writer is done with everything
+ * queued before.
+ */
 class AsyncWriter {
  public:
   /**
@@ -84,6 +92,15 @@ class AsyncWriter {
    */
   ~AsyncWriter();
  private:
+  struct Task {
+    explicit Task(std::function<void()> f)
+        : func(std::move(f)) {
+    }
+
+    std::function<void()> func;
+    AtomicLinkedListHook<Task> hook;
+  };
+
   const size_t maxQueueSize_;
   std::atomic<size_t> queueSize_{0};
   std::atomic<bool> stopped_{false};
@@ -91,9 +108,14 @@ class AsyncWriter {
   // process id of the parent thread (before fork)
   const pid_t pid_;
 
-  FiberManager fiberManager_;
+  AtomicLinkedList<Task, &Task::hook> queue_;
   folly::EventBase eventBase_;
   std::thread thread_;
+
+  /**
+   * Runs all queued functions, including the ones queued meanwhile.
+   */
+  void drain();
 };
 
 /**
@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <cstdint>
+
 #include <folly/Range.h>
 
 #include "mcrouter/lib/fbi/hash.h"
@@ -19,6 +21,15 @@ class dynamic;
 
 namespace facebook { namespace memcache {
 
+/**
+ * furc_key_digest() of a routing key, see
+ * McRequestBase::routingKeyFurcDigest(). Its own type so it's never
+ * mistaken for other key digests.
+ */
+struct FurcDigest {
+  uint64_t value;
+};
+
 /* CH3 consistent hashing function object */
 class Ch3HashFunc {
  public:
@@ -37,6 +48,11 @@ class Ch3HashFunc {
     return furc_hash(hashable.data(), hashable.size(), n_);
   }
 
+  /* Same as above for the key the digest is of, without reading it */
+  size_t operator() (folly::StringPiece hashable, FurcDigest digest) const {
+    return furc_hash_digest(digest.value, n_);
+  }
+
   static std::string type() {
     return "Ch3";
   }
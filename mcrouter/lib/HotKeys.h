@@ -0,0 +1,30 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+namespace facebook { namespace memcache {
+
+/**
+ * Customization point for routes that only act on hot keys
+ * (e.g. NearCacheRoute with "hot_keys_min_share").
+ *
+ * Routers that track hot keys declare a non-template
+ * isHotKey(const TheirRequest&, double) next to their request type,
+ * which is found by argument dependent lookup. Without one, every key
+ * is considered hot.
+ *
+ * @return true if req's key is at least minShare of recent traffic
+ */
+template <class Request>
+bool isHotKey(const Request& req, double minShare) {
+  return true;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "JemallocArenas.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/Malloc.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+std::mutex& arenasLock() {
+  static std::mutex lock;
+  return lock;
+}
+
+/* Indexes of the arenas created by bindThreadToNewArena() */
+std::vector<unsigned>& arenas() {
+  static std::vector<unsigned> arenas;
+  return arenas;
+}
+
+/* 0 if the stat is missing, e.g. huge allocations of jemalloc 3 */
+size_t readArenaStat(unsigned arena, const char* name) {
+  auto fullName = folly::to<std::string>("stats.arenas.", arena, ".", name);
+  size_t value = 0;
+  size_t size = sizeof(value);
+  if (mallctl(fullName.c_str(), &value, &size, nullptr, 0) != 0) {
+    return 0;
+  }
+  return value;
+}
+
+}  // anonymous namespace
+
+int JemallocArenas::bindThreadToNewArena() {
+  if (!folly::usingJEMalloc()) {
+    return -1;
+  }
+
+  unsigned arena;
+  size_t size = sizeof(arena);
+  if (mallctl("arenas.extend", &arena, &size, nullptr, 0) != 0 ||
+      mallctl("thread.arena", nullptr, nullptr, &arena, sizeof(arena)) != 0) {
+    return -1;
+  }
+
+  std::lock_guard<std::mutex> lock(arenasLock());
+  arenas().push_back(arena);
+  return static_cast<int>(arena);
+}
+
+JemallocArenas::Stats JemallocArenas::stats() {
+  Stats stats;
+  if (!folly::usingJEMalloc()) {
+    return stats;
+  }
+
+  uint64_t epoch = 1;
+  size_t pageSize = 0;
+  size_t size = sizeof(pageSize);
+  if (mallctl("epoch", nullptr, nullptr, &epoch, sizeof(epoch)) != 0 ||
+      mallctl("arenas.page", &pageSize, &size, nullptr, 0) != 0) {
+    return stats;
+  }
+
+  std::lock_guard<std::mutex> lock(arenasLock());
+  for (auto arena : arenas()) {
+    stats.allocated += readArenaStat(arena, "small.allocated") +
+                       readArenaStat(arena, "large.allocated") +
+                       readArenaStat(arena, "huge.allocated");
+    stats.active += readArenaStat(arena, "pactive") * pageSize;
+    stats.dirty += readArenaStat(arena, "pdirty") * pageSize;
+  }
+  return stats;
+}
+
+void JemallocArenas::purge() {
+  if (!folly::usingJEMalloc()) {
+    return;
+  }
+
+  std::vector<unsigned> toPurge;
+  {
+    std::lock_guard<std::mutex> lock(arenasLock());
+    toPurge = arenas();
+  }
+  for (auto arena : toPurge) {
+    auto name = folly::to<std::string>("arena.", arena, ".purge");
+    mallctl(name.c_str(), nullptr, nullptr, nullptr, 0);
+  }
+}
+
+size_t JemallocArenas::count() {
+  std::lock_guard<std::mutex> lock(arenasLock());
+  return arenas().size();
+}
+
+}}  // facebook::memcache
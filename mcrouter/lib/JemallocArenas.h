@@ -0,0 +1,59 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Dedicated jemalloc arenas for long lived threads (proxy threads, server
+ * workers), so that their allocations don't contend with other threads on
+ * the shared arenas. Everything is a no-op with other allocators.
+ */
+class JemallocArenas {
+ public:
+  /**
+   * Creates a new arena and makes it the calling thread's arena.
+   *
+   * @return  index of the new arena, -1 if not using jemalloc or on error
+   */
+  static int bindThreadToNewArena();
+
+  struct Stats {
+    /* Bytes allocated by the application */
+    uint64_t allocated{0};
+    /* Bytes in active pages */
+    uint64_t active{0};
+    /* Bytes in dirty pages not yet returned to the OS */
+    uint64_t dirty{0};
+  };
+
+  /**
+   * @return  stats summed over all arenas created by bindThreadToNewArena().
+   *          Refreshes jemalloc's stats snapshot, which takes its stats
+   *          locks: don't call on the hot path.
+   */
+  static Stats stats();
+
+  /**
+   * Returns the dirty pages of all arenas created by bindThreadToNewArena()
+   * to the OS. Meant to be called periodically from an auxiliary thread.
+   */
+  static void purge();
+
+  /**
+   * @return  number of arenas created by bindThreadToNewArena()
+   */
+  static size_t count();
+};
+
+}}  // facebook::memcache
@@ -16,6 +16,20 @@
 
 namespace facebook { namespace memcache {
 
+namespace {
+
+/* Reply fields of mc_msg_t that McReplyBase doesn't copy out */
+bool hasFieldsOnlyInMsg(const mc_msg_t& msg) {
+  return msg.exptime != 0 || msg.number != 0 || msg.stats != nullptr ||
+         msg.lowval != 0 || msg.highval != 0 || msg.ipv != 0
+#ifndef LIBMC_FBTRACE_DISABLE
+         || msg.fbtrace_info != nullptr
+#endif
+         ;
+}
+
+}  // anonymous namespace
+
 bool McReplyBase::worseThan(const McReplyBase& other) const {
   return awfulness(result_) > awfulness(other.result_);
 }
@@ -81,42 +95,48 @@ McReplyBase::McReplyBase(mc_res_t res)
 }
 
 McReplyBase::McReplyBase(mc_res_t res, folly::IOBuf val)
-    : result_(res),
-      valueData_(std::move(val)) {
+    : valueData_(std::move(val)),
+      result_(res) {
 }
 
 McReplyBase::McReplyBase(mc_res_t res, folly::StringPiece val)
-    : result_(res),
-      valueData_(folly::IOBuf(folly::IOBuf::COPY_BUFFER, val)) {
+    : valueData_(folly::IOBuf(folly::IOBuf::COPY_BUFFER, val)),
+      result_(res) {
 }
 
 McReplyBase::McReplyBase(mc_res_t res, const char* value)
-    : result_(res),
-      valueData_(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value,
-                              strlen(value))) {
+    : valueData_(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value,
+                              strlen(value))),
+      result_(res) {
 }
 
 McReplyBase::McReplyBase(mc_res_t res, const std::string& value)
-    : result_(res),
-      valueData_(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value)) {
+    : valueData_(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value)),
+      result_(res) {
 }
 
 McReplyBase::McReplyBase(mc_res_t res, McMsgRef&& msg)
-    : msg_(std::move(msg)),
-      result_(res),
-      flags_(msg_.get() ? msg_->flags : 0),
-      leaseToken_(msg_.get() ? msg_->lease_id : 0),
-      delta_(msg_.get() ? msg_->delta : 0),
-      cas_(msg_.get() ? msg_->cas : 0),
-      errCode_(msg_.get() ? msg_->err_code : 0) {
-  if (msg_.get() && msg_->value.str != nullptr) {
-    valueData_.emplace(makeMsgValueIOBufStack(msg_));
+    : result_(res) {
+  if (!msg.get()) {
+    return;
+  }
+  flags_ = msg->flags;
+  errCode_ = msg->err_code;
+  setLeaseToken(msg->lease_id);
+  setDelta(msg->delta);
+  setCas(msg->cas);
+  if (msg->value.str != nullptr) {
+    /* The value holds its own reference to msg */
+    valueData_.emplace(makeMsgValueIOBufStack(msg));
+  }
+  if (hasFieldsOnlyInMsg(*msg)) {
+    ext().msg = std::move(msg);
   }
 }
 
 void McReplyBase::dependentMsg(mc_op_t op, mc_msg_t* out) const {
-  if (msg_.get() != nullptr) {
-    mc_msg_shallow_copy(out, msg_.get());
+  if (msg() != nullptr) {
+    mc_msg_shallow_copy(out, msg());
   }
 
   auto value = valueRangeSlow();
@@ -128,27 +148,28 @@ void McReplyBase::dependentMsg(mc_op_t op, mc_msg_t* out) const {
   out->op = op;
   out->result = result_;
   out->flags = flags_;
-  out->lease_id = leaseToken_;
-  out->delta = delta_;
-  out->cas = cas_;
+  out->lease_id = leaseToken();
+  out->delta = delta();
+  out->cas = cas();
   out->err_code = errCode_;
 }
 
 McMsgRef McReplyBase::releasedMsg(mc_op_t op) const {
-  if (msg_.get() != nullptr &&
-      msg_->op == op &&
-      msg_->result == result_ &&
-      msg_->flags == flags_ &&
-      msg_->lease_id == leaseToken_ &&
-      msg_->delta == delta_ &&
-      msg_->err_code == errCode_ &&
-      hasSameMemoryRegion(value(), to<folly::StringPiece>(msg_->value))) {
-    return msg_.clone();
+  auto m = msg();
+  if (m != nullptr &&
+      m->op == op &&
+      m->result == result_ &&
+      m->flags == flags_ &&
+      m->lease_id == leaseToken() &&
+      m->delta == delta() &&
+      m->err_code == errCode_ &&
+      hasSameMemoryRegion(value(), to<folly::StringPiece>(m->value))) {
+    return ext_->msg.clone();
   } else {
     auto len = value().computeChainDataLength();
     auto toRelease = createMcMsgRef(len + 1);
-    if (msg_.get() != nullptr) {
-      mc_msg_shallow_copy(toRelease.get(), msg_.get());
+    if (m != nullptr) {
+      mc_msg_shallow_copy(toRelease.get(), m);
       // TODO: fbtrace?
     }
     toRelease->key.str = nullptr;
@@ -160,9 +181,9 @@ McMsgRef McReplyBase::releasedMsg(mc_op_t op) const {
     toRelease->op = op;
     toRelease->result = result_;
     toRelease->flags = flags_;
-    toRelease->lease_id = leaseToken_;
-    toRelease->delta = delta_;
-    toRelease->cas = cas_;
+    toRelease->lease_id = leaseToken();
+    toRelease->delta = delta();
+    toRelease->cas = cas();
     toRelease->err_code = errCode_;
 
     return std::move(toRelease);
@@ -24,6 +24,11 @@ namespace facebook { namespace memcache {
 
 /**
  * mc_msg_t-based Reply implementation.
+ *
+ * Replies are moved through every route handle layer, so only the fields
+ * most replies have are kept inline; lease token, cas, delta, the
+ * destructor and the mc_msg_t (needed only for fields like exptime that
+ * have no member here) live in an extension allocated on first use.
  */
 class McReplyBase {
  public:
@@ -208,52 +213,58 @@ class McReplyBase {
   }
 
   uint32_t exptime() const {
-    return msg_.get() ? msg_->exptime : 0;
+    return msg() ? msg()->exptime : 0;
   }
 
   uint32_t number() const {
-    return msg_.get() ? msg_->number : 0;
+    return msg() ? msg()->number : 0;
   }
 
   uint64_t leaseToken() const {
-    return leaseToken_;
+    return ext_ ? ext_->leaseToken : 0;
   }
 
   void setLeaseToken(uint64_t lt) {
-    leaseToken_ = lt;
+    if (lt != 0 || ext_) {
+      ext().leaseToken = lt;
+    }
   }
 
   uint64_t cas() const {
-    return cas_;
+    return ext_ ? ext_->cas : 0;
   }
 
   void setCas(uint64_t c) {
-    cas_ = c;
+    if (c != 0 || ext_) {
+      ext().cas = c;
+    }
   }
 
   uint64_t delta() const {
-    return delta_;
+    return ext_ ? ext_->delta : 0;
   }
 
   void setDelta(uint64_t d) {
-    delta_ = d;
+    if (d != 0 || ext_) {
+      ext().delta = d;
+    }
   }
 
   double lowValue() const {
-    return msg_.get() ? msg_->lowval : 0;
+    return msg() ? msg()->lowval : 0;
   }
 
   double highValue() const {
-    return msg_.get() ? msg_->highval : 0;
+    return msg() ? msg()->highval : 0;
   }
 
   uint8_t ipv() const {
-    return msg_.get() ? msg_->ipv : 0;
+    return msg() ? msg()->ipv : 0;
   }
 
   const struct in6_addr& ipAddress() const {
     static struct in6_addr addr;
-    return msg_.get() ? msg_->ip_addr : addr;
+    return msg() ? msg()->ip_addr : addr;
   }
 
   /**
@@ -279,8 +290,8 @@ class McReplyBase {
    * destructor(ctx) when this reply is destroyed.
    */
   void setDestructor(void (*destructor) (void*), void* ctx) {
-    assert(!destructor_.hasValue());
-    destructor_.assign(CUniquePtr(ctx, destructor));
+    assert(!ext_ || !ext_->destructor.hasValue());
+    ext().destructor.assign(CUniquePtr(ctx, destructor));
   }
 
  protected:
@@ -298,20 +309,36 @@ class McReplyBase {
   McReplyBase& operator=(McReplyBase&& other) = default;
 
  private:
-  McMsgRef msg_;
-  mc_res_t result_{mc_res_unknown};
-  mutable folly::Optional<folly::IOBuf> valueData_;
-  uint64_t flags_{0};
-  uint64_t leaseToken_{0};
-  uint64_t delta_{0};
-  uint64_t cas_{0};
-  uint32_t errCode_{0};
-
   /**
    * Container for a C-style destructor
    */
   using CUniquePtr = std::unique_ptr<void, void(*)(void*)>;
-  folly::Optional<CUniquePtr> destructor_;
+
+  struct Extension {
+    /* Only kept if it has fields not copied into McReplyBase */
+    McMsgRef msg;
+    uint64_t leaseToken{0};
+    uint64_t delta{0};
+    uint64_t cas{0};
+    folly::Optional<CUniquePtr> destructor;
+  };
+
+  mutable folly::Optional<folly::IOBuf> valueData_;
+  uint64_t flags_{0};
+  mc_res_t result_{mc_res_unknown};
+  uint32_t errCode_{0};
+  std::unique_ptr<Extension> ext_;
+
+  Extension& ext() {
+    if (!ext_) {
+      ext_ = folly::make_unique<Extension>();
+    }
+    return *ext_;
+  }
+
+  const mc_msg_t* msg() const {
+    return ext_ ? ext_->msg.get() : nullptr;
+  }
 };
 
 }}  // facebook::memcache
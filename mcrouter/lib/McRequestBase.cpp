@@ -9,11 +9,15 @@
  */
 #include "McRequestBase.h"
 
+#include <cstring>
+
 #include <folly/io/IOBuf.h>
 #include <folly/Memory.h>
 #include <folly/Range.h>
 
 #include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fbi/hash.h"
+#include "mcrouter/lib/network/McSerializedRequest.h"
 
 namespace facebook { namespace memcache {
 
@@ -34,27 +38,131 @@ McRequestBase::McRequestBase(McMsgRef&& msg)
 {
 }
 
-McRequestBase::McRequestBase(folly::StringPiece key)
-    : keyData_(folly::IOBuf(folly::IOBuf::COPY_BUFFER, key)) {
-  keyData_.coalesce();
-  keys_.update(getRange(keyData_));
-  auto msg = createMcMsgRef();
-  msg->key = to<nstring_t>(getRange(keyData_));
-  msg_ = std::move(msg);
+constexpr size_t McRequestBase::kMaxInlineKeySize;
+
+static_assert(McRequestBase::kMaxInlineKeySize <= 255,
+              "inlineKeySize_ is a uint8_t");
+
+McRequestBase::McRequestBase(folly::StringPiece key) {
+  /* msg_ is created on demand, see ensureMsgExists() */
+  setKey(key);
+}
+
+McRequestBase::McRequestBase(McRequestBase&& other) noexcept
+    : msg_(std::move(other.msg_)),
+      keyData_(std::move(other.keyData_)),
+      valueData_(std::move(other.valueData_)),
+      valueBytesCopied_(other.valueBytesCopied_),
+      keys_(other.keys_),
+      exptime_(other.exptime_),
+      flags_(other.flags_),
+      delta_(other.delta_),
+      leaseToken_(other.leaseToken_),
+      cas_(other.cas_),
+      routingKeyDigestHint_(other.routingKeyDigestHint_),
+      noreply_(other.noreply_),
+      inlineKeySize_(other.inlineKeySize_),
+      sharedSerialization_(std::move(other.sharedSerialization_))
+#ifndef LIBMC_FBTRACE_DISABLE
+    ,
+      fbtraceInfo_(std::move(other.fbtraceInfo_))
+#endif
+{
+  if (inlineKeySize_ != 0) {
+    moveInlineKey(other);
+  }
+}
+
+McRequestBase& McRequestBase::operator=(McRequestBase&& other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  msg_ = std::move(other.msg_);
+  keyData_ = std::move(other.keyData_);
+  valueData_ = std::move(other.valueData_);
+  valueBytesCopied_ = other.valueBytesCopied_;
+  keys_ = other.keys_;
+  exptime_ = other.exptime_;
+  flags_ = other.flags_;
+  delta_ = other.delta_;
+  leaseToken_ = other.leaseToken_;
+  cas_ = other.cas_;
+  routingKeyDigestHint_ = other.routingKeyDigestHint_;
+  noreply_ = other.noreply_;
+  inlineKeySize_ = other.inlineKeySize_;
+  sharedSerialization_ = std::move(other.sharedSerialization_);
+  if (inlineKeySize_ != 0) {
+    moveInlineKey(other);
+  }
+#ifndef LIBMC_FBTRACE_DISABLE
+  fbtraceInfo_ = std::move(other.fbtraceInfo_);
+#endif
+  return *this;
+}
+
+void McRequestBase::enableSharedSerialization() const {
+  if (!sharedSerialization_) {
+    sharedSerialization_ = std::make_shared<SharedSerializedRequest>();
+  }
+}
+
+void McRequestBase::setKey(folly::StringPiece k) {
+  if (!k.empty() && k.size() <= kMaxInlineKeySize) {
+    /* k may point into our own key */
+    std::memmove(inlineKey_, k.data(), k.size());
+    inlineKeySize_ = k.size();
+    keyData_ = folly::IOBuf();
+  } else {
+    keyData_ = folly::IOBuf(folly::IOBuf::COPY_BUFFER, k);
+    keyData_.coalesce();
+    inlineKeySize_ = 0;
+  }
+  keys_.update(fullKey());
 }
 
-bool McRequestBase::setKeyFrom(const folly::IOBuf& source,
-                               const uint8_t* keyBegin, size_t keySize) {
-  if (keySize && cloneInto(keyData_, source, keyBegin, keySize)) {
-    keys_ = Keys(getRange(keyData_));
-    return true;
+void McRequestBase::stripRoutingPrefix() {
+  auto prefixSize = keys_.routingPrefix.size();
+  if (inlineKeySize_ != 0 && prefixSize != 0) {
+    std::memmove(inlineKey_, inlineKey_ + prefixSize,
+                 inlineKeySize_ - prefixSize);
+    inlineKeySize_ -= prefixSize;
+    keyData_ = folly::IOBuf();
+    rebaseKeys(inlineKey_ + prefixSize, inlineKey_);
+  } else {
+    keyData_.trimStart(prefixSize);
   }
-  return false;
+  keys_.routingPrefix.clear();
 }
 
-bool McRequestBase::setValueFrom(const folly::IOBuf& source,
-                                 const uint8_t* valueBegin, size_t valueSize) {
-  return valueSize && cloneInto(valueData_, source, valueBegin, valueSize);
+bool McRequestBase::sameKeyMemoryRegion(folly::StringPiece range) const {
+  auto key = fullKey();
+  return key.empty() ||
+    (range.begin() == key.begin() && range.size() == key.size());
+}
+
+void McRequestBase::rebaseKeys(const char* oldBegin, const char* newBegin) {
+  auto rebase = [oldBegin, newBegin](folly::StringPiece& piece) {
+    if (piece.begin() != nullptr) {
+      piece.reset(newBegin + (piece.begin() - oldBegin), piece.size());
+    }
+  };
+  rebase(keys_.keyWithoutRoute);
+  rebase(keys_.routingPrefix);
+  rebase(keys_.routingKey);
+}
+
+void McRequestBase::moveInlineKey(const McRequestBase& other) {
+  std::memcpy(inlineKey_, other.inlineKey_, inlineKeySize_);
+  rebaseKeys(other.inlineKey_, inlineKey_);
+  /* A msg_ made by ensureMsgExists() points into other's inline key,
+     it will be made again on demand */
+  if (msg_.get()) {
+    auto msgKey = msg_->key.str;
+    if (msgKey >= other.inlineKey_ &&
+        msgKey < other.inlineKey_ + kMaxInlineKeySize) {
+      msg_ = McMsgRef();
+    }
+  }
 }
 
 void McRequestBase::dependentHelper(mc_op_t op, folly::StringPiece key,
@@ -81,8 +189,8 @@ void McRequestBase::ensureMsgExists(mc_op_t op) const {
      so create one if necessary. */
   if (!msg_.get()) {
     auto msg = createMcMsgRef();
-    dependentHelper(op, getRange(keyData_),
-                    coalesceAndGetRange(const_cast<folly::IOBuf&>(valueData_)),
+    dependentHelper(op, fullKey(),
+                    coalesceValue(),
                     msg);
     const_cast<McMsgRef&>(msg_) = std::move(msg);
   }
@@ -92,7 +200,7 @@ McMsgRef McRequestBase::dependentMsg(mc_op_t op) const {
   ensureMsgExists(op);
 
   auto is_key_set =
-    hasSameMemoryRegion(keyData_, to<folly::StringPiece>(msg_->key));
+    sameKeyMemoryRegion(to<folly::StringPiece>(msg_->key));
   auto is_value_set =
     hasSameMemoryRegion(valueData_, to<folly::StringPiece>(msg_->value));
 
@@ -115,8 +223,8 @@ McMsgRef McRequestBase::dependentMsg(mc_op_t op) const {
     /* Out of luck.  The best we can do is make the copy
        reference key/value fields from the backing store. */
     auto toRelease = createMcMsgRef();
-    dependentHelper(op, getRange(keyData_),
-                    coalesceAndGetRange(const_cast<folly::IOBuf&>(valueData_)),
+    dependentHelper(op, fullKey(),
+                    coalesceValue(),
                     toRelease);
     return std::move(toRelease);
   }
@@ -127,7 +235,7 @@ McMsgRef McRequestBase::dependentMsgStripRoutingPrefix(mc_op_t op) const {
 
   auto is_key_set =
     keys_.routingPrefix.empty() &&
-    hasSameMemoryRegion(keyData_, to<folly::StringPiece>(msg_->key));
+    sameKeyMemoryRegion(to<folly::StringPiece>(msg_->key));
   auto is_value_set =
     hasSameMemoryRegion(valueData_, to<folly::StringPiece>(msg_->value));
 
@@ -151,7 +259,7 @@ McMsgRef McRequestBase::dependentMsgStripRoutingPrefix(mc_op_t op) const {
        reference key/value fields from the backing store. */
     auto toRelease = dependentMcMsgRef(msg_);
     dependentHelper(op, keys_.keyWithoutRoute,
-                    coalesceAndGetRange(const_cast<folly::IOBuf&>(valueData_)),
+                    coalesceValue(),
                     toRelease);
     return std::move(toRelease);
   }
@@ -197,7 +305,18 @@ void McRequestBase::Keys::update(folly::StringPiece key) {
     routingKey.reset(keyWithoutRoute.begin(), pos);
   }
 
-  routingKeyHash = getMemcacheKeyHashValue(routingKey);
+  hasRoutingKeyDigest = false;
+  hasFurcDigest = false;
+}
+
+void McRequestBase::Keys::computeRoutingKeyDigest() const {
+  routingKeyDigest = getMemcacheKeyDigest(routingKey);
+  hasRoutingKeyDigest = true;
+}
+
+void McRequestBase::Keys::computeFurcDigest() const {
+  furcDigest = furc_key_digest(routingKey.data(), routingKey.size());
+  hasFurcDigest = true;
 }
 
 McRequestBase::McRequestBase(const McRequestBase& other)
@@ -205,20 +324,33 @@ McRequestBase::McRequestBase(const McRequestBase& other)
       flags_(other.flags_),
       delta_(other.delta_),
       leaseToken_(other.leaseToken_),
-      cas_(other.cas_) {
-  // Key is always a single piece, so it's safe to do cloneOneInto.
-  other.keyData_.cloneOneInto(keyData_);
-  keys_ = Keys(getRange(keyData_));
+      cas_(other.cas_),
+      routingKeyDigestHint_(other.routingKeyDigestHint_),
+      noreply_(other.noreply_),
+      sharedSerialization_(other.sharedSerialization_) {
+  if (other.inlineKeySize_ != 0) {
+    std::memcpy(inlineKey_, other.inlineKey_, other.inlineKeySize_);
+    inlineKeySize_ = other.inlineKeySize_;
+  } else {
+    // Key is always a single piece, so it's safe to do cloneOneInto.
+    other.keyData_.cloneOneInto(keyData_);
+  }
+  keys_ = Keys(fullKey());
+  keys_.copyDigests(other.keys_);
   other.valueData_.cloneInto(valueData_);
+  valueBytesCopied_ = other.valueBytesCopied_;
 
-  if (hasSameMemoryRegion(keyData_, other.keyData_) &&
-      hasSameMemoryRegion(valueData_, other.valueData_)) {
+  if (!other.msg_.get()) {
+    /* Will be created on demand, see ensureMsgExists() */
+  } else if (inlineKeySize_ == 0 &&
+             hasSameMemoryRegion(keyData_, other.keyData_) &&
+             hasSameMemoryRegion(valueData_, other.valueData_)) {
 
     msg_ = other.msg_.clone();
   } else {
     msg_ = createMcMsgRef(
-      other.msg_, getRange(keyData_),
-      coalesceAndGetRange(valueData_));
+      other.msg_, fullKey(),
+      coalesceValue());
   }
 
 #ifndef LIBMC_FBTRACE_DISABLE
@@ -229,6 +361,13 @@ McRequestBase::McRequestBase(const McRequestBase& other)
 #endif
 }
 
+folly::StringPiece McRequestBase::coalesceValue() const {
+  if (valueData_.isChained()) {
+    valueBytesCopied_ += valueData_.computeChainDataLength();
+  }
+  return coalesceAndGetRange(valueData_);
+}
+
 McRequestBase::~McRequestBase() {
 }
 
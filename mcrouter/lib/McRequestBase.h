@@ -12,6 +12,7 @@
 #include <memory>
 
 #include <folly/io/IOBuf.h>
+#include <folly/Likely.h>
 #include <folly/Range.h>
 
 #include "mcrouter/lib/IOBufUtil.h"
@@ -24,6 +25,7 @@
 
 namespace facebook { namespace memcache {
 class McRequest;
+class SharedSerializedRequest;
 
 /**
  * As far as the routing module is concerned, a Request has
@@ -40,8 +42,14 @@ class McRequestBase {
 
   /* Request interface */
 
-  McRequestBase(McRequestBase&& other) noexcept = default;
-  McRequestBase& operator=(McRequestBase&& other) = default;
+  /**
+   * Keys up to this size set from strings are stored in the request itself,
+   * without allocating.
+   */
+  static constexpr size_t kMaxInlineKeySize = 64;
+
+  McRequestBase(McRequestBase&& other) noexcept;
+  McRequestBase& operator=(McRequestBase&& other) noexcept;
 
   /**
    * The routing prefix.
@@ -62,9 +70,66 @@ class McRequestBase {
   /**
    * Hashes the routing part of the key (using SpookyHashV2).
    * Used for probabilistic decisions, like stats sampling or shadowing.
+   * Same as the lower 32 bits of routingKeyDigest().
    */
   uint32_t routingKeyHash() const {
-    return keys_.routingKeyHash;
+    return static_cast<uint32_t>(routingKeyDigest());
+  }
+
+  /**
+   * 64-bit SpookyHashV2 (seed 0) of routingKey(). Computed on first use
+   * and cached (copies of the request inherit it), so route handles
+   * and hash functions can share one pass over the key.
+   */
+  uint64_t routingKeyDigest() const {
+    if (!keys_.hasRoutingKeyDigest) {
+      keys_.computeRoutingKeyDigest();
+    }
+    return keys_.routingKeyDigest;
+  }
+
+  /**
+   * furc_key_digest() of routingKey(), what CH3 hash functions (Ch3,
+   * WeightedCh3, ConstShard) read the key for. Cached like
+   * routingKeyDigest(), so pools of any size hash the key only once.
+   */
+  uint64_t routingKeyFurcDigest() const {
+    if (!keys_.hasFurcDigest) {
+      keys_.computeFurcDigest();
+    }
+    return keys_.furcDigest;
+  }
+
+  /**
+   * True if routingKeyDigest() was computed (or set from the hint)
+   * already, i.e. it can be read without hashing the key.
+   */
+  bool hasRoutingKeyDigest() const {
+    return keys_.hasRoutingKeyDigest;
+  }
+
+  /**
+   * routingKeyDigest() the request came with from an upstream mcrouter
+   * (umbrella msg_key_digest), 0 if none. Only a hint: it's used instead
+   * of hashing the key after useRoutingKeyDigestHint().
+   */
+  uint64_t routingKeyDigestHint() const {
+    return routingKeyDigestHint_;
+  }
+
+  void setRoutingKeyDigestHint(uint64_t digest) {
+    routingKeyDigestHint_ = digest;
+  }
+
+  /**
+   * Trust the hint, if any, as the digest of the current routing key.
+   * Must be called after the key is set, setting the key drops it.
+   */
+  void useRoutingKeyDigestHint() {
+    if (routingKeyDigestHint_ != 0) {
+      keys_.routingKeyDigest = routingKeyDigestHint_;
+      keys_.hasRoutingKeyDigest = true;
+    }
   }
 
   /**
@@ -73,20 +138,14 @@ class McRequestBase {
   void setExptime(uint32_t expt) {
     exptime_ = expt;
   }
-  void setKey(folly::StringPiece k) {
-    keyData_ = folly::IOBuf(folly::IOBuf::COPY_BUFFER, k);
-    keyData_.coalesce();
-    keys_.update(getRange(keyData_));
-  }
+  void setKey(folly::StringPiece k);
   void setKey(folly::IOBuf keyData) {
     keyData_ = std::move(keyData);
     keyData_.coalesce();
+    inlineKeySize_ = 0;
     keys_.update(getRange(keyData_));
   }
-  void stripRoutingPrefix() {
-    keyData_.trimStart(keys_.routingPrefix.size());
-    keys_.routingPrefix.clear();
-  }
+  void stripRoutingPrefix();
   void setValue(folly::IOBuf valueData) {
     valueData_ = std::move(valueData);
   }
@@ -94,6 +153,29 @@ class McRequestBase {
     flags_ = f;
   }
 
+  /**
+   * Lets the destinations this request and its clones made from now on
+   * are sent to unchanged share their serialized forms, instead of
+   * serializing the same bytes once per destination.
+   * See SharedSerializedRequest in mcrouter/lib/network/McSerializedRequest.h.
+   */
+  void enableSharedSerialization() const;
+
+  /**
+   * @return  serialized forms shared with other clones of the request,
+   *          nullptr unless enableSharedSerialization() was called.
+   */
+  SharedSerializedRequest* sharedSerialization() const {
+    return sharedSerialization_.get();
+  }
+
+  /**
+   * Stop sharing serialized forms with the clones.
+   */
+  void disableSharedSerialization() {
+    sharedSerialization_.reset();
+  }
+
   /* mc_msg_t specific */
 
   /**
@@ -106,7 +188,8 @@ class McRequestBase {
   explicit McRequestBase(McMsgRef&& msg);
 
   /**
-   * Constructs an McRequestBase with the given full key
+   * Constructs an McRequestBase with the given full key.
+   * Doesn't allocate if the key is at most kMaxInlineKeySize long.
    */
   explicit McRequestBase(folly::StringPiece key);
 
@@ -117,7 +200,8 @@ class McRequestBase {
    * Note: McRequestBase assumes this object will not be modified.
    *
    * The returned mc_msg_t might reference data owned by this McRequestBase,
-   * so the McRequestBase must be kept alive (thus "dependent").
+   * so the McRequestBase must be kept alive and not moved (thus
+   * "dependent").
    */
   McMsgRef dependentMsg(mc_op_t op) const;
 
@@ -180,23 +264,57 @@ class McRequestBase {
     cas_ = c;
   }
 
+  /**
+   * If set, the request is sent to ascii destinations with "noreply" and
+   * completes as soon as it's written (see NoreplyRoute). Not taken from
+   * the client's request: clients' noreply only affects their own reply.
+   */
+  bool noreply() const {
+    return noreply_;
+  }
+
+  void setNoreply(bool nr) {
+    noreply_ = nr;
+  }
+
   /**
    * @return Full key, including the routing prefix and
    *         non-hashable parts if present
    */
   folly::StringPiece fullKey() const {
-    return getRange(keyData_);
+    return inlineKeySize_ != 0 ?
+      folly::StringPiece(inlineKey_, inlineKeySize_) : getRange(keyData_);
   }
 
   const folly::IOBuf& value() const {
     return valueData_;
   }
 
+  /**
+   * Note: coalesces the value if it's chained. Prefer passing value()
+   * as is where possible, e.g. serializers can write the chain directly.
+   */
   folly::StringPiece valueRangeSlow() const {
-    return folly::StringPiece(valueData_.coalesce());
+    return coalesceValue();
+  }
+
+  /**
+   * @return  number of value bytes that were copied so far in order to make
+   *          the value of this request (or of the requests it was cloned
+   *          from) contiguous.
+   */
+  size_t valueBytesCopied() const {
+    return valueBytesCopied_;
   }
 
+  /**
+   * Note: an inline key is copied into an IOBuf on the first call,
+   * prefer fullKey() where a range will do.
+   */
   const folly::IOBuf& key() const {
+    if (UNLIKELY(inlineKeySize_ != 0 && keyData_.empty())) {
+      keyData_ = folly::IOBuf(folly::IOBuf::COPY_BUFFER, fullKey());
+    }
     return keyData_;
   }
 
@@ -213,41 +331,74 @@ class McRequestBase {
   }
 #endif
 
- private:
-  McMsgRef msg_;
-
-  /* Always stored unchained */
-  folly::IOBuf keyData_;
-
-  /* May be chained */
-  mutable folly::IOBuf valueData_;
-
   /**
    * Holds all the references to the various parts of the key.
    *
    *                        /region/cluster/foo:key|#|etc
-   * keyData_:              ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
+   * full key:              ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
    * keyWithoutRoute:                       ^^^^^^^^^^^^^
    * routingPrefix:         ^^^^^^^^^^^^^^^^
    * routingKey:                            ^^^^^^^
+   *
+   * Shared with the typed requests (see TypedRequest.h).
    */
   struct Keys {
     folly::StringPiece keyWithoutRoute;
     folly::StringPiece routingPrefix;
     folly::StringPiece routingKey;
 
-    uint32_t routingKeyHash;
+    /* Lazily computed, see routingKeyDigest() */
+    mutable uint64_t routingKeyDigest{0};
+    mutable bool hasRoutingKeyDigest{false};
+    /* Lazily computed, see routingKeyFurcDigest() */
+    mutable uint64_t furcDigest{0};
+    mutable bool hasFurcDigest{false};
 
     Keys() {}
     explicit Keys(folly::StringPiece key) noexcept;
     void update(folly::StringPiece key);
-  } keys_;
+    void computeRoutingKeyDigest() const;
+    void computeFurcDigest() const;
+    /* For a copy of the same key, no need to hash it again */
+    void copyDigests(const Keys& other) {
+      routingKeyDigest = other.routingKeyDigest;
+      hasRoutingKeyDigest = other.hasRoutingKeyDigest;
+      furcDigest = other.furcDigest;
+      hasFurcDigest = other.hasFurcDigest;
+    }
+  };
+
+ private:
+  McMsgRef msg_;
+
+  /**
+   * Always stored unchained. If inlineKeySize_ != 0 the key is in
+   * inlineKey_ instead, and this is either empty or a copy made by key().
+   */
+  mutable folly::IOBuf keyData_;
+
+  /* May be chained */
+  mutable folly::IOBuf valueData_;
+
+  /* Number of value bytes copied by coalesceValue() */
+  mutable size_t valueBytesCopied_{0};
+
+  Keys keys_;
 
   uint32_t exptime_{0};
   uint64_t flags_{0};
   uint64_t delta_{0};
   uint64_t leaseToken_{0};
   uint64_t cas_{0};
+  uint64_t routingKeyDigestHint_{0};
+  bool noreply_{false};
+
+  /* Non-empty keys up to kMaxInlineKeySize set from strings */
+  uint8_t inlineKeySize_{0};
+  char inlineKey_[kMaxInlineKeySize];
+
+  /* Shared with clones, see enableSharedSerialization() */
+  mutable std::shared_ptr<SharedSerializedRequest> sharedSerialization_;
 
 #ifndef LIBMC_FBTRACE_DISABLE
   struct McFbtraceRefPolicy {
@@ -270,29 +421,6 @@ class McRequestBase {
   McFbtraceRef fbtraceInfo_;
 #endif
 
-  /**
-   * Direct key/value construction from the parsing code for efficiency.
-   */
-  friend McRequest umbrellaParseRequest(const folly::IOBuf& source,
-                                        const uint8_t*, size_t,
-                                        const uint8_t*, size_t,
-                                        mc_op_t&, uint64_t&);
-  /**
-   * Clone the key from the subregion of source [begin, begin + size).
-   * @return false If the subregion is empty or not valid (i.e. not contained
-   *   within [source.data(), source.data() + length())
-   */
-  bool setKeyFrom(const folly::IOBuf& source,
-                  const uint8_t* keyBegin, size_t keySize);
-
-  /**
-   * Clone the key from the subregion of source [begin, begin + size).
-   * @return false If the subregion is empty or not valid (i.e. not contained
-   *   within [source.data(), source.data() + length())
-   */
-  bool setValueFrom(const folly::IOBuf& source,
-                    const uint8_t* valueBegin, size_t valueSize);
-
   /**
    * Helper method to set all fields and proper key/value into McMsgRef.
    */
@@ -302,6 +430,20 @@ class McRequestBase {
 
   void ensureMsgExists(mc_op_t op) const;
 
+  /* keys_ of a copy of the key that was at oldBegin, now at newBegin */
+  void rebaseKeys(const char* oldBegin, const char* newBegin);
+
+  /* Copies the inline key of a request being moved from into this one */
+  void moveInlineKey(const McRequestBase& other);
+
+  /* Like hasSameMemoryRegion() for the key, wherever it's stored */
+  bool sameKeyMemoryRegion(folly::StringPiece range) const;
+
+  /**
+   * Coalesces valueData_ and accounts copied bytes in valueBytesCopied_.
+   */
+  folly::StringPiece coalesceValue() const;
+
  protected:
   /**
    * Useful for incremental construction, i.e. during parsing.
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "MemoryAccounting.h"
+
+#include <folly/Malloc.h>
+
+namespace facebook { namespace memcache {
+
+constexpr size_t MemoryAccounting::kNumTags;
+
+std::atomic<MemoryAccounting::Counters*>& MemoryAccounting::head() {
+  static std::atomic<Counters*> head{nullptr};
+  return head;
+}
+
+MemoryAccounting::Counters::Counters() {
+  for (auto& counter : bytes) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+}
+
+MemoryAccounting::Counters* MemoryAccounting::registerThread() {
+  auto counters = new Counters();
+  auto oldHead = head().load(std::memory_order_relaxed);
+  do {
+    counters->next = oldHead;
+  } while (!head().compare_exchange_weak(oldHead, counters,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+  return counters;
+}
+
+std::array<int64_t, MemoryAccounting::kNumTags> MemoryAccounting::totals() {
+  std::array<int64_t, kNumTags> totals;
+  totals.fill(0);
+  for (auto counters = head().load(std::memory_order_acquire);
+       counters != nullptr; counters = counters->next) {
+    for (size_t i = 0; i < kNumTags; ++i) {
+      totals[i] += counters->bytes[i].load(std::memory_order_relaxed);
+    }
+  }
+  return totals;
+}
+
+const char* MemoryAccounting::tagName(MemoryTag tag) {
+  static const char* const kNames[kNumTags] = {
+    "config",
+    "destinations",
+    "read_buffers",
+    "write_buffers",
+    "fiber_stacks",
+    "asynclog",
+  };
+  auto i = static_cast<size_t>(tag);
+  return i < kNumTags ? kNames[i] : "unknown";
+}
+
+int64_t MemoryAccounting::threadAllocatedBytes() {
+  static __thread uint64_t* allocated = nullptr;
+  static __thread uint64_t* deallocated = nullptr;
+  if (allocated == nullptr) {
+    if (!folly::usingJEMalloc()) {
+      return 0;
+    }
+    size_t size = sizeof(allocated);
+    if (mallctl("thread.allocatedp", &allocated, &size, nullptr, 0) != 0 ||
+        mallctl("thread.deallocatedp", &deallocated, &size, nullptr, 0) != 0) {
+      allocated = nullptr;
+      return 0;
+    }
+  }
+  return static_cast<int64_t>(*allocated - *deallocated);
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace facebook { namespace memcache {
+
+/**
+ * What accounted memory is used for.
+ */
+enum class MemoryTag : size_t {
+  /* Allocations made while building proxy configs, mostly route handles
+     (measured with jemalloc, 0 with other allocators) */
+  kConfig,
+  /* ProxyDestination objects */
+  kDestinations,
+  /* McParser read buffers of clients and server sessions, and pooled
+     server read buffers */
+  kReadBuffers,
+  /* Server reply WriteBuffers, including the free lists */
+  kWriteBuffers,
+  /* Stacks of allocated fibers */
+  kFiberStacks,
+  /* Asynclog records waiting to be written */
+  kAsynclog,
+
+  kNumTags
+};
+
+/**
+ * Byte counts of long lived allocations by MemoryTag, for attributing RSS.
+ *
+ * Every thread updates its own counters (a relaxed load and store, no
+ * read-modify-write), readers sum them over all threads. Memory may be
+ * freed on another thread than it was allocated on, so the counters of one
+ * thread can go negative; only the totals are meaningful.
+ */
+class MemoryAccounting {
+ public:
+  static constexpr size_t kNumTags = static_cast<size_t>(MemoryTag::kNumTags);
+
+  static void add(MemoryTag tag, int64_t bytes) {
+    auto& counter = threadCounters().bytes[static_cast<size_t>(tag)];
+    counter.store(counter.load(std::memory_order_relaxed) + bytes,
+                  std::memory_order_relaxed);
+  }
+
+  static void sub(MemoryTag tag, int64_t bytes) {
+    add(tag, -bytes);
+  }
+
+  /**
+   * @return  bytes accounted to tag by the calling thread
+   */
+  static int64_t threadBytes(MemoryTag tag) {
+    return threadCounters().bytes[static_cast<size_t>(tag)].load(
+      std::memory_order_relaxed);
+  }
+
+  /**
+   * @return  bytes accounted to each tag, over all threads
+   */
+  static std::array<int64_t, kNumTags> totals();
+
+  /**
+   * @return  e.g. "read_buffers" for MemoryTag::kReadBuffers
+   */
+  static const char* tagName(MemoryTag tag);
+
+  /**
+   * @return  bytes allocated minus bytes freed by the calling thread so far,
+   *          from jemalloc's per thread counters; 0 with other allocators.
+   *          The difference around a piece of code is what it allocated.
+   */
+  static int64_t threadAllocatedBytes();
+
+ private:
+  struct Counters {
+    std::array<std::atomic<int64_t>, kNumTags> bytes;
+    Counters* next{nullptr};
+
+    Counters();
+  };
+
+  static Counters& threadCounters() {
+    static __thread Counters* counters = nullptr;
+    if (counters == nullptr) {
+      counters = registerThread();
+    }
+    return *counters;
+  }
+
+  /* All threads' counters */
+  static std::atomic<Counters*>& head();
+
+  /**
+   * Counters of exited threads stay in the list (their counts are still
+   * part of the totals), so they are never freed.
+   */
+  static Counters* registerThread();
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,52 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "MissRateTracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <folly/SpookyHashV2.h>
+
+namespace facebook { namespace memcache {
+
+constexpr size_t MissRateTracker::kSlots;
+
+MissRateTracker::MissRateTracker(double alpha, char delimiter)
+    : alpha_(std::min(std::max(alpha, 1e-6), 1.0)),
+      minSamples_(static_cast<uint32_t>(std::ceil(1 / alpha_))),
+      delimiter_(delimiter) {
+}
+
+size_t MissRateTracker::slot(folly::StringPiece key) const {
+  auto pos = key.find(delimiter_);
+  if (pos != folly::StringPiece::npos) {
+    key = key.subpiece(0, pos + 1);
+  }
+  return folly::hash::SpookyHashV2::Hash64(key.data(), key.size(), 0) %
+    kSlots;
+}
+
+double MissRateTracker::missRate(size_t slot) const {
+  const auto& s = slots_[slot];
+  return s.samples < minSamples_ ? 0 : s.missRate;
+}
+
+void MissRateTracker::record(size_t slot, bool miss) {
+  auto& s = slots_[slot];
+  if (s.samples < minSamples_) {
+    /* Plain average of the first samples, the EWMA afterwards */
+    ++s.samples;
+    s.missRate += ((miss ? 1.0 : 0.0) - s.missRate) / s.samples;
+    return;
+  }
+  s.missRate += alpha_ * ((miss ? 1.0 : 0.0) - s.missRate);
+}
+
+}}  // facebook::memcache
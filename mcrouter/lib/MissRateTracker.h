@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Recent miss rate by key prefix (see MissFailoverRoute speculative mode):
+ * an exponentially weighted moving average per prefix. Prefixes are hashed
+ * into kSlots slots so the memory used stays bounded, prefixes that collide
+ * share an average.
+ *
+ * The prefix of a key is its part up to and including the first delimiter,
+ * the whole key if there's none.
+ *
+ * Not thread-safe.
+ */
+class MissRateTracker {
+ public:
+  static constexpr size_t kSlots = 256;
+
+  /**
+   * @param alpha  weight of a new sample, in (0, 1]. A slot reports a miss
+   *               rate of 0 until it got 1/alpha samples.
+   */
+  MissRateTracker(double alpha, char delimiter);
+
+  size_t slot(folly::StringPiece key) const;
+
+  double missRate(size_t slot) const;
+
+  void record(size_t slot, bool miss);
+
+ private:
+  struct Slot {
+    double missRate{0};
+    uint32_t samples{0};
+  };
+
+  const double alpha_;
+  const uint32_t minSamples_;
+  const char delimiter_;
+  std::array<Slot, kSlots> slots_;
+};
+
+/**
+ * Customization point for MissFailoverRoute speculative lookup statistics.
+ *
+ * Routers that count them declare a non-template
+ * speculativeLookupEvent(const TheirRequest&, SpeculativeLookupEvent)
+ * next to their request type, which is found by argument dependent lookup.
+ */
+enum class SpeculativeLookupEvent {
+  /* The next child was sent the request before the current one missed */
+  SENT,
+  /* ... and its reply wasn't needed */
+  WASTED,
+};
+
+template <class Request>
+void speculativeLookupEvent(const Request& req, SpeculativeLookupEvent event) {
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "NegativeCache.h"
+
+#include <algorithm>
+
+#include <folly/SpookyHashV2.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+const uint8_t kMaxCounter = 0xf;
+
+}  // anonymous namespace
+
+constexpr size_t NegativeCache::kBuckets;
+constexpr size_t NegativeCache::kHashes;
+constexpr size_t NegativeCache::kCountersPerEntry;
+
+NegativeCache::NegativeCache(size_t maxEntries, std::chrono::milliseconds ttl)
+    : maxEntries_(std::max<size_t>(maxEntries, 1)),
+      numCounters_(maxEntries_ * kCountersPerEntry),
+      span_(std::max<Clock::duration>(ttl / kBuckets,
+                                      std::chrono::milliseconds(1))) {
+  for (auto& bucket : buckets_) {
+    bucket.counters.resize((numCounters_ + 1) / 2);
+  }
+}
+
+uint64_t NegativeCache::epoch(Clock::time_point now) const {
+  /* + kBuckets: buckets start at epoch 0, which must never look live */
+  return now.time_since_epoch() / span_ + kBuckets;
+}
+
+bool NegativeCache::live(const Bucket& bucket, uint64_t nowEpoch) const {
+  return bucket.epoch + kBuckets > nowEpoch;
+}
+
+NegativeCache::Positions NegativeCache::positions(
+    folly::StringPiece key) const {
+  uint64_t h1 = 0;
+  uint64_t h2 = 0;
+  folly::hash::SpookyHashV2::Hash128(key.data(), key.size(), &h1, &h2);
+  Positions pos;
+  for (size_t i = 0; i < kHashes; ++i) {
+    pos[i] = (h1 + i * h2) % numCounters_;
+  }
+  return pos;
+}
+
+uint8_t NegativeCache::counter(const Bucket& bucket, size_t pos) const {
+  return (bucket.counters[pos / 2] >> (pos % 2 * 4)) & kMaxCounter;
+}
+
+void NegativeCache::setCounter(Bucket& bucket, size_t pos, uint8_t value) {
+  auto shift = pos % 2 * 4;
+  auto& byte = bucket.counters[pos / 2];
+  byte = (byte & ~(kMaxCounter << shift)) | (value << shift);
+}
+
+bool NegativeCache::containsIn(const Bucket& bucket,
+                               const Positions& pos) const {
+  for (auto p : pos) {
+    if (counter(bucket, p) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void NegativeCache::insert(folly::StringPiece key, Clock::time_point now) {
+  auto nowEpoch = epoch(now);
+  auto& bucket = buckets_[nowEpoch % kBuckets];
+  if (bucket.epoch != nowEpoch) {
+    std::fill(bucket.counters.begin(), bucket.counters.end(), 0);
+    bucket.epoch = nowEpoch;
+    bucket.inserts = 0;
+  }
+
+  auto pos = positions(key);
+  if (bucket.inserts >= maxEntries_ || containsIn(bucket, pos)) {
+    return;
+  }
+  ++bucket.inserts;
+  for (auto p : pos) {
+    auto value = counter(bucket, p);
+    if (value < kMaxCounter) {
+      setCounter(bucket, p, value + 1);
+    }
+  }
+}
+
+bool NegativeCache::contains(folly::StringPiece key,
+                             Clock::time_point now) const {
+  auto nowEpoch = epoch(now);
+  auto pos = positions(key);
+  for (const auto& bucket : buckets_) {
+    if (bucket.inserts > 0 && live(bucket, nowEpoch) &&
+        containsIn(bucket, pos)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void NegativeCache::remove(folly::StringPiece key) {
+  auto pos = positions(key);
+  for (auto& bucket : buckets_) {
+    if (bucket.inserts == 0 || !containsIn(bucket, pos)) {
+      continue;
+    }
+    /* If key was a false positive in this bucket, this can drop other keys:
+       they'll just miss in the target again */
+    for (auto p : pos) {
+      auto value = counter(bucket, p);
+      if (value < kMaxCounter) {
+        setCounter(bucket, p, value - 1);
+      }
+    }
+  }
+}
+
+void NegativeCache::clear() {
+  for (auto& bucket : buckets_) {
+    std::fill(bucket.counters.begin(), bucket.counters.end(), 0);
+    bucket.inserts = 0;
+  }
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Approximate set of recently missed keys (see NegativeCacheRoute):
+ * a counting Bloom filter split into kBuckets time buckets, so that
+ * entries expire together with their bucket, between 3/4 ttl and ttl
+ * after they were inserted.
+ *
+ * Counters are 4 bits, kCountersPerEntry counters per entry a bucket
+ * can hold; a bucket stops taking new keys once it holds maxEntries keys,
+ * so the false positive rate stays around 2.5% per bucket.
+ * Counters that reached the maximum stay there until the bucket expires.
+ *
+ * Not thread-safe.
+ */
+class NegativeCache {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kBuckets = 4;
+  static constexpr size_t kHashes = 4;
+  static constexpr size_t kCountersPerEntry = 8;
+
+  NegativeCache(size_t maxEntries, std::chrono::milliseconds ttl);
+
+  void insert(folly::StringPiece key, Clock::time_point now = Clock::now());
+
+  /**
+   * @return true if key was inserted and has not expired or been removed
+   *         since; may be wrong, but only in that direction.
+   */
+  bool contains(folly::StringPiece key,
+                Clock::time_point now = Clock::now()) const;
+
+  void remove(folly::StringPiece key);
+
+  void clear();
+
+ private:
+  using Positions = std::array<size_t, kHashes>;
+
+  struct Bucket {
+    /* Two counters per byte */
+    std::vector<uint8_t> counters;
+    uint64_t epoch{0};
+    size_t inserts{0};
+  };
+
+  const size_t maxEntries_;
+  const size_t numCounters_;
+  const Clock::duration span_;
+  std::array<Bucket, kBuckets> buckets_;
+
+  uint64_t epoch(Clock::time_point now) const;
+  bool live(const Bucket& bucket, uint64_t nowEpoch) const;
+  Positions positions(folly::StringPiece key) const;
+
+  uint8_t counter(const Bucket& bucket, size_t pos) const;
+  void setCounter(Bucket& bucket, size_t pos, uint8_t value);
+  bool containsIn(const Bucket& bucket, const Positions& pos) const;
+};
+
+/**
+ * Customization point for NegativeCacheRoute statistics.
+ *
+ * Routers that count them declare a non-template
+ * negativeCacheEvent(const TheirRequest&, NegativeCacheEvent)
+ * next to their request type, which is found by argument dependent lookup.
+ */
+enum class NegativeCacheEvent {
+  /* The key was found in the negative cache */
+  HIT,
+  /* ... but the target found the key */
+  FALSE_POSITIVE,
+};
+
+template <class Request>
+void negativeCacheEvent(const Request& req, NegativeCacheEvent event) {
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,214 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <folly/Bits.h>
+#include <folly/Range.h>
+#include <folly/SpookyHashV2.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Immutable string-keyed map with a collision free slot for every key,
+ * built once (e.g. at config load) with "hash and displace": keys are
+ * hashed into small buckets and each bucket gets the displacement that
+ * lands all of its keys on free slots.
+ *
+ * find() is one hash of the key, two array reads and one key compare,
+ * with no allocation and no probing. Entries are kept sorted by key, so
+ * iteration order is deterministic. Safe to share between threads.
+ */
+template <class T>
+class PerfectHashMap {
+ public:
+  using value_type = std::pair<std::string, T>;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+  PerfectHashMap() = default;
+
+  /**
+   * @throws std::logic_error if a key is repeated
+   */
+  explicit PerfectHashMap(std::vector<value_type> entries)
+      : entries_(std::move(entries)) {
+
+    std::sort(entries_.begin(), entries_.end(),
+              [](const value_type& a, const value_type& b) {
+                return a.first < b.first;
+              });
+    for (size_t i = 1; i < entries_.size(); ++i) {
+      if (entries_[i - 1].first == entries_[i].first) {
+        throw std::logic_error("PerfectHashMap: duplicate key " +
+                               entries_[i].first);
+      }
+    }
+    if (entries_.empty()) {
+      return;
+    }
+
+    /* ~25% free slots keep the displacement search short */
+    auto tableSize = folly::nextPowTwo(entries_.size() + entries_.size() / 4);
+    while (!build(tableSize)) {
+      tableSize *= 2;
+    }
+  }
+
+  const_iterator find(folly::StringPiece key) const {
+    if (entries_.empty()) {
+      return entries_.end();
+    }
+    auto h = hash(key);
+    auto idx = slots_[slotOf(h, displacements_[h.bucket])];
+    if (idx == kEmpty || entries_[idx].first != key) {
+      return entries_.end();
+    }
+    return entries_.begin() + idx;
+  }
+
+  size_t count(folly::StringPiece key) const {
+    return find(key) != end() ? 1 : 0;
+  }
+
+  const_iterator begin() const {
+    return entries_.begin();
+  }
+
+  const_iterator end() const {
+    return entries_.end();
+  }
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  bool empty() const {
+    return entries_.empty();
+  }
+
+ private:
+  static constexpr uint32_t kEmpty = static_cast<uint32_t>(-1);
+  /* Average keys per bucket */
+  static constexpr size_t kBucketSize = 4;
+
+  struct Hash {
+    size_t bucket;
+    uint32_t base;
+    uint32_t step;
+  };
+
+  /* slot = (base + d0 * step + d1) & mask */
+  struct Displacement {
+    uint32_t d0{0};
+    uint32_t d1{0};
+  };
+
+  std::vector<value_type> entries_;
+  /* Entry index per slot */
+  std::vector<uint32_t> slots_;
+  std::vector<Displacement> displacements_;
+  uint32_t mask_{0};
+
+  Hash hash(folly::StringPiece key) const {
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+    folly::hash::SpookyHashV2::Hash128(key.data(), key.size(), &h1, &h2);
+    /* odd step, so that d0 = 0..mask visits every slot */
+    return {h1 % displacements_.size(),
+            static_cast<uint32_t>(h2),
+            static_cast<uint32_t>(h2 >> 32) | 1};
+  }
+
+  uint32_t slotOf(const Hash& h, const Displacement& d) const {
+    return (h.base + d.d0 * h.step + d.d1) & mask_;
+  }
+
+  /**
+   * @return false if some bucket couldn't be placed in tableSize slots
+   */
+  bool build(size_t tableSize) {
+    mask_ = tableSize - 1;
+    slots_.assign(tableSize, kEmpty);
+    displacements_.assign(
+      std::max<size_t>(1, (entries_.size() + kBucketSize - 1) / kBucketSize),
+      Displacement());
+
+    std::vector<std::vector<std::pair<uint32_t, Hash>>> buckets(
+      displacements_.size());
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      auto h = hash(entries_[i].first);
+      buckets[h.bucket].emplace_back(i, h);
+    }
+
+    /* Largest buckets first, while most slots are still free */
+    std::vector<size_t> order(buckets.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&buckets](size_t a, size_t b) {
+                       return buckets[a].size() > buckets[b].size();
+                     });
+
+    std::vector<uint32_t> placed;
+    for (auto b : order) {
+      const auto& bucket = buckets[b];
+      if (bucket.empty()) {
+        break;
+      }
+      bool found = false;
+      Displacement d;
+      for (d.d0 = 0; d.d0 <= mask_ && !found; ++d.d0) {
+        for (d.d1 = 0; d.d1 <= mask_ && !found; ++d.d1) {
+          found = tryPlace(bucket, d, placed);
+        }
+      }
+      if (!found) {
+        return false;
+      }
+      /* the loops incremented past the displacement that fit */
+      --d.d0;
+      --d.d1;
+      displacements_[b] = d;
+    }
+    return true;
+  }
+
+  bool tryPlace(const std::vector<std::pair<uint32_t, Hash>>& bucket,
+                const Displacement& d, std::vector<uint32_t>& placed) {
+    placed.clear();
+    for (const auto& it : bucket) {
+      auto slot = slotOf(it.second, d);
+      if (slots_[slot] != kEmpty) {
+        for (auto s : placed) {
+          slots_[s] = kEmpty;
+        }
+        return false;
+      }
+      slots_[slot] = it.first;
+      placed.push_back(slot);
+    }
+    return true;
+  }
+};
+
+template <class T>
+constexpr uint32_t PerfectHashMap<T>::kEmpty;
+
+template <class T>
+constexpr size_t PerfectHashMap<T>::kBucketSize;
+
+}}  // facebook::memcache
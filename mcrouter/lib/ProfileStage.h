@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include <folly/Likely.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * What a thread is busy with, for a sampling profiler.
+ */
+enum class ProfileStage : uintptr_t {
+  kOther = 0,
+  /* Parsing requests or replies read from a socket */
+  kParse = 1,
+  /* Running route handles */
+  kRoute = 2,
+  /* Serializing requests or replies */
+  kSerialize = 3,
+  /* Handing serialized data to the socket */
+  kWrite = 4,
+};
+
+constexpr size_t kNumProfileStages = 5;
+constexpr uintptr_t kProfileStageMask = 7;
+
+/**
+ * The thread's profile slot: a word written only by the thread, which
+ * a sampling profiler reads from another thread. The low bits
+ * (kProfileStageMask) are the ProfileStage, the rest is owned by the
+ * profiler (e.g. the route handle being run, see StageProfiler).
+ *
+ * nullptr unless a profiler registered one for this thread; the markers
+ * below are no-ops while it is.
+ */
+inline std::atomic<uintptr_t>*& threadProfileSlot() {
+  static __thread std::atomic<uintptr_t>* slot = nullptr;
+  return slot;
+}
+
+/**
+ * Sets the stage of the thread's profile slot for the lifetime of this
+ * object, keeping the profiler's bits.
+ */
+class ProfileStageScope {
+ public:
+  explicit ProfileStageScope(ProfileStage stage)
+      : slot_(threadProfileSlot()) {
+    if (UNLIKELY(slot_ != nullptr)) {
+      prev_ = slot_->load(std::memory_order_relaxed);
+      slot_->store((prev_ & ~kProfileStageMask) |
+                   static_cast<uintptr_t>(stage),
+                   std::memory_order_relaxed);
+    }
+  }
+
+  ~ProfileStageScope() {
+    if (UNLIKELY(slot_ != nullptr)) {
+      slot_->store(prev_, std::memory_order_relaxed);
+    }
+  }
+
+  ProfileStageScope(const ProfileStageScope&) = delete;
+  ProfileStageScope& operator=(const ProfileStageScope&) = delete;
+
+ private:
+  std::atomic<uintptr_t>* slot_;
+  uintptr_t prev_{0};
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,43 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Customization point for ReplicationQueueRoute statistics.
+ *
+ * Routers that count them declare a non-template
+ * replicationEvent(const TheirRequest&, ReplicationEvent, int64_t)
+ * next to their request type, which is found by argument dependent lookup.
+ * req is the queued copy of the request.
+ */
+enum class ReplicationEvent {
+  /* A copy was queued for the remote route */
+  QUEUED,
+  /* ... or dropped because the queue was full */
+  DROPPED,
+  /* The remote route failed, the copy is queued again */
+  RETRIED,
+  /* The remote route replied, lagUs after the copy was first queued */
+  DONE,
+  /* ... or failed for the last time, the copy is dropped */
+  FAILED,
+};
+
+template <class Request>
+void replicationEvent(const Request& req,
+                      ReplicationEvent event,
+                      int64_t lagUs) {
+}
+
+}}  // facebook::memcache
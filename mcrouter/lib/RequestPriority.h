@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mcrouter/lib/McOperationTraits.h"
+#include "mcrouter/lib/OperationTraits.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Classes of requests sharing a connection. AsyncMcClient queues each class
+ * in its own lane, so that background traffic doesn't hold up foreground
+ * requests (see ConnectionOptions::priorityWeights).
+ */
+enum class RequestPriority : uint8_t {
+  FOREGROUND_GET,
+  FOREGROUND_WRITE,
+  SHADOW,
+  /* fills of cold caches (WarmUpRoute) */
+  WARMUP,
+  ASYNCLOG_REPLAY,
+};
+
+constexpr size_t kNumRequestPriorities = 5;
+
+/**
+ * Priority of a request nothing marked as background.
+ */
+template <class Operation>
+constexpr RequestPriority foregroundPriority(Operation) {
+  return GetLike<Operation>::value ? RequestPriority::FOREGROUND_GET
+                                   : RequestPriority::FOREGROUND_WRITE;
+}
+
+/**
+ * Customization point for routes that generate background requests
+ * (e.g. WarmUpRoute fills).
+ *
+ * Routers that send requests with priorities declare a non-template
+ * overload next to their request type, which is found by argument
+ * dependent lookup. Without it, the marks are ignored.
+ */
+template <class Request>
+void setBackgroundPriority(Request& req, RequestPriority priority) {
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "RetryBudget.h"
+
+#include <algorithm>
+
+namespace facebook { namespace memcache {
+
+constexpr size_t RetryBudget::kBuckets;
+
+RetryBudget::RetryBudget(uint32_t ratioPct, uint32_t minPerSec,
+                         std::chrono::milliseconds window)
+    : ratioPct_(ratioPct),
+      minRetries_(static_cast<uint64_t>(minPerSec) *
+                  std::max<int64_t>(window.count(), 0) / 1000),
+      span_(std::max<Clock::duration>(window / kBuckets,
+                                      std::chrono::milliseconds(1))) {
+}
+
+uint64_t RetryBudget::epoch(Clock::time_point now) const {
+  /* + kBuckets: buckets start at epoch 0, which must never look live */
+  return now.time_since_epoch() / span_ + kBuckets;
+}
+
+RetryBudget::Bucket& RetryBudget::current(uint64_t nowEpoch) {
+  auto& bucket = buckets_[nowEpoch % kBuckets];
+  if (bucket.epoch != nowEpoch) {
+    bucket = Bucket();
+    bucket.epoch = nowEpoch;
+  }
+  return bucket;
+}
+
+void RetryBudget::onRequest(Clock::time_point now) {
+  ++current(epoch(now)).requests;
+}
+
+bool RetryBudget::tryRetry(Clock::time_point now) {
+  auto nowEpoch = epoch(now);
+  uint64_t requests = 0;
+  uint64_t retries = 0;
+  for (const auto& bucket : buckets_) {
+    if (bucket.epoch + kBuckets > nowEpoch) {
+      requests += bucket.requests;
+      retries += bucket.retries;
+    }
+  }
+  if (retries >= requests * ratioPct_ / 100 + minRetries_) {
+    return false;
+  }
+  ++current(nowEpoch).retries;
+  return true;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Limits retries (e.g. failovers) to ratioPct percent of the requests
+ * seen over a sliding window, plus minPerSec retries per second so that
+ * low traffic can still fail over. Once a destination goes bad, this
+ * keeps the extra load on the others bounded instead of multiplying it
+ * by the number of failover targets.
+ *
+ * The window is split into kBuckets time buckets, which expire together.
+ *
+ * Not thread-safe.
+ */
+class RetryBudget {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kBuckets = 10;
+
+  RetryBudget(uint32_t ratioPct, uint32_t minPerSec,
+              std::chrono::milliseconds window);
+
+  /**
+   * Counts a request that may be retried.
+   */
+  void onRequest(Clock::time_point now = Clock::now());
+
+  /**
+   * @return true (and counts the retry) if the budget allows one more
+   *         retry right now.
+   */
+  bool tryRetry(Clock::time_point now = Clock::now());
+
+ private:
+  struct Bucket {
+    uint64_t epoch{0};
+    uint64_t requests{0};
+    uint64_t retries{0};
+  };
+
+  const uint32_t ratioPct_;
+  const uint64_t minRetries_;
+  const Clock::duration span_;
+  std::array<Bucket, kBuckets> buckets_;
+
+  uint64_t epoch(Clock::time_point now) const;
+  Bucket& current(uint64_t nowEpoch);
+};
+
+/**
+ * Customization points for failover retry budgets (see FailoverRoute).
+ *
+ * Routers that limit failovers declare non-template overloads next to
+ * their request type, which are found by argument dependent lookup.
+ * Without them, failovers are not limited.
+ */
+
+/**
+ * Called once for each request a failover route sends to its primary.
+ */
+template <class Request>
+void failoverPrimaryRequest(const Request& req) {
+}
+
+/**
+ * Called before a failed request is sent to another failover target.
+ *
+ * @return false if the budget is used up: the route gives up and returns
+ *         the last error reply.
+ */
+template <class Request>
+bool failoverAllowed(const Request& req) {
+  return true;
+}
+
+/**
+ * Called before a request is sent to another target of a failover route
+ * for any reason (error, miss, hedging).
+ *
+ * @return true if the request has no time left for another attempt:
+ *         the route returns the reply it has.
+ */
+template <class Request>
+bool requestDeadlineExceeded(const Request& req) {
+  return false;
+}
+
+}}  // facebook::memcache
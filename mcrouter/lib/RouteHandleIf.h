@@ -9,7 +9,10 @@
  */
 #pragma once
 
+#include <typeinfo>
+
 #include "mcrouter/lib/fbi/cpp/TypeList.h"
+#include "mcrouter/lib/RouteTracing.h"
 
 namespace facebook { namespace memcache {
 
@@ -61,9 +64,42 @@ class RouteHandle<Route, RouteHandleIf, List<>, OpList, op_id> :
     return name + (name_.empty() ? "" : ":" + name_);
   }
 
+  bool knownDead() const {
+    return knownDeadImpl(route_, 0);
+  }
+
+  bool routesInline() const {
+    return routesInlineImpl(route_, 0);
+  }
+
  protected:
   std::string name_;
   Route route_;
+
+ private:
+  /* Routes can define knownDead(), the others are never known dead */
+  template <class R>
+  static auto knownDeadImpl(const R& route, int)
+      -> decltype(route.knownDead()) {
+    return route.knownDead();
+  }
+
+  template <class R>
+  static bool knownDeadImpl(const R&, long) {
+    return false;
+  }
+
+  /* Same for routesInline(), the others may block */
+  template <class R>
+  static auto routesInlineImpl(const R& route, int)
+      -> decltype(route.routesInline()) {
+    return route.routesInline();
+  }
+
+  template <class R>
+  static bool routesInlineImpl(const R&, long) {
+    return false;
+  }
 };
 
 template<typename Route,
@@ -149,6 +185,8 @@ class RouteHandle<Route,
 
   typename ReplyType<typename OpList::template Item<op_id>::op, Request>::type
   route(const Request& req, typename OpList::template Item<op_id>::op) {
+    auto span = startRouteSpan(req, typeid(Route).name());
+    (void)span;
     return this->route_.route(req, typename OpList::template Item<op_id>::op());
   }
 };
@@ -170,6 +208,20 @@ class RouteHandleIf<RouteHandleIf_, List<Request>, OpList, 1> {
    */
   virtual std::string routeName() const = 0;
 
+  /**
+   * True if any request routed here is known to get a TKO reply right away,
+   * e.g. all destinations under this route handle are TKO. Parents can skip
+   * known dead children. Must be cheap, it can be called for every request.
+   */
+  virtual bool knownDead() const = 0;
+
+  /**
+   * True if route() always returns right away, without blocking or adding
+   * fiber tasks (e.g. NullRoute, ErrorRoute), so that it can also be called
+   * outside of a fiber. Must be cheap, it can be called for every request.
+   */
+  virtual bool routesInline() const = 0;
+
   /**
    * Returns a list of all possible route handles this route handle could
    * send a request to (for debugging)
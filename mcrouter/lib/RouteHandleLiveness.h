@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Process wide counter, bumped every time a leaf route handle may have
+ * changed between known dead and alive (see RouteHandleIf::knownDead()),
+ * e.g. a destination was marked TKO or came back.
+ */
+inline std::atomic<uint64_t>& routeLivenessEpoch() {
+  static std::atomic<uint64_t> epoch{1};
+  return epoch;
+}
+
+inline void bumpRouteLivenessEpoch() {
+  routeLivenessEpoch().fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * "All children are known dead" bit of a route handle with many children,
+ * recomputed only when routeLivenessEpoch() changes, so that asking is
+ * O(1) while no destination changes state.
+ */
+class AllDeadCache {
+ public:
+  AllDeadCache() = default;
+
+  /* Copies start over, the children may differ */
+  AllDeadCache(const AllDeadCache&) {}
+  AllDeadCache& operator=(const AllDeadCache&) {
+    state_.store(0, std::memory_order_relaxed);
+    return *this;
+  }
+
+  template <class RouteHandleIf>
+  bool allDead(
+      const std::vector<std::shared_ptr<RouteHandleIf>>& children) const {
+    auto epoch = routeLivenessEpoch().load(std::memory_order_acquire);
+    auto cached = state_.load(std::memory_order_relaxed);
+    if ((cached >> 1) == epoch) {
+      return cached & 1;
+    }
+
+    bool dead = !children.empty();
+    for (const auto& child : children) {
+      if (!child->knownDead()) {
+        dead = false;
+        break;
+      }
+    }
+    state_.store((epoch << 1) | dead, std::memory_order_relaxed);
+    return dead;
+  }
+
+ private:
+  /* (epoch << 1) | dead, 0 if never computed */
+  mutable std::atomic<uint64_t> state_{0};
+};
+
+}}  // facebook::memcache
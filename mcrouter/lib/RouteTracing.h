@@ -0,0 +1,32 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+namespace facebook { namespace memcache {
+
+struct NoRouteSpan {
+};
+
+/**
+ * Customization point called by RouteHandle::route() for every route
+ * handle a request goes through, with the mangled name of the route type.
+ *
+ * Routers that trace requests declare a non-template
+ * startRouteSpan(const TheirRequest&, const char*) next to their request
+ * type, which is found by argument dependent lookup. It returns an object
+ * that records the span when destroyed, after the route returns.
+ * Without one, nothing is recorded.
+ */
+template <class Request>
+NoRouteSpan startRouteSpan(const Request& req, const char* route) {
+  return NoRouteSpan();
+}
+
+}}  // facebook::memcache
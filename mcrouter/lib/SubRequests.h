@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "mcrouter/lib/fibers/ForEach.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Customization points for subrequests a route stops waiting for: the
+ * children of AllMajorityRoute still running once a majority agreed,
+ * the asynchronous children of AllInitialRoute.
+ *
+ * Routers that limit such detached subrequests declare non-template
+ * overloads next to their request type, which are found by argument
+ * dependent lookup (like startRouteSpan()). Without them, detached
+ * subrequests are neither limited nor counted.
+ */
+
+/**
+ * Called on the shared copy of a request before it's sent to children
+ * that may be detached later. Clones of req made afterwards must see
+ * a cancellation of req, see detachSubRequests().
+ */
+template <class Request>
+void enableCancellation(Request& req) {
+}
+
+/**
+ * Called when count subrequests made from req are detached: either the
+ * route returns while they are still in flight, or they are about to be
+ * sent without waiting for the reply.
+ *
+ * @return false if the subrequests are over the limit and cancelled:
+ *         subrequests not sent yet should not be sent, the ones in flight
+ *         (if req was passed to enableCancellation()) are not sent to any
+ *         other destination.
+ */
+template <class Request>
+bool detachSubRequests(Request& req, size_t count) {
+  return true;
+}
+
+/**
+ * Called when a detached subrequest made from req completes, whether it
+ * was cancelled or not.
+ */
+template <class Request>
+void detachedSubRequestDone(const Request& req) {
+}
+
+/**
+ * Called on a request about to be sent as is to several children, before
+ * it's cloned for them. Clones that reach a destination unchanged may then
+ * share one serialized form of the request.
+ */
+template <class Request>
+void enableSharedSerialization(const Request& req) {
+}
+
+/**
+ * One request of a fan-out, see routeSubRequests().
+ */
+template <class RouteHandleIf, class Request>
+struct SubRequest {
+  RouteHandleIf* rh;
+  const Request* req;
+};
+
+/**
+ * Routes every subReqs[i].req through subReqs[i].rh and calls f(i, reply)
+ * with its reply, returns once all the replies are in. The caller keeps
+ * the requests and route handles alive until then.
+ *
+ * Routers that can send several requests from one fiber (e.g. all of the
+ * ones for plain destinations) declare an overload next to their request
+ * type. This one routes each subrequest on a fiber of its own.
+ */
+template <class RouteHandleIf, class Request, class Operation, class F>
+void routeSubRequests(
+    const std::vector<SubRequest<RouteHandleIf, Request>>& subReqs,
+    Operation, F&& f) {
+  fiber::forEachBounded(
+    subReqs.size(), 0,
+    [&subReqs, &f] (size_t id) {
+      f(id, subReqs[id].rh->route(*subReqs[id].req, Operation()));
+    });
+}
+
+}}  // facebook::memcache
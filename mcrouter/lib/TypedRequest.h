@@ -0,0 +1,291 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#include <folly/io/IOBuf.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/IOBufUtil.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McRequestBase.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Opt-in alternative to McRequest that only carries the fields its
+ * operation uses, e.g. TypedRequest<mc_op_get> is a key and flags,
+ * TypedRequest<mc_op_incr> adds a delta. Route handles templated on
+ * Request (and the ascii serializer) take it as is; using a field
+ * the operation doesn't have is a compile error.
+ *
+ * Only defined for the operations with a TypedRequestFields
+ * specialization below.
+ */
+class TypedRequestBase {
+ public:
+  /* Request interface, see McRequestBase */
+
+  folly::StringPiece routingPrefix() const {
+    return keys_.routingPrefix;
+  }
+
+  folly::StringPiece routingKey() const {
+    return keys_.routingKey;
+  }
+
+  uint32_t routingKeyHash() const {
+    return static_cast<uint32_t>(routingKeyDigest());
+  }
+
+  uint64_t routingKeyDigest() const {
+    if (!keys_.hasRoutingKeyDigest) {
+      keys_.computeRoutingKeyDigest();
+    }
+    return keys_.routingKeyDigest;
+  }
+
+  uint64_t routingKeyFurcDigest() const {
+    if (!keys_.hasFurcDigest) {
+      keys_.computeFurcDigest();
+    }
+    return keys_.furcDigest;
+  }
+
+  folly::StringPiece keyWithoutRoute() const {
+    return keys_.keyWithoutRoute;
+  }
+
+  folly::StringPiece fullKey() const {
+    return getRange(keyData_);
+  }
+
+  const folly::IOBuf& key() const {
+    return keyData_;
+  }
+
+  void setKey(folly::StringPiece k) {
+    setKey(folly::IOBuf(folly::IOBuf::COPY_BUFFER, k));
+  }
+
+  void setKey(folly::IOBuf keyData) {
+    keyData_ = std::move(keyData);
+    keyData_.coalesce();
+    keys_.update(getRange(keyData_));
+  }
+
+  void stripRoutingPrefix() {
+    keyData_.trimStart(keys_.routingPrefix.size());
+    keys_.routingPrefix.clear();
+  }
+
+  uint64_t flags() const {
+    return flags_;
+  }
+
+  void setFlags(uint64_t f) {
+    flags_ = f;
+  }
+
+ protected:
+  explicit TypedRequestBase(folly::StringPiece key) {
+    setKey(key);
+  }
+
+  TypedRequestBase(const TypedRequestBase& other)
+      : flags_(other.flags_) {
+    // Key is always a single piece, so it's safe to do cloneOneInto.
+    other.keyData_.cloneOneInto(keyData_);
+    keys_ = McRequestBase::Keys(getRange(keyData_));
+    keys_.copyDigests(other.keys_);
+  }
+
+  TypedRequestBase(TypedRequestBase&&) noexcept = default;
+  TypedRequestBase& operator=(TypedRequestBase&&) = default;
+
+ private:
+  /* Always stored unchained */
+  folly::IOBuf keyData_;
+  McRequestBase::Keys keys_;
+  uint64_t flags_{0};
+};
+
+/* Fields shared by several operations */
+
+class TypedRequestExptime {
+ public:
+  uint32_t exptime() const {
+    return exptime_;
+  }
+
+  void setExptime(uint32_t expt) {
+    exptime_ = expt;
+  }
+
+ private:
+  uint32_t exptime_{0};
+};
+
+class TypedRequestValue : public TypedRequestExptime {
+ public:
+  TypedRequestValue() = default;
+  TypedRequestValue(const TypedRequestValue& other)
+      : TypedRequestExptime(other) {
+    other.valueData_.cloneInto(valueData_);
+  }
+  TypedRequestValue(TypedRequestValue&&) noexcept = default;
+  TypedRequestValue& operator=(TypedRequestValue&&) = default;
+
+  const folly::IOBuf& value() const {
+    return valueData_;
+  }
+
+  void setValue(folly::IOBuf valueData) {
+    valueData_ = std::move(valueData);
+  }
+
+  /**
+   * Note: coalesces the value if it's chained.
+   */
+  folly::StringPiece valueRangeSlow() const {
+    return coalesceAndGetRange(valueData_);
+  }
+
+ private:
+  /* May be chained */
+  mutable folly::IOBuf valueData_;
+};
+
+class TypedRequestDelta {
+ public:
+  uint64_t delta() const {
+    return delta_;
+  }
+
+  void setDelta(uint64_t d) {
+    delta_ = d;
+  }
+
+ private:
+  uint64_t delta_{0};
+};
+
+class TypedRequestCas {
+ public:
+  uint64_t cas() const {
+    return cas_;
+  }
+
+  void setCas(uint64_t c) {
+    cas_ = c;
+  }
+
+ private:
+  uint64_t cas_{0};
+};
+
+class TypedRequestLeaseToken {
+ public:
+  uint64_t leaseToken() const {
+    return leaseToken_;
+  }
+
+  void setLeaseToken(uint64_t lt) {
+    leaseToken_ = lt;
+  }
+
+ private:
+  uint64_t leaseToken_{0};
+};
+
+/**
+ * Fields of TypedRequest<op> besides the key and flags.
+ */
+template <int op>
+struct TypedRequestFields;
+
+// Get-like ops.
+template <>
+struct TypedRequestFields<mc_op_get> {};
+
+template <>
+struct TypedRequestFields<mc_op_gets> {};
+
+template <>
+struct TypedRequestFields<mc_op_metaget> {};
+
+template <>
+struct TypedRequestFields<mc_op_lease_get> {};
+
+// Update-like ops.
+template <>
+struct TypedRequestFields<mc_op_set> : TypedRequestValue {};
+
+template <>
+struct TypedRequestFields<mc_op_add> : TypedRequestValue {};
+
+template <>
+struct TypedRequestFields<mc_op_replace> : TypedRequestValue {};
+
+template <>
+struct TypedRequestFields<mc_op_append> : TypedRequestValue {};
+
+template <>
+struct TypedRequestFields<mc_op_prepend> : TypedRequestValue {};
+
+template <>
+struct TypedRequestFields<mc_op_cas>
+    : TypedRequestValue, TypedRequestCas {};
+
+template <>
+struct TypedRequestFields<mc_op_lease_set>
+    : TypedRequestValue, TypedRequestLeaseToken {};
+
+// Arithmetic ops.
+template <>
+struct TypedRequestFields<mc_op_incr> : TypedRequestDelta {};
+
+template <>
+struct TypedRequestFields<mc_op_decr> : TypedRequestDelta {};
+
+// Delete op.
+template <>
+struct TypedRequestFields<mc_op_delete> : TypedRequestExptime {};
+
+template <int op>
+class TypedRequest : public TypedRequestBase, public TypedRequestFields<op> {
+ public:
+  static const mc_op_t mc_op = (mc_op_t)op;
+
+  explicit TypedRequest(folly::StringPiece key)
+    : TypedRequestBase(key) {}
+
+  TypedRequest(TypedRequest&& other) noexcept = default;
+  TypedRequest& operator=(TypedRequest&& other) = default;
+
+  TypedRequest clone() const {
+    return TypedRequest(*this);
+  }
+
+ private:
+  TypedRequest(const TypedRequest& other) = default;
+};
+
+/**
+ * Typed requests get the usual McReply.
+ */
+template <typename Operation, int op>
+struct ReplyType<Operation, TypedRequest<op>> {
+  typedef class McReply type;
+};
+
+}}  // facebook::memcache
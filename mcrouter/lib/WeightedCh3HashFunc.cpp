@@ -46,6 +46,11 @@ WeightedCh3HashFunc::WeightedCh3HashFunc(const folly::dynamic& json, size_t n) {
 }
 
 size_t WeightedCh3HashFunc::operator()(folly::StringPiece key) const {
+  return (*this)(key, FurcDigest{furc_key_digest(key.data(), key.size())});
+}
+
+size_t WeightedCh3HashFunc::operator()(folly::StringPiece key,
+                                       FurcDigest digest) const {
   auto n = weights_.size();
   checkLogic(n && n <= furc_maximum_pool_size(), "Invalid pool size: {}", n);
   size_t salt = 0;
@@ -53,7 +58,8 @@ size_t WeightedCh3HashFunc::operator()(folly::StringPiece key) const {
   std::string saltedKey;
   auto originalKey = key;
   for (size_t i = 0; i < kNumTries; ++i) {
-    index = furc_hash(key.data(), key.size(), n);
+    index = i == 0 ? furc_hash_digest(digest.value, n)
+                   : furc_hash(key.data(), key.size(), n);
 
     /* Use 32-bit hash, but store in 64-bit ints so that
        we don't have to deal with overflows */
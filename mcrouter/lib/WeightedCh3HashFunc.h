@@ -13,6 +13,8 @@
 
 #include <folly/Range.h>
 
+#include "mcrouter/lib/Ch3HashFunc.h"
+
 namespace folly {
 class dynamic;
 }
@@ -56,6 +58,9 @@ class WeightedCh3HashFunc {
 
   size_t operator()(folly::StringPiece key) const;
 
+  /* Same as above, the first try uses the digest instead of the key */
+  size_t operator()(folly::StringPiece key, FurcDigest digest) const;
+
   /**
    * @return Saved weights.
    */
@@ -0,0 +1,155 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "WeightedMaglevHashFunc.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <mutex>
+
+#include <folly/dynamic.h>
+#include <folly/SpookyHashV2.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+namespace facebook { namespace memcache {
+
+namespace {
+const uint64_t kOffsetSeed = 0x6f666673;
+const uint64_t kSkipSeed = 0x736b6970;
+const uint32_t kEmptySlot = std::numeric_limits<uint32_t>::max();
+
+bool isPrime(size_t x) {
+  if (x < 2) {
+    return false;
+  }
+  for (size_t d = 2; d * d <= x; ++d) {
+    if (x % d == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t nextPrime(size_t x) {
+  while (!isPrime(x)) {
+    ++x;
+  }
+  return x;
+}
+
+}  // anonymous namespace
+
+constexpr size_t WeightedMaglevHashFunc::kSlotsPerServer;
+constexpr size_t WeightedMaglevHashFunc::kMaxTableSize;
+
+WeightedMaglevHashFunc::WeightedMaglevHashFunc(std::vector<double> weights)
+    : weights_(std::move(weights)),
+      table_(getTable(weights_)) {
+}
+
+WeightedMaglevHashFunc::WeightedMaglevHashFunc(const folly::dynamic& json,
+                                               size_t n) {
+  checkLogic(json.isObject() && json.count("weights"),
+             "WeightedMaglevHashFunc: not an object or no weights");
+  checkLogic(json["weights"].isArray(),
+             "WeightedMaglevHashFunc: weights is not array");
+  const auto& jWeights = json["weights"];
+  LOG_IF(ERROR, jWeights.size() < n)
+    << "WeightedMaglevHashFunc: CONFIG IS BROKEN!!! number of weights ("
+    << jWeights.size() << ") is smaller than number of servers (" << n
+    << "). Missing weights are set to 0.5";
+  for (size_t i = 0; i < std::min(n, jWeights.size()); ++i) {
+    const auto& weight = jWeights[i];
+    checkLogic(weight.isNumber(),
+               "WeightedMaglevHashFunc: weight is not number");
+    weights_.push_back(weight.asDouble());
+  }
+  weights_.resize(n, 0.5);
+  table_ = getTable(weights_);
+}
+
+size_t WeightedMaglevHashFunc::operator()(folly::StringPiece key) const {
+  return (*this)(key, getMemcacheKeyDigest(key));
+}
+
+std::shared_ptr<const WeightedMaglevHashFunc::Table>
+WeightedMaglevHashFunc::getTable(const std::vector<double>& weights) {
+  static std::mutex lock;
+  static std::map<std::vector<double>, std::weak_ptr<const Table>> tables;
+
+  std::lock_guard<std::mutex> guard(lock);
+  auto& cached = tables[weights];
+  if (auto table = cached.lock()) {
+    return table;
+  }
+  auto table = buildTable(weights);
+  cached = table;
+
+  /* Drop tables of pools that are gone */
+  for (auto it = tables.begin(); it != tables.end();) {
+    if (it->second.expired()) {
+      it = tables.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return table;
+}
+
+std::shared_ptr<const WeightedMaglevHashFunc::Table>
+WeightedMaglevHashFunc::buildTable(const std::vector<double>& weights) {
+  auto n = weights.size();
+  checkLogic(n && n < kEmptySlot / 2,
+             "Invalid pool size: {}", n);
+  double maxWeight = 0;
+  for (auto w : weights) {
+    checkLogic(0 <= w && w <= 1.0,
+               "WeightedMaglevHashFunc: weight {} is not in [0, 1]", w);
+    maxWeight = std::max(maxWeight, w);
+  }
+
+  auto m = nextPrime(std::max(2 * n, std::min(n * kSlotsPerServer,
+                                              kMaxTableSize)));
+  std::vector<uint64_t> pos(n);
+  std::vector<uint64_t> skip(n);
+  std::vector<double> turns(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    pos[i] = folly::hash::SpookyHashV2::Hash64(&i, sizeof(i), kOffsetSeed) % m;
+    skip[i] =
+      folly::hash::SpookyHashV2::Hash64(&i, sizeof(i), kSkipSeed) % (m - 1) + 1;
+    turns[i] = maxWeight > 0 ? weights[i] / maxWeight : 1.0;
+  }
+
+  /* Every round each server earns its relative weight in credit and claims
+     one slot per whole unit of credit, so the heaviest server claims a slot
+     every round. Since m is prime, each server's sequence pos + k * skip
+     visits every slot, so claiming always terminates. */
+  auto table = std::make_shared<Table>(m, kEmptySlot);
+  std::vector<double> credit(n, 0);
+  size_t filled = 0;
+  while (filled < m) {
+    for (size_t i = 0; i < n && filled < m; ++i) {
+      credit[i] += turns[i];
+      if (credit[i] < 1.0) {
+        continue;
+      }
+      credit[i] -= 1.0;
+      while ((*table)[pos[i]] != kEmptySlot) {
+        pos[i] = (pos[i] + skip[i]) % m;
+      }
+      (*table)[pos[i]] = i;
+      ++filled;
+    }
+  }
+  return table;
+}
+
+}}  // facebook::memcache
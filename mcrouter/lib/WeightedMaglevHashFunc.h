@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/Range.h>
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache {
+
+/**
+ * A weighted consistent hash function based on a Maglev lookup table.
+ *
+ * Each server is assigned a weight between 0.0 and 1.0 inclusive.
+ * The lookup table has m slots, m being a prime of about kSlotsPerServer * n
+ * (at most about kMaxTableSize). Every server has its own permutation of the
+ * slots (derived from the server index only) and servers take turns claiming
+ * their next free preferred slot, with a server of weight w taking w turns
+ * per turn of the heaviest server. Lookup is a single key hash:
+ *
+ *   index = table[getMemcacheKeyDigest(key) % m]
+ *
+ * so the cost doesn't depend on the weights, unlike WeightedCh3HashFunc
+ * which rehashes the key for every rejected server. HashRoute can pass in
+ * the digest cached on the request instead of hashing the key again.
+ *
+ * Changing a single weight mostly moves slots from/to that server only
+ * (the more slots per server, the closer to minimal the disruption is).
+ * If all weights are zero, all servers are treated as equal.
+ *
+ * The table is built by the constructor of the first instance with given
+ * weights. Later instances with the same weights (i.e. all proxies using the
+ * same pool) share it, so there's only one copy per process. A table is
+ * freed once no instance uses it.
+ *
+ * Note: the mapping is different from WeightedCh3HashFunc (which stays
+ * the default), so switching a pool between the two reshuffles its keys.
+ */
+class WeightedMaglevHashFunc {
+ public:
+  static constexpr size_t kSlotsPerServer = 1024;
+  static constexpr size_t kMaxTableSize = 1 << 22;
+
+  /**
+   * @param weights  A list of server weights.
+   *                 Pool size is taken to be weights.size()
+   */
+  explicit WeightedMaglevHashFunc(std::vector<double> weights);
+
+  WeightedMaglevHashFunc(const folly::dynamic& json, size_t n);
+
+  size_t operator()(folly::StringPiece key) const;
+
+  /**
+   * Same as operator()(key), but reuses the key's precomputed
+   * getMemcacheKeyDigest() (see McRequestBase::routingKeyDigest()).
+   */
+  size_t operator()(folly::StringPiece key, uint64_t keyDigest) const {
+    return (*table_)[keyDigest % table_->size()];
+  }
+
+  /**
+   * @return Saved weights.
+   */
+  const std::vector<double>& weights() const {
+    return weights_;
+  }
+
+  /**
+   * @return Number of slots in the lookup table.
+   */
+  size_t tableSize() const {
+    return table_->size();
+  }
+
+  static std::string type() {
+    return "WeightedMaglev";
+  }
+
+ private:
+  using Table = std::vector<uint32_t>;
+
+  std::vector<double> weights_;
+  std::shared_ptr<const Table> table_;
+
+  static std::shared_ptr<const Table> getTable(
+    const std::vector<double>& weights);
+  static std::shared_ptr<const Table> buildTable(
+    const std::vector<double>& weights);
+};
+
+}}  // facebook::memcache
@@ -9,20 +9,25 @@
  */
 #include "ConfigPreprocessor.h"
 
+#include <algorithm>
+#include <exception>
 #include <random>
+#include <thread>
 #include <unordered_set>
 
 #include <folly/Format.h>
 #include <folly/json.h>
 #include <folly/Memory.h>
 #include <folly/Random.h>
+#include <folly/SpookyHashV2.h>
 
 #include "mcrouter/lib/config/ImportResolverIf.h"
+#include "mcrouter/lib/config/JsonParser.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 
 using folly::StringPiece;
 using folly::dynamic;
-using folly::json::stripComments;
+using folly::hash::SpookyHashV2;
 using folly::make_unique;
 using std::placeholders::_1;
 using std::placeholders::_2;
@@ -33,17 +38,21 @@ namespace facebook { namespace memcache {
 
 namespace {
 
+/* Nesting depth of the current thread, macros of the top level config
+   properties are expanded by different threads. */
+thread_local size_t nestedDepth = 0;
+
 class NestedLimitGuard {
  public:
-  explicit NestedLimitGuard(size_t& nestedLimit)
-      : nestedLimit_(nestedLimit) {
-    checkLogic(--nestedLimit_ > 0, "Too many nested macros. Check for cycles.");
+  explicit NestedLimitGuard(size_t nestedLimit) {
+    if (++nestedDepth >= nestedLimit) {
+      --nestedDepth;
+      throw std::logic_error("Too many nested macros. Check for cycles.");
+    }
   }
   ~NestedLimitGuard() {
-    ++nestedLimit_;
+    --nestedDepth;
   }
- private:
-  size_t& nestedLimit_;
 };
 
 string asString(const dynamic& obj, StringPiece objName) {
@@ -161,8 +170,6 @@ size_t unescapeUntil(StringPiece from, string& to, char c) {
 
 } // namespace
 
-const ConfigPreprocessor::Context ConfigPreprocessor::emptyContext_;
-
 ///////////////////////////////Macro////////////////////////////////////////////
 
 class ConfigPreprocessor::Macro {
@@ -262,28 +269,48 @@ class ConfigPreprocessor::Const {
         dynamic result)
     : prep_(prep),
       name_(std::move(name)),
-      result_(std::move(result)) {
+      source_(std::move(result)) {
   }
 
+  /**
+   * Expands the const on first use. The lock is not held during expansion,
+   * so cyclic consts fail with nesting error instead of deadlocking. In the
+   * worst case concurrent callers expand the same const twice.
+   */
   const dynamic& getResult() const {
-    if (!expanded_) {
-      try {
-        result_ = prep_.expandMacros(std::move(result_),
-                                     ConfigPreprocessor::emptyContext_);
-      } catch (const std::logic_error& e) {
-        throw std::logic_error("Const '" + name_ + "':\n" + e.what());
-      }
-      expanded_ = true;
+    if (expanded_.load(std::memory_order_acquire)) {
+      return result_;
+    }
+    dynamic result;
+    try {
+      Context context;
+      result = prep_.expandMacros(source_, context);
+    } catch (const std::logic_error& e) {
+      throw std::logic_error("Const '" + name_ + "':\n" + e.what());
+    }
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!expanded_.load(std::memory_order_relaxed)) {
+      result_ = std::move(result);
+      expanded_.store(true, std::memory_order_release);
     }
     return result_;
   }
  private:
-  mutable bool expanded_{false};
+  mutable std::atomic<bool> expanded_{false};
+  mutable std::mutex lock_;
   const ConfigPreprocessor& prep_;
   const std::string name_;
+  const dynamic source_;
   mutable dynamic result_;
 };
 
+///////////////////////////////ImportResolverIf/////////////////////////////////
+
+std::shared_ptr<const dynamic>
+ImportResolverIf::importParsed(StringPiece path) {
+  return std::make_shared<const dynamic>(parseJsonWithComments(import(path)));
+}
+
 ///////////////////////////////////BuiltIns/////////////////////////////////////
 
 class ConfigPreprocessor::BuiltIns {
@@ -296,6 +323,7 @@ class ConfigPreprocessor::BuiltIns {
                              ImportResolverIf& importResolver,
                              Context ctx) {
     auto path = asString(ctx.at("path"), "import path");
+    std::lock_guard<std::recursive_mutex> lock(p->importLock_);
     // cache each result by path, so we won't import same path twice
     auto it = p->importCache_.find(path);
     if (it != p->importCache_.end()) {
@@ -303,10 +331,10 @@ class ConfigPreprocessor::BuiltIns {
     }
     dynamic result = nullptr;
     try {
-      auto jsonC = importResolver.import(path);
-      // result may contain comments, macros, etc.
-      result = p->expandMacros(parseJsonString(stripComments(jsonC)),
-                               ConfigPreprocessor::emptyContext_);
+      // result may contain macros
+      auto json = importResolver.importParsed(path);
+      Context context;
+      result = p->expandMacros(*json, context);
     } catch (const std::exception& e) {
       throw std::logic_error("Import '" + path + "':\n" + e.what());
     }
@@ -427,13 +455,17 @@ class ConfigPreprocessor::BuiltIns {
    *
    * Returns list or object with randomly shuffled items.
    */
-  static dynamic shuffleMacro(Context ctx) {
+  static dynamic shuffleMacro(const ConfigPreprocessor* p, Context ctx) {
     auto& dictionary = ctx.at("dictionary");
 
     checkLogic(dictionary.isObject() || dictionary.isArray(),
                "Shuffle: dictionary is not array/object");
 
+    // result is random, macros that use it should not be memoized
+    ++p->impureCalls_;
+    static std::mutex engineLock;
     static std::minstd_rand engine(folly::randomNumberSeed());
+    std::lock_guard<std::mutex> lock(engineLock);
     if (dictionary.isArray()) {
       for (size_t i = 0; i < dictionary.size(); ++i) {
         std::uniform_int_distribution<size_t> d(i, dictionary.size() - 1);
@@ -1207,8 +1239,10 @@ class ConfigPreprocessor::BuiltIns {
 
 ConfigPreprocessor::ConfigPreprocessor(ImportResolverIf& importResolver,
                                        Context globals,
-                                       size_t nestedLimit)
-  : nestedLimit_(nestedLimit) {
+                                       size_t nestedLimit,
+                                       Stats* stats)
+  : stats_(stats),
+    nestedLimit_(nestedLimit) {
 
   for (auto& it : globals) {
     auto constObj = make_unique<Const>(*this, it.first, std::move(it.second));
@@ -1232,7 +1266,8 @@ ConfigPreprocessor::ConfigPreprocessor(ImportResolverIf& importResolver,
 
   addBuiltInMacro("select", { "dictionary", "key" }, &BuiltIns::selectMacro);
 
-  addBuiltInMacro("shuffle", { "dictionary" }, &BuiltIns::shuffleMacro);
+  addBuiltInMacro("shuffle", { "dictionary" },
+                  std::bind(&BuiltIns::shuffleMacro, this, _1));
 
   addBuiltInMacro("slice", { "dictionary", "from", "to" },
                   &BuiltIns::sliceMacro);
@@ -1424,7 +1459,10 @@ dynamic ConfigPreprocessor::expandStringMacro(StringPiece str,
 
   const auto& inner = tryGet(macros_, nameStr, "Macro");
   try {
-    return inner->getResult(inner->getContext(std::move(innerParams)));
+    auto innerContext = inner->getContext(std::move(innerParams));
+    return measure(nameStr, [&inner, &innerContext]() {
+      return inner->getResult(std::move(innerContext));
+    });
   } catch (const std::logic_error& e) {
     throw std::logic_error("Macro in string '" + nameStr + "':\n" + e.what());
   }
@@ -1448,7 +1486,10 @@ dynamic ConfigPreprocessor::expandMacros(dynamic json,
         auto builtInIt = builtInCalls_.find(typeStr);
         if (builtInIt != builtInCalls_.end()) {
           try {
-            return builtInIt->second(std::move(json), context);
+            const auto& call = builtInIt->second;
+            return measure(typeStr, [&call, &json, &context]() {
+              return call(std::move(json), context);
+            });
           } catch (const std::logic_error& e) {
             throw std::logic_error("Built-in '" + typeStr + "':\n" + e.what());
           }
@@ -1467,7 +1508,9 @@ dynamic ConfigPreprocessor::expandMacros(dynamic json,
             }
           }
           try {
-            return inner->getResult(std::move(innerContext));
+            return measure(typeStr, [&inner, &innerContext]() {
+              return inner->getResult(std::move(innerContext));
+            });
           } catch (const std::logic_error& e) {
             throw std::logic_error("Macro '" + typeStr + "':\n" + e.what());
           }
@@ -1507,8 +1550,137 @@ dynamic ConfigPreprocessor::expandMacros(dynamic json,
   }
 }
 
+dynamic ConfigPreprocessor::expandConfig(dynamic config,
+                                         size_t numThreads) const {
+  if (numThreads <= 1 || !config.isObject() || config.size() < 2 ||
+      config.get_ptr("type")) {
+    Context context;
+    return expandMacros(std::move(config), context);
+  }
+
+  struct Item {
+    dynamic* key;
+    dynamic* value;
+    dynamic nKey;
+    dynamic nValue;
+    std::exception_ptr error;
+  };
+  vector<Item> items;
+  items.reserve(config.size());
+  for (const auto& it : config.items()) {
+    items.push_back(Item{const_cast<dynamic*>(&it.first),
+                         const_cast<dynamic*>(&it.second),
+                         nullptr, nullptr, nullptr});
+  }
+
+  std::atomic<size_t> next{0};
+  auto worker = [this, &items, &next]() {
+    for (auto i = next++; i < items.size(); i = next++) {
+      auto& item = items[i];
+      try {
+        NestedLimitGuard nestedGuard(nestedLimit_);
+        Context context;
+        item.nKey = expandMacros(*item.key, context);
+        checkLogic(item.nKey.isString(), "Expanded key is not a string");
+        item.nValue = expandMacros(std::move(*item.value), context);
+      } catch (...) {
+        item.error = std::current_exception();
+      }
+    }
+  };
+  vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(numThreads, items.size()); ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // same result and error as sequential expansion would give
+  dynamic result = dynamic::object();
+  for (auto& item : items) {
+    if (item.error) {
+      try {
+        std::rethrow_exception(item.error);
+      } catch (const std::logic_error& e) {
+        throw std::logic_error(string("Raw object property '") +
+          item.key->stringPiece().str() + "':\n" + e.what());
+      }
+    }
+    result.insert(std::move(item.nKey), std::move(item.nValue));
+  }
+  return result;
+}
+
+dynamic ConfigPreprocessor::expandMacroDef(const string& name,
+                                           const dynamic& result,
+                                           const Context& args) const {
+  // fingerprint of (name, args), args are hashed regardless of their order
+  JsonFingerprint argsSum;
+  for (const auto& it : args) {
+    auto fp = jsonFingerprint(it.second);
+    SpookyHashV2::Hash128(it.first.data(), it.first.size(),
+                          &fp.hash1, &fp.hash2);
+    argsSum.hash1 += fp.hash1;
+    argsSum.hash2 += fp.hash2;
+  }
+  auto key = argsSum;
+  SpookyHashV2::Hash128(name.data(), name.size(), &key.hash1, &key.hash2);
+
+  {
+    std::lock_guard<std::mutex> lock(memoLock_);
+    auto it = memo_.find(key);
+    if (it != memo_.end()) {
+      for (const auto& entry : it->second) {
+        if (entry.name == name && entry.args == args) {
+          if (stats_) {
+            std::lock_guard<std::mutex> statsLock(statsLock_);
+            ++(*stats_)[name].memoized;
+          }
+          return *entry.result;
+        }
+      }
+    }
+  }
+
+  auto impureCalls = impureCalls_.load();
+  auto expanded = std::make_shared<const dynamic>(expandMacros(result, args));
+  // result of the same call may differ, if there were random calls
+  if (impureCalls == impureCalls_.load()) {
+    std::lock_guard<std::mutex> lock(memoLock_);
+    memo_[key].push_back(MemoEntry{name, args, expanded});
+  }
+  return *expanded;
+}
+
+template <class Func>
+dynamic ConfigPreprocessor::measure(const string& name, Func&& func) const {
+  if (!stats_) {
+    return func();
+  }
+  auto start = std::chrono::steady_clock::now();
+  auto addStats = [this, &name, start]() {
+    auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+    std::lock_guard<std::mutex> lock(statsLock_);
+    auto& macroStats = (*stats_)[name];
+    ++macroStats.calls;
+    macroStats.time += time;
+  };
+  try {
+    auto result = func();
+    addStats();
+    return result;
+  } catch (...) {
+    addStats();
+    throw;
+  }
+}
+
 void ConfigPreprocessor::parseConstDefs(dynamic jconsts) {
-  auto consts = expandMacros(std::move(jconsts), emptyContext_);
+  Context context;
+  auto consts = expandMacros(std::move(jconsts), context);
   checkLogic(consts.isArray(), "config consts is not an array");
   for (const auto& it : consts) {
     checkLogic(it.isObject(), "constDef is not an object");
@@ -1542,8 +1714,8 @@ void ConfigPreprocessor::parseMacroDef(const dynamic& jkey,
         params.push_back(paramObj);
       }
     }
-    auto f = [res, this](const Context& ctx) {
-      return expandMacros(res, ctx);
+    auto f = [key, res, this](const Context& ctx) {
+      return expandMacroDef(key, res, ctx);
     };
     macros_.emplace(key, make_unique<Macro>(key, params, std::move(f)));
   } else if (objType == "constDef") {
@@ -1556,7 +1728,8 @@ void ConfigPreprocessor::parseMacroDef(const dynamic& jkey,
 }
 
 void ConfigPreprocessor::parseMacroDefs(dynamic jmacros) {
-  auto macros = expandMacros(std::move(jmacros), emptyContext_);
+  Context context;
+  auto macros = expandMacros(std::move(jmacros), context);
   checkLogic(macros.isObject() || macros.isArray(),
              "config macros is not an array/object");
 
@@ -1575,12 +1748,15 @@ dynamic ConfigPreprocessor::getConfigWithoutMacros(
     StringPiece jsonC,
     ImportResolverIf& importResolver,
     std::unordered_map<string, dynamic> globalParams,
-    size_t nestedLimit) {
+    size_t nestedLimit,
+    size_t numThreads,
+    Stats* stats) {
 
-  auto config = parseJsonString(stripComments(jsonC));
+  auto config = parseJsonWithComments(jsonC);
   checkLogic(config.isObject(), "config is not an object");
 
-  ConfigPreprocessor prep(importResolver, std::move(globalParams), nestedLimit);
+  ConfigPreprocessor prep(importResolver, std::move(globalParams), nestedLimit,
+                          stats);
 
   // parse and add consts. DEPRECATED.
   auto jconsts = config.get_ptr("consts");
@@ -1596,7 +1772,7 @@ dynamic ConfigPreprocessor::getConfigWithoutMacros(
     config.erase("macros");
   }
 
-  return prep.expandMacros(std::move(config), emptyContext_);
+  return prep.expandConfig(std::move(config), numThreads);
 }
 
 }}  // facebook::memcache
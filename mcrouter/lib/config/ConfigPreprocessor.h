@@ -9,14 +9,19 @@
  */
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include <folly/dynamic.h>
 
+#include "mcrouter/lib/config/JsonFingerprint.h"
+
 namespace facebook { namespace memcache {
 
 class ImportResolverIf;
@@ -27,23 +32,47 @@ class ImportResolverIf;
  */
 class ConfigPreprocessor {
  public:
+  /**
+   * Expansion statistics of a single macro or built-in call.
+   */
+  struct MacroStats {
+    /// number of times it was expanded
+    size_t calls{0};
+    /// number of calls, result of which was taken from the memo
+    size_t memoized{0};
+    /// total time spent in expansions, including nested calls
+    std::chrono::nanoseconds time{0};
+  };
+
+  /// macro or built-in call name -> stats
+  typedef std::unordered_map<std::string, MacroStats> Stats;
+
   /**
    * Method to expand macros and get resulting dynamic object.
    *
+   * Results of user defined macros are memoized by macro name and arguments,
+   * unless the expansion involved calls with random results (@shuffle).
+   *
    * @param jsonC JSON with comments and macros
    * @param importResolver resolves @import macros
    * @param globalParams parameters available in all macros. Should not have
    *                     macros.
    * @param nestedLimit maximum number of nested macros/objects.
+   * @param numThreads number of threads to expand top level properties of
+   *                   the config with. Calls to importResolver are
+   *                   serialized.
+   * @param stats if not nullptr, expansion statistics are added to it.
    *
    * @return JSON without macros
-   * @throws std::logic_error/folly::ParseError if jsonC is invalid
+   * @throws std::logic_error/std::runtime_error if jsonC is invalid
    */
   static folly::dynamic getConfigWithoutMacros(
     folly::StringPiece jsonC,
     ImportResolverIf& importResolver,
     std::unordered_map<std::string, folly::dynamic> globalParams,
-    size_t nestedLimit = 250);
+    size_t nestedLimit = 250,
+    size_t numThreads = 1,
+    Stats* stats = nullptr);
 
  private:
   /**
@@ -63,6 +92,15 @@ class ConfigPreprocessor {
 
   typedef std::unordered_map<std::string, folly::dynamic> Context;
 
+  /**
+   * Memoized result of a user defined macro call
+   */
+  struct MemoEntry {
+    std::string name;
+    Context args;
+    std::shared_ptr<const folly::dynamic> result;
+  };
+
   std::unordered_map<std::string, std::unique_ptr<Macro>> macros_;
   std::unordered_map<std::string, std::unique_ptr<Const>> consts_;
   std::unordered_map<std::string, folly::dynamic> importCache_;
@@ -71,9 +109,26 @@ class ConfigPreprocessor {
     std::function<folly::dynamic(const folly::dynamic&, const Context&)>
   > builtInCalls_;
 
-  mutable size_t nestedLimit_;
+  /*
+   * Macros are expanded by multiple threads at once, all the mutable state
+   * below is protected by locks.
+   */
+
+  /// also serializes calls to ImportResolverIf. Imports may be nested.
+  mutable std::recursive_mutex importLock_;
+
+  /// fingerprint of (name, args) -> memoized calls
+  mutable std::unordered_map<JsonFingerprint, std::vector<MemoEntry>,
+                             JsonFingerprintHasher> memo_;
+  mutable std::mutex memoLock_;
 
-  static const Context emptyContext_;
+  /// number of calls with random results so far
+  mutable std::atomic<size_t> impureCalls_{0};
+
+  Stats* stats_{nullptr};
+  mutable std::mutex statsLock_;
+
+  const size_t nestedLimit_;
 
   /**
    * Create preprocessor with given macros
@@ -82,10 +137,12 @@ class ConfigPreprocessor {
    * @param globals parameters available in all macros. Should not have
    *                macros.
    * @param nestedLimit maximum number of nested macros/objects.
+   * @param stats where to add expansion statistics, may be nullptr.
    */
   ConfigPreprocessor(ImportResolverIf& importResolver,
                      Context globals,
-                     size_t nestedLimit);
+                     size_t nestedLimit,
+                     Stats* stats);
 
   /**
    * Expands all macros found in json
@@ -98,6 +155,26 @@ class ConfigPreprocessor {
   folly::dynamic
   expandMacros(folly::dynamic json, const Context& context) const;
 
+  /**
+   * Expands all macros in config object, top level properties are expanded
+   * in parallel.
+   */
+  folly::dynamic expandConfig(folly::dynamic config, size_t numThreads) const;
+
+  /**
+   * Expands result of user defined macro with given arguments or returns
+   * the memoized result of the same call.
+   */
+  folly::dynamic expandMacroDef(const std::string& name,
+                                const folly::dynamic& result,
+                                const Context& args) const;
+
+  /**
+   * Calls func(), recording its time in stats of macro/built-in call name.
+   */
+  template <class Func>
+  folly::dynamic measure(const std::string& name, Func&& func) const;
+
   /**
    * Parses parameters passed to macro call inside string like in
    * @a(param1,%substituteMe%)
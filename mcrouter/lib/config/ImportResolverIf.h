@@ -9,10 +9,15 @@
  */
 #pragma once
 
+#include <memory>
 #include <string>
 
 #include <folly/Range.h>
 
+namespace folly {
+class dynamic;
+}
+
 namespace facebook { namespace memcache {
 
 /**
@@ -28,6 +33,16 @@ class ImportResolverIf {
    */
   virtual std::string import(folly::StringPiece path) = 0;
 
+  /**
+   * @param path parameter passed to @import macro
+   *
+   * @return parsed JSON with macros. By default, import(path) parsed with
+   *         parseJsonWithComments(); implementations may return the same
+   *         parsed JSON for unchanged files instead of parsing them again.
+   */
+  virtual std::shared_ptr<const folly::dynamic>
+  importParsed(folly::StringPiece path);
+
   virtual ~ImportResolverIf() {}
 };
 
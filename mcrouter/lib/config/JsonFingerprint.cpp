@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "JsonFingerprint.h"
+
+#include <cstring>
+
+#include <folly/dynamic.h>
+#include <folly/SpookyHashV2.h>
+
+using folly::hash::SpookyHashV2;
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+JsonFingerprint hashBytes(const void* data, size_t len, uint64_t seed) {
+  JsonFingerprint fp;
+  fp.hash1 = seed;
+  fp.hash2 = seed;
+  SpookyHashV2::Hash128(data, len, &fp.hash1, &fp.hash2);
+  return fp;
+}
+
+JsonFingerprint hashScalar(const folly::dynamic& json) {
+  uint64_t type = json.type();
+  switch (json.type()) {
+    case folly::dynamic::STRING: {
+      auto str = json.stringPiece();
+      return hashBytes(str.data(), str.size(), type);
+    }
+    case folly::dynamic::INT64: {
+      int64_t value = json.getInt();
+      return hashBytes(&value, sizeof(value), type);
+    }
+    case folly::dynamic::DOUBLE: {
+      double value = json.asDouble();
+      return hashBytes(&value, sizeof(value), type);
+    }
+    case folly::dynamic::BOOL: {
+      uint8_t value = json.getBool();
+      return hashBytes(&value, sizeof(value), type);
+    }
+    default:
+      return hashBytes(nullptr, 0, type);
+  }
+}
+
+/**
+ * Calls child(json) for every child and combines their fingerprints:
+ * sequentially for arrays and order independently for objects.
+ */
+template <class Child>
+JsonFingerprint hashContainer(const folly::dynamic& json, Child&& child) {
+  uint64_t type = json.type();
+  if (json.isArray()) {
+    SpookyHashV2 hasher;
+    hasher.Init(type, type);
+    for (const auto& it : json) {
+      auto fp = child(it);
+      hasher.Update(&fp, sizeof(fp));
+    }
+    JsonFingerprint fp;
+    hasher.Final(&fp.hash1, &fp.hash2);
+    return fp;
+  }
+
+  JsonFingerprint sum;
+  for (const auto& it : json.items()) {
+    JsonFingerprint item[2] = { hashScalar(it.first), child(it.second) };
+    auto fp = hashBytes(item, sizeof(item), type);
+    sum.hash1 += fp.hash1;
+    sum.hash2 += fp.hash2;
+  }
+  return hashBytes(&sum, sizeof(sum), type);
+}
+
+}  // anonymous namespace
+
+JsonFingerprint jsonFingerprint(const folly::dynamic& json) {
+  if (!json.isArray() && !json.isObject()) {
+    return hashScalar(json);
+  }
+  return hashContainer(json, [](const folly::dynamic& child) {
+    return jsonFingerprint(child);
+  });
+}
+
+JsonFingerprints::JsonFingerprints(const folly::dynamic& root) {
+  add(root);
+}
+
+JsonFingerprint JsonFingerprints::add(const folly::dynamic& json) {
+  if (!json.isArray() && !json.isObject()) {
+    return hashScalar(json);
+  }
+  auto fp = hashContainer(json, [this](const folly::dynamic& child) {
+    return add(child);
+  });
+  fingerprints_[&json] = fp;
+  return fp;
+}
+
+JsonFingerprint JsonFingerprints::get(const folly::dynamic& json) const {
+  auto it = fingerprints_.find(&json);
+  if (it != fingerprints_.end()) {
+    return it->second;
+  }
+  return jsonFingerprint(json);
+}
+
+}}  // facebook::memcache
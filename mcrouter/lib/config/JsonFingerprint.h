@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache {
+
+/**
+ * 128 bit structural hash of a JSON value. Equal values have equal
+ * fingerprints (objects are compared regardless of the order of their items),
+ * different values collide with negligible probability.
+ */
+struct JsonFingerprint {
+  uint64_t hash1{0};
+  uint64_t hash2{0};
+
+  bool operator==(const JsonFingerprint& other) const {
+    return hash1 == other.hash1 && hash2 == other.hash2;
+  }
+
+  bool operator!=(const JsonFingerprint& other) const {
+    return !(*this == other);
+  }
+};
+
+struct JsonFingerprintHasher {
+  size_t operator()(const JsonFingerprint& fp) const {
+    return fp.hash1;
+  }
+};
+
+/**
+ * @return fingerprint of given JSON value.
+ */
+JsonFingerprint jsonFingerprint(const folly::dynamic& json);
+
+/**
+ * Fingerprints of all objects and arrays in a JSON tree, computed in a single
+ * pass. Nodes are looked up by address, so the tree should outlive this
+ * object and should not be modified.
+ */
+class JsonFingerprints {
+ public:
+  explicit JsonFingerprints(const folly::dynamic& root);
+
+  /**
+   * @return fingerprint of json. Computed on the fly for nodes that are not
+   *         objects or arrays of the tree.
+   */
+  JsonFingerprint get(const folly::dynamic& json) const;
+
+ private:
+  std::unordered_map<const folly::dynamic*, JsonFingerprint> fingerprints_;
+
+  JsonFingerprint add(const folly::dynamic& json);
+};
+
+}}  // facebook::memcache
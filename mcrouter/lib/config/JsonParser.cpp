@@ -0,0 +1,373 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "JsonParser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+/* deeper JSON is most likely a mistake, and would use up the stack */
+const size_t kMaxDepth = 1000;
+
+class Parser {
+ public:
+  explicit Parser(folly::StringPiece in)
+      : begin_(in.begin()),
+        p_(in.begin()),
+        end_(in.end()) {
+  }
+
+  folly::dynamic parse() {
+    skipWhitespace();
+    auto ret = parseValue(0);
+    skipWhitespace();
+    if (p_ != end_) {
+      error("parsing didn't consume all input");
+    }
+    return ret;
+  }
+
+ private:
+  const char* const begin_;
+  const char* p_;
+  const char* const end_;
+
+  [[noreturn]] void error(folly::StringPiece what) const {
+    auto line = 1 + std::count(begin_, p_, '\n');
+    std::string msg = folly::to<std::string>("json parse error on line ",
+                                             line);
+    if (p_ != end_) {
+      auto near = folly::StringPiece(
+        p_, std::min<size_t>(end_ - p_, 20));
+      msg += folly::to<std::string>(" near `", near, "'");
+    }
+    throw std::runtime_error(folly::to<std::string>(msg, ": ", what));
+  }
+
+  bool consume(char c) {
+    if (p_ != end_ && *p_ == c) {
+      ++p_;
+      return true;
+    }
+    return false;
+  }
+
+  bool consume(folly::StringPiece s) {
+    if (static_cast<size_t>(end_ - p_) >= s.size() &&
+        std::memcmp(p_, s.data(), s.size()) == 0) {
+      p_ += s.size();
+      return true;
+    }
+    return false;
+  }
+
+  static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  void skipDigits() {
+    while (p_ != end_ && isDigit(*p_)) {
+      ++p_;
+    }
+  }
+
+  /* whitespace and comments; an unterminated comment ends the input */
+  void skipWhitespace() {
+    while (p_ != end_) {
+      switch (*p_) {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+          ++p_;
+          break;
+        case '/':
+          if (end_ - p_ < 2) {
+            return;
+          }
+          if (p_[1] == '/') {
+            p_ = std::find(p_ + 2, end_, '\n');
+          } else if (p_[1] == '*') {
+            folly::StringPiece rest(p_ + 2, end_);
+            auto pos = rest.find("*/");
+            p_ = pos == std::string::npos ? end_ : rest.begin() + pos + 2;
+          } else {
+            return;
+          }
+          break;
+        default:
+          return;
+      }
+    }
+  }
+
+  folly::dynamic parseValue(size_t depth) {
+    if (p_ == end_) {
+      error("unexpected end of input");
+    }
+    switch (*p_) {
+      case '{':
+        return parseObject(depth + 1);
+      case '[':
+        return parseArray(depth + 1);
+      case '"':
+        return parseString();
+      case 't':
+        if (consume("true")) {
+          return true;
+        }
+        break;
+      case 'f':
+        if (consume("false")) {
+          return false;
+        }
+        break;
+      case 'n':
+        if (consume("null")) {
+          return nullptr;
+        }
+        break;
+      case 'N':
+        if (consume("NaN")) {
+          return std::numeric_limits<double>::quiet_NaN();
+        }
+        break;
+      case 'I':
+        if (consume("Infinity")) {
+          return std::numeric_limits<double>::infinity();
+        }
+        break;
+      default:
+        if (*p_ == '-' || isDigit(*p_)) {
+          return parseNumber();
+        }
+        break;
+    }
+    error("expected json value");
+  }
+
+  folly::dynamic parseObject(size_t depth) {
+    if (depth > kMaxDepth) {
+      error("too deeply nested");
+    }
+    ++p_;
+    folly::dynamic ret = folly::dynamic::object;
+    skipWhitespace();
+    if (consume('}')) {
+      return ret;
+    }
+    for (;;) {
+      if (p_ == end_ || *p_ != '"') {
+        error("expected string as object key");
+      }
+      auto key = parseStringValue();
+      skipWhitespace();
+      if (!consume(':')) {
+        error("expected ':' after object key");
+      }
+      skipWhitespace();
+      auto value = parseValue(depth);
+      ret.insert(std::move(key), std::move(value));
+      skipWhitespace();
+      if (!consume(',')) {
+        break;
+      }
+      skipWhitespace();
+      if (p_ != end_ && *p_ == '}') {
+        break;
+      }
+    }
+    if (!consume('}')) {
+      error("expected ',' or '}'");
+    }
+    return ret;
+  }
+
+  folly::dynamic parseArray(size_t depth) {
+    if (depth > kMaxDepth) {
+      error("too deeply nested");
+    }
+    ++p_;
+    folly::dynamic ret = {};
+    skipWhitespace();
+    if (consume(']')) {
+      return ret;
+    }
+    for (;;) {
+      ret.push_back(parseValue(depth));
+      skipWhitespace();
+      if (!consume(',')) {
+        break;
+      }
+      skipWhitespace();
+      if (p_ != end_ && *p_ == ']') {
+        break;
+      }
+    }
+    if (!consume(']')) {
+      error("expected ',' or ']'");
+    }
+    return ret;
+  }
+
+  folly::dynamic parseNumber() {
+    auto start = p_;
+    if (consume('-') && consume("Infinity")) {
+      return -std::numeric_limits<double>::infinity();
+    }
+    auto digits = p_;
+    skipDigits();
+    if (p_ == digits) {
+      error("expected digit");
+    }
+    bool isDouble = false;
+    if (consume('.')) {
+      isDouble = true;
+      digits = p_;
+      skipDigits();
+      if (p_ == digits) {
+        error("expected digit after '.'");
+      }
+    }
+    if (p_ != end_ && (*p_ == 'e' || *p_ == 'E')) {
+      isDouble = true;
+      ++p_;
+      if (!consume('-')) {
+        consume('+');
+      }
+      digits = p_;
+      skipDigits();
+      if (p_ == digits) {
+        error("expected digit in exponent");
+      }
+    }
+
+    folly::StringPiece number(start, p_);
+    try {
+      if (isDouble) {
+        return folly::to<double>(number);
+      }
+      return folly::to<int64_t>(number);
+    } catch (const std::exception& e) {
+      p_ = start;
+      error(e.what());
+    }
+  }
+
+  folly::dynamic parseString() {
+    return parseStringValue();
+  }
+
+  std::string parseStringValue() {
+    ++p_;
+    std::string ret;
+    for (;;) {
+      auto start = p_;
+      while (p_ != end_ && *p_ != '"' && *p_ != '\\') {
+        ++p_;
+      }
+      ret.append(start, p_);
+      if (p_ == end_) {
+        error("unterminated string");
+      }
+      if (*p_++ == '"') {
+        return ret;
+      }
+      if (p_ == end_) {
+        error("unterminated string");
+      }
+      switch (*p_++) {
+        case '"': ret.push_back('"'); break;
+        case '\\': ret.push_back('\\'); break;
+        case '/': ret.push_back('/'); break;
+        case 'b': ret.push_back('\b'); break;
+        case 'f': ret.push_back('\f'); break;
+        case 'n': ret.push_back('\n'); break;
+        case 'r': ret.push_back('\r'); break;
+        case 't': ret.push_back('\t'); break;
+        case 'u': appendCodePoint(ret); break;
+        default:
+          --p_;
+          error("unknown escape sequence");
+      }
+    }
+  }
+
+  uint32_t parseHex4() {
+    if (end_ - p_ < 4) {
+      error("expected 4 hex digits");
+    }
+    uint32_t ret = 0;
+    for (int i = 0; i < 4; ++i, ++p_) {
+      auto c = *p_;
+      ret <<= 4;
+      if (isDigit(c)) {
+        ret |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        ret |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        ret |= c - 'A' + 10;
+      } else {
+        error("expected 4 hex digits");
+      }
+    }
+    return ret;
+  }
+
+  /* \uXXXX (or a surrogate pair of them) as UTF-8 */
+  void appendCodePoint(std::string& out) {
+    auto cp = parseHex4();
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+      if (!consume("\\u")) {
+        error("expected low surrogate after high surrogate");
+      }
+      auto low = parseHex4();
+      if (low < 0xDC00 || low > 0xDFFF) {
+        error("invalid low surrogate");
+      }
+      cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+      error("low surrogate without high surrogate");
+    }
+
+    if (cp < 0x80) {
+      out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+      out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+      out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+  }
+};
+
+}  // anonymous namespace
+
+folly::dynamic parseJsonWithComments(folly::StringPiece jsonC) {
+  return Parser(jsonC).parse();
+}
+
+}}  // facebook::memcache
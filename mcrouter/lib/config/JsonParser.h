@@ -0,0 +1,34 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <folly/Range.h>
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache {
+
+/**
+ * Parses JSON with comments (configs, imported files): '//' and
+ * C-style comments between tokens, trailing commas in objects and
+ * arrays, NaN and (-)Infinity.
+ *
+ * Same result as parseJsonString(folly::json::stripComments(jsonC)), in
+ * one pass over jsonC instead of making a copy of it without the comments
+ * and parsing that: values are built in place, strings without escapes
+ * are copied in one go.
+ *
+ * @throws std::runtime_error with the line number if jsonC is invalid.
+ */
+folly::dynamic parseJsonWithComments(folly::StringPiece jsonC);
+
+}}  // facebook::memcache
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ParsedJsonCache.h"
+
+#include <folly/dynamic.h>
+#include <folly/SpookyHashV2.h>
+
+#include "mcrouter/lib/config/JsonParser.h"
+
+using folly::hash::SpookyHashV2;
+
+namespace facebook { namespace memcache {
+
+std::shared_ptr<const folly::dynamic>
+ParsedJsonCache::get(const std::string& path, folly::StringPiece jsonC) {
+  uint64_t hash1 = 0;
+  uint64_t hash2 = 0;
+  SpookyHashV2::Hash128(jsonC.data(), jsonC.size(), &hash1, &hash2);
+
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(path);
+    if (it != entries_.end() && it->second.hash1 == hash1 &&
+        it->second.hash2 == hash2 && it->second.size == jsonC.size()) {
+      ++hits_;
+      return it->second.json;
+    }
+    ++misses_;
+  }
+
+  /* parse without the lock, other paths may be imported meanwhile */
+  auto json = std::make_shared<const folly::dynamic>(
+    parseJsonWithComments(jsonC));
+
+  std::lock_guard<std::mutex> lock(lock_);
+  entries_[path] = Entry{hash1, hash2, jsonC.size(), json};
+  return json;
+}
+
+size_t ParsedJsonCache::hits() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return hits_;
+}
+
+size_t ParsedJsonCache::misses() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return misses_;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <folly/Range.h>
+
+namespace folly {
+class dynamic;
+}
+
+namespace facebook { namespace memcache {
+
+/**
+ * Parsed JSON of files (e.g. @import-ed ones) by path, reused as long as
+ * the contents of the file stay the same: a reload that changes one file
+ * only parses that one again.
+ *
+ * Keeps the last parsed version of each path, contents are compared by
+ * a 128 bit hash. Thread safe.
+ */
+class ParsedJsonCache {
+ public:
+  /**
+   * @return jsonC parsed with parseJsonWithComments(), shared with earlier
+   *         calls with the same path and contents.
+   * @throws std::runtime_error if jsonC is invalid.
+   */
+  std::shared_ptr<const folly::dynamic> get(const std::string& path,
+                                            folly::StringPiece jsonC);
+
+  /**
+   * @return number of get() calls that returned an already parsed JSON.
+   */
+  size_t hits() const;
+
+  /**
+   * @return number of get() calls that parsed jsonC.
+   */
+  size_t misses() const;
+
+ private:
+  struct Entry {
+    uint64_t hash1;
+    uint64_t hash2;
+    size_t size;
+    std::shared_ptr<const folly::dynamic> json;
+  };
+
+  std::unordered_map<std::string, Entry> entries_;
+  size_t hits_{0};
+  size_t misses_{0};
+  mutable std::mutex lock_;
+};
+
+}}  // facebook::memcache
@@ -8,6 +8,7 @@
  *
  */
 #include <folly/dynamic.h>
+#include <folly/ScopeGuard.h>
 
 #include "mcrouter/lib/config/RouteHandleProviderIf.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
@@ -20,6 +21,19 @@ RouteHandleFactory<RouteHandleIf>::RouteHandleFactory(
     : provider_(provider) {
 }
 
+template <class RouteHandleIf>
+RouteHandleFactory<RouteHandleIf>::RouteHandleFactory(
+    RouteHandleProviderIf<RouteHandleIf>& provider,
+    const JsonFingerprints* fingerprints,
+    std::shared_ptr<const Cache> previous)
+    : provider_(provider),
+      fingerprints_(fingerprints) {
+  if (fingerprints_) {
+    previous_ = std::move(previous);
+    next_ = std::make_shared<Cache>();
+  }
+}
+
 template <class RouteHandleIf>
 std::shared_ptr<RouteHandleIf>
 RouteHandleFactory<RouteHandleIf>::create(const folly::dynamic& json) {
@@ -32,10 +46,10 @@ RouteHandleFactory<RouteHandleIf>::create(const folly::dynamic& json) {
 }
 
 template <class RouteHandleIf>
-std::vector<std::shared_ptr<RouteHandleIf>>
+typename RouteHandleFactory<RouteHandleIf>::RouteHandles
 RouteHandleFactory<RouteHandleIf>::createList(const folly::dynamic& json) {
   if (json.isArray()) {
-    std::vector<std::shared_ptr<RouteHandleIf>> ret;
+    RouteHandles ret;
     // merge all inner lists into result
     for (const auto& it : json) {
       auto list = createList(it);
@@ -50,22 +64,22 @@ RouteHandleFactory<RouteHandleIf>::createList(const folly::dynamic& json) {
                "Type field in RouteHandle is not a string");
     auto type = typeIt->second.stringPiece();
 
+    std::string name;
     auto nameIt = json.find("name");
     if (nameIt != json.items().end() && nameIt->second.isString()) {
       // got named handle
-      auto name = nameIt->second.stringPiece().str();
-      auto it = seen_.find(name);
-      if (it != seen_.end()) {
+      name = nameIt->second.stringPiece().str();
+      bool found;
+      auto ret = findSeen(name, found);
+      if (found) {
         // we had the same named handle already. Reuse it.
-        return it->second;
+        return ret;
       }
+    }
 
-      auto ret = provider_.create(*this, type, json);
-      seen_.emplace(name, ret);
-      return ret;
-    } else {
+    return createCached(json, name, [this, type, &json]() -> RouteHandles {
       return provider_.create(*this, type, json);
-    }
+    });
   } else if (json.isString()) {
     if (json.empty()) {
       // useful for routes with optional children
@@ -76,26 +90,218 @@ RouteHandleFactory<RouteHandleIf>::createList(const folly::dynamic& json) {
     // form of handle.
     auto handlePiece = json.stringPiece();
     auto handleString = handlePiece.str();
-    auto it = seen_.find(handleString);
-    if (it != seen_.end()) {
-      return it->second;
+    bool found;
+    auto ret = findSeen(handleString, found);
+    if (found) {
+      return ret;
     }
 
-    std::vector<std::shared_ptr<RouteHandleIf>> ret;
-    auto pipeId = handlePiece.find("|");
-    if (pipeId != std::string::npos) { // short form (e.g. HashRoute|ErrorRoute)
-      auto type = handlePiece.subpiece(0, pipeId); // split by first '|'
-      auto def = handlePiece.subpiece(pipeId + 1);
-      ret = provider_.create(*this, type, def);
-    } else {
-      // assume it is a short form of route without children (e.g. ErrorRoute)
-      ret = provider_.create(*this, handlePiece, nullptr);
-    }
+    auto build = [this, handlePiece]() -> RouteHandles {
+      auto pipeId = handlePiece.find("|");
+      if (pipeId != std::string::npos) {
+        // short form (e.g. HashRoute|ErrorRoute)
+        auto type = handlePiece.subpiece(0, pipeId); // split by first '|'
+        auto def = handlePiece.subpiece(pipeId + 1);
+        return provider_.create(*this, type, def);
+      } else {
+        // assume it is a short form of route without children (e.g.
+        // ErrorRoute)
+        return provider_.create(*this, handlePiece, nullptr);
+      }
+    };
+    return createCached(json, handleString, build);
+  }
+  throw std::logic_error("RouteHandle should be object, array or string");
+}
 
-    seen_.emplace(handleString, ret);
+template <class RouteHandleIf>
+void RouteHandleFactory<RouteHandleIf>::addDependency(
+    std::string key, std::shared_ptr<const void> value) {
+  if (!frames_.empty()) {
+    frames_.back()->dependencies.emplace(std::move(key), std::move(value));
+  }
+}
+
+template <class RouteHandleIf>
+void RouteHandleFactory<RouteHandleIf>::addExport(
+    std::string key, std::shared_ptr<RouteHandleIf> rh) {
+  if (!frames_.empty()) {
+    frames_.back()->exports.emplace(std::move(key), std::move(rh));
+  }
+}
+
+template <class RouteHandleIf>
+typename RouteHandleFactory<RouteHandleIf>::RouteHandles
+RouteHandleFactory<RouteHandleIf>::findSeen(const std::string& name,
+                                             bool& found) {
+  auto it = seen_.find(name);
+  found = it != seen_.end();
+  if (!found) {
+    return {};
+  }
+  if (!frames_.empty() && !frames_.back()->definedNames.count(name)) {
+    frames_.back()->usedNames.emplace(name, it->second);
+  }
+  return it->second;
+}
+
+template <class RouteHandleIf>
+template <class Build>
+typename RouteHandleFactory<RouteHandleIf>::RouteHandles
+RouteHandleFactory<RouteHandleIf>::createCached(const folly::dynamic& json,
+                                                const std::string& name,
+                                                Build&& build) {
+  if (!fingerprints_) {
+    auto ret = build();
+    if (!name.empty()) {
+      seen_.emplace(name, ret);
+    }
     return ret;
   }
-  throw std::logic_error("RouteHandle should be object, array or string");
+
+  auto key = fingerprints_->get(json);
+  auto sameIt = next_->entries_.find(key);
+  if (sameIt != next_->entries_.end()) {
+    for (const auto& entry : sameIt->second) {
+      if (!entry->stateful && sameContext(*entry)) {
+        share(entry);
+        return entry->handles;
+      }
+    }
+  }
+  if (previous_) {
+    auto it = previous_->entries_.find(key);
+    if (it != previous_->entries_.end()) {
+      for (const auto& entry : it->second) {
+        if (canReuse(*entry)) {
+          reuse(entry);
+          return entry->handles;
+        }
+      }
+    }
+  }
+
+  auto entry = std::make_shared<CacheEntry>();
+  entry->key = key;
+  frames_.push_back(entry);
+  auto frameGuard = folly::makeGuard([this]() {
+    frames_.pop_back();
+  });
+  entry->handles = build();
+  frameGuard.dismiss();
+  frames_.pop_back();
+
+  if (!name.empty()) {
+    seen_.emplace(name, entry->handles);
+    entry->definedNames.emplace(name, entry->handles);
+  }
+  next_->entries_[key].push_back(entry);
+  ++next_->size_;
+  addToFrame(entry);
+  return entry->handles;
+}
+
+template <class RouteHandleIf>
+bool RouteHandleFactory<RouteHandleIf>::sameContext(
+    const CacheEntry& entry) const {
+  for (const auto& it : entry.usedNames) {
+    auto seenIt = seen_.find(it.first);
+    if (seenIt == seen_.end() || seenIt->second != it.second) {
+      return false;
+    }
+  }
+  for (const auto& it : entry.dependencies) {
+    if (provider_.resolveDependency(it.first) != it.second) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class RouteHandleIf>
+bool RouteHandleFactory<RouteHandleIf>::canReuse(
+    const CacheEntry& entry) const {
+  if (consumed_.count(&entry)) {
+    return false;
+  }
+  for (const auto& it : entry.definedNames) {
+    if (seen_.count(it.first)) {
+      return false;
+    }
+  }
+  return sameContext(entry);
+}
+
+template <class RouteHandleIf>
+void RouteHandleFactory<RouteHandleIf>::reuse(
+    const std::shared_ptr<const CacheEntry>& entry) {
+  ++reused_;
+  collapsed_ += entry->collapsed;
+  seen_.insert(entry->definedNames.begin(), entry->definedNames.end());
+  for (const auto& it : entry->exports) {
+    provider_.restoreExport(it.first, it.second);
+  }
+  keep(entry);
+  addToFrame(entry);
+}
+
+template <class RouteHandleIf>
+void RouteHandleFactory<RouteHandleIf>::share(
+    const std::shared_ptr<const CacheEntry>& entry) {
+  ++shared_;
+  if (frames_.empty()) {
+    return;
+  }
+  auto& parent = *frames_.back();
+  // names defined in the shared subtree are already seen, so the parent
+  // only uses them, same as if the subtree was built again
+  for (const auto* names : { &entry->usedNames, &entry->definedNames }) {
+    for (const auto& it : *names) {
+      if (!parent.definedNames.count(it.first)) {
+        parent.usedNames.insert(it);
+      }
+    }
+  }
+  parent.dependencies.insert(entry->dependencies.begin(),
+                             entry->dependencies.end());
+  parent.exports.insert(entry->exports.begin(), entry->exports.end());
+  parent.children.push_back(entry);
+}
+
+template <class RouteHandleIf>
+void RouteHandleFactory<RouteHandleIf>::keep(
+    const std::shared_ptr<const CacheEntry>& entry) {
+  // each cached entry is reused once, identical subtrees share it then
+  if (!consumed_.insert(entry.get()).second) {
+    return;
+  }
+  next_->entries_[entry->key].push_back(entry);
+  ++next_->size_;
+  for (const auto& child : entry->children) {
+    keep(child);
+  }
+}
+
+template <class RouteHandleIf>
+void RouteHandleFactory<RouteHandleIf>::addToFrame(
+    const std::shared_ptr<const CacheEntry>& entry) {
+  if (frames_.empty()) {
+    return;
+  }
+  auto& parent = *frames_.back();
+  for (const auto& it : entry->usedNames) {
+    if (!parent.definedNames.count(it.first)) {
+      parent.usedNames.insert(it);
+    }
+  }
+  parent.definedNames.insert(entry->definedNames.begin(),
+                             entry->definedNames.end());
+  parent.dependencies.insert(entry->dependencies.begin(),
+                             entry->dependencies.end());
+  parent.exports.insert(entry->exports.begin(), entry->exports.end());
+  parent.children.push_back(entry);
+  parent.collapsed += entry->collapsed;
+  parent.stateful = parent.stateful || entry->stateful;
 }
 
 }}  // facebook::memcache
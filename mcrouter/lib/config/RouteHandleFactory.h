@@ -12,8 +12,11 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "mcrouter/lib/config/JsonFingerprint.h"
+
 namespace folly {
 class dynamic;
 }
@@ -25,10 +28,68 @@ class RouteHandleProviderIf;
 
 /**
  * Parses RouteHandle tree from JSON object.
+ *
+ * Optionally reuses subtrees created from the previous version of the config:
+ * every object and string RouteHandle definition is cached by the fingerprint
+ * of its JSON, together with everything it was built from (named handles
+ * defined outside of it, provider dependencies). If on reconfiguration the
+ * JSON and all the dependencies are the same, the previously created handles
+ * are returned as is instead of building the subtree again, so the work done
+ * on reconfiguration is proportional to the size of the change.
+ *
+ * The same cache deduplicates subtrees within one config: identical
+ * definitions (e.g. the same pool referenced from many prefixes) map to one
+ * shared set of handles instead of being built for every occurrence.
+ * Subtrees with route handles that keep state of their own (in-flight
+ * requests, rate limiters, caches, see addStateful()) are still built for
+ * every occurrence, sharing them would merge that state; a named handle
+ * has to be used to share one on purpose.
  */
 template <class RouteHandleIf>
 class RouteHandleFactory {
  public:
+  typedef std::vector<std::shared_ptr<RouteHandleIf>> RouteHandles;
+
+  /**
+   * Subtrees created by one factory, that may be reused by the next one.
+   */
+  class Cache {
+   public:
+    /**
+     * @return number of cached subtrees.
+     */
+    size_t size() const {
+      return size_;
+    }
+   private:
+    struct Entry {
+      JsonFingerprint key;
+      RouteHandles handles;
+      /// named handles defined outside of the subtree it refers to
+      std::unordered_map<std::string, RouteHandles> usedNames;
+      /// named handles defined in the subtree
+      std::unordered_map<std::string, RouteHandles> definedNames;
+      /// see addDependency()
+      std::unordered_map<std::string, std::shared_ptr<const void>>
+        dependencies;
+      /// see addExport()
+      std::unordered_map<std::string, std::shared_ptr<RouteHandleIf>> exports;
+      /// cached subtrees of this subtree
+      std::vector<std::shared_ptr<const Entry>> children;
+      /// see addCollapsed()
+      size_t collapsed{0};
+      /// see addStateful()
+      bool stateful{false};
+    };
+
+    std::unordered_map<JsonFingerprint,
+                       std::vector<std::shared_ptr<const Entry>>,
+                       JsonFingerprintHasher> entries_;
+    size_t size_{0};
+
+    friend class RouteHandleFactory;
+  };
+
   RouteHandleFactory(const RouteHandleFactory&) = delete;
   RouteHandleFactory& operator=(const RouteHandleFactory&) = delete;
 
@@ -37,6 +98,21 @@ class RouteHandleFactory {
    */
   explicit RouteHandleFactory(RouteHandleProviderIf<RouteHandleIf>& provider);
 
+  /**
+   * Factory that caches created subtrees and reuses subtrees from
+   * the previous cache.
+   *
+   * @param provider that can create single node of RouteHandle tree.
+   * @param fingerprints of the config all RouteHandles will be created from.
+   *                     Should outlive this factory. If nullptr, caching
+   *                     and deduplication are disabled.
+   * @param previous cache released by factory of the previous config,
+   *                 may be nullptr.
+   */
+  RouteHandleFactory(RouteHandleProviderIf<RouteHandleIf>& provider,
+                     const JsonFingerprints* fingerprints,
+                     std::shared_ptr<const Cache> previous);
+
   /**
    * Creates single RouteHandle from JSON object.
    *
@@ -51,15 +127,138 @@ class RouteHandleFactory {
    * @param json array, object or string that represents zero, one or multiple
    *             RouteHandles.
    */
-  std::vector<std::shared_ptr<RouteHandleIf>>
-  createList(const folly::dynamic& json);
+  RouteHandles createList(const folly::dynamic& json);
+
+  /**
+   * Records that the subtree being created depends on a provider object
+   * (e.g. a pool) which is not part of the subtree JSON. The subtree is
+   * reused only if provider.resolveDependency(key) returns the same object.
+   */
+  void addDependency(std::string key, std::shared_ptr<const void> value);
+
+  /**
+   * Records that the provider stored a route handle of the subtree being
+   * created outside of the tree. When the subtree is reused,
+   * provider.restoreExport(key, rh) is called.
+   */
+  void addExport(std::string key, std::shared_ptr<RouteHandleIf> rh);
+
+  /**
+   * Records that the subtree being created has a route handle with state
+   * of its own, so an identical subtree of the same config must not share
+   * its handles.
+   */
+  void addStateful() {
+    if (!frames_.empty()) {
+      frames_.back()->stateful = true;
+    }
+  }
+
+  /**
+   * @return number of subtrees reused from the previous cache.
+   */
+  size_t reusedCount() const {
+    return reused_;
+  }
+
+  /**
+   * @return number of subtrees that were identical to another subtree
+   *         of the same config and share its handles.
+   */
+  size_t sharedCount() const {
+    return shared_;
+  }
+
+  /**
+   * Records that a no-op route handle (e.g. a HashRoute with a single child)
+   * was replaced by its only target while building the tree.
+   */
+  void addCollapsed() {
+    ++collapsed_;
+    if (!frames_.empty()) {
+      ++frames_.back()->collapsed;
+    }
+  }
+
+  /**
+   * @return number of route handle layers left out of the created trees,
+   *         including the ones of reused subtrees.
+   */
+  size_t collapsedCount() const {
+    return collapsed_;
+  }
+
+  /**
+   * @return all named handles created or reused so far.
+   */
+  const std::unordered_map<std::string, RouteHandles>& namedHandles() const {
+    return seen_;
+  }
+
+  /**
+   * Makes named handles of another factory (e.g. the one the rest of
+   * the config was built with) available to the subtrees created by this one.
+   */
+  void addNamedHandles(
+    const std::unordered_map<std::string, RouteHandles>& named) {
+    seen_.insert(named.begin(), named.end());
+  }
+
+  /**
+   * @return cache of all subtrees created or reused by this factory,
+   *         nullptr if caching is disabled.
+   */
+  std::shared_ptr<const Cache> releaseCache() {
+    return std::move(next_);
+  }
+
  private:
+  typedef typename Cache::Entry CacheEntry;
+
   RouteHandleProviderIf<RouteHandleIf>& provider_;
 
   /// Named routes we've already parsed
-  std::unordered_map<std::string,
-                     std::vector<std::shared_ptr<RouteHandleIf>>> seen_;
+  std::unordered_map<std::string, RouteHandles> seen_;
+
+  const JsonFingerprints* fingerprints_{nullptr};
+  std::shared_ptr<const Cache> previous_;
+  std::shared_ptr<Cache> next_;
+  /// entries of subtrees being created, innermost last
+  std::vector<std::shared_ptr<CacheEntry>> frames_;
+  /// entries of previous_ that were already reused
+  std::unordered_set<const CacheEntry*> consumed_;
+  size_t reused_{0};
+  size_t shared_{0};
+  size_t collapsed_{0};
+
+  /**
+   * Creates RouteHandles with build(), shares the ones of an identical
+   * subtree of this config or reuses cached ones.
+   *
+   * @param name if not empty, created RouteHandles are stored in seen_.
+   */
+  template <class Build>
+  RouteHandles createCached(const folly::dynamic& json,
+                            const std::string& name,
+                            Build&& build);
+
+  RouteHandles findSeen(const std::string& name, bool& found);
+
+  /**
+   * @return true if entry was built from the same named handles and
+   *         dependencies as the subtree being created would be.
+   */
+  bool sameContext(const CacheEntry& entry) const;
+
+  bool canReuse(const CacheEntry& entry) const;
+
+  void reuse(const std::shared_ptr<const CacheEntry>& entry);
+
+  void share(const std::shared_ptr<const CacheEntry>& entry);
+
+  void keep(const std::shared_ptr<const CacheEntry>& entry);
 
+  void addToFrame(const std::shared_ptr<const CacheEntry>& entry);
 };
 
 }} // facebook::memcache
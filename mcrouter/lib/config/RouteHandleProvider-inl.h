@@ -9,11 +9,14 @@
  */
 #pragma once
 
+#include <folly/Conv.h>
+
 #include "mcrouter/lib/Ch3HashFunc.h"
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/Crc32HashFunc.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/WeightedCh3HashFunc.h"
+#include "mcrouter/lib/WeightedMaglevHashFunc.h"
 
 namespace facebook { namespace memcache {
 
@@ -50,18 +53,42 @@ class HashRoute;
 template <class RouteHandleIf>
 class HostIdRoute;
 
+template <class RouteHandleIf>
+class HotKeyReplicationRoute;
+
+template <class RouteHandleIf>
+class LargeStackRoute;
+
 template <class RouteHandleIf>
 class LatestRoute;
 
 template <class RouteHandleIf>
 class MissFailoverRoute;
 
+template <class RouteHandleIf>
+class NearCacheRoute;
+
+template <class RouteHandleIf>
+class NegativeCacheRoute;
+
+template <class RouteHandleIf>
+class NoreplyRoute;
+
 template <class RouteHandleIf>
 class NullRoute;
 
 template <class RouteHandleIf>
 class RandomRoute;
 
+template <class RouteHandleIf>
+class ReplicationQueueRoute;
+
+template <class RouteHandleIf>
+class StaleWhileRevalidateRoute;
+
+template <class RouteHandleIf>
+class ValueSizeSelectorRoute;
+
 template <class RouteHandleIf>
 std::vector<std::shared_ptr<RouteHandleIf>>
 RouteHandleProvider<RouteHandleIf>::create(
@@ -86,7 +113,19 @@ RouteHandleProvider<RouteHandleIf>::create(
   } else if (type == "ErrorRoute") {
     return { makeRouteHandle<RouteHandleIf, ErrorRoute>(json) };
   } else if (type == "FailoverRoute") {
-    return { makeRouteHandle<RouteHandleIf, FailoverRoute>(factory, json) };
+    std::vector<std::shared_ptr<RouteHandleIf>> children;
+    if (!json.isObject()) {
+      children = factory.createList(json);
+    } else if (json.count("children")) {
+      children = factory.createList(json["children"]);
+    }
+    if (children.size() == 1) {
+      /* nothing to fail over to */
+      factory.addCollapsed();
+      return children;
+    }
+    return { makeRouteHandle<RouteHandleIf, FailoverRoute>(
+      std::move(children)) };
   } else if (type == "HashRoute") {
     std::vector<std::shared_ptr<RouteHandleIf>> children;
     if (!json.isObject()) {
@@ -94,9 +133,37 @@ RouteHandleProvider<RouteHandleIf>::create(
     } else if (json.count("children")) {
       children = factory.createList(json["children"]);
     }
-    return { makeHash(json, std::move(children)) };
+    return { makeHash(factory, json, std::move(children)) };
   } else if (type == "HostIdRoute") {
     return { makeRouteHandle<RouteHandleIf, HostIdRoute>(factory, json) };
+  } else if (type == "HotKeyReplicationRoute") {
+    checkLogic(json.isObject() && json.count("children"),
+               "HotKeyReplicationRoute: no children");
+    auto children = factory.createList(json["children"]);
+    size_t replicas = 3;
+    if (auto jreplicas = json.get_ptr("replicas")) {
+      checkLogic(jreplicas->isInt() && jreplicas->getInt() > 0,
+                 "HotKeyReplicationRoute: replicas is not a positive integer");
+      replicas = jreplicas->getInt();
+    }
+    if (children.size() <= 1 || replicas == 1) {
+      /* every replica would be the same box */
+      return { makeHash(factory, json, std::move(children)) };
+    }
+    std::vector<std::shared_ptr<RouteHandleIf>> targets;
+    targets.reserve(replicas);
+    targets.push_back(makeHash(factory, json, children));
+    for (size_t i = 1; i < replicas; ++i) {
+      /* same salts as ReliablePoolRoute's failover targets */
+      auto jhash = json;
+      jhash["salt"] = folly::to<std::string>("salt", i - 1);
+      targets.push_back(makeHash(factory, jhash, children));
+    }
+    factory.addStateful();
+    return { makeRouteHandle<RouteHandleIf, HotKeyReplicationRoute>(
+      json, std::move(targets)) };
+  } else if (type == "LargeStackRoute") {
+    return { makeRouteHandle<RouteHandleIf, LargeStackRoute>(factory, json) };
   } else if (type == "LatestRoute") {
     std::vector<std::shared_ptr<RouteHandleIf>> children;
     if (!json.isObject()) {
@@ -107,11 +174,36 @@ RouteHandleProvider<RouteHandleIf>::create(
     return { makeRouteHandle<RouteHandleIf, LatestRoute>(json,
                                                          std::move(children)) };
   } else if (type == "MissFailoverRoute") {
+    factory.addStateful();
     return { makeRouteHandle<RouteHandleIf, MissFailoverRoute>(factory, json) };
+  } else if (type == "NearCacheRoute") {
+    factory.addStateful();
+    return { makeRouteHandle<RouteHandleIf, NearCacheRoute>(factory, json) };
+  } else if (type == "NegativeCacheRoute") {
+    factory.addStateful();
+    return {
+      makeRouteHandle<RouteHandleIf, NegativeCacheRoute>(factory, json)
+    };
+  } else if (type == "NoreplyRoute") {
+    return { makeRouteHandle<RouteHandleIf, NoreplyRoute>(factory, json) };
   } else if (type == "NullRoute") {
     return { makeRouteHandle<RouteHandleIf, NullRoute>() };
   } else if (type == "RandomRoute") {
     return { makeRouteHandle<RouteHandleIf, RandomRoute>(factory, json) };
+  } else if (type == "ReplicationQueueRoute") {
+    factory.addStateful();
+    return {
+      makeRouteHandle<RouteHandleIf, ReplicationQueueRoute>(factory, json)
+    };
+  } else if (type == "StaleWhileRevalidateRoute") {
+    factory.addStateful();
+    return {
+      makeRouteHandle<RouteHandleIf, StaleWhileRevalidateRoute>(factory, json)
+    };
+  } else if (type == "ValueSizeSelectorRoute") {
+    return {
+      makeRouteHandle<RouteHandleIf, ValueSizeSelectorRoute>(factory, json)
+    };
   }
 
   return {};
@@ -136,6 +228,10 @@ RouteHandleProvider<RouteHandleIf>::createHash(
     return makeRouteHandle<RouteHandleIf, HashRoute, WeightedCh3HashFunc>(
       json, std::move(children));
   }
+  if (funcType == WeightedMaglevHashFunc::type()) {
+    return makeRouteHandle<RouteHandleIf, HashRoute, WeightedMaglevHashFunc>(
+      json, std::move(children));
+  }
   if (funcType == "Latest") {
     return makeRouteHandle<RouteHandleIf, LatestRoute>(
       json, std::move(children));
@@ -147,6 +243,7 @@ RouteHandleProvider<RouteHandleIf>::createHash(
 template <class RouteHandleIf>
 std::shared_ptr<RouteHandleIf>
 RouteHandleProvider<RouteHandleIf>::makeHash(
+    RouteHandleFactory<RouteHandleIf>& factory,
     const folly::dynamic& json,
     std::vector<std::shared_ptr<RouteHandleIf>> children) {
 
@@ -159,6 +256,17 @@ RouteHandleProvider<RouteHandleIf>::makeHash(
     funcType = func.stringPiece();
   }
 
+  if (children.size() == 1) {
+    /* Every key hashes to the only child. The HashRoute is still created
+       to validate the json. */
+    auto child = children[0];
+    if (!createHash(funcType, json, std::move(children))) {
+      return nullptr;
+    }
+    factory.addCollapsed();
+    return child;
+  }
+
   return createHash(funcType, json, std::move(children));
 }
 
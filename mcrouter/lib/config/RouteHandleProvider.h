@@ -48,9 +48,11 @@ class RouteHandleProvider : public RouteHandleProviderIf<RouteHandleIf> {
 
   /**
    * Helper method to parse "hash_func" and create corresponding HashRoute.
+   * With a single child, returns the child itself.
    */
   std::shared_ptr<RouteHandleIf>
-  makeHash(const folly::dynamic& json,
+  makeHash(RouteHandleFactory<RouteHandleIf>& factory,
+           const folly::dynamic& json,
            std::vector<std::shared_ptr<RouteHandleIf>> children);
 };
 
@@ -43,6 +43,25 @@ class RouteHandleProviderIf {
   create(RouteHandleFactory<RouteHandleIf>& factory, folly::StringPiece type,
          const folly::dynamic& json) = 0;
 
+  /**
+   * Used by RouteHandleFactory to check whether a cached subtree, that was
+   * created with RouteHandleFactory::addDependency(key, ...), can be reused.
+   *
+   * @return object currently registered for the key, nullptr if there's none.
+   */
+  virtual std::shared_ptr<const void> resolveDependency(
+      const std::string& key) {
+    return nullptr;
+  }
+
+  /**
+   * Called when RouteHandleFactory reuses a cached subtree, for every route
+   * handle exported with RouteHandleFactory::addExport(key, rh).
+   */
+  virtual void restoreExport(const std::string& key,
+                             std::shared_ptr<RouteHandleIf> rh) {
+  }
+
   virtual ~RouteHandleProviderIf() {};
 };
 
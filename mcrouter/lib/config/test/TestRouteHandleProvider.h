@@ -22,5 +22,9 @@
 #include "mcrouter/lib/routes/HostIdRoute.h"
 #include "mcrouter/lib/routes/LatestRoute.h"
 #include "mcrouter/lib/routes/MissFailoverRoute.h"
+#include "mcrouter/lib/routes/NearCacheRoute.h"
+#include "mcrouter/lib/routes/NegativeCacheRoute.h"
 #include "mcrouter/lib/routes/NullRoute.h"
 #include "mcrouter/lib/routes/RandomRoute.h"
+#include "mcrouter/lib/routes/ReplicationQueueRoute.h"
+#include "mcrouter/lib/routes/ValueSizeSelectorRoute.h"
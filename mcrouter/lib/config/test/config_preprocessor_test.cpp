@@ -155,3 +155,77 @@ TEST(ConfigPreprocessorTest, comments) {
 
   EXPECT_EQ(orig, expand);
 }
+
+TEST(ConfigPreprocessorTest, memoizeAndStats) {
+  MockImportResolver resolver;
+
+  auto jsonStr = R"({
+    "macros": {
+      "leaf": {
+        "type": "macroDef",
+        "params": [ "a" ],
+        "result": { "value": "%a%" }
+      },
+      "node": {
+        "type": "macroDef",
+        "params": [ "a" ],
+        "result": [ "@leaf(%a%)", "@leaf(%a%)" ]
+      },
+      "random": {
+        "type": "macroDef",
+        "result": "@shuffle(@range(1,10))"
+      }
+    },
+    "a": "@node(x)",
+    "b": "@node(x)",
+    "c": "@node(y)",
+    "d": [ "@random", "@random" ]
+  })";
+
+  ConfigPreprocessor::Stats stats;
+  auto json = ConfigPreprocessor::getConfigWithoutMacros(
+    jsonStr, resolver, kGlobalParams, 250, 1, &stats);
+
+  auto leaf = parseJsonString(R"({ "value": "x" })");
+  EXPECT_EQ(json["a"], json["b"]);
+  EXPECT_EQ(leaf, json["a"][0]);
+  EXPECT_EQ(leaf, json["a"][1]);
+  EXPECT_EQ("y", json["c"][0]["value"]);
+
+  EXPECT_EQ(3U, stats["node"].calls);
+  EXPECT_EQ(1U, stats["node"].memoized);
+  EXPECT_EQ(4U, stats["leaf"].calls);
+  EXPECT_EQ(2U, stats["leaf"].memoized);
+  // results of random macros are not memoized
+  EXPECT_EQ(2U, stats["random"].calls);
+  EXPECT_EQ(0U, stats["random"].memoized);
+  EXPECT_EQ(2U, stats["shuffle"].calls);
+
+  // expanding in parallel gives the same result
+  auto parallel = ConfigPreprocessor::getConfigWithoutMacros(
+    jsonStr, resolver, kGlobalParams, 250, 4);
+  EXPECT_EQ(json["a"], parallel["a"]);
+  EXPECT_EQ(json["b"], parallel["b"]);
+  EXPECT_EQ(json["c"], parallel["c"]);
+  EXPECT_EQ(2U, parallel["d"].size());
+}
+
+TEST(ConfigPreprocessorTest, parallelErrors) {
+  MockImportResolver resolver;
+
+  auto jsonStr = R"({
+    "a": "@int(1)",
+    "b": "@undefined",
+    "c": "@int(2)"
+  })";
+
+  try {
+    ConfigPreprocessor::getConfigWithoutMacros(
+      jsonStr, resolver, kGlobalParams, 250, 4);
+  } catch (const std::logic_error& e) {
+    EXPECT_NE(std::string::npos,
+              std::string(e.what()).find("Raw object property 'b'"));
+    return;
+  }
+  FAIL() << "No error thrown";
+}
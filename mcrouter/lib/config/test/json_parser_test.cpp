@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/dynamic.h>
+#include <folly/FileUtil.h>
+#include <folly/json.h>
+
+#include "mcrouter/lib/config/JsonParser.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+using facebook::memcache::parseJsonString;
+using facebook::memcache::parseJsonWithComments;
+
+namespace {
+
+void expectSameAsFolly(const std::string& jsonC) {
+  auto expected = parseJsonString(folly::json::stripComments(jsonC));
+  EXPECT_EQ(expected, parseJsonWithComments(jsonC)) << jsonC;
+}
+
+}  // anonymous namespace
+
+TEST(JsonParser, testFiles) {
+  for (auto file : {
+         "mcrouter/lib/config/test/config_preprocessor_test_file.json",
+         "mcrouter/lib/config/test/config_preprocessor_test_errors.json",
+         "mcrouter/lib/config/test/config_preprocessor_test_comments.json" }) {
+    std::string jsonC;
+    ASSERT_TRUE(folly::readFile(file, jsonC)) << "can not read " << file;
+    expectSameAsFolly(jsonC);
+  }
+}
+
+TEST(JsonParser, values) {
+  expectSameAsFolly("null");
+  expectSameAsFolly(" [true, false, null, 0, -1, 1.5, -2e-3, 1E+2] ");
+  expectSameAsFolly("9223372036854775807");
+  expectSameAsFolly("-9223372036854775808");
+  expectSameAsFolly(R"({"a": {"b": [[], {}]}, "c": "d", "a": 1})");
+  expectSameAsFolly(R"(["\"\\\/\b\f\n\r\t", "\u0041\u00e9\u4e2d",
+                       "\ud83d\ude00", "\u0000"])");
+  expectSameAsFolly("[1, 2,] // trailing comma");
+  expectSameAsFolly("{\"a\": 1, /* c */ \"b\": [ /**/ ], } /* unterminated");
+  expectSameAsFolly("{\"/*\": \"//\", \"x\": \"*/\"}");
+
+  auto inf = parseJsonWithComments("[Infinity, -Infinity]");
+  EXPECT_EQ(std::numeric_limits<double>::infinity(), inf[0].asDouble());
+  EXPECT_EQ(-std::numeric_limits<double>::infinity(), inf[1].asDouble());
+}
+
+TEST(JsonParser, errors) {
+  std::vector<std::string> invalid = {
+    "", "// nothing", "{", "[1, 2", "[,]", "[1,,2]", "{\"a\" 1}", "{a: 1}",
+    "{\"a\": 1,,}", "\"unterminated", "\"\\x\"", "\"\\u12\"", "\"\\ud800\"",
+    "\"\\udc00\"", "tru", "-", "1.", "1e", "99999999999999999999", "[1] 2",
+    std::string(2000, '[') + std::string(2000, ']')
+  };
+  for (const auto& jsonC : invalid) {
+    EXPECT_THROW(parseJsonWithComments(jsonC), std::runtime_error) << jsonC;
+  }
+
+  try {
+    parseJsonWithComments("{\n  \"a\": 1,\n  \"b\": }");
+    FAIL() << "No error thrown";
+  } catch (const std::runtime_error& e) {
+    EXPECT_NE(std::string::npos, std::string(e.what()).find("line 3"))
+      << e.what();
+  }
+}
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/config/ParsedJsonCache.h"
+
+using facebook::memcache::ParsedJsonCache;
+
+TEST(ParsedJsonCache, reusedWhileUnchanged) {
+  ParsedJsonCache cache;
+  auto a1 = cache.get("a", R"({"x": 1} // comment)");
+  auto b1 = cache.get("b", R"({"x": 1} // comment)");
+  auto a2 = cache.get("a", R"({"x": 1} // comment)");
+  EXPECT_EQ(a1, a2);
+  EXPECT_NE(a1, b1);
+  EXPECT_EQ(1, (*a1)["x"].asInt());
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(2, cache.misses());
+
+  /* changed contents are parsed again, and replace the old version */
+  auto a3 = cache.get("a", R"({"x": 2})");
+  EXPECT_NE(a1, a3);
+  EXPECT_EQ(2, (*a3)["x"].asInt());
+  EXPECT_EQ(a3, cache.get("a", R"({"x": 2})"));
+  EXPECT_NE(a1, cache.get("a", R"({"x": 1} // comment)"));
+  EXPECT_EQ(1, (*a1)["x"].asInt());
+}
+
+TEST(ParsedJsonCache, invalid) {
+  ParsedJsonCache cache;
+  EXPECT_THROW(cache.get("a", "{"), std::runtime_error);
+  EXPECT_THROW(cache.get("a", "{"), std::runtime_error);
+  EXPECT_EQ(0, cache.hits());
+}
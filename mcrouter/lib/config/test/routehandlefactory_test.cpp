@@ -10,6 +10,9 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include <folly/json.h>
+
+#include "mcrouter/lib/config/JsonFingerprint.h"
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/config/test/TestRouteHandleProvider.h"
 #include "mcrouter/lib/test/RouteHandleTestUtil.h"
@@ -100,3 +103,194 @@ TEST(RouteHandleFactoryTest, sanity) {
     EXPECT_TRUE(reply.isError());
   });
 }
+
+TEST(RouteHandleFactoryTest, reuseUnchangedSubtrees) {
+  RouteHandleProvider<TestRouteHandleIf> provider;
+
+  auto json1 = folly::parseJson(R"([
+    { "type": "AllSyncRoute", "children": [ "NullRoute" ] },
+    { "type": "FailoverRoute", "name": "b", "children": [ "ErrorRoute" ] }
+  ])");
+  JsonFingerprints fingerprints1(json1);
+  RouteHandleFactory<TestRouteHandleIf> factory1(provider, &fingerprints1,
+                                                 nullptr);
+  auto list1 = factory1.createList(json1);
+  ASSERT_EQ(2, list1.size());
+  EXPECT_EQ(0, factory1.reusedCount());
+  auto cache = factory1.releaseCache();
+  ASSERT_TRUE(cache != nullptr);
+  EXPECT_EQ(4, cache->size());
+
+  auto json2 = folly::parseJson(R"([
+    { "children": [ "NullRoute" ], "type": "AllSyncRoute" },
+    { "type": "FailoverRoute", "name": "b", "children": [ "NullRoute" ] }
+  ])");
+  JsonFingerprints fingerprints2(json2);
+  RouteHandleFactory<TestRouteHandleIf> factory2(provider, &fingerprints2,
+                                                 cache);
+  auto list2 = factory2.createList(json2);
+  ASSERT_EQ(2, list2.size());
+  EXPECT_EQ(1, factory2.reusedCount());
+  EXPECT_EQ(list1[0], list2[0]);
+  EXPECT_NE(list1[1], list2[1]);
+  /* reused handles are still in use, so they stay cached */
+  EXPECT_EQ(3, factory2.releaseCache()->size());
+}
+
+TEST(RouteHandleFactoryTest, reuseChecksNamedHandles) {
+  TestFiberManager fm;
+  RouteHandleProvider<TestRouteHandleIf> provider;
+
+  auto json1 = folly::parseJson(R"([
+    { "type": "AllSyncRoute", "name": "x", "children": [ "NullRoute" ] },
+    { "type": "FailoverRoute", "children": [ "x" ] }
+  ])");
+  JsonFingerprints fingerprints1(json1);
+  RouteHandleFactory<TestRouteHandleIf> factory1(provider, &fingerprints1,
+                                                 nullptr);
+  auto list1 = factory1.createList(json1);
+
+  /* same FailoverRoute json, but "x" changed */
+  auto json2 = folly::parseJson(R"([
+    { "type": "AllSyncRoute", "name": "x", "children": [ "ErrorRoute" ] },
+    { "type": "FailoverRoute", "children": [ "x" ] }
+  ])");
+  JsonFingerprints fingerprints2(json2);
+  RouteHandleFactory<TestRouteHandleIf> factory2(provider, &fingerprints2,
+                                                 factory1.releaseCache());
+  auto list2 = factory2.createList(json2);
+  ASSERT_EQ(2, list2.size());
+  EXPECT_EQ(0, factory2.reusedCount());
+  EXPECT_NE(list1[1], list2[1]);
+
+  auto rh = list2[1];
+  fm.run([&rh]() {
+    auto reply = rh->route(McRequest("a"), McOperation<mc_op_get>());
+    EXPECT_TRUE(reply.isError());
+  });
+
+  /* the whole config is the same, reuse everything */
+  RouteHandleFactory<TestRouteHandleIf> factory3(provider, &fingerprints2,
+                                                 factory2.releaseCache());
+  auto list3 = factory3.createList(json2);
+  EXPECT_EQ(2, factory3.reusedCount());
+  EXPECT_EQ(list2, list3);
+}
+
+TEST(RouteHandleFactoryTest, collapseSingleChild) {
+  RouteHandleProvider<TestRouteHandleIf> provider;
+
+  auto json1 = folly::parseJson(R"([
+    { "type": "AllSyncRoute", "name": "x", "children": [ "NullRoute" ] },
+    { "type": "FailoverRoute", "children": [ "x" ] },
+    { "type": "HashRoute", "children": [
+      { "type": "FailoverRoute", "children": [ "x" ] }
+    ] },
+    { "type": "FailoverRoute", "children": [ "x", "NullRoute" ] }
+  ])");
+  JsonFingerprints fingerprints1(json1);
+  RouteHandleFactory<TestRouteHandleIf> factory1(provider, &fingerprints1,
+                                                 nullptr);
+  auto list1 = factory1.createList(json1);
+  ASSERT_EQ(4, list1.size());
+  EXPECT_EQ(list1[0], list1[1]);
+  EXPECT_EQ(list1[0], list1[2]);
+  EXPECT_NE(list1[0], list1[3]);
+  /* the inner FailoverRoute is shared with the identical one above */
+  EXPECT_EQ(1, factory1.sharedCount());
+  EXPECT_EQ(2, factory1.collapsedCount());
+
+  /* reused subtrees are still counted */
+  RouteHandleFactory<TestRouteHandleIf> factory2(provider, &fingerprints1,
+                                                 factory1.releaseCache());
+  factory2.createList(json1);
+  EXPECT_EQ(4, factory2.reusedCount());
+  EXPECT_EQ(2, factory2.collapsedCount());
+}
+
+TEST(RouteHandleFactoryTest, shareIdenticalSubtrees) {
+  RouteHandleProvider<TestRouteHandleIf> provider;
+
+  auto json = folly::parseJson(R"([
+    { "type": "AllSyncRoute", "children": [
+      { "type": "HashRoute", "children": [ "NullRoute", "ErrorRoute" ] }
+    ] },
+    { "children": [
+      { "children": [ "NullRoute", "ErrorRoute" ], "type": "HashRoute" }
+    ], "type": "AllSyncRoute" },
+    { "type": "AllFastestRoute", "children": [
+      { "type": "HashRoute", "children": [ "NullRoute", "ErrorRoute" ] }
+    ] }
+  ])");
+  JsonFingerprints fingerprints(json);
+  RouteHandleFactory<TestRouteHandleIf> factory(provider, &fingerprints,
+                                                nullptr);
+  auto list = factory.createList(json);
+  ASSERT_EQ(3, list.size());
+  EXPECT_EQ(list[0], list[1]);
+  EXPECT_NE(list[0], list[2]);
+  /* the second AllSyncRoute and the HashRoute of AllFastestRoute */
+  EXPECT_EQ(2, factory.sharedCount());
+
+  /* the next config reuses shared subtrees once and shares them again */
+  RouteHandleFactory<TestRouteHandleIf> factory2(provider, &fingerprints,
+                                                 factory.releaseCache());
+  auto list2 = factory2.createList(json);
+  EXPECT_EQ(list, list2);
+  EXPECT_EQ(2, factory2.reusedCount());
+  EXPECT_EQ(1, factory2.sharedCount());
+
+  /* no sharing without fingerprints */
+  RouteHandleFactory<TestRouteHandleIf> factory3(provider);
+  auto list3 = factory3.createList(json);
+  EXPECT_NE(list3[0], list3[1]);
+  EXPECT_EQ(0, factory3.sharedCount());
+}
+
+TEST(RouteHandleFactoryTest, statefulSubtreesNotShared) {
+  RouteHandleProvider<TestRouteHandleIf> provider;
+
+  auto json = folly::parseJson(R"([
+    { "type": "AllSyncRoute", "children": [
+      { "type": "NegativeCacheRoute", "target": "NullRoute" }
+    ] },
+    { "type": "AllSyncRoute", "children": [
+      { "type": "NegativeCacheRoute", "target": "NullRoute" }
+    ] },
+    { "type": "NegativeCacheRoute", "target": "NullRoute", "name": "cache" },
+    "cache"
+  ])");
+  JsonFingerprints fingerprints(json);
+  RouteHandleFactory<TestRouteHandleIf> factory(provider, &fingerprints,
+                                                nullptr);
+  auto list = factory.createList(json);
+  ASSERT_EQ(4, list.size());
+  /* each would have a filter of its own */
+  EXPECT_NE(list[0], list[1]);
+  EXPECT_EQ(0, factory.sharedCount());
+  /* unless shared on purpose */
+  EXPECT_EQ(list[2], list[3]);
+
+  /* the next config still reuses every one of them */
+  RouteHandleFactory<TestRouteHandleIf> factory2(provider, &fingerprints,
+                                                 factory.releaseCache());
+  auto list2 = factory2.createList(json);
+  EXPECT_EQ(list, list2);
+  EXPECT_EQ(0, factory2.sharedCount());
+}
+
+TEST(RouteHandleFactoryTest, jsonFingerprint) {
+  auto a = folly::parseJson(R"({"a": [1, "b", 2.5], "c": {"d": null}})");
+  auto b = folly::parseJson(R"({"c": {"d": null}, "a": [1, "b", 2.5]})");
+  auto c = folly::parseJson(R"({"c": {"d": null}, "a": [1, 2.5, "b"]})");
+  auto d = folly::parseJson(R"({"c": {"d": null}, "a": [1, "1", 2.5]})");
+  EXPECT_EQ(jsonFingerprint(a), jsonFingerprint(b));
+  EXPECT_NE(jsonFingerprint(a), jsonFingerprint(c));
+  EXPECT_NE(jsonFingerprint(a), jsonFingerprint(d));
+  EXPECT_NE(jsonFingerprint(a["a"]), jsonFingerprint(a["c"]));
+
+  JsonFingerprints fingerprints(a);
+  EXPECT_EQ(jsonFingerprint(a), fingerprints.get(a));
+  EXPECT_EQ(jsonFingerprint(a["c"]), fingerprints.get(a["c"]));
+  EXPECT_EQ(jsonFingerprint(b["c"]), fingerprints.get(b["c"]));
+}
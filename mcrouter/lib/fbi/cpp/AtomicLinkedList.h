@@ -72,6 +72,25 @@ class AtomicLinkedList {
     return oldHead == nullptr;
   }
 
+  /**
+   * Atomically insert the already linked elements first..last at the head
+   * of the list, first becoming the new head. next(last) must be nullptr.
+   * @return True if the list was empty before the call.
+   */
+  bool insertHeadList(T* first, T* last) {
+    assert(next(last) == nullptr);
+
+    auto oldHead = head_.load(std::memory_order_relaxed);
+    do {
+      next(last) = oldHead;
+      /* See insertHead() for why oldHead is used directly */
+    } while (!head_.compare_exchange_weak(oldHead, first,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
+
+    return oldHead == nullptr;
+  }
+
   /**
    * Repeatedly replaces the head with nullptr,
    * and calls func() on the removed elements in the order from tail to head.
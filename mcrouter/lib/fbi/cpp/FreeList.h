@@ -0,0 +1,131 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Per thread list of free memory blocks for objects of type T.
+ *
+ * Blocks freed on a thread are reused by the next allocations on the same
+ * thread, so objects allocated and freed at a high rate don't go to malloc.
+ * Blocks can be freed on a different thread than they were allocated on.
+ * Once a thread holds kHighWater free blocks, half of them are given back
+ * to the allocator, so a burst doesn't pin memory forever.
+ */
+template <class T>
+class ThreadLocalFreeList {
+ public:
+  static constexpr size_t kHighWater = 1024;
+
+  static void* allocate() {
+    auto& l = local();
+    if (l.head == nullptr) {
+      ++l.allocatorCalls;
+      return ::operator new(sizeof(T));
+    }
+    auto node = l.head;
+    l.head = node->next;
+    --l.size;
+    return node;
+  }
+
+  static void deallocate(void* p) noexcept {
+    if (p == nullptr) {
+      return;
+    }
+    auto& l = local();
+    if (l.size >= kHighWater) {
+      l.trim(kHighWater / 2);
+    }
+    auto node = static_cast<Node*>(p);
+    node->next = l.head;
+    l.head = node;
+    ++l.size;
+  }
+
+  /**
+   * Number of blocks this thread got from the allocator,
+   * for tests and benchmarks.
+   */
+  static uint64_t allocatorCalls() {
+    return local().allocatorCalls;
+  }
+
+  /**
+   * Number of free blocks held by this thread.
+   */
+  static size_t freeBlocks() {
+    return local().size;
+  }
+
+ private:
+  struct Node {
+    Node* next;
+  };
+  static_assert(sizeof(T) >= sizeof(Node), "T is too small for a free list");
+
+  struct Local {
+    Node* head{nullptr};
+    size_t size{0};
+    uint64_t allocatorCalls{0};
+
+    void trim(size_t keep) noexcept {
+      while (size > keep) {
+        auto node = head;
+        head = node->next;
+        --size;
+        ::operator delete(node);
+      }
+    }
+
+    ~Local() {
+      trim(0);
+    }
+  };
+
+  static Local& local() {
+    static thread_local Local l;
+    return l;
+  }
+};
+
+template <class T>
+constexpr size_t ThreadLocalFreeList<T>::kHighWater;
+
+/**
+ * Inherit from this to allocate objects of (exactly) type T with new/delete
+ * from ThreadLocalFreeList<T>.
+ */
+template <class T>
+class FreeListAllocated {
+ public:
+  static void* operator new(size_t size) {
+    if (size != sizeof(T)) {
+      /* A subclass, or T is incomplete where the size is computed */
+      return ::operator new(size);
+    }
+    return ThreadLocalFreeList<T>::allocate();
+  }
+
+  static void operator delete(void* p, size_t size) noexcept {
+    if (size != sizeof(T)) {
+      ::operator delete(p);
+      return;
+    }
+    ThreadLocalFreeList<T>::deallocate(p);
+  }
+};
+
+}}  // facebook::memcache
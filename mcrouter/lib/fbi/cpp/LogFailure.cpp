@@ -11,6 +11,8 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <ctime>
 #include <map>
 #include <mutex>
@@ -23,6 +25,7 @@
 
 #include <folly/experimental/Singleton.h>
 #include <folly/Format.h>
+#include <folly/SpookyHashV2.h>
 
 #include "mcrouter/lib/fbi/cpp/util.h"
 
@@ -85,6 +88,24 @@ struct StaticContainer {
 
 folly::Singleton<StaticContainer> containerSingleton;
 
+/*
+ * Rate limit state of call sites, hashed into a fixed table so that no
+ * call site allocates; call sites sharing a slot share its limit.
+ * Plain statics, since failures may be logged during static destruction.
+ */
+struct RateLimitSlot {
+  /* Interval the counts are for, in intervals since the epoch */
+  std::atomic<uint64_t> window{0};
+  std::atomic<uint64_t> admitted{0};
+  std::atomic<uint64_t> dropped{0};
+};
+
+const size_t kRateLimitSlots = 1024;
+RateLimitSlot rateLimitSlots[kRateLimitSlots];
+
+std::atomic<size_t> rateLimitMax{100};
+std::atomic<uint64_t> rateLimitIntervalSec{10};
+
 }  // anonymous namespace
 
 namespace handlers {
@@ -150,9 +171,60 @@ void setServiceContext(folly::StringPiece service, std::string context) {
   }
 }
 
+void setRateLimit(size_t maxPerInterval, std::chrono::seconds interval) {
+  rateLimitMax.store(maxPerInterval, std::memory_order_relaxed);
+  rateLimitIntervalSec.store(std::max<int64_t>(interval.count(), 1),
+                             std::memory_order_relaxed);
+}
+
 void log(folly::StringPiece service,
          folly::StringPiece category,
          folly::StringPiece msg) {
+  if (detail::admit(service, category, msg)) {
+    detail::dispatch(service, category, msg);
+  }
+}
+
+namespace detail {
+
+bool admit(folly::StringPiece service,
+           folly::StringPiece category,
+           folly::StringPiece msgFormat) {
+  auto max = rateLimitMax.load(std::memory_order_relaxed);
+  if (max == 0) {
+    return true;
+  }
+
+  auto hash = folly::hash::SpookyHashV2::Hash64(
+    msgFormat.data(), msgFormat.size(),
+    folly::hash::SpookyHashV2::Hash64(category.data(), category.size(), 0));
+  auto& slot = rateLimitSlots[hash % kRateLimitSlots];
+
+  auto interval = rateLimitIntervalSec.load(std::memory_order_relaxed);
+  uint64_t now = time(nullptr) / interval;
+  auto window = slot.window.load(std::memory_order_relaxed);
+  if (window != now &&
+      slot.window.compare_exchange_strong(window, now)) {
+    /* Failures racing with the reset may be counted in either interval */
+    slot.admitted.store(0, std::memory_order_relaxed);
+    auto dropped = slot.dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped != 0) {
+      dispatch(service, category, folly::format(
+        "{} failures like '{}' dropped by the rate limit of {} per {}s",
+        dropped, msgFormat, max, interval).str());
+    }
+  }
+
+  if (slot.admitted.fetch_add(1, std::memory_order_relaxed) < max) {
+    return true;
+  }
+  slot.dropped.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void dispatch(folly::StringPiece service,
+              folly::StringPiece category,
+              folly::StringPiece msg) {
   std::map<std::string, std::string> contexts;
   std::vector<std::pair<std::string, HandlerFunc>> handlers;
   if (auto container = containerSingleton.get_weak().lock()) {
@@ -165,4 +237,6 @@ void log(folly::StringPiece service,
   }
 }
 
+}  // detail
+
 }}}  // facebook::memcache
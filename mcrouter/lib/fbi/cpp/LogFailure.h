@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <chrono>
+#include <cstddef>
 #include <functional>
 #include <map>
 #include <string>
@@ -106,24 +108,59 @@ bool setHandler(std::pair<std::string, HandlerFunc> handler);
  */
 void setServiceContext(folly::StringPiece service, std::string context);
 
+/**
+ * Failures of each call site (category and message format) are logged at
+ * most maxPerInterval times per interval, the others are dropped before
+ * the message is formatted. The number of dropped failures is logged
+ * with the first failure of the call site in a later interval.
+ * 0 means unlimited. Defaults to 100 per 10 seconds.
+ */
+void setRateLimit(size_t maxPerInterval, std::chrono::seconds interval);
+
+namespace detail {
+
+/**
+ * Takes a token of the call site, see setRateLimit(). Takes no locks and
+ * allocates nothing unless a summary of dropped failures is due.
+ *
+ * @return  false if the failure must be dropped
+ */
+bool admit(folly::StringPiece service,
+           folly::StringPiece category,
+           folly::StringPiece msgFormat);
+
+/**
+ * Passes the failure to all handlers, without rate limiting.
+ */
+void dispatch(folly::StringPiece service,
+              folly::StringPiece category,
+              folly::StringPiece msg);
+
+}  // detail
+
 /**
  * Log failure according to action for given category (see @setCategoryAction).
  * If no special action is provided, default constructed one will be used.
+ * Rate limited by message, see setRateLimit().
  */
 void log(folly::StringPiece service,
          folly::StringPiece category,
          folly::StringPiece msg);
 
 /**
- * log overload to format messages automatically.
+ * log overload to format messages automatically. Rate limited by message
+ * format, arguments are only formatted if the failure is logged.
  */
 template <typename... Args>
 void log(folly::StringPiece service,
          folly::StringPiece category,
          folly::StringPiece msgFormat,
          Args&&... args) {
-  log(service, category,
-      folly::format(msgFormat, std::forward<Args>(args)...).str());
+  if (!detail::admit(service, category, msgFormat)) {
+    return;
+  }
+  detail::dispatch(service, category,
+                   folly::format(msgFormat, std::forward<Args>(args)...).str());
 }
 
 }}}  // facebook::memcache::failure
@@ -0,0 +1,194 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Immutable map from string keys to values, optimized for longest prefix
+ * lookups. Built once (e.g. at config load), then only read.
+ *
+ * Keys are kept sorted in a single contiguous buffer. For every key we also
+ * store the index of its longest proper prefix in the map. The longest
+ * prefix of a string S is then found by binary search for the greatest key
+ * K <= S (every prefix of S in the map is also a prefix of K) followed by
+ * walking K's prefix chain until a prefix of S is found. Keys are bucketed
+ * by their first character to narrow the search.
+ *
+ * Compared to Trie this needs no per character nodes, so it uses a fraction
+ * of the memory and lookups touch a few contiguous arrays instead of chasing
+ * one pointer per character of the key.
+ *
+ * @param Value type of stored value
+ */
+template <class Value>
+class PrefixMap {
+ public:
+  typedef std::pair<std::string, Value> value_type;
+
+  PrefixMap() {
+    bucket_.fill(0);
+  }
+
+  /**
+   * @param items  key-value pairs in any order. If a key is repeated,
+   *               the last value wins. Keys may contain any characters.
+   */
+  explicit PrefixMap(std::vector<value_type> items) {
+    std::stable_sort(items.begin(), items.end(),
+                     [](const value_type& a, const value_type& b) {
+                       return a.first < b.first;
+                     });
+
+    offsets_.push_back(0);
+    for (size_t i = 0; i < items.size(); ++i) {
+      if (i + 1 < items.size() && items[i].first == items[i + 1].first) {
+        continue;
+      }
+      keys_.append(items[i].first);
+      offsets_.push_back(keys_.size());
+      values_.push_back(std::move(items[i].second));
+    }
+    keys_.shrink_to_fit();
+    offsets_.shrink_to_fit();
+    values_.shrink_to_fit();
+
+    /* Keys are sorted, so all the prefixes of a key come before it and
+       are still on the stack when it's reached. */
+    parents_.reserve(values_.size());
+    std::vector<uint32_t> stack;
+    for (uint32_t i = 0; i < values_.size(); ++i) {
+      while (!stack.empty() && !isPrefix(key(stack.back()), key(i))) {
+        stack.pop_back();
+      }
+      parents_.push_back(stack.empty() ? kNone : stack.back());
+      stack.push_back(i);
+    }
+
+    /* bucket_[c] is the index of the first key starting with a character
+       >= c (as unsigned), the empty key sorts before everything. */
+    uint32_t idx = values_.size() > 0 && key(0).empty() ? 1 : 0;
+    for (size_t c = 0; c < 256; ++c) {
+      while (idx < values_.size() &&
+             static_cast<unsigned char>(key(idx)[0]) < c) {
+        ++idx;
+      }
+      bucket_[c] = idx;
+    }
+    bucket_[256] = values_.size();
+  }
+
+  /**
+   * @return pointer to value stored for the key, nullptr if there's none
+   */
+  const Value* find(folly::StringPiece k) const {
+    auto idx = upperBound(k);
+    return idx > 0 && key(idx - 1) == k ? &values_[idx - 1] : nullptr;
+  }
+
+  /**
+   * @return pointer to value of the longest key that is a prefix of k,
+   *         nullptr if there's none
+   */
+  const Value* findPrefix(folly::StringPiece k) const {
+    auto idx = upperBound(k);
+    if (idx == 0) {
+      return nullptr;
+    }
+    for (uint32_t i = idx - 1; i != kNone; i = parents_[i]) {
+      if (isPrefix(key(i), k)) {
+        return &values_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  size_t size() const {
+    return values_.size();
+  }
+
+  bool empty() const {
+    return values_.empty();
+  }
+
+  /**
+   * @return key with given index, keys are indexed in sorted order
+   */
+  folly::StringPiece key(size_t i) const {
+    return folly::StringPiece(keys_.data() + offsets_[i],
+                              keys_.data() + offsets_[i + 1]);
+  }
+
+  const Value& value(size_t i) const {
+    return values_[i];
+  }
+
+  /**
+   * @return memory used by the index itself (not counting what values own)
+   */
+  size_t memoryUsage() const {
+    return sizeof(*this) + keys_.capacity() +
+      offsets_.capacity() * sizeof(uint32_t) +
+      parents_.capacity() * sizeof(uint32_t) +
+      values_.capacity() * sizeof(Value);
+  }
+
+ private:
+  static constexpr uint32_t kNone = static_cast<uint32_t>(-1);
+
+  std::string keys_;
+  /* key i is keys_[offsets_[i], offsets_[i + 1]) */
+  std::vector<uint32_t> offsets_;
+  /* index of the longest proper prefix of key i, kNone if there's none */
+  std::vector<uint32_t> parents_;
+  std::vector<Value> values_;
+  std::array<uint32_t, 257> bucket_;
+
+  static bool isPrefix(folly::StringPiece prefix, folly::StringPiece s) {
+    return prefix.size() <= s.size() &&
+      std::memcmp(prefix.data(), s.data(), prefix.size()) == 0;
+  }
+
+  /**
+   * @return index of the first key greater than k, size() if there's none
+   */
+  uint32_t upperBound(folly::StringPiece k) const {
+    if (k.empty()) {
+      return values_.size() > 0 && key(0).empty() ? 1 : 0;
+    }
+    auto c = static_cast<unsigned char>(k[0]);
+    uint32_t lo = bucket_[c];
+    uint32_t hi = bucket_[c + 1];
+    while (lo < hi) {
+      auto mid = lo + (hi - lo) / 2;
+      if (k < key(mid)) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    return lo;
+  }
+};
+
+template <class Value>
+constexpr uint32_t PrefixMap<Value>::kNone;
+
+}}  // facebook::memcache
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <iostream>
+#include <memory>
+
+#include <gflags/gflags.h>
+
+#include "folly/Benchmark.h"
+#include "mcrouter/lib/fbi/cpp/FreeList.h"
+
+using facebook::memcache::FreeListAllocated;
+using facebook::memcache::ThreadLocalFreeList;
+
+namespace {
+
+/* Roughly the size of a request context */
+constexpr size_t kContextSize = 256;
+/* Requests in flight at the same time */
+constexpr size_t kOutstanding = 64;
+
+struct MallocContext {
+  char data[kContextSize];
+};
+
+struct PooledContext : public FreeListAllocated<PooledContext> {
+  char data[kContextSize];
+};
+
+uint64_t gMallocCalls = 0;
+uint64_t gRequests = 0;
+
+template <class Context>
+void runRequests(size_t iters) {
+  std::unique_ptr<Context> inflight[kOutstanding];
+  for (size_t i = 0; i < iters; ++i) {
+    /* Replaces the oldest outstanding request with a new one */
+    inflight[i % kOutstanding].reset(new Context());
+    folly::doNotOptimizeAway(inflight[i % kOutstanding]->data[0]);
+  }
+}
+
+}  // anonymous namespace
+
+BENCHMARK(Context_malloc, iters) {
+  runRequests<MallocContext>(iters);
+}
+
+BENCHMARK_RELATIVE(Context_freeList, iters) {
+  auto before = ThreadLocalFreeList<PooledContext>::allocatorCalls();
+  runRequests<PooledContext>(iters);
+  gMallocCalls += ThreadLocalFreeList<PooledContext>::allocatorCalls() - before;
+  gRequests += iters;
+}
+
+int main(int argc, char **argv){
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarksOnFlag();
+  if (gRequests > 0) {
+    std::cout << "allocator calls per request: malloc 1.0, free list "
+              << static_cast<double>(gMallocCalls) / gRequests << std::endl;
+  }
+  return 0;
+}
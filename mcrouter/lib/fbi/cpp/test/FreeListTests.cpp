@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/fbi/cpp/FreeList.h"
+
+using facebook::memcache::FreeListAllocated;
+using facebook::memcache::ThreadLocalFreeList;
+
+namespace {
+
+struct Object : public FreeListAllocated<Object> {
+  explicit Object(int v) : value(v) {}
+  int value;
+  char padding[64];
+};
+
+struct Base {
+  virtual ~Base() {}
+};
+
+struct Derived : public Base, public FreeListAllocated<Derived> {
+  char data[128];
+};
+
+}  // anonymous namespace
+
+TEST(FreeList, reuse) {
+  auto calls = ThreadLocalFreeList<Object>::allocatorCalls();
+  auto blocks = ThreadLocalFreeList<Object>::freeBlocks();
+  std::vector<std::unique_ptr<Object>> objects;
+  for (int i = 0; i < 10; ++i) {
+    objects.emplace_back(new Object(i));
+  }
+  EXPECT_EQ(calls + 10, ThreadLocalFreeList<Object>::allocatorCalls());
+  objects.clear();
+  EXPECT_EQ(blocks + 10, ThreadLocalFreeList<Object>::freeBlocks());
+
+  for (int round = 0; round < 100; ++round) {
+    for (int i = 0; i < 10; ++i) {
+      objects.emplace_back(new Object(i));
+    }
+    EXPECT_EQ(9, objects.back()->value);
+    objects.clear();
+  }
+  /* Everything came from the free list */
+  EXPECT_EQ(calls + 10, ThreadLocalFreeList<Object>::allocatorCalls());
+}
+
+TEST(FreeList, virtualDelete) {
+  auto calls = ThreadLocalFreeList<Derived>::allocatorCalls();
+  std::unique_ptr<Base> p(new Derived());
+  p.reset();
+  p.reset(new Derived());
+  p.reset();
+  EXPECT_EQ(calls + 1, ThreadLocalFreeList<Derived>::allocatorCalls());
+}
+
+TEST(FreeList, highWaterTrim) {
+  std::thread([]() {
+    const size_t n = ThreadLocalFreeList<Object>::kHighWater + 10;
+    std::vector<std::unique_ptr<Object>> objects;
+    for (size_t i = 0; i < n; ++i) {
+      objects.emplace_back(new Object(i));
+    }
+    objects.clear();
+    EXPECT_LE(ThreadLocalFreeList<Object>::freeBlocks(),
+              ThreadLocalFreeList<Object>::kHighWater);
+  }).join();
+}
+
+TEST(FreeList, otherThread) {
+  std::unique_ptr<Object> p(new Object(1));
+  auto before = ThreadLocalFreeList<Object>::freeBlocks();
+  std::thread([&p]() {
+    p.reset();
+    EXPECT_EQ(1, ThreadLocalFreeList<Object>::freeBlocks());
+  }).join();
+  EXPECT_EQ(before, ThreadLocalFreeList<Object>::freeBlocks());
+}
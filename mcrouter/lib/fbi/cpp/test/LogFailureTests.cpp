@@ -0,0 +1,48 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/fbi/cpp/LogFailure.h"
+
+using namespace facebook::memcache;
+
+TEST(LogFailure, RateLimitPerCallSite) {
+  std::vector<std::string> logged;
+  failure::setHandler(std::make_pair<std::string, failure::HandlerFunc>(
+    "logToStdError",
+    [&logged](folly::StringPiece, folly::StringPiece, folly::StringPiece msg,
+              const std::map<std::string, std::string>&) {
+      logged.push_back(msg.str());
+    }));
+  failure::setRateLimit(2, std::chrono::hours(1));
+
+  for (int i = 0; i < 5; ++i) {
+    failure::log("test", failure::Category::kOther, "first {}", i);
+    failure::log("test", failure::Category::kOther, "second {}", i);
+  }
+  /* each format has its own limit */
+  ASSERT_EQ(4, logged.size());
+  EXPECT_EQ("first 0", logged[0]);
+  EXPECT_EQ("second 0", logged[1]);
+  EXPECT_EQ("first 1", logged[2]);
+  EXPECT_EQ("second 1", logged[3]);
+
+  failure::setRateLimit(0, std::chrono::hours(1));
+  failure::log("test", failure::Category::kOther, "first {}", 5);
+  EXPECT_EQ(5, logged.size());
+
+  failure::setRateLimit(100, std::chrono::seconds(10));
+  failure::setHandler(failure::handlers::verboseLogToStdError());
+}
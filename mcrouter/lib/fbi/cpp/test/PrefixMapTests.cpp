@@ -0,0 +1,89 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/fbi/cpp/PrefixMap.h"
+#include "mcrouter/lib/fbi/cpp/Trie.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+
+using facebook::memcache::PrefixMap;
+using facebook::memcache::Trie;
+
+TEST(PrefixMap, SanityTest) {
+  PrefixMap<int> empty;
+  EXPECT_TRUE(empty.find("") == nullptr);
+  EXPECT_TRUE(empty.findPrefix("abc") == nullptr);
+
+  PrefixMap<int> map({{"hello", 1}, {"world", 2}, {"!helloo~", 3}, {"", 4},
+                      {"hello", 5}});
+  EXPECT_EQ(4, map.size());
+  EXPECT_EQ(5, *map.find("hello"));
+  EXPECT_EQ(2, *map.find("world"));
+  EXPECT_EQ(3, *map.find("!helloo~"));
+  EXPECT_EQ(4, *map.find(""));
+  EXPECT_TRUE(map.find("hell") == nullptr);
+  EXPECT_TRUE(map.find("helloo") == nullptr);
+
+  EXPECT_EQ("", map.key(0));
+  EXPECT_EQ("!helloo~", map.key(1));
+  EXPECT_EQ("hello", map.key(2));
+  EXPECT_EQ("world", map.key(3));
+}
+
+TEST(PrefixMap, PrefixTest) {
+  PrefixMap<int> map({{"a", 1}, {"ab", 2}, {"abc", 3}, {"abd", 4},
+                      {"b\xff", 5}});
+
+  EXPECT_EQ(1, *map.findPrefix("a"));
+  EXPECT_EQ(2, *map.findPrefix("ab111"));
+  EXPECT_EQ(3, *map.findPrefix("abc"));
+  EXPECT_EQ(4, *map.findPrefix("abdasdfkljasdklfjsdaklfjsdflkj"));
+  EXPECT_EQ(2, *map.findPrefix("abb"));
+  EXPECT_EQ(1, *map.findPrefix("aa"));
+  EXPECT_EQ(5, *map.findPrefix("b\xff\xff"));
+  EXPECT_TRUE(map.findPrefix("b") == nullptr);
+  EXPECT_TRUE(map.findPrefix("cd") == nullptr);
+  EXPECT_TRUE(map.findPrefix("") == nullptr);
+}
+
+TEST(PrefixMap, MatchesTrie) {
+  std::vector<std::pair<std::string, int>> items;
+  Trie<int> trie;
+  for (int i = 0; i < 1000; ++i) {
+    auto key = facebook::memcache::randomString(0, 6, "abc:");
+    items.emplace_back(key, i);
+    trie.emplace(key, i);
+  }
+  PrefixMap<int> map(items);
+  EXPECT_EQ(std::distance(trie.begin(), trie.end()), map.size());
+
+  for (int i = 0; i < 10000; ++i) {
+    auto key = facebook::memcache::randomString(0, 10, "abc:");
+    auto expected = trie.findPrefix(key);
+    auto found = map.findPrefix(key);
+    if (expected == trie.end()) {
+      EXPECT_TRUE(found == nullptr);
+    } else {
+      ASSERT_TRUE(found != nullptr);
+      EXPECT_EQ(expected->second, *found);
+    }
+
+    auto expectedExact = trie.find(key);
+    auto foundExact = map.find(key);
+    EXPECT_EQ(expectedExact == trie.end(), foundExact == nullptr);
+    if (foundExact) {
+      EXPECT_EQ(expectedExact->second, *foundExact);
+    }
+  }
+}
@@ -7,14 +7,23 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <malloc.h>
+
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include "folly/Benchmark.h"
+#include "folly/Memory.h"
+#include "mcrouter/lib/fbi/cpp/PrefixMap.h"
 #include "mcrouter/lib/fbi/cpp/Trie.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
 
+using facebook::memcache::PrefixMap;
 using facebook::memcache::Trie;
 
 static int const kNumGetKeys = 7;
@@ -28,8 +37,16 @@ static std::string keysToGet[kNumGetKeys] = {
   "abd",
 };
 static Trie<long> randTrie;
+static PrefixMap<long> randMap;
 static long x = 0;
 
+/* Config sized set: thousands of key prefixes looked up by full keys */
+static int const kNumConfigPrefixes = 5000;
+static int const kNumConfigKeys = 1000;
+static std::unique_ptr<Trie<long>> configTrie;
+static std::unique_ptr<PrefixMap<long>> configMap;
+static std::vector<std::string> configKeys;
+
 static void prepareRand() {
   static std::string keys[] = {
     "abacaba",
@@ -39,9 +56,44 @@ static void prepareRand() {
   };
   auto numKeys = sizeof(keys) / sizeof(keys[0]);
 
+  std::vector<std::pair<std::string, long>> items;
   for (long i = 0; i < numKeys; ++i) {
     randTrie.emplace(keys[i], i + 1);
+    items.emplace_back(keys[i], i + 1);
   }
+  randMap = PrefixMap<long>(std::move(items));
+}
+
+static size_t heapInUse() {
+  return mallinfo().uordblks;
+}
+
+static void prepareConfig() {
+  using facebook::memcache::randomString;
+
+  std::vector<std::pair<std::string, long>> items;
+  for (long i = 0; i < kNumConfigPrefixes; ++i) {
+    items.emplace_back(randomString(3, 6, "abcdefgh") + ":" +
+                       randomString(0, 10, "abcdefgh") + ":", i + 1);
+  }
+  for (int i = 0; i < kNumConfigKeys; ++i) {
+    auto& prefix = items[i * (kNumConfigPrefixes / kNumConfigKeys)].first;
+    configKeys.push_back(prefix + randomString(10, 30));
+  }
+
+  auto before = heapInUse();
+  configTrie = folly::make_unique<Trie<long>>();
+  for (auto& it : items) {
+    configTrie->emplace(it.first, it.second);
+  }
+  auto trieBytes = heapInUse() - before;
+
+  before = heapInUse();
+  configMap = folly::make_unique<PrefixMap<long>>(items);
+  auto mapBytes = heapInUse() - before;
+
+  std::cout << kNumConfigPrefixes << " prefixes: Trie uses " << trieBytes
+            << " bytes, PrefixMap uses " << mapBytes << " bytes" << std::endl;
 }
 
 BENCHMARK(Trie_get) {
@@ -58,10 +110,47 @@ BENCHMARK(Trie_get_prefix) {
   }
 }
 
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(PrefixMap_get) {
+  for (int i = 0; i < kNumGetKeys; ++i) {
+    auto r = randMap.find(keysToGet[i]);
+    x += r == nullptr ? 0 : *r;
+  }
+}
+
+BENCHMARK(PrefixMap_get_prefix) {
+  for (int i = 0; i < kNumGetKeys; ++i) {
+    auto r = randMap.findPrefix(keysToGet[i]);
+    x += r == nullptr ? 0 : *r;
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(Trie_config_get_prefix, iters) {
+  long sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    auto r = configTrie->findPrefix(configKeys[i % kNumConfigKeys]);
+    sum += r == configTrie->end() ? 0 : r->second;
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+BENCHMARK_RELATIVE(PrefixMap_config_get_prefix, iters) {
+  long sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    auto r = configMap->findPrefix(configKeys[i % kNumConfigKeys]);
+    sum += r == nullptr ? 0 : *r;
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
 int main(int argc, char **argv){
   prepareRand();
+  prepareConfig();
   google::ParseCommandLineFlags(&argc, &argv, true);
   folly::runBenchmarksOnFlag();
-  std::cout << "check (should be num of iters*12): " << x << std::endl;
+  std::cout << "check (should be num of iters*24): " << x << std::endl;
   return 0;
 }
@@ -54,6 +54,11 @@ uint32_t getMemcacheKeyHashValue(folly::StringPiece key) {
     folly::hash::SpookyHashV2::Hash32(key.begin(), key.size(), /* seed= */ 0);
 }
 
+uint64_t getMemcacheKeyDigest(folly::StringPiece key) {
+  return
+    folly::hash::SpookyHashV2::Hash64(key.begin(), key.size(), /* seed= */ 0);
+}
+
 bool determineIfSampleKeyForViolet(uint32_t routingKeyHash,
                                    uint32_t sample_period) {
   assert(sample_period > 0);
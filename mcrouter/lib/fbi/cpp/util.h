@@ -133,6 +133,12 @@ std::string randomString(size_t minLen = 1, size_t maxLen = 20,
  */
 uint32_t getMemcacheKeyHashValue(folly::StringPiece key);
 
+/**
+ * 64-bit version of getMemcacheKeyHashValue(), the lower 32 bits
+ * are the same.
+ */
+uint64_t getMemcacheKeyDigest(folly::StringPiece key);
+
 /**
  * Checks if the given hash is within a range.
  * The range is from 0 to (MAX(uint32_t)/sample_rate)
@@ -8,6 +8,7 @@
  *
  */
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <sys/time.h>
@@ -122,25 +123,17 @@ static uint64_t murmur_rehash_64A(uint64_t k) {
 /**
  * furc_get_bit -- the bitstream generator
  *
- * Given a key and an index, provides a pseudorandom bit dependent on both.
- * Caches hash values; a NULL key clears the cache.
+ * Given a key digest and an index, provides a pseudorandom bit dependent
+ * on both.  Caches hash values in |hash|, hash[0] is the digest.
  */
-static uint32_t furc_get_bit(const char* const key, const size_t len,
-                             const uint32_t idx, uint64_t* hash,
+static uint32_t furc_get_bit(const uint32_t idx, uint64_t* hash,
                              int32_t* old_ord_p) {
     int32_t ord = (idx >> 6);
     int n;
 
-    if (key == NULL) {
-        *old_ord_p = -1;
-        return 0;
-    }
-
     if (*old_ord_p < ord) {
         for (n = *old_ord_p + 1; n <= ord; n++) {
-            hash[n] = ((n == 0)
-                       ? murmur_hash_64A(key, len, SEED)
-                       : murmur_rehash_64A(hash[n-1]));
+            hash[n] = murmur_rehash_64A(hash[n-1]);
         }
         *old_ord_p = ord;
     }
@@ -148,7 +141,18 @@ static uint32_t furc_get_bit(const char* const key, const size_t len,
     return (hash[ord] >> (idx&0x3f)) & 0x1;
 }
 
+uint64_t furc_key_digest(const char* const key, const size_t len) {
+    return murmur_hash_64A(key, len, SEED);
+}
+
 uint32_t furc_hash(const char* const key, const size_t len, const uint32_t m) {
+    if (m <= 1) {
+        return 0;
+    }
+    return furc_hash_digest(furc_key_digest(key, len), m);
+}
+
+uint32_t furc_hash_digest(const uint64_t digest, const uint32_t m) {
     uint32_t try;
     uint32_t d;
     uint32_t num;
@@ -163,13 +167,14 @@ uint32_t furc_hash(const char* const key, const size_t len, const uint32_t m) {
         return 0;
     }
 
-    furc_get_bit(NULL, 0, 0, hash, &old_ord);
+    hash[0] = digest;
+    old_ord = 0;
     for (d = 0; m > (1ul << d); d++)
         ;
 
     a = d;
     for (try = 0; try < MAX_TRIES; try++) {
-        while (!furc_get_bit(key, len, a, hash, &old_ord)) {
+        while (!furc_get_bit(a, hash, &old_ord)) {
             if (--d == 0) {
                 return 0;
             }
@@ -178,7 +183,7 @@ uint32_t furc_hash(const char* const key, const size_t len, const uint32_t m) {
         a += FURC_SHIFT;
         num = 1;
         for (i = 0; i < d-1; i++) {
-            num = (num << 1) | furc_get_bit(key, len, a, hash, &old_ord);
+            num = (num << 1) | furc_get_bit(a, hash, &old_ord);
             a += FURC_SHIFT;
         }
         if (num < m) {
@@ -273,16 +278,177 @@ static const unsigned int crc32tab[256] = {
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
 };
 
-uint32_t crc32_hash(const char* const key, const size_t len) {
-	uint32_t crc;
-	unsigned int i;
+/*
+ * crc32tab extended for slicing-by-8: crc32_slice[k][b] is the crc of byte b
+ * followed by k zero bytes. Filled in by crc32_init().
+ */
+static uint32_t crc32_slice[8][256];
 
-	crc = ~0;
+/* Whether the carry-less multiply version can be used on this cpu */
+static int crc32_have_clmul;
 
-	for (i = 0; i < len; i++) {
-        crc = (crc >> 8) ^ crc32tab[(crc ^ (key[i])) & 0xff];
+/* Keys shorter than this aren't worth the folding setup */
+#define CRC32_CLMUL_MIN_LEN 64
+
+static uint32_t crc32_bytes(uint32_t crc, const unsigned char* p,
+                            size_t len) {
+  while (len--) {
+    crc = (crc >> 8) ^ crc32tab[(crc ^ *p++) & 0xff];
+  }
+  return crc;
+}
+
+static uint32_t crc32_sliced(uint32_t crc, const unsigned char* p,
+                             size_t len) {
+  while (len >= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, p, sizeof(lo));
+    memcpy(&hi, p + 4, sizeof(hi));
+    lo ^= crc;
+    crc = crc32_slice[7][lo & 0xff] ^
+          crc32_slice[6][(lo >> 8) & 0xff] ^
+          crc32_slice[5][(lo >> 16) & 0xff] ^
+          crc32_slice[4][lo >> 24] ^
+          crc32_slice[3][hi & 0xff] ^
+          crc32_slice[2][(hi >> 8) & 0xff] ^
+          crc32_slice[1][(hi >> 16) & 0xff] ^
+          crc32_slice[0][hi >> 24];
+    p += 8;
+    len -= 8;
+  }
+  return crc32_bytes(crc, p, len);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+/**
+ * Folds the key 64 bytes at a time with carry-less multiplication, see
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction" (Intel, 2009). The constants are for the bit-reflected
+ * crc32 polynomial 0x04c11db7, so the result is the same as crc32_bytes().
+ * Note that the SSE4.2 crc32 instruction uses a different polynomial
+ * (crc32c) and can't be used here without moving every key.
+ *
+ * @param len  at least CRC32_CLMUL_MIN_LEN
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_clmul(uint32_t crc, const unsigned char* p,
+                            size_t len) {
+  static const uint64_t k1k2[2] __attribute__((aligned(16))) =
+    { 0x0154442bd4ULL, 0x01c6e41596ULL };
+  static const uint64_t k3k4[2] __attribute__((aligned(16))) =
+    { 0x01751997d0ULL, 0x00ccaa009eULL };
+  static const uint64_t k5k0[2] __attribute__((aligned(16))) =
+    { 0x0163cd6124ULL, 0x0000000000ULL };
+  static const uint64_t poly[2] __attribute__((aligned(16))) =
+    { 0x01db710641ULL, 0x01f7011641ULL };
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+  x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+  x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+  x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  x0 = _mm_load_si128((const __m128i*)k1k2);
+  p += 64;
+  len -= 64;
+
+  /* fold 4 x 128 bits in parallel */
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128((const __m128i*)(p + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                       _mm_loadu_si128((const __m128i*)(p + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                       _mm_loadu_si128((const __m128i*)(p + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                       _mm_loadu_si128((const __m128i*)(p + 0x30)));
+    p += 64;
+    len -= 64;
+  }
+
+  /* fold into 128 bits */
+  x0 = _mm_load_si128((const __m128i*)k3k4);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* fold the remaining 16 byte blocks */
+  while (len >= 16) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128((const __m128i*)p));
+    p += 16;
+    len -= 16;
+  }
+
+  /* fold 128 bits to 64 bits */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x0 = _mm_load_si128((const __m128i*)poly);
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  crc = _mm_extract_epi32(x1, 1);
+  return crc32_sliced(crc, p, len);
+}
+#endif
+
+__attribute__((constructor))
+static void crc32_init(void) {
+  int i, k;
+  for (i = 0; i < 256; i++) {
+    crc32_slice[0][i] = crc32tab[i];
+  }
+  for (k = 1; k < 8; k++) {
+    for (i = 0; i < 256; i++) {
+      uint32_t prev = crc32_slice[k - 1][i];
+      crc32_slice[k][i] = (prev >> 8) ^ crc32tab[prev & 0xff];
     }
+  }
+#if defined(__x86_64__) && defined(__GNUC__)
+  __builtin_cpu_init();
+  crc32_have_clmul = __builtin_cpu_supports("pclmul") &&
+    __builtin_cpu_supports("sse4.1");
+#endif
+}
 
-	//crc = (~crc >> 16) & 0x7fff;
-    return (~crc);
+uint32_t crc32_hash(const char* const key, const size_t len) {
+  const unsigned char* p = (const unsigned char*)key;
+  uint32_t crc = ~0;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (crc32_have_clmul && len >= CRC32_CLMUL_MIN_LEN) {
+    return ~crc32_clmul(crc, p, len);
+  }
+#endif
+  return ~crc32_sliced(crc, p, len);
 }
@@ -47,6 +47,15 @@ __BEGIN_DECLS
 uint32_t furc_hash(const char* const key, const size_t len,
                    const uint32_t m);
 
+/**
+ * The part of furc_hash() that reads the key: furc_hash(key, len, m) is
+ * furc_hash_digest(furc_key_digest(key, len), m) for m > 1.  A key hashed
+ * into pools of different sizes only needs to be read once.
+ */
+uint64_t furc_key_digest(const char* const key, const size_t len);
+
+uint32_t furc_hash_digest(const uint64_t digest, const uint32_t m);
+
 uint32_t furc_maximum_pool_size(void);
 
 /**
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/**
+ * Outstanding object counters (mc_msg_num_outstanding,
+ * proxy_request_num_outstanding) updated from 1 to 32 threads at once:
+ * a plain atomic shared by all of them, as they used to be, against
+ * counter_t. Every iteration is an increment and a decrement on each
+ * thread, so a flat time per iteration means it scales.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+
+#include "mcrouter/lib/fbi/counter.h"
+
+namespace {
+
+const size_t kThreads[] = {1, 2, 4, 8, 16, 32};
+
+template <class Update>
+void runThreads(size_t nthreads, size_t iters, Update update) {
+  folly::BenchmarkSuspender suspender;
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < nthreads; ++t) {
+    threads.emplace_back([&go, iters, update]() {
+      while (!go.load(std::memory_order_acquire)) {
+      }
+      for (size_t i = 0; i < iters; ++i) {
+        update(1);
+        update(-1);
+      }
+    });
+  }
+  suspender.dismiss();
+
+  go.store(true, std::memory_order_release);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void addBenchmarks() {
+  for (auto nthreads : kThreads) {
+    auto suffix = folly::to<std::string>("_", nthreads, "threads");
+    folly::addBenchmark(
+      __FILE__, "shared_atomic" + suffix,
+      [nthreads](unsigned int iters) {
+        static uint64_t count = 0;
+        runThreads(nthreads, iters, [](int64_t delta) {
+          __sync_fetch_and_add(&count, delta);
+        });
+        return iters;
+      });
+    /* relative to the shared atomic */
+    folly::addBenchmark(
+      __FILE__, "%counter" + suffix,
+      [nthreads](unsigned int iters) {
+        static counter_t count;
+        runThreads(nthreads, iters, [](int64_t delta) {
+          counter_add(&count, delta);
+        });
+        folly::doNotOptimizeAway(counter_get(&count));
+        return iters;
+      });
+    folly::addBenchmark(__FILE__, "-", []() -> unsigned { return 0; });
+  }
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  addBenchmarks();
+  folly::runBenchmarks();
+  return 0;
+}
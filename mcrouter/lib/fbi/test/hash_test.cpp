@@ -10,6 +10,7 @@
 #include <sys/time.h>
 
 #include <cmath>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -278,3 +279,46 @@ TEST(ch3, timing) {
   printf("Lookup:\t\t\t%zdus total\t%0.3fus/query\n",
          (end - start), ((float) (end - start)) / NUM_LOOKUPS);
 }
+
+TEST(ch3, digest) {
+  /* furc_hash() values from before it was split into digest and lookup */
+  EXPECT_EQ(478, furc_hash("foo", 3, 1000));
+  EXPECT_EQ(336045, furc_hash("key:1234:blah", 13, 8388608));
+
+  const char* keys[] = {"foo", "abcdefghijklmnopqrstuvwxyz", "key:1234:blah"};
+  for (auto key : keys) {
+    auto len = strlen(key);
+    auto digest = furc_key_digest(key, len);
+    for (uint32_t m : {1, 2, 7, 1000, 8388608}) {
+      EXPECT_EQ(furc_hash(key, len, m), furc_hash_digest(digest, m));
+    }
+  }
+}
+
+TEST(crc32, matchesReference) {
+  /* bit at a time crc32, the definition of what crc32_hash should return */
+  auto reference = [](const char* key, size_t len) {
+    uint32_t crc = ~0;
+    for (size_t i = 0; i < len; ++i) {
+      crc ^= (unsigned char)key[i];
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+      }
+    }
+    return ~crc;
+  };
+
+  EXPECT_EQ(0xcbf43926, crc32_hash("123456789", 9));
+
+  std::vector<char> buf(1024);
+  for (auto& c : buf) {
+    c = rand();
+  }
+  /* covers the sliced and folded versions and all their tails */
+  for (size_t off = 0; off < 16; ++off) {
+    for (size_t len = 0; len + off <= buf.size(); len += 1 + len / 64) {
+      EXPECT_EQ(reference(buf.data() + off, len),
+                crc32_hash(buf.data() + off, len));
+    }
+  }
+}
@@ -14,6 +14,7 @@
 
 #include <folly/Optional.h>
 #include <folly/futures/Try.h>
+#include <folly/small_vector.h>
 
 #include "mcrouter/lib/fibers/FiberPromise.h"
 
@@ -22,6 +23,12 @@ namespace facebook { namespace memcache { namespace fiber {
 template <typename T>
 class TaskIterator;
 
+/**
+ * Fan-outs (addTasks, whenAll, forEach) of up to this many tasks keep
+ * their bookkeeping inline and don't allocate beyond the fibers themselves.
+ */
+constexpr size_t kInlineTasks = 8;
+
 /**
  * Schedules several tasks and immediately returns an iterator, that
  * allow to traverse tasks in the order of their completion. All results and
@@ -100,7 +107,8 @@ class TaskIterator {
   addTasks(InputIterator first, InputIterator last);
 
   struct Context {
-    std::vector<std::pair<size_t, folly::Try<T>>> results;
+    folly::small_vector<std::pair<size_t, folly::Try<T>>, kInlineTasks>
+      results;
     folly::Optional<FiberPromise<void>> promise;
     size_t totalTasks{0};
     size_t tasksConsumed{0};
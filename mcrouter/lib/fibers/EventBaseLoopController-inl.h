@@ -67,6 +67,16 @@ inline void EventBaseLoopController::schedule() {
   }
 }
 
+inline void EventBaseLoopController::scheduleYielded() {
+  if (eventBase_ == nullptr) {
+    schedule();
+  } else {
+    // Schedule it to run in the next iteration, after socket and timer
+    // events were processed.
+    eventBase_->runInLoop(callback_.get());
+  }
+}
+
 inline void EventBaseLoopController::cancel() {
   callback_->cancelLoopCallback();
 }
@@ -48,6 +48,7 @@ class EventBaseLoopController : public LoopController {
 
   void setFiberManager(FiberManager* fm) override;
   void schedule() override;
+  void scheduleYielded() override;
   void cancel() override;
   void runLoop();
   void scheduleThreadSafe() override;
@@ -28,6 +28,10 @@ namespace facebook { namespace memcache {
 namespace {
 static const uint64_t kMagic8Bytes = 0xfaceb00cfaceb00c;
 
+/* Part of the stack right below the current position that
+   fillStackSampleMagic() leaves alone, for its own frame */
+static const size_t kStackSampleSafetyMargin = 512;
+
 pid_t localThreadId() {
   static thread_local pid_t threadId = syscall(SYS_gettid);
   return threadId;
@@ -63,20 +67,22 @@ void Fiber::setData(intptr_t data) {
   state_ = READY_TO_RUN;
 
   if (LIKELY(threadId_ == localThreadId())) {
-    TAILQ_INSERT_TAIL(&fiberManager_.readyFibers_, this, entry_);
+    fiberManager_.readyFibersInsert(this);
     fiberManager_.ensureLoopScheduled();
   } else {
     fiberManager_.remoteReadyInsert(this);
   }
 }
 
-Fiber::Fiber(FiberManager& fiberManager) :
-    fiberManager_(fiberManager) {
+Fiber::Fiber(FiberManager& fiberManager, bool largeStack) :
+    fiberManager_(fiberManager),
+    largeStack_(largeStack),
+    stackSize_(largeStack ? fiberManager.options_.largeStackSize
+                          : fiberManager.options_.stackSize) {
 
-  auto size = fiberManager_.options_.stackSize;
-  auto limit = fiberManager_.stackAllocator_.allocate(size);
+  auto limit = fiberManager_.allocateStack(stackSize_);
 
-  fcontext_ = makeContext(limit, size, &Fiber::fiberFuncHelper);
+  fcontext_ = makeContext(limit, stackSize_, &Fiber::fiberFuncHelper);
 
   if (UNLIKELY(fiberManager_.options_.debugRecordStackUsed)) {
     fillMagic(fcontext_);
@@ -84,9 +90,8 @@ Fiber::Fiber(FiberManager& fiberManager) :
 }
 
 Fiber::~Fiber() {
-  fiberManager_.stackAllocator_.deallocate(
-    static_cast<unsigned char*>(fcontext_.stackLimit()),
-    fiberManager_.options_.stackSize);
+  fiberManager_.deallocateStack(
+    static_cast<unsigned char*>(fcontext_.stackLimit()), stackSize_);
 }
 
 void Fiber::recordStackPosition() {
@@ -99,6 +104,29 @@ void Fiber::recordStackPosition() {
                  static_cast<void*>(&stackDummy))));
 }
 
+void Fiber::fillStackSampleMagic() {
+  unsigned char stackDummy;
+  uint64_t* begin = static_cast<uint64_t*>(fcontext_.stackLimit());
+  uint64_t* end = reinterpret_cast<uint64_t*>(
+    reinterpret_cast<uintptr_t>(&stackDummy - kStackSampleSafetyMargin) &
+    ~(sizeof(uint64_t) - 1));
+
+  if (begin < end) {
+    std::fill(begin, end, kMagic8Bytes);
+  }
+}
+
+void Fiber::recordStackSample() {
+  auto used = nonMagicInBytes(fcontext_);
+  fiberManager_.stackHighWatermark_ =
+    std::max(fiberManager_.stackHighWatermark_, used);
+  if (fiberManager_.stackSampleCallback_) {
+    fiberManager_.stackSampleCallback_(stackSampleTag_, used);
+  }
+  stackSampled_ = false;
+  stackSampleTag_ = nullptr;
+}
+
 void Fiber::fiberFuncHelper(intptr_t fiber) {
   reinterpret_cast<Fiber*>(fiber)->fiberFunc();
 }
@@ -121,6 +149,10 @@ void Fiber::fiberFunc() {
     threadId_ = localThreadId();
     state_ = RUNNING;
 
+    if (UNLIKELY(stackSampled_)) {
+      fillStackSampleMagic();
+    }
+
     try {
       if (resultFunc_) {
         assert(finallyFunc_);
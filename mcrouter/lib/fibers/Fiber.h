@@ -61,7 +61,7 @@ class Fiber {
   friend class Baton;
   friend class FiberManager;
 
-  explicit Fiber(FiberManager& fiberManager);
+  Fiber(FiberManager& fiberManager, bool largeStack);
 
   template <typename F>
   void setFunction(F&& func);
@@ -85,6 +85,27 @@ class Fiber {
    */
   intptr_t preempt(State state);
 
+  /**
+   * Sampled stack usage recording (see FiberManager::Options::stackSampleRate)
+   */
+  bool stackSampled_{false};
+  const char* stackSampleTag_{nullptr};
+
+  /* Saved *FiberManager::profileSlot_ while the fiber is not running */
+  uintptr_t profileWord_{0};
+
+  /**
+   * Fills the unused part of the stack (below the current stack position)
+   * with the magic value. Must be called on this fiber's context.
+   */
+  void fillStackSampleMagic();
+
+  /**
+   * Finds the used stack size and reports it to the FiberManager.
+   * Must be called on the main context once the task is done.
+   */
+  void recordStackSample();
+
   /**
    * Examines how much of the stack we used at this moment and
    * registers with the FiberManager (for monitoring).
@@ -92,6 +113,8 @@ class Fiber {
   void recordStackPosition();
 
   FiberManager& fiberManager_;  /**< Associated FiberManager */
+  const bool largeStack_;       /**< see Options::largeStackSize */
+  const size_t stackSize_;
   FContext fcontext_;           /**< current task execution context */
   intptr_t data_;               /**< Used to keep some data with the Fiber */
   std::function<void()> func_;  /**< task function */
@@ -34,6 +34,11 @@ inline void FiberManager::ensureLoopScheduled() {
   loopController_->schedule();
 }
 
+inline void FiberManager::readyFibersInsert(Fiber* fiber) {
+  TAILQ_INSERT_TAIL(&readyFibers_, fiber, entry_);
+  ++readyFibersSize_;
+}
+
 inline void FiberManager::runReadyFiber(Fiber* fiber) {
   assert(fiber->state_ == Fiber::NOT_STARTED ||
          fiber->state_ == Fiber::READY_TO_RUN);
@@ -44,7 +49,16 @@ inline void FiberManager::runReadyFiber(Fiber* fiber) {
     if (fiber->readyFunc_) {
       fiber->readyFunc_();
     }
+    uintptr_t mainProfileWord = 0;
+    if (UNLIKELY(profileSlot_ != nullptr)) {
+      mainProfileWord = profileSlot_->load(std::memory_order_relaxed);
+      profileSlot_->store(fiber->profileWord_, std::memory_order_relaxed);
+    }
     jumpContext(&mainContext_, &fiber->fcontext_, fiber->data_);
+    if (UNLIKELY(profileSlot_ != nullptr)) {
+      fiber->profileWord_ = profileSlot_->load(std::memory_order_relaxed);
+      profileSlot_->store(mainProfileWord, std::memory_order_relaxed);
+    }
     if (fiber->state_ == Fiber::AWAITING_IMMEDIATE) {
       try {
         immediateFunc_();
@@ -62,6 +76,14 @@ inline void FiberManager::runReadyFiber(Fiber* fiber) {
   } else if (fiber->state_ == Fiber::INVALID) {
     assert(fibersActive_ > 0);
     --fibersActive_;
+    if (fiber->largeStack_) {
+      assert(largeFibersActive_ > 0);
+      --largeFibersActive_;
+    }
+    if (UNLIKELY(fiber->stackSampled_)) {
+      fiber->recordStackSample();
+    }
+    fiber->profileWord_ = 0;
     // Making sure that task functor is deleted once task is complete.
     // NOTE: we must do it on main context, as the fiber is not
     // running at this point.
@@ -76,7 +98,16 @@ inline void FiberManager::runReadyFiber(Fiber* fiber) {
       fiber->finallyFunc_ = nullptr;
     }
 
-    if (fibersPoolSize_ < options_.maxFibersPoolSize) {
+    if (fiber->largeStack_) {
+      if (largeFibersPoolSize_ < options_.maxLargeFibersPoolSize) {
+        TAILQ_INSERT_HEAD(&largeFibersPool_, fiber, entry_);
+        ++largeFibersPoolSize_;
+      } else {
+        delete fiber;
+        assert(fibersAllocated_ > 0);
+        --fibersAllocated_;
+      }
+    } else if (fibersPoolSize_ < fibersPoolTarget_) {
       TAILQ_INSERT_HEAD(&fibersPool_, fiber, entry_);
       ++fibersPoolSize_;
     } else {
@@ -88,52 +119,157 @@ inline void FiberManager::runReadyFiber(Fiber* fiber) {
 }
 
 inline bool FiberManager::loopUntilNoReady() {
+  bool yielded = false;
   SCOPE_EXIT {
     isLoopScheduled_ = false;
     currentFiberManager_ = nullptr;
+    if (yielded) {
+      isLoopScheduled_ = true;
+      loopController_->scheduleYielded();
+    }
   };
 
   currentFiberManager_ = this;
 
+  size_t fibersRun = 0;
+  auto readyAtStart = readyFibersSize_;
+  std::chrono::steady_clock::time_point loopStart;
+  if (loopStatsCallback_) {
+    loopStart = std::chrono::steady_clock::now();
+  }
+  std::chrono::steady_clock::time_point loopDeadline;
+  if (options_.maxLoopRunTimeUs != 0) {
+    loopDeadline = std::chrono::steady_clock::now() +
+      std::chrono::microseconds(options_.maxLoopRunTimeUs);
+  }
+  auto overBudget = [this, &fibersRun, &loopDeadline]() {
+    return (options_.maxFibersRunPerLoop != 0 &&
+            fibersRun >= options_.maxFibersRunPerLoop) ||
+           (options_.maxLoopRunTimeUs != 0 &&
+            std::chrono::steady_clock::now() >= loopDeadline);
+  };
+
   bool hadRemoteFiber = true;
   while (hadRemoteFiber) {
     hadRemoteFiber = false;
 
     while (!TAILQ_EMPTY(&readyFibers_)) {
+      if (overBudget()) {
+        yielded = true;
+        break;
+      }
       auto fiber = TAILQ_FIRST(&readyFibers_);
       TAILQ_REMOVE(&readyFibers_, fiber, entry_);
+      --readyFibersSize_;
       runReadyFiber(fiber);
+      ++fibersRun;
+    }
+
+    if (yielded) {
+      /* Remote fibers will be picked up by the rescheduled loop */
+      ++loopsOverBudget_;
+      break;
     }
 
     remoteReadyQueue_.sweep(
-      [this, &hadRemoteFiber] (Fiber* fiber) {
+      [this, &hadRemoteFiber, &fibersRun] (Fiber* fiber) {
         runReadyFiber(fiber);
+        ++fibersRun;
         hadRemoteFiber = true;
       }
     );
 
     remoteTaskQueue_.sweep(
-      [this, &hadRemoteFiber] (RemoteTask* taskPtr) {
+      [this, &hadRemoteFiber, &fibersRun] (RemoteTask* taskPtr) {
         std::unique_ptr<RemoteTask> task(taskPtr);
+        remoteTasksPending_.fetch_sub(1, std::memory_order_relaxed);
         auto fiber = getFiber();
-        fiber->setFunction(std::move(task->func));
+        task->moveInto(*this, *fiber);
         fiber->data_ = reinterpret_cast<intptr_t>(fiber);
         runReadyFiber(fiber);
+        ++fibersRun;
         hadRemoteFiber = true;
       }
     );
   }
+  fibersRunTotal_ += fibersRun;
+
+  if (loopStatsCallback_) {
+    loopStatsCallback_(
+      readyAtStart,
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - loopStart));
+  }
+
+  if (options_.poolResizePeriodMs != 0) {
+    maybeResizePool();
+  }
 
   return fibersActive_ > 0;
 }
 
+/**
+ * Stores the task functor in the fiber's user buffer if it fits there, so
+ * that Fiber::func_ only needs to hold a reference (and doesn't allocate).
+ */
+template <typename F>
+struct FiberManager::AddTaskHelper {
+  class Func;
+
+  static constexpr bool allocateInBuffer =
+    sizeof(Func) <= Fiber::kUserBufferSize;
+
+  class Func {
+   public:
+    explicit Func(F&& func) : func_(std::move(func)) {}
+
+    void operator()() {
+      SCOPE_EXIT {
+        if (allocateInBuffer) {
+          this->~Func();
+        } else {
+          delete this;
+        }
+      };
+      func_();
+    }
+
+   private:
+    F func_;
+  };
+};
+
+template <typename F>
+void FiberManager::setTaskFunction(Fiber& fiber, F&& func) {
+  typedef AddTaskHelper<typename std::decay<F>::type> Helper;
+
+  if (Helper::allocateInBuffer) {
+    auto funcLoc = static_cast<typename Helper::Func*>(fiber.getUserBuffer());
+    new (funcLoc) typename Helper::Func(std::move(func));
+    fiber.setFunction(std::ref(*funcLoc));
+  } else {
+    fiber.setFunction(std::ref(*new typename Helper::Func(std::move(func))));
+  }
+}
+
 template <typename F>
 void FiberManager::addTask(F&& func) {
   auto fiber = getFiber();
-  fiber->setFunction(std::forward<F>(func));
+  setTaskFunction(*fiber, std::forward<F>(func));
 
   fiber->data_ = reinterpret_cast<intptr_t>(fiber);
-  TAILQ_INSERT_TAIL(&readyFibers_, fiber, entry_);
+  readyFibersInsert(fiber);
+
+  ensureLoopScheduled();
+}
+
+template <typename F>
+void FiberManager::addTaskLargeStack(F&& func) {
+  auto fiber = getFiber(/* largeStack= */ true);
+  setTaskFunction(*fiber, std::forward<F>(func));
+
+  fiber->data_ = reinterpret_cast<intptr_t>(fiber);
+  readyFibersInsert(fiber);
 
   ensureLoopScheduled();
 }
@@ -141,19 +277,48 @@ void FiberManager::addTask(F&& func) {
 template <typename F, typename G>
 void FiberManager::addTaskReadyFunc(F&& func, G&& readyFunc) {
   auto fiber = getFiber();
-  fiber->setFunction(std::forward<F>(func));
+  setTaskFunction(*fiber, std::forward<F>(func));
   fiber->setReadyFunction(std::forward<G>(readyFunc));
 
   fiber->data_ = reinterpret_cast<intptr_t>(fiber);
-  TAILQ_INSERT_TAIL(&readyFibers_, fiber, entry_);
+  readyFibersInsert(fiber);
 
   ensureLoopScheduled();
 }
 
+template <typename F>
+FiberManager::RemoteTask* FiberManager::makeRemoteTask(F&& func) {
+  return new RemoteTaskImpl<typename std::decay<F>::type>(std::move(func));
+}
+
 template <typename F>
 void FiberManager::addTaskRemote(F&& func) {
-  auto task = folly::make_unique<RemoteTask>(std::move(func));
-  if (remoteTaskQueue_.insertHead(task.release())) {
+  auto task = makeRemoteTask(std::forward<F>(func));
+  remoteTasksPending_.fetch_add(1, std::memory_order_relaxed);
+  if (remoteTaskQueue_.insertHead(task)) {
+    loopController_->scheduleThreadSafe();
+  }
+}
+
+template <typename InputIterator>
+void FiberManager::addTasksRemote(InputIterator first, InputIterator last) {
+  if (first == last) {
+    return;
+  }
+
+  /* The queue is swept from tail to head, so the first task goes last:
+     each new task is linked in front of the previous ones. */
+  RemoteTask* tail = makeRemoteTask(std::move(*first));
+  RemoteTask* head = tail;
+  size_t n = 1;
+  for (++first; first != last; ++first, ++n) {
+    auto task = makeRemoteTask(std::move(*first));
+    task->nextRemoteTask.next = head;
+    head = task;
+  }
+
+  remoteTasksPending_.fetch_add(n, std::memory_order_relaxed);
+  if (remoteTaskQueue_.insertHeadList(head, tail)) {
     loopController_->scheduleThreadSafe();
   }
 }
@@ -265,7 +430,7 @@ void FiberManager::addTaskFinally(F&& func, G&& finally) {
   }
 
   fiber->data_ = reinterpret_cast<intptr_t>(fiber);
-  TAILQ_INSERT_TAIL(&readyFibers_, fiber, entry_);
+  readyFibersInsert(fiber);
 
   ensureLoopScheduled();
 }
@@ -312,6 +477,27 @@ FiberManager::runInMainContextHelper(F&& func) {
   activeFiber_->preempt(Fiber::AWAITING_IMMEDIATE);
 }
 
+template <typename F>
+typename std::result_of<F()>::type
+FiberManager::runInLargeStack(F&& func) {
+  if (activeFiber_ == nullptr || options_.largeStackSize == 0 ||
+      activeFiber_->largeStack_) {
+    return func();
+  }
+
+  typedef typename std::result_of<F()>::type Result;
+
+  folly::Try<Result> result;
+  Baton baton;
+  addTaskLargeStack([&func, &result, &baton]() {
+      result = folly::makeTryFunction(std::forward<F>(func));
+      baton.post();
+    });
+  baton.wait();
+
+  return folly::moveFromTry(std::move(result));
+}
+
 inline FiberManager& FiberManager::getFiberManager() {
   assert(currentFiberManager_ != nullptr);
   return *currentFiberManager_;
@@ -321,6 +507,13 @@ inline FiberManager* FiberManager::getFiberManagerUnsafe() {
   return currentFiberManager_;
 }
 
+inline void FiberManager::setStackSampleTag(const char* tag) {
+  if (UNLIKELY(activeFiber_ != nullptr && activeFiber_->stackSampled_ &&
+               activeFiber_->stackSampleTag_ == nullptr)) {
+    activeFiber_->stackSampleTag_ = tag;
+  }
+}
+
 inline bool FiberManager::hasActiveFiber() {
   return activeFiber_ != nullptr;
 }
@@ -12,12 +12,16 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
+#include <folly/Memory.h>
+
 #include "mcrouter/lib/fibers/Fiber.h"
 #include "mcrouter/lib/fibers/LoopController.h"
 #include "mcrouter/lib/fbi/cpp/LogFailure.h"
+#include "mcrouter/lib/MemoryAccounting.h"
 
 namespace facebook { namespace memcache {
 
@@ -27,6 +31,8 @@ FiberManager::FiberManager(std::unique_ptr<LoopController> loopController,
                            Options options) :
     loopController_(std::move(loopController)),
     options_(options),
+    fibersPoolTarget_(options.poolResizePeriodMs != 0
+                      ? 0 : options.maxFibersPoolSize),
     exceptionCallback_([](std::exception_ptr e, std::string context) {
         try {
           std::rethrow_exception(e);
@@ -47,8 +53,16 @@ FiberManager::FiberManager(std::unique_ptr<LoopController> loopController,
     timeoutManager_(std::make_shared<TimeoutController>(*loopController_)) {
   TAILQ_INIT(&readyFibers_);
   TAILQ_INIT(&fibersPool_);
+  TAILQ_INIT(&largeFibersPool_);
+
+  if (options_.stackArenaSize != 0) {
+    stackArena_ = folly::make_unique<StackArena>(
+      options_.stackSize, options_.stackArenaSize,
+      options_.maxFibersPoolSize, options_.stackArenaUseHugePages);
+  }
 
   loopController_->setFiberManager(this);
+  poolResizePeriodStart_ = std::chrono::steady_clock::now();
 }
 
 FiberManager::~FiberManager() {
@@ -61,10 +75,31 @@ FiberManager::~FiberManager() {
   TAILQ_FOREACH_SAFE(fiberIt, &fibersPool_, entry_, fiberItNext) {
     delete fiberIt;
   }
+  TAILQ_FOREACH_SAFE(fiberIt, &largeFibersPool_, entry_, fiberItNext) {
+    delete fiberIt;
+  }
   assert(TAILQ_EMPTY(&readyFibers_));
   assert(fibersActive_ == 0);
 }
 
+unsigned char* FiberManager::allocateStack(size_t size) {
+  MemoryAccounting::add(MemoryTag::kFiberStacks, size);
+  if (stackArena_) {
+    if (auto limit = stackArena_->allocate(size)) {
+      return limit;
+    }
+  }
+  return stackAllocator_.allocate(size);
+}
+
+void FiberManager::deallocateStack(unsigned char* limit, size_t size) {
+  MemoryAccounting::sub(MemoryTag::kFiberStacks, size);
+  if (stackArena_ && stackArena_->deallocate(limit)) {
+    return;
+  }
+  stackAllocator_.deallocate(limit, size);
+}
+
 LoopController& FiberManager::loopController() {
   return *loopController_;
 }
@@ -79,22 +114,79 @@ bool FiberManager::hasTasks() const {
          !remoteTaskQueue_.empty();
 }
 
-Fiber* FiberManager::getFiber() {
+Fiber* FiberManager::getFiber(bool largeStack) {
+  largeStack = largeStack && options_.largeStackSize != 0;
+  auto& pool = largeStack ? largeFibersPool_ : fibersPool_;
+  auto& poolSize = largeStack ? largeFibersPoolSize_ : fibersPoolSize_;
   Fiber* fiber = nullptr;
-  if (TAILQ_FIRST(&fibersPool_) == nullptr) {
-    fiber = new Fiber(*this);
+  bool allocated = TAILQ_FIRST(&pool) == nullptr;
+  if (allocated) {
+    fiber = new Fiber(*this, largeStack);
     ++fibersAllocated_;
   } else {
-    fiber = TAILQ_FIRST(&fibersPool_);
-    TAILQ_REMOVE(&fibersPool_, fiber, entry_);
-    assert(fibersPoolSize_ > 0);
-    --fibersPoolSize_;
+    fiber = TAILQ_FIRST(&pool);
+    TAILQ_REMOVE(&pool, fiber, entry_);
+    assert(poolSize > 0);
+    --poolSize;
   }
   ++fibersActive_;
+  if (largeStack) {
+    ++largeFibersActive_;
+  }
+  /* Only the regular pool is resized */
+  maxFibersActiveInPeriod_ = std::max(maxFibersActiveInPeriod_,
+                                      fibersActive_ - largeFibersActive_);
+  if (allocated && !largeStack && options_.poolResizePeriodMs != 0) {
+    /* Grow on demand, so fibers of a burst are kept for the next one */
+    fibersPoolTarget_ = std::max(
+      fibersPoolTarget_,
+      std::min(maxFibersActiveInPeriod_, options_.maxFibersPoolSize));
+  }
   assert(fiber);
+  if (UNLIKELY(options_.stackSampleRate != 0 &&
+               !options_.debugRecordStackUsed &&
+               ++tasksSinceStackSample_ >= options_.stackSampleRate)) {
+    tasksSinceStackSample_ = 0;
+    fiber->stackSampled_ = true;
+  }
   return fiber;
 }
 
+void FiberManager::maybeResizePool() {
+  auto now = std::chrono::steady_clock::now();
+  if (now - poolResizePeriodStart_ <
+      std::chrono::milliseconds(options_.poolResizePeriodMs)) {
+    return;
+  }
+  poolResizePeriodStart_ = now;
+
+  auto observed = std::min(maxFibersActiveInPeriod_,
+                           options_.maxFibersPoolSize);
+  maxFibersActiveInPeriod_ = fibersActive_ - largeFibersActive_;
+  if (observed > fibersPoolTarget_) {
+    fibersPoolTarget_ = observed;
+  } else if (observed < fibersPoolTarget_ / 4 * 3) {
+    fibersPoolTarget_ = observed + (fibersPoolTarget_ - observed) / 2;
+  }
+
+  while (fibersPoolSize_ > fibersPoolTarget_) {
+    auto fiber = TAILQ_FIRST(&fibersPool_);
+    TAILQ_REMOVE(&fibersPool_, fiber, entry_);
+    --fibersPoolSize_;
+    delete fiber;
+    assert(fibersAllocated_ > 0);
+    --fibersAllocated_;
+    ++fibersPoolTrimmed_;
+  }
+  // Preallocate fibers, so that the next burst doesn't have to.
+  while (fibersPoolSize_ + fibersActive_ - largeFibersActive_ <
+         fibersPoolTarget_) {
+    TAILQ_INSERT_HEAD(&fibersPool_, new Fiber(*this, false), entry_);
+    ++fibersPoolSize_;
+    ++fibersAllocated_;
+  }
+}
+
 void FiberManager::setExceptionCallback(FiberManager::ExceptionCallback ec) {
   assert(ec);
   exceptionCallback_ = std::move(ec);
@@ -108,6 +200,48 @@ size_t FiberManager::fibersPoolSize() const {
   return fibersPoolSize_;
 }
 
+size_t FiberManager::largeFibersPoolSize() const {
+  return largeFibersPoolSize_;
+}
+
+size_t FiberManager::fibersPoolTarget() const {
+  return fibersPoolTarget_;
+}
+
+void FiberManager::setStackSampleCallback(
+    FiberManager::StackSampleCallback cb) {
+  stackSampleCallback_ = std::move(cb);
+}
+
+void FiberManager::setLoopStatsCallback(
+    FiberManager::LoopStatsCallback cb) {
+  loopStatsCallback_ = std::move(cb);
+}
+
+void FiberManager::setProfileSlot(std::atomic<uintptr_t>* slot) {
+  profileSlot_ = slot;
+}
+
+size_t FiberManager::fibersPoolTrimmed() const {
+  return fibersPoolTrimmed_;
+}
+
+size_t FiberManager::loopsOverBudget() const {
+  return loopsOverBudget_;
+}
+
+size_t FiberManager::fibersRunTotal() const {
+  return fibersRunTotal_;
+}
+
+size_t FiberManager::readyFibers() const {
+  return readyFibersSize_;
+}
+
+size_t FiberManager::remoteTasksPending() const {
+  return remoteTasksPending_.load(std::memory_order_relaxed);
+}
+
 size_t FiberManager::stackHighWatermark() const {
   return stackHighWatermark_;
 }
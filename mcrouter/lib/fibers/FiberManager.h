@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <queue>
@@ -23,6 +25,7 @@
 #include "mcrouter/lib/fbi/queue.h"
 #include "mcrouter/lib/fibers/BoostContextCompatibility.h"
 #include "mcrouter/lib/fibers/Fiber.h"
+#include "mcrouter/lib/fibers/StackArena.h"
 #include "mcrouter/lib/fibers/TimeoutController.h"
 
 #ifdef USE_GUARD_ALLOCATOR
@@ -62,6 +65,19 @@ class FiberManager {
      */
     size_t stackSize{kDefaultStackSize};
 
+    /**
+     * If non-zero, stack size of a second class of fibers, used for the
+     * tasks added with addTaskLargeStack() and for runInLargeStack().
+     * stackSize then only needs to fit the common tasks.
+     */
+    size_t largeStackSize{0};
+
+    /**
+     * Keep at most this many free fibers with large stacks (in a pool of
+     * their own, not resized by poolResizePeriodMs).
+     */
+    size_t maxLargeFibersPoolSize{100};
+
     /**
      * Record exact amount of stack used.
      *
@@ -71,6 +87,16 @@ class FiberManager {
      */
     bool debugRecordStackUsed{false};
 
+    /**
+     * If non-zero (and debugRecordStackUsed is off), record stack usage of
+     * every stackSampleRate-th task: the fiber fills its unused stack with
+     * a known value before running the task and afterwards the boundary is
+     * searched for from the far end of the stack, so only sampled tasks pay.
+     * Samples update stackHighWatermark() and are reported to the
+     * StackSampleCallback.
+     */
+    size_t stackSampleRate{0};
+
     /**
      * Keep at most this many free fibers in the pool.
      * This way the total number of fibers in the system is always bounded
@@ -78,12 +104,64 @@ class FiberManager {
      */
     size_t maxFibersPoolSize{1000};
 
+    /**
+     * If non-zero, the free pool is resized every this many milliseconds
+     * towards the highest number of concurrently active fibers observed
+     * during the period, so maxFibersPoolSize becomes an upper bound.
+     * The target starts at 0 and grows right away as fibers are allocated,
+     * but shrinks only when the observed concurrency drops below 3/4 of it,
+     * by half of the difference.
+     * Resizing happens in the main context, after running ready fibers.
+     */
+    size_t poolResizePeriodMs{0};
+
+    /**
+     * If non-zero, reserve stacks for this many fibers in one contiguous
+     * region upfront (see StackArena), and prefault up to maxFibersPoolSize
+     * of them. Stacks for fibers beyond that are allocated as usual.
+     */
+    size_t stackArenaSize{0};
+
+    /**
+     * Back the stack arena by transparent huge pages.
+     * Stacks in the arena don't have guard pages in this case.
+     */
+    bool stackArenaUseHugePages{false};
+
+    /**
+     * If non-zero, run at most this many fibers per loop (i.e. per
+     * loopUntilNoReady() call). Remaining ready fibers are run after the
+     * LoopController had a chance to process other events
+     * (see LoopController::scheduleYielded()).
+     */
+    size_t maxFibersRunPerLoop{0};
+
+    /**
+     * If non-zero, stop running ready fibers once a loop has taken this
+     * many microseconds and yield as with maxFibersRunPerLoop.
+     */
+    size_t maxLoopRunTimeUs{0};
+
     constexpr Options() {}
   };
 
   typedef std::function<void(std::exception_ptr, std::string)>
   ExceptionCallback;
 
+  /**
+   * Called on the main context with the tag set by setStackSampleTag()
+   * (nullptr if none) and the number of stack bytes used by a sampled task.
+   */
+  typedef std::function<void(const char*, size_t)> StackSampleCallback;
+
+  /**
+   * Called on the main context at the end of every loopUntilNoReady() with
+   * the number of fibers that were ready when the loop started and the time
+   * it took to run them.
+   */
+  typedef std::function<void(size_t, std::chrono::microseconds)>
+  LoopStatsCallback;
+
   /**
    * Initializes, but doesn't start FiberManager loop
    *
@@ -120,6 +198,33 @@ class FiberManager {
    */
   void setExceptionCallback(ExceptionCallback ec);
 
+  /**
+   * Sets the callback for stack usage samples (see Options::stackSampleRate).
+   */
+  void setStackSampleCallback(StackSampleCallback cb);
+
+  /**
+   * Sets the callback for per-loop stats. Loops are only timed if set.
+   */
+  void setLoopStatsCallback(LoopStatsCallback cb);
+
+  /**
+   * Makes *slot a per fiber word: while a fiber runs, *slot holds the
+   * fiber's own value (0 when a task starts) and the main context's value
+   * is restored when it switches back. Lets a sampling profiler on another
+   * thread see what the current fiber is doing (see ProfileStage.h).
+   * nullptr (the default) disables this.
+   */
+  void setProfileSlot(std::atomic<uintptr_t>* slot);
+
+  /**
+   * Attributes the stack usage of the active fiber's task to tag,
+   * if the task is sampled and doesn't have a tag yet.
+   *
+   * @param tag  Must outlive the FiberManager (e.g. a string literal).
+   */
+  void setStackSampleTag(const char* tag);
+
   /**
    * Add a new task to be executed. Must be called from FiberManager's thread.
    *
@@ -129,6 +234,13 @@ class FiberManager {
   template <typename F>
   void addTask(F&& func);
 
+  /**
+   * Same as addTask(), but the task runs on a fiber with a stack of
+   * Options::largeStackSize (stackSize if that's not set).
+   */
+  template <typename F>
+  void addTaskLargeStack(F&& func);
+
   /**
    * Add a new task to be executed, along with a function readyFunc_ which needs
    * to be executed just before jumping to the ready fiber
@@ -150,6 +262,18 @@ class FiberManager {
   template <typename F>
   void addTaskRemote(F&& func);
 
+  /**
+   * Add all tasks in [first, last) to be executed, in that order.
+   * Safe to call from other threads. Same as calling addTaskRemote() for
+   * each of them, but the whole batch is queued with one atomic operation
+   * and wakes up the loop at most once.
+   *
+   * @param first, last  Range of task functions with a signature of
+   *                     `void func()`; they're moved out of the range.
+   */
+  template <typename InputIterator>
+  void addTasksRemote(InputIterator first, InputIterator last);
+
   /**
    * Add a new task. When the task is complete, execute finally(Try<Result>&&)
    * on the main context.
@@ -173,6 +297,18 @@ class FiberManager {
   typename std::result_of<F()>::type
   runInMainContext(F&& func);
 
+  /**
+   * If called from a fiber with a regular stack while
+   * Options::largeStackSize is set, runs func() in a new task on a fiber
+   * with a large stack (see addTaskLargeStack()) and blocks until it's
+   * done. Otherwise just calls func() directly.
+   *
+   * @return value returned by func().
+   */
+  template <typename F>
+  typename std::result_of<F()>::type
+  runInLargeStack(F&& func);
+
   /**
    * @return How many fiber objects (and stacks) has this manager allocated.
    */
@@ -184,6 +320,47 @@ class FiberManager {
    */
   size_t fibersPoolSize() const;
 
+  /**
+   * @return How many of the allocated fiber objects are in the free pool
+   *         of fibers with large stacks (see Options::largeStackSize).
+   */
+  size_t largeFibersPoolSize() const;
+
+  /**
+   * @return Number of free fibers we're trying to keep in the pool.
+   *         Same as options.maxFibersPoolSize if adaptive pool is disabled.
+   */
+  size_t fibersPoolTarget() const;
+
+  /**
+   * @return How many free fibers were destroyed by adaptive pool resizing.
+   */
+  size_t fibersPoolTrimmed() const;
+
+  /**
+   * @return Number of loops that yielded with fibers still ready to run
+   *         because they exhausted the run budget
+   *         (see Options::maxFibersRunPerLoop, Options::maxLoopRunTimeUs).
+   */
+  size_t loopsOverBudget() const;
+
+  /**
+   * @return Number of times a fiber was started or resumed. Can be used to
+   *         tell whether an event loop iteration did any fiber work.
+   */
+  size_t fibersRunTotal() const;
+
+  /**
+   * @return Number of fibers ready to run on this thread right now.
+   */
+  size_t readyFibers() const;
+
+  /**
+   * @return Number of tasks added with addTaskRemote() that didn't start
+   *         yet. Can be called from any thread.
+   */
+  size_t remoteTasksPending() const;
+
   /**
    * return     true if running activeFiber_ is not nullptr.
    */
@@ -200,26 +377,58 @@ class FiberManager {
  private:
   friend class Baton;
   friend class Fiber;
+  template <typename F>
+  struct AddTaskHelper;
+  template <typename F>
+  void setTaskFunction(Fiber& fiber, F&& func);
   template <typename F, typename G>
   struct AddTaskFinallyHelper;
 
+  /**
+   * The task functor is stored in the queue node itself (see
+   * RemoteTaskImpl), so queueing a task is one allocation, and it's moved
+   * into the fiber with setTaskFunction() once dequeued.
+   */
   struct RemoteTask {
-    template <typename F>
-    explicit RemoteTask(F&& f) : func(std::move(f)) {}
-    std::function<void()> func;
+    virtual ~RemoteTask() {}
+    virtual void moveInto(FiberManager& fm, Fiber& fiber) = 0;
     AtomicLinkedListHook<RemoteTask> nextRemoteTask;
   };
+  template <typename F>
+  struct RemoteTaskImpl : public RemoteTask {
+    template <typename G>
+    explicit RemoteTaskImpl(G&& f) : func(std::forward<G>(f)) {}
+    void moveInto(FiberManager& fm, Fiber& fiber) override {
+      fm.setTaskFunction(fiber, std::move(func));
+    }
+    F func;
+  };
+  template <typename F>
+  static RemoteTask* makeRemoteTask(F&& func);
 
   TAILQ_HEAD(FiberTailQHead, Fiber);
 
   Fiber* activeFiber_{nullptr}; /**< active fiber, nullptr on main context */
 
   FiberTailQHead readyFibers_;  /**< queue of fibers ready to be executed */
+  size_t readyFibersSize_{0};   /**< number of fibers in readyFibers_ */
   FiberTailQHead fibersPool_;   /**< pool of unitialized Fiber objects */
+  FiberTailQHead largeFibersPool_; /**< same, with large stacks */
 
   size_t fibersAllocated_{0};   /**< total number of fibers allocated */
   size_t fibersPoolSize_{0};    /**< total number of fibers in the free pool */
   size_t fibersActive_{0};      /**< number of running or blocked fibers */
+  size_t largeFibersPoolSize_{0}; /**< fibers in largeFibersPool_ */
+  size_t largeFibersActive_{0}; /**< part of fibersActive_ */
+
+  /* Adaptive pool sizing, see Options::poolResizePeriodMs */
+  size_t fibersPoolTarget_{0};  /**< max number of fibers in the free pool */
+  size_t fibersPoolTrimmed_{0}; /**< fibers destroyed by resizing */
+  size_t maxFibersActiveInPeriod_{0};
+  std::chrono::steady_clock::time_point poolResizePeriodStart_;
+
+  size_t loopsOverBudget_{0};   /**< loops that yielded due to run budget */
+  size_t fibersRunTotal_{0};    /**< fibers started or resumed */
 
   FContext::ContextStruct mainContext_;  /**< stores loop function context */
 
@@ -264,11 +473,35 @@ class FiberManager {
 
   const Options options_;       /**< FiberManager options */
 
+  /**
+   * Preallocated stacks, nullptr unless options_.stackArenaSize is set.
+   */
+  std::unique_ptr<StackArena> stackArena_;
+
+  /**
+   * Allocate/free Fiber stack, either from stackArena_ or stackAllocator_.
+   */
+  unsigned char* allocateStack(size_t size);
+  void deallocateStack(unsigned char* limit, size_t size);
+
   /**
    * Largest observed individual Fiber stack usage in bytes.
    */
   size_t stackHighWatermark_{0};
 
+  /* See Options::stackSampleRate */
+  size_t tasksSinceStackSample_{0};
+  StackSampleCallback stackSampleCallback_;
+  LoopStatsCallback loopStatsCallback_;
+
+  /* See setProfileSlot() */
+  std::atomic<uintptr_t>* profileSlot_{nullptr};
+
+  /**
+   * Queues a fiber that's ready to run from this thread.
+   */
+  void readyFibersInsert(Fiber* fiber);
+
   /**
    * Schedules a loop with loopController (unless already scheduled before).
    */
@@ -276,8 +509,17 @@ class FiberManager {
 
   /**
    * @return An initialized Fiber object from the pool
+   *
+   * @param largeStack  take it from the large stack pool
+   *                    (see Options::largeStackSize)
+   */
+  Fiber* getFiber(bool largeStack = false);
+
+  /**
+   * Recompute fibersPoolTarget_ and trim/grow the pool, if resize period
+   * has passed.
    */
-  Fiber* getFiber();
+  void maybeResizePool();
 
   /**
    * Function passed to the await call.
@@ -294,6 +536,7 @@ class FiberManager {
   AtomicLinkedList<Fiber, &Fiber::nextRemoteReady_> remoteReadyQueue_;
 
   AtomicLinkedList<RemoteTask, &RemoteTask::nextRemoteTask> remoteTaskQueue_;
+  std::atomic<size_t> remoteTasksPending_{0};
 
   std::shared_ptr<TimeoutController> timeoutManager_;
 
@@ -311,6 +554,17 @@ inline bool onFiber() {
   return fm ? fm->hasActiveFiber() : false;
 }
 
+/**
+ * Attributes stack usage of the current task (if sampled) to tag, see
+ * FiberManager::setStackSampleTag(). No-op outside of fiber context.
+ */
+inline void setStackSampleTag(const char* tag) {
+  auto fm = FiberManager::getFiberManagerUnsafe();
+  if (fm) {
+    fm->setStackSampleTag(tag);
+  }
+}
+
 /**
  * Add a new task to be executed.
  *
@@ -367,6 +621,22 @@ inline runInMainContext(F&& func) {
   return fm->runInMainContext(std::forward<F>(func));
 }
 
+/**
+ * Runs func() on a fiber with a large stack, see
+ * FiberManager::runInLargeStack(). Outside a fiber, just calls func().
+ *
+ * @return value returned by func().
+ */
+template <typename F>
+typename std::result_of<F()>::type
+inline runInLargeStack(F&& func) {
+  auto fm = FiberManager::getFiberManagerUnsafe();
+  if (UNLIKELY(fm == nullptr)) {
+    return func();
+  }
+  return fm->runInLargeStack(std::forward<F>(func));
+}
+
 }
 
 }}
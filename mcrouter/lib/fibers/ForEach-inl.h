@@ -7,6 +7,8 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <algorithm>
+
 #include "mcrouter/lib/fibers/FiberManager.h"
 
 namespace facebook { namespace memcache { namespace fiber {
@@ -72,4 +74,42 @@ inline void forEach(InputIterator first, InputIterator last, F&& f) {
   }
 }
 
+template <class F>
+inline void forEachBounded(size_t n, size_t maxConcurrency, F&& func) {
+  if (n == 0) {
+    return;
+  }
+
+  size_t numTasks = maxConcurrency == 0 ? n : std::min(n, maxConcurrency);
+  size_t nextId = 0;
+  size_t tasksTodo = numTasks;
+  std::exception_ptr e;
+  Baton baton;
+
+  auto task = [n, &nextId, &tasksTodo, &e, &func, &baton]() {
+    while (nextId < n) {
+      auto id = nextId++;
+      try {
+        func(id);
+      } catch (...) {
+        e = std::current_exception();
+      }
+    }
+    if (--tasksTodo == 0) {
+      baton.post();
+    }
+  };
+
+  for (size_t i = 1; i < numTasks; ++i) {
+    fiber::addTask(task);
+  }
+
+  task();
+  baton.wait();
+
+  if (e != std::exception_ptr()) {
+    std::rethrow_exception(e);
+  }
+}
+
 }}}  // facebook::memcache::fiber
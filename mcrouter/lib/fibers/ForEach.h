@@ -32,6 +32,18 @@ namespace facebook { namespace memcache { namespace fiber {
 template <class InputIterator, class F>
 inline void forEach(InputIterator first, InputIterator last, F&& f);
 
+/**
+ * Calls func(id) for every id in [0, n) and blocks until all calls are
+ * completed. At most maxConcurrency calls run at a time (0 means no limit):
+ * that many tasks are scheduled, each one taking the next id once it's done
+ * with the previous one, so the number of fibers doesn't grow with n.
+ * Exceptions are handled as in forEach(); the other calls still run.
+ *
+ * @param func  callable as func(size_t id)
+ */
+template <class F>
+inline void forEachBounded(size_t n, size_t maxConcurrency, F&& func);
+
 }}}  // facebook::memcache::fiber
 
 #include "mcrouter/lib/fibers/ForEach-inl.h"
@@ -33,6 +33,15 @@ class LoopController {
    */
   virtual void schedule() = 0;
 
+  /**
+   * Called by FiberManager when it stopped running ready fibers because
+   * the loop exhausted its run budget. The loop function should run again
+   * after other pending events had a chance to be processed.
+   */
+  virtual void scheduleYielded() {
+    schedule();
+  }
+
   /**
    * Same as schedule(), but safe to call from any thread.
    */
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "StackArena.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "mcrouter/lib/fbi/cpp/LogFailure.h"
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t roundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+}  // anonymous namespace
+
+StackArena::StackArena(size_t stackSize, size_t numStacks, size_t numPrefault,
+                       bool useHugePages)
+    : stackSize_(stackSize) {
+  const size_t pageSize = sysconf(_SC_PAGESIZE);
+  guardSize_ = useHugePages ? 0 : pageSize;
+  slotSize_ = roundUp(stackSize_, pageSize) + guardSize_;
+  mappedSize_ = slotSize_ * numStacks;
+  if (useHugePages) {
+    mappedSize_ = roundUp(mappedSize_, kHugePageSize);
+  }
+  if (mappedSize_ == 0) {
+    return;
+  }
+
+  auto p = ::mmap(nullptr, mappedSize_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    failure::log("StackArena", failure::Category::kOutOfResources,
+                 "Failed to map {} bytes for fiber stacks, falling back "
+                 "to regular stack allocation", mappedSize_);
+    mappedSize_ = 0;
+    return;
+  }
+  base_ = static_cast<unsigned char*>(p);
+
+#ifdef MADV_HUGEPAGE
+  if (useHugePages && ::madvise(base_, mappedSize_, MADV_HUGEPAGE) != 0) {
+    VLOG(1) << "madvise(MADV_HUGEPAGE) failed for fiber stacks arena";
+  }
+#endif
+
+  freeStacks_.reserve(numStacks);
+  // Push in reverse order, so that stacks are handed out from the bottom of
+  // the arena and the prefaulted ones are used first.
+  for (size_t i = numStacks; i > 0; --i) {
+    auto slot = base_ + (i - 1) * slotSize_;
+    if (guardSize_ != 0) {
+      // Stack grows downwards, protect the page below it. Ignore errors.
+      ::mprotect(slot, guardSize_, PROT_NONE);
+    }
+    freeStacks_.push_back(slot + guardSize_);
+  }
+
+  numPrefault = std::min(numPrefault, numStacks);
+  for (size_t i = 0; i < numPrefault; ++i) {
+    auto stack = base_ + i * slotSize_ + guardSize_;
+    for (size_t offset = 0; offset < slotSize_ - guardSize_;
+         offset += pageSize) {
+      stack[offset] = 0;
+    }
+  }
+}
+
+StackArena::~StackArena() {
+  if (base_) {
+    ::munmap(base_, mappedSize_);
+  }
+}
+
+unsigned char* StackArena::allocate(size_t size) {
+  if (size > stackSize_ || freeStacks_.empty()) {
+    return nullptr;
+  }
+  auto stack = freeStacks_.back();
+  freeStacks_.pop_back();
+  return stack;
+}
+
+bool StackArena::deallocate(unsigned char* limit) {
+  if (limit < base_ || limit >= base_ + mappedSize_) {
+    return false;
+  }
+  freeStacks_.push_back(limit);
+  return true;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Fixed number of fiber stacks carved out of one contiguous mapping.
+ *
+ * The whole region is mapped once on construction, so allocating a stack
+ * from the arena never calls into mmap or malloc. Each stack is preceded
+ * by a protected guard page, unless huge pages are requested: mprotect
+ * would split the huge pages, so in that case there are no guard pages.
+ *
+ *         -- increasing addresses -->
+ *   | guard | stack 0 | guard | stack 1 | ...
+ *
+ * Note: not thread-safe.
+ */
+class StackArena {
+ public:
+  /**
+   * @param stackSize     Size of every stack in bytes.
+   * @param numStacks     Number of stacks to reserve.
+   * @param numPrefault   Touch the pages of this many stacks upfront, so that
+   *                      we don't take page faults when they're first used.
+   * @param useHugePages  Ask the kernel to back the arena by transparent
+   *                      huge pages.
+   */
+  StackArena(size_t stackSize, size_t numStacks, size_t numPrefault,
+             bool useHugePages);
+  ~StackArena();
+
+  StackArena(const StackArena&) = delete;
+  StackArena& operator=(const StackArena&) = delete;
+
+  /**
+   * @return  Lowest address of a free stack of stackSize bytes,
+   *          nullptr if size is too big or all stacks are in use.
+   */
+  unsigned char* allocate(size_t size);
+
+  /**
+   * @return  True if the stack belongs to the arena (and was returned to it).
+   */
+  bool deallocate(unsigned char* limit);
+
+  size_t stackSize() const {
+    return stackSize_;
+  }
+
+  size_t numFree() const {
+    return freeStacks_.size();
+  }
+
+ private:
+  const size_t stackSize_;
+  size_t slotSize_{0};
+  size_t guardSize_{0};
+  size_t mappedSize_{0};
+  unsigned char* base_{nullptr};
+  std::vector<unsigned char*> freeStacks_;
+};
+
+}}  // facebook::memcache
@@ -8,7 +8,9 @@
  *
  */
 #include <folly/Optional.h>
+#include <folly/small_vector.h>
 
+#include "mcrouter/lib/fibers/AddTasks.h"
 #include "mcrouter/lib/fibers/FiberManager.h"
 #include "mcrouter/lib/fibers/ForEach.h"
 
@@ -152,8 +154,8 @@ inline whenAll(InputIterator first, InputIterator last) {
   typedef typename std::result_of<
     typename std::iterator_traits<InputIterator>::value_type()>::type Result;
   size_t n = std::distance(first, last);
-  std::vector<Result> results;
-  std::vector<size_t> order(n);
+  folly::small_vector<Result, kInlineTasks> results;
+  folly::small_vector<size_t, kInlineTasks> order(n);
   results.reserve(n);
 
   forEach(first, last,
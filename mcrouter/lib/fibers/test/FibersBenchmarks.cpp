@@ -0,0 +1,246 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/**
+ * Costs of the fiber runtime primitives that every mcrouter request goes
+ * through. Run with mcrouter_fibers_test --benchmark.
+ *
+ * FContext_jumpRoundTrip measures the raw boost::context switch (through
+ * BoostContextCompatibility.h); build against different boost versions to
+ * compare them.
+ */
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/fibers/BoostContextCompatibility.h"
+#include "mcrouter/lib/fibers/EventBaseLoopController.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/fibers/ForEach.h"
+#include "mcrouter/lib/fibers/GuardPageAllocator.h"
+#include "mcrouter/lib/fibers/SimpleLoopController.h"
+#include "mcrouter/lib/fibers/WhenN.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+/* One task at a time: spawn, run to completion, recycle the fiber */
+void runSpawn(size_t iters) {
+  FiberManager fm(folly::make_unique<SimpleLoopController>());
+  for (size_t i = 0; i < iters; ++i) {
+    fm.addTask([]() {});
+    fm.loopUntilNoReady();
+  }
+}
+
+/* Two fibers handing control to each other through batons */
+void runBatonPingPong(size_t iters) {
+  FiberManager fm(folly::make_unique<SimpleLoopController>());
+  Baton* ping = nullptr;
+  Baton* pong = nullptr;
+
+  fm.addTask([&]() {
+    for (size_t i = 0; i < iters; ++i) {
+      Baton baton;
+      ping = &baton;
+      if (pong) {
+        pong->post();
+      }
+      baton.wait();
+    }
+    ping = nullptr;
+    if (pong) {
+      pong->post();
+    }
+  });
+  fm.addTask([&]() {
+    while (ping) {
+      Baton baton;
+      pong = &baton;
+      ping->post();
+      baton.wait();
+    }
+  });
+  fm.loopUntilNoReady();
+}
+
+/**
+ * A task added from this thread to a fiber manager on an event base
+ * thread, whose completion this thread waits for.
+ */
+void runAddTaskRemote(size_t iters) {
+  folly::EventBase evb;
+  std::unique_ptr<FiberManager> fm;
+  std::thread loop;
+  BENCHMARK_SUSPEND {
+    fm = folly::make_unique<FiberManager>(
+      folly::make_unique<EventBaseLoopController>());
+    dynamic_cast<EventBaseLoopController&>(fm->loopController()).
+      attachEventBase(evb);
+    loop = std::thread([&evb]() { evb.loopForever(); });
+    evb.waitUntilRunning();
+  }
+
+  for (size_t i = 0; i < iters; ++i) {
+    Baton done;
+    fm->addTaskRemote([&done]() { done.post(); });
+    done.wait();
+  }
+
+  BENCHMARK_SUSPEND {
+    evb.terminateLoopSoon();
+    loop.join();
+  }
+}
+
+void runInMainContext(size_t iters) {
+  FiberManager fm(folly::make_unique<SimpleLoopController>());
+  fm.addTask([iters]() {
+    for (size_t i = 0; i < iters; ++i) {
+      FiberManager::getFiberManager().runInMainContext([]() {});
+    }
+  });
+  fm.loopUntilNoReady();
+}
+
+/**
+ * Fans out to n tasks with the given combinator, from a fiber; the
+ * tasks yield once each, so that the waiting side is exercised.
+ */
+template <class FanOut>
+void runFanOut(size_t iters, size_t n, FanOut fanOut) {
+  FiberManager fm(folly::make_unique<SimpleLoopController>());
+  std::vector<Baton*> pending;
+  bool done = false;
+
+  fm.addTask([&]() {
+    for (size_t i = 0; i < iters; ++i) {
+      std::vector<std::function<int()>> tasks;
+      BENCHMARK_SUSPEND {
+        for (size_t j = 0; j < n; ++j) {
+          tasks.push_back([&pending]() {
+            Baton baton;
+            pending.push_back(&baton);
+            baton.wait();
+            return 1;
+          });
+        }
+      }
+      fanOut(tasks);
+    }
+    done = true;
+  });
+
+  while (!done) {
+    fm.loopUntilNoReady();
+    auto batons = std::move(pending);
+    pending.clear();
+    for (auto baton : batons) {
+      baton->post();
+    }
+  }
+}
+
+void whenAllFanOut(size_t iters, size_t n) {
+  runFanOut(iters, n, [](std::vector<std::function<int()>>& tasks) {
+    auto results = fiber::whenAll(tasks.begin(), tasks.end());
+    folly::doNotOptimizeAway(results);
+  });
+}
+
+void whenNFanOut(size_t iters, size_t n) {
+  runFanOut(iters, n, [n](std::vector<std::function<int()>>& tasks) {
+    auto results = fiber::whenN(tasks.begin(), tasks.end(), (n + 1) / 2);
+    folly::doNotOptimizeAway(results);
+  });
+}
+
+void forEachFanOut(size_t iters, size_t n) {
+  runFanOut(iters, n, [](std::vector<std::function<int()>>& tasks) {
+    int sum = 0;
+    fiber::forEach(tasks.begin(), tasks.end(),
+                   [&sum](size_t, int result) { sum += result; });
+    folly::doNotOptimizeAway(sum);
+  });
+}
+
+FContext::ContextStruct gMainContext;
+FContext gJumpContext;
+
+void jumpBack(intptr_t) {
+  while (true) {
+    jumpContext(&gJumpContext, &gMainContext, 0);
+  }
+}
+
+}  // anonymous namespace
+
+BENCHMARK(FiberManager_spawn, iters) {
+  runSpawn(iters);
+}
+
+BENCHMARK(FiberManager_batonPingPong, iters) {
+  runBatonPingPong(iters);
+}
+
+BENCHMARK(FiberManager_addTaskRemote, iters) {
+  runAddTaskRemote(iters);
+}
+
+BENCHMARK(FiberManager_runInMainContext, iters) {
+  runInMainContext(iters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_PARAM(whenAllFanOut, 2)
+BENCHMARK_PARAM(whenAllFanOut, 8)
+BENCHMARK_PARAM(whenAllFanOut, 64)
+BENCHMARK_PARAM(whenNFanOut, 2)
+BENCHMARK_PARAM(whenNFanOut, 8)
+BENCHMARK_PARAM(whenNFanOut, 64)
+BENCHMARK_PARAM(forEachFanOut, 2)
+BENCHMARK_PARAM(forEachFanOut, 8)
+BENCHMARK_PARAM(forEachFanOut, 64)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(GuardPageAllocator_allocateDeallocate, iters) {
+  GuardPageAllocator allocator;
+  const auto size = FiberManager::Options::kDefaultStackSize;
+  for (size_t i = 0; i < iters; ++i) {
+    auto stack = allocator.allocate(size);
+    folly::doNotOptimizeAway(stack);
+    allocator.deallocate(stack, size);
+  }
+}
+
+BENCHMARK(FContext_jumpRoundTrip, iters) {
+  GuardPageAllocator allocator;
+  const size_t kStackSize = 16 * 1024;
+  unsigned char* stack;
+  BENCHMARK_SUSPEND {
+    stack = allocator.allocate(kStackSize);
+    gJumpContext = makeContext(stack, kStackSize, &jumpBack);
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    jumpContext(&gMainContext, &gJumpContext, 0);
+  }
+  BENCHMARK_SUSPEND {
+    allocator.deallocate(stack, kStackSize);
+  }
+}
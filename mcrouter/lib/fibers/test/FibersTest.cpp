@@ -7,7 +7,13 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cstring>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -21,6 +27,7 @@
 #include "mcrouter/lib/fibers/FiberManager.h"
 #include "mcrouter/lib/fibers/GenericBaton.h"
 #include "mcrouter/lib/fibers/SimpleLoopController.h"
+#include "mcrouter/lib/fibers/StackArena.h"
 #include "mcrouter/lib/fibers/WhenN.h"
 
 using namespace facebook::memcache;
@@ -287,6 +294,29 @@ TEST(FiberManager, genericBatonThreadWait) {
   thr.join();
 }
 
+TEST(FiberManager, addTaskDestroysFunctor) {
+  FiberManager manager(folly::make_unique<SimpleLoopController>());
+
+  auto counter = std::make_shared<int>(0);
+  std::array<char, 1024> bigBuffer;
+  bigBuffer.fill('a');
+
+  /* Small functors are kept in the fiber, big ones on the heap */
+  manager.addTask([counter]() {
+    ++*counter;
+  });
+  manager.addTask([counter, bigBuffer]() {
+    EXPECT_EQ('a', bigBuffer[0]);
+    ++*counter;
+  });
+  EXPECT_EQ(3, counter.use_count());
+
+  manager.loopUntilNoReady();
+
+  EXPECT_EQ(2, *counter);
+  EXPECT_TRUE(counter.unique());
+}
+
 TEST(FiberManager, addTasksNoncopyable) {
   std::vector<FiberPromise<int>> pendingFibers;
   bool taskAdded = false;
@@ -597,6 +627,48 @@ TEST(FiberManager, forEach) {
   loopController.loop(std::move(loopFunc));
 }
 
+TEST(FiberManager, forEachBounded) {
+  std::vector<FiberPromise<int>> pendingFibers;
+  bool taskAdded = false;
+  size_t maxPending = 0;
+
+  FiberManager manager(folly::make_unique<SimpleLoopController>());
+  auto& loopController =
+    dynamic_cast<SimpleLoopController&>(manager.loopController());
+
+  auto loopFunc = [&]() {
+    if (!taskAdded) {
+      manager.addTask(
+        [&]() {
+          std::vector<size_t> ids;
+          fiber::forEachBounded(10, 3,
+            [&pendingFibers, &maxPending, &ids](size_t id) {
+              fiber::await([&pendingFibers](FiberPromise<int> promise) {
+                  pendingFibers.push_back(std::move(promise));
+                });
+              maxPending = std::max(maxPending, pendingFibers.size() + 1);
+              ids.push_back(id);
+            });
+          EXPECT_EQ(10, ids.size());
+          std::sort(ids.begin(), ids.end());
+          for (size_t i = 0; i < 10; ++i) {
+            EXPECT_EQ(i, ids[i]);
+          }
+          EXPECT_EQ(3, maxPending);
+        }
+      );
+      taskAdded = true;
+    } else if (pendingFibers.size()) {
+      pendingFibers.back().setValue(0);
+      pendingFibers.pop_back();
+    } else {
+      loopController.stop();
+    }
+  };
+
+  loopController.loop(std::move(loopFunc));
+}
+
 TEST(FiberManager, whenN) {
   std::vector<FiberPromise<int>> pendingFibers;
   bool taskAdded = false;
@@ -1062,6 +1134,267 @@ TEST(FiberManager, fibersPoolOverLimit) {
   EXPECT_EQ(5, manager.fibersPoolSize());
 }
 
+TEST(FiberManager, adaptivePoolSize) {
+  FiberManager::Options opts;
+  opts.maxFibersPoolSize = 20;
+  opts.poolResizePeriodMs = 1;
+
+  FiberManager manager(folly::make_unique<SimpleLoopController>(), opts);
+  // Nothing is preallocated before fibers are needed.
+  EXPECT_EQ(0, manager.fibersPoolTarget());
+
+  auto runConcurrently = [&manager](size_t n) {
+    auto& loopController =
+      dynamic_cast<SimpleLoopController&>(manager.loopController());
+    for (size_t i = 0; i < n; ++i) {
+      manager.addTask([]() {});
+    }
+    loopController.loop(
+      [&]() {
+        loopController.stop();
+      }
+    );
+  };
+
+  runConcurrently(2);
+  EXPECT_EQ(2, manager.fibersPoolTarget());
+  EXPECT_EQ(2, manager.fibersAllocated());
+
+  // Burst: target goes up (up to maxFibersPoolSize) right away.
+  runConcurrently(30);
+  usleep(2000);
+  runConcurrently(1);
+  EXPECT_EQ(20, manager.fibersPoolTarget());
+  EXPECT_EQ(20, manager.fibersPoolSize());
+
+  // Low concurrency: target goes down, extra fibers are trimmed.
+  for (size_t i = 0; i < 10; ++i) {
+    runConcurrently(2);
+    usleep(2000);
+  }
+  runConcurrently(2);
+  EXPECT_GT(10, manager.fibersPoolTarget());
+  EXPECT_LE(2, manager.fibersPoolTarget());
+  EXPECT_GE(manager.fibersPoolTarget(), manager.fibersPoolSize());
+  EXPECT_LT(0, manager.fibersPoolTrimmed());
+}
+
+TEST(FiberManager, stackSampling) {
+  FiberManager::Options opts;
+  opts.stackSampleRate = 2;
+
+  FiberManager manager(folly::make_unique<SimpleLoopController>(), opts);
+  std::vector<std::pair<std::string, size_t>> samples;
+  manager.setStackSampleCallback(
+    [&samples](const char* tag, size_t stackUsed) {
+      samples.emplace_back(tag ? tag : "none", stackUsed);
+    });
+
+  for (size_t i = 0; i < 4; ++i) {
+    manager.addTask([i]() {
+      fiber::setStackSampleTag(i % 2 ? "odd" : "even");
+      fiber::setStackSampleTag("ignored");
+      volatile char buffer[4096];
+      for (size_t j = 0; j < sizeof(buffer); ++j) {
+        buffer[j] = j;
+      }
+    });
+  }
+  manager.loopUntilNoReady();
+
+  ASSERT_EQ(2, samples.size());
+  for (const auto& sample : samples) {
+    EXPECT_EQ("odd", sample.first);
+    EXPECT_LE(4096, sample.second);
+    EXPECT_GT(opts.stackSize, sample.second);
+  }
+  EXPECT_LE(4096, manager.stackHighWatermark());
+}
+
+TEST(FiberManager, loopRunBudget) {
+  FiberManager::Options opts;
+  opts.maxFibersRunPerLoop = 3;
+
+  FiberManager manager(folly::make_unique<SimpleLoopController>(), opts);
+  auto& loopController =
+    dynamic_cast<SimpleLoopController&>(manager.loopController());
+
+  size_t tasksRun = 0;
+  for (size_t i = 0; i < 10; ++i) {
+    manager.addTask([&tasksRun]() {
+      ++tasksRun;
+    });
+  }
+
+  manager.loopUntilNoReady();
+  EXPECT_EQ(3, tasksRun);
+  EXPECT_EQ(1, manager.loopsOverBudget());
+
+  /* The rest runs in following loops */
+  loopController.loop(
+    [&]() {
+      loopController.stop();
+    }
+  );
+  EXPECT_EQ(10, tasksRun);
+  EXPECT_EQ(3, manager.loopsOverBudget());
+}
+
+TEST(FiberManager, loopStats) {
+  FiberManager manager(folly::make_unique<SimpleLoopController>());
+
+  std::vector<size_t> readyAtStart;
+  manager.setLoopStatsCallback(
+    [&readyAtStart](size_t ready, std::chrono::microseconds runTime) {
+      EXPECT_LE(0, runTime.count());
+      readyAtStart.push_back(ready);
+    });
+
+  folly::Optional<FiberPromise<int>> savedPromise;
+  for (size_t i = 0; i < 3; ++i) {
+    manager.addTask([]() {});
+  }
+  manager.addTask([&savedPromise]() {
+    fiber::await([&savedPromise](FiberPromise<int> promise) {
+      savedPromise = std::move(promise);
+    });
+  });
+  EXPECT_EQ(4, manager.readyFibers());
+
+  manager.loopUntilNoReady();
+  EXPECT_EQ(0, manager.readyFibers());
+
+  /* Fulfilled promise makes the awaiting fiber ready again */
+  savedPromise->setValue(1);
+  EXPECT_EQ(1, manager.readyFibers());
+  manager.loopUntilNoReady();
+
+  ASSERT_EQ(2, readyAtStart.size());
+  EXPECT_EQ(4, readyAtStart[0]);
+  EXPECT_EQ(1, readyAtStart[1]);
+
+  std::thread remoteThread([&manager]() {
+    manager.addTaskRemote([]() {});
+    manager.addTaskRemote([]() {});
+  });
+  remoteThread.join();
+  EXPECT_EQ(2, manager.remoteTasksPending());
+  manager.loopUntilNoReady();
+  EXPECT_EQ(0, manager.remoteTasksPending());
+}
+
+TEST(FiberManager, stackArena) {
+  FiberManager::Options opts;
+  opts.maxFibersPoolSize = 5;
+  opts.stackArenaSize = 5;
+
+  FiberManager manager(folly::make_unique<SimpleLoopController>(), opts);
+  auto& loopController =
+    dynamic_cast<SimpleLoopController&>(manager.loopController());
+
+  // More fibers than there're stacks in the arena.
+  size_t fibersRun = 0;
+  for (size_t i = 0; i < 10; ++i) {
+    manager.addTask(
+      [&]() {
+        char buffer[1024];
+        memset(buffer, 0, sizeof(buffer));
+        fibersRun += buffer[0] + 1;
+      }
+    );
+  }
+  loopController.loop(
+    [&]() {
+      loopController.stop();
+    }
+  );
+
+  EXPECT_EQ(10, fibersRun);
+  EXPECT_EQ(5, manager.fibersAllocated());
+  EXPECT_EQ(5, manager.fibersPoolSize());
+}
+
+TEST(FiberManager, runInLargeStack) {
+  FiberManager::Options opts;
+  opts.stackSize = 16 * 1024;
+  opts.largeStackSize = 256 * 1024;
+
+  FiberManager manager(folly::make_unique<SimpleLoopController>(), opts);
+  auto& loopController =
+    dynamic_cast<SimpleLoopController&>(manager.loopController());
+
+  size_t result = 0;
+  bool thrown = false;
+  manager.addTask(
+    [&]() {
+      result = fiber::runInLargeStack(
+        [&]() {
+          // Wouldn't fit in the regular stack.
+          char buffer[64 * 1024];
+          memset(buffer, 1, sizeof(buffer));
+          // Already on a large stack, runs right here.
+          return fiber::runInLargeStack([&]() {
+              return buffer[0] + sizeof(buffer) - 1;
+            });
+        });
+      try {
+        fiber::runInLargeStack([]() { throw std::runtime_error("large"); });
+      } catch (const std::runtime_error&) {
+        thrown = true;
+      }
+    }
+  );
+  loopController.loop(
+    [&]() {
+      loopController.stop();
+    }
+  );
+
+  EXPECT_EQ(64 * 1024, result);
+  EXPECT_TRUE(thrown);
+  EXPECT_EQ(2, manager.fibersAllocated());
+  EXPECT_EQ(1, manager.fibersPoolSize());
+  EXPECT_EQ(1, manager.largeFibersPoolSize());
+
+  // Without a large stack size there's a single class of fibers.
+  FiberManager single(folly::make_unique<SimpleLoopController>());
+  auto& singleLoop =
+    dynamic_cast<SimpleLoopController&>(single.loopController());
+  single.addTask(
+    [&]() {
+      result = fiber::runInLargeStack([]() { return 1; });
+    }
+  );
+  singleLoop.loop(
+    [&]() {
+      singleLoop.stop();
+    }
+  );
+  EXPECT_EQ(1, result);
+  EXPECT_EQ(1, single.fibersAllocated());
+  EXPECT_EQ(0, single.largeFibersPoolSize());
+}
+
+TEST(StackArena, allocate) {
+  StackArena arena(16 * 1024, 2, 1, false);
+  auto a = arena.allocate(16 * 1024);
+  auto b = arena.allocate(1024);
+  ASSERT_NE(nullptr, a);
+  ASSERT_NE(nullptr, b);
+  EXPECT_NE(a, b);
+  // Stacks are usable.
+  memset(a, 1, 16 * 1024);
+  memset(b, 1, 16 * 1024);
+
+  EXPECT_EQ(nullptr, arena.allocate(1));
+  EXPECT_EQ(nullptr, StackArena(1024, 2, 0, false).allocate(2048));
+
+  unsigned char other;
+  EXPECT_FALSE(arena.deallocate(&other));
+  EXPECT_TRUE(arena.deallocate(a));
+  EXPECT_EQ(a, arena.allocate(16 * 1024));
+}
+
 TEST(FiberManager, remoteFiberBasic) {
   FiberManager manager(folly::make_unique<SimpleLoopController>());
   auto& loopController =
@@ -1160,6 +1493,28 @@ TEST(FiberManager, addTaskRemoteBasic) {
   EXPECT_EQ(43, result[1]);
 }
 
+TEST(FiberManager, addTasksRemote) {
+  FiberManager manager(folly::make_unique<SimpleLoopController>());
+
+  std::vector<int> order;
+  std::thread remoteThread([&]() {
+    manager.addTaskRemote([&]() { order.push_back(0); });
+
+    std::vector<std::function<void()>> tasks;
+    for (int i = 1; i <= 3; ++i) {
+      tasks.push_back([&order, i]() { order.push_back(i); });
+    }
+    manager.addTasksRemote(tasks.begin(), tasks.end());
+    manager.addTasksRemote(tasks.end(), tasks.end());
+  });
+  remoteThread.join();
+
+  EXPECT_EQ(4, manager.remoteTasksPending());
+  manager.loopUntilNoReady();
+  EXPECT_EQ(0, manager.remoteTasksPending());
+  EXPECT_EQ((std::vector<int>{0, 1, 2, 3}), order);
+}
+
 TEST(FiberManager, remoteHasTasks) {
   size_t counter = 0;
   FiberManager fm(folly::make_unique<SimpleLoopController>());
@@ -1256,3 +1611,38 @@ BENCHMARK(FiberManagerBasicOneAwait, iters) {
 BENCHMARK(FiberManagerBasicFiveAwaits, iters) {
   runBenchmark(5, iters);
 }
+
+BENCHMARK(FiberManagerAddTasks, iters) {
+  FiberManager fiberManager(folly::make_unique<SimpleLoopController>());
+
+  static const size_t kBatchSize = 100;
+  while (iters > 0) {
+    auto batch = std::min<size_t>(iters, kBatchSize);
+    for (size_t i = 0; i < batch; ++i) {
+      fiberManager.addTask([]() {});
+    }
+    fiberManager.loopUntilNoReady();
+    iters -= batch;
+  }
+}
+
+BENCHMARK(FiberManagerBatonRoundTrip, iters) {
+  FiberManager fiberManager(folly::make_unique<SimpleLoopController>());
+
+  Baton* waiting = nullptr;
+  fiberManager.addTask([&waiting, iters]() {
+      for (size_t i = 0; i < iters; ++i) {
+        Baton baton;
+        waiting = &baton;
+        baton.wait();
+      }
+    });
+  fiberManager.loopUntilNoReady();
+
+  while (waiting) {
+    auto baton = waiting;
+    waiting = nullptr;
+    baton->post();
+    fiberManager.loopUntilNoReady();
+  }
+}
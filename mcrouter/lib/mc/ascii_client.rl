@@ -2,6 +2,11 @@
 /* ascii_client.c is built from ascii_client.rl using ragel */
 
 #include <ctype.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "mcrouter/lib/fbi/debug.h"
 #include "mcrouter/lib/mc/_protocol.h"
@@ -406,10 +411,27 @@ version_reply = ('VERSION ' (any* -- ('\r' | '\n')) >start_token %finish_token
   }
   fin);
 
+# memcached meta command replies, see mc_ascii_meta_protocol.
+# Return flags we don't ask for are skipped.
+meta_ttl = 't' ('-1' %{ parser->msg->exptime = 0; } | exptime);
+meta_flag = 'f' flags | 'c' cas_unique | meta_ttl |
+  ((alpha - [fct]) (any -- (cntrl | space))*);
+meta_flags = (' '+ meta_flag)* ' '*;
+meta_value = 'VA' %{ parser->msg->result = mc_res_found; }
+  ' '+ value_bytes meta_flags nl @rx_data fin;
+meta_miss = 'EN' @{ parser->msg->result = mc_res_notfound; } fin;
+# HD is the success of both ms and md, AsyncMcClient tells them apart
+meta_status = ('HD' @{ parser->msg->result = mc_res_stored; } |
+               'NS' @{ parser->msg->result = mc_res_notstored; } |
+               'EX' @{ parser->msg->result = mc_res_exists; } |
+               'NF' @{ parser->msg->result = mc_res_notfound; })
+  meta_flags fin;
+meta_reply = meta_value | meta_miss | meta_status;
+
 reply := get_reply | lease_get | metaget_reply |
         reply_set | reply_add | reply_replace | reply_lease_set |
         reply_append | reply_prepend | reply_cas | delete_reply |
-        arithmetic_reply |
+        arithmetic_reply | meta_reply |
         stats_reply | ok | version_reply | error;
 
 # requests
@@ -485,7 +507,7 @@ request_reply := get | store | cas | delete | arithmetic
   get_reply | lease_get | metaget_reply |
   reply_set | reply_add | reply_replace | reply_lease_set |
   reply_append | reply_prepend | reply_cas | delete_reply |
-  arithmetic_reply |
+  arithmetic_reply | meta_reply |
   stats_reply | ok | version_reply | error;
 
 
@@ -504,6 +526,283 @@ int get_request_reply_ragel_start_state() {
   return ascii_en_request_reply;
 }
 
+/* Fast path for the most common messages
+
+   Requests: "get <key>[ <key>...]", "delete <key>" and
+   "set <key> <flags> <exptime> <bytes>[ noreply]" with the data.
+   Replies: "VALUE <key> <flags> <bytes>[ <cas>]" with the data and "END",
+   "END" and the storage/delete results, including the meta command ones
+   without return flags ("EN", "HD", "NS", "EX" and "NF").
+
+   Only messages that are completely in the buffer, use single spaces between
+   tokens and contain no invalid or oversized keys are handled here. Nothing is
+   consumed unless the whole message is valid, so everything else is simply
+   left to the state machine, which produces the same msgs. */
+
+/* (cntrl | space) in ragel terms, i.e. anything that can't be in a key */
+static inline int ascii_is_delim(char c) {
+  return (unsigned char)c <= ' ' || c == 0x7f;
+}
+
+/* @return first delimiter at or after p, end if there is none */
+static inline char* ascii_token_end(char* p, char* end) {
+#ifdef __SSE2__
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i del = _mm_set1_epi8(0x7f);
+  while (end - p >= 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)p);
+    /* unsigned x <= ' ' is min(x, ' ') == x */
+    __m128i delim = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(x, space), x),
+                                 _mm_cmpeq_epi8(x, del));
+    int mask = _mm_movemask_epi8(delim);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p < end && !ascii_is_delim(*p)) {
+    p++;
+  }
+  return p;
+}
+
+/* Parses a key token followed by a single space or the end of line.
+   @return key end, NULL if the key is empty, too long or badly delimited */
+static inline char* ascii_fast_key(char* p, char* end) {
+  char* e = ascii_token_end(p, end);
+  if (e == p || e - p > MC_KEY_MAX_LEN_ASCII ||
+      (e < end && (*e != ' ' || e + 1 == end))) {
+    return NULL;
+  }
+  return e;
+}
+
+/* Parses an unsigned number followed by a single space or the end of line.
+   Numbers are limited to 18 digits, so there's no overflow to worry about.
+   @return number end, NULL on failure */
+static inline char* ascii_fast_number(char* p, char* end, uint64_t* num) {
+  char* start = p;
+  uint64_t n = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    n = n * 10 + (*p - '0');
+    p++;
+  }
+  if (p == start || p - start > 18 ||
+      (p < end && (*p != ' ' || p + 1 == end))) {
+    return NULL;
+  }
+  *num = n;
+  return p;
+}
+
+/* @return pointer past the '\n' of nl at p, NULL if it's not all there */
+static inline char* ascii_fast_nl(char* p, char* pe) {
+  if (p < pe && *p == '\r') {
+    p++;
+  }
+  return (p < pe && *p == '\n') ? p + 1 : NULL;
+}
+
+#define ascii_fast_is(p, end, lit) \
+  ((size_t)((end) - (p)) == sizeof(lit) - 1 && \
+   memcmp((p), (lit), sizeof(lit) - 1) == 0)
+
+#define ascii_fast_prefix(p, end, lit) \
+  ((size_t)((end) - (p)) > sizeof(lit) - 1 && \
+   memcmp((p), (lit), sizeof(lit) - 1) == 0)
+
+/* Allocates a msg with (optional) key and value in a single chunk */
+static mc_msg_t* ascii_fast_msg(mc_op_t op, const char* key, size_t nkey,
+                                const char* value, size_t nvalue) {
+  size_t extra = (key ? nkey + 1 : 0) + (value ? nvalue + 1 : 0);
+  mc_msg_t* msg = mc_msg_new(extra);
+  if (msg == NULL) {
+    return NULL;
+  }
+  msg->op = op;
+  char* ptr = (char*)msg + sizeof(mc_msg_t);
+  if (key) {
+    memcpy(ptr, key, nkey);
+    ptr[nkey] = '\0';
+    msg->key.str = ptr;
+    msg->key.len = nkey;
+    ptr += nkey + 1;
+  }
+  if (value) {
+    memcpy(ptr, value, nvalue);
+    ptr[nvalue] = '\0';
+    msg->value.str = ptr;
+    msg->value.len = nvalue;
+  }
+  return msg;
+}
+
+static inline void ascii_fast_msg_ready(mc_parser_t* parser, mc_msg_t* msg) {
+  parser->parser_state = parser_msg_header;
+  parser->msg_ready(parser->context, 0, msg);
+}
+
+/* @return 1 if the msg at *pp was handled (and *pp advanced past it),
+           0 if it should go to the state machine, -1 if out of memory */
+static int ascii_fast_path(mc_parser_t* parser, char** pp, char* pe) {
+  char* p = *pp;
+  char* eol = memchr(p, '\n', pe - p);
+  if (eol == NULL) {
+    return 0;
+  }
+  char* end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+  char* next = eol + 1;
+  mc_msg_t* msg;
+
+  if (parser->ragel_start_state != ascii_en_reply) {
+    if (ascii_fast_prefix(p, end, "get ")) {
+      /* validate all the keys before any msg is passed on */
+      char* k;
+      for (k = p + 4; k < end; k++) {
+        if ((k = ascii_fast_key(k, end)) == NULL) {
+          return 0;
+        }
+      }
+      for (k = p + 4; k < end; k++) {
+        char* e = ascii_token_end(k, end);
+        if ((msg = ascii_fast_msg(mc_op_get, k, e - k, NULL, 0)) == NULL) {
+          return -1;
+        }
+        parser->parser_state = parser_partial;
+        parser->msg_ready(parser->context, 0, msg);
+        if (parser->parser_state != parser_partial) {
+          /* parser was reset from the callback */
+          *pp = next;
+          return 1;
+        }
+        k = e;
+      }
+      if ((msg = ascii_fast_msg(mc_op_end, NULL, 0, NULL, 0)) == NULL) {
+        return -1;
+      }
+      ascii_fast_msg_ready(parser, msg);
+      *pp = next;
+      return 1;
+    }
+
+    if (ascii_fast_prefix(p, end, "delete ")) {
+      char* k = p + 7;
+      char* e = ascii_fast_key(k, end);
+      if (e != end) {
+        return 0;
+      }
+      if ((msg = ascii_fast_msg(mc_op_delete, k, e - k, NULL, 0)) == NULL) {
+        return -1;
+      }
+      ascii_fast_msg_ready(parser, msg);
+      *pp = next;
+      return 1;
+    }
+
+    if (ascii_fast_prefix(p, end, "set ")) {
+      uint64_t flags, exptime, nvalue;
+      bool noreply = false;
+      char* k = p + 4;
+      char* e = ascii_fast_key(k, end);
+      char* t;
+      if (e == NULL || e == end ||
+          (t = ascii_fast_number(e + 1, end, &flags)) == NULL || t == end ||
+          (t = ascii_fast_number(t + 1, end, &exptime)) == NULL || t == end ||
+          (t = ascii_fast_number(t + 1, end, &nvalue)) == NULL) {
+        return 0;
+      }
+      if (t != end) {
+        if (!ascii_fast_is(t + 1, end, "noreply")) {
+          return 0;
+        }
+        noreply = true;
+      }
+      if (nvalue > (size_t)(pe - next)) {
+        return 0;
+      }
+      char* tail = ascii_fast_nl(next + nvalue, pe);
+      if (tail == NULL) {
+        return 0;
+      }
+      if ((msg = ascii_fast_msg(mc_op_set, k, e - k, next, nvalue)) == NULL) {
+        return -1;
+      }
+      msg->flags = flags;
+      msg->exptime = exptime;
+      msg->noreply = noreply;
+      ascii_fast_msg_ready(parser, msg);
+      *pp = tail;
+      return 1;
+    }
+  }
+
+  if (parser->ragel_start_state != ascii_en_request) {
+    if (ascii_fast_prefix(p, end, "VALUE ")) {
+      uint64_t flags, nvalue, cas = 0;
+      char* k = p + 6;
+      char* e = ascii_fast_key(k, end);
+      char* t;
+      if (e == NULL || e == end ||
+          (t = ascii_fast_number(e + 1, end, &flags)) == NULL ||
+          t == end ||
+          (t = ascii_fast_number(t + 1, end, &nvalue)) == NULL ||
+          (t != end && ascii_fast_number(t + 1, end, &cas) != end)) {
+        return 0;
+      }
+      if (nvalue > (size_t)(pe - next)) {
+        return 0;
+      }
+      char* tail = ascii_fast_nl(next + nvalue, pe);
+      if (tail == NULL || pe - tail < 3 || memcmp(tail, "END", 3) != 0 ||
+          (tail = ascii_fast_nl(tail + 3, pe)) == NULL) {
+        return 0;
+      }
+      /* keys are only recorded if requested, see skipping_key() */
+      msg = ascii_fast_msg(mc_op_unknown,
+                           parser->record_skip_key ? k : NULL, e - k,
+                           next, nvalue);
+      if (msg == NULL) {
+        return -1;
+      }
+      msg->result = mc_res_found;
+      msg->flags = flags;
+      msg->cas = cas;
+      ascii_fast_msg_ready(parser, msg);
+      *pp = tail;
+      return 1;
+    }
+
+    mc_res_t result;
+    if (ascii_fast_is(p, end, "END") || ascii_fast_is(p, end, "NOT_FOUND") ||
+        ascii_fast_is(p, end, "EN") || ascii_fast_is(p, end, "NF")) {
+      result = mc_res_notfound;
+    } else if (ascii_fast_is(p, end, "STORED") ||
+               ascii_fast_is(p, end, "HD")) {
+      result = mc_res_stored;
+    } else if (ascii_fast_is(p, end, "NOT_STORED") ||
+               ascii_fast_is(p, end, "NS")) {
+      result = mc_res_notstored;
+    } else if (ascii_fast_is(p, end, "EXISTS") ||
+               ascii_fast_is(p, end, "EX")) {
+      result = mc_res_exists;
+    } else if (ascii_fast_is(p, end, "DELETED")) {
+      result = mc_res_deleted;
+    } else {
+      return 0;
+    }
+    if ((msg = ascii_fast_msg(mc_op_unknown, NULL, 0, NULL, 0)) == NULL) {
+      return -1;
+    }
+    msg->result = result;
+    ascii_fast_msg_ready(parser, msg);
+    *pp = next;
+    return 1;
+  }
+
+  return 0;
+}
+
 /** ascii reply parsing
     This is the real workhorse. It consumes buf, resuming the partial reply if
     one exists. As each reply is fully received, we call mcc_req_complete().
@@ -554,6 +853,18 @@ int _on_ascii_rx(mc_parser_t* parser, char* buf, size_t nbuf) {
     cs = parser->ragel_state;
 
     if (parser->parser_state == parser_msg_header) {
+      int fast = ascii_fast_path(parser, &p, pe);
+      if (fast == 1) {
+        nmsgs++;
+        continue;
+      } else if (fast < 0) {
+        parser->error = parser_out_of_memory;
+        parser->resid = parser->off = 0;
+        parser->parse_error(parser->context, parser->error);
+        success = 0;
+        goto epilogue;
+      }
+
       if (parser->msg != NULL) {
         dbg_error("parser->msg already exists at start of new message. "
                   "Probable memory leak.");
@@ -41,6 +41,41 @@
     }                                                           \
   }
 
+/**
+ * Append " <value>" to the scratch buffer, like snprintf(" %" PRIu64) but
+ * without parsing a format. Used for headers of the common replies.
+ * Everything appended since a saved offset is then added as a single iovec
+ * with IOV_WRITE_SCRATCH.
+ */
+static inline void scratch_append_uint64(mc_ascii_response_buf_t* scratch,
+                                         uint64_t value) {
+  char digits[20];
+  size_t n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+
+  /* " " + up to 20 digits, always fits for the replies we format */
+  FBI_ASSERT(scratch->offset + n + 1 < SCRATCH_BUFFER_LEN);
+  char* p = scratch->buffer + scratch->offset;
+  *p++ = ' ';
+  while (n > 0) {
+    *p++ = digits[--n];
+  }
+  scratch->offset = p - scratch->buffer;
+}
+
+static inline void scratch_append_term(mc_ascii_response_buf_t* scratch) {
+  FBI_ASSERT(scratch->offset + 2 < SCRATCH_BUFFER_LEN);
+  scratch->buffer[scratch->offset++] = '\r';
+  scratch->buffer[scratch->offset++] = '\n';
+}
+
+#define IOV_WRITE_SCRATCH(scratch, start) {                     \
+    IOV_WRITE(scratch->buffer + (start), scratch->offset - (start)); \
+  }
+
 #define IOV_WRITE_IP(scratch, v, ip) {                          \
     char* p = scratch->buffer + scratch->offset;                \
     size_t max_len = SCRATCH_BUFFER_LEN - scratch->offset;      \
@@ -51,45 +86,49 @@
     scratch->offset += length + 1;                              \
   }
 
-static inline const char* mc_res_to_response_string(const mc_res_t result) {
-  static char const* const mc_res_strings[] = {
-    [mc_res_unknown] = "SERVER_ERROR unknown result\r\n",
-    [mc_res_deleted] = "DELETED\r\n",
-    [mc_res_found] = "FOUND\r\n",
+/* Complete replies, lengths are computed at compile time */
+static inline const nstring_t* mc_res_to_response_string(
+    const mc_res_t result) {
+  static const nstring_t mc_res_strings[] = {
+    [mc_res_unknown] = NSTRING_LIT("SERVER_ERROR unknown result\r\n"),
+    [mc_res_deleted] = NSTRING_LIT("DELETED\r\n"),
+    [mc_res_found] = NSTRING_LIT("FOUND\r\n"),
     // hostmiss ?
-    [mc_res_notfound] = "NOT_FOUND\r\n",
-    [mc_res_notstored] = "NOT_STORED\r\n",
-    [mc_res_stalestored] = "STALE_STORED\r\n",
-    [mc_res_ok] = "OK\r\n",
-    [mc_res_stored] = "STORED\r\n",
-    [mc_res_exists] = "EXISTS\r\n",
+    [mc_res_notfound] = NSTRING_LIT("NOT_FOUND\r\n"),
+    [mc_res_notstored] = NSTRING_LIT("NOT_STORED\r\n"),
+    [mc_res_stalestored] = NSTRING_LIT("STALE_STORED\r\n"),
+    [mc_res_ok] = NSTRING_LIT("OK\r\n"),
+    [mc_res_stored] = NSTRING_LIT("STORED\r\n"),
+    [mc_res_exists] = NSTRING_LIT("EXISTS\r\n"),
     /* soft errors -- */
     /* this shouldn't happen as we don't support UDP yet, and when we do
        hopefully we can be more intelligent than this. */
-    [mc_res_ooo] = "SERVER_ERROR out of order\r\n",
-    [mc_res_timeout] = "SERVER_ERROR timeout\r\n",
-    [mc_res_connect_timeout] = "SERVER_ERROR connection timeout\r\n",
-    [mc_res_connect_error] = "SERVER_ERROR connection error\r\n",
-    [mc_res_busy] = "SERVER_ERROR 307 busy\r\n",
-    [mc_res_shutdown] = "SERVER_ERROR 301 shutdown\r\n",
-    [mc_res_try_again] = "SERVER_ERROR 302 try again\r\n",
-    [mc_res_tko] = "SERVER_ERROR unavailable\r\n",
+    [mc_res_ooo] = NSTRING_LIT("SERVER_ERROR out of order\r\n"),
+    [mc_res_timeout] = NSTRING_LIT("SERVER_ERROR timeout\r\n"),
+    [mc_res_connect_timeout] =
+      NSTRING_LIT("SERVER_ERROR connection timeout\r\n"),
+    [mc_res_connect_error] =
+      NSTRING_LIT("SERVER_ERROR connection error\r\n"),
+    [mc_res_busy] = NSTRING_LIT("SERVER_ERROR 307 busy\r\n"),
+    [mc_res_shutdown] = NSTRING_LIT("SERVER_ERROR 301 shutdown\r\n"),
+    [mc_res_try_again] = NSTRING_LIT("SERVER_ERROR 302 try again\r\n"),
+    [mc_res_tko] = NSTRING_LIT("SERVER_ERROR unavailable\r\n"),
     /* hard errors -- */
-    [mc_res_bad_command] = "CLIENT_ERROR bad command\r\n",
-    [mc_res_bad_key] = "CLIENT_ERROR bad key\r\n",
-    [mc_res_bad_flags] = "CLIENT_ERROR bad flags\r\n",
-    [mc_res_bad_exptime] = "CLIENT_ERROR bad exptime\r\n",
-    [mc_res_bad_lease_id] = "CLIENT_ERROR bad lease_id\r\n",
-    [mc_res_bad_cas_id] = "CLIENT_ERROR bad cas_id\r\n",
-    [mc_res_bad_value] = "SERVER_ERROR bad value\r\n",
-    [mc_res_aborted] = "SERVER_ERROR aborted\r\n",
-    [mc_res_client_error] = "CLIENT_ERROR\r\n",
-    [mc_res_local_error] = "SERVER_ERROR local error\r\n",
-    [mc_res_remote_error] = "SERVER_ERROR remote error\r\n",
+    [mc_res_bad_command] = NSTRING_LIT("CLIENT_ERROR bad command\r\n"),
+    [mc_res_bad_key] = NSTRING_LIT("CLIENT_ERROR bad key\r\n"),
+    [mc_res_bad_flags] = NSTRING_LIT("CLIENT_ERROR bad flags\r\n"),
+    [mc_res_bad_exptime] = NSTRING_LIT("CLIENT_ERROR bad exptime\r\n"),
+    [mc_res_bad_lease_id] = NSTRING_LIT("CLIENT_ERROR bad lease_id\r\n"),
+    [mc_res_bad_cas_id] = NSTRING_LIT("CLIENT_ERROR bad cas_id\r\n"),
+    [mc_res_bad_value] = NSTRING_LIT("SERVER_ERROR bad value\r\n"),
+    [mc_res_aborted] = NSTRING_LIT("SERVER_ERROR aborted\r\n"),
+    [mc_res_client_error] = NSTRING_LIT("CLIENT_ERROR\r\n"),
+    [mc_res_local_error] = NSTRING_LIT("SERVER_ERROR local error\r\n"),
+    [mc_res_remote_error] = NSTRING_LIT("SERVER_ERROR remote error\r\n"),
     /* in progress -- */
-    [mc_res_waiting] = "SERVER_ERROR waiting\r\n"
+    [mc_res_waiting] = NSTRING_LIT("SERVER_ERROR waiting\r\n")
   };
-  return mc_res_strings[result < mc_nres ? result : mc_res_unknown];
+  return &mc_res_strings[result < mc_nres ? result : mc_res_unknown];
 }
 
 static char* stats_reply_to_string(nstring_t *stats,
@@ -175,7 +214,7 @@ size_t mc_ascii_response_write_iovs(mc_ascii_response_buf_t* buf,
       IOV_WRITE_NSTRING(reply->value);
       IOV_WRITE_CONST_STR("\r\n");
     } else {
-      IOV_WRITE_STR(mc_res_to_response_string(reply->result));
+      IOV_WRITE_NSTRING(*mc_res_to_response_string(reply->result));
     }
     return niovs;
   }
@@ -184,9 +223,14 @@ size_t mc_ascii_response_write_iovs(mc_ascii_response_buf_t* buf,
     case mc_op_incr:
     case mc_op_decr:
       switch (reply->result) {
-        case mc_res_stored:
-          IOV_FORMAT(buf, "%" PRIu64 "\r\n", reply->delta);
+        case mc_res_stored: {
+          /* "<delta>\r\n", skip the leading space */
+          size_t start = buf->offset + 1;
+          scratch_append_uint64(buf, reply->delta);
+          scratch_append_term(buf);
+          IOV_WRITE_SCRATCH(buf, start);
           break;
+        }
         case mc_res_notfound:
           IOV_WRITE_CONST_STR("NOT_FOUND\r\n");
           break;
@@ -204,7 +248,7 @@ size_t mc_ascii_response_write_iovs(mc_ascii_response_buf_t* buf,
     case mc_op_cas:
       switch (reply->result) {
         case mc_res_ok:
-          IOV_WRITE_STR(mc_res_to_response_string(mc_res_stored));
+          IOV_WRITE_NSTRING(*mc_res_to_response_string(mc_res_stored));
           break;
 
         case mc_res_stored:
@@ -213,7 +257,7 @@ size_t mc_ascii_response_write_iovs(mc_ascii_response_buf_t* buf,
         case mc_res_notstored:
         case mc_res_notfound:
         case mc_res_exists:
-          IOV_WRITE_STR(mc_res_to_response_string(reply->result));
+          IOV_WRITE_NSTRING(*mc_res_to_response_string(reply->result));
           break;
 
         default:
@@ -225,7 +269,7 @@ size_t mc_ascii_response_write_iovs(mc_ascii_response_buf_t* buf,
       switch (reply->result) {
         case mc_res_deleted:
         case mc_res_notfound:
-          IOV_WRITE_STR(mc_res_to_response_string(reply->result));
+          IOV_WRITE_NSTRING(*mc_res_to_response_string(reply->result));
           break;
         default:
           goto UNEXPECTED;
@@ -237,18 +281,22 @@ size_t mc_ascii_response_write_iovs(mc_ascii_response_buf_t* buf,
     case mc_op_lease_get:
     case mc_op_gets:
       switch (reply->result) {
-        case mc_res_found:
+        case mc_res_found: {
           IOV_WRITE_CONST_STR("VALUE ");
           IOV_WRITE_NSTRING(key);
-          IOV_FORMAT(buf, " %" PRIu64 " %lu", reply->flags,
-                     reply->value.len);
+          /* " <flags> <length>[ <cas>]\r\n" */
+          size_t start = buf->offset;
+          scratch_append_uint64(buf, reply->flags);
+          scratch_append_uint64(buf, reply->value.len);
           if (op == mc_op_gets) {
-            IOV_FORMAT(buf, " %" PRIu64, reply->cas);
+            scratch_append_uint64(buf, reply->cas);
           }
-          IOV_WRITE_CONST_STR("\r\n");
+          scratch_append_term(buf);
+          IOV_WRITE_SCRATCH(buf, start);
           IOV_WRITE_NSTRING(reply->value);
           IOV_WRITE_CONST_STR("\r\n");
           break;
+        }
 
         case mc_res_notfound:
           if (op != mc_op_lease_get) {
@@ -310,7 +358,7 @@ size_t mc_ascii_response_write_iovs(mc_ascii_response_buf_t* buf,
         IOV_WRITE_CONST_STR("END\r\n");
       }
       else {
-        IOV_WRITE_STR(mc_res_to_response_string(reply->result));
+        IOV_WRITE_NSTRING(*mc_res_to_response_string(reply->result));
       }
       break;
 
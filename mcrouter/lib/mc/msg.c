@@ -9,12 +9,12 @@
  */
 #include "msg.h"
 
-#include <ctype.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <zlib.h>
 
+#include "mcrouter/lib/fbi/counter.h"
 #include "mcrouter/lib/fbi/nstring.h"
 #include "mcrouter/lib/mc/protocol.h"
 
@@ -66,9 +66,11 @@ void mc_msg_track_num_outstanding(int enable) {
   _mc_msg_track_num_outstanding = enable;
 }
 
-static uint64_t _mc_msg_num_outstanding = 0;
+/* Messages are allocated and freed by all threads, the counter spreads
+   over per-thread slots once they contend */
+static counter_t _mc_msg_num_outstanding;
 uint64_t mc_msg_num_outstanding() {
-  return _mc_msg_num_outstanding;
+  return counter_get(&_mc_msg_num_outstanding);
 }
 
 void mc_msg_init_not_refcounted(mc_msg_t* msg) {
@@ -88,7 +90,7 @@ mc_msg_t* mc_msg_new(size_t extra_size) {
   msg->_extra_size = extra_size;
 
   if (_mc_msg_track_num_outstanding) {
-    __sync_fetch_and_add(&_mc_msg_num_outstanding, 1);
+    counter_add(&_mc_msg_num_outstanding, 1);
   }
 
   return msg;
@@ -380,7 +382,7 @@ void mc_msg_decref(mc_msg_t* msg) {
 
     if (new_refcount == 0) {
       if (_mc_msg_track_num_outstanding) {
-        __sync_fetch_and_add(&_mc_msg_num_outstanding, -1);
+        counter_add(&_mc_msg_num_outstanding, -1);
       }
 #ifndef LIBMC_FBTRACE_DISABLE
       mc_fbtrace_info_decref(msg->fbtrace_info);
@@ -550,9 +552,42 @@ mc_req_err_t mc_client_req_check(const mc_msg_t* req) {
   return mc_client_req_key_check(req->key);
 }
 
-mc_req_err_t mc_client_req_key_check(nstring_t key) {
-  size_t i;
+#define MC_BYTES(x) (0x0101010101010101ULL * (x))
+
+/**
+ * Spaces and control characters (of the C locale) are the bytes up to ' '
+ * and DEL. Checks 8 bytes at a time: a byte b of the word is below n
+ * (n <= 128) iff the high bit of (b - n) & ~b is set, and the subtraction
+ * only borrows from higher bytes once a lower byte was already found.
+ */
+static int has_space_or_ctrl(const char* str, size_t len) {
+  uint64_t found = 0;
+  size_t i = 0;
+
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t word;
+    uint64_t del;
+    memcpy(&word, str + i, sizeof(word));
+    del = word ^ MC_BYTES(0x7f);
+    found |= (word - MC_BYTES(' ' + 1)) & ~word;
+    found |= (del - MC_BYTES(1)) & ~del;
+  }
+  if (found & MC_BYTES(0x80)) {
+    return 1;
+  }
+
+  for (; i < len; ++i) {
+    unsigned char c = str[i];
+    if (c <= ' ' || c == 0x7f) {
+      return 1;
+    }
+  }
+  return 0;
+}
 
+#undef MC_BYTES
+
+mc_req_err_t mc_client_req_key_check(nstring_t key) {
   if (key.len < 1) {
     return mc_req_err_no_key;
   }
@@ -561,10 +596,8 @@ mc_req_err_t mc_client_req_key_check(nstring_t key) {
     return mc_req_err_key_too_long;
   }
 
-  for (i = 0; i < key.len; ++i) {
-    if (iscntrl(key.str[i]) || isspace(key.str[i])) {
-      return mc_req_err_space_or_ctrl;
-    }
+  if (has_space_or_ctrl(key.str, key.len)) {
+    return mc_req_err_space_or_ctrl;
   }
 
   return mc_req_err_valid;
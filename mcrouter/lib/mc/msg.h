@@ -201,6 +201,12 @@ enum mc_msg_flags_t {
     MC_MSG_FLAG_SNAPPY_COMPRESSED = 0x4000,
     MC_MSG_FLAG_BIG_VALUE = 0X8000,
     MC_MSG_FLAG_NEGATIVE_CACHE = 0x10000,
+    /* Values compressed by mcrouter (see ValueCompressor) */
+    MC_MSG_FLAG_LZ4_COMPRESSED = 0x20000,
+    MC_MSG_FLAG_ZSTD_COMPRESSED = 0x40000,
+    /* Values prefixed with their soft expiry
+       (see StaleWhileRevalidateRoute) */
+    MC_MSG_FLAG_SOFT_EXPTIME = 0x80000,
     /* Bits reserved for application-specific extension flags: */
     MC_MSG_FLAG_USER_1 = 0x100000000LL,
     MC_MSG_FLAG_USER_2 = 0x200000000LL,
@@ -147,6 +147,30 @@ void mc_parser_parse(mc_parser_t *parser, const uint8_t *buf, size_t len) {
   }
 }
 
+char* mc_parser_value_tail(mc_parser_t *parser, size_t *len) {
+  FBI_ASSERT(parser != NULL && len != NULL);
+  if (parser->known_protocol != mc_ascii_protocol ||
+      parser->parser_state != parser_body ||
+      parser->resid == 0) {
+    *len = 0;
+    return NULL;
+  }
+  *len = parser->resid;
+  return &parser->msg->value.str[parser->off];
+}
+
+void mc_parser_value_append(mc_parser_t *parser, size_t n) {
+  FBI_ASSERT(parser != NULL);
+  FBI_ASSERT(parser->parser_state == parser_body);
+  FBI_ASSERT(parser->resid >= n);
+  parser->off += n;
+  parser->resid -= n;
+  if (parser->resid == 0) {
+    FBI_ASSERT(parser->off == parser->msg->value.len);
+    parser->parser_state = parser_partial;
+  }
+}
+
 void mc_parser_reset(mc_parser_t *parser) {
   FBI_ASSERT(parser != NULL);
   if (parser->msg != NULL) {
@@ -146,6 +146,24 @@ mc_protocol_t mc_parser_determine_protocol(uint8_t first_byte);
  */
 void mc_parser_parse(mc_parser_t *parser, const uint8_t *buf, size_t len);
 
+/**
+ * While an ascii message value is being read (parser_body), the rest of it
+ * can be written straight into the message instead of passed to
+ * mc_parser_parse(), see mc_parser_value_append().
+ *
+ * @param len  Set to the number of value bytes still expected
+ * @return     Where they go, NULL if no value is being read
+ */
+char* mc_parser_value_tail(mc_parser_t *parser, size_t *len);
+
+/**
+ * Accounts for n bytes written at mc_parser_value_tail().
+ * Once the whole value is there, parsing continues with mc_parser_parse().
+ *
+ * @param n  Must not be more than the length mc_parser_value_tail() returned
+ */
+void mc_parser_value_append(mc_parser_t *parser, size_t n);
+
 /**
  * Cleans up internal state, freeing any allocated memory.
  * After the call, the parser is in the same state as after mc_parser_init().
@@ -31,6 +31,9 @@ typedef enum mc_protocol_e {
   mc_ascii_protocol = 1,
   mc_binary_protocol = 2,
   mc_umbrella_protocol = 3,
+  /* ascii using memcached meta commands (mg, ms, md) where possible,
+     client side only */
+  mc_ascii_meta_protocol = 4,
   mc_nprotocols, // placeholder
 } mc_protocol_t;
 
@@ -42,6 +45,8 @@ static inline mc_protocol_t mc_string_to_protocol(const char * str) {
     return mc_binary_protocol;
   } else if (!strcmp(str, "umbrella")) {
     return mc_umbrella_protocol;
+  } else if (!strcmp(str, "meta")) {
+    return mc_ascii_meta_protocol;
   } else {
     return mc_unknown_protocol;
   }
@@ -53,6 +58,7 @@ static inline const char* mc_protocol_to_string(const mc_protocol_t value) {
     "ascii",
     "binary",
     "umbrella",
+    "meta",
   };
   return strings[value < mc_nprotocols ? value : mc_unknown_protocol];
 }
@@ -0,0 +1,211 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/mc/parser.h"
+
+namespace {
+
+struct ParsedMsg {
+  mc_op_t op;
+  mc_res_t result;
+  std::string key;
+  std::string value;
+  uint64_t flags;
+  uint32_t exptime;
+  uint64_t cas;
+  bool noreply;
+
+  bool operator==(const ParsedMsg& other) const {
+    return op == other.op && result == other.result && key == other.key &&
+      value == other.value && flags == other.flags &&
+      exptime == other.exptime && cas == other.cas &&
+      noreply == other.noreply;
+  }
+};
+
+struct ParseResult {
+  std::vector<ParsedMsg> msgs;
+  size_t errors{0};
+};
+
+void msgReady(void* context, uint64_t reqid, mc_msg_t* msg) {
+  auto result = static_cast<ParseResult*>(context);
+  result->msgs.push_back(ParsedMsg{
+    msg->op,
+    msg->result,
+    std::string(msg->key.str ? msg->key.str : "", msg->key.len),
+    std::string(msg->value.str ? msg->value.str : "", msg->value.len),
+    msg->flags,
+    msg->exptime,
+    msg->cas,
+    msg->noreply
+  });
+  mc_msg_decref(msg);
+}
+
+void parseError(void* context, parser_error_t error) {
+  ++static_cast<ParseResult*>(context)->errors;
+}
+
+/**
+ * Parses data in chunks of at most chunkSize bytes.
+ */
+ParseResult parse(parser_type_t type, const std::string& data,
+                  size_t chunkSize) {
+  ParseResult result;
+  mc_parser_t parser;
+  mc_parser_init(&parser, type, &msgReady, &parseError, &result);
+  for (size_t i = 0; i < data.size(); i += chunkSize) {
+    mc_parser_parse(&parser,
+                    reinterpret_cast<const uint8_t*>(data.data() + i),
+                    std::min(chunkSize, data.size() - i));
+  }
+  mc_parser_reset(&parser);
+  return result;
+}
+
+/**
+ * Whole messages take the fast path, while single bytes always go
+ * through the state machine. Both should produce the same msgs.
+ */
+void checkSameAsStateMachine(parser_type_t type, const std::string& data,
+                             size_t expectedMsgs) {
+  auto fast = parse(type, data, data.size());
+  auto slow = parse(type, data, 1);
+  EXPECT_EQ(0, fast.errors);
+  EXPECT_EQ(0, slow.errors);
+  EXPECT_EQ(expectedMsgs, fast.msgs.size());
+  EXPECT_TRUE(fast.msgs == slow.msgs);
+}
+
+}  // anonymous namespace
+
+TEST(asciiParser, requests) {
+  std::string longKey(200, 'k');
+  checkSameAsStateMachine(request_parser, "get a\r\n", 2);
+  checkSameAsStateMachine(request_parser, "get a b " + longKey + "\r\n", 4);
+  checkSameAsStateMachine(request_parser, "get a\n", 2);
+  checkSameAsStateMachine(request_parser, "get  a  b  \r\n", 3);
+  checkSameAsStateMachine(request_parser, "delete " + longKey + "\r\n", 1);
+  checkSameAsStateMachine(request_parser, "delete a 0 noreply\r\n", 1);
+  checkSameAsStateMachine(request_parser,
+                          "set a 1 2 5\r\nhello\r\n"
+                          "set b 3 4 0 noreply\r\n\r\n"
+                          "set " + longKey + " 5 6 3\nabc\n", 3);
+  checkSameAsStateMachine(request_parser, "set a 1 2 3  \r\nabc\r\n", 1);
+  checkSameAsStateMachine(request_parser, "version\r\nget z\r\n", 3);
+}
+
+TEST(asciiParser, replies) {
+  checkSameAsStateMachine(reply_parser,
+                          "VALUE a 1 5\r\nhello\r\nEND\r\n"
+                          "VALUE a 2 3 12345\r\nabc\r\nEND\r\n"
+                          "END\r\n"
+                          "STORED\r\nNOT_STORED\r\nEXISTS\r\n"
+                          "NOT_FOUND\r\nDELETED\r\n", 7);
+  checkSameAsStateMachine(reply_parser, "VALUE a  1 5\r\nhello\r\nEND\r\n", 1);
+  checkSameAsStateMachine(reply_parser, "VERSION 1.0\r\nEND\r\n", 2);
+}
+
+TEST(asciiParser, metaReplies) {
+  checkSameAsStateMachine(reply_parser,
+                          "VA 5 f1 t30 c12345\r\nhello\r\n"
+                          "VA 3 t-1 s3\r\nabc\r\n"
+                          "EN\r\nHD\r\nNS\r\nEX\r\nNF\r\nHD c7\r\n", 8);
+
+  auto result = parse(reply_parser,
+                      "VA 5 f1 t30 c12345\r\nhello\r\nVA 3 t-1\r\nabc\r\n"
+                      "EN\r\nHD\r\nNS\r\n", 1000);
+  EXPECT_EQ(0, result.errors);
+  ASSERT_EQ(5, result.msgs.size());
+  EXPECT_EQ(mc_res_found, result.msgs[0].result);
+  EXPECT_EQ("hello", result.msgs[0].value);
+  EXPECT_EQ(1, result.msgs[0].flags);
+  EXPECT_EQ(30, result.msgs[0].exptime);
+  EXPECT_EQ(12345, result.msgs[0].cas);
+  /* no expiry */
+  EXPECT_EQ(0, result.msgs[1].exptime);
+  EXPECT_EQ(mc_res_notfound, result.msgs[2].result);
+  EXPECT_EQ(mc_res_stored, result.msgs[3].result);
+  EXPECT_EQ(mc_res_notstored, result.msgs[4].result);
+}
+
+TEST(asciiParser, recordSkipKey) {
+  ParseResult result;
+  mc_parser_t parser;
+  mc_parser_init(&parser, reply_parser, &msgReady, &parseError, &result);
+  parser.record_skip_key = true;
+  std::string data = "VALUE abc 0 1\r\nx\r\nEND\r\n";
+  mc_parser_parse(&parser, reinterpret_cast<const uint8_t*>(data.data()),
+                  data.size());
+  mc_parser_reset(&parser);
+
+  ASSERT_EQ(1, result.msgs.size());
+  EXPECT_EQ("abc", result.msgs[0].key);
+  EXPECT_EQ("x", result.msgs[0].value);
+  EXPECT_EQ(mc_res_found, result.msgs[0].result);
+}
+
+TEST(asciiParser, partialMessage) {
+  /* the tail of the reply arrives later, so the state machine finishes it */
+  auto result = parse(reply_parser,
+                      "VALUE a 1 5\r\nhello\r\nEND\r\nVALUE b 1 5\r\nhel", 1000);
+  EXPECT_EQ(1, result.msgs.size());
+  EXPECT_EQ(0, result.errors);
+
+  auto chunked = parse(reply_parser,
+                       "VALUE a 1 5\r\nhello\r\nEND\r\nVALUE b 1 5\r\nhello"
+                       "\r\nEND\r\n", 30);
+  ASSERT_EQ(2, chunked.msgs.size());
+  EXPECT_EQ("hello", chunked.msgs[1].value);
+}
+
+TEST(asciiParser, valueTail) {
+  ParseResult result;
+  mc_parser_t parser;
+  mc_parser_init(&parser, reply_parser, &msgReady, &parseError, &result);
+
+  size_t len;
+  EXPECT_EQ(nullptr, mc_parser_value_tail(&parser, &len));
+  EXPECT_EQ(0, len);
+
+  std::string head = "VALUE a 1 10\r\nhel";
+  mc_parser_parse(&parser, reinterpret_cast<const uint8_t*>(head.data()),
+                  head.size());
+  auto tail = mc_parser_value_tail(&parser, &len);
+  ASSERT_NE(nullptr, tail);
+  ASSERT_EQ(7, len);
+
+  /* the rest of the value is written in place, in two pieces */
+  memcpy(tail, "lo w", 4);
+  mc_parser_value_append(&parser, 4);
+  tail = mc_parser_value_tail(&parser, &len);
+  ASSERT_NE(nullptr, tail);
+  ASSERT_EQ(3, len);
+  memcpy(tail, "rld", 3);
+  mc_parser_value_append(&parser, 3);
+  EXPECT_EQ(nullptr, mc_parser_value_tail(&parser, &len));
+
+  std::string end = "\r\nEND\r\n";
+  mc_parser_parse(&parser, reinterpret_cast<const uint8_t*>(end.data()),
+                  end.size());
+  mc_parser_reset(&parser);
+
+  EXPECT_EQ(0, result.errors);
+  ASSERT_EQ(1, result.msgs.size());
+  EXPECT_EQ("hello wrld", result.msgs[0].value);
+  EXPECT_EQ(mc_res_found, result.msgs[0].result);
+}
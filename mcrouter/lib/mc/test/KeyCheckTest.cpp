@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/mc/protocol.h"
+
+namespace {
+
+mc_req_err_t check(const std::string& key) {
+  nstring_t str;
+  str.str = const_cast<char*>(key.data());
+  str.len = key.size();
+  return mc_client_req_key_check(str);
+}
+
+}  // anonymous namespace
+
+TEST(KeyCheck, lengths) {
+  EXPECT_EQ(mc_req_err_no_key, check(""));
+  EXPECT_EQ(mc_req_err_valid, check("a"));
+  EXPECT_EQ(mc_req_err_valid, check(std::string(MC_KEY_MAX_LEN, 'a')));
+  EXPECT_EQ(mc_req_err_key_too_long,
+            check(std::string(MC_KEY_MAX_LEN + 1, 'a')));
+}
+
+TEST(KeyCheck, spaceOrCtrl) {
+  const int invalid[] = { 0, '\t', '\n', '\r', ' ', 0x1f, 0x7f };
+  const int valid[] = { '!', '~', '/', '|', 0x80, 0xff };
+  /* every length and position, so that both the word at a time part and
+     the tail are covered */
+  for (size_t len = 1; len <= 20; ++len) {
+    for (size_t pos = 0; pos < len; ++pos) {
+      for (int c : invalid) {
+        std::string key(len, 'k');
+        key[pos] = c;
+        EXPECT_EQ(mc_req_err_space_or_ctrl, check(key))
+          << "len " << len << " pos " << pos << " char " << c;
+      }
+      for (int c : valid) {
+        std::string key(len, 'k');
+        key[pos] = c;
+        EXPECT_EQ(mc_req_err_valid, check(key))
+          << "len " << len << " pos " << pos << " char " << c;
+      }
+    }
+  }
+}
@@ -241,6 +241,9 @@ typedef enum msg_field_e {
   msg_stats = 0x1000,
   msg_key = 0x2000,
   msg_value = 0x4000,
+  // SpookyHashV2 digest of the request's routing key, set by mcrouter
+  // for the next hop (see McRequestBase::routingKeyDigestHint())
+  msg_key_digest = 0x8000,
   // These values must fit in a short, so 0x8000 is the max
   // with this scheme.
 } msg_field_t;
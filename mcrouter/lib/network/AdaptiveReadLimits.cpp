@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "AdaptiveReadLimits.h"
+
+#include <algorithm>
+
+namespace facebook { namespace memcache {
+
+AdaptiveReadLimits::AdaptiveReadLimits(Options opts)
+    : opts_(opts),
+      requestsPerRead_(std::max<size_t>(1, opts_.maxRequestsPerRead)),
+      readsPerEvent_(std::max<uint16_t>(1, opts_.maxReadsPerEvent)) {
+}
+
+bool AdaptiveReadLimits::update(std::chrono::microseconds loopTime,
+                                size_t backlog) {
+  if (++iterations_ < opts_.interval) {
+    return false;
+  }
+  iterations_ = 0;
+
+  auto oldRequestsPerRead = requestsPerRead_;
+  auto oldReadsPerEvent = readsPerEvent_;
+
+  if (loopTime > opts_.targetLoopTime ||
+      (backlog > 0 && backlog > lastBacklog_)) {
+    /* Back off quickly */
+    requestsPerRead_ = std::max<size_t>(1, requestsPerRead_ / 2);
+    readsPerEvent_ = std::max<uint16_t>(1, readsPerEvent_ / 2);
+  } else if (loopTime < opts_.targetLoopTime / 2 && backlog == 0) {
+    /* Recover slowly */
+    requestsPerRead_ = std::min(
+      std::max<size_t>(1, opts_.maxRequestsPerRead),
+      requestsPerRead_ + std::max<size_t>(1, requestsPerRead_ / 4));
+    readsPerEvent_ = std::min<uint16_t>(
+      std::max<uint16_t>(1, opts_.maxReadsPerEvent), readsPerEvent_ + 1);
+  }
+  lastBacklog_ = backlog;
+
+  return requestsPerRead_ != oldRequestsPerRead ||
+    readsPerEvent_ != oldReadsPerEvent;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Adapts read limits of a server worker (requests per read and reads per
+ * event, see AsyncMcServerWorkerOptions) to the event loop load.
+ *
+ * Large limits save system calls while the loop is mostly idle, but under
+ * load they let a pipelining client monopolize loop iterations. So the
+ * limits are halved when loop iterations get slower than the target or the
+ * backlog of waiting requests grows, and are slowly raised back while
+ * iterations are fast and nothing is waiting.
+ */
+class AdaptiveReadLimits {
+ public:
+  struct Options {
+    /* Upper bounds, lower bounds are always 1 */
+    size_t maxRequestsPerRead{100};
+    uint16_t maxReadsPerEvent{16};
+
+    /* Busy time of a loop iteration we try to stay under */
+    std::chrono::microseconds targetLoopTime{200};
+
+    /* Number of loop iterations between adjustments */
+    size_t interval{64};
+  };
+
+  /**
+   * Starts with the upper bounds.
+   */
+  explicit AdaptiveReadLimits(Options opts);
+
+  /**
+   * Should be called once per event loop iteration.
+   *
+   * @param loopTime  smoothed busy time of a loop iteration
+   *                  (e.g. EventBase::getAvgLoopTime())
+   * @param backlog   number of requests waiting to be processed
+   * @return true if the limits have changed
+   */
+  bool update(std::chrono::microseconds loopTime, size_t backlog);
+
+  size_t requestsPerRead() const {
+    return requestsPerRead_;
+  }
+
+  uint16_t readsPerEvent() const {
+    return readsPerEvent_;
+  }
+
+ private:
+  const Options opts_;
+  size_t requestsPerRead_;
+  uint16_t readsPerEvent_;
+  size_t iterations_{0};
+  size_t lastBacklog_{0};
+};
+
+}}  // facebook::memcache
@@ -51,10 +51,26 @@ template <class Operation, class Request>
 bool AsciiSerializedRequest::prepare(const Request& request, Operation,
                                      struct iovec*& iovOut, size_t& niovOut) {
   iovsCount_ = 0;
+  noreply_ = false;
   auto r = PrepareImplWrapper::prepare(*this, request, Operation());
   iovOut = iovs_;
   niovOut = iovsCount_;
   return r;
 }
 
+template <class Operation, class Request>
+bool AsciiSerializedRequest::prepareMeta(const Request& request, Operation,
+                                         struct iovec*& iovOut,
+                                         size_t& niovOut) {
+  iovsCount_ = 0;
+  /* Meta commands' quiet mode still replies to misses and errors,
+     noreply requests go as classic commands */
+  if (requestNoreply(request) || !prepareMetaImpl(request, Operation())) {
+    return prepare(request, Operation(), iovOut, niovOut);
+  }
+  iovOut = iovs_;
+  niovOut = iovsCount_;
+  return true;
+}
+
 }} // facebook::memcache
@@ -10,6 +10,7 @@
 #include "AsciiSerialized.h"
 
 #include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/TypedRequest.h"
 
 namespace facebook { namespace memcache {
 
@@ -25,16 +26,108 @@ void AsciiSerializedRequest::addString(folly::StringPiece str) {
   addString(folly::ByteRange(str));
 }
 
+template <class Request>
+void AsciiSerializedRequest::addValue(const Request& request) {
+  const auto& value = request.value();
+  if (value.countChainElements() + 1 > kMaxIovs - iovsCount_) {
+    addString(request.valueRangeSlow());
+    return;
+  }
+  auto cur = &value;
+  do {
+    if (cur->length() > 0) {
+      addString(folly::ByteRange(cur->data(), cur->length()));
+    }
+    cur = cur->next();
+  } while (cur != &value);
+}
+
+bool AsciiSerializedRequest::requestNoreply(const McRequest& request) {
+  return request.noreply();
+}
+
+template <class Request>
+const char* AsciiSerializedRequest::noreplySuffix(const Request& request) {
+  noreply_ = requestNoreply(request);
+  return noreply_ ? " noreply" : "";
+}
+
 template <class Request>
 void AsciiSerializedRequest::keyValueRequestCommon(folly::StringPiece prefix,
                                                    const Request& request) {
-  auto value = request.valueRangeSlow();
-  auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu %u %zd\r\n",
-                      request.flags(), request.exptime(), value.size());
+  auto valueSize = request.value().computeChainDataLength();
+  auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu %u %zd%s\r\n",
+                      request.flags(), request.exptime(), valueSize,
+                      noreplySuffix(request));
   assert(len > 0 && len < kMaxBufferLength);
   addStrings(prefix, request.fullKey(),
-             folly::StringPiece(printBuffer_, static_cast<size_t>(len)),
-             value, "\r\n");
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  addValue(request);
+  addString("\r\n");
+}
+
+template <class Request>
+void AsciiSerializedRequest::casCommon(const Request& request) {
+  auto valueSize = request.value().computeChainDataLength();
+  auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu %u %zd %lu\r\n",
+                      request.flags(), request.exptime(), valueSize,
+                      request.cas());
+  assert(len > 0 && len < kMaxBufferLength);
+  addStrings("cas ", request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  addValue(request);
+  addString("\r\n");
+}
+
+template <class Request>
+void AsciiSerializedRequest::leaseSetCommon(const Request& request) {
+  auto valueSize = request.value().computeChainDataLength();
+  auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu %lu %u %zd\r\n",
+                      request.leaseToken(), request.flags(), request.exptime(),
+                      valueSize);
+  assert(len > 0 && len < kMaxBufferLength);
+  addStrings("lease-set ", request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  addValue(request);
+  addString("\r\n");
+}
+
+template <class Request>
+void AsciiSerializedRequest::arithmeticCommon(folly::StringPiece prefix,
+                                              const Request& request) {
+  auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu%s\r\n",
+                      request.delta(), noreplySuffix(request));
+  assert(len > 0 && len < kMaxBufferLength);
+  addStrings(prefix, request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+}
+
+template <class Request>
+void AsciiSerializedRequest::deleteCommon(const Request& request) {
+  auto len = snprintf(printBuffer_, kMaxBufferLength, " %u%s\r\n",
+                      request.exptime(), noreplySuffix(request));
+  assert(len > 0 && len < kMaxBufferLength);
+  addStrings("delete ", request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+}
+
+void AsciiSerializedRequest::metaSetCommon(char mode, uint64_t cas,
+                                           const McRequest& request) {
+  auto valueSize = request.value().computeChainDataLength();
+  int len;
+  if (cas != 0) {
+    len = snprintf(printBuffer_, kMaxBufferLength,
+                   " %zd F%lu T%u M%c C%lu\r\n", valueSize, request.flags(),
+                   request.exptime(), mode, cas);
+  } else {
+    len = snprintf(printBuffer_, kMaxBufferLength, " %zd F%lu T%u M%c\r\n",
+                   valueSize, request.flags(), request.exptime(), mode);
+  }
+  assert(len > 0 && len < kMaxBufferLength);
+  addStrings("ms ", request.fullKey(),
+             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  addValue(request);
+  addString("\r\n");
 }
 
 // Get-like ops.
@@ -88,57 +181,31 @@ void AsciiSerializedRequest::prepareImpl(const McRequest& request,
 
 void AsciiSerializedRequest::prepareImpl(const McRequest& request,
                                          McOperation<mc_op_cas>) {
-  auto value = request.valueRangeSlow();
-  auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu %u %zd %lu\r\n",
-                      request.flags(), request.exptime(), value.size(),
-                      request.cas());
-  assert(len > 0 && len < kMaxBufferLength);
-  addStrings("cas ", request.fullKey(),
-             folly::StringPiece(printBuffer_, static_cast<size_t>(len)), value,
-             "\r\n");
+  casCommon(request);
 }
 
 void AsciiSerializedRequest::prepareImpl(const McRequest& request,
                                          McOperation<mc_op_lease_set>) {
-  auto value = request.valueRangeSlow();
-  auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu %lu %u %zd\r\n",
-                      request.leaseToken(), request.flags(), request.exptime(),
-                      value.size());
-  assert(len > 0 && len < kMaxBufferLength);
-  addStrings("lease-set ", request.fullKey(),
-             folly::StringPiece(printBuffer_, static_cast<size_t>(len)), value,
-             "\r\n");
+  leaseSetCommon(request);
 }
 
 // Arithmetic ops.
 
 void AsciiSerializedRequest::prepareImpl(const McRequest& request,
                                          McOperation<mc_op_incr>) {
-  auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu\r\n",
-                      request.delta());
-  assert(len > 0 && len < kMaxBufferLength);
-  addStrings("incr ", request.fullKey(),
-             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  arithmeticCommon("incr ", request);
 }
 
 void AsciiSerializedRequest::prepareImpl(const McRequest& request,
                                          McOperation<mc_op_decr>) {
-  auto len = snprintf(printBuffer_, kMaxBufferLength, " %lu\r\n",
-                      request.delta());
-  assert(len > 0 && len < kMaxBufferLength);
-  addStrings("decr ", request.fullKey(),
-             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  arithmeticCommon("decr ", request);
 }
 
 // Delete op.
 
 void AsciiSerializedRequest::prepareImpl(const McRequest& request,
                                          McOperation<mc_op_delete>) {
-  auto len = snprintf(printBuffer_, kMaxBufferLength, " %u\r\n",
-                      request.exptime());
-  assert(len > 0 && len < kMaxBufferLength);
-  addStrings("delete ", request.fullKey(),
-             folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
+  deleteCommon(request);
 }
 
 // Version op.
@@ -158,4 +225,142 @@ void AsciiSerializedRequest::prepareImpl(const McRequest& request,
              folly::StringPiece(printBuffer_, static_cast<size_t>(len)));
 }
 
+// Meta commands.
+
+bool AsciiSerializedRequest::prepareMetaImpl(const McRequest& request,
+                                             McOperation<mc_op_get>) {
+  addStrings("mg ", request.fullKey(), " v f t\r\n");
+  return true;
+}
+
+bool AsciiSerializedRequest::prepareMetaImpl(const McRequest& request,
+                                             McOperation<mc_op_gets>) {
+  addStrings("mg ", request.fullKey(), " v f t c\r\n");
+  return true;
+}
+
+bool AsciiSerializedRequest::prepareMetaImpl(const McRequest& request,
+                                             McOperation<mc_op_set>) {
+  metaSetCommon('S', 0, request);
+  return true;
+}
+
+bool AsciiSerializedRequest::prepareMetaImpl(const McRequest& request,
+                                             McOperation<mc_op_add>) {
+  metaSetCommon('E', 0, request);
+  return true;
+}
+
+bool AsciiSerializedRequest::prepareMetaImpl(const McRequest& request,
+                                             McOperation<mc_op_replace>) {
+  metaSetCommon('R', 0, request);
+  return true;
+}
+
+bool AsciiSerializedRequest::prepareMetaImpl(const McRequest& request,
+                                             McOperation<mc_op_append>) {
+  metaSetCommon('A', 0, request);
+  return true;
+}
+
+bool AsciiSerializedRequest::prepareMetaImpl(const McRequest& request,
+                                             McOperation<mc_op_prepend>) {
+  metaSetCommon('P', 0, request);
+  return true;
+}
+
+bool AsciiSerializedRequest::prepareMetaImpl(const McRequest& request,
+                                             McOperation<mc_op_cas>) {
+  if (request.cas() == 0) {
+    /* "C0" would be a plain set */
+    return false;
+  }
+  metaSetCommon('S', request.cas(), request);
+  return true;
+}
+
+bool AsciiSerializedRequest::prepareMetaImpl(const McRequest& request,
+                                             McOperation<mc_op_delete>) {
+  /* md has no delete hold time */
+  if (request.exptime() != 0) {
+    return false;
+  }
+  addStrings("md ", request.fullKey(), "\r\n");
+  return true;
+}
+
+// Typed requests.
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_get>& request, McOperation<mc_op_get>) {
+  addStrings("get ", request.fullKey(), "\r\n");
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_gets>& request, McOperation<mc_op_gets>) {
+  addStrings("gets ", request.fullKey(), "\r\n");
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_metaget>& request, McOperation<mc_op_metaget>) {
+  addStrings("metaget ", request.fullKey(), "\r\n");
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_lease_get>& request,
+    McOperation<mc_op_lease_get>) {
+  addStrings("lease-get ", request.fullKey(), "\r\n");
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_set>& request, McOperation<mc_op_set>) {
+  keyValueRequestCommon("set ", request);
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_add>& request, McOperation<mc_op_add>) {
+  keyValueRequestCommon("add ", request);
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_replace>& request, McOperation<mc_op_replace>) {
+  keyValueRequestCommon("replace ", request);
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_append>& request, McOperation<mc_op_append>) {
+  keyValueRequestCommon("append ", request);
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_prepend>& request, McOperation<mc_op_prepend>) {
+  keyValueRequestCommon("prepend ", request);
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_cas>& request, McOperation<mc_op_cas>) {
+  casCommon(request);
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_lease_set>& request,
+    McOperation<mc_op_lease_set>) {
+  leaseSetCommon(request);
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_incr>& request, McOperation<mc_op_incr>) {
+  arithmeticCommon("incr ", request);
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_decr>& request, McOperation<mc_op_decr>) {
+  arithmeticCommon("decr ", request);
+}
+
+void AsciiSerializedRequest::prepareImpl(
+    const TypedRequest<mc_op_delete>& request, McOperation<mc_op_delete>) {
+  deleteCommon(request);
+}
+
 }} // facebook::memcache
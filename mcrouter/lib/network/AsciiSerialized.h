@@ -15,6 +15,8 @@
 
 namespace facebook { namespace memcache {
 
+template <int op> class TypedRequest;
+
 /**
  * Class for serializing requests in ascii protocol.
  */
@@ -40,28 +42,79 @@ class AsciiSerializedRequest {
   template <class Operation, class Request>
   bool prepare(const Request& request, Operation,
                struct iovec*& iovOut, size_t& niovOut);
+
+  /**
+   * Same as prepare(), but with memcached meta commands (mg, ms, md)
+   * for operations that have one (see mc_ascii_meta_protocol):
+   * gets ask for flags, remaining TTL and (gets only) cas in one request.
+   * Other operations are prepared as classic commands.
+   */
+  template <class Operation, class Request>
+  bool prepareMeta(const Request& request, Operation,
+                   struct iovec*& iovOut, size_t& niovOut);
+
+  /**
+   * @return true if the prepared request was sent with "noreply", i.e. the
+   *         server won't reply to it. Only storage (other than cas and
+   *         lease-set), delete and arithmetic requests asking for it
+   *         (McRequest::noreply()) are.
+   */
+  bool noreply() const {
+    return noreply_;
+  }
  private:
   // We need at most 5 iovecs (lease-set):
   //   command + key + printBuffer + value + "\r\n"
-  static constexpr size_t kMaxIovs = 8;
-  // The longest print buffer we need is for lease-set/cas operations.
-  // It requires 2 uint64, 2 uint32 + 4 spaces + "\r\n" + '\0' = 67 chars.
-  static constexpr size_t kMaxBufferLength = 80;
+  // plus extra iovecs for chained values.
+  static constexpr size_t kMaxIovs = 16;
+  // The longest print buffer we need is for meta cas (ms with C):
+  // 3 uint64, 1 uint32 + 5 spaces, 4 flag letters and the mode +
+  // "\r\n" + '\0' = 83 chars.
+  static constexpr size_t kMaxBufferLength = 96;
 
   struct iovec iovs_[kMaxIovs];
   size_t iovsCount_{0};
+  bool noreply_{false};
   char printBuffer_[kMaxBufferLength];
 
   void addString(folly::ByteRange range);
   void addString(folly::StringPiece str);
 
+  /**
+   * Add the value of the request, writing every IOBuf of a chained value
+   * into its own iovec. Falls back to coalescing if we run out of iovecs.
+   * Reserves one iovec for the trailing "\r\n".
+   */
+  template <class Request>
+  void addValue(const Request& request);
+
   template <class Arg1, class Arg2>
   void addStrings(Arg1&& arg1, Arg2&& arg2);
   template <class Arg, class... Args>
   void addStrings(Arg&& arg, Args&&... args);
 
+  static bool requestNoreply(const McRequest& request);
+  template <class Request>
+  static bool requestNoreply(const Request& request) {
+    return false;
+  }
+
+  /* " noreply", if the request asks for it */
+  template <class Request>
+  const char* noreplySuffix(const Request& request);
+
   template <class Request>
   void keyValueRequestCommon(folly::StringPiece prefix, const Request& request);
+  template <class Request>
+  void casCommon(const Request& request);
+  template <class Request>
+  void leaseSetCommon(const Request& request);
+  template <class Request>
+  void arithmeticCommon(folly::StringPiece prefix, const Request& request);
+  template <class Request>
+  void deleteCommon(const Request& request);
+
+  void metaSetCommon(char mode, uint64_t cas, const McRequest& request);
 
   // Get-like ops.
   void prepareImpl(const McRequest& request, McOperation<mc_op_get>);
@@ -86,10 +139,57 @@ class AsciiSerializedRequest {
   // FlushAll op.
   void prepareImpl(const McRequest& request, McOperation<mc_op_flushall>);
 
+
+  // Typed requests (see TypedRequest.h), same output as for McRequest.
+  void prepareImpl(const TypedRequest<mc_op_get>& request,
+                   McOperation<mc_op_get>);
+  void prepareImpl(const TypedRequest<mc_op_gets>& request,
+                   McOperation<mc_op_gets>);
+  void prepareImpl(const TypedRequest<mc_op_metaget>& request,
+                   McOperation<mc_op_metaget>);
+  void prepareImpl(const TypedRequest<mc_op_lease_get>& request,
+                   McOperation<mc_op_lease_get>);
+  void prepareImpl(const TypedRequest<mc_op_set>& request,
+                   McOperation<mc_op_set>);
+  void prepareImpl(const TypedRequest<mc_op_add>& request,
+                   McOperation<mc_op_add>);
+  void prepareImpl(const TypedRequest<mc_op_replace>& request,
+                   McOperation<mc_op_replace>);
+  void prepareImpl(const TypedRequest<mc_op_append>& request,
+                   McOperation<mc_op_append>);
+  void prepareImpl(const TypedRequest<mc_op_prepend>& request,
+                   McOperation<mc_op_prepend>);
+  void prepareImpl(const TypedRequest<mc_op_cas>& request,
+                   McOperation<mc_op_cas>);
+  void prepareImpl(const TypedRequest<mc_op_lease_set>& request,
+                   McOperation<mc_op_lease_set>);
+  void prepareImpl(const TypedRequest<mc_op_incr>& request,
+                   McOperation<mc_op_incr>);
+  void prepareImpl(const TypedRequest<mc_op_decr>& request,
+                   McOperation<mc_op_decr>);
+  void prepareImpl(const TypedRequest<mc_op_delete>& request,
+                   McOperation<mc_op_delete>);
+
   // Everything else is false.
   template <class Request, class Operation>
   std::false_type prepareImpl(const Request& request, Operation);
 
+  // Meta commands, false if there is none for the operation.
+  bool prepareMetaImpl(const McRequest& request, McOperation<mc_op_get>);
+  bool prepareMetaImpl(const McRequest& request, McOperation<mc_op_gets>);
+  bool prepareMetaImpl(const McRequest& request, McOperation<mc_op_set>);
+  bool prepareMetaImpl(const McRequest& request, McOperation<mc_op_add>);
+  bool prepareMetaImpl(const McRequest& request, McOperation<mc_op_replace>);
+  bool prepareMetaImpl(const McRequest& request, McOperation<mc_op_append>);
+  bool prepareMetaImpl(const McRequest& request, McOperation<mc_op_prepend>);
+  bool prepareMetaImpl(const McRequest& request, McOperation<mc_op_cas>);
+  bool prepareMetaImpl(const McRequest& request, McOperation<mc_op_delete>);
+
+  template <class Request, class Operation>
+  bool prepareMetaImpl(const Request& request, Operation) {
+    return false;
+  }
+
   struct PrepareImplWrapper;
 };
 
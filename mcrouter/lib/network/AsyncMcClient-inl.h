@@ -31,13 +31,36 @@ inline void AsyncMcClient::setStatusCallbacks(
 template <class Operation, class Request>
 typename ReplyType<Operation, Request>::type
 AsyncMcClient::sendSync(const Request& request, Operation,
-                        std::chrono::milliseconds timeout) {
-  return base_->sendSync(request, Operation(), timeout);
+                        std::chrono::milliseconds timeout,
+                        const std::atomic<bool>* cancellation,
+                        RequestPriority priority) {
+  return base_->sendSync(request, Operation(), timeout, cancellation,
+                         priority);
 }
 
 template <class Operation, class Request, class F>
-void AsyncMcClient::send(const Request& request, Operation, F&& f) {
-  base_->send(request, Operation(), std::forward<F>(f));
+void AsyncMcClient::send(const Request& request, Operation, F&& f,
+                         RequestPriority priority) {
+  base_->send(request, Operation(), std::forward<F>(f), priority);
+}
+
+template <class Operation, class Request>
+AsyncMcClient::SyncRequest<Operation, Request>
+AsyncMcClient::startSync(const Request& request, Operation,
+                         std::chrono::milliseconds timeout,
+                         const std::atomic<bool>* cancellation,
+                         RequestPriority priority) {
+  SyncRequest<Operation, Request> sent;
+  sent.client = base_;
+  sent.ctx = base_->startSync(request, Operation(), timeout, cancellation,
+                              priority);
+  return sent;
+}
+
+template <class Operation, class Request>
+typename ReplyType<Operation, Request>::type
+AsyncMcClient::waitSync(SyncRequest<Operation, Request> request) {
+  return request.client->waitSync(std::move(request.ctx));
 }
 
 inline void AsyncMcClient::setThrottle(size_t maxInflight, size_t maxPending) {
@@ -56,6 +79,20 @@ inline std::pair<uint64_t, uint64_t> AsyncMcClient::getBatchingStat() const {
   return base_->getBatchingStat();
 }
 
+inline const WriteBatchHistogram&
+AsyncMcClient::getWriteBatchHistogram() const {
+  return base_->getWriteBatchHistogram();
+}
+
+inline uint64_t AsyncMcClient::getNoreplyRequestCount() const {
+  return base_->getNoreplyRequestCount();
+}
+
+inline std::chrono::microseconds
+AsyncMcClient::getLastConnectLatency() const {
+  return base_->getLastConnectLatency();
+}
+
 inline void AsyncMcClient::updateWriteTimeout(
     std::chrono::milliseconds timeout) {
   base_->updateWriteTimeout(timeout);
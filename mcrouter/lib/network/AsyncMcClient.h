@@ -12,10 +12,13 @@
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
 #include "mcrouter/lib/network/ConnectionOptions.h"
+#include "mcrouter/lib/network/WriteBatchHistogram.h"
 
 namespace facebook { namespace memcache {
 
 class AsyncMcClientImpl;
+template <class Operation, class Request>
+class McClientRequestContextSync;
 
 /**
  * A class for network communication with memcache protocol.
@@ -59,11 +62,20 @@ class AsyncMcClient {
    * Send request synchronously (i.e. blocking call).
    * Note: it must be called only from fiber context. It will block the current
    *       stack and will send request only when we loop EventBase.
+   *
+   * @param cancellation  If not null and true by the time the request is
+   *                      about to be written, the request is not sent and
+   *                      gets an mc_res_aborted reply. Must stay valid
+   *                      until the call returns.
+   * @param priority  send queue lane of the request, see
+   *                  ConnectionOptions::priorityWeights
    */
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type
   sendSync(const Request& request, Operation,
-           std::chrono::milliseconds timeout);
+           std::chrono::milliseconds timeout,
+           const std::atomic<bool>* cancellation = nullptr,
+           RequestPriority priority = foregroundPriority(Operation()));
 
   /**
    * Send request with given Op and call callback on reply.
@@ -72,11 +84,43 @@ class AsyncMcClient {
    *           failed. Guaranteed to be called exactly once.
    *           Should be callable
    *           f(typename ReplyType<Operation, Request>::type&&)
+   * @param priority  send queue lane of the request, see
+   *                  ConnectionOptions::priorityWeights
    * Note: caller is responsible for keeping request alive until the callback
    *       is called.
    */
   template <class Operation, class Request, class F>
-  void send(const Request& request, Operation, F&& f);
+  void send(const Request& request, Operation, F&& f,
+            RequestPriority priority = foregroundPriority(Operation()));
+
+  /**
+   * A request queued by startSync(), to be passed to waitSync().
+   */
+  template <class Operation, class Request>
+  struct SyncRequest {
+    /* Keeps the client alive, even once this AsyncMcClient is destroyed */
+    std::shared_ptr<AsyncMcClientImpl> client;
+    /* nullptr if the request was over the throttling limits */
+    std::unique_ptr<McClientRequestContextSync<Operation, Request>> ctx;
+  };
+
+  /**
+   * sendSync() in two steps, so that one fiber can have requests to several
+   * clients in flight at once: startSync() queues the request and returns
+   * right away, waitSync() blocks until the reply is in or the timeout
+   * (counted from startSync()) expires. Every started request must be
+   * waited for, and stay alive until then.
+   */
+  template <class Operation, class Request>
+  SyncRequest<Operation, Request>
+  startSync(const Request& request, Operation,
+            std::chrono::milliseconds timeout,
+            const std::atomic<bool>* cancellation = nullptr,
+            RequestPriority priority = foregroundPriority(Operation()));
+
+  template <class Operation, class Request>
+  static typename ReplyType<Operation, Request>::type
+  waitSync(SyncRequest<Operation, Request> request);
 
   /**
    * Set throttling options.
@@ -122,6 +166,24 @@ class AsyncMcClient {
    */
   std::pair<uint64_t, uint64_t> getBatchingStat() const;
 
+  /**
+   * Get histogram of the number of requests written with one writev call,
+   * collected over the lifetime of this client.
+   */
+  const WriteBatchHistogram& getWriteBatchHistogram() const;
+
+  /**
+   * Get the number of requests written with "noreply" (see
+   * McRequest::noreply()), completed without waiting for a reply.
+   */
+  uint64_t getNoreplyRequestCount() const;
+
+  /**
+   * Get time it took to connect (including SSL handshake) on the last
+   * successful connection attempt. Valid in onUp callback.
+   */
+  std::chrono::microseconds getLastConnectLatency() const;
+
   /**
    * Update send and connect timeout. If new value is larger than current
    * it is ignored.
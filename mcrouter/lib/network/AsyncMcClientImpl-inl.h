@@ -14,13 +14,16 @@
 #include "mcrouter/lib/McRequest.h"
 
 #include "mcrouter/lib/network/FBTrace.h"
+#include "mcrouter/lib/ProfileStage.h"
 
 namespace facebook { namespace memcache {
 
 template <class Operation, class Request>
 typename ReplyType<Operation, Request>::type
 AsyncMcClientImpl::sendSync(const Request& request, Operation,
-                            std::chrono::milliseconds timeout) {
+                            std::chrono::milliseconds timeout,
+                            const std::atomic<bool>* cancellation,
+                            RequestPriority priority) {
   auto selfPtr = selfPtr_.lock();
   // shouldn't happen.
   assert(selfPtr);
@@ -28,7 +31,8 @@ AsyncMcClientImpl::sendSync(const Request& request, Operation,
 
   using Reply = typename ReplyType<Operation, Request>::type;
 
-  if (maxPending_ != 0 && getPendingRequestCount() >= maxPending_) {
+  if ((maxPending_ != 0 && getPendingRequestCount() >= maxPending_) ||
+      outstandingBytesLimitReached()) {
     return Reply(mc_res_local_error);
   }
 
@@ -39,15 +43,83 @@ AsyncMcClientImpl::sendSync(const Request& request, Operation,
   McClientRequestContextSync<Operation, Request> ctx(
     Operation(), request, nextMsgId_,
     connectionOptions_.accessPoint.getProtocol(), selfPtr);
+  ctx.cancellation = cancellation;
+  ctx.priority = priority;
   sendCommon(ctx.createDummyPtr());
 
   // We sent request successfully, wait for the result.
   ctx.wait(timeout);
+  return syncReply(ctx);
+}
+
+template <class Operation, class Request>
+std::unique_ptr<McClientRequestContextSync<Operation, Request>>
+AsyncMcClientImpl::startSync(const Request& request, Operation,
+                             std::chrono::milliseconds timeout,
+                             const std::atomic<bool>* cancellation,
+                             RequestPriority priority) {
+  auto selfPtr = selfPtr_.lock();
+  // shouldn't happen.
+  assert(selfPtr);
+
+  if ((maxPending_ != 0 && getPendingRequestCount() >= maxPending_) ||
+      outstandingBytesLimitReached()) {
+    return nullptr;
+  }
+
+  fbTraceOnSend(Operation(), request, connectionOptions_.accessPoint);
+
+  auto ctx = folly::make_unique<McClientRequestContextSync<Operation, Request>>(
+    Operation(), request, nextMsgId_,
+    connectionOptions_.accessPoint.getProtocol(), std::move(selfPtr));
+  ctx->cancellation = cancellation;
+  ctx->priority = priority;
+  if (timeout.count() != 0) {
+    ctx->deadline = std::chrono::steady_clock::now() + timeout;
+  }
+  sendCommon(ctx->createDummyPtr());
+  return ctx;
+}
+
+template <class Operation, class Request>
+typename ReplyType<Operation, Request>::type
+AsyncMcClientImpl::waitSync(
+    std::unique_ptr<McClientRequestContextSync<Operation, Request>> ctx) {
+  assert(fiber::onFiber());
+
+  using Reply = typename ReplyType<Operation, Request>::type;
+
+  if (!ctx) {
+    // over the limits in startSync()
+    return Reply(mc_res_local_error);
+  }
+
+  if (ctx->deadline == std::chrono::steady_clock::time_point()) {
+    ctx->wait(std::chrono::milliseconds(0));
+  } else {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      ctx->deadline - std::chrono::steady_clock::now());
+    // past the deadline (e.g. spent waiting for other requests), the
+    // reply is taken if it's already in, as sendSync() would have
+    if (left.count() > 0) {
+      ctx->wait(left);
+    }
+  }
+  return syncReply(*ctx);
+}
+
+template <class Operation, class Request>
+typename ReplyType<Operation, Request>::type
+AsyncMcClientImpl::syncReply(
+    McClientRequestContextSync<Operation, Request>& ctx) {
+  using Reply = typename ReplyType<Operation, Request>::type;
+
   switch (ctx.state) {
     case ReqState::COMPLETE:
       return ctx.getReply();
     case ReqState::PENDING_QUEUE:
     {
+      ctx.cancelTimeout();
       idMap_.erase(ctx.id);
       auto it = pendingReplyQueue_.iterator_to(ctx);
       pendingReplyQueue_.extract(it);
@@ -56,8 +128,7 @@ AsyncMcClientImpl::sendSync(const Request& request, Operation,
     case ReqState::SEND_QUEUE:
     {
       idMap_.erase(ctx.id);
-      auto it = sendQueue_.iterator_to(ctx);
-      sendQueue_.extract(it);
+      sendQueue_.extract(ctx);
       return Reply(mc_res_timeout);
     }
     case ReqState::WRITE_QUEUE:
@@ -72,14 +143,16 @@ AsyncMcClientImpl::sendSync(const Request& request, Operation,
 }
 
 template <class Operation, class Request, class F>
-void AsyncMcClientImpl::send(const Request& request, Operation, F&& f) {
+void AsyncMcClientImpl::send(const Request& request, Operation, F&& f,
+                             RequestPriority priority) {
   DestructorGuard dg(this);
 
   auto selfPtr = selfPtr_.lock();
   // shouldn't happen.
   assert(selfPtr);
 
-  if (maxPending_ != 0 && getPendingRequestCount() >= maxPending_) {
+  if ((maxPending_ != 0 && getPendingRequestCount() >= maxPending_) ||
+      outstandingBytesLimitReached()) {
     f(typename ReplyType<Operation, Request>::type(mc_res_local_error));
     return;
   }
@@ -88,15 +161,21 @@ void AsyncMcClientImpl::send(const Request& request, Operation, F&& f) {
   // miss fbtrace id.
   fbTraceOnSend(Operation(), request, connectionOptions_.accessPoint);
 
-  auto ctx = McClientRequestContextBase::createAsync(
-    Operation(), request, std::forward<F>(f), nextMsgId_,
-    connectionOptions_.accessPoint.getProtocol(), selfPtr);
+  McClientRequestContextBase::UniquePtr ctx;
+  {
+    ProfileStageScope stage(ProfileStage::kSerialize);
+    ctx = McClientRequestContextBase::createAsync(
+      Operation(), request, std::forward<F>(f), nextMsgId_,
+      connectionOptions_.accessPoint.getProtocol(), selfPtr);
+  }
+  ctx->priority = priority;
   sendCommon(std::move(ctx));
 }
 
 template <class Reply>
 void AsyncMcClientImpl::reply(McClientRequestContextBase::UniquePtr req,
                               Reply&& r) {
+  req->cancelTimeout();
   idMap_.erase(req->id);
   if (!req->reply(std::move(r))) {
     req->replyError(mc_res_local_error);
@@ -112,7 +191,9 @@ void AsyncMcClientImpl::replyReady(Reply&& r, uint64_t reqId) {
   // e.g. we sent some command that server didn't understand. We need to log
   // the original request and close the connection.
   if (r.result() == mc_res_local_error &&
-      connectionOptions_.accessPoint.getProtocol() == mc_ascii_protocol) {
+      (connectionOptions_.accessPoint.getProtocol() == mc_ascii_protocol ||
+       connectionOptions_.accessPoint.getProtocol() ==
+         mc_ascii_meta_protocol)) {
     logCriticalAsciiError();
     processShutdown();
     return;
@@ -9,20 +9,45 @@
  */
 #include "AsyncMcClientImpl.h"
 
+#include <algorithm>
+#include <climits>
+#include <mutex>
+
+#include <folly/Bits.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/Memory.h>
+#include <folly/MoveWrapper.h>
 #include <folly/io/async/AsyncSSLSocket.h>
 
 #include "mcrouter/lib/fbi/cpp/LogFailure.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/HostResolver.h"
+#include "mcrouter/lib/network/IoUringTransport.h"
+#include "mcrouter/lib/network/KernelTls.h"
 #include "mcrouter/lib/network/MockMcClientTransport.h"
+#include "mcrouter/lib/network/ReadBufferPool.h"
+#include "mcrouter/lib/network/SSLHandshakePool.h"
+#include "mcrouter/lib/network/SSLSessionCache.h"
+#include "mcrouter/lib/ProfileStage.h"
 
 namespace facebook { namespace memcache {
 
 constexpr size_t kReadBufferSizeMin = 256;
 constexpr size_t kReadBufferSizeMax = 4096;
 constexpr uint16_t kBatchSizeStatWindow = 1024;
+// Max number of iovecs we pass to one writev call.
+constexpr size_t kMaxIovsPerWrite = IOV_MAX;
+// Iovecs of the write batch kept allocated while nothing is being sent.
+constexpr size_t kMaxIdleWriteIovs = 64;
+
+size_t iovsLength(const struct iovec* iovs, size_t iovsCount) {
+  size_t length = 0;
+  for (size_t i = 0; i < iovsCount; ++i) {
+    length += iovs[i].iov_len;
+  }
+  return length;
+}
 
 namespace detail {
 class OnEventBaseDestructionCallback : public folly::EventBase::LoopCallback {
@@ -56,34 +81,33 @@ class AsyncMcClientImpl::WriterLoop : public folly::EventBase::LoopCallback {
   AsyncMcClientImpl& client_;
 };
 
-/**
- * A callback class for handling timeouts.
- */
-class AsyncMcClientImpl::TimeoutCallback : public folly::AsyncTimeout {
- public:
-  TimeoutCallback(AsyncMcClientImpl& client) : client_(client) {
-    attachEventBase(&client_.eventBase_,
-                    folly::TimeoutManager::InternalEnum::NORMAL);
+McClientRequestContextBase::~McClientRequestContextBase() {
+  if (outstandingBytes != 0) {
+    client_->releaseOutstandingBytes(outstandingBytes);
   }
+}
 
-  void timeoutExpired() noexcept override {
-    client_.timeoutExpired();
-  }
- private:
-  AsyncMcClientImpl& client_;
-};
+void McClientRequestContextBase::timeoutExpired() noexcept {
+  client_->requestTimedOut(*this);
+}
 
 AsyncMcClientImpl::AsyncMcClientImpl(
     folly::EventBase& eventBase,
     ConnectionOptions options)
-    : eventBase_(eventBase),
+    : sendQueue_(options.priorityWeights),
+      eventBase_(eventBase),
       connectionOptions_(std::move(options)),
       outOfOrder_(connectionOptions_.accessPoint.getProtocol() ==
                   mc_umbrella_protocol),
-      timeoutCallback_(folly::make_unique<TimeoutCallback>(*this)),
+      timerWheel_(TimerWheel::get(eventBase)),
       writer_(folly::make_unique<WriterLoop>(*this)),
       eventBaseDestructionCallback_(
         folly::make_unique<detail::OnEventBaseDestructionCallback>(*this)) {
+  maxWriteIovs_ = kMaxIovsPerWrite;
+  if (connectionOptions_.maxWriteIovs != 0) {
+    maxWriteIovs_ = std::min(maxWriteIovs_, connectionOptions_.maxWriteIovs);
+  }
+  maxWriteBytes_ = connectionOptions_.maxWriteBytes;
   eventBase_.runOnDestruction(eventBaseDestructionCallback_.get());
 }
 
@@ -95,6 +119,11 @@ std::shared_ptr<AsyncMcClientImpl> AsyncMcClientImpl::create(
     throw std::logic_error("No network mode is not supported for umbrella "
                            "protocol yet!");
   }
+  if (options.accessPoint.getProtocol() == mc_binary_protocol &&
+      options.noNetwork) {
+    throw std::logic_error("No network mode is not supported for binary "
+                           "protocol yet!");
+  }
 
   auto client = std::shared_ptr<AsyncMcClientImpl>(
     new AsyncMcClientImpl(eventBase, std::move(options)), Destructor());
@@ -102,9 +131,39 @@ std::shared_ptr<AsyncMcClientImpl> AsyncMcClientImpl::create(
   return client;
 }
 
+/**
+ * Lets the resolver thread hand a finished resolution back to the client's
+ * event base, as long as the client is waiting for it.
+ */
+struct AsyncMcClientImpl::ResolveWaiter {
+  std::mutex mutex;
+  /* nullptr once the client stopped waiting */
+  folly::EventBase* eventBase;
+  std::weak_ptr<AsyncMcClientImpl> client;
+};
+
+/**
+ * Same for a handshake done by the SSL handshake pool.
+ */
+struct AsyncMcClientImpl::HandshakeWaiter {
+  std::mutex mutex;
+  /* nullptr once the client stopped waiting */
+  folly::EventBase* eventBase;
+  std::weak_ptr<AsyncMcClientImpl> client;
+};
+
 void AsyncMcClientImpl::closeNow() {
   DestructorGuard dg(this);
 
+  if (resolveWaiter_ || handshakeWaiter_) {
+    stopWaitingForResolution();
+    stopWaitingForHandshake();
+    isAborting_ = true;
+    connectErr(folly::AsyncSocketException(
+                 folly::AsyncSocketException::NOT_OPEN, "aborted"));
+    isAborting_ = false;
+  }
+
   if (socket_) {
     isAborting_ = true;
     // We need to destroy it immediately.
@@ -112,8 +171,6 @@ void AsyncMcClientImpl::closeNow() {
     socket_.reset();
     isAborting_ = false;
   }
-
-  timeoutCallback_->cancelTimeout();
 }
 
 void AsyncMcClientImpl::setStatusCallbacks(
@@ -134,7 +191,10 @@ void AsyncMcClientImpl::setStatusCallbacks(
 AsyncMcClientImpl::~AsyncMcClientImpl() {
   assert(sendQueue_.empty());
   assert(writeQueue_.empty());
+  assert(writeBatchSizes_.empty());
   assert(pendingReplyQueue_.empty());
+  stopWaitingForResolution();
+  stopWaitingForHandshake();
   if (socket_) {
     // Close the socket immediately. We need to process all callbacks, such as
     // readEOF and connectError, before we exit destructor.
@@ -159,15 +219,26 @@ std::pair<uint64_t, uint64_t> AsyncMcClientImpl::getBatchingStat() const {
 void AsyncMcClientImpl::setThrottle(size_t maxInflight, size_t maxPending) {
   maxInflight_ = maxInflight;
   maxPending_ = maxPending;
+  if (outOfOrder_ && maxInflight_ != 0) {
+    // Every request in send, write and pending queues has an entry.
+    idMap_.reserve(maxInflight_ + maxPending_);
+  }
 }
 
 void AsyncMcClientImpl::sendCommon(McClientRequestContextBase::UniquePtr req) {
   switch (req->reqContext.serializationResult()) {
     case McSerializedRequest::Result::OK:
-      incMsgId(nextMsgId_);
-
+      // With in order protocol, requests get their ids once they're
+      // written (see pushMessages()).
       if (outOfOrder_) {
-        idMap_[req->id] = req.get();
+        incMsgId(nextMsgId_);
+        idMap_.insert(req->id, req.get());
+      }
+      req->outstandingBytes = iovsLength(req->reqContext.getIovs(),
+                                         req->reqContext.getIovsCount());
+      outstandingBytes_ += req->outstandingBytes;
+      if (auto shared = connectionOptions_.sharedOutstandingBytes) {
+        shared->bytes += req->outstandingBytes;
       }
       assert(req->state == ReqState::NONE);
       req->state = ReqState::SEND_QUEUE;
@@ -190,6 +261,28 @@ void AsyncMcClientImpl::sendCommon(McClientRequestContextBase::UniquePtr req) {
   }
 }
 
+bool AsyncMcClientImpl::outstandingBytesLimitReached() {
+  auto shared = connectionOptions_.sharedOutstandingBytes;
+  if ((connectionOptions_.maxOutstandingBytes != 0 &&
+       outstandingBytes_ >= connectionOptions_.maxOutstandingBytes) ||
+      (shared && shared->reached())) {
+    ++bytesThrottled_;
+    if (shared) {
+      ++shared->rejected;
+    }
+    return true;
+  }
+  return false;
+}
+
+void AsyncMcClientImpl::releaseOutstandingBytes(size_t bytes) {
+  assert(outstandingBytes_ >= bytes);
+  outstandingBytes_ -= bytes;
+  if (auto shared = connectionOptions_.sharedOutstandingBytes) {
+    shared->bytes -= bytes;
+  }
+}
+
 void AsyncMcClientImpl::scheduleNextWriterLoop() {
   if (connectionState_ == ConnectionState::UP && !writeScheduled_ &&
       !sendQueue_.empty()) {
@@ -200,6 +293,7 @@ void AsyncMcClientImpl::scheduleNextWriterLoop() {
 
 void AsyncMcClientImpl::cancelWriterCallback() {
   writeScheduled_ = false;
+  corking_ = false;
   writer_->cancelLoopCallback();
 }
 
@@ -216,6 +310,14 @@ void AsyncMcClientImpl::pushMessages() {
                            maxInflight_ - getInflightRequestCount());
     }
   }
+  if (connectionOptions_.writeCorkWindow.count() > 0 &&
+      shouldCork(numToSend)) {
+    // Stay scheduled, we'll check again on the next loop iteration.
+    eventBase_.runInLoop(writer_.get());
+    return;
+  }
+  corking_ = false;
+
   // Record current batch size.
   batchStatCurrent.first += numToSend;
   ++batchStatCurrent.second;
@@ -224,41 +326,114 @@ void AsyncMcClientImpl::pushMessages() {
     batchStatCurrent = {0, 0};
   }
 
+  // All requests sent in this iteration are written with as few writev calls
+  // as possible: we only split the batch if it doesn't fit into one writev.
+  size_t batchRequests = 0;
+  size_t batchBytes = 0;
   while (!sendQueue_.empty() && numToSend > 0 &&
          /* we might be already not UP, because of failed writev */
          connectionState_ == ConnectionState::UP) {
+    auto cancellation = sendQueue_.front().cancellation;
+    if (cancellation && cancellation->load(std::memory_order_relaxed)) {
+      dropCancelledRequest();
+      continue;
+    }
+    auto& reqContext = sendQueue_.front().reqContext;
+    auto iovsCount = reqContext.getIovsCount();
+    auto bytes = iovsLength(reqContext.getIovs(), iovsCount);
+    if (batchRequests > 0 &&
+        (writeBatchIovs_.size() + iovsCount > maxWriteIovs_ ||
+         (maxWriteBytes_ != 0 && batchBytes + bytes > maxWriteBytes_))) {
+      flushWriteBatch(batchRequests, /* more */ true);
+      batchRequests = 0;
+      batchBytes = 0;
+      continue;
+    }
+
     auto& req = writeQueue_.pushBack(sendQueue_.popFront());
+    if (!outOfOrder_) {
+      // Replies are matched to ids in order, so a request that gets no reply
+      // doesn't take one: the next request shares it.
+      req.id = nextMsgId_;
+      if (!req.reqContext.noreply()) {
+        incMsgId(nextMsgId_);
+      }
+    }
     if (connectionOptions_.sendTimeout.count()) {
       req.sentAt = std::chrono::steady_clock::now();
     }
     assert(req.state == ReqState::SEND_QUEUE);
     req.state = ReqState::WRITE_QUEUE;
 
-    socket_->writev(this, req.reqContext.getIovs(),
-                    req.reqContext.getIovsCount(),
-                    numToSend == 1 ? folly::WriteFlags::NONE
-                    : folly::WriteFlags::CORK);
+    auto iovs = req.reqContext.getIovs();
+    writeBatchIovs_.insert(writeBatchIovs_.end(), iovs, iovs + iovsCount);
+    ++batchRequests;
+    batchBytes += bytes;
     --numToSend;
   }
+  if (batchRequests > 0) {
+    flushWriteBatch(batchRequests, /* more */ false);
+  }
   writeScheduled_ = false;
   scheduleNextWriterLoop();
 }
 
-void AsyncMcClientImpl::timeoutExpired() {
-  DestructorGuard dg(this);
+void AsyncMcClientImpl::dropCancelledRequest() {
+  replyError(sendQueue_.popFront(), mc_res_aborted);
+}
 
-  timeoutScheduled_ = false;
-  auto currentTime = std::chrono::steady_clock::now();
-  // process all requests that were replied/timed out.
-  while (!pendingReplyQueue_.empty()) {
-    if (currentTime - pendingReplyQueue_.front().sentAt >=
-        connectionOptions_.sendTimeout) {
-      replyError(pendingReplyQueue_.popFront(), mc_res_timeout);
-    } else {
-      scheduleNextTimeout();
-      break;
-    }
+void AsyncMcClientImpl::flushWriteBatch(size_t numRequests, bool more) {
+  // writev may call writeSuccess/writeErr inline, so account for the batch
+  // before writing it.
+  writeBatchSizes_.push_back(numRequests);
+  auto bucket = std::min<size_t>(folly::findLastSet(numRequests) - 1,
+                                 writeBatchHistogram_.size() - 1);
+  ++writeBatchHistogram_[bucket];
+  // AsyncSocket copies the iovec array if it can't write everything at once,
+  // so it's safe to reuse the buffer right away.
+  ProfileStageScope stage(ProfileStage::kWrite);
+  socket_->writev(this, writeBatchIovs_.data(), writeBatchIovs_.size(),
+                  more ? folly::WriteFlags::CORK : folly::WriteFlags::NONE);
+  writeBatchIovs_.clear();
+}
+
+bool AsyncMcClientImpl::shouldCork(size_t numToSend) {
+  if (numToSend == 0) {
+    return false;
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (!corking_) {
+    corking_ = true;
+    corkStart_ = now;
+  }
+  if (now - corkStart_ >= connectionOptions_.writeCorkWindow) {
+    return false;
   }
+
+  // Don't wait if we already have enough requests to fill a write.
+  size_t iovsCount = 0;
+  size_t bytes = 0;
+  bool full = false;
+  sendQueue_.forEach([&](McClientRequestContextBase& req) {
+    if (numToSend-- == 0) {
+      return false;
+    }
+    iovsCount += req.reqContext.getIovsCount();
+    bytes += iovsLength(req.reqContext.getIovs(),
+                        req.reqContext.getIovsCount());
+    full = iovsCount >= maxWriteIovs_ ||
+      (maxWriteBytes_ != 0 && bytes >= maxWriteBytes_);
+    return !full;
+  });
+  return !full;
+}
+
+void AsyncMcClientImpl::requestTimedOut(McClientRequestContextBase& req) {
+  DestructorGuard dg(this);
+
+  assert(req.state == ReqState::PENDING_QUEUE);
+  replyError(pendingReplyQueue_.extract(pendingReplyQueue_.iterator_to(req)),
+             mc_res_timeout);
 }
 
 namespace {
@@ -368,26 +543,39 @@ folly::AsyncSocket::OptionMap createSocketOptions(
   if (connectionOptions.enableQoS) {
     createQoSClassOption(options, address.getFamily(), connectionOptions.qos);
   }
+#ifdef SO_BUSY_POLL
+  if (connectionOptions.busyPoll.count() > 0) {
+    options[folly::AsyncSocket::OptionKey{SOL_SOCKET, SO_BUSY_POLL}] =
+      connectionOptions.busyPoll.count();
+  }
+#endif
+#ifdef TCP_FASTOPEN_CONNECT
+  if (connectionOptions.tcpFastOpen) {
+    options[folly::AsyncSocket::OptionKey{IPPROTO_TCP, TCP_FASTOPEN_CONNECT}] =
+      1;
+  }
+#endif
 
   return std::move(options);
 }
 
 } // anonymous namespace
 
-void AsyncMcClientImpl::scheduleNextTimeout() {
-  if (!timeoutScheduled_ && connectionOptions_.sendTimeout.count() > 0 &&
-      !pendingReplyQueue_.empty()) {
-    timeoutScheduled_ = true;
-    const auto& req = pendingReplyQueue_.front();
-    // Rount up, or otherwise we might get stuck processing timeouts of 0ms.
-    timeoutCallback_->scheduleTimeout(
-      round_up<std::chrono::milliseconds>(req.sentAt +
-        connectionOptions_.sendTimeout - std::chrono::steady_clock::now()));
-  }
+void AsyncMcClientImpl::scheduleRequestTimeout(
+    McClientRequestContextBase& req) {
+  // Each request has its own timer, they don't need to expire in the order
+  // of pendingReplyQueue_.
+  auto left = req.sentAt + connectionOptions_.sendTimeout -
+    std::chrono::steady_clock::now();
+  timerWheel_->scheduleTimeout(
+    req,
+    std::max(round_up<std::chrono::milliseconds>(left),
+             std::chrono::milliseconds(0)));
 }
 
 void AsyncMcClientImpl::replyError(McClientRequestContextBase::UniquePtr req,
                                    mc_res_t result) {
+  req->cancelTimeout();
   idMap_.erase(req->id);
   req->replyError(result);
 }
@@ -400,10 +588,8 @@ McClientRequestContextBase::UniquePtr AsyncMcClientImpl::getRequestContext(
   }
 
   if (outOfOrder_) {
-    auto iter = idMap_.find(id);
-    if (iter != idMap_.end()) {
-      return pendingReplyQueue_.extract(
-        pendingReplyQueue_.iterator_to(*iter->second));
+    if (auto req = idMap_.find(id)) {
+      return pendingReplyQueue_.extract(pendingReplyQueue_.iterator_to(*req));
     }
   } else {
     if (pendingReplyQueue_.front().id == id) {
@@ -418,6 +604,7 @@ void AsyncMcClientImpl::attemptConnection() {
   assert(connectionState_ == ConnectionState::DOWN);
 
   connectionState_ = ConnectionState::CONNECTING;
+  connectStart_ = std::chrono::steady_clock::now();
 
   if (connectionOptions_.noNetwork) {
     socket_.reset(new MockMcClientTransport(eventBase_));
@@ -425,6 +612,68 @@ void AsyncMcClientImpl::attemptConnection() {
     return;
   }
 
+  folly::SocketAddress address;
+  if (!HostResolver::get().lookup(connectionOptions_.accessPoint.getHost(),
+                                  connectionOptions_.accessPoint.getPort(),
+                                  address)) {
+    // Not an IP and not cached: resolve off the event loop, then connect.
+    waitForResolution();
+    return;
+  }
+  connectTo(address);
+}
+
+void AsyncMcClientImpl::waitForResolution() {
+  auto waiter = std::make_shared<ResolveWaiter>();
+  waiter->eventBase = &eventBase_;
+  waiter->client = selfPtr_;
+  resolveWaiter_ = waiter;
+
+  HostResolver::get().resolve(
+    connectionOptions_.accessPoint.getHost(),
+    [waiter]() {
+      std::lock_guard<std::mutex> lock(waiter->mutex);
+      if (waiter->eventBase == nullptr) {
+        return;
+      }
+      auto clientWeak = waiter->client;
+      waiter->eventBase->runInEventBaseThread([clientWeak, waiter]() {
+          auto client = clientWeak.lock();
+          if (client && client->resolveWaiter_ == waiter) {
+            client->hostResolved();
+          }
+        });
+    });
+}
+
+void AsyncMcClientImpl::stopWaitingForResolution() {
+  if (resolveWaiter_) {
+    std::lock_guard<std::mutex> lock(resolveWaiter_->mutex);
+    resolveWaiter_->eventBase = nullptr;
+  }
+  resolveWaiter_.reset();
+}
+
+void AsyncMcClientImpl::hostResolved() {
+  DestructorGuard dg(this);
+  stopWaitingForResolution();
+
+  folly::SocketAddress address;
+  if (!HostResolver::get().lookup(connectionOptions_.accessPoint.getHost(),
+                                  connectionOptions_.accessPoint.getPort(),
+                                  address)) {
+    failure::log("AsyncMcClient", failure::Category::kBadEnvironment,
+      "Failed to resolve {}",
+      connectionOptions_.accessPoint.toHostPortString());
+    connectErr(folly::AsyncSocketException(
+                 folly::AsyncSocketException::NOT_OPEN,
+                 "failed to resolve host"));
+    return;
+  }
+  connectTo(address);
+}
+
+void AsyncMcClientImpl::connectTo(const folly::SocketAddress& address) {
   if (connectionOptions_.sslContextProvider) {
     auto sslContext = connectionOptions_.sslContextProvider();
     if (!sslContext) {
@@ -436,19 +685,25 @@ void AsyncMcClientImpl::attemptConnection() {
                    folly::AsyncSocketException::SSL_ERROR, ""));
       return;
     }
-    socket_.reset(new folly::AsyncSSLSocket(
-      sslContext, &eventBase_));
+    if (connectionOptions_.sslHandshakePool) {
+      // plain TCP connect, the pool does the handshake (offloadHandshake())
+      pendingSslContext_ = std::move(sslContext);
+      socket_.reset(new folly::AsyncSocket(&eventBase_));
+    } else {
+      auto sslSocket = new folly::AsyncSSLSocket(sslContext, &eventBase_);
+      socket_.reset(sslSocket);
+      // resume the previous session, avoids a full handshake on reconnect
+      if (auto session = SSLSessionCache::threadLocal().get(
+            connectionOptions_.accessPoint.toString())) {
+        sslSocket->setSSLSession(session, /* takeOwnership= */ false);
+      }
+    }
   } else {
     socket_.reset(new folly::AsyncSocket(&eventBase_));
   }
 
   auto& socket = dynamic_cast<folly::AsyncSocket&>(*socket_);
 
-  auto address = folly::SocketAddress(
-    connectionOptions_.accessPoint.getHost().str(),
-    connectionOptions_.accessPoint.getPort(),
-    /* allowNameLookup */ true);
-
   auto socketOptions = createSocketOptions(address, connectionOptions_);
 
   socket.setSendTimeout(connectionOptions_.writeTimeout.count());
@@ -460,10 +715,99 @@ void AsyncMcClientImpl::attemptConnection() {
   }
 }
 
+void AsyncMcClientImpl::offloadHandshake() {
+  auto context = std::move(pendingSslContext_);
+  pendingSslContext_.reset();
+  auto fd = dynamic_cast<folly::AsyncSocket&>(*socket_).detachFd();
+  socket_.reset();
+
+  auto waiter = std::make_shared<HandshakeWaiter>();
+  waiter->eventBase = &eventBase_;
+  waiter->client = selfPtr_;
+  handshakeWaiter_ = waiter;
+
+  connectionOptions_.sslHandshakePool->connect(
+    fd, std::move(context),
+    SSLSessionCache::threadLocal().get(
+      connectionOptions_.accessPoint.toString()),
+    connectionOptions_.writeTimeout,
+    [waiter](folly::AsyncSSLSocket::UniquePtr sslSocket,
+             const folly::AsyncSocketException* error) {
+      auto errorType = error ? error->getType()
+                             : folly::AsyncSocketException::UNKNOWN;
+      std::lock_guard<std::mutex> lock(waiter->mutex);
+      if (waiter->eventBase == nullptr) {
+        return;
+      }
+      auto eventBase = waiter->eventBase;
+      auto clientWeak = waiter->client;
+      auto socketWrapper = folly::makeMoveWrapper(
+        folly::AsyncTransportWrapper::UniquePtr(std::move(sslSocket)));
+      eventBase->runInEventBaseThread(
+        [eventBase, clientWeak, waiter, socketWrapper, errorType]() {
+          auto socket = std::move(*socketWrapper);
+          if (socket) {
+            socket->attachEventBase(eventBase);
+          }
+          auto client = clientWeak.lock();
+          if (client && client->handshakeWaiter_ == waiter) {
+            client->handshakeDone(std::move(socket), errorType);
+          }
+        });
+    });
+}
+
+void AsyncMcClientImpl::stopWaitingForHandshake() {
+  if (handshakeWaiter_) {
+    std::lock_guard<std::mutex> lock(handshakeWaiter_->mutex);
+    handshakeWaiter_->eventBase = nullptr;
+  }
+  handshakeWaiter_.reset();
+}
+
+void AsyncMcClientImpl::handshakeDone(
+    folly::AsyncTransportWrapper::UniquePtr socket,
+    folly::AsyncSocketException::AsyncSocketExceptionType errorType) {
+  DestructorGuard dg(this);
+  stopWaitingForHandshake();
+
+  if (!socket) {
+    connectErr(folly::AsyncSocketException(errorType,
+                                           "SSL handshake failed"));
+    return;
+  }
+  socket->setSendTimeout(connectionOptions_.writeTimeout.count());
+  socket_ = std::move(socket);
+  connectSuccess();
+}
+
 void AsyncMcClientImpl::connectSuccess() noexcept {
   assert(connectionState_ == ConnectionState::CONNECTING);
   DestructorGuard dg(this);
+  if (pendingSslContext_) {
+    offloadHandshake();
+    return;
+  }
   connectionState_ = ConnectionState::UP;
+  lastConnectLatency_ = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - connectStart_);
+
+  if (auto sslSocket = dynamic_cast<folly::AsyncSSLSocket*>(socket_.get())) {
+    auto resumed = sslSocket->getSSLSessionReused();
+    clientSSLHandshakeStats().record(resumed, kernelTlsActive(*sslSocket));
+    if (!resumed) {
+      SSLSessionCache::threadLocal().put(
+        connectionOptions_.accessPoint.toString(),
+        sslSocket->getSSLSession());
+    }
+  } else if (connectionOptions_.useIoUring && !connectionOptions_.noNetwork) {
+    if (auto ring = IoUring::get(eventBase_)) {
+      // the connected fd is handed over, AsyncSocket is destroyed with -1
+      auto fd = dynamic_cast<folly::AsyncSocket&>(*socket_).detachFd();
+      socket_.reset(new IoUringTransport(*ring, fd));
+      socket_->setSendTimeout(connectionOptions_.writeTimeout.count());
+    }
+  }
 
   if (statusCallbacks_.onUp) {
     statusCallbacks_.onUp();
@@ -473,12 +817,14 @@ void AsyncMcClientImpl::connectSuccess() noexcept {
   assert(!sendQueue_.empty());
   // We might have successfuly reconnected after error, so we need to restart
   // our msg id counter.
-  nextInflightMsgId_ = sendQueue_.front().id;
+  nextInflightMsgId_ = nextMsgId_;
 
   scheduleNextWriterLoop();
+  auto pool = connectionOptions_.readBufferPool;
   parser_ = folly::make_unique<McParser>(
     static_cast<McParser::ClientParseCallback*>(this), 0,
-    kReadBufferSizeMin, kReadBufferSizeMax);
+    kReadBufferSizeMin, pool ? pool->bufferSize() : kReadBufferSizeMax,
+    pool);
   socket_->setReadCB(this);
 }
 
@@ -486,6 +832,7 @@ void AsyncMcClientImpl::connectErr(
     const folly::AsyncSocketException& ex) noexcept {
   assert(connectionState_ == ConnectionState::CONNECTING);
   DestructorGuard dg(this);
+  pendingSslContext_.reset();
 
   mc_res_t error;
 
@@ -504,6 +851,12 @@ void AsyncMcClientImpl::connectErr(
   assert(writeQueue_.empty());
   assert(pendingReplyQueue_.empty());
 
+  if (ex.getType() == folly::AsyncSocketException::SSL_ERROR) {
+    // don't offer a session the server may have choked on
+    SSLSessionCache::threadLocal().remove(
+      connectionOptions_.accessPoint.toString());
+  }
+
   connectionState_ = ConnectionState::DOWN;
   // We don't need it anymore, so let it perform complete cleanup.
   socket_.reset();
@@ -578,6 +931,7 @@ void AsyncMcClientImpl::getReadBuffer(void** bufReturn, size_t* lenReturn) {
 
 void AsyncMcClientImpl::readDataAvailable(size_t len) noexcept {
   DestructorGuard dg(this);
+  ProfileStageScope stage(ProfileStage::kParse);
   parser_->readDataAvailable(len);
 }
 
@@ -598,21 +952,39 @@ void AsyncMcClientImpl::readErr(
 void AsyncMcClientImpl::writeSuccess() noexcept {
   assert(connectionState_ == ConnectionState::UP);
   DestructorGuard dg(this);
-  auto req = writeQueue_.popFront();
-  if (req->state == ReqState::CANCELED) {
-    req->canceled();
-    return;
-  }
-  assert(req->state == ReqState::WRITE_QUEUE);
-  req->state = ReqState::PENDING_QUEUE;
-  pendingReplyQueue_.pushBack(std::move(req));
-  if (connectionOptions_.sendTimeout.count()) {
-    scheduleNextTimeout();
+  assert(!writeBatchSizes_.empty());
+  auto numRequests = writeBatchSizes_.front();
+  writeBatchSizes_.pop_front();
+
+  for (size_t i = 0; i < numRequests; ++i) {
+    auto req = writeQueue_.popFront();
+    if (req->state == ReqState::CANCELED) {
+      req->canceled();
+      continue;
+    }
+    assert(req->state == ReqState::WRITE_QUEUE);
+    if (req->reqContext.noreply()) {
+      // Nothing to wait for, done as soon as it's written.
+      ++noreplyRequests_;
+      replyError(std::move(req), mc_res_unknown);
+      continue;
+    }
+    req->state = ReqState::PENDING_QUEUE;
+    auto& pending = pendingReplyQueue_.pushBack(std::move(req));
+    if (connectionOptions_.sendTimeout.count()) {
+      scheduleRequestTimeout(pending);
+    }
+
+    // In case of no-network we need to provide fake reply.
+    if (connectionOptions_.noNetwork) {
+      sendFakeReply(pendingReplyQueue_.back());
+    }
   }
 
-  // In case of no-network we need to provide fake reply.
-  if (connectionOptions_.noNetwork) {
-    sendFakeReply(pendingReplyQueue_.back());
+  // Nothing left to send, don't hold on to the iovecs of a large batch.
+  if (writeQueue_.empty() && sendQueue_.empty() &&
+      writeBatchIovs_.capacity() > kMaxIdleWriteIovs) {
+    std::vector<struct iovec>().swap(writeBatchIovs_);
   }
 }
 
@@ -629,13 +1001,19 @@ void AsyncMcClientImpl::writeErr(
 
   // We're already in an error state, so all requests in pendingReplyQueue_ will
   // be replied with an error.
-  auto req = writeQueue_.popFront();
-  if (req->state == ReqState::CANCELED) {
-    req->canceled();
-  } else {
-    assert(req->state == ReqState::WRITE_QUEUE);
-    req->state = ReqState::PENDING_QUEUE;
-    pendingReplyQueue_.pushBack(std::move(req));
+  assert(!writeBatchSizes_.empty());
+  auto numRequests = writeBatchSizes_.front();
+  writeBatchSizes_.pop_front();
+
+  for (size_t i = 0; i < numRequests; ++i) {
+    auto req = writeQueue_.popFront();
+    if (req->state == ReqState::CANCELED) {
+      req->canceled();
+    } else {
+      assert(req->state == ReqState::WRITE_QUEUE);
+      req->state = ReqState::PENDING_QUEUE;
+      pendingReplyQueue_.pushBack(std::move(req));
+    }
   }
   processShutdown();
 }
@@ -9,8 +9,14 @@
  */
 #pragma once
 
+#include <sys/uio.h>
+
+#include <atomic>
 #include <chrono>
+#include <deque>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <folly/io/IOBufQueue.h>
 #include <folly/io/async/AsyncTransport.h>
@@ -20,7 +26,11 @@
 #include "mcrouter/lib/fibers/Baton.h"
 #include "mcrouter/lib/network/ConnectionOptions.h"
 #include "mcrouter/lib/network/McClientRequestContext.h"
+#include "mcrouter/lib/network/McClientSendQueue.h"
 #include "mcrouter/lib/network/McParser.h"
+#include "mcrouter/lib/network/RequestIdMap.h"
+#include "mcrouter/lib/network/TimerWheel.h"
+#include "mcrouter/lib/network/WriteBatchHistogram.h"
 
 namespace facebook { namespace memcache {
 
@@ -63,22 +73,51 @@ class AsyncMcClientImpl :
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type
   sendSync(const Request& request, Operation,
-           std::chrono::milliseconds timeout);
+           std::chrono::milliseconds timeout,
+           const std::atomic<bool>* cancellation,
+           RequestPriority priority);
 
   template <class Operation, class Request, class F>
-  void send(const Request& request, Operation, F&& f);
+  void send(const Request& request, Operation, F&& f,
+            RequestPriority priority);
+
+  /* sendSync() in two steps, see AsyncMcClient::startSync() */
+  template <class Operation, class Request>
+  std::unique_ptr<McClientRequestContextSync<Operation, Request>>
+  startSync(const Request& request, Operation,
+            std::chrono::milliseconds timeout,
+            const std::atomic<bool>* cancellation,
+            RequestPriority priority);
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type
+  waitSync(std::unique_ptr<McClientRequestContextSync<Operation, Request>>
+           ctx);
 
   void setThrottle(size_t maxInflight, size_t maxPending);
 
   size_t getPendingRequestCount() const;
   size_t getInflightRequestCount() const;
   std::pair<uint64_t, uint64_t> getBatchingStat() const;
+  const WriteBatchHistogram& getWriteBatchHistogram() const {
+    return writeBatchHistogram_;
+  }
+  uint64_t getNoreplyRequestCount() const {
+    return noreplyRequests_;
+  }
+  std::chrono::microseconds getLastConnectLatency() const {
+    return lastConnectLatency_;
+  }
+  size_t getOutstandingBytes() const {
+    return outstandingBytes_;
+  }
+  uint64_t getBytesThrottledCount() const {
+    return bytesThrottled_;
+  }
 
   void updateWriteTimeout(std::chrono::milliseconds timeout);
 
  private:
-  class TimeoutCallback;
-
   enum class ConnectionState {
     UP, // Connection is open and we can write into it.
     DOWN, // Connection is not open (or close), we need to reconnect.
@@ -97,26 +136,46 @@ class AsyncMcClientImpl :
   std::weak_ptr<AsyncMcClientImpl> selfPtr_;
 
   // Queue of requests, that are queued to be sent.
-  McClientRequestContextBase::Queue sendQueue_;
+  McClientSendQueue sendQueue_;
   // Queue of requests, that are currently being written to the socket.
   McClientRequestContextBase::Queue writeQueue_;
+  // Number of requests from writeQueue_ in each of the writes issued to the
+  // socket (requests sent in the same loop iteration share one writev).
+  std::deque<size_t> writeBatchSizes_;
+  // Iovecs of the requests in the write batch that is being assembled.
+  std::vector<struct iovec> writeBatchIovs_;
   // Queue of requests, that are already sent and are waiting for replies.
   McClientRequestContextBase::Queue pendingReplyQueue_;
 
   // Stats.
   std::pair<uint64_t, uint16_t> batchStatPrevious{0, 0};
   std::pair<uint64_t, uint16_t> batchStatCurrent{0, 0};
+  WriteBatchHistogram writeBatchHistogram_{};
+  // Requests written with noreply, which are not tracked any further.
+  uint64_t noreplyRequests_{0};
+  // Time it took to establish the connection of the last successful
+  // connect attempt (including SSL handshake), connectStart_ is the time
+  // the current attempt started.
+  std::chrono::microseconds lastConnectLatency_{0};
+  std::chrono::steady_clock::time_point connectStart_;
+
+  // Write coalescing limits, see ConnectionOptions.
+  size_t maxWriteIovs_{0};
+  size_t maxWriteBytes_{0};
+  // True if we're holding the writes of requests in sendQueue_ to batch
+  // them, corkStart_ is the time the current batch started.
+  bool corking_{false};
+  std::chrono::steady_clock::time_point corkStart_;
 
   // Id to request map. Used only in case of out-of-order protocol for fast
   // request lookup.
-  std::unordered_map<uint64_t, McClientRequestContextBase*> idMap_;
+  RequestIdMap<McClientRequestContextBase> idMap_;
 
   folly::EventBase& eventBase_;
   std::unique_ptr<McParser> parser_;
 
   // Socket related variables.
   ConnectionState connectionState_{ConnectionState::DOWN};
-  folly::IOBufQueue buffer_;
   ConnectionOptions connectionOptions_;
   folly::AsyncTransportWrapper::UniquePtr socket_;
   ConnectionStatusCallbacks statusCallbacks_;
@@ -124,6 +183,9 @@ class AsyncMcClientImpl :
   bool outOfOrder_{false};
 
   // Id for the next message that will be used by the next sendMsg() call.
+  // For in order protocol, id of the next request that will be written
+  // (requests are matched to replies in the order they're written, which
+  // isn't the order they were sent, see McClientSendQueue).
   uint64_t nextMsgId_{1};
 
   // Id of the next message pending for reply (request is already sent).
@@ -134,9 +196,18 @@ class AsyncMcClientImpl :
   size_t maxPending_{0};
   size_t maxInflight_{0};
 
-  // Timeout for sending requests.
-  bool timeoutScheduled_{false};
-  std::unique_ptr<TimeoutCallback> timeoutCallback_;
+  // Serialized bytes of requests the client holds (see
+  // ConnectionOptions::maxOutstandingBytes) and the number of requests
+  // failed because of the limits on them.
+  size_t outstandingBytes_{0};
+  uint64_t bytesThrottled_{0};
+  // Counts a rejected request if true.
+  bool outstandingBytesLimitReached();
+  // Called by request contexts on destruction.
+  void releaseOutstandingBytes(size_t bytes);
+
+  // Timeouts of sent requests, shared with everything on eventBase_.
+  std::shared_ptr<TimerWheel> timerWheel_;
 
   // Writer loop related variables.
   class WriterLoop;
@@ -154,13 +225,27 @@ class AsyncMcClientImpl :
   // Common part for send/sendSync.
   void sendCommon(McClientRequestContextBase::UniquePtr req);
 
+  // Common part for sendSync/waitSync, once the wait for the reply is over:
+  // the reply, or mc_res_timeout if ctx is still queued.
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type
+  syncReply(McClientRequestContextSync<Operation, Request>& ctx);
+
   // Write some requests from sendQueue_ to the socket, until max inflight limit
   // is reached or queue is empty.
   void pushMessages();
-  // Callback for request timeout event.
-  void timeoutExpired();
-  // Schedule timeout event for the next request in the queue.
-  void scheduleNextTimeout();
+  // Reply mc_res_aborted to the request sendQueue_ would write next,
+  // which was cancelled before being written.
+  void dropCancelledRequest();
+  // Write all requests from the current write batch with one writev.
+  void flushWriteBatch(size_t numRequests, bool more);
+  // Returns true if we should wait for more requests, before writing the first
+  // numToSend requests from sendQueue_ (see ConnectionOptions::writeCorkWindow).
+  bool shouldCork(size_t numToSend);
+  // Schedule sendTimeout for a request that was just sent.
+  void scheduleRequestTimeout(McClientRequestContextBase& req);
+  // Reply the request from pendingReplyQueue_ with a timeout.
+  void requestTimedOut(McClientRequestContextBase& req);
   // Schedule next writer loop if it's not scheduled.
   void scheduleNextWriterLoop();
   void cancelWriterCallback();
@@ -183,6 +268,27 @@ class AsyncMcClientImpl :
   void replyReady(Reply&& reply, uint64_t reqId);
 
   void attemptConnection();
+  void connectTo(const folly::SocketAddress& address);
+
+  // Host name resolution (see HostResolver), done when the destination is
+  // not an IP and its address isn't cached. Still CONNECTING meanwhile.
+  struct ResolveWaiter;
+  std::shared_ptr<ResolveWaiter> resolveWaiter_;
+  void waitForResolution();
+  void stopWaitingForResolution();
+  void hostResolved();
+
+  // SSL handshake on connectionOptions_.sslHandshakePool: the socket
+  // connects unencrypted, then its fd is handed to the pool. Still
+  // CONNECTING until the pool hands back the established socket.
+  struct HandshakeWaiter;
+  std::shared_ptr<folly::SSLContext> pendingSslContext_;
+  std::shared_ptr<HandshakeWaiter> handshakeWaiter_;
+  void offloadHandshake();
+  void stopWaitingForHandshake();
+  void handshakeDone(folly::AsyncTransportWrapper::UniquePtr socket,
+                     folly::AsyncSocketException::AsyncSocketExceptionType
+                       errorType);
 
   // TAsyncSocket::ConnectCallback overrides
   void connectSuccess() noexcept override;
@@ -210,6 +316,8 @@ class AsyncMcClientImpl :
   void sendFakeReply(McClientRequestContextBase& request);
 
   static void incMsgId(size_t& msgId);
+
+  friend class McClientRequestContextBase;
 };
 
 }} // facebook::memcache
@@ -9,10 +9,16 @@
  */
 #include "AsyncMcServer.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
+#include <sys/socket.h>
 
 #include <chrono>
 #include <condition_variable>
+#include <cstring>
+#include <future>
 #include <mutex>
 #include <thread>
 
@@ -22,6 +28,8 @@
 #include <folly/io/async/AsyncServerSocket.h>
 
 #include "mcrouter/lib/network/AsyncMcServerWorker.h"
+#include "mcrouter/lib/network/KernelTls.h"
+#include "mcrouter/lib/network/SSLHandshakePool.h"
 #include "mcrouter/lib/network/ThreadLocalSSLContextProvider.h"
 
 namespace facebook { namespace memcache {
@@ -29,6 +37,40 @@ namespace facebook { namespace memcache {
 namespace {
 /* Global pointer to the server for signal handlers */
 facebook::memcache::AsyncMcServer* gServer;
+
+/**
+ * @return CPU thread with given id should run on, -1 if unknown
+ */
+int threadCpu(const std::vector<int>& cpus, size_t threadId) {
+  if (!cpus.empty()) {
+    return cpus[threadId % cpus.size()];
+  }
+  auto numCpus = std::thread::hardware_concurrency();
+  return numCpus == 0 ? -1 : threadId % numCpus;
+}
+
+void pinCurrentThread(int cpu) {
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  CPU_SET(cpu, &cpuSet);
+  auto err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+  if (err != 0) {
+    LOG(WARNING) << "Can not pin server thread to CPU " << cpu << ": "
+                 << strerror(err);
+  }
+}
+
+void setIncomingCpu(folly::AsyncServerSocket& socket, int cpu) {
+#ifdef SO_INCOMING_CPU
+  for (auto fd : socket.getSockets()) {
+    if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) != 0) {
+      PLOG(WARNING) << "Can not set SO_INCOMING_CPU";
+    }
+  }
+#else
+  LOG_FIRST_N(WARNING, 1) << "SO_INCOMING_CPU is not supported";
+#endif
+}
 }
 
 
@@ -70,16 +112,24 @@ class McServerThread {
 
   enum AcceptorT { Acceptor };
 
+  /**
+   * @param mainThread  if true, the thread also handles shutdown signals
+   *                    and (unless reusePort is set) accepts connections
+   *                    for all threads.
+   */
   McServerThread(
     AcceptorT,
-    AsyncMcServer& server)
+    AsyncMcServer& server,
+    bool mainThread = true)
       : server_(server),
         evb_(/* enableTimeMeasurement */ false),
         worker_(server.opts_.worker, evb_),
         acceptCallback_(this, false),
         sslAcceptCallback_(this, true),
         accepting_(true),
-        shutdownPipe_(folly::make_unique<ShutdownPipe>(server, evb_)) {
+        shutdownPipe_(mainThread
+                      ? folly::make_unique<ShutdownPipe>(server, evb_)
+                      : nullptr) {
   }
 
   folly::EventBase& eventBase() {
@@ -103,6 +153,11 @@ class McServerThread {
 
     thread_ = std::thread{
       [fn, threadId, this] (){
+        cpu_ = threadCpu(server_.opts_.cpus, threadId);
+        if (server_.opts_.pinThreadsToCpus && cpu_ != -1) {
+          pinCurrentThread(cpu_);
+        }
+
         if (accepting_) {
           startAccepting();
 
@@ -140,6 +195,35 @@ class McServerThread {
     CHECK(result) << "error calling runInEventBaseThread";
   }
 
+  /* Safe to call from other threads, blocks until done */
+  void dupListeningSockets(std::vector<int>& fds, std::vector<int>& sslFds) {
+    if (!accepting_) {
+      return;
+    }
+    std::promise<void> done;
+    auto result = evb_.runInEventBaseThread(
+      [&] () {
+        dupAll(socket_.get(), fds);
+        dupAll(sslSocket_.get(), sslFds);
+        done.set_value();
+      });
+    CHECK(result) << "error calling runInEventBaseThread";
+    done.get_future().wait();
+  }
+
+  /* Safe to call from other threads */
+  void stopAccepting() {
+    if (!accepting_) {
+      return;
+    }
+    auto result = evb_.runInEventBaseThread(
+      [&] () {
+        socket_.reset();
+        sslSocket_.reset();
+      });
+    CHECK(result) << "error calling runInEventBaseThread";
+  }
+
   void shutdownFromSignalHandler() {
     if (shutdownPipe_) {
       shutdownPipe_->shutdownFromSignalHandler();
@@ -168,6 +252,9 @@ class McServerThread {
         if (sslCtx) {
           sslCtx->setVerificationOption(
             folly::SSLContext::SSLVerifyPeerEnum::VERIFY_REQ_CLIENT_CERT);
+          if (opts.kernelTls) {
+            enableKernelTls(*sslCtx);
+          }
           mcServerThread_->worker_.addSecureClientSocket(fd, std::move(sslCtx));
         } else {
           ::close(fd);
@@ -192,6 +279,7 @@ class McServerThread {
   AcceptCallback sslAcceptCallback_;
 
   bool accepting_{false};
+  int cpu_{-1};
 
   std::mutex acceptorLock_;
   std::condition_variable acceptorCv_;
@@ -203,12 +291,44 @@ class McServerThread {
   folly::AsyncServerSocket::UniquePtr sslSocket_;
   std::unique_ptr<ShutdownPipe> shutdownPipe_;
 
+  static void dupAll(folly::AsyncServerSocket* socket,
+                     std::vector<int>& fds) {
+    if (socket == nullptr) {
+      return;
+    }
+    for (auto fd : socket->getSockets()) {
+      auto copy = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+      if (copy < 0) {
+        PLOG(ERROR) << "Can not duplicate listening socket";
+        continue;
+      }
+      fds.push_back(copy);
+    }
+  }
+
   void startAccepting() {
     CHECK(accepting_);
     try {
       auto& opts = server_.opts_;
 
-      if (opts.existingSocketFd != -1) {
+      if (!opts.inheritedSocketFds.empty() ||
+          !opts.inheritedSslSocketFds.empty()) {
+        checkLogic(opts.existingSocketFd == -1,
+                   "Can't use inherited sockets with existing socket");
+        if (!opts.inheritedSocketFds.empty()) {
+          socket_.reset(new folly::AsyncServerSocket());
+          socket_->useExistingSockets(opts.inheritedSocketFds);
+        }
+        if (!opts.inheritedSslSocketFds.empty()) {
+          checkLogic(!opts.pemCertPath.empty() &&
+                     !opts.pemKeyPath.empty() &&
+                     !opts.pemCaPath.empty(),
+                     "All of pemCertPath, pemKeyPath, pemCaPath required"
+                     " with inherited SSL sockets");
+          sslSocket_.reset(new folly::AsyncServerSocket());
+          sslSocket_->useExistingSockets(opts.inheritedSslSocketFds);
+        }
+      } else if (opts.existingSocketFd != -1) {
         checkLogic(opts.ports.empty() && opts.sslPorts.empty(),
                    "Can't use ports if using existing socket");
         if (!opts.pemCertPath.empty() || !opts.pemKeyPath.empty() ||
@@ -231,6 +351,7 @@ class McServerThread {
                    "At least one port (plain or SSL) must be speicified");
         if (!server_.opts_.ports.empty()) {
           socket_.reset(new folly::AsyncServerSocket());
+          socket_->setReusePortEnabled(opts.reusePort);
           for (auto port : server_.opts_.ports) {
             socket_->bind(port);
           }
@@ -243,12 +364,21 @@ class McServerThread {
                      " with sslPorts");
 
           sslSocket_.reset(new folly::AsyncServerSocket());
+          sslSocket_->setReusePortEnabled(opts.reusePort);
           for (auto sslPort : server_.opts_.sslPorts) {
             sslSocket_->bind(sslPort);
           }
         }
       }
 
+      if (opts.reusePort && opts.pinThreadsToCpus && cpu_ != -1) {
+        for (auto socket : { socket_.get(), sslSocket_.get() }) {
+          if (socket) {
+            setIncomingCpu(*socket, cpu_);
+          }
+        }
+      }
+
       if (socket_) {
         socket_->listen(SOMAXCONN);
         socket_->startAccepting();
@@ -260,12 +390,22 @@ class McServerThread {
         sslSocket_->attachEventBase(&evb_);
       }
 
-      for (auto& t : server_.threads_) {
+      if (opts.reusePort) {
+        // accepted sockets stay in this thread, no hand off
         if (socket_ != nullptr) {
-          socket_->addAcceptCallback(&t->acceptCallback_, &t->evb_);
+          socket_->addAcceptCallback(&acceptCallback_, nullptr);
         }
         if (sslSocket_ != nullptr) {
-          sslSocket_->addAcceptCallback(&t->sslAcceptCallback_, &t->evb_);
+          sslSocket_->addAcceptCallback(&sslAcceptCallback_, nullptr);
+        }
+      } else {
+        for (auto& t : server_.threads_) {
+          if (socket_ != nullptr) {
+            socket_->addAcceptCallback(&t->acceptCallback_, &t->evb_);
+          }
+          if (sslSocket_ != nullptr) {
+            sslSocket_->addAcceptCallback(&t->sslAcceptCallback_, &t->evb_);
+          }
         }
       }
     } catch (...) {
@@ -295,19 +435,34 @@ AsyncMcServer::~AsyncMcServer() {
 void AsyncMcServer::spawn(LoopFn fn) {
   CHECK(opts_.numThreads > 0);
 
-  threads_.emplace_back(folly::make_unique<McServerThread>(
-                          McServerThread::Acceptor, *this));
-  for (size_t i = 1; i < opts_.numThreads; ++i) {
-    threads_.emplace_back(folly::make_unique<McServerThread>(*this));
+  if (opts_.sslHandshakeThreads > 0) {
+    sslHandshakePool_ =
+      folly::make_unique<SSLHandshakePool>(opts_.sslHandshakeThreads);
+    opts_.worker.sslHandshakePool = sslHandshakePool_.get();
   }
 
-  /* We need to make sure we register all acceptor callbacks before
-     running spawn() on other threads. This is so that eventBase.loop()
-     never exits immediately on non-acceptor threads. */
-  threads_[0]->spawn(fn, 0);
-  threads_[0]->waitForAcceptor();
-  for (size_t id = 1; id < threads_.size(); ++id) {
-    threads_[id]->spawn(fn, id);
+  if (opts_.reusePort) {
+    checkLogic(opts_.existingSocketFd == -1,
+               "Can't use reusePort with existing socket");
+    checkLogic(opts_.inheritedSocketFds.empty() &&
+               opts_.inheritedSslSocketFds.empty(),
+               "Can't use reusePort with inherited sockets");
+    spawnReusePort(std::move(fn));
+  } else {
+    threads_.emplace_back(folly::make_unique<McServerThread>(
+                            McServerThread::Acceptor, *this));
+    for (size_t i = 1; i < opts_.numThreads; ++i) {
+      threads_.emplace_back(folly::make_unique<McServerThread>(*this));
+    }
+
+    /* We need to make sure we register all acceptor callbacks before
+       running spawn() on other threads. This is so that eventBase.loop()
+       never exits immediately on non-acceptor threads. */
+    threads_[0]->spawn(fn, 0);
+    threads_[0]->waitForAcceptor();
+    for (size_t id = 1; id < threads_.size(); ++id) {
+      threads_[id]->spawn(fn, id);
+    }
   }
 
   /* We atomically attempt to change the state STARTUP -> SPAWNED.
@@ -325,12 +480,53 @@ void AsyncMcServer::spawn(LoopFn fn) {
              SignalShutdownState::SPAWNED));
 }
 
+void AsyncMcServer::spawnReusePort(LoopFn fn) {
+  for (size_t i = 0; i < opts_.numThreads; ++i) {
+    threads_.emplace_back(folly::make_unique<McServerThread>(
+                            McServerThread::Acceptor, *this,
+                            /* mainThread */ i == 0));
+  }
+
+  /* Every thread binds its own sockets, wait for each of them so that
+     bind errors are reported from here. */
+  for (size_t id = 0; id < threads_.size(); ++id) {
+    threads_[id]->spawn(fn, id);
+    try {
+      threads_[id]->waitForAcceptor();
+    } catch (...) {
+      for (size_t i = 0; i < id; ++i) {
+        threads_[i]->shutdown();
+        threads_[i]->join();
+      }
+      threads_.clear();
+      throw;
+    }
+  }
+}
+
+void AsyncMcServer::dupListeningSockets(std::vector<int>& fds,
+                                        std::vector<int>& sslFds) {
+  for (auto& thread : threads_) {
+    thread->dupListeningSockets(fds, sslFds);
+  }
+}
+
+void AsyncMcServer::stopAccepting() {
+  for (auto& thread : threads_) {
+    thread->stopAccepting();
+  }
+}
+
 void AsyncMcServer::shutdown() {
   std::lock_guard<std::mutex> lock(shutdownLock_);
   if (!alive_) {
     return;
   }
 
+  /* No connection is handed back to a worker after it shut down */
+  if (sslHandshakePool_) {
+    sslHandshakePool_->stop();
+  }
   for (auto& thread : threads_) {
     thread->shutdown();
   }
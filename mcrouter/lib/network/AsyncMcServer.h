@@ -57,6 +57,15 @@ class AsyncMcServer {
      */
     std::vector<uint16_t> sslPorts;
 
+    /**
+     * Listening sockets taken over from the process this one replaces
+     * (see HotRestart.h), already bound and listening. Used instead of
+     * binding ports and sslPorts, the server owns them.
+     * Can't be used with existingSocketFd or reusePort.
+     */
+    std::vector<int> inheritedSocketFds;
+    std::vector<int> inheritedSslSocketFds;
+
     /**
      * SSL cert/key/CA paths.
      * If sslPorts is non-empty, these must also be nonempty.
@@ -65,11 +74,43 @@ class AsyncMcServer {
     std::string pemKeyPath;
     std::string pemCaPath;
 
+    /**
+     * Offload record encryption of SSL connections to the kernel where
+     * supported, see KernelTls.h.
+     */
+    bool kernelTls{false};
+
+    /**
+     * If non-zero, the handshakes of SSL connections run on a pool of this
+     * many threads instead of the threads serving requests, so that bursts
+     * of new connections don't stall them (see SSLHandshakePool.h).
+     */
+    size_t sslHandshakeThreads{0};
+
     /**
      * Number of threads to spawn, must be positive.
      */
     size_t numThreads{1};
 
+    /**
+     * If true, every thread binds its own listening sockets to ports and
+     * sslPorts with SO_REUSEPORT and accepts connections itself, so that
+     * the kernel spreads incoming connections between threads instead of
+     * one thread accepting all of them.
+     * Can't be used with existingSocketFd.
+     */
+    bool reusePort{false};
+
+    /**
+     * If true, thread i is pinned to CPU cpus[i % cpus.size()], or to CPU
+     * (i % number of CPUs) if cpus is empty. With reusePort, its sockets
+     * also get SO_INCOMING_CPU set to that CPU (where supported), which
+     * hints the kernel to pick the socket of the thread that runs on the CPU
+     * handling the connection's packets.
+     */
+    bool pinThreadsToCpus{false};
+    std::vector<int> cpus;
+
     /**
      * Worker-specific options
      */
@@ -109,6 +150,21 @@ class AsyncMcServer {
    */
   void shutdown();
 
+  /**
+   * Duplicates all listening sockets of the server, e.g. to hand them over
+   * to another process. The caller owns the duplicates.
+   * Can be called from any thread after spawn(), but not from a server
+   * thread.
+   */
+  void dupListeningSockets(std::vector<int>& fds, std::vector<int>& sslFds);
+
+  /**
+   * Closes the listening sockets. Already accepted connections are still
+   * served until shutdown().
+   * Can be called from any thread after spawn().
+   */
+  void stopAccepting();
+
   /**
    * Installs a new handler for the given signals that would shutdown
    * this server when delivered.
@@ -132,6 +188,8 @@ class AsyncMcServer {
  private:
   Options opts_;
   std::vector<std::unique_ptr<McServerThread>> threads_;
+  /* Destroyed before threads_, it hands connections back to them */
+  std::unique_ptr<SSLHandshakePool> sslHandshakePool_;
 
   bool alive_{true};
   std::mutex shutdownLock_;
@@ -144,6 +202,8 @@ class AsyncMcServer {
   std::atomic<SignalShutdownState> signalShutdownState_{
     SignalShutdownState::STARTUP};
 
+  void spawnReusePort(LoopFn fn);
+
   AsyncMcServer(const AsyncMcServer&) = delete;
   AsyncMcServer& operator=(const AsyncMcServer&) = delete;
 
@@ -9,6 +9,12 @@
  */
 #include "AsyncMcServerWorker.h"
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <glog/logging.h>
+
 #include <folly/io/async/EventBase.h>
 #include <folly/Memory.h>
 #include <folly/MoveWrapper.h>
@@ -16,7 +22,11 @@
 #include <folly/io/async/AsyncSSLSocket.h>
 #include <folly/io/async/SSLContext.h>
 
+#include "mcrouter/lib/network/IoUringTransport.h"
+#include "mcrouter/lib/network/KernelTls.h"
 #include "mcrouter/lib/network/McServerSession.h"
+#include "mcrouter/lib/network/SSLHandshakePool.h"
+#include "mcrouter/lib/network/SSLSessionCache.h"
 
 namespace facebook { namespace memcache {
 namespace {
@@ -56,7 +66,10 @@ class SimpleHandshakeCallback : public AsyncSSLSocket::HandshakeCB {
     return folly::OpenSSLUtils::validatePeerCertNames(
         cert, reinterpret_cast<sockaddr*>(&addrStorage), addrLen);
   }
-  void handshakeSuc(AsyncSSLSocket *sock) noexcept override { }
+  void handshakeSuc(AsyncSSLSocket *sock) noexcept override {
+    serverSSLHandshakeStats().record(sock->getSSLSessionReused(),
+                                     kernelTlsActive(*sock));
+  }
   void handshakeErr(
       AsyncSSLSocket *sock,
       const folly::AsyncSocketException& ex)
@@ -68,13 +81,42 @@ SimpleHandshakeCallback simpleHandshakeCallback;
 AsyncMcServerWorker::AsyncMcServerWorker(AsyncMcServerWorkerOptions opts,
                                          folly::EventBase& eventBase)
     : opts_(std::move(opts)),
-      eventBase_(eventBase) {
+      eventBase_(eventBase),
+      writeFlushQueue_(eventBase) {
+  if (opts_.readBufferPoolSize > 0) {
+    readBufferPool_ = folly::make_unique<ReadBufferPool>(
+      opts_.maxBufferSize, opts_.readBufferPoolSize);
+  }
+  if (opts_.workerMaxInFlightBytes > 0) {
+    readScheduler_ = folly::make_unique<ReadScheduler>(
+      eventBase_, opts_.workerMaxInFlightBytes, opts_.readQuantumBytes);
+  }
 }
 
 void AsyncMcServerWorker::addSecureClientSocket(
     int fd,
     const std::shared_ptr<folly::SSLContext>& context,
     void* userCtxt) {
+  if (opts_.sslHandshakePool) {
+    opts_.sslHandshakePool->accept(
+      fd, context, &simpleHandshakeCallback,
+      [this, userCtxt](folly::AsyncSSLSocket::UniquePtr socket,
+                       const folly::AsyncSocketException*) {
+        if (!socket) {
+          return;
+        }
+        auto socketWrapper = folly::makeMoveWrapper(std::move(socket));
+        eventBase_.runInEventBaseThread([this, socketWrapper, userCtxt]() {
+            auto sslSocket = std::move(*socketWrapper);
+            sslSocket->attachEventBase(&eventBase_);
+            if (isAlive_) {
+              addClientSocket(std::move(sslSocket), userCtxt);
+            }
+          });
+      });
+    return;
+  }
+
   folly::AsyncSSLSocket::UniquePtr sslSocket(
       new folly::AsyncSSLSocket(
           context, &eventBase_, fd, /* server = */ true));
@@ -83,6 +125,22 @@ void AsyncMcServerWorker::addSecureClientSocket(
 }
 
 void AsyncMcServerWorker::addClientSocket(int fd, void* userCtxt) {
+  if (opts_.useIoUring) {
+    if (auto ring = IoUring::get(eventBase_)) {
+      int noDelay = 1;
+      if (::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+                       &noDelay, sizeof(noDelay)) != 0) {
+        PLOG(WARNING) << "Failed to set TCP_NODELAY";
+      }
+      setBusyPoll(fd);
+      folly::AsyncTransportWrapper::UniquePtr transport(
+          new IoUringTransport(*ring, fd));
+      transport->setSendTimeout(opts_.sendTimeout.count());
+      addSession(std::move(transport), userCtxt);
+      return;
+    }
+  }
+
   auto socket = folly::AsyncSocket::UniquePtr(
       new folly::AsyncSocket(&eventBase_, fd));
   addClientSocket(std::move(socket), userCtxt);
@@ -91,6 +149,29 @@ void AsyncMcServerWorker::addClientSocket(int fd, void* userCtxt) {
 void AsyncMcServerWorker::addClientSocket(
     folly::AsyncSocket::UniquePtr&& socket,
     void* userCtxt) {
+  socket->setSendTimeout(opts_.sendTimeout.count());
+  socket->setMaxReadsPerEvent(opts_.maxReadsPerEvent);
+  socket->setNoDelay(true);
+  setBusyPoll(socket->getFd());
+
+  addSession(std::move(socket), userCtxt);
+}
+
+void AsyncMcServerWorker::setBusyPoll(int fd) {
+#ifdef SO_BUSY_POLL
+  if (opts_.busyPoll.count() > 0) {
+    int busyPoll = opts_.busyPoll.count();
+    if (::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+                     &busyPoll, sizeof(busyPoll)) != 0) {
+      PLOG(WARNING) << "Failed to set SO_BUSY_POLL";
+    }
+  }
+#endif
+}
+
+void AsyncMcServerWorker::addSession(
+    folly::AsyncTransportWrapper::UniquePtr&& transport,
+    void* userCtxt) {
   if (!onRequest_) {
     throw std::logic_error("can't add a socket without onRequest callback");
   }
@@ -99,13 +180,9 @@ void AsyncMcServerWorker::addClientSocket(
     onAccepted_();
   }
 
-  socket->setSendTimeout(opts_.sendTimeout.count());
-  socket->setMaxReadsPerEvent(opts_.maxReadsPerEvent);
-  socket->setNoDelay(true);
-
   sessions_.push_back(
     McServerSession::create(
-      std::move(socket),
+      std::move(transport),
       onRequest_,
       onWriteQuiescence_,
       [this] (McServerSession& session) {
@@ -116,10 +193,22 @@ void AsyncMcServerWorker::addClientSocket(
       },
       onShutdown_,
       opts_,
-      userCtxt
+      userCtxt,
+      readBufferPool_.get(),
+      &writeFlushQueue_,
+      readScheduler_.get()
     ));
 }
 
+void AsyncMcServerWorker::setReadLimits(size_t requestsPerRead,
+                                        uint16_t maxReadsPerEvent) {
+  opts_.requestsPerRead = requestsPerRead;
+  opts_.maxReadsPerEvent = maxReadsPerEvent;
+  for (auto& session : sessions_) {
+    session.setReadLimits(requestsPerRead, maxReadsPerEvent);
+  }
+}
+
 void AsyncMcServerWorker::shutdown() {
   if (!isAlive_) {
     return;
@@ -18,6 +18,9 @@
 #include "mcrouter/lib/network/AsyncMcServerWorkerOptions.h"
 #include "mcrouter/lib/network/McServerRequestContext.h"
 #include "mcrouter/lib/network/McServerSession.h"
+#include "mcrouter/lib/network/ReadBufferPool.h"
+#include "mcrouter/lib/network/ReadScheduler.h"
+#include "mcrouter/lib/network/WriteFlushQueue.h"
 
 namespace folly {
 class EventBase;
@@ -48,6 +51,8 @@ class AsyncMcServerWorker {
   /**
    * Moves in ownership of an externally accepted client socket with an ssl
    * context which will be used to manage it.
+   * With opts.sslHandshakePool, the session is only added once the
+   * handshake on the pool is done.
    */
   void addSecureClientSocket(
       int fd,
@@ -137,10 +142,51 @@ class AsyncMcServerWorker {
    */
   bool writesPending() const;
 
+  /**
+   * Pool of read buffers shared by sessions of this worker,
+   * nullptr if opts.readBufferPoolSize is 0.
+   */
+  const ReadBufferPool* readBufferPool() const {
+    return readBufferPool_.get();
+  }
+
+  /**
+   * Bytes in flight over all sessions of this worker,
+   * nullptr if opts.workerMaxInFlightBytes is 0.
+   */
+  const ReadScheduler* readScheduler() const {
+    return readScheduler_.get();
+  }
+
+  /**
+   * Change requestsPerRead and maxReadsPerEvent for existing and
+   * new sessions.
+   */
+  void setReadLimits(size_t requestsPerRead, uint16_t maxReadsPerEvent);
+
+  /**
+   * Writes of replies by sessions of this worker.
+   */
+  const WriteFlushQueue::Stats& writeStats() const {
+    return writeFlushQueue_.stats();
+  }
+
+  /**
+   * Open sessions and closing sessions that still have pending writes,
+   * see McServerSession::stats(). Only valid on the worker's thread.
+   */
+  const McServerSession::Queue& sessions() const {
+    return sessions_;
+  }
+
  private:
   void addClientSocket(
       folly::AsyncSocket::UniquePtr&& socket,
       void* userCtxt);
+  void addSession(
+      folly::AsyncTransportWrapper::UniquePtr&& transport,
+      void* userCtxt);
+  void setBusyPoll(int fd);
 
   AsyncMcServerWorkerOptions opts_;
   folly::EventBase& eventBase_;
@@ -149,6 +195,9 @@ class AsyncMcServerWorker {
   std::function<void(McServerSession&)> onWriteQuiescence_;
   std::function<void(McServerSession&)> onClosed_;
   std::function<void()> onShutdown_;
+  std::unique_ptr<ReadBufferPool> readBufferPool_;
+  WriteFlushQueue writeFlushQueue_;
+  std::unique_ptr<ReadScheduler> readScheduler_;
 
   bool isAlive_{true};
 
@@ -14,6 +14,8 @@
 
 namespace facebook { namespace memcache {
 
+class SSLHandshakePool;
+
 struct AsyncMcServerWorkerOptions {
   /**
    * String that will be returned for 'VERSION' commands.
@@ -33,6 +35,21 @@ struct AsyncMcServerWorkerOptions {
    */
   size_t maxInFlight{0};
 
+  /**
+   * Maximum key and value bytes of unreplied requests of one connection
+   * before we stop reading from it. If 0, there is no limit.
+   */
+  size_t maxInFlightBytes{0};
+
+  /**
+   * If non-zero, once unreplied requests of all connections of a worker
+   * hold this many key and value bytes, connections take turns reading
+   * by deficit round robin (see ReadScheduler), granted readQuantumBytes
+   * per turn.
+   */
+  size_t workerMaxInFlightBytes{0};
+  size_t readQuantumBytes{64 * 1024};
+
   /**
    * Maximum number of read system calls per event loop iteration.
    * If 0, there is no limit.
@@ -66,6 +83,33 @@ struct AsyncMcServerWorkerOptions {
    */
   size_t maxBufferSize{4096};
 
+  /**
+   * If non-zero, read buffers of maxBufferSize bytes are shared between all
+   * sessions of a worker: a session only holds a buffer while it has unparsed
+   * data, and up to this many idle buffers are kept around for reuse.
+   *
+   * If 0, every session owns its read buffer for its whole lifetime.
+   */
+  size_t readBufferPoolSize{0};
+
+  /**
+   * If not null, handshakes of SSL connections run on this pool and the
+   * established connections are handed back to the worker.
+   * Set by AsyncMcServer (see Options::sslHandshakeThreads), must outlive
+   * the worker's event loop.
+   */
+  SSLHandshakePool* sslHandshakePool{nullptr};
+
+  /**
+   * In-order protocols (ascii): if true, the hits of a multiget are written
+   * as soon as all earlier replies of the connection are, instead of once
+   * the whole multiget is done. A slow key then no longer holds back the
+   * hits before it.
+   * The catch: if a key fails after hits were already written, the client
+   * gets those hits followed by the error instead of just the error.
+   */
+  bool streamMultiget{false};
+
   /**
    * If true, we attempt to write every reply to the socket
    * immediately.  If the write cannot be fully completed (i.e. not
@@ -73,6 +117,41 @@ struct AsyncMcServerWorkerOptions {
    * is completed.
    */
   bool singleWrite{false};
+
+  /**
+   * If true, a client closing its end of the connection cancels its
+   * requests (see McServerSession::cancellation()), like a connection
+   * error does. Clients that shut down writes but still read the replies
+   * (e.g. `printf 'get a\r\n' | nc`) then get no reply.
+   */
+  bool cancelRequestsOnEof{false};
+
+  /**
+   * If true, the routing key digests CH3 hash functions use
+   * (McRequest::routingKeyFurcDigest()) of an umbrella batch get are
+   * computed in one pass over the parsed keys, before any of them is
+   * dispatched.
+   */
+  bool prehashBatchKeys{false};
+
+  /**
+   * Max number of iovecs and bytes passed to one writev call when replies
+   * queued in one event loop iteration are written together. A reply is
+   * never split. 0 means no limit.
+   */
+  size_t maxWriteIovs{0};
+  size_t maxWriteBytes{0};
+
+  /**
+   * If true, plain (non-SSL) client connections do reads and writes through
+   * io_uring. Falls back to epoll if io_uring is not available.
+   */
+  bool useIoUring{false};
+
+  /**
+   * If non-zero, SO_BUSY_POLL is set on client sockets (where supported).
+   */
+  std::chrono::microseconds busyPoll{0};
 };
 
 }}  // facebook::memcache
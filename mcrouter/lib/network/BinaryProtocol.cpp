@@ -0,0 +1,554 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "BinaryProtocol.h"
+
+#include <cassert>
+#include <stdexcept>
+
+#include <folly/Bits.h>
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/IOBufUtil.h"
+#include "mcrouter/lib/mc/protocol.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+/* incr/decr expiration that makes a miss fail instead of creating the key */
+const uint32_t kNoAutoCreate = 0xffffffff;
+
+template <class T>
+T loadBig(const uint8_t* p) {
+  return folly::Endian::big(folly::loadUnaligned<T>(p));
+}
+
+template <class T>
+void storeBig(uint8_t* p, T val) {
+  folly::storeUnaligned<T>(p, folly::Endian::big(val));
+}
+
+mc_res_t resultFromStatus(mc_op_t op, uint16_t status) {
+  switch (status) {
+    case kBinaryNoError:
+      switch (op) {
+        case mc_op_get:
+          return mc_res_found;
+        case mc_op_delete:
+          return mc_res_deleted;
+        case mc_op_set:
+        case mc_op_add:
+        case mc_op_replace:
+        case mc_op_append:
+        case mc_op_prepend:
+        case mc_op_incr:
+        case mc_op_decr:
+          return mc_res_stored;
+        default:
+          return mc_res_ok;
+      }
+    case kBinaryKeyNotFound:
+      /* The ascii protocol reports these as NOT_STORED */
+      return (op == mc_op_replace || op == mc_op_append ||
+              op == mc_op_prepend)
+        ? mc_res_notstored
+        : mc_res_notfound;
+    case kBinaryKeyExists:
+      return op == mc_op_add ? mc_res_notstored : mc_res_exists;
+    case kBinaryItemNotStored:
+      return mc_res_notstored;
+    case kBinaryValueTooLarge:
+    case kBinaryInvalidArguments:
+    case kBinaryNonNumeric:
+      return mc_res_client_error;
+    case kBinaryUnknownCommand:
+      return mc_res_bad_command;
+    case kBinaryBusy:
+      return mc_res_busy;
+    case kBinaryTemporaryFailure:
+      return mc_res_try_again;
+    default:
+      return mc_res_remote_error;
+  }
+}
+
+uint16_t statusFromResult(mc_op_t op, mc_res_t result) {
+  switch (result) {
+    case mc_res_found:
+    case mc_res_foundstale:
+    case mc_res_deleted:
+    case mc_res_stored:
+    case mc_res_stalestored:
+    case mc_res_ok:
+      return kBinaryNoError;
+    case mc_res_notfound:
+    case mc_res_notfoundhot:
+      return kBinaryKeyNotFound;
+    case mc_res_exists:
+      return kBinaryKeyExists;
+    case mc_res_notstored:
+      /* Binary clients expect the reason for not storing */
+      if (op == mc_op_add) {
+        return kBinaryKeyExists;
+      } else if (op == mc_op_replace) {
+        return kBinaryKeyNotFound;
+      }
+      return kBinaryItemNotStored;
+    case mc_res_bad_key:
+    case mc_res_bad_flags:
+    case mc_res_bad_exptime:
+    case mc_res_bad_lease_id:
+    case mc_res_bad_cas_id:
+    case mc_res_bad_value:
+    case mc_res_client_error:
+      return kBinaryInvalidArguments;
+    case mc_res_bad_command:
+      return kBinaryUnknownCommand;
+    case mc_res_busy:
+      return kBinaryBusy;
+    default:
+      /* Timeouts, TKOs and other errors behind the proxy */
+      return kBinaryTemporaryFailure;
+  }
+}
+
+size_t requestExtrasLength(mc_op_t op) {
+  switch (op) {
+    case mc_op_set:
+    case mc_op_cas:
+    case mc_op_add:
+    case mc_op_replace:
+      return 8;
+    case mc_op_incr:
+    case mc_op_decr:
+      return 20;
+    default:
+      return 0;
+  }
+}
+
+}  // anonymous namespace
+
+BinaryParseStatus binaryParseHeader(const uint8_t* buf, size_t nbuf,
+                                    BinaryMessageInfo& info) {
+  if (nbuf == 0) {
+    return BinaryParseStatus::kNotEnoughData;
+  }
+  if (buf[0] != kBinaryRequestMagic && buf[0] != kBinaryResponseMagic) {
+    return BinaryParseStatus::kError;
+  }
+  if (nbuf < kBinaryHeaderSize) {
+    return BinaryParseStatus::kNotEnoughData;
+  }
+
+  info.magic = buf[0];
+  info.opcode = buf[1];
+  info.keyLength = loadBig<uint16_t>(buf + 2);
+  info.extrasLength = buf[4];
+  /* buf[5] is the data type, which is always raw bytes */
+  info.status = loadBig<uint16_t>(buf + 6);
+  info.bodyLength = loadBig<uint32_t>(buf + 8);
+  info.opaque = loadBig<uint32_t>(buf + 12);
+  info.cas = loadBig<uint64_t>(buf + 16);
+
+  if (size_t(info.keyLength) + info.extrasLength > info.bodyLength) {
+    return BinaryParseStatus::kError;
+  }
+  return BinaryParseStatus::kOk;
+}
+
+mc_op_t binaryOpcodeToOp(uint8_t opcode) {
+  switch (opcode) {
+    case kBinaryGet:
+    case kBinaryGetQ:
+    case kBinaryGetK:
+    case kBinaryGetKQ:
+      return mc_op_get;
+    case kBinarySet:
+    case kBinarySetQ:
+      return mc_op_set;
+    case kBinaryAdd:
+    case kBinaryAddQ:
+      return mc_op_add;
+    case kBinaryReplace:
+    case kBinaryReplaceQ:
+      return mc_op_replace;
+    case kBinaryDelete:
+    case kBinaryDeleteQ:
+      return mc_op_delete;
+    case kBinaryIncrement:
+    case kBinaryIncrementQ:
+      return mc_op_incr;
+    case kBinaryDecrement:
+    case kBinaryDecrementQ:
+      return mc_op_decr;
+    case kBinaryQuit:
+    case kBinaryQuitQ:
+      return mc_op_quit;
+    case kBinaryFlush:
+    case kBinaryFlushQ:
+      return mc_op_flushall;
+    case kBinaryNoop:
+      return mc_op_echo;
+    case kBinaryVersion:
+      return mc_op_version;
+    case kBinaryAppend:
+    case kBinaryAppendQ:
+      return mc_op_append;
+    case kBinaryPrepend:
+    case kBinaryPrependQ:
+      return mc_op_prepend;
+    default:
+      /* Stat replies are a sequence of messages, which we don't support */
+      return mc_op_unknown;
+  }
+}
+
+uint8_t binaryOpcodeFromOp(mc_op_t op) {
+  switch (op) {
+    case mc_op_get:
+    case mc_op_gets:
+      /* Binary get replies always include the cas */
+      return kBinaryGet;
+    case mc_op_set:
+    case mc_op_cas:
+      return kBinarySet;
+    case mc_op_add:
+      return kBinaryAdd;
+    case mc_op_replace:
+      return kBinaryReplace;
+    case mc_op_delete:
+      return kBinaryDelete;
+    case mc_op_incr:
+      return kBinaryIncrement;
+    case mc_op_decr:
+      return kBinaryDecrement;
+    case mc_op_quit:
+      return kBinaryQuit;
+    case mc_op_flushall:
+      return kBinaryFlush;
+    case mc_op_echo:
+      return kBinaryNoop;
+    case mc_op_version:
+      return kBinaryVersion;
+    case mc_op_append:
+      return kBinaryAppend;
+    case mc_op_prepend:
+      return kBinaryPrepend;
+    default:
+      return kBinaryUnsupported;
+  }
+}
+
+bool binaryIsQuiet(uint8_t opcode) {
+  switch (opcode) {
+    case kBinaryGetQ:
+    case kBinaryGetKQ:
+    case kBinarySetQ:
+    case kBinaryAddQ:
+    case kBinaryReplaceQ:
+    case kBinaryDeleteQ:
+    case kBinaryIncrementQ:
+    case kBinaryDecrementQ:
+    case kBinaryQuitQ:
+    case kBinaryFlushQ:
+    case kBinaryAppendQ:
+    case kBinaryPrependQ:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool binaryReplyHasKey(uint8_t opcode) {
+  return opcode == kBinaryGetK || opcode == kBinaryGetKQ;
+}
+
+bool binaryOmitQuietReply(uint8_t opcode, const McReply& reply) {
+  auto op = binaryOpcodeToOp(opcode);
+  auto status = statusFromResult(op, reply.result());
+  if (op == mc_op_get) {
+    /* Quiet gets only report hits and errors */
+    return status == kBinaryKeyNotFound;
+  }
+  return status == kBinaryNoError;
+}
+
+McRequest binaryParseRequest(const folly::IOBuf& source,
+                             const BinaryMessageInfo& info,
+                             const uint8_t* body,
+                             mc_op_t& opOut,
+                             mc_res_t& resultOut) {
+  if (info.magic != kBinaryRequestMagic) {
+    throw std::runtime_error("Not a request");
+  }
+
+  McRequest req;
+  opOut = binaryOpcodeToOp(info.opcode);
+  resultOut = mc_res_unknown;
+  if (opOut == mc_op_unknown) {
+    return req;
+  }
+
+  auto extras = body;
+  auto key = extras + info.extrasLength;
+  auto value = key + info.keyLength;
+  size_t valueLength = info.bodyLength - info.extrasLength - info.keyLength;
+
+  switch (opOut) {
+    case mc_op_set:
+    case mc_op_add:
+    case mc_op_replace:
+      if (info.extrasLength != 8) {
+        throw std::runtime_error("Invalid extras length");
+      }
+      req.setFlags(loadBig<uint32_t>(extras));
+      req.setExptime(loadBig<uint32_t>(extras + 4));
+      if (opOut == mc_op_set && info.cas != 0) {
+        opOut = mc_op_cas;
+      }
+      break;
+    case mc_op_incr:
+    case mc_op_decr:
+      if (info.extrasLength != 20) {
+        throw std::runtime_error("Invalid extras length");
+      }
+      /* Initial value and expiration are ignored: mcrouter's incr/decr
+         never create missing keys */
+      req.setDelta(loadBig<uint64_t>(extras));
+      break;
+    default:
+      /* Flush delay is ignored */
+      break;
+  }
+  req.setCas(info.cas);
+
+  if (info.keyLength != 0) {
+    if (info.keyLength > MC_KEY_MAX_LEN_ASCII) {
+      resultOut = mc_res_bad_key;
+    }
+    folly::IOBuf keyBuf;
+    if (!cloneInto(keyBuf, source, key, info.keyLength)) {
+      throw std::runtime_error("Key: invalid offset/length");
+    }
+    req.setKey(std::move(keyBuf));
+  } else if (mc_op_has_key(opOut)) {
+    resultOut = mc_res_bad_key;
+  }
+
+  if (valueLength != 0) {
+    folly::IOBuf valueBuf;
+    if (!cloneInto(valueBuf, source, value, valueLength)) {
+      throw std::runtime_error("Value: invalid offset/length");
+    }
+    req.setValue(std::move(valueBuf));
+  }
+
+  return req;
+}
+
+McReply binaryParseReply(const folly::IOBuf& source,
+                         const BinaryMessageInfo& info,
+                         const uint8_t* body,
+                         mc_op_t& opOut) {
+  if (info.magic != kBinaryResponseMagic) {
+    throw std::runtime_error("Not a reply");
+  }
+
+  opOut = binaryOpcodeToOp(info.opcode);
+  McReply reply(resultFromStatus(opOut, info.status));
+
+  auto extras = body;
+  auto value = extras + info.extrasLength + info.keyLength;
+  size_t valueLength = info.bodyLength - info.extrasLength - info.keyLength;
+  if (value + valueLength > source.data() + source.length() ||
+      body < source.data()) {
+    throw std::runtime_error("Value: invalid offset/length");
+  }
+
+  if (info.status == kBinaryNoError && opOut == mc_op_get &&
+      info.extrasLength >= 4) {
+    reply.setFlags(loadBig<uint32_t>(extras));
+  }
+  if (info.cas != 0) {
+    reply.setCas(info.cas);
+  }
+
+  if (info.status == kBinaryNoError &&
+      (opOut == mc_op_incr || opOut == mc_op_decr)) {
+    if (valueLength != 8) {
+      throw std::runtime_error("Invalid counter length");
+    }
+    reply.setDelta(loadBig<uint64_t>(value));
+  } else if (valueLength != 0 || opOut == mc_op_get) {
+    /* Error replies carry a message, an empty hit is still a value */
+    folly::IOBuf valueBuf;
+    cloneInto(valueBuf, source, value, valueLength);
+    if (reply.result() != mc_res_notfound) {
+      reply.setValue(std::move(valueBuf));
+    }
+  }
+
+  return reply;
+}
+
+BinarySerializedMessage::BinarySerializedMessage() {
+  iovs_[0].iov_base = header_;
+  iovs_[0].iov_len = kBinaryHeaderSize;
+  clear();
+}
+
+void BinarySerializedMessage::clear() {
+  niovs_ = 1;
+}
+
+void BinarySerializedMessage::writeHeader(uint8_t magic, uint8_t opcode,
+                                          size_t keyLength,
+                                          size_t extrasLength,
+                                          size_t valueLength,
+                                          uint16_t status, uint32_t opaque,
+                                          uint64_t cas) {
+  header_[0] = magic;
+  header_[1] = opcode;
+  storeBig<uint16_t>(header_ + 2, keyLength);
+  header_[4] = extrasLength;
+  header_[5] = 0;
+  storeBig<uint16_t>(header_ + 6, status);
+  storeBig<uint32_t>(header_ + 8, extrasLength + keyLength + valueLength);
+  storeBig<uint32_t>(header_ + kBinaryOpaqueOffset, opaque);
+  storeBig<uint64_t>(header_ + 16, cas);
+}
+
+void BinarySerializedMessage::append(const void* data, size_t len) {
+  assert(niovs_ < kMaxIovs);
+  if (len == 0) {
+    return;
+  }
+  iovs_[niovs_].iov_base = const_cast<void*>(data);
+  iovs_[niovs_].iov_len = len;
+  ++niovs_;
+}
+
+bool BinarySerializedMessage::appendChain(const folly::IOBuf& buf) {
+  if (buf.countChainElements() > kMaxValueChainLength) {
+    return false;
+  }
+  auto cur = &buf;
+  do {
+    append(cur->data(), cur->length());
+    cur = cur->next();
+  } while (cur != &buf);
+  return true;
+}
+
+bool BinarySerializedMessage::prepare(
+  const McReply& reply, mc_op_t op, uint8_t opcode, uint32_t opaque,
+  const folly::Optional<folly::IOBuf>& key,
+  struct iovec*& iovOut, size_t& niovOut) {
+
+  niovOut = 0;
+  clear();
+
+  auto status = statusFromResult(op, reply.result());
+  size_t extrasLength = 0;
+  size_t keyLength = 0;
+  size_t valueLength = 0;
+
+  if (status == kBinaryNoError && op == mc_op_get) {
+    storeBig<uint32_t>(extras_, reply.flags());
+    extrasLength = 4;
+    append(extras_, extrasLength);
+  }
+  if (binaryReplyHasKey(opcode) && key.hasValue()) {
+    keyLength = key->length();
+    append(key->data(), keyLength);
+  }
+
+  if (status == kBinaryNoError && (op == mc_op_incr || op == mc_op_decr)) {
+    counter_ = folly::Endian::big(reply.delta());
+    valueLength = sizeof(counter_);
+    append(&counter_, valueLength);
+  } else if (reply.hasValue() &&
+             (status == kBinaryNoError || reply.isError())) {
+    /* Misses must not have a value, errors send their message */
+    if (appendChain(reply.value())) {
+      valueLength = reply.value().computeChainDataLength();
+    } else {
+      auto valueRange = reply.valueRangeSlow();
+      append(valueRange.data(), valueRange.size());
+      valueLength = valueRange.size();
+    }
+  }
+
+  writeHeader(kBinaryResponseMagic, opcode, keyLength, extrasLength,
+              valueLength, status, opaque, reply.cas());
+  iovOut = iovs_;
+  niovOut = niovs_;
+  return true;
+}
+
+bool BinarySerializedMessage::prepareRequest(const McRequest& request,
+                                             mc_op_t op, uint64_t reqid) {
+  clear();
+
+  auto opcode = binaryOpcodeFromOp(op);
+  if (opcode == kBinaryUnsupported) {
+    return false;
+  }
+
+  size_t extrasLength = requestExtrasLength(op);
+  switch (op) {
+    case mc_op_set:
+    case mc_op_cas:
+    case mc_op_add:
+    case mc_op_replace:
+      storeBig<uint32_t>(extras_, request.flags());
+      storeBig<uint32_t>(extras_ + 4, request.exptime());
+      break;
+    case mc_op_incr:
+    case mc_op_decr:
+      storeBig<uint64_t>(extras_, request.delta());
+      storeBig<uint64_t>(extras_ + 8, 0);
+      storeBig<uint32_t>(extras_ + 16, kNoAutoCreate);
+      break;
+    default:
+      break;
+  }
+  append(extras_, extrasLength);
+
+  auto key = request.fullKey();
+  if (key.size() > MC_KEY_MAX_LEN_ASCII) {
+    return false;
+  }
+  append(key.data(), key.size());
+
+  size_t valueLength = 0;
+  if (mc_op_has_value(op) || op == mc_op_prepend) {
+    const auto& value = request.value();
+    if (appendChain(value)) {
+      valueLength = value.computeChainDataLength();
+    } else {
+      auto valueRange = request.valueRangeSlow();
+      append(valueRange.data(), valueRange.size());
+      valueLength = valueRange.size();
+    }
+  }
+
+  uint64_t cas = op == mc_op_cas ? request.cas() : 0;
+  /* Requests are matched to replies in order, the opaque is only
+     set to help debugging */
+  writeHeader(kBinaryRequestMagic, opcode, key.size(), extrasLength,
+              valueLength, 0, static_cast<uint32_t>(reqid), cas);
+  return true;
+}
+
+}} // facebook::memcache
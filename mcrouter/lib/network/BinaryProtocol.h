@@ -0,0 +1,261 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/Optional.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/McOperation.h"
+
+namespace folly {
+class IOBuf;
+}
+
+namespace facebook { namespace memcache {
+
+class McReply;
+class McRequest;
+
+/**
+ * Memcached binary protocol: every message is a fixed 24 byte header
+ * followed by extras, key and value.
+ */
+constexpr uint8_t kBinaryRequestMagic = 0x80;
+constexpr uint8_t kBinaryResponseMagic = 0x81;
+constexpr size_t kBinaryHeaderSize = 24;
+/* Big endian opaque in the header, serialized messages have the header
+   in their first iovec */
+constexpr size_t kBinaryOpaqueOffset = 12;
+
+enum BinaryOpcode : uint8_t {
+  kBinaryGet = 0x00,
+  kBinarySet = 0x01,
+  kBinaryAdd = 0x02,
+  kBinaryReplace = 0x03,
+  kBinaryDelete = 0x04,
+  kBinaryIncrement = 0x05,
+  kBinaryDecrement = 0x06,
+  kBinaryQuit = 0x07,
+  kBinaryFlush = 0x08,
+  kBinaryGetQ = 0x09,
+  kBinaryNoop = 0x0a,
+  kBinaryVersion = 0x0b,
+  kBinaryGetK = 0x0c,
+  kBinaryGetKQ = 0x0d,
+  kBinaryAppend = 0x0e,
+  kBinaryPrepend = 0x0f,
+  kBinaryStat = 0x10,
+  kBinarySetQ = 0x11,
+  kBinaryAddQ = 0x12,
+  kBinaryReplaceQ = 0x13,
+  kBinaryDeleteQ = 0x14,
+  kBinaryIncrementQ = 0x15,
+  kBinaryDecrementQ = 0x16,
+  kBinaryQuitQ = 0x17,
+  kBinaryFlushQ = 0x18,
+  kBinaryAppendQ = 0x19,
+  kBinaryPrependQ = 0x1a,
+  /* Not a valid opcode, returned for unsupported operations */
+  kBinaryUnsupported = 0xff,
+};
+
+enum BinaryStatus : uint16_t {
+  kBinaryNoError = 0x00,
+  kBinaryKeyNotFound = 0x01,
+  kBinaryKeyExists = 0x02,
+  kBinaryValueTooLarge = 0x03,
+  kBinaryInvalidArguments = 0x04,
+  kBinaryItemNotStored = 0x05,
+  kBinaryNonNumeric = 0x06,
+  kBinaryUnknownCommand = 0x81,
+  kBinaryOutOfMemory = 0x82,
+  kBinaryBusy = 0x85,
+  kBinaryTemporaryFailure = 0x86,
+};
+
+/**
+ * Binary protocol header fields, in host byte order.
+ */
+struct BinaryMessageInfo {
+  uint8_t magic{0};
+  uint8_t opcode{0};
+  uint16_t keyLength{0};
+  uint8_t extrasLength{0};
+  /* Status in replies, vbucket id (ignored) in requests */
+  uint16_t status{0};
+  uint32_t bodyLength{0};
+  uint32_t opaque{0};
+  uint64_t cas{0};
+
+  size_t messageSize() const {
+    return kBinaryHeaderSize + bodyLength;
+  }
+};
+
+enum class BinaryParseStatus {
+  kOk,
+  kNotEnoughData,
+  kError,
+};
+
+/**
+ * Parse a binary protocol header.
+ *
+ * @param buf, nbuf  Data read so far, must start at a message boundary.
+ * @paramOut info    Only valid if kOk is returned.
+ * @return           kError if the magic byte or the lengths are invalid.
+ */
+BinaryParseStatus binaryParseHeader(const uint8_t* buf, size_t nbuf,
+                                    BinaryMessageInfo& info);
+
+/**
+ * @return operation of a request opcode (quiet opcodes map to the same
+ *         operation as their normal version), mc_op_unknown if the
+ *         opcode is not supported.
+ */
+mc_op_t binaryOpcodeToOp(uint8_t opcode);
+
+/**
+ * @return opcode used to send requests of this operation,
+ *         kBinaryUnsupported if it can't be sent over the binary protocol.
+ */
+uint8_t binaryOpcodeFromOp(mc_op_t op);
+
+/**
+ * Quiet opcodes (getq, setq, ...) only get a reply if they fail
+ * (or, for gets, if they hit), so that pipelined requests can be
+ * terminated with a noop.
+ */
+bool binaryIsQuiet(uint8_t opcode);
+
+/**
+ * @return true if replies to this opcode echo the key (getk, getkq)
+ */
+bool binaryReplyHasKey(uint8_t opcode);
+
+/**
+ * @return true if a reply to a quiet request of this opcode
+ *         must not be sent.
+ */
+bool binaryOmitQuietReply(uint8_t opcode, const McReply& reply);
+
+/**
+ * Parse an on-the-wire binary protocol request.
+ *
+ * @param source      Unchained IOBuf; [body, body + info.bodyLength)
+ *                    must point inside it.
+ * @param info        Parsed header of the request.
+ * @param body        Extras, key and value of the request.
+ * @paramOut opOut    Parsed operation, mc_op_unknown if the opcode
+ *                    is not supported (the request is still consumed).
+ * @paramOut resultOut  mc_res_bad_key if the key is too long,
+ *                    mc_res_unknown otherwise.
+ * @return            Parsed request.
+ * @throws            std::runtime_error on any parse error.
+ */
+McRequest binaryParseRequest(const folly::IOBuf& source,
+                             const BinaryMessageInfo& info,
+                             const uint8_t* body,
+                             mc_op_t& opOut,
+                             mc_res_t& resultOut);
+
+/**
+ * Parse an on-the-wire binary protocol reply.
+ *
+ * Arguments are the same as for binaryParseRequest().
+ *
+ * @return            Parsed reply.
+ * @throws            std::runtime_error on any parse error.
+ */
+McReply binaryParseReply(const folly::IOBuf& source,
+                         const BinaryMessageInfo& info,
+                         const uint8_t* body,
+                         mc_op_t& opOut);
+
+class BinarySerializedMessage {
+ public:
+  BinarySerializedMessage();
+  void clear();
+
+  /**
+   * @param opcode  Opcode of the request, echoed in the reply.
+   * @param opaque  Opaque of the request, echoed in the reply.
+   * @param key     Request key, only used if the opcode echoes it.
+   */
+  bool prepare(const McReply& reply, mc_op_t op, uint8_t opcode,
+               uint32_t opaque, const folly::Optional<folly::IOBuf>& key,
+               struct iovec*& iovOut, size_t& niovOut);
+
+  /**
+   * The low 32 bits of reqid are sent as the opaque.
+   *
+   * @return  false if the operation isn't supported by the protocol
+   *          or the key is too long.
+   */
+  template<int Op>
+  bool prepare(const McRequest& request, McOperation<Op>, uint64_t reqid,
+               struct iovec*& iovOut, size_t& niovOut);
+
+ private:
+  static constexpr size_t kMaxIovs = 16;
+  /* Longest IOBuf chain we'll write without coalescing */
+  static constexpr size_t kMaxValueChainLength = kMaxIovs - 3;
+  /* incr/decr requests have the largest extras */
+  static constexpr size_t kMaxExtrasLength = 20;
+
+  struct iovec iovs_[kMaxIovs];
+  uint8_t header_[kBinaryHeaderSize];
+  uint8_t extras_[kMaxExtrasLength];
+  /* Big endian delta of incr/decr replies */
+  uint64_t counter_{0};
+  size_t niovs_{0};
+
+  bool prepareRequest(const McRequest& request, mc_op_t op, uint64_t reqid);
+
+  void writeHeader(uint8_t magic, uint8_t opcode, size_t keyLength,
+                   size_t extrasLength, size_t valueLength, uint16_t status,
+                   uint32_t opaque, uint64_t cas);
+
+  /**
+   * Append a (possibly chained) IOBuf without copying it.
+   *
+   * @return  false if the chain is too long, nothing is appended then.
+   */
+  bool appendChain(const folly::IOBuf& buf);
+
+  void append(const void* data, size_t len);
+
+  BinarySerializedMessage(const BinarySerializedMessage&) = delete;
+  BinarySerializedMessage& operator=(const BinarySerializedMessage&) = delete;
+  BinarySerializedMessage(BinarySerializedMessage&&) noexcept = delete;
+  BinarySerializedMessage& operator=(BinarySerializedMessage&&) = delete;
+};
+
+template<int Op>
+bool BinarySerializedMessage::prepare(const McRequest& request,
+                                      McOperation<Op>, uint64_t reqid,
+                                      struct iovec*& iovOut,
+                                      size_t& niovOut) {
+  niovOut = 0;
+  if (!prepareRequest(request, static_cast<mc_op_t>(Op), reqid)) {
+    return false;
+  }
+  iovOut = iovs_;
+  niovOut = niovs_;
+  return true;
+}
+
+}} // facebook::memcache
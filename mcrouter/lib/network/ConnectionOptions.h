@@ -9,11 +9,13 @@
  */
 #pragma once
 
+#include <array>
 #include <chrono>
 
 #include <folly/io/async/AsyncSocket.h>
 
 #include "mcrouter/lib/mc/protocol.h"
+#include "mcrouter/lib/RequestPriority.h"
 #include "mcrouter/lib/network/AccessPoint.h"
 
 namespace folly {
@@ -22,6 +24,26 @@ class SSLContext;
 
 namespace facebook { namespace memcache {
 
+class ReadBufferPool;
+class SSLHandshakePool;
+
+/**
+ * Key and value bytes of the outstanding requests of a group of clients
+ * (see ConnectionOptions::sharedOutstandingBytes), with a limit.
+ * Not thread-safe: the clients must share an event base.
+ */
+struct OutstandingBytesLimit {
+  /* 0 means no limit */
+  size_t limit{0};
+  size_t bytes{0};
+  /* requests failed because the limit was reached */
+  uint64_t rejected{0};
+
+  bool reached() const {
+    return limit != 0 && bytes >= limit;
+  }
+};
+
 /**
  * A struct for storing all connection related options.
  */
@@ -89,6 +111,49 @@ struct ConnectionOptions {
    */
   unsigned int qos{0};
 
+  /**
+   * Max number of iovecs and bytes we pass to one writev call. Requests queued
+   * in one event loop iteration are written together until one of the limits
+   * is hit. 0 means no limit (IOV_MAX iovecs is always enforced).
+   */
+  size_t maxWriteIovs{0};
+  size_t maxWriteBytes{0};
+
+  /**
+   * If non-zero, writes are delayed for up to this long in order to collect
+   * a bigger batch. The batch is written right away as soon as it hits one of
+   * the limits above, so in practice the delay only happens at low load.
+   * Note: while waiting, event loop is polled without blocking, so this is
+   * meant to be a few microseconds.
+   */
+  std::chrono::microseconds writeCorkWindow{0};
+
+  /**
+   * Do reads and writes of established plain (non-SSL) connections through
+   * io_uring. Falls back to epoll if io_uring is not available.
+   */
+  bool useIoUring{false};
+
+  /**
+   * If non-zero, set SO_BUSY_POLL on the socket (where supported), so that
+   * blocking receives poll the device queue for up to this long.
+   */
+  std::chrono::microseconds busyPoll{0};
+
+  /**
+   * Connect with TCP_FASTOPEN_CONNECT (where supported): the first write
+   * goes out in the SYN once the server handed out a Fast Open cookie.
+   */
+  bool tcpFastOpen{false};
+
+  /**
+   * If not null, the connection borrows its read buffer from this pool
+   * when the socket becomes readable and hands it back as soon as all read
+   * replies were parsed, so idle connections don't hold read buffer memory.
+   * Must outlive the client; not thread-safe, like the client itself.
+   */
+  ReadBufferPool* readBufferPool{nullptr};
+
   /**
    * SSLContext provider callback. If null, then unsecured connections will be
    * established, else it will be called for each attempt to establish
@@ -96,6 +161,39 @@ struct ConnectionOptions {
    */
   std::function<std::shared_ptr<folly::SSLContext>()>
     sslContextProvider;
+
+  /**
+   * If not null (and the connection is SSL), the handshake runs on this
+   * pool once the TCP connection is established, instead of on the
+   * client's event base. Must outlive the client.
+   */
+  SSLHandshakePool* sslHandshakePool{nullptr};
+
+  /**
+   * If non-zero, new requests fail right away with mc_res_local_error
+   * (like with AsyncMcClient::setThrottle()'s maxPending) while the
+   * request bytes the client holds, queued, being written or waiting for
+   * replies, are at least this many. Bounds the memory of a destination
+   * that slows down during big value traffic, which request counts alone
+   * don't.
+   */
+  size_t maxOutstandingBytes{0};
+
+  /**
+   * If not null, the client's outstanding bytes are also counted here, and
+   * new requests fail the same way while its limit is reached.
+   * Must outlive the client.
+   */
+  OutstandingBytesLimit* sharedOutstandingBytes{nullptr};
+
+  /**
+   * Weights of the send queue lanes, indexed by RequestPriority. Requests
+   * waiting to be written (e.g. over the limit of setThrottle()'s
+   * maxInflight) are written by weighted round robin among the classes
+   * (see McClientSendQueue), instead of in the order they were sent.
+   * If all are 0, the send queue is FIFO.
+   */
+  std::array<uint32_t, kNumRequestPriorities> priorityWeights{{}};
 };
 
 }} // facebook::memcache
@@ -0,0 +1,153 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HostResolver.h"
+
+#include <folly/Optional.h>
+#include <folly/ThreadName.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+folly::Optional<folly::IPAddress> resolveBlocking(const std::string& host) {
+  try {
+    folly::SocketAddress address(host, 0, /* allowNameLookup */ true);
+    return address.getIPAddress();
+  } catch (const std::exception&) {
+    return folly::none;
+  }
+}
+
+}  // anonymous namespace
+
+constexpr int HostResolver::kIdleTtls;
+
+HostResolver::HostResolver(std::chrono::milliseconds ttl)
+    : ttl_(ttl),
+      thread_([this]() { run(); }) {
+}
+
+HostResolver::~HostResolver() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+HostResolver& HostResolver::get() {
+  static HostResolver resolver(std::chrono::seconds(60));
+  return resolver;
+}
+
+bool HostResolver::lookup(folly::StringPiece host, uint16_t port,
+                          folly::SocketAddress& address) {
+  if (folly::IPAddress::validate(host)) {
+    address = folly::SocketAddress(folly::IPAddress(host), port);
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = cache_.find(host.str());
+  if (it == cache_.end()) {
+    return false;
+  }
+  it->second.lastUsed = std::chrono::steady_clock::now();
+  address = folly::SocketAddress(it->second.address, port);
+  return true;
+}
+
+void HostResolver::resolve(folly::StringPiece host,
+                           std::function<void()> onDone) {
+  auto hostStr = host.str();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!folly::IPAddress::validate(host) && !cache_.count(hostStr)) {
+      auto& waiters = waiters_[hostStr];
+      waiters.push_back(std::move(onDone));
+      if (waiters.size() == 1) {
+        enqueue(hostStr);
+      }
+      return;
+    }
+  }
+  onDone();
+}
+
+void HostResolver::enqueue(const std::string& host) {
+  queue_.push_back(host);
+  cv_.notify_one();
+}
+
+void HostResolver::run() {
+  folly::setThreadName("mcrtr-resolver");
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto nextRefresh = std::chrono::steady_clock::now() + ttl_;
+  while (!stop_) {
+    if (queue_.empty()) {
+      cv_.wait_until(lock, nextRefresh);
+      auto now = std::chrono::steady_clock::now();
+      if (now >= nextRefresh) {
+        refreshExpired(now);
+        nextRefresh = now + ttl_ / 2;
+      }
+      continue;
+    }
+
+    auto host = std::move(queue_.front());
+    queue_.pop_front();
+
+    lock.unlock();
+    auto address = resolveBlocking(host);
+    lock.lock();
+
+    auto now = std::chrono::steady_clock::now();
+    if (address) {
+      auto& entry = cache_[host];
+      if (entry.lastUsed == std::chrono::steady_clock::time_point()) {
+        entry.lastUsed = now;
+      }
+      entry.address = *address;
+      entry.resolvedAt = now;
+    }
+
+    std::vector<std::function<void()>> waiters;
+    auto it = waiters_.find(host);
+    if (it != waiters_.end()) {
+      waiters = std::move(it->second);
+      waiters_.erase(it);
+    }
+
+    lock.unlock();
+    for (auto& onDone : waiters) {
+      onDone();
+    }
+    lock.lock();
+  }
+}
+
+void HostResolver::refreshExpired(std::chrono::steady_clock::time_point now) {
+  for (auto it = cache_.begin(); it != cache_.end(); ) {
+    if (now - it->second.lastUsed > ttl_ * kIdleTtls) {
+      it = cache_.erase(it);
+      continue;
+    }
+    if (now - it->second.resolvedAt >= ttl_ && !waiters_.count(it->first)) {
+      /* Marks it as queued, without waiters */
+      waiters_[it->first];
+      enqueue(it->first);
+    }
+    ++it;
+  }
+}
+
+}}  // facebook::memcache
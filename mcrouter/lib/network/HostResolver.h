@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/IPAddress.h>
+#include <folly/Range.h>
+#include <folly/SocketAddress.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Process wide cache of host name resolutions, filled by a background
+ * thread, so that event loops never block on getaddrinfo().
+ *
+ * Cached entries are refreshed in the background once older than the TTL
+ * and keep being served meanwhile (and if refreshing fails). Entries not
+ * looked up for kIdleTtls TTLs are dropped.
+ */
+class HostResolver {
+ public:
+  static constexpr int kIdleTtls = 3;
+
+  explicit HostResolver(std::chrono::milliseconds ttl);
+  ~HostResolver();
+
+  /**
+   * @return resolver of the process, with a 60s TTL
+   */
+  static HostResolver& get();
+
+  /**
+   * Never blocks.
+   *
+   * @return true and sets address if host is an IP address or its
+   *         resolution is cached, false otherwise (see resolve())
+   */
+  bool lookup(folly::StringPiece host, uint16_t port,
+              folly::SocketAddress& address);
+
+  /**
+   * Resolves host in the background unless it's already cached.
+   *
+   * @param onDone  called once done, successfully or not (lookup() tells),
+   *                on the resolver thread, or inline if host is cached
+   */
+  void resolve(folly::StringPiece host, std::function<void()> onDone);
+
+ private:
+  struct Entry {
+    folly::IPAddress address;
+    std::chrono::steady_clock::time_point resolvedAt;
+    std::chrono::steady_clock::time_point lastUsed;
+  };
+
+  const std::chrono::milliseconds ttl_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::unordered_map<std::string, Entry> cache_;
+  /* Callbacks of the hosts queued for resolution (or refresh) */
+  std::unordered_map<std::string, std::vector<std::function<void()>>>
+    waiters_;
+  std::deque<std::string> queue_;
+  bool stop_{false};
+
+  std::thread thread_;
+
+  void run();
+
+  /* Queues expired entries for refresh and drops idle ones. */
+  void refreshExpired(std::chrono::steady_clock::time_point now);
+
+  void enqueue(const std::string& host);
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,388 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "HotRestart.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <folly/ThreadName.h>
+
+#include <glog/logging.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x4d435248;  // "MCRH"
+/* Sockets sent in one message, below SCM_MAX_FD */
+constexpr size_t kMaxFds = 250;
+constexpr char kReady = 'R';
+
+struct Header {
+  uint32_t magic;
+  uint32_t numFds;
+  uint32_t numSslFds;
+  uint32_t stateSize;
+};
+
+void closeAll(std::vector<int>& fds) {
+  for (auto fd : fds) {
+    ::close(fd);
+  }
+  fds.clear();
+}
+
+bool makeAddress(const std::string& path, sockaddr_un& addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    LOG(ERROR) << "Hot restart socket path too long: " << path;
+    return false;
+  }
+  memcpy(addr.sun_path, path.data(), path.size());
+  return true;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    auto n = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool readAll(int fd, char* data, size_t size) {
+  while (size > 0) {
+    auto n = ::recv(fd, data, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+/**
+ * Sends the header with all of the sockets attached, then the state.
+ */
+bool sendHandoff(int fd, const HotRestartHandoff& handoff) {
+  std::vector<int> fds(handoff.fds);
+  fds.insert(fds.end(), handoff.sslFds.begin(), handoff.sslFds.end());
+  if (fds.size() > kMaxFds) {
+    LOG(ERROR) << "Hot restart: too many listening sockets " << fds.size();
+    return false;
+  }
+
+  Header header;
+  header.magic = kMagic;
+  header.numFds = handoff.fds.size();
+  header.numSslFds = handoff.sslFds.size();
+  header.stateSize = handoff.state.size();
+
+  iovec iov;
+  iov.iov_base = &header;
+  iov.iov_len = sizeof(header);
+
+  char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (!fds.empty()) {
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+  }
+
+  ssize_t n;
+  do {
+    n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n != sizeof(header)) {
+    PLOG(ERROR) << "Hot restart: can not send listening sockets";
+    return false;
+  }
+  return writeAll(fd, handoff.state.data(), handoff.state.size());
+}
+
+bool receiveHandoff(int fd, HotRestartHandoff& handoff) {
+  Header header;
+  iovec iov;
+  iov.iov_base = &header;
+  iov.iov_len = sizeof(header);
+
+  char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n;
+  do {
+    n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+  } while (n < 0 && errno == EINTR);
+
+  std::vector<int> fds;
+  for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      auto data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+      fds.insert(fds.end(), data, data + count);
+    }
+  }
+
+  if (n != sizeof(header) || header.magic != kMagic ||
+      (msg.msg_flags & MSG_CTRUNC) ||
+      fds.size() != header.numFds + header.numSslFds) {
+    LOG(ERROR) << "Hot restart: bad handoff from the previous process";
+    closeAll(fds);
+    return false;
+  }
+
+  handoff.fds.assign(fds.begin(), fds.begin() + header.numFds);
+  handoff.sslFds.assign(fds.begin() + header.numFds, fds.end());
+  handoff.state.resize(header.stateSize);
+  if (!readAll(fd, &handoff.state[0], header.stateSize)) {
+    LOG(ERROR) << "Hot restart: can not read state of the previous process";
+    return false;
+  }
+  return true;
+}
+
+}  // anonymous namespace
+
+HotRestartHandoff::HotRestartHandoff(HotRestartHandoff&& other) noexcept
+    : fds(std::move(other.fds)),
+      sslFds(std::move(other.sslFds)),
+      state(std::move(other.state)) {
+  other.release();
+}
+
+HotRestartHandoff& HotRestartHandoff::operator=(
+    HotRestartHandoff&& other) noexcept {
+  if (this != &other) {
+    closeAll(fds);
+    closeAll(sslFds);
+    fds = std::move(other.fds);
+    sslFds = std::move(other.sslFds);
+    state = std::move(other.state);
+    other.release();
+  }
+  return *this;
+}
+
+HotRestartHandoff::~HotRestartHandoff() {
+  closeAll(fds);
+  closeAll(sslFds);
+}
+
+void HotRestartHandoff::release() {
+  fds.clear();
+  sslFds.clear();
+}
+
+HotRestartStats& hotRestartStats() {
+  static HotRestartStats stats;
+  return stats;
+}
+
+HotRestartListener::HotRestartListener(std::string path,
+                                       Provider provider,
+                                       OnHandoff onHandoff)
+    : path_(std::move(path)),
+      provider_(std::move(provider)),
+      onHandoff_(std::move(onHandoff)) {
+
+  sockaddr_un addr;
+  if (!makeAddress(path_, addr)) {
+    throw std::system_error(ENAMETOOLONG, std::system_category(),
+                            "hot restart socket path");
+  }
+  listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd_ < 0) {
+    throw std::system_error(errno, std::system_category(),
+                            "hot restart socket");
+  }
+  /* a new process unlinks the socket of the one it replaces */
+  ::unlink(path_.c_str());
+  if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr),
+             sizeof(addr)) != 0 ||
+      ::listen(listenFd_, 1) != 0) {
+    auto err = errno;
+    ::close(listenFd_);
+    throw std::system_error(err, std::system_category(),
+                            "hot restart socket " + path_);
+  }
+  stopFd_ = eventfd(0, EFD_CLOEXEC);
+  if (stopFd_ < 0) {
+    auto err = errno;
+    ::close(listenFd_);
+    throw std::system_error(err, std::system_category(),
+                            "hot restart eventfd");
+  }
+
+  thread_ = std::thread([this]() { run(); });
+}
+
+HotRestartListener::~HotRestartListener() {
+  uint64_t one = 1;
+  if (::write(stopFd_, &one, sizeof(one)) != sizeof(one)) {
+    PLOG(ERROR) << "Hot restart: can not stop the listener thread";
+  }
+  thread_.join();
+  ::close(stopFd_);
+  if (listenFd_ >= 0) {
+    ::close(listenFd_);
+  }
+  /* the path belongs to the new process now */
+  if (!handedOff_) {
+    ::unlink(path_.c_str());
+  }
+}
+
+bool HotRestartListener::waitReadable(int fd) {
+  pollfd fds[2];
+  fds[0].fd = fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = stopFd_;
+  fds[1].events = POLLIN;
+  while (true) {
+    auto n = ::poll(fds, 2, -1);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 || fds[1].revents != 0) {
+      return false;
+    }
+    if (fds[0].revents != 0) {
+      return true;
+    }
+  }
+}
+
+void HotRestartListener::run() {
+  folly::setThreadName("mcrtr-hotrstrt");
+
+  while (waitReadable(listenFd_)) {
+    auto fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EINTR && errno != EAGAIN) {
+        PLOG(ERROR) << "Hot restart: accept failed";
+      }
+      continue;
+    }
+    auto ready = serve(fd);
+    ::close(fd);
+    if (ready) {
+      handedOff_ = true;
+      ++hotRestartStats().handoffs;
+      /* one handoff per process, nobody else may connect */
+      ::close(listenFd_);
+      listenFd_ = -1;
+      onHandoff_();
+      return;
+    }
+  }
+}
+
+bool HotRestartListener::serve(int fd) {
+  LOG(INFO) << "Hot restart: new process connected, handing over";
+  auto handoff = provider_();
+  if (!sendHandoff(fd, handoff)) {
+    return false;
+  }
+  /* the new process pre-connects to destinations in the meantime */
+  if (!waitReadable(fd)) {
+    return false;
+  }
+  char c;
+  if (!readAll(fd, &c, 1) || c != kReady) {
+    LOG(WARNING) << "Hot restart: new process went away before taking over";
+    return false;
+  }
+  LOG(INFO) << "Hot restart: new process is ready";
+  return true;
+}
+
+HotRestartClient::HotRestartClient(int fd)
+    : fd_(fd) {
+}
+
+HotRestartClient::~HotRestartClient() {
+  ::close(fd_);
+}
+
+std::unique_ptr<HotRestartClient> HotRestartClient::connect(
+    const std::string& path, std::chrono::milliseconds timeout) {
+
+  sockaddr_un addr;
+  if (!makeAddress(path, addr)) {
+    return nullptr;
+  }
+  auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    PLOG(ERROR) << "Hot restart: can not create socket";
+    return nullptr;
+  }
+  std::unique_ptr<HotRestartClient> client(new HotRestartClient(fd));
+
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    /* no previous process, a regular start */
+    if (errno != ENOENT && errno != ECONNREFUSED) {
+      PLOG(WARNING) << "Hot restart: can not connect to " << path;
+    }
+    return nullptr;
+  }
+
+  timeval tv;
+  tv.tv_sec = timeout.count() / 1000;
+  tv.tv_usec = (timeout.count() % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  if (!receiveHandoff(fd, client->handoff_)) {
+    return nullptr;
+  }
+  LOG(INFO) << "Hot restart: took over " << client->handoff_.fds.size()
+            << " listening sockets and " << client->handoff_.sslFds.size()
+            << " SSL listening sockets";
+  return client;
+}
+
+bool HotRestartClient::ready() {
+  return writeAll(fd_, &kReady, 1);
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,158 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Hot restart: a new server process (e.g. after a binary upgrade) takes
+ * over the listening sockets of the one it replaces, over a Unix socket:
+ *
+ *  1. the new process connects to the old one (HotRestartClient::connect());
+ *  2. the old process sends duplicates of its listening sockets and an
+ *     opaque state blob (HotRestartListener's provider);
+ *  3. the new process starts accepting on the same sockets, warms up and
+ *     tells the old one it's ready (HotRestartClient::ready());
+ *  4. the old process stops accepting and drains its connections
+ *     (HotRestartListener's onHandoff).
+ *
+ * Both processes accept on the same sockets between 3 and 4, so no
+ * connection attempt is refused during the restart.
+ */
+struct HotRestartHandoff {
+  /* Listening sockets, owned by whoever holds the handoff */
+  std::vector<int> fds;
+  std::vector<int> sslFds;
+  std::string state;
+
+  HotRestartHandoff() = default;
+  HotRestartHandoff(HotRestartHandoff&&) noexcept;
+  HotRestartHandoff& operator=(HotRestartHandoff&&) noexcept;
+  ~HotRestartHandoff();
+
+  /**
+   * Gives up ownership of the sockets, e.g. to a server.
+   */
+  void release();
+};
+
+/**
+ * Process wide counters, for stats.
+ */
+struct HotRestartStats {
+  /* Handoffs completed to new processes */
+  std::atomic<uint64_t> handoffs{0};
+  /* Listening sockets taken over from the previous process */
+  std::atomic<uint64_t> inheritedSockets{0};
+  /* Non zero while connections are drained after a handoff */
+  std::atomic<uint64_t> draining{0};
+  /* Connections still open while draining */
+  std::atomic<uint64_t> drainRemaining{0};
+  /* How long the drain has been going on */
+  std::atomic<uint64_t> drainElapsedMs{0};
+};
+
+HotRestartStats& hotRestartStats();
+
+/**
+ * Old process side: waits for a new process on a Unix socket in a
+ * background thread. Hands over one time only.
+ */
+class HotRestartListener {
+ public:
+  /**
+   * Called from the listener thread for every new process connecting,
+   * the sockets in the result are closed once they're sent.
+   */
+  using Provider = std::function<HotRestartHandoff()>;
+  /**
+   * Called from the listener thread once the new process is ready.
+   */
+  using OnHandoff = std::function<void()>;
+
+  /**
+   * Replaces any socket file present at path.
+   *
+   * @throws std::system_error if the socket can't be bound
+   */
+  HotRestartListener(std::string path, Provider provider, OnHandoff onHandoff);
+
+  /**
+   * Removes the socket file, unless a new process took over.
+   */
+  ~HotRestartListener();
+
+ private:
+  const std::string path_;
+  Provider provider_;
+  OnHandoff onHandoff_;
+  int listenFd_{-1};
+  /* eventfd waking up the thread on destruction */
+  int stopFd_{-1};
+  std::atomic<bool> handedOff_{false};
+  std::thread thread_;
+
+  void run();
+  /* @return true if the new process is ready */
+  bool serve(int fd);
+  /* @return false if stopFd_ fired first */
+  bool waitReadable(int fd);
+
+  HotRestartListener(const HotRestartListener&) = delete;
+  HotRestartListener& operator=(const HotRestartListener&) = delete;
+};
+
+/**
+ * New process side.
+ */
+class HotRestartClient {
+ public:
+  /**
+   * Connects to the process listening at path and receives its handoff.
+   *
+   * @return nullptr if no process listens at path (e.g. the first start)
+   *         or the handoff failed (logged)
+   */
+  static std::unique_ptr<HotRestartClient> connect(
+    const std::string& path, std::chrono::milliseconds timeout);
+
+  HotRestartHandoff& handoff() {
+    return handoff_;
+  }
+
+  /**
+   * Tells the old process to stop accepting.
+   *
+   * @return false if the old process went away
+   */
+  bool ready();
+
+  ~HotRestartClient();
+
+ private:
+  int fd_;
+  HotRestartHandoff handoff_;
+
+  explicit HotRestartClient(int fd);
+
+  HotRestartClient(const HotRestartClient&) = delete;
+  HotRestartClient& operator=(const HotRestartClient&) = delete;
+};
+
+}}  // facebook::memcache
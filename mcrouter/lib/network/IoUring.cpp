@@ -0,0 +1,257 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "IoUring.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+
+#include <glog/logging.h>
+
+#include <folly/Memory.h>
+
+#ifdef MCROUTER_HAVE_LIBURING
+#include <liburing.h>
+#else
+struct io_uring {};
+#endif
+
+namespace facebook { namespace memcache {
+
+constexpr unsigned IoUring::kEntries;
+
+namespace {
+
+typedef std::unordered_map<folly::EventBase*, std::unique_ptr<IoUring>>
+  RingMap;
+
+RingMap& threadRings() {
+  thread_local RingMap rings;
+  return rings;
+}
+
+/* If one ring can't be created, none can */
+std::atomic<bool> gUnsupported{false};
+
+}  // anonymous namespace
+
+IoUring* IoUring::get(folly::EventBase& eventBase) {
+  auto& rings = threadRings();
+  auto it = rings.find(&eventBase);
+  if (it != rings.end()) {
+    return it->second.get();
+  }
+  if (gUnsupported) {
+    return nullptr;
+  }
+
+  std::unique_ptr<IoUring> ring(new IoUring(eventBase));
+  if (!ring->init()) {
+    gUnsupported = true;
+    return nullptr;
+  }
+  auto result = ring.get();
+  rings.emplace(&eventBase, std::move(ring));
+  return result;
+}
+
+IoUring::IoUring(folly::EventBase& eventBase)
+    : folly::EventHandler(&eventBase),
+      eventBase_(eventBase),
+      submitCallback_(*this),
+      destructionCallback_(*this) {
+}
+
+bool IoUring::init() {
+#ifdef MCROUTER_HAVE_LIBURING
+  auto ring = folly::make_unique<struct io_uring>();
+  auto ret = io_uring_queue_init(kEntries, ring.get(), 0);
+  if (ret < 0) {
+    LOG(WARNING) << "io_uring is not available, using epoll: "
+                 << strerror(-ret);
+    return false;
+  }
+  eventFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (eventFd_ < 0 || io_uring_register_eventfd(ring.get(), eventFd_) < 0) {
+    LOG(WARNING) << "Can not register eventfd with io_uring, using epoll";
+    io_uring_queue_exit(ring.get());
+    return false;
+  }
+  ring_ = std::move(ring);
+  changeHandlerFD(eventFd_);
+  eventBase_.runOnDestruction(&destructionCallback_);
+  return true;
+#else
+  LOG(WARNING) << "mcrouter is built without liburing, using epoll";
+  return false;
+#endif
+}
+
+IoUring::~IoUring() {
+  if (isHandlerRegistered()) {
+    unregisterHandler();
+  }
+#ifdef MCROUTER_HAVE_LIBURING
+  if (ring_) {
+    io_uring_queue_exit(ring_.get());
+  }
+#endif
+  ring_.reset();
+  if (eventFd_ >= 0) {
+    ::close(eventFd_);
+  }
+
+  /* Operations are cancelled together with the ring. Callbacks must not
+     queue new operations at this point, getSqe() fails without ring_. */
+  auto inflight = std::move(inflight_);
+  inflight_.clear();
+  for (auto callback : inflight) {
+    callback->ioComplete(-ECANCELED);
+  }
+}
+
+struct io_uring_sqe* IoUring::getSqe(Callback* callback) {
+#ifdef MCROUTER_HAVE_LIBURING
+  if (!ring_) {
+    return nullptr;
+  }
+  auto sqe = io_uring_get_sqe(ring_.get());
+  if (sqe == nullptr) {
+    submit();
+    sqe = io_uring_get_sqe(ring_.get());
+    if (sqe == nullptr) {
+      return nullptr;
+    }
+  }
+  if (callback != nullptr) {
+    inflight_.insert(callback);
+  }
+  ++operations_;
+  /* As with sockets, only operations in flight keep the loop running */
+  if (!isHandlerRegistered()) {
+    registerHandler(folly::EventHandler::READ | folly::EventHandler::PERSIST);
+  }
+  scheduleSubmit();
+  return sqe;
+#else
+  return nullptr;
+#endif
+}
+
+bool IoUring::recv(int fd, void* buf, size_t len, Callback& callback) {
+#ifdef MCROUTER_HAVE_LIBURING
+  auto sqe = getSqe(&callback);
+  if (sqe == nullptr) {
+    return false;
+  }
+  io_uring_prep_recv(sqe, fd, buf, len, 0);
+  io_uring_sqe_set_data(sqe, &callback);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool IoUring::sendmsg(int fd, const struct msghdr* msg, int flags,
+                      Callback& callback) {
+#ifdef MCROUTER_HAVE_LIBURING
+  auto sqe = getSqe(&callback);
+  if (sqe == nullptr) {
+    return false;
+  }
+  io_uring_prep_sendmsg(sqe, fd, msg, flags);
+  io_uring_sqe_set_data(sqe, &callback);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool IoUring::cancel(Callback& callback) {
+#ifdef MCROUTER_HAVE_LIBURING
+  /* Result of the cancellation itself doesn't matter, the operation
+     completes either way */
+  auto sqe = getSqe(nullptr);
+  if (sqe == nullptr) {
+    return false;
+  }
+  io_uring_prep_cancel(sqe, &callback, 0);
+  io_uring_sqe_set_data(sqe, nullptr);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void IoUring::scheduleSubmit() {
+  if (!submitScheduled_) {
+    submitScheduled_ = true;
+    eventBase_.runInLoop(&submitCallback_, /* thisIteration= */ true);
+  }
+}
+
+void IoUring::submit() {
+#ifdef MCROUTER_HAVE_LIBURING
+  ++submitCalls_;
+  auto ret = io_uring_submit(ring_.get());
+  if (ret == -EBUSY || ret == -EAGAIN) {
+    // completion queue is full, retry after reaping completions
+    if (!submitScheduled_) {
+      submitScheduled_ = true;
+      eventBase_.runInLoop(&submitCallback_);
+    }
+  } else if (ret < 0) {
+    LOG_EVERY_N(ERROR, 1000) << "io_uring_submit failed: " << strerror(-ret);
+  }
+#endif
+}
+
+void IoUring::handlerReady(uint16_t events) noexcept {
+#ifdef MCROUTER_HAVE_LIBURING
+  uint64_t value;
+  // nonblocking, only resets the counter
+  if (::read(eventFd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+    PLOG(ERROR) << "Failed to read io_uring eventfd";
+  }
+
+  struct io_uring_cqe* cqe;
+  while (ring_ && io_uring_peek_cqe(ring_.get(), &cqe) == 0) {
+    auto callback = static_cast<Callback*>(io_uring_cqe_get_data(cqe));
+    auto result = cqe->res;
+    io_uring_cqe_seen(ring_.get(), cqe);
+    if (callback == nullptr) {
+      // completion of a cancellation
+      continue;
+    }
+    inflight_.erase(callback);
+    // may destroy the callback
+    callback->ioComplete(result);
+  }
+  if (inflight_.empty() && isHandlerRegistered()) {
+    unregisterHandler();
+  }
+#endif
+}
+
+void IoUring::SubmitCallback::runLoopCallback() noexcept {
+  ring_.submitScheduled_ = false;
+  ring_.submit();
+}
+
+void IoUring::DestructionCallback::runLoopCallback() noexcept {
+  // destroys the ring
+  threadRings().erase(&ring_.eventBase_);
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,154 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+
+struct io_uring;
+struct io_uring_sqe;
+
+namespace facebook { namespace memcache {
+
+/**
+ * io_uring instance of one EventBase.
+ *
+ * Operations queued during an event loop iteration are submitted together
+ * with a single io_uring_enter() at the end of the iteration. Completions are
+ * signalled through an eventfd watched by the EventBase, so io_uring and
+ * epoll based sockets can be mixed on the same loop. Like a socket, the ring
+ * keeps the loop running only while it has operations in flight.
+ *
+ * Must only be used from the thread of its EventBase.
+ */
+class IoUring : private folly::EventHandler {
+ public:
+  /**
+   * Completion callback of a queued operation.
+   */
+  class Callback {
+   public:
+    /**
+     * @param result  return value of the operation, -errno on failure.
+     *                -ECANCELED if the ring is destroyed first.
+     */
+    virtual void ioComplete(int result) noexcept = 0;
+
+   protected:
+    ~Callback() = default;
+  };
+
+  /* Size of the submission queue */
+  static constexpr unsigned kEntries = 1024;
+
+  /**
+   * @return ring of the event base, created on first use. nullptr if
+   *         mcrouter is built without liburing or the kernel doesn't
+   *         support io_uring (logged once).
+   */
+  static IoUring* get(folly::EventBase& eventBase);
+
+  ~IoUring();
+
+  /**
+   * Queue recv(fd, buf, len, 0). buf must stay valid until completion.
+   *
+   * @return false if the operation can't be queued
+   */
+  bool recv(int fd, void* buf, size_t len, Callback& callback);
+
+  /**
+   * Queue sendmsg(fd, msg, flags). msg and the memory it points to must stay
+   * valid until completion.
+   *
+   * @return false if the operation can't be queued
+   */
+  bool sendmsg(int fd, const struct msghdr* msg, int flags,
+               Callback& callback);
+
+  /**
+   * Queue a cancellation of the operation of callback. The operation still
+   * completes through its callback, with -ECANCELED if it was cancelled
+   * before it could finish.
+   *
+   * @return false if the cancellation can't be queued
+   */
+  bool cancel(Callback& callback);
+
+  folly::EventBase& getEventBase() const {
+    return eventBase_;
+  }
+
+  /**
+   * Number of io_uring_enter() calls made to submit operations and number of
+   * operations submitted, for benchmarks.
+   */
+  uint64_t submitCalls() const {
+    return submitCalls_;
+  }
+  uint64_t operations() const {
+    return operations_;
+  }
+
+ private:
+  class SubmitCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit SubmitCallback(IoUring& ring) : ring_(ring) {}
+    void runLoopCallback() noexcept override;
+   private:
+    IoUring& ring_;
+  };
+
+  class DestructionCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit DestructionCallback(IoUring& ring) : ring_(ring) {}
+    void runLoopCallback() noexcept override;
+   private:
+    IoUring& ring_;
+  };
+
+  folly::EventBase& eventBase_;
+  std::unique_ptr<struct io_uring> ring_;
+  int eventFd_{-1};
+  SubmitCallback submitCallback_;
+  DestructionCallback destructionCallback_;
+  bool submitScheduled_{false};
+  /* Operations submitted, but not completed yet */
+  std::unordered_set<Callback*> inflight_;
+  uint64_t submitCalls_{0};
+  uint64_t operations_{0};
+
+  explicit IoUring(folly::EventBase& eventBase);
+
+  /**
+   * @return true on success
+   */
+  bool init();
+
+  /**
+   * @param callback  callback of the operation, nullptr if its completion
+   *                  is ignored.
+   * @return the next submission entry for an operation of callback,
+   *         nullptr if the queue is full even after submitting it.
+   */
+  struct io_uring_sqe* getSqe(Callback* callback);
+  void scheduleSubmit();
+  void submit();
+
+  void handlerReady(uint16_t events) noexcept override;
+};
+
+}}  // facebook::memcache
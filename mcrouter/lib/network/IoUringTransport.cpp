@@ -0,0 +1,496 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "IoUringTransport.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <folly/Memory.h>
+#include <folly/SocketAddress.h>
+
+namespace facebook { namespace memcache {
+
+using folly::AsyncSocketException;
+
+IoUringTransport::IoUringTransport(IoUring& ring, int fd)
+    : ring_(ring),
+      fd_(fd),
+      readOperation_(*this),
+      pendingReadCallback_(*this),
+      writeOperation_(*this),
+      writeTimeout_(*this) {
+  std::memset(&msg_, 0, sizeof(msg_));
+}
+
+IoUringTransport::~IoUringTransport() {
+  pendingReadCallback_.cancelLoopCallback();
+  writeTimeout_.cancelTimeout();
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+void IoUringTransport::setReadCB(ReadCallback* callback) {
+  readCallback_ = callback;
+  if (readCallback_ == nullptr) {
+    // recv in flight (if any) completes into the buffer it was given
+    return;
+  }
+  if (pendingReadBytes_ > 0 || pendingEof_) {
+    if (!pendingReadCallback_.isLoopCallbackScheduled()) {
+      ring_.getEventBase().runInLoop(&pendingReadCallback_);
+    }
+    return;
+  }
+  startRead();
+}
+
+IoUringTransport::ReadCallback* IoUringTransport::getReadCallback() const {
+  return readCallback_;
+}
+
+void IoUringTransport::startRead() {
+  if (readInflight_ || readCallback_ == nullptr || state_ != State::kOpen) {
+    return;
+  }
+
+  void* buf = nullptr;
+  size_t len = 0;
+  readCallback_->getReadBuffer(&buf, &len);
+  if (buf == nullptr || len == 0) {
+    fail(AsyncSocketException(AsyncSocketException::BAD_ARGS,
+                              "ReadCallback::getReadBuffer() returned "
+                              "empty buffer"));
+    return;
+  }
+
+  if (!ring_.recv(fd_, buf, len, readOperation_)) {
+    fail(AsyncSocketException(AsyncSocketException::INTERNAL_ERROR,
+                              "Failed to queue io_uring recv"));
+    return;
+  }
+  readInflight_ = true;
+  readGuard_ = folly::make_unique<DestructorGuard>(this);
+}
+
+void IoUringTransport::readComplete(int result) {
+  readInflight_ = false;
+  // released at the end of this function
+  auto guard = std::move(readGuard_);
+
+  if (readEnded_) {
+    // the buffer is no longer used, data that made it is dropped
+    readEnded_ = false;
+    auto error = std::move(readError_);
+    readError_.clear();
+    endRead(error.get_pointer());
+    return;
+  }
+  if (state_ == State::kClosed || state_ == State::kError) {
+    return;
+  }
+
+  if (result > 0) {
+    appBytesReceived_ += result;
+    if (readCallback_ == nullptr) {
+      pendingReadBytes_ = result;
+      return;
+    }
+    readCallback_->readDataAvailable(result);
+    startRead();
+  } else if (result == 0) {
+    if (readCallback_ == nullptr) {
+      pendingEof_ = true;
+      return;
+    }
+    auto callback = readCallback_;
+    readCallback_ = nullptr;
+    callback->readEOF();
+  } else if (result == -ECANCELED) {
+    fail(AsyncSocketException(AsyncSocketException::END_OF_FILE,
+                              "io_uring was destroyed"));
+  } else {
+    fail(AsyncSocketException(AsyncSocketException::INTERNAL_ERROR,
+                              "io_uring recv failed", -result));
+  }
+}
+
+void IoUringTransport::endRead(const AsyncSocketException* ex) {
+  if (readInflight_) {
+    if (!readEnded_) {
+      readEnded_ = true;
+      if (ex) {
+        readError_ = *ex;
+      }
+      ring_.cancel(readOperation_);
+    }
+    return;
+  }
+  if (readCallback_) {
+    auto callback = readCallback_;
+    readCallback_ = nullptr;
+    if (ex) {
+      callback->readErr(*ex);
+    } else {
+      callback->readEOF();
+    }
+  }
+}
+
+void IoUringTransport::PendingReadCallback::runLoopCallback() noexcept {
+  transport_.deliverPendingRead();
+}
+
+void IoUringTransport::deliverPendingRead() {
+  if (readCallback_ == nullptr || !readable()) {
+    return;
+  }
+  DestructorGuard dg(this);
+  if (pendingReadBytes_ > 0) {
+    auto bytes = pendingReadBytes_;
+    pendingReadBytes_ = 0;
+    readCallback_->readDataAvailable(bytes);
+  }
+  if (pendingEof_ && readCallback_ != nullptr) {
+    pendingEof_ = false;
+    auto callback = readCallback_;
+    readCallback_ = nullptr;
+    callback->readEOF();
+    return;
+  }
+  startRead();
+}
+
+void IoUringTransport::write(WriteCallback* callback, const void* buf,
+                             size_t bytes, WriteFlags flags) {
+  iovec op;
+  op.iov_base = const_cast<void*>(buf);
+  op.iov_len = bytes;
+  writev(callback, &op, 1, flags);
+}
+
+void IoUringTransport::writev(WriteCallback* callback, const iovec* vec,
+                              size_t count, WriteFlags flags) {
+  if (state_ != State::kOpen || shutdownWritePending_) {
+    if (callback) {
+      callback->writeErr(0, AsyncSocketException(
+          AsyncSocketException::NOT_OPEN, "Transport is not open"));
+    }
+    return;
+  }
+
+  WriteRequest req;
+  req.callback = callback;
+  req.iovs.assign(vec, vec + count);
+  writes_.push_back(std::move(req));
+  startWrite();
+}
+
+void IoUringTransport::writeChain(WriteCallback* callback,
+                                  std::unique_ptr<folly::IOBuf>&& buf,
+                                  WriteFlags flags) {
+  if (state_ != State::kOpen || shutdownWritePending_) {
+    if (callback) {
+      callback->writeErr(0, AsyncSocketException(
+          AsyncSocketException::NOT_OPEN, "Transport is not open"));
+    }
+    return;
+  }
+
+  WriteRequest req;
+  req.callback = callback;
+  auto vec = buf->getIov();
+  req.iovs.assign(vec.begin(), vec.end());
+  req.buf = std::move(buf);
+  writes_.push_back(std::move(req));
+  startWrite();
+}
+
+void IoUringTransport::startWrite() {
+  if (writeInflight_) {
+    return;
+  }
+  if (writes_.empty()) {
+    return;
+  }
+  if (writes_.front().iovIndex == writes_.front().iovs.size()) {
+    // empty request, completes immediately
+    finishWrites();
+    return;
+  }
+
+  /* Send all the queued requests with one sendmsg */
+  sendIovs_.clear();
+  for (const auto& req : writes_) {
+    sendIovs_.insert(sendIovs_.end(), req.iovs.begin() + req.iovIndex,
+                     req.iovs.end());
+    if (sendIovs_.size() >= IOV_MAX) {
+      sendIovs_.resize(IOV_MAX);
+      break;
+    }
+  }
+  std::memset(&msg_, 0, sizeof(msg_));
+  msg_.msg_iov = sendIovs_.data();
+  msg_.msg_iovlen = sendIovs_.size();
+
+  if (!ring_.sendmsg(fd_, &msg_, MSG_NOSIGNAL, writeOperation_)) {
+    fail(AsyncSocketException(AsyncSocketException::INTERNAL_ERROR,
+                              "Failed to queue io_uring sendmsg"));
+    return;
+  }
+  writeInflight_ = true;
+  writeGuard_ = folly::make_unique<DestructorGuard>(this);
+  if (sendTimeoutMs_ > 0) {
+    writeTimeout_.scheduleTimeout(sendTimeoutMs_);
+  }
+}
+
+void IoUringTransport::writeComplete(int result) {
+  writeInflight_ = false;
+  writeTimeout_.cancelTimeout();
+  // released at the end of this function
+  auto guard = std::move(writeGuard_);
+
+  if (writeError_) {
+    if (result > 0) {
+      appBytesWritten_ += result;
+      advanceWrites(result);
+    }
+    auto error = std::move(*writeError_);
+    writeError_.clear();
+    failWrites(error);
+    return;
+  }
+  if (state_ == State::kClosed || state_ == State::kError) {
+    return;
+  }
+  if (result < 0) {
+    fail(AsyncSocketException(AsyncSocketException::INTERNAL_ERROR,
+                              "io_uring sendmsg failed", -result));
+    return;
+  }
+
+  appBytesWritten_ += result;
+  advanceWrites(result);
+  finishWrites();
+}
+
+void IoUringTransport::advanceWrites(size_t written) {
+  for (auto& req : writes_) {
+    // empty iovecs are skipped even if nothing is left
+    while (req.iovIndex < req.iovs.size() &&
+           (written > 0 || req.iovs[req.iovIndex].iov_len == 0)) {
+      auto& iov = req.iovs[req.iovIndex];
+      auto n = std::min(written, iov.iov_len);
+      iov.iov_base = static_cast<char*>(iov.iov_base) + n;
+      iov.iov_len -= n;
+      req.bytesWritten += n;
+      written -= n;
+      if (iov.iov_len == 0) {
+        ++req.iovIndex;
+      }
+    }
+    if (written == 0) {
+      break;
+    }
+  }
+}
+
+void IoUringTransport::finishWrites() {
+  DestructorGuard dg(this);
+  while (!writes_.empty() &&
+         writes_.front().iovIndex == writes_.front().iovs.size()) {
+    auto callback = writes_.front().callback;
+    writes_.pop_front();
+    if (callback) {
+      callback->writeSuccess();
+    }
+    if (state_ == State::kClosed || state_ == State::kError) {
+      return;
+    }
+  }
+
+  if (!writes_.empty()) {
+    startWrite();
+    return;
+  }
+  if (shutdownWritePending_) {
+    shutdownWritePending_ = false;
+    ::shutdown(fd_, SHUT_WR);
+  }
+  if (state_ == State::kClosing) {
+    closeNow();
+  }
+}
+
+void IoUringTransport::WriteTimeout::timeoutExpired() noexcept {
+  transport_.fail(AsyncSocketException(AsyncSocketException::TIMED_OUT,
+                                       "write timed out"));
+}
+
+void IoUringTransport::fail(const AsyncSocketException& ex) {
+  if (state_ == State::kClosed || state_ == State::kError) {
+    return;
+  }
+  DestructorGuard dg(this);
+  state_ = State::kError;
+  // operations in flight are cancelled
+  ::shutdown(fd_, SHUT_RDWR);
+  writeTimeout_.cancelTimeout();
+  pendingReadCallback_.cancelLoopCallback();
+
+  failWrites(ex);
+  endRead(&ex);
+}
+
+void IoUringTransport::failWrites(const AsyncSocketException& ex) {
+  if (writeInflight_) {
+    if (!writeError_) {
+      writeError_ = ex;
+      ring_.cancel(writeOperation_);
+    }
+    return;
+  }
+  while (!writes_.empty()) {
+    auto req = std::move(writes_.front());
+    writes_.pop_front();
+    if (req.callback) {
+      req.callback->writeErr(req.bytesWritten, ex);
+    }
+  }
+}
+
+void IoUringTransport::close() {
+  if (state_ != State::kOpen) {
+    return;
+  }
+  if (writes_.empty()) {
+    closeNow();
+    return;
+  }
+  state_ = State::kClosing;
+  DestructorGuard dg(this);
+  endRead(nullptr);
+}
+
+void IoUringTransport::closeNow() {
+  if (state_ == State::kClosed || state_ == State::kError) {
+    return;
+  }
+  DestructorGuard dg(this);
+  state_ = State::kClosed;
+  // operations in flight are cancelled, the fd is closed in destructor
+  ::shutdown(fd_, SHUT_RDWR);
+  writeTimeout_.cancelTimeout();
+  pendingReadCallback_.cancelLoopCallback();
+
+  failWrites(AsyncSocketException(AsyncSocketException::END_OF_FILE,
+                                  "Transport closed locally"));
+  endRead(nullptr);
+}
+
+void IoUringTransport::shutdownWrite() {
+  if (state_ != State::kOpen) {
+    return;
+  }
+  if (writes_.empty()) {
+    ::shutdown(fd_, SHUT_WR);
+  } else {
+    shutdownWritePending_ = true;
+  }
+}
+
+void IoUringTransport::shutdownWriteNow() {
+  if (state_ != State::kOpen) {
+    return;
+  }
+  failWrites(AsyncSocketException(AsyncSocketException::END_OF_FILE,
+                                  "Write side shut down"));
+  ::shutdown(fd_, SHUT_WR);
+}
+
+bool IoUringTransport::good() const {
+  return state_ == State::kOpen;
+}
+
+bool IoUringTransport::readable() const {
+  return state_ == State::kOpen || state_ == State::kClosing;
+}
+
+bool IoUringTransport::connecting() const {
+  return false;
+}
+
+bool IoUringTransport::error() const {
+  return state_ == State::kError;
+}
+
+void IoUringTransport::attachEventBase(folly::EventBase*) {
+  throw std::logic_error("Unsupported function call.");
+}
+
+void IoUringTransport::detachEventBase() {
+  throw std::logic_error("Unsupported function call.");
+}
+
+bool IoUringTransport::isDetachable() const {
+  return false;
+}
+
+folly::EventBase* IoUringTransport::getEventBase() const {
+  return &ring_.getEventBase();
+}
+
+void IoUringTransport::setSendTimeout(uint32_t milliseconds) {
+  sendTimeoutMs_ = milliseconds;
+}
+
+uint32_t IoUringTransport::getSendTimeout() const {
+  return sendTimeoutMs_;
+}
+
+void IoUringTransport::getLocalAddress(folly::SocketAddress* address) const {
+  address->setFromLocalAddress(fd_);
+}
+
+void IoUringTransport::getPeerAddress(folly::SocketAddress* address) const {
+  address->setFromPeerAddress(fd_);
+}
+
+bool IoUringTransport::isEorTrackingEnabled() const {
+  return false;
+}
+
+void IoUringTransport::setEorTracking(bool) {
+  throw std::logic_error("Unsupported function call.");
+}
+
+size_t IoUringTransport::getAppBytesWritten() const {
+  return appBytesWritten_;
+}
+
+size_t IoUringTransport::getRawBytesWritten() const {
+  return appBytesWritten_;
+}
+
+size_t IoUringTransport::getAppBytesReceived() const {
+  return appBytesReceived_;
+}
+
+size_t IoUringTransport::getRawBytesReceived() const {
+  return appBytesReceived_;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,227 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/AsyncTransport.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Optional.h>
+
+#include "mcrouter/lib/network/IoUring.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * AsyncTransportWrapper over a connected (plain) socket that does reads
+ * and writes through io_uring instead of a read()/writev() per readiness
+ * event. Operations of all transports on the same EventBase are submitted
+ * with one system call per loop iteration, see IoUring.
+ *
+ * A recv is kept posted into the buffer returned by ReadCallback's
+ * getReadBuffer() whenever a read callback is installed. If the callback
+ * is removed while the recv is in flight, data that arrives is delivered
+ * to the next installed callback, so only the same callback should be
+ * reinstalled (as McServerSession and AsyncMcClient do).
+ *
+ * Like AsyncSocket, written buffers must stay valid until the write callback
+ * is called. Since the kernel may still be using them, operations in flight
+ * when the transport is closed or fails are cancelled, and their callbacks
+ * (and the read callback, whose buffer a posted recv writes into) are only
+ * notified once the operations complete. The transport can't be attached to
+ * another EventBase.
+ */
+class IoUringTransport : public folly::AsyncTransportWrapper {
+ public:
+  using WriteFlags = folly::WriteFlags;
+  typedef std::unique_ptr<IoUringTransport, Destructor> UniquePtr;
+
+  /**
+   * Takes ownership of fd.
+   */
+  IoUringTransport(IoUring& ring, int fd);
+
+  int getFd() const {
+    return fd_;
+  }
+
+  // folly::AsyncTransportWrapper overrides
+
+  void setReadCB(ReadCallback* callback) override;
+  ReadCallback* getReadCallback() const override;
+
+  void write(WriteCallback* callback, const void* buf, size_t bytes,
+             WriteFlags flags = WriteFlags::NONE) override;
+  void writev(WriteCallback* callback, const iovec* vec, size_t count,
+              WriteFlags flags = WriteFlags::NONE) override;
+  void writeChain(WriteCallback* callback,
+                  std::unique_ptr<folly::IOBuf>&& buf,
+                  WriteFlags flags = WriteFlags::NONE) override;
+
+  // folly::AsyncTransport overrides
+
+  void close() override;
+  void closeNow() override;
+  void shutdownWrite() override;
+  void shutdownWriteNow() override;
+  bool good() const override;
+  bool readable() const override;
+  bool connecting() const override;
+  bool error() const override;
+  void attachEventBase(folly::EventBase*) override;
+  void detachEventBase() override;
+  bool isDetachable() const override;
+  folly::EventBase* getEventBase() const override;
+  void setSendTimeout(uint32_t milliseconds) override;
+  uint32_t getSendTimeout() const override;
+  void getLocalAddress(folly::SocketAddress* address) const override;
+  void getPeerAddress(folly::SocketAddress* address) const override;
+  bool isEorTrackingEnabled() const override;
+  void setEorTracking(bool) override;
+  size_t getAppBytesWritten() const override;
+  size_t getRawBytesWritten() const override;
+  size_t getAppBytesReceived() const override;
+  size_t getRawBytesReceived() const override;
+
+ private:
+  class ReadOperation : public IoUring::Callback {
+   public:
+    explicit ReadOperation(IoUringTransport& t) : transport_(t) {}
+    void ioComplete(int result) noexcept override {
+      transport_.readComplete(result);
+    }
+   private:
+    IoUringTransport& transport_;
+  };
+
+  class WriteOperation : public IoUring::Callback {
+   public:
+    explicit WriteOperation(IoUringTransport& t) : transport_(t) {}
+    void ioComplete(int result) noexcept override {
+      transport_.writeComplete(result);
+    }
+   private:
+    IoUringTransport& transport_;
+  };
+
+  class WriteTimeout : public folly::AsyncTimeout {
+   public:
+    explicit WriteTimeout(IoUringTransport& t)
+        : folly::AsyncTimeout(&t.ring_.getEventBase()),
+          transport_(t) {
+    }
+    void timeoutExpired() noexcept override;
+   private:
+    IoUringTransport& transport_;
+  };
+
+  /**
+   * Delivers data (or EOF) that arrived while there was no read callback.
+   */
+  class PendingReadCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit PendingReadCallback(IoUringTransport& t) : transport_(t) {}
+    void runLoopCallback() noexcept override;
+   private:
+    IoUringTransport& transport_;
+  };
+
+  struct WriteRequest {
+    WriteCallback* callback{nullptr};
+    std::vector<iovec> iovs;
+    /* first iovec that is not fully written */
+    size_t iovIndex{0};
+    size_t bytesWritten{0};
+    /* keeps writeChain() data alive */
+    std::unique_ptr<folly::IOBuf> buf;
+  };
+
+  enum class State {
+    kOpen,
+    // close() was called, sending pending writes
+    kClosing,
+    kClosed,
+    kError,
+  };
+
+  IoUring& ring_;
+  int fd_;
+  State state_{State::kOpen};
+
+  ReadCallback* readCallback_{nullptr};
+  ReadOperation readOperation_;
+  bool readInflight_{false};
+  /* Reads ended while a recv was in flight, see endRead() */
+  bool readEnded_{false};
+  folly::Optional<folly::AsyncSocketException> readError_;
+  /* Received while there was no read callback */
+  size_t pendingReadBytes_{0};
+  bool pendingEof_{false};
+  PendingReadCallback pendingReadCallback_;
+
+  std::deque<WriteRequest> writes_;
+  WriteOperation writeOperation_;
+  bool writeInflight_{false};
+  /* Writes failed while a sendmsg was in flight, see failWrites() */
+  folly::Optional<folly::AsyncSocketException> writeError_;
+  bool shutdownWritePending_{false};
+  /* Arguments of the sendmsg in flight */
+  struct msghdr msg_;
+  std::vector<iovec> sendIovs_;
+
+  WriteTimeout writeTimeout_;
+  uint32_t sendTimeoutMs_{0};
+
+  /* Keep us alive while operations are in flight */
+  std::unique_ptr<DestructorGuard> readGuard_;
+  std::unique_ptr<DestructorGuard> writeGuard_;
+
+  size_t appBytesWritten_{0};
+  size_t appBytesReceived_{0};
+
+  ~IoUringTransport() override;
+
+  void startRead();
+  void readComplete(int result);
+  void deliverPendingRead();
+
+  /**
+   * Notifies the read callback with readErr(*ex), or readEOF() if ex is
+   * nullptr. With a recv in flight it's cancelled instead and the callback
+   * is notified on its completion.
+   */
+  void endRead(const folly::AsyncSocketException* ex);
+
+  void startWrite();
+  void writeComplete(int result);
+  /* Accounts written bytes to the pending writes */
+  void advanceWrites(size_t written);
+  void finishWrites();
+
+  /**
+   * Fails all pending writes and the read callback, the socket is unusable
+   * afterwards.
+   */
+  void fail(const folly::AsyncSocketException& ex);
+  /**
+   * Fails all pending writes. With a sendmsg in flight it's cancelled
+   * instead and the writes are failed on its completion.
+   */
+  void failWrites(const folly::AsyncSocketException& ex);
+};
+
+}}  // facebook::memcache
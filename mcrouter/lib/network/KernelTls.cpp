@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "KernelTls.h"
+
+#include <openssl/bio.h>
+#include <openssl/ssl.h>
+
+#include <glog/logging.h>
+
+#include <folly/io/async/AsyncSSLSocket.h>
+#include <folly/io/async/SSLContext.h>
+
+/* OpenSSL 3.0+ built without OPENSSL_NO_KTLS */
+#if defined(SSL_OP_ENABLE_KTLS) && defined(BIO_get_ktls_send)
+#define MCROUTER_KTLS 1
+#else
+#define MCROUTER_KTLS 0
+#endif
+
+namespace facebook { namespace memcache {
+
+bool kernelTlsSupported() {
+  return MCROUTER_KTLS;
+}
+
+void enableKernelTls(folly::SSLContext& context) {
+#if MCROUTER_KTLS
+  context.setOptions(SSL_OP_ENABLE_KTLS);
+#else
+  LOG_FIRST_N(WARNING, 1) << "Kernel TLS requested, but OpenSSL doesn't "
+                             "support it. Using userspace encryption.";
+#endif
+}
+
+bool kernelTlsActive(const folly::AsyncSSLSocket& socket) {
+#if MCROUTER_KTLS
+  auto ssl = socket.getSSL();
+  return ssl != nullptr && BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+  return false;
+#endif
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+namespace folly {
+class AsyncSSLSocket;
+class SSLContext;
+}  // namespace
+
+namespace facebook { namespace memcache {
+
+/**
+ * Kernel TLS (kTLS): after the handshake OpenSSL installs the session keys
+ * into the socket with setsockopt(SOL_TLS), and records are then encrypted
+ * (and decrypted) by the kernel. Writes still go through AsyncSSLSocket, but
+ * OpenSSL passes the plaintext straight to the socket.
+ *
+ * OpenSSL falls back to userspace encryption per connection if the kernel
+ * has no TLS module or doesn't support the negotiated cipher.
+ */
+
+/**
+ * @return true if the OpenSSL mcrouter is built with supports kTLS
+ */
+bool kernelTlsSupported();
+
+/**
+ * Enables kTLS for connections created from the context after this call.
+ * No-op (logged once) if kernelTlsSupported() is false.
+ */
+void enableKernelTls(folly::SSLContext& context);
+
+/**
+ * @return true if records sent over the established connection are
+ *         encrypted by the kernel
+ */
+bool kernelTlsActive(const folly::AsyncSSLSocket& socket);
+
+}}  // facebook::memcache
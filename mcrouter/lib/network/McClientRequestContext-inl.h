@@ -29,6 +29,20 @@ inline getFbTraceInfo(const Request& request) {
 }
 
 #endif
+
+/**
+ * Meta protocol servers reply HD to both ms and md, which the ascii parser
+ * reads as mc_res_stored. A delete can't be stored otherwise.
+ */
+inline void fixMetaReply(McOperation<mc_op_delete>, McReply& reply) {
+  if (reply.result() == mc_res_stored) {
+    reply.setResult(mc_res_deleted);
+  }
+}
+
+template <class Operation, class Reply>
+inline void fixMetaReply(Operation, Reply& reply) {
+}
 }
 
 template <class Reply>
@@ -91,6 +105,7 @@ template <class Operation, class Request>
 typename McClientRequestContextCommon<Operation, Request>::Reply
 McClientRequestContextCommon<Operation, Request>::getReply() {
   assert(replyStorage_.hasValue());
+  fixMetaReply(Operation(), replyStorage_.value());
   return std::move(replyStorage_.value());
 }
 
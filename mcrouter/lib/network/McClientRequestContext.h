@@ -9,10 +9,15 @@
  */
 #pragma once
 
+#include <atomic>
 #include <typeindex>
 
+#include "mcrouter/lib/fbi/cpp/FreeList.h"
 #include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/RequestPriority.h"
 #include "mcrouter/lib/network/McSerializedRequest.h"
+#include "mcrouter/lib/network/TimerWheel.h"
 #include "mcrouter/lib/network/UniqueIntrusiveList.h"
 
 #include "mcrouter/lib/network/FBTrace.h"
@@ -33,13 +38,23 @@ enum class ReqState {
 /**
  * Class for storing per request data that is required for proper requests
  * processing inside of AsyncMcClient.
+ *
+ * Doubles as the timer of the request's send timeout.
  */
-class McClientRequestContextBase {
+class McClientRequestContextBase : public TimerWheel::Callback {
  public:
   McSerializedRequest reqContext;
   uint64_t id;
   std::chrono::steady_clock::time_point sentAt;
   ReqState state{ReqState::NONE};
+  /* If set and true by the time the request is to be written, it's
+     dropped instead (see AsyncMcClient::sendSync()) */
+  const std::atomic<bool>* cancellation{nullptr};
+  /* Serialized bytes counted as outstanding by the client until the
+     context is destroyed, see ConnectionOptions::maxOutstandingBytes */
+  size_t outstandingBytes{0};
+  /* Send queue lane, see McClientSendQueue */
+  RequestPriority priority{RequestPriority::FOREGROUND_GET};
 
   McClientRequestContextBase(const McClientRequestContextBase&) = delete;
   McClientRequestContextBase& operator=(const McClientRequestContextBase& other)
@@ -85,7 +100,7 @@ class McClientRequestContextBase {
     }
   };
 
-  virtual ~McClientRequestContextBase() {}
+  virtual ~McClientRequestContextBase();
 
   template <class Operation, class Request>
   McClientRequestContextBase(
@@ -95,6 +110,9 @@ class McClientRequestContextBase {
 
   virtual void forwardReply() = 0;
 
+  // Send timeout, see AsyncMcClientImpl::scheduleRequestTimeout()
+  void timeoutExpired() noexcept override;
+
  public:
   using UniquePtr = std::unique_ptr<McClientRequestContextBase, Deleter>;
 
@@ -154,6 +172,10 @@ class McClientRequestContextSync :
         Operation(), request, reqid, protocol, std::move(client), true) {
   }
 
+  /* Set by AsyncMcClientImpl::startSync(), zero if the request doesn't
+     time out */
+  std::chrono::steady_clock::time_point deadline;
+
   void wait(std::chrono::milliseconds timeout);
   void cancelAndWait();
   void canceled() override;
@@ -162,9 +184,14 @@ class McClientRequestContextSync :
   Baton baton_;
 };
 
+/**
+ * Allocated per async request, recycled through a per thread free list.
+ */
 template <class Operation, class Request, class F>
 class McClientRequestContextAsync :
-      public McClientRequestContextCommon<Operation, Request> {
+      public McClientRequestContextCommon<Operation, Request>,
+      public FreeListAllocated<McClientRequestContextAsync<Operation, Request,
+                                                           F>> {
  public:
   template <class G>
   McClientRequestContextAsync(Operation, const Request& request,
@@ -0,0 +1,72 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "McClientSendQueue.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace facebook { namespace memcache {
+
+McClientSendQueue::McClientSendQueue(const Weights& weights) {
+  for (auto weight : weights) {
+    if (weight != 0) {
+      enabled_ = true;
+    }
+  }
+  for (size_t i = 0; i < kNumRequestPriorities; ++i) {
+    // A lane with weight 0 would never get a turn
+    weights_[i] = enabled_ ? std::max<uint32_t>(weights[i], 1) : 1;
+  }
+  credits_ = weights_;
+}
+
+McClientRequestContextBase::Queue& McClientSendQueue::laneOf(
+    const McClientRequestContextBase& req) {
+  return lanes_[enabled_ ? static_cast<size_t>(req.priority) : 0];
+}
+
+size_t McClientSendQueue::nextLane() {
+  assert(!empty());
+  while (true) {
+    for (size_t i = 0; i < kNumRequestPriorities; ++i) {
+      if (credits_[i] > 0 && !lanes_[i].empty()) {
+        return i;
+      }
+    }
+    // every lane with queued requests used up its share, next round
+    credits_ = weights_;
+  }
+}
+
+void McClientSendQueue::pushBack(McClientRequestContextBase::UniquePtr req) {
+  auto& lane = laneOf(*req);
+  lane.pushBack(std::move(req));
+  ++size_;
+}
+
+McClientRequestContextBase& McClientSendQueue::front() {
+  return lanes_[nextLane()].front();
+}
+
+McClientRequestContextBase::UniquePtr McClientSendQueue::popFront() {
+  auto lane = nextLane();
+  --credits_[lane];
+  --size_;
+  return lanes_[lane].popFront();
+}
+
+McClientRequestContextBase::UniquePtr McClientSendQueue::extract(
+    McClientRequestContextBase& req) {
+  auto& lane = laneOf(req);
+  --size_;
+  return lane.extract(lane.iterator_to(req));
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "mcrouter/lib/RequestPriority.h"
+#include "mcrouter/lib/network/McClientRequestContext.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Requests of an AsyncMcClient waiting to be written, in one FIFO lane per
+ * RequestPriority.
+ *
+ * Requests are popped by weighted round robin: in each round, every lane
+ * gets up to its weight of requests popped, lanes of more important
+ * priorities (lower RequestPriority values) first. So however busy the
+ * other lanes are, a lane waits for at most the sum of their weights
+ * between its turns.
+ *
+ * If all weights are 0, all requests share one lane (plain FIFO).
+ */
+class McClientSendQueue {
+ public:
+  typedef std::array<uint32_t, kNumRequestPriorities> Weights;
+
+  explicit McClientSendQueue(const Weights& weights);
+
+  bool empty() const {
+    return size_ == 0;
+  }
+  size_t size() const {
+    return size_;
+  }
+
+  void pushBack(McClientRequestContextBase::UniquePtr req);
+
+  /**
+   * The request popFront() pops next. Must not be empty.
+   */
+  McClientRequestContextBase& front();
+
+  McClientRequestContextBase::UniquePtr popFront();
+
+  /**
+   * Removes a request from anywhere in the queue.
+   */
+  McClientRequestContextBase::UniquePtr extract(
+    McClientRequestContextBase& req);
+
+  /**
+   * Calls f(req) for the queued requests, a lane at a time, until it
+   * returns false.
+   */
+  template <class F>
+  void forEach(F&& f) {
+    for (auto& lane : lanes_) {
+      for (auto& req : lane) {
+        if (!f(req)) {
+          return;
+        }
+      }
+    }
+  }
+
+ private:
+  std::array<McClientRequestContextBase::Queue, kNumRequestPriorities> lanes_;
+  Weights weights_;
+  bool enabled_{false};
+  size_t size_{0};
+
+  // Requests each lane may still pop in the current round.
+  Weights credits_;
+
+  McClientRequestContextBase::Queue& laneOf(
+    const McClientRequestContextBase& req);
+  // Lane front() is taken from, starts the next round if needed.
+  size_t nextLane();
+};
+
+}}  // facebook::memcache
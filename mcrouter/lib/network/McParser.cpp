@@ -11,6 +11,8 @@
 
 #include <folly/Memory.h>
 
+#include "mcrouter/lib/MemoryAccounting.h"
+#include "mcrouter/lib/network/ReadBufferPool.h"
 #include "mcrouter/lib/network/UmbrellaProtocol.h"
 
 namespace facebook { namespace memcache {
@@ -24,74 +26,130 @@ const double kBprDecay = 0.9;
 McParser::McParser(ServerParseCallback* callback,
                    size_t requestsPerRead,
                    size_t minBufferSize,
-                   size_t maxBufferSize)
+                   size_t maxBufferSize,
+                   ReadBufferPool* readBufferPool)
     : type_(ParserType::SERVER),
       serverParseCallback_(callback),
       messagesPerRead_(requestsPerRead),
       minBufferSize_(minBufferSize),
       maxBufferSize_(maxBufferSize),
       bufferSize_(maxBufferSize),
-      readBuffer_(folly::IOBuf::CREATE, bufferSize_) {
+      readBuffer_(readBufferPool
+                  ? folly::IOBuf()
+                  : folly::IOBuf(folly::IOBuf::CREATE, bufferSize_)),
+      readBufferPool_(readBufferPool) {
   assert(serverParseCallback_ != nullptr);
   mc_parser_init(&mcParser_,
                  request_parser,
                  &parserMsgReady,
                  &parserParseError,
                  this);
+  accountBuffers();
 }
 
 McParser::McParser(ClientParseCallback* callback,
                    size_t repliesPerRead,
                    size_t minBufferSize,
-                   size_t maxBufferSize)
+                   size_t maxBufferSize,
+                   ReadBufferPool* readBufferPool)
     : type_(ParserType::CLIENT),
       clientParseCallback_(callback),
       messagesPerRead_(repliesPerRead),
       minBufferSize_(minBufferSize),
       maxBufferSize_(maxBufferSize),
       bufferSize_(maxBufferSize),
-      readBuffer_(folly::IOBuf::CREATE, bufferSize_) {
+      readBuffer_(readBufferPool
+                  ? folly::IOBuf()
+                  : folly::IOBuf(folly::IOBuf::CREATE, bufferSize_)),
+      readBufferPool_(readBufferPool) {
   assert(clientParseCallback_ != nullptr);
   mc_parser_init(&mcParser_,
                  reply_parser,
                  &parserMsgReady,
                  &parserParseError,
                  this);
+  accountBuffers();
 }
 
 McParser::~McParser() {
   mc_parser_reset(&mcParser_);
+  if (readBufferPool_) {
+    readBufferPool_->release(readBuffer_);
+  }
+  MemoryAccounting::sub(MemoryTag::kReadBuffers, accountedBufferBytes_);
+}
+
+void McParser::accountBuffers() {
+  auto bytes = readBuffer_.capacity() +
+    (bodyBuffer_ ? bodyBuffer_->capacity() : 0);
+  if (bytes != accountedBufferBytes_) {
+    MemoryAccounting::add(MemoryTag::kReadBuffers,
+                          static_cast<int64_t>(bytes) -
+                          static_cast<int64_t>(accountedBufferBytes_));
+    accountedBufferBytes_ = bytes;
+  }
 }
 
 void McParser::shrinkBuffers() {
   if (readBuffer_.length() == 0 && bufferShrinkRequired_) {
-    readBuffer_ = folly::IOBuf(folly::IOBuf::CREATE, bufferSize_);
+    if (readBufferPool_) {
+      /* Oversized buffers are dropped by the pool */
+      readBufferPool_->release(readBuffer_);
+    } else {
+      readBuffer_ = folly::IOBuf(folly::IOBuf::CREATE, bufferSize_);
+    }
     bufferShrinkRequired_ = false;
   }
 }
 
+void McParser::releaseReadBuffer() {
+  if (readBufferPool_ && !bodyBuffer_ && readBuffer_.empty()) {
+    bufferShrinkRequired_ = false;
+    readBufferPool_->release(readBuffer_);
+  }
+}
+
 std::pair<void*, size_t> McParser::getReadBuffer() {
-  if (protocol_ == mc_umbrella_protocol
-      && umBodyBuffer_) {
-    /* We're reading in umbrella message body */
-    return std::make_pair(umBodyBuffer_->writableTail(),
-                          umMsgInfo_.body_size - umBodyBuffer_->length());
-  } else {
-    readBuffer_.unshare();
-    if (!readBuffer_.length() && readBuffer_.capacity() > 0) {
-      /* If we read everything, reset pointers to 0 and re-use the buffer */
-      readBuffer_.clear();
-    } else if (readBuffer_.headroom() > 0) {
-      /* Move partially read data to the beginning */
-      readBuffer_.retreat(readBuffer_.headroom());
-    } else {
-      /* Reallocate more space if necessary */
-      bufferShrinkRequired_ = true;
-      readBuffer_.reserve(0, bufferSize_);
+  SCOPE_EXIT {
+    accountBuffers();
+  };
+
+  if (bodyBuffer_) {
+    /* We're reading in an umbrella or binary message body */
+    return std::make_pair(bodyBuffer_->writableTail(),
+                          bodyBufferSize() - bodyBuffer_->length());
+  }
+
+  if (protocol_ == mc_ascii_protocol && readBuffer_.empty()) {
+    /* Like umbrella and binary bodies, ascii values that don't fit in a
+       small buffer are read into their final one (the message's value,
+       allocated with the exact size by the parser), so readBuffer_
+       doesn't need to grow for them. */
+    size_t len;
+    auto tail = mc_parser_value_tail(&mcParser_, &len);
+    if (tail != nullptr && len > minBufferSize_) {
+      readingAsciiValue_ = true;
+      return std::make_pair(tail, len);
     }
-    return std::make_pair(readBuffer_.writableTail(),
-                          std::min(readBuffer_.tailroom(), bufferSize_));
   }
+
+  if (readBufferPool_ && readBuffer_.capacity() == 0) {
+    readBuffer_ = readBufferPool_->borrow();
+  }
+  readBuffer_.unshare();
+  if (!readBuffer_.length() && readBuffer_.capacity() > 0) {
+    /* If we read everything, reset pointers to 0 and re-use the buffer */
+    readBuffer_.clear();
+  } else if (readBuffer_.headroom() > 0) {
+    /* Move partially read data to the beginning */
+    readBuffer_.retreat(readBuffer_.headroom());
+  } else {
+    /* Reallocate more space if necessary */
+    bufferShrinkRequired_ = true;
+    readBuffer_.reserve(0, bufferSize_);
+  }
+  return std::make_pair(readBuffer_.writableTail(),
+                        std::min(readBuffer_.tailroom(), bufferSize_));
 }
 
 void McParser::recalculateBufferSize(size_t read) {
@@ -113,6 +171,17 @@ void McParser::recalculateBufferSize(size_t read) {
   readBytes_ = 0;
 }
 
+void McParser::setMessagesPerRead(size_t messagesPerRead) {
+  messagesPerRead_ = messagesPerRead;
+  if (messagesPerRead_ == 0) {
+    bufferSize_ = maxBufferSize_;
+  } else if (bytesPerRequest_ != 0.0) {
+    bufferSize_ = std::max(
+      minBufferSize_,
+      std::min((size_t)bytesPerRequest_ * messagesPerRead_, maxBufferSize_));
+  }
+}
+
 void McParser::errorHelper(McReply reply) {
   switch (type_) {
     case ParserType::SERVER:
@@ -152,10 +221,20 @@ bool McParser::umMessageReady(
         try {
           mc_op_t op;
           uint64_t reqid;
-          auto req = umbrellaParseRequest(bodyBuffer,
-                                          header, umMsgInfo_.header_size,
-                                          body, umMsgInfo_.body_size,
-                                          op, reqid);
+          std::vector<McRequest> batch;
+          auto req = body
+            ? umbrellaParseRequest(bodyBuffer,
+                                   header, umMsgInfo_.header_size,
+                                   body, umMsgInfo_.body_size,
+                                   op, reqid, &batch)
+            : umbrellaParseRequest(header, umMsgInfo_.header_size,
+                                   bodyBuffer, op, reqid, &batch);
+          if (!batch.empty()) {
+            batch.insert(batch.begin(), std::move(req));
+            ++parsedMessages_;
+            serverParseCallback_->batchGetReady(std::move(batch), reqid);
+            break;
+          }
           /* Umbrella requests never include a result and are never 'noreply' */
           requestReadyHelper(std::move(req), op, reqid,
                              /* result= */ mc_res_unknown,
@@ -171,8 +250,39 @@ bool McParser::umMessageReady(
       break;
     case ParserType::CLIENT:
       {
-        auto mutMsg = createMcMsgRef();
+        mc_op_t op;
         uint64_t reqid;
+        McReply reply(mc_res_unknown);
+        try {
+          if (body
+              ? umbrellaParseReply(bodyBuffer,
+                                   header, umMsgInfo_.header_size,
+                                   body, umMsgInfo_.body_size,
+                                   op, reqid, reply)
+              : umbrellaParseReply(header, umMsgInfo_.header_size,
+                                   bodyBuffer, op, reqid, reply)) {
+            replyReadyHelper(std::move(reply), op, reqid);
+            break;
+          }
+        } catch (const std::runtime_error& e) {
+          errorHelper(
+            McReply(mc_res_remote_error,
+                    std::string("Error parsing Umbrella message: ")
+                    + e.what()));
+          return false;
+        }
+
+        /* Rare replies with fields McReply keeps only in mc_msg_t,
+           um_consume_no_copy() needs a contiguous body */
+        folly::IOBuf flatBody;
+        const folly::IOBuf* source = &bodyBuffer;
+        if (!body) {
+          bodyBuffer.cloneInto(flatBody);
+          flatBody.coalesce();
+          body = flatBody.data();
+          source = &flatBody;
+        }
+        auto mutMsg = createMcMsgRef();
         auto st = um_consume_no_copy(header, umMsgInfo_.header_size,
                                      body, umMsgInfo_.body_size,
                                      &reqid, mutMsg.get());
@@ -184,7 +294,7 @@ bool McParser::umMessageReady(
 
         folly::IOBuf value;
         if (mutMsg->value.len != 0) {
-          if (!cloneInto(value, bodyBuffer,
+          if (!cloneInto(value, *source,
                          reinterpret_cast<uint8_t*>(mutMsg->value.str),
                          mutMsg->value.len)) {
             errorHelper(McReply(mc_res_remote_error,
@@ -196,7 +306,7 @@ bool McParser::umMessageReady(
           mutMsg->value.len = 0;
         }
         McMsgRef msg(std::move(mutMsg));
-        auto reply = McReply(msg->result, msg.clone());
+        reply = McReply(msg->result, msg.clone());
         if (value.length() != 0) {
           reply.setValue(std::move(value));
         }
@@ -239,18 +349,96 @@ bool McParser::readUmbrellaData() {
                umMsgInfo_.message_size - readBuffer_.length() >
                minBufferSize_) {
       /* 2) we have the entire header, but body is incomplete.
-         Copy the partially read body into the new buffer.
-         TODO: this copy could be eliminated, but needs
-         some modification of umbrella library. */
-      auto partial = readBuffer_.length() - umMsgInfo_.header_size;
-      umBodyBuffer_ = folly::IOBuf::copyBuffer(
-        readBuffer_.data() + umMsgInfo_.header_size,
+         The partially read body stays in readBuffer_ and the rest is
+         read into a buffer of its own, the two are parsed as a chain. */
+      bodyBuffer_ = folly::IOBuf::create(
+        umMsgInfo_.message_size - readBuffer_.length());
+      return true;
+    }
+    /* 3) else header is incomplete */
+    return true;
+  }
+  return true;
+}
+
+bool McParser::binaryMessageReady(const uint8_t* body,
+                                  const folly::IOBuf& bodyBuffer) {
+  switch (type_) {
+    case ParserType::SERVER:
+      {
+        mc_op_t op;
+        mc_res_t result;
+        McRequest req;
+        try {
+          req = binaryParseRequest(bodyBuffer, binMsgInfo_, body, op, result);
+        } catch (const std::runtime_error& e) {
+          errorHelper(
+            McReply(mc_res_remote_error,
+                    std::string("Error parsing binary message: ")
+                    + e.what()));
+          return false;
+        }
+        ++parsedMessages_;
+        serverParseCallback_->binaryRequestReady(std::move(req), op,
+                                                 binMsgInfo_.opcode,
+                                                 binMsgInfo_.opaque, result);
+      }
+      break;
+    case ParserType::CLIENT:
+      {
+        mc_op_t op;
+        McReply reply(mc_res_unknown);
+        try {
+          reply = binaryParseReply(bodyBuffer, binMsgInfo_, body, op);
+        } catch (const std::runtime_error& e) {
+          errorHelper(
+            McReply(mc_res_remote_error,
+                    std::string("Error parsing binary message: ")
+                    + e.what()));
+          return false;
+        }
+        replyReadyHelper(std::move(reply), op, binMsgInfo_.opaque);
+      }
+      break;
+  }
+  return true;
+}
+
+bool McParser::readBinaryData() {
+  while (!readBuffer_.empty()) {
+    auto st = binaryParseHeader(readBuffer_.data(),
+                                readBuffer_.length(),
+                                binMsgInfo_);
+    if (st == BinaryParseStatus::kNotEnoughData) {
+      return true;
+    }
+
+    if (st != BinaryParseStatus::kOk) {
+      errorHelper(McReply(mc_res_remote_error,
+                          "Error parsing binary header"));
+      return false;
+    }
+
+    /* Same three cases as in readUmbrellaData() */
+    if (readBuffer_.length() >= binMsgInfo_.messageSize()) {
+      if (!binaryMessageReady(readBuffer_.data() + kBinaryHeaderSize,
+                              readBuffer_)) {
+        readBuffer_.clear();
+        return false;
+      }
+      readBuffer_.trimStart(binMsgInfo_.messageSize());
+      continue;
+    } else if (binMsgInfo_.messageSize() - readBuffer_.length() >
+               minBufferSize_) {
+      /* The header is complete, since binaryParseHeader() returned kOk */
+      auto partial = readBuffer_.length() - kBinaryHeaderSize;
+      bodyBuffer_ = folly::IOBuf::copyBuffer(
+        readBuffer_.data() + kBinaryHeaderSize,
         partial,
         /* headroom= */ 0,
-        /* minTailroom= */ umMsgInfo_.body_size - partial);
+        /* minTailroom= */ binMsgInfo_.bodyLength - partial);
       return true;
     }
-    /* 3) else header is incomplete */
     return true;
   }
   return true;
@@ -261,16 +449,32 @@ bool McParser::readDataAvailable(size_t len) {
     if (messagesPerRead_ > 0) {
       recalculateBufferSize(len);
     }
+    releaseReadBuffer();
+    accountBuffers();
   };
 
-  if (umBodyBuffer_) {
-    umBodyBuffer_->append(len);
-    if (umBodyBuffer_->length() == umMsgInfo_.body_size) {
-      auto res = umMessageReady(readBuffer_.data(),
-                                umBodyBuffer_->data(),
-                                *umBodyBuffer_);
+  if (readingAsciiValue_) {
+    readingAsciiValue_ = false;
+    mc_parser_value_append(&mcParser_, len);
+    return true;
+  }
+
+  if (bodyBuffer_) {
+    bodyBuffer_->append(len);
+    if (bodyBuffer_->length() == bodyBufferSize()) {
+      bool res;
+      if (protocol_ == mc_umbrella_protocol) {
+        /* The body starts in readBuffer_, right after the header */
+        folly::IOBuf body;
+        readBuffer_.cloneOneInto(body);
+        body.trimStart(umMsgInfo_.header_size);
+        body.prependChain(std::move(bodyBuffer_));
+        res = umMessageReady(readBuffer_.data(), nullptr, body);
+      } else {
+        res = binaryMessageReady(bodyBuffer_->data(), *bodyBuffer_);
+      }
       readBuffer_.clear();
-      umBodyBuffer_.reset();
+      bodyBuffer_.reset();
       return res;
     }
     return true;
@@ -282,10 +486,19 @@ bool McParser::readDataAvailable(size_t len) {
 
     if (UNLIKELY(!seenFirstByte_)) {
       seenFirstByte_ = true;
-      protocol_ = mc_parser_determine_protocol(*readBuffer_.data());
+      auto firstByte = *readBuffer_.data();
+      if (firstByte == kBinaryRequestMagic ||
+          firstByte == kBinaryResponseMagic) {
+        protocol_ = mc_binary_protocol;
+      } else {
+        protocol_ = mc_parser_determine_protocol(firstByte);
+      }
       if (protocol_ == mc_umbrella_protocol) {
         outOfOrder_ = true;
-      } else if (protocol_ == mc_ascii_protocol) {
+      } else if (protocol_ == mc_ascii_protocol ||
+                 protocol_ == mc_binary_protocol) {
+        /* Binary protocol replies are matched to requests in order,
+           like memcached sends them */
         outOfOrder_ = false;
       } else {
         return false;
@@ -296,6 +509,10 @@ bool McParser::readDataAvailable(size_t len) {
       const bool ret = readUmbrellaData();
       shrinkBuffers(); /* no-op if buffer is not large */
       return ret;
+    } else if (protocol_ == mc_binary_protocol) {
+      const bool ret = readBinaryData();
+      shrinkBuffers(); /* no-op if buffer is not large */
+      return ret;
     } else {
       /* mc_parser only works with contiguous blocks */
       auto bytes = readBuffer_.coalesce();
@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <vector>
+
 #include <folly/io/IOBufQueue.h>
 
 #include "mcrouter/lib/mc/parser.h"
@@ -16,9 +18,12 @@
 #include "mcrouter/lib/McMsgRef.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/BinaryProtocol.h"
 
 namespace facebook { namespace memcache {
 
+class ReadBufferPool;
+
 class McParser {
  public:
 
@@ -42,6 +47,28 @@ class McParser {
                               mc_res_t result,
                               bool noreply) = 0;
 
+    /**
+     * Called on every new binary protocol request.
+     * @param opcode, opaque  Must be echoed in the reply.
+     * @param result  mc_res_bad_key or mc_res_unknown, see requestReady().
+     *                Requests with unsupported opcodes come in with
+     *                operation == mc_op_unknown.
+     */
+    virtual void binaryRequestReady(McRequest&& req,
+                                    mc_op_t operation,
+                                    uint8_t opcode,
+                                    uint32_t opaque,
+                                    mc_res_t result) = 0;
+
+    /**
+     * Called on every new umbrella batched get, i.e. a single get
+     * request with several keys.
+     * @param reqs   One mc_op_get request per key, in request order.
+     * @param reqid  Shared by all replies to the batch.
+     */
+    virtual void batchGetReady(std::vector<McRequest>&& reqs,
+                               uint64_t reqid) = 0;
+
     /**
      * Called on fatal parse error (the stream should normally be closed)
      */
@@ -65,15 +92,22 @@ class McParser {
     virtual void parseError(McReply errorReply) = 0;
   };
 
+  /**
+   * @param readBufferPool  If not null, the read buffer is borrowed from
+   *                        this pool on every read and returned as soon as
+   *                        all read data was parsed. Must outlive the parser.
+   */
   McParser(ServerParseCallback* cb,
            size_t requestsPerRead,
            size_t minBufferSize,
-           size_t maxBufferSize);
+           size_t maxBufferSize,
+           ReadBufferPool* readBufferPool = nullptr);
 
   McParser(ClientParseCallback* cb,
            size_t repliesPerRead,
            size_t minBufferSize,
-           size_t maxBufferSize);
+           size_t maxBufferSize,
+           ReadBufferPool* readBufferPool = nullptr);
 
   ~McParser();
 
@@ -102,6 +136,13 @@ class McParser {
    */
   bool readDataAvailable(size_t len);
 
+  /**
+   * Change the number of messages the buffer size is adjusted to
+   * (requestsPerRead/repliesPerRead of the constructor).
+   * 0 means the buffer size is always maxBufferSize.
+   */
+  void setMessagesPerRead(size_t messagesPerRead);
+
  private:
   bool seenFirstByte_{false};
   bool outOfOrder_{false};
@@ -134,6 +175,15 @@ class McParser {
   double bytesPerRequest_{0.0};
 
   folly::IOBuf readBuffer_;
+  ReadBufferPool* readBufferPool_{nullptr};
+
+  /**
+   * True if the last getReadBuffer() returned the tail of the ascii value
+   * being read (more than minBufferSize_ bytes of it left), which is then
+   * read in place instead of copied out of readBuffer_. The ascii
+   * counterpart of bodyBuffer_ below.
+   */
+  bool readingAsciiValue_{false};
 
   /**
    * If we've read an umbrella header, this will contain header/body sizes.
@@ -141,10 +191,32 @@ class McParser {
   um_message_info_t umMsgInfo_{0, 0, 0};
 
   /**
-   * If this is nonempty, we're currently reading in umbrella message body.
-   * We know we're done when this has as much data as umMsgInfo_.body_size
+   * If we've read a binary protocol header, this will contain its fields.
+   */
+  BinaryMessageInfo binMsgInfo_;
+
+  /**
+   * If this is nonempty, we're currently reading in an umbrella or binary
+   * message body. We know we're done when this has bodyBufferSize() bytes.
+   * For umbrella, it only holds the part of the body that wasn't already in
+   * readBuffer_.
    */
-  std::unique_ptr<folly::IOBuf> umBodyBuffer_;
+  std::unique_ptr<folly::IOBuf> bodyBuffer_;
+
+  /* Capacity of the buffers above last reported to MemoryAccounting */
+  size_t accountedBufferBytes_{0};
+
+  /**
+   * Reports the change in capacity of the read buffers since the last call
+   * to MemoryAccounting.
+   */
+  void accountBuffers();
+
+  size_t bodyBufferSize() const {
+    return protocol_ == mc_umbrella_protocol
+      ? umMsgInfo_.message_size - readBuffer_.length()
+      : binMsgInfo_.bodyLength;
+  }
 
   /**
    * We fully parsed an umbrella message and want to call RequestReady or
@@ -153,7 +225,8 @@ class McParser {
    *
    * @param header      Pointer to a contigous block of header_size bytes
    * @param body        Pointer to a contigous block of body_size bytes,
-   *                    must point inside bodyBuffer.
+   *                    must point inside bodyBuffer. If null, bodyBuffer
+   *                    is the whole body, possibly chained.
    * @param bodyBuffer  Cloneable buffer that holds body bytes.
    * @return            False on any parse errors.
    */
@@ -164,6 +237,17 @@ class McParser {
 
   bool readUmbrellaData();
 
+  /**
+   * We fully parsed a binary protocol message, binMsgInfo_ must be filled
+   * out. Arguments are the same as for umMessageReady().
+   *
+   * @return            False on any parse errors.
+   */
+  bool binaryMessageReady(const uint8_t* body,
+                          const folly::IOBuf& bodyBuffer);
+
+  bool readBinaryData();
+
   void requestReadyHelper(McRequest&& req, mc_op_t operation, uint64_t reqid,
                           mc_res_t result, bool noreply);
   void replyReadyHelper(McReply reply, mc_op_t operation, uint64_t reqid);
@@ -175,6 +259,11 @@ class McParser {
    */
   void shrinkBuffers();
 
+  /**
+   * Return the read buffer to readBufferPool_ if it's fully consumed.
+   */
+  void releaseReadBuffer();
+
   /* mc_parser callbacks */
   void msgReady(McMsgRef msg, uint64_t reqid);
   void parseError(parser_error_t error);
@@ -15,10 +15,22 @@ McSerializedRequest::McSerializedRequest(const McRequest& req,
                                          mc_protocol_t protocol)
   : protocol_(protocol) {
 
+  if (auto shared = req.sharedSerialization()) {
+    auto form = shared->get(req, McOperation<Op>(), protocol);
+    if (form && reuse(std::move(form), reqId)) {
+      return;
+    }
+  }
+  serialize(req, McOperation<Op>(), reqId);
+}
+
+template<int Op>
+void McSerializedRequest::serialize(const McRequest& req, McOperation<Op>,
+                                    size_t reqId) {
   switch (protocol_) {
     case mc_ascii_protocol:
       new (&asciiRequest_) AsciiSerializedRequest();
-      if (req.key().length() > MC_KEY_MAX_LEN_ASCII) {
+      if (req.fullKey().size() > MC_KEY_MAX_LEN_ASCII) {
         result_ = Result::BAD_KEY;
         return;
       }
@@ -26,6 +38,30 @@ McSerializedRequest::McSerializedRequest(const McRequest& req,
                                  iovsCount_)) {
         result_ = Result::ERROR;
       }
+      noreply_ = asciiRequest_.noreply();
+      break;
+    case mc_ascii_meta_protocol:
+      new (&asciiRequest_) AsciiSerializedRequest();
+      if (req.fullKey().size() > MC_KEY_MAX_LEN_ASCII) {
+        result_ = Result::BAD_KEY;
+        return;
+      }
+      if (!asciiRequest_.prepareMeta(req, McOperation<Op>(), iovsBegin_,
+                                     iovsCount_)) {
+        result_ = Result::ERROR;
+      }
+      noreply_ = asciiRequest_.noreply();
+      break;
+    case mc_binary_protocol:
+      new (&binaryMessage_) BinarySerializedMessage();
+      if (req.fullKey().size() > MC_KEY_MAX_LEN_ASCII) {
+        result_ = Result::BAD_KEY;
+        return;
+      }
+      if (!binaryMessage_.prepare(req, McOperation<Op>(), reqId, iovsBegin_,
+                                  iovsCount_)) {
+        result_ = Result::ERROR;
+      }
       break;
     case mc_umbrella_protocol:
       new (&umbrellaMessage_) UmbrellaSerializedMessage();
@@ -35,13 +71,68 @@ McSerializedRequest::McSerializedRequest(const McRequest& req,
       }
       break;
     case mc_unknown_protocol:
-    case mc_binary_protocol:
     case mc_nprotocols:
       checkLogic(false, "Used unsupported protocol! Value: {}", (int)protocol_);
       result_ = Result::ERROR;
       iovsCount_ = 0;
   }
+}
 
+template<int Op>
+McSerializedRequest::McSerializedRequest(const TypedRequest<Op>& req,
+                                         McOperation<Op>, size_t reqId,
+                                         mc_protocol_t protocol) {
+  /* Typed requests are sent as classic ascii commands */
+  if (protocol != mc_ascii_protocol && protocol != mc_ascii_meta_protocol) {
+    result_ = Result::ERROR;
+    return;
+  }
+
+  protocol_ = protocol;
+  new (&asciiRequest_) AsciiSerializedRequest();
+  if (req.fullKey().size() > MC_KEY_MAX_LEN_ASCII) {
+    result_ = Result::BAD_KEY;
+    return;
+  }
+  if (!asciiRequest_.prepare(req, McOperation<Op>(), iovsBegin_,
+                             iovsCount_)) {
+    result_ = Result::ERROR;
+  }
+}
+
+template<int Op>
+SharedSerializedForm::SharedSerializedForm(const McRequest& req,
+                                           McOperation<Op>,
+                                           mc_protocol_t protocol)
+  : op_(static_cast<mc_op_t>(Op)),
+    protocol_(protocol),
+    valueData_(req.value().data()),
+    valueLength_(req.value().computeChainDataLength()),
+    req_(unsharedCopy(req)),
+    serialized_(req_, McOperation<Op>(), /* reqId= */ 0, protocol) {
+}
+
+template<int Op>
+std::shared_ptr<const SharedSerializedForm>
+SharedSerializedRequest::get(const McRequest& req, McOperation<Op>,
+                             mc_protocol_t protocol) {
+#ifndef LIBMC_FBTRACE_DISABLE
+  /* Clones get their own copy of the fbtrace info */
+  if (req.fbtraceInfo()) {
+    return nullptr;
+  }
+#endif
+  for (size_t i = 0; i < nForms_; ++i) {
+    if (forms_[i]->matches(req, static_cast<mc_op_t>(Op), protocol)) {
+      return forms_[i];
+    }
+  }
+  if (nForms_ == kMaxForms) {
+    return nullptr;
+  }
+  forms_[nForms_] = std::make_shared<SharedSerializedForm>(
+    req, McOperation<Op>(), protocol);
+  return forms_[nForms_++];
 }
 
 }} // facebook::memcache
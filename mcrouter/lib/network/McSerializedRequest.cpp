@@ -9,21 +9,33 @@
  */
 #include "McSerializedRequest.h"
 
+#include <cassert>
+#include <cstring>
+
+#include <folly/Bits.h>
+
 #include "mcrouter/lib/McMsgRef.h"
 #include "mcrouter/lib/McRequest.h"
 
 namespace facebook { namespace memcache {
 
 McSerializedRequest::~McSerializedRequest() {
+  if (shared_) {
+    sharedIovs_.~SharedIovs();
+    return;
+  }
   switch (protocol_) {
     case mc_ascii_protocol:
+    case mc_ascii_meta_protocol:
       asciiRequest_.~AsciiSerializedRequest();
       break;
+    case mc_binary_protocol:
+      binaryMessage_.~BinarySerializedMessage();
+      break;
     case mc_umbrella_protocol:
       umbrellaMessage_.~UmbrellaSerializedMessage();
       break;
     case mc_unknown_protocol:
-    case mc_binary_protocol:
     case mc_nprotocols:
       break;
   }
@@ -33,4 +45,105 @@ McSerializedRequest::Result McSerializedRequest::serializationResult() const {
   return result_;
 }
 
+bool McSerializedRequest::reuse(
+  std::shared_ptr<const SharedSerializedForm> form, size_t reqId) {
+
+  const auto& from = form->serialized_;
+  if (from.result_ != Result::OK ||
+      from.iovsCount_ + 2 > kMaxSharedIovs) {
+    return false;
+  }
+
+  new (&sharedIovs_) SharedIovs;
+  shared_ = true;
+  noreply_ = from.noreply_;
+  auto iovs = sharedIovs_.iovs;
+  size_t niovs = 0;
+  size_t nextIov = 0;
+
+  switch (protocol_) {
+    case mc_binary_protocol:
+      std::memcpy(sharedIovs_.binaryHeader, from.iovsBegin_[0].iov_base,
+                  kBinaryHeaderSize);
+      {
+        /* The low 32 bits of reqid are sent as the opaque */
+        auto opaque = folly::Endian::big(static_cast<uint32_t>(reqId));
+        std::memcpy(sharedIovs_.binaryHeader + kBinaryOpaqueOffset, &opaque,
+                    sizeof(opaque));
+      }
+      iovs[niovs].iov_base = sharedIovs_.binaryHeader;
+      iovs[niovs].iov_len = kBinaryHeaderSize;
+      ++niovs;
+      nextIov = 1;
+      break;
+    case mc_umbrella_protocol:
+      {
+        /* Message header, then the entries around the reqid one */
+        iovs[niovs++] = from.iovsBegin_[0];
+        auto entries =
+          static_cast<const um_elist_entry_t*>(from.iovsBegin_[1].iov_base);
+        auto nEntries = from.iovsBegin_[1].iov_len / sizeof(um_elist_entry_t);
+        auto reqidEntry = UmbrellaSerializedMessage::kReqidEntry;
+        assert(nEntries > reqidEntry);
+
+        iovs[niovs].iov_base = const_cast<um_elist_entry_t*>(entries);
+        iovs[niovs].iov_len = reqidEntry * sizeof(um_elist_entry_t);
+        ++niovs;
+        sharedIovs_.reqidEntry = entries[reqidEntry];
+        sharedIovs_.reqidEntry.data.val =
+          folly::Endian::big(static_cast<uint64_t>(reqId));
+        iovs[niovs].iov_base = &sharedIovs_.reqidEntry;
+        iovs[niovs].iov_len = sizeof(um_elist_entry_t);
+        ++niovs;
+        if (nEntries > reqidEntry + 1) {
+          iovs[niovs].iov_base =
+            const_cast<um_elist_entry_t*>(entries + reqidEntry + 1);
+          iovs[niovs].iov_len =
+            (nEntries - reqidEntry - 1) * sizeof(um_elist_entry_t);
+          ++niovs;
+        }
+        nextIov = 2;
+      }
+      break;
+    default:
+      /* No reqid in ascii requests */
+      break;
+  }
+
+  for (; nextIov < from.iovsCount_; ++nextIov) {
+    iovs[niovs++] = from.iovsBegin_[nextIov];
+  }
+  sharedIovs_.form = std::move(form);
+  iovsBegin_ = iovs;
+  iovsCount_ = niovs;
+  return true;
+}
+
+McRequest SharedSerializedForm::unsharedCopy(const McRequest& req) {
+  auto copy = McRequest::cloneFrom(req);
+  copy.disableSharedSerialization();
+  return copy;
+}
+
+bool SharedSerializedForm::matches(const McRequest& req, mc_op_t op,
+                                   mc_protocol_t protocol) const {
+  /* Every request field a serializer reads, the value by identity:
+     clones share the value buffer */
+  return op == op_ &&
+    protocol == protocol_ &&
+    req.fullKey() == req_.fullKey() &&
+    req.value().data() == valueData_ &&
+    req.value().computeChainDataLength() == valueLength_ &&
+    req.exptime() == req_.exptime() &&
+    req.flags() == req_.flags() &&
+    req.delta() == req_.delta() &&
+    req.leaseToken() == req_.leaseToken() &&
+    req.cas() == req_.cas() &&
+    req.number() == req_.number() &&
+    req.noreply() == req_.noreply() &&
+    req.hasRoutingKeyDigest() == req_.hasRoutingKeyDigest() &&
+    (!req.hasRoutingKeyDigest() ||
+     req.routingKeyDigest() == req_.routingKeyDigest());
+}
+
 }} // facebook::memcache
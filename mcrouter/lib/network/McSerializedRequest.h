@@ -14,12 +14,15 @@
 #include "mcrouter/lib/mc/parser.h"
 #include "mcrouter/lib/mc/protocol.h"
 #include "mcrouter/lib/McMsgRef.h"
+#include "mcrouter/lib/McRequest.h"
 #include "mcrouter/lib/network/AsciiSerialized.h"
+#include "mcrouter/lib/network/BinaryProtocol.h"
 #include "mcrouter/lib/network/UmbrellaProtocol.h"
 
 namespace facebook { namespace memcache {
 
-class McRequest;
+class SharedSerializedForm;
+template <int op> class TypedRequest;
 
 /**
  * A class for serializing memcache requests into iovs.
@@ -37,31 +40,138 @@ class McSerializedRequest {
    *
    * @param req  request to serialize, caller is responsible to keep it alive
    *             for the whole lifecycle of this serialized request.
+   *             If it shares serialized forms with its clones (see
+   *             McRequestBase::enableSharedSerialization()), the iovs of
+   *             the form are reused, with reqId patched in.
    */
   template<int Op>
   McSerializedRequest(const McRequest& req, McOperation<Op>, size_t reqId,
                       mc_protocol_t protocol);
+
+  /**
+   * Same for a typed request (see TypedRequest.h). Only the ascii protocols
+   * are supported for now (always with classic commands), the others result
+   * in Result::ERROR.
+   */
+  template<int Op>
+  McSerializedRequest(const TypedRequest<Op>& req, McOperation<Op>,
+                      size_t reqId, mc_protocol_t protocol);
   ~McSerializedRequest();
 
   McSerializedRequest(const McSerializedRequest&) = delete;
   McSerializedRequest& operator=(const McSerializedRequest&) = delete;
 
   Result serializationResult() const;
+
+  /**
+   * @return true if no reply will come for this request,
+   *         see AsciiSerializedRequest::noreply().
+   */
+  bool noreply() const { return noreply_; }
   size_t getIovsCount() { return iovsCount_; }
   struct iovec* getIovs() { return iovsBegin_; }
 
  private:
   static const size_t kMaxIovs = 20;
+  /* The umbrella entries iovec may be split in three to patch the reqid */
+  static const size_t kMaxSharedIovs = 34;
+
+  /* A shared form's iovs, with the own reqid patched in */
+  struct SharedIovs {
+    std::shared_ptr<const SharedSerializedForm> form;
+    struct iovec iovs[kMaxSharedIovs];
+    union {
+      um_elist_entry_t reqidEntry;
+      uint8_t binaryHeader[kBinaryHeaderSize];
+    };
+  };
 
   union {
     AsciiSerializedRequest asciiRequest_;
+    BinarySerializedMessage binaryMessage_;
     UmbrellaSerializedMessage umbrellaMessage_;
+    SharedIovs sharedIovs_;
   };
 
   struct iovec* iovsBegin_{nullptr};
   size_t iovsCount_{0};
   mc_protocol_t protocol_{mc_unknown_protocol};
   Result result_{Result::OK};
+  bool noreply_{false};
+  /* sharedIovs_ is the active member of the union */
+  bool shared_{false};
+
+  template<int Op>
+  void serialize(const McRequest& req, McOperation<Op>, size_t reqId);
+
+  /**
+   * @return  false if the form can't be reused (it failed to serialize or
+   *          has too many iovs), nothing is initialized then.
+   */
+  bool reuse(std::shared_ptr<const SharedSerializedForm> form, size_t reqId);
+};
+
+/**
+ * A request serialized for an (operation, protocol), to be reused by all
+ * the destinations that get it unchanged (see SharedSerializedRequest).
+ * Owns a copy of the request the iovs point into.
+ */
+class SharedSerializedForm {
+ public:
+  template<int Op>
+  SharedSerializedForm(const McRequest& req, McOperation<Op>,
+                       mc_protocol_t protocol);
+
+  /**
+   * @return  true if req would be serialized to the same bytes
+   *          (up to the reqid) for op over protocol.
+   */
+  bool matches(const McRequest& req, mc_op_t op,
+               mc_protocol_t protocol) const;
+
+ private:
+  const mc_op_t op_;
+  const mc_protocol_t protocol_;
+  /* What the value was, the copy of a chained value may get coalesced */
+  const void* valueData_;
+  size_t valueLength_;
+  McRequest req_;
+  McSerializedRequest serialized_;
+
+  /* A clone of req that doesn't share the forms it's part of */
+  static McRequest unsharedCopy(const McRequest& req);
+
+  friend class McSerializedRequest;
+};
+
+/**
+ * Serialized forms of a request shared by its clones, so that a request
+ * routed unchanged to several destinations (by AllSyncRoute, ShadowRoute,
+ * ...) is serialized once per (operation, protocol) instead of once per
+ * destination. Protocols that send the reqid (umbrella, binary) get a copy
+ * of the few bytes holding it, the rest is shared.
+ *
+ * Clones changed after enableSharedSerialization() (different key,
+ * exptime, ...) don't match any form and are serialized on their own.
+ * Not thread safe: clones and clients of a proxy share its thread.
+ */
+class SharedSerializedRequest {
+ public:
+  /**
+   * @return  form matching req, serialized now if needed; nullptr if
+   *          req isn't shared (e.g. fbtraced) or there are too many forms.
+   */
+  template<int Op>
+  std::shared_ptr<const SharedSerializedForm> get(const McRequest& req,
+                                                  McOperation<Op>,
+                                                  mc_protocol_t protocol);
+
+ private:
+  /* Usually a single destination protocol, up to a few key variants */
+  static const size_t kMaxForms = 4;
+
+  std::shared_ptr<const SharedSerializedForm> forms_[kMaxForms];
+  size_t nForms_{0};
 };
 
 }} // facebook::memcache
@@ -9,6 +9,7 @@
  */
 #include "McServerRequestContext.h"
 
+#include "mcrouter/lib/network/BinaryProtocol.h"
 #include "mcrouter/lib/network/McServerSession.h"
 #include "mcrouter/lib/network/MultiOpParent.h"
 
@@ -40,6 +41,10 @@ bool McServerRequestContext::noReply(const McReply& reply) const {
     return true;
   }
 
+  if (binaryIsQuiet(binaryOpcode_)) {
+    return binaryOmitQuietReply(binaryOpcode_, reply);
+  }
+
   if (!hasParent()) {
     return false;
   }
@@ -76,6 +81,9 @@ McServerRequestContext::McServerRequestContext(
       operation_(other.operation_),
       noReply_(other.noReply_),
       replied_(other.replied_),
+      binaryOpcode_(other.binaryOpcode_),
+      binaryOpaque_(other.binaryOpaque_),
+      requestBytes_(other.requestBytes_),
       reqid_(other.reqid_),
       asciiState_(std::move(other.asciiState_)) {
   other.session_ = nullptr;
@@ -89,6 +97,9 @@ McServerRequestContext& McServerRequestContext::operator=(
   reqid_ = other.reqid_;
   noReply_ = other.noReply_;
   replied_ = other.replied_;
+  binaryOpcode_ = other.binaryOpcode_;
+  binaryOpaque_ = other.binaryOpaque_;
+  requestBytes_ = other.requestBytes_;
   asciiState_ = std::move(other.asciiState_);
   other.session_ = nullptr;
 
@@ -99,7 +110,8 @@ McServerRequestContext::~McServerRequestContext() {
   if (session_) {
     /* Check that a reply was returned */
     assert(replied_);
-    session_->onTransactionCompleted(hasParent() || operation_ == mc_op_end);
+    session_->onTransactionCompleted(hasParent() || operation_ == mc_op_end,
+                                     requestBytes_);
   }
 }
 
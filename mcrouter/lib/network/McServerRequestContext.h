@@ -11,6 +11,7 @@
 
 #include <utility>
 
+#include "mcrouter/lib/fbi/cpp/FreeList.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
 
@@ -26,8 +27,11 @@ class MultiOpParent;
  *
  * Each onRequest callback is provided a context object,
  * which must eventually be surrendered back via a reply() call.
+ * Contexts kept on the heap (e.g. until a proxy replies) are allocated
+ * from a per thread free list.
  */
-class McServerRequestContext {
+class McServerRequestContext :
+      public FreeListAllocated<McServerRequestContext> {
  public:
   /**
    * Notify the server that the request-reply exchange is complete.
@@ -55,8 +59,15 @@ class McServerRequestContext {
   bool noReply_;
   bool replied_{false};
 
+  /* Binary protocol only: echoed in the reply */
+  uint8_t binaryOpcode_{0};
+  uint32_t binaryOpaque_{0};
+  /* Key and value bytes accounted in the session, fits in padding */
+  uint32_t requestBytes_{0};
+
   uint64_t reqid_;
-  struct AsciiState {
+  /* Also keeps the key of binary getk requests, which echo it */
+  struct AsciiState : public FreeListAllocated<AsciiState> {
     std::shared_ptr<MultiOpParent> parent_;
     folly::Optional<folly::IOBuf> key_;
   };
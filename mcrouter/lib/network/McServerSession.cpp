@@ -9,11 +9,18 @@
  */
 #include "McServerSession.h"
 
+#include <algorithm>
 #include <memory>
 
+#include <folly/Bits.h>
+#include <folly/io/async/AsyncSocket.h>
 #include <folly/Memory.h>
 
+#include "mcrouter/lib/network/BinaryProtocol.h"
+#include "mcrouter/lib/ProfileStage.h"
 #include "mcrouter/lib/network/MultiOpParent.h"
+#include "mcrouter/lib/network/ReadScheduler.h"
+#include "mcrouter/lib/network/WriteFlushQueue.h"
 
 namespace facebook { namespace memcache {
 
@@ -46,7 +53,10 @@ McServerSession& McServerSession::create(
   std::function<void(McServerSession&)> onTerminated,
   std::function<void()> onShutdown,
   AsyncMcServerWorkerOptions options,
-  void* userCtxt) {
+  void* userCtxt,
+  ReadBufferPool* readBufferPool,
+  WriteFlushQueue* writeFlushQueue,
+  ReadScheduler* readScheduler) {
 
   auto ptr = new McServerSession(
     std::move(transport),
@@ -55,7 +65,10 @@ McServerSession& McServerSession::create(
     std::move(onTerminated),
     std::move(onShutdown),
     std::move(options),
-    userCtxt
+    userCtxt,
+    readBufferPool,
+    writeFlushQueue,
+    readScheduler
   );
 
   return *ptr;
@@ -68,7 +81,10 @@ McServerSession::McServerSession(
   std::function<void(McServerSession&)> onTerminated,
   std::function<void()> onShutdown,
   AsyncMcServerWorkerOptions options,
-  void* userCtxt)
+  void* userCtxt,
+  ReadBufferPool* readBufferPool,
+  WriteFlushQueue* writeFlushQueue,
+  ReadScheduler* readScheduler)
     : transport_(std::move(transport)),
       onRequest_(std::move(cb)),
       onWriteQuiescence_(std::move(onWriteQuiescence)),
@@ -76,15 +92,33 @@ McServerSession::McServerSession(
       onShutdown_(std::move(onShutdown)),
       options_(std::move(options)),
       userCtxt_(userCtxt),
+      writeFlushQueue_(writeFlushQueue),
+      readScheduler_(readScheduler),
       parser_(this,
               options_.requestsPerRead,
               options_.minBufferSize,
-              options_.maxBufferSize),
+              options_.maxBufferSize,
+              readBufferPool),
       sendWritesCallback_(*this) {
 
+  try {
+    transport_->getPeerAddress(&peerAddress_);
+  } catch (const std::exception& e) {
+    /* Not connected anymore or not a socket: stats are just unattributed */
+  }
   transport_->setReadCB(this);
 }
 
+void McServerSession::setReadLimits(size_t requestsPerRead,
+                                    uint16_t maxReadsPerEvent) {
+  options_.requestsPerRead = requestsPerRead;
+  options_.maxReadsPerEvent = maxReadsPerEvent;
+  parser_.setMessagesPerRead(requestsPerRead);
+  if (auto socket = dynamic_cast<folly::AsyncSocket*>(transport_.get())) {
+    socket->setMaxReadsPerEvent(maxReadsPerEvent);
+  }
+}
+
 void McServerSession::pause(PauseReason reason) {
   pauseState_ |= static_cast<uint64_t>(reason);
 
@@ -108,7 +142,10 @@ void McServerSession::onTransactionStarted(bool isSubRequest) {
 
   ++inFlight_;
   if (!isSubRequest) {
+    updateInFlightTime();
     ++realRequestsInFlight_;
+    ++stats_.requests;
+    stats_.maxInFlight = std::max(stats_.maxInFlight, realRequestsInFlight_);
   }
 
   if (options_.maxInFlight > 0 &&
@@ -117,6 +154,16 @@ void McServerSession::onTransactionStarted(bool isSubRequest) {
   }
 }
 
+void McServerSession::updateInFlightTime() {
+  auto now = std::chrono::steady_clock::now();
+  if (realRequestsInFlight_ > 0) {
+    stats_.inFlightUs += realRequestsInFlight_ *
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        now - inFlightChanged_).count();
+  }
+  inFlightChanged_ = now;
+}
+
 void McServerSession::checkClosed() {
   if (!inFlight_) {
     assert(pendingWrites_.empty());
@@ -138,14 +185,47 @@ void McServerSession::checkClosed() {
   }
 }
 
-void McServerSession::onTransactionCompleted(bool isSubRequest) {
+void McServerSession::onRequestBytes(McServerRequestContext& ctx,
+                                     const McRequest& req) {
+  if (options_.maxInFlightBytes == 0 && !readScheduler_) {
+    return;
+  }
+
+  auto bytes = static_cast<uint32_t>(
+    req.fullKey().size() + req.value().computeChainDataLength());
+  ctx.requestBytes_ = bytes;
+  inFlightBytes_ += bytes;
+  if (options_.maxInFlightBytes > 0 &&
+      inFlightBytes_ >= options_.maxInFlightBytes) {
+    pause(PAUSE_THROTTLED_BYTES);
+  }
+  if (readScheduler_) {
+    readScheduler_->charge(*this, bytes);
+  }
+}
+
+void McServerSession::onTransactionCompleted(bool isSubRequest,
+                                             size_t requestBytes) {
   DestructorGuard dg(this);
 
+  if (requestBytes > 0) {
+    assert(inFlightBytes_ >= requestBytes);
+    inFlightBytes_ -= requestBytes;
+    if (inFlightBytes_ < options_.maxInFlightBytes) {
+      resume(PAUSE_THROTTLED_BYTES);
+    }
+    if (readScheduler_) {
+      readScheduler_->release(requestBytes);
+    }
+  }
+
   assert(inFlight_ > 0);
   --inFlight_;
   if (!isSubRequest) {
     assert(realRequestsInFlight_ > 0);
+    updateInFlightTime();
     --realRequestsInFlight_;
+    ++stats_.completed;
   }
 
   if (options_.maxInFlight > 0 &&
@@ -167,8 +247,18 @@ void McServerSession::reply(McServerRequestContext&& ctx, McReply&& reply) {
       /* head of line reply, write it and all contiguous blocked replies */
       queueWrite(std::move(ctx), std::move(reply));
       auto it = blockedReplies_.find(++headReqid_);
+      if (it == blockedReplies_.end()) {
+        return;
+      }
+      auto now = std::chrono::steady_clock::now();
       while (it != blockedReplies_.end()) {
-        queueWrite(std::move(it->second.first), std::move(it->second.second));
+        auto heldUs = std::chrono::duration_cast<std::chrono::microseconds>(
+          now - it->second.since).count();
+        auto bucket = std::min<size_t>(
+          folly::findLastSet(static_cast<uint64_t>(heldUs)),
+          stats_.blockedUs.size() - 1);
+        ++stats_.blockedUs[bucket];
+        queueWrite(std::move(it->second.ctx), std::move(it->second.reply));
         blockedReplies_.erase(it);
         it = blockedReplies_.find(++headReqid_);
       }
@@ -176,7 +266,8 @@ void McServerSession::reply(McServerRequestContext&& ctx, McReply&& reply) {
       /* can't write this reply now, save for later */
       blockedReplies_.emplace(
         reqid,
-        std::make_pair(std::move(ctx), std::move(reply)));
+        BlockedReply{std::move(ctx), std::move(reply),
+                     std::chrono::steady_clock::now()});
     }
   }
 }
@@ -208,7 +299,13 @@ void McServerSession::getReadBuffer(void** bufReturn, size_t* lenReturn) {
 void McServerSession::readDataAvailable(size_t len) noexcept {
   DestructorGuard dg(this);
 
-  if (!parser_.readDataAvailable(len)) {
+  stats_.bytesIn += len;
+  bool ok;
+  {
+    ProfileStageScope stage(ProfileStage::kParse);
+    ok = parser_.readDataAvailable(len);
+  }
+  if (!ok) {
     close();
   }
 }
@@ -216,15 +313,23 @@ void McServerSession::readDataAvailable(size_t len) noexcept {
 void McServerSession::readEOF() noexcept {
   DestructorGuard dg(this);
 
+  if (options_.cancelRequestsOnEof) {
+    cancelRequests();
+  }
   close();
 }
 
 void McServerSession::readErr(const folly::AsyncSocketException& ex) noexcept {
   DestructorGuard dg(this);
 
+  cancelRequests();
   close();
 }
 
+void McServerSession::cancelRequests() {
+  cancelled_->store(true, std::memory_order_relaxed);
+}
+
 void McServerSession::requestReady(McRequest&& req,
                                    mc_op_t operation,
                                    uint64_t reqid,
@@ -240,6 +345,9 @@ void McServerSession::requestReady(McRequest&& req,
     if (isPartOfMultiget(parser_.protocol(), operation) &&
         !currentMultiop_) {
       currentMultiop_ = std::make_shared<MultiOpParent>(*this, tailReqid_++);
+      if (options_.streamMultiget) {
+        currentMultiop_->unblock();
+      }
     }
 
     if (operation == mc_op_end) {
@@ -257,11 +365,80 @@ void McServerSession::requestReady(McRequest&& req,
     req.key().cloneOneInto(ctx.asciiKey().value());
   }
 
+  processRequest(std::move(ctx), std::move(req), result);
+}
+
+void McServerSession::binaryRequestReady(McRequest&& req,
+                                         mc_op_t operation,
+                                         uint8_t opcode,
+                                         uint32_t opaque,
+                                         mc_res_t result) {
+  DestructorGuard dg(this);
+
+  if (state_ != STREAMING) {
+    return;
+  }
+
+  /* Binary replies are written in order, quiet requests still take
+     a slot and just don't write anything */
+  McServerRequestContext ctx(*this, operation, tailReqid_++);
+  ctx.binaryOpcode_ = opcode;
+  ctx.binaryOpaque_ = opaque;
+  if (binaryReplyHasKey(opcode)) {
+    ctx.asciiKey().emplace();
+    req.key().cloneOneInto(ctx.asciiKey().value());
+  }
+
+  if (operation == mc_op_unknown) {
+    McServerRequestContext::reply(std::move(ctx),
+                                  McReply(mc_res_bad_command));
+    return;
+  }
+
+  processRequest(std::move(ctx), std::move(req), result);
+}
+
+void McServerSession::batchGetReady(std::vector<McRequest>&& reqs,
+                                    uint64_t reqid) {
+  DestructorGuard dg(this);
+
+  if (state_ != STREAMING) {
+    return;
+  }
+
+  /* Same as an ascii multiget, but all contexts share the batch reqid:
+     hits are written as soon as they complete (with their key),
+     misses are dropped and the end context reports errors. */
+  if (options_.prehashBatchKeys) {
+    /* While the keys are still in cache, and without the dispatch of
+       each key in between */
+    for (const auto& req : reqs) {
+      req.routingKeyFurcDigest();
+    }
+  }
+
+  auto parent = std::make_shared<MultiOpParent>(*this, reqid);
+  for (auto& req : reqs) {
+    McServerRequestContext ctx(*this, mc_op_get, reqid, /* noReply= */ false,
+                               parent);
+    ctx.asciiKey().emplace();
+    req.key().cloneOneInto(ctx.asciiKey().value());
+    processRequest(std::move(ctx), std::move(req), mc_res_unknown);
+  }
+  parent->recordEnd(reqid);
+}
+
+void McServerSession::processRequest(McServerRequestContext&& ctx,
+                                     McRequest&& req,
+                                     mc_res_t result) {
   if (result == mc_res_bad_key) {
     McServerRequestContext::reply(std::move(ctx), McReply(mc_res_bad_key));
   } else if (ctx.operation_ == mc_op_version) {
     McServerRequestContext::reply(std::move(ctx),
                                   McReply(mc_res_ok, options_.versionString));
+  } else if (ctx.operation_ == mc_op_echo) {
+    /* Binary protocol noop */
+    McServerRequestContext::reply(std::move(ctx), McReply(mc_res_ok));
   } else if (ctx.operation_ == mc_op_quit) {
     /* mc_op_quit transaction will have `noreply` set, so this call
        is solely to make sure the transaction is completed and cleaned up */
@@ -271,6 +448,7 @@ void McServerSession::requestReady(McRequest&& req,
     McServerRequestContext::reply(std::move(ctx), McReply(mc_res_ok));
     onShutdown_();
   } else {
+    onRequestBytes(ctx, req);
     onRequest_->requestReady(std::move(ctx), std::move(req), ctx.operation_);
   }
 }
@@ -320,6 +498,13 @@ void McServerSession::queueWrite(McServerRequestContext&& ctx,
       transport_->close();
       return;
     }
+    for (size_t k = 0; k < n; ++k) {
+      stats_.bytesOut += i[k].iov_len;
+    }
+    if (writeFlushQueue_) {
+      writeFlushQueue_->recordWrite(1);
+    }
+    ProfileStageScope stage(ProfileStage::kWrite);
     transport_->writev(this, i, n);
     if (!writeBufs_->empty()) {
       /* We only need to pause if the sendmsg() call didn't write everything
@@ -330,9 +515,13 @@ void McServerSession::queueWrite(McServerRequestContext&& ctx,
     pendingWrites_.emplace_back(std::move(ctx), std::move(reply));
 
     if (!writeScheduled_) {
-      auto eventBase = transport_->getEventBase();
-      CHECK(eventBase != nullptr);
-      eventBase->runInLoop(&sendWritesCallback_, /* thisIteration= */ true);
+      if (writeFlushQueue_) {
+        writeFlushQueue_->add(*this);
+      } else {
+        auto eventBase = transport_->getEventBase();
+        CHECK(eventBase != nullptr);
+        eventBase->runInLoop(&sendWritesCallback_, /* thisIteration= */ true);
+      }
       writeScheduled_ = true;
     }
   }
@@ -347,8 +536,10 @@ void McServerSession::sendWrites() {
 
   writeScheduled_ = false;
 
+  ProfileStageScope stage(ProfileStage::kSerialize);
   std::vector<struct iovec> iovs;
   size_t count = 0;
+  size_t bytes = 0;
   while (!pendingWrites_.empty()) {
     auto& pw = pendingWrites_.front();
     struct iovec* i;
@@ -364,12 +555,43 @@ void McServerSession::sendWrites() {
       return;
     }
     pendingWrites_.pop_front();
+
+    size_t replyBytes = 0;
+    for (size_t k = 0; k < n; ++k) {
+      replyBytes += i[k].iov_len;
+    }
+    /* Start a new batch if this reply doesn't fit, a single reply
+       is never split */
+    if (count > 0 &&
+        ((options_.maxWriteIovs != 0 &&
+          iovs.size() + n > options_.maxWriteIovs) ||
+         (options_.maxWriteBytes != 0 &&
+          bytes + replyBytes > options_.maxWriteBytes))) {
+      writeBatch(iovs, count);
+      count = 0;
+      bytes = 0;
+    }
     ++count;
+    bytes += replyBytes;
+    stats_.bytesOut += replyBytes;
     iovs.insert(iovs.end(), i, i + n);
   }
-  writeBatches_.push_back(count);
+  if (count > 0) {
+    writeBatch(iovs, count);
+  }
+}
 
+void McServerSession::writeBatch(std::vector<struct iovec>& iovs,
+                                 size_t count) {
+  // writev may call writeSuccess/writeErr inline
+  writeBatches_.push_back(count);
+  if (writeFlushQueue_) {
+    writeFlushQueue_->recordWrite(count);
+  }
+  ProfileStageScope stage(ProfileStage::kWrite);
+  // the transport copies iovecs it can't write right away
   transport_->writev(this, iovs.data(), iovs.size());
+  iovs.clear();
 }
 
 void McServerSession::completeWrite() {
@@ -407,6 +629,8 @@ void McServerSession::writeErr(
   const folly::AsyncSocketException& ex) noexcept {
 
   DestructorGuard dg(this);
+  /* the replies still to come won't make it either */
+  cancelRequests();
   completeWrite();
 }
 
@@ -9,10 +9,18 @@
  */
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 #include <folly/IntrusiveList.h>
 #include <folly/io/async/AsyncTransport.h>
 #include <folly/io/async/DelayedDestruction.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/SocketAddress.h>
 
 #include "mcrouter/lib/network/AsyncMcServerWorkerOptions.h"
 #include "mcrouter/lib/network/McParser.h"
@@ -22,6 +30,9 @@
 namespace facebook { namespace memcache {
 
 class McServerOnRequest;
+class ReadBufferPool;
+class ReadScheduler;
+class WriteFlushQueue;
 
 /**
  * A session owns a single transport, and processes the request/reply stream.
@@ -33,10 +44,18 @@ class McServerSession :
       private McParser::ServerParseCallback {
  private:
   folly::SafeIntrusiveListHook hook_;
+  /* Linked while waiting in WriteFlushQueue */
+  folly::IntrusiveListHook flushHook_;
+  /* Linked while waiting for its turn to read in ReadScheduler */
+  folly::IntrusiveListHook readHook_;
 
  public:
   using Queue = folly::CountedIntrusiveList<McServerSession,
                                             &McServerSession::hook_>;
+  using FlushQueue = folly::IntrusiveList<McServerSession,
+                                          &McServerSession::flushHook_>;
+  using ReadQueue = folly::IntrusiveList<McServerSession,
+                                         &McServerSession::readHook_>;
 
   /**
    * Creates a new session.  Sessions manage their own lifetime.
@@ -59,6 +78,11 @@ class McServerSession :
    *
    * @param transport  Connected transport; transfers ownership inside
    *                   this session.
+   * @param readBufferPool  If not null, read buffers are borrowed from this
+   *                        pool only while there's data to parse.
+   * @param writeFlushQueue  If not null, batched replies are written by this
+   *                         queue's flush, otherwise the session schedules
+   *                         its own loop callback.
    */
   static McServerSession& create(
     folly::AsyncTransportWrapper::UniquePtr transport,
@@ -67,7 +91,10 @@ class McServerSession :
     std::function<void(McServerSession&)> onTerminated,
     std::function<void()> onShutdown,
     AsyncMcServerWorkerOptions options,
-    void* userCtxt);
+    void* userCtxt,
+    ReadBufferPool* readBufferPool = nullptr,
+    WriteFlushQueue* writeFlushQueue = nullptr,
+    ReadScheduler* readScheduler = nullptr);
 
   /**
    * Eventually closes the transport. All pending writes will still be drained.
@@ -75,6 +102,17 @@ class McServerSession :
    */
   void close();
 
+  /**
+   * Set once replies to this session's requests can't be delivered anymore:
+   * the connection failed, or the client closed it (only with
+   * AsyncMcServerWorkerOptions::cancelRequestsOnEof). Requests still
+   * waiting to be processed or sent out can be dropped then.
+   * May be checked from other threads, and after the session is gone.
+   */
+  std::shared_ptr<const std::atomic<bool>> cancellation() const {
+    return cancelled_;
+  }
+
   /**
    * Returns true if there are some unfinished writes pending to the transport.
    */
@@ -93,6 +131,12 @@ class McServerSession :
     resume(PAUSE_USER);
   }
 
+  /**
+   * Change read limits of this session, see requestsPerRead and
+   * maxReadsPerEvent of AsyncMcServerWorkerOptions.
+   */
+  void setReadLimits(size_t requestsPerRead, uint16_t maxReadsPerEvent);
+
   /**
    * Get the user context associated with this session.
    */
@@ -100,6 +144,44 @@ class McServerSession :
     return userCtxt_;
   }
 
+  /**
+   * Traffic of this connection since it was accepted.
+   */
+  struct Stats {
+    /* Requests read (multiget keys are not counted separately) */
+    uint64_t requests{0};
+    /* Requests whose reply was written (or dropped) */
+    uint64_t completed{0};
+    uint64_t bytesIn{0};
+    /* Bytes of replies handed to the transport */
+    uint64_t bytesOut{0};
+    /* High-water mark of requests in flight */
+    size_t maxInFlight{0};
+    /* Sum over time of requests in flight: by Little's law this is also
+       the sum of latencies (read to write out) of completed requests,
+       without keeping a timestamp per request */
+    uint64_t inFlightUs{0};
+    /* In-order protocols: replies held back until all earlier replies were
+       written, by time held. Bucket 0 counts holds under 1us, bucket i
+       [2^(i-1), 2^i) us, the last bucket also counts all longer holds. */
+    std::array<uint64_t, 20> blockedUs{};
+
+    double avgLatencyUs() const {
+      return completed == 0 ? 0.0 : static_cast<double>(inFlightUs) / completed;
+    }
+  };
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+  /**
+   * Address of the client, empty if the transport doesn't have one.
+   */
+  const folly::SocketAddress& peerAddress() const {
+    return peerAddress_;
+  }
+
  private:
   folly::AsyncTransportWrapper::UniquePtr transport_;
   std::shared_ptr<McServerOnRequest> onRequest_;
@@ -108,6 +190,8 @@ class McServerSession :
   std::function<void()> onShutdown_;
   AsyncMcServerWorkerOptions options_;
   void* userCtxt_{nullptr};
+  WriteFlushQueue* writeFlushQueue_{nullptr};
+  ReadScheduler* readScheduler_{nullptr};
 
   enum State {
     STREAMING,  /* close() was not called */
@@ -119,6 +203,12 @@ class McServerSession :
   };
   State state_{STREAMING};
 
+  /* See cancellation() */
+  std::shared_ptr<std::atomic<bool>> cancelled_{
+    std::make_shared<std::atomic<bool>>(false)};
+
+  void cancelRequests();
+
   McParser parser_;
 
   /* In-order protocol state */
@@ -128,9 +218,12 @@ class McServerSession :
      Out of order replies are stalled in the blockedReplies_ queue. */
   uint64_t headReqid_{0}; /**< Id of next unblocked reply */
   uint64_t tailReqid_{0}; /**< Id to assign to next request */
-  std::unordered_map<
-    uint64_t,
-    std::pair<McServerRequestContext, McReply>> blockedReplies_;
+  struct BlockedReply {
+    McServerRequestContext ctx;
+    McReply reply;
+    std::chrono::steady_clock::time_point since;
+  };
+  std::unordered_map<uint64_t, BlockedReply> blockedReplies_;
 
   /* If non-null, a multi-op operation is being parsed.*/
   std::shared_ptr<MultiOpParent> currentMultiop_;
@@ -173,6 +266,21 @@ class McServerSession :
    */
   size_t realRequestsInFlight_{0};
 
+  /* Key and value bytes of requests in flight,
+     see AsyncMcServerWorkerOptions::maxInFlightBytes */
+  size_t inFlightBytes_{0};
+
+  /* Bytes this session may still read while readScheduler_ is over
+     its limit, see ReadScheduler */
+  int64_t readDeficit_{0};
+
+  Stats stats_;
+  /* Last time realRequestsInFlight_ changed */
+  std::chrono::steady_clock::time_point inFlightChanged_;
+  folly::SocketAddress peerAddress_;
+
+  void updateInFlightTime();
+
   struct SendWritesCallback : public folly::EventBase::LoopCallback {
     explicit SendWritesCallback(McServerSession& session) : session_(session) {}
     void runLoopCallback() noexcept override;
@@ -186,6 +294,8 @@ class McServerSession :
     PAUSE_THROTTLED = 1 << 0,
     PAUSE_WRITE = 1 << 1,
     PAUSE_USER = 1 << 2,
+    PAUSE_THROTTLED_BYTES = 1 << 3,
+    PAUSE_SCHEDULED = 1 << 4,
   };
 
   /* Reads are enabled iff pauseState_ == 0 */
@@ -202,10 +312,16 @@ class McServerSession :
   void resume(PauseReason reason);
 
   /**
-   * Flush pending writes to the transport.
+   * Flush pending writes to the transport, in as few writev calls as
+   * options_.maxWriteIovs/maxWriteBytes allow.
    */
   void sendWrites();
 
+  /**
+   * Write the batch of iovs with replies of `count` requests.
+   */
+  void writeBatch(std::vector<struct iovec>& iovs, size_t count);
+
   /**
    * Check if no outstanding transactions, and close socket and
    * call onTerminated() if so.
@@ -233,8 +349,21 @@ class McServerSession :
                     uint64_t reqid,
                     mc_res_t result,
                     bool noreply) override;
+  void binaryRequestReady(McRequest&& req,
+                          mc_op_t operation,
+                          uint8_t opcode,
+                          uint32_t opaque,
+                          mc_res_t result) override;
+  void batchGetReady(std::vector<McRequest>&& reqs, uint64_t reqid) override;
   void parseError(McReply reply) override;
 
+  /**
+   * Replies to requests the session handles itself, and passes
+   * the rest to onRequest_.
+   */
+  void processRequest(McServerRequestContext&& ctx, McRequest&& req,
+                      mc_res_t result);
+
   /**
    * Must be called after parser has detected the protocol (i.e.
    * at least one request was processed).
@@ -254,7 +383,13 @@ class McServerSession :
     noexcept override;
 
   void onTransactionStarted(bool isSubRequest);
-  void onTransactionCompleted(bool isSubRequest);
+  void onTransactionCompleted(bool isSubRequest, size_t requestBytes);
+
+  /**
+   * Accounts for the key and value of a request passed to onRequest_,
+   * released by onTransactionCompleted().
+   */
+  void onRequestBytes(McServerRequestContext& ctx, const McRequest& req);
 
   McServerSession(
     folly::AsyncTransportWrapper::UniquePtr transport,
@@ -263,12 +398,17 @@ class McServerSession :
     std::function<void(McServerSession&)> onTerminated,
     std::function<void()> onShutdown,
     AsyncMcServerWorkerOptions options,
-    void* userCtxt);
+    void* userCtxt,
+    ReadBufferPool* readBufferPool,
+    WriteFlushQueue* writeFlushQueue,
+    ReadScheduler* readScheduler);
 
   McServerSession(const McServerSession&) = delete;
   McServerSession& operator=(const McServerSession&) = delete;
 
   friend class McServerRequestContext;
+  friend class ReadScheduler;
+  friend class WriteFlushQueue;
 };
 
 
@@ -39,6 +39,13 @@ bool MultiOpParent::reply(McReply&& r) {
   return stole;
 }
 
+void MultiOpParent::unblock() {
+  if (blocked_) {
+    blocked_ = false;
+    McServerRequestContext::reply(std::move(block_), McReply());
+  }
+}
+
 void MultiOpParent::recordEnd(uint64_t reqid) {
   end_ = McServerRequestContext(session_, mc_op_end, reqid);
   if (!waiting_) {
@@ -51,7 +58,7 @@ void MultiOpParent::release() {
     reply_ = McReply(mc_res_found);
   }
   McServerRequestContext::reply(std::move(*end_), std::move(*reply_));
-  McServerRequestContext::reply(std::move(block_), McReply());
+  unblock();
 }
 
 }}  // facebook::memcache
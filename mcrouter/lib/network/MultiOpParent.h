@@ -42,6 +42,10 @@ class McServerSession;
  * write anything to the transport (same as if 'noreply' was set).
  *
  * Finally the end context will write out the stored error reply.
+ *
+ * Umbrella batched gets reuse this with all contexts sharing the batch
+ * reqid. Since umbrella is out-of-order, the block_ctx doesn't hold
+ * anything back there: hits are written as they complete.
  */
 class MultiOpParent {
  public:
@@ -61,6 +65,14 @@ class MultiOpParent {
     ++waiting_;
   }
 
+  /**
+   * Reply to the block_ctx right away, so that the sub-request replies are
+   * written as soon as the ones before them are (see
+   * AsyncMcServerWorkerOptions::streamMultiget). Errors are still reported
+   * by the end context, but may then follow hits already written.
+   */
+  void unblock();
+
   /**
    * Notify that we saw an mc_op_end, and create the 'end' context
    * with this id.
@@ -78,6 +90,7 @@ class MultiOpParent {
   size_t waiting_{0};
   folly::Optional<McReply> reply_;
   bool error_{false};
+  bool blocked_{true};
 
   McServerSession& session_;
   McServerRequestContext block_;
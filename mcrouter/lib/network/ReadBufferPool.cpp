@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ReadBufferPool.h"
+
+#include "mcrouter/lib/MemoryAccounting.h"
+
+namespace facebook { namespace memcache {
+
+ReadBufferPool::ReadBufferPool(size_t bufferSize, size_t maxBuffers)
+    : bufferSize_(bufferSize),
+      maxBuffers_(maxBuffers) {
+  buffers_.reserve(maxBuffers_);
+}
+
+ReadBufferPool::~ReadBufferPool() {
+  MemoryAccounting::sub(MemoryTag::kReadBuffers, stats_.bytesPooled);
+}
+
+folly::IOBuf ReadBufferPool::borrow() {
+  ++stats_.borrows;
+  ++stats_.buffersBorrowed;
+  if (buffers_.empty()) {
+    ++stats_.borrowMisses;
+    return folly::IOBuf(folly::IOBuf::CREATE, bufferSize_);
+  }
+
+  auto buf = std::move(buffers_.back());
+  buffers_.pop_back();
+  --stats_.buffersPooled;
+  stats_.bytesPooled -= buf.capacity();
+  MemoryAccounting::sub(MemoryTag::kReadBuffers, buf.capacity());
+  return buf;
+}
+
+void ReadBufferPool::release(folly::IOBuf& buf) {
+  if (buf.capacity() == 0) {
+    return;
+  }
+  if (stats_.buffersBorrowed > 0) {
+    --stats_.buffersBorrowed;
+  }
+
+  /* Shared buffers are still referenced by parsed requests, and buffers
+     that grew while reading a large message would make the pooled memory
+     unpredictable. Let those go. */
+  if (buffers_.size() < maxBuffers_ &&
+      !buf.isSharedOne() &&
+      buf.capacity() >= bufferSize_ &&
+      buf.capacity() <= 2 * bufferSize_) {
+    buf.clear();
+    stats_.bytesPooled += buf.capacity();
+    MemoryAccounting::add(MemoryTag::kReadBuffers, buf.capacity());
+    ++stats_.buffersPooled;
+    buffers_.push_back(std::move(buf));
+  }
+  buf = folly::IOBuf();
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <vector>
+
+#include <folly/io/IOBuf.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Pool of equally sized read buffers shared by all sessions of a single
+ * AsyncMcServerWorker.
+ *
+ * A session borrows a buffer when its socket becomes readable and hands it
+ * back as soon as everything read was parsed, so idle connections don't hold
+ * any read buffer memory.
+ *
+ * Note: not thread-safe, must be used from the worker's thread only.
+ */
+class ReadBufferPool {
+ public:
+  struct Stats {
+    /* Total capacity of the buffers currently sitting in the pool */
+    uint64_t bytesPooled{0};
+    /* Number of buffers currently sitting in the pool */
+    uint64_t buffersPooled{0};
+    /* Number of buffers currently lent out */
+    uint64_t buffersBorrowed{0};
+    /* Number of borrow() calls */
+    uint64_t borrows{0};
+    /* Number of borrow() calls that had to allocate a new buffer */
+    uint64_t borrowMisses{0};
+  };
+
+  /**
+   * @param bufferSize  Size of every buffer handed out by the pool.
+   * @param maxBuffers  Maximum number of idle buffers kept in the pool,
+   *                    the rest are freed on release.
+   */
+  ReadBufferPool(size_t bufferSize, size_t maxBuffers);
+  ~ReadBufferPool();
+
+  ReadBufferPool(const ReadBufferPool&) = delete;
+  ReadBufferPool& operator=(const ReadBufferPool&) = delete;
+
+  /**
+   * @return  Empty unshared buffer with at least bufferSize() bytes of
+   *          tailroom.
+   */
+  folly::IOBuf borrow();
+
+  /**
+   * Hands the buffer back to the pool, buf is left empty with no capacity.
+   * Buffers that are still shared (e.g. cloned into a request) or have
+   * an unexpected size are released to the allocator instead.
+   */
+  void release(folly::IOBuf& buf);
+
+  size_t bufferSize() const {
+    return bufferSize_;
+  }
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  const size_t bufferSize_;
+  const size_t maxBuffers_;
+  std::vector<folly::IOBuf> buffers_;
+  Stats stats_;
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ReadScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace facebook { namespace memcache {
+
+ReadScheduler::ReadScheduler(folly::EventBase& eventBase,
+                             size_t maxInFlightBytes,
+                             size_t quantumBytes)
+    : eventBase_(eventBase),
+      maxInFlightBytes_(maxInFlightBytes),
+      quantumBytes_(std::max<size_t>(quantumBytes, 1)) {
+  assert(maxInFlightBytes_ > 0);
+}
+
+ReadScheduler::~ReadScheduler() {
+  cancelLoopCallback();
+  waiting_.clear();
+}
+
+void ReadScheduler::charge(McServerSession& session, size_t bytes) {
+  inFlightBytes_ += bytes;
+  if (inFlightBytes_ < maxInFlightBytes_) {
+    return;
+  }
+
+  session.readDeficit_ -= bytes;
+  if (session.readDeficit_ <= 0 && !session.readHook_.is_linked()) {
+    session.pause(McServerSession::PAUSE_SCHEDULED);
+    waiting_.push_back(session);
+    ++pauses_;
+  }
+}
+
+void ReadScheduler::release(size_t bytes) {
+  assert(inFlightBytes_ >= bytes);
+  inFlightBytes_ -= bytes;
+  if (!waiting_.empty() &&
+      inFlightBytes_ < maxInFlightBytes_ &&
+      !isLoopCallbackScheduled()) {
+    eventBase_.runInLoop(this);
+  }
+}
+
+void ReadScheduler::runLoopCallback() noexcept {
+  /* Went over the limit again since this was scheduled,
+     the next release() schedules another round */
+  if (inFlightBytes_ >= maxInFlightBytes_) {
+    return;
+  }
+
+  auto it = waiting_.begin();
+  while (it != waiting_.end()) {
+    auto& session = *it;
+    ++it;
+    /* Unused quanta don't accumulate, a session that was idle
+       can't burst past the others later */
+    session.readDeficit_ =
+      std::min(session.readDeficit_ + quantumBytes_, quantumBytes_);
+    if (session.readDeficit_ > 0) {
+      waiting_.erase(waiting_.iterator_to(session));
+      session.resume(McServerSession::PAUSE_SCHEDULED);
+    }
+  }
+
+  /* Sessions deep in deficit get another quantum next iteration */
+  if (!waiting_.empty()) {
+    eventBase_.runInLoop(this);
+  }
+}
+
+}}  // facebook::memcache
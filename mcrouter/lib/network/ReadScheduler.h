@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/lib/network/McServerSession.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Bytes (keys and values) of requests in flight over all sessions of
+ * a worker, with deficit round robin reads once they reach a limit.
+ *
+ * While the worker is over the limit, every request read is charged to its
+ * session's deficit, and a session whose deficit drops to zero stops
+ * reading. Once enough requests complete, the waiting sessions are granted
+ * one quantum of bytes each per event loop iteration and read again when
+ * their deficit is positive. A client sending large requests digs a deeper
+ * deficit and so waits for proportionally more rounds than one sending
+ * small requests.
+ */
+class ReadScheduler : private folly::EventBase::LoopCallback {
+ public:
+  struct Stats {
+    uint64_t inFlightBytes{0};
+    /* Sessions currently waiting for their turn to read */
+    size_t waitingSessions{0};
+    /* Number of times a session was paused by the scheduler */
+    uint64_t pauses{0};
+  };
+
+  /**
+   * @param maxInFlightBytes  limit of bytes in flight before reads are
+   *                          scheduled, must be non-zero
+   * @param quantumBytes      deficit granted to a waiting session per round
+   */
+  ReadScheduler(folly::EventBase& eventBase,
+                size_t maxInFlightBytes,
+                size_t quantumBytes);
+
+  ~ReadScheduler();
+
+  /**
+   * Account for a request of `bytes` read by session.
+   * Might pause the session's reads.
+   */
+  void charge(McServerSession& session, size_t bytes);
+
+  /**
+   * Account for a completed request of `bytes`.
+   */
+  void release(size_t bytes);
+
+  Stats stats() const {
+    Stats stats;
+    stats.inFlightBytes = inFlightBytes_;
+    stats.waitingSessions = waiting_.size();
+    stats.pauses = pauses_;
+    return stats;
+  }
+
+ private:
+  folly::EventBase& eventBase_;
+  const size_t maxInFlightBytes_;
+  const int64_t quantumBytes_;
+  size_t inFlightBytes_{0};
+  uint64_t pauses_{0};
+  McServerSession::ReadQueue waiting_;
+
+  /* One round over the waiting sessions */
+  void runLoopCallback() noexcept override;
+
+  ReadScheduler(const ReadScheduler&) = delete;
+  ReadScheduler& operator=(const ReadScheduler&) = delete;
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,177 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include <folly/Bits.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Flat open-addressing table from request id to T*.
+ *
+ * Designed for monotonically growing ids (as produced by AsyncMcClientImpl):
+ * the slot of an id is simply (id & mask), so ids of the requests that are in
+ * flight at the same time map into consecutive slots and nearly never
+ * collide. Collisions are resolved with linear probing and erase uses
+ * backward shift deletion, so there are no tombstones and lookups always stop
+ * at the first empty slot.
+ *
+ * Id 0 is reserved as an empty slot marker and can't be inserted.
+ *
+ * Note: not thread-safe.
+ */
+template <class T>
+class RequestIdMap {
+ public:
+  explicit RequestIdMap(size_t capacity = kMinCapacity) {
+    rehash(normalizeCapacity(capacity));
+  }
+
+  RequestIdMap(const RequestIdMap&) = delete;
+  RequestIdMap& operator=(const RequestIdMap&) = delete;
+
+  /**
+   * Make sure we can store at least n entries without growing the table.
+   */
+  void reserve(size_t n) {
+    auto capacity = normalizeCapacity(n * 2);
+    if (capacity > table_.size()) {
+      rehash(capacity);
+    }
+  }
+
+  /**
+   * Insert (or overwrite) entry with given id.
+   */
+  void insert(uint64_t id, T* value) {
+    assert(id != 0);
+    if ((size_ + 1) * 2 > table_.size()) {
+      rehash(table_.size() * 2);
+    }
+    auto idx = id & mask_;
+    while (table_[idx].id != 0) {
+      if (table_[idx].id == id) {
+        table_[idx].value = value;
+        return;
+      }
+      idx = (idx + 1) & mask_;
+    }
+    table_[idx] = Entry{id, value};
+    ++size_;
+  }
+
+  /**
+   * @return  pointer stored with given id, nullptr if there's no such entry.
+   */
+  T* find(uint64_t id) const {
+    auto idx = findIndex(id);
+    return idx == kNotFound ? nullptr : table_[idx].value;
+  }
+
+  /**
+   * Remove entry with given id, noop if there's no such entry.
+   */
+  void erase(uint64_t id) {
+    auto hole = findIndex(id);
+    if (hole == kNotFound) {
+      return;
+    }
+    // Backward shift deletion: move every entry of the probe chain, that
+    // would become unreachable, into the hole.
+    auto idx = hole;
+    while (true) {
+      idx = (idx + 1) & mask_;
+      if (table_[idx].id == 0) {
+        break;
+      }
+      auto home = table_[idx].id & mask_;
+      bool reachable = hole <= idx ? (hole < home && home <= idx)
+                                   : (hole < home || home <= idx);
+      if (!reachable) {
+        table_[hole] = table_[idx];
+        hole = idx;
+      }
+    }
+    table_[hole] = Entry();
+    --size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t capacity() const {
+    return table_.size();
+  }
+
+ private:
+  static constexpr size_t kMinCapacity = 16;
+  static constexpr size_t kNotFound = static_cast<size_t>(-1);
+
+  struct Entry {
+    uint64_t id{0};
+    T* value{nullptr};
+
+    Entry() = default;
+    Entry(uint64_t id_, T* value_) : id(id_), value(value_) {}
+  };
+
+  std::vector<Entry> table_;
+  size_t mask_{0};
+  size_t size_{0};
+
+  static size_t normalizeCapacity(size_t capacity) {
+    return capacity <= kMinCapacity ? kMinCapacity
+                                    : folly::nextPowTwo(capacity);
+  }
+
+  size_t findIndex(uint64_t id) const {
+    if (id == 0 || size_ == 0) {
+      return kNotFound;
+    }
+    auto idx = id & mask_;
+    while (table_[idx].id != 0) {
+      if (table_[idx].id == id) {
+        return idx;
+      }
+      idx = (idx + 1) & mask_;
+    }
+    return kNotFound;
+  }
+
+  void rehash(size_t capacity) {
+    assert((capacity & (capacity - 1)) == 0);
+    std::vector<Entry> old(capacity);
+    old.swap(table_);
+    mask_ = capacity - 1;
+    size_ = 0;
+    for (const auto& entry : old) {
+      if (entry.id != 0) {
+        insert(entry.id, entry.value);
+      }
+    }
+  }
+};
+
+template <class T>
+constexpr size_t RequestIdMap<T>::kMinCapacity;
+
+template <class T>
+constexpr size_t RequestIdMap<T>::kNotFound;
+
+}}  // facebook::memcache
@@ -0,0 +1,274 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "SSLHandshakePool.h"
+
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+#include <glog/logging.h>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/Memory.h>
+#include <folly/ThreadName.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+uint64_t usSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+void failEarly(int fd, const SSLHandshakePool::Callback& callback) {
+  ::close(fd);
+  ++sslHandshakePoolStats().failed;
+  folly::AsyncSocketException ex(folly::AsyncSocketException::NOT_OPEN,
+                                 "SSL handshake pool is stopped");
+  callback(nullptr, &ex);
+}
+
+}  // anonymous namespace
+
+struct SSLHandshakePool::Thread {
+  folly::EventBase eventBase;
+  std::thread thread;
+  /* Handshakes started on the thread, only touched by it (and by stop()
+     once it's joined) */
+  std::unordered_set<Handshake*> handshakes;
+};
+
+/**
+ * Owns the socket until the handshake is done, then hands it out and
+ * deletes itself.
+ */
+class SSLHandshakePool::Handshake :
+      public folly::AsyncSSLSocket::HandshakeCB,
+      public folly::EventBase::LoopCallback {
+ public:
+  Handshake(Thread& thread,
+            folly::AsyncSSLSocket::UniquePtr socket,
+            folly::AsyncSSLSocket::HandshakeCB* delegate,
+            Callback callback)
+      : thread_(thread),
+        socket_(std::move(socket)),
+        delegate_(delegate),
+        callback_(std::move(callback)),
+        start_(std::chrono::steady_clock::now()) {
+    thread_.handshakes.insert(this);
+  }
+
+  folly::AsyncSSLSocket& socket() {
+    return *socket_;
+  }
+
+  bool handshakeVer(folly::AsyncSSLSocket* sock,
+                    bool preverifyOk,
+                    X509_STORE_CTX* ctx) noexcept override {
+    if (delegate_) {
+      return delegate_->handshakeVer(sock, preverifyOk, ctx);
+    }
+    return preverifyOk;
+  }
+
+  void handshakeSuc(folly::AsyncSSLSocket* sock) noexcept override {
+    if (delegate_) {
+      delegate_->handshakeSuc(sock);
+    }
+    done_ = true;
+    /* The socket still touches its event handlers after this returns,
+       it can only be detached from the next loop iteration on */
+    thread_.eventBase.runInLoop(this);
+  }
+
+  void handshakeErr(folly::AsyncSSLSocket* sock,
+                    const folly::AsyncSocketException& ex) noexcept override {
+    if (delegate_) {
+      delegate_->handshakeErr(sock, ex);
+    }
+    finish(&ex);
+  }
+
+  void runLoopCallback() noexcept override {
+    finish(nullptr);
+  }
+
+  /**
+   * Called by stop() once the thread is joined: hands out the socket if
+   * the handshake is done, fails the handshake otherwise.
+   */
+  void abort() {
+    if (done_) {
+      cancelLoopCallback();
+      finish(nullptr);
+    } else {
+      /* fails the handshake, which calls handshakeErr() */
+      socket_->closeNow();
+    }
+  }
+
+ private:
+  Thread& thread_;
+  folly::AsyncSSLSocket::UniquePtr socket_;
+  folly::AsyncSSLSocket::HandshakeCB* delegate_;
+  Callback callback_;
+  std::chrono::steady_clock::time_point start_;
+  bool done_{false};
+
+  void finish(const folly::AsyncSocketException* error) {
+    auto& stats = sslHandshakePoolStats();
+    stats.handshakeUs += usSince(start_);
+    ++(error ? stats.failed : stats.completed);
+    --stats.pending;
+
+    folly::AsyncSSLSocket::UniquePtr socket;
+    if (!error) {
+      socket_->detachEventBase();
+      socket = std::move(socket_);
+    }
+    auto callback = std::move(callback_);
+    thread_.handshakes.erase(this);
+    /* a failed socket is destroyed here, on its thread */
+    delete this;
+
+    callback(std::move(socket), error);
+  }
+};
+
+SSLHandshakePool::SSLHandshakePool(size_t numThreads) {
+  for (size_t i = 0; i < numThreads; ++i) {
+    auto thread = folly::make_unique<Thread>();
+    auto evb = &thread->eventBase;
+    thread->thread = std::thread([evb]() {
+        evb->loopForever();
+      });
+    folly::setThreadName(thread->thread.native_handle(), "mcrtr-ssl-hs");
+    threads_.push_back(std::move(thread));
+  }
+}
+
+SSLHandshakePool::~SSLHandshakePool() {
+  stop();
+}
+
+void SSLHandshakePool::accept(int fd,
+                              std::shared_ptr<folly::SSLContext> context,
+                              folly::AsyncSSLSocket::HandshakeCB* delegate,
+                              Callback callback) {
+  auto started = start(
+    [fd, context, delegate, callback](Thread& thread) {
+      folly::AsyncSSLSocket::UniquePtr socket(
+        new folly::AsyncSSLSocket(
+          context, &thread.eventBase, fd, /* server = */ true));
+      auto handshake = new Handshake(thread, std::move(socket), delegate,
+                                     callback);
+      handshake->socket().sslAccept(handshake, /* timeout = */ 0);
+    });
+  if (!started) {
+    failEarly(fd, callback);
+  }
+}
+
+void SSLHandshakePool::connect(int fd,
+                               std::shared_ptr<folly::SSLContext> context,
+                               SSL_SESSION* session,
+                               std::chrono::milliseconds timeout,
+                               Callback callback) {
+  /* The session may be freed by its cache before the pool thread gets to
+     it, pass a serialized copy */
+  std::string sessionData;
+  if (session) {
+    auto len = i2d_SSL_SESSION(session, nullptr);
+    if (len > 0) {
+      sessionData.resize(len);
+      auto p = reinterpret_cast<unsigned char*>(&sessionData[0]);
+      i2d_SSL_SESSION(session, &p);
+    }
+  }
+
+  auto started = start(
+    [fd, context, sessionData, timeout, callback](Thread& thread) {
+      folly::AsyncSSLSocket::UniquePtr socket(
+        new folly::AsyncSSLSocket(
+          context, &thread.eventBase, fd, /* server = */ false));
+      if (!sessionData.empty()) {
+        auto p = reinterpret_cast<const unsigned char*>(sessionData.data());
+        if (auto copy = d2i_SSL_SESSION(nullptr, &p, sessionData.size())) {
+          socket->setSSLSession(copy, /* takeOwnership= */ true);
+        }
+      }
+      auto handshake = new Handshake(thread, std::move(socket),
+                                     /* delegate */ nullptr, callback);
+      handshake->socket().sslConn(handshake, timeout.count());
+    });
+  if (!started) {
+    failEarly(fd, callback);
+  }
+}
+
+bool SSLHandshakePool::start(std::function<void(Thread&)> startHandshake) {
+  auto queued = std::chrono::steady_clock::now();
+
+  /* Queued under the lock, so that nothing is queued after the task
+     stop() ends the loops with */
+  std::lock_guard<std::mutex> lock(stopMutex_);
+  if (stopped_ || threads_.empty()) {
+    return false;
+  }
+  auto& thread = *threads_[nextThread_++ % threads_.size()];
+  ++sslHandshakePoolStats().pending;
+  auto result = thread.eventBase.runInEventBaseThread(
+    [&thread, startHandshake, queued]() {
+      sslHandshakePoolStats().queueUs += usSince(queued);
+      startHandshake(thread);
+    });
+  if (!result) {
+    LOG(ERROR) << "Failed to queue an SSL handshake";
+    --sslHandshakePoolStats().pending;
+  }
+  return result;
+}
+
+void SSLHandshakePool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(stopMutex_);
+    if (stopped_) {
+      return;
+    }
+    stopped_ = true;
+    for (auto& thread : threads_) {
+      auto evb = &thread->eventBase;
+      /* runs after all the queued handshakes were started */
+      evb->runInEventBaseThread([evb]() {
+          evb->terminateLoopSoon();
+        });
+    }
+  }
+
+  for (auto& thread : threads_) {
+    thread->thread.join();
+  }
+  for (auto& thread : threads_) {
+    auto handshakes = thread->handshakes;
+    for (auto handshake : handshakes) {
+      handshake->abort();
+    }
+  }
+}
+
+SSLHandshakePoolStats& sslHandshakePoolStats() {
+  static SSLHandshakePoolStats stats;
+  return stats;
+}
+
+}}  // facebook::memcache
@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+#include <folly/io/async/AsyncSSLSocket.h>
+
+namespace folly {
+class SSLContext;
+}
+
+namespace facebook { namespace memcache {
+
+/**
+ * Threads that run SSL handshakes (the RSA/ECDHE operations) off the event
+ * loops that serve requests, so that reconnect storms don't stall them.
+ *
+ * A socket is handed to one of the pool threads (round robin) right after
+ * it was accepted or connected. Once the handshake is done, the socket is
+ * detached from the pool thread and passed to the callback, which hands it
+ * back to its owner's event base (attachEventBase()).
+ */
+class SSLHandshakePool {
+ public:
+  /**
+   * Called on a pool thread (or the thread calling stop()) once the
+   * handshake is done.
+   *
+   * @param socket  established socket, detached from any event base;
+   *                nullptr if the handshake failed
+   * @param error   why it failed, nullptr on success. Only valid during
+   *                the call.
+   */
+  typedef std::function<void(folly::AsyncSSLSocket::UniquePtr socket,
+                             const folly::AsyncSocketException* error)>
+    Callback;
+
+  explicit SSLHandshakePool(size_t numThreads);
+
+  /**
+   * Calls stop().
+   */
+  ~SSLHandshakePool();
+
+  /**
+   * Runs the server side handshake of an accepted connection.
+   *
+   * @param delegate  if not null, verifies the peer certificate and is
+   *                  told about the outcome too (on the pool thread),
+   *                  like a handshake callback of AsyncSSLSocket::sslAccept
+   */
+  void accept(int fd,
+              std::shared_ptr<folly::SSLContext> context,
+              folly::AsyncSSLSocket::HandshakeCB* delegate,
+              Callback callback);
+
+  /**
+   * Runs the client side handshake of a connected socket.
+   *
+   * @param session  session to resume, may be null. It's copied, the
+   *                 caller keeps ownership.
+   * @param timeout  handshake timeout, 0 means none
+   */
+  void connect(int fd,
+               std::shared_ptr<folly::SSLContext> context,
+               SSL_SESSION* session,
+               std::chrono::milliseconds timeout,
+               Callback callback);
+
+  /**
+   * Stops and joins the threads. Handshakes in progress fail, the ones
+   * already done are handed out. Handshakes requested afterwards fail
+   * right away. Safe to call more than once.
+   */
+  void stop();
+
+ private:
+  class Handshake;
+  struct Thread;
+
+  std::vector<std::unique_ptr<Thread>> threads_;
+  std::atomic<size_t> nextThread_{0};
+
+  std::mutex stopMutex_;
+  bool stopped_{false};
+
+  /**
+   * Queues startHandshake on the next thread.
+   *
+   * @return false if the pool is stopped
+   */
+  bool start(std::function<void(Thread&)> startHandshake);
+};
+
+/**
+ * Handshakes run by SSLHandshakePools, for the whole process.
+ * Times are totals (in microseconds), so that rates give averages.
+ */
+struct SSLHandshakePoolStats {
+  /// handshakes queued or running on pool threads right now
+  std::atomic<uint64_t> pending{0};
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> failed{0};
+  /// time handshakes waited for a pool thread
+  std::atomic<uint64_t> queueUs{0};
+  /// time from the start of a handshake until it was done
+  std::atomic<uint64_t> handshakeUs{0};
+};
+
+SSLHandshakePoolStats& sslHandshakePoolStats();
+
+}}  // facebook::memcache
@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "SSLSessionCache.h"
+
+namespace facebook { namespace memcache {
+
+constexpr size_t SSLSessionCache::kMaxSessions;
+
+SSLSessionCache& SSLSessionCache::threadLocal() {
+  thread_local SSLSessionCache cache;
+  return cache;
+}
+
+SSL_SESSION* SSLSessionCache::get(folly::StringPiece key) const {
+  auto it = sessions_.find(key.str());
+  return it != sessions_.end() ? it->second.get() : nullptr;
+}
+
+void SSLSessionCache::put(folly::StringPiece key, SSL_SESSION* session) {
+  if (session == nullptr) {
+    remove(key);
+    return;
+  }
+  if (sessions_.size() >= kMaxSessions) {
+    sessions_.clear();
+  }
+  sessions_[key.str()].reset(session);
+}
+
+void SSLSessionCache::remove(folly::StringPiece key) {
+  sessions_.erase(key.str());
+}
+
+SSLHandshakeStats& clientSSLHandshakeStats() {
+  static SSLHandshakeStats stats;
+  return stats;
+}
+
+SSLHandshakeStats& serverSSLHandshakeStats() {
+  static SSLHandshakeStats stats;
+  return stats;
+}
+
+}}  // facebook::memcache
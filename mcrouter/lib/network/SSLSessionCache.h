@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <openssl/ssl.h>
+
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Client SSL sessions of one thread, keyed by destination (see
+ * AccessPoint::toString()). Reconnects resume the cached session
+ * (by session ticket or session id) instead of doing a full handshake.
+ */
+class SSLSessionCache {
+ public:
+  /* The cache is dropped when it grows beyond this, stale destinations
+     would otherwise accumulate over reconfigurations */
+  static constexpr size_t kMaxSessions = 100000;
+
+  /**
+   * @return cache of the calling thread
+   */
+  static SSLSessionCache& threadLocal();
+
+  /**
+   * @return cached session, nullptr if there's none. The cache keeps
+   *         ownership.
+   */
+  SSL_SESSION* get(folly::StringPiece key) const;
+
+  /**
+   * Replaces the session for the key, takes ownership of the session.
+   */
+  void put(folly::StringPiece key, SSL_SESSION* session);
+
+  void remove(folly::StringPiece key);
+
+  size_t size() const {
+    return sessions_.size();
+  }
+
+ private:
+  struct SessionDeleter {
+    void operator()(SSL_SESSION* session) const {
+      SSL_SESSION_free(session);
+    }
+  };
+
+  std::unordered_map<std::string, std::unique_ptr<SSL_SESSION, SessionDeleter>>
+    sessions_;
+};
+
+/**
+ * Number of completed SSL handshakes by kind, for the whole process.
+ */
+struct SSLHandshakeStats {
+  std::atomic<uint64_t> full{0};
+  std::atomic<uint64_t> resumed{0};
+  /// handshakes after which the kernel encrypts sent records (kTLS)
+  std::atomic<uint64_t> kernelTls{0};
+
+  void record(bool isResumed, bool isKernelTls) {
+    ++(isResumed ? resumed : full);
+    if (isKernelTls) {
+      ++kernelTls;
+    }
+  }
+};
+
+/// Handshakes of outgoing connections (AsyncMcClient)
+SSLHandshakeStats& clientSSLHandshakeStats();
+
+/// Handshakes of accepted connections (AsyncMcServer)
+SSLHandshakeStats& serverSSLHandshakeStats();
+
+}}  // facebook::memcache
@@ -9,6 +9,8 @@
  */
 #include "ThreadLocalSSLContextProvider.h"
 
+#include <openssl/rand.h>
+
 #include <folly/io/async/SSLContext.h>
 #include <unordered_map>
 
@@ -16,6 +18,41 @@ using folly::SSLContext;
 
 namespace facebook { namespace memcache {
 
+namespace {
+
+const char kSessionIdContext[] = "mcrouter";
+
+/**
+ * Session ticket keys shared by all contexts of the process, so that
+ * a ticket issued by one thread (or before a reload) is accepted by all.
+ */
+struct TicketKeys {
+  bool valid{true};
+  unsigned char keys[48];
+
+  TicketKeys() {
+    if (RAND_bytes(keys, sizeof(keys)) != 1) {
+      LOG(ERROR) << "Failed to generate SSL session ticket keys";
+      valid = false;
+    }
+  }
+};
+
+void enableSessionResumption(SSLContext& sslContext) {
+  static TicketKeys ticketKeys;
+  auto ctx = sslContext.getSSLCtx();
+  // required to resume sessions of clients that sent a certificate
+  SSL_CTX_set_session_id_context(
+    ctx, reinterpret_cast<const unsigned char*>(kSessionIdContext),
+    sizeof(kSessionIdContext) - 1);
+  if (ticketKeys.valid) {
+    SSL_CTX_set_tlsext_ticket_keys(ctx, ticketKeys.keys,
+                                   sizeof(ticketKeys.keys));
+  }
+}
+
+}  // anonymous namespace
+
 struct CertPaths {
   folly::StringPiece pemCertPath;
   folly::StringPiece pemKeyPath;
@@ -86,6 +123,7 @@ std::shared_ptr<SSLContext> getSSLContext(folly::StringPiece pemCertPath,
 #ifdef SSL_OP_NO_COMPRESSION
       sslContext->setOptions(SSL_OP_NO_COMPRESSION);
 #endif
+      enableSessionResumption(*sslContext);
       contextInfo.lastLoadTime = now;
       contextInfo.context = std::move(sslContext);
     } catch (const std::exception& ex) {
@@ -21,6 +21,8 @@ namespace facebook { namespace memcache {
  * Manages sets of certificates on per thread basis.
  * Each set will be loaded only once per thread and will be reloaded if it's
  * older than 5 minutes.
+ * All contexts share session ticket keys, so incoming connections can resume
+ * sessions established with any thread of the process.
  */
 std::shared_ptr<folly::SSLContext> getSSLContext(
   folly::StringPiece pemCertPath,
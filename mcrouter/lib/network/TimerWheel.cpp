@@ -0,0 +1,242 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace facebook { namespace memcache {
+
+constexpr size_t TimerWheel::kLevels;
+constexpr size_t TimerWheel::kSlotBits;
+constexpr size_t TimerWheel::kSlots;
+
+namespace {
+
+constexpr uint64_t kSlotMask = TimerWheel::kSlots - 1;
+constexpr uint64_t kMaxTicks =
+  (uint64_t(1) << (TimerWheel::kSlotBits * TimerWheel::kLevels)) - 1;
+
+struct WheelMap {
+  std::mutex mutex;
+  std::unordered_map<folly::EventBase*, std::weak_ptr<TimerWheel>> wheels;
+};
+
+WheelMap& wheelMap() {
+  /* Leaked, wheels may go away during static destruction */
+  static auto map = new WheelMap();
+  return *map;
+}
+
+}  // anonymous namespace
+
+std::shared_ptr<TimerWheel> TimerWheel::get(folly::EventBase& eventBase) {
+  auto& map = wheelMap();
+  std::lock_guard<std::mutex> lck(map.mutex);
+  auto& entry = map.wheels[&eventBase];
+  auto wheel = entry.lock();
+  if (!wheel) {
+    wheel = std::shared_ptr<TimerWheel>(new TimerWheel(eventBase));
+    entry = wheel;
+  }
+  return wheel;
+}
+
+TimerWheel::TimerWheel(folly::EventBase& eventBase)
+    : eventBase_(&eventBase),
+      start_(std::chrono::steady_clock::now()),
+      wakeupTimeout_(*this),
+      destructionCallback_(*this) {
+  eventBase.runOnDestruction(&destructionCallback_);
+}
+
+TimerWheel::~TimerWheel() {
+  detachAll();
+  if (eventBase_ != nullptr) {
+    auto& map = wheelMap();
+    std::lock_guard<std::mutex> lck(map.mutex);
+    auto it = map.wheels.find(eventBase_);
+    /* Might already be replaced by a new wheel */
+    if (it != map.wheels.end() && it->second.expired()) {
+      map.wheels.erase(it);
+    }
+  }
+}
+
+void TimerWheel::Callback::cancelTimeout() {
+  if (wheel_ == nullptr) {
+    return;
+  }
+  hook_.unlink();
+  auto wheel = wheel_;
+  wheel_ = nullptr;
+  if (--wheel->count_ == 0) {
+    /* Don't keep the event base looping */
+    wheel->scheduleWakeup();
+  }
+}
+
+void TimerWheel::scheduleTimeout(Callback& callback,
+                                 std::chrono::milliseconds timeout) {
+  callback.cancelTimeout();
+  if (eventBase_ == nullptr) {
+    return;
+  }
+
+  /* The current tick is partially over, round up so we never fire early */
+  uint64_t ticks = std::max<int64_t>(timeout.count(), 0) + 1;
+  callback.dueTick_ = nowTick() + std::min(ticks, kMaxTicks);
+  callback.wheel_ = this;
+  ++count_;
+  place(callback);
+
+  if (wakeupTick_ == 0) {
+    scheduleWakeup();
+  } else if (callback.dueTick_ < wakeupTick_) {
+    armWakeup(callback.dueTick_);
+  }
+}
+
+uint64_t TimerWheel::nowTick() const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - start_).count();
+}
+
+void TimerWheel::place(Callback& callback) {
+  if (callback.dueTick_ < curTick_) {
+    callback.dueTick_ = curTick_;
+  }
+  auto diff = callback.dueTick_ - curTick_;
+  if (diff > kMaxTicks) {
+    diff = kMaxTicks;
+    callback.dueTick_ = curTick_ + kMaxTicks;
+  }
+
+  size_t level = 0;
+  while (level + 1 < kLevels &&
+         diff >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+  auto idx = (callback.dueTick_ >> (kSlotBits * level)) & kSlotMask;
+  slots_[level][idx].push_back(callback);
+}
+
+void TimerWheel::cascade(size_t level) {
+  auto idx = (curTick_ >> (kSlotBits * level)) & kSlotMask;
+  if (idx == 0 && level + 1 < kLevels) {
+    cascade(level + 1);
+  }
+
+  Slot moved;
+  moved.swap(slots_[level][idx]);
+  while (!moved.empty()) {
+    auto& callback = moved.front();
+    moved.pop_front();
+    place(callback);
+  }
+}
+
+void TimerWheel::advance() {
+  auto now = nowTick();
+  while (curTick_ < now && eventBase_ != nullptr) {
+    if (count_ == 0) {
+      curTick_ = now;
+      break;
+    }
+    ++curTick_;
+    if ((curTick_ & kSlotMask) == 0) {
+      cascade(1);
+    }
+
+    auto& slot = slots_[0][curTick_ & kSlotMask];
+    while (!slot.empty()) {
+      auto& callback = slot.front();
+      slot.pop_front();
+      callback.wheel_ = nullptr;
+      --count_;
+      /* May schedule and cancel other callbacks, or itself */
+      callback.timeoutExpired();
+    }
+  }
+}
+
+void TimerWheel::scheduleWakeup() {
+  if (eventBase_ == nullptr) {
+    return;
+  }
+  if (count_ == 0) {
+    wakeupTimeout_.cancelTimeout();
+    wakeupTick_ = 0;
+    return;
+  }
+
+  /* Next non-empty slot, but don't go past the next cascade */
+  auto tick = curTick_ + 1;
+  while ((tick & kSlotMask) != 0 && slots_[0][tick & kSlotMask].empty()) {
+    ++tick;
+  }
+  armWakeup(tick);
+}
+
+void TimerWheel::armWakeup(uint64_t tick) {
+  wakeupTick_ = tick;
+  auto now = nowTick();
+  wakeupTimeout_.scheduleTimeout(tick > now ? tick - now : 0);
+}
+
+void TimerWheel::detachAll() {
+  for (auto& level : slots_) {
+    for (auto& slot : level) {
+      while (!slot.empty()) {
+        auto& callback = slot.front();
+        slot.pop_front();
+        callback.wheel_ = nullptr;
+      }
+    }
+  }
+  count_ = 0;
+}
+
+void TimerWheel::onEventBaseDestroyed() {
+  detachAll();
+  wakeupTimeout_.cancelTimeout();
+  wakeupTimeout_.detachEventBase();
+  wakeupTick_ = 0;
+  {
+    auto& map = wheelMap();
+    std::lock_guard<std::mutex> lck(map.mutex);
+    auto it = map.wheels.find(eventBase_);
+    if (it != map.wheels.end() && it->second.lock().get() == this) {
+      map.wheels.erase(it);
+    }
+  }
+  eventBase_ = nullptr;
+}
+
+TimerWheel::WakeupTimeout::WakeupTimeout(TimerWheel& wheel)
+    : wheel_(wheel) {
+  attachEventBase(wheel_.eventBase_,
+                  folly::TimeoutManager::InternalEnum::NORMAL);
+}
+
+void TimerWheel::WakeupTimeout::timeoutExpired() noexcept {
+  /* Callbacks may drop the last reference to the wheel */
+  auto guard = wheel_.shared_from_this();
+  wheel_.wakeupTick_ = 0;
+  wheel_.advance();
+  wheel_.scheduleWakeup();
+}
+
+void TimerWheel::DestructionCallback::runLoopCallback() noexcept {
+  wheel_.onEventBaseDestroyed();
+}
+
+}}  // facebook::memcache
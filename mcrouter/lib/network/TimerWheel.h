@@ -0,0 +1,157 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include <folly/IntrusiveList.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Hierarchical timer wheel shared by everything running on one EventBase:
+ * request timeouts of all AsyncMcClients, destination probes, connection
+ * resets.
+ *
+ * Scheduling and cancelling a timer are O(1) regardless of the number of
+ * pending timers and of the order in which they expire. The wheel has
+ * kLevels levels of kSlots slots each, with a 1ms tick on the first level.
+ * Timers further in the future sit on higher levels and are moved down
+ * as their time approaches.
+ *
+ * The wheel only keeps one libevent timer, which is armed while timers are
+ * pending: at the next non-empty slot, or at most kSlots ticks ahead.
+ *
+ * Timers never fire early, they may fire up to one tick late.
+ *
+ * Except for get(), must only be used from the thread of its EventBase.
+ */
+class TimerWheel : public std::enable_shared_from_this<TimerWheel> {
+ public:
+  class Callback {
+   public:
+    Callback() = default;
+    Callback(const Callback&) = delete;
+    Callback& operator=(const Callback&) = delete;
+
+    virtual ~Callback() {
+      cancelTimeout();
+    }
+
+    virtual void timeoutExpired() noexcept = 0;
+
+    /**
+     * No-op if the callback is not scheduled.
+     */
+    void cancelTimeout();
+
+    bool isScheduled() const {
+      return wheel_ != nullptr;
+    }
+
+   private:
+    folly::IntrusiveListHook hook_;
+    TimerWheel* wheel_{nullptr};
+    uint64_t dueTick_{0};
+
+    friend class TimerWheel;
+  };
+
+  static constexpr size_t kLevels = 4;
+  static constexpr size_t kSlotBits = 8;
+  static constexpr size_t kSlots = 1 << kSlotBits;
+
+  /**
+   * @return wheel of the event base, created on first use. The wheel stays
+   *         around while it's referenced, but stops firing timers once the
+   *         event base is destroyed. Thread-safe.
+   */
+  static std::shared_ptr<TimerWheel> get(folly::EventBase& eventBase);
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  ~TimerWheel();
+
+  /**
+   * Schedules (or reschedules) callback to fire after timeout.
+   * Timeouts longer than the span of the wheel (~49 days) are capped.
+   */
+  void scheduleTimeout(Callback& callback, std::chrono::milliseconds timeout);
+
+  /**
+   * Number of scheduled callbacks.
+   */
+  size_t count() const {
+    return count_;
+  }
+
+ private:
+  using Slot = folly::IntrusiveList<Callback, &Callback::hook_>;
+
+  class WakeupTimeout : public folly::AsyncTimeout {
+   public:
+    explicit WakeupTimeout(TimerWheel& wheel);
+    void timeoutExpired() noexcept override;
+   private:
+    TimerWheel& wheel_;
+  };
+
+  class DestructionCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit DestructionCallback(TimerWheel& wheel) : wheel_(wheel) {}
+    void runLoopCallback() noexcept override;
+   private:
+    TimerWheel& wheel_;
+  };
+
+  /* null once the event base is destroyed */
+  folly::EventBase* eventBase_;
+  const std::chrono::steady_clock::time_point start_;
+
+  std::array<std::array<Slot, kSlots>, kLevels> slots_;
+  size_t count_{0};
+  /* All timers due at or before this tick have fired */
+  uint64_t curTick_{0};
+  /* Tick the wakeup timeout is armed for, 0 if it's not armed */
+  uint64_t wakeupTick_{0};
+
+  WakeupTimeout wakeupTimeout_;
+  DestructionCallback destructionCallback_;
+
+  explicit TimerWheel(folly::EventBase& eventBase);
+
+  uint64_t nowTick() const;
+
+  /* Puts the callback into the slot for its dueTick_ */
+  void place(Callback& callback);
+
+  /* Moves the timers of the current slot of level down to lower levels */
+  void cascade(size_t level);
+
+  /* Fires all timers due by now */
+  void advance();
+
+  /* Arms the wakeup timeout for the next tick that needs processing */
+  void scheduleWakeup();
+  void armWakeup(uint64_t tick);
+
+  /* Unschedules all callbacks without firing them */
+  void detachAll();
+
+  void onEventBaseDestroyed();
+};
+
+}}  // facebook::memcache
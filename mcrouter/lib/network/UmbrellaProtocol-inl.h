@@ -35,6 +35,11 @@ bool UmbrellaSerializedMessage::prepare(const McRequest& request,
   if (request.cas()) {
     appendInt(U64, msg_cas, request.cas());
   }
+  /* Free to send if some route hashed the key already, lets the next
+     mcrouter skip hashing it (see --trust-key-digest-hint) */
+  if (request.hasRoutingKeyDigest()) {
+    appendInt(U64, msg_key_digest, request.routingKeyDigest());
+  }
 
   auto key = request.fullKey();
   if (key.begin() != nullptr) {
@@ -42,11 +47,16 @@ bool UmbrellaSerializedMessage::prepare(const McRequest& request,
                  key.size());
   }
 
-  auto valueRange = request.valueRangeSlow();
-  if (valueRange.begin() != nullptr) {
-    appendString(msg_value,
-                 reinterpret_cast<const uint8_t*>(valueRange.begin()),
-                 valueRange.size());
+  const auto& value = request.value();
+  if (value.isChained()) {
+    if (!appendStringChain(msg_value, value)) {
+      auto valueRange = request.valueRangeSlow();
+      appendString(msg_value,
+                   reinterpret_cast<const uint8_t*>(valueRange.begin()),
+                   valueRange.size());
+    }
+  } else if (value.data() != nullptr) {
+    appendString(msg_value, value.data(), value.length());
   }
 
 #ifndef LIBMC_FBTRACE_DISABLE
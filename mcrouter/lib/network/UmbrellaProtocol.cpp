@@ -10,7 +10,9 @@
 #include "UmbrellaProtocol.h"
 
 #include <folly/Bits.h>
+#include <folly/io/Cursor.h>
 
+#include "mcrouter/lib/IOBufUtil.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
 #include "mcrouter/lib/mc/umbrella.h"
@@ -21,13 +23,101 @@
 
 namespace facebook { namespace memcache {
 
-McRequest umbrellaParseRequest(const folly::IOBuf& source,
-                               const uint8_t* header, size_t nheader,
-                               const uint8_t* body, size_t nbody,
-                               mc_op_t& opOut, uint64_t& reqidOut) {
+namespace {
+
+McRequest& nextBatchRequest(std::vector<McRequest>* batchOut) {
+  if (!batchOut) {
+    throw std::runtime_error("Duplicate key");
+  }
+  batchOut->emplace_back();
+  return batchOut->back();
+}
+
+/**
+ * Body of a message stored in a single buffer, see umbrellaParseRequest().
+ */
+class ContiguousBody {
+ public:
+  ContiguousBody(const folly::IOBuf& source, const uint8_t* body, size_t nbody)
+      : source_(source), body_(body), nbody_(nbody) {}
+
+  /**
+   * Clones [offset, offset + len) of the body into out.
+   * @return false if the range is invalid
+   */
+  bool clone(folly::IOBuf& out, size_t offset, size_t len) const {
+    return cloneInto(out, source_, body_ + offset, len);
+  }
+
+  /**
+   * Copies [offset, offset + len) of the body to dest.
+   * @return false if the range is invalid
+   */
+  bool copy(void* dest, size_t offset, size_t len) const {
+    if (offset + len > nbody_ || offset + len < offset) {
+      return false;
+    }
+    memcpy(dest, body_ + offset, len);
+    return true;
+  }
+
+ private:
+  const folly::IOBuf& source_;
+  const uint8_t* body_;
+  size_t nbody_;
+};
+
+/**
+ * Body of a message split over an IOBuf chain. Ranges are cloned (or copied)
+ * out of the chain piece by piece, so a range spanning buffers comes out
+ * chained instead of the whole body being coalesced.
+ */
+class ChainedBody {
+ public:
+  explicit ChainedBody(const folly::IOBuf& body)
+      : body_(body),
+        nbody_(body.computeChainDataLength()) {}
+
+  bool clone(folly::IOBuf& out, size_t offset, size_t len) const {
+    if (offset > nbody_ || len > nbody_ - offset) {
+      return false;
+    }
+    if (len == 0) {
+      out = folly::IOBuf();
+      return true;
+    }
+    folly::io::Cursor cursor(&body_);
+    cursor.skip(offset);
+    std::unique_ptr<folly::IOBuf> buf;
+    cursor.clone(buf, len);
+    out = std::move(*buf);
+    return true;
+  }
+
+  bool copy(void* dest, size_t offset, size_t len) const {
+    if (offset > nbody_ || len > nbody_ - offset) {
+      return false;
+    }
+    folly::io::Cursor cursor(&body_);
+    cursor.skip(offset);
+    cursor.pull(dest, len);
+    return true;
+  }
+
+ private:
+  const folly::IOBuf& body_;
+  size_t nbody_;
+};
+
+template <class Body>
+McRequest parseRequest(const uint8_t* header, size_t nheader,
+                       const Body& body,
+                       mc_op_t& opOut, uint64_t& reqidOut,
+                       std::vector<McRequest>* batchOut) {
   McRequest req;
   opOut = mc_op_unknown;
   reqidOut = 0;
+  bool hasKey = false;
 
   auto msg = reinterpret_cast<const entry_list_msg_t*>(header);
   size_t nentries = folly::Endian::big((uint16_t)msg->nentries);
@@ -74,23 +164,40 @@ McRequest umbrellaParseRequest(const folly::IOBuf& source,
         req.setLeaseToken(val);
         break;
 
+      case msg_key_digest:
+        req.setRoutingKeyDigestHint(val);
+        break;
+
       case msg_key:
-        if (!req.setKeyFrom(
-              source, body +
-              folly::Endian::big((uint32_t)entry.data.str.offset),
-              folly::Endian::big((uint32_t)entry.data.str.len) - 1)) {
+      {
+        auto& keyReq = hasKey ? nextBatchRequest(batchOut) : req;
+        /* Keys are stored unchained: one split over buffers is copied */
+        folly::IOBuf key;
+        auto len = folly::Endian::big((uint32_t)entry.data.str.len) - 1;
+        if (len == 0 ||
+            !body.clone(key,
+                        folly::Endian::big((uint32_t)entry.data.str.offset),
+                        len)) {
           throw std::runtime_error("Key: invalid offset/length");
         }
+        keyReq.setKey(std::move(key));
+        hasKey = true;
         break;
+      }
 
       case msg_value:
-        if (!req.setValueFrom(
-              source, body +
-              folly::Endian::big((uint32_t)entry.data.str.offset),
-              folly::Endian::big((uint32_t)entry.data.str.len) - 1)) {
+      {
+        folly::IOBuf value;
+        auto len = folly::Endian::big((uint32_t)entry.data.str.len) - 1;
+        if (len == 0 ||
+            !body.clone(value,
+                        folly::Endian::big((uint32_t)entry.data.str.offset),
+                        len)) {
           throw std::runtime_error("Value: invalid offset/length");
         }
+        req.setValue(std::move(value));
         break;
+      }
 
 #ifndef LIBMC_FBTRACE_DISABLE
       case msg_fbtrace:
@@ -101,11 +208,12 @@ McRequest umbrellaParseRequest(const folly::IOBuf& source,
         if (len > FBTRACE_METADATA_SZ) {
           throw std::runtime_error("Fbtrace metadata too large");
         }
-        if (off + len > nbody || off + len < off) {
+        char metadata[FBTRACE_METADATA_SZ];
+        if (!body.copy(metadata, off, len)) {
           throw std::runtime_error("Fbtrace metadata field invalid");
         }
         auto fbtraceInfo = new_mc_fbtrace_info(0);
-        memcpy(fbtraceInfo->metadata, body + off, len);
+        memcpy(fbtraceInfo->metadata, metadata, len);
         req.setFbtraceInfo(fbtraceInfo);
         break;
       }
@@ -125,9 +233,173 @@ McRequest umbrellaParseRequest(const folly::IOBuf& source,
     throw std::runtime_error("Request missing reqid");
   }
 
+  if (batchOut && !batchOut->empty() && opOut != mc_op_get) {
+    throw std::runtime_error("Only gets can be batched");
+  }
+
   return req;
 }
 
+template <class Body>
+bool parseReply(const uint8_t* header, size_t nheader, const Body& body,
+                mc_op_t& opOut, uint64_t& reqidOut, McReply& replyOut) {
+  opOut = mc_op_unknown;
+  reqidOut = 0;
+  McReply reply(mc_res_unknown);
+  bool hasValue = false;
+
+  auto msg = reinterpret_cast<const entry_list_msg_t*>(header);
+  size_t nentries = folly::Endian::big((uint16_t)msg->nentries);
+  if (reinterpret_cast<const uint8_t*>(&msg->entries[nentries])
+      != header + nheader) {
+    throw std::runtime_error("Invalid number of entries");
+  }
+  for (size_t i = 0; i < nentries; ++i) {
+    auto& entry = msg->entries[i];
+    size_t tag = folly::Endian::big((uint16_t)entry.tag);
+    uint64_t val = folly::Endian::big((uint64_t)entry.data.val);
+    switch (tag) {
+      case msg_op:
+        if (val >= UM_NOPS) {
+          throw std::runtime_error("op out of range");
+        }
+        opOut = static_cast<mc_op_t>(umbrella_op_to_mc[val]);
+        if (opOut == mc_nops) {
+          throw std::runtime_error("invalid op");
+        }
+        if (opOut == mc_op_metaget) {
+          return false;
+        }
+        break;
+
+      case msg_result:
+        if (val >= mc_nres) {
+          throw std::runtime_error("result out of range");
+        }
+        reply.setResult(static_cast<mc_res_t>(umbrella_res_to_mc[val]));
+        break;
+
+      case msg_reqid:
+        if (val == 0) {
+          throw std::runtime_error("invalid reqid");
+        }
+        reqidOut = val;
+        break;
+
+      case msg_err_code:
+        reply.setAppSpecificErrorCode(val);
+        break;
+
+      case msg_flags:
+        reply.setFlags(val);
+        break;
+
+      case msg_delta:
+        reply.setDelta(val);
+        break;
+
+      case msg_lease_id:
+        reply.setLeaseToken(val);
+        break;
+
+      case msg_cas:
+        reply.setCas(val);
+        break;
+
+      case msg_value:
+      {
+        if (hasValue) {
+          throw std::runtime_error("Duplicate value");
+        }
+        hasValue = true;
+        auto len = folly::Endian::big((uint32_t)entry.data.str.len);
+        if (len == 0) {
+          throw std::runtime_error("Value: invalid length");
+        }
+        /* An empty value is still a value */
+        folly::IOBuf value;
+        if (!body.clone(value,
+                        folly::Endian::big((uint32_t)entry.data.str.offset),
+                        len - 1)) {
+          throw std::runtime_error("Value: invalid offset/length");
+        }
+        reply.setValue(std::move(value));
+        break;
+      }
+
+      case msg_exptime:
+      case msg_number:
+      case msg_double:
+      case msg_stats:
+        return false;
+
+      default:
+        /* Key, fbtrace and unknown tags aren't needed in McReply */
+        break;
+    }
+  }
+
+  if (opOut == mc_op_unknown) {
+    throw std::runtime_error("Reply missing operation");
+  }
+
+  if (!reqidOut) {
+    throw std::runtime_error("Reply missing reqid");
+  }
+
+  replyOut = std::move(reply);
+  return true;
+}
+
+}  // anonymous namespace
+
+constexpr size_t UmbrellaSerializedMessage::kMaxBatchKeys;
+constexpr size_t UmbrellaSerializedMessage::kReqidEntry;
+
+McRequest umbrellaParseRequest(const folly::IOBuf& source,
+                               const uint8_t* header, size_t nheader,
+                               const uint8_t* body, size_t nbody,
+                               mc_op_t& opOut, uint64_t& reqidOut,
+                               std::vector<McRequest>* batchOut) {
+  return parseRequest(header, nheader, ContiguousBody(source, body, nbody),
+                      opOut, reqidOut, batchOut);
+}
+
+McRequest umbrellaParseRequest(const uint8_t* header, size_t nheader,
+                               const folly::IOBuf& body,
+                               mc_op_t& opOut, uint64_t& reqidOut,
+                               std::vector<McRequest>* batchOut) {
+  if (!body.isChained()) {
+    return umbrellaParseRequest(body, header, nheader,
+                                body.data(), body.length(),
+                                opOut, reqidOut, batchOut);
+  }
+  return parseRequest(header, nheader, ChainedBody(body),
+                      opOut, reqidOut, batchOut);
+}
+
+bool umbrellaParseReply(const folly::IOBuf& source,
+                        const uint8_t* header, size_t nheader,
+                        const uint8_t* body, size_t nbody,
+                        mc_op_t& opOut, uint64_t& reqidOut,
+                        McReply& replyOut) {
+  return parseReply(header, nheader, ContiguousBody(source, body, nbody),
+                    opOut, reqidOut, replyOut);
+}
+
+bool umbrellaParseReply(const uint8_t* header, size_t nheader,
+                        const folly::IOBuf& body,
+                        mc_op_t& opOut, uint64_t& reqidOut,
+                        McReply& replyOut) {
+  if (!body.isChained()) {
+    return umbrellaParseReply(body, header, nheader,
+                              body.data(), body.length(),
+                              opOut, reqidOut, replyOut);
+  }
+  return parseReply(header, nheader, ChainedBody(body),
+                    opOut, reqidOut, replyOut);
+}
+
 UmbrellaSerializedMessage::UmbrellaSerializedMessage() {
   /* These will not change from message to message */
   msg_.msg_header.magic_byte = ENTRY_LIST_MAGIC_BYTE;
@@ -140,13 +412,21 @@ UmbrellaSerializedMessage::UmbrellaSerializedMessage() {
 }
 
 void UmbrellaSerializedMessage::clear() {
-  nEntries_ = nStrings_ = offset_ = 0;
+  nEntries_ = nStrings_ = nStringIovs_ = offset_ = 0;
   error_ = false;
 }
 
 bool UmbrellaSerializedMessage::prepare(const McReply& reply, mc_op_t op,
                                         uint64_t reqid, struct iovec*& iovOut,
                                         size_t& niovOut) {
+  return prepare(reply, op, reqid, folly::none, iovOut, niovOut);
+}
+
+bool UmbrellaSerializedMessage::prepare(
+  const McReply& reply, mc_op_t op, uint64_t reqid,
+  const folly::Optional<folly::IOBuf>& key,
+  struct iovec*& iovOut, size_t& niovOut) {
+
   niovOut = 0;
 
   appendInt(I32, msg_op, umbrella_op_from_mc[op]);
@@ -178,9 +458,13 @@ bool UmbrellaSerializedMessage::prepare(const McReply& reply, mc_op_t op,
     appendDouble(reply.highValue());
   }
 
-  /* TODO: if we intend to pass chained IOBufs as values,
-     we can optimize this to write multiple iovs directly */
-  if (reply.hasValue()) {
+  /* Keys are appended before the value, so they always fit */
+  if (key.hasValue() && !appendStringChain(msg_key, *key)) {
+    error_ = true;
+  }
+
+  if (reply.hasValue() &&
+      !appendStringChain(msg_value, reply.value())) {
     auto valueRange = reply.valueRangeSlow();
     appendString(msg_value,
                  reinterpret_cast<const uint8_t*>(valueRange.begin()),
@@ -197,6 +481,32 @@ bool UmbrellaSerializedMessage::prepare(const McReply& reply, mc_op_t op,
   return true;
 }
 
+bool UmbrellaSerializedMessage::prepareBatchGet(
+  const std::vector<folly::StringPiece>& keys, uint64_t reqid,
+  struct iovec*& iovOut, size_t& niovOut) {
+
+  niovOut = 0;
+  if (keys.empty() || keys.size() > kMaxBatchKeys) {
+    return false;
+  }
+
+  appendInt(I32, msg_op, umbrella_op_from_mc[mc_op_get]);
+  appendInt(U64, msg_reqid, reqid);
+  for (const auto& key : keys) {
+    appendString(msg_key, reinterpret_cast<const uint8_t*>(key.begin()),
+                 key.size());
+  }
+
+  /* NOTE: this check must come after all append*() calls */
+  if (error_) {
+    return false;
+  }
+
+  niovOut = finalizeMessage();
+  iovOut = iovs_;
+  return true;
+}
+
 void UmbrellaSerializedMessage::appendInt(
   entry_type_t type, int32_t tag, uint64_t val) {
 
@@ -229,12 +539,14 @@ void UmbrellaSerializedMessage::appendDouble(double val) {
 void UmbrellaSerializedMessage::appendString(
   int32_t tag, const uint8_t* data, size_t len, entry_type_t type) {
 
-  if (nStrings_ >= kInlineStrings) {
+  if (nStrings_ >= kInlineStrings || nEntries_ >= kInlineEntries ||
+      2 + nStringIovs_ + 2 > kMaxIovs) {
     error_ = true;
     return;
   }
 
-  strings_[nStrings_++] = folly::StringPiece((const char*)data, len);
+  strings_[nStrings_++] = {folly::StringPiece((const char*)data, len), true};
+  nStringIovs_ += 2;
 
   um_elist_entry_t& entry = entries_[nEntries_++];
   entry.type = folly::Endian::big((uint16_t)type);
@@ -244,6 +556,39 @@ void UmbrellaSerializedMessage::appendString(
   offset_ += len + 1;
 }
 
+bool UmbrellaSerializedMessage::appendStringChain(int32_t tag,
+                                                  const folly::IOBuf& buf) {
+  auto nParts = buf.countChainElements();
+  if (nParts > kMaxStringChainLength ||
+      nStrings_ + nParts > kInlineStrings ||
+      2 + nStringIovs_ + nParts + 1 > kMaxIovs) {
+    return false;
+  }
+  if (nEntries_ >= kInlineEntries) {
+    error_ = true;
+    return true;
+  }
+
+  size_t len = 0;
+  auto cur = &buf;
+  do {
+    strings_[nStrings_++] = {
+      folly::StringPiece((const char*)cur->data(), cur->length()), false};
+    len += cur->length();
+    cur = cur->next();
+  } while (cur != &buf);
+  strings_[nStrings_ - 1].last = true;
+  nStringIovs_ += nParts + 1;
+
+  um_elist_entry_t& entry = entries_[nEntries_++];
+  entry.type = folly::Endian::big((uint16_t)BSTRING);
+  entry.tag = folly::Endian::big((uint16_t)tag);
+  entry.data.str.offset = folly::Endian::big((uint32_t)offset_);
+  entry.data.str.len = folly::Endian::big((uint32_t)(len + 1));
+  offset_ += len + 1;
+  return true;
+}
+
 size_t UmbrellaSerializedMessage::finalizeMessage() {
   static char nul = '\0';
 
@@ -258,13 +603,15 @@ size_t UmbrellaSerializedMessage::finalizeMessage() {
   size_t niovOut = 2;
 
   for (size_t i = 0; i < nStrings_; i++) {
-    iovs_[niovOut].iov_base = (char *)strings_[i].begin();
-    iovs_[niovOut].iov_len = strings_[i].size();
+    iovs_[niovOut].iov_base = (char *)strings_[i].data.begin();
+    iovs_[niovOut].iov_len = strings_[i].data.size();
     niovOut++;
 
-    iovs_[niovOut].iov_base = &nul;
-    iovs_[niovOut].iov_len = 1;
-    niovOut++;
+    if (strings_[i].last) {
+      iovs_[niovOut].iov_base = &nul;
+      iovs_[niovOut].iov_len = 1;
+      niovOut++;
+    }
   }
   return niovOut;
 }
@@ -9,6 +9,9 @@
  */
 #pragma once
 
+#include <vector>
+
+#include <folly/Optional.h>
 #include <folly/Range.h>
 
 #include "mcrouter/lib/mc/msg.h"
@@ -35,37 +38,133 @@ class McRequest;
  *                         Umbrella body stored in the `source` IOBuf
  * @paramOut opOut         Parsed operation.
  * @paramOut reqidOut      Parsed request ID
+ * @paramOut batchOut      If not null, a request for every key after
+ *                         the first one of a batched get is appended here
+ *                         (see UmbrellaSerializedMessage::prepareBatchGet()).
+ *                         If null, batched gets are a parse error.
  * @return                 Parsed request.
  * @throws                 std::runtime_error on any parse error.
  */
 McRequest umbrellaParseRequest(const folly::IOBuf& source,
                                const uint8_t* header, size_t nheader,
                                const uint8_t* body, size_t nbody,
-                               mc_op_t& opOut, uint64_t& reqidOut);
+                               mc_op_t& opOut, uint64_t& reqidOut,
+                               std::vector<McRequest>* batchOut = nullptr);
+
+/**
+ * Parse an on-the-wire Umbrella reply straight into McReply, without
+ * building an mc_msg_t.
+ *
+ * Arguments are the same as for umbrellaParseRequest().
+ *
+ * @paramOut replyOut      Parsed reply, only valid if true is returned.
+ * @return                 false if the reply has fields that McReply can only
+ *                         keep in an mc_msg_t (exptime, number, doubles,
+ *                         stats, metaget IP address). Such replies must be
+ *                         parsed with um_consume_no_copy().
+ * @throws                 std::runtime_error on any parse error.
+ */
+bool umbrellaParseReply(const folly::IOBuf& source,
+                        const uint8_t* header, size_t nheader,
+                        const uint8_t* body, size_t nbody,
+                        mc_op_t& opOut, uint64_t& reqidOut,
+                        McReply& replyOut);
+
+/**
+ * umbrellaParseRequest() for a body that may be split over an IOBuf chain,
+ * e.g. a message that straddled reads. The chain is not coalesced:
+ * values are cloned out of it and come out chained if they span buffers,
+ * only keys (always stored unchained) are copied in that case.
+ *
+ * @param body  The whole body, body_size bytes over the chain.
+ */
+McRequest umbrellaParseRequest(const uint8_t* header, size_t nheader,
+                               const folly::IOBuf& body,
+                               mc_op_t& opOut, uint64_t& reqidOut,
+                               std::vector<McRequest>* batchOut = nullptr);
+
+/**
+ * umbrellaParseReply() for a body that may be split over an IOBuf chain,
+ * see above.
+ */
+bool umbrellaParseReply(const uint8_t* header, size_t nheader,
+                        const folly::IOBuf& body,
+                        mc_op_t& opOut, uint64_t& reqidOut,
+                        McReply& replyOut);
 
 class UmbrellaSerializedMessage {
+ private:
+  static constexpr size_t kMaxIovs = 32;
+  static constexpr size_t kInlineEntries = 16;
+
  public:
+  /**
+   * Batched gets carry op and reqid entries plus one entry per key.
+   */
+  static constexpr size_t kMaxBatchKeys = kInlineEntries - 2;
+
+  /**
+   * Requests and batched gets always carry the reqid in this entry (in the
+   * second iovec), right after the op: a message can be sent again with
+   * another reqid by replacing the entry (see SharedSerializedRequest).
+   */
+  static constexpr size_t kReqidEntry = 1;
+
   UmbrellaSerializedMessage();
   void clear();
   bool prepare(const McReply& reply, mc_op_t op, uint64_t reqid,
                struct iovec*& iovOut, size_t& niovOut);
 
+  /**
+   * @param key  If set, sent along with the reply. Used for the hits of
+   *             a batched get, which share the reqid of the batch.
+   */
+  bool prepare(const McReply& reply, mc_op_t op, uint64_t reqid,
+               const folly::Optional<folly::IOBuf>& key,
+               struct iovec*& iovOut, size_t& niovOut);
+
   template<int Op>
   bool prepare(const McRequest& request, McOperation<Op>, uint64_t reqid,
                struct iovec*& iovOut, size_t& niovOut);
 
+  /**
+   * Serialize a batched get: a single mc_op_get request with several keys.
+   * The server replies with one mc_op_get reply (that includes the key)
+   * per hit, followed by an mc_op_end reply with the same reqid. Misses
+   * are not replied to. The result of the mc_op_end reply is
+   * mc_res_found, or the worst error seen for any of the keys.
+   *
+   * @param keys  Must stay alive until the message is written,
+   *              at most kMaxBatchKeys.
+   * @return      false if there are too many keys.
+   */
+  bool prepareBatchGet(const std::vector<folly::StringPiece>& keys,
+                       uint64_t reqid,
+                       struct iovec*& iovOut, size_t& niovOut);
+
  private:
-  static constexpr size_t kMaxIovs = 16;
   struct iovec iovs_[kMaxIovs];
 
   entry_list_msg_t msg_;
-  static constexpr size_t kInlineEntries = 16;
   size_t nEntries_{0};
   um_elist_entry_t entries_[kInlineEntries];
 
+  /* Longest IOBuf chain we'll write without coalescing */
+  static constexpr size_t kMaxStringChainLength = 8;
+
+  /**
+   * A string entry may be split into several pieces (one per IOBuf in
+   * a chain), only the last one is followed by '\0'.
+   */
+  struct StringPart {
+    folly::StringPiece data;
+    bool last;
+  };
   static constexpr size_t kInlineStrings = 16;
   size_t nStrings_{0};
-  folly::StringPiece strings_[kInlineStrings];
+  StringPart strings_[kInlineStrings];
+  /* Number of iovecs needed for the strings added so far */
+  size_t nStringIovs_{0};
 
   size_t offset_{0};
 
@@ -76,6 +175,14 @@ class UmbrellaSerializedMessage {
   void appendString(int32_t tag, const uint8_t* data, size_t len,
                     entry_type_t type = BSTRING);
 
+  /**
+   * Append a string stored in a (possibly chained) IOBuf without copying it.
+   *
+   * @return  false if the chain is too long to be written as is,
+   *          in this case nothing is appended.
+   */
+  bool appendStringChain(int32_t tag, const folly::IOBuf& buf);
+
   /**
    * Put message header and all added entries/strings into iovecs.
    *
@@ -0,0 +1,23 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace facebook { namespace memcache {
+
+/**
+ * Number of writev calls by batch size: bucket i counts writes of
+ * [2^i, 2^(i+1)) requests, the last bucket also counts all bigger batches.
+ */
+using WriteBatchHistogram = std::array<uint64_t, 8>;
+
+}}  // facebook::memcache
@@ -10,6 +10,7 @@
 #include "WriteBuffer.h"
 
 #include "mcrouter/lib/mc/protocol.h"
+#include "mcrouter/lib/MemoryAccounting.h"
 
 namespace facebook { namespace memcache {
 
@@ -20,6 +21,10 @@ WriteBuffer::WriteBuffer(mc_protocol_t protocol)
       new (&asciiReply_) AsciiSerializedReply();
       break;
 
+    case mc_binary_protocol:
+      new (&binaryReply_) BinarySerializedMessage();
+      break;
+
     case mc_umbrella_protocol:
       new (&umbrellaReply_) UmbrellaSerializedMessage();
       break;
@@ -27,14 +32,20 @@ WriteBuffer::WriteBuffer(mc_protocol_t protocol)
     default:
       CHECK(false) << "Unknown protocol";
   }
+  MemoryAccounting::add(MemoryTag::kWriteBuffers, sizeof(WriteBuffer));
 }
 
 WriteBuffer::~WriteBuffer() {
+  MemoryAccounting::sub(MemoryTag::kWriteBuffers, sizeof(WriteBuffer));
   switch (protocol_) {
     case mc_ascii_protocol:
       asciiReply_.~AsciiSerializedReply();
       break;
 
+    case mc_binary_protocol:
+      binaryReply_.~BinarySerializedMessage();
+      break;
+
     case mc_umbrella_protocol:
       umbrellaReply_.~UmbrellaSerializedMessage();
       break;
@@ -53,6 +64,10 @@ void WriteBuffer::clear() {
       asciiReply_.clear();
       break;
 
+    case mc_binary_protocol:
+      binaryReply_.clear();
+      break;
+
     case mc_umbrella_protocol:
       umbrellaReply_.clear();
       break;
@@ -75,7 +90,24 @@ bool WriteBuffer::prepare(McServerRequestContext&& ctx, McReply&& reply,
                                  iovOut, niovOut);
       break;
 
+    case mc_binary_protocol:
+      return binaryReply_.prepare(reply_.value(),
+                                  ctx_->operation_,
+                                  ctx_->binaryOpcode_,
+                                  ctx_->binaryOpaque_,
+                                  ctx_->asciiKey(),
+                                  iovOut, niovOut);
+      break;
+
     case mc_umbrella_protocol:
+      if (ctx_->hasParent()) {
+        /* Hits of a batched get share the reqid and carry their key */
+        return umbrellaReply_.prepare(reply_.value(),
+                                      ctx_->operation_,
+                                      ctx_->reqid_,
+                                      ctx_->asciiKey(),
+                                      iovOut, niovOut);
+      }
       return umbrellaReply_.prepare(reply_.value(),
                                     ctx_->operation_,
                                     ctx_->reqid_,
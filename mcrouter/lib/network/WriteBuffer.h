@@ -16,6 +16,7 @@
 #include "mcrouter/lib/mc/protocol.h"
 #include "mcrouter/lib/mc/umbrella.h"
 #include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/network/BinaryProtocol.h"
 #include "mcrouter/lib/network/UniqueIntrusiveList.h"
 #include "mcrouter/lib/network/McServerRequestContext.h"
 #include "mcrouter/lib/network/UmbrellaProtocol.h"
@@ -78,6 +79,7 @@ class WriteBuffer {
   /* Write buffers */
   union {
     AsciiSerializedReply asciiReply_;
+    BinarySerializedMessage binaryReply_;
     UmbrellaSerializedMessage umbrellaReply_;
   };
 
@@ -95,6 +97,7 @@ class WriteBufferQueue {
   explicit WriteBufferQueue(mc_protocol_t protocol)
       : protocol_(protocol) {
     if (protocol_ != mc_ascii_protocol &&
+        protocol_ != mc_binary_protocol &&
         protocol_ != mc_umbrella_protocol) {
       throw std::runtime_error("Invalid protocol");
     }
@@ -131,7 +134,9 @@ class WriteBufferQueue {
     return *freeQ[(size_t)protocol_];
   }
   WriteBuffer::Queue queue_;
-  constexpr static size_t kMaxFreeQueueSz = 50;
+  /* Buffers (with their iovecs and header scratch space) are recycled
+     per thread, keep enough for pipelined clients to not allocate */
+  constexpr static size_t kMaxFreeQueueSz = 256;
 
   WriteBufferQueue(const WriteBufferQueue&) = delete;
   WriteBufferQueue& operator=(const WriteBufferQueue&) = delete;
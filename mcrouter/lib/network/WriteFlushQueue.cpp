@@ -0,0 +1,39 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "WriteFlushQueue.h"
+
+namespace facebook { namespace memcache {
+
+WriteFlushQueue::~WriteFlushQueue() {
+  cancelLoopCallback();
+  sessions_.clear();
+}
+
+void WriteFlushQueue::add(McServerSession& session) {
+  if (!session.flushHook_.is_linked()) {
+    sessions_.push_back(session);
+  }
+  if (!isLoopCallbackScheduled()) {
+    eventBase_.runInLoop(this, /* thisIteration= */ true);
+  }
+}
+
+void WriteFlushQueue::runLoopCallback() noexcept {
+  McServerSession::FlushQueue sessions;
+  sessions.swap(sessions_);
+  while (!sessions.empty()) {
+    auto& session = sessions.front();
+    sessions.pop_front();
+    McServerSession::DestructorGuard dg(&session);
+    session.sendWrites();
+  }
+}
+
+}}  // facebook::memcache
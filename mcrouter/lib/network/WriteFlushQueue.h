@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/lib/network/McServerSession.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * End of loop flush phase shared by all sessions of a worker.
+ *
+ * Sessions with replies to write add themselves here instead of scheduling
+ * their own loop callback. At the end of the loop iteration (after the loop
+ * callbacks that run fibers producing replies) every queued session writes
+ * all its pending replies in one batch. Sessions added while flushing, or by
+ * callbacks that run after the flush, are flushed once more in the same
+ * iteration.
+ */
+class WriteFlushQueue : private folly::EventBase::LoopCallback {
+ public:
+  struct Stats {
+    /* Number of writev calls for batches of replies */
+    uint64_t writes{0};
+    /* Number of replies written by those calls */
+    uint64_t replies{0};
+  };
+
+  explicit WriteFlushQueue(folly::EventBase& eventBase)
+      : eventBase_(eventBase) {
+  }
+
+  ~WriteFlushQueue();
+
+  /**
+   * Flush pending writes of the session at the end of this loop iteration.
+   * The session is removed from the queue if destroyed before that.
+   */
+  void add(McServerSession& session);
+
+  /**
+   * Account for one write of `replies` replies.
+   */
+  void recordWrite(size_t replies) {
+    ++stats_.writes;
+    stats_.replies += replies;
+  }
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  folly::EventBase& eventBase_;
+  McServerSession::FlushQueue sessions_;
+  Stats stats_;
+
+  void runLoopCallback() noexcept override;
+
+  WriteFlushQueue(const WriteFlushQueue&) = delete;
+  WriteFlushQueue& operator=(const WriteFlushQueue&) = delete;
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/network/AdaptiveReadLimits.h"
+
+using namespace facebook::memcache;
+
+using std::chrono::microseconds;
+
+namespace {
+
+AdaptiveReadLimits::Options testOptions() {
+  AdaptiveReadLimits::Options opts;
+  opts.maxRequestsPerRead = 100;
+  opts.maxReadsPerEvent = 16;
+  opts.targetLoopTime = microseconds(200);
+  opts.interval = 1;
+  return opts;
+}
+
+}  // anonymous namespace
+
+TEST(AdaptiveReadLimits, backoffOnSlowLoop) {
+  AdaptiveReadLimits limits(testOptions());
+  EXPECT_EQ(100, limits.requestsPerRead());
+  EXPECT_EQ(16, limits.readsPerEvent());
+
+  EXPECT_TRUE(limits.update(microseconds(300), 0));
+  EXPECT_EQ(50, limits.requestsPerRead());
+  EXPECT_EQ(8, limits.readsPerEvent());
+
+  for (int i = 0; i < 20; ++i) {
+    limits.update(microseconds(300), 0);
+  }
+  EXPECT_EQ(1, limits.requestsPerRead());
+  EXPECT_EQ(1, limits.readsPerEvent());
+}
+
+TEST(AdaptiveReadLimits, backoffOnGrowingBacklog) {
+  AdaptiveReadLimits limits(testOptions());
+
+  EXPECT_TRUE(limits.update(microseconds(150), 10));
+  EXPECT_EQ(50, limits.requestsPerRead());
+
+  /* Backlog is not growing, loop time is within target: keep limits */
+  EXPECT_FALSE(limits.update(microseconds(150), 10));
+  EXPECT_EQ(50, limits.requestsPerRead());
+
+  EXPECT_TRUE(limits.update(microseconds(150), 20));
+  EXPECT_EQ(25, limits.requestsPerRead());
+}
+
+TEST(AdaptiveReadLimits, recoverWhenIdle) {
+  AdaptiveReadLimits limits(testOptions());
+  for (int i = 0; i < 20; ++i) {
+    limits.update(microseconds(300), 0);
+  }
+
+  EXPECT_TRUE(limits.update(microseconds(50), 0));
+  EXPECT_EQ(2, limits.requestsPerRead());
+  EXPECT_EQ(2, limits.readsPerEvent());
+
+  for (int i = 0; i < 100; ++i) {
+    limits.update(microseconds(50), 0);
+  }
+  EXPECT_EQ(100, limits.requestsPerRead());
+  EXPECT_EQ(16, limits.readsPerEvent());
+  EXPECT_FALSE(limits.update(microseconds(50), 0));
+}
+
+TEST(AdaptiveReadLimits, interval) {
+  auto opts = testOptions();
+  opts.interval = 4;
+  AdaptiveReadLimits limits(opts);
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_FALSE(limits.update(microseconds(300), 0));
+  }
+  EXPECT_EQ(100, limits.requestsPerRead());
+  EXPECT_TRUE(limits.update(microseconds(300), 0));
+  EXPECT_EQ(50, limits.requestsPerRead());
+}
@@ -7,13 +7,21 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <array>
+#include <numeric>
+#include <string>
+#include <vector>
+
 #include <gtest/gtest.h>
 
+#include <folly/Conv.h>
 #include <folly/io/async/EventBase.h>
 
 #include "mcrouter/lib/network/AsyncMcClient.h"
 #include "mcrouter/lib/network/AsyncMcServer.h"
 #include "mcrouter/lib/network/AsyncMcServerWorker.h"
+#include "mcrouter/lib/network/SSLHandshakePool.h"
+#include "mcrouter/lib/network/SSLSessionCache.h"
 #include "mcrouter/lib/network/ThreadLocalSSLContextProvider.h"
 #include "mcrouter/lib/network/test/TestUtil.h"
 #include "mcrouter/lib/test/RouteHandleTestUtil.h"
@@ -106,7 +114,8 @@ class ServerOnRequest {
 class TestServer {
  public:
   TestServer(bool outOfOrder, bool useSsl,
-             int maxInflight = 10, int timeoutMs = 250) :
+             int maxInflight = 10, int timeoutMs = 250,
+             size_t sslHandshakeThreads = 0) :
       outOfOrder_(outOfOrder) {
     socketFd_ = createListenSocket();
     opts_.existingSocketFd = socketFd_;
@@ -117,6 +126,7 @@ class TestServer {
       opts_.pemKeyPath = kPemKeyPath;
       opts_.pemCertPath = kPemCertPath;
       opts_.pemCaPath = kPemCaPath;
+      opts_.sslHandshakeThreads = sslHandshakeThreads;
     }
     EXPECT_TRUE(run());
     // allow server some time to startup
@@ -183,7 +193,9 @@ class TestClient {
                std::shared_ptr<folly::SSLContext>()
              > contextProvider = nullptr,
              bool enableQoS = false,
-             uint64_t qos = 0) {
+             uint64_t qos = 0,
+             SSLHandshakePool* sslHandshakePool = nullptr,
+             std::function<void(ConnectionOptions&)> adjustOptions = nullptr) {
     ConnectionOptions opts(host, port, protocol);
     opts.sendTimeout = std::chrono::milliseconds(timeoutMs);
     opts.writeTimeout = std::chrono::milliseconds(timeoutMs);
@@ -194,11 +206,15 @@ class TestClient {
       opts.sslContextProvider = contextProvider
         ? contextProvider
         : defaultContextProvider;
+      opts.sslHandshakePool = sslHandshakePool;
     }
     if (enableQoS) {
       opts.enableQoS = true;
       opts.qos = qos;
     }
+    if (adjustOptions) {
+      adjustOptions(opts);
+    }
     client_ = folly::make_unique<AsyncMcClient>(eventBase_, opts);
     client_->setStatusCallbacks([] { LOG(INFO) << "Client UP."; },
                                 [] (const folly::AsyncSocketException&) {
@@ -235,6 +251,25 @@ class TestClient {
     }
   }
 
+  /**
+   * Sends a get that should be found, and appends its key to `replied`
+   * once the reply comes.
+   */
+  void sendGet(const char* key, RequestPriority priority,
+               std::vector<std::string>& replied) {
+    auto msg = createMcMsgRef(key);
+    msg->op = mc_op_get;
+    auto req = std::make_shared<McRequest>(std::move(msg));
+    client_->send(*req,
+                  McOperation<mc_op_get>(),
+                  [req, &replied] (McReply&& reply) {
+                    EXPECT_EQ(mc_res_found, reply.result());
+                    EXPECT_EQ(req->fullKey(), toString(reply.value()));
+                    replied.push_back(req->fullKey().str());
+                  },
+                  priority);
+  }
+
   void sendSet(const char* key, const char* value, mc_res_t expectedResult) {
     auto msg = createMcMsgRef(key, value);
     msg->op = mc_op_set;
@@ -460,6 +495,89 @@ TEST(AsyncMcClient, outstandingThrottleSsl) {
   outstandingThrottleTest(true);
 }
 
+TEST(AsyncMcClient, outstandingBytesThrottle) {
+  OutstandingBytesLimit shared;
+  TestServer server(false, false);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol, false, nullptr, false, 0, nullptr,
+                    [&shared](ConnectionOptions& opts) {
+                      opts.maxOutstandingBytes = 1;
+                      opts.sharedOutstandingBytes = &shared;
+                    });
+  TestClient other("localhost", server.getListenPort(), 200,
+                   mc_ascii_protocol, false, nullptr, false, 0, nullptr,
+                   [&shared](ConnectionOptions& opts) {
+                     opts.sharedOutstandingBytes = &shared;
+                   });
+
+  // the client's own limit
+  client.sendGet("hold", mc_res_timeout);
+  EXPECT_LT(0, shared.bytes);
+  client.sendGet("flush", mc_res_local_error);
+  EXPECT_EQ(1, shared.rejected);
+  other.sendGet("test", mc_res_found);
+  client.waitForReplies();
+  other.waitForReplies();
+  EXPECT_EQ(0, shared.bytes);
+
+  // the shared limit
+  shared.limit = 1;
+  client.sendGet("hold", mc_res_timeout);
+  other.sendGet("test", mc_res_local_error);
+  EXPECT_EQ(2, shared.rejected);
+  client.waitForReplies();
+  EXPECT_EQ(0, shared.bytes);
+
+  shared.limit = 0;
+  other.sendGet("shutdown", mc_res_ok);
+  other.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 2);
+}
+
+void priorityLanesTest(
+    mc_protocol_t protocol,
+    const std::array<uint32_t, kNumRequestPriorities>& weights,
+    const std::vector<std::string>& expected) {
+  TestServer server(protocol == mc_umbrella_protocol, false);
+  TestClient client("localhost", server.getListenPort(), 200, protocol,
+                    false, nullptr, false, 0, nullptr,
+                    [&weights](ConnectionOptions& opts) {
+                      opts.priorityWeights = weights;
+                    });
+  // one request written at a time, the rest wait in the send queue
+  client.setThrottle(1, 0);
+
+  std::vector<std::string> replied;
+  client.sendGet("shadow1", RequestPriority::SHADOW, replied);
+  client.sendGet("shadow2", RequestPriority::SHADOW, replied);
+  client.sendGet("get1", RequestPriority::FOREGROUND_GET, replied);
+  client.sendGet("get2", RequestPriority::FOREGROUND_GET, replied);
+  client.sendGet("get3", RequestPriority::FOREGROUND_GET, replied);
+  client.waitForReplies();
+  EXPECT_EQ(expected, replied);
+
+  client.sendGet("shutdown", mc_res_ok);
+  client.waitForReplies();
+  server.join();
+}
+
+TEST(AsyncMcClient, priorityLanes) {
+  std::array<uint32_t, kNumRequestPriorities> weights{{2, 1, 1, 1, 1}};
+  std::vector<std::string> expected{
+    "get1", "get2", "shadow1", "get3", "shadow2"
+  };
+  // replies matched in the order requests are written
+  priorityLanesTest(mc_ascii_protocol, weights, expected);
+  // replies matched by id
+  priorityLanesTest(mc_umbrella_protocol, weights, expected);
+}
+
+TEST(AsyncMcClient, priorityLanesDisabled) {
+  priorityLanesTest(mc_ascii_protocol, {{}},
+                    {"shadow1", "shadow2", "get1", "get2", "get3"});
+}
+
 void connectionErrorTest(bool useSsl = false) {
   TestServer server(false, useSsl);
   TestClient client1("localhost", server.getListenPort(), 200,
@@ -515,6 +633,48 @@ TEST(AsyncMcClient, umbrellaSsl) {
   umbrellaTest(true);
 }
 
+// Requests sent in one loop iteration are written in batches, make sure
+// batches that don't fit into a single writev are handled correctly.
+void manyRequestsTest(mc_protocol_e protocol) {
+  TestServer server(protocol == mc_umbrella_protocol, false);
+  TestClient client("localhost", server.getListenPort(), 200, protocol);
+  for (size_t i = 0; i < 500; ++i) {
+    client.sendGet(folly::to<std::string>("test", i).c_str(), mc_res_found);
+  }
+  client.waitForReplies();
+  client.sendGet("shutdown", mc_res_ok);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
+TEST(AsyncMcClient, manyRequestsAscii) {
+  manyRequestsTest(mc_ascii_protocol);
+}
+
+TEST(AsyncMcClient, manyRequestsUmbrella) {
+  manyRequestsTest(mc_umbrella_protocol);
+}
+
+TEST(AsyncMcClient, writeBatchHistogram) {
+  TestServer server(false, false);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol);
+  // All requests are queued before the connection is up, so they should be
+  // written together.
+  for (size_t i = 0; i < 10; ++i) {
+    client.sendGet(folly::to<std::string>("test", i).c_str(), mc_res_found);
+  }
+  client.waitForReplies();
+  auto histogram = client.getClient().getWriteBatchHistogram();
+  EXPECT_EQ(1, histogram[3]);
+  EXPECT_EQ(1, std::accumulate(histogram.begin(), histogram.end(), 0));
+  client.sendGet("shutdown", mc_res_ok);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
 void qosTest(mc_protocol_e protocol = mc_ascii_protocol,
              bool useSsl = false,
              uint64_t qos = 0) {
@@ -572,6 +732,65 @@ TEST(AsyncMcClient, reconnectUmbrella) {
   reconnectTest(mc_umbrella_protocol);
 }
 
+TEST(AsyncMcClient, sslSessionResumption) {
+  auto& clientStats = clientSSLHandshakeStats();
+  auto& serverStats = serverSSLHandshakeStats();
+  auto handshakes = clientStats.full.load() + clientStats.resumed.load();
+
+  TestServer server(false, true);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol, true);
+  // may be resumed if an earlier test used the same port
+  client.sendGet("test1", mc_res_found);
+  client.waitForReplies();
+  EXPECT_EQ(handshakes + 1,
+            clientStats.full.load() + clientStats.resumed.load());
+
+  auto full = clientStats.full.load();
+  auto resumed = clientStats.resumed.load();
+  auto serverResumed = serverStats.resumed.load();
+  client.getClient().closeNow();
+  client.sendGet("test2", mc_res_found);
+  client.waitForReplies();
+  EXPECT_EQ(full, clientStats.full.load());
+  EXPECT_EQ(resumed + 1, clientStats.resumed.load());
+  EXPECT_EQ(serverResumed + 1, serverStats.resumed.load());
+
+  client.sendGet("shutdown", mc_res_ok);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 2);
+}
+
+TEST(AsyncMcClient, sslHandshakePool) {
+  auto& poolStats = sslHandshakePoolStats();
+  auto& clientStats = clientSSLHandshakeStats();
+  auto completed = poolStats.completed.load();
+
+  SSLHandshakePool pool(1);
+  TestServer server(false, true, 10, 250, /* sslHandshakeThreads */ 2);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_ascii_protocol, true, nullptr, false, 0, &pool);
+  client.sendGet("test1", mc_res_found);
+  client.waitForReplies();
+  // client and server side
+  EXPECT_EQ(completed + 2, poolStats.completed.load());
+
+  // the session is resumed on the pool too
+  auto resumed = clientStats.resumed.load();
+  client.getClient().closeNow();
+  client.sendGet("test2", mc_res_found);
+  client.waitForReplies();
+  EXPECT_EQ(completed + 4, poolStats.completed.load());
+  EXPECT_EQ(resumed + 1, clientStats.resumed.load());
+  EXPECT_EQ(0, poolStats.pending.load());
+
+  client.sendGet("shutdown", mc_res_ok);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 2);
+}
+
 void bigKeyTest(mc_protocol_t protocol) {
   TestServer server(protocol == mc_umbrella_protocol, false);
   TestClient client("localhost", server.getListenPort(), 200,
@@ -7,6 +7,8 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <atomic>
+
 #include <gtest/gtest.h>
 
 #include <folly/io/async/EventBase.h>
@@ -214,16 +216,18 @@ class TestClient {
     client_->setThrottle(maxInflight, maxOutstanding);
   }
 
-  void sendGet(const char* key, mc_res_t expectedResult) {
+  void sendGet(const char* key, mc_res_t expectedResult,
+               const std::atomic<bool>* cancellation = nullptr) {
     inflight_++;
     std::string K(key);
-    fm_.addTask([K, expectedResult, this]() {
+    fm_.addTask([K, expectedResult, cancellation, this]() {
         auto msg = createMcMsgRef(K.c_str());
         msg->op = mc_op_get;
         McRequest req{std::move(msg)};
         try {
           auto reply = client_->sendSync(req, McOperation<mc_op_get>(),
-                                         std::chrono::milliseconds(200));
+                                         std::chrono::milliseconds(200),
+                                         cancellation);
           if (reply.result() == mc_res_found) {
             if (req.fullKey() == "empty") {
               EXPECT_TRUE(reply.hasValue());
@@ -242,6 +246,33 @@ class TestClient {
       });
   }
 
+  /**
+   * Sends all the gets from one fiber with startSync(), before waiting
+   * for any of the replies.
+   */
+  void sendGetBatch(std::vector<std::string> keys,
+                    std::vector<mc_res_t> expectedResults) {
+    inflight_++;
+    fm_.addTask([keys, expectedResults, this]() {
+        using Op = McOperation<mc_op_get>;
+        std::vector<McRequest> reqs;
+        for (const auto& key : keys) {
+          reqs.emplace_back(key);
+        }
+        std::vector<AsyncMcClient::SyncRequest<Op, McRequest>> sent;
+        for (const auto& req : reqs) {
+          sent.push_back(client_->startSync(req, Op(),
+                                            std::chrono::milliseconds(200)));
+        }
+        for (size_t i = 0; i < sent.size(); ++i) {
+          auto reply = AsyncMcClient::waitSync(std::move(sent[i]));
+          EXPECT_EQ(std::string(mc_res_to_string(expectedResults[i])),
+                    std::string(mc_res_to_string(reply.result())));
+        }
+        inflight_--;
+      });
+  }
+
   void sendSet(const char* key, const char* value, mc_res_t expectedResult) {
     inflight_++;
     std::string K(key);
@@ -357,6 +388,20 @@ TEST(AsyncMcClient, simpleUmbrellaTimeoutSsl) {
   simpleUmbrellaTimeoutTest(true);
 }
 
+TEST(AsyncMcClient, startSyncBatch) {
+  TestServer server(true, false);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    mc_umbrella_protocol);
+  // nohold2 is waited for once hold timed out, its reply is in by then
+  client.sendGetBatch({"nohold1", "hold", "nohold2"},
+                      {mc_res_found, mc_res_timeout, mc_res_found});
+  client.waitForReplies();
+  client.sendGet("shutdown", mc_res_ok);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
 void noServerTimeoutTest(bool useSsl = false) {
   TestClient client("10.1.1.1", 11302, 200, mc_ascii_protocol, useSsl);
   client.sendGet("hold", mc_res_connect_timeout);
@@ -609,6 +654,33 @@ TEST(AsyncMcClient, badKey) {
   bigKeyTest(mc_ascii_protocol);
 }
 
+void cancelledTest(mc_protocol_t protocol) {
+  TestServer server(protocol == mc_umbrella_protocol, false);
+  TestClient client("localhost", server.getListenPort(), 200,
+                    protocol);
+  std::atomic<bool> cancelled{true};
+  client.sendGet("test1", mc_res_aborted, &cancelled);
+  client.sendGet("test2", mc_res_found);
+  client.sendGet("test3", mc_res_aborted, &cancelled);
+  client.sendGet("test4", mc_res_found);
+  client.waitForReplies();
+  std::atomic<bool> notCancelled{false};
+  client.sendGet("test5", mc_res_found, &notCancelled);
+  client.waitForReplies();
+  client.sendGet("shutdown", mc_res_ok);
+  client.waitForReplies();
+  server.join();
+  EXPECT_EQ(server.getStats().accepted.load(), 1);
+}
+
+TEST(AsyncMcClient, cancelledAscii) {
+  cancelledTest(mc_ascii_protocol);
+}
+
+TEST(AsyncMcClient, cancelledUmbrella) {
+  cancelledTest(mc_umbrella_protocol);
+}
+
 // Test that we won't leave zombie AsyncMcClientImpl after EventBase is
 // destroyed.
 TEST(AsyncMcClient, eventBaseDestruction) {
@@ -0,0 +1,217 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/BinaryProtocol.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+std::unique_ptr<folly::IOBuf> toBuf(struct iovec* iovs, size_t niovs) {
+  auto buf = folly::IOBuf::create(0);
+  for (size_t i = 0; i < niovs; ++i) {
+    buf->prependChain(folly::IOBuf::copyBuffer(iovs[i].iov_base,
+                                               iovs[i].iov_len));
+  }
+  buf->coalesce();
+  return buf;
+}
+
+template <int Op>
+std::unique_ptr<folly::IOBuf> serialize(const McRequest& req,
+                                        McOperation<Op> op,
+                                        uint64_t reqid) {
+  BinarySerializedMessage message;
+  struct iovec* iovs;
+  size_t niovs;
+  EXPECT_TRUE(message.prepare(req, op, reqid, iovs, niovs));
+  return toBuf(iovs, niovs);
+}
+
+std::unique_ptr<folly::IOBuf> serialize(const McReply& reply, mc_op_t op,
+                                        uint8_t opcode, uint32_t opaque,
+                                        folly::Optional<folly::IOBuf> key =
+                                          folly::none) {
+  BinarySerializedMessage message;
+  struct iovec* iovs;
+  size_t niovs;
+  EXPECT_TRUE(message.prepare(reply, op, opcode, opaque, key, iovs, niovs));
+  return toBuf(iovs, niovs);
+}
+
+BinaryMessageInfo parseHeader(const folly::IOBuf& buf) {
+  BinaryMessageInfo info;
+  EXPECT_EQ(BinaryParseStatus::kOk,
+            binaryParseHeader(buf.data(), buf.length(), info));
+  EXPECT_EQ(buf.length(), info.messageSize());
+  return info;
+}
+
+McRequest parseRequest(const folly::IOBuf& buf, mc_op_t& op,
+                       mc_res_t& result) {
+  auto info = parseHeader(buf);
+  return binaryParseRequest(buf, info, buf.data() + kBinaryHeaderSize,
+                            op, result);
+}
+
+McReply parseReply(const folly::IOBuf& buf, mc_op_t& op) {
+  auto info = parseHeader(buf);
+  return binaryParseReply(buf, info, buf.data() + kBinaryHeaderSize, op);
+}
+
+}  // anonymous namespace
+
+TEST(BinaryProtocol, parseHeader) {
+  auto buf = serialize(McRequest("key"), McOperation<mc_op_get>(), 1);
+  BinaryMessageInfo info;
+  EXPECT_EQ(BinaryParseStatus::kNotEnoughData,
+            binaryParseHeader(buf->data(), kBinaryHeaderSize - 1, info));
+
+  auto info2 = parseHeader(*buf);
+  EXPECT_EQ(kBinaryRequestMagic, info2.magic);
+  EXPECT_EQ(kBinaryGet, info2.opcode);
+  EXPECT_EQ(3, info2.keyLength);
+  EXPECT_EQ(1, info2.opaque);
+
+  /* Ascii request */
+  const uint8_t ascii[] = "get key\r\n";
+  EXPECT_EQ(BinaryParseStatus::kError,
+            binaryParseHeader(ascii, sizeof(ascii), info));
+}
+
+TEST(BinaryProtocol, requestSet) {
+  McRequest req("key");
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+  req.setFlags(0x20);
+  req.setExptime(100);
+  auto buf = serialize(req, McOperation<mc_op_set>(), 17);
+
+  mc_op_t op;
+  mc_res_t result;
+  auto parsed = parseRequest(*buf, op, result);
+  EXPECT_EQ(mc_op_set, op);
+  EXPECT_EQ(mc_res_unknown, result);
+  EXPECT_EQ("key", parsed.fullKey().str());
+  EXPECT_EQ("value", parsed.valueRangeSlow().str());
+  EXPECT_EQ(0x20, parsed.flags());
+  EXPECT_EQ(100, parsed.exptime());
+}
+
+TEST(BinaryProtocol, requestCas) {
+  McRequest req("key");
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+  req.setCas(12);
+  auto buf = serialize(req, McOperation<mc_op_cas>(), 1);
+
+  mc_op_t op;
+  mc_res_t result;
+  auto parsed = parseRequest(*buf, op, result);
+  EXPECT_EQ(mc_op_cas, op);
+  EXPECT_EQ(12, parsed.cas());
+}
+
+TEST(BinaryProtocol, requestIncr) {
+  McRequest req("key");
+  req.setDelta(42);
+  auto buf = serialize(req, McOperation<mc_op_incr>(), 1);
+
+  mc_op_t op;
+  mc_res_t result;
+  auto parsed = parseRequest(*buf, op, result);
+  EXPECT_EQ(mc_op_incr, op);
+  EXPECT_EQ(42, parsed.delta());
+}
+
+TEST(BinaryProtocol, requestUnsupported) {
+  BinarySerializedMessage message;
+  struct iovec* iovs;
+  size_t niovs;
+  EXPECT_FALSE(message.prepare(McRequest("key"),
+                               McOperation<mc_op_metaget>(), 1, iovs, niovs));
+  EXPECT_EQ(0, niovs);
+}
+
+TEST(BinaryProtocol, replyGet) {
+  McReply reply(mc_res_found, "value");
+  reply.setFlags(0x20);
+  reply.setCas(34);
+  auto buf = serialize(reply, mc_op_get, kBinaryGet, 17);
+
+  mc_op_t op;
+  auto parsed = parseReply(*buf, op);
+  EXPECT_EQ(mc_op_get, op);
+  EXPECT_EQ(mc_res_found, parsed.result());
+  EXPECT_EQ("value", parsed.valueRangeSlow().str());
+  EXPECT_EQ(0x20, parsed.flags());
+  EXPECT_EQ(34, parsed.cas());
+  EXPECT_EQ(17, parseHeader(*buf).opaque);
+}
+
+TEST(BinaryProtocol, replyGetK) {
+  auto buf = serialize(McReply(mc_res_found, "value"), mc_op_get,
+                       kBinaryGetK, 1,
+                       folly::IOBuf(folly::IOBuf::COPY_BUFFER, "key"));
+  auto info = parseHeader(*buf);
+  EXPECT_EQ(3, info.keyLength);
+  EXPECT_EQ("key",
+            std::string(reinterpret_cast<const char*>(buf->data()) +
+                        kBinaryHeaderSize + info.extrasLength,
+                        info.keyLength));
+
+  mc_op_t op;
+  EXPECT_EQ("value", parseReply(*buf, op).valueRangeSlow().str());
+}
+
+TEST(BinaryProtocol, replyStatus) {
+  mc_op_t op;
+  auto miss = serialize(McReply(mc_res_notfound), mc_op_get, kBinaryGet, 1);
+  auto parsed = parseReply(*miss, op);
+  EXPECT_EQ(mc_res_notfound, parsed.result());
+  EXPECT_FALSE(parsed.hasValue());
+
+  auto notStored = serialize(McReply(mc_res_notstored), mc_op_add,
+                             kBinaryAdd, 1);
+  EXPECT_EQ(kBinaryKeyExists, parseHeader(*notStored).status);
+  EXPECT_EQ(mc_res_notstored, parseReply(*notStored, op).result());
+
+  auto error = serialize(McReply(mc_res_timeout), mc_op_set, kBinarySet, 1);
+  EXPECT_EQ(kBinaryTemporaryFailure, parseHeader(*error).status);
+  EXPECT_EQ(mc_res_try_again, parseReply(*error, op).result());
+}
+
+TEST(BinaryProtocol, replyIncr) {
+  McReply reply(mc_res_stored);
+  reply.setDelta(43);
+  auto buf = serialize(reply, mc_op_incr, kBinaryIncrement, 1);
+
+  mc_op_t op;
+  auto parsed = parseReply(*buf, op);
+  EXPECT_EQ(mc_op_incr, op);
+  EXPECT_EQ(mc_res_stored, parsed.result());
+  EXPECT_EQ(43, parsed.delta());
+}
+
+TEST(BinaryProtocol, quietReplies) {
+  EXPECT_TRUE(binaryIsQuiet(kBinaryGetQ));
+  EXPECT_TRUE(binaryIsQuiet(kBinaryGetKQ));
+  EXPECT_FALSE(binaryIsQuiet(kBinaryGet));
+  EXPECT_FALSE(binaryIsQuiet(kBinaryNoop));
+
+  EXPECT_TRUE(binaryOmitQuietReply(kBinaryGetQ, McReply(mc_res_notfound)));
+  EXPECT_FALSE(binaryOmitQuietReply(kBinaryGetQ,
+                                    McReply(mc_res_found, "value")));
+  EXPECT_TRUE(binaryOmitQuietReply(kBinarySetQ, McReply(mc_res_stored)));
+  EXPECT_FALSE(binaryOmitQuietReply(kBinarySetQ, McReply(mc_res_notstored)));
+}
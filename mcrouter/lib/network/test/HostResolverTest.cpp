@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <future>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/network/HostResolver.h"
+
+using facebook::memcache::HostResolver;
+
+TEST(HostResolver, ipNeedsNoResolution) {
+  HostResolver resolver(std::chrono::seconds(60));
+  folly::SocketAddress address;
+  EXPECT_TRUE(resolver.lookup("127.0.0.1", 11211, address));
+  EXPECT_EQ("127.0.0.1", address.getAddressStr());
+  EXPECT_EQ(11211, address.getPort());
+
+  EXPECT_TRUE(resolver.lookup("::1", 11212, address));
+  EXPECT_EQ("::1", address.getAddressStr());
+  EXPECT_EQ(11212, address.getPort());
+
+  bool called = false;
+  resolver.resolve("127.0.0.1", [&called]() { called = true; });
+  EXPECT_TRUE(called);
+}
+
+TEST(HostResolver, resolveInBackground) {
+  HostResolver resolver(std::chrono::seconds(60));
+  folly::SocketAddress address;
+  EXPECT_FALSE(resolver.lookup("localhost", 11211, address));
+
+  std::promise<void> done;
+  resolver.resolve("localhost", [&done]() { done.set_value(); });
+  done.get_future().wait();
+
+  ASSERT_TRUE(resolver.lookup("localhost", 11211, address));
+  EXPECT_TRUE(address.isLoopbackAddress());
+  EXPECT_EQ(11211, address.getPort());
+
+  /* Cached, so done inline */
+  bool called = false;
+  resolver.resolve("localhost", [&called]() { called = true; });
+  EXPECT_TRUE(called);
+}
+
+TEST(HostResolver, resolveFailure) {
+  HostResolver resolver(std::chrono::seconds(60));
+  std::promise<void> done;
+  resolver.resolve("nonexistent.invalid", [&done]() { done.set_value(); });
+  done.get_future().wait();
+
+  folly::SocketAddress address;
+  EXPECT_FALSE(resolver.lookup("nonexistent.invalid", 11211, address));
+}
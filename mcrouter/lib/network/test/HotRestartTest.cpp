@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/network/HotRestart.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+std::string socketPath() {
+  return "/tmp/mcrouter_hot_restart_test." + std::to_string(getpid());
+}
+
+int listeningSocket() {
+  auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  EXPECT_EQ(0, ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+  EXPECT_EQ(0, ::listen(fd, 1));
+  return fd;
+}
+
+uint16_t port(int fd) {
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+  ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+  return ntohs(addr.sin_port);
+}
+
+}  // anonymous namespace
+
+TEST(HotRestart, noPreviousProcess) {
+  auto path = socketPath();
+  ::unlink(path.c_str());
+  EXPECT_EQ(nullptr,
+            HotRestartClient::connect(path, std::chrono::milliseconds(100)));
+}
+
+TEST(HotRestart, handoff) {
+  auto path = socketPath();
+  auto fd = listeningSocket();
+  std::atomic<bool> handedOff{false};
+  auto handoffsBefore = hotRestartStats().handoffs.load();
+
+  {
+    HotRestartListener listener(
+      path,
+      [fd] () {
+        HotRestartHandoff handoff;
+        handoff.fds.push_back(::dup(fd));
+        handoff.state = "hello";
+        return handoff;
+      },
+      [&handedOff] () {
+        handedOff = true;
+      });
+
+    auto client =
+      HotRestartClient::connect(path, std::chrono::milliseconds(1000));
+    ASSERT_NE(nullptr, client);
+    ASSERT_EQ(1, client->handoff().fds.size());
+    EXPECT_TRUE(client->handoff().sslFds.empty());
+    EXPECT_EQ("hello", client->handoff().state);
+    /* the very same listening socket */
+    EXPECT_EQ(port(fd), port(client->handoff().fds[0]));
+    EXPECT_FALSE(handedOff);
+
+    EXPECT_TRUE(client->ready());
+    for (int i = 0; i < 1000 && !handedOff; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_TRUE(handedOff);
+  }
+
+  EXPECT_EQ(handoffsBefore + 1, hotRestartStats().handoffs);
+  /* the new process listens there now */
+  EXPECT_EQ(0, ::access(path.c_str(), F_OK));
+  ::unlink(path.c_str());
+  ::close(fd);
+}
+
+TEST(HotRestart, removesSocketWithoutHandoff) {
+  auto path = socketPath();
+  {
+    HotRestartListener listener(
+      path,
+      [] () { return HotRestartHandoff(); },
+      [] () {});
+    EXPECT_EQ(0, ::access(path.c_str(), F_OK));
+  }
+  EXPECT_NE(0, ::access(path.c_str(), F_OK));
+}
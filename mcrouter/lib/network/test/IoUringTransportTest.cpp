@@ -0,0 +1,209 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <sys/socket.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/network/IoUringTransport.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+class TestReadCallback : public folly::AsyncTransportWrapper::ReadCallback {
+ public:
+  std::string data;
+  bool eof{false};
+  bool error{false};
+
+  void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+    *bufReturn = buffer_;
+    *lenReturn = sizeof(buffer_);
+  }
+  void readDataAvailable(size_t len) noexcept override {
+    data.append(buffer_, len);
+  }
+  void readEOF() noexcept override {
+    eof = true;
+  }
+  void readErr(const folly::AsyncSocketException&) noexcept override {
+    error = true;
+  }
+
+ private:
+  char buffer_[16];
+};
+
+class TestWriteCallback : public folly::AsyncTransportWrapper::WriteCallback {
+ public:
+  size_t successes{0};
+  size_t errors{0};
+
+  void writeSuccess() noexcept override {
+    ++successes;
+  }
+  void writeErr(size_t, const folly::AsyncSocketException&) noexcept override {
+    ++errors;
+  }
+};
+
+struct TransportPair {
+  IoUringTransport::UniquePtr a;
+  IoUringTransport::UniquePtr b;
+};
+
+bool makePair(folly::EventBase& evb, TransportPair& pair) {
+  auto ring = IoUring::get(evb);
+  if (ring == nullptr) {
+    return false;
+  }
+  int fds[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    return false;
+  }
+  pair.a.reset(new IoUringTransport(*ring, fds[0]));
+  pair.b.reset(new IoUringTransport(*ring, fds[1]));
+  return true;
+}
+
+}  // anonymous namespace
+
+TEST(IoUringTransport, writeRead) {
+  folly::EventBase evb;
+  TransportPair pair;
+  if (!makePair(evb, pair)) {
+    LOG(WARNING) << "io_uring is not available, skipping";
+    return;
+  }
+
+  TestReadCallback readCb;
+  TestWriteCallback writeCb;
+  pair.b->setReadCB(&readCb);
+
+  /* Larger than the read buffer, takes multiple recvs */
+  std::string first(100, 'a');
+  std::string second = "second";
+  pair.a->write(&writeCb, first.data(), first.size());
+  pair.a->writeChain(&writeCb, folly::IOBuf::copyBuffer(second));
+
+  while (readCb.data.size() < first.size() + second.size()) {
+    evb.loopOnce();
+  }
+  EXPECT_EQ(first + second, readCb.data);
+  EXPECT_EQ(2, writeCb.successes);
+  EXPECT_EQ(0, writeCb.errors);
+  EXPECT_EQ(first.size() + second.size(), pair.a->getAppBytesWritten());
+  EXPECT_EQ(first.size() + second.size(), pair.b->getAppBytesReceived());
+
+  pair.a->close();
+  while (!readCb.eof) {
+    evb.loopOnce();
+  }
+  EXPECT_FALSE(readCb.error);
+  EXPECT_FALSE(pair.a->good());
+
+  pair.b->closeNow();
+  pair.a.reset();
+  pair.b.reset();
+  evb.loop();
+}
+
+TEST(IoUringTransport, readCallbackReinstalled) {
+  folly::EventBase evb;
+  TransportPair pair;
+  if (!makePair(evb, pair)) {
+    LOG(WARNING) << "io_uring is not available, skipping";
+    return;
+  }
+
+  TestReadCallback readCb;
+  TestWriteCallback writeCb;
+  pair.b->setReadCB(&readCb);
+  // recv is in flight from now on
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  pair.b->setReadCB(nullptr);
+
+  std::string data = "data";
+  pair.a->write(&writeCb, data.data(), data.size());
+  while (writeCb.successes == 0) {
+    evb.loopOnce();
+  }
+  /* Data that arrived without a callback is delivered once it's back */
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_TRUE(readCb.data.empty());
+
+  pair.b->setReadCB(&readCb);
+  while (readCb.data.size() < data.size()) {
+    evb.loopOnce();
+  }
+  EXPECT_EQ(data, readCb.data);
+
+  pair.a->closeNow();
+  pair.b->closeNow();
+  pair.a.reset();
+  pair.b.reset();
+  evb.loop();
+}
+
+TEST(IoUringTransport, writeAfterClose) {
+  folly::EventBase evb;
+  TransportPair pair;
+  if (!makePair(evb, pair)) {
+    LOG(WARNING) << "io_uring is not available, skipping";
+    return;
+  }
+
+  TestWriteCallback writeCb;
+  pair.a->closeNow();
+  std::string data = "data";
+  pair.a->write(&writeCb, data.data(), data.size());
+  EXPECT_EQ(0, writeCb.successes);
+  EXPECT_EQ(1, writeCb.errors);
+
+  pair.b->closeNow();
+  pair.a.reset();
+  pair.b.reset();
+  evb.loop();
+}
+
+TEST(IoUringTransport, closeNowWithRecvInFlight) {
+  folly::EventBase evb;
+  TransportPair pair;
+  if (!makePair(evb, pair)) {
+    LOG(WARNING) << "io_uring is not available, skipping";
+    return;
+  }
+
+  TestReadCallback readCb;
+  pair.b->setReadCB(&readCb);
+  // recv is in flight from now on
+  evb.loopOnce(EVLOOP_NONBLOCK);
+
+  /* The kernel may still write into the buffer of readCb, so it's only
+     notified once the cancelled recv completes */
+  pair.b->closeNow();
+  EXPECT_FALSE(readCb.eof);
+  EXPECT_EQ(&readCb, pair.b->getReadCallback());
+  while (!readCb.eof) {
+    evb.loopOnce();
+  }
+  EXPECT_FALSE(readCb.error);
+  EXPECT_EQ(nullptr, pair.b->getReadCallback());
+
+  pair.a->closeNow();
+  pair.a.reset();
+  pair.b.reset();
+  evb.loop();
+}
@@ -0,0 +1,302 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/McSerializedRequest.h"
+#include "mcrouter/lib/TypedRequest.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+std::string joinIovs(struct iovec* iovs, size_t niovs) {
+  std::string out;
+  for (size_t i = 0; i < niovs; ++i) {
+    out.append(static_cast<const char*>(iovs[i].iov_base), iovs[i].iov_len);
+  }
+  return out;
+}
+
+folly::IOBuf chainedValue(size_t nparts) {
+  folly::IOBuf value(folly::IOBuf::COPY_BUFFER, "v0");
+  for (size_t i = 1; i < nparts; ++i) {
+    value.prependChain(
+      folly::IOBuf::copyBuffer("v" + folly::to<std::string>(i)));
+  }
+  return value;
+}
+
+bool sharesValueMemory(struct iovec* iovs, size_t niovs,
+                       const folly::IOBuf& value) {
+  auto cur = &value;
+  do {
+    bool found = false;
+    for (size_t i = 0; i < niovs; ++i) {
+      if (iovs[i].iov_base == cur->data()) {
+        found = true;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+    cur = cur->next();
+  } while (cur != &value);
+  return true;
+}
+
+template <int op>
+std::string serializeAscii(const McRequest& req) {
+  McSerializedRequest s(req, McOperation<op>(), 1, mc_ascii_protocol);
+  EXPECT_EQ(McSerializedRequest::Result::OK, s.serializationResult());
+  return joinIovs(s.getIovs(), s.getIovsCount());
+}
+
+template <int op>
+std::string serializeAscii(const TypedRequest<op>& req) {
+  McSerializedRequest s(req, McOperation<op>(), 1, mc_ascii_protocol);
+  EXPECT_EQ(McSerializedRequest::Result::OK, s.serializationResult());
+  return joinIovs(s.getIovs(), s.getIovsCount());
+}
+
+template <int op>
+std::string serializeMeta(const McRequest& req) {
+  McSerializedRequest s(req, McOperation<op>(), 1, mc_ascii_meta_protocol);
+  EXPECT_EQ(McSerializedRequest::Result::OK, s.serializationResult());
+  return joinIovs(s.getIovs(), s.getIovsCount());
+}
+
+}  // anonymous namespace
+
+TEST(McSerializedRequest, asciiChainedValue) {
+  McRequest req("key");
+  req.setValue(chainedValue(3));
+
+  McSerializedRequest s(req, McOperation<mc_op_set>(), 1, mc_ascii_protocol);
+  ASSERT_EQ(McSerializedRequest::Result::OK, s.serializationResult());
+  EXPECT_EQ("set key 0 0 6\r\nv0v1v2\r\n",
+            joinIovs(s.getIovs(), s.getIovsCount()));
+  EXPECT_TRUE(sharesValueMemory(s.getIovs(), s.getIovsCount(), req.value()));
+  EXPECT_TRUE(req.value().isChained());
+  EXPECT_EQ(0, req.valueBytesCopied());
+}
+
+TEST(McSerializedRequest, asciiLongChainIsCoalesced) {
+  McRequest req("key");
+  req.setValue(chainedValue(20));
+  auto expectedSize = req.value().computeChainDataLength();
+
+  McSerializedRequest s(req, McOperation<mc_op_set>(), 1, mc_ascii_protocol);
+  ASSERT_EQ(McSerializedRequest::Result::OK, s.serializationResult());
+  EXPECT_FALSE(req.value().isChained());
+  EXPECT_EQ(expectedSize, req.valueBytesCopied());
+}
+
+TEST(McSerializedRequest, umbrellaChainedValue) {
+  McRequest req("key");
+  req.setValue(chainedValue(3));
+
+  McSerializedRequest s(req, McOperation<mc_op_set>(), 1,
+                        mc_umbrella_protocol);
+  ASSERT_EQ(McSerializedRequest::Result::OK, s.serializationResult());
+  auto serialized = joinIovs(s.getIovs(), s.getIovsCount());
+  EXPECT_NE(std::string::npos,
+            serialized.find(std::string("v0v1v2\0", 7)));
+  EXPECT_TRUE(sharesValueMemory(s.getIovs(), s.getIovsCount(), req.value()));
+  EXPECT_TRUE(req.value().isChained());
+  EXPECT_EQ(0, req.valueBytesCopied());
+}
+
+TEST(McSerializedRequest, cloneKeepsCopiedBytes) {
+  McRequest req("key");
+  req.setValue(chainedValue(2));
+  req.valueRangeSlow();
+  EXPECT_EQ(4, req.valueBytesCopied());
+
+  auto clone = req.clone();
+  EXPECT_EQ(4, clone.valueBytesCopied());
+}
+
+TEST(McSerializedRequest, asciiTypedRequest) {
+  McRequest req("/a/b/key");
+  req.setValue(chainedValue(2));
+  req.setFlags(7);
+  req.setExptime(3);
+  req.setDelta(4);
+  req.setCas(5);
+  req.setLeaseToken(6);
+
+  TypedRequest<mc_op_get> get("/a/b/key");
+  EXPECT_EQ(serializeAscii<mc_op_get>(req), serializeAscii(get));
+
+  TypedRequest<mc_op_delete> del("/a/b/key");
+  del.setExptime(3);
+  EXPECT_EQ(serializeAscii<mc_op_delete>(req), serializeAscii(del));
+
+  TypedRequest<mc_op_incr> incr("/a/b/key");
+  incr.setDelta(4);
+  EXPECT_EQ(serializeAscii<mc_op_incr>(req), serializeAscii(incr));
+
+  TypedRequest<mc_op_cas> cas("/a/b/key");
+  cas.setValue(chainedValue(2));
+  cas.setFlags(7);
+  cas.setExptime(3);
+  cas.setCas(5);
+  EXPECT_EQ(serializeAscii<mc_op_cas>(req), serializeAscii(cas));
+  EXPECT_TRUE(cas.value().isChained());
+
+  TypedRequest<mc_op_lease_set> leaseSet("/a/b/key");
+  leaseSet.setValue(chainedValue(2));
+  leaseSet.setFlags(7);
+  leaseSet.setExptime(3);
+  leaseSet.setLeaseToken(6);
+  EXPECT_EQ(serializeAscii<mc_op_lease_set>(req), serializeAscii(leaseSet));
+
+  McSerializedRequest umbrella(get, McOperation<mc_op_get>(), 1,
+                               mc_umbrella_protocol);
+  EXPECT_EQ(McSerializedRequest::Result::ERROR,
+            umbrella.serializationResult());
+}
+
+TEST(McSerializedRequest, asciiMeta) {
+  McRequest req("key");
+  EXPECT_EQ("mg key v f t\r\n", serializeMeta<mc_op_get>(req));
+  EXPECT_EQ("mg key v f t c\r\n", serializeMeta<mc_op_gets>(req));
+  EXPECT_EQ("md key\r\n", serializeMeta<mc_op_delete>(req));
+
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+  req.setFlags(3);
+  req.setExptime(10);
+  EXPECT_EQ("ms key 5 F3 T10 MS\r\nvalue\r\n",
+            serializeMeta<mc_op_set>(req));
+  EXPECT_EQ("ms key 5 F3 T10 ME\r\nvalue\r\n",
+            serializeMeta<mc_op_add>(req));
+  EXPECT_EQ("ms key 5 F3 T10 MP\r\nvalue\r\n",
+            serializeMeta<mc_op_prepend>(req));
+  req.setCas(42);
+  EXPECT_EQ("ms key 5 F3 T10 MS C42\r\nvalue\r\n",
+            serializeMeta<mc_op_cas>(req));
+
+  /* no meta command for these */
+  EXPECT_EQ(serializeAscii<mc_op_lease_set>(req),
+            serializeMeta<mc_op_lease_set>(req));
+  EXPECT_EQ(serializeAscii<mc_op_version>(req),
+            serializeMeta<mc_op_version>(req));
+  EXPECT_EQ("delete key 10\r\n", serializeMeta<mc_op_delete>(req));
+}
+
+TEST(McSerializedRequest, asciiNoreply) {
+  McRequest req("key");
+  req.setNoreply(true);
+  EXPECT_EQ("delete key 0 noreply\r\n", serializeAscii<mc_op_delete>(req));
+  /* quiet meta mode still replies to misses, so it's classic noreply */
+  EXPECT_EQ("delete key 0 noreply\r\n", serializeMeta<mc_op_delete>(req));
+  req.setDelta(2);
+  EXPECT_EQ("incr key 2 noreply\r\n", serializeAscii<mc_op_incr>(req));
+
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+  req.setExptime(10);
+  EXPECT_EQ("set key 0 10 5 noreply\r\nvalue\r\n",
+            serializeAscii<mc_op_set>(req));
+  EXPECT_EQ("set key 0 10 5 noreply\r\nvalue\r\n",
+            serializeMeta<mc_op_set>(req));
+  /* the result of these matters */
+  req.setCas(42);
+  EXPECT_EQ("cas key 0 10 5 42\r\nvalue\r\n", serializeAscii<mc_op_cas>(req));
+
+  McSerializedRequest s(req, McOperation<mc_op_set>(), 1, mc_ascii_protocol);
+  EXPECT_TRUE(s.noreply());
+  McSerializedRequest cas(req, McOperation<mc_op_cas>(), 1, mc_ascii_protocol);
+  EXPECT_FALSE(cas.noreply());
+  McSerializedRequest umbrella(req, McOperation<mc_op_set>(), 1,
+                               mc_umbrella_protocol);
+  EXPECT_FALSE(umbrella.noreply());
+}
+
+namespace {
+
+std::string serializeSet(const McRequest& req, size_t reqId,
+                         mc_protocol_t protocol) {
+  McSerializedRequest s(req, McOperation<mc_op_set>(), reqId, protocol);
+  EXPECT_EQ(McSerializedRequest::Result::OK, s.serializationResult());
+  return joinIovs(s.getIovs(), s.getIovsCount());
+}
+
+/* Where the iovs send the key from, nullptr if not in a single iov */
+const void* keyIov(McSerializedRequest& s, folly::StringPiece key) {
+  for (size_t i = 0; i < s.getIovsCount(); ++i) {
+    auto iov = s.getIovs()[i];
+    if (folly::StringPiece(static_cast<const char*>(iov.iov_base),
+                           iov.iov_len).endsWith(key)) {
+      return iov.iov_base;
+    }
+  }
+  return nullptr;
+}
+
+McRequest makeSet() {
+  McRequest req("key");
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+  req.setExptime(10);
+  return req;
+}
+
+}  // anonymous namespace
+
+TEST(McSerializedRequest, sharedSerialization) {
+  for (auto protocol : { mc_ascii_protocol, mc_ascii_meta_protocol,
+                         mc_binary_protocol, mc_umbrella_protocol }) {
+    auto unshared = makeSet();
+    auto expected1 = serializeSet(unshared, 1, protocol);
+    auto expected2 = serializeSet(unshared, 2, protocol);
+
+    std::unique_ptr<McSerializedRequest> s1;
+    std::unique_ptr<McSerializedRequest> s2;
+    {
+      auto req = makeSet();
+      req.enableSharedSerialization();
+      auto clone1 = req.clone();
+      auto clone2 = req.clone();
+      s1 = folly::make_unique<McSerializedRequest>(
+        clone1, McOperation<mc_op_set>(), 1, protocol);
+      s2 = folly::make_unique<McSerializedRequest>(
+        clone2, McOperation<mc_op_set>(), 2, protocol);
+    }
+    /* the shared form outlives the requests */
+    ASSERT_EQ(McSerializedRequest::Result::OK, s2->serializationResult());
+    EXPECT_EQ(expected1, joinIovs(s1->getIovs(), s1->getIovsCount()));
+    EXPECT_EQ(expected2, joinIovs(s2->getIovs(), s2->getIovsCount()));
+    /* both send the key of the shared copy */
+    EXPECT_NE(nullptr, keyIov(*s1, "key"));
+    EXPECT_EQ(keyIov(*s1, "key"), keyIov(*s2, "key"));
+  }
+}
+
+TEST(McSerializedRequest, sharedSerializationChangedClone) {
+  for (auto protocol : { mc_ascii_protocol, mc_umbrella_protocol }) {
+    auto changed = makeSet();
+    changed.setExptime(20);
+    auto expected = serializeSet(changed, 1, protocol);
+
+    auto req = makeSet();
+    req.enableSharedSerialization();
+    auto clone = req.clone();
+    clone.setExptime(20);
+    EXPECT_NE(expected, serializeSet(req, 1, protocol));
+    EXPECT_EQ(expected, serializeSet(clone, 1, protocol));
+  }
+}
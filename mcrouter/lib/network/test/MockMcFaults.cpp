@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "MockMcFaults.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include <folly/Conv.h>
+#include <folly/Format.h>
+#include <folly/String.h>
+
+namespace facebook { namespace memcache {
+
+namespace {
+
+double parseNumber(folly::StringPiece s, folly::StringPiece spec) {
+  try {
+    return folly::to<double>(s);
+  } catch (const std::exception&) {
+    throw std::invalid_argument(
+      folly::sformat("invalid number '{}' in '{}'", s, spec));
+  }
+}
+
+bool happens(double share, std::mt19937_64& rng) {
+  return share >= 1 ||
+    (share > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < share);
+}
+
+}  // anonymous namespace
+
+std::vector<mc_op_t> MockMcFaults::parseCommon(folly::StringPiece spec,
+                                               double& share,
+                                               folly::StringPiece& rest) {
+  folly::StringPiece opName;
+  folly::StringPiece shareStr;
+  if (!folly::split(':', spec, opName, shareStr, rest)) {
+    throw std::invalid_argument(folly::sformat("invalid fault '{}'", spec));
+  }
+  share = parseNumber(shareStr, spec);
+  if (share < 0 || share > 1) {
+    throw std::invalid_argument(
+      folly::sformat("share is not in [0, 1] in '{}'", spec));
+  }
+
+  std::vector<mc_op_t> ops;
+  if (opName == "all") {
+    for (int op = mc_op_unknown + 1; op < mc_nops; ++op) {
+      ops.push_back(static_cast<mc_op_t>(op));
+    }
+  } else {
+    auto op = mc_op_from_string(opName.str().c_str());
+    if (op == mc_op_unknown) {
+      throw std::invalid_argument(
+        folly::sformat("unknown operation '{}'", opName));
+    }
+    ops.push_back(op);
+  }
+  return ops;
+}
+
+void MockMcFaults::addDelay(folly::StringPiece spec) {
+  Delay delay;
+  folly::StringPiece dist;
+  auto ops = parseCommon(spec, delay.share, dist);
+
+  std::vector<folly::StringPiece> parts;
+  folly::split(':', dist, parts);
+  if (parts.size() == 1) {
+    delay.type = Delay::Type::FIXED;
+    delay.a = parseNumber(parts[0], spec);
+  } else if (parts.size() == 3 && parts[0] == "uniform") {
+    delay.type = Delay::Type::UNIFORM;
+    delay.a = parseNumber(parts[1], spec);
+    delay.b = parseNumber(parts[2], spec);
+  } else if (parts.size() == 3 && parts[0] == "lognormal") {
+    delay.type = Delay::Type::LOGNORMAL;
+    delay.a = parseNumber(parts[1], spec);
+    delay.b = parseNumber(parts[2], spec);
+    if (delay.a <= 0) {
+      throw std::invalid_argument(
+        folly::sformat("median is not positive in '{}'", spec));
+    }
+  } else {
+    throw std::invalid_argument(
+      folly::sformat("invalid delay distribution in '{}'", spec));
+  }
+  if (delay.a < 0 || delay.b < 0 ||
+      (delay.type == Delay::Type::UNIFORM && delay.a > delay.b)) {
+    throw std::invalid_argument(folly::sformat("invalid delay '{}'", spec));
+  }
+
+  for (auto op : ops) {
+    faults_[op].delays.push_back(delay);
+  }
+  empty_ = false;
+}
+
+void MockMcFaults::addError(folly::StringPiece spec) {
+  Error error;
+  folly::StringPiece resultName;
+  auto ops = parseCommon(spec, error.share, resultName);
+
+  auto name = folly::to<std::string>("mc_res_", resultName);
+  for (int res = mc_res_unknown + 1; res < mc_nres; ++res) {
+    if (name == mc_res_to_string(static_cast<mc_res_t>(res))) {
+      error.result = static_cast<mc_res_t>(res);
+    }
+  }
+  if (error.result == mc_res_unknown) {
+    throw std::invalid_argument(
+      folly::sformat("unknown result '{}'", resultName));
+  }
+
+  for (auto op : ops) {
+    faults_[op].errors.push_back(error);
+  }
+  empty_ = false;
+}
+
+MockMcFaults::Fault MockMcFaults::pick(mc_op_t op,
+                                       std::mt19937_64& rng) const {
+  Fault fault;
+  if (op >= mc_nops) {
+    return fault;
+  }
+  const auto& faults = faults_[op];
+  for (const auto& error : faults.errors) {
+    if (happens(error.share, rng)) {
+      fault.error = error.result;
+      break;
+    }
+  }
+  for (const auto& delay : faults.delays) {
+    if (!happens(delay.share, rng)) {
+      continue;
+    }
+    double ms = delay.a;
+    switch (delay.type) {
+      case Delay::Type::FIXED:
+        break;
+      case Delay::Type::UNIFORM:
+        ms = std::uniform_real_distribution<double>(delay.a, delay.b)(rng);
+        break;
+      case Delay::Type::LOGNORMAL:
+        ms = std::lognormal_distribution<double>(
+          std::log(delay.a), delay.b)(rng);
+        break;
+    }
+    fault.delay = std::chrono::milliseconds(
+      static_cast<int64_t>(std::round(ms)));
+    break;
+  }
+  return fault;
+}
+
+}}  // facebook::memcache
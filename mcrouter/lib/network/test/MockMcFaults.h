@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <folly/Range.h>
+
+#include "mcrouter/lib/mc/msg.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Latency and errors that MockMcServer injects, per operation.
+ *
+ * Delay spec "OP:SHARE:DIST": the given share of requests of operation OP
+ * (e.g. "get", or "all") is delayed by DIST milliseconds, one of
+ *   "N", "uniform:MIN:MAX" or "lognormal:MEDIAN:SIGMA".
+ * Error spec "OP:SHARE:RESULT": the given share of requests of operation OP
+ * gets the RESULT error reply (e.g. "busy" for mc_res_busy) instead.
+ *
+ * Several specs may apply to one operation; the first one that is picked
+ * wins (errors and delays are picked independently).
+ */
+class MockMcFaults {
+ public:
+  struct Fault {
+    std::chrono::milliseconds delay{0};
+    /* mc_res_unknown if the request is served normally */
+    mc_res_t error{mc_res_unknown};
+  };
+
+  /**
+   * @throws std::invalid_argument on a malformed spec
+   */
+  void addDelay(folly::StringPiece spec);
+  void addError(folly::StringPiece spec);
+
+  bool empty() const {
+    return empty_;
+  }
+
+  Fault pick(mc_op_t op, std::mt19937_64& rng) const;
+
+ private:
+  struct Delay {
+    enum class Type {
+      FIXED,
+      UNIFORM,
+      LOGNORMAL,
+    };
+
+    double share{0};
+    Type type{Type::FIXED};
+    /* fixed: a; uniform: [a, b]; lognormal: median a, sigma b */
+    double a{0};
+    double b{0};
+  };
+
+  struct Error {
+    double share{0};
+    mc_res_t result{mc_res_unknown};
+  };
+
+  struct OperationFaults {
+    std::vector<Delay> delays;
+    std::vector<Error> errors;
+  };
+
+  std::array<OperationFaults, mc_nops> faults_;
+  bool empty_{true};
+
+  /**
+   * Parses "OP:SHARE:REST".
+   *
+   * @return operations the spec applies to
+   */
+  static std::vector<mc_op_t> parseCommon(folly::StringPiece spec,
+                                          double& share,
+                                          folly::StringPiece& rest);
+};
+
+}}  // facebook::memcache
@@ -9,10 +9,17 @@
  */
 #include <signal.h>
 
+#include <random>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <glog/logging.h>
 
+#include <folly/io/async/EventBase.h>
+#include <folly/MoveWrapper.h>
+
 #include "mcrouter/lib/McOperation.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
@@ -20,6 +27,8 @@
 #include "mcrouter/lib/network/AsyncMcServerWorker.h"
 #include "mcrouter/lib/network/McServerRequestContext.h"
 #include "mcrouter/lib/network/test/MockMc.h"
+#include "mcrouter/lib/network/test/MockMcFaults.h"
+#include "mcrouter/lib/network/test/ShardedMockMc.h"
 
 /**
  * Mock Memcached implementation.
@@ -36,6 +45,10 @@
  *
  * Certain keys with __mockmc__. prefix provide extra functionality
  * useful for testing.
+ *
+ * In benchmark mode (-T, -n, -d or -e), all server threads share one
+ * ShardedMockMc instead, and replies can be delayed or replaced with
+ * errors (see MockMcFaults). There are no __mockmc__. keys in this mode.
  */
 
 using facebook::memcache::AsyncMcServer;
@@ -45,6 +58,8 @@ using facebook::memcache::McReply;
 using facebook::memcache::McRequest;
 using facebook::memcache::McServerRequestContext;
 using facebook::memcache::MockMc;
+using facebook::memcache::MockMcFaults;
+using facebook::memcache::ShardedMockMc;
 using facebook::memcache::createMcMsgRef;
 
 class MockMcOnRequest {
@@ -251,6 +266,157 @@ class MockMcOnRequest {
   MockMc mc_;
 };
 
+/**
+ * Benchmark mode: one instance per server thread, over the shared store.
+ */
+class ShardedMockMcOnRequest {
+ public:
+  ShardedMockMcOnRequest(ShardedMockMc& mc,
+                         const MockMcFaults& faults,
+                         folly::EventBase& evb,
+                         size_t threadId)
+      : mc_(mc),
+        faults_(faults),
+        evb_(evb),
+        rng_(threadId) {
+  }
+
+  template <class Operation>
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 Operation) {
+    reply(std::move(ctx), Operation::mc_op, McReply(mc_res_remote_error));
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_get>) {
+    ShardedMockMc::Item item;
+    if (!mc_.get(req.fullKey(), item)) {
+      reply(std::move(ctx), mc_op_get, McReply(mc_res_notfound));
+      return;
+    }
+    reply(std::move(ctx), mc_op_get, found(std::move(item)));
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_lease_get>) {
+    ShardedMockMc::Item item;
+    if (!mc_.get(req.fullKey(), item)) {
+      McReply miss(mc_res_notfound);
+      miss.setLeaseToken(mc_.newLeaseToken());
+      reply(std::move(ctx), mc_op_lease_get, std::move(miss));
+      return;
+    }
+    reply(std::move(ctx), mc_op_lease_get, found(std::move(item)));
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_set>) {
+    mc_.set(req.fullKey(), ShardedMockMc::Item(req));
+    reply(std::move(ctx), mc_op_set, McReply(mc_res_stored));
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_lease_set>) {
+    mc_.set(req.fullKey(), ShardedMockMc::Item(req));
+    reply(std::move(ctx), mc_op_lease_set, McReply(mc_res_stored));
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_add>) {
+    auto stored = mc_.add(req.fullKey(), ShardedMockMc::Item(req));
+    reply(std::move(ctx), mc_op_add,
+          McReply(stored ? mc_res_stored : mc_res_notstored));
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_replace>) {
+    auto stored = mc_.replace(req.fullKey(), ShardedMockMc::Item(req));
+    reply(std::move(ctx), mc_op_replace,
+          McReply(stored ? mc_res_stored : mc_res_notstored));
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_delete>) {
+    auto deleted = mc_.del(req.fullKey());
+    reply(std::move(ctx), mc_op_delete,
+          McReply(deleted ? mc_res_deleted : mc_res_notfound));
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_incr>) {
+    arith(std::move(ctx), mc_op_incr, req.fullKey(), req.delta());
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_decr>) {
+    arith(std::move(ctx), mc_op_decr, req.fullKey(), -req.delta());
+  }
+
+  void onRequest(McServerRequestContext&& ctx,
+                 McRequest&& req,
+                 McOperation<mc_op_flushall>) {
+    mc_.flushAll();
+    reply(std::move(ctx), mc_op_flushall, McReply(mc_res_ok));
+  }
+
+ private:
+  ShardedMockMc& mc_;
+  const MockMcFaults& faults_;
+  folly::EventBase& evb_;
+  std::mt19937_64 rng_;
+
+  static McReply found(ShardedMockMc::Item item) {
+    McReply reply(mc_res_found);
+    reply.setValue(std::move(item.value));
+    reply.setFlags(item.flags);
+    return reply;
+  }
+
+  void arith(McServerRequestContext&& ctx, mc_op_t op,
+             folly::StringPiece key, int64_t delta) {
+    auto p = mc_.arith(key, delta);
+    if (!p.first) {
+      reply(std::move(ctx), op, McReply(mc_res_notfound));
+      return;
+    }
+    McReply stored(mc_res_stored);
+    stored.setDelta(p.second);
+    reply(std::move(ctx), op, std::move(stored));
+  }
+
+  void reply(McServerRequestContext&& ctx, mc_op_t op, McReply&& reply) {
+    if (faults_.empty()) {
+      McServerRequestContext::reply(std::move(ctx), std::move(reply));
+      return;
+    }
+
+    auto fault = faults_.pick(op, rng_);
+    auto ctxWrapper = folly::makeMoveWrapper(std::move(ctx));
+    auto replyWrapper = folly::makeMoveWrapper(
+      fault.error == mc_res_unknown ? std::move(reply) : McReply(fault.error));
+    if (fault.delay.count() == 0) {
+      McServerRequestContext::reply(std::move(*ctxWrapper),
+                                    std::move(*replyWrapper));
+      return;
+    }
+    evb_.runAfterDelay([ctxWrapper, replyWrapper]() mutable {
+        McServerRequestContext::reply(std::move(*ctxWrapper),
+                                      std::move(*replyWrapper));
+      },
+      fault.delay.count());
+  }
+};
+
 void serverLoop(size_t threadId, folly::EventBase& evb,
                 AsyncMcServerWorker& worker) {
   worker.setOnRequest(MockMcOnRequest());
@@ -263,6 +429,12 @@ void usage(char** argv) {
     "  -P <port>      TCP port on which to listen\n"
     "  -t <fd>        TCP listen sock fd\n"
     "  -s             Use ssl\n"
+    "Benchmark mode:\n"
+    "  -T <threads>   Server threads sharing one store\n"
+    "  -n <items>     Expected number of items, to size the store\n"
+    "  -d <spec>      Inject delays OP:SHARE:DIST, where DIST (in ms) is\n"
+    "                 N, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA\n"
+    "  -e <spec>      Inject errors OP:SHARE:RESULT, e.g. get:0.01:busy\n"
     "Usage:\n"
     "  $ " << argv[0] << " -p 15213\n";
   exit(1);
@@ -276,10 +448,35 @@ int main(int argc, char** argv) {
 
   bool ssl = false;
   uint16_t port = 0;
+  bool benchmark = false;
+  size_t expectedItems = 0;
+  MockMcFaults faults;
 
   int c;
-  while ((c = getopt(argc, argv, "P:t:sh")) >= 0) {
+  while ((c = getopt(argc, argv, "P:t:sT:n:d:e:h")) >= 0) {
     switch (c) {
+      case 'T':
+        benchmark = true;
+        opts.numThreads = folly::to<size_t>(optarg);
+        break;
+      case 'n':
+        benchmark = true;
+        expectedItems = folly::to<size_t>(optarg);
+        break;
+      case 'd':
+      case 'e':
+        benchmark = true;
+        try {
+          if (c == 'd') {
+            faults.addDelay(optarg);
+          } else {
+            faults.addError(optarg);
+          }
+        } catch (const std::invalid_argument& e) {
+          std::cerr << e.what() << "\n";
+          usage(argv);
+        }
+        break;
       case 's':
         ssl = true;
         break;
@@ -311,7 +508,19 @@ int main(int argc, char** argv) {
     LOG(INFO) << "Starting server";
     AsyncMcServer server(opts);
     server.installShutdownHandler({SIGINT, SIGTERM});
-    server.spawn(&serverLoop);
+    /* More shards than threads, to keep lock contention low */
+    ShardedMockMc mc(benchmark ? 64 * opts.numThreads : 1, expectedItems);
+    if (benchmark) {
+      server.spawn(
+        [&mc, &faults](size_t threadId, folly::EventBase& evb,
+                       AsyncMcServerWorker& worker) {
+          worker.setOnRequest(
+            ShardedMockMcOnRequest(mc, faults, evb, threadId));
+          evb.loop();
+        });
+    } else {
+      server.spawn(&serverLoop);
+    }
     server.join();
     LOG(INFO) << "Shutting down";
   } catch (const std::exception& e) {
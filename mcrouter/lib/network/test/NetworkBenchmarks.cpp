@@ -0,0 +1,470 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/IoUringTransport.h"
+#include "mcrouter/lib/network/McParser.h"
+#include "mcrouter/lib/network/McSerializedRequest.h"
+#include "mcrouter/lib/network/test/SessionTestHarness.h"
+#include "mcrouter/lib/network/UmbrellaProtocol.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+const char* const kKey = "someprefix:somekey:1234567890";
+const std::string kValue(100, 'v');
+
+std::string joinIovs(const struct iovec* iovs, size_t niovs) {
+  std::string out;
+  for (size_t i = 0; i < niovs; ++i) {
+    out.append(static_cast<const char*>(iovs[i].iov_base), iovs[i].iov_len);
+  }
+  return out;
+}
+
+template <class Operation>
+std::string umbrellaRequest(const McRequest& req, Operation) {
+  UmbrellaSerializedMessage message;
+  struct iovec* iovs;
+  size_t niovs;
+  message.prepare(req, Operation(), 1, iovs, niovs);
+  return joinIovs(iovs, niovs);
+}
+
+std::string umbrellaGetRequest() {
+  return umbrellaRequest(McRequest(kKey), McOperation<mc_op_get>());
+}
+
+std::string umbrellaSetRequest(size_t valueSize) {
+  McRequest req(kKey);
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER,
+                            std::string(valueSize, 'v')));
+  return umbrellaRequest(req, McOperation<mc_op_set>());
+}
+
+std::string asciiSetRequest(size_t valueSize) {
+  return folly::to<std::string>("set ", kKey, " 0 0 ", valueSize, "\r\n",
+                                std::string(valueSize, 'v'), "\r\n");
+}
+
+std::string asciiMultiGetRequest(size_t keys) {
+  std::string request = "get";
+  for (size_t i = 0; i < keys; ++i) {
+    folly::toAppend(" ", kKey, i, &request);
+  }
+  request += "\r\n";
+  return request;
+}
+
+std::string umbrellaGetReply() {
+  UmbrellaSerializedMessage message;
+  McReply reply(mc_res_found, kValue);
+  struct iovec* iovs;
+  size_t niovs;
+  message.prepare(reply, mc_op_get, 1, iovs, niovs);
+  return joinIovs(iovs, niovs);
+}
+
+class ServerCallback : public McParser::ServerParseCallback {
+ public:
+  size_t requests{0};
+
+  void requestReady(McRequest&& req, mc_op_t operation, uint64_t reqid,
+                    mc_res_t result, bool noreply) override {
+    ++requests;
+  }
+
+  void binaryRequestReady(McRequest&& req, mc_op_t operation, uint8_t opcode,
+                          uint32_t opaque, mc_res_t result) override {
+    ++requests;
+  }
+
+  void batchGetReady(std::vector<McRequest>&& reqs, uint64_t reqid) override {
+    requests += reqs.size();
+  }
+
+  void parseError(McReply errorReply) override {
+    LOG(FATAL) << "Parse error";
+  }
+};
+
+class ClientCallback : public McParser::ClientParseCallback {
+ public:
+  size_t replies{0};
+
+  void replyReady(McReply reply, mc_op_t operation, uint64_t reqid) override {
+    ++replies;
+  }
+
+  void parseError(McReply errorReply) override {
+    LOG(FATAL) << "Parse error";
+  }
+};
+
+/**
+ * Feeds iters copies of data into the parser, one message per read.
+ */
+void feedParser(McParser& parser, const std::string& data, size_t iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    auto buffer = parser.getReadBuffer();
+    CHECK(buffer.second >= data.size());
+    std::memcpy(buffer.first, data.data(), data.size());
+    parser.readDataAvailable(data.size());
+  }
+}
+
+void runServerParser(const std::string& data, size_t iters) {
+  ServerCallback callback;
+  std::unique_ptr<McParser> parser;
+  BENCHMARK_SUSPEND {
+    parser = folly::make_unique<McParser>(&callback, 0, 4096, 4096);
+  }
+  feedParser(*parser, data, iters);
+  CHECK(callback.requests == iters);
+}
+
+void runClientParser(const std::string& data, size_t iters) {
+  ClientCallback callback;
+  std::unique_ptr<McParser> parser;
+  BENCHMARK_SUSPEND {
+    parser = folly::make_unique<McParser>(&callback, 0, 4096, 4096);
+  }
+  feedParser(*parser, data, iters);
+  CHECK(callback.replies == iters);
+}
+
+/**
+ * Peer of a socket pair: sends a message each time it reads one. Closes
+ * after reading `messages` messages, 0 means echo until EOF.
+ */
+class PingPongPeer : public folly::AsyncTransportWrapper::ReadCallback,
+                     public folly::AsyncTransportWrapper::WriteCallback {
+ public:
+  PingPongPeer(folly::AsyncTransportWrapper::UniquePtr transport,
+               size_t messages)
+      : transport_(std::move(transport)),
+        messagesLeft_(messages),
+        message_(kValue) {
+    transport_->setReadCB(this);
+  }
+
+  void start() {
+    transport_->write(this, message_.data(), message_.size());
+  }
+
+  void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+    *bufReturn = buffer_ + received_;
+    *lenReturn = sizeof(buffer_) - received_;
+  }
+
+  void readDataAvailable(size_t len) noexcept override {
+    received_ += len;
+    if (received_ < message_.size()) {
+      return;
+    }
+    received_ = 0;
+    if (messagesLeft_ > 0 && --messagesLeft_ == 0) {
+      transport_->setReadCB(nullptr);
+      transport_->close();
+      return;
+    }
+    transport_->write(this, message_.data(), message_.size());
+  }
+
+  void readEOF() noexcept override {
+    transport_->close();
+  }
+
+  void readErr(const folly::AsyncSocketException& ex) noexcept override {
+    LOG(FATAL) << "Read error: " << ex.what();
+  }
+
+  void writeSuccess() noexcept override {
+  }
+
+  void writeErr(size_t bytesWritten,
+                const folly::AsyncSocketException& ex) noexcept override {
+    LOG(FATAL) << "Write error: " << ex.what();
+  }
+
+ private:
+  folly::AsyncTransportWrapper::UniquePtr transport_;
+  size_t messagesLeft_;
+  const std::string message_;
+  char buffer_[4096];
+  size_t received_{0};
+};
+
+/**
+ * Ping-pongs iters messages over a socket pair.
+ *
+ * @param useIoUring  use IoUringTransport instead of AsyncSocket
+ */
+void runPingPong(size_t iters, bool useIoUring) {
+  folly::EventBase evb;
+  std::unique_ptr<PingPongPeer> client;
+  std::unique_ptr<PingPongPeer> server;
+  BENCHMARK_SUSPEND {
+    int fds[2];
+    PCHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    auto makeTransport = [&evb, useIoUring](int fd) {
+      if (useIoUring) {
+        if (auto ring = IoUring::get(evb)) {
+          return folly::AsyncTransportWrapper::UniquePtr(
+            new IoUringTransport(*ring, fd));
+        }
+        LOG_FIRST_N(WARNING, 1) << "io_uring is not available, "
+                                << "benchmarking AsyncSocket";
+      }
+      return folly::AsyncTransportWrapper::UniquePtr(
+        new folly::AsyncSocket(&evb, fd));
+    };
+    client = folly::make_unique<PingPongPeer>(makeTransport(fds[0]), iters);
+    // echoes until the client closes
+    server = folly::make_unique<PingPongPeer>(makeTransport(fds[1]), 0);
+  }
+  client->start();
+  evb.loop();
+}
+
+/**
+ * Feeds iters copies of request to a McServerSession through
+ * SessionTestHarness, perPacket of them per read as from a pipelining
+ * client. Requests of a read are replied to once all of them are parsed,
+ * so that their replies are written together.
+ */
+void runSession(const std::string& request, size_t perPacket, size_t iters) {
+  std::unique_ptr<SessionTestHarness> harness;
+  std::string packet;
+  BENCHMARK_SUSPEND {
+    harness = folly::make_unique<SessionTestHarness>();
+    harness->discardWrites();
+    harness->pause();
+    for (size_t i = 0; i < perPacket; ++i) {
+      packet += request;
+    }
+  }
+  while (iters > 0) {
+    auto n = std::min(iters, perPacket);
+    harness->inputPackets(
+      folly::StringPiece(packet.data(), n * request.size()));
+    harness->resume();
+    harness->pause();
+    iters -= n;
+  }
+  CHECK(harness->bytesWritten() > 0);
+  BENCHMARK_SUSPEND {
+    harness.reset();
+  }
+}
+
+}  // anonymous namespace
+
+BENCHMARK(McParser_asciiGetRequest, iters) {
+  std::string data;
+  BENCHMARK_SUSPEND {
+    data = folly::to<std::string>("get ", kKey, "\r\n");
+  }
+  runServerParser(data, iters);
+}
+
+BENCHMARK(McParser_asciiSetRequest, iters) {
+  std::string data;
+  BENCHMARK_SUSPEND {
+    data = folly::to<std::string>("set ", kKey, " 0 0 ", kValue.size(),
+                                  "\r\n", kValue, "\r\n");
+  }
+  runServerParser(data, iters);
+}
+
+BENCHMARK(McParser_umbrellaGetRequest, iters) {
+  std::string data;
+  BENCHMARK_SUSPEND {
+    data = umbrellaGetRequest();
+  }
+  runServerParser(data, iters);
+}
+
+BENCHMARK(McParser_asciiGetReply, iters) {
+  std::string data;
+  BENCHMARK_SUSPEND {
+    data = folly::to<std::string>("VALUE ", kKey, " 0 ", kValue.size(),
+                                  "\r\n", kValue, "\r\nEND\r\n");
+  }
+  runClientParser(data, iters);
+}
+
+BENCHMARK(McParser_asciiMissReply, iters) {
+  std::string data;
+  BENCHMARK_SUSPEND {
+    data = "END\r\n";
+  }
+  runClientParser(data, iters);
+}
+
+BENCHMARK(McParser_umbrellaGetReply, iters) {
+  std::string data;
+  BENCHMARK_SUSPEND {
+    data = umbrellaGetReply();
+  }
+  runClientParser(data, iters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(McSerializedRequest_asciiGet, iters) {
+  McRequest req(kKey);
+  for (size_t i = 0; i < iters; ++i) {
+    McSerializedRequest s(req, McOperation<mc_op_get>(), i + 1,
+                          mc_ascii_protocol);
+    folly::doNotOptimizeAway(s.getIovsCount());
+  }
+}
+
+BENCHMARK(McSerializedRequest_asciiSet, iters) {
+  McRequest req(kKey);
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, kValue));
+  for (size_t i = 0; i < iters; ++i) {
+    McSerializedRequest s(req, McOperation<mc_op_set>(), i + 1,
+                          mc_ascii_protocol);
+    folly::doNotOptimizeAway(s.getIovsCount());
+  }
+}
+
+BENCHMARK(McSerializedRequest_umbrellaGet, iters) {
+  McRequest req(kKey);
+  for (size_t i = 0; i < iters; ++i) {
+    McSerializedRequest s(req, McOperation<mc_op_get>(), i + 1,
+                          mc_umbrella_protocol);
+    folly::doNotOptimizeAway(s.getIovsCount());
+  }
+}
+
+BENCHMARK(UmbrellaSerializedMessage_setRequest, iters) {
+  McRequest req(kKey);
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, kValue));
+  UmbrellaSerializedMessage message;
+  for (size_t i = 0; i < iters; ++i) {
+    struct iovec* iovs;
+    size_t niovs;
+    message.prepare(req, McOperation<mc_op_set>(), i + 1, iovs, niovs);
+    folly::doNotOptimizeAway(niovs);
+    message.clear();
+  }
+}
+
+BENCHMARK(UmbrellaSerializedMessage_getReply, iters) {
+  McReply reply(mc_res_found, kValue);
+  UmbrellaSerializedMessage message;
+  for (size_t i = 0; i < iters; ++i) {
+    struct iovec* iovs;
+    size_t niovs;
+    message.prepare(reply, mc_op_get, i + 1, iovs, niovs);
+    folly::doNotOptimizeAway(niovs);
+    message.clear();
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+/* Parsing, McServerRequestContext, reply serialization and writes */
+BENCHMARK(Session_asciiGet, iters) {
+  std::string request;
+  BENCHMARK_SUSPEND {
+    request = folly::to<std::string>("get ", kKey, "\r\n");
+  }
+  runSession(request, 100, iters);
+}
+
+/* One MultiOpParent per 100 key get */
+BENCHMARK(Session_asciiMultiGet100, iters) {
+  std::string request;
+  BENCHMARK_SUSPEND {
+    request = asciiMultiGetRequest(100);
+  }
+  runSession(request, 1, iters);
+}
+
+BENCHMARK(Session_asciiSet100B, iters) {
+  std::string request;
+  BENCHMARK_SUSPEND {
+    request = asciiSetRequest(100);
+  }
+  runSession(request, 100, iters);
+}
+
+BENCHMARK(Session_asciiSet4KB, iters) {
+  std::string request;
+  BENCHMARK_SUSPEND {
+    request = asciiSetRequest(4096);
+  }
+  runSession(request, 10, iters);
+}
+
+BENCHMARK(Session_asciiSet64KB, iters) {
+  std::string request;
+  BENCHMARK_SUSPEND {
+    request = asciiSetRequest(65536);
+  }
+  runSession(request, 1, iters);
+}
+
+BENCHMARK(Session_umbrellaGet, iters) {
+  std::string request;
+  BENCHMARK_SUSPEND {
+    request = umbrellaGetRequest();
+  }
+  runSession(request, 100, iters);
+}
+
+BENCHMARK(Session_umbrellaSet100B, iters) {
+  std::string request;
+  BENCHMARK_SUSPEND {
+    request = umbrellaSetRequest(100);
+  }
+  runSession(request, 100, iters);
+}
+
+BENCHMARK(Session_umbrellaSet4KB, iters) {
+  std::string request;
+  BENCHMARK_SUSPEND {
+    request = umbrellaSetRequest(4096);
+  }
+  runSession(request, 10, iters);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(PingPong_asyncSocket, iters) {
+  runPingPong(iters, /* useIoUring= */ false);
+}
+
+BENCHMARK_RELATIVE(PingPong_ioUring, iters) {
+  runPingPong(iters, /* useIoUring= */ true);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/network/McParser.h"
+#include "mcrouter/lib/network/ReadBufferPool.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+class ClientCallback : public McParser::ClientParseCallback {
+ public:
+  size_t replies{0};
+
+  void replyReady(McReply reply, mc_op_t operation, uint64_t reqid) override {
+    ++replies;
+  }
+
+  void parseError(McReply errorReply) override {
+    ADD_FAILURE() << "Parse error";
+  }
+};
+
+void feed(McParser& parser, const char* data) {
+  auto buffer = parser.getReadBuffer();
+  ASSERT_GE(buffer.second, strlen(data));
+  memcpy(buffer.first, data, strlen(data));
+  parser.readDataAvailable(strlen(data));
+}
+
+}  // anonymous namespace
+
+TEST(ReadBufferPool, borrowRelease) {
+  ReadBufferPool pool(1024, 2);
+
+  auto a = pool.borrow();
+  auto b = pool.borrow();
+  auto c = pool.borrow();
+  EXPECT_GE(a.tailroom(), 1024);
+  EXPECT_EQ(3, pool.stats().borrows);
+  EXPECT_EQ(3, pool.stats().borrowMisses);
+  EXPECT_EQ(3, pool.stats().buffersBorrowed);
+
+  a.append(10);
+  pool.release(a);
+  pool.release(b);
+  pool.release(c);
+  EXPECT_EQ(0, a.capacity());
+  EXPECT_EQ(0, c.capacity());
+  /* Only two buffers are kept */
+  EXPECT_EQ(2, pool.stats().buffersPooled);
+  EXPECT_EQ(0, pool.stats().buffersBorrowed);
+  EXPECT_GE(pool.stats().bytesPooled, 2048);
+
+  auto d = pool.borrow();
+  EXPECT_EQ(0, d.length());
+  EXPECT_GE(d.tailroom(), 1024);
+  EXPECT_EQ(3, pool.stats().borrowMisses);
+  EXPECT_EQ(1, pool.stats().buffersPooled);
+}
+
+TEST(ReadBufferPool, sharedNotPooled) {
+  ReadBufferPool pool(1024, 2);
+
+  auto a = pool.borrow();
+  a.append(100);
+  auto clone = a.clone();
+  pool.release(a);
+  EXPECT_EQ(0, a.capacity());
+  EXPECT_EQ(0, pool.stats().buffersPooled);
+  /* The clone still owns the data */
+  EXPECT_EQ(100, clone->length());
+}
+
+TEST(ReadBufferPool, oversizedNotPooled) {
+  ReadBufferPool pool(1024, 2);
+
+  auto a = pool.borrow();
+  a.reserve(0, 8192);
+  pool.release(a);
+  EXPECT_EQ(0, pool.stats().buffersPooled);
+  EXPECT_EQ(0, pool.stats().bytesPooled);
+}
+
+TEST(ReadBufferPool, clientParserReturnsBuffer) {
+  ReadBufferPool pool(4096, 2);
+  ClientCallback callback;
+  McParser parser(&callback, 0, 256, pool.bufferSize(), &pool);
+  EXPECT_EQ(0, pool.stats().borrows);
+
+  feed(parser, "STORED\r\n");
+  EXPECT_EQ(1, callback.replies);
+  EXPECT_EQ(0, pool.stats().buffersBorrowed);
+  EXPECT_EQ(1, pool.stats().buffersPooled);
+
+  /* the ascii parser keeps partial replies itself */
+  feed(parser, "STO");
+  EXPECT_EQ(0, pool.stats().buffersBorrowed);
+  feed(parser, "RED\r\n");
+  EXPECT_EQ(2, callback.replies);
+  EXPECT_EQ(0, pool.stats().buffersBorrowed);
+  EXPECT_EQ(1, pool.stats().borrowMisses);
+}
@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <unordered_map>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/network/RequestIdMap.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+TEST(RequestIdMap, basic) {
+  int a, b;
+  RequestIdMap<int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(nullptr, map.find(1));
+
+  map.insert(1, &a);
+  map.insert(2, &b);
+  EXPECT_EQ(2, map.size());
+  EXPECT_EQ(&a, map.find(1));
+  EXPECT_EQ(&b, map.find(2));
+  EXPECT_EQ(nullptr, map.find(3));
+
+  map.insert(1, &b);
+  EXPECT_EQ(2, map.size());
+  EXPECT_EQ(&b, map.find(1));
+
+  map.erase(1);
+  map.erase(3);
+  EXPECT_EQ(1, map.size());
+  EXPECT_EQ(nullptr, map.find(1));
+  EXPECT_EQ(&b, map.find(2));
+}
+
+TEST(RequestIdMap, reserve) {
+  RequestIdMap<int> map;
+  map.reserve(1000);
+  auto capacity = map.capacity();
+  EXPECT_GE(capacity, 2000);
+
+  int x;
+  for (uint64_t id = 1; id <= 1000; ++id) {
+    map.insert(id, &x);
+  }
+  EXPECT_EQ(capacity, map.capacity());
+  EXPECT_EQ(1000, map.size());
+}
+
+TEST(RequestIdMap, collisions) {
+  std::vector<int> values(64);
+  RequestIdMap<int> map;
+  std::unordered_map<uint64_t, int*> expected;
+
+  // All of these ids share the same home slot, and some of the chains wrap
+  // around the end of the table.
+  auto capacity = map.capacity();
+  for (size_t i = 0; i < capacity / 2 - 1; ++i) {
+    uint64_t id = (capacity - 2) + i * capacity;
+    map.insert(id, &values[i]);
+    expected[id] = &values[i];
+  }
+  EXPECT_EQ(capacity, map.capacity());
+
+  // Erase from the middle of the probe chain, everything else should still be
+  // reachable.
+  for (size_t i = 0; i < capacity / 2 - 1; i += 2) {
+    uint64_t id = (capacity - 2) + i * capacity;
+    map.erase(id);
+    expected.erase(id);
+    for (const auto& it : expected) {
+      EXPECT_EQ(it.second, map.find(it.first));
+    }
+    EXPECT_EQ(nullptr, map.find(id));
+  }
+  EXPECT_EQ(expected.size(), map.size());
+}
+
+TEST(RequestIdMap, slidingWindow) {
+  std::vector<int> values(100);
+  RequestIdMap<int> map;
+  map.reserve(values.size());
+  auto capacity = map.capacity();
+
+  // Emulate monotonic ids with a bounded number of requests in flight,
+  // replied out of order.
+  uint64_t nextId = 1;
+  std::vector<uint64_t> inflight;
+  for (size_t iter = 0; iter < 10000; ++iter) {
+    while (inflight.size() < values.size()) {
+      map.insert(nextId, &values[nextId % values.size()]);
+      inflight.push_back(nextId++);
+    }
+    auto pos = (iter * 7) % inflight.size();
+    auto id = inflight[pos];
+    EXPECT_EQ(&values[id % values.size()], map.find(id));
+    map.erase(id);
+    EXPECT_EQ(nullptr, map.find(id));
+    inflight.erase(inflight.begin() + pos);
+  }
+  EXPECT_EQ(inflight.size(), map.size());
+  EXPECT_EQ(capacity, map.capacity());
+}
+
+} // namespace
@@ -13,6 +13,8 @@
 #include <gtest/gtest.h>
 
 #include "mcrouter/lib/network/AsyncMcServerWorkerOptions.h"
+#include "mcrouter/lib/network/McServerSession.h"
+#include "mcrouter/lib/network/ReadScheduler.h"
 #include "mcrouter/lib/network/test/SessionTestHarness.h"
 
 using namespace facebook::memcache;
@@ -34,6 +36,93 @@ TEST(Session, basic) {
     t.flushWrites());
 }
 
+TEST(Session, maxWriteBytes) {
+  AsyncMcServerWorkerOptions opts;
+  /* Room for two 34 byte replies */
+  opts.maxWriteBytes = 70;
+  SessionTestHarness t(opts);
+  t.inputPackets("get key1\r\nget key2\r\nget key3\r\n");
+
+  EXPECT_EQ(
+    vector<string>({"VALUE key1 0 10\r\nkey1_value\r\nEND\r\n"
+                    "VALUE key2 0 10\r\nkey2_value\r\nEND\r\n",
+                    "VALUE key3 0 10\r\nkey3_value\r\nEND\r\n"}),
+    t.flushWrites());
+}
+
+TEST(Session, stats) {
+  SessionTestHarness t;
+  t.pause();
+  t.inputPackets("get key1\r\n", "get key2\r\nget key3\r\n");
+
+  const auto& stats = t.session().stats();
+  EXPECT_EQ(3, stats.requests);
+  EXPECT_EQ(0, stats.completed);
+  EXPECT_EQ(30, stats.bytesIn);
+  EXPECT_EQ(3, stats.maxInFlight);
+
+  t.resume();
+  auto writes = t.flushWrites();
+  size_t written = 0;
+  for (const auto& w : writes) {
+    written += w.size();
+  }
+  EXPECT_EQ(3, stats.completed);
+  EXPECT_EQ(3 * 34, written);
+  EXPECT_EQ(written, stats.bytesOut);
+  EXPECT_EQ(3, stats.maxInFlight);
+  EXPECT_GE(stats.avgLatencyUs(), 0.0);
+  EXPECT_TRUE(t.session().peerAddress().empty());
+}
+
+namespace {
+
+uint64_t blockedReplies(const McServerSession::Stats& stats) {
+  uint64_t total = 0;
+  for (auto n : stats.blockedUs) {
+    total += n;
+  }
+  return total;
+}
+
+}  // anonymous namespace
+
+TEST(Session, multigetHeld) {
+  SessionTestHarness t;
+  t.pause();
+  t.inputPackets("get key1 key2\r\n");
+
+  /* Nothing is written until the whole multiget is done */
+  t.resume(1);
+  EXPECT_TRUE(t.flushWrites().empty());
+  t.resume();
+  EXPECT_EQ(
+    vector<string>({"VALUE key1 0 10\r\nkey1_value\r\n"
+                    "VALUE key2 0 10\r\nkey2_value\r\n"
+                    "END\r\n"}),
+    t.flushWrites());
+  /* Both hits and the END waited for the block context */
+  EXPECT_EQ(3, blockedReplies(t.session().stats()));
+}
+
+TEST(Session, streamMultiget) {
+  AsyncMcServerWorkerOptions opts;
+  opts.streamMultiget = true;
+  SessionTestHarness t(opts);
+  t.pause();
+  t.inputPackets("get key1 key2\r\n");
+
+  /* The first hit goes out before the second key is done */
+  t.resume(1);
+  EXPECT_EQ(vector<string>({"VALUE key1 0 10\r\nkey1_value\r\n"}),
+            t.flushWrites());
+  t.resume();
+  EXPECT_EQ(
+    vector<string>({"VALUE key2 0 10\r\nkey2_value\r\nEND\r\n"}),
+    t.flushWrites());
+  EXPECT_EQ(0, blockedReplies(t.session().stats()));
+}
+
 TEST(Session, throttle) {
   AsyncMcServerWorkerOptions opts;
   opts.maxInFlight = 2;
@@ -76,6 +165,69 @@ TEST(Session, throttle) {
   EXPECT_TRUE(t.pausedKeys().empty());
 }
 
+TEST(Session, throttleBytes) {
+  AsyncMcServerWorkerOptions opts;
+  /* Two 4 byte keys */
+  opts.maxInFlightBytes = 8;
+  SessionTestHarness t(opts);
+
+  t.pause();
+  t.inputPackets(
+    "get key1\r\n",
+    "get key2\r\n",
+    "get key3\r\n");
+
+  EXPECT_TRUE(t.flushWrites().empty());
+  EXPECT_EQ(vector<string>({"key1", "key2"}), t.pausedKeys());
+
+  /* Replying frees 4 bytes, one more request will be read */
+  t.resume(1);
+
+  EXPECT_EQ(
+    vector<string>({"VALUE key1 0 10\r\nkey1_value\r\nEND\r\n"}),
+    t.flushWrites());
+  EXPECT_EQ(vector<string>({"key2", "key3"}), t.pausedKeys());
+
+  t.resume();
+  EXPECT_EQ(
+    vector<string>({"VALUE key2 0 10\r\nkey2_value\r\nEND\r\n"
+                    "VALUE key3 0 10\r\nkey3_value\r\nEND\r\n"}),
+    t.flushWrites());
+}
+
+TEST(Session, readScheduler) {
+  AsyncMcServerWorkerOptions opts;
+  opts.workerMaxInFlightBytes = 10;
+  opts.readQuantumBytes = 100;
+  SessionTestHarness t(opts);
+
+  /* The third key goes over the worker limit with no deficit left */
+  t.pause();
+  t.inputPackets(
+    "get key1\r\n",
+    "get key2\r\n",
+    "get key3\r\n",
+    "get key4\r\n");
+
+  EXPECT_TRUE(t.flushWrites().empty());
+  EXPECT_EQ(vector<string>({"key1", "key2", "key3"}), t.pausedKeys());
+  EXPECT_EQ(12, t.readScheduler()->stats().inFlightBytes);
+  EXPECT_EQ(1, t.readScheduler()->stats().waitingSessions);
+  EXPECT_EQ(1, t.readScheduler()->stats().pauses);
+
+  /* Under the limit again: the session gets its turn in the next
+     loop iteration */
+  t.resume();
+  t.flushWrites();
+  EXPECT_EQ(0, t.readScheduler()->stats().inFlightBytes);
+  EXPECT_EQ(0, t.readScheduler()->stats().waitingSessions);
+
+  t.resume();
+  EXPECT_EQ(
+    vector<string>({"VALUE key4 0 10\r\nkey4_value\r\nEND\r\n"}),
+    t.flushWrites());
+}
+
 TEST(Session, throttleBigPacket) {
   AsyncMcServerWorkerOptions opts;
   opts.maxInFlight = 2;
@@ -9,6 +9,7 @@
  */
 #include "SessionTestHarness.h"
 
+#include <folly/Memory.h>
 #include <folly/SocketAddress.h>
 
 #include "mcrouter/lib/network/McServerSession.h"
@@ -42,13 +43,19 @@ class MockAsyncSocket : public folly::AsyncTransportWrapper {
 
   void writev(folly::AsyncTransportWrapper::WriteCallback* callback, const iovec* vec, size_t count,
               WriteFlags flags = WriteFlags::NONE) override {
-    std::string out;
-    for (size_t i = 0; i < count; ++i) {
-      out += std::string(reinterpret_cast<char*>(vec[i].iov_base),
-                         vec[i].iov_len);
-    }
+    if (harness_.discardWrites_) {
+      for (size_t i = 0; i < count; ++i) {
+        harness_.bytesWritten_ += vec[i].iov_len;
+      }
+    } else {
+      std::string out;
+      for (size_t i = 0; i < count; ++i) {
+        out += std::string(reinterpret_cast<char*>(vec[i].iov_base),
+                           vec[i].iov_len);
+      }
 
-    harness_.write(out);
+      harness_.write(out);
+    }
 
     if (callback) {
       callback->writeSuccess();
@@ -117,7 +124,13 @@ SessionTestHarness::SessionTestHarness(
     AsyncMcServerWorkerOptions opts,
     std::function<void(McServerSession&)> onWriteQuiescence,
     std::function<void(McServerSession&)> onTerminate)
-    : session_(McServerSession::create(
+    : readScheduler_(opts.workerMaxInFlightBytes > 0
+                     ? folly::make_unique<ReadScheduler>(
+                         eventBase_,
+                         opts.workerMaxInFlightBytes,
+                         opts.readQuantumBytes)
+                     : nullptr),
+      session_(McServerSession::create(
           folly::AsyncTransportWrapper::UniquePtr(
               new MockAsyncSocket(*this)),
           std::make_shared<McServerOnRequestWrapper<OnRequest>>(
@@ -126,7 +139,10 @@ SessionTestHarness::SessionTestHarness(
           std::move(onTerminate),
           nullptr,
           std::move(opts),
-          nullptr)) {}
+          nullptr,
+          nullptr,
+          nullptr,
+          readScheduler_.get())) {}
 
 void SessionTestHarness::inputPacket(folly::StringPiece p) {
   savedInputs_.push_back(p.str());
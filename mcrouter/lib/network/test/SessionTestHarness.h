@@ -68,6 +68,21 @@ class SessionTestHarness {
     return output;
   }
 
+  /**
+   * Only count the bytes written from now on instead of keeping the writes
+   * for flushWrites(), which saves copying them (e.g. in benchmarks).
+   */
+  void discardWrites() {
+    discardWrites_ = true;
+  }
+
+  /**
+   * @return number of bytes written on the socket so far.
+   */
+  size_t bytesWritten() const {
+    return bytesWritten_;
+  }
+
   /**
    * Stop replying to incoming requests immediately
    */
@@ -103,6 +118,14 @@ class SessionTestHarness {
     session_.close();
   }
 
+  const McServerSession& session() const {
+    return session_;
+  }
+
+  const ReadScheduler* readScheduler() const {
+    return readScheduler_.get();
+  }
+
   /**
    * Returns the list of currently accumulated paused requests' keys.
    */
@@ -116,9 +139,13 @@ class SessionTestHarness {
 
  private:
   folly::EventBase eventBase_;
+  /* Set if opts.workerMaxInFlightBytes is non-zero, as in the worker */
+  std::unique_ptr<ReadScheduler> readScheduler_;
   McServerSession& session_;
   std::deque<std::string> savedInputs_;
   std::vector<std::string> output_;
+  bool discardWrites_{false};
+  size_t bytesWritten_{0};
   folly::AsyncTransportWrapper::ReadCallback* read_;
 
   /* Paused state. -1 means reply to everything; >= 0 means
@@ -140,6 +167,7 @@ class SessionTestHarness {
 
   /* MockAsyncSocket interface */
   void write(folly::StringPiece out) {
+    bytesWritten_ += out.size();
     output_.push_back(out.str());
   }
 
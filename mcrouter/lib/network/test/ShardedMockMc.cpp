@@ -0,0 +1,150 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ShardedMockMc.h"
+
+#include <time.h>
+
+#include <algorithm>
+
+#include <folly/Conv.h>
+#include <folly/Memory.h>
+#include <folly/SpookyHashV2.h>
+
+#include "mcrouter/lib/IOBufUtil.h"
+#include "mcrouter/lib/McRequest.h"
+
+namespace facebook { namespace memcache {
+
+ShardedMockMc::Item::Item(const McRequest& req)
+    : exptime(req.exptime() > 0 ? req.exptime() + time(nullptr) : 0),
+      flags(req.flags()) {
+  req.value().cloneInto(value);
+}
+
+ShardedMockMc::Item::Item(const Item& other)
+    : exptime(other.exptime),
+      flags(other.flags) {
+  other.value.cloneInto(value);
+}
+
+ShardedMockMc::Item& ShardedMockMc::Item::operator=(const Item& other) {
+  if (this != &other) {
+    other.value.cloneInto(value);
+    exptime = other.exptime;
+    flags = other.flags;
+  }
+  return *this;
+}
+
+ShardedMockMc::ShardedMockMc(size_t numShards, size_t expectedItems) {
+  numShards = std::max<size_t>(1, numShards);
+  for (size_t i = 0; i < numShards; ++i) {
+    shards_.push_back(folly::make_unique<Shard>());
+    shards_.back()->items.reserve(expectedItems / numShards + 1);
+  }
+}
+
+ShardedMockMc::Shard& ShardedMockMc::shard(folly::StringPiece key) {
+  auto hash = folly::hash::SpookyHashV2::Hash64(key.data(), key.size(), 0);
+  return *shards_[hash % shards_.size()];
+}
+
+ShardedMockMc::Item* ShardedMockMc::find(Shard& shard,
+                                         const std::string& key) {
+  auto it = shard.items.find(key);
+  if (it == shard.items.end()) {
+    return nullptr;
+  }
+  if (it->second.exptime > 0 && it->second.exptime <= time(nullptr)) {
+    shard.items.erase(it);
+    return nullptr;
+  }
+  return &it->second;
+}
+
+bool ShardedMockMc::get(folly::StringPiece key, Item& out) {
+  auto& s = shard(key);
+  std::lock_guard<std::mutex> guard(s.lock);
+  auto item = find(s, key.str());
+  if (!item) {
+    return false;
+  }
+  out = *item;
+  return true;
+}
+
+void ShardedMockMc::set(folly::StringPiece key, Item item) {
+  auto& s = shard(key);
+  std::lock_guard<std::mutex> guard(s.lock);
+  s.items[key.str()] = std::move(item);
+}
+
+bool ShardedMockMc::add(folly::StringPiece key, Item item) {
+  auto& s = shard(key);
+  auto k = key.str();
+  std::lock_guard<std::mutex> guard(s.lock);
+  if (find(s, k)) {
+    return false;
+  }
+  s.items[k] = std::move(item);
+  return true;
+}
+
+bool ShardedMockMc::replace(folly::StringPiece key, Item item) {
+  auto& s = shard(key);
+  auto k = key.str();
+  std::lock_guard<std::mutex> guard(s.lock);
+  auto existing = find(s, k);
+  if (!existing) {
+    return false;
+  }
+  *existing = std::move(item);
+  return true;
+}
+
+std::pair<bool, int64_t> ShardedMockMc::arith(folly::StringPiece key,
+                                               int64_t delta) {
+  auto& s = shard(key);
+  std::lock_guard<std::mutex> guard(s.lock);
+  auto item = find(s, key.str());
+  if (!item) {
+    return std::make_pair(false, 0);
+  }
+
+  auto value = item->value.clone();
+  auto newval = folly::to<uint64_t>(coalesceAndGetRange(value)) + delta;
+  item->value = folly::IOBuf(folly::IOBuf::COPY_BUFFER,
+                             folly::to<std::string>(newval));
+  return std::make_pair(true, newval);
+}
+
+bool ShardedMockMc::del(folly::StringPiece key) {
+  auto& s = shard(key);
+  auto k = key.str();
+  std::lock_guard<std::mutex> guard(s.lock);
+  if (!find(s, k)) {
+    return false;
+  }
+  s.items.erase(k);
+  return true;
+}
+
+uint64_t ShardedMockMc::newLeaseToken() {
+  return leaseTokens_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ShardedMockMc::flushAll() {
+  for (auto& s : shards_) {
+    std::lock_guard<std::mutex> guard(s->lock);
+    s->items.clear();
+  }
+}
+
+}}  // facebook::memcache
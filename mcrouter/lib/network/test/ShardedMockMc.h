@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <folly/io/IOBuf.h>
+#include <folly/Range.h>
+
+namespace facebook { namespace memcache {
+
+class McRequest;
+
+/**
+ * Thread-safe hash table for benchmarking with MockMcServer: keys are
+ * spread over shards with a lock each, so that many server threads can
+ * share one table.
+ *
+ * Compared to MockMc, there is no TLRU: deleted items are gone, lease-gets
+ * that miss always get a new token and lease-sets always store.
+ */
+class ShardedMockMc {
+ public:
+  struct Item {
+    folly::IOBuf value;
+    uint32_t exptime{0};
+    uint64_t flags{0};
+
+    Item() = default;
+    explicit Item(const McRequest& req);
+
+    /* Shares (doesn't copy) the value */
+    Item(const Item& other);
+    Item& operator=(const Item& other);
+  };
+
+  /**
+   * @param expectedItems  the table is sized for this many items up front,
+   *                       so that it doesn't rehash while being filled
+   */
+  ShardedMockMc(size_t numShards, size_t expectedItems);
+
+  /**
+   * @return  true and the item in out if it exists and hasn't expired
+   */
+  bool get(folly::StringPiece key, Item& out);
+
+  void set(folly::StringPiece key, Item item);
+
+  bool add(folly::StringPiece key, Item item);
+
+  bool replace(folly::StringPiece key, Item item);
+
+  /**
+   * @return  (exists, new value), see MockMc::arith()
+   */
+  std::pair<bool, int64_t> arith(folly::StringPiece key, int64_t delta);
+
+  bool del(folly::StringPiece key);
+
+  /**
+   * @return  new lease token (> 1)
+   */
+  uint64_t newLeaseToken();
+
+  void flushAll();
+
+ private:
+  struct Shard {
+    std::mutex lock;
+    std::unordered_map<std::string, Item> items;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<uint64_t> leaseTokens_{100};
+
+  Shard& shard(folly::StringPiece key);
+
+  /**
+   * @return  the unexpired item with key, nullptr if there's none
+   *          (expects shard.lock to be held)
+   */
+  static Item* find(Shard& shard, const std::string& key);
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,129 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/lib/IOBufUtil.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/test/MockMcFaults.h"
+#include "mcrouter/lib/network/test/ShardedMockMc.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+McRequest setRequest(folly::StringPiece key, folly::StringPiece value) {
+  McRequest req(key);
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value));
+  req.setFlags(7);
+  return req;
+}
+
+std::string getValue(ShardedMockMc& mc, folly::StringPiece key) {
+  ShardedMockMc::Item item;
+  if (!mc.get(key, item)) {
+    return "<miss>";
+  }
+  return coalesceAndGetRange(item.value).str();
+}
+
+}  // anonymous namespace
+
+TEST(ShardedMockMc, basic) {
+  ShardedMockMc mc(4, 100);
+
+  EXPECT_EQ("<miss>", getValue(mc, "a"));
+  mc.set("a", ShardedMockMc::Item(setRequest("a", "1")));
+  EXPECT_EQ("1", getValue(mc, "a"));
+
+  EXPECT_FALSE(mc.add("a", ShardedMockMc::Item(setRequest("a", "2"))));
+  EXPECT_TRUE(mc.replace("a", ShardedMockMc::Item(setRequest("a", "2"))));
+  EXPECT_FALSE(mc.replace("b", ShardedMockMc::Item(setRequest("b", "2"))));
+  EXPECT_EQ("2", getValue(mc, "a"));
+
+  EXPECT_EQ(std::make_pair(true, int64_t(12)), mc.arith("a", 10));
+  EXPECT_EQ("12", getValue(mc, "a"));
+  EXPECT_FALSE(mc.arith("b", 1).first);
+
+  EXPECT_TRUE(mc.del("a"));
+  EXPECT_FALSE(mc.del("a"));
+  EXPECT_EQ("<miss>", getValue(mc, "a"));
+
+  auto token = mc.newLeaseToken();
+  EXPECT_GT(token, 1);
+  EXPECT_NE(token, mc.newLeaseToken());
+
+  mc.set("c", ShardedMockMc::Item(setRequest("c", "3")));
+  mc.flushAll();
+  EXPECT_EQ("<miss>", getValue(mc, "c"));
+}
+
+TEST(ShardedMockMc, threads) {
+  ShardedMockMc mc(16, 4000);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&mc, t]() {
+      for (int i = 0; i < 1000; ++i) {
+        auto key = folly::to<std::string>(t, ":", i);
+        mc.set(key, ShardedMockMc::Item(setRequest(key, key)));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < 4; ++t) {
+    for (int i = 0; i < 1000; ++i) {
+      auto key = folly::to<std::string>(t, ":", i);
+      EXPECT_EQ(key, getValue(mc, key));
+    }
+  }
+}
+
+TEST(MockMcFaults, pick) {
+  std::mt19937_64 rng(0);
+  MockMcFaults faults;
+  EXPECT_TRUE(faults.empty());
+
+  faults.addError("get:1:busy");
+  faults.addDelay("all:1:uniform:5:10");
+  faults.addDelay("set:0:1000");
+  EXPECT_FALSE(faults.empty());
+
+  auto fault = faults.pick(mc_op_get, rng);
+  EXPECT_EQ(mc_res_busy, fault.error);
+  EXPECT_GE(fault.delay.count(), 5);
+  EXPECT_LE(fault.delay.count(), 10);
+
+  fault = faults.pick(mc_op_set, rng);
+  EXPECT_EQ(mc_res_unknown, fault.error);
+  EXPECT_LE(fault.delay.count(), 10);
+
+  faults.addError("delete:0.5:timeout");
+  size_t errors = 0;
+  for (int i = 0; i < 1000; ++i) {
+    errors += faults.pick(mc_op_delete, rng).error == mc_res_timeout;
+  }
+  EXPECT_GT(errors, 400);
+  EXPECT_LT(errors, 600);
+
+  EXPECT_THROW(faults.addError("get:0.1:nosuchresult"), std::invalid_argument);
+  EXPECT_THROW(faults.addError("nosuchop:0.1:busy"), std::invalid_argument);
+  EXPECT_THROW(faults.addDelay("get:2:10"), std::invalid_argument);
+  EXPECT_THROW(faults.addDelay("get:0.1:uniform:10:5"), std::invalid_argument);
+  EXPECT_THROW(faults.addDelay("get:0.1"), std::invalid_argument);
+}
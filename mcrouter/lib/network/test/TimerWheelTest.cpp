@@ -0,0 +1,188 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/lib/network/TimerWheel.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+class TestCallback : public TimerWheel::Callback {
+ public:
+  explicit TestCallback(int id = 0, std::vector<int>* order = nullptr)
+    : id_(id), order_(order) {}
+
+  void timeoutExpired() noexcept override {
+    ++fired;
+    firedAt = Clock::now();
+    if (order_) {
+      order_->push_back(id_);
+    }
+  }
+
+  size_t fired{0};
+  Clock::time_point firedAt;
+
+ private:
+  int id_;
+  std::vector<int>* order_;
+};
+
+}  // anonymous namespace
+
+TEST(TimerWheel, sharedPerEventBase) {
+  folly::EventBase evb1;
+  folly::EventBase evb2;
+  auto wheel = TimerWheel::get(evb1);
+  EXPECT_EQ(wheel, TimerWheel::get(evb1));
+  EXPECT_NE(wheel, TimerWheel::get(evb2));
+}
+
+TEST(TimerWheel, outOfOrderTimeouts) {
+  folly::EventBase evb;
+  auto wheel = TimerWheel::get(evb);
+  std::vector<int> order;
+  TestCallback a(1, &order);
+  TestCallback b(2, &order);
+  TestCallback c(3, &order);
+
+  auto start = Clock::now();
+  wheel->scheduleTimeout(a, std::chrono::milliseconds(30));
+  wheel->scheduleTimeout(b, std::chrono::milliseconds(10));
+  wheel->scheduleTimeout(c, std::chrono::milliseconds(20));
+  EXPECT_EQ(3, wheel->count());
+
+  evb.loop();
+
+  EXPECT_EQ(std::vector<int>({2, 3, 1}), order);
+  EXPECT_EQ(0, wheel->count());
+  EXPECT_GE(b.firedAt - start, std::chrono::milliseconds(10));
+  EXPECT_GE(c.firedAt - start, std::chrono::milliseconds(20));
+  EXPECT_GE(a.firedAt - start, std::chrono::milliseconds(30));
+}
+
+TEST(TimerWheel, cancelAndReschedule) {
+  folly::EventBase evb;
+  auto wheel = TimerWheel::get(evb);
+  TestCallback a;
+  TestCallback b;
+
+  wheel->scheduleTimeout(a, std::chrono::milliseconds(10));
+  wheel->scheduleTimeout(b, std::chrono::milliseconds(10));
+  a.cancelTimeout();
+  EXPECT_FALSE(a.isScheduled());
+  EXPECT_TRUE(b.isScheduled());
+  /* Rescheduling replaces the old timeout */
+  wheel->scheduleTimeout(b, std::chrono::milliseconds(20));
+  EXPECT_EQ(1, wheel->count());
+
+  evb.loop();
+
+  EXPECT_EQ(0, a.fired);
+  EXPECT_EQ(1, b.fired);
+  EXPECT_FALSE(b.isScheduled());
+
+  {
+    TestCallback c;
+    wheel->scheduleTimeout(c, std::chrono::milliseconds(10));
+  }
+  /* Destroyed callbacks are cancelled */
+  EXPECT_EQ(0, wheel->count());
+  evb.loop();
+}
+
+TEST(TimerWheel, higherLevels) {
+  folly::EventBase evb;
+  auto wheel = TimerWheel::get(evb);
+  std::vector<int> order;
+  /* Beyond the first level, cascaded down while waiting */
+  TestCallback a(1, &order);
+  TestCallback b(2, &order);
+
+  auto start = Clock::now();
+  wheel->scheduleTimeout(a, std::chrono::milliseconds(600));
+  wheel->scheduleTimeout(b, std::chrono::milliseconds(300));
+
+  evb.loop();
+
+  EXPECT_EQ(std::vector<int>({2, 1}), order);
+  EXPECT_GE(b.firedAt - start, std::chrono::milliseconds(300));
+  EXPECT_GE(a.firedAt - start, std::chrono::milliseconds(600));
+  EXPECT_LT(a.firedAt - start, std::chrono::milliseconds(900));
+}
+
+TEST(TimerWheel, manyTimers) {
+  const size_t kNumTimers = 200000;
+  folly::EventBase evb;
+  auto wheel = TimerWheel::get(evb);
+  std::vector<std::unique_ptr<TestCallback>> callbacks;
+  callbacks.reserve(kNumTimers);
+  for (size_t i = 0; i < kNumTimers; ++i) {
+    callbacks.emplace_back(new TestCallback());
+    wheel->scheduleTimeout(*callbacks.back(),
+                           std::chrono::milliseconds(1 + i % 50));
+  }
+  for (size_t i = 0; i < kNumTimers; i += 2) {
+    callbacks[i]->cancelTimeout();
+  }
+  EXPECT_EQ(kNumTimers / 2, wheel->count());
+
+  evb.loop();
+
+  for (size_t i = 0; i < kNumTimers; ++i) {
+    EXPECT_EQ(i % 2, callbacks[i]->fired);
+  }
+}
+
+TEST(TimerWheel, rescheduleFromCallback) {
+  class Periodic : public TimerWheel::Callback {
+   public:
+    explicit Periodic(TimerWheel& wheel) : wheel_(wheel) {}
+    void timeoutExpired() noexcept override {
+      if (++fired < 3) {
+        wheel_.scheduleTimeout(*this, std::chrono::milliseconds(0));
+      }
+    }
+    size_t fired{0};
+   private:
+    TimerWheel& wheel_;
+  };
+
+  folly::EventBase evb;
+  auto wheel = TimerWheel::get(evb);
+  Periodic periodic(*wheel);
+  wheel->scheduleTimeout(periodic, std::chrono::milliseconds(0));
+  evb.loop();
+  EXPECT_EQ(3, periodic.fired);
+}
+
+TEST(TimerWheel, eventBaseDestroyed) {
+  std::shared_ptr<TimerWheel> wheel;
+  TestCallback a;
+  {
+    folly::EventBase evb;
+    wheel = TimerWheel::get(evb);
+    wheel->scheduleTimeout(a, std::chrono::milliseconds(10));
+  }
+  /* Pending timers are dropped, new ones are never scheduled */
+  EXPECT_FALSE(a.isScheduled());
+  wheel->scheduleTimeout(a, std::chrono::milliseconds(10));
+  EXPECT_FALSE(a.isScheduled());
+  EXPECT_EQ(0, a.fired);
+}
@@ -0,0 +1,310 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include <folly/Bits.h>
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/mc/umbrella_protocol.h"
+#include "mcrouter/lib/McMsgRef.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/UmbrellaProtocol.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+std::unique_ptr<folly::IOBuf> serialize(const McReply& reply, mc_op_t op,
+                                        uint64_t reqid) {
+  UmbrellaSerializedMessage message;
+  struct iovec* iovs;
+  size_t niovs;
+  EXPECT_TRUE(message.prepare(reply, op, reqid, iovs, niovs));
+  auto buf = folly::IOBuf::create(0);
+  for (size_t i = 0; i < niovs; ++i) {
+    buf->prependChain(folly::IOBuf::copyBuffer(iovs[i].iov_base,
+                                               iovs[i].iov_len));
+  }
+  buf->coalesce();
+  return buf;
+}
+
+bool parse(const folly::IOBuf& buf, mc_op_t& op, uint64_t& reqid,
+           McReply& reply) {
+  um_message_info_t info;
+  EXPECT_EQ(um_ok, um_parse_header(buf.data(), buf.length(), &info));
+  return umbrellaParseReply(buf, buf.data(), info.header_size,
+                            buf.data() + info.header_size, info.body_size,
+                            op, reqid, reply);
+}
+
+/**
+ * Body of the coalesced message buf, as a chain of two buffers split at
+ * offset split of the body.
+ */
+std::unique_ptr<folly::IOBuf> splitBody(const folly::IOBuf& buf,
+                                        const um_message_info_t& info,
+                                        size_t split) {
+  auto body = buf.data() + info.header_size;
+  auto chain = folly::IOBuf::copyBuffer(body, split);
+  chain->prependChain(folly::IOBuf::copyBuffer(body + split,
+                                               info.body_size - split));
+  return chain;
+}
+
+}  // anonymous namespace
+
+TEST(UmbrellaProtocol, parseReply) {
+  McReply reply(mc_res_found, "value");
+  reply.setFlags(0x20);
+  reply.setLeaseToken(12);
+  reply.setCas(34);
+  reply.setAppSpecificErrorCode(5);
+  auto buf = serialize(reply, mc_op_gets, 17);
+
+  mc_op_t op;
+  uint64_t reqid;
+  McReply parsed(mc_res_unknown);
+  ASSERT_TRUE(parse(*buf, op, reqid, parsed));
+  EXPECT_EQ(mc_op_gets, op);
+  EXPECT_EQ(17, reqid);
+  EXPECT_EQ(mc_res_found, parsed.result());
+  EXPECT_EQ("value", parsed.valueRangeSlow().str());
+  EXPECT_EQ(0x20, parsed.flags());
+  EXPECT_EQ(12, parsed.leaseToken());
+  EXPECT_EQ(34, parsed.cas());
+  EXPECT_EQ(5, parsed.appSpecificErrorCode());
+}
+
+TEST(UmbrellaProtocol, parseReplyNoValue) {
+  auto buf = serialize(McReply(mc_res_stored), mc_op_set, 1);
+
+  mc_op_t op;
+  uint64_t reqid;
+  McReply parsed(mc_res_unknown);
+  ASSERT_TRUE(parse(*buf, op, reqid, parsed));
+  EXPECT_EQ(mc_op_set, op);
+  EXPECT_EQ(mc_res_stored, parsed.result());
+  EXPECT_FALSE(parsed.hasValue());
+}
+
+TEST(UmbrellaProtocol, parseReplyNeedsMsg) {
+  auto msg = createMcMsgRef();
+  msg->exptime = 100;
+  McReply reply(mc_res_found, McMsgRef(std::move(msg)));
+  auto buf = serialize(reply, mc_op_get, 1);
+
+  mc_op_t op;
+  uint64_t reqid;
+  McReply parsed(mc_res_unknown);
+  EXPECT_FALSE(parse(*buf, op, reqid, parsed));
+}
+
+TEST(UmbrellaProtocol, parseReplyErrors) {
+  auto buf = serialize(McReply(mc_res_found, "value"), mc_op_get, 1);
+  um_message_info_t info;
+  ASSERT_EQ(um_ok, um_parse_header(buf->data(), buf->length(), &info));
+
+  mc_op_t op;
+  uint64_t reqid;
+  McReply parsed(mc_res_unknown);
+  /* Body doesn't contain the value */
+  auto header = folly::IOBuf::copyBuffer(buf->data(), info.header_size);
+  EXPECT_THROW(umbrellaParseReply(*header, buf->data(), info.header_size,
+                                  buf->data() + info.header_size,
+                                  info.body_size, op, reqid, parsed),
+               std::runtime_error);
+}
+
+TEST(UmbrellaProtocol, batchGet) {
+  std::vector<folly::StringPiece> keys = {"a", "bb", "ccc"};
+  UmbrellaSerializedMessage message;
+  struct iovec* iovs;
+  size_t niovs;
+  ASSERT_TRUE(message.prepareBatchGet(keys, 17, iovs, niovs));
+  auto buf = folly::IOBuf::create(0);
+  for (size_t i = 0; i < niovs; ++i) {
+    buf->prependChain(folly::IOBuf::copyBuffer(iovs[i].iov_base,
+                                               iovs[i].iov_len));
+  }
+  buf->coalesce();
+
+  um_message_info_t info;
+  ASSERT_EQ(um_ok, um_parse_header(buf->data(), buf->length(), &info));
+  mc_op_t op;
+  uint64_t reqid;
+  std::vector<McRequest> batch;
+  auto req = umbrellaParseRequest(*buf, buf->data(), info.header_size,
+                                  buf->data() + info.header_size,
+                                  info.body_size, op, reqid, &batch);
+  EXPECT_EQ(mc_op_get, op);
+  EXPECT_EQ(17, reqid);
+  EXPECT_EQ("a", req.fullKey().str());
+  ASSERT_EQ(2, batch.size());
+  EXPECT_EQ("bb", batch[0].fullKey().str());
+  EXPECT_EQ("ccc", batch[1].fullKey().str());
+
+  /* Batches are only accepted where the caller expects them */
+  EXPECT_THROW(umbrellaParseRequest(*buf, buf->data(), info.header_size,
+                                    buf->data() + info.header_size,
+                                    info.body_size, op, reqid),
+               std::runtime_error);
+}
+
+TEST(UmbrellaProtocol, parseChainedBody) {
+  auto buf = serialize(McReply(mc_res_found, "hello world"), mc_op_get, 3);
+  um_message_info_t info;
+  ASSERT_EQ(um_ok, um_parse_header(buf->data(), buf->length(), &info));
+
+  /* Wherever the body is split, the value comes out the same */
+  for (size_t split = 0; split <= info.body_size; ++split) {
+    auto body = splitBody(*buf, info, split);
+    mc_op_t op;
+    uint64_t reqid;
+    McReply parsed(mc_res_unknown);
+    ASSERT_TRUE(umbrellaParseReply(buf->data(), info.header_size, *body,
+                                   op, reqid, parsed));
+    EXPECT_EQ(mc_op_get, op);
+    EXPECT_EQ(3, reqid);
+    EXPECT_EQ(mc_res_found, parsed.result());
+    EXPECT_EQ("hello world", parsed.valueRangeSlow().str());
+  }
+
+  std::vector<folly::StringPiece> keys = {"abcdef", "ghijkl"};
+  UmbrellaSerializedMessage message;
+  struct iovec* iovs;
+  size_t niovs;
+  ASSERT_TRUE(message.prepareBatchGet(keys, 17, iovs, niovs));
+  auto req = folly::IOBuf::create(0);
+  for (size_t i = 0; i < niovs; ++i) {
+    req->prependChain(folly::IOBuf::copyBuffer(iovs[i].iov_base,
+                                               iovs[i].iov_len));
+  }
+  req->coalesce();
+  ASSERT_EQ(um_ok, um_parse_header(req->data(), req->length(), &info));
+
+  for (size_t split = 0; split <= info.body_size; ++split) {
+    auto body = splitBody(*req, info, split);
+    mc_op_t op;
+    uint64_t reqid;
+    std::vector<McRequest> batch;
+    auto parsed = umbrellaParseRequest(req->data(), info.header_size, *body,
+                                       op, reqid, &batch);
+    EXPECT_EQ(17, reqid);
+    EXPECT_EQ("abcdef", parsed.fullKey().str());
+    ASSERT_EQ(1, batch.size());
+    EXPECT_EQ("ghijkl", batch[0].fullKey().str());
+  }
+
+  /* Offsets past the end of the chain */
+  auto shortBody = splitBody(*req, info, 1);
+  shortBody->prev()->trimEnd(4);
+  mc_op_t op;
+  uint64_t reqid;
+  std::vector<McRequest> batch;
+  EXPECT_THROW(umbrellaParseRequest(req->data(), info.header_size,
+                                    *shortBody, op, reqid, &batch),
+               std::runtime_error);
+}
+
+TEST(UmbrellaProtocol, batchGetTooManyKeys) {
+  std::vector<folly::StringPiece> keys(
+    UmbrellaSerializedMessage::kMaxBatchKeys + 1, "key");
+  UmbrellaSerializedMessage message;
+  struct iovec* iovs;
+  size_t niovs;
+  EXPECT_FALSE(message.prepareBatchGet(keys, 1, iovs, niovs));
+  message.clear();
+  EXPECT_FALSE(message.prepareBatchGet({}, 1, iovs, niovs));
+}
+
+TEST(UmbrellaProtocol, replyWithKey) {
+  UmbrellaSerializedMessage message;
+  struct iovec* iovs;
+  size_t niovs;
+  folly::Optional<folly::IOBuf> key(
+    folly::IOBuf(folly::IOBuf::COPY_BUFFER, "key"));
+  ASSERT_TRUE(message.prepare(McReply(mc_res_found, "value"), mc_op_get, 3,
+                              key, iovs, niovs));
+  auto buf = folly::IOBuf::create(0);
+  for (size_t i = 0; i < niovs; ++i) {
+    buf->prependChain(folly::IOBuf::copyBuffer(iovs[i].iov_base,
+                                               iovs[i].iov_len));
+  }
+  buf->coalesce();
+
+  mc_op_t op;
+  uint64_t reqid;
+  McReply parsed(mc_res_unknown);
+  ASSERT_TRUE(parse(*buf, op, reqid, parsed));
+  EXPECT_EQ(3, reqid);
+  EXPECT_EQ("value", parsed.valueRangeSlow().str());
+
+  um_message_info_t info;
+  ASSERT_EQ(um_ok, um_parse_header(buf->data(), buf->length(), &info));
+  auto msg = reinterpret_cast<const entry_list_msg_t*>(buf->data());
+  size_t nentries = folly::Endian::big((uint16_t)msg->nentries);
+  bool hasKey = false;
+  for (size_t i = 0; i < nentries; ++i) {
+    if (folly::Endian::big((uint16_t)msg->entries[i].tag) == msg_key) {
+      auto offset = folly::Endian::big(
+        (uint32_t)msg->entries[i].data.str.offset);
+      EXPECT_STREQ("key", reinterpret_cast<const char*>(
+                     buf->data() + info.header_size + offset));
+      hasKey = true;
+    }
+  }
+  EXPECT_TRUE(hasKey);
+}
+
+TEST(UmbrellaProtocol, keyDigestHint) {
+  auto roundTrip = [](const McRequest& req) {
+    UmbrellaSerializedMessage message;
+    struct iovec* iovs;
+    size_t niovs;
+    EXPECT_TRUE(message.prepare(req, McOperation<mc_op_get>(), 5,
+                                iovs, niovs));
+    auto buf = folly::IOBuf::create(0);
+    for (size_t i = 0; i < niovs; ++i) {
+      buf->prependChain(folly::IOBuf::copyBuffer(iovs[i].iov_base,
+                                                 iovs[i].iov_len));
+    }
+    buf->coalesce();
+    um_message_info_t info;
+    EXPECT_EQ(um_ok, um_parse_header(buf->data(), buf->length(), &info));
+    mc_op_t op;
+    uint64_t reqid;
+    return umbrellaParseRequest(*buf, buf->data(), info.header_size,
+                                buf->data() + info.header_size,
+                                info.body_size, op, reqid);
+  };
+
+  /* Not hashed yet: nothing to pass along */
+  McRequest req("/a/b/key:1");
+  auto parsed = roundTrip(req);
+  EXPECT_EQ(0, parsed.routingKeyDigestHint());
+  EXPECT_FALSE(parsed.hasRoutingKeyDigest());
+
+  auto digest = req.routingKeyDigest();
+  parsed = roundTrip(req);
+  EXPECT_EQ(digest, parsed.routingKeyDigestHint());
+  /* Only used when trusted */
+  EXPECT_FALSE(parsed.hasRoutingKeyDigest());
+  parsed.useRoutingKeyDigestHint();
+  EXPECT_TRUE(parsed.hasRoutingKeyDigest());
+  EXPECT_EQ(digest, parsed.routingKeyDigest());
+
+  /* A bogus hint is taken as is, hence the trust option */
+  parsed.setRoutingKeyDigestHint(digest + 1);
+  parsed.useRoutingKeyDigestHint();
+  EXPECT_EQ(digest + 1, parsed.routingKeyDigest());
+}
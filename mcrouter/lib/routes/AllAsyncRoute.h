@@ -18,12 +18,15 @@
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/fibers/FiberManager.h"
 #include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/lib/SubRequests.h"
 
 namespace facebook { namespace memcache {
 
 /**
  * Sends the same request to all child route handles.
- * Does not wait for response.
+ * Does not wait for response: the requests are detached, and not sent
+ * if there are too many detached requests (see mcrouter/lib/SubRequests.h).
+ * They are routed from one fiber with routeSubRequests().
  */
 template <class RouteHandleIf>
 class AllAsyncRoute {
@@ -58,12 +61,27 @@ class AllAsyncRoute {
 
     if (!children_.empty()) {
       auto reqCopy = std::make_shared<Request>(req.clone());
-      for (auto& rh : children_) {
-        fiber::addTask(
-          [rh, reqCopy]() {
-            rh->route(*reqCopy, Operation());
-          });
+      if (!detachSubRequests(*reqCopy, children_.size())) {
+        return NullRoute<RouteHandleIf>::route(req, Operation());
       }
+      if (children_.size() > 1) {
+        enableSharedSerialization(*reqCopy);
+      }
+      /* the children are kept alive by the task, like the request */
+      auto children = children_;
+      fiber::addTask(
+        [children, reqCopy]() {
+          using Reply = typename ReplyType<Operation, Request>::type;
+          std::vector<SubRequest<RouteHandleIf, Request>> subReqs;
+          subReqs.reserve(children.size());
+          for (const auto& child : children) {
+            subReqs.push_back({child.get(), reqCopy.get()});
+          }
+          routeSubRequests(subReqs, Operation(),
+                           [&reqCopy] (size_t, Reply&&) {
+                             detachedSubRequestDone(*reqCopy);
+                           });
+        });
     }
     return NullRoute<RouteHandleIf>::route(req, Operation());
   }
@@ -14,6 +14,7 @@
 #include <vector>
 
 #include <folly/dynamic.h>
+#include <folly/small_vector.h>
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/fibers/AddTasks.h"
@@ -67,15 +68,17 @@ class AllFastestRoute {
       return children_.back()->route(req, Operation());
     }
 
-    std::vector<std::function<Reply()>> funcs;
-    funcs.reserve(children_.size());
     auto reqCopy = std::make_shared<Request>(req.clone());
+    auto makeFunc = [&reqCopy](const std::shared_ptr<RouteHandleIf>& rh) {
+      return [reqCopy, rh]() {
+        return rh->route(*reqCopy, Operation());
+      };
+    };
+    folly::small_vector<decltype(makeFunc(children_[0])), fiber::kInlineTasks>
+      funcs;
+    funcs.reserve(children_.size());
     for (auto& rh : children_) {
-      funcs.push_back(
-        [reqCopy, rh]() {
-          return rh->route(*reqCopy, Operation());
-        }
-      );
+      funcs.push_back(makeFunc(rh));
     }
 
     auto taskIt = fiber::addTasks(funcs.begin(), funcs.end());
@@ -21,13 +21,14 @@
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/routes/AllAsyncRoute.h"
 #include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/lib/SubRequests.h"
 
 namespace facebook { namespace memcache {
 
 /**
  * Sends the same request to all child route handles.
  * Returns the reply from the first route handle in the list;
- * all other requests complete asynchronously.
+ * all other requests complete asynchronously, like in AllAsyncRoute.
  */
 template <class RouteHandleIf>
 class AllInitialRoute {
@@ -100,6 +101,8 @@ class AllInitialRoute {
 
     /* Process all children except first asynchronously */
     if (asyncRoute_) {
+      /* before AllAsyncRoute clones it */
+      enableSharedSerialization(req);
       asyncRoute_->route(req, Operation());
     }
 
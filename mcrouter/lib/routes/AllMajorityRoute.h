@@ -14,12 +14,14 @@
 #include <vector>
 
 #include <folly/dynamic.h>
+#include <folly/small_vector.h>
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/fibers/AddTasks.h"
 #include "mcrouter/lib/mc/msg.h"
 #include "mcrouter/lib/Reply.h"
 #include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/lib/SubRequests.h"
 
 namespace facebook { namespace memcache {
 
@@ -29,6 +31,8 @@ namespace facebook { namespace memcache {
  * (or all results if that never happens).
  * Responds with one of the replies with the most common result.
  * Ties are broken using Reply::reduce().
+ * Requests still in flight at that point are detached, see
+ * mcrouter/lib/SubRequests.h.
  */
 template <class RouteHandleIf>
 class AllMajorityRoute {
@@ -71,15 +75,32 @@ class AllMajorityRoute {
       return children_.back()->route(req, Operation());
     }
 
-    std::vector<std::function<Reply()>> funcs;
+    struct Shared {
+      explicit Shared(Request r) : req(std::move(r)) {}
+      Request req;
+      /* children whose route() didn't return yet */
+      size_t running{0};
+      /* set once the route returned */
+      bool detached{false};
+    };
+    auto shared = std::make_shared<Shared>(req.clone());
+    enableCancellation(shared->req);
+    enableSharedSerialization(shared->req);
+    auto makeFunc = [&shared](const std::shared_ptr<RouteHandleIf>& rh) {
+      return [shared, rh]() {
+        auto reply = rh->route(shared->req, Operation());
+        --shared->running;
+        if (shared->detached) {
+          detachedSubRequestDone(shared->req);
+        }
+        return reply;
+      };
+    };
+    folly::small_vector<decltype(makeFunc(children_[0])), fiber::kInlineTasks>
+      funcs;
     funcs.reserve(children_.size());
-    auto reqCopy = std::make_shared<Request>(req.clone());
     for (auto& rh : children_) {
-      funcs.push_back(
-        [reqCopy, rh]() {
-          return rh->route(*reqCopy, Operation());
-        }
-      );
+      funcs.push_back(makeFunc(rh));
     }
 
     size_t counts[mc_nres];
@@ -87,6 +108,7 @@ class AllMajorityRoute {
     size_t majorityCount = 0;
     Reply majorityReply = Reply(DefaultReply, Operation());
 
+    shared->running = children_.size();
     auto taskIt = fiber::addTasks(funcs.begin(), funcs.end());
     taskIt.reserve(children_.size() / 2 + 1);
     while (taskIt.hasNext() &&
@@ -103,6 +125,12 @@ class AllMajorityRoute {
       }
     }
 
+    if (shared->running > 0) {
+      /* The rest complete on their own, possibly after long timeouts */
+      shared->detached = true;
+      detachSubRequests(shared->req, shared->running);
+    }
+
     return majorityReply;
   }
 
@@ -17,22 +17,31 @@
 #include <folly/Optional.h>
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
-#include "mcrouter/lib/fibers/WhenN.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fibers/ForEach.h"
 #include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/lib/SubRequests.h"
 
 namespace facebook { namespace memcache {
 
 /**
  * Sends the same request to all child route handles.
  * Collects all the replies and responds with the "most awful" reply.
+ *
+ * With "max_concurrency": N, at most N children are waited for at a time
+ * (by N fibers going through the children), so broadcasts to large pools
+ * don't need a fiber and a reply per child. 0 (default) means no limit,
+ * the children are then routed with routeSubRequests().
  */
 template <class RouteHandleIf>
 class AllSyncRoute {
  public:
   static std::string routeName() { return "all-sync"; }
 
-  explicit AllSyncRoute(std::vector<std::shared_ptr<RouteHandleIf>> rh)
-      : children_(std::move(rh)) {
+  explicit AllSyncRoute(std::vector<std::shared_ptr<RouteHandleIf>> rh,
+                        size_t maxConcurrency = 0)
+      : children_(std::move(rh)),
+        maxConcurrency_(maxConcurrency) {
   }
 
   AllSyncRoute(RouteHandleFactory<RouteHandleIf>& factory,
@@ -41,6 +50,12 @@ class AllSyncRoute {
       if (json.count("children")) {
         children_ = factory.createList(json["children"]);
       }
+      if (auto jmax = json.get_ptr("max_concurrency")) {
+        checkLogic(jmax->isInt() && jmax->getInt() >= 0,
+                   "AllSyncRoute: max_concurrency is not a non-negative "
+                   "integer");
+        maxConcurrency_ = jmax->getInt();
+      }
     } else {
       children_ = factory.createList(json);
     }
@@ -68,29 +83,35 @@ class AllSyncRoute {
       return children_.back()->route(req, Operation());
     }
 
-    std::vector<std::function<Reply()>> fs;
-    fs.reserve(children_.size());
-    for (auto& rh : children_) {
-      // no need to copy the child and request, we will not return from method
-      // until we get replies
-      fs.emplace_back(
-        [&rh, &req]() {
-          return rh->route(req, Operation());
-        }
-      );
-    }
-
+    // no need to copy the child and request, we will not return from method
+    // until we get replies
+    enableSharedSerialization(req);
     folly::Optional<Reply> reply;
-    fiber::forEach(fs.begin(), fs.end(), [&reply] (size_t id, Reply newReply) {
+    auto onReply = [&reply] (size_t, Reply&& newReply) {
       if (!reply || newReply.worseThan(reply.value())) {
         reply = std::move(newReply);
       }
-    });
+    };
+    if (maxConcurrency_ != 0) {
+      fiber::forEachBounded(
+        children_.size(), maxConcurrency_,
+        [this, &req, &onReply] (size_t id) {
+          onReply(id, children_[id]->route(req, Operation()));
+        });
+    } else {
+      std::vector<SubRequest<RouteHandleIf, Request>> subReqs;
+      subReqs.reserve(children_.size());
+      for (const auto& child : children_) {
+        subReqs.push_back({child.get(), &req});
+      }
+      routeSubRequests(subReqs, Operation(), onReply);
+    }
     return std::move(reply.value());
   }
 
  private:
   std::vector<std::shared_ptr<RouteHandleIf>> children_;
+  size_t maxConcurrency_{0};
 };
 
 }}
@@ -37,6 +37,10 @@ struct ErrorRoute {
     return {};
   }
 
+  static bool routesInline() {
+    return true;
+  }
+
   ErrorRoute() {}
 
   explicit ErrorRoute(const folly::dynamic& json) {
@@ -17,6 +17,8 @@
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/RetryBudget.h"
+#include "mcrouter/lib/RouteHandleLiveness.h"
 #include "mcrouter/lib/routes/NullRoute.h"
 
 namespace facebook { namespace memcache {
@@ -25,6 +27,12 @@ namespace facebook { namespace memcache {
  * Sends the same request sequentially to each destination in the list in order,
  * until the first non-error reply.  If all replies result in errors, returns
  * the last destination's reply.
+ * Destinations known dead (see RouteHandleIf::knownDead()) are skipped,
+ * their reply would be a failover error anyway.
+ *
+ * Sending the request to another target after an error reply is subject
+ * to the router's retry budget and the request deadline (see
+ * failoverAllowed()); once either is used up, the error reply is returned.
  */
 template <class RouteHandleIf>
 class FailoverRoute {
@@ -63,18 +71,33 @@ class FailoverRoute {
       return NullRoute<RouteHandleIf>::route(req, Operation());
     }
 
-    for (size_t i = 0; i + 1 < targets_.size(); ++i) {
-      auto reply = targets_[i]->route(req, Operation());
-      if (!reply.isFailoverError()) {
-        return reply;
+    failoverPrimaryRequest(req);
+
+    size_t i = 0;
+    while (i + 1 < targets_.size() && targets_[i]->knownDead()) {
+      ++i;
+    }
+    auto reply = targets_[i]->route(req, Operation());
+
+    for (++i; i < targets_.size() && reply.isFailoverError(); ++i) {
+      if (i + 1 < targets_.size() && targets_[i]->knownDead()) {
+        continue;
+      }
+      if (!failoverAllowed(req)) {
+        break;
       }
+      reply = targets_[i]->route(req, Operation());
     }
+    return reply;
+  }
 
-    return targets_.back()->route(req, Operation());
+  bool knownDead() const {
+    return allDead_.allDead(targets_);
   }
 
  private:
   std::vector<std::shared_ptr<RouteHandleIf>> targets_;
+  AllDeadCache allDead_;
 };
 
 }}
@@ -11,20 +11,33 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <folly/dynamic.h>
 #include <folly/Range.h>
+#include <folly/ScopeGuard.h>
 
+#include "mcrouter/lib/Ch3HashFunc.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/fibers/FiberManager.h"
 #include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/RouteHandleLiveness.h"
 #include "mcrouter/lib/routes/NullRoute.h"
 
 namespace facebook { namespace memcache {
 
 /**
  * Hashes routing_key using provided function and routes to the destination
+ *
+ * With "bounded_load_epsilon": e > 0, a destination that already has more
+ * than (1 + e) times the average number of requests in flight through this
+ * route overflows the request to the next destination (in index order)
+ * that doesn't, as in consistent hashing with bounded loads
+ * (Mirrokni et al.). The counts are kept per route handle, i.e. per proxy.
+ * Only get-like requests are bounded unless "bounded_load_all_ops" is true,
+ * so that all updates of a key still go to the same box.
  */
 template <class RouteHandleIf, typename HashFunc>
 class HashRoute {
@@ -33,10 +46,15 @@ class HashRoute {
 
   HashRoute(std::vector<std::shared_ptr<RouteHandleIf>> rh,
             std::string salt,
-            HashFunc hashFunc)
+            HashFunc hashFunc,
+            double loadEpsilon = 0,
+            bool boundedLoadAllOps = false)
     : rh_(std::move(rh)),
       salt_(std::move(salt)),
-      hashFunc_(std::move(hashFunc)) {
+      hashFunc_(std::move(hashFunc)),
+      loadEpsilon_(loadEpsilon),
+      boundedLoadAllOps_(boundedLoadAllOps),
+      inflight_(loadEpsilon_ > 0 ? rh_.size() : 0) {
   }
 
   HashRoute(const folly::dynamic& json,
@@ -48,6 +66,18 @@ class HashRoute {
       checkLogic(json["salt"].isString(), "HashRoute salt is not a string");
       salt_ = json["salt"].getString().toStdString();
     }
+    if (auto jeps = json.get_ptr("bounded_load_epsilon")) {
+      checkLogic(jeps->isNumber() && jeps->asDouble() >= 0,
+                 "HashRoute bounded_load_epsilon is not a non-negative "
+                 "number");
+      loadEpsilon_ = jeps->asDouble();
+      inflight_.resize(loadEpsilon_ > 0 ? rh_.size() : 0);
+    }
+    if (auto jall = json.get_ptr("bounded_load_all_ops")) {
+      checkLogic(jall->isBool(),
+                 "HashRoute bounded_load_all_ops is not a boolean");
+      boundedLoadAllOps_ = jall->getBool();
+    }
   }
 
   template <class Operation, class Request>
@@ -63,9 +93,49 @@ class HashRoute {
 
     if (rh_.empty()) {
       return NullRoute<RouteHandleIf>::route(req, Operation());
-    } else {
-      return rh_[pickInMainContext(req)]->route(req, Operation());
     }
+    auto n = pickInMainContext(req);
+    if (inflight_.empty() ||
+        !(GetLike<Operation>::value || boundedLoadAllOps_)) {
+      return rh_[n]->route(req, Operation());
+    }
+
+    n = leastLoadedFrom(n);
+    ++inflight_[n];
+    ++totalInflight_;
+    SCOPE_EXIT {
+      --inflight_[n];
+      --totalInflight_;
+    };
+    return rh_[n]->route(req, Operation());
+  }
+
+  /**
+   * @return index of the child req hashes to. Unlike route(), doesn't
+   *         jump to the main context.
+   */
+  template <class Request>
+  size_t pickDestination(const Request& req) const {
+    return pick(req);
+  }
+
+  /**
+   * Where route() sends req if it's not get-like (see routeSubRequests()),
+   * unless that depends on the load. For route handles with
+   * updateDestination(), like mcrouter's.
+   */
+  template <class Request>
+  auto updateDestination(const Request& req) const
+      -> decltype(std::declval<const RouteHandleIf&>().updateDestination(req)) {
+    if (rh_.empty() || (!inflight_.empty() && boundedLoadAllOps_)) {
+      return nullptr;
+    }
+    return rh_[pick(req)]->updateDestination(req);
+  }
+
+  /* Dead once all of the children are, e.g. a whole pool is TKO */
+  bool knownDead() const {
+    return allDead_.allDead(rh_);
   }
 
  private:
@@ -73,12 +143,37 @@ class HashRoute {
   const std::vector<std::shared_ptr<RouteHandleIf>> rh_;
   std::string salt_;
   HashFunc hashFunc_;
+  AllDeadCache allDead_;
+
+  double loadEpsilon_{0};
+  bool boundedLoadAllOps_{false};
+  /* Requests in flight per destination, empty if loads aren't bounded.
+     Only touched from this proxy's fibers. */
+  mutable std::vector<size_t> inflight_;
+  mutable size_t totalInflight_{0};
+
+  /**
+   * @return first destination starting at n that is under
+   *         (1 + epsilon) * (average load with this request)
+   */
+  size_t leastLoadedFrom(size_t n) const {
+    auto capacity = (1 + loadEpsilon_) * (totalInflight_ + 1);
+    for (size_t i = 0; i < rh_.size(); ++i) {
+      auto c = (n + i) % rh_.size();
+      /* inflight_[c] < capacity / size */
+      if (inflight_[c] * rh_.size() < capacity) {
+        return c;
+      }
+    }
+    /* unreachable: some destination is at or under the average */
+    return n;
+  }
 
   template <class Request>
   size_t pick(const Request& req) const {
     size_t n = 0;
     if (salt_.empty()) {
-      n = hashFunc_(req.routingKey());
+      n = hashRoutingKey(hashFunc_, req, 0);
     } else {
       // fast string concatenation
       char c[kMaxKeySaltSize];
@@ -98,6 +193,26 @@ class HashRoute {
     return n;
   }
 
+  /* Hash functions that accept one of the request's cached key digests
+     get it (a function takes at most one of them) */
+  template <class Func, class Request>
+  static auto hashRoutingKey(const Func& func, const Request& req, int)
+      -> decltype(func(req.routingKey(), req.routingKeyDigest())) {
+    return func(req.routingKey(), req.routingKeyDigest());
+  }
+
+  template <class Func, class Request>
+  static auto hashRoutingKey(const Func& func, const Request& req, int)
+      -> decltype(func(req.routingKey(),
+                       FurcDigest{req.routingKeyFurcDigest()})) {
+    return func(req.routingKey(), FurcDigest{req.routingKeyFurcDigest()});
+  }
+
+  template <class Func, class Request>
+  static size_t hashRoutingKey(const Func& func, const Request& req, long) {
+    return func(req.routingKey());
+  }
+
   template <class Request>
   size_t pickInMainContext(const Request& req) const {
     /* Hash functions can be stack-intensive,
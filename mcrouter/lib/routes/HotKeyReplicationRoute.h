@@ -0,0 +1,287 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/HotKeys.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/SubRequests.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Spreads the reads of hot keys over several replicas within a pool.
+ *
+ * The replicas are HashRoutes over the same children with different salts:
+ * the first one uses the configured salt (so keys that are not hot route
+ * exactly like a HashRoute), the others "salt0", "salt1", ..., the same
+ * targets ReliablePoolRoute fails over to.
+ *
+ * 'get' requests for keys that are at least hot_keys_min_share of recent
+ * traffic (see isHotKey() in mcrouter/lib/HotKeys.h) go to the replicas in
+ * turn. A miss on a replica other than the first is retried on the first
+ * one, and a hit there fills the replica in the background with an exptime
+ * of replica_ttl_s.
+ *
+ * Keys read as hot are remembered for replica_ttl_s after their last hot
+ * read; any other request for such a key deletes it from the other replicas
+ * in the background once the first replica replied. So once a key cools
+ * down, its copies expire on their own and need no invalidation. Copies
+ * may be stale for up to replica_ttl_s if a fill races with an update.
+ * Every other request only goes to the first replica.
+ *
+ * Route handles are created per proxy, so the state is never shared
+ * between threads and needs no locking.
+ *
+ * Example:
+ *  {
+ *    "type": "HotKeyReplicationRoute",
+ *    "children": "Pool|A",
+ *    "hash_func": "Ch3",
+ *    "replicas": 3,
+ *    "hot_keys_min_share": 0.01,
+ *    "replica_ttl_s": 10,
+ *    "max_replicated_keys": 1024
+ *  }
+ */
+template <class RouteHandleIf>
+class HotKeyReplicationRoute {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static std::string routeName() { return "hot-key-replication"; }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    return {replicas_.front()};
+  }
+
+  HotKeyReplicationRoute(std::vector<std::shared_ptr<RouteHandleIf>> replicas,
+                         double minHotShare,
+                         std::chrono::seconds replicaTtl,
+                         size_t maxKeys)
+      : replicas_(std::move(replicas)),
+        minHotShare_(minHotShare),
+        replicaTtl_(replicaTtl),
+        maxKeys_(maxKeys) {
+    checkLogic(!replicas_.empty(), "HotKeyReplicationRoute: no replicas");
+  }
+
+  /**
+   * @param replicas  built by RouteHandleProvider from the children,
+   *                  see "replicas"
+   */
+  HotKeyReplicationRoute(const folly::dynamic& json,
+                         std::vector<std::shared_ptr<RouteHandleIf>> replicas)
+      : replicas_(std::move(replicas)) {
+
+    checkLogic(!replicas_.empty(), "HotKeyReplicationRoute: no replicas");
+    checkLogic(json.isObject(), "HotKeyReplicationRoute should be object");
+    if (auto jshare = json.get_ptr("hot_keys_min_share")) {
+      checkLogic(jshare->isNumber() && jshare->asDouble() > 0 &&
+                 jshare->asDouble() <= 1,
+                 "HotKeyReplicationRoute: hot_keys_min_share is not in "
+                 "(0, 1]");
+      minHotShare_ = jshare->asDouble();
+    }
+    if (auto jttl = json.get_ptr("replica_ttl_s")) {
+      checkLogic(jttl->isInt() && jttl->getInt() > 0,
+                 "HotKeyReplicationRoute: replica_ttl_s is not a positive "
+                 "integer");
+      replicaTtl_ = std::chrono::seconds(jttl->getInt());
+    }
+    if (auto jmax = json.get_ptr("max_replicated_keys")) {
+      checkLogic(jmax->isInt() && jmax->getInt() > 0,
+                 "HotKeyReplicationRoute: max_replicated_keys is not a "
+                 "positive integer");
+      maxKeys_ = jmax->getInt();
+    }
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, typename GetLike<Operation>::Type = 0) {
+
+    return routeGetLike(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    OtherThanT(Operation, GetLike<>) = 0) {
+
+    if (!isReplicated(req.fullKey())) {
+      return replicas_.front()->route(req, Operation());
+    }
+    ++generation_;
+    auto reply = replicas_.front()->route(req, Operation());
+    invalidateReplicas(req);
+    return reply;
+  }
+
+  /**
+   * @return number of keys currently replicated
+   */
+  size_t replicatedKeys() const {
+    return replicated_.size();
+  }
+
+ private:
+  const std::vector<std::shared_ptr<RouteHandleIf>> replicas_;
+  double minHotShare_{0.01};
+  std::chrono::seconds replicaTtl_{10};
+  size_t maxKeys_{1024};
+
+  /* Key -> end of its replication */
+  std::unordered_map<std::string, Clock::time_point> replicated_;
+  Clock::time_point lastPurge_;
+  /* Replica the next hot read goes to */
+  size_t next_{0};
+
+  /* Bumped on every invalidation, so that fills that raced with an update
+     are skipped. */
+  uint64_t generation_{0};
+
+  template <class Request>
+  typename ReplyType<McOperation<mc_op_get>, Request>::type routeGetLike(
+    const Request& req, McOperation<mc_op_get>) {
+
+    if (replicas_.size() == 1 || !isHotKey(req, minHotShare_) ||
+        !markReplicated(req.fullKey())) {
+      return replicas_.front()->route(req, McOperation<mc_op_get>());
+    }
+
+    auto& replica = replicas_[next_];
+    next_ = (next_ + 1) % replicas_.size();
+    if (replica == replicas_.front()) {
+      return replica->route(req, McOperation<mc_op_get>());
+    }
+
+    auto reply = replica->route(req, McOperation<mc_op_get>());
+    if (reply.isHit()) {
+      return reply;
+    }
+
+    auto generation = generation_;
+    reply = replicas_.front()->route(req, McOperation<mc_op_get>());
+    if (reply.isHit() && generation == generation_) {
+      fill(replica, req, reply);
+    }
+    return reply;
+  }
+
+  /* gets, metaget and lease-get are tied to the box that has the item */
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeGetLike(
+    const Request& req, Operation) {
+
+    return replicas_.front()->route(req, Operation());
+  }
+
+  /**
+   * Starts (or extends) the replication of key.
+   *
+   * @return false if max_replicated_keys other keys are replicated
+   */
+  bool markReplicated(folly::StringPiece key) {
+    auto now = Clock::now();
+    auto keyStr = key.str();
+    auto it = replicated_.find(keyStr);
+    if (it != replicated_.end()) {
+      it->second = now + replicaTtl_;
+      return true;
+    }
+    if (replicated_.size() >= maxKeys_) {
+      /* at most once a second, the map may be full of live keys */
+      if (now - lastPurge_ < std::chrono::seconds(1)) {
+        return false;
+      }
+      lastPurge_ = now;
+      for (auto jt = replicated_.begin(); jt != replicated_.end(); ) {
+        if (jt->second <= now) {
+          jt = replicated_.erase(jt);
+        } else {
+          ++jt;
+        }
+      }
+      if (replicated_.size() >= maxKeys_) {
+        return false;
+      }
+    }
+    replicated_.emplace(std::move(keyStr), now + replicaTtl_);
+    return true;
+  }
+
+  bool isReplicated(folly::StringPiece key) {
+    if (replicated_.empty()) {
+      return false;
+    }
+    auto it = replicated_.find(key.str());
+    if (it == replicated_.end()) {
+      return false;
+    }
+    if (it->second <= Clock::now()) {
+      replicated_.erase(it);
+      return false;
+    }
+    return true;
+  }
+
+  template <class Request, class Reply>
+  void fill(const std::shared_ptr<RouteHandleIf>& replica,
+            const Request& origReq, const Reply& reply) {
+    auto req = std::make_shared<Request>(origReq.clone());
+    folly::IOBuf value;
+    reply.value().cloneInto(value);
+    req->setValue(std::move(value));
+    req->setFlags(reply.flags());
+    req->setExptime(replicaTtl_.count());
+    if (!detachSubRequests(*req, 1)) {
+      return;
+    }
+    auto rh = replica;
+    fiber::addTask([rh, req]() {
+      rh->route(*req, McOperation<mc_op_set>());
+      detachedSubRequestDone(*req);
+    });
+  }
+
+  template <class Request>
+  void invalidateReplicas(const Request& origReq) {
+    auto req = std::make_shared<Request>(origReq.clone());
+    req->setExptime(0);
+    if (!detachSubRequests(*req, replicas_.size() - 1)) {
+      return;
+    }
+    for (size_t i = 1; i < replicas_.size(); ++i) {
+      auto rh = replicas_[i];
+      fiber::addTask([rh, req]() {
+        rh->route(*req, McOperation<mc_op_delete>());
+        detachedSubRequestDone(*req);
+      });
+    }
+  }
+};
+
+}}  // facebook::memcache
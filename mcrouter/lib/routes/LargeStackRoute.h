@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/Operation.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Routes the target's subtree on a fiber with a large stack
+ * (see FiberManager::Options::largeStackSize), so only the requests
+ * that go through deep subtrees pay for large stacks. Without large
+ * stacks configured it's a plain pass-through. Stack usage by route
+ * (with fiber stack sampling enabled) tells which subtrees need it.
+ *
+ * Config:
+ *  {
+ *    "type": "LargeStackRoute",
+ *    "target": "PoolRoute|A"
+ *  }
+ */
+template <class RouteHandleIf>
+class LargeStackRoute {
+ public:
+  static std::string routeName() { return "large-stack"; }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    return { target_ };
+  }
+
+  explicit LargeStackRoute(std::shared_ptr<RouteHandleIf> target)
+      : target_(std::move(target)) {
+  }
+
+  LargeStackRoute(RouteHandleFactory<RouteHandleIf>& factory,
+                  const folly::dynamic& json) {
+    checkLogic(json.isObject(), "LargeStackRoute should be object");
+    auto jtarget = json.get_ptr("target");
+    checkLogic(jtarget, "LargeStackRoute: no target");
+    target_ = factory.create(*jtarget);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation) const {
+
+    return fiber::runInLargeStack([this, &req]() {
+        return target_->route(req, Operation());
+      });
+  }
+
+ private:
+  std::shared_ptr<RouteHandleIf> target_;
+};
+
+}}  // facebook::memcache
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/Reply.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Builds its target on first use, for subtrees that may never see traffic.
+ *
+ * The target is built in the main context: no other fiber of the thread
+ * runs until it's done, so there is never a build in progress that other
+ * requests would have to wait for. If the builder fails (returns nullptr
+ * or throws), all requests get the error reply and the build is not
+ * retried.
+ *
+ * couldRouteTo() doesn't build the target, it's empty until the first
+ * request was routed.
+ *
+ * mcrouter config (the target is built by the proxy that uses it, from
+ * the preprocessed JSON, and may refer to named handles of the config):
+ *  {
+ *    "type": "LazyRoute",
+ *    "target": "PoolRoute|A"
+ *  }
+ */
+template <class RouteHandleIf>
+class LazyRoute {
+ public:
+  typedef std::function<std::shared_ptr<RouteHandleIf>()> Builder;
+
+  static std::string routeName() { return "lazy"; }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    if (target_) {
+      return { target_ };
+    }
+    return {};
+  }
+
+  explicit LazyRoute(Builder builder)
+      : builder_(std::move(builder)) {
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation) const {
+
+    typedef typename ReplyType<Operation, Request>::type Reply;
+
+    if (builder_) {
+      build();
+    }
+    if (!target_) {
+      return Reply(ErrorReply, "LazyRoute: failed to build the target");
+    }
+    return target_->route(req, Operation());
+  }
+
+  /**
+   * @return true if the target was built (or failed to build).
+   */
+  bool built() const {
+    return !builder_;
+  }
+
+ private:
+  mutable Builder builder_;
+  mutable std::shared_ptr<RouteHandleIf> target_;
+
+  void build() const {
+    fiber::runInMainContext([this]() {
+      try {
+        target_ = builder_();
+      } catch (...) {
+        target_ = nullptr;
+      }
+    });
+    /* also frees everything the builder captured */
+    builder_ = nullptr;
+  }
+};
+
+}}  // facebook::memcache
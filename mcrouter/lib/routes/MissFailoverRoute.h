@@ -9,16 +9,24 @@
  */
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include <folly/dynamic.h>
+#include <folly/Optional.h>
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fibers/Baton.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/MissRateTracker.h"
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/RetryBudget.h"
 #include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/lib/SubRequests.h"
 
 namespace facebook { namespace memcache {
 
@@ -26,7 +34,30 @@ namespace facebook { namespace memcache {
  * For get-like requests, sends the same request sequentially
  * to each destination in the list in order until the first hit reply.
  * If all replies result in errors/misses, returns the reply from the
- * last destination in the list.
+ * last destination in the list. Once the request deadline has passed
+ * (see requestDeadlineExceeded()), the current reply is returned instead
+ * of trying the next destination.
+ *
+ * With "speculative", gets don't wait for a miss to query the next
+ * destination: it's sent the request too once the current one didn't
+ * reply for "delay_ms", or right away for key prefixes the first
+ * destination misses at least "miss_rate" of the time (an EWMA with
+ * weight "ewma_alpha" per prefix, the key up to "prefix_delimiter",
+ * see MissRateTracker). At most one destination is queried ahead of the
+ * current one. The first hit in list order is still the reply; requests
+ * whose reply wasn't needed complete on their own (see
+ * mcrouter/lib/SubRequests.h) and count as wasted (see
+ * speculativeLookupEvent()).
+ *
+ * Example:
+ *  {
+ *    "type": "MissFailoverRoute",
+ *    "children": [ "PoolRoute|L1", "PoolRoute|L2", "PoolRoute|L3" ],
+ *    "speculative": {
+ *      "delay_ms": 2,
+ *      "miss_rate": 0.8
+ *    }
+ *  }
  */
 template <class RouteHandleIf>
 class MissFailoverRoute {
@@ -40,17 +71,36 @@ class MissFailoverRoute {
     return targets_;
   }
 
+  /**
+   * Settings of the speculative mode, 0 disables either trigger.
+   */
+  struct SpeculativeOptions {
+    std::chrono::milliseconds delay{0};
+    double missRate{0};
+    double ewmaAlpha{0.01};
+    char prefixDelimiter{':'};
+  };
+
   explicit MissFailoverRoute(
     std::vector<std::shared_ptr<RouteHandleIf>> targets)
       : targets_(std::move(targets)) {
   }
 
+  MissFailoverRoute(std::vector<std::shared_ptr<RouteHandleIf>> targets,
+                    SpeculativeOptions speculative)
+      : targets_(std::move(targets)) {
+    initSpeculative(speculative);
+  }
+
   MissFailoverRoute(RouteHandleFactory<RouteHandleIf>& factory,
                     const folly::dynamic& json) {
     if (json.isObject()) {
       if (json.count("children")) {
         targets_ = factory.createList(json["children"]);
       }
+      if (auto jspeculative = json.get_ptr("speculative")) {
+        initSpeculative(parseSpeculative(*jspeculative));
+      }
     } else {
       targets_ = factory.createList(json);
     }
@@ -66,7 +116,7 @@ class MissFailoverRoute {
 
     for (size_t i = 0; i < targets_.size() - 1; ++i) {
       auto reply = targets_[i]->route(req, Operation());
-      if (reply.isHit()) {
+      if (reply.isHit() || requestDeadlineExceeded(req)) {
         return reply;
       }
     }
@@ -78,6 +128,9 @@ class MissFailoverRoute {
   typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation, typename GetLike<Operation>::Type = 0)
     const {
+    if (speculative_ && targets_.size() > 1) {
+      return routeSpeculative(req, Operation());
+    }
     return routeImpl(req, Operation());
   }
 
@@ -102,6 +155,149 @@ class MissFailoverRoute {
 
  private:
   std::vector<std::shared_ptr<RouteHandleIf>> targets_;
+  folly::Optional<SpeculativeOptions> speculative_;
+  /* Miss rate of the first target, route handles are created per proxy
+     so it needs no locking */
+  std::shared_ptr<MissRateTracker> missRates_;
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeSpeculative(
+    const Request& req, Operation) const {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+
+    struct Shared {
+      Shared(Request r, size_t n) : req(std::move(r)), replies(n) {}
+      Request req;
+      std::vector<folly::Optional<Reply>> replies;
+      Baton baton;
+      /* the route is blocked on baton */
+      bool waiting{false};
+      /* targets whose route() didn't return yet */
+      size_t running{0};
+      /* set once the route returned */
+      bool detached{false};
+    };
+
+    auto shared = std::make_shared<Shared>(req.clone(), targets_.size());
+    auto start = [this, &shared](size_t i) {
+      ++shared->running;
+      auto rh = targets_[i];
+      auto s = shared;
+      fiber::addTask([s, rh, i]() {
+        auto reply = rh->route(s->req, Operation());
+        --s->running;
+        if (s->detached) {
+          detachedSubRequestDone(s->req);
+          return;
+        }
+        s->replies[i] = std::move(reply);
+        if (s->waiting) {
+          s->waiting = false;
+          s->baton.post();
+        }
+      });
+    };
+    auto speculate = [&start, &req](size_t i) {
+      speculativeLookupEvent(req, SpeculativeLookupEvent::SENT);
+      start(i);
+    };
+
+    auto slot = missRates_->slot(req.routingKey());
+    const auto n = targets_.size();
+    /* targets started so far, the first one whose reply is needed */
+    size_t next = 0;
+    size_t current = 0;
+    start(next++);
+    if (speculative_->missRate > 0 &&
+        missRates_->missRate(slot) >= speculative_->missRate) {
+      speculate(next++);
+    }
+
+    while (true) {
+      while (current < next && shared->replies[current]) {
+        auto& reply = *shared->replies[current];
+        if (current == 0) {
+          missRates_->record(slot, !reply.isHit());
+        }
+        /* Nothing to wait for once the deadline passed, unless the
+           next destination was already queried */
+        if (reply.isHit() || current + 1 == n ||
+            (current + 1 == next && requestDeadlineExceeded(req))) {
+          for (size_t i = current + 1; i < next; ++i) {
+            speculativeLookupEvent(req, SpeculativeLookupEvent::WASTED);
+          }
+          if (shared->running > 0) {
+            shared->detached = true;
+            detachSubRequests(shared->req, shared->running);
+          }
+          return std::move(reply);
+        }
+        ++current;
+      }
+      if (next == current) {
+        /* missed before the delay, plain failover */
+        start(next++);
+      }
+
+      shared->waiting = true;
+      if (next == current + 1 && next < n &&
+          speculative_->delay.count() > 0 && !requestDeadlineExceeded(req)) {
+        if (!shared->baton.timed_wait(speculative_->delay)) {
+          /* Nothing else runs between the timeout and reset(), so no post
+             is lost */
+          shared->waiting = false;
+          speculate(next++);
+        }
+      } else {
+        shared->baton.wait();
+      }
+      shared->baton.reset();
+    }
+  }
+
+  void initSpeculative(const SpeculativeOptions& options) {
+    checkLogic(options.delay.count() >= 0,
+               "MissFailoverRoute: speculative delay_ms is negative");
+    checkLogic(0 <= options.missRate && options.missRate <= 1,
+               "MissFailoverRoute: speculative miss_rate should be in [0, 1]");
+    checkLogic(0 < options.ewmaAlpha && options.ewmaAlpha <= 1,
+               "MissFailoverRoute: speculative ewma_alpha should be "
+               "in (0, 1]");
+    checkLogic(options.delay.count() > 0 || options.missRate > 0,
+               "MissFailoverRoute: speculative needs delay_ms or miss_rate");
+    speculative_ = options;
+    missRates_ = std::make_shared<MissRateTracker>(options.ewmaAlpha,
+                                                   options.prefixDelimiter);
+  }
+
+  static SpeculativeOptions parseSpeculative(const folly::dynamic& json) {
+    checkLogic(json.isObject(),
+               "MissFailoverRoute: speculative is not an object");
+    SpeculativeOptions options;
+    if (auto jdelay = json.get_ptr("delay_ms")) {
+      checkLogic(jdelay->isInt(),
+                 "MissFailoverRoute: speculative delay_ms is not an integer");
+      options.delay = std::chrono::milliseconds(jdelay->getInt());
+    }
+    if (auto jrate = json.get_ptr("miss_rate")) {
+      checkLogic(jrate->isNumber(),
+                 "MissFailoverRoute: speculative miss_rate is not a number");
+      options.missRate = jrate->asDouble();
+    }
+    if (auto jalpha = json.get_ptr("ewma_alpha")) {
+      checkLogic(jalpha->isNumber(),
+                 "MissFailoverRoute: speculative ewma_alpha is not a number");
+      options.ewmaAlpha = jalpha->asDouble();
+    }
+    if (auto jdelim = json.get_ptr("prefix_delimiter")) {
+      checkLogic(jdelim->isString() && jdelim->getString().size() == 1,
+                 "MissFailoverRoute: speculative prefix_delimiter is not "
+                 "a single character");
+      options.prefixDelimiter = jdelim->getString()[0];
+    }
+    return options;
+  }
 };
 
 }}
@@ -0,0 +1,240 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Range.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/HotKeys.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Small LRU cache of get hits in front of the target route handle.
+ *
+ * Only hits for 'get' requests with values not larger than max_value_size
+ * are cached, for at most ttl_ms milliseconds. Any other non-get-like
+ * request that goes through this route drops the cached entry for its key
+ * (flush_all drops everything) before being forwarded to the target.
+ *
+ * With hot_keys_min_share set, only keys that are at least that share of
+ * recent traffic are cached (see isHotKey() in mcrouter/lib/HotKeys.h),
+ * so that a small cache isn't churned by the long tail.
+ *
+ * Route handles are created per proxy, so the cache is never shared between
+ * threads and needs no locking.
+ *
+ * Example:
+ *  {
+ *    "type": "NearCacheRoute",
+ *    "target": "PoolRoute|A",
+ *    "ttl_ms": 500,
+ *    "max_entries": 10000,
+ *    "max_value_size": 512
+ *  }
+ */
+template <class RouteHandleIf>
+class NearCacheRoute {
+ public:
+  static std::string routeName() { return "near-cache"; }
+
+  using Clock = std::chrono::steady_clock;
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    return { target_ };
+  }
+
+  NearCacheRoute(std::shared_ptr<RouteHandleIf> target,
+                 std::chrono::milliseconds ttl,
+                 size_t maxEntries,
+                 size_t maxValueSize)
+      : target_(std::move(target)),
+        ttl_(ttl),
+        maxEntries_(maxEntries),
+        maxValueSize_(maxValueSize) {
+  }
+
+  NearCacheRoute(RouteHandleFactory<RouteHandleIf>& factory,
+                 const folly::dynamic& json) {
+    checkLogic(json.isObject(), "NearCacheRoute should be object");
+    auto jtarget = json.get_ptr("target");
+    checkLogic(jtarget, "NearCacheRoute: no target");
+    target_ = factory.create(*jtarget);
+
+    if (auto jttl = json.get_ptr("ttl_ms")) {
+      checkLogic(jttl->isInt() && jttl->getInt() > 0,
+                 "NearCacheRoute: ttl_ms is not a positive integer");
+      ttl_ = std::chrono::milliseconds(jttl->getInt());
+    }
+    if (auto jmaxEntries = json.get_ptr("max_entries")) {
+      checkLogic(jmaxEntries->isInt() && jmaxEntries->getInt() > 0,
+                 "NearCacheRoute: max_entries is not a positive integer");
+      maxEntries_ = jmaxEntries->getInt();
+    }
+    if (auto jmaxValueSize = json.get_ptr("max_value_size")) {
+      checkLogic(jmaxValueSize->isInt() && jmaxValueSize->getInt() >= 0,
+                 "NearCacheRoute: max_value_size is not an integer");
+      maxValueSize_ = jmaxValueSize->getInt();
+    }
+    if (auto jshare = json.get_ptr("hot_keys_min_share")) {
+      checkLogic(jshare->isNumber() && jshare->asDouble() >= 0 &&
+                 jshare->asDouble() <= 1,
+                 "NearCacheRoute: hot_keys_min_share is not in [0, 1]");
+      minHotShare_ = jshare->asDouble();
+    }
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, typename GetLike<Operation>::Type = 0) {
+
+    return routeGetLike(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, OtherThanT(Operation, GetLike<>) = 0) {
+
+    invalidate(req, Operation());
+    return target_->route(req, Operation());
+  }
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+ private:
+  struct Entry {
+    std::string key;
+    folly::IOBuf value;
+    uint64_t flags;
+    Clock::time_point expireTime;
+  };
+
+  std::shared_ptr<RouteHandleIf> target_;
+  std::chrono::milliseconds ttl_{1000};
+  size_t maxEntries_{1024};
+  size_t maxValueSize_{1024};
+  /* 0 caches every key */
+  double minHotShare_{0};
+
+  /* Most recently used entries are at the front */
+  std::list<Entry> lru_;
+  std::unordered_map<folly::StringPiece, typename std::list<Entry>::iterator,
+                     folly::StringPieceHash> entries_;
+
+  /* Bumped on every invalidation, so that replies to gets that raced with
+     an update are not cached. */
+  uint64_t generation_{0};
+
+  template <class Request>
+  typename ReplyType<McOperation<mc_op_get>, Request>::type routeGetLike(
+    const Request& req, McOperation<mc_op_get>) {
+
+    using Reply = typename ReplyType<McOperation<mc_op_get>, Request>::type;
+
+    auto now = Clock::now();
+    auto it = entries_.find(req.fullKey());
+    if (it != entries_.end()) {
+      auto entryIt = it->second;
+      if (entryIt->expireTime > now) {
+        lru_.splice(lru_.begin(), lru_, entryIt);
+        Reply reply(mc_res_found);
+        folly::IOBuf value;
+        entryIt->value.cloneInto(value);
+        reply.setValue(std::move(value));
+        reply.setFlags(entryIt->flags);
+        return reply;
+      }
+      erase(it);
+    }
+
+    auto generation = generation_;
+    auto reply = target_->route(req, McOperation<mc_op_get>());
+    if (reply.isHit() && generation == generation_ &&
+        reply.value().computeChainDataLength() <= maxValueSize_ &&
+        (minHotShare_ == 0 || isHotKey(req, minHotShare_))) {
+      insert(req.fullKey(), reply.value(), reply.flags(), now + ttl_);
+    }
+    return reply;
+  }
+
+  /* gets, metaget and lease-get are never cached */
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeGetLike(
+    const Request& req, Operation) {
+
+    return target_->route(req, Operation());
+  }
+
+  template <class Request>
+  void invalidate(const Request& req, McOperation<mc_op_flushall>) {
+    ++generation_;
+    entries_.clear();
+    lru_.clear();
+  }
+
+  template <class Operation, class Request>
+  void invalidate(const Request& req, Operation) {
+    ++generation_;
+    auto it = entries_.find(req.fullKey());
+    if (it != entries_.end()) {
+      erase(it);
+    }
+  }
+
+  void insert(folly::StringPiece key, const folly::IOBuf& value,
+              uint64_t flags, Clock::time_point expireTime) {
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      erase(it);
+    }
+    if (entries_.size() >= maxEntries_) {
+      entries_.erase(folly::StringPiece(lru_.back().key));
+      lru_.pop_back();
+    }
+
+    lru_.push_front(Entry());
+    auto& entry = lru_.front();
+    entry.key = key.str();
+    // Make a compact copy: value is small, and we don't want to pin
+    // the (possibly much larger) buffer it was read into.
+    auto data = value.clone();
+    entry.value = folly::IOBuf(folly::IOBuf::COPY_BUFFER, data->coalesce());
+    entry.flags = flags;
+    entry.expireTime = expireTime;
+    entries_.emplace(folly::StringPiece(entry.key), lru_.begin());
+  }
+
+  template <class Iterator>
+  void erase(Iterator it) {
+    auto entryIt = it->second;
+    entries_.erase(it);
+    lru_.erase(entryIt);
+  }
+};
+
+}}  // facebook::memcache
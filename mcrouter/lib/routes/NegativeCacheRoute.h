@@ -0,0 +1,204 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/NegativeCache.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Remembers keys that recently missed in the target, in a compact
+ * approximate filter (see mcrouter/lib/NegativeCache.h).
+ *
+ * Only 'get' misses are remembered, for at most ttl_ms milliseconds.
+ * Updates that go through this route drop the key from the filter
+ * (deletes keep it, flush_all drops everything).
+ *
+ * By default the route only observes: gets for remembered keys are still
+ * sent to the target, and counted as hits, or as false positives if the
+ * target found the key. With "short_circuit": true, they are answered
+ * with a miss without asking the target, except for one in verify_one_in
+ * of them, which checks for false positives. Short circuiting is only
+ * correct if all updates to the keys go through this route, or if misses
+ * up to ttl_ms stale are fine.
+ *
+ * Route handles are created per proxy, so the filter is never shared between
+ * threads and needs no locking.
+ *
+ * Example:
+ *  {
+ *    "type": "NegativeCacheRoute",
+ *    "target": "PoolRoute|A",
+ *    "ttl_ms": 200,
+ *    "max_entries": 100000,
+ *    "short_circuit": true
+ *  }
+ */
+template <class RouteHandleIf>
+class NegativeCacheRoute {
+ public:
+  static std::string routeName() { return "negative-cache"; }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    return { target_ };
+  }
+
+  NegativeCacheRoute(std::shared_ptr<RouteHandleIf> target,
+                     std::chrono::milliseconds ttl,
+                     size_t maxEntries,
+                     bool shortCircuit,
+                     size_t verifyOneIn = 100)
+      : target_(std::move(target)),
+        shortCircuit_(shortCircuit),
+        verifyOneIn_(verifyOneIn),
+        cache_(maxEntries, ttl) {
+  }
+
+  NegativeCacheRoute(RouteHandleFactory<RouteHandleIf>& factory,
+                     const folly::dynamic& json)
+      : NegativeCacheRoute(nullptr, ttlFromJson(json),
+                           maxEntriesFromJson(json), false) {
+    auto jtarget = json.get_ptr("target");
+    checkLogic(jtarget, "NegativeCacheRoute: no target");
+    target_ = factory.create(*jtarget);
+
+    if (auto jshortCircuit = json.get_ptr("short_circuit")) {
+      checkLogic(jshortCircuit->isBool(),
+                 "NegativeCacheRoute: short_circuit is not a boolean");
+      shortCircuit_ = jshortCircuit->getBool();
+    }
+    if (auto jverify = json.get_ptr("verify_one_in")) {
+      checkLogic(jverify->isInt() && jverify->getInt() >= 0,
+                 "NegativeCacheRoute: verify_one_in is not an integer");
+      verifyOneIn_ = jverify->getInt();
+    }
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, typename GetLike<Operation>::Type = 0) {
+
+    return routeGetLike(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, OtherThanT(Operation, GetLike<>) = 0) {
+
+    invalidate(req, Operation());
+    return target_->route(req, Operation());
+  }
+
+ private:
+  std::shared_ptr<RouteHandleIf> target_;
+  bool shortCircuit_;
+  /* 0 never verifies */
+  size_t verifyOneIn_;
+  size_t sinceVerify_{0};
+  NegativeCache cache_;
+
+  /* Bumped on every invalidation, so that misses of gets that raced with
+     an update are not remembered. */
+  uint64_t generation_{0};
+
+  static std::chrono::milliseconds ttlFromJson(const folly::dynamic& json) {
+    checkLogic(json.isObject(), "NegativeCacheRoute should be object");
+    auto jttl = json.get_ptr("ttl_ms");
+    if (!jttl) {
+      return std::chrono::milliseconds(1000);
+    }
+    checkLogic(jttl->isInt() && jttl->getInt() > 0,
+               "NegativeCacheRoute: ttl_ms is not a positive integer");
+    return std::chrono::milliseconds(jttl->getInt());
+  }
+
+  static size_t maxEntriesFromJson(const folly::dynamic& json) {
+    checkLogic(json.isObject(), "NegativeCacheRoute should be object");
+    auto jmaxEntries = json.get_ptr("max_entries");
+    if (!jmaxEntries) {
+      return 10000;
+    }
+    checkLogic(jmaxEntries->isInt() && jmaxEntries->getInt() > 0,
+               "NegativeCacheRoute: max_entries is not a positive integer");
+    return jmaxEntries->getInt();
+  }
+
+  template <class Request>
+  typename ReplyType<McOperation<mc_op_get>, Request>::type routeGetLike(
+    const Request& req, McOperation<mc_op_get>) {
+
+    using Reply = typename ReplyType<McOperation<mc_op_get>, Request>::type;
+
+    if (cache_.contains(req.fullKey())) {
+      negativeCacheEvent(req, NegativeCacheEvent::HIT);
+      if (shortCircuit_ &&
+          (verifyOneIn_ == 0 || ++sinceVerify_ < verifyOneIn_)) {
+        return Reply(mc_res_notfound);
+      }
+      sinceVerify_ = 0;
+      auto reply = target_->route(req, McOperation<mc_op_get>());
+      if (reply.isHit()) {
+        negativeCacheEvent(req, NegativeCacheEvent::FALSE_POSITIVE);
+        ++generation_;
+        cache_.remove(req.fullKey());
+      }
+      return reply;
+    }
+
+    auto generation = generation_;
+    auto reply = target_->route(req, McOperation<mc_op_get>());
+    if (reply.result() == mc_res_notfound && generation == generation_) {
+      cache_.insert(req.fullKey());
+    }
+    return reply;
+  }
+
+  /* Misses of gets, metaget and lease-get are never remembered */
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeGetLike(
+    const Request& req, Operation) {
+
+    return target_->route(req, Operation());
+  }
+
+  template <class Request>
+  void invalidate(const Request& req, McOperation<mc_op_flushall>) {
+    ++generation_;
+    cache_.clear();
+  }
+
+  /* A deleted key is still missing */
+  template <class Request>
+  void invalidate(const Request& req, McOperation<mc_op_delete>) {
+  }
+
+  template <class Operation, class Request>
+  void invalidate(const Request& req, Operation) {
+    ++generation_;
+    cache_.remove(req.fullKey());
+  }
+};
+
+}}  // facebook::memcache
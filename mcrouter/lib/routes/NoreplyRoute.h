@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/dynamic.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McOperationTraits.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/routes/NullRoute.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Fire-and-forget writes: updates, deletes and arithmetic requests are
+ * sent to the target with 'noreply' set, and answered right away with
+ * the NullRoute reply. Ascii destinations send them as noreply commands
+ * and complete them as soon as they're written, without waiting for
+ * (or matching) a reply. Other protocols ignore the flag.
+ *
+ * cas and lease-set are always sent as is, their result matters.
+ * Gets and everything else are sent as is too.
+ *
+ * Config:
+ *  {
+ *    "type": "NoreplyRoute",
+ *    "target": "PoolRoute|A"
+ *  }
+ */
+template <class RouteHandleIf>
+class NoreplyRoute {
+ public:
+  static std::string routeName() { return "noreply"; }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    return { target_ };
+  }
+
+  explicit NoreplyRoute(std::shared_ptr<RouteHandleIf> target)
+      : target_(std::move(target)) {
+  }
+
+  NoreplyRoute(RouteHandleFactory<RouteHandleIf>& factory,
+               const folly::dynamic& json) {
+    checkLogic(json.isObject(), "NoreplyRoute should be object");
+    auto jtarget = json.get_ptr("target");
+    checkLogic(jtarget, "NoreplyRoute: no target");
+    target_ = factory.create(*jtarget);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    OtherThanT(Operation, UpdateLike<>, DeleteLike<>, ArithmeticLike<>) = 0)
+    const {
+
+    return target_->route(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename UpdateLike<Operation>::Type = 0) const {
+
+    if (Operation::mc_op == mc_op_cas || Operation::mc_op == mc_op_lease_set) {
+      return target_->route(req, Operation());
+    }
+    return routeNoreply(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename DeleteLike<Operation>::Type = 0) const {
+
+    return routeNoreply(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename ArithmeticLike<Operation>::Type = 0) const {
+
+    return routeNoreply(req, Operation());
+  }
+
+ private:
+  std::shared_ptr<RouteHandleIf> target_;
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeNoreply(
+    const Request& req, Operation) const {
+
+    auto reqCopy = req.clone();
+    reqCopy.setNoreply(true);
+    target_->route(reqCopy, Operation());
+    return NullRoute<RouteHandleIf>::route(req, Operation());
+  }
+};
+
+}}  // facebook::memcache
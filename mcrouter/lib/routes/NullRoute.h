@@ -34,6 +34,10 @@ struct NullRoute {
     return {};
   }
 
+  static bool routesInline() {
+    return true;
+  }
+
   template <class Operation, class Request>
   static typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation) {
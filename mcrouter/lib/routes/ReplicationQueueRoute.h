@@ -0,0 +1,288 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/MoveWrapper.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fibers/Baton.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McOperationTraits.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/ReplicationQueue.h"
+#include "mcrouter/lib/SubRequests.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Write-behind replication. Updates and deletes are sent to "local",
+ * and the client gets the local reply right away. A copy of every
+ * update that was stored locally, and of every delete that deleted a key,
+ * is queued and sent to "remote" in the background, at most max_in_flight
+ * at a time. A copy that fails with a failover error (connection error,
+ * timeout, TKO) is retried max_retries times, waiting retry_delay_ms longer
+ * before every attempt. lease-set and cas are replicated as plain sets;
+ * the ones local rejected (stale lease token, cas mismatch) aren't
+ * replicated.
+ * Other requests only go to local.
+ *
+ * The queue is per proxy and holds max_queue copies, including the ones
+ * being sent; copies that don't fit, or that are over the limit on
+ * detached subrequests (see mcrouter/lib/SubRequests.h), are dropped.
+ * Queued copies keep their request alive, like AllAsyncRoute children.
+ * With max_in_flight 1, copies reach remote in the order they were queued.
+ *
+ * The queue is in memory only. Failed remote deletes still go to the
+ * async spool if the remote pool has asynclog enabled.
+ *
+ * Example:
+ *  {
+ *    "type": "ReplicationQueueRoute",
+ *    "local": "PoolRoute|local",
+ *    "remote": "PoolRoute|remote",
+ *    "max_queue": 10000,
+ *    "max_in_flight": 16,
+ *    "max_retries": 3,
+ *    "retry_delay_ms": 100
+ *  }
+ */
+template <class RouteHandleIf>
+class ReplicationQueueRoute {
+ public:
+  static std::string routeName() { return "replication-queue"; }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    if (UpdateLike<Operation>::value || DeleteLike<Operation>::value) {
+      return { local_, remote_ };
+    }
+    return { local_ };
+  }
+
+  ReplicationQueueRoute(std::shared_ptr<RouteHandleIf> local,
+                        std::shared_ptr<RouteHandleIf> remote,
+                        size_t maxQueue,
+                        size_t maxInFlight,
+                        size_t maxRetries,
+                        std::chrono::milliseconds retryDelay)
+      : local_(std::move(local)),
+        remote_(std::move(remote)),
+        queue_(std::make_shared<Queue>(maxQueue, maxInFlight, maxRetries,
+                                       retryDelay)) {
+  }
+
+  ReplicationQueueRoute(RouteHandleFactory<RouteHandleIf>& factory,
+                        const folly::dynamic& json) {
+    checkLogic(json.isObject(), "ReplicationQueueRoute should be object");
+    auto jlocal = json.get_ptr("local");
+    checkLogic(jlocal, "ReplicationQueueRoute: no local");
+    local_ = factory.create(*jlocal);
+    auto jremote = json.get_ptr("remote");
+    checkLogic(jremote, "ReplicationQueueRoute: no remote");
+    remote_ = factory.create(*jremote);
+
+    auto parseInt = [&json](const char* name, int64_t min, int64_t def) {
+      auto jvalue = json.get_ptr(name);
+      if (!jvalue) {
+        return def;
+      }
+      checkLogic(jvalue->isInt() && jvalue->getInt() >= min,
+                 "ReplicationQueueRoute: {} is not an integer >= {}",
+                 name, min);
+      return jvalue->getInt();
+    };
+    queue_ = std::make_shared<Queue>(
+      parseInt("max_queue", 1, 10000),
+      parseInt("max_in_flight", 1, 16),
+      parseInt("max_retries", 0, 3),
+      std::chrono::milliseconds(parseInt("retry_delay_ms", 0, 100)));
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    OtherThanT(Operation, UpdateLike<>, DeleteLike<>) = 0) const {
+
+    return local_->route(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename UpdateLike<Operation>::Type = 0) const {
+
+    return routeReplicated(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename DeleteLike<Operation>::Type = 0) const {
+
+    return routeReplicated(req, Operation());
+  }
+
+  /**
+   * Copies queued or being sent.
+   */
+  size_t queueSize() const {
+    return queue_->entries.size() + queue_->inFlight;
+  }
+
+ private:
+  class Entry {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    virtual ~Entry() {}
+
+    /**
+     * @return true if the remote route replied with a failover error
+     */
+    virtual bool send() = 0;
+
+    virtual void report(ReplicationEvent event) = 0;
+
+    virtual void done() = 0;
+
+    const Clock::time_point queuedAt{Clock::now()};
+  };
+
+  template <class Operation, class Request>
+  class EntryImpl : public Entry {
+   public:
+    EntryImpl(std::shared_ptr<RouteHandleIf> remote,
+              std::shared_ptr<Request> req)
+        : remote_(std::move(remote)),
+          req_(std::move(req)) {
+    }
+
+    bool send() override {
+      return remote_->route(*req_, Operation()).isFailoverError();
+    }
+
+    void report(ReplicationEvent event) override {
+      auto lag = std::chrono::duration_cast<std::chrono::microseconds>(
+        Entry::Clock::now() - this->queuedAt);
+      replicationEvent(*req_, event, lag.count());
+    }
+
+    void done() override {
+      detachedSubRequestDone(*req_);
+    }
+
+   private:
+    std::shared_ptr<RouteHandleIf> remote_;
+    std::shared_ptr<Request> req_;
+  };
+
+  struct Queue {
+    Queue(size_t maxSize_, size_t maxInFlight_, size_t maxRetries_,
+          std::chrono::milliseconds retryDelay_)
+        : maxSize(maxSize_),
+          maxInFlight(maxInFlight_),
+          maxRetries(maxRetries_),
+          retryDelay(retryDelay_) {
+    }
+
+    const size_t maxSize;
+    const size_t maxInFlight;
+    const size_t maxRetries;
+    const std::chrono::milliseconds retryDelay;
+
+    std::deque<std::unique_ptr<Entry>> entries;
+    size_t inFlight{0};
+  };
+
+  std::shared_ptr<RouteHandleIf> local_;
+  std::shared_ptr<RouteHandleIf> remote_;
+  /* Shared with the fibers sending the copies, which finish sending the
+     queue even if the route is destroyed by a reconfiguration */
+  std::shared_ptr<Queue> queue_;
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeReplicated(
+    const Request& req, Operation) const {
+
+    auto reply = local_->route(req, Operation());
+    auto applied = UpdateLike<Operation>::value ? mc_res_stored
+                                                : mc_res_deleted;
+    if (reply.result() == applied) {
+      enqueue(req, Operation());
+    }
+    return reply;
+  }
+
+  template <class Operation, class Request>
+  void enqueue(const Request& req, Operation) const {
+    /* The local lease token or cas unique is meaningless remotely */
+    using RemoteOperation = typename std::conditional<
+      std::is_same<Operation, McOperation<mc_op_lease_set>>::value ||
+        std::is_same<Operation, McOperation<mc_op_cas>>::value,
+      McOperation<mc_op_set>,
+      Operation>::type;
+
+    auto reqCopy = std::make_shared<Request>(req.clone());
+    if (queueSize() >= queue_->maxSize ||
+        !detachSubRequests(*reqCopy, 1)) {
+      replicationEvent(*reqCopy, ReplicationEvent::DROPPED, 0);
+      return;
+    }
+    replicationEvent(*reqCopy, ReplicationEvent::QUEUED, 0);
+    queue_->entries.emplace_back(
+      new EntryImpl<RemoteOperation, Request>(remote_, std::move(reqCopy)));
+    drain(queue_);
+  }
+
+  static void drain(const std::shared_ptr<Queue>& queue) {
+    while (queue->inFlight < queue->maxInFlight && !queue->entries.empty()) {
+      auto entry = folly::makeMoveWrapper(std::move(queue->entries.front()));
+      queue->entries.pop_front();
+      ++queue->inFlight;
+      fiber::addTask(
+        [queue, entry]() {
+          auto& e = **entry;
+          for (size_t attempt = 1; ; ++attempt) {
+            if (!e.send()) {
+              e.report(ReplicationEvent::DONE);
+              break;
+            }
+            if (attempt > queue->maxRetries) {
+              e.report(ReplicationEvent::FAILED);
+              break;
+            }
+            e.report(ReplicationEvent::RETRIED);
+            if (queue->retryDelay.count() > 0) {
+              Baton baton;
+              baton.timed_wait(queue->retryDelay * attempt);
+            }
+          }
+          e.done();
+          --queue->inFlight;
+          drain(queue);
+        });
+    }
+  }
+};
+
+}}  // facebook::memcache
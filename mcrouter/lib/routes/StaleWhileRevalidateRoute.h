@@ -0,0 +1,363 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Bits.h>
+#include <folly/dynamic.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Random.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Keeps serving values for stale_s seconds after they expire, while one
+ * client at a time refreshes them, so that an expiring popular key
+ * doesn't send all of its clients to the backing store at once.
+ *
+ * Sets, adds, replaces, lease-sets and cas with a non-zero exptime are
+ * stored with stale_s more seconds to live, and their value is prefixed
+ * with the original expiry (an "envelope", 4 bytes of big endian unix
+ * time, marked with MC_MSG_FLAG_SOFT_EXPTIME). The envelope is stripped
+ * from get-like replies.
+ *
+ * Once a value is past its original expiry, the first get or lease-get
+ * of the key is told to refresh it: a get gets a miss, a lease-get a miss
+ * with a lease token. Every other get-like request gets the stale value
+ * until the key is updated, or for refresh_timeout_ms, after which the
+ * next request refreshes it instead. A lease-set with the token is sent
+ * as a set, since the target never gave out that token.
+ *
+ * Prepend must not be used on keys written through this route. All routes
+ * reading them must strip the envelope, otherwise clients get values with
+ * an unknown flag.
+ *
+ * Route handles are created per proxy, so refreshes are tracked per proxy
+ * and need no locking: a key is refreshed by at most one client per proxy.
+ *
+ * Example:
+ *  {
+ *    "type": "StaleWhileRevalidateRoute",
+ *    "target": "PoolRoute|A",
+ *    "stale_s": 30,
+ *    "refresh_timeout_ms": 1000
+ *  }
+ */
+template <class RouteHandleIf>
+class StaleWhileRevalidateRoute {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr uint64_t kEnvelopeFlag = MC_MSG_FLAG_SOFT_EXPTIME;
+  static constexpr size_t kEnvelopeSize = sizeof(uint32_t);
+
+  static std::string routeName() { return "stale-while-revalidate"; }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    return { target_ };
+  }
+
+  StaleWhileRevalidateRoute(std::shared_ptr<RouteHandleIf> target,
+                            std::chrono::seconds stale,
+                            std::chrono::milliseconds refreshTimeout)
+      : target_(std::move(target)),
+        stale_(stale),
+        refreshTimeout_(refreshTimeout) {
+  }
+
+  StaleWhileRevalidateRoute(RouteHandleFactory<RouteHandleIf>& factory,
+                            const folly::dynamic& json) {
+    checkLogic(json.isObject(), "StaleWhileRevalidateRoute should be object");
+    auto jtarget = json.get_ptr("target");
+    checkLogic(jtarget, "StaleWhileRevalidateRoute: no target");
+    target_ = factory.create(*jtarget);
+    if (auto jstale = json.get_ptr("stale_s")) {
+      checkLogic(jstale->isInt() && jstale->getInt() > 0,
+                 "StaleWhileRevalidateRoute: stale_s is not a positive "
+                 "integer");
+      stale_ = std::chrono::seconds(jstale->getInt());
+    }
+    if (auto jtimeout = json.get_ptr("refresh_timeout_ms")) {
+      checkLogic(jtimeout->isInt() && jtimeout->getInt() > 0,
+                 "StaleWhileRevalidateRoute: refresh_timeout_ms is not a "
+                 "positive integer");
+      refreshTimeout_ = std::chrono::milliseconds(jtimeout->getInt());
+    }
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, typename GetLike<Operation>::Type = 0) {
+
+    return routeGetLike(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, typename UpdateLike<Operation>::Type = 0) {
+
+    return routeUpdate(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    OtherThanT(Operation, GetLike<>, UpdateLike<>) = 0) {
+
+    if (!refreshes_.empty()) {
+      refreshes_.erase(req.fullKey().str());
+    }
+    return target_->route(req, Operation());
+  }
+
+  /**
+   * @return value prefixed with softExptime, flags must include
+   *         kEnvelopeFlag
+   */
+  static folly::IOBuf wrap(const folly::IOBuf& value, uint32_t softExptime) {
+    auto header = folly::IOBuf::create(kEnvelopeSize);
+    auto be = folly::Endian::big(softExptime);
+    std::memcpy(header->writableData(), &be, kEnvelopeSize);
+    header->append(kEnvelopeSize);
+    header->prependChain(value.clone());
+    return std::move(*header);
+  }
+
+  /**
+   * @return number of keys being refreshed by clients
+   */
+  size_t refreshesInProgress() const {
+    return refreshes_.size();
+  }
+
+ private:
+  /* Relative exptimes are at most this, larger ones are unix times */
+  static constexpr uint32_t kMaxRelativeExptime = 60 * 60 * 24 * 30;
+  static constexpr size_t kMinRefreshSweep = 1024;
+  /* Tokens memcached gives out for misses while a lease is held */
+  static constexpr uint64_t kHotMissToken = 1;
+
+  struct Refresh {
+    uint64_t token;
+    Clock::time_point expires;
+  };
+
+  std::shared_ptr<RouteHandleIf> target_;
+  std::chrono::seconds stale_{30};
+  std::chrono::milliseconds refreshTimeout_{1000};
+
+  /* Keys some client was told to refresh, by full key */
+  std::unordered_map<std::string, Refresh> refreshes_;
+  /* Expired refreshes are dropped when the map grows to this size */
+  size_t nextRefreshSweep_{kMinRefreshSweep};
+  uint64_t nextToken_{0};
+
+  template <class Request>
+  typename ReplyType<McOperation<mc_op_get>, Request>::type routeGetLike(
+    const Request& req, McOperation<mc_op_get>) {
+
+    using Reply = typename ReplyType<McOperation<mc_op_get>, Request>::type;
+
+    auto reply = target_->route(req, McOperation<mc_op_get>());
+    if (!unwrap(reply) || !startRefresh(req.fullKey())) {
+      return reply;
+    }
+    return Reply(mc_res_notfound);
+  }
+
+  template <class Request>
+  typename ReplyType<McOperation<mc_op_lease_get>, Request>::type routeGetLike(
+    const Request& req, McOperation<mc_op_lease_get>) {
+
+    using Reply =
+      typename ReplyType<McOperation<mc_op_lease_get>, Request>::type;
+
+    auto reply = target_->route(req, McOperation<mc_op_lease_get>());
+    if (!unwrap(reply)) {
+      return reply;
+    }
+    auto token = startRefresh(req.fullKey());
+    if (token == 0) {
+      return reply;
+    }
+    Reply miss(mc_res_notfound);
+    miss.setLeaseToken(token);
+    return miss;
+  }
+
+  /* metaget replies carry no value */
+  template <class Request>
+  typename ReplyType<McOperation<mc_op_metaget>, Request>::type routeGetLike(
+    const Request& req, McOperation<mc_op_metaget>) {
+
+    return target_->route(req, McOperation<mc_op_metaget>());
+  }
+
+  /* gets: a stale value is still served, refreshing needs a get */
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeGetLike(
+    const Request& req, Operation) {
+
+    auto reply = target_->route(req, Operation());
+    unwrap(reply);
+    return reply;
+  }
+
+  /* A lease-set with our token refreshes the key, the target doesn't know
+     the token */
+  template <class Request>
+  typename ReplyType<McOperation<mc_op_lease_set>, Request>::type routeUpdate(
+    const Request& req, McOperation<mc_op_lease_set>) {
+
+    auto it = refreshes_.find(req.fullKey().str());
+    if (it == refreshes_.end() || it->second.token != req.leaseToken()) {
+      return routeWrapped(req, McOperation<mc_op_lease_set>());
+    }
+    refreshes_.erase(it);
+    return routeWrapped(req, McOperation<mc_op_set>());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeUpdate(
+    const Request& req, Operation) {
+
+    if (!refreshes_.empty()) {
+      refreshes_.erase(req.fullKey().str());
+    }
+    return routeWrapped(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeWrapped(
+    const Request& req, Operation) {
+
+    if (!wrappable(Operation::mc_op) || req.exptime() == 0 ||
+        (req.flags() & kEnvelopeFlag)) {
+      return target_->route(req, Operation());
+    }
+
+    uint32_t now = time(nullptr);
+    uint32_t softExptime = req.exptime() <= kMaxRelativeExptime
+      ? now + req.exptime()
+      : req.exptime();
+    uint32_t exptime = req.exptime() + stale_.count();
+    if (req.exptime() <= kMaxRelativeExptime &&
+        exptime > kMaxRelativeExptime) {
+      exptime = softExptime + stale_.count();
+    }
+
+    auto newReq = req.clone();
+    newReq.setValue(wrap(req.value(), softExptime));
+    newReq.setFlags(req.flags() | kEnvelopeFlag);
+    newReq.setExptime(exptime);
+    return target_->route(newReq, Operation());
+  }
+
+  static bool wrappable(mc_op_t op) {
+    return op == mc_op_set || op == mc_op_add || op == mc_op_replace ||
+           op == mc_op_lease_set || op == mc_op_cas;
+  }
+
+  /**
+   * Strips the envelope from the value of a hit. Hits too short to have
+   * an envelope become misses, so that clients fill them again.
+   *
+   * @return true if the value is past its soft expiry
+   */
+  template <class Reply>
+  static bool unwrap(Reply& reply) {
+    if (!reply.isHit() || !(reply.flags() & kEnvelopeFlag)) {
+      return false;
+    }
+    if (reply.value().computeChainDataLength() < kEnvelopeSize) {
+      reply = Reply(mc_res_notfound);
+      return false;
+    }
+    folly::io::Cursor cursor(&reply.value());
+    auto softExptime = cursor.readBE<uint32_t>();
+    folly::IOBuf value;
+    cursor.clone(value, cursor.totalLength());
+    reply.setValue(std::move(value));
+    reply.setFlags(reply.flags() & ~kEnvelopeFlag);
+    return softExptime <= static_cast<uint32_t>(time(nullptr));
+  }
+
+  /**
+   * @return lease token of the client that should refresh fullKey,
+   *         0 if another client is refreshing it already
+   */
+  uint64_t startRefresh(folly::StringPiece fullKey) {
+    auto now = Clock::now();
+    if (refreshes_.size() >= nextRefreshSweep_) {
+      for (auto it = refreshes_.begin(); it != refreshes_.end(); ) {
+        if (it->second.expires <= now) {
+          it = refreshes_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      nextRefreshSweep_ = std::max(kMinRefreshSweep, 2 * refreshes_.size());
+    }
+
+    auto& refresh = refreshes_[fullKey.str()];
+    if (refresh.token != 0 && refresh.expires > now) {
+      return 0;
+    }
+    refresh.token = nextToken();
+    refresh.expires = now + refreshTimeout_;
+    return refresh.token;
+  }
+
+  uint64_t nextToken() {
+    /* starts at a random point, unlikely to match a token of the target
+       for the same key */
+    if (nextToken_ == 0) {
+      nextToken_ = folly::Random::rand64();
+    }
+    do {
+      ++nextToken_;
+    } while (nextToken_ <= kHotMissToken);
+    return nextToken_;
+  }
+};
+
+template <class RouteHandleIf>
+constexpr uint64_t StaleWhileRevalidateRoute<RouteHandleIf>::kEnvelopeFlag;
+template <class RouteHandleIf>
+constexpr size_t StaleWhileRevalidateRoute<RouteHandleIf>::kEnvelopeSize;
+template <class RouteHandleIf>
+constexpr uint32_t
+StaleWhileRevalidateRoute<RouteHandleIf>::kMaxRelativeExptime;
+template <class RouteHandleIf>
+constexpr size_t StaleWhileRevalidateRoute<RouteHandleIf>::kMinRefreshSweep;
+template <class RouteHandleIf>
+constexpr uint64_t StaleWhileRevalidateRoute<RouteHandleIf>::kHotMissToken;
+
+}}  // facebook::memcache
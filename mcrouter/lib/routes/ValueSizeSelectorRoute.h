@@ -0,0 +1,268 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/Optional.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/fibers/ForEach.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/SubRequests.h"
+
+namespace facebook { namespace memcache {
+
+/**
+ * Keeps large values apart from small ones: sets, adds, replaces and cas
+ * go to the policy of the largest size threshold their value reaches
+ * (default_policy below the smallest one), so that big objects don't
+ * evict small ones nor hold up their connections.
+ *
+ * The key is then deleted from the other policies (without waiting), so
+ * that a value that changed size isn't found stale where it used to be.
+ *
+ * Gets go to default_policy first; unless "miss_failover" is false,
+ * misses are retried in the other policies by ascending threshold.
+ * Deletes and flush_all go to all the policies.
+ * Everything else (leases, which are only valid where they were issued,
+ * appends, arithmetic, ...) goes to default_policy only.
+ *
+ * Example:
+ *  {
+ *    "type": "ValueSizeSelectorRoute",
+ *    "default_policy": "PoolRoute|small",
+ *    "size_policies": {
+ *      "65536": "PoolRoute|medium",
+ *      "524288": "PoolRoute|large"
+ *    }
+ *  }
+ */
+template <class RouteHandleIf>
+class ValueSizeSelectorRoute {
+ public:
+  static std::string routeName() { return "value-size-selector"; }
+
+  /**
+   * @param sizePolicies  (threshold in bytes, policy) by ascending
+   *                      threshold, thresholds above zero
+   */
+  ValueSizeSelectorRoute(
+    std::shared_ptr<RouteHandleIf> defaultPolicy,
+    std::vector<std::pair<size_t, std::shared_ptr<RouteHandleIf>>>
+      sizePolicies,
+    bool missFailover = true)
+      : missFailover_(missFailover) {
+    thresholds_.push_back(0);
+    policies_.push_back(std::move(defaultPolicy));
+    for (auto& it : sizePolicies) {
+      checkLogic(it.first > thresholds_.back(),
+                 "ValueSizeSelectorRoute: thresholds must be positive "
+                 "and ascending");
+      thresholds_.push_back(it.first);
+      policies_.push_back(std::move(it.second));
+    }
+  }
+
+  ValueSizeSelectorRoute(RouteHandleFactory<RouteHandleIf>& factory,
+                         const folly::dynamic& json) {
+    checkLogic(json.isObject(), "ValueSizeSelectorRoute should be object");
+    auto jdefault = json.get_ptr("default_policy");
+    checkLogic(jdefault, "ValueSizeSelectorRoute: no default_policy");
+
+    /* parsed by ascending threshold, like OperationSelectorRoute's
+       policies, so that named handles resolve the same way every time */
+    std::map<size_t, const folly::dynamic*> orderedPolicies;
+    if (auto jpolicies = json.get_ptr("size_policies")) {
+      checkLogic(jpolicies->isObject(),
+                 "ValueSizeSelectorRoute: size_policies is not object");
+      for (const auto& it : jpolicies->items()) {
+        checkLogic(it.first.isString(),
+                   "ValueSizeSelectorRoute: size_policies key is not "
+                   "a string");
+        size_t threshold = 0;
+        try {
+          threshold = folly::to<size_t>(it.first.stringPiece());
+        } catch (const std::exception&) {
+        }
+        checkLogic(threshold > 0,
+                   "ValueSizeSelectorRoute: size_policies key '{}' is not "
+                   "a positive integer", it.first.stringPiece());
+        orderedPolicies.emplace(threshold, &it.second);
+      }
+    }
+
+    thresholds_.push_back(0);
+    policies_.push_back(factory.create(*jdefault));
+    for (const auto& it : orderedPolicies) {
+      thresholds_.push_back(it.first);
+      policies_.push_back(factory.create(*it.second));
+    }
+
+    if (auto jmissFailover = json.get_ptr("miss_failover")) {
+      checkLogic(jmissFailover->isBool(),
+                 "ValueSizeSelectorRoute: miss_failover is not a boolean");
+      missFailover_ = jmissFailover->getBool();
+    }
+  }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    return policies_;
+  }
+
+  template <int M, class Request>
+  typename ReplyType<McOperation<M>, Request>::type route(
+    const Request& req, McOperation<M>,
+    typename GetLike<McOperation<M>>::Type = 0) const {
+
+    if (!missFailover_ || M == mc_op_lease_get) {
+      return policies_[0]->route(req, McOperation<M>());
+    }
+    for (size_t i = 0; i < policies_.size() - 1; ++i) {
+      auto reply = policies_[i]->route(req, McOperation<M>());
+      if (reply.isHit()) {
+        return reply;
+      }
+    }
+    return policies_.back()->route(req, McOperation<M>());
+  }
+
+  template <int M, class Request>
+  typename ReplyType<McOperation<M>, Request>::type route(
+    const Request& req, McOperation<M>,
+    typename UpdateLike<McOperation<M>>::Type = 0) const {
+
+    if (!isSizeRouted(mc_op_t(M))) {
+      return policies_[0]->route(req, McOperation<M>());
+    }
+    auto target = policyFor(req.value().computeChainDataLength());
+    auto reply = policies_[target]->route(req, McOperation<M>());
+    invalidateOthers(req, target);
+    return reply;
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation, typename DeleteLike<Operation>::Type = 0)
+    const {
+
+    return routeAll(req, Operation());
+  }
+
+  template <class Request>
+  typename ReplyType<McOperation<mc_op_flushall>, Request>::type route(
+    const Request& req, McOperation<mc_op_flushall>) const {
+
+    return routeAll(req, McOperation<mc_op_flushall>());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    OtherThanT(Operation, GetLike<>, UpdateLike<>, DeleteLike<>,
+               McOperation<mc_op_flushall>) = 0)
+    const {
+
+    return policies_[0]->route(req, Operation());
+  }
+
+ private:
+  /* thresholds_[i] is the smallest value size sent to policies_[i] */
+  std::vector<size_t> thresholds_;
+  std::vector<std::shared_ptr<RouteHandleIf>> policies_;
+  bool missFailover_{true};
+
+  /* The ops carrying the whole value */
+  static bool isSizeRouted(mc_op_t op) {
+    return op == mc_op_set || op == mc_op_add || op == mc_op_replace ||
+      op == mc_op_cas;
+  }
+
+  size_t policyFor(size_t valueSize) const {
+    size_t i = thresholds_.size() - 1;
+    while (thresholds_[i] > valueSize) {
+      --i;
+    }
+    return i;
+  }
+
+  template <class Request>
+  void invalidateOthers(const Request& origReq, size_t target) const {
+    if (policies_.size() == 1) {
+      return;
+    }
+    auto req = std::make_shared<Request>(origReq.clone());
+    req->setExptime(0);
+    if (!detachSubRequests(*req, policies_.size() - 1)) {
+      return;
+    }
+    for (size_t i = 0; i < policies_.size(); ++i) {
+      if (i == target) {
+        continue;
+      }
+      auto rh = policies_[i];
+      fiber::addTask([rh, req]() {
+        rh->route(*req, McOperation<mc_op_delete>());
+        detachedSubRequestDone(*req);
+      });
+    }
+  }
+
+  /**
+   * Sends req to all the policies. The key normally lives in only one of
+   * them, so a miss only wins if nothing found the key (errors win over
+   * both).
+   */
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeAll(
+    const Request& req, Operation) const {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+
+    if (policies_.size() == 1) {
+      return policies_[0]->route(req, Operation());
+    }
+
+    folly::Optional<Reply> reply;
+    fiber::forEachBounded(
+      policies_.size(), /* maxConcurrency= */ 0,
+      [this, &req, &reply] (size_t id) {
+        auto newReply = policies_[id]->route(req, Operation());
+        if (!reply || preferredReply(newReply, *reply)) {
+          reply = std::move(newReply);
+        }
+      });
+    return std::move(reply.value());
+  }
+
+  template <class Reply>
+  static bool preferredReply(const Reply& reply, const Reply& current) {
+    if (reply.isError() || current.isError()) {
+      return reply.worseThan(current);
+    }
+    return current.result() == mc_res_notfound &&
+      reply.result() != mc_res_notfound;
+  }
+};
+
+}}  // facebook::memcache
@@ -9,11 +9,17 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <string>
+#include <unordered_set>
 
 #include <folly/dynamic.h>
 #include <folly/io/IOBuf.h>
+#include <folly/MoveWrapper.h>
+#include <folly/Optional.h>
+#include <folly/ScopeGuard.h>
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
@@ -23,6 +29,7 @@
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/OperationTraits.h"
 #include "mcrouter/lib/Reply.h"
+#include "mcrouter/lib/RequestPriority.h"
 
 namespace facebook { namespace memcache {
 
@@ -36,7 +43,20 @@ namespace facebook { namespace memcache {
  * fetched from the "warm" route handle (where the request is likely to result
  * in a cache hit). If "warm" returns an hit, the response is then forwarded to
  * the client and an asynchronous request, with the configured expiration time,
- * updates the value in the "cold" route handle.
+ * updates the value in the "cold" route handle. If the "warm" reply carries
+ * the remaining TTL of the item (e.g. "protocol": "meta" destinations), the
+ * fill uses it instead.
+ *
+ * There is at most one such fill per key in flight. While a cold pool warms
+ * up, fills can be limited with (all optional, 0 means no limit):
+ *  "fill_rate": fills per second,
+ *  "fill_burst": fills allowed at once after an idle period, default
+ *                fill_rate (at least 1),
+ *  "max_pending_fills": fills in flight.
+ * Fills over the limits are skipped; the key is filled on a later miss.
+ * Route handles are created per proxy, so are the limits.
+ * Fills are marked with RequestPriority::WARMUP, so that they queue behind
+ * foreground requests to the cold destinations.
  */
 template <class RouteHandleIf, typename AddOperation>
 class WarmUpRoute {
@@ -80,6 +100,25 @@ class WarmUpRoute {
       exptime_ = json["exptime"].asInt();
     }
 
+    if (auto jrate = json.get_ptr("fill_rate")) {
+      checkLogic(jrate->isNumber() && jrate->asDouble() >= 0,
+                 "WarmUpRoute: fill_rate is not a non-negative number");
+      fills_->rate = jrate->asDouble();
+    }
+    fills_->burst = std::max(fills_->rate, 1.0);
+    if (auto jburst = json.get_ptr("fill_burst")) {
+      checkLogic(jburst->isNumber() && jburst->asDouble() >= 1,
+                 "WarmUpRoute: fill_burst is not a number >= 1");
+      fills_->burst = jburst->asDouble();
+    }
+    fills_->tokens = fills_->burst;
+    if (auto jmax = json.get_ptr("max_pending_fills")) {
+      checkLogic(jmax->isInt() && jmax->getInt() >= 0,
+                 "WarmUpRoute: max_pending_fills is not a non-negative "
+                 "integer");
+      fills_->maxPending = jmax->getInt();
+    }
+
     cold_ = factory.create(json["cold"]);
     warm_ = factory.create(json["warm"]);
 
@@ -114,19 +153,15 @@ class WarmUpRoute {
     /* else */
     auto warmReply = warm_->route(req, Operation());
     if (warmReply.isHit()) {
-      auto wrappedAddReq = folly::makeMoveWrapper(
-        coldUpdateFromWarm(req, warmReply, exptime_));
-      auto cold = cold_;
-      fiber::addTask([cold, wrappedAddReq]() {
-        cold->route(*wrappedAddReq, AddOperation());
-      });
+      if (auto key = startFill(req)) {
+        fill(std::move(*key),
+             coldUpdateFromWarm(req, warmReply,
+                                fillExptime(warmReply, exptime_)));
+      }
     } else if (warmReply.isMiss() && ncacheUpdatePeriod_) {
-      auto wrappedAddReq = folly::makeMoveWrapper(
-        coldNcache(req, ncacheExptime_));
-      auto cold = cold_;
-      fiber::addTask([cold, wrappedAddReq]() {
-        cold->route(*wrappedAddReq, AddOperation());
-      });
+      if (auto key = startFill(req)) {
+        fill(std::move(*key), coldNcache(req, ncacheExptime_));
+      }
     }
     return warmReply;
   }
@@ -139,12 +174,89 @@ class WarmUpRoute {
   }
 
  private:
+  /**
+   * Fills in flight and fill limits. Shared with the fills, which may
+   * outlive the route.
+   */
+  struct Fills {
+    /* keys with a fill in flight */
+    std::unordered_set<std::string> keys;
+    size_t maxPending{0};
+    /* token bucket, unused if rate is 0 */
+    double rate{0};
+    double burst{1};
+    double tokens{1};
+    std::chrono::steady_clock::time_point lastRefill{
+      std::chrono::steady_clock::now()};
+  };
+
+  /* Larger exptimes are absolute unix times to memcached */
+  static constexpr uint32_t kMaxRelativeExptime = 60 * 60 * 24 * 30;
+
   std::shared_ptr<RouteHandleIf> warm_;
   std::shared_ptr<RouteHandleIf> cold_;
   uint32_t exptime_{0};
   size_t ncacheExptime_{0};
   size_t ncacheUpdatePeriod_{0};
   size_t ncacheUpdateCounter_{0};
+  std::shared_ptr<Fills> fills_{std::make_shared<Fills>()};
+
+  /**
+   * @return key to pass to fill(), none if the key is being filled
+   *         already or the fill is over the limits.
+   */
+  template <class Request>
+  folly::Optional<std::string> startFill(const Request& req) {
+    auto& fills = *fills_;
+    if (fills.maxPending != 0 && fills.keys.size() >= fills.maxPending) {
+      return folly::none;
+    }
+    auto key = req.fullKey().str();
+    if (fills.keys.count(key)) {
+      return folly::none;
+    }
+    if (fills.rate > 0) {
+      auto now = std::chrono::steady_clock::now();
+      auto elapsed =
+        std::chrono::duration<double>(now - fills.lastRefill).count();
+      fills.lastRefill = now;
+      fills.tokens = std::min(fills.burst, fills.tokens + elapsed * fills.rate);
+      if (fills.tokens < 1) {
+        return folly::none;
+      }
+      fills.tokens -= 1;
+    }
+    fills.keys.insert(key);
+    return std::move(key);
+  }
+
+  template <class Request>
+  void fill(std::string key, Request addReq) {
+    auto wrappedAddReq = folly::makeMoveWrapper(std::move(addReq));
+    auto wrappedKey = folly::makeMoveWrapper(std::move(key));
+    auto cold = cold_;
+    auto fills = fills_;
+    fiber::addTask([cold, wrappedAddReq, wrappedKey, fills]() {
+      auto guard = folly::makeGuard([&fills, &wrappedKey]() {
+        fills->keys.erase(*wrappedKey);
+      });
+      cold->route(*wrappedAddReq, AddOperation());
+    });
+  }
+
+  /**
+   * Remaining TTL of the warm item if its reply has it (e.g. from a
+   * mc_ascii_meta_protocol destination), so that the cold copy expires
+   * at the same time. Otherwise (or if it's too long to be sent as a
+   * relative exptime) the configured exptime.
+   */
+  template <class Reply>
+  static uint32_t fillExptime(const Reply& reply, uint32_t exptime) {
+    if (reply.exptime() != 0 && reply.exptime() <= kMaxRelativeExptime) {
+      return reply.exptime();
+    }
+    return exptime;
+  }
 
   template <class Request, class Reply>
   static Request coldUpdateFromWarm(const Request& origReq,
@@ -156,6 +268,7 @@ class WarmUpRoute {
     req.setValue(std::move(cloned));
     req.setFlags(reply.flags());
     req.setExptime(exptime);
+    setBackgroundPriority(req, RequestPriority::WARMUP);
     return std::move(req);
   }
 
@@ -167,6 +280,7 @@ class WarmUpRoute {
         folly::IOBuf::COPY_BUFFER, "ncache"));
     req.setFlags(MC_MSG_FLAG_NEGATIVE_CACHE);
     req.setExptime(ncacheExptime);
+    setBackgroundPriority(req, RequestPriority::WARMUP);
     return std::move(req);
   }
 
@@ -175,14 +289,17 @@ class WarmUpRoute {
     auto cold = cold_;
     auto warm = warm_;
     auto creq = folly::makeMoveWrapper(Request(req.clone()));
+    setBackgroundPriority(*creq, RequestPriority::WARMUP);
     auto exptime = exptime_;
     auto ncacheExptime = ncacheExptime_;
     fiber::addTask(
       [cold, warm, creq, exptime, ncacheExptime]() {
         auto warmReply = warm->route(*creq, Operation());
         if (warmReply.isHit()) {
-          cold->route(coldUpdateFromWarm(*creq, warmReply, exptime),
-                      McOperation<mc_op_set>());
+          cold->route(
+            coldUpdateFromWarm(*creq, warmReply,
+                               fillExptime(warmReply, exptime)),
+            McOperation<mc_op_set>());
         } else {
           /* bump TTL on the ncache entry */
           cold->route(coldNcache(*creq, ncacheExptime),
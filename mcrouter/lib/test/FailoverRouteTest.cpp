@@ -79,3 +79,30 @@ TEST(failoverRouteTest, fail) {
   /* Will return the last reply when ran out of targets */
   EXPECT_EQ(toString(reply.value()), "c");
 }
+
+TEST(failoverRouteTest, skipsKnownDead) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c"))
+  };
+
+  TestRouteHandle<FailoverRoute<TestRouteHandleIf>> rh(
+    get_route_handles(test_handles));
+
+  test_handles[0]->setDead(true);
+  auto reply = rh.route(McRequest("0"), McOperation<mc_op_get>());
+  EXPECT_EQ(toString(reply.value()), "b");
+  EXPECT_TRUE(test_handles[0]->saw_keys.empty());
+  EXPECT_FALSE(rh.knownDead());
+
+  /* The last target is always tried */
+  test_handles[1]->setDead(true);
+  test_handles[2]->setDead(true);
+  EXPECT_TRUE(rh.knownDead());
+  reply = rh.route(McRequest("0"), McOperation<mc_op_get>());
+  EXPECT_EQ(toString(reply.value()), "c");
+
+  test_handles[1]->setDead(false);
+  EXPECT_FALSE(rh.knownDead());
+}
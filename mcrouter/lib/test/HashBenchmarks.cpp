@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+
+#include "mcrouter/lib/Ch3HashFunc.h"
+#include "mcrouter/lib/Crc32HashFunc.h"
+#include "mcrouter/lib/WeightedCh3HashFunc.h"
+#include "mcrouter/lib/WeightedMaglevHashFunc.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+const size_t kNumServers = 100;
+const size_t kNumKeys = 1000;
+
+std::vector<std::string> generateKeys() {
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < kNumKeys; ++i) {
+    keys.push_back(folly::to<std::string>("someprefix:somekey:", i));
+  }
+  return keys;
+}
+
+const std::vector<std::string> kKeys = generateKeys();
+
+template <class HashFunc>
+void runHash(const HashFunc& func, size_t iters) {
+  size_t sum = 0;
+  for (size_t i = 0; i < iters; ++i) {
+    sum += func(kKeys[i % kNumKeys]);
+  }
+  folly::doNotOptimizeAway(sum);
+}
+
+}  // anonymous namespace
+
+BENCHMARK(Ch3HashFunc, iters) {
+  runHash(Ch3HashFunc(kNumServers), iters);
+}
+
+BENCHMARK(Crc32HashFunc, iters) {
+  runHash(Crc32HashFunc(kNumServers), iters);
+}
+
+BENCHMARK(WeightedCh3HashFunc, iters) {
+  std::vector<double> weights;
+  BENCHMARK_SUSPEND {
+    for (size_t i = 0; i < kNumServers; ++i) {
+      weights.push_back(0.5 + (i % 2) * 0.5);
+    }
+  }
+  runHash(WeightedCh3HashFunc(std::move(weights)), iters);
+}
+
+BENCHMARK(WeightedMaglevHashFunc, iters) {
+  std::vector<double> weights;
+  BENCHMARK_SUSPEND {
+    for (size_t i = 0; i < kNumServers; ++i) {
+      weights.push_back(0.5 + (i % 2) * 0.5);
+    }
+  }
+  WeightedMaglevHashFunc func(std::move(weights));
+  runHash(func, iters);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/HotKeyReplicationRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestHotKeyReplicationRoute = HotKeyReplicationRoute<TestRouteHandleIf>;
+
+/* With the generic isHotKey() every key is hot */
+
+TEST(hotKeyReplicationRouteTest, spreadsReads) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c")),
+  };
+  TestHotKeyReplicationRoute rh(get_route_handles(test_handles), 0.01,
+                                std::chrono::seconds(10), 16);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    vector<string> values;
+    for (int i = 0; i < 4; ++i) {
+      auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+      values.push_back(toString(reply.value()));
+    }
+    EXPECT_EQ((vector<string>{"a", "b", "c", "a"}), values);
+    EXPECT_EQ(1, rh.replicatedKeys());
+
+    /* gets only goes to the first replica */
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_gets>());
+    EXPECT_EQ("a", toString(reply.value()));
+  });
+}
+
+TEST(hotKeyReplicationRouteTest, fillsReplicaOnMiss) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""),
+                            UpdateRouteTestData(mc_res_stored)),
+  };
+  TestHotKeyReplicationRoute rh(get_route_handles(test_handles), 0.01,
+                                std::chrono::seconds(5), 16);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    rh.route(McRequest("key"), McOperation<mc_op_get>());
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ("a", toString(reply.value()));
+  });
+  fm.run([&]() {
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_get, mc_op_set }),
+              test_handles[1]->sawOperations);
+    EXPECT_EQ((vector<uint32_t>{ 0, 5 }), test_handles[1]->sawExptimes);
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_get, mc_op_get }),
+              test_handles[0]->sawOperations);
+  });
+}
+
+TEST(hotKeyReplicationRouteTest, invalidatesReplicas) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+  };
+  TestHotKeyReplicationRoute rh(get_route_handles(test_handles), 0.01,
+                                std::chrono::seconds(10), 16);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    /* not replicated yet, only the first replica sees it */
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_set>());
+    EXPECT_EQ(mc_res_stored, reply.result());
+  });
+  fm.run([&]() {
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_set }), test_handles[0]->sawOperations);
+    EXPECT_TRUE(test_handles[1]->sawOperations.empty());
+    EXPECT_TRUE(test_handles[2]->sawOperations.empty());
+
+    rh.route(McRequest("key"), McOperation<mc_op_get>());
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_set>());
+    EXPECT_EQ(mc_res_stored, reply.result());
+  });
+  fm.run([&]() {
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_set, mc_op_get, mc_op_set }),
+              test_handles[0]->sawOperations);
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_delete }),
+              test_handles[1]->sawOperations);
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_delete }),
+              test_handles[2]->sawOperations);
+  });
+}
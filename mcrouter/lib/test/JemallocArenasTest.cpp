@@ -0,0 +1,47 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <folly/Malloc.h>
+
+#include "mcrouter/lib/JemallocArenas.h"
+
+using namespace facebook::memcache;
+
+TEST(JemallocArenas, bindThread) {
+  int arena = -1;
+  size_t countBefore = JemallocArenas::count();
+  std::unique_ptr<char[]> buffer;
+  std::thread thread([&arena, &buffer]() {
+    arena = JemallocArenas::bindThreadToNewArena();
+    /* Big enough to bypass the thread cache */
+    buffer.reset(new char[1 << 20]);
+  });
+  thread.join();
+
+  if (!folly::usingJEMalloc()) {
+    EXPECT_EQ(-1, arena);
+    EXPECT_EQ(countBefore, JemallocArenas::count());
+    EXPECT_EQ(0, JemallocArenas::stats().allocated);
+    JemallocArenas::purge();
+    return;
+  }
+
+  ASSERT_GE(arena, 0);
+  EXPECT_EQ(countBefore + 1, JemallocArenas::count());
+  EXPECT_GE(JemallocArenas::stats().allocated, 1 << 20);
+
+  buffer.reset();
+  JemallocArenas::purge();
+  EXPECT_EQ(0, JemallocArenas::stats().dirty);
+}
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/LargeStackRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::vector;
+
+using LargeStackTestRoute =
+  TestRouteHandle<LargeStackRoute<TestRouteHandleIf>>;
+
+TEST(largeStackRouteTest, routesOnLargeStack) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
+                                      UpdateRouteTestData(mc_res_stored));
+  LargeStackTestRoute rh(leaf->rh);
+
+  FiberManager::Options opts;
+  opts.largeStackSize = 256 * 1024;
+  TestFiberManager fm(opts);
+  fm.run([&]() {
+      auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+      EXPECT_EQ(mc_res_found, reply.result());
+      EXPECT_EQ("a", toString(reply.value()));
+      reply = rh.route(McRequest("key"), McOperation<mc_op_set>());
+      EXPECT_EQ(mc_res_stored, reply.result());
+    });
+
+  EXPECT_EQ(vector<mc_op_t>({mc_op_get, mc_op_set}), leaf->sawOperations);
+  EXPECT_EQ(1, fm.getFiberManager().largeFibersPoolSize());
+}
+
+TEST(largeStackRouteTest, passThroughWithoutLargeStacks) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  LargeStackTestRoute rh(leaf->rh);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+      EXPECT_EQ("a", replyFor(rh, "key"));
+    });
+  EXPECT_EQ(0, fm.getFiberManager().largeFibersPoolSize());
+}
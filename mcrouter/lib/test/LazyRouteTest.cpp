@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/LazyRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::shared_ptr;
+using std::vector;
+
+using LazyTestRoute = TestRouteHandle<LazyRoute<TestRouteHandleIf>>;
+
+TEST(lazyRouteTest, buildsOnFirstUse) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  int builds = 0;
+  LazyTestRoute rh([&leaf, &builds]() {
+      ++builds;
+      return leaf->rh;
+    });
+
+  EXPECT_EQ(0, builds);
+  EXPECT_TRUE(rh.couldRouteTo(McRequest("key"),
+                              McOperation<mc_op_get>()).empty());
+
+  TestFiberManager fm;
+  fm.run([&]() {
+      EXPECT_EQ("a", replyFor(rh, "key"));
+      EXPECT_EQ("a", replyFor(rh, "key2"));
+    });
+
+  EXPECT_EQ(1, builds);
+  EXPECT_EQ(vector<std::string>({"key", "key2"}), leaf->saw_keys);
+  EXPECT_EQ(vector<shared_ptr<TestRouteHandleIf>>({leaf->rh}),
+            rh.couldRouteTo(McRequest("key"), McOperation<mc_op_get>()));
+}
+
+TEST(lazyRouteTest, buildFailure) {
+  int builds = 0;
+  LazyTestRoute nullRh([&builds]() {
+      ++builds;
+      return shared_ptr<TestRouteHandleIf>();
+    });
+  LazyTestRoute throwingRh([&builds]() -> shared_ptr<TestRouteHandleIf> {
+      ++builds;
+      throw std::runtime_error("bad config");
+    });
+
+  TestFiberManager fm;
+  fm.run([&]() {
+      for (int i = 0; i < 2; ++i) {
+        auto reply = nullRh.route(McRequest("key"), McOperation<mc_op_get>());
+        EXPECT_TRUE(reply.isError());
+        reply = throwingRh.route(McRequest("key"), McOperation<mc_op_get>());
+        EXPECT_TRUE(reply.isError());
+      }
+    });
+
+  /* not retried */
+  EXPECT_EQ(2, builds);
+}
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/MemoryAccounting.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+int64_t total(MemoryTag tag) {
+  return MemoryAccounting::totals()[static_cast<size_t>(tag)];
+}
+
+}  // anonymous namespace
+
+TEST(MemoryAccounting, addAndSub) {
+  auto before = total(MemoryTag::kAsynclog);
+  auto threadBefore = MemoryAccounting::threadBytes(MemoryTag::kAsynclog);
+
+  MemoryAccounting::add(MemoryTag::kAsynclog, 1000);
+  EXPECT_EQ(before + 1000, total(MemoryTag::kAsynclog));
+  EXPECT_EQ(threadBefore + 1000,
+            MemoryAccounting::threadBytes(MemoryTag::kAsynclog));
+
+  MemoryAccounting::sub(MemoryTag::kAsynclog, 400);
+  EXPECT_EQ(before + 600, total(MemoryTag::kAsynclog));
+
+  MemoryAccounting::sub(MemoryTag::kAsynclog, 600);
+  EXPECT_EQ(before, total(MemoryTag::kAsynclog));
+}
+
+TEST(MemoryAccounting, crossThread) {
+  auto before = total(MemoryTag::kWriteBuffers);
+
+  /* Allocated on one thread, freed on another */
+  std::thread([]() {
+    MemoryAccounting::add(MemoryTag::kWriteBuffers, 4096);
+  }).join();
+  EXPECT_EQ(before + 4096, total(MemoryTag::kWriteBuffers));
+
+  std::thread([]() {
+    MemoryAccounting::sub(MemoryTag::kWriteBuffers, 4096);
+    EXPECT_EQ(-4096, MemoryAccounting::threadBytes(MemoryTag::kWriteBuffers));
+  }).join();
+  EXPECT_EQ(before, total(MemoryTag::kWriteBuffers));
+}
+
+TEST(MemoryAccounting, tagNames) {
+  EXPECT_EQ(std::string("config"),
+            MemoryAccounting::tagName(MemoryTag::kConfig));
+  EXPECT_EQ(std::string("read_buffers"),
+            MemoryAccounting::tagName(MemoryTag::kReadBuffers));
+  EXPECT_EQ(std::string("asynclog"),
+            MemoryAccounting::tagName(MemoryTag::kAsynclog));
+  EXPECT_EQ(std::string("unknown"),
+            MemoryAccounting::tagName(MemoryTag::kNumTags));
+}
@@ -7,21 +7,51 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <gtest/gtest.h>
 
+#include "mcrouter/lib/fibers/Baton.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/MissRateTracker.h"
 #include "mcrouter/lib/routes/MissFailoverRoute.h"
 #include "mcrouter/lib/test/RouteHandleTestUtil.h"
 
 using namespace facebook::memcache;
 
 using std::make_shared;
+using std::string;
 using std::vector;
 
+using TestMissFailoverRoute = TestRouteHandle<
+  MissFailoverRoute<TestRouteHandleIf>>;
+using SpeculativeOptions =
+  MissFailoverRoute<TestRouteHandleIf>::SpeculativeOptions;
+
+namespace {
+
+SpeculativeOptions delayOptions() {
+  SpeculativeOptions options;
+  options.delay = std::chrono::milliseconds(10);
+  return options;
+}
+
+/* Unpauses the handle once the route had the time to speculate */
+std::function<void()> unpauseLater(TestHandle& handle) {
+  return [&handle]() {
+    Baton baton;
+    baton.timed_wait(std::chrono::milliseconds(50));
+    handle.unpause();
+  };
+}
+
+}  // anonymous namespace
+
 TEST(missMissFailoverRouteTest, success) {
   vector<std::shared_ptr<TestHandle>> test_handles{
     make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
@@ -100,3 +130,113 @@ TEST(missMissFailoverRouteTest, nonGetLike) {
   EXPECT_TRUE(test_handles[1]->saw_keys.size() == 0);
   EXPECT_TRUE(test_handles[2]->saw_keys.size() == 0);
 }
+
+TEST(missMissFailoverRouteTest, speculativeHitInOrder) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b"))
+  };
+  TestMissFailoverRoute rh(get_route_handles(test_handles), delayOptions());
+
+  TestFiberManager fm;
+  test_handles[0]->pause();
+  fm.runAll({
+    [&]() {
+      auto reply = rh.route(McRequest("0"), McOperation<mc_op_get>());
+      /* the first target's hit, though the second one replied first */
+      EXPECT_EQ("a", toString(reply.value()));
+    },
+    unpauseLater(*test_handles[0])
+  });
+  EXPECT_EQ(vector<string>{"0"}, test_handles[1]->saw_keys);
+}
+
+TEST(missMissFailoverRouteTest, speculativeMiss) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c"))
+  };
+  TestMissFailoverRoute rh(get_route_handles(test_handles), delayOptions());
+
+  TestFiberManager fm;
+  test_handles[0]->pause();
+  fm.runAll({
+    [&]() {
+      auto reply = rh.route(McRequest("0"), McOperation<mc_op_get>());
+      EXPECT_EQ("c", toString(reply.value()));
+    },
+    unpauseLater(*test_handles[0])
+  });
+  for (const auto& handle : test_handles) {
+    EXPECT_EQ(vector<string>{"0"}, handle->saw_keys);
+  }
+}
+
+TEST(missMissFailoverRouteTest, speculativeMissRate) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b"))
+  };
+  SpeculativeOptions options;
+  options.missRate = 0.5;
+  options.ewmaAlpha = 0.5;
+  TestMissFailoverRoute rh(get_route_handles(test_handles), options);
+  MissRateTracker probe(options.ewmaAlpha, options.prefixDelimiter);
+  ASSERT_NE(probe.slot("miss:1"), probe.slot("other:1"));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    /* misses to learn from, a rate is only known after 1/alpha samples */
+    EXPECT_EQ("b", replyFor(rh, "miss:1"));
+    EXPECT_EQ("b", replyFor(rh, "miss:2"));
+  });
+
+  test_handles[0]->pause();
+  fm.runAll({
+    [&]() {
+      EXPECT_EQ("b", replyFor(rh, "miss:3"));
+    },
+    [&]() {
+      Baton baton;
+      baton.timed_wait(std::chrono::milliseconds(50));
+      /* sent without waiting for the first target */
+      EXPECT_EQ(3, test_handles[1]->saw_keys.size());
+      test_handles[0]->unpause();
+    }
+  });
+
+  /* nothing known about this prefix */
+  test_handles[0]->pause();
+  fm.runAll({
+    [&]() {
+      EXPECT_EQ("b", replyFor(rh, "other:1"));
+    },
+    [&]() {
+      Baton baton;
+      baton.timed_wait(std::chrono::milliseconds(50));
+      EXPECT_EQ(3, test_handles[1]->saw_keys.size());
+      test_handles[0]->unpause();
+    }
+  });
+  EXPECT_EQ(4, test_handles[1]->saw_keys.size());
+}
+
+TEST(missRateTrackerTest, ewmaPerPrefix) {
+  MissRateTracker tracker(0.5, ':');
+  auto slot = tracker.slot("foo:1");
+  EXPECT_EQ(slot, tracker.slot("foo:2"));
+
+  tracker.record(slot, true);
+  /* not enough samples yet */
+  EXPECT_EQ(0, tracker.missRate(slot));
+  tracker.record(slot, true);
+  EXPECT_EQ(1, tracker.missRate(slot));
+  tracker.record(slot, false);
+  EXPECT_EQ(0.5, tracker.missRate(slot));
+
+  auto other = tracker.slot("bar:1");
+  if (other != slot) {
+    EXPECT_EQ(0, tracker.missRate(other));
+  }
+}
@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/NearCacheRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using NearCacheTestRoute = TestRouteHandle<NearCacheRoute<TestRouteHandleIf>>;
+
+TEST(nearCacheRouteTest, hit) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  NearCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(60000), 10, 100);
+
+  auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_found, reply.result());
+  EXPECT_EQ("a", toString(reply.value()));
+
+  reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_found, reply.result());
+  EXPECT_EQ("a", toString(reply.value()));
+  EXPECT_EQ(vector<string>{"key"}, leaf->saw_keys);
+
+  // gets are never served from cache
+  rh.route(McRequest("key"), McOperation<mc_op_gets>());
+  EXPECT_EQ(vector<string>({"key", "key"}), leaf->saw_keys);
+}
+
+TEST(nearCacheRouteTest, missNotCached) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""));
+  NearCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(60000), 10, 100);
+
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+  EXPECT_EQ(vector<string>({"key", "key"}), leaf->saw_keys);
+}
+
+TEST(nearCacheRouteTest, invalidate) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  NearCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(60000), 10, 100);
+
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  rh.route(McRequest("key"), McOperation<mc_op_set>());
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(vector<string>({"key", "key", "key"}), leaf->saw_keys);
+
+  rh.route(McRequest("key"), McOperation<mc_op_delete>());
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(vector<string>({"key", "key", "key", "key", "key"}),
+            leaf->saw_keys);
+}
+
+TEST(nearCacheRouteTest, expire) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  NearCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(10), 10, 100);
+
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(vector<string>({"key", "key"}), leaf->saw_keys);
+}
+
+TEST(nearCacheRouteTest, evict) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  NearCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(60000), 2, 100);
+
+  rh.route(McRequest("a"), McOperation<mc_op_get>());
+  rh.route(McRequest("b"), McOperation<mc_op_get>());
+  // "a" becomes most recently used, so "b" is evicted
+  rh.route(McRequest("a"), McOperation<mc_op_get>());
+  rh.route(McRequest("c"), McOperation<mc_op_get>());
+  rh.route(McRequest("a"), McOperation<mc_op_get>());
+  rh.route(McRequest("b"), McOperation<mc_op_get>());
+  EXPECT_EQ(vector<string>({"a", "b", "c", "b"}), leaf->saw_keys);
+}
+
+TEST(nearCacheRouteTest, largeValue) {
+  auto leaf = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, string(101, 'a')));
+  NearCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(60000), 10, 100);
+
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(vector<string>({"key", "key"}), leaf->saw_keys);
+}
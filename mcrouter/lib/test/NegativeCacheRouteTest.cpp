@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/NegativeCache.h"
+#include "mcrouter/lib/routes/NegativeCacheRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using NegativeCacheTestRoute =
+  TestRouteHandle<NegativeCacheRoute<TestRouteHandleIf>>;
+
+TEST(negativeCacheRouteTest, observeOnly) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""));
+  NegativeCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(60000), 10,
+                            /* shortCircuit */ false);
+
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+  EXPECT_EQ(vector<string>({"key", "key"}), leaf->saw_keys);
+}
+
+TEST(negativeCacheRouteTest, shortCircuit) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""));
+  NegativeCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(60000), 10,
+                            /* shortCircuit */ true, /* verifyOneIn */ 3);
+
+  for (int i = 0; i < 4; ++i) {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_notfound, reply.result());
+  }
+  // the third remembered miss is verified
+  EXPECT_EQ(vector<string>({"key", "key"}), leaf->saw_keys);
+
+  // lease-get misses are never answered locally
+  rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+  EXPECT_EQ(vector<string>({"key", "key", "key"}), leaf->saw_keys);
+}
+
+TEST(negativeCacheRouteTest, invalidate) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""));
+  NegativeCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(60000), 10,
+                            /* shortCircuit */ true, /* verifyOneIn */ 0);
+
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  rh.route(McRequest("key"), McOperation<mc_op_delete>());
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(vector<string>({"key", "key"}), leaf->saw_keys);
+
+  rh.route(McRequest("key"), McOperation<mc_op_set>());
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(vector<string>({"key", "key", "key", "key"}), leaf->saw_keys);
+}
+
+TEST(negativeCacheRouteTest, hitsNotRemembered) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"));
+  NegativeCacheTestRoute rh(leaf->rh, std::chrono::milliseconds(60000), 10,
+                            /* shortCircuit */ true);
+
+  rh.route(McRequest("key"), McOperation<mc_op_get>());
+  auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_found, reply.result());
+  EXPECT_EQ(vector<string>({"key", "key"}), leaf->saw_keys);
+}
+
+TEST(negativeCache, expire) {
+  NegativeCache cache(10, std::chrono::milliseconds(100));
+  auto now = NegativeCache::Clock::now();
+  cache.insert("key", now);
+  EXPECT_TRUE(cache.contains("key", now));
+  EXPECT_TRUE(cache.contains("key", now + std::chrono::milliseconds(70)));
+  EXPECT_FALSE(cache.contains("key", now + std::chrono::milliseconds(100)));
+  EXPECT_FALSE(cache.contains("other", now));
+}
+
+TEST(negativeCache, removeAndFull) {
+  NegativeCache cache(100, std::chrono::milliseconds(60000));
+  auto now = NegativeCache::Clock::now();
+  for (int i = 0; i < 200; ++i) {
+    cache.insert(folly::to<string>("key", i), now);
+  }
+  // the bucket is full after the first 100 keys
+  size_t found = 0;
+  for (int i = 100; i < 200; ++i) {
+    found += cache.contains(folly::to<string>("key", i), now);
+  }
+  EXPECT_LT(found, 20);
+
+  EXPECT_TRUE(cache.contains("key1", now));
+  cache.remove("key1");
+  EXPECT_FALSE(cache.contains("key1", now));
+
+  cache.clear();
+  EXPECT_FALSE(cache.contains("key2", now));
+}
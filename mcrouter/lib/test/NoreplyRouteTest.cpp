@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/NoreplyRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::vector;
+
+using NoreplyTestRoute = TestRouteHandle<NoreplyRoute<TestRouteHandleIf>>;
+
+TEST(noreplyRouteTest, writesAreNoreply) {
+  auto leaf = make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored),
+                                      DeleteRouteTestData(mc_res_deleted));
+  NoreplyTestRoute rh(leaf->rh);
+
+  McRequest req("key");
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+  auto reply = rh.route(req, McOperation<mc_op_set>());
+  EXPECT_EQ(mc_res_notstored, reply.result());
+  reply = rh.route(req, McOperation<mc_op_delete>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+  rh.route(req, McOperation<mc_op_incr>());
+
+  EXPECT_EQ(vector<mc_op_t>({mc_op_set, mc_op_delete, mc_op_incr}),
+            leaf->sawOperations);
+  EXPECT_EQ(vector<bool>({true, true, true}), leaf->sawNoreply);
+  /* the caller's request is left alone */
+  EXPECT_FALSE(req.noreply());
+}
+
+TEST(noreplyRouteTest, othersPassThrough) {
+  auto leaf = make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
+                                      UpdateRouteTestData(mc_res_stored));
+  NoreplyTestRoute rh(leaf->rh);
+
+  McRequest req("key");
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+  auto reply = rh.route(req, McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_found, reply.result());
+  EXPECT_EQ("a", toString(reply.value()));
+  reply = rh.route(req, McOperation<mc_op_cas>());
+  EXPECT_EQ(mc_res_stored, reply.result());
+  reply = rh.route(req, McOperation<mc_op_lease_set>());
+  EXPECT_EQ(mc_res_stored, reply.result());
+
+  EXPECT_EQ(vector<bool>({false, false, false}), leaf->sawNoreply);
+}
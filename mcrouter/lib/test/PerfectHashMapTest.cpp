@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/lib/PerfectHashMap.h"
+
+using namespace facebook::memcache;
+
+TEST(PerfectHashMap, empty) {
+  PerfectHashMap<int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.find("a") == map.end());
+  EXPECT_EQ(0, map.count(""));
+}
+
+TEST(PerfectHashMap, findsEveryKey) {
+  for (size_t n : {1, 2, 3, 7, 100, 5000}) {
+    std::vector<std::pair<std::string, size_t>> entries;
+    for (size_t i = 0; i < n; ++i) {
+      entries.emplace_back(folly::to<std::string>("/region", i, "/c/"), i);
+    }
+    PerfectHashMap<size_t> map(std::move(entries));
+    ASSERT_EQ(n, map.size());
+
+    for (size_t i = 0; i < n; ++i) {
+      auto it = map.find(folly::to<std::string>("/region", i, "/c/"));
+      ASSERT_TRUE(it != map.end());
+      EXPECT_EQ(i, it->second);
+    }
+    EXPECT_TRUE(map.find("/region/c/") == map.end());
+    EXPECT_TRUE(map.find(folly::to<std::string>("/region", n, "/c/")) ==
+                map.end());
+  }
+}
+
+TEST(PerfectHashMap, sortedIteration) {
+  PerfectHashMap<int> map({{"b", 2}, {"c", 3}, {"a", 1}});
+  std::vector<std::string> keys;
+  for (const auto& it : map) {
+    keys.push_back(it.first);
+  }
+  EXPECT_EQ((std::vector<std::string>{"a", "b", "c"}), keys);
+}
+
+TEST(PerfectHashMap, duplicateKey) {
+  EXPECT_THROW(PerfectHashMap<int>({{"a", 1}, {"a", 2}}), std::logic_error);
+}
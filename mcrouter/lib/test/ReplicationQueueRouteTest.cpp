@@ -0,0 +1,127 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/ReplicationQueueRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using ReplicationQueueTestRoute =
+  TestRouteHandle<ReplicationQueueRoute<TestRouteHandleIf>>;
+
+namespace {
+
+std::shared_ptr<TestHandle> makeHandle(mc_res_t updateResult) {
+  return make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
+                                 UpdateRouteTestData(updateResult),
+                                 DeleteRouteTestData(mc_res_deleted));
+}
+
+}  // anonymous namespace
+
+TEST(replicationQueueRouteTest, replicate) {
+  auto local = makeHandle(mc_res_stored);
+  auto remote = makeHandle(mc_res_stored);
+  ReplicationQueueTestRoute rh(local->rh, remote->rh, 100, 16, 0,
+                               std::chrono::milliseconds(0));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    rh.route(McRequest("get"), McOperation<mc_op_get>());
+    auto reply = rh.route(McRequest("set"), McOperation<mc_op_lease_set>());
+    EXPECT_EQ(mc_res_stored, reply.result());
+    rh.route(McRequest("delete"), McOperation<mc_op_delete>());
+  });
+
+  EXPECT_EQ(vector<string>({"get", "set", "delete"}), local->saw_keys);
+  EXPECT_EQ(vector<string>({"set", "delete"}), remote->saw_keys);
+  // lease-sets are replicated as sets
+  EXPECT_EQ(vector<mc_op_t>({mc_op_set, mc_op_delete}),
+            remote->sawOperations);
+}
+
+TEST(replicationQueueRouteTest, localFailure) {
+  auto local = makeHandle(mc_res_local_error);
+  auto remote = makeHandle(mc_res_stored);
+  ReplicationQueueTestRoute rh(local->rh, remote->rh, 100, 16, 0,
+                               std::chrono::milliseconds(0));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh.route(McRequest("set"), McOperation<mc_op_set>());
+    EXPECT_EQ(mc_res_local_error, reply.result());
+  });
+  EXPECT_TRUE(remote->saw_keys.empty());
+}
+
+TEST(replicationQueueRouteTest, localCasRejected) {
+  auto local = makeHandle(mc_res_exists);
+  auto remote = makeHandle(mc_res_stored);
+  ReplicationQueueTestRoute rh(local->rh, remote->rh, 100, 16, 0,
+                               std::chrono::milliseconds(0));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh.route(McRequest("cas"), McOperation<mc_op_cas>());
+    EXPECT_EQ(mc_res_exists, reply.result());
+  });
+  EXPECT_EQ(vector<string>({"cas"}), local->saw_keys);
+  EXPECT_TRUE(remote->saw_keys.empty());
+  EXPECT_EQ(0, rh.queueSize());
+}
+
+TEST(replicationQueueRouteTest, localLeaseSetRejected) {
+  auto local = makeHandle(mc_res_notstored);
+  auto remote = makeHandle(mc_res_stored);
+  ReplicationQueueTestRoute rh(local->rh, remote->rh, 100, 16, 0,
+                               std::chrono::milliseconds(0));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh.route(McRequest("lease"), McOperation<mc_op_lease_set>());
+    EXPECT_EQ(mc_res_notstored, reply.result());
+  });
+  EXPECT_EQ(vector<string>({"lease"}), local->saw_keys);
+  EXPECT_TRUE(remote->saw_keys.empty());
+  EXPECT_EQ(0, rh.queueSize());
+}
+
+TEST(replicationQueueRouteTest, queueFull) {
+  auto local = makeHandle(mc_res_stored);
+  auto remote = makeHandle(mc_res_stored);
+  ReplicationQueueTestRoute rh(local->rh, remote->rh, 2, 1, 0,
+                               std::chrono::milliseconds(0));
+
+  TestFiberManager fm;
+  remote->pause();
+  fm.run([&]() {
+    // "a" is in flight, "b" waits for it, "c" doesn't fit
+    rh.route(McRequest("a"), McOperation<mc_op_set>());
+    rh.route(McRequest("b"), McOperation<mc_op_set>());
+    rh.route(McRequest("c"), McOperation<mc_op_set>());
+    EXPECT_TRUE(remote->saw_keys.empty());
+    remote->unpause();
+  });
+
+  EXPECT_EQ(vector<string>({"a", "b", "c"}), local->saw_keys);
+  EXPECT_EQ(vector<string>({"a", "b"}), remote->saw_keys);
+}
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <folly/Benchmark.h>
+
+#include "mcrouter/lib/McReply.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+/* Roughly what a reply goes through on its way back to the client */
+const size_t kLayers = 6;
+
+McReply passThrough(McReply reply, size_t layersLeft) {
+  if (layersLeft == 0) {
+    return reply;
+  }
+  return passThrough(std::move(reply), layersLeft - 1);
+}
+
+void runMoves(McReply reply, size_t iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    reply = passThrough(std::move(reply), kLayers);
+  }
+  folly::doNotOptimizeAway(reply.result());
+}
+
+}  // anonymous namespace
+
+BENCHMARK(McReplyMoveTko, iters) {
+  runMoves(McReply(TkoReply), iters);
+}
+
+BENCHMARK(McReplyMoveHit, iters) {
+  McReply reply(mc_res_found, "value");
+  reply.setFlags(1);
+  runMoves(std::move(reply), iters);
+}
+
+BENCHMARK(McReplyMoveLeaseHit, iters) {
+  McReply reply(mc_res_found, "value");
+  reply.setLeaseToken(12345);
+  runMoves(std::move(reply), iters);
+}
+
+BENCHMARK(McReplyCreateMiss, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    McReply reply(mc_res_notfound);
+    folly::doNotOptimizeAway(reply.result());
+  }
+}
@@ -9,7 +9,9 @@
  */
 #include <iostream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -22,6 +24,7 @@
 #include "mcrouter/lib/McRequest.h"
 #include "mcrouter/lib/test/RouteHandleTestUtil.h"
 #include "mcrouter/lib/test/TestRequest.h"
+#include "mcrouter/lib/TypedRequest.h"
 
 using namespace facebook::memcache;
 
@@ -312,6 +315,75 @@ TEST(requestReply, requestWithRoute) {
   EXPECT_TRUE(mc_msg_num_outstanding() == 0);
 }
 
+TEST(requestReply, inlineKey) {
+  std::string longKey(McRequest::kMaxInlineKeySize + 1, 'a');
+  McRequest longReq(longKey);
+  EXPECT_EQ(longKey, longReq.fullKey());
+
+  McRequest req("/region/cluster/somekey:blah|#|non:hashed:part");
+  auto moved = std::move(req);
+  vector<McRequest> reqs;
+  reqs.push_back(std::move(moved));
+  reqs.push_back(reqs[0].clone());
+  reqs.push_back(McRequest(longKey));
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_EQ("/region/cluster/", reqs[i].routingPrefix());
+    EXPECT_EQ("somekey:blah", reqs[i].routingKey());
+    EXPECT_EQ("somekey:blah|#|non:hashed:part", reqs[i].keyWithoutRoute());
+    EXPECT_EQ("/region/cluster/somekey:blah|#|non:hashed:part",
+              toString(reqs[i].key()));
+  }
+
+  reqs[1].stripRoutingPrefix();
+  EXPECT_EQ("", reqs[1].routingPrefix());
+  EXPECT_EQ("somekey:blah", reqs[1].routingKey());
+  EXPECT_EQ("somekey:blah|#|non:hashed:part", reqs[1].fullKey());
+
+  /* From inline to IOBuf and back */
+  reqs[1].setKey(longKey);
+  EXPECT_EQ(longKey, reqs[1].fullKey());
+  reqs[1].setKey(reqs[1].fullKey().subpiece(0, 3));
+  EXPECT_EQ("aaa", reqs[1].fullKey());
+  reqs[1].setKey(reqs[1].fullKey().subpiece(1));
+  EXPECT_EQ("aa", reqs[1].routingKey());
+}
+
+TEST(requestReply, inlineKeyMoveAfterDependentMsg) {
+  mc_msg_track_num_outstanding(1);
+  {
+    vector<McRequest> reqs;
+    reqs.emplace_back("somekey");
+    /* msg_ now references the inline key of reqs[0] */
+    reqs[0].dependentMsg(mc_op_get);
+    McRequest moved(std::move(reqs[0]));
+    reqs[0] = McRequest("otherkey");
+    reqs[0].dependentMsg(mc_op_get);
+    McRequest assigned("overwritten");
+    assigned = std::move(reqs[0]);
+    reqs.clear();
+
+    auto msg = moved.dependentMsg(mc_op_get);
+    EXPECT_EQ("somekey", to<std::string>(msg->key));
+    EXPECT_EQ(moved.fullKey().data(), msg->key.str);
+    msg = assigned.dependentMsg(mc_op_get);
+    EXPECT_EQ("otherkey", to<std::string>(msg->key));
+  }
+  EXPECT_TRUE(mc_msg_num_outstanding() == 0);
+}
+
+TEST(requestReply, routingKeyDigest) {
+  McRequest req("/region/cluster/somekey:blah|#|non:hashed:part");
+  EXPECT_EQ(getMemcacheKeyDigest("somekey:blah"), req.routingKeyDigest());
+  EXPECT_EQ(getMemcacheKeyHashValue("somekey:blah"), req.routingKeyHash());
+
+  auto copy = req.clone();
+  EXPECT_EQ(req.routingKeyDigest(), copy.routingKeyDigest());
+
+  copy.setKey("otherkey");
+  EXPECT_EQ(getMemcacheKeyDigest("otherkey"), copy.routingKeyDigest());
+  EXPECT_EQ(getMemcacheKeyDigest("somekey:blah"), req.routingKeyDigest());
+}
+
 TEST(requestReply, replyBasic) {
   mc_msg_track_num_outstanding(1);
   {
@@ -357,6 +429,47 @@ TEST(requestReply, replyBasic) {
   EXPECT_TRUE(mc_msg_num_outstanding() == 0);
 }
 
+TEST(requestReply, replyExtension) {
+  /* Rare fields are out of line, the rest is about one IOBuf */
+  EXPECT_LE(sizeof(McReply),
+            sizeof(folly::Optional<folly::IOBuf>) + 4 * sizeof(uint64_t));
+
+  McReply reply(mc_res_found);
+  reply.setCas(0);
+  EXPECT_EQ(0, reply.cas());
+  reply.setCas(5);
+  reply.setLeaseToken(7);
+  EXPECT_EQ(5, reply.cas());
+  EXPECT_EQ(7, reply.leaseToken());
+  EXPECT_EQ(0, reply.delta());
+
+  McReply moved(std::move(reply));
+  EXPECT_EQ(5, moved.cas());
+  EXPECT_EQ(7, moved.leaseToken());
+}
+
+TEST(requestReply, replyMcMsgRareFields) {
+  mc_msg_track_num_outstanding(1);
+
+  {
+    auto mc_msg = createMcMsgRef("key", "value");
+    mc_msg->op = mc_op_get;
+    mc_msg->result = mc_res_found;
+    mc_msg->exptime = 10;
+    mc_msg->lease_id = 3;
+    auto raw = mc_msg.get();
+
+    McReply reply(mc_res_found, std::move(mc_msg));
+    EXPECT_EQ(10, reply.exptime());
+    EXPECT_EQ(3, reply.leaseToken());
+    /* Kept for exptime, so it can be released as is */
+    auto msg = reply.releasedMsg(mc_op_get);
+    EXPECT_TRUE(msg.get() == raw);
+  }
+
+  EXPECT_TRUE(mc_msg_num_outstanding() == 0);
+}
+
 TEST(requestReply, mutableReply) {
   { // msg_ == nullptr
     McReply r(mc_res_found);
@@ -395,7 +508,9 @@ TEST(requestReply, replyMcMsg) {
     EXPECT_TRUE(toString(reply.value()) == "value");
     auto msg = reply.releasedMsg(mc_op_get);
     auto msg_2 = reply.releasedMsg(mc_op_set);
-    EXPECT_TRUE(msg.get() == mc_msg);
+    /* mc_msg has no fields the reply doesn't copy out, so it's not kept */
+    EXPECT_TRUE(msg.get() != mc_msg);
+    EXPECT_TRUE(to<string>(msg->value) == "value");
     EXPECT_TRUE(msg_2.get() != nullptr);
     EXPECT_TRUE(msg_2.get() != mc_msg);
     EXPECT_TRUE(to<string>(msg_2->value) == "value");
@@ -504,3 +619,55 @@ TEST(requestReply, RequestMoveNoExcept) {
   vector <McRequest> req_vec;
   req_vec.push_back(std::move(req_b));
 }
+
+TEST(requestReply, typedRequest) {
+  static_assert(sizeof(TypedRequest<mc_op_get>) < sizeof(McRequest),
+                "typed get should be smaller than McRequest");
+  static_assert(sizeof(TypedRequest<mc_op_incr>) ==
+                sizeof(TypedRequest<mc_op_get>) + sizeof(uint64_t),
+                "typed incr should only add the delta");
+  static_assert(std::is_same<
+                  ReplyType<McOperation<mc_op_get>,
+                            TypedRequest<mc_op_get>>::type,
+                  McReply>::value,
+                "typed requests should get McReply");
+  EXPECT_TRUE(noexcept(TypedRequest<mc_op_get>(
+    std::declval<TypedRequest<mc_op_get>&&>())));
+
+  TypedRequest<mc_op_get> get("/region/cluster/key:1|#|blah");
+  get.setFlags(42);
+  EXPECT_EQ("/region/cluster/", get.routingPrefix());
+  EXPECT_EQ("key:1", get.routingKey());
+  EXPECT_EQ("key:1|#|blah", get.keyWithoutRoute());
+  EXPECT_EQ(McRequest("key:1").routingKeyHash(), get.routingKeyHash());
+
+  auto getClone = get.clone();
+  vector<TypedRequest<mc_op_get>> gets;
+  gets.push_back(std::move(get));
+  gets.push_back(std::move(getClone));
+  for (const auto& r : gets) {
+    EXPECT_EQ("key:1", r.routingKey());
+    EXPECT_EQ(42, r.flags());
+  }
+  gets[0].stripRoutingPrefix();
+  EXPECT_EQ("key:1|#|blah", gets[0].fullKey());
+  EXPECT_EQ("", gets[0].routingPrefix());
+  EXPECT_EQ("/region/cluster/key:1|#|blah", gets[1].fullKey());
+
+  TypedRequest<mc_op_incr> incr("counter");
+  incr.setDelta(5);
+  EXPECT_EQ(5, incr.clone().delta());
+
+  TypedRequest<mc_op_set> set("key");
+  set.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+  set.setExptime(10);
+  auto setClone = set.clone();
+  EXPECT_EQ("value", toString(setClone.value()));
+  EXPECT_EQ(set.value().data(), setClone.value().data());
+  EXPECT_EQ(10, setClone.exptime());
+
+  TypedRequest<mc_op_lease_set> leaseSet("key");
+  leaseSet.setLeaseToken(123);
+  leaseSet.setExptime(1);
+  EXPECT_EQ(123, leaseSet.clone().leaseToken());
+}
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/RetryBudget.h"
+
+using facebook::memcache::RetryBudget;
+
+using std::chrono::milliseconds;
+
+namespace {
+
+size_t retries(RetryBudget& budget, RetryBudget::Clock::time_point now,
+               size_t attempts) {
+  size_t allowed = 0;
+  for (size_t i = 0; i < attempts; ++i) {
+    if (budget.tryRetry(now)) {
+      ++allowed;
+    }
+  }
+  return allowed;
+}
+
+}  // anonymous namespace
+
+TEST(RetryBudget, ratioOfRequests) {
+  RetryBudget budget(10, 0, milliseconds(1000));
+  auto now = RetryBudget::Clock::now();
+  EXPECT_EQ(0, retries(budget, now, 5));
+
+  for (size_t i = 0; i < 100; ++i) {
+    budget.onRequest(now);
+  }
+  EXPECT_EQ(10, retries(budget, now, 50));
+
+  for (size_t i = 0; i < 50; ++i) {
+    budget.onRequest(now);
+  }
+  EXPECT_EQ(5, retries(budget, now, 50));
+}
+
+TEST(RetryBudget, minimumRate) {
+  RetryBudget budget(10, 5, milliseconds(2000));
+  auto now = RetryBudget::Clock::now();
+  EXPECT_EQ(10, retries(budget, now, 50));
+
+  for (size_t i = 0; i < 100; ++i) {
+    budget.onRequest(now);
+  }
+  EXPECT_EQ(10, retries(budget, now, 50));
+}
+
+TEST(RetryBudget, slidingWindow) {
+  RetryBudget budget(50, 0, milliseconds(1000));
+  auto now = RetryBudget::Clock::now();
+  for (size_t i = 0; i < 10; ++i) {
+    budget.onRequest(now);
+  }
+  EXPECT_EQ(5, retries(budget, now, 10));
+
+  /* still within the window */
+  now += milliseconds(500);
+  EXPECT_EQ(0, retries(budget, now, 10));
+
+  /* requests and retries expired together */
+  now += milliseconds(1000);
+  EXPECT_EQ(0, retries(budget, now, 10));
+  for (size_t i = 0; i < 4; ++i) {
+    budget.onRequest(now);
+  }
+  EXPECT_EQ(2, retries(budget, now, 10));
+}
@@ -65,6 +65,27 @@ TEST(routeHandleTest, error) {
   EXPECT_TRUE(reply.isError());
 }
 
+TEST(routeHandleTest, routesInline) {
+  /* Outside of any fiber */
+  TestRouteHandle<NullRoute<TestRouteHandleIf>> null;
+  TestRouteHandle<ErrorRoute<TestRouteHandleIf>> error;
+  EXPECT_TRUE(null.routesInline());
+  EXPECT_TRUE(error.routesInline());
+  EXPECT_FALSE(null.route(McRequest("key"),
+                          McOperation<mc_op_get>()).isError());
+  EXPECT_TRUE(error.route(McRequest("key"),
+                          McOperation<mc_op_get>()).isError());
+
+  /* Routes that don't say so may block */
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"))
+  };
+  TestRouteHandle<AllSyncRoute<TestRouteHandleIf>> rh(
+    get_route_handles(test_handles));
+  EXPECT_FALSE(rh.routesInline());
+  EXPECT_FALSE(test_handles[0]->rh->routesInline());
+}
+
 TEST(routeHandleTest, allSync) {
   vector<std::shared_ptr<TestHandle>> test_handles{
     make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
@@ -360,3 +381,40 @@ TEST(routeHandleTest, hashSalt) {
       EXPECT_TRUE(toString(reply.value()) == "a");
     });
 }
+
+TEST(routeHandleTest, hashBoundedLoad) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c")),
+  };
+
+  TestFiberManager fm;
+
+  TestRouteHandle<HashRoute<TestRouteHandleIf, HashFunc>> rh(
+    get_route_handles(test_handles),
+    /* salt= */ "",
+    HashFunc(test_handles.size()),
+    /* loadEpsilon= */ 0.5);
+
+  test_handles[0]->pause();
+
+  fm.runAll(
+    {
+      [&]() {
+        auto reply = rh.route(McRequest("0"), McOperation<mc_op_get>());
+        EXPECT_EQ("a", toString(reply.value()));
+      },
+      [&]() {
+        /* "a" has 1 request in flight, over 1.5 * 2 / 3 */
+        auto reply = rh.route(McRequest("3"), McOperation<mc_op_get>());
+        EXPECT_EQ("b", toString(reply.value()));
+        test_handles[0]->unpause();
+      }
+    });
+
+  fm.run([&]() {
+      auto reply = rh.route(McRequest("3"), McOperation<mc_op_get>());
+      EXPECT_EQ("a", toString(reply.value()));
+    });
+}
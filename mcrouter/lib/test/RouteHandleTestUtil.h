@@ -21,6 +21,7 @@
 #include "mcrouter/lib/IOBufUtil.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/RouteHandleLiveness.h"
 #include "mcrouter/lib/test/TestRouteHandle.h"
 
 namespace facebook { namespace memcache {
@@ -34,14 +35,20 @@ struct GetRouteTestData {
   mc_res_t result_;
   std::string value_;
   int64_t flags_;
+  uint64_t leaseToken_;
+  /* Remaining TTL, as meta protocol replies carry it */
+  uint32_t exptime_;
 
   GetRouteTestData() :
-    result_(mc_res_unknown), value_(std::string()), flags_(0) {
+    result_(mc_res_unknown), value_(std::string()), flags_(0),
+    leaseToken_(0), exptime_(0) {
   }
 
   GetRouteTestData(
-      mc_res_t result, const std::string& value, int64_t flags = 0) :
-    result_(result), value_(value), flags_(flags) {
+      mc_res_t result, const std::string& value, int64_t flags = 0,
+      uint64_t leaseToken = 0, uint32_t exptime = 0) :
+    result_(result), value_(value), flags_(flags), leaseToken_(leaseToken),
+    exptime_(exptime) {
   }
 };
 
@@ -78,10 +85,15 @@ struct TestHandle {
 
   std::vector<mc_op_t> sawOperations;
 
+  std::vector<bool> sawNoreply;
+
   bool isTko;
 
   bool isPaused;
 
+  /* See RouteHandleIf::knownDead() */
+  bool isDead{false};
+
   folly::Optional<FiberPromise<void>> promise_;
 
   explicit TestHandle(GetRouteTestData td)
@@ -124,6 +136,11 @@ struct TestHandle {
     isTko = false;
   }
 
+  void setDead(bool dead) {
+    isDead = dead;
+    bumpRouteLivenessEpoch();
+  }
+
   void pause() {
     isPaused = true;
   }
@@ -159,6 +176,10 @@ struct RecordingRoute {
   DeleteRouteTestData dataDelete_;
   TestHandle* h_;
 
+  bool knownDead() const {
+    return h_->isDead;
+  }
+
   RecordingRoute(GetRouteTestData g_td,
                  UpdateRouteTestData u_td,
                  DeleteRouteTestData d_td,
@@ -183,10 +204,14 @@ struct RecordingRoute {
     }
     h_->sawOperations.push_back((mc_op_t) M);
     h_->sawExptimes.push_back(req.exptime());
+    h_->sawNoreply.push_back(req.noreply());
     if (GetLike<McOperation<M>>::value) {
       auto msg = createMcMsgRef(req.fullKey(), dataGet_.value_);
       msg->flags = dataGet_.flags_;
-      return McReply(dataGet_.result_, std::move(msg));
+      msg->exptime = dataGet_.exptime_;
+      McReply reply(dataGet_.result_, std::move(msg));
+      reply.setLeaseToken(dataGet_.leaseToken_);
+      return reply;
     }
     if (UpdateLike<McOperation<M>>::value) {
       auto val = req.value().clone();
@@ -220,6 +245,9 @@ class TestFiberManager {
   TestFiberManager()
       : fm_(folly::make_unique<SimpleLoopController>()) {}
 
+  explicit TestFiberManager(FiberManager::Options opts)
+      : fm_(folly::make_unique<SimpleLoopController>(), opts) {}
+
   void run(std::function<void()>&& fun) {
     runAll({std::move(fun)});
   }
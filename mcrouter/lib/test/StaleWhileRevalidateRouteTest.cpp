@@ -0,0 +1,185 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/StaleWhileRevalidateRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using SwrRoute = StaleWhileRevalidateRoute<TestRouteHandleIf>;
+
+namespace {
+
+string envelope(const string& value, uint32_t softExptime) {
+  return toString(
+    SwrRoute::wrap(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value),
+                   softExptime));
+}
+
+uint32_t now() {
+  return time(nullptr);
+}
+
+McRequest setRequest(const string& key, const string& value,
+                     uint32_t exptime) {
+  McRequest req(key);
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value));
+  req.setExptime(exptime);
+  return req;
+}
+
+}  // anonymous namespace
+
+TEST(staleWhileRevalidateRouteTest, updatesAreWrapped) {
+  auto leaf = make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored));
+  SwrRoute rh(leaf->rh, std::chrono::seconds(30),
+              std::chrono::milliseconds(1000));
+
+  auto start = now();
+  auto reply = rh.route(setRequest("key", "value", 10),
+                        McOperation<mc_op_set>());
+  EXPECT_EQ(mc_res_stored, reply.result());
+  ASSERT_EQ(1, leaf->sawValues.size());
+  EXPECT_EQ(40, leaf->sawExptimes[0]);
+  auto stored = leaf->sawValues[0];
+  ASSERT_EQ(SwrRoute::kEnvelopeSize + 5, stored.size());
+  EXPECT_EQ("value", stored.substr(SwrRoute::kEnvelopeSize));
+  EXPECT_TRUE(stored == envelope("value", start + 10) ||
+              stored == envelope("value", now() + 10));
+
+  /* no expiry, nothing to revalidate */
+  rh.route(setRequest("key", "value", 0), McOperation<mc_op_set>());
+  EXPECT_EQ("value", leaf->sawValues[1]);
+  EXPECT_EQ(0, leaf->sawExptimes[1]);
+
+  /* absolute exptime */
+  rh.route(setRequest("key", "value", start + 100), McOperation<mc_op_add>());
+  EXPECT_EQ(envelope("value", start + 100), leaf->sawValues[2]);
+  EXPECT_EQ(start + 130, leaf->sawExptimes[2]);
+}
+
+TEST(staleWhileRevalidateRouteTest, freshHit) {
+  auto leaf = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, envelope("value", now() + 100),
+                     SwrRoute::kEnvelopeFlag | 7));
+  SwrRoute rh(leaf->rh, std::chrono::seconds(30),
+              std::chrono::milliseconds(1000));
+
+  for (int i = 0; i < 2; ++i) {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("value", toString(reply.value()));
+    EXPECT_EQ(7, reply.flags());
+  }
+  EXPECT_EQ(0, rh.refreshesInProgress());
+}
+
+TEST(staleWhileRevalidateRouteTest, oneGetRefreshes) {
+  auto leaf = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, envelope("value", now() - 1),
+                     SwrRoute::kEnvelopeFlag),
+    UpdateRouteTestData(mc_res_stored),
+    DeleteRouteTestData(mc_res_deleted));
+  SwrRoute rh(leaf->rh, std::chrono::seconds(30),
+              std::chrono::milliseconds(60000));
+
+  auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+  EXPECT_EQ(1, rh.refreshesInProgress());
+
+  /* everyone else gets the stale value */
+  for (int i = 0; i < 3; ++i) {
+    reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("value", toString(reply.value()));
+    EXPECT_EQ(0, reply.flags());
+  }
+
+  /* the refresh ends with the update */
+  rh.route(setRequest("key", "new", 10), McOperation<mc_op_set>());
+  EXPECT_EQ(0, rh.refreshesInProgress());
+  reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+}
+
+TEST(staleWhileRevalidateRouteTest, refreshTimeout) {
+  auto leaf = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, envelope("value", now() - 1),
+                     SwrRoute::kEnvelopeFlag));
+  SwrRoute rh(leaf->rh, std::chrono::seconds(30),
+              std::chrono::milliseconds(1));
+
+  auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+  usleep(5000);
+  reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+}
+
+TEST(staleWhileRevalidateRouteTest, leaseGetRefreshes) {
+  auto leaf = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, envelope("value", now() - 1),
+                     SwrRoute::kEnvelopeFlag),
+    UpdateRouteTestData(mc_res_stored),
+    DeleteRouteTestData(mc_res_deleted));
+  SwrRoute rh(leaf->rh, std::chrono::seconds(30),
+              std::chrono::milliseconds(60000));
+
+  auto reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+  auto token = reply.leaseToken();
+  EXPECT_GT(token, 1);
+
+  reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+  EXPECT_EQ(mc_res_found, reply.result());
+  EXPECT_EQ("value", toString(reply.value()));
+  EXPECT_EQ(0, reply.leaseToken());
+
+  /* somebody else's lease goes to the target as is */
+  auto req = setRequest("key", "other", 10);
+  req.setLeaseToken(token + 1);
+  rh.route(req, McOperation<mc_op_lease_set>());
+  EXPECT_EQ(mc_op_lease_set, leaf->sawOperations.back());
+
+  req = setRequest("key", "new", 10);
+  req.setLeaseToken(token);
+  reply = rh.route(req, McOperation<mc_op_lease_set>());
+  EXPECT_EQ(mc_res_stored, reply.result());
+  EXPECT_EQ(mc_op_set, leaf->sawOperations.back());
+  EXPECT_EQ("new", leaf->sawValues.back().substr(SwrRoute::kEnvelopeSize));
+  EXPECT_EQ(0, rh.refreshesInProgress());
+}
+
+TEST(staleWhileRevalidateRouteTest, shortValueIsMiss) {
+  auto leaf = make_shared<TestHandle>(
+    GetRouteTestData(mc_res_found, "ab", SwrRoute::kEnvelopeFlag));
+  SwrRoute rh(leaf->rh, std::chrono::seconds(30),
+              std::chrono::milliseconds(1000));
+
+  auto reply = rh.route(McRequest("key"), McOperation<mc_op_gets>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+}
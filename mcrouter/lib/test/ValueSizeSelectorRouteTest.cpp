@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/ValueSizeSelectorRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+
+using namespace facebook::memcache;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using TestValueSizeSelectorRoute =
+  TestRouteHandle<ValueSizeSelectorRoute<TestRouteHandleIf>>;
+
+namespace {
+
+vector<std::shared_ptr<TestHandle>> makeHandles(mc_res_t smallGet,
+                                                mc_res_t largeGet) {
+  return {
+    make_shared<TestHandle>(GetRouteTestData(smallGet, "small"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_notfound)),
+    make_shared<TestHandle>(GetRouteTestData(largeGet, "large"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+  };
+}
+
+McRequest makeRequest(size_t valueSize) {
+  McRequest req("key");
+  req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER,
+                            string(valueSize, 'x')));
+  return req;
+}
+
+/* the second handle gets values from 100 bytes on */
+vector<std::pair<size_t, std::shared_ptr<TestRouteHandleIf>>> sizePolicies(
+    const vector<std::shared_ptr<TestHandle>>& handles) {
+  vector<std::pair<size_t, std::shared_ptr<TestRouteHandleIf>>> policies;
+  policies.emplace_back(100, handles[1]->rh);
+  return policies;
+}
+
+}  // anonymous namespace
+
+TEST(valueSizeSelectorRouteTest, updatesBySize) {
+  auto handles = makeHandles(mc_res_found, mc_res_found);
+  TestValueSizeSelectorRoute rh(handles[0]->rh, sizePolicies(handles));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh.route(makeRequest(99), McOperation<mc_op_set>());
+    EXPECT_EQ(mc_res_stored, reply.result());
+  });
+  fm.run([&]() {
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_set }), handles[0]->sawOperations);
+    /* the other size class forgets the key */
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_delete }), handles[1]->sawOperations);
+
+    rh.route(makeRequest(100), McOperation<mc_op_set>());
+  });
+  fm.run([&]() {
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_set, mc_op_delete }),
+              handles[0]->sawOperations);
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_delete, mc_op_set }),
+              handles[1]->sawOperations);
+
+    /* leases are only valid where they were issued */
+    rh.route(makeRequest(1000), McOperation<mc_op_lease_set>());
+    EXPECT_EQ(mc_op_lease_set, handles[0]->sawOperations.back());
+  });
+}
+
+TEST(valueSizeSelectorRouteTest, getMissFailover) {
+  auto handles = makeHandles(mc_res_notfound, mc_res_found);
+  TestValueSizeSelectorRoute rh(handles[0]->rh, sizePolicies(handles));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ("large", toString(reply.value()));
+
+    reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+    EXPECT_EQ(mc_res_notfound, reply.result());
+  });
+  EXPECT_EQ((vector<mc_op_t>{ mc_op_get, mc_op_lease_get }),
+            handles[0]->sawOperations);
+  EXPECT_EQ((vector<mc_op_t>{ mc_op_get }), handles[1]->sawOperations);
+}
+
+TEST(valueSizeSelectorRouteTest, noMissFailover) {
+  auto handles = makeHandles(mc_res_notfound, mc_res_found);
+  TestValueSizeSelectorRoute rh(handles[0]->rh, sizePolicies(handles),
+                                /* missFailover= */ false);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_notfound, reply.result());
+  });
+  EXPECT_TRUE(handles[1]->sawOperations.empty());
+}
+
+TEST(valueSizeSelectorRouteTest, deleteEverywhere) {
+  auto handles = makeHandles(mc_res_found, mc_res_found);
+  TestValueSizeSelectorRoute rh(handles[0]->rh, sizePolicies(handles));
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    /* found in one size class only */
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_delete>());
+    EXPECT_EQ(mc_res_deleted, reply.result());
+  });
+  EXPECT_EQ((vector<mc_op_t>{ mc_op_delete }), handles[0]->sawOperations);
+  EXPECT_EQ((vector<mc_op_t>{ mc_op_delete }), handles[1]->sawOperations);
+}
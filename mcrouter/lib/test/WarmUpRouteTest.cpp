@@ -91,3 +91,62 @@ TEST(warmUpRouteTest, warmUp) {
 
 
 }
+
+TEST(warmUpRouteTest, oneFillPerKey) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_notfound)),
+  };
+  auto route_handles = get_route_handles(test_handles);
+  TestRouteHandle<WarmUpRoute<TestRouteHandleIf,
+                              McOperation<mc_op_add>>> rh(
+    route_handles[0], route_handles[1], 1);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    /* the first fill didn't start yet */
+    auto reply1 = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    auto reply2 = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ("a", toString(reply1.value()));
+    EXPECT_EQ("a", toString(reply2.value()));
+  });
+  fm.run([&]() {
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_get, mc_op_get, mc_op_add }),
+              test_handles[1]->sawOperations);
+    test_handles[1]->sawOperations.clear();
+
+    /* the fill is done, the key can be filled again */
+    rh.route(McRequest("key"), McOperation<mc_op_get>());
+  });
+  fm.run([&]() {
+    EXPECT_EQ((vector<mc_op_t>{ mc_op_get, mc_op_add }),
+              test_handles[1]->sawOperations);
+  });
+}
+
+TEST(warmUpRouteTest, fillKeepsWarmTtl) {
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a", 0, 0, 20),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, ""),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_notfound)),
+  };
+  auto route_handles = get_route_handles(test_handles);
+  TestRouteHandle<WarmUpRoute<TestRouteHandleIf,
+                              McOperation<mc_op_add>>> rh(
+    route_handles[0], route_handles[1], 1);
+
+  TestFiberManager fm;
+  fm.run([&]() {
+    rh.route(McRequest("key"), McOperation<mc_op_get>());
+  });
+  fm.run([&]() {
+    EXPECT_EQ((vector<uint32_t>{0, 20}), test_handles[1]->sawExptimes);
+  });
+}
@@ -114,3 +114,16 @@ TEST(WeightedCh3HashFunc, randomWeights) {
     {1016, 1252, 288, 2354, 661, 195, 247, 122, 1668, 2197}) ==
     wch3_counts);
 }
+
+/* The key digest gives the same indices as the key, salted retries too */
+TEST(WeightedCh3HashFunc, digest) {
+  WeightedCh3HashFunc func({0.429, 0.541, 0.117, 0.998, 0.283});
+  Ch3HashFunc ch3(5);
+
+  for (size_t i = 0; i < 1000; ++i) {
+    auto key = folly::to<std::string>(i);
+    FurcDigest digest{furc_key_digest(key.data(), key.size())};
+    EXPECT_EQ(func(key), func(key, digest));
+    EXPECT_EQ(ch3(key), ch3(key, digest));
+  }
+}
@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/WeightedMaglevHashFunc.h"
+
+using namespace facebook::memcache;
+
+namespace {
+
+std::vector<size_t> countKeys(const WeightedMaglevHashFunc& func,
+                              size_t numKeys) {
+  std::vector<size_t> counts(func.weights().size(), 0);
+  for (size_t i = 0; i < numKeys; ++i) {
+    ++counts[func(folly::to<std::string>("key:", i))];
+  }
+  return counts;
+}
+
+}  // anonymous namespace
+
+TEST(WeightedMaglevHashFunc, proportionalToWeights) {
+  WeightedMaglevHashFunc func({1.0, 1.0, 0.5, 0.0});
+
+  auto counts = countKeys(func, 100000);
+  EXPECT_NEAR(40000, counts[0], 2000);
+  EXPECT_NEAR(40000, counts[1], 2000);
+  EXPECT_NEAR(20000, counts[2], 2000);
+  EXPECT_EQ(0, counts[3]);
+}
+
+/* All zero weights -> every server is used */
+TEST(WeightedMaglevHashFunc, zeroWeights) {
+  WeightedMaglevHashFunc func_1({0.0});
+  EXPECT_EQ(0, func_1("sample"));
+  EXPECT_EQ(0, func_1(""));
+
+  WeightedMaglevHashFunc func_2({0.0, 0.0});
+  auto counts = countKeys(func_2, 10000);
+  EXPECT_NEAR(5000, counts[0], 500);
+  EXPECT_NEAR(5000, counts[1], 500);
+}
+
+/* Reducing one weight moves few keys between the other servers */
+TEST(WeightedMaglevHashFunc, reducedWeight) {
+  WeightedMaglevHashFunc func({1.0, 1.0, 0.5});
+  WeightedMaglevHashFunc funcReduced({1.0, 1.0, 0.4});
+
+  size_t moved = 0;
+  size_t movedBetweenOthers = 0;
+  const size_t kNumKeys = 100000;
+  for (size_t i = 0; i < kNumKeys; ++i) {
+    auto key = folly::to<std::string>("key:", i);
+    auto before = func(key);
+    auto after = funcReduced(key);
+    if (before != after) {
+      ++moved;
+      if (before != 2) {
+        ++movedBetweenOthers;
+      }
+    }
+  }
+
+  /* Ideally 20% - 16.7% = 3.3% of the keys move, all of them from server 2 */
+  EXPECT_LT(moved, kNumKeys * 5 / 100);
+  EXPECT_LT(movedBetweenOthers, kNumKeys / 100);
+}
+
+TEST(WeightedMaglevHashFunc, sharedTable) {
+  WeightedMaglevHashFunc func({1.0, 0.3});
+  WeightedMaglevHashFunc sameWeights({1.0, 0.3});
+
+  EXPECT_EQ(func.tableSize(), sameWeights.tableSize());
+  for (size_t i = 0; i < 1000; ++i) {
+    auto key = folly::to<std::string>(i);
+    EXPECT_EQ(func(key), sameWeights(key));
+  }
+}
+
+TEST(WeightedMaglevHashFunc, keyDigest) {
+  WeightedMaglevHashFunc func({1.0, 0.5, 0.7});
+
+  for (size_t i = 0; i < 1000; ++i) {
+    auto key = folly::to<std::string>(i);
+    EXPECT_EQ(func(key), func(key, getMemcacheKeyDigest(key)));
+  }
+}
+
+TEST(WeightedMaglevHashFunc, tableSize) {
+  WeightedMaglevHashFunc func_100(std::vector<double>(100, 1.0));
+  EXPECT_GE(func_100.tableSize(),
+            100 * WeightedMaglevHashFunc::kSlotsPerServer);
+
+  WeightedMaglevHashFunc func_10000(std::vector<double>(10000, 1.0));
+  EXPECT_GE(func_10000.tableSize(), WeightedMaglevHashFunc::kMaxTableSize);
+  EXPECT_LT(func_10000.tableSize(),
+            WeightedMaglevHashFunc::kMaxTableSize + 1000);
+}
+
+TEST(WeightedMaglevHashFunc, invalidWeight) {
+  EXPECT_THROW(WeightedMaglevHashFunc({1.0, 1.5}), std::logic_error);
+  EXPECT_THROW(WeightedMaglevHashFunc(std::vector<double>()),
+               std::logic_error);
+}
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/**
+ * Memcache load generator, see LoadGenerator.
+ *
+ *   mcrouter_loadgen [OPTIONS] HOST:PORT
+ *
+ * prints the number of requests, replies by result and latency
+ * histograms (per operation and in total) at the end of the run,
+ * as JSON with --json.
+ */
+
+#include <getopt.h>
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/LoadGenerator.h"
+
+using facebook::memcache::mcrouter::LoadGenerator;
+
+namespace {
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [OPTIONS] HOST:PORT\n"
+          "\n"
+          "Options:\n"
+          "  --rate N             requests per second over all threads,\n"
+          "                       0 is closed loop (0)\n"
+          "  --fixed-intervals    open loop: evenly spaced requests rather\n"
+          "                       than Poisson arrivals\n"
+          "  --max-in-flight N    open loop: requests in flight per thread\n"
+          "                       (10000)\n"
+          "  --concurrency N      closed loop: requests in flight per\n"
+          "                       connection (1)\n"
+          "  --threads N          (1)\n"
+          "  --connections N      connections per thread (1)\n"
+          "  --protocol P         ascii or umbrella (ascii)\n"
+          "  --duration-s N       measured length of the run (10)\n"
+          "  --warmup-s N         unmeasured load before that (0)\n"
+          "  --timeout-ms N       timeout of one request (1000)\n"
+          "  --keys N             number of distinct keys (100000)\n"
+          "  --key-prefix S       (loadgen:)\n"
+          "  --key-dist D         uniform, zipf:S or hotset:F:P (uniform)\n"
+          "  --value-size D       N, uniform:MIN:MAX or\n"
+          "                       lognormal:MEDIAN:SIGMA (100)\n"
+          "  --ops MIX            weighted get, set and delete\n"
+          "                       (get:90,set:10)\n"
+          "  --seed N             random seed (0)\n"
+          "  --json               print results as JSON\n",
+          argv0);
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  enum {
+    kRate = 256,
+    kFixedIntervals,
+    kMaxInFlight,
+    kConcurrency,
+    kThreads,
+    kConnections,
+    kProtocol,
+    kDurationS,
+    kWarmupS,
+    kTimeoutMs,
+    kKeys,
+    kKeyPrefix,
+    kKeyDist,
+    kValueSize,
+    kOps,
+    kSeed,
+    kJson,
+    kHelp,
+  };
+  static const struct option longOptions[] = {
+    {"rate", required_argument, nullptr, kRate},
+    {"fixed-intervals", no_argument, nullptr, kFixedIntervals},
+    {"max-in-flight", required_argument, nullptr, kMaxInFlight},
+    {"concurrency", required_argument, nullptr, kConcurrency},
+    {"threads", required_argument, nullptr, kThreads},
+    {"connections", required_argument, nullptr, kConnections},
+    {"protocol", required_argument, nullptr, kProtocol},
+    {"duration-s", required_argument, nullptr, kDurationS},
+    {"warmup-s", required_argument, nullptr, kWarmupS},
+    {"timeout-ms", required_argument, nullptr, kTimeoutMs},
+    {"keys", required_argument, nullptr, kKeys},
+    {"key-prefix", required_argument, nullptr, kKeyPrefix},
+    {"key-dist", required_argument, nullptr, kKeyDist},
+    {"value-size", required_argument, nullptr, kValueSize},
+    {"ops", required_argument, nullptr, kOps},
+    {"seed", required_argument, nullptr, kSeed},
+    {"json", no_argument, nullptr, kJson},
+    {"help", no_argument, nullptr, kHelp},
+    {nullptr, 0, nullptr, 0},
+  };
+
+  LoadGenerator::Options opts;
+  bool json = false;
+  try {
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+      switch (c) {
+        case kRate:
+          opts.rate = folly::to<double>(optarg);
+          break;
+        case kFixedIntervals:
+          opts.poisson = false;
+          break;
+        case kMaxInFlight:
+          opts.maxInFlightPerThread = folly::to<size_t>(optarg);
+          break;
+        case kConcurrency:
+          opts.concurrency = folly::to<size_t>(optarg);
+          break;
+        case kThreads:
+          opts.threads = folly::to<size_t>(optarg);
+          break;
+        case kConnections:
+          opts.connectionsPerThread = folly::to<size_t>(optarg);
+          break;
+        case kProtocol:
+          opts.protocol = mc_string_to_protocol(optarg);
+          if (opts.protocol != mc_ascii_protocol &&
+              opts.protocol != mc_umbrella_protocol) {
+            fprintf(stderr, "unknown protocol %s\n", optarg);
+            return 1;
+          }
+          break;
+        case kDurationS:
+          opts.duration = std::chrono::milliseconds(
+            static_cast<int64_t>(folly::to<double>(optarg) * 1000));
+          break;
+        case kWarmupS:
+          opts.warmup = std::chrono::milliseconds(
+            static_cast<int64_t>(folly::to<double>(optarg) * 1000));
+          break;
+        case kTimeoutMs:
+          opts.timeout = std::chrono::milliseconds(folly::to<int64_t>(optarg));
+          break;
+        case kKeys:
+          opts.numKeys = folly::to<size_t>(optarg);
+          break;
+        case kKeyPrefix:
+          opts.keyPrefix = optarg;
+          break;
+        case kKeyDist:
+          opts.keyDistribution = optarg;
+          break;
+        case kValueSize:
+          opts.valueSize = optarg;
+          break;
+        case kOps:
+          opts.operations = optarg;
+          break;
+        case kSeed:
+          opts.seed = folly::to<uint64_t>(optarg);
+          break;
+        case kJson:
+          json = true;
+          break;
+        case kHelp:
+          usage(argv[0]);
+          return 0;
+        default:
+          usage(argv[0]);
+          return 1;
+      }
+    }
+  } catch (const std::exception& e) {
+    fprintf(stderr, "invalid option value: %s\n", e.what());
+    return 1;
+  }
+
+  if (optind + 1 != argc) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string hostPort(argv[optind]);
+  auto colon = hostPort.rfind(':');
+  if (colon == std::string::npos) {
+    usage(argv[0]);
+    return 1;
+  }
+  try {
+    opts.host = hostPort.substr(0, colon);
+    opts.port = folly::to<uint16_t>(hostPort.substr(colon + 1));
+  } catch (const std::exception& e) {
+    fprintf(stderr, "invalid port: %s\n", e.what());
+    return 1;
+  }
+
+  try {
+    LoadGenerator loadGenerator(std::move(opts));
+    auto results = loadGenerator.run();
+    auto out = json ? results.toJson() + "\n" : results.toString();
+    fputs(out.c_str(), stdout);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
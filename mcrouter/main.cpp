@@ -25,11 +25,14 @@
 #include <time.h>
 
 #include <algorithm>
+#include <chrono>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <glog/logging.h>
@@ -41,6 +44,7 @@
 
 #include "mcrouter/async.h"
 #include "mcrouter/config.h"
+#include "mcrouter/ConfigValidator.h"
 #include "mcrouter/flavor.h"
 #include "mcrouter/lib/fbi/error.h"
 #include "mcrouter/lib/fbi/fb_cpu_util.h"
@@ -74,8 +78,9 @@ static int pidfile_fd;
 static void print_usage_and_die(char* progname, int errorCode) {
 
   fprintf(stderr, "%s\n"
-          "usage: %s [options] -p port(s) -f config\n\n",
-          MCROUTER_PACKAGE_STRING, progname);
+          "usage: %s [options] -p port(s) -f config\n"
+          "       %s [options] --validate-config [flavor...]\n\n",
+          MCROUTER_PACKAGE_STRING, progname, progname);
 
   fprintf(stderr, "libmcrouter options:\n");
 
@@ -114,7 +119,8 @@ static void print_usage_and_die(char* progname, int errorCode) {
   print_usage("-V, --version", "version");
   print_usage("-v, --verbose", "verbose");
   print_usage("    --validate-config", "Check config and exit immediately"
-              " with good or error status");
+              " with good or error status. Several flavors may be given,"
+              " they are checked in parallel");
 
   fprintf(stderr, "\nRETURN VALUE\n");
   print_usage("2", "On a problem that might be resolved by restarting later.");
@@ -175,7 +181,7 @@ static void parse_options(int argc,
                           unordered_map<string, string>& standalone_option_dict,
                           unordered_set<string>& unrecognized_options,
                           int* validate_configs,
-                          string* flavor) {
+                          vector<string>* flavors) {
 
   vector<option> long_options = {
     { "debug",                       0, nullptr, 'd'},
@@ -319,12 +325,12 @@ static void parse_options(int argc,
   standalone_option_dict["debug_level"] = std::to_string(debug_level);
 
   /* getopt permutes argv so that all non-options are at the end.
-     For now we only expect one non-option argument, so look at the last one. */
-  *flavor = string();
-  if (optind < argc && argv[optind]) {
-    *flavor = string(argv[optind]);
+     Only --validate-config expects more than one of them. */
+  flavors->clear();
+  for (int i = optind; i < argc && argv[i]; ++i) {
+    flavors->emplace_back(argv[i]);
   }
-  if (optind + 1 < argc) {
+  if (flavors->size() > 1 && !*validate_configs) {
     LOG(ERROR) << "Expected only one non-option argument";
   }
 }
@@ -472,6 +478,54 @@ void notify_command_line(int argc, char ** argv) {
   free(cmd_line);
 }
 
+/**
+ * Options of another flavor given to --validate-config, with the same
+ * command line options on top as for the first one.
+ */
+static bool read_flavor_options(
+    const string& flavor,
+    const unordered_map<string, string>& cmdline_option_dict,
+    McrouterOptions& flavorOpts) {
+  unordered_map<string, string> option_dict, st_option_dict;
+  if (!read_standalone_flavor(flavor, option_dict, st_option_dict)) {
+    return false;
+  }
+  for (auto& it : cmdline_option_dict) {
+    option_dict[it.first] = it.second;
+  }
+  auto errors = flavorOpts.updateFromDict(option_dict);
+  for (auto& e : errors) {
+    LOG(ERROR) << flavor << ": option parse error: " << e.requestedName
+               << "=" << e.requestedValue << ", " << e.errorMsg;
+  }
+  flavorOpts.standalone = 1;
+  flavorOpts.service_name = "mcrouter";
+  return errors.empty();
+}
+
+/**
+ * Builds the configs of all flavors at once, one per thread, and logs
+ * build time and memory of each.
+ *
+ * @return  exit status
+ */
+static int validate_flavors(
+    const vector<std::pair<string, McrouterOptions>>& flavors) {
+  auto results = validateConfigs(flavors, std::thread::hardware_concurrency());
+  int status = 0;
+  for (const auto& result : results) {
+    if (result.valid) {
+      LOG(INFO) << result.name << ": valid, built in "
+                << result.buildTime.count() / 1000.0 << " ms using "
+                << result.memoryBytes << " bytes";
+    } else {
+      LOG(ERROR) << result.name << ": invalid config: " << result.error;
+      status = EXIT_STATUS_TRANSIENT_ERROR;
+    }
+  }
+  return status;
+}
+
 void on_assert_fail(const char *msg) {
   logFailure(failure::Category::kBrokenLogic, msg);
 }
@@ -485,10 +539,11 @@ int main(int argc, char **argv) {
     cmdline_option_dict, cmdline_st_option_dict;
   unordered_set<string> unrecognized_options;
   int validate_configs = 0;
-  std::string flavor;
+  vector<string> flavors;
 
   parse_options(argc, argv, cmdline_option_dict, cmdline_st_option_dict,
-                unrecognized_options, &validate_configs, &flavor);
+                unrecognized_options, &validate_configs, &flavors);
+  auto flavor = flavors.empty() ? string() : flavors[0];
 
   if (flavor.empty()) {
     option_dict = cmdline_option_dict;
@@ -587,6 +642,8 @@ int main(int argc, char **argv) {
 
   if (validate_configs) {
     failure::addHandler(failure::handlers::throwLogicError());
+    /* every failure has to throw, none may be dropped */
+    failure::setRateLimit(0, std::chrono::seconds(1));
   }
 
   if (standaloneOpts.pidfile != "") {
@@ -629,6 +686,22 @@ int main(int argc, char **argv) {
     opts.router_name = port_str.c_str();
   }
 
+  if (validate_configs) {
+    /* Only validating config, no need to start a router */
+    vector<std::pair<string, McrouterOptions>> configs;
+    auto name = !flavor.empty() ? flavor :
+      !opts.config_file.empty() ? opts.config_file : string("config_str");
+    configs.emplace_back(std::move(name), opts);
+    for (size_t i = 1; i < flavors.size(); ++i) {
+      McrouterOptions flavorOpts;
+      if (!read_flavor_options(flavors[i], cmdline_option_dict, flavorOpts)) {
+        exit(EXIT_STATUS_UNRECOVERABLE_ERROR);
+      }
+      configs.emplace_back(flavors[i], std::move(flavorOpts));
+    }
+    _exit(validate_flavors(configs));
+  }
+
   /*
    * We know that mc_msg_t's are guaranteed to
    * only ever be used by one thread, so disable
@@ -640,9 +713,6 @@ int main(int argc, char **argv) {
   if (router == nullptr) {
     LOG(ERROR) << "CRITICAL: Failed to initialize mcrouter!";
     exit(EXIT_STATUS_TRANSIENT_ERROR);
-  } else if (validate_configs) {
-    /* Only validating config, exit with good status immediately */
-    _exit(0);
   }
 
   set_standalone_args(commandArgs);
@@ -66,6 +66,24 @@ mcrouter_option_toggle(
   "use-asynclog-version2", no_short,
   "Enable using the asynclog version 2.0")
 
+mcrouter_option_toggle(
+  asynclog_batch, false,
+  "asynclog-batch", no_short,
+  "Spool failed deletes in the binary asynclog format without waiting for"
+  " the disk. Records are written in batches once per event loop iteration"
+  " (see mcrouter_asynclog_replay to convert them to the text format)")
+
+mcrouter_option_integer(
+  size_t, asynclog_batch_max_pending_bytes, 64 * 1024 * 1024,
+  "asynclog-batch-max-pending-bytes", no_short,
+  "With --asynclog-batch, drop failed deletes of a proxy while it has"
+  " this many bytes of records waiting to be written")
+
+mcrouter_option_toggle(
+  asynclog_batch_fdatasync, true,
+  "asynclog-batch-fdatasync", no_short,
+  "With --asynclog-batch, fdatasync() the spool file after each batch write")
+
 mcrouter_option_toggle(
   asynclog_route_name, false,
   no_long, no_short,
@@ -76,6 +94,56 @@ mcrouter_option_integer(
   "num-proxies", no_short,
   "adjust how many proxy threads to run")
 
+mcrouter_option_integer(
+  size_t, max_proxies, 0,
+  "max-proxies", no_short,
+  "If greater than num_proxies, embedded routers running their own proxy"
+  " threads may be resized up to this many proxies at runtime (see"
+  " McrouterInstance::resizeProxies())")
+
+mcrouter_option_integer(
+  size_t, proxy_request_ring_size, 0,
+  "proxy-request-ring-size", no_short,
+  "If nonzero, clients hand requests to proxy threads through a lock-free"
+  " ring of this many entries (rounded up to a power of two) instead of"
+  " asox queue. Clients block while the ring is full.")
+
+mcrouter_option_integer(
+  size_t, proxy_request_ring_batch, 128,
+  "proxy-request-ring-batch", no_short,
+  "Maximum number of entries taken from the proxy request ring"
+  " per event loop iteration")
+
+mcrouter_option_toggle(
+  proxy_key_affinity, false,
+  "proxy-key-affinity", no_short,
+  "If enabled (and num-proxies > 1), each proxy forwards requests to the"
+  " proxy that owns the key (Ch3 hash of the routing key over proxies), so"
+  " that every proxy only connects to its share of destinations. Replies"
+  " go back to the proxy of the client.")
+
+mcrouter_option_integer(
+  size_t, proxy_key_affinity_ring_size, 1024,
+  "proxy-key-affinity-ring-size", no_short,
+  "Size of each ring between a pair of proxies used by --proxy-key-affinity"
+  " and --proxy-offload-threshold. Requests are routed locally while the"
+  " ring to their proxy is full.")
+
+mcrouter_option_integer(
+  size_t, proxy_offload_threshold, 0,
+  "proxy-offload-threshold", no_short,
+  "If nonzero (and num-proxies > 1), a proxy routing at least this many"
+  " requests of its own hands new requests over to the least loaded proxy"
+  " routing less than half as many. Replies go back to the proxy of the"
+  " client. Ignored with --proxy-key-affinity.")
+
+mcrouter_option_integer(
+  uint32_t, proxy_offload_loop_lag_us, 0,
+  "proxy-offload-loop-lag-us", no_short,
+  "If nonzero, a proxy whose event loop lag (see --loop-lag-interval-ms)"
+  " is at least this much is overloaded for --proxy-offload-threshold"
+  " regardless of requests routed, and never takes over requests.")
+
 mcrouter_option_toggle(
   use_priorities, true,
   "disable-priorities", no_short,
@@ -88,17 +156,58 @@ mcrouter_option_toggle(
   "improve latency. Use this option to disable realtime-priority "
   "when run as root")
 
+mcrouter_option_string(
+  thread_affinity, "",
+  "thread-affinity", no_short,
+  "If not empty, proxy (and in standalone mode server) threads are pinned"
+  " one per CPU, and auxiliary threads are restricted to the same CPUs."
+  " Either a CPU list (e.g. '0-7,16-23') or 'nic:<interface>' for one CPU"
+  " per physical core of the interface's NUMA node. Memory of a proxy"
+  " thread (e.g. fiber stacks) is then allocated on its node.")
+
 mcrouter_option_integer(
   size_t, big_value_split_threshold, 0,
   "big-value-split-threshold", no_short,
   "If 0, big value route handle is not part of route handle tree,"
   "else used as threshold for splitting big values internally")
 
+mcrouter_option_integer(
+  size_t, big_value_max_chunk_fanout, 0,
+  "big-value-max-chunk-fanout", no_short,
+  "If nonzero, a get of a big value has at most this many chunk gets"
+  " in flight, and stops fetching chunks after the first miss")
+
+mcrouter_option_integer(
+  size_t, big_value_manifest_cache_size, 0,
+  "big-value-manifest-cache-size", no_short,
+  "If nonzero, every proxy remembers chunk lists of this many recently"
+  " accessed big values, so their chunks are fetched in parallel with the"
+  " original key (one round trip instead of two)")
+
 mcrouter_option_integer(
   size_t, fibers_max_pool_size, 1000,
   "fibers-max-pool-size", no_short,
   "Maximum number of preallocated free fibers to keep around")
 
+mcrouter_option_integer(
+  size_t, fibers_pool_resize_period_ms, 0,
+  "fibers-pool-resize-period-ms", no_short,
+  "If nonzero, every this many ms resize the pool of free fibers towards"
+  " the peak number of concurrently active fibers in the last period"
+  " (fibers-max-pool-size is then an upper bound)")
+
+mcrouter_option_integer(
+  size_t, fibers_max_run_per_loop, 0,
+  "fibers-max-run-per-loop", no_short,
+  "If nonzero, run at most this many ready fibers per event loop iteration"
+  " before processing other events")
+
+mcrouter_option_integer(
+  size_t, fibers_max_loop_run_time_us, 0,
+  "fibers-max-loop-run-time-us", no_short,
+  "If nonzero, stop running ready fibers after this many microseconds"
+  " per event loop iteration and process other events first")
+
 #ifdef FOLLY_SANITIZE_ADDRESS
 /* ASAN needs a lot of extra stack space.
    16x is a conservative estimate, 8x also worked with tests
@@ -115,6 +224,31 @@ mcrouter_option_integer(
   "Size of stack in bytes to allocate per fiber."
   " 0 means use fibers library default.")
 
+mcrouter_option_integer(
+  size_t, fibers_large_stack_size, 0,
+  "fibers-large-stack-size", no_short,
+  "If nonzero, size of stack in bytes of fibers for deep subtrees"
+  " (LargeStackRoute, chunking of big values). 0 means such subtrees"
+  " run on regular fibers.")
+
+mcrouter_option_integer(
+  size_t, fibers_max_large_pool_size, 100,
+  "fibers-max-large-pool-size", no_short,
+  "Maximum number of preallocated free large stack fibers to keep around")
+
+mcrouter_option_integer(
+  size_t, fibers_stack_arena_size, 0,
+  "fibers-stack-arena-size", no_short,
+  "If nonzero, each proxy thread reserves stacks for this many fibers in one"
+  " contiguous region at startup and prefaults up to fibers-max-pool-size of"
+  " them. Fibers beyond that get their stacks allocated as usual.")
+
+mcrouter_option_toggle(
+  fibers_stack_arena_huge_pages, false,
+  "fibers-stack-arena-huge-pages", no_short,
+  "Back the fiber stack arena by transparent huge pages"
+  " (stacks in the arena won't have guard pages)")
+
 #undef DEFAULT_STACK_SIZE
 
 mcrouter_option_toggle(
@@ -122,6 +256,12 @@ mcrouter_option_toggle(
   "fibers-debug-record-stack-size", no_short,
   "Record exact amount of fibers stacks used (expensive: debug only!)")
 
+mcrouter_option_integer(
+  size_t, fibers_stack_sample_rate, 0,
+  "fibers-stack-sample-rate", no_short,
+  "If nonzero, record stack usage of 1 in this many fibers (reported in"
+  " fibers_stack_high_watermark and per route handle in 'stats fiber_stack')")
+
 mcrouter_option_string(
   runtime_vars_file,
   MCROUTER_RUNTIME_VARS_DEFAULT,
@@ -131,7 +271,8 @@ mcrouter_option_string(
 mcrouter_option_integer(
   uint32_t, file_observer_poll_period_ms, 100,
   "file-observer-poll-period-ms", no_short,
-  "How often to check inotify for updates on the tracked files.")
+  "Unused, file updates are delivered by inotify as they happen."
+  " Kept for compatibility.")
 
 mcrouter_option_integer(
   uint32_t, file_observer_sleep_before_update_ms, 1000,
@@ -163,6 +304,14 @@ mcrouter_option_integer(
   "Will close open connections without any activity after at most 2 * interval"
   " ms. If value is 0, connections won't be closed.")
 
+mcrouter_option_toggle(
+  tcp_fast_open, false,
+  "tcp-fast-open", no_short,
+  "Connect to destinations with TCP Fast Open (TCP_FASTOPEN_CONNECT), so that"
+  " reconnects to a known server send the first request (or TLS hello) in"
+  " the SYN. Needs Linux 4.11+ with net.ipv4.tcp_fastopen enabled for"
+  " clients, has no effect otherwise.")
+
 mcrouter_option_integer(
   int, tcp_rto_min, -1,
   "tcp-rto-min", no_short,
@@ -174,6 +323,63 @@ mcrouter_option_integer(
   "Maximum inflight requests allowed per target per thread"
   " (0 means no throttling)")
 
+mcrouter_option_toggle(
+  target_priority_lanes, true,
+  "target-priority-lanes", no_short,
+  "Requests waiting to be written to a target (e.g. over"
+  " --target-max-inflight-requests) are written by weighted round robin"
+  " over foreground gets, foreground writes, shadow requests, WarmUpRoute"
+  " fills and asynclog replays, with weights 8:4:2:1:1. If off, they are"
+  " written in the order they were routed.")
+
+mcrouter_option_integer(
+  size_t, target_max_write_iovs, 0,
+  "target-max-write-iovs", no_short,
+  "Maximum number of iovecs written to a target with one writev call"
+  " (0 means IOV_MAX)")
+
+mcrouter_option_integer(
+  size_t, target_max_write_bytes, 0,
+  "target-max-write-bytes", no_short,
+  "Maximum number of bytes written to a target with one writev call,"
+  " a single request is never split (0 means no limit)")
+
+mcrouter_option_integer(
+  size_t, target_read_buffer_pool_size, 0,
+  "target-read-buffer-pool-size", no_short,
+  "If non-zero, connections to targets share read buffers and only hold one"
+  " while there are replies to parse. Up to this many idle buffers are kept"
+  " per proxy thread for reuse.")
+
+mcrouter_option_integer(
+  uint64_t, target_write_cork_window_us, 0,
+  "target-write-cork-window-us", no_short,
+  "If nonzero, writes to a target are delayed for up to this many"
+  " microseconds to batch more requests into one writev."
+  " The event loop busy-polls while waiting, keep it small.")
+
+mcrouter_option_toggle(
+  io_uring, false,
+  "io-uring", no_short,
+  "Do reads and writes of plain (non-SSL) client and destination connections"
+  " through io_uring, submitting once per event loop iteration. Falls back"
+  " to epoll if mcrouter is built without liburing or the kernel doesn't"
+  " support it.")
+
+mcrouter_option_integer(
+  uint32_t, busy_poll_us, 0,
+  "busy-poll-us", no_short,
+  "If nonzero, proxy threads poll their event loop without blocking for up"
+  " to this many microseconds before going to sleep, and client and"
+  " destination sockets get SO_BUSY_POLL of the same value. Lowers wakeup"
+  " latency at the cost of CPU.")
+
+mcrouter_option_integer(
+  uint32_t, loop_lag_interval_ms, 100,
+  "loop-lag-interval-ms", no_short,
+  "Proxy threads check how late their event loop runs a timer every this"
+  " many milliseconds (loop_lag_us in 'stats latency'). 0 disables.")
+
 mcrouter_option_integer(
   uint64_t, target_max_pending_requests, 100000,
   "target-max-pending-requests", no_short,
@@ -182,6 +388,58 @@ mcrouter_option_integer(
   " per target per thread.  Requests that would exceed this limit are dropped"
   " immediately.")
 
+mcrouter_option_integer(
+  size_t, target_max_outstanding_bytes, 0,
+  "target-max-outstanding-bytes", no_short,
+  "If non-zero, requests to a target fail immediately with a local error"
+  " while the requests (key and value bytes) queued, being sent or waiting"
+  " for replies to it on a proxy add up to at least this many bytes.")
+
+mcrouter_option_integer(
+  size_t, proxy_max_outstanding_target_bytes, 0,
+  "proxy-max-outstanding-target-bytes", no_short,
+  "Same as --target-max-outstanding-bytes, for all targets of a proxy"
+  " together.")
+
+mcrouter_option_toggle(
+  target_adaptive_concurrency, false,
+  "target-adaptive-concurrency", no_short,
+  "Adapt the limit on outstanding requests per target per thread to target"
+  " latency: the limit grows while latency stays close to the lowest latency"
+  " seen recently, and shrinks when it rises or requests time out."
+  " Requests over the limit are refused immediately with a busy reply.")
+
+mcrouter_option_integer(
+  uint64_t, target_adaptive_concurrency_min, 4,
+  "target-adaptive-concurrency-min", no_short,
+  "Lowest limit on outstanding requests per target per thread with"
+  " --target-adaptive-concurrency")
+
+mcrouter_option_integer(
+  uint64_t, target_adaptive_concurrency_max, 1000,
+  "target-adaptive-concurrency-max", no_short,
+  "Highest limit on outstanding requests per target per thread with"
+  " --target-adaptive-concurrency")
+
+mcrouter_option_integer(
+  uint32_t, target_adaptive_timeout_pct, 0,
+  "target-adaptive-timeout-pct", no_short,
+  "If non-zero, the timeout of requests to a target is this percentage of"
+  " the p99 latency of its last 1000 replies, clamped to"
+  " [--target-adaptive-timeout-min-ms, --target-adaptive-timeout-max-ms]."
+  " Pools can override these with \"adaptive_timeout\".")
+
+mcrouter_option_integer(
+  uint32_t, target_adaptive_timeout_min_ms, 5,
+  "target-adaptive-timeout-min-ms", no_short,
+  "Shortest timeout with --target-adaptive-timeout-pct")
+
+mcrouter_option_integer(
+  uint32_t, target_adaptive_timeout_max_ms, 0,
+  "target-adaptive-timeout-max-ms", no_short,
+  "Longest timeout with --target-adaptive-timeout-pct"
+  " (0 means the pool's server timeout)")
+
 mcrouter_option_integer(
   size_t, target_max_shadow_requests, 1000,
   "target-max-shadow-requests", no_short,
@@ -189,6 +447,29 @@ mcrouter_option_integer(
   " per target per thread.  Requests that would exceed this limit are dropped"
   " immediately.")
 
+mcrouter_option_integer(
+  size_t, max_shadow_pending_bytes, 0,
+  "max-shadow-pending-bytes", no_short,
+  "If nonzero, limit on the key and value bytes of shadow requests in flight"
+  " per thread (counted once per shadow destination).  Shadow requests"
+  " that would exceed this limit are not sent.")
+
+mcrouter_option_integer(
+  size_t, max_detached_subrequests, 0,
+  "max-detached-subrequests", no_short,
+  "If nonzero, limit on the subrequests in flight per thread that no client"
+  " waits for: AllAsyncRoute and AllInitialRoute children, AllMajorityRoute"
+  " children still running once a majority agreed.  Subrequests over"
+  " the limit are not sent, or not sent to any other destination if they"
+  " are in flight already.")
+
+mcrouter_option_toggle(
+  share_serialized_requests, true,
+  "share-serialized-requests", no_short,
+  "Requests sent as is to several destinations (e.g. by AllSyncRoute or"
+  " ShadowRoute) are serialized once per protocol, instead of once per"
+  " destination.")
+
 mcrouter_option_toggle(
   no_network, false, "no-network", no_short,
   "Debug only. Return random generated replies, do not use network.")
@@ -209,6 +490,46 @@ mcrouter_option_integer(
   "proxy. Further requests will be rejected with an error immediately. 0 means "
   "disabled.")
 
+mcrouter_option_string(
+  proxy_queue_priorities, "",
+  "proxy-queue-priorities", no_short,
+  "Only active if proxy-max-inflight-requests is non-zero. Comma separated"
+  " list of key_prefix:class pairs, class is 0 to 3 (0 is the most"
+  " important), the longest matching prefix wins. Queued requests are"
+  " dequeued by weighted round robin over classes with weights 8:4:2:1,"
+  " and when the queue is full the newest request of a less important class"
+  " is refused first.")
+
+mcrouter_option_integer(
+  size_t, proxy_queue_default_priority, 1,
+  "proxy-queue-default-priority", no_short,
+  "Priority class of requests not matching any of proxy-queue-priorities.")
+
+mcrouter_option_integer(
+  uint32_t, proxy_queue_timeout_ms, 0,
+  "proxy-queue-timeout-ms", no_short,
+  "Only active if proxy-max-inflight-requests is non-zero. Requests that"
+  " waited in the queue for at least this long are refused with a busy"
+  " reply instead of being routed, as they would most likely time out anyway."
+  " 0 means disabled.")
+
+mcrouter_option_string(
+  proxy_tenant_quotas, "",
+  "proxy-tenant-quotas", no_short,
+  "Comma separated list of key_prefix:requests_per_sec:bytes_per_sec:"
+  "max_inflight quotas of tenants sharing this router (0 means unlimited),"
+  " the longest matching prefix wins. Rates are for all proxies together,"
+  " bytes are request key and value bytes. Requests over quota are refused"
+  " with a busy reply, see also proxy-tenant-quota-demote.")
+
+mcrouter_option_toggle(
+  proxy_tenant_quota_demote, false,
+  "proxy-tenant-quota-demote", no_short,
+  "If enabled and proxy-max-inflight-requests is non-zero, requests over"
+  " their tenant's quota are queued as the least important"
+  " proxy-queue-priorities class instead of being refused, so that they"
+  " only get capacity nobody else needs.")
+
 mcrouter_option_string(
   pem_cert_path, "",
   "pem-cert-path", no_short,
@@ -224,6 +545,21 @@ mcrouter_option_string(
   "pem-ca-path", no_short,
   "Path of pem-style CA cert for ssl")
 
+mcrouter_option_toggle(
+  ssl_kernel_tls, false,
+  "ssl-kernel-tls", no_short,
+  "Offload record encryption of SSL connections (SSL ports and destinations)"
+  " to the kernel (kTLS). Connections fall back to userspace encryption if"
+  " the kernel, OpenSSL or the negotiated cipher doesn't support it.")
+
+mcrouter_option_integer(
+  size_t, ssl_handshake_threads, 0,
+  "ssl-handshake-threads", no_short,
+  "If non-zero, SSL handshakes run on this many dedicated threads instead"
+  " of the proxy and server threads, which get the established connections"
+  " handed back. Connections to SSL destinations and connections accepted"
+  " on SSL ports get a pool of this size each.")
+
 mcrouter_option_toggle(
   destination_rate_limiting, false,
   "destination-rate-limiting", no_short,
@@ -252,6 +588,41 @@ mcrouter_option_toggle(
   "disable-reload-configs", no_short,
   "")
 
+mcrouter_option_toggle(
+  disable_incremental_reload, false,
+  "disable-incremental-reload", no_short,
+  "If enabled, rebuild all pools and route handles on every reconfiguration"
+  " instead of reusing the ones whose config didn't change. Also disables"
+  " sharing of identical route handle subtrees within a config")
+
+mcrouter_option_integer(
+  size_t, config_preprocessor_threads, 1,
+  "config-preprocessor-threads", no_short,
+  "Number of threads to expand macros of the top level config properties"
+  " with. Imports are still loaded one at a time.")
+
+mcrouter_option_integer(
+  size_t, config_pool_threads, 1,
+  "config-pool-threads", no_short,
+  "Number of threads to build the pools of the config with, including"
+  " the ones loaded from files.")
+
+mcrouter_option_integer(
+  size_t, destination_warmup_concurrency, 0,
+  "destination-warmup-concurrency", no_short,
+  "If non-zero, after startup and every reconfiguration connect to all new"
+  " destinations with at most this many connection attempts at a time per"
+  " proxy, instead of connecting on the first request."
+  " See 'warmup' service info command for readiness.")
+
+mcrouter_option_string(
+  config_snapshot_dir, "",
+  "config-snapshot-dir", no_short,
+  "If not empty, a binary snapshot of the preprocessed config is kept in"
+  " this directory (e.g. next to async-spool). On startup and"
+  " reconfiguration it's used instead of parsing and preprocessing"
+  " the config if the config and all its imports are unchanged.")
+
 mcrouter_option_string(
   config_file, "",
   "config-file", 'f',
@@ -262,6 +633,13 @@ mcrouter_option_string(
   "config-str", no_short,
   "Configuration string provided as a command line argument")
 
+mcrouter_option_toggle(
+  compress_config_str, false,
+  "compress-config-str", no_short,
+  "Keep --config-str in memory only once per process, zstd compressed,"
+  " instead of in the options of every proxy. It's uncompressed on"
+  " reconfiguration and for the 'config' service info command.")
+
 mcrouter_option(
   facebook::memcache::mcrouter::RoutingPrefix, default_route, "/././",
   "route-prefix", 'R',
@@ -294,6 +672,12 @@ mcrouter_option_toggle(
   "enable-flush-cmd", no_short,
   "Enable flush_all command")
 
+mcrouter_option_integer(
+  size_t, flush_all_max_concurrency, 64,
+  "flush-all-max-concurrency", no_short,
+  "Maximum destinations flush_all is sent to at a time, from as many fibers"
+  " (0 means all of them at once)")
+
 mcrouter_option_group("TKO probes")
 
 mcrouter_option_toggle(
@@ -313,6 +697,47 @@ mcrouter_option_integer(
   "probe-timeout-max", no_short,
   "TKO probe retry max timeout in ms")
 
+mcrouter_option_integer(
+  unsigned int, pool_probe_sample_threshold_pct, 0,
+  "pool-probe-sample-threshold-pct", no_short,
+  "Once at least this percentage of a pool's destinations is TKO, only"
+  " a sample of them is probed (see --pool-probe-sample-pct), every"
+  " probe-timeout-initial ms, and a successful probe makes the rest probe"
+  " right away. 0 disables pool level probing.")
+
+mcrouter_option_integer(
+  unsigned int, pool_probe_sample_pct, 10,
+  "pool-probe-sample-pct", no_short,
+  "Percentage of the TKO destinations of a mostly dead pool that are"
+  " probed; the others are still probed every probe-timeout-max ms")
+
+mcrouter_option_toggle(
+  skip_dead_routes, false,
+  "skip-dead-routes", no_short,
+  "Keep track of route handles all of whose destinations are TKO: failover"
+  " routes skip them, and requests that could only go to them get a TKO"
+  " reply right away, without being routed.")
+
+mcrouter_option_integer(
+  uint32_t, failover_retry_budget_pct, 0,
+  "failover-retry-budget-pct", no_short,
+  "If nonzero, failover routes send a failed request to their next target"
+  " only while failovers stay under this percentage of the requests they"
+  " sent to their first target over --failover-retry-budget-window-ms (per"
+  " thread), plus --failover-retry-budget-min-per-sec. Otherwise the error"
+  " is returned right away.")
+
+mcrouter_option_integer(
+  uint32_t, failover_retry_budget_min_per_sec, 10,
+  "failover-retry-budget-min-per-sec", no_short,
+  "Failovers per second (per thread) allowed by --failover-retry-budget-pct"
+  " regardless of traffic")
+
+mcrouter_option_integer(
+  uint32_t, failover_retry_budget_window_ms, 10000,
+  "failover-retry-budget-window-ms", no_short,
+  "Sliding window of --failover-retry-budget-pct")
+
 mcrouter_option_integer(
   int, failures_until_tko, 3,
   "timeouts-until-tko", no_short,
@@ -324,6 +749,52 @@ mcrouter_option_integer(
   "The maximum number of machines we can mark TKO if they don't have a hard"
   " failure.")
 
+mcrouter_option_string(
+  shared_tko_table, "",
+  "shared-tko-table", no_short,
+  "If not empty, path of a file (e.g. in /dev/shm) through which all mcrouter"
+  " processes on the host share TKO state. Destinations marked TKO by one"
+  " process get no requests from the others, and only that process probes"
+  " them.")
+
+mcrouter_option_integer(
+  uint32_t, outlier_detection_interval_ms, 0,
+  "outlier-detection-interval-ms", no_short,
+  "If nonzero, every this many ms compare error rate and p99 latency of each"
+  " destination over the last two intervals to the medians of its pool"
+  " (per thread), and eject outliers for --outlier-ejection-ms. Catches"
+  " destinations that are slow or flaky but never fail often enough in a row"
+  " to be marked TKO.")
+
+mcrouter_option_integer(
+  uint64_t, outlier_detection_min_requests, 100,
+  "outlier-detection-min-requests", no_short,
+  "Destinations with fewer requests over the last two intervals are neither"
+  " ejected nor used as peers by outlier detection")
+
+mcrouter_option_integer(
+  uint32_t, outlier_error_rate_margin_pct, 10,
+  "outlier-error-rate-margin-pct", no_short,
+  "Eject destinations whose error rate is this many percentage points above"
+  " the median error rate of the pool")
+
+mcrouter_option_integer(
+  uint32_t, outlier_latency_ratio_pct, 300,
+  "outlier-latency-ratio-pct", no_short,
+  "Eject destinations whose p99 latency is over this percentage of the median"
+  " p99 latency of the pool")
+
+mcrouter_option_integer(
+  uint32_t, outlier_max_ejected_pct, 10,
+  "outlier-max-ejected-pct", no_short,
+  "The maximum percentage of destinations of a pool ejected by outlier"
+  " detection at the same time.")
+
+mcrouter_option_integer(
+  uint32_t, outlier_ejection_ms, 30000,
+  "outlier-ejection-ms", no_short,
+  "How long destinations ejected by outlier detection get no requests")
+
 mcrouter_option_integer(
   size_t, latency_window_size, 16,
   "latency-window-size", no_short,
@@ -338,6 +809,14 @@ mcrouter_option_integer(
   "server timeout in ms (DEPRECATED try to use cluster-server-timeout "
   "and regional-server-timeout)")
 
+mcrouter_option_integer(
+  unsigned int, request_deadline_ms, 0,
+  "request-deadline", no_short,
+  "If nonzero, total time in ms mcrouter may spend on a request, including"
+  " queueing and failover, unless the client sets its own deadline."
+  " Server timeouts are clamped to the time left and no more requests are"
+  " sent to destinations once it's used up.")
+
 mcrouter_option_integer(
   unsigned int, cluster_pools_timeout_ms, 0,
   "cluster-pools-timeout", no_short,
@@ -374,6 +853,13 @@ mcrouter_option_toggle(
   "If enabled - same connection to a destination may be used for requests "
   "with different timeouts.")
 
+mcrouter_option_toggle(
+  share_destinations_across_instances, false,
+  "share-destinations-across-instances", no_short,
+  "If enabled, proxies of different mcrouter instances running on the same "
+  "event base share connections (irrespective of timeouts) and TKO state "
+  "for the same destinations.")
+
 
 mcrouter_option_group("Logging")
 
@@ -387,12 +873,110 @@ mcrouter_option_integer(
   "stats-logging-interval", no_short,
   "Time in ms between stats reports, or 0 for no logging")
 
+mcrouter_option_integer(
+  unsigned int, stats_logging_checkpoint_interval, 0,
+  "stats-logging-checkpoint-interval", no_short,
+  "If nonzero, the stats file is only rewritten every N stats reports."
+  " Every report appends the stats that changed since the previous one to"
+  " the stats_delta file as a JSON line, which starts over with all stats"
+  " on each full report.")
+
+mcrouter_option_integer(
+  unsigned int, stats_export_port, 0,
+  "stats-export-port", no_short,
+  "If non-zero, serve a snapshot of all stats in OpenMetrics text format"
+  " over HTTP on this port, separately from the memcache 'stats' command")
+
+mcrouter_option_integer(
+  unsigned int, stats_export_interval_ms, 1000,
+  "stats-export-interval-ms", no_short,
+  "Time in ms between refreshes of the --stats-export-port snapshot")
+
+mcrouter_option_integer(
+  size_t, hot_keys_sample_rate, 0,
+  "hot-keys-sample-rate", no_short,
+  "If nonzero, track the most frequent keys and routing prefixes over one"
+  " of every N requests of each proxy ('__mcrouter__.hot_keys' service"
+  " info command, hot_keys_min_share of CoalescingRoute/NearCacheRoute)")
+
+mcrouter_option_integer(
+  size_t, hot_keys_capacity, 128,
+  "hot-keys-capacity", no_short,
+  "Keys and prefixes tracked per proxy by --hot-keys-sample-rate")
+
+mcrouter_option_integer(
+  size_t, trace_sample_rate, 0,
+  "trace-sample-rate", no_short,
+  "If nonzero, trace one of every N requests of each proxy: client read,"
+  " queue wait, every route handle, destination round trips and client"
+  " write are recorded as timed spans (see --trace-export-file)")
+
+mcrouter_option_integer(
+  size_t, trace_ring_size, 4096,
+  "trace-ring-size", no_short,
+  "Spans buffered per proxy between exports, spans beyond that are dropped")
+
+mcrouter_option_string(
+  trace_export_file, "",
+  "trace-export-file", no_short,
+  "Append spans of traced requests to this file, one JSON object per line")
+
+mcrouter_option_integer(
+  unsigned int, trace_export_interval_ms, 1000,
+  "trace-export-interval-ms", no_short,
+  "Time in ms between exports of traced spans")
+
+mcrouter_option_string(
+  traffic_capture_file, "",
+  "traffic-capture-file", no_short,
+  "If set, each proxy captures a sample of the requests it receives"
+  " (operation, key, flags, exptime, value size and time, not values) to"
+  " this path with '.<proxy index>' appended, for mcrouter_traffic_replay")
+
+mcrouter_option_integer(
+  size_t, traffic_capture_sample_rate, 1,
+  "traffic-capture-sample-rate", no_short,
+  "Capture the requests of one of every N keys, so that all requests to a"
+  " captured key are in the capture")
+
+mcrouter_option_integer(
+  size_t, traffic_capture_max_bytes, 1024 * 1024 * 1024,
+  "traffic-capture-max-bytes", no_short,
+  "Disk space of the capture files of all proxies; once full, the oldest"
+  " requests are overwritten")
+
+mcrouter_option_integer(
+  unsigned int, stage_profiler_interval_ms, 0,
+  "stage-profiler-interval-ms", no_short,
+  "If non-zero, every N ms record which route handle and stage (parse, route,"
+  " serialize, write) each proxy thread is in, reported by the stage_profile"
+  " ServiceInfo command. 0 disables the profiler.")
+
+mcrouter_option_toggle(
+  thread_arenas, false,
+  "thread-arenas", no_short,
+  "With jemalloc, give every proxy thread (server worker in standalone mode)"
+  " its own arena")
+
+mcrouter_option_integer(
+  unsigned int, thread_arenas_purge_interval_ms, 0,
+  "thread-arenas-purge-interval-ms", no_short,
+  "If non-zero and --thread-arenas is set, every N ms return the dirty pages"
+  " of the proxy thread arenas to the OS from an auxiliary thread")
+
 mcrouter_option_integer(
   unsigned int, logging_rtt_outlier_threshold_us, 0,
   "logging-rtt-outlier-threshold-us", no_short,
   "surpassing this threshold rtt time means we will log it as an outlier. "
   "0 (the default) means that we will do no logging of outliers.")
 
+mcrouter_option_integer(
+  size_t, rtt_outlier_samples, 0,
+  "rtt-outlier-samples", no_short,
+  "If nonzero, each proxy keeps the key prefix, destination and duration"
+  " of its latest N rtt outliers (see --logging-rtt-outlier-threshold-us)"
+  " for the rtt_outliers service info command")
+
 mcrouter_option_integer(
   unsigned int, stats_async_queue_length, 50,
   "stats-async-queue-length", no_short,
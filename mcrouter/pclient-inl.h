@@ -21,4 +21,20 @@ void ProxyClientOwner::foreach_shared_synchronized(const F& func) {
   }
 }
 
+template<typename F>
+std::string ProxyClientOwner::foreach_shared_synchronized(
+    const std::string& startKey,
+    size_t limit,
+    const F& func) {
+  std::lock_guard<std::mutex> lock(mx);
+  auto it = pclient_shared.lower_bound(startKey);
+  for (; it != pclient_shared.end() && limit > 0; ++it) {
+    if (auto pcs = it->second.lock()) {
+      func(it->first, *pcs);
+      --limit;
+    }
+  }
+  return it == pclient_shared.end() ? std::string() : it->first;
+}
+
 }}}
@@ -12,6 +12,7 @@
 #include <folly/MapUtil.h>
 
 #include "mcrouter/ProxyDestination.h"
+#include "mcrouter/SharedTkoTable.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -19,9 +20,12 @@ ProxyClientShared::ProxyClientShared(const std::string& key_,
                                      const size_t tkoThreshold,
                                      const size_t maxSoftTkos,
                                      TkoCounters& globalTkos,
+                                     SharedTkoTable* sharedTkoTable,
                                      ProxyClientOwner& owner)
     : key(key_),
-      tko(tkoThreshold, maxSoftTkos, globalTkos),
+      tko(tkoThreshold, maxSoftTkos, globalTkos,
+          sharedTkoTable ? sharedTkoTable->entry(key_)
+                         : SharedTkoTable::Entry()),
       owner_(owner) {
 }
 
@@ -44,7 +48,8 @@ void ProxyClientOwner::updateProxyClientShared(
   ProxyDestination& pdstn,
   const size_t tkoThreshold,
   const size_t maxSoftTkos,
-  TkoCounters& globalTkos) {
+  TkoCounters& globalTkos,
+  SharedTkoTable* sharedTkoTable) {
   const std::string& key = pdstn.destinationKey;
   {
     std::lock_guard<std::mutex> lock(mx);
@@ -55,6 +60,7 @@ void ProxyClientOwner::updateProxyClientShared(
                                                 tkoThreshold,
                                                 maxSoftTkos,
                                                 globalTkos,
+                                                sharedTkoTable,
                                                 *this);
       pclient_shared.emplace(key, pcs);
     }
@@ -70,4 +76,19 @@ ProxyClientOwner::getSharedByKey(const std::string& key) {
   return folly::get_default(pclient_shared, key);
 }
 
+std::shared_ptr<PoolTkoTracker>
+ProxyClientOwner::getPoolTkoTracker(const std::string& pool,
+                                    size_t thresholdPct,
+                                    size_t samplePct) {
+  std::lock_guard<std::mutex> lock(mx);
+
+  auto& weak = poolTkoTrackers_[pool];
+  auto tracker = weak.lock();
+  if (!tracker) {
+    tracker = std::make_shared<PoolTkoTracker>(pool, thresholdPct, samplePct);
+    weak = tracker;
+  }
+  return tracker;
+}
+
 }}}
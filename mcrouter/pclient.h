@@ -9,18 +9,20 @@
  */
 #pragma once
 
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
-#include <unordered_map>
 #include <unordered_set>
 
+#include "mcrouter/PoolTkoTracker.h"
 #include "mcrouter/TkoTracker.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
 class ProxyClientOwner;
 class ProxyDestination;
+class SharedTkoTable;
 class TkoCounters;
 
 /**
@@ -37,6 +39,7 @@ struct ProxyClientShared {
                     const size_t tkoThreshold,
                     const size_t maxSoftTkos,
                     TkoCounters& globalTkos,
+                    SharedTkoTable* sharedTkoTable,
                     ProxyClientOwner& owner);
 
   /**
@@ -66,11 +69,14 @@ struct ProxyClientOwner {
   /**
    * Creates/updates ProxyClientShared with the given pdstn
    * and also updates pdstn->shared pointer.
+   *
+   * @param sharedTkoTable  TKO table shared with other processes, may be null
    */
   void updateProxyClientShared(ProxyDestination& pdstn,
                                const size_t tkoThreshold,
                                const size_t maxSoftTkos,
-                               TkoCounters& globalTkos);
+                               TkoCounters& globalTkos,
+                               SharedTkoTable* sharedTkoTable);
   /**
    * Calls func(key, ProxyClientShared*) for each live proxy client
    * shared object.  The whole map will be locked for the duration of the call.
@@ -78,12 +84,34 @@ struct ProxyClientOwner {
   template<typename F>
   void foreach_shared_synchronized(const F& func);
 
+  /**
+   * Same as above, but only calls func for up to `limit` live shared
+   * objects in key order, starting from the first key >= startKey.
+   * The map is only locked for the duration of this page.
+   *
+   * @return startKey of the next page, empty if this was the last one
+   */
+  template<typename F>
+  std::string foreach_shared_synchronized(const std::string& startKey,
+                                          size_t limit,
+                                          const F& func);
+
   std::weak_ptr<ProxyClientShared> getSharedByKey(const std::string& key);
 
+  /**
+   * @return the pool's tracker, created with the given parameters if
+   *         there's no live one
+   */
+  std::shared_ptr<PoolTkoTracker> getPoolTkoTracker(const std::string& pool,
+                                                    size_t thresholdPct,
+                                                    size_t samplePct);
+
  private:
   std::mutex mx;
-  std::unordered_map<std::string, std::weak_ptr<ProxyClientShared>>
-    pclient_shared;
+  /// ordered, so that per-server stats can be paged through by key
+  std::map<std::string, std::weak_ptr<ProxyClientShared>> pclient_shared;
+  /// by pool name, guarded by mx
+  std::map<std::string, std::weak_ptr<PoolTkoTracker>> poolTkoTrackers_;
 
   friend class ProxyClientShared;
 };
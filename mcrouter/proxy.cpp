@@ -15,10 +15,12 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 
 #include <boost/regex.hpp>
 
+#include <folly/Conv.h>
 #include <folly/DynamicConverter.h>
 #include <folly/FileUtil.h>
 #include <folly/Format.h>
@@ -29,32 +31,46 @@
 #include <folly/File.h>
 
 #include "mcrouter/async.h"
+#include "mcrouter/AsynclogSpool.h"
+#include "mcrouter/ClientTracker.h"
 #include "mcrouter/config-impl.h"
 #include "mcrouter/config.h"
+#include "mcrouter/EventLoopLagProbe.h"
+#include "mcrouter/HotKeyTracker.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/fbi/nstring.h"
 #include "mcrouter/lib/fbi/queue.h"
-#include "mcrouter/lib/fbi/timer.h"
+#include "mcrouter/lib/Ch3HashFunc.h"
 #include "mcrouter/lib/fibers/EventBaseLoopController.h"
+#include "mcrouter/lib/network/ReadBufferPool.h"
+#include "mcrouter/lib/RetryBudget.h"
 #include "mcrouter/lib/WeightedCh3HashFunc.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/McrouterLogFailure.h"
 #include "mcrouter/options.h"
 #include "mcrouter/priorities.h"
 #include "mcrouter/ProxyClientCommon.h"
+#include "mcrouter/ProxyClock.h"
 #include "mcrouter/ProxyConfig.h"
 #include "mcrouter/ProxyConfigBuilder.h"
 #include "mcrouter/ProxyDestinationMap.h"
 #include "mcrouter/ProxyMcRequest.h"
 #include "mcrouter/ProxyRequestContext.h"
+#include "mcrouter/ProxyRequestRing.h"
 #include "mcrouter/ProxyThread.h"
+#include "mcrouter/RequestStatsBuffer.h"
+#include "mcrouter/RequestTracer.h"
 #include "mcrouter/route.h"
 #include "mcrouter/routes/ProxyRoute.h"
 #include "mcrouter/routes/RateLimiter.h"
 #include "mcrouter/routes/ShardSplitter.h"
+#include "mcrouter/RttOutlierTracker.h"
 #include "mcrouter/RuntimeVarsData.h"
 #include "mcrouter/ServiceInfo.h"
+#include "mcrouter/StageProfiler.h"
 #include "mcrouter/stats.h"
+#include "mcrouter/TenantQuotas.h"
+#include "mcrouter/TrafficCapture.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -72,22 +88,97 @@ static asox_queue_callbacks_t const proxy_request_queue_cb =  {
 
 namespace {
 
+/* Largest read buffer of a target connection (see AsyncMcClientImpl) */
+constexpr size_t kTargetReadBufferSize = 4096;
+
+/**
+ * @return false for requests that are not about a key and must be answered
+ *         by the proxy that received them
+ */
+bool canForward(mc_op_t op) {
+  switch (op) {
+    case mc_op_stats:
+    case mc_op_version:
+    case mc_op_get_service_info:
+    case mc_op_flushall:
+    case mc_op_flushre:
+      return false;
+    default:
+      return true;
+  }
+}
+
+/**
+ * @return true for requests without side effects, which can be dropped
+ *         once nobody waits for their reply
+ */
+bool isGetOp(mc_op_t op) {
+  switch (op) {
+    case mc_op_get:
+    case mc_op_gets:
+    case mc_op_metaget:
+    case mc_op_lease_get:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @return true for requests about the router itself, which are neither
+ *         queued nor charged to tenants
+ */
+bool alwaysLetThrough(mc_op_t op) {
+  return op == mc_op_stats ||
+    op == mc_op_version ||
+    op == mc_op_get_service_info;
+}
+
 FiberManager::Options getFiberManagerOptions(const McrouterOptions& opts) {
   FiberManager::Options fmOpts;
   fmOpts.stackSize = opts.fibers_stack_size;
+  fmOpts.largeStackSize = opts.fibers_large_stack_size;
+  fmOpts.maxLargeFibersPoolSize = opts.fibers_max_large_pool_size;
   fmOpts.debugRecordStackUsed = opts.fibers_debug_record_stack_size;
+  fmOpts.stackSampleRate = opts.fibers_stack_sample_rate;
   fmOpts.maxFibersPoolSize = opts.fibers_max_pool_size;
+  fmOpts.poolResizePeriodMs = opts.fibers_pool_resize_period_ms;
+  fmOpts.maxFibersRunPerLoop = opts.fibers_max_run_per_loop;
+  fmOpts.maxLoopRunTimeUs = opts.fibers_max_loop_run_time_us;
+  fmOpts.stackArenaSize = opts.fibers_stack_arena_size;
+  fmOpts.stackArenaUseHugePages = opts.fibers_stack_arena_huge_pages;
   return fmOpts;
 }
 
+/**
+ * Routes the original request of ctx with the config's route handles,
+ * errors thrown while routing become local errors. The caller keeps
+ * the context alive until the reply is sent.
+ */
+McReply dispatchRequest(std::shared_ptr<ProxyRequestContext> ctx) {
+  auto& origReq = ctx->origReq();
+  try {
+    auto& proute = ctx->proxyRoute();
+    auto reply = proute.dispatchMcMsg(origReq.clone(), std::move(ctx));
+    return ProxyMcReply::moveToMcReply(std::move(reply));
+  } catch (const std::exception& e) {
+    std::string err = "error routing "
+      + to<std::string>(origReq->key) + ": " +
+      e.what();
+    return McReply(mc_res_local_error, err);
+  }
+}
+
 }
 
 proxy_t::proxy_t(McrouterInstance* router_,
                  folly::EventBase* eventBase_,
-                 const McrouterOptions& opts_)
+                 const McrouterOptions& opts_,
+                 size_t index_)
     : router(router_),
       opts(opts_),
       eventBase(eventBase_),
+      index(index_),
       destinationMap(folly::make_unique<ProxyDestinationMap>(this)),
       durationUs(kExponentialFactor),
       randomGenerator(folly::randomNumberSeed()),
@@ -103,6 +194,67 @@ proxy_t::proxy_t(McrouterInstance* router_,
 
   init_stats(stats);
 
+  if (!opts.proxy_queue_priorities.empty()) {
+    try {
+      requestPriorities_ = folly::make_unique<RequestPriorities>(
+        opts.proxy_queue_priorities, opts.proxy_queue_default_priority);
+    } catch (const std::invalid_argument& e) {
+      LOG(ERROR) << "Ignoring --proxy-queue-priorities: " << e.what();
+    }
+  }
+
+  if (opts.trace_sample_rate != 0) {
+    tracer = folly::make_unique<RequestTracer>(opts.trace_sample_rate,
+                                               opts.trace_ring_size);
+  }
+
+  if (!opts.traffic_capture_file.empty()) {
+    try {
+      trafficCapture = folly::make_unique<TrafficCapture>(
+        folly::to<std::string>(opts.traffic_capture_file, '.', index),
+        opts.traffic_capture_max_bytes / std::max<size_t>(1, opts.num_proxies),
+        opts.traffic_capture_sample_rate);
+    } catch (const std::runtime_error& e) {
+      LOG(ERROR) << "Traffic capture disabled: " << e.what();
+    }
+  }
+
+  targetOutstandingBytes.limit = opts.proxy_max_outstanding_target_bytes;
+
+  if (opts.target_read_buffer_pool_size != 0) {
+    targetReadBuffers = folly::make_unique<ReadBufferPool>(
+      kTargetReadBufferSize, opts.target_read_buffer_pool_size);
+  }
+
+  if (opts.failover_retry_budget_pct != 0) {
+    failoverBudget = folly::make_unique<RetryBudget>(
+      opts.failover_retry_budget_pct,
+      opts.failover_retry_budget_min_per_sec,
+      std::chrono::milliseconds(opts.failover_retry_budget_window_ms));
+  }
+
+  if (opts.stage_profiler_interval_ms != 0) {
+    stageProfiler = folly::make_unique<StageProfiler>();
+  }
+
+  fiberManager.setLoopStatsCallback(
+    [this] (size_t readyFibers, std::chrono::microseconds runTime) {
+      fibersReadyPerLoop.insertSample(readyFibers);
+      fiberLoopRunUs.insertSample(runTime.count());
+    });
+
+  if (opts.fibers_stack_sample_rate != 0) {
+    fiberManager.setStackSampleCallback(
+      [this] (const char* tag, size_t stackUsed) {
+        auto it = stackUsageByRoute.find(tag);
+        if (it == stackUsageByRoute.end()) {
+          std::lock_guard<std::mutex> lock(stackUsageLock);
+          it = stackUsageByRoute.emplace(tag, LatencyHistogram()).first;
+        }
+        it->second.insertSample(stackUsed);
+      });
+  }
+
   if (eventBase != nullptr) {
     onEventBaseAttached();
   }
@@ -115,12 +267,37 @@ void proxy_t::attachEventBase(folly::EventBase* eventBase_) {
   onEventBaseAttached();
 }
 
+void proxy_t::warmupDestinations() {
+  if (opts.destination_warmup_concurrency == 0 || eventBase == nullptr) {
+    return;
+  }
+  eventBase->runInEventBaseThread([this]() {
+    destinationMap->warmup(opts.destination_warmup_concurrency);
+  });
+}
+
 void proxy_t::onEventBaseAttached() {
   dynamic_cast<EventBaseLoopController&>(
     fiberManager.loopController()).attachEventBase(*eventBase);
 
   init_proxy_event_priorities(this);
 
+  clock = folly::make_unique<ProxyClock>(*eventBase);
+
+  if (stageProfiler) {
+    auto slot = &stageProfiler->slot();
+    fiberManager.setProfileSlot(slot);
+    eventBase->runInEventBaseThread([slot]() {
+      threadProfileSlot() = slot;
+    });
+  }
+
+  if (opts.loop_lag_interval_ms != 0) {
+    loopLagProbe = folly::make_unique<EventLoopLagProbe>(
+      *eventBase, std::chrono::milliseconds(opts.loop_lag_interval_ms),
+      loopLagUs, &lastLoopLagUs);
+  }
+
   std::chrono::milliseconds connectionResetInterval{
     opts.reset_inactive_connection_interval
   };
@@ -129,12 +306,50 @@ void proxy_t::onEventBaseAttached() {
   }
 
   int priority = get_event_priority(opts, SERVER_REQUEST);
-  request_queue = asox_queue_init(eventBase->getLibeventBase(), priority,
-                                  1, 0, 0, &proxy_request_queue_cb,
-                                  ASOX_QUEUE_INTRA_PROCESS, this);
+  if (opts.proxy_request_ring_size > 0) {
+    requestRing = folly::make_unique<ProxyRequestRing>(
+      *eventBase, opts.proxy_request_ring_size, opts.proxy_request_ring_batch,
+      priority, &proxy_request_queue_cb, this);
+  } else {
+    request_queue = asox_queue_init(eventBase->getLibeventBase(), priority,
+                                    1, 0, 0, &proxy_request_queue_cb,
+                                    ASOX_QUEUE_INTRA_PROCESS, this);
+  }
+
+  if ((opts.proxy_key_affinity || opts.proxy_offload_threshold > 0) &&
+      opts.num_proxies > 1) {
+    affinityRings.resize(opts.num_proxies);
+    for (size_t i = 0; i < affinityRings.size(); ++i) {
+      if (i != index) {
+        affinityRings[i] = folly::make_unique<ProxyRequestRing>(
+          *eventBase, opts.proxy_key_affinity_ring_size,
+          opts.proxy_request_ring_batch, priority, &proxy_request_queue_cb,
+          this);
+      }
+    }
+    affinityReady.store(true, std::memory_order_release);
+  }
 
   statsContainer = folly::make_unique<ProxyStatsContainer>(this);
 
+  if (opts.asynclog_batch) {
+    asynclogSpool = folly::make_unique<AsynclogSpool>(*this);
+  }
+
+  if (opts.hot_keys_sample_rate != 0) {
+    hotKeys = folly::make_unique<HotKeyTracker>(opts.hot_keys_sample_rate,
+                                                opts.hot_keys_capacity);
+  }
+
+  requestStats = folly::make_unique<RequestStatsBuffer>(*this);
+  if (opts.rtt_outlier_samples != 0 &&
+      opts.logging_rtt_outlier_threshold_us != 0) {
+    rttOutliers = folly::make_unique<RttOutlierTracker>(
+      opts.rtt_outlier_samples);
+  }
+
+  warmupDestinations();
+
   if (router != nullptr) {
     router->startupLock().notify();
   }
@@ -161,17 +376,29 @@ std::shared_ptr<ProxyConfigIf> proxy_t::swapConfig(
   std::lock_guard<SFRWriteLock> lg(configLock_.writeLock());
   auto old = std::move(config_);
   config_ = std::move(newConfig);
+  configVersion_.fetch_add(1, std::memory_order_release);
   return old;
 }
 
+void proxy_t::enqueueEntries(asox_queue_entry_t* entries, size_t nentries) {
+  if (requestRing) {
+    requestRing->enqueue(entries, nentries);
+  } else {
+    asox_queue_multi_enqueue(request_queue, entries, nentries);
+  }
+}
+
 /** drain and delete proxy object */
 proxy_t::~proxy_t() {
+  asynclogSpool.reset();
   destinationMap.reset();
 
   being_destroyed = true;
   if (request_queue) {
     asox_queue_del(request_queue);
   }
+  requestRing.reset();
+  affinityRings.clear();
 
   magic = 0xdeadbeefdeadbeefLL;
 }
@@ -185,7 +412,13 @@ void proxy_t::routeHandlesProcessRequest(
     return;
   }
 
-  auto preq = ProxyRequestContext::process(std::move(upreq), getConfig());
+  auto version = configVersion_.load(std::memory_order_acquire);
+  if (version != configEpochsVersion_ || !configEpochs.current()) {
+    configEpochs.update(getConfig());
+    configEpochsVersion_ = version;
+  }
+
+  auto preq = ProxyRequestContext::process(std::move(upreq));
   if (preq->origReq()->op == mc_op_get_service_info) {
     auto orig = preq->origReq().clone();
     const auto& config = preq->proxyConfig();
@@ -196,24 +429,28 @@ void proxy_t::routeHandlesProcessRequest(
     return;
   }
 
+  /* No fiber needed if we already know how routing would end */
+  McReply deadReply;
+  if (preq->proxyRoute().knownDeadReply(preq->origReq(), deadReply)) {
+    stat_incr(stats, dead_route_replies_stat, 1);
+    preq->sendReply(std::move(deadReply));
+    return;
+  }
+
+  /* Nor if the route answers right away (e.g. NullRoute, ErrorRoute) */
+  if (preq->proxyRoute().routesInline(preq->origReq())) {
+    stat_incr(stats, inline_routed_requests_stat, 1);
+    preq->sendReply(dispatchRequest(preq));
+    return;
+  }
+
   auto func_ctx = folly::makeMoveWrapper(
     std::shared_ptr<ProxyRequestContext>(preq));
   auto finally_ctx = folly::makeMoveWrapper(std::move(preq));
 
   fiberManager.addTaskFinally(
     [func_ctx]() {
-      auto& origReq = (*func_ctx)->origReq();
-      try {
-        auto& proute = (*func_ctx)->proxyRoute();
-        auto reply = proute.dispatchMcMsg(origReq.clone(),
-                                          std::move(*func_ctx));
-        return ProxyMcReply::moveToMcReply(std::move(reply));
-      } catch (const std::exception& e) {
-        std::string err = "error routing "
-          + to<std::string>(origReq->key) + ": " +
-          e.what();
-        return McReply(mc_res_local_error, err);
-      }
+      return dispatchRequest(std::move(*func_ctx));
     },
     [finally_ctx](folly::Try<McReply>&& reply) {
       (*finally_ctx)->sendReply(std::move(*reply));
@@ -285,40 +522,217 @@ void proxy_t::processRequest(std::unique_ptr<ProxyRequestContext> preq) {
       break;
   }
 
-  routeHandlesProcessRequest(std::move(preq));
+  auto target = &affinityTarget(*preq);
+  bool offload = false;
+  if (target == this) {
+    target = &offloadTarget(*preq);
+    offload = target != this;
+  }
+  if (target != this && forwardRequest(*target, preq)) {
+    if (offload) {
+      stat_incr(stats, proxy_reqs_offloaded_stat, 1);
+    }
+  } else {
+    routeHandlesProcessRequest(std::move(preq));
+  }
 
   stat_incr(stats, request_sent_stat, 1);
   stat_incr(stats, request_sent_count_stat, 1);
 }
 
+proxy_t& proxy_t::affinityTarget(const ProxyRequestContext& preq) {
+  if (!opts.proxy_key_affinity || affinityRings.empty() ||
+      router == nullptr || !canForward(preq.origReq()->op)) {
+    return *this;
+  }
+
+  McRequest req(preq.origReq().clone());
+  auto target =
+    router->getProxy(Ch3HashFunc(opts.num_proxies)(req.routingKey()));
+  if (target == nullptr ||
+      !target->affinityReady.load(std::memory_order_acquire)) {
+    return *this;
+  }
+  return *target;
+}
+
+proxy_t& proxy_t::offloadTarget(const ProxyRequestContext& preq) {
+  if (opts.proxy_offload_threshold == 0 || affinityRings.empty() ||
+      router == nullptr || !canForward(preq.origReq()->op)) {
+    return *this;
+  }
+
+  auto lagLimit = opts.proxy_offload_loop_lag_us;
+  auto lagging = [lagLimit](const proxy_t& proxy) {
+    return lagLimit != 0 &&
+      proxy.lastLoopLagUs.load(std::memory_order_relaxed) >= lagLimit;
+  };
+  if (numRequestsProcessing_ - numRequestsForwarded_ <
+        opts.proxy_offload_threshold &&
+      !lagging(*this)) {
+    return *this;
+  }
+
+  proxy_t* best = this;
+  /* Only hand over to proxies that are idle enough not to need
+     offloading themselves right away */
+  uint64_t bestLoad = opts.proxy_offload_threshold / 2;
+  for (size_t i = 0; i < opts.num_proxies; ++i) {
+    auto proxy = router->getProxy(i);
+    if (proxy == nullptr || proxy == this ||
+        !proxy->affinityReady.load(std::memory_order_acquire) ||
+        lagging(*proxy)) {
+      continue;
+    }
+    auto load = stat_get_uint64(proxy->stats, proxy_reqs_processing_stat);
+    if (load < bestLoad) {
+      best = proxy;
+      bestLoad = load;
+    }
+  }
+  return *best;
+}
+
+bool proxy_t::forwardRequest(proxy_t& target,
+                             std::unique_ptr<ProxyRequestContext>& preq) {
+  auto fwd = ProxyRequestContext::create(
+    target,
+    preq->origReq().clone(),
+    [] (ProxyRequestContext& fwdReq) {
+      /* Runs on the target proxy */
+      auto orig = reinterpret_cast<ProxyRequestContext*>(fwdReq.context_);
+      orig->reply_ = std::move(fwdReq.reply_.value());
+
+      asox_queue_entry_t entry;
+      entry.data = orig;
+      entry.nbytes = sizeof(ProxyRequestContext*);
+      entry.priority = 0;
+      entry.type = request_type_forwarded_reply;
+      auto& origin = orig->proxy();
+      /* Never wait on a full ring here: the origin might be waiting
+         for us. Its request queue is always drained. */
+      if (!origin.affinityRings[fwdReq.proxy().index]->tryEnqueue(entry)) {
+        origin.enqueueEntries(&entry, 1);
+      }
+    },
+    preq.get());
+  fwd->deadlineUs_ = preq->deadlineUs_;
+  fwd->failoverDisabled_ = preq->failoverDisabled_;
+  fwd->cancellation_ = preq->cancellation_;
+  fwd->createdUs_ = preq->createdUs_;
+  /* savedRequest_ stays with the origin: its origReq() points into it and
+     the origin is what gets freed when the reply arrives. fwd owns a clone. */
+
+  asox_queue_entry_t entry;
+  entry.data = fwd.get();
+  entry.nbytes = sizeof(ProxyRequestContext*);
+  entry.priority = 0;
+  entry.type = request_type_forwarded_request;
+  if (!target.affinityRings[index]->tryEnqueue(entry)) {
+    stat_incr(stats, proxy_reqs_forward_full_stat, 1);
+    /* Never dispatched, nothing to reply to */
+    fwd->replied_ = true;
+    return false;
+  }
+
+  stat_incr(stats, proxy_reqs_forwarded_stat, 1);
+  ++numRequestsForwarded_;
+  /* Owned by the reply entry from now on */
+  fwd.release();
+  preq.release();
+  return true;
+}
+
+void proxy_t::onForwardedRequest(ProxyRequestContext* preq) {
+  std::unique_ptr<ProxyRequestContext> upreq(preq);
+  if (being_destroyed) {
+    upreq->sendReply(McReply(mc_res_unknown));
+    return;
+  }
+  /* Counts towards the load of this proxy, but doesn't go through
+     the rate limiting queue: the origin proxy already let it through */
+  upreq->processing_ = true;
+  ++numRequestsProcessing_;
+  stat_incr(stats, proxy_reqs_processing_stat, 1);
+  routeHandlesProcessRequest(std::move(upreq));
+}
+
+void proxy_t::onForwardedReply(ProxyRequestContext* preq) {
+  std::unique_ptr<ProxyRequestContext> upreq(preq);
+  --numRequestsForwarded_;
+  if (!upreq->reply_.hasValue()) {
+    upreq->sendReply(McReply(mc_res_unknown));
+    return;
+  }
+  upreq->sendReply(std::move(upreq->reply_.value()));
+}
+
 void proxy_t::dispatchRequest(std::unique_ptr<ProxyRequestContext> preq) {
+  if (tracer && (preq->traceId_ = tracer->sample()) != 0) {
+    preq->traceSpan(SpanKind::kClientRead, nullptr, "",
+                    preq->createdUs_, nowUs());
+  }
+
+  if (trafficCapture) {
+    trafficCapture->add(preq->origReq());
+  }
+
+  bool overQuota = false;
+  if (!admitToTenant(*preq)) {
+    stat_incr(stats, proxy_reqs_over_quota_stat, 1);
+    if (!opts.proxy_tenant_quota_demote || !opts.proxy_max_inflight_requests) {
+      preq->sendReply(McReply(mc_res_busy, "Tenant quota exceeded"));
+      return;
+    }
+    overQuota = true;
+  }
+
   if (rateLimited(*preq)) {
+    auto priority = overQuota ? RequestPriorities::kNumClasses - 1
+                              : priorityClass(*preq);
     if (opts.proxy_max_throttled_requests > 0 &&
-        waitingRequests_.size() >= opts.proxy_max_throttled_requests) {
+        numWaitingRequests_ >= opts.proxy_max_throttled_requests &&
+        !shedLessImportant(priority)) {
       preq->sendReply(McReply(mc_res_local_error, "Max throttled exceeded"));
       return;
     }
-    auto w = folly::make_unique<WaitingRequest>(std::move(preq));
-    waitingRequests_.pushBack(std::move(w));
+    auto w = folly::make_unique<WaitingRequest>(std::move(preq), priority);
+    waitingRequests_[priority].pushBack(std::move(w));
+    ++numWaitingRequests_;
     stat_incr(stats, proxy_reqs_waiting_stat, 1);
   } else {
     processRequest(std::move(preq));
   }
 }
 
+bool proxy_t::admitToTenant(ProxyRequestContext& preq) {
+  auto quotas = router ? router->tenantQuotas() : nullptr;
+  if (quotas == nullptr || alwaysLetThrough(preq.origReq()->op)) {
+    return true;
+  }
+  const auto& req = *preq.origReq();
+  auto tenant = quotas->tenantOf(folly::StringPiece(req.key.str, req.key.len));
+  if (tenant == nullptr) {
+    return true;
+  }
+  auto verdict = TenantQuotas::admit(*tenant, req.key.len + req.value.len);
+  if (verdict != TenantQuotas::Verdict::kAdmitted) {
+    return false;
+  }
+  preq.tenant_ = tenant;
+  return true;
+}
+
 bool proxy_t::rateLimited(const ProxyRequestContext& preq) const {
   if (!opts.proxy_max_inflight_requests) {
     return false;
   }
 
-  /* Always let through certain requests */
-  if (preq.origReq()->op == mc_op_stats ||
-      preq.origReq()->op == mc_op_version ||
-      preq.origReq()->op == mc_op_get_service_info) {
+  if (alwaysLetThrough(preq.origReq()->op)) {
     return false;
   }
 
-  if (waitingRequests_.empty() &&
+  if (numWaitingRequests_ == 0 &&
       numRequestsProcessing_ < opts.proxy_max_inflight_requests) {
     return false;
   }
@@ -326,19 +740,84 @@ bool proxy_t::rateLimited(const ProxyRequestContext& preq) const {
   return true;
 }
 
-proxy_t::WaitingRequest::WaitingRequest(std::unique_ptr<ProxyRequestContext> r)
-    : request(std::move(r)) {}
+proxy_t::WaitingRequest::WaitingRequest(std::unique_ptr<ProxyRequestContext> r,
+                                        size_t priority_)
+    : request(std::move(r)),
+      priority(priority_),
+      enqueueTimeUs(nowUs()) {}
 
 void proxy_t::pump() {
   while (numRequestsProcessing_ < opts.proxy_max_inflight_requests &&
-         !waitingRequests_.empty()) {
-    auto w = waitingRequests_.popFront();
+         numWaitingRequests_ > 0) {
+    auto w = popWaitingRequest();
     stat_decr(stats, proxy_reqs_waiting_stat, 1);
 
+    auto dequeueTimeUs = nowUs();
+    auto queueTimeUs = std::max<int64_t>(dequeueTimeUs - w->enqueueTimeUs, 0);
+    queueTimeUsByClass[w->priority].insertSample(queueTimeUs);
+    if (w->request->traceId()) {
+      w->request->traceSpan(SpanKind::kQueueWait, nullptr, "",
+                            w->enqueueTimeUs, dequeueTimeUs);
+    }
+    if (opts.proxy_queue_timeout_ms > 0 &&
+        queueTimeUs >= opts.proxy_queue_timeout_ms * 1000LL) {
+      // would most likely time out on the client anyway, don't waste
+      // destination capacity on it
+      stat_incr(stats, proxy_reqs_queue_timeout_stat, 1);
+      w->request->sendReply(McReply(mc_res_busy, "Queue timeout exceeded"));
+      continue;
+    }
+    if (w->request->clientGone() && isGetOp(w->request->origReq()->op)) {
+      stat_incr(stats, proxy_reqs_cancelled_stat, 1);
+      w->request->sendReply(McReply(mc_res_aborted, "Client gone"));
+      continue;
+    }
+
     processRequest(std::move(w->request));
   }
 }
 
+size_t proxy_t::priorityClass(const ProxyRequestContext& preq) const {
+  if (!requestPriorities_) {
+    return 0;
+  }
+  const auto& key = preq.origReq()->key;
+  return requestPriorities_->classOf(folly::StringPiece(key.str, key.len));
+}
+
+std::unique_ptr<proxy_t::WaitingRequest> proxy_t::popWaitingRequest() {
+  assert(numWaitingRequests_ > 0);
+  while (true) {
+    for (size_t i = 0; i < RequestPriorities::kNumClasses; ++i) {
+      if (dequeueCredits_[i] > 0 && !waitingRequests_[i].empty()) {
+        --dequeueCredits_[i];
+        --numWaitingRequests_;
+        return waitingRequests_[i].popFront();
+      }
+    }
+    // every class with waiting requests used up its share, next round
+    for (size_t i = 0; i < RequestPriorities::kNumClasses; ++i) {
+      dequeueCredits_[i] = RequestPriorities::kWeights[i];
+    }
+  }
+}
+
+bool proxy_t::shedLessImportant(size_t priority) {
+  for (size_t i = RequestPriorities::kNumClasses - 1; i > priority; --i) {
+    auto& queue = waitingRequests_[i];
+    if (!queue.empty()) {
+      auto w = queue.extract(queue.iterator_to(queue.back()));
+      --numWaitingRequests_;
+      stat_decr(stats, proxy_reqs_waiting_stat, 1);
+      stat_incr(stats, proxy_reqs_shed_stat, 1);
+      w->request->sendReply(McReply(mc_res_local_error,
+                                    "Max throttled exceeded"));
+      return true;
+    }
+  }
+  return false;
+}
+
 /** allocate a new reply with piggybacking copy of str and the appropriate
     fields of the value nstring pointing to it.
     str may be nullptr for no piggybacking string.
@@ -427,6 +906,11 @@ std::shared_ptr<const ShadowSettings::Data> ShadowSettings::getData() {
   return data_.get();
 }
 
+void ShadowSettings::setData(std::shared_ptr<const Data> data) {
+  data_.set(std::move(data));
+  version_.fetch_add(1, std::memory_order_release);
+}
+
 void ShadowSettings::registerOnUpdateCallback(McrouterInstance* router) {
   handle_ = router->rtVarsData().subscribeAndCall(
     [this](std::shared_ptr<const RuntimeVarsData> oldVars,
@@ -491,7 +975,7 @@ void ShadowSettings::registerOnUpdateCallback(McrouterInstance* router) {
         dataCopy->end_key_fraction = end_key_fraction_temp;
       }
 
-      this->data_.set(std::move(dataCopy));
+      this->setData(std::move(dataCopy));
     });
 }
 
@@ -502,6 +986,7 @@ void proxy_config_swap(proxy_t* proxy,
 
   auto oldConfig = proxy->swapConfig(std::move(config));
   stat_set_uint64(proxy->stats, config_last_success_stat, time(nullptr));
+  proxy->warmupDestinations();
 
   if (oldConfig) {
     auto configReq = new old_config_req_t(std::move(oldConfig));
@@ -511,7 +996,7 @@ void proxy_config_swap(proxy_t* proxy,
     oldConfigEntry.priority = 0;
     oldConfigEntry.type = request_type_old_config;
     oldConfigEntry.time_enqueued = time(nullptr);
-    asox_queue_enqueue(proxy->request_queue, &oldConfigEntry);
+    proxy->enqueueEntries(&oldConfigEntry, 1);
   }
 }
 
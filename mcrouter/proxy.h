@@ -17,15 +17,23 @@
 #include <sys/resource.h>
 #include <sys/types.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include <folly/detail/CacheLocality.h>
 #include <folly/Range.h>
 
 #include "mcrouter/config.h"
+#include "mcrouter/ConfigEpochs.h"
 #include "mcrouter/ExponentialSmoothData.h"
+#include "mcrouter/LatencyHistogram.h"
 #include "mcrouter/lib/fbi/asox_queue.h"
+#include "mcrouter/lib/fbi/counter.h"
 #include "mcrouter/lib/fbi/cpp/AtomicSharedPtr.h"
 #include "mcrouter/lib/fibers/FiberManager.h"
 #include "mcrouter/lib/mc/msg.h"
@@ -33,9 +41,12 @@
 #include "mcrouter/lib/McMsgRef.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/network/ConnectionOptions.h"
 #include "mcrouter/lib/network/UniqueIntrusiveList.h"
 #include "mcrouter/Observable.h"
 #include "mcrouter/options.h"
+#include "mcrouter/RequestArena.h"
+#include "mcrouter/RequestPriorities.h"
 #include "mcrouter/stats.h"
 
 // make sure MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND can be exactly divided by
@@ -51,25 +62,35 @@ namespace folly {
   class File;
 }
 
-class fb_timer_s;
-typedef class fb_timer_s fb_timer_t;
-
 namespace facebook { namespace memcache {
 
 class McReply;
+class ReadBufferPool;
+class RetryBudget;
 
 namespace mcrouter {
 // forward declaration
+class AsynclogSpool;
+class ClientTracker;
+class EventLoopLagProbe;
+class HotKeyTracker;
 class McrouterClient;
 class McrouterInstance;
 class ProxyConfig;
 class ProxyConfigIf;
 class ProxyClientCommon;
+class ProxyClock;
 class ProxyDestination;
 class ProxyDestinationMap;
 class ProxyRequestContext;
+class ProxyRequestRing;
+class RequestStatsBuffer;
+class RequestTracer;
+class TrafficCapture;
+class RttOutlierTracker;
 class RuntimeVarsData;
 class ShardSplitter;
+class StageProfiler;
 
 typedef Observable<std::shared_ptr<const RuntimeVarsData>>
   ObservableRuntimeVars;
@@ -94,8 +115,24 @@ struct ShadowSettings {
 
   std::shared_ptr<const Data> getData();
 
+  /**
+   * Replaces the data and bumps version().
+   */
+  void setData(std::shared_ptr<const Data> data);
+
+  /**
+   * Changes every time the data is replaced, so that readers can keep
+   * their own snapshot of getData() and refresh it only when the version
+   * they got it at is stale (see ShadowRoute). A single atomic load, unlike
+   * getData() which locks and copies a shared_ptr.
+   */
+  uint64_t version() const {
+    return version_.load(std::memory_order_acquire);
+  }
+
  private:
   AtomicSharedPtr<Data> data_;
+  std::atomic<uint64_t> version_{0};
   ObservableRuntimeVars::CallbackHandle handle_;
   void registerOnUpdateCallback(McrouterInstance* router);
 };
@@ -108,19 +145,97 @@ struct proxy_t {
   const McrouterOptions opts;
 
   asox_queue_t request_queue{0};
+  /* Used instead of request_queue if proxy_request_ring_size is set */
+  std::unique_ptr<ProxyRequestRing> requestRing;
   folly::EventBase* eventBase{nullptr};
 
+  /* Index of this proxy in its router */
+  const size_t index{0};
+
+  /**
+   * With --proxy-key-affinity or --proxy-offload-threshold: rings through
+   * which other proxies forward requests to this proxy and send back
+   * replies to requests this proxy forwarded, indexed by the producing
+   * proxy (one producer each). Set once affinityReady is true.
+   */
+  std::vector<std::unique_ptr<ProxyRequestRing>> affinityRings;
+  std::atomic<bool> affinityReady{false};
+
+  /**
+   * Set if --target-read-buffer-pool-size is enabled: read buffers lent to
+   * target connections. Declared before anything that holds destinations,
+   * so that it outlives them.
+   */
+  std::unique_ptr<ReadBufferPool> targetReadBuffers;
+
+  /**
+   * Request bytes held by the target connections of the proxy, limited
+   * by --proxy-max-outstanding-target-bytes. Declared before anything that
+   * holds destinations, so that it outlives them.
+   */
+  OutstandingBytesLimit targetOutstandingBytes;
+
+  /* Set if --failover-retry-budget-pct is enabled */
+  std::unique_ptr<RetryBudget> failoverBudget;
+
   std::unique_ptr<ProxyDestinationMap> destinationMap;
 
   // async spool related
   std::shared_ptr<folly::File> async_fd{nullptr};
   time_t async_spool_time{0};
+  /* Set if --asynclog-batch is enabled */
+  std::unique_ptr<AsynclogSpool> asynclogSpool;
 
-  std::mutex stats_lock;
+  /*
+   * Stat values are only accessed with relaxed atomics (see stat_incr() and
+   * friends), so other threads can take a snapshot at any time without
+   * blocking the proxy. Rate stats are drained by the stat updater thread
+   * with an atomic exchange.
+   */
   stat_t stats[num_stats];
 
+  /*
+   * Request contexts alive (see proxy_request_num_outstanding). They're
+   * created on client threads and destroyed on the proxy thread, so this
+   * spreads over per-thread slots once they contend instead of sharing
+   * the stats cache lines. Summed when stats are read.
+   */
+  counter_t requestContextsOutstanding{};
+
   static constexpr double kExponentialFactor{1.0 / 64.0};
   ExponentialSmoothData durationUs{kExponentialFactor};
+  /* Distribution of request durations, per operation */
+  LatencyHistogram durationUsByOp[mc_nops];
+  /* Replies not accounted in the stats above yet, see ProxyRequestLogger */
+  std::unique_ptr<RequestStatsBuffer> requestStats;
+  /* Time requests spent in the proxy queue (see
+     --proxy-max-inflight-requests), per priority class */
+  LatencyHistogram queueTimeUsByClass[RequestPriorities::kNumClasses];
+
+  /*
+   * Proxy thread saturation: lateness of a periodic timer (see
+   * --loop-lag-interval-ms), time between a client sending a request and
+   * the proxy picking it up, fibers ready when a fiber loop starts and
+   * time the loop took to run them.
+   */
+  LatencyHistogram loopLagUs;
+  LatencyHistogram requestQueueLagUs;
+  LatencyHistogram fibersReadyPerLoop;
+  LatencyHistogram fiberLoopRunUs;
+  /* Time from queueing to being replicated, see ReplicationQueueRoute */
+  LatencyHistogram replicationLagUs;
+  /* Latest loop lag sample, read by other proxies (--proxy-offload-*) */
+  std::atomic<uint64_t> lastLoopLagUs{0};
+
+  /*
+   * Sampled fiber stack usage in bytes, keyed by mangled name of the
+   * type of the route handle RootRoute routed the fiber's request to
+   * (nullptr for other fibers), see --fibers-stack-sample-rate. Only the
+   * proxy thread inserts, holding stackUsageLock; other threads must hold
+   * it while reading.
+   */
+  std::unordered_map<const char*, LatencyHistogram> stackUsageByRoute;
+  std::mutex stackUsageLock;
 
   // we are wasting some memory here to get faster mapping from stat name to
   // stats_bin[] and stats_num_within_window[] entry. i.e., the stats_bin[]
@@ -136,8 +251,9 @@ struct proxy_t {
    * once every MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND second by setting the
    * oldest time bin to stats[stat_name], and then reset stats[stat_name] to 0.
    */
-  uint64_t stats_bin[num_stats][MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND /
-                                MOVING_AVERAGE_BIN_SIZE_IN_SECOND];
+  uint64_t FOLLY_ALIGN_TO_AVOID_FALSE_SHARING
+  stats_bin[num_stats][MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND /
+                       MOVING_AVERAGE_BIN_SIZE_IN_SECOND];
   /*
    * stats_num_within_window[stat_name] contains the count of stat "stat_name"
    * in the past MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND seconds. this array is
@@ -151,23 +267,85 @@ struct proxy_t {
    * increased by 1 every MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND seconds.
    * num_bins_used is at most MOVING_AVERAGE_WINDOW_SIZE_IN_SECOND /
    * MOVING_AVERAGE_BIN_SIZE_IN_SECOND
+   *
+   * stats_bin[], stats_num_within_window[] and num_bins_used are written
+   * only by the updater thread; readers use relaxed atomic loads.
    */
   int num_bins_used{0};
 
-  std::mt19937 randomGenerator;
+  /* Everything below is only touched by the proxy thread again, so keep it
+     off the cache lines the updater thread writes to */
+  std::mt19937 FOLLY_ALIGN_TO_AVOID_FALSE_SHARING randomGenerator;
+
+  /**
+   * Key and value bytes of shadow requests in flight, see
+   * --max-shadow-pending-bytes. Only accessed from the proxy thread.
+   */
+  size_t pendingShadowBytes{0};
+
+  /**
+   * Detached subrequests in flight, see --max-detached-subrequests.
+   * Only accessed from the proxy thread.
+   */
+  size_t detachedSubRequests{0};
+
+  /* Set if --hot-keys-sample-rate is enabled */
+  std::unique_ptr<HotKeyTracker> hotKeys;
+
+  /* Set if --rtt-outlier-samples and --logging-rtt-outlier-threshold-us
+     are enabled */
+  std::unique_ptr<RttOutlierTracker> rttOutliers;
+
+  /* Client connections, set by the standalone server before it starts */
+  std::unique_ptr<ClientTracker> clientTracker;
+
+  /**
+   * Set if --trace-sample-rate is enabled. Created with the proxy, since
+   * ProxyRequestContexts check the option from client threads.
+   */
+  std::unique_ptr<RequestTracer> tracer;
+
+  /* Set if --traffic-capture-file is enabled */
+  std::unique_ptr<TrafficCapture> trafficCapture;
+
+  /**
+   * Set if --stage-profiler-interval-ms is enabled, sampled by a router
+   * thread. Registered as the proxy thread's profile slot once the event
+   * base is attached.
+   */
+  std::unique_ptr<StageProfiler> stageProfiler;
+
+  /* Set once the event base is attached, see loopLagUs */
+  std::unique_ptr<EventLoopLagProbe> loopLagProbe;
+
+  /* Set once the event base is attached, see coarseNowSec() */
+  std::unique_ptr<ProxyClock> clock;
 
   /**
    * If true, processing new requests is not safe.
    */
   bool being_destroyed{false};
 
+  /**
+   * Blocks for per-request arenas. Must outlive the fiberManager,
+   * since requests still in flight are destroyed along with it.
+   */
+  RequestArenaPool requestArenaPool;
+
+  /**
+   * Configs pinned by requests routed on the proxy thread. Must outlive
+   * the fiberManager for the same reason as requestArenaPool.
+   */
+  ConfigEpochs<ProxyConfigIf> configEpochs;
+
   FiberManager fiberManager;
 
   std::unique_ptr<ProxyStatsContainer> statsContainer;
 
   proxy_t(McrouterInstance* router,
           folly::EventBase* eventBase,
-          const McrouterOptions& opts);
+          const McrouterOptions& opts,
+          size_t index = 0);
 
   ~proxy_t();
 
@@ -191,6 +369,12 @@ struct proxy_t {
   std::shared_ptr<ProxyConfigIf> swapConfig(
     std::shared_ptr<ProxyConfigIf> newConfig);
 
+  /**
+   * Thread-safe. Hands entries (see request_entry_type_t) over to the proxy
+   * thread through requestRing if it's enabled, request_queue otherwise.
+   */
+  void enqueueEntries(asox_queue_entry_t* entries, size_t nentries);
+
   /** Queue up and route the new incoming request */
   void dispatchRequest(std::unique_ptr<ProxyRequestContext> preq);
 
@@ -200,10 +384,24 @@ struct proxy_t {
    */
   void attachEventBase(folly::EventBase* eventBase);
 
+  /**
+   * Thread-safe. Starts connecting to the destinations of the current
+   * config in the proxy thread, if --destination-warmup-concurrency is set.
+   * Noop if there's no event base yet, it's called again once attached.
+   */
+  void warmupDestinations();
+
  private:
   /** Read/write lock for config pointer */
   SFRLock configLock_;
   std::shared_ptr<ProxyConfigIf> config_;
+  /**
+   * Bumped on every swapConfig(). The proxy thread only takes configLock_
+   * to refresh configEpochs when this is different from
+   * configEpochsVersion_.
+   */
+  std::atomic<uint64_t> configVersion_{0};
+  uint64_t configEpochsVersion_{0};
 
   pthread_t awriterThreadHandle_{0};
   void* awriterThreadStack_{nullptr};
@@ -214,6 +412,31 @@ struct proxy_t {
   void routeHandlesProcessRequest(std::unique_ptr<ProxyRequestContext> preq);
   void processRequest(std::unique_ptr<ProxyRequestContext> preq);
 
+  /**
+   * --proxy-key-affinity: proxy that should route this request,
+   * this proxy if the request must be routed locally.
+   */
+  proxy_t& affinityTarget(const ProxyRequestContext& preq);
+
+  /**
+   * --proxy-offload-threshold: least loaded proxy if this one is
+   * overloaded and there's an idle one, this proxy otherwise.
+   */
+  proxy_t& offloadTarget(const ProxyRequestContext& preq);
+
+  /**
+   * Routes a copy of the request on target, the reply comes back
+   * to this proxy (see request_type_forwarded_reply).
+   *
+   * @return false if target's ring is full, preq is left untouched then
+   */
+  bool forwardRequest(proxy_t& target,
+                      std::unique_ptr<ProxyRequestContext>& preq);
+
+  /** Handles request_type_forwarded_request/reply entries */
+  void onForwardedRequest(ProxyRequestContext* preq);
+  void onForwardedReply(ProxyRequestContext* preq);
+
   /**
    * Incoming request rate limiting.
    *
@@ -227,6 +450,9 @@ struct proxy_t {
   /** Number of requests processing */
   size_t numRequestsProcessing_{0};
 
+  /** Requests processing that were forwarded to other proxies */
+  size_t numRequestsForwarded_{0};
+
   /**
    * We use this wrapper instead of putting 'hook' inside ProxyRequestContext
    * directly due to an include cycle:
@@ -238,11 +464,27 @@ struct proxy_t {
     using Queue = UniqueIntrusiveList<WaitingRequest,
                                       &WaitingRequest::hook>;
     std::unique_ptr<ProxyRequestContext> request;
-    explicit WaitingRequest(std::unique_ptr<ProxyRequestContext> r);
+    size_t priority;
+    int64_t enqueueTimeUs;
+    WaitingRequest(std::unique_ptr<ProxyRequestContext> r, size_t priority);
   };
 
-  /** Queue of requests we didn't start processing yet */
-  WaitingRequest::Queue waitingRequests_;
+  /**
+   * Queues of requests we didn't start processing yet, by priority class.
+   * Without --proxy-queue-priorities all requests are in class 0.
+   */
+  WaitingRequest::Queue waitingRequests_[RequestPriorities::kNumClasses];
+  size_t numWaitingRequests_{0};
+  /** Requests left to dequeue from each class in the current round */
+  size_t dequeueCredits_[RequestPriorities::kNumClasses] = {0};
+  std::unique_ptr<RequestPriorities> requestPriorities_;
+
+  /**
+   * Charges the request to its tenant (see --proxy-tenant-quotas).
+   *
+   * @return false if the tenant is over quota
+   */
+  bool admitToTenant(ProxyRequestContext& preq);
 
   /** If true, we can't start processing this request right now */
   bool rateLimited(const ProxyRequestContext& preq) const;
@@ -250,9 +492,25 @@ struct proxy_t {
   /** Will let through requests from the above queue if we have capacity */
   void pump();
 
+  size_t priorityClass(const ProxyRequestContext& preq) const;
+
+  /**
+   * @return next waiting request by weighted round robin over classes
+   */
+  std::unique_ptr<WaitingRequest> popWaitingRequest();
+
+  /**
+   * Refuses the newest waiting request of a class less important than
+   * priority, to make room in the full queue.
+   *
+   * @return false if there's no such request
+   */
+  bool shedLessImportant(size_t priority);
+
   /** Called once after a valid eventBase has been provided */
   void onEventBaseAttached();
 
+  friend class McrouterClient;
   friend class ProxyRequestContext;
 };
 
@@ -269,6 +527,10 @@ enum request_entry_type_t {
   request_type_disconnect,
   request_type_old_config,
   request_type_router_shutdown,
+  /* --proxy-key-affinity: request routed on behalf of another proxy */
+  request_type_forwarded_request,
+  /* --proxy-key-affinity: reply to a request this proxy forwarded */
+  request_type_forwarded_reply,
 };
 
 void proxy_config_swap(proxy_t* proxy,
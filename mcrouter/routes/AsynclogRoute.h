@@ -10,6 +10,7 @@
 #pragma once
 
 #include "mcrouter/async.h"
+#include "mcrouter/AsynclogSpool.h"
 #include "mcrouter/awriter.h"
 #include "mcrouter/config-impl.h"
 #include "mcrouter/lib/McOperationTraits.h"
@@ -60,16 +61,28 @@ class AsynclogRoute {
     if (!dest) {
       return reply;
     }
-    folly::StringPiece key = dest->keep_routing_prefix ?
+    folly::StringPiece key = dest->settings.keep_routing_prefix ?
       req.fullKey() :
       req.keyWithoutRoute();
     folly::StringPiece asynclogName = asynclogName_;
 
     auto proxy = &req.context().proxy();
+    if (proxy->asynclogSpool) {
+      if (!proxy->asynclogSpool->add(dest->ap.getHost(), dest->ap.getPort(),
+                                     asynclogName, key)) {
+        logFailure(proxy->router,
+                   memcache::failure::Category::kOutOfResources,
+                   "Asynclog batch is full, dropped request (key {}, pool {})",
+                   key, asynclogName);
+      }
+      return NullRoute<RouteHandleIf>::route(req, Operation());
+    }
+
     Baton b;
     auto res = proxy->router->asyncWriter().run(
-      [&b, proxy, &dest, key, asynclogName] () {
-        asynclog_delete(proxy, dest, key, asynclogName);
+      [&b, proxy, dest, key, asynclogName] () {
+        /* The request, and so its config and dest, outlive the wait below */
+        asynclog_delete(proxy, *dest, key, asynclogName);
         b.post();
       }
     );
@@ -62,6 +62,12 @@ bool BigValueRoute<RouteHandleIf>::ChunksInfo::valid() const {
   return valid_;
 }
 
+template <class RouteHandleIf>
+bool BigValueRoute<RouteHandleIf>::ChunksInfo::sameChunks(
+    const ChunksInfo& other) const {
+  return numChunks_ == other.numChunks_ && randSuffix_ == other.randSuffix_;
+}
+
 template <class RouteHandleIf>
 template <class Operation, class Request>
 std::vector<std::shared_ptr<RouteHandleIf>>
@@ -84,35 +90,64 @@ typename ReplyType<Operation, Request>::type
 BigValueRoute<RouteHandleIf>::route(const Request& req,
                                     Operation,
                                     typename GetLike<Operation>::Type) const {
-  auto initialReply = ch_->route(req, Operation());
-  if (!initialReply.isHit() ||
-      !(initialReply.flags() & MC_MSG_FLAG_BIG_VALUE)) {
-    return initialReply;
+  typedef typename ReplyType<Operation, Request>::type Reply;
+
+  auto key = req.fullKey();
+  auto cached_info = findManifest(key);
+  folly::Optional<Reply> initialReply;
+  std::vector<Reply> replies;
+  if (cached_info) {
+    // Save a round trip: fetch the chunks we expect along with the manifest
+    auto reqs = chunkGetRequests(req, *cached_info, Operation());
+    std::vector<std::function<void()>> fs;
+    fs.push_back(
+      [this, &req, &initialReply]() {
+        initialReply.emplace(ch_->route(req, Operation()));
+      }
+    );
+    fs.push_back(
+      [this, &reqs, &replies]() {
+        replies = fetchChunks<Reply>(reqs);
+      }
+    );
+    fiber::whenAll(fs.begin(), fs.end());
+  } else {
+    initialReply.emplace(ch_->route(req, Operation()));
   }
 
-  typedef typename ReplyType<Operation, Request>::type Reply;
-  auto buf = initialReply.value().clone();
+  if (!initialReply->isHit() ||
+      !(initialReply->flags() & MC_MSG_FLAG_BIG_VALUE)) {
+    if (cached_info) {
+      eraseManifest(key);
+    }
+    return std::move(*initialReply);
+  }
+
+  auto buf = initialReply->value().clone();
   ChunksInfo chunks_info(coalesceAndGetRange(buf));
   if (!chunks_info.valid()) {
+    if (cached_info) {
+      eraseManifest(key);
+    }
     return NullRoute<RouteHandleIf>::route(req, Operation());
   }
 
-  auto reqs = chunkGetRequests(req, chunks_info, Operation());
-  std::vector<std::function<Reply()>> fs;
-  fs.reserve(reqs.size());
-
-  auto& target = *ch_;
-  for (const auto& req_b : reqs) {
-    fs.push_back(
-      [&target, &req_b]() {
-        return target.route(req_b, ChunkGetOP());
-      }
-    );
+  // Fetching and merging the chunks is deep, do it on a large stack
+  // (if there are any) so that the common small gets don't need one
+  auto reply = fiber::runInLargeStack([&]() {
+    if (!cached_info || !cached_info->sameChunks(chunks_info)) {
+      auto reqs = chunkGetRequests(req, chunks_info, Operation());
+      replies = fetchChunks<Reply>(reqs);
+    }
+    return mergeChunkGetReplies(
+      replies.begin(), replies.end(), std::move(*initialReply));
+  });
+  if (reply.isHit()) {
+    saveManifest(key, chunks_info);
+  } else if (cached_info) {
+    eraseManifest(key);
   }
-
-  auto replies = fiber::whenAll(fs.begin(), fs.end());
-  return mergeChunkGetReplies(
-    replies.begin(), replies.end(), std::move(initialReply));
+  return reply;
 }
 
 template <class RouteHandleIf>
@@ -128,32 +163,42 @@ BigValueRoute<RouteHandleIf>::route(
     return ch_->route(req, Operation());
   }
 
-  auto reqs_info_pair = chunkUpdateRequests(req, Operation());
-  std::vector<std::function<Reply()>> fs;
-  fs.reserve(reqs_info_pair.first.size());
-
-  auto& target = *ch_;
-  for (const auto& req_b : reqs_info_pair.first) {
-    fs.push_back(
-      [&target, &req_b]() {
-        return target.route(req_b, ChunkUpdateOP());
+  // Splitting the value and reducing the chunk replies runs on a large
+  // stack, if the proxy has any
+  return fiber::runInLargeStack([this, &req]() {
+    auto reqs_info_pair = chunkUpdateRequests(req, Operation());
+    std::vector<std::function<Reply()>> fs;
+    fs.reserve(reqs_info_pair.first.size());
+
+    auto& target = *ch_;
+    for (const auto& req_b : reqs_info_pair.first) {
+      fs.push_back(
+        [&target, &req_b]() {
+          return target.route(req_b, ChunkUpdateOP());
+        }
+      );
+    }
+
+    auto replies = fiber::whenAll(fs.begin(), fs.end());
+
+    // reply for all chunk update requests
+    auto reducedReply = Reply::reduce(replies.begin(), replies.end());
+    if (reducedReply->isStored()) {
+      // original key with modified value stored at the back
+      auto new_req = req.clone();
+      new_req.setFlags(req.flags() | MC_MSG_FLAG_BIG_VALUE);
+      new_req.setValue(reqs_info_pair.second.toStringType());
+      auto reply = ch_->route(std::move(new_req), Operation());
+      if (reply.isStored()) {
+        saveManifest(req.fullKey(), reqs_info_pair.second);
+      } else {
+        eraseManifest(req.fullKey());
       }
-    );
-  }
-
-  auto replies = fiber::whenAll(fs.begin(), fs.end());
-
-  // reply for all chunk update requests
-  auto reducedReply = Reply::reduce(replies.begin(), replies.end());
-  if (reducedReply->isStored()) {
-    // original key with modified value stored at the back
-    auto new_req = req.clone();
-    new_req.setFlags(req.flags() | MC_MSG_FLAG_BIG_VALUE);
-    new_req.setValue(reqs_info_pair.second.toStringType());
-    return ch_->route(std::move(new_req), Operation());
-  } else {
-    return Reply(reducedReply->result());
-  }
+      return reply;
+    } else {
+      return Reply(reducedReply->result());
+    }
+  });
 }
 
 template <class RouteHandleIf>
@@ -245,6 +290,95 @@ Reply BigValueRoute<RouteHandleIf>::mergeChunkGetReplies(
   return std::move(initial_reply);
 }
 
+template <class RouteHandleIf>
+template <class Reply, class ChunkRequest>
+std::vector<Reply> BigValueRoute<RouteHandleIf>::fetchChunks(
+    const std::vector<ChunkRequest>& reqs) const {
+  auto& target = *ch_;
+  if (options_.maxChunkFanout_ == 0 ||
+      options_.maxChunkFanout_ >= reqs.size()) {
+    std::vector<std::function<Reply()>> fs;
+    fs.reserve(reqs.size());
+    for (const auto& req_b : reqs) {
+      fs.push_back(
+        [&target, &req_b]() {
+          return target.route(req_b, ChunkGetOP());
+        }
+      );
+    }
+    return fiber::whenAll(fs.begin(), fs.end());
+  }
+
+  // A fixed number of workers, each getting the next chunk not taken yet
+  std::vector<folly::Optional<Reply>> replies(reqs.size());
+  folly::Optional<Reply> miss;
+  size_t next = 0;
+  std::vector<std::function<void()>> workers(
+    options_.maxChunkFanout_,
+    [&target, &reqs, &replies, &miss, &next]() {
+      while (!miss && next < reqs.size()) {
+        auto i = next++;
+        auto reply = target.route(reqs[i], ChunkGetOP());
+        if (!reply.isHit()) {
+          if (!miss) {
+            miss.emplace(std::move(reply));
+          }
+          return;
+        }
+        replies[i].emplace(std::move(reply));
+      }
+    }
+  );
+  fiber::whenAll(workers.begin(), workers.end());
+
+  std::vector<Reply> result;
+  if (miss) {
+    result.push_back(std::move(*miss));
+    return result;
+  }
+  result.reserve(replies.size());
+  for (auto& reply : replies) {
+    result.push_back(std::move(*reply));
+  }
+  return result;
+}
+
+template <class RouteHandleIf>
+folly::Optional<typename BigValueRoute<RouteHandleIf>::ChunksInfo>
+BigValueRoute<RouteHandleIf>::findManifest(folly::StringPiece key) const {
+  if (options_.manifestCacheSize_ == 0) {
+    return folly::none;
+  }
+  auto it = manifests_.find(key.str());
+  if (it == manifests_.end()) {
+    return folly::none;
+  }
+  return it->second;
+}
+
+template <class RouteHandleIf>
+void BigValueRoute<RouteHandleIf>::saveManifest(folly::StringPiece key,
+                                                const ChunksInfo& info) const {
+  if (options_.manifestCacheSize_ == 0) {
+    return;
+  }
+  auto keyStr = key.str();
+  manifests_.erase(keyStr);
+  if (manifests_.size() >= options_.manifestCacheSize_) {
+    // Evict an arbitrary entry, hot keys come back soon enough
+    manifests_.erase(manifests_.begin());
+  }
+  manifests_.emplace(std::move(keyStr), info);
+}
+
+template <class RouteHandleIf>
+void BigValueRoute<RouteHandleIf>::eraseManifest(folly::StringPiece key) const {
+  if (options_.manifestCacheSize_ == 0) {
+    return;
+  }
+  manifests_.erase(key.str());
+}
+
 template <class RouteHandleIf>
 folly::IOBuf BigValueRoute<RouteHandleIf>::createChunkKey(
     folly::StringPiece base_key,
@@ -9,9 +9,12 @@
  */
 #pragma once
 
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <folly/Format.h>
+#include <folly/Optional.h>
 
 #include "mcrouter/lib/McOperation.h"
 #include "mcrouter/lib/OperationTraits.h"
@@ -38,9 +41,13 @@ struct ChunkUpdateRequest {
  * For get-like request:
  * 1. Perform get-like request on child route handle.
  * 2. If the received reply is a reply for big get request, generate chunk
- * getlike requests and forward to child route handle.
- * Merge all the replies and return it.
+ * getlike requests and forward to child route handle (at most
+ * maxChunkFanout_ at a time, stopping at the first miss).
+ * Chain all the chunk values without copying and return it.
  * 3. Else return the reply.
+ * If the chunk manifest of the key is cached (see manifestCacheSize_), chunks
+ * are fetched concurrently with the original key, and only used if the reply
+ * still refers to the same chunks. Otherwise they are fetched again.
  *
  * For update-like request:
  * 1. If value size is below or equal to threshold option,
@@ -95,6 +102,11 @@ class BigValueRoute {
     uint32_t randSuffix() const;
     bool valid() const;
 
+    /**
+     * @return true if both refer to the same chunk keys
+     */
+    bool sameChunks(const ChunksInfo& other) const;
+
    private:
     const uint32_t infoVersion_;
     uint32_t numChunks_;
@@ -105,6 +117,23 @@ class BigValueRoute {
   typedef McOperation<mc_op_get> ChunkGetOP;
   typedef McOperation<mc_op_set> ChunkUpdateOP;
 
+  /* Chunk manifests by key. Route handles are per proxy, so this is only
+     accessed from one thread. */
+  mutable std::unordered_map<std::string, ChunksInfo> manifests_;
+
+  folly::Optional<ChunksInfo> findManifest(folly::StringPiece key) const;
+  void saveManifest(folly::StringPiece key, const ChunksInfo& info) const;
+  void eraseManifest(folly::StringPiece key) const;
+
+  /**
+   * Gets all chunks, at most maxChunkFanout_ at a time. With a limit, stops
+   * at the first reply which is not a hit.
+   *
+   * @return replies in chunk order, or only the first non-hit reply
+   */
+  template <class Reply, class ChunkRequest>
+  std::vector<Reply> fetchChunks(const std::vector<ChunkRequest>& reqs) const;
+
   template <class Operation, class Request>
   std::pair<std::vector<typename ChunkUpdateRequest<Request>::type>, ChunksInfo>
   chunkUpdateRequests(const Request& req, Operation) const;
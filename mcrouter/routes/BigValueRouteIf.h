@@ -9,13 +9,24 @@
  */
 #pragma once
 
+#include <cstddef>
+
 namespace facebook { namespace memcache {
 
 struct BigValueRouteOptions {
-  explicit BigValueRouteOptions(size_t threshold) :
-    threshold_(threshold) {
+  explicit BigValueRouteOptions(size_t threshold,
+                                size_t maxChunkFanout = 0,
+                                size_t manifestCacheSize = 0) :
+    threshold_(threshold),
+    maxChunkFanout_(maxChunkFanout),
+    manifestCacheSize_(manifestCacheSize) {
   }
   const size_t threshold_;
+  /* Max number of chunk gets in flight for one request, 0 means no limit */
+  const size_t maxChunkFanout_;
+  /* Number of chunk manifests of recently seen big values to remember,
+     0 disables the cache */
+  const size_t manifestCacheSize_;
 };
 
 }}
@@ -0,0 +1,350 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/ExceptionWrapper.h>
+#include <folly/io/IOBuf.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fibers/Baton.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/fibers/FiberPromise.h"
+#include "mcrouter/lib/HotKeys.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/Reply.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Coalesces identical get-like requests (same operation and full key)
+ * that are in flight at the same time: only the first one is sent to
+ * the target, all the others wait for it to complete and get a copy
+ * of its reply. Other operations are passed through as is.
+ *
+ * A lease token belongs to the client it was given to, so lease-gets are
+ * only coalesced with lease_wait_ms set, where the callers that didn't get
+ * the token are parked (see below) instead of sharing it.
+ *
+ * With hot_keys_min_share set, only keys that are at least that share of
+ * the proxy's sampled requests are coalesced (see --hot-keys-sample-rate),
+ * others skip the in-flight map entirely.
+ *
+ * With lease_wait_ms set, coalesced lease-gets that miss are parked in the
+ * proxy for up to that long instead of making clients poll the target:
+ * when a lease-get misses with a lease token, the lease-get that got
+ * the token gets its reply as usual, while all the others for the key,
+ * and the ones that get a hot miss (token 1), wait for a lease-set or set
+ * of the key through this route, and get its value if it's stored.
+ * If the set fails, another update or delete of the key comes first,
+ * or the wait times out, they get a hot miss and retry as they would
+ * without this route.
+ *
+ * Route handles are created per proxy, so in-flight requests are tracked
+ * per proxy and no synchronization is needed.
+ *
+ * Example:
+ *  {
+ *    "type": "CoalescingRoute",
+ *    "target": "PoolRoute|A",
+ *    "hot_keys_min_share": 0.01,
+ *    "lease_wait_ms": 100
+ *  }
+ */
+template <class RouteHandleIf>
+class CoalescingRoute {
+ public:
+  static std::string routeName() { return "coalescing"; }
+
+  explicit CoalescingRoute(std::shared_ptr<RouteHandleIf> target,
+                           std::chrono::milliseconds leaseWait =
+                             std::chrono::milliseconds(0))
+      : target_(std::move(target)),
+        leaseWait_(leaseWait) {
+  }
+
+  CoalescingRoute(RouteHandleFactory<RouteHandleIf>& factory,
+                  const folly::dynamic& json) {
+    checkLogic(json.isObject(), "CoalescingRoute should be an object");
+    auto jtarget = json.get_ptr("target");
+    checkLogic(jtarget, "CoalescingRoute: no target");
+    target_ = factory.create(*jtarget);
+    if (auto jshare = json.get_ptr("hot_keys_min_share")) {
+      checkLogic(jshare->isNumber() && jshare->asDouble() >= 0 &&
+                 jshare->asDouble() <= 1,
+                 "CoalescingRoute: hot_keys_min_share is not in [0, 1]");
+      minHotShare_ = jshare->asDouble();
+    }
+    if (auto jleaseWait = json.get_ptr("lease_wait_ms")) {
+      checkLogic(jleaseWait->isInt() && jleaseWait->getInt() >= 0,
+                 "CoalescingRoute: lease_wait_ms is not an integer >= 0");
+      leaseWait_ = std::chrono::milliseconds(jleaseWait->getInt());
+    }
+  }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    return { target_ };
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename GetLike<Operation>::Type = 0) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+
+    if (minHotShare_ != 0 && !isHotKey(req, minHotShare_)) {
+      return target_->route(req, Operation());
+    }
+
+    /* Only lease-gets are parked, see waitForLease() */
+    bool leases = std::is_same<Operation, McOperation<mc_op_lease_get>>::value;
+    if (leases && leaseWait_.count() == 0) {
+      return target_->route(req, Operation());
+    }
+    if (leases && hasLease(req.fullKey())) {
+      return waitForLease<Reply>(req.fullKey());
+    }
+
+    auto key = folly::to<std::string>(mc_op_to_string(Operation::mc_op), ' ',
+                                      req.fullKey());
+    auto it = inflight_.find(key);
+    if (it != inflight_.end()) {
+      auto& waiters = it->second;
+      auto reply = fiber::await(
+        [&waiters](FiberPromise<std::shared_ptr<const McReply>> promise) {
+          waiters.push_back(std::move(promise));
+        });
+      if (leases && isLeaseMiss(*reply)) {
+        /* Either the lease token went to the first lease-get,
+           or it's a hot miss */
+        return waitForLease<Reply>(req.fullKey());
+      }
+      return copyReply<Reply>(*reply);
+    }
+
+    inflight_.emplace(key, Waiters());
+    try {
+      auto reply = target_->route(req, Operation());
+      if (leases && isLeaseMiss(reply)) {
+        startLease(req.fullKey());
+      }
+      auto shared = std::make_shared<McReply>(copyReply<McReply>(reply));
+      for (auto& promise : extractWaiters(key)) {
+        promise.setValue(shared);
+      }
+      if (leases && isLeaseMiss(reply) && reply.leaseToken() == kHotMiss) {
+        return waitForLease<Reply>(req.fullKey());
+      }
+      return reply;
+    } catch (const std::exception& e) {
+      auto ew = folly::exception_wrapper(std::current_exception(), e);
+      for (auto& promise : extractWaiters(key)) {
+        promise.setException(ew);
+      }
+      throw;
+    }
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    OtherThanT(Operation, GetLike<>) = 0) {
+
+    auto reply = target_->route(req, Operation());
+    if (!leases_.empty()) {
+      finishLease(req, reply, Operation());
+    }
+    return reply;
+  }
+
+ private:
+  using Waiters = std::vector<FiberPromise<std::shared_ptr<const McReply>>>;
+  using Clock = std::chrono::steady_clock;
+
+  /* Lease token of a miss while someone else holds the lease */
+  static constexpr uint64_t kHotMiss = 1;
+  static constexpr size_t kMinLeaseSweep = 1024;
+
+  struct LeaseWaiter {
+    Baton baton;
+    /* nullptr if the lease ended without a value */
+    std::shared_ptr<const McReply> reply;
+  };
+
+  struct Lease {
+    Clock::time_point expires;
+    std::vector<LeaseWaiter*> waiters;
+  };
+
+  std::shared_ptr<RouteHandleIf> target_;
+  /* 0 coalesces every key */
+  double minHotShare_{0};
+  /* 0 never parks lease-gets */
+  std::chrono::milliseconds leaseWait_{0};
+  std::unordered_map<std::string, Waiters> inflight_;
+  /* Outstanding leases by full key */
+  std::unordered_map<std::string, Lease> leases_;
+  /* Expired leases are dropped when the map grows to this size */
+  size_t nextLeaseSweep_{kMinLeaseSweep};
+
+  template <class Reply>
+  static bool isLeaseMiss(const Reply& reply) {
+    return reply.isMiss() && reply.leaseToken() != 0;
+  }
+
+  bool hasLease(folly::StringPiece fullKey) {
+    auto it = leases_.find(fullKey.str());
+    if (it == leases_.end()) {
+      return false;
+    }
+    if (it->second.expires <= Clock::now() && it->second.waiters.empty()) {
+      leases_.erase(it);
+      return false;
+    }
+    return true;
+  }
+
+  void startLease(folly::StringPiece fullKey) {
+    auto now = Clock::now();
+    if (leases_.size() >= nextLeaseSweep_) {
+      for (auto it = leases_.begin(); it != leases_.end(); ) {
+        if (it->second.expires <= now && it->second.waiters.empty()) {
+          it = leases_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      nextLeaseSweep_ = std::max(kMinLeaseSweep, 2 * leases_.size());
+    }
+    leases_[fullKey.str()].expires = now + leaseWait_;
+  }
+
+  /**
+   * Waits until the lease of fullKey ends (it must have one).
+   *
+   * @return copy of the value stored by the lease-set, or a hot miss
+   */
+  template <class Reply>
+  Reply waitForLease(folly::StringPiece fullKey) {
+    auto key = fullKey.str();
+    auto it = leases_.find(key);
+    if (it == leases_.end()) {
+      /* Ended before we got here */
+      return hotMiss<Reply>();
+    }
+    LeaseWaiter waiter;
+    it->second.waiters.push_back(&waiter);
+    waiter.baton.timed_wait(it->second.expires);
+
+    /* The lease may have ended right as the wait timed out */
+    if (waiter.reply) {
+      return copyReply<Reply>(*waiter.reply);
+    }
+    it = leases_.find(key);
+    if (it != leases_.end()) {
+      auto& waiters = it->second.waiters;
+      waiters.erase(std::remove(waiters.begin(), waiters.end(), &waiter),
+                    waiters.end());
+      if (waiters.empty() && it->second.expires <= Clock::now()) {
+        leases_.erase(it);
+      }
+    }
+    return hotMiss<Reply>();
+  }
+
+  template <class Reply>
+  static Reply hotMiss() {
+    Reply reply(mc_res_notfound);
+    reply.setLeaseToken(kHotMiss);
+    return reply;
+  }
+
+  /**
+   * Ends the lease of the request key, if any: stored sets and lease-sets
+   * hand their value to the waiters, anything else sends them back
+   * to retry.
+   */
+  template <class Operation, class Request, class Reply>
+  void finishLease(const Request& req, const Reply& reply, Operation) {
+    auto it = leases_.find(req.fullKey().str());
+    if (it == leases_.end()) {
+      return;
+    }
+    auto waiters = std::move(it->second.waiters);
+    leases_.erase(it);
+
+    std::shared_ptr<const McReply> value;
+    if ((std::is_same<Operation, McOperation<mc_op_set>>::value ||
+         std::is_same<Operation, McOperation<mc_op_lease_set>>::value) &&
+        reply.result() == mc_res_stored) {
+      auto found = std::make_shared<McReply>(mc_res_found);
+      folly::IOBuf buf;
+      req.value().cloneInto(buf);
+      found->setValue(std::move(buf));
+      found->setFlags(req.flags());
+      value = std::move(found);
+    }
+    for (auto waiter : waiters) {
+      waiter->reply = value;
+      waiter->baton.post();
+    }
+  }
+
+  Waiters extractWaiters(const std::string& key) {
+    auto it = inflight_.find(key);
+    assert(it != inflight_.end());
+    auto waiters = std::move(it->second);
+    inflight_.erase(it);
+    return waiters;
+  }
+
+  /**
+   * Replies are not copyable, value is shared (not copied) between
+   * the original reply and the copy.
+   */
+  template <class ToReply, class FromReply>
+  static ToReply copyReply(const FromReply& from) {
+    ToReply to(from.result());
+    if (from.hasValue()) {
+      folly::IOBuf value;
+      from.value().cloneInto(value);
+      to.setValue(std::move(value));
+    }
+    to.setFlags(from.flags());
+    to.setLeaseToken(from.leaseToken());
+    to.setCas(from.cas());
+    to.setDelta(from.delta());
+    to.setAppSpecificErrorCode(from.appSpecificErrorCode());
+    return to;
+  }
+};
+
+template <class RouteHandleIf>
+constexpr uint64_t CoalescingRoute<RouteHandleIf>::kHotMiss;
+template <class RouteHandleIf>
+constexpr size_t CoalescingRoute<RouteHandleIf>::kMinLeaseSweep;
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,26 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "CompressionRoute.h"
+
+#include "mcrouter/routes/McRouteHandleBuilder.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+McrouterRouteHandlePtr makeCompressionRoute(
+  McrouterRouteHandlePtr rh,
+  std::unique_ptr<ValueCompressor> compressor) {
+
+  return makeMcrouterRouteHandle<CompressionRoute>(
+    std::move(rh),
+    std::move(compressor));
+}
+
+}}}  // facebook::memcache::mcrouter
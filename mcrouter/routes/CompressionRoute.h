@@ -0,0 +1,136 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/Format.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/lib/McOperationTraits.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/Reply.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyRequestContext.h"
+#include "mcrouter/routes/ValueCompressor.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Compresses values of set, add, replace, lease-set and cas requests
+ * that are at least threshold bytes long and aren't compressed already, and
+ * uncompresses values of get-like replies.
+ *
+ * Append and prepend are sent as is, so they must not be used on keys
+ * with compressed values. All routes reading keys written through this route
+ * must uncompress them, otherwise clients get values with an unknown
+ * compression flag.
+ */
+template <class RouteHandleIf>
+class CompressionRoute {
+ public:
+  std::string routeName() const {
+    return folly::sformat("compression|codec={}|threshold={}",
+                          ValueCompressor::codecName(compressor_->codec()),
+                          compressor_->threshold());
+  }
+
+  CompressionRoute(std::shared_ptr<RouteHandleIf> target,
+                   std::unique_ptr<ValueCompressor> compressor)
+      : target_(std::move(target)),
+        compressor_(std::move(compressor)) {
+  }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+    return { target_ };
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename GetLike<Operation>::Type = 0) const {
+
+    typedef typename ReplyType<Operation, Request>::type Reply;
+
+    auto reply = target_->route(req, Operation());
+    if (!reply.isHit() || !ValueCompressor::isCompressed(reply.flags())) {
+      return reply;
+    }
+
+    auto& proxy = req.context().proxy();
+    auto start = nowUs();
+    try {
+      auto codec = ValueCompressor::flagsCodec(reply.flags());
+      reply.setValue(compressor_->uncompress(reply.value(), reply.flags()));
+      reply.setFlags(reply.flags() & ~ValueCompressor::codecFlag(codec));
+      stat_incr(proxy.stats, ValueCompressor::cpuStat(codec),
+                nowUs() - start);
+    } catch (const std::exception& e) {
+      stat_incr(proxy.stats, compression_errors_stat, 1);
+      return Reply(ErrorReply,
+                   std::string("CompressionRoute: can't uncompress value: ") +
+                   e.what());
+    }
+    return reply;
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename UpdateLike<Operation>::Type = 0) const {
+
+    if (!compressible(Operation::mc_op) ||
+        (req.flags() & ValueCompressor::kCompressedFlags) ||
+        req.value().computeChainDataLength() < compressor_->threshold()) {
+      return target_->route(req, Operation());
+    }
+
+    auto& proxy = req.context().proxy();
+    auto start = nowUs();
+    auto length = req.value().computeChainDataLength();
+    auto compressed = compressor_->compress(req.value());
+    stat_incr(proxy.stats, ValueCompressor::cpuStat(compressor_->codec()),
+              nowUs() - start);
+    if (!compressed) {
+      return target_->route(req, Operation());
+    }
+
+    stat_incr(proxy.stats, compression_bytes_saved_stat,
+              length - compressed->computeChainDataLength());
+    auto newReq = req.clone();
+    newReq.setFlags(
+      req.flags() | ValueCompressor::codecFlag(compressor_->codec()));
+    newReq.setValue(std::move(*compressed));
+    return target_->route(newReq, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    OtherThanT(Operation, GetLike<>, UpdateLike<>) = 0) const {
+
+    return target_->route(req, Operation());
+  }
+
+ private:
+  const std::shared_ptr<RouteHandleIf> target_;
+  const std::unique_ptr<ValueCompressor> compressor_;
+
+  static bool compressible(mc_op_t op) {
+    return op == mc_op_set || op == mc_op_add || op == mc_op_replace ||
+           op == mc_op_lease_set || op == mc_op_cas;
+  }
+};
+
+}}}  // facebook::memcache::mcrouter
@@ -17,6 +17,16 @@ namespace facebook { namespace memcache { namespace mcrouter {
  */
 class DefaultShadowPolicy {
  public:
+  /**
+   * @return  true if updateRequestForShadowing() should be called to obtain
+   *          the request sent to both normal and shadow routes. Otherwise
+   *          the original request is used as is.
+   */
+  template <class Operation, class Request>
+  static bool shouldModifyRequest(const Request& req, Operation) {
+    return false;
+  }
+
   template <class Operation, class Request>
   static Request updateRequestForShadowing(const Request& req, Operation) {
     return req.clone();
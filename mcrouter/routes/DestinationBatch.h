@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <deque>
+#include <exception>
+#include <utility>
+#include <vector>
+
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/fibers/ForEach.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/SubRequests.h"
+#include "mcrouter/ProxyMcReply.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/routes/DestinationRoute.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * routeSubRequests() for mcrouter's fan-out routes.
+ *
+ * Updates and deletes that reach a DestinationRoute as they are (see
+ * McrouterRouteHandleIf::updateDestination()) are all sent from the
+ * calling fiber before it waits for any of the replies, so they don't take
+ * a fiber each, and the ones for the same destination can share one
+ * write batch. The other subrequests (gets, shadow requests, requests
+ * changed on the way) are routed on a fiber each meanwhile.
+ */
+template <int Op, class F>
+void routeSubRequests(
+    const std::vector<SubRequest<McrouterRouteHandleIf, ProxyMcRequest>>&
+      subReqs,
+    McOperation<Op>, F&& f) {
+  using Destination = DestinationRoute<McrouterRouteHandleIf>;
+
+  std::vector<const Destination*> destinations(subReqs.size(), nullptr);
+  if (!GetLike<McOperation<Op>>::value) {
+    /* Hash functions can be stack-intensive,
+       so jump back to the main context */
+    fiber::runInMainContext([&subReqs, &destinations]() {
+        for (size_t i = 0; i < subReqs.size(); ++i) {
+          const auto& req = *subReqs[i].req;
+          if (req.getRequestClass() != RequestClass::SHADOW) {
+            destinations[i] = subReqs[i].rh->updateDestination(req);
+          }
+        }
+      });
+  }
+
+  /* Started requests are referred to by their sends, a deque doesn't
+     move them */
+  std::deque<typename Destination::template PendingRoute<Op>> pending;
+  std::vector<size_t> pendingIds;
+  std::vector<std::pair<size_t, ProxyMcReply>> replies;
+  std::vector<size_t> routed;
+  for (size_t i = 0; i < subReqs.size(); ++i) {
+    if (!destinations[i]) {
+      routed.push_back(i);
+      continue;
+    }
+    pending.emplace_back();
+    auto refused = destinations[i]->startRoute(
+      *subReqs[i].req, McOperation<Op>(), pending.back());
+    if (refused) {
+      pending.pop_back();
+      replies.emplace_back(i, std::move(refused.value()));
+      continue;
+    }
+    pendingIds.push_back(i);
+  }
+
+  std::exception_ptr e;
+  try {
+    fiber::forEachBounded(
+      routed.size(), 0,
+      [&subReqs, &routed, &f] (size_t id) {
+        auto i = routed[id];
+        f(i, subReqs[i].rh->route(*subReqs[i].req, McOperation<Op>()));
+      });
+  } catch (...) {
+    e = std::current_exception();
+  }
+
+  /* Every started request is waited for, even if a fiber above threw */
+  for (size_t j = 0; j < pending.size(); ++j) {
+    replies.emplace_back(pendingIds[j],
+                         destinations[pendingIds[j]]->finishRoute(pending[j]));
+  }
+  if (e != std::exception_ptr()) {
+    std::rethrow_exception(e);
+  }
+  for (auto& reply : replies) {
+    f(reply.first, std::move(reply.second));
+  }
+}
+
+}}}  // facebook::memcache::mcrouter
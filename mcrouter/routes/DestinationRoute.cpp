@@ -16,11 +16,13 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 McrouterRouteHandlePtr makeDestinationRoute(
   std::shared_ptr<const ProxyClientCommon> client,
-  std::shared_ptr<ProxyDestination> destination) {
+  std::shared_ptr<ProxyDestination> destination,
+  std::shared_ptr<OutlierDetector> outlierDetector) {
 
   return makeMcrouterRouteHandle<DestinationRoute>(
     std::move(client),
-    std::move(destination));
+    std::move(destination),
+    std::move(outlierDetector));
 }
 
 }}}
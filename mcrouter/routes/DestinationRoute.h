@@ -9,6 +9,8 @@
  */
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <string>
@@ -16,6 +18,7 @@
 
 #include <folly/Format.h>
 #include <folly/Memory.h>
+#include <folly/Optional.h>
 #include <folly/ScopeGuard.h>
 
 #include "mcrouter/ClientPool.h"
@@ -24,8 +27,10 @@
 #include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/lib/fibers/FiberManager.h"
 #include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McOperationTraits.h"
 #include "mcrouter/lib/McReply.h"
 #include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/OutlierDetector.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/ProxyDestination.h"
@@ -40,6 +45,15 @@ namespace facebook { namespace memcache { namespace mcrouter {
 struct DestinationRequestCtx {
   int64_t startTime{0};
   int64_t endTime{0};
+  /* Server timeout was reduced to the time left until the request deadline */
+  bool deadlineClamped{false};
+  /* Gets only: the request is dropped instead of written once this is true
+     (see ProxyRequestContext::clientGone()) */
+  const std::atomic<bool>* cancellation{nullptr};
+  /* Set by ProxyDestination::send() if the request was dropped that way */
+  bool cancelled{false};
+  /* Send queue lane of the request, see --target-priority-lanes */
+  RequestPriority priority{RequestPriority::FOREGROUND_GET};
 
   DestinationRequestCtx() : startTime(nowUs()) {
   }
@@ -58,17 +72,27 @@ class DestinationRoute {
       client_->indexInPool,
       client_->useSsl,
       client_->ap.toString(),
-      client_->server_timeout.count());
+      client_->settings.server_timeout.count());
   }
 
   /**
    * @param client Client to send request to
    * @param destination The destination where the request is to be sent
+   * @param outlierDetector  shared by all destinations of the pool,
+   *                         indexed by client->indexInPool. May be null.
    */
   DestinationRoute(std::shared_ptr<const ProxyClientCommon> client,
-                   std::shared_ptr<ProxyDestination> destination) :
+                   std::shared_ptr<ProxyDestination> destination,
+                   std::shared_ptr<OutlierDetector> outlierDetector) :
       client_(std::move(client)),
-      destination_(std::move(destination)) {
+      destination_(std::move(destination)),
+      outlierDetector_(std::move(outlierDetector)) {
+  }
+
+  /* Only with --skip-dead-routes, see TkoTracker for the epoch */
+  bool knownDead() const {
+    return destination_->proxy->opts.skip_dead_routes &&
+           destination_->shared->tko.isTko();
   }
 
   template <class Operation>
@@ -99,7 +123,7 @@ class DestinationRoute {
     const Request& req, Operation,
     typename DeleteLike<Operation>::Type = 0) const {
 
-    auto deleteTime = client_->deleteTime;
+    auto deleteTime = client_->settings.deleteTime;
     if (deleteTime != 0 && (req.exptime() == 0 || req.exptime() > deleteTime)) {
       auto mutReq = req.clone();
       mutReq.setExptime(deleteTime);
@@ -108,30 +132,89 @@ class DestinationRoute {
     return routeImpl(req, Operation());
   }
 
+  /* This route sends every request to the destination as is, see
+     McrouterRouteHandleIf::updateDestination() */
+  const DestinationRoute* updateDestination(const ProxyMcRequest&) const {
+    return this;
+  }
+
+  /**
+   * A request started by startRoute(). Not movable once started, the send
+   * refers to its members.
+   */
+  template <int Op>
+  struct PendingRoute {
+    const ProxyMcRequest* req{nullptr};
+    /* Copy of a delete with the exptime changed (see route()) */
+    folly::Optional<ProxyMcRequest> mutReq;
+    folly::Optional<McRequest> newReq;
+    DestinationRequestCtx ctx;
+    ProxyDestination::PendingSend<Op, McRequest> send;
+  };
+
+  /**
+   * route() in two steps, so that one fiber can have requests to several
+   * destinations in flight (see routeSubRequests()): startRoute() sends req
+   * and returns right away, finishRoute() waits for the reply.
+   * Not for shadow requests.
+   *
+   * @return the reply if req is refused instead of sent, pending must
+   *         not be finished then
+   */
+  template <int Op>
+  folly::Optional<ProxyMcReply> startRoute(const ProxyMcRequest& req,
+                                           McOperation<Op>,
+                                           PendingRoute<Op>& pending) const {
+    assert(req.getRequestClass() != RequestClass::SHADOW);
+    destination_->prefetch();
+    pending.req = &req;
+    auto deleteTime = client_->settings.deleteTime;
+    if (DeleteLike<McOperation<Op>>::value && deleteTime != 0 &&
+        (req.exptime() == 0 || req.exptime() > deleteTime)) {
+      pending.mutReq.emplace(req.clone());
+      pending.mutReq->setExptime(deleteTime);
+      pending.req = pending.mutReq.get_pointer();
+    }
+
+    std::chrono::milliseconds timeout;
+    if (auto refused = prepareSend(*pending.req, McOperation<Op>(),
+                                   pending.ctx, timeout)) {
+      return refused;
+    }
+    pending.newReq.emplace(destinationRequest(*pending.req));
+    pending.send = destination_->startSend(*pending.newReq, McOperation<Op>(),
+                                           pending.ctx, timeout);
+    return folly::none;
+  }
+
+  template <int Op>
+  ProxyMcReply finishRoute(PendingRoute<Op>& pending) const {
+    auto reply = ProxyMcReply(
+      destination_->finishSend(std::move(pending.send), *pending.newReq,
+                               pending.ctx));
+    onSendReply(*pending.req, reply, pending.ctx, McOperation<Op>());
+    return reply;
+  }
+
  private:
   std::shared_ptr<const ProxyClientCommon> client_;
   std::shared_ptr<ProxyDestination> destination_;
+  std::shared_ptr<OutlierDetector> outlierDetector_;
   size_t pendingShadowReqs_{0};
 
   template <int Op>
   ProxyMcReply routeImpl(const ProxyMcRequest& req, McOperation<Op>) const {
 
-    auto proxy = &req.context().proxy();
-    if (!destination_->may_send()) {
-      ProxyMcReply reply(TkoReply);
-      reply.setDestination(client_);
-      req.context().onRequestRefused(req, reply);
-      return reply;
+    /* Likely a cache miss with many destinations, overlap it with
+       the checks below */
+    destination_->prefetch();
+    DestinationRequestCtx ctx;
+    std::chrono::milliseconds timeout;
+    if (auto refused = prepareSend(req, McOperation<Op>(), ctx, timeout)) {
+      return std::move(refused.value());
     }
 
     if (req.getRequestClass() == RequestClass::SHADOW) {
-      if (proxy->opts.target_max_shadow_requests > 0 &&
-          pendingShadowReqs_ >= proxy->opts.target_max_shadow_requests) {
-        ProxyMcReply reply(ErrorReply);
-        reply.setDestination(client_);
-        req.context().onRequestRefused(req, reply);
-        return reply;
-      }
       auto& mutableCounter = const_cast<size_t&>(pendingShadowReqs_);
       ++mutableCounter;
     }
@@ -143,28 +226,132 @@ class DestinationRoute {
       }
     });
 
-    auto& destination = destination_;
+    auto newReq = destinationRequest(req);
+    auto reply = ProxyMcReply(
+      destination_->send(newReq, McOperation<Op>(), ctx,
+                         req.context().senderId(),
+                         timeout));
+    onSendReply(req, reply, ctx, McOperation<Op>());
+    return reply;
+  }
 
-    DestinationRequestCtx ctx;
-    auto newReq = McRequest::cloneFrom(req, !client_->keep_routing_prefix);
+  ProxyMcReply refuse(const ProxyMcRequest& req, ProxyMcReply reply) const {
+    reply.setDestination(client_.get());
+    req.context().onRequestRefused(req, reply);
+    return reply;
+  }
 
-    auto reply = ProxyMcReply(
-      destination->send(newReq, McOperation<Op>(), ctx,
-                        req.context().senderId(),
-                        client_->server_timeout));
+  /**
+   * Checks made before req is sent, sets up ctx and the timeout for it.
+   *
+   * @return the reply to req if it's refused instead
+   */
+  template <int Op>
+  folly::Optional<ProxyMcReply> prepareSend(
+    const ProxyMcRequest& req, McOperation<Op>, DestinationRequestCtx& ctx,
+    std::chrono::milliseconds& timeout) const {
+
+    auto proxy = &req.context().proxy();
+    if (req.isCancelled()) {
+      /* a detached subrequest over --max-detached-subrequests */
+      return refuse(req, ProxyMcReply(mc_res_local_error,
+                                      "Subrequest cancelled"));
+    }
+
+    constexpr bool kCancellable = GetLike<McOperation<Op>>::value;
+    if (kCancellable && req.context().clientGone()) {
+      /* nobody waits for the reply */
+      stat_incr(proxy->stats, destination_cancelled_sends_stat, 1);
+      return refuse(req, ProxyMcReply(mc_res_aborted, "Client gone"));
+    }
+
+    if (!destination_->may_send()) {
+      return refuse(req, ProxyMcReply(TkoReply));
+    }
+
+    if (outlierDetector_ &&
+        outlierDetector_->isEjected(client_->indexInPool, nowUs())) {
+      return refuse(req, ProxyMcReply(TkoReply));
+    }
+
+    if (!destination_->underConcurrencyLimit()) {
+      stat_incr(proxy->stats, destination_concurrency_refused_stat, 1);
+      return refuse(req, ProxyMcReply(mc_res_busy));
+    }
+
+    if (req.getRequestClass() == RequestClass::SHADOW &&
+        proxy->opts.target_max_shadow_requests > 0 &&
+        pendingShadowReqs_ >= proxy->opts.target_max_shadow_requests) {
+      return refuse(req, ProxyMcReply(ErrorReply));
+    }
+
+    if (kCancellable) {
+      ctx.cancellation = req.context().cancellation();
+    }
+    ctx.priority = req.getPriority(McOperation<Op>());
+    timeout = destination_->requestTimeout(*client_);
+    if (req.getRequestClass() != RequestClass::SHADOW) {
+      // shadow requests don't hold up the reply, so they get the full timeout
+      if (auto remaining = req.context().remainingTime()) {
+        auto remainingMs =
+          std::chrono::duration_cast<std::chrono::milliseconds>(*remaining);
+        if (remainingMs.count() == 0) {
+          stat_incr(proxy->stats, request_deadline_exceeded_stat, 1);
+          return refuse(req, ProxyMcReply(mc_res_timeout,
+                                          "Request deadline exceeded"));
+        }
+        if (timeout.count() == 0 || remainingMs < timeout) {
+          timeout = remainingMs;
+          ctx.deadlineClamped = true;
+        }
+      }
+    }
+    return folly::none;
+  }
+
+  /* The copy of req actually sent to the destination */
+  McRequest destinationRequest(const ProxyMcRequest& req) const {
+    auto newReq = McRequest::cloneFrom(
+      req, !client_->settings.keep_routing_prefix);
+    if (newReq.noreply() &&
+        (client_->ap.getProtocol() == mc_ascii_protocol ||
+         client_->ap.getProtocol() == mc_ascii_meta_protocol)) {
+      auto proxy = &req.context().proxy();
+      stat_incr(proxy->stats, destination_noreply_requests_stat, 1);
+    }
+    return newReq;
+  }
+
+  /* Accounts the reply to req sent with ctx */
+  template <int Op>
+  void onSendReply(const ProxyMcRequest& req, ProxyMcReply& reply,
+                   const DestinationRequestCtx& ctx, McOperation<Op>) const {
+    auto proxy = &req.context().proxy();
     req.context().onReplyReceived(*client_,
                                   req,
                                   reply,
                                   ctx.startTime,
                                   ctx.endTime,
                                   McOperation<Op>());
+    if (req.context().traceId()) {
+      req.context().traceSpan(SpanKind::kDestination, nullptr,
+                              client_->destination_key,
+                              ctx.startTime, ctx.endTime);
+    }
+
+    if (outlierDetector_ && !ctx.cancelled &&
+        !(ctx.deadlineClamped && reply.result() == mc_res_timeout)) {
+      auto ejected = outlierDetector_->onReply(client_->indexInPool,
+                                               reply.isFailoverError(),
+                                               ctx.endTime - ctx.startTime,
+                                               ctx.endTime);
+      stat_incr(proxy->stats, destination_outlier_ejections_stat, ejected);
+    }
 
     // For AsynclogRoute
     if (reply.isFailoverError()) {
-      reply.setDestination(client_);
+      reply.setDestination(client_.get());
     }
-
-    return reply;
   }
 
   template <typename Operation>
@@ -34,6 +34,10 @@ class DevNullRoute {
     return {};
   }
 
+  static bool routesInline() {
+    return true;
+  }
+
   template <class Operation>
   static ProxyMcReply route(const ProxyMcRequest& req, Operation) {
 
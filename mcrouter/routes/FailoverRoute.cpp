@@ -15,7 +15,6 @@ namespace facebook { namespace memcache {
 
 template std::shared_ptr<mcrouter::McrouterRouteHandleIf>
 makeRouteHandle<mcrouter::McrouterRouteHandleIf, FailoverRoute>(
-  RouteHandleFactory<mcrouter::McrouterRouteHandleIf>&,
-  const folly::dynamic&);
+  std::vector<std::shared_ptr<mcrouter::McrouterRouteHandleIf>>&&);
 
 }}
@@ -18,6 +18,7 @@
 #include "mcrouter/config-impl.h"
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/RetryBudget.h"
 #include "mcrouter/lib/routes/FailoverRoute.h"
 #include "mcrouter/lib/routes/NullRoute.h"
 #include "mcrouter/ProxyClientCommon.h"
@@ -94,6 +95,7 @@ class FailoverWithExptimeRoute {
       return NullRoute<RouteHandleIf>::route(req, Operation());
     }
 
+    failoverPrimaryRequest(req);
     auto reply = normal_->route(req, Operation());
 
     if (!reply.isFailoverError() ||
@@ -112,6 +114,11 @@ class FailoverWithExptimeRoute {
       return reply;
     }
 
+    /* failover_ charges the budget again for its own failovers */
+    if (!failoverAllowed(req)) {
+      return reply;
+    }
+
     auto mutReq = req.clone();
     if (settings_.failoverTagging) {
       mutReq.setKey(keyWithFailoverTag(mutReq, reply));
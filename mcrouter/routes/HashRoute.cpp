@@ -11,6 +11,7 @@
 #include "mcrouter/lib/Crc32HashFunc.h"
 #include "mcrouter/lib/routes/HashRoute.h"
 #include "mcrouter/lib/WeightedCh3HashFunc.h"
+#include "mcrouter/lib/WeightedMaglevHashFunc.h"
 #include "mcrouter/routes/McRouteHandleBuilder.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 #include "mcrouter/routes/ShardHashFunc.h"
@@ -33,6 +34,12 @@ makeRouteHandle<mcrouter::McrouterRouteHandleIf, HashRoute,
   const folly::dynamic&,
   std::vector<std::shared_ptr<mcrouter::McrouterRouteHandleIf>>&&);
 
+template std::shared_ptr<mcrouter::McrouterRouteHandleIf>
+makeRouteHandle<mcrouter::McrouterRouteHandleIf, HashRoute,
+                WeightedMaglevHashFunc>(
+  const folly::dynamic&,
+  std::vector<std::shared_ptr<mcrouter::McrouterRouteHandleIf>>&&);
+
 template std::shared_ptr<mcrouter::McrouterRouteHandleIf>
 makeRouteHandle<mcrouter::McrouterRouteHandleIf, HashRoute,
                 mcrouter::ConstShardHashFunc>(
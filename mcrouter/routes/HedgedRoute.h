@@ -0,0 +1,269 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/Optional.h>
+
+#include "mcrouter/LatencyHistogram.h"
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/fibers/Baton.h"
+#include "mcrouter/lib/fibers/FiberManager.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/RetryBudget.h"
+#include "mcrouter/ProxyMcRequest.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Sends gets and metagets to the primary route handle. If there's no reply
+ * after a hedge delay, sends the same request to the alternate as well and
+ * returns the first non-error reply (or the last error reply if both
+ * failed). The other request completes asynchronously and its reply is
+ * dropped. If the primary replies with an error before the delay expires,
+ * the request is sent to the alternate right away, like FailoverRoute.
+ * Nothing is sent to the alternate once the request deadline has passed.
+ *
+ * With hedge_percentile set, the delay is the given percentile of the
+ * primary's reply latency over the last window of requests, capped at
+ * hedge_delay_ms; hedge_delay_ms alone is used until the first window
+ * is complete.
+ * Delays are rounded up to whole milliseconds, the granularity of fiber
+ * timeouts. At most max_hedge_percent of recent requests are hedged, so
+ * a slow primary can't double the load.
+ *
+ * Other operations only go to the primary. That includes lease-gets,
+ * whose lease token is only valid on the destination that issued it.
+ *
+ * Route handles are created per proxy, so the latency stats need
+ * no locking.
+ *
+ * Example:
+ *  {
+ *    "type": "HedgedRoute",
+ *    "primary": "PoolRoute|A",
+ *    "alternate": "PoolRoute|A-replica",
+ *    "hedge_delay_ms": 10,
+ *    "hedge_percentile": 95,
+ *    "max_hedge_percent": 10
+ *  }
+ */
+template <class RouteHandleIf>
+class HedgedRoute {
+ public:
+  static std::string routeName() { return "hedged"; }
+
+  /* The adaptive delay is recomputed from each kLatencyWindow samples */
+  static constexpr uint64_t kLatencyWindow = 1024;
+  /* Request and hedge counts are halved after this many requests */
+  static constexpr uint64_t kHedgeWindow = 1024;
+
+  HedgedRoute(std::shared_ptr<RouteHandleIf> primary,
+              std::shared_ptr<RouteHandleIf> alternate,
+              std::chrono::milliseconds hedgeDelay,
+              double hedgePercentile = 0,
+              double maxHedgePercent = 10)
+      : primary_(std::move(primary)),
+        alternate_(std::move(alternate)),
+        stats_(std::make_shared<Stats>()) {
+    init(hedgeDelay, hedgePercentile, maxHedgePercent);
+  }
+
+  HedgedRoute(RouteHandleFactory<RouteHandleIf>& factory,
+              const folly::dynamic& json)
+      : stats_(std::make_shared<Stats>()) {
+    checkLogic(json.isObject(), "HedgedRoute should be an object");
+    auto jprimary = json.get_ptr("primary");
+    checkLogic(jprimary, "HedgedRoute: no primary");
+    primary_ = factory.create(*jprimary);
+    auto jalternate = json.get_ptr("alternate");
+    checkLogic(jalternate, "HedgedRoute: no alternate");
+    alternate_ = factory.create(*jalternate);
+
+    auto jdelay = json.get_ptr("hedge_delay_ms");
+    checkLogic(jdelay && jdelay->isInt() && jdelay->getInt() > 0,
+               "HedgedRoute: hedge_delay_ms is not a positive integer");
+    double percentile = 0;
+    if (auto jpercentile = json.get_ptr("hedge_percentile")) {
+      checkLogic(jpercentile->isNumber(),
+                 "HedgedRoute: hedge_percentile is not a number");
+      percentile = jpercentile->asDouble();
+    }
+    double maxHedgePercent = 10;
+    if (auto jmax = json.get_ptr("max_hedge_percent")) {
+      checkLogic(jmax->isNumber(),
+                 "HedgedRoute: max_hedge_percent is not a number");
+      maxHedgePercent = jmax->asDouble();
+    }
+    init(std::chrono::milliseconds(jdelay->getInt()), percentile,
+         maxHedgePercent);
+  }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    return { primary_, alternate_ };
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename GetLike<Operation>::Type = 0) {
+
+    using Reply = typename ReplyType<Operation, Request>::type;
+
+    if (!std::is_same<Operation, McOperation<mc_op_get>>::value &&
+        !std::is_same<Operation, McOperation<mc_op_metaget>>::value) {
+      return primary_->route(req, Operation());
+    }
+
+    struct Result {
+      Baton baton;
+      folly::Optional<Reply> reply;
+      size_t pending{0};
+    };
+
+    auto reqCopy = makeSharedRequest(req, req.clone());
+    auto result = std::make_shared<Result>();
+    auto stats = stats_;
+    auto send = [&reqCopy, &result, &stats](
+        const std::shared_ptr<RouteHandleIf>& rh, bool isPrimary) {
+      ++result->pending;
+      fiber::addTask([reqCopy, result, stats, rh, isPrimary]() {
+        auto start = std::chrono::steady_clock::now();
+        auto reply = rh->route(*reqCopy, Operation());
+        if (isPrimary) {
+          stats->addSample(std::chrono::duration_cast<
+            std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start).count());
+        }
+        --result->pending;
+        if (result->reply) {
+          return;
+        }
+        if (!reply.isFailoverError() || result->pending == 0) {
+          result->reply = std::move(reply);
+          result->baton.post();
+        }
+      });
+    };
+
+    stats_->countRequest();
+    send(primary_, true);
+    if (!result->baton.timed_wait(stats_->hedgeDelay())) {
+      /* Nothing else runs between the timeout and reset(), so no post
+         is lost */
+      result->baton.reset();
+      if (!requestDeadlineExceeded(req) && stats_->tryHedge()) {
+        send(alternate_, false);
+      }
+      result->baton.wait();
+    } else if (result->reply->isFailoverError() &&
+               !requestDeadlineExceeded(req)) {
+      result->reply.clear();
+      result->baton.reset();
+      send(alternate_, false);
+      result->baton.wait();
+    }
+
+    return std::move(*result->reply);
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    OtherThanT(Operation, GetLike<>) = 0) {
+
+    return primary_->route(req, Operation());
+  }
+
+ private:
+  /**
+   * Shared with requests in flight, which may outlive the route.
+   */
+  struct Stats {
+    LatencyHistogram latencyUs;
+    std::chrono::milliseconds fixedDelay{0};
+    std::chrono::milliseconds delay{0};
+    double percentile{0};
+    double maxHedgePercent{0};
+    uint64_t requests{0};
+    uint64_t hedges{0};
+
+    void addSample(int64_t us) {
+      if (percentile == 0) {
+        return;
+      }
+      latencyUs.insertSample(std::max<int64_t>(us, 0));
+      if (latencyUs.count() >= kLatencyWindow) {
+        auto quantileUs = latencyUs.quantile(percentile / 100);
+        auto ms = std::chrono::milliseconds((quantileUs + 999) / 1000);
+        delay = std::max(std::chrono::milliseconds(1),
+                         std::min(fixedDelay, ms));
+        latencyUs = LatencyHistogram();
+      }
+    }
+
+    void countRequest() {
+      if (++requests > kHedgeWindow) {
+        requests /= 2;
+        hedges /= 2;
+      }
+    }
+
+    bool tryHedge() {
+      if ((hedges + 1) * 100 > maxHedgePercent * requests) {
+        return false;
+      }
+      ++hedges;
+      return true;
+    }
+
+    std::chrono::milliseconds hedgeDelay() const {
+      return delay;
+    }
+  };
+
+  std::shared_ptr<RouteHandleIf> primary_;
+  std::shared_ptr<RouteHandleIf> alternate_;
+  std::shared_ptr<Stats> stats_;
+
+  void init(std::chrono::milliseconds hedgeDelay, double percentile,
+            double maxHedgePercent) {
+    checkLogic(hedgeDelay.count() > 0,
+               "HedgedRoute: hedge delay should be positive");
+    checkLogic(0 <= percentile && percentile < 100,
+               "HedgedRoute: hedge_percentile should be in [0, 100)");
+    checkLogic(0 <= maxHedgePercent && maxHedgePercent <= 100,
+               "HedgedRoute: max_hedge_percent should be in [0, 100]");
+    stats_->fixedDelay = hedgeDelay;
+    stats_->delay = hedgeDelay;
+    stats_->percentile = percentile;
+    stats_->maxHedgePercent = maxHedgePercent;
+  }
+};
+
+template <class RouteHandleIf>
+constexpr uint64_t HedgedRoute<RouteHandleIf>::kLatencyWindow;
+
+template <class RouteHandleIf>
+constexpr uint64_t HedgedRoute<RouteHandleIf>::kHedgeWindow;
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,23 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "mcrouter/lib/config/RouteHandleBuilder.h"
+#include "mcrouter/lib/routes/HotKeyReplicationRoute.h"
+#include "mcrouter/HotKeyTracker.h"
+#include "mcrouter/routes/McRouteHandleBuilder.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace facebook { namespace memcache {
+
+template std::shared_ptr<mcrouter::McrouterRouteHandleIf>
+makeRouteHandle<mcrouter::McrouterRouteHandleIf, HotKeyReplicationRoute>(
+  const folly::dynamic&,
+  std::vector<std::shared_ptr<mcrouter::McrouterRouteHandleIf>>&&);
+
+}}  // facebook::memcache
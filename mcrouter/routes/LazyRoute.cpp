@@ -0,0 +1,22 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "mcrouter/lib/routes/LazyRoute.h"
+
+#include "mcrouter/routes/McRouteHandleBuilder.h"
+#include "mcrouter/routes/McrouterRouteHandle.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+McrouterRouteHandlePtr makeLazyRoute(
+    LazyRoute<McrouterRouteHandleIf>::Builder builder) {
+  return makeMcrouterRouteHandle<LazyRoute>(std::move(builder));
+}
+
+}}}
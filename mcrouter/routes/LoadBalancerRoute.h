@@ -0,0 +1,201 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <folly/dynamic.h>
+#include <folly/ScopeGuard.h>
+
+#include "mcrouter/ExponentialSmoothData.h"
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/routes/AllSyncRoute.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Power of two choices load balancing of get-like requests between
+ * interchangeable children (e.g. replicas of the same data).
+ *
+ * For every get-like request two distinct random children are picked and
+ * the request is sent to the one with the lower score
+ *   (requests in flight + 1) * smoothed reply latency,
+ * so hot or degraded children shed load long before they'd be marked TKO.
+ * Replies with failover errors count as error_penalty_ms latency, otherwise
+ * a child that fails fast would attract all the traffic.
+ *
+ * Other requests (updates, deletes, ...) must reach every replica to keep
+ * them interchangeable: they are sent to "update_route" if it's set, and
+ * to all of the children otherwise, like AllSyncRoute.
+ *
+ * Latencies and in flight requests are tracked by this route for the requests
+ * it sends, since children may be arbitrary route handles. Route handles are
+ * created per proxy, so no synchronization is needed.
+ *
+ * Example:
+ *  {
+ *    "type": "LoadBalancerRoute",
+ *    "children": [ "PoolRoute|A-replica1", "PoolRoute|A-replica2" ],
+ *    "smoothing_factor": 0.05,
+ *    "error_penalty_ms": 1000,
+ *    "update_route": "AllSyncRoute|Pool|A-replicas"
+ *  }
+ */
+template <class RouteHandleIf>
+class LoadBalancerRoute {
+ public:
+  static std::string routeName() { return "load-balancer"; }
+
+  static constexpr double kDefaultSmoothingFactor = 0.05;
+  static constexpr int64_t kDefaultErrorPenaltyMs = 1000;
+
+  explicit LoadBalancerRoute(
+    std::vector<std::shared_ptr<RouteHandleIf>> children,
+    double smoothingFactor = kDefaultSmoothingFactor,
+    std::chrono::milliseconds errorPenalty =
+      std::chrono::milliseconds(kDefaultErrorPenaltyMs))
+      : children_(std::move(children)),
+        errorPenaltyUs_(
+          std::chrono::duration_cast<std::chrono::microseconds>(errorPenalty)
+            .count()) {
+    init(smoothingFactor);
+  }
+
+  LoadBalancerRoute(RouteHandleFactory<RouteHandleIf>& factory,
+                    const folly::dynamic& json) {
+    checkLogic(json.isObject(), "LoadBalancerRoute should be an object");
+    auto jchildren = json.get_ptr("children");
+    checkLogic(jchildren, "LoadBalancerRoute: no children");
+    children_ = factory.createList(*jchildren);
+    if (auto jupdate = json.get_ptr("update_route")) {
+      updateRoute_ = factory.create(*jupdate);
+    }
+
+    double smoothingFactor = kDefaultSmoothingFactor;
+    if (auto jfactor = json.get_ptr("smoothing_factor")) {
+      checkLogic(jfactor->isNumber(),
+                 "LoadBalancerRoute: smoothing_factor is not a number");
+      smoothingFactor = jfactor->asDouble();
+    }
+    int64_t errorPenaltyMs = kDefaultErrorPenaltyMs;
+    if (auto jpenalty = json.get_ptr("error_penalty_ms")) {
+      checkLogic(jpenalty->isInt() && jpenalty->getInt() >= 0,
+                 "LoadBalancerRoute: error_penalty_ms is not an integer");
+      errorPenaltyMs = jpenalty->getInt();
+    }
+    errorPenaltyUs_ = errorPenaltyMs * 1000;
+    init(smoothingFactor);
+  }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+
+    if (!GetLike<Operation>::value && updateRoute_) {
+      return { updateRoute_ };
+    }
+    return children_;
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    OtherThanT(Operation, GetLike<>) = 0) const {
+
+    if (updateRoute_) {
+      return updateRoute_->route(req, Operation());
+    }
+    return allChildren_.route(req, Operation());
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type route(
+    const Request& req, Operation,
+    typename GetLike<Operation>::Type = 0) {
+
+    auto idx = pick();
+    auto& child = stats_[idx];
+    ++child.inflight;
+    auto inflightGuard = folly::makeGuard([&child]() {
+      --child.inflight;
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    auto reply = children_[idx]->route(req, Operation());
+    double latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+    if (reply.isFailoverError()) {
+      latencyUs = std::max<double>(latencyUs, errorPenaltyUs_);
+    }
+    child.latencyUs.insertSample(latencyUs);
+    return reply;
+  }
+
+ private:
+  struct ChildStats {
+    ExponentialSmoothData latencyUs;
+    size_t inflight{0};
+
+    explicit ChildStats(double smoothingFactor)
+        : latencyUs(smoothingFactor) {
+    }
+
+    double score() const {
+      return (inflight + 1) * std::max(latencyUs.value(), 1.0);
+    }
+  };
+
+  std::vector<std::shared_ptr<RouteHandleIf>> children_;
+  /* Non get-like requests go here if set, and to allChildren_ otherwise */
+  std::shared_ptr<RouteHandleIf> updateRoute_;
+  AllSyncRoute<RouteHandleIf> allChildren_{
+    std::vector<std::shared_ptr<RouteHandleIf>>()};
+  std::vector<ChildStats> stats_;
+  int64_t errorPenaltyUs_{0};
+  std::mt19937 gen_;
+
+  void init(double smoothingFactor) {
+    checkLogic(!children_.empty(), "LoadBalancerRoute children is empty");
+    checkLogic(0 < smoothingFactor && smoothingFactor <= 1,
+               "LoadBalancerRoute: smoothing_factor should be in (0, 1]");
+    stats_.assign(children_.size(), ChildStats(smoothingFactor));
+    allChildren_ = AllSyncRoute<RouteHandleIf>(children_);
+    gen_.seed(std::chrono::system_clock::now().time_since_epoch().count());
+  }
+
+  size_t pick() {
+    auto n = children_.size();
+    if (n == 1) {
+      return 0;
+    }
+    size_t first = gen_() % n;
+    size_t second = gen_() % (n - 1);
+    if (second >= first) {
+      ++second;
+    }
+    return stats_[second].score() < stats_[first].score() ? second : first;
+  }
+};
+
+template <class RouteHandleIf>
+constexpr double LoadBalancerRoute<RouteHandleIf>::kDefaultSmoothingFactor;
+
+template <class RouteHandleIf>
+constexpr int64_t LoadBalancerRoute<RouteHandleIf>::kDefaultErrorPenaltyMs;
+
+}}}  // facebook::memcache::mcrouter
@@ -9,8 +9,11 @@
  */
 #include "McImportResolver.h"
 
+#include <folly/dynamic.h>
+
 #include "mcrouter/ConfigApi.h"
 #include "mcrouter/lib/config/ImportResolverIf.h"
+#include "mcrouter/lib/config/ParsedJsonCache.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -29,4 +32,14 @@ std::string McImportResolver::import(folly::StringPiece path) {
   return ret;
 }
 
+std::shared_ptr<const folly::dynamic>
+McImportResolver::importParsed(folly::StringPiece path) {
+  return parsedImportsCache().get(path.str(), import(path));
+}
+
+ParsedJsonCache& McImportResolver::parsedImportsCache() {
+  static ParsedJsonCache cache;
+  return cache;
+}
+
 }}} // facebook::memcache::mcrouter
@@ -9,13 +9,18 @@
  */
 #pragma once
 
+#include <memory>
 #include <string>
 
 #include <folly/Range.h>
 
 #include "mcrouter/lib/config/ImportResolverIf.h"
 
-namespace facebook { namespace memcache { namespace mcrouter {
+namespace facebook { namespace memcache {
+
+class ParsedJsonCache;
+
+namespace mcrouter {
 
 class ConfigApi;
 
@@ -30,7 +35,24 @@ class McImportResolver : public ImportResolverIf {
   /**
    * @throws std::runtime_error if can not load file
    */
-  std::string import(folly::StringPiece path);
+  std::string import(folly::StringPiece path) override;
+
+  /**
+   * Files are still read on every call, but only parsed again if their
+   * contents changed since the last time any McImportResolver of
+   * the process parsed them (see parsedImportsCache()).
+   *
+   * @throws std::runtime_error if can not load or parse file
+   */
+  std::shared_ptr<const folly::dynamic>
+  importParsed(folly::StringPiece path) override;
+
+  /**
+   * Process wide cache of parsed imports, shared by all reloads of all
+   * mcrouter instances.
+   */
+  static ParsedJsonCache& parsedImportsCache();
+
  private:
   ConfigApi* configApi_;
 };
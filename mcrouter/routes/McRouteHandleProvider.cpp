@@ -9,11 +9,18 @@
  */
 #include "McRouteHandleProvider.h"
 
+#include <algorithm>
+
+#include <folly/json.h>
+#include <folly/Memory.h>
 #include <folly/Range.h>
+#include <glog/logging.h>
 
 #include "mcrouter/ClientPool.h"
 #include "mcrouter/config.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/routes/LazyRoute.h"
+#include "mcrouter/OutlierDetector.h"
 #include "mcrouter/PoolFactory.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyClientCommon.h"
@@ -23,15 +30,26 @@
 #include "mcrouter/routes/ShadowRouteIf.h"
 #include "mcrouter/routes/ShardHashFunc.h"
 #include "mcrouter/routes/ShardSplitter.h"
+#include "mcrouter/routes/ValueCompressor.h"
+#include "mcrouter/SharedConfigObjects.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
 McrouterRouteHandlePtr makeAsynclogRoute(McrouterRouteHandlePtr rh,
                                          std::string asynclogName);
 
+McrouterRouteHandlePtr makeCoalescingRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+McrouterRouteHandlePtr makeCompressionRoute(
+  McrouterRouteHandlePtr rh,
+  std::unique_ptr<ValueCompressor> compressor);
+
 McrouterRouteHandlePtr makeDestinationRoute(
   std::shared_ptr<const ProxyClientCommon> client,
-  std::shared_ptr<ProxyDestination> destination);
+  std::shared_ptr<ProxyDestination> destination,
+  std::shared_ptr<OutlierDetector> outlierDetector);
 
 McrouterRouteHandlePtr makeDevNullRoute(const char* name);
 
@@ -39,6 +57,17 @@ McrouterRouteHandlePtr makeFailoverWithExptimeRoute(
   RouteHandleFactory<McrouterRouteHandleIf>& factory,
   const folly::dynamic& json);
 
+McrouterRouteHandlePtr makeHedgedRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
+McrouterRouteHandlePtr makeLazyRoute(
+  LazyRoute<McrouterRouteHandleIf>::Builder builder);
+
+McrouterRouteHandlePtr makeLoadBalancerRoute(
+  RouteHandleFactory<McrouterRouteHandleIf>& factory,
+  const folly::dynamic& json);
+
 McrouterRouteHandlePtr makeMigrateRoute(
   RouteHandleFactory<McrouterRouteHandleIf>& factory,
   const folly::dynamic& json);
@@ -55,22 +84,75 @@ McrouterRouteHandlePtr makeRateLimitRoute(
   McrouterRouteHandlePtr normalRoute,
   RateLimiter rateLimiter);
 
-McrouterRouteHandlePtr makeShardSplitRoute(McrouterRouteHandlePtr rh,
-                                           ShardSplitter);
+McrouterRouteHandlePtr makeShardSplitRoute(
+  McrouterRouteHandlePtr rh,
+  std::shared_ptr<const ShardSplitter> shardSplitter);
 
 McrouterRouteHandlePtr makeWarmUpRoute(
   RouteHandleFactory<McrouterRouteHandleIf>& factory,
   const folly::dynamic& json,
   uint32_t exptime);
 
+namespace {
+
+/* Dependency of subtrees with LazyRoutes, so that they are never reused by
+   the next config: their targets would be built as part of the old one */
+const char* const kLazySubtreesKey = "LazyRoute:subtrees";
+
+}  // anonymous namespace
+
+/**
+ * Builds the targets of the LazyRoutes of one config on one proxy, with
+ * a provider and a factory of its own that live as long as the config.
+ * Shared config objects of the lazy targets are not shared with other
+ * proxies.
+ */
+class LazySubtrees {
+ public:
+  LazySubtrees(proxy_t* proxy,
+               ProxyDestinationMap& destinationMap,
+               PoolFactory& poolFactory)
+      : proxy_(proxy),
+        provider_(proxy, destinationMap, poolFactory, sharedObjects_),
+        factory_(provider_) {
+    provider_.lazy_ = true;
+  }
+
+  void addNamedHandles(
+      const RouteHandleFactory<McrouterRouteHandleIf>& factory) {
+    factory_.addNamedHandles(factory.namedHandles());
+  }
+
+  McrouterRouteHandlePtr build(const folly::dynamic& json) {
+    try {
+      auto rh = factory_.create(json);
+      stat_incr(proxy_->stats, lazy_routes_built_stat, 1);
+      return rh;
+    } catch (const std::exception& e) {
+      stat_incr(proxy_->stats, lazy_routes_failed_stat, 1);
+      LOG(ERROR) << "LazyRoute: can not build " << folly::toJson(json)
+                 << ": " << e.what();
+      return nullptr;
+    }
+  }
+
+ private:
+  proxy_t* proxy_;
+  SharedConfigObjects sharedObjects_;
+  McRouteHandleProvider provider_;
+  RouteHandleFactory<McrouterRouteHandleIf> factory_;
+};
+
 McRouteHandleProvider::McRouteHandleProvider(
   proxy_t* proxy,
   ProxyDestinationMap& destinationMap,
-  PoolFactory& poolFactory)
+  PoolFactory& poolFactory,
+  SharedConfigObjects& sharedObjects)
     : RouteHandleProvider<McrouterRouteHandleIf>(),
       proxy_(proxy),
       destinationMap_(destinationMap),
       poolFactory_(poolFactory),
+      sharedObjects_(sharedObjects),
       extraProvider_(createExtraRouteHandleProvider()) {
 }
 
@@ -79,19 +161,37 @@ McRouteHandleProvider::~McRouteHandleProvider() {
 }
 
 std::pair<std::shared_ptr<ClientPool>, std::vector<McrouterRouteHandlePtr>>
-McRouteHandleProvider::makePool(const folly::dynamic& json) {
+McRouteHandleProvider::makePool(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json) {
   checkLogic(json.isString() || json.isObject(),
              "Pool should be a string (name of pool) or an object");
   auto pool = poolFactory_.parsePool(json);
+  factory.addDependency(pool->getName(), pool);
   auto seenIt = pools_.find(pool->getName());
   if (seenIt != pools_.end()) {
     return seenIt->second;
   }
 
+  std::shared_ptr<OutlierDetector> outlierDetector;
+  const auto& opts = proxy_->opts;
+  if (opts.outlier_detection_interval_ms > 0) {
+    OutlierDetector::Options detectorOpts;
+    detectorOpts.intervalUs = opts.outlier_detection_interval_ms * 1000LL;
+    detectorOpts.minRequests = opts.outlier_detection_min_requests;
+    detectorOpts.errorRateMargin = opts.outlier_error_rate_margin_pct / 100.0;
+    detectorOpts.latencyRatio = opts.outlier_latency_ratio_pct / 100.0;
+    detectorOpts.maxEjectedFraction = opts.outlier_max_ejected_pct / 100.0;
+    detectorOpts.ejectionUs = opts.outlier_ejection_ms * 1000LL;
+    outlierDetector = std::make_shared<OutlierDetector>(
+      pool->getClients().size(), detectorOpts);
+  }
+
   std::vector<McrouterRouteHandlePtr> destinations;
   for (const auto& client : pool->getClients()) {
     auto pdstn = destinationMap_.fetch(*client);
-    auto route = makeDestinationRoute(client, std::move(pdstn));
+    auto route = makeDestinationRoute(client, std::move(pdstn),
+                                      outlierDetector);
     destinations.push_back(std::move(route));
   }
 
@@ -99,11 +199,14 @@ McRouteHandleProvider::makePool(const folly::dynamic& json) {
 }
 
 McrouterRouteHandlePtr
-McRouteHandleProvider::createAsynclogRoute(McrouterRouteHandlePtr target,
-                                           std::string asynclogName) {
+McRouteHandleProvider::createAsynclogRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    McrouterRouteHandlePtr target,
+    std::string asynclogName) {
   if (!proxy_->opts.asynclog_disable) {
     target = makeAsynclogRoute(std::move(target), asynclogName);
   }
+  factory.addExport(asynclogName, target);
   asyncLogRoutes_.emplace(std::move(asynclogName), target);
   return target;
 }
@@ -121,7 +224,7 @@ McrouterRouteHandlePtr McRouteHandleProvider::makePoolRoute(
   } else {
     jpool = &json;
   }
-  auto p = makePool(*jpool);
+  auto p = makePool(factory, *jpool);
   auto pool = std::move(p.first);
   auto destinations = std::move(p.second);
 
@@ -137,8 +240,24 @@ McrouterRouteHandlePtr McRouteHandleProvider::makePoolRoute(
     for (auto& shadow : json["shadows"]) {
       checkLogic(shadow.count("target"),
                  "PoolRoute {} shadows: no target for shadow", pool->getName());
-      auto policy = std::make_shared<ShadowSettings>(shadow, proxy_->router);
-      data.emplace_back(factory.create(shadow["target"]), std::move(policy));
+      // settings are updated from runtime vars thread, so they can be shared
+      auto router = proxy_->router;
+      auto policy = sharedObjects_.get<ShadowSettings>(
+        shadow, [&shadow, router]() {
+          return std::make_shared<ShadowSettings>(shadow, router);
+        });
+      auto target = factory.create(shadow["target"]);
+      auto same = std::find_if(
+        data.begin(), data.end(),
+        [&target, &policy](const McrouterShadowData::value_type& it) {
+          return it.first == target && it.second == policy;
+        });
+      if (same != data.end()) {
+        /* would shadow every request to the same target twice */
+        factory.addCollapsed();
+        continue;
+      }
+      data.emplace_back(std::move(target), std::move(policy));
     }
 
     for (size_t i = 0; i < destinations.size(); ++i) {
@@ -168,17 +287,40 @@ McrouterRouteHandlePtr McRouteHandleProvider::makePoolRoute(
       }
     }
   }
-  auto route = makeHash(jhashWithWeights, std::move(destinations));
+  auto route = makeHash(factory, jhashWithWeights, std::move(destinations));
 
   if (json.isObject()) {
+    if (auto jcompression = json.get_ptr("compression")) {
+      route = makeCompressionRoute(
+        std::move(route),
+        folly::make_unique<ValueCompressor>(*jcompression));
+    }
+
     if (proxy_->opts.destination_rate_limiting) {
       if (auto jrates = json.get_ptr("rates")) {
-        route = makeRateLimitRoute(std::move(route), RateLimiter(*jrates));
+        std::shared_ptr<RateLimiter::SharedBuckets> buckets;
+        if (RateLimiter::isGlobal(*jrates)) {
+          // pools with the same rates must still have their own buckets
+          folly::dynamic jkey = folly::dynamic::object
+            ("pool", pool->getName())
+            ("rates", *jrates);
+          buckets = sharedObjects_.get<RateLimiter::SharedBuckets>(
+            jkey, [jrates]() {
+              return std::make_shared<RateLimiter::SharedBuckets>(*jrates);
+            });
+        }
+        route = makeRateLimitRoute(std::move(route),
+                                   RateLimiter(*jrates, std::move(buckets)));
+        factory.addStateful();
       }
     }
 
     if (auto jsplits = json.get_ptr("shard_splits")) {
-      route = makeShardSplitRoute(std::move(route), ShardSplitter(*jsplits));
+      auto splitter = sharedObjects_.get<const ShardSplitter>(
+        *jsplits, [jsplits]() {
+          return std::make_shared<const ShardSplitter>(*jsplits);
+        });
+      route = makeShardSplitRoute(std::move(route), std::move(splitter));
     }
   }
 
@@ -197,12 +339,45 @@ McrouterRouteHandlePtr McRouteHandleProvider::makePoolRoute(
     }
   }
   if (needAsynclog) {
-    route = createAsynclogRoute(std::move(route), asynclogName);
+    route = createAsynclogRoute(factory, std::move(route), asynclogName);
   }
 
   return route;
 }
 
+McrouterRouteHandlePtr McRouteHandleProvider::createLazyRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json) {
+  checkLogic(json.isObject(), "LazyRoute should be object");
+  auto jtarget = json.get_ptr("target");
+  checkLogic(jtarget, "LazyRoute: no target");
+  if (lazy_) {
+    /* already building a lazy target */
+    return factory.create(*jtarget);
+  }
+
+  if (!lazySubtrees_) {
+    lazySubtrees_ = std::make_shared<LazySubtrees>(proxy_, destinationMap_,
+                                                   poolFactory_);
+  }
+  factory.addDependency(kLazySubtreesKey, lazySubtrees_);
+  std::weak_ptr<LazySubtrees> subtrees = lazySubtrees_;
+  auto target = *jtarget;
+  return makeLazyRoute(
+    [subtrees, target]() -> McrouterRouteHandlePtr {
+      auto s = subtrees.lock();
+      return s ? s->build(target) : nullptr;
+    });
+}
+
+std::shared_ptr<LazySubtrees> McRouteHandleProvider::releaseLazySubtrees(
+    const RouteHandleFactory<McrouterRouteHandleIf>& factory) {
+  if (lazySubtrees_) {
+    lazySubtrees_->addNamedHandles(factory);
+  }
+  return std::move(lazySubtrees_);
+}
+
 std::vector<McrouterRouteHandlePtr> McRouteHandleProvider::create(
     RouteHandleFactory<McrouterRouteHandleIf>& factory,
     folly::StringPiece type,
@@ -225,24 +400,37 @@ std::vector<McrouterRouteHandlePtr> McRouteHandleProvider::create(
       asynclogName = jname->stringPiece().str();
       target = factory.create(*jtarget);
     }
-    return { createAsynclogRoute(std::move(target), std::move(asynclogName)) };
+    return { createAsynclogRoute(factory, std::move(target),
+                                 std::move(asynclogName)) };
   } else if (type == "OperationSelectorRoute" || type == "PrefixPolicyRoute") {
     // PrefixPolicyRoute is deprecated, but must be preserved for backwards
     // compatibility.
     return { makeOperationSelectorRoute(factory, json) };
+  } else if (type == "CoalescingRoute") {
+    factory.addStateful();
+    return { makeCoalescingRoute(factory, json) };
   } else if (type == "DevNullRoute") {
     return { makeDevNullRoute("devnull") };
   } else if (type == "FailoverWithExptimeRoute") {
     return { makeFailoverWithExptimeRoute(factory, json) };
+  } else if (type == "HedgedRoute") {
+    factory.addStateful();
+    return { makeHedgedRoute(factory, json) };
   } else if (type == "WarmUpRoute") {
+    factory.addStateful();
     return { makeWarmUpRoute(factory, json,
                              proxy_->opts.upgrading_l1_exptime) };
+  } else if (type == "LazyRoute") {
+    return { createLazyRoute(factory, json) };
+  } else if (type == "LoadBalancerRoute") {
+    factory.addStateful();
+    return { makeLoadBalancerRoute(factory, json) };
   } else if (type == "MigrateRoute") {
     return { makeMigrateRoute(factory, json) };
   } else if (type == "ModifyKeyRoute") {
     return { makeModifyKeyRoute(factory, json) };
   } else if (type == "Pool") {
-    return makePool(json).second;
+    return makePool(factory, json).second;
   } else if (type == "PoolRoute") {
     return { makePoolRoute(factory, json) };
   } else {
@@ -276,4 +464,17 @@ McrouterRouteHandlePtr McRouteHandleProvider::createHash(
   return ret;
 }
 
+std::shared_ptr<const void>
+McRouteHandleProvider::resolveDependency(const std::string& key) {
+  if (key == kLazySubtreesKey) {
+    return lazySubtrees_;
+  }
+  return poolFactory_.findPool(key);
+}
+
+void McRouteHandleProvider::restoreExport(const std::string& key,
+                                          McrouterRouteHandlePtr rh) {
+  asyncLogRoutes_.emplace(key, std::move(rh));
+}
+
 }}} // facebook::memcache::mcrouter
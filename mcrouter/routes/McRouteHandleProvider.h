@@ -25,10 +25,12 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 class ClientPool;
 class ExtraRouteHandleProviderIf;
+class LazySubtrees;
 class PoolFactory;
 class ProxyClientCommon;
 class ProxyDestinationMap;
 class proxy_t;
+class SharedConfigObjects;
 
 /**
  * RouteHandleProviderIf implementation that can create mcrouter-specific
@@ -39,7 +41,8 @@ class McRouteHandleProvider :
  public:
   McRouteHandleProvider(proxy_t* proxy,
                         ProxyDestinationMap& destinationMap,
-                        PoolFactory& poolFactory);
+                        PoolFactory& poolFactory,
+                        SharedConfigObjects& sharedObjects);
 
   std::vector<McrouterRouteHandlePtr>
   create(RouteHandleFactory<McrouterRouteHandleIf>& factory,
@@ -50,17 +53,34 @@ class McRouteHandleProvider :
              const folly::dynamic& json,
              std::vector<McrouterRouteHandlePtr> children) override;
 
+  std::shared_ptr<const void>
+  resolveDependency(const std::string& key) override;
+
+  void restoreExport(const std::string& key,
+                     McrouterRouteHandlePtr rh) override;
+
   std::unordered_map<std::string, McrouterRouteHandlePtr>
   releaseAsyncLogRoutes() {
     return std::move(asyncLogRoutes_);
   }
 
+  /**
+   * @return object that builds the targets of LazyRoutes created by this
+   *         provider on first use, nullptr if there are none. Must be kept
+   *         (by the config) for as long as the LazyRoutes are used.
+   *
+   * @param factory  the lazy targets may refer to all handles named in it.
+   */
+  std::shared_ptr<LazySubtrees> releaseLazySubtrees(
+    const RouteHandleFactory<McrouterRouteHandleIf>& factory);
+
   ~McRouteHandleProvider();
 
  private:
   proxy_t* proxy_;
   ProxyDestinationMap& destinationMap_;
   PoolFactory& poolFactory_;
+  SharedConfigObjects& sharedObjects_;
   std::unique_ptr<ExtraRouteHandleProviderIf> extraProvider_;
   // pool name => { ClientPool, destinations }
   std::unordered_map<std::string,
@@ -70,15 +90,28 @@ class McRouteHandleProvider :
   // poolName -> AsynclogRoute
   std::unordered_map<std::string, McrouterRouteHandlePtr> asyncLogRoutes_;
 
+  std::shared_ptr<LazySubtrees> lazySubtrees_;
+  /// true if this provider builds lazy targets itself
+  bool lazy_{false};
+
   std::pair<std::shared_ptr<ClientPool>, std::vector<McrouterRouteHandlePtr>>
-  makePool(const folly::dynamic& json);
+  makePool(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+           const folly::dynamic& json);
 
   McrouterRouteHandlePtr makePoolRoute(
     RouteHandleFactory<McrouterRouteHandleIf>& factory,
     const folly::dynamic& json);
 
+  McrouterRouteHandlePtr createLazyRoute(
+    RouteHandleFactory<McrouterRouteHandleIf>& factory,
+    const folly::dynamic& json);
+
   McrouterRouteHandlePtr
-  createAsynclogRoute(McrouterRouteHandlePtr route, std::string asynclogName);
+  createAsynclogRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
+                      McrouterRouteHandlePtr route,
+                      std::string asynclogName);
+
+  friend class LazySubtrees;
 };
 
 }}} // facebook::memcache::mcrouter
@@ -15,10 +15,13 @@
 #include "mcrouter/ProxyMcReply.h"
 #include "mcrouter/ProxyMcRequest.h"
 #include "mcrouter/RecordingContext.h"
+#include "mcrouter/RequestTracer.h"
 #include "mcrouter/routes/McOpList.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+template <class RouteHandleIf>
+class DestinationRoute;
 class McrouterRouteHandleIf;
 
 template <typename Route>
@@ -36,6 +39,27 @@ class McrouterRouteHandle :
                   McOpList>(
                     std::forward<Args>(args)...) {
   }
+
+  const DestinationRoute<McrouterRouteHandleIf>*
+  updateDestination(const ProxyMcRequest& req) const override {
+    return updateDestinationImpl(this->route_, req, 0);
+  }
+
+ private:
+  /* Routes can define updateDestination(), the others are never
+     batched */
+  template <class R>
+  static auto updateDestinationImpl(const R& route,
+                                    const ProxyMcRequest& req, int)
+      -> decltype(route.updateDestination(req)) {
+    return route.updateDestination(req);
+  }
+
+  template <class R>
+  static const DestinationRoute<McrouterRouteHandleIf>*
+  updateDestinationImpl(const R&, const ProxyMcRequest&, long) {
+    return nullptr;
+  }
 };
 
 class McrouterRouteHandleIf :
@@ -45,7 +69,18 @@ class McrouterRouteHandleIf :
  public:
   template <class Route>
   using Impl = McrouterRouteHandle<Route>;
+
+  /**
+   * The DestinationRoute route() sends req to as is (straight or through
+   * hash routes), if req isn't get-like; nullptr if that's not known up
+   * front. Lets routeSubRequests() send such requests without routing each
+   * of them on a fiber of its own. Can be called outside of a fiber.
+   */
+  virtual const DestinationRoute<McrouterRouteHandleIf>*
+  updateDestination(const ProxyMcRequest& req) const = 0;
 };
 typedef std::shared_ptr<McrouterRouteHandleIf> McrouterRouteHandlePtr;
 
 }}}  // facebook::memcache::mcrouter
+
+#include "mcrouter/routes/DestinationBatch.h"
@@ -16,7 +16,12 @@ namespace facebook { namespace memcache { namespace mcrouter {
 McrouterRouteHandlePtr
 makeModifyKeyRoute(RouteHandleFactory<McrouterRouteHandleIf>& factory,
                    const folly::dynamic& json) {
-  return makeMcrouterRouteHandle<ModifyKeyRoute>(factory, json);
+  ModifyKeyRoute<McrouterRouteHandleIf> route(factory, json);
+  if (auto target = route.noOpTarget()) {
+    factory.addCollapsed();
+    return target;
+  }
+  return makeMcrouterRouteHandle<ModifyKeyRoute>(std::move(route));
 }
 
 }}}
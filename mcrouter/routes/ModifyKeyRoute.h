@@ -10,18 +10,22 @@
 #pragma once
 
 #include <cctype>
+#include <cstring>
+#include <initializer_list>
 #include <memory>
 #include <string>
 #include <vector>
 
-#include <folly/Conv.h>
 #include <folly/dynamic.h>
+#include <folly/io/IOBuf.h>
 #include <folly/Optional.h>
 
 #include "mcrouter/lib/config/RouteHandleFactory.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/IOBufUtil.h"
 #include "mcrouter/lib/mc/msg.h"
 #include "mcrouter/lib/mc/protocol.h"
+#include "mcrouter/lib/McRequestBase.h"
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/Reply.h"
 #include "mcrouter/RoutingPrefix.h"
@@ -76,6 +80,16 @@ class ModifyKeyRoute {
     }
   }
 
+  /**
+   * @return target if the route never changes keys, nullptr otherwise.
+   */
+  std::shared_ptr<RouteHandleIf> noOpTarget() const {
+    if (routingPrefix_.hasValue() || !keyPrefix_.empty()) {
+      return nullptr;
+    }
+    return target_;
+  }
+
   template <class Operation, class Request>
   std::vector<std::shared_ptr<RouteHandleIf>>
   couldRouteTo(const Request& req, Operation) const {
@@ -90,11 +104,13 @@ class ModifyKeyRoute {
       : req.routingPrefix();
 
     if (!req.keyWithoutRoute().startsWith(keyPrefix_)) {
-      auto key = folly::to<std::string>(rp, keyPrefix_, req.keyWithoutRoute());
-      return routeReqWithKey(req, key, Operation());
+      return routeReqWithKey(req, { rp, keyPrefix_, req.keyWithoutRoute() },
+                             Operation());
     } else if (routingPrefix_.hasValue() && rp != req.routingPrefix()) {
-      auto key = folly::to<std::string>(rp, req.keyWithoutRoute());
-      return routeReqWithKey(req, key, Operation());
+      if (rp.empty()) {
+        return routeReqWithoutRoutingPrefix(req, Operation());
+      }
+      return routeReqWithKey(req, { rp, req.keyWithoutRoute() }, Operation());
     }
     return target_->route(req, Operation());
   }
@@ -104,18 +120,72 @@ class ModifyKeyRoute {
   folly::Optional<std::string> routingPrefix_;
   std::string keyPrefix_;
 
+  template <class Reply>
+  static Reply invalidKeyReply(mc_req_err_t err) {
+    return Reply(ErrorReply, "ModifyKeyRoute: invalid key: " +
+        std::string(mc_req_err_to_string(err)));
+  }
+
+  /**
+   * Routes a copy of req with the concatenation of pieces as the key.
+   * Short keys are built on the stack and kept inline in the copy,
+   * longer ones in place in the new key buffer.
+   */
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type
+  routeReqWithKey(const Request& req,
+                  std::initializer_list<folly::StringPiece> pieces,
+                  Operation) const {
+    typedef typename ReplyType<Operation, Request>::type Reply;
+
+    size_t size = 0;
+    for (auto piece : pieces) {
+      size += piece.size();
+    }
+    if (size <= McRequestBase::kMaxInlineKeySize) {
+      char buf[McRequestBase::kMaxInlineKeySize];
+      auto end = buf;
+      for (auto piece : pieces) {
+        std::memcpy(end, piece.data(), piece.size());
+        end += piece.size();
+      }
+      folly::StringPiece key(buf, end);
+      auto err = mc_client_req_key_check(to<nstring_t>(key));
+      if (err != mc_req_err_valid) {
+        return invalidKeyReply<Reply>(err);
+      }
+      auto cloneReq = req.clone();
+      cloneReq.setKey(key);
+      return target_->route(cloneReq, Operation());
+    }
+
+    folly::IOBuf key(folly::IOBuf::CREATE, size);
+    for (auto piece : pieces) {
+      std::memcpy(key.writableTail(), piece.data(), piece.size());
+      key.append(piece.size());
+    }
+
+    auto err = mc_client_req_key_check(to<nstring_t>(getRange(key)));
+    if (err != mc_req_err_valid) {
+      return invalidKeyReply<Reply>(err);
+    }
+    auto cloneReq = req.clone();
+    cloneReq.setKey(std::move(key));
+    return target_->route(cloneReq, Operation());
+  }
+
+  /* Shares the key buffer of req, no copy */
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type
-  routeReqWithKey(const Request& req, folly::StringPiece key, Operation) const {
+  routeReqWithoutRoutingPrefix(const Request& req, Operation) const {
     typedef typename ReplyType<Operation, Request>::type Reply;
 
-    auto err = mc_client_req_key_check(to<nstring_t>(key));
+    auto err = mc_client_req_key_check(to<nstring_t>(req.keyWithoutRoute()));
     if (err != mc_req_err_valid) {
-      return Reply(ErrorReply, "ModifyKeyRoute: invalid key: " +
-          std::string(mc_req_err_to_string(err)));
+      return invalidKeyReply<Reply>(err);
     }
     auto cloneReq = req.clone();
-    cloneReq.setKey(key);
+    cloneReq.stripRoutingPrefix();
     return target_->route(cloneReq, Operation());
   }
 };
@@ -29,7 +29,13 @@ McrouterRouteHandlePtr makeOperationSelectorRoute(
   RouteHandleFactory<McrouterRouteHandleIf>& factory,
   const folly::dynamic& json) {
 
-  return makeMcrouterRouteHandle<OperationSelectorRoute>(factory, json);
+  OperationSelectorRoute<McrouterRouteHandleIf> route(factory, json);
+  if (auto target = route.singleTarget()) {
+    /* doesn't select anything */
+    factory.addCollapsed();
+    return target;
+  }
+  return makeMcrouterRouteHandle<OperationSelectorRoute>(std::move(route));
 }
 
 }}}
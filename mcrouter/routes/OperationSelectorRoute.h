@@ -71,6 +71,19 @@ class OperationSelectorRoute {
     }
   }
 
+  /**
+   * @return route every operation is sent to, nullptr if it depends on
+   *         the operation or there is no such route.
+   */
+  std::shared_ptr<RouteHandleIf> singleTarget() const {
+    for (const auto& policy : operationPolicies_) {
+      if (policy && policy != defaultPolicy_) {
+        return nullptr;
+      }
+    }
+    return defaultPolicy_;
+  }
+
   template <int M, class Request>
   std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
     const Request& req, McOperation<M>) const {
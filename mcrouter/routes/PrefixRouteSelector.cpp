@@ -43,7 +43,7 @@ PrefixRouteSelector::PrefixRouteSelector(
     }
     // order is important
     for (const auto& it : items) {
-      policies.emplace(it.first, factory.create(it.second));
+      policies.emplace_back(it.first, factory.create(it.second));
     }
   }
 
@@ -10,8 +10,10 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
-#include "mcrouter/lib/fbi/cpp/Trie.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 
 namespace folly {
@@ -31,8 +33,10 @@ namespace mcrouter {
  */
 class PrefixRouteSelector {
  public:
-  /// Trie that acts like map from key prefix to corresponding RouteHandle.
-  Trie<std::shared_ptr<McrouterRouteHandleIf>> policies;
+  /// Key prefixes with corresponding RouteHandles, sorted by prefix.
+  /// Lookups are done by RoutePolicyMap, which aggregates all clusters.
+  std::vector<std::pair<std::string, std::shared_ptr<McrouterRouteHandleIf>>>
+    policies;
   /// Used when no RouteHandle found in policies
   std::shared_ptr<McrouterRouteHandleIf> wildcard;
 
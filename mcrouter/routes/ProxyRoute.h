@@ -9,12 +9,17 @@
  */
 #pragma once
 
+#include <array>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "mcrouter/HotKeyTracker.h"
 #include "mcrouter/lib/mc/msg.h"
 #include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McOperationTraits.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
 #include "mcrouter/lib/Reply.h"
 #include "mcrouter/lib/routes/AllSyncRoute.h"
 #include "mcrouter/proxy.h"
@@ -27,73 +32,85 @@
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
+class OutlierDetector;
+
 McrouterRouteHandlePtr makeBigValueRoute(McrouterRouteHandlePtr ch,
                                          BigValueRouteOptions options);
 
 McrouterRouteHandlePtr
 makeDestinationRoute(std::shared_ptr<const ProxyClientCommon> client,
-                     std::shared_ptr<ProxyDestination> destination);
+                     std::shared_ptr<ProxyDestination> destination,
+                     std::shared_ptr<OutlierDetector> outlierDetector);
 
 /**
  * This is the top-most level of Mcrouter's RouteHandle tree.
  */
 class ProxyRoute {
- private:
-  ProxyMcReply dispatchMcMsgHelper(
-    McMsgRef&& msg,
-    std::shared_ptr<ProxyRequestContext> ctx,
-    McOpList::Item<0>) const {
-
-    throw std::runtime_error("dispatch for requested op not implemented");
-  }
-
-  template <int op_id>
-  ProxyMcReply dispatchMcMsgHelper(
-    McMsgRef&& msg,
-    std::shared_ptr<ProxyRequestContext> ctx,
-    McOpList::Item<op_id>) const {
-
-    if (msg->op == McOpList::Item<op_id>::op::mc_op) {
-      return route(ProxyMcRequest(std::move(ctx), std::move(msg)),
-                   typename McOpList::Item<op_id>::op());
-    }
-
-    return dispatchMcMsgHelper(std::move(msg), std::move(ctx),
-                               McOpList::Item<op_id-1>());
-  }
-
  public:
   static std::string routeName() { return "proxy"; }
 
   ProxyRoute(proxy_t* proxy, const RouteSelectorMap& routeSelectors)
       : proxy_(proxy) {
-    root_ = std::make_shared<McrouterRouteHandle<RootRoute>>(
-      proxy_, routeSelectors);
+    rootRoute_ = std::make_shared<RootRouteHandle>(proxy_, routeSelectors);
+    root_ = rootRoute_;
     if (proxy_->opts.big_value_split_threshold != 0) {
-      BigValueRouteOptions options(proxy_->opts.big_value_split_threshold);
+      BigValueRouteOptions options(
+        proxy_->opts.big_value_split_threshold,
+        proxy_->opts.big_value_max_chunk_fanout,
+        proxy_->opts.big_value_manifest_cache_size);
       root_ = makeBigValueRoute(std::move(root_), std::move(options));
     }
+    opRoots_.fill(root_);
+    initOpRoots(McOpList::LastItem());
   }
 
+  /**
+   * Routes msg according to its op, looked up in a table built from
+   * McOpList once per process instead of comparing against every op.
+   */
   ProxyMcReply dispatchMcMsg(
     McMsgRef&& msg,
     std::shared_ptr<ProxyRequestContext> ctx) const {
 
-    return dispatchMcMsgHelper(std::move(msg), std::move(ctx),
-                               McOpList::LastItem());
+    auto fn = opTables().dispatch[opIndex(msg->op)];
+    return (this->*fn)(std::move(msg), std::move(ctx));
+  }
+
+  /**
+   * With --skip-dead-routes, if msg could only be routed to route handles
+   * known dead, sets reply to the reply it would end up with.
+   * Unlike dispatchMcMsg(), doesn't need to run on a fiber.
+   *
+   * @return true if reply was set, msg doesn't need to be routed
+   */
+  bool knownDeadReply(const McMsgRef& msg, McReply& reply) const {
+    if (!proxy_->opts.skip_dead_routes) {
+      return false;
+    }
+    auto fn = opTables().knownDeadReply[opIndex(msg->op)];
+    return (this->*fn)(msg, reply);
+  }
+
+  /**
+   * True if dispatchMcMsg(msg) can be called outside of a fiber, see
+   * RootRoute::routesInline(). Never with BigValueRoute in between.
+   */
+  bool routesInline(const McMsgRef& msg) const {
+    auto fn = opTables().routesInline[opIndex(msg->op)];
+    return (this->*fn)(msg);
   }
 
   template <class Operation, class Request>
   std::vector<McrouterRouteHandlePtr> couldRouteTo(
     const Request& req, Operation) const {
 
-    return { root_ };
+    return { opRoots_[Operation::mc_op] };
   }
 
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation) const {
-    return root_->route(req, Operation());
+    return opRoots_[Operation::mc_op]->route(req, Operation());
   }
 
   template <class Request>
@@ -111,14 +128,129 @@ class ProxyRoute {
     auto clients = proxy_->getConfig()->getClients();
     for (auto& client : clients) {
       auto dest = proxy_->destinationMap->fetch(*client);
-      rh.push_back(makeDestinationRoute(std::move(client), std::move(dest)));
+      rh.push_back(makeDestinationRoute(std::move(client), std::move(dest),
+                                        nullptr));
     }
-    return AllSyncRoute<McrouterRouteHandleIf>(std::move(rh)).route(req, op);
+    return AllSyncRoute<McrouterRouteHandleIf>(
+      std::move(rh), proxy_->opts.flush_all_max_concurrency).route(req, op);
   }
 
  private:
+  /* Gives access to RootRoute::knownDeadReply() and routesInline() */
+  class RootRouteHandle : public McrouterRouteHandle<RootRoute> {
+   public:
+    template <typename... Args>
+    explicit RootRouteHandle(Args&&... args)
+      : McrouterRouteHandle<RootRoute>(std::forward<Args>(args)...) {
+    }
+
+    const RootRoute& rootRoute() const {
+      return this->route_;
+    }
+  };
+
   proxy_t* proxy_;
+  std::shared_ptr<RootRouteHandle> rootRoute_;
   McrouterRouteHandlePtr root_;
+
+  /**
+   * Where requests of each op start, resolved at config load: BigValueRoute
+   * only changes get-like and update-like requests, other ops skip it.
+   */
+  std::array<McrouterRouteHandlePtr, mc_nops> opRoots_;
+
+  void initOpRoots(McOpList::Item<0>) {}
+
+  template <int op_id>
+  void initOpRoots(McOpList::Item<op_id>) {
+    using Op = typename McOpList::Item<op_id>::op;
+    if (!GetLike<Op>::value && !UpdateLike<Op>::value) {
+      opRoots_[Op::mc_op] = rootRoute_;
+    }
+    initOpRoots(McOpList::Item<op_id-1>());
+  }
+
+  using DispatchFn = ProxyMcReply (ProxyRoute::*)(
+    McMsgRef&&, std::shared_ptr<ProxyRequestContext>) const;
+  using KnownDeadReplyFn =
+    bool (ProxyRoute::*)(const McMsgRef&, McReply&) const;
+  using RoutesInlineFn = bool (ProxyRoute::*)(const McMsgRef&) const;
+
+  /* Per op entry points, shared by all ProxyRoutes */
+  struct OpTables {
+    std::array<DispatchFn, mc_nops> dispatch;
+    std::array<KnownDeadReplyFn, mc_nops> knownDeadReply;
+    std::array<RoutesInlineFn, mc_nops> routesInline;
+
+    OpTables() {
+      dispatch.fill(&ProxyRoute::dispatchUnknownOp);
+      knownDeadReply.fill(&ProxyRoute::knownDeadReplyUnknownOp);
+      routesInline.fill(&ProxyRoute::routesInlineUnknownOp);
+      init(McOpList::LastItem());
+    }
+
+    void init(McOpList::Item<0>) {}
+
+    template <int op_id>
+    void init(McOpList::Item<op_id>) {
+      using Op = typename McOpList::Item<op_id>::op;
+      dispatch[Op::mc_op] = &ProxyRoute::dispatchOp<Op>;
+      knownDeadReply[Op::mc_op] = &ProxyRoute::knownDeadReplyOp<Op>;
+      routesInline[Op::mc_op] = &ProxyRoute::routesInlineOp<Op>;
+      init(McOpList::Item<op_id-1>());
+    }
+  };
+
+  static const OpTables& opTables() {
+    static const OpTables tables;
+    return tables;
+  }
+
+  static size_t opIndex(mc_op_t op) {
+    return static_cast<size_t>(op) < mc_nops ? op : mc_op_unknown;
+  }
+
+  template <class Operation>
+  ProxyMcReply dispatchOp(McMsgRef&& msg,
+                          std::shared_ptr<ProxyRequestContext> ctx) const {
+    ProxyMcRequest req(std::move(ctx), std::move(msg));
+    if (proxy_->hotKeys) {
+      proxy_->hotKeys->onRequest(req.keyWithoutRoute(), req.routingPrefix());
+    }
+    return route(req, Operation());
+  }
+
+  ProxyMcReply dispatchUnknownOp(McMsgRef&& msg,
+                                 std::shared_ptr<ProxyRequestContext> ctx)
+    const {
+
+    throw std::runtime_error("dispatch for requested op not implemented");
+  }
+
+  template <class Operation>
+  bool knownDeadReplyOp(const McMsgRef& msg, McReply& reply) const {
+    McRequest req(msg.clone());
+    return rootRoute_->rootRoute().knownDeadReply(req, Operation(), reply);
+  }
+
+  bool knownDeadReplyUnknownOp(const McMsgRef& msg, McReply& reply) const {
+    return false;
+  }
+
+  template <class Operation>
+  bool routesInlineOp(const McMsgRef& msg) const {
+    /* flushall goes to every client through AllSyncRoute, see route() */
+    if (Operation::mc_op == mc_op_flushall ||
+        opRoots_[Operation::mc_op] != rootRoute_) {
+      return false;
+    }
+    McRequest req(msg.clone());
+    return rootRoute_->rootRoute().routesInline(req, Operation());
+  }
+
+  bool routesInlineUnknownOp(const McMsgRef& msg) const {
+    return false;
+  }
 };
 
 }}}  // facebook::memcache::mcrouter
@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "mcrouter/lib/Reply.h"
+#include "mcrouter/ProxyClock.h"
 #include "mcrouter/routes/RateLimiter.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -44,7 +45,7 @@ class RateLimitRoute {
   template <class Operation, class Request>
   typename ReplyType<Operation, Request>::type route(const Request& req,
                                                      Operation) {
-    if (LIKELY(rl_.canPassThrough(Operation()))) {
+    if (LIKELY(rl_.canPassThrough(Operation(), coarseNowSec(req)))) {
       return target_->route(req, Operation());
     }
 
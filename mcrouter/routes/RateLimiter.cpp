@@ -9,9 +9,12 @@
  */
 #include "RateLimiter.h"
 
+#include <algorithm>
 #include <string>
+#include <utility>
 
 #include <folly/dynamic.h>
+#include <folly/Memory.h>
 
 #include "mcrouter/lib/fbi/cpp/util.h"
 
@@ -39,30 +42,87 @@ double asPositiveDoubleDefault(const dynamic& obj, const string& keyName,
   return def;
 }
 
+/**
+ * @return (rate, burst) of operations op ("gets", "sets" or "deletes"),
+ *         none if they are not rate limited.
+ */
+folly::Optional<std::pair<double, double>> parseRate(const dynamic& json,
+                                                     const string& op) {
+  auto rateKey = op + "_rate";
+  if (!json.count(rateKey)) {
+    return folly::none;
+  }
+  double rate = asPositiveDouble(json, rateKey);
+  double burst = asPositiveDoubleDefault(json, op + "_burst", rate);
+  return std::make_pair(rate, burst);
+}
+
+std::unique_ptr<AtomicTokenBucket> makeSharedBucket(const dynamic& json,
+                                                    const string& op) {
+  auto rate = parseRate(json, op);
+  if (!rate) {
+    return nullptr;
+  }
+  checkLogic(rate->second >= 1.0, "{}_burst is less than 1", op);
+  return folly::make_unique<AtomicTokenBucket>(rate->first, rate->second);
+}
+
+double batchSize(const dynamic& json, double rate, double burst) {
+  if (json.count("global_batch")) {
+    return asPositiveDouble(json, "global_batch");
+  }
+  // 1ms worth of tokens, but don't let proxies hold much of the burst
+  return std::max(1.0, std::min(rate / 1000.0, burst / 8.0));
+}
+
 }  // namespace
 
-RateLimiter::RateLimiter(const folly::dynamic& json) {
+RateLimiter::SharedBuckets::SharedBuckets(const folly::dynamic& json) {
   checkLogic(json.isObject(), "RateLimiter settings json is not an object");
 
-  auto now = TokenBucket::defaultClockNow();
+  getsTb_ = makeSharedBucket(json, "gets");
+  setsTb_ = makeSharedBucket(json, "sets");
+  deletesTb_ = makeSharedBucket(json, "deletes");
+}
 
-  if (json.count("gets_rate")) {
-    double rate = asPositiveDouble(json, "gets_rate");
-    double burst = asPositiveDoubleDefault(json, "gets_burst", rate);
-    getsTb_ = TokenBucket(rate, burst, now);
-  }
+RateLimiter::RateLimiter(const folly::dynamic& json,
+                         std::shared_ptr<SharedBuckets> shared)
+    : shared_(std::move(shared)) {
+  checkLogic(json.isObject(), "RateLimiter settings json is not an object");
 
-  if (json.count("sets_rate")) {
-    double rate = asPositiveDouble(json, "sets_rate");
-    double burst = asPositiveDoubleDefault(json, "sets_burst", rate);
-    setsTb_ = TokenBucket(rate, burst, now);
-  }
+  bool global = isGlobal(json);
+  checkLogic(!global || shared_, "RateLimiter: global rates are not shared");
+
+  auto now = TokenBucket::defaultClockNow();
+  auto makeBucket = [&json, global, now](const string& op,
+                                         AtomicTokenBucket* sharedTb) {
+    folly::Optional<Bucket> bucket;
+    auto rate = parseRate(json, op);
+    if (!rate) {
+      return bucket;
+    }
+    if (global) {
+      checkLogic(sharedTb, "RateLimiter: no shared bucket for {}", op);
+      bucket.emplace(*sharedTb, batchSize(json, rate->first, rate->second));
+    } else {
+      bucket.emplace(TokenBucket(rate->first, rate->second, now));
+    }
+    return bucket;
+  };
+
+  getsTb_ = makeBucket("gets", global ? shared_->getsTb_.get() : nullptr);
+  setsTb_ = makeBucket("sets", global ? shared_->setsTb_.get() : nullptr);
+  deletesTb_ = makeBucket("deletes",
+                          global ? shared_->deletesTb_.get() : nullptr);
+}
 
-  if (json.count("deletes_rate")) {
-    double rate = asPositiveDouble(json, "deletes_rate");
-    double burst = asPositiveDoubleDefault(json, "deletes_burst", rate);
-    deletesTb_ = TokenBucket(rate, burst, now);
+bool RateLimiter::isGlobal(const folly::dynamic& json) {
+  auto jglobal = json.get_ptr("global");
+  if (!jglobal) {
+    return false;
   }
+  checkLogic(jglobal->isBool(), "RateLimiter: global is not a bool");
+  return jglobal->getBool();
 }
 
 }}}  // facebook::memcache::mcrouter
@@ -9,8 +9,11 @@
  */
 #pragma once
 
+#include <memory>
+
 #include <folly/Optional.h>
 
+#include "mcrouter/AtomicTokenBucket.h"
 #include "mcrouter/lib/McOperationTraits.h"
 #include "mcrouter/TokenBucket.h"
 
@@ -23,15 +26,40 @@ namespace facebook { namespace memcache { namespace mcrouter {
 /**
  * This is a container for TokenBucket rate limiters for different
  * operation types.
+ *
+ * By default each RateLimiter (i.e. each proxy) has its own buckets, so
+ * the total rate is multiplied by the number of proxies. With
+ * "global": true the buckets are AtomicTokenBuckets shared by all proxies
+ * (see SharedBuckets). To keep contention low, each proxy takes tokens
+ * from the shared bucket in batches of "global_batch" tokens (by default
+ * 1ms worth of tokens, at most 1/8 of the burst), so up to one batch
+ * per proxy may be consumed ahead of time.
  */
 class RateLimiter {
  public:
+  /**
+   * Token buckets of a global rate limiting config, shared by RateLimiters
+   * of all proxies.
+   */
+  class SharedBuckets {
+   public:
+    explicit SharedBuckets(const folly::dynamic& json);
+
+   private:
+    std::unique_ptr<AtomicTokenBucket> getsTb_;
+    std::unique_ptr<AtomicTokenBucket> setsTb_;
+    std::unique_ptr<AtomicTokenBucket> deletesTb_;
+
+    friend class RateLimiter;
+  };
+
   /**
    * @param json  Rate limiting configuration; must be an object. Format:
    *
    *              { "gets_rate": GR, "gets_burst": GB,
    *                "sets_rate": SR, "sets_burst": GB,
-   *                "deletes_rate": DR, "deletes_burst": DB }
+   *                "deletes_rate": DR, "deletes_burst": DB,
+   *                "global": G, "global_batch": B }
    *
    *              Where rate and burst parameters are passed to
    *              the corresponding TokenBucket's constructor.
@@ -39,39 +67,93 @@ class RateLimiter {
    *              performed for that operation.
    *              If some *_burst key is missing, burst is set
    *              equal to rate.
+   * @param shared  buckets shared by all proxies, required if
+   *                isGlobal(json).
+   */
+  explicit RateLimiter(const folly::dynamic& json,
+                       std::shared_ptr<SharedBuckets> shared = nullptr);
+
+  /**
+   * @return true if json configures rates shared by all proxies
    */
-  explicit RateLimiter(const folly::dynamic& json);
+  static bool isGlobal(const folly::dynamic& json);
 
+  /**
+   * Takes a token for the operation, if it's rate limited.
+   *
+   * @param now  current time in seconds, from nowSec() or a coarser
+   *             clock like coarseNowSec()
+   */
   template <class Operation>
-  bool canPassThrough(Operation, typename GetLike<Operation>::Type = 0) {
-    return LIKELY(
-      !getsTb_ || getsTb_->consume(1.0, TokenBucket::defaultClockNow()));
+  bool canPassThrough(Operation, double now,
+                      typename GetLike<Operation>::Type = 0) {
+    return LIKELY(!getsTb_ || getsTb_->consume(now));
   }
 
   template <class Operation>
-  bool canPassThrough(Operation, typename UpdateLike<Operation>::Type = 0) {
-    return LIKELY(
-      !setsTb_ || setsTb_->consume(1.0, TokenBucket::defaultClockNow()));
+  bool canPassThrough(Operation, double now,
+                      typename UpdateLike<Operation>::Type = 0) {
+    return LIKELY(!setsTb_ || setsTb_->consume(now));
   }
 
   template <class Operation>
-  bool canPassThrough(Operation, typename DeleteLike<Operation>::Type = 0) {
-    return LIKELY(
-      !deletesTb_ || deletesTb_->consume(1.0, TokenBucket::defaultClockNow()));
+  bool canPassThrough(Operation, double now,
+                      typename DeleteLike<Operation>::Type = 0) {
+    return LIKELY(!deletesTb_ || deletesTb_->consume(now));
   }
 
   template <class Operation>
-  bool canPassThrough(Operation, OtherThanT(Operation,
-                                            GetLike<>,
-                                            UpdateLike<>,
-                                            DeleteLike<>) = 0) {
+  bool canPassThrough(Operation, double now,
+                      OtherThanT(Operation,
+                                 GetLike<>,
+                                 UpdateLike<>,
+                                 DeleteLike<>) = 0) {
     return true;
   }
 
  private:
-  folly::Optional<TokenBucket> getsTb_;
-  folly::Optional<TokenBucket> setsTb_;
-  folly::Optional<TokenBucket> deletesTb_;
+  /**
+   * Either a TokenBucket of this RateLimiter, or a batch of tokens taken
+   * from a shared AtomicTokenBucket.
+   */
+  class Bucket {
+   public:
+    explicit Bucket(TokenBucket local)
+        : local_(std::move(local)) {
+    }
+
+    Bucket(AtomicTokenBucket& shared, double batch)
+        : shared_(&shared),
+          batch_(batch) {
+    }
+
+    bool consume(double now) {
+      if (!shared_) {
+        return local_->consume(1.0, now);
+      }
+      if (tokens_ >= 1.0) {
+        tokens_ -= 1.0;
+        return true;
+      }
+      if (batch_ > 1.0 && shared_->consume(batch_, now)) {
+        tokens_ = batch_ - 1.0;
+        return true;
+      }
+      return shared_->consume(1.0, now);
+    }
+
+   private:
+    folly::Optional<TokenBucket> local_;
+    AtomicTokenBucket* shared_{nullptr};
+    double batch_{1.0};
+    /* Tokens of the last batch not consumed yet */
+    double tokens_{0.0};
+  };
+
+  std::shared_ptr<SharedBuckets> shared_;
+  folly::Optional<Bucket> getsTb_;
+  folly::Optional<Bucket> setsTb_;
+  folly::Optional<Bucket> deletesTb_;
 };
 
 }}}  // facebook::memcache::mcrouter
@@ -9,13 +9,22 @@
  */
 #pragma once
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/Optional.h>
+
+#include "mcrouter/lib/fibers/FiberManager.h"
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/RetryBudget.h"
 #include "mcrouter/lib/routes/AllSyncRoute.h"
 #include "mcrouter/lib/routes/ErrorRoute.h"
-#include "mcrouter/lib/routes/FailoverRoute.h"
 #include "mcrouter/lib/routes/HashRoute.h"
 #include "mcrouter/lib/routes/NullRoute.h"
+#include "mcrouter/lib/SubRequests.h"
 #include "mcrouter/proxy.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -28,7 +37,11 @@ namespace facebook { namespace memcache { namespace mcrouter {
  * first salt and if error reply received it will try the next in
  * the list and continue so on until an non-error reply is receieved.
  * If all the requests fails it will return the reply from the last
- * salt.
+ * salt. Salts that hash to a destination known dead (see
+ * RouteHandleIf::knownDead()) are skipped. The failover destinations are
+ * hashed all at once, only after the first salt's reply was an error.
+ * Like FailoverRoute, failovers after an error reply are subject to
+ * the retry budget (see failoverAllowed()).
  *
  * For all other operation reply from the first salted route is returned.
  */
@@ -44,7 +57,6 @@ class ReliablePoolRoute {
       : destinations_(std::move(destinations)),
         failoverCount_(failoverCount),
         rhs_(makeFailoverTargets(std::move(init_salt))),
-        failoverRoute_(rhs_),
         allSyncRoute_(rhs_) {
   }
 
@@ -60,7 +72,7 @@ class ReliablePoolRoute {
     const Request& req, Operation,
     typename GetLike<Operation>::Type = 0) const {
 
-    return failoverRoute_.route(req, Operation());
+    return routeWithFailover(req, Operation());
   }
 
   template <class Operation, class Request>
@@ -68,7 +80,7 @@ class ReliablePoolRoute {
     const Request& req, Operation,
     typename UpdateLike<Operation>::Type = 0) const {
 
-    return failoverRoute_.route(req, Operation());
+    return routeWithFailover(req, Operation());
   }
 
   template <class Operation, class Request>
@@ -94,9 +106,71 @@ class ReliablePoolRoute {
   const std::vector<std::shared_ptr<RouteHandleIf>> destinations_;
   size_t failoverCount_;
   const std::vector<std::shared_ptr<HashRoute<RouteHandleIf, HashFunc>>> rhs_;
-  const FailoverRoute<HashRoute<RouteHandleIf, HashFunc>> failoverRoute_;
   const AllSyncRoute<HashRoute<RouteHandleIf, HashFunc>> allSyncRoute_;
 
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type routeWithFailover(
+    const Request& req, Operation) const {
+
+    if (destinations_.empty()) {
+      return NullRoute<RouteHandleIf>::route(req, Operation());
+    }
+
+    /* Hash functions can be stack-intensive,
+       so jump back to the main context */
+    auto first = fiber::runInMainContext([this, &req] () {
+        return this->rhs_.front()->pickDestination(req);
+      }
+    );
+    const auto& primary = destinations_[first];
+    if (rhs_.size() == 1) {
+      return primary->route(req, Operation());
+    }
+    failoverPrimaryRequest(req);
+    folly::Optional<typename ReplyType<Operation, Request>::type> reply;
+    if (!primary->knownDead()) {
+      reply = primary->route(req, Operation());
+      if (!reply->isFailoverError()) {
+        return std::move(*reply);
+      }
+    }
+
+    auto failover = fiber::runInMainContext([this, &req] () {
+        return this->failoverDestinations(req);
+      }
+    );
+    if (failover.size() > 1) {
+      enableSharedSerialization(req);
+    }
+    for (size_t i = 0; i < failover.size(); ++i) {
+      const auto& rh = destinations_[failover[i]];
+      if (i + 1 < failover.size() && rh->knownDead()) {
+        continue;
+      }
+      if (reply.hasValue() && !failoverAllowed(req)) {
+        break;
+      }
+      reply = rh->route(req, Operation());
+      if (!reply->isFailoverError()) {
+        break;
+      }
+    }
+    return std::move(*reply);
+  }
+
+  /**
+   * @return destinations of all salts but the first, in failover order
+   */
+  template <class Request>
+  std::vector<size_t> failoverDestinations(const Request& req) const {
+    std::vector<size_t> ret;
+    ret.reserve(rhs_.size() - 1);
+    for (size_t i = 1; i < rhs_.size(); ++i) {
+      ret.push_back(rhs_[i]->pickDestination(req));
+    }
+    return ret;
+  }
+
   std::vector<std::shared_ptr<HashRoute<RouteHandleIf, HashFunc>>>
   makeFailoverTargets(std::string init_salt) const {
     std::vector<std::shared_ptr<HashRoute<RouteHandleIf, HashFunc>>> ret;
@@ -11,6 +11,7 @@
 
 #include <memory>
 #include <string>
+#include <typeinfo>
 #include <vector>
 
 #include <folly/Likely.h>
@@ -20,6 +21,7 @@
 #include "mcrouter/lib/routes/ErrorRoute.h"
 #include "mcrouter/lib/routes/NullRoute.h"
 #include "mcrouter/proxy.h"
+#include "mcrouter/ProxyMcRequest.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 #include "mcrouter/routes/RouteHandleMap.h"
 
@@ -51,9 +53,6 @@ class RootRoute {
   typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation) const {
 
-    typedef typename ReplyType<Operation, Request>::type Reply;
-
-    Reply reply;
     /* If we have to send to more than one prefix,
        wait for the first in the list to reply and let others
        run in the background.
@@ -64,16 +63,62 @@ class RootRoute {
     if (UNLIKELY(rhPtr == nullptr)) {
       auto rh = rhMap_.getTargetsForKeySlow(req.routingPrefix(),
                                             req.routingKey());
-      reply = routeImpl(rh, req, Operation());
-    } else {
-      reply = routeImpl(*rhPtr, req, Operation());
+      return finishReply(doRoute(rh, req, Operation()), rh.empty(), req,
+                         Operation());
     }
+    return finishReply(doRoute(*rhPtr, req, Operation()), rhPtr->empty(), req,
+                       Operation());
+  }
 
-    if (reply.isError() && opts_.group_remote_errors) {
-      reply = Reply(mc_res_remote_error);
+  /**
+   * If all route handles req would be sent to are known dead
+   * (see McrouterRouteHandleIf::knownDead()), sets reply to the reply
+   * routing req would end up with, without routing it.
+   *
+   * @return true if reply was set
+   */
+  template <class Operation, class Request>
+  bool knownDeadReply(const Request& req, Operation,
+                      typename ReplyType<Operation, Request>::type& reply)
+    const {
+
+    typedef typename ReplyType<Operation, Request>::type Reply;
+
+    std::vector<McrouterRouteHandlePtr> slowTargets;
+    const auto* rhPtr =
+      rhMap_.getTargetsForKeyFast(req.routingPrefix(), req.routingKey());
+    if (UNLIKELY(rhPtr == nullptr)) {
+      slowTargets = rhMap_.getTargetsForKeySlow(req.routingPrefix(),
+                                                req.routingKey());
+      rhPtr = &slowTargets;
+    }
+    if (rhPtr->empty()) {
+      return false;
     }
+    for (const auto& rh : *rhPtr) {
+      if (!rh->knownDead()) {
+        return false;
+      }
+    }
+    reply = finishReply(Reply(TkoReply), false, req, Operation());
+    return true;
+  }
 
-    return reply;
+  /**
+   * True if routing req can be done outside of a fiber: it has no targets
+   * (the reply is an error right away) or a single one that routes inline
+   * (see McrouterRouteHandleIf::routesInline()). More targets always need
+   * a fiber, the others are routed in fibers of their own.
+   */
+  template <class Operation, class Request>
+  bool routesInline(const Request& req, Operation) const {
+    const auto* rhPtr =
+      rhMap_.getTargetsForKeyFast(req.routingPrefix(), req.routingKey());
+    if (UNLIKELY(rhPtr == nullptr)) {
+      return false;
+    }
+    return rhPtr->empty() ||
+           (rhPtr->size() == 1 && (*rhPtr)[0]->routesInline());
   }
 
  private:
@@ -81,14 +126,26 @@ class RootRoute {
   RouteHandleMap rhMap_;
 
   template <class Operation, class Request>
-  typename ReplyType<Operation, Request>::type routeImpl(
-    const std::vector<McrouterRouteHandlePtr>& rh,
+  typename ReplyType<Operation, Request>::type finishReply(
+    typename ReplyType<Operation, Request>::type reply, bool noTargets,
+    const Request& req, Operation) const {
+
+    reply = finishReplyForOp(std::move(reply), noTargets, req, Operation());
+    if (reply.isError() && opts_.group_remote_errors) {
+      typedef typename ReplyType<Operation, Request>::type Reply;
+      reply = Reply(mc_res_remote_error);
+    }
+    return reply;
+  }
+
+  template <class Operation, class Request>
+  typename ReplyType<Operation, Request>::type finishReplyForOp(
+    typename ReplyType<Operation, Request>::type reply, bool noTargets,
     const Request& req, Operation, typename GetLike<Operation>::Type = 0)
     const {
 
-    auto reply = doRoute(rh, req, Operation());
-    if (!reply.isError() || rh.empty()) {
-      /* rh.empty() case: for backwards compatibility,
+    if (!reply.isError() || noTargets) {
+      /* noTargets case: for backwards compatibility,
          always surface invalid routing errors */
       return reply;
     }
@@ -100,12 +157,11 @@ class RootRoute {
   }
 
   template <class Operation, class Request>
-  typename ReplyType<Operation, Request>::type routeImpl(
-    const std::vector<McrouterRouteHandlePtr>& rh,
+  typename ReplyType<Operation, Request>::type finishReplyForOp(
+    typename ReplyType<Operation, Request>::type reply, bool noTargets,
     const Request& req, Operation, typename ArithmeticLike<Operation>::Type = 0)
     const {
 
-    auto reply = doRoute(rh, req, Operation());
     if (reply.isError()) {
       return NullRoute<McrouterRouteHandleIf>::route(req, Operation());
     }
@@ -113,13 +169,13 @@ class RootRoute {
   }
 
   template <class Operation, class Request>
-  typename ReplyType<Operation, Request>::type routeImpl(
-    const std::vector<McrouterRouteHandlePtr>& rh,
+  typename ReplyType<Operation, Request>::type finishReplyForOp(
+    typename ReplyType<Operation, Request>::type reply, bool noTargets,
     const Request& req, Operation,
     OtherThanT(Operation, GetLike<>, ArithmeticLike<>) = 0)
     const {
 
-    return doRoute(rh, req, Operation());
+    return reply;
   }
 
   template <class Operation, class Request>
@@ -132,15 +188,20 @@ class RootRoute {
     }
 
     if (rh.size() > 1) {
-      auto reqCopy = std::make_shared<Request>(req.clone());
+      auto reqCopy = makeSharedRequest(req, req.clone());
       for (size_t i = 1; i < rh.size(); ++i) {
         auto r = rh[i];
         fiber::addTask(
           [r, reqCopy]() {
+            fiber::setStackSampleTag(typeid(*r).name());
             r->route(*reqCopy, Operation());
           });
       }
     }
+    // Stack usage of a sampled request fiber is attributed to the type of
+    // the route handle the request is routed to, see
+    // --fibers-stack-sample-rate
+    fiber::setStackSampleTag(typeid(*rh[0]).name());
     return rh[0]->route(req, Operation());
   }
 };
@@ -12,6 +12,7 @@
 #include <memory>
 #include <string>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <folly/Hash.h>
@@ -98,15 +99,20 @@ RouteHandleMap::RouteHandleMap(
   // create corresponding RoutePolicyMaps
   UniqueVectorMap uniqueVectors;
   allRoutes_ = makePolicyMap(uniqueVectors, allRoutes);
+  std::vector<std::pair<std::string, std::shared_ptr<RoutePolicyMap>>> maps;
   for (const auto& it : byRegion) {
-    byRegion_.emplace(it.first, makePolicyMap(uniqueVectors, it.second));
+    maps.emplace_back(it.first, makePolicyMap(uniqueVectors, it.second));
   }
+  byRegion_ = decltype(byRegion_)(std::move(maps));
+  maps.clear();
   for (const auto& it : byRoute) {
-    byRoute_.emplace(it.first, makePolicyMap(uniqueVectors, it.second));
+    maps.emplace_back(it.first, makePolicyMap(uniqueVectors, it.second));
   }
+  byRoute_ = decltype(byRoute_)(std::move(maps));
 
-  assert(byRoute_.find(defaultRoute_) != byRoute_.end());
-  defaultRouteMap_ = byRoute_[defaultRoute_];
+  auto defaultIt = byRoute_.find(defaultRoute_);
+  assert(defaultIt != byRoute_.end());
+  defaultRouteMap_ = defaultIt->second;
 }
 
 void RouteHandleMap::foreachRoutePolicy(folly::StringPiece prefix,
@@ -14,10 +14,10 @@
 #include <unordered_map>
 #include <vector>
 
-#include <folly/experimental/StringKeyedUnorderedMap.h>
 #include <folly/Range.h>
 
 #include "mcrouter/config.h"
+#include "mcrouter/lib/PerfectHashMap.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 #include "mcrouter/routes/RouteSelectorMap.h"
 
@@ -59,8 +59,10 @@ class RouteHandleMap {
   std::shared_ptr<RoutePolicyMap> defaultRouteMap_;
 
   std::shared_ptr<RoutePolicyMap> allRoutes_;
-  folly::StringKeyedUnorderedMap<std::shared_ptr<RoutePolicyMap>> byRegion_;
-  folly::StringKeyedUnorderedMap<std::shared_ptr<RoutePolicyMap>> byRoute_;
+  /* Known regions and routing prefixes don't change with the config,
+     see PerfectHashMap */
+  PerfectHashMap<std::shared_ptr<RoutePolicyMap>> byRegion_;
+  PerfectHashMap<std::shared_ptr<RoutePolicyMap>> byRoute_;
 
   void foreachRoutePolicy(folly::StringPiece prefix,
     std::function<void(const std::shared_ptr<RoutePolicyMap>&)> f) const;
@@ -10,6 +10,9 @@
 #include "RoutePolicyMap.h"
 
 #include <algorithm>
+#include <cassert>
+#include <map>
+#include <string>
 #include <unordered_set>
 #include <utility>
 
@@ -47,42 +50,45 @@ RoutePolicyMap::RoutePolicyMap(
   const vector<std::shared_ptr<PrefixRouteSelector>>& clusters) {
   // wildcards of all clusters
   vector<McrouterRouteHandlePtr> wildcards;
-  // Trie with aggregated policies from all clusters
-  Trie<vector<pair<size_t, McrouterRouteHandlePtr>>> t;
+  // aggregated policies from all clusters
+  std::map<std::string, vector<pair<size_t, McrouterRouteHandlePtr>>> t;
 
   for (size_t clusterId = 0; clusterId < clusters.size(); ++clusterId) {
     auto& policy = clusters[clusterId];
     wildcards.push_back(policy->wildcard);
 
     for (auto& it : policy->policies) {
-      auto clusterHandlePair = std::make_pair(clusterId, it.second);
-      auto existing = t.find(it.first);
-      if (existing != t.end()) {
-        existing->second.push_back(std::move(clusterHandlePair));
-      } else {
-        t.emplace(it.first, { clusterHandlePair });
-      }
+      t[it.first].push_back(std::make_pair(clusterId, it.second));
     }
   }
 
-  ut_.emplace("", std::move(wildcards));
+  vector<pair<std::string, vector<McrouterRouteHandlePtr>>> items;
+  items.emplace_back("", std::move(wildcards));
   // we iterate over keys in lexicographic order, so all prefixes of key will go
-  // before key itself
+  // before key itself and are still on the stack of (indices of) prefixes of
+  // the previous key
+  vector<size_t> prefixes = { 0 };
   for (auto& it : t) {
-    auto existing = ut_.findPrefix(it.first);
-    // at least empty string should be there
-    assert(existing != ut_.end());
-    ut_.emplace(it.first, overrideItems(existing->second, it.second));
+    while (!folly::StringPiece(it.first).startsWith(
+             items[prefixes.back()].first)) {
+      // at least empty string should be there
+      assert(prefixes.size() > 1);
+      prefixes.pop_back();
+    }
+    auto targets = overrideItems(items[prefixes.back()].second, it.second);
+    prefixes.push_back(items.size());
+    items.emplace_back(it.first, std::move(targets));
   }
-  for (auto& it : ut_) {
+  for (auto& it : items) {
     it.second = orderedUnique(it.second);
   }
+  ut_ = PrefixMap<vector<McrouterRouteHandlePtr>>(std::move(items));
 }
 
 const vector<McrouterRouteHandlePtr>&
 RoutePolicyMap::getTargetsForKey(folly::StringPiece key) const {
   auto result = ut_.findPrefix(key);
-  return result == ut_.end() ? emptyV_ : result->second;
+  return result ? *result : emptyV_;
 }
 
 }}}  // facebook::memcache::mcrouter
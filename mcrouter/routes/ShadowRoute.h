@@ -13,10 +13,13 @@
 #include <utility>
 #include <vector>
 
+#include <folly/Likely.h>
 #include <folly/Optional.h>
+#include <folly/ScopeGuard.h>
 
 #include "mcrouter/lib/fibers/FiberManager.h"
 #include "mcrouter/lib/Operation.h"
+#include "mcrouter/lib/SubRequests.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyMcRequest.h"
 #include "mcrouter/route.h"
@@ -33,6 +36,12 @@ namespace facebook { namespace memcache { namespace mcrouter {
  *   2) key hash is within settings range
  * Both ranges might be updated at runtime.
  * We can shadow to multiple shadow destinations for a given normal route.
+ *
+ * Settings are shared by the route trees of all proxies. Each route keeps
+ * its own snapshot of them, refreshed only when ShadowSettings::version()
+ * changes, so a request doesn't lock or copy shared_ptrs to read them.
+ * Like the rest of the route tree, the route is only used by the thread
+ * of its proxy.
  */
 template <class RouteHandleIf, class ShadowPolicy>
 class ShadowRoute {
@@ -47,6 +56,12 @@ class ShadowRoute {
         shadowData_(std::move(shadowData)),
         normalIndex_(normalIndex),
         shadowPolicy_(std::move(shadowPolicy)) {
+    snapshots_.reserve(shadowData_.size());
+    for (auto& iter : shadowData_) {
+      /* version first: an update in between is picked up on first use */
+      auto version = iter.second->version();
+      snapshots_.push_back({version, iter.second->getData()});
+    }
   }
 
   template <class Operation, class Request>
@@ -64,23 +79,42 @@ class ShadowRoute {
   typename ReplyType<Operation, Request>::type route(
     const Request& req, Operation) const {
 
+    /* Only copy the request if the policy wants to change it; otherwise
+       the normal route gets the original request. The shadow copy is made
+       once and shared by all shadow destinations. Key and value IOBufs
+       are refcounted, so neither copy duplicates the value buffer. */
     std::shared_ptr<Request> adjustedReq;
+    std::shared_ptr<Request> shadowReq;
     folly::Optional<typename ReplyType<Operation, Request>::type> normalReply;
-    for (auto iter: shadowData_) {
-      if (shouldShadow(req, iter.second.get())) {
-        if (!adjustedReq) {
-          adjustedReq = std::make_shared<Request>(
-            shadowPolicy_.updateRequestForShadowing(req, Operation()));
+    for (size_t i = 0; i < shadowData_.size(); ++i) {
+      auto& iter = shadowData_[i];
+      if (shouldShadow(req, settingsData(i))) {
+        if (!adjustedReq &&
+            shadowPolicy_.shouldModifyRequest(req, Operation())) {
+          adjustedReq = makeSharedRequest(
+            req, shadowPolicy_.updateRequestForShadowing(req, Operation()));
         }
+        const auto& baseReq = adjustedReq ? *adjustedReq : req;
         if (!normalReply && shadowPolicy_.shouldDelayShadow(req, Operation())) {
-          normalReply = normal_->route(*adjustedReq, Operation());
+          normalReply = normal_->route(baseReq, Operation());
+        }
+        auto reservedBytes = reserveShadowBytes(baseReq);
+        if (reservedBytes == kShadowOverLimit) {
+          continue;
+        }
+        if (!shadowReq) {
+          /* the normal route and the shadows mostly send the same bytes */
+          enableSharedSerialization(baseReq);
+          shadowReq = makeSharedRequest(baseReq, baseReq.clone());
+          attachRequestClass(*shadowReq);
         }
         auto shadow = iter.first;
         fiber::addTask(
-          [shadow, adjustedReq] () {
-            Request shadowReq(adjustedReq->clone());
-            attachRequestClass(shadowReq);
-            shadow->route(shadowReq, Operation());
+          [shadow, shadowReq, reservedBytes] () {
+            auto guard = folly::makeGuard([&shadowReq, reservedBytes]() {
+              releaseShadowBytes(*shadowReq, reservedBytes);
+            });
+            shadow->route(*shadowReq, Operation());
           });
       }
     }
@@ -98,6 +132,24 @@ class ShadowRoute {
   const size_t normalIndex_;
   ShadowPolicy shadowPolicy_;
 
+  struct SettingsSnapshot {
+    uint64_t version;
+    std::shared_ptr<const ShadowSettings::Data> data;
+  };
+  /* parallel to shadowData_ */
+  mutable std::vector<SettingsSnapshot> snapshots_;
+
+  const ShadowSettings::Data& settingsData(size_t i) const {
+    auto& snapshot = snapshots_[i];
+    auto& settings = *shadowData_[i].second;
+    auto version = settings.version();
+    if (UNLIKELY(version != snapshot.version)) {
+      snapshot.version = version;
+      snapshot.data = settings.getData();
+    }
+    return *snapshot.data;
+  }
+
   static void attachRequestClass(ProxyMcRequest& req) {
     req.setRequestClass(RequestClass::SHADOW);
   }
@@ -106,26 +158,64 @@ class ShadowRoute {
   static void attachRequestClass(Request& req) {
   }
 
+  static constexpr size_t kShadowOverLimit = static_cast<size_t>(-1);
+
+  /**
+   * Accounts key and value bytes of a shadow request against the proxy's
+   * --max-shadow-pending-bytes limit.
+   *
+   * @return  number of reserved bytes, kShadowOverLimit if the request
+   *          shouldn't be shadowed.
+   */
+  static size_t reserveShadowBytes(const ProxyMcRequest& req) {
+    auto& proxy = req.context().proxy();
+    if (proxy.opts.max_shadow_pending_bytes == 0) {
+      return 0;
+    }
+    auto bytes = req.fullKey().size() + req.value().computeChainDataLength();
+    if (proxy.pendingShadowBytes + bytes > proxy.opts.max_shadow_pending_bytes) {
+      stat_incr(proxy.stats, shadow_requests_over_limit_stat, 1);
+      return kShadowOverLimit;
+    }
+    proxy.pendingShadowBytes += bytes;
+    return bytes;
+  }
+
+  template <class Request>
+  static size_t reserveShadowBytes(const Request& req) {
+    return 0;
+  }
+
+  static void releaseShadowBytes(const ProxyMcRequest& req, size_t bytes) {
+    req.context().proxy().pendingShadowBytes -= bytes;
+  }
+
   template <class Request>
-  bool shouldShadow(const Request& req, ShadowSettings* settings) const {
-    auto data = settings->getData();
+  static void releaseShadowBytes(const Request& req, size_t bytes) {
+  }
 
-    if (normalIndex_ < data->start_index ||
-        normalIndex_ >= data->end_index) {
+  template <class Request>
+  bool shouldShadow(const Request& req,
+                    const ShadowSettings::Data& data) const {
+    if (normalIndex_ < data.start_index ||
+        normalIndex_ >= data.end_index) {
       return false;
     }
 
-    assert(data->start_key_fraction >= 0.0 &&
-           data->start_key_fraction <= 1.0 &&
-           data->end_key_fraction >= 0.0 &&
-           data->end_key_fraction <= 1.0 &&
-           data->start_key_fraction <= data->end_key_fraction);
+    assert(data.start_key_fraction >= 0.0 &&
+           data.start_key_fraction <= 1.0 &&
+           data.end_key_fraction >= 0.0 &&
+           data.end_key_fraction <= 1.0 &&
+           data.start_key_fraction <= data.end_key_fraction);
 
     return match_routing_key_hash(req.routingKeyHash(),
-      data->start_key_fraction,
-      data->end_key_fraction);
+      data.start_key_fraction,
+      data.end_key_fraction);
   }
 
 };
 
+template <class RouteHandleIf, class ShadowPolicy>
+constexpr size_t ShadowRoute<RouteHandleIf, ShadowPolicy>::kShadowOverLimit;
+
 }}}  // facebook::memcache::mcrouter
@@ -9,6 +9,8 @@
  */
 #include "ShardHashFunc.h"
 
+#include <limits>
+
 #include <folly/dynamic.h>
 
 namespace facebook { namespace memcache { namespace mcrouter {
@@ -48,22 +50,33 @@ size_t ConstShardHashFunc::operator()(folly::StringPiece key) const {
   return ch3_(key);
 }
 
+size_t ConstShardHashFunc::operator()(folly::StringPiece key,
+                                      FurcDigest digest) const {
+  size_t index;
+  if (shardLookup(key, &index)) {
+    return index;
+  }
+  return ch3_(key, digest);
+}
+
 bool ConstShardHashFunc::shardLookup(folly::StringPiece key,
                                      size_t* result) const {
   folly::StringPiece shard;
   if (!getShardId(key, shard)) {
     return false;
   }
+  /* Digit check and conversion in one pass, without the exceptions
+     folly::to would throw on overflow. */
+  size_t index = 0;
   for (const auto& iter: shard) {
     if (!isdigit(iter)) {
       return false;
     }
-  }
-  size_t index;
-  try {
-    index = folly::to<size_t>(shard);
-  } catch (...) {
-    return false;
+    size_t digit = iter - '0';
+    if (index > (std::numeric_limits<size_t>::max() - digit) / 10) {
+      return false;
+    }
+    index = index * 10 + digit;
   }
 
   if (index >= n_) {
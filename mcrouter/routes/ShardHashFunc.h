@@ -49,6 +49,9 @@ class ConstShardHashFunc {
 
   size_t operator()(folly::StringPiece key) const;
 
+  /* Keys without a shard id are hashed with the digest */
+  size_t operator()(folly::StringPiece key, FurcDigest digest) const;
+
   static std::string type() { return "ConstShard"; }
 
  private:
@@ -9,6 +9,8 @@
  */
 #include "ShardSplitRoute.h"
 
+#include <algorithm>
+
 #include "mcrouter/routes/McRouteHandleBuilder.h"
 #include "mcrouter/routes/McrouterRouteHandle.h"
 
@@ -16,21 +18,22 @@ namespace facebook { namespace memcache { namespace mcrouter {
 
 McrouterRouteHandlePtr makeShardSplitRoute(
   McrouterRouteHandlePtr rh,
-  ShardSplitter shardSplitter) {
+  std::shared_ptr<const ShardSplitter> shardSplitter) {
 
   return makeMcrouterRouteHandle<ShardSplitRoute>(
     std::move(rh), std::move(shardSplitter));
 }
 
-std::string createSplitKey(folly::StringPiece fullKey,
-                           size_t offset,
-                           folly::StringPiece shard) {
-  std::string newKey;
-  newKey.reserve(fullKey.size() + 2);
-  newKey.append(fullKey.begin(), shard.end());
-  newKey.push_back('a' + (offset % 26));
-  newKey.push_back('a' + (offset / 26));
-  newKey.append(shard.end(), fullKey.end());
+folly::IOBuf createSplitKey(folly::StringPiece fullKey,
+                            size_t offset,
+                            folly::StringPiece shard) {
+  folly::IOBuf newKey(folly::IOBuf::CREATE, fullKey.size() + 2);
+  auto out = reinterpret_cast<char*>(newKey.writableTail());
+  out = std::copy(fullKey.begin(), shard.end(), out);
+  *out++ = 'a' + (offset % 26);
+  *out++ = 'a' + (offset / 26);
+  std::copy(shard.end(), fullKey.end(), out);
+  newKey.append(fullKey.size() + 2);
   return newKey;
 }
 
@@ -14,6 +14,7 @@
 #include <vector>
 
 #include <folly/dynamic.h>
+#include <folly/io/IOBuf.h>
 #include <folly/MoveWrapper.h>
 #include <folly/Range.h>
 
@@ -23,6 +24,7 @@
 #include "mcrouter/lib/fibers/FiberManager.h"
 #include "mcrouter/lib/Operation.h"
 #include "mcrouter/lib/OperationTraits.h"
+#include "mcrouter/lib/SubRequests.h"
 #include "mcrouter/RecordingContext.h"
 #include "mcrouter/routes/ShardSplitter.h"
 
@@ -37,14 +39,18 @@ namespace facebook { namespace memcache { namespace mcrouter {
  * @param offset Which split the new key should route to.
  * @param shard The shard portion of fullKey. Must be a substring of 'fullKey'
  *              and can be obtained via getShardId().
- * @return A new key which routes to the n'th shard split for 'shard'.
+ * @return A new key which routes to the n'th shard split for 'shard',
+ *         in a buffer of its own that can be handed to the request as is.
  */
-std::string createSplitKey(folly::StringPiece fullKey,
-                           size_t offset,
-                           folly::StringPiece shard);
+folly::IOBuf createSplitKey(folly::StringPiece fullKey,
+                            size_t offset,
+                            folly::StringPiece shard);
 
 /**
  * Splits given request according to shard splits provided by ShardSplitter
+ *
+ * Deletes are sent to the other splits in the background, all of them
+ * with one routeSubRequests() call.
  */
 template <class RouteHandleIf>
 class ShardSplitRoute {
@@ -52,7 +58,7 @@ class ShardSplitRoute {
   static std::string routeName() { return "shard-split"; }
 
   ShardSplitRoute(std::shared_ptr<RouteHandleIf> rh,
-                  ShardSplitter shardSplitter)
+                  std::shared_ptr<const ShardSplitter> shardSplitter)
     : rh_(std::move(rh)),
       shardSplitter_(std::move(shardSplitter)) {
   }
@@ -60,7 +66,7 @@ class ShardSplitRoute {
   template <class Operation>
   std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
     const RecordingMcRequest& req, Operation) const {
-    req.context().recordShardSplitter(shardSplitter_);
+    req.context().recordShardSplitter(*shardSplitter_);
     return couldRouteToImpl(req, Operation());
   }
 
@@ -77,7 +83,7 @@ class ShardSplitRoute {
 
     // Gets are routed to one of the splits.
     folly::StringPiece shard;
-    auto cnt = shardSplitter_.getShardSplitCnt(req.routingKey(), shard);
+    auto cnt = shardSplitter_->getShardSplitCnt(req.routingKey(), shard);
     size_t i = globals::hostid() % cnt;
     if (i == 0) {
       return rh_->route(req, Operation());
@@ -98,13 +104,24 @@ class ShardSplitRoute {
 
     // Deletes are broadcast to all splits.
     folly::StringPiece shard;
-    auto cnt = shardSplitter_.getShardSplitCnt(req.routingKey(), shard);
-    auto r = rh_;
-    for (size_t i = 0; i < cnt - 1; ++i) {
-      auto wrappedReq = folly::makeMoveWrapper(splitReq(req, i, shard));
+    auto cnt = shardSplitter_->getShardSplitCnt(req.routingKey(), shard);
+    if (cnt > 1) {
+      std::vector<Request> splits;
+      splits.reserve(cnt - 1);
+      for (size_t i = 0; i < cnt - 1; ++i) {
+        splits.push_back(splitReq(req, i, shard));
+      }
+      auto r = rh_;
+      auto wrappedSplits = folly::makeMoveWrapper(std::move(splits));
       fiber::addTask(
-        [r, wrappedReq]() {
-          r->route(*wrappedReq, Operation());
+        [r, wrappedSplits]() {
+          using Reply = typename ReplyType<Operation, Request>::type;
+          std::vector<SubRequest<RouteHandleIf, Request>> subReqs;
+          subReqs.reserve(wrappedSplits->size());
+          for (const auto& split : *wrappedSplits) {
+            subReqs.push_back({r.get(), &split});
+          }
+          routeSubRequests(subReqs, Operation(), [] (size_t, Reply&&) {});
         });
     }
     return rh_->route(req, Operation());
@@ -112,7 +129,8 @@ class ShardSplitRoute {
 
  private:
   std::shared_ptr<RouteHandleIf> rh_;
-  const ShardSplitter shardSplitter_;
+  /* shared by all proxies */
+  const std::shared_ptr<const ShardSplitter> shardSplitter_;
 
   // from request with key 'prefix:shard:suffix' creates a copy of
   // request with key 'prefix:shardXY:suffix'
@@ -133,7 +151,7 @@ class ShardSplitRoute {
     }
 
     folly::StringPiece shard;
-    auto cnt = shardSplitter_.getShardSplitCnt(req.routingKey(), shard);
+    auto cnt = shardSplitter_->getShardSplitCnt(req.routingKey(), shard);
     if (cnt == 1) {
       return rh_->couldRouteTo(req, Operation());
     }
@@ -9,6 +9,10 @@
  */
 #include "ShardSplitter.h"
 
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <folly/dynamic.h>
 
 #include "mcrouter/routes/ShardHashFunc.h"
@@ -22,6 +26,7 @@ ShardSplitter::ShardSplitter(const folly::dynamic& json) {
     return;
   }
 
+  std::vector<std::pair<std::string, size_t>> splits;
   for (const auto& it : json.items()) {
     if (!it.second.isInt()) {
       LOG(ERROR) << "ShardSplitter: shard_splits value is not an int for "
@@ -36,11 +41,12 @@ ShardSplitter::ShardSplitter(const folly::dynamic& json) {
     } else if (static_cast<size_t>(splitCnt) > kMaxSplits) {
       LOG(ERROR) << "ShardSplitter: shard_splits value > " << kMaxSplits
                  << " '" << it.first.asString() << "': " << splitCnt;
-      shardSplits_.emplace(it.first.c_str(), kMaxSplits);
+      splits.emplace_back(it.first.asString().toStdString(), kMaxSplits);
     } else {
-      shardSplits_.emplace(it.first.c_str(), splitCnt);
+      splits.emplace_back(it.first.asString().toStdString(), splitCnt);
     }
   }
+  shardSplits_ = PerfectHashMap<size_t>(std::move(splits));
 }
 
 size_t ShardSplitter::getShardSplitCnt(folly::StringPiece routingKey,
@@ -9,10 +9,10 @@
  */
 #pragma once
 
-#include <folly/experimental/StringKeyedUnorderedMap.h>
 #include <folly/Range.h>
 
 #include "mcrouter/config.h"
+#include "mcrouter/lib/PerfectHashMap.h"
 
 namespace folly {
 class dynamic;
@@ -33,11 +33,12 @@ class ShardSplitter {
   size_t getShardSplitCnt(folly::StringPiece key,
                           folly::StringPiece& shardId) const;
 
-  const folly::StringKeyedUnorderedMap<size_t>& getShardSplits() const {
+  const PerfectHashMap<size_t>& getShardSplits() const {
     return shardSplits_;
   }
  private:
-  folly::StringKeyedUnorderedMap<size_t> shardSplits_;
+  /* Built once, shared by all proxies with the splitter */
+  PerfectHashMap<size_t> shardSplits_;
 };
 
 }}}  // facebook::memcache::mcrouter
@@ -9,7 +9,7 @@
  */
 #pragma once
 
-#include "mcrouter/config.h"
+#include "mcrouter/ProxyClock.h"
 
 namespace facebook { namespace memcache { namespace mcrouter {
 
@@ -18,7 +18,7 @@ class TimeProviderFunc {
  public:
   template <class Request>
   time_t operator() (const Request& req) const {
-    return nowWallSec();
+    return coarseNowWallSec(req);
   }
 };
 
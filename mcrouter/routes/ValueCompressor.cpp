@@ -0,0 +1,170 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include "ValueCompressor.h"
+
+#include <stdexcept>
+
+#include <folly/io/Compression.h>
+#include <folly/io/Cursor.h>
+#include <folly/Varint.h>
+
+#include "mcrouter/lib/fbi/cpp/util.h"
+#include "mcrouter/lib/mc/msg.h"
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+namespace {
+
+/* Corrupted lengths must not make us allocate arbitrary amounts of memory */
+const uint64_t kMaxUncompressedLength = 1ULL << 30;
+
+ValueCompressor::Codec parseCodec(const folly::dynamic& json) {
+  checkLogic(json.isString(), "compression: codec is not a string");
+  auto name = json.stringPiece();
+  if (name == "lz4") {
+    return ValueCompressor::Codec::LZ4;
+  } else if (name == "zstd") {
+    return ValueCompressor::Codec::ZSTD;
+  }
+  throw std::logic_error("compression: unknown codec " + name.str());
+}
+
+folly::io::CodecType codecType(ValueCompressor::Codec codec) {
+  switch (codec) {
+    case ValueCompressor::Codec::LZ4:
+      return folly::io::CodecType::LZ4;
+    case ValueCompressor::Codec::ZSTD:
+      return folly::io::CodecType::ZSTD;
+  }
+  return folly::io::CodecType::NO_COMPRESSION;
+}
+
+}  // anonymous namespace
+
+const uint64_t ValueCompressor::kCompressedFlags =
+  MC_MSG_FLAG_COMPRESSED | MC_MSG_FLAG_NZLIB_COMPRESSED |
+  MC_MSG_FLAG_QUICKLZ_COMPRESSED | MC_MSG_FLAG_SNAPPY_COMPRESSED |
+  MC_MSG_FLAG_LZ4_COMPRESSED | MC_MSG_FLAG_ZSTD_COMPRESSED;
+
+ValueCompressor::ValueCompressor(const folly::dynamic& json) {
+  checkLogic(json.isString() || json.isObject(),
+             "compression should be a string (codec) or an object");
+  if (json.isString()) {
+    codec_ = parseCodec(json);
+  } else {
+    auto jcodec = json.get_ptr("codec");
+    checkLogic(jcodec, "compression: codec not found");
+    codec_ = parseCodec(*jcodec);
+    if (auto jthreshold = json.get_ptr("threshold")) {
+      checkLogic(jthreshold->isInt() && jthreshold->getInt() >= 0,
+                 "compression: threshold is not a non-negative integer");
+      threshold_ = jthreshold->getInt();
+    }
+  }
+
+  // Fail on config load rather than on the first request
+  try {
+    getCodec(codec_);
+  } catch (const std::exception& e) {
+    throw std::logic_error(folly::sformat(
+      "compression: codec {} is not available: {}",
+      codecName(codec_), e.what()));
+  }
+}
+
+ValueCompressor::~ValueCompressor() {
+  /* Needed for forward declaration of folly::io::Codec in .h */
+}
+
+const char* ValueCompressor::codecName(Codec codec) {
+  switch (codec) {
+    case Codec::LZ4:
+      return "lz4";
+    case Codec::ZSTD:
+      return "zstd";
+  }
+  return "unknown";
+}
+
+uint64_t ValueCompressor::codecFlag(Codec codec) {
+  switch (codec) {
+    case Codec::LZ4:
+      return MC_MSG_FLAG_LZ4_COMPRESSED;
+    case Codec::ZSTD:
+      return MC_MSG_FLAG_ZSTD_COMPRESSED;
+  }
+  return 0;
+}
+
+bool ValueCompressor::isCompressed(uint64_t flags) {
+  return flags & (MC_MSG_FLAG_LZ4_COMPRESSED | MC_MSG_FLAG_ZSTD_COMPRESSED);
+}
+
+ValueCompressor::Codec ValueCompressor::flagsCodec(uint64_t flags) {
+  return (flags & MC_MSG_FLAG_ZSTD_COMPRESSED) ? Codec::ZSTD : Codec::LZ4;
+}
+
+stat_name_t ValueCompressor::cpuStat(Codec codec) {
+  switch (codec) {
+    case Codec::LZ4:
+      return compression_lz4_cpu_us_stat;
+    case Codec::ZSTD:
+      return compression_zstd_cpu_us_stat;
+  }
+  return compression_lz4_cpu_us_stat;
+}
+
+folly::io::Codec& ValueCompressor::getCodec(Codec codec) {
+  auto& c = codecs_[static_cast<size_t>(codec)];
+  if (!c) {
+    c = folly::io::getCodec(codecType(codec));
+  }
+  return *c;
+}
+
+folly::Optional<folly::IOBuf>
+ValueCompressor::compress(const folly::IOBuf& value) {
+  auto length = value.computeChainDataLength();
+  auto compressed = getCodec(codec_).compress(&value);
+
+  auto result = folly::IOBuf::create(folly::kMaxVarintLength64);
+  result->append(folly::encodeVarint(length, result->writableData()));
+  if (result->length() + compressed->computeChainDataLength() >= length) {
+    return folly::none;
+  }
+  result->prependChain(std::move(compressed));
+  return std::move(*result);
+}
+
+folly::IOBuf ValueCompressor::uncompress(const folly::IOBuf& value,
+                                         uint64_t flags) {
+  folly::io::Cursor cursor(&value);
+  uint64_t length = 0;
+  for (size_t shift = 0; ; shift += 7) {
+    if (shift >= 64) {
+      throw std::runtime_error("invalid uncompressed length");
+    }
+    auto byte = cursor.read<uint8_t>();
+    length |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      break;
+    }
+  }
+  if (length > kMaxUncompressedLength) {
+    throw std::runtime_error("uncompressed length is too large");
+  }
+
+  std::unique_ptr<folly::IOBuf> data;
+  cursor.clone(data, cursor.totalLength());
+  auto result = getCodec(flagsCodec(flags)).uncompress(data.get(), length);
+  return std::move(*result);
+}
+
+}}}  // facebook::memcache::mcrouter
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <folly/dynamic.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Optional.h>
+
+#include "mcrouter/stats.h"
+
+namespace folly { namespace io {
+class Codec;
+}}
+
+namespace facebook { namespace memcache { namespace mcrouter {
+
+/**
+ * Compresses values stored by mcrouter and uncompresses them in replies.
+ *
+ * Compressed values are marked with the flag of the codec
+ * (MC_MSG_FLAG_LZ4_COMPRESSED or MC_MSG_FLAG_ZSTD_COMPRESSED) and carry
+ * the uncompressed length as a varint in front of the codec output.
+ * Values of any known codec are uncompressed, not only the configured one,
+ * so the codec of a pool can be changed without flushing it.
+ *
+ * Codecs may keep state, so an instance must only be used from one thread.
+ */
+class ValueCompressor {
+ public:
+  enum class Codec {
+    LZ4,
+    ZSTD,
+  };
+
+  /* Flags of values compressed by clients or by mcrouter */
+  static const uint64_t kCompressedFlags;
+
+  /**
+   * @param json  codec name ("lz4" or "zstd"), or an object with
+   *              "codec" and optional "threshold" (minimum value size
+   *              to compress, 1024 by default).
+   * @throws std::logic_error on invalid config or unavailable codec
+   */
+  explicit ValueCompressor(const folly::dynamic& json);
+
+  ~ValueCompressor();
+
+  Codec codec() const {
+    return codec_;
+  }
+
+  size_t threshold() const {
+    return threshold_;
+  }
+
+  static const char* codecName(Codec codec);
+
+  /**
+   * @return flag marking values compressed with codec
+   */
+  static uint64_t codecFlag(Codec codec);
+
+  /**
+   * @return true if value with these flags was compressed by us
+   */
+  static bool isCompressed(uint64_t flags);
+
+  /**
+   * @return codec of value compressed by us with these flags
+   */
+  static Codec flagsCodec(uint64_t flags);
+
+  /**
+   * @return stat counting CPU time spent in codec
+   */
+  static stat_name_t cpuStat(Codec codec);
+
+  /**
+   * @return compressed value, none if it doesn't get smaller
+   */
+  folly::Optional<folly::IOBuf> compress(const folly::IOBuf& value);
+
+  /**
+   * @param flags  flags of the value, isCompressed(flags) must be true
+   * @throws std::exception if value is corrupted
+   */
+  folly::IOBuf uncompress(const folly::IOBuf& value, uint64_t flags);
+
+ private:
+  Codec codec_;
+  size_t threshold_{1024};
+  /* Indexed by Codec, created on first use */
+  std::unique_ptr<folly::io::Codec> codecs_[2];
+
+  folly::io::Codec& getCodec(Codec codec);
+};
+
+}}}  // facebook::memcache::mcrouter
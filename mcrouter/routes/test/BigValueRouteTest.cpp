@@ -7,6 +7,7 @@
  *  of patent rights can be found in the PATENTS file in the same directory.
  *
  */
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -215,3 +216,115 @@ TEST(BigValueRouteTest, bigvalue) {
     }
   });
 }
+
+TEST(BigValueRouteTest, chunkFanout) {
+  // with a fanout limit all chunks are still fetched and merged in order
+  std::string rand_suffix_get("123456");
+  int num_chunks = 10;
+  std::string init_reply =
+    folly::format("{}-{}-{}", version, num_chunks, rand_suffix_get).str();
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(GetRouteTestData(
+          mc_res_found, init_reply, MC_MSG_FLAG_BIG_VALUE))
+  };
+  auto route_handles = get_route_handles(test_handles);
+  BigValueRouteOptions fanout_options(threshold, /* maxChunkFanout */ 3);
+
+  TestFiberManager fm;
+
+  fm.runAll({
+    [&]() {
+      TestRouteHandle<BigValueRoute<TestRouteHandleIf>> rh(
+        route_handles[0], fanout_options);
+
+      auto msg = createMcMsgRef("key_get");
+      msg->op = mc_op_get;
+      McRequest req_get(std::move(msg));
+
+      auto f_get = rh.route(req_get, McOperation<mc_op_get>());
+      auto keys_get = test_handles[0]->saw_keys;
+      ASSERT_EQ(num_chunks + 1, keys_get.size());
+      EXPECT_EQ("key_get", keys_get.front());
+
+      std::string merged_str;
+      for (int i = 1; i < num_chunks + 1; i++) {
+        auto chunk_key = folly::format(
+          "key_get|#|{}:{}", i-1, rand_suffix_get).str();
+        EXPECT_EQ(chunk_key, keys_get[i]);
+        merged_str.append(init_reply);
+      }
+      EXPECT_EQ(mc_res_found, f_get.result());
+      EXPECT_EQ(merged_str, toString(f_get.value()));
+    }
+  });
+}
+
+TEST(BigValueRouteTest, manifestCache) {
+  std::string rand_suffix_get("123456");
+  int num_chunks = 4;
+  std::string init_reply =
+    folly::format("{}-{}-{}", version, num_chunks, rand_suffix_get).str();
+  vector<std::shared_ptr<TestHandle>> test_handles{
+    make_shared<TestHandle>(
+      GetRouteTestData(mc_res_found, init_reply, MC_MSG_FLAG_BIG_VALUE),
+      UpdateRouteTestData(mc_res_stored),
+      DeleteRouteTestData(mc_res_deleted))
+  };
+  auto route_handles = get_route_handles(test_handles);
+  BigValueRouteOptions cache_options(threshold, 0, /* manifestCacheSize */ 8);
+
+  std::string merged_str;
+  vector<string> chunk_keys;
+  for (int i = 0; i < num_chunks; i++) {
+    chunk_keys.push_back(
+      folly::format("key|#|{}:{}", i, rand_suffix_get).str());
+    merged_str.append(init_reply);
+  }
+
+  TestFiberManager fm;
+
+  fm.runAll({
+    [&]() {
+      TestRouteHandle<BigValueRoute<TestRouteHandleIf>> rh(
+        route_handles[0], cache_options);
+      auto& saw_keys = test_handles[0]->saw_keys;
+
+      auto get = [&rh]() {
+        auto msg = createMcMsgRef("key");
+        msg->op = mc_op_get;
+        McRequest req_get(std::move(msg));
+        return rh.route(req_get, McOperation<mc_op_get>());
+      };
+
+      // set stores the manifest of its own chunks
+      std::string big_value(threshold * num_chunks, 'v');
+      auto msg_set = createMcMsgRef("key", big_value);
+      msg_set->op = mc_op_set;
+      McRequest req_set(std::move(msg_set));
+      rh.route(req_set, McOperation<mc_op_set>());
+      auto set_chunk_key = saw_keys.front();
+      saw_keys.clear();
+
+      // cached manifest is stale (server has different chunks): chunks are
+      // fetched again according to the reply
+      auto reply = get();
+      EXPECT_EQ(merged_str, toString(reply.value()));
+      ASSERT_EQ(2 * num_chunks + 1, saw_keys.size());
+      EXPECT_NE(saw_keys.end(),
+                std::find(saw_keys.begin(), saw_keys.end(), set_chunk_key));
+      vector<string> refetched(saw_keys.end() - num_chunks, saw_keys.end());
+      EXPECT_EQ(chunk_keys, refetched);
+      saw_keys.clear();
+
+      // now the manifest is up to date, chunks are fetched only once
+      reply = get();
+      EXPECT_EQ(merged_str, toString(reply.value()));
+      ASSERT_EQ(num_chunks + 1, saw_keys.size());
+      std::sort(saw_keys.begin(), saw_keys.end());
+      vector<string> expected_keys = chunk_keys;
+      expected_keys.push_back("key");
+      std::sort(expected_keys.begin(), expected_keys.end());
+      EXPECT_EQ(expected_keys, saw_keys);
+    }
+  });
+}
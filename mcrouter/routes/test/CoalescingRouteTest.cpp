@@ -0,0 +1,218 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/fibers/Baton.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/CoalescingRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::vector;
+
+TEST(coalescingRouteTest, coalescesGets) {
+  vector<std::shared_ptr<TestHandle>> handle{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a", 7)),
+  };
+  TestRouteHandle<CoalescingRoute<TestRouteHandleIf>> rh(
+    get_route_handles(handle)[0]);
+
+  TestFiberManager fm;
+  handle[0]->pause();
+
+  auto get = [&rh] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("a", toString(reply.value()));
+    EXPECT_EQ(7, reply.flags());
+  };
+
+  fm.runAll({
+    get,
+    get,
+    get,
+    [&] () {
+      handle[0]->unpause();
+    }
+  });
+
+  EXPECT_EQ(vector<std::string>({"key"}), handle[0]->saw_keys);
+
+  /* Once the first request completed, new requests go to the target again */
+  fm.run(get);
+  EXPECT_EQ(2, handle[0]->saw_keys.size());
+}
+
+TEST(coalescingRouteTest, otherOperations) {
+  vector<std::shared_ptr<TestHandle>> handle{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+  };
+  TestRouteHandle<CoalescingRoute<TestRouteHandleIf>> rh(
+    get_route_handles(handle)[0]);
+
+  TestFiberManager fm;
+  fm.run([&] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+
+    McRequest req("key");
+    req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+    reply = rh.route(std::move(req), McOperation<mc_op_set>());
+    EXPECT_EQ(mc_res_stored, reply.result());
+
+    reply = rh.route(McRequest("key"), McOperation<mc_op_delete>());
+    EXPECT_EQ(mc_res_deleted, reply.result());
+  });
+
+  EXPECT_EQ(vector<mc_op_t>({mc_op_lease_get, mc_op_set, mc_op_delete}),
+            handle[0]->sawOperations);
+}
+
+TEST(coalescingRouteTest, leaseGetsNotCoalescedWithoutLeaseWait) {
+  vector<std::shared_ptr<TestHandle>> handle{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "", 0, 123)),
+  };
+  TestRouteHandle<CoalescingRoute<TestRouteHandleIf>> rh(
+    get_route_handles(handle)[0]);
+
+  TestFiberManager fm;
+  handle[0]->pause();
+
+  size_t tokens = 0;
+  auto leaseGet = [&rh, &tokens] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+    EXPECT_EQ(mc_res_notfound, reply.result());
+    EXPECT_EQ(123, reply.leaseToken());
+    ++tokens;
+  };
+
+  fm.runAll({
+    leaseGet,
+    leaseGet,
+    leaseGet,
+    [&] () {
+      handle[0]->unpause();
+    }
+  });
+
+  /* Every caller got its own token from the target */
+  EXPECT_EQ(3, tokens);
+  EXPECT_EQ(vector<mc_op_t>({mc_op_lease_get, mc_op_lease_get,
+                             mc_op_lease_get}),
+            handle[0]->sawOperations);
+}
+
+TEST(coalescingRouteTest, leaseWaitersGetLeaseSetValue) {
+  vector<std::shared_ptr<TestHandle>> handle{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "", 0, 123),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+  };
+  TestRouteHandle<CoalescingRoute<TestRouteHandleIf>> rh(
+    get_route_handles(handle)[0], std::chrono::milliseconds(60000));
+
+  TestFiberManager fm;
+  handle[0]->pause();
+
+  auto leaseGet = [&rh] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("value", toString(reply.value()));
+    EXPECT_EQ(5, reply.flags());
+  };
+
+  fm.runAll({
+    [&] () {
+      /* Gets the lease token */
+      auto reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+      EXPECT_EQ(mc_res_notfound, reply.result());
+      EXPECT_EQ(123, reply.leaseToken());
+
+      /* Let the others park */
+      Baton baton;
+      baton.timed_wait(std::chrono::milliseconds(50));
+
+      McRequest req("key");
+      req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+      req.setFlags(5);
+      req.setLeaseToken(reply.leaseToken());
+      reply = rh.route(std::move(req), McOperation<mc_op_lease_set>());
+      EXPECT_EQ(mc_res_stored, reply.result());
+    },
+    leaseGet,
+    leaseGet,
+    [&] () {
+      handle[0]->unpause();
+    }
+  });
+
+  EXPECT_EQ(vector<mc_op_t>({mc_op_lease_get, mc_op_lease_set}),
+            handle[0]->sawOperations);
+}
+
+TEST(coalescingRouteTest, leaseWaitersRetryAfterDelete) {
+  vector<std::shared_ptr<TestHandle>> handle{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "", 0, 1),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+  };
+  TestRouteHandle<CoalescingRoute<TestRouteHandleIf>> rh(
+    get_route_handles(handle)[0], std::chrono::milliseconds(60000));
+
+  TestFiberManager fm;
+
+  auto hotMiss = [&rh] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+    EXPECT_EQ(mc_res_notfound, reply.result());
+    EXPECT_EQ(1, reply.leaseToken());
+  };
+
+  fm.runAll({
+    hotMiss,
+    hotMiss,
+    [&] () {
+      rh.route(McRequest("key"), McOperation<mc_op_delete>());
+    }
+  });
+
+  /* Both parked on one hot miss */
+  EXPECT_EQ(vector<mc_op_t>({mc_op_lease_get, mc_op_delete}),
+            handle[0]->sawOperations);
+}
+
+TEST(coalescingRouteTest, leaseWaitTimeout) {
+  vector<std::shared_ptr<TestHandle>> handle{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_notfound, "", 0, 1)),
+  };
+  TestRouteHandle<CoalescingRoute<TestRouteHandleIf>> rh(
+    get_route_handles(handle)[0], std::chrono::milliseconds(10));
+
+  TestFiberManager fm;
+  fm.run([&] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+    EXPECT_EQ(mc_res_notfound, reply.result());
+    EXPECT_EQ(1, reply.leaseToken());
+  });
+  EXPECT_EQ(1, handle[0]->saw_keys.size());
+
+  /* The lease expired, so the next lease-get goes to the target */
+  fm.run([&] () {
+    rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+  });
+  EXPECT_EQ(2, handle[0]->saw_keys.size());
+}
@@ -33,3 +33,12 @@ TEST(constShardHashFuncTest, ch3Fallback) {
   EXPECT_EQ(0, func("blah:12c34:meh"));
   EXPECT_EQ(3, func("blah:4:meh"));
 }
+
+TEST(constShardHashFuncTest, overflowFallback) {
+  ConstShardHashFunc func(4);
+  Ch3HashFunc ch3(4);
+
+  folly::StringPiece key = "blah:18446744073709551616:meh";
+  EXPECT_EQ(ch3(key), func(key));
+  EXPECT_EQ(2, func("blah:000000000000000000000000002:meh"));
+}
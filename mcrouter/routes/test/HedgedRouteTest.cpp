@@ -0,0 +1,166 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/fibers/Baton.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/HedgedRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using HedgedTestRoute = TestRouteHandle<HedgedRoute<TestRouteHandleIf>>;
+
+namespace {
+
+vector<std::shared_ptr<TestHandle>> makeHandles() {
+  return {
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+  };
+}
+
+}  // anonymous namespace
+
+TEST(hedgedRouteTest, fastPrimary) {
+  auto handles = makeHandles();
+  HedgedTestRoute rh(handles[0]->rh, handles[1]->rh,
+                     std::chrono::milliseconds(100), 0, 100);
+
+  TestFiberManager fm;
+  fm.run([&] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("a", toString(reply.value()));
+  });
+
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+  EXPECT_TRUE(handles[1]->saw_keys.empty());
+}
+
+TEST(hedgedRouteTest, slowPrimary) {
+  auto handles = makeHandles();
+  HedgedTestRoute rh(handles[0]->rh, handles[1]->rh,
+                     std::chrono::milliseconds(10), 0, 100);
+
+  TestFiberManager fm;
+  handles[0]->pause();
+  fm.run([&] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("b", toString(reply.value()));
+    EXPECT_EQ(vector<string>{"key"}, handles[1]->saw_keys);
+
+    /* The primary reply arriving later is dropped */
+    handles[0]->unpause();
+  });
+
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+}
+
+TEST(hedgedRouteTest, primaryError) {
+  auto handles = makeHandles();
+  HedgedTestRoute rh(handles[0]->rh, handles[1]->rh,
+                     std::chrono::milliseconds(1000), 0, 0);
+
+  TestFiberManager fm;
+  handles[0]->setTko();
+  auto start = std::chrono::steady_clock::now();
+  fm.run([&] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+    EXPECT_EQ("b", toString(reply.value()));
+  });
+
+  /* Failover doesn't wait for the hedge delay and isn't limited by
+     max_hedge_percent */
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(1000));
+  EXPECT_EQ(vector<string>{"key"}, handles[1]->saw_keys);
+}
+
+TEST(hedgedRouteTest, hedgeLimit) {
+  auto handles = makeHandles();
+  HedgedTestRoute rh(handles[0]->rh, handles[1]->rh,
+                     std::chrono::milliseconds(10), 0, 0);
+
+  TestFiberManager fm;
+  handles[0]->pause();
+  fm.runAll({
+    [&] () {
+      auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+      EXPECT_EQ(mc_res_found, reply.result());
+      EXPECT_EQ("a", toString(reply.value()));
+    },
+    [&] () {
+      Baton baton;
+      baton.timed_wait(std::chrono::milliseconds(50));
+      handles[0]->unpause();
+    }
+  });
+
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+  EXPECT_TRUE(handles[1]->saw_keys.empty());
+}
+
+TEST(hedgedRouteTest, otherOperations) {
+  auto handles = makeHandles();
+  HedgedTestRoute rh(handles[0]->rh, handles[1]->rh,
+                     std::chrono::milliseconds(10), 0, 100);
+
+  TestFiberManager fm;
+  fm.run([&] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_set>());
+    EXPECT_EQ(mc_res_stored, reply.result());
+    reply = rh.route(McRequest("key"), McOperation<mc_op_delete>());
+    EXPECT_EQ(mc_res_deleted, reply.result());
+  });
+
+  EXPECT_EQ(vector<string>({"key", "key"}), handles[0]->saw_keys);
+  EXPECT_TRUE(handles[1]->saw_keys.empty());
+}
+
+TEST(hedgedRouteTest, leaseGetNotHedged) {
+  auto handles = makeHandles();
+  HedgedTestRoute rh(handles[0]->rh, handles[1]->rh,
+                     std::chrono::milliseconds(10), 0, 100);
+
+  TestFiberManager fm;
+  handles[0]->pause();
+  fm.runAll({
+    [&] () {
+      auto reply = rh.route(McRequest("key"), McOperation<mc_op_lease_get>());
+      EXPECT_EQ(mc_res_found, reply.result());
+      EXPECT_EQ("a", toString(reply.value()));
+    },
+    [&] () {
+      Baton baton;
+      baton.timed_wait(std::chrono::milliseconds(50));
+      handles[0]->unpause();
+    }
+  });
+
+  /* The lease token must come from the destination the lease-set goes to */
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+  EXPECT_TRUE(handles[1]->saw_keys.empty());
+}
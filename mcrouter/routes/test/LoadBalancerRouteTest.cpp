@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/routes/LoadBalancerRoute.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using std::make_shared;
+using std::string;
+using std::vector;
+
+using LoadBalancerTestRoute =
+  TestRouteHandle<LoadBalancerRoute<TestRouteHandleIf>>;
+
+TEST(loadBalancerRouteTest, avoidsInflight) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+  LoadBalancerTestRoute rh(get_route_handles(handles));
+
+  TestFiberManager fm;
+  handles[0]->pause();
+  handles[1]->pause();
+
+  auto get = [&rh] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ(mc_res_found, reply.result());
+  };
+
+  /* The first request is stuck on one of the children, so the second one
+     must go to the other */
+  fm.runAll({
+    get,
+    get,
+    [&] () {
+      handles[0]->unpause();
+      handles[1]->unpause();
+    }
+  });
+
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+  EXPECT_EQ(vector<string>{"key"}, handles[1]->saw_keys);
+}
+
+TEST(loadBalancerRouteTest, avoidsErrors) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+  LoadBalancerTestRoute rh(get_route_handles(handles));
+  handles[0]->setTko();
+
+  TestFiberManager fm;
+  fm.run([&rh] () {
+    for (size_t i = 0; i < 10; ++i) {
+      rh.route(McRequest("key"), McOperation<mc_op_get>());
+    }
+  });
+
+  /* At most one request could go to the failing child before
+     its latency was penalized */
+  EXPECT_GE(handles[1]->saw_keys.size(), 9);
+}
+
+TEST(loadBalancerRouteTest, singleChild) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+  };
+  LoadBalancerTestRoute rh(get_route_handles(handles));
+
+  TestFiberManager fm;
+  fm.run([&rh] () {
+    auto reply = rh.route(McRequest("key"), McOperation<mc_op_get>());
+    EXPECT_EQ("a", toString(reply.value()));
+  });
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+}
+
+TEST(loadBalancerRouteTest, updatesGoToAllChildren) {
+  vector<std::shared_ptr<TestHandle>> handles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b"),
+                            UpdateRouteTestData(mc_res_stored),
+                            DeleteRouteTestData(mc_res_deleted)),
+  };
+  LoadBalancerTestRoute rh(get_route_handles(handles));
+
+  TestFiberManager fm;
+  fm.run([&rh] () {
+    McRequest req("key");
+    req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+    auto reply = rh.route(std::move(req), McOperation<mc_op_set>());
+    EXPECT_EQ(mc_res_stored, reply.result());
+  });
+
+  /* Replicas stay interchangeable */
+  EXPECT_EQ(vector<string>{"key"}, handles[0]->saw_keys);
+  EXPECT_EQ(vector<string>{"key"}, handles[1]->saw_keys);
+  EXPECT_EQ(vector<mc_op_t>{mc_op_set}, handles[0]->sawOperations);
+  EXPECT_EQ(vector<mc_op_t>{mc_op_set}, handles[1]->sawOperations);
+}
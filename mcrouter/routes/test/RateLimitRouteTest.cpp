@@ -94,3 +94,29 @@ TEST(rateLimitRouteTest, getsBasic) { testGets(); }
 TEST(rateLimitRouteTest, getsBurst) { testGets(true); }
 TEST(rateLimitRouteTest, deletesBasic) { testDeletes(); }
 TEST(rateLimitRouteTest, deletesBurst) { testDeletes(true); }
+
+TEST(rateLimitRouteTest, globalShared) {
+  /* Slow enough to not refill during the test */
+  auto json = parseJsonString(
+    "{\"gets_rate\": 0.001, \"gets_burst\": 4.0,"
+    " \"global\": true, \"global_batch\": 2.0}");
+  EXPECT_TRUE(RateLimiter::isGlobal(json));
+  EXPECT_THROW(RateLimiter{json}, std::logic_error);
+
+  auto buckets = make_shared<RateLimiter::SharedBuckets>(json);
+  RateLimiter a(json, buckets);
+  RateLimiter b(json, buckets);
+
+  /* Both limiters draw from the same 4 tokens, 2 at a time */
+  McOperation<mc_op_get> get;
+  auto now = nowSec();
+  EXPECT_TRUE(a.canPassThrough(get, now));
+  EXPECT_TRUE(b.canPassThrough(get, now));
+  EXPECT_TRUE(a.canPassThrough(get, now));
+  EXPECT_TRUE(b.canPassThrough(get, now));
+  EXPECT_FALSE(a.canPassThrough(get, now));
+  EXPECT_FALSE(b.canPassThrough(get, now));
+
+  /* Not limited operations */
+  EXPECT_TRUE(a.canPassThrough(McOperation<mc_op_set>(), now));
+}
@@ -140,3 +140,32 @@ TEST(ReliablePoolRouteTest, deleteOps) {
   EXPECT_TRUE(saltedHandle[1]->saw_keys == (vector<std::string>{"key", "key"}));
   EXPECT_TRUE(saltedHandle[2]->saw_keys == (vector<std::string>{"key", "key"}));
 }
+
+TEST(ReliablePoolRouteTest, skipsDeadDestinations) {
+  counter = 0;
+  vector<std::shared_ptr<TestHandle>> saltedHandle{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_timeout, "a")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "c")),
+  };
+  saltedHandle[0]->setDead(true);
+  saltedHandle[1]->setDead(true);
+
+  TestFiberManager fm;
+
+  TestRouteHandle<ReliablePoolRoute<TestRouteHandleIf, HashFunc>> rh(
+    get_route_handles(saltedHandle),
+    HashFunc(saltedHandle.size()),
+    "", 5);
+
+  auto reply = rh.route(McRequest("key"),
+                        McOperation<mc_op_get>());
+
+  EXPECT_EQ(reply.result(), mc_res_found);
+  EXPECT_EQ(toString(reply.value()), "c");
+  EXPECT_TRUE(saltedHandle[0]->saw_keys.empty());
+  EXPECT_TRUE(saltedHandle[1]->saw_keys.empty());
+  EXPECT_TRUE(saltedHandle[2]->saw_keys == vector<std::string>{"key"});
+  /* the primary and all 5 failover salts were hashed once */
+  EXPECT_EQ(6, counter);
+}
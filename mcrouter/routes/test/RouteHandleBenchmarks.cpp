@@ -0,0 +1,320 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/**
+ * Cost of routing one request through representative route handle trees,
+ * built from JSON by RouteHandleFactory like a real config, on in-memory
+ * TestRouteHandle leaves that reply right away. Requests are routed from
+ * fibers as in a proxy, detached subrequests (shadows, warm up sets, ...)
+ * included, so route handle overhead is measured apart from the network
+ * and the protocol parsers.
+ *
+ * Prints the number of operator new calls per request of every case at the
+ * end; IOBuf data buffers are malloc()ed directly and not counted.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/dynamic.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Memory.h>
+#include <gflags/gflags.h>
+
+#include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/config/test/TestRouteHandleProvider.h"
+#include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/McRequest.h"
+#include "mcrouter/lib/routes/MigrateRoute.h"
+#include "mcrouter/lib/routes/WarmUpRoute.h"
+#include "mcrouter/lib/test/RouteHandleTestUtil.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/routes/BigValueRoute.h"
+#include "mcrouter/routes/DefaultShadowPolicy.h"
+#include "mcrouter/routes/OperationSelectorRoute.h"
+#include "mcrouter/routes/ShadowRoute.h"
+#include "mcrouter/routes/ShardSplitRoute.h"
+#include "mcrouter/routes/ShardSplitter.h"
+#include "mcrouter/routes/TimeProviderFunc.h"
+
+DEFINE_int32(alloc_requests, 10000,
+             "Requests to route per case when counting allocations");
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+std::atomic<size_t> gAllocations{0};
+
+}  // anonymous namespace
+
+void* operator new(size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto p = malloc(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+namespace {
+
+/* Replies right away, as a healthy server would */
+template <class RouteHandleIf>
+struct LeafRoute {
+  static std::string routeName() { return "leaf"; }
+
+  template <class Operation, class Request>
+  std::vector<std::shared_ptr<RouteHandleIf>> couldRouteTo(
+    const Request& req, Operation) const {
+    return {};
+  }
+
+  template <int M, class Request>
+  typename ReplyType<McOperation<M>, Request>::type route(
+    const Request& req, McOperation<M>) const {
+
+    if (GetLike<McOperation<M>>::value) {
+      return McReply(mc_res_found, value_.cloneAsValue());
+    }
+    if (UpdateLike<McOperation<M>>::value) {
+      return McReply(mc_res_stored);
+    }
+    if (DeleteLike<McOperation<M>>::value) {
+      return McReply(mc_res_deleted);
+    }
+    return McReply(DefaultReply, McOperation<M>());
+  }
+
+ private:
+  folly::IOBuf value_{folly::IOBuf::COPY_BUFFER, "value"};
+};
+
+/**
+ * The lib routes, "Leaf" and the mcrouter routes the benchmarked trees
+ * need, which McRouteHandleProvider would only build on top of a proxy.
+ */
+class BenchmarkRouteHandleProvider
+    : public RouteHandleProvider<TestRouteHandleIf> {
+ public:
+  std::vector<TestRouteHandlePtr>
+  create(RouteHandleFactory<TestRouteHandleIf>& factory,
+         folly::StringPiece type, const folly::dynamic& json) override {
+
+    if (type == "Leaf") {
+      return { makeRouteHandle<TestRouteHandleIf, LeafRoute>() };
+    } else if (type == "BigValueRoute") {
+      BigValueRouteOptions options(json["threshold"].asInt());
+      return { makeRouteHandle<TestRouteHandleIf, BigValueRoute>(
+        factory.create(json["child"]), options) };
+    } else if (type == "MigrateRoute") {
+      return { makeRouteHandle<TestRouteHandleIf, MigrateRoute,
+                               TimeProviderFunc>(factory, json,
+                                                 TimeProviderFunc()) };
+    } else if (type == "OperationSelectorRoute") {
+      return { makeRouteHandle<TestRouteHandleIf, OperationSelectorRoute>(
+        factory, json) };
+    } else if (type == "ShadowRoute") {
+      ShadowData<TestRouteHandleIf> shadowData;
+      for (const auto& shadow : json["shadows"]) {
+        shadowData.emplace_back(factory.create(shadow["target"]),
+                                std::make_shared<ShadowSettings>(shadow,
+                                                                 nullptr));
+      }
+      return { makeRouteHandle<TestRouteHandleIf, ShadowRoute,
+                               DefaultShadowPolicy>(
+        factory.create(json["child"]), std::move(shadowData),
+        /* normalIndex= */ 0, DefaultShadowPolicy()) };
+    } else if (type == "ShardSplitRoute") {
+      return { makeRouteHandle<TestRouteHandleIf, ShardSplitRoute>(
+        factory.create(json["child"]),
+        std::make_shared<const ShardSplitter>(json["shard_splits"])) };
+    } else if (type == "WarmUpRoute") {
+      return { makeRouteHandle<TestRouteHandleIf, WarmUpRoute,
+                               McOperation<mc_op_add>>(
+        factory, json, /* exptime= */ 0) };
+    }
+    return RouteHandleProvider<TestRouteHandleIf>::create(factory, type,
+                                                          json);
+  }
+};
+
+folly::dynamic leaves(int n) {
+  folly::dynamic children = {};
+  for (int i = 0; i < n; ++i) {
+    children.push_back("Leaf");
+  }
+  return children;
+}
+
+folly::dynamic hashedPool(int hosts) {
+  return folly::dynamic::object("type", "HashRoute")
+                               ("children", leaves(hosts));
+}
+
+/* Gets from the latest replica, updates to all of them */
+folly::dynamic replicatedPool(int replicas) {
+  return folly::dynamic::object
+    ("type", "OperationSelectorRoute")
+    ("default_policy", folly::dynamic::object
+      ("type", "AllInitialRoute")
+      ("children", leaves(replicas)))
+    ("operation_policies", folly::dynamic::object
+      ("get", folly::dynamic::object
+        ("type", "LatestRoute")
+        ("children", leaves(replicas))));
+}
+
+/* Requests are routed from one fiber, kBatch at a time */
+const size_t kBatch = 1000;
+const int kHosts = 8;
+const int kReplicas = 3;
+const int kBigValueThreshold = 1024;
+
+struct Case {
+  std::string name;
+  TestRouteHandlePtr rh;
+  mc_op_t op;
+  std::shared_ptr<McRequest> req;
+};
+
+struct Fixture {
+  TestFiberManager fm;
+  std::vector<Case> cases;
+
+  Fixture() {
+    BenchmarkRouteHandleProvider provider;
+    RouteHandleFactory<TestRouteHandleIf> factory(provider);
+
+    std::vector<std::pair<std::string, folly::dynamic>> trees;
+    trees.emplace_back("Leaf", "Leaf");
+    trees.emplace_back("FailoverHash", folly::dynamic::object
+      ("type", "FailoverRoute")
+      ("children", folly::dynamic{hashedPool(kHosts), hashedPool(kHosts)}));
+    trees.emplace_back("ShadowedReplicated", folly::dynamic::object
+      ("type", "ShadowRoute")
+      ("child", replicatedPool(kReplicas))
+      ("shadows", folly::dynamic{folly::dynamic::object
+        ("target", replicatedPool(kReplicas))
+        ("index_range", folly::dynamic{0, 1})
+        ("key_fraction_range", folly::dynamic{0.0, 1.0})}));
+    trees.emplace_back("BigValue", folly::dynamic::object
+      ("type", "BigValueRoute")
+      ("child", hashedPool(kHosts))
+      ("threshold", kBigValueThreshold));
+    trees.emplace_back("ShardSplit", folly::dynamic::object
+      ("type", "ShardSplitRoute")
+      ("child", hashedPool(kHosts))
+      ("shard_splits", folly::dynamic::object("1", 4)));
+    trees.emplace_back("WarmUp", folly::dynamic::object
+      ("type", "WarmUpRoute")
+      ("cold", hashedPool(kHosts))
+      ("warm", hashedPool(kHosts)));
+    /* halfway through, when requests may go to both pools */
+    trees.emplace_back("Migrate", folly::dynamic::object
+      ("type", "MigrateRoute")
+      ("from", hashedPool(kHosts))
+      ("to", hashedPool(kHosts))
+      ("start_time", time(nullptr) - 1800)
+      ("interval", 3600));
+
+    /* the shard id is 1 */
+    auto get = std::make_shared<McRequest>("key:1:value");
+    auto set = std::make_shared<McRequest>("key:1:value");
+    set->setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, "value"));
+    auto del = std::make_shared<McRequest>("key:1:value");
+
+    auto bigSet = std::make_shared<McRequest>("key:1:value");
+    bigSet->setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER,
+                                  std::string(4 * kBigValueThreshold, 'x')));
+
+    for (const auto& tree : trees) {
+      auto rh = factory.create(tree.second);
+      cases.push_back({tree.first + "_get", rh, mc_op_get, get});
+      cases.push_back({tree.first + "_set", rh, mc_op_set, set});
+      cases.push_back({tree.first + "_delete", rh, mc_op_delete, del});
+      if (tree.first == "BigValue") {
+        cases.push_back({tree.first + "_setChunked", rh, mc_op_set, bigSet});
+      }
+    }
+  }
+
+  template <class Operation>
+  void route(const Case& c, size_t n, Operation) {
+    while (n > 0) {
+      auto batch = std::min(n, kBatch);
+      fm.run([&c, batch]() {
+        for (size_t i = 0; i < batch; ++i) {
+          auto reply = c.rh->route(*c.req, Operation());
+          folly::doNotOptimizeAway(reply.result());
+        }
+      });
+      n -= batch;
+    }
+  }
+
+  void route(const Case& c, size_t n) {
+    switch (c.op) {
+      case mc_op_get:
+        route(c, n, McOperation<mc_op_get>());
+        break;
+      case mc_op_set:
+        route(c, n, McOperation<mc_op_set>());
+        break;
+      default:
+        route(c, n, McOperation<mc_op_delete>());
+        break;
+    }
+  }
+};
+
+std::unique_ptr<Fixture> fixture;
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  fixture = folly::make_unique<Fixture>();
+
+  for (const auto& c : fixture->cases) {
+    folly::addBenchmark(__FILE__, c.name.c_str(),
+                        [&c](unsigned int iters) {
+                          fixture->route(c, iters);
+                          return iters;
+                        });
+  }
+  folly::runBenchmarks();
+
+  printf("\noperator new calls per request:\n");
+  for (const auto& c : fixture->cases) {
+    /* warm up the fiber pool and lazily initialized state first */
+    fixture->route(c, kBatch);
+    auto before = gAllocations.load();
+    fixture->route(c, FLAGS_alloc_requests);
+    auto allocations = gAllocations.load() - before;
+    printf("%-40s %.2f\n", c.name.c_str(),
+           static_cast<double>(allocations) / FLAGS_alloc_requests);
+  }
+
+  fixture.reset();
+  return 0;
+}
@@ -86,3 +86,110 @@ TEST(shadowRouteTest, defaultPolicy) {
   EXPECT_TRUE(shadowHandles[0]->saw_keys == vector<string>{"key"});
   EXPECT_TRUE(shadowHandles[1]->saw_keys == vector<string>{"key"});
 }
+
+TEST(shadowRouteTest, updateSharesRequest) {
+  vector<std::shared_ptr<TestHandle>> normalHandle{
+    make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored)),
+  };
+  auto normalRh = get_route_handles(normalHandle)[0];
+
+  vector<std::shared_ptr<TestHandle>> shadowHandles{
+    make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored)),
+    make_shared<TestHandle>(UpdateRouteTestData(mc_res_stored)),
+  };
+
+  TestFiberManager fm;
+
+  auto data = make_shared<ShadowSettings::Data>();
+  data->end_index = 1;
+  data->end_key_fraction = 1.0;
+  vector<std::shared_ptr<ShadowSettings>> settings {
+    make_shared<ShadowSettings>(data, nullptr),
+    make_shared<ShadowSettings>(data, nullptr),
+  };
+
+  auto shadowRhs = get_route_handles(shadowHandles);
+  ShadowData<TestRouteHandleIf> shadowData = {
+    {std::move(shadowRhs[0]), std::move(settings[0])},
+    {std::move(shadowRhs[1]), std::move(settings[1])},
+  };
+
+  TestRouteHandle<ShadowRoute<TestRouteHandleIf, DefaultShadowPolicy>> rh(
+    normalRh,
+    std::move(shadowData),
+    0,
+    DefaultShadowPolicy());
+
+  string value(4096, 'v');
+  fm.runAll(
+    {
+      [&] () {
+        McRequest req("key");
+        req.setValue(folly::IOBuf(folly::IOBuf::COPY_BUFFER, value));
+        auto reply = rh.route(req, McOperation<mc_op_set>());
+
+        EXPECT_EQ(mc_res_stored, reply.result());
+      }
+    });
+
+  EXPECT_EQ(vector<string>{value}, normalHandle[0]->sawValues);
+  EXPECT_EQ(vector<string>{"key"}, shadowHandles[0]->saw_keys);
+  EXPECT_EQ(vector<string>{value}, shadowHandles[0]->sawValues);
+  EXPECT_EQ(vector<string>{"key"}, shadowHandles[1]->saw_keys);
+  EXPECT_EQ(vector<string>{value}, shadowHandles[1]->sawValues);
+}
+
+TEST(shadowRouteTest, settingsUpdate) {
+  vector<std::shared_ptr<TestHandle>> normalHandle{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "a")),
+  };
+  auto normalRh = get_route_handles(normalHandle)[0];
+
+  vector<std::shared_ptr<TestHandle>> shadowHandles{
+    make_shared<TestHandle>(GetRouteTestData(mc_res_found, "b")),
+  };
+
+  TestFiberManager fm;
+
+  auto settings = make_shared<ShadowSettings>(
+    make_shared<ShadowSettings::Data>(), nullptr);
+
+  auto shadowRhs = get_route_handles(shadowHandles);
+  ShadowData<TestRouteHandleIf> shadowData = {
+    {std::move(shadowRhs[0]), settings},
+  };
+
+  TestRouteHandle<ShadowRoute<TestRouteHandleIf, DefaultShadowPolicy>> rh(
+    normalRh,
+    std::move(shadowData),
+    0,
+    DefaultShadowPolicy());
+
+  auto routeOnce = [&] () {
+    fm.runAll(
+      {
+        [&] () {
+          auto reply = rh.route(McRequest("key"),
+                                McOperation<mc_op_get>());
+          EXPECT_EQ("a", toString(reply.value()));
+        }
+      });
+  };
+
+  routeOnce();
+  EXPECT_TRUE(shadowHandles[0]->saw_keys.empty());
+
+  auto version = settings->version();
+  auto data = make_shared<ShadowSettings::Data>();
+  data->end_index = 1;
+  data->end_key_fraction = 1.0;
+  settings->setData(data);
+  EXPECT_NE(version, settings->version());
+
+  routeOnce();
+  EXPECT_EQ(vector<string>{"key"}, shadowHandles[0]->saw_keys);
+
+  settings->setData(make_shared<ShadowSettings::Data>());
+  routeOnce();
+  EXPECT_EQ(vector<string>{"key"}, shadowHandles[0]->saw_keys);
+}
@@ -11,13 +11,29 @@
 
 #include <signal.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <thread>
+
+#include <folly/Memory.h>
+#include <folly/Optional.h>
+
+#include "mcrouter/BusyPoller.h"
+#include "mcrouter/ClientTracker.h"
 #include "mcrouter/config.h"
+#include "mcrouter/HotRestartState.h"
+#include "mcrouter/lib/JemallocArenas.h"
+#include "mcrouter/lib/network/AdaptiveReadLimits.h"
 #include "mcrouter/lib/network/AsyncMcServer.h"
 #include "mcrouter/lib/network/AsyncMcServerWorker.h"
+#include "mcrouter/lib/network/HotRestart.h"
 #include "mcrouter/ManagedModeUtil.h"
 #include "mcrouter/McrouterClient.h"
 #include "mcrouter/McrouterLogFailure.h"
 #include "mcrouter/proxy.h"
+#include "mcrouter/ProxyDestinationMap.h"
 #include "mcrouter/ProxyThread.h"
 #include "mcrouter/standalone_options.h"
 
@@ -30,68 +46,75 @@ namespace {
  */
 class ServerOnRequest {
  public:
-  explicit ServerOnRequest(McrouterClient* client)
-      : client_(client) {
+  ServerOnRequest(McrouterClient* client, ClientTracker& tracker,
+                  bool trustKeyDigestHint)
+      : client_(client),
+        tracker_(tracker),
+        trustKeyDigestHint_(trustKeyDigestHint) {
   }
 
   template <int M>
   void onRequest(McServerRequestContext&& ctx,
                  McRequest&& req,
                  McOperation<M>) {
-    mcrouter_msg_t router_msg;
-
-    auto op = mc_op_t(M);
-    /* TODO: nasty C/C++ interface stuff.  We should hand off the McRequest
-       directly here.  For now, hand off the dependentMsg() since we can assume
-       req will stay alive. */
-    auto p = folly::make_unique<McServerRequestContext>(std::move(ctx));
-    router_msg.context = p.get();
-    router_msg.saved_request = std::move(req);
-    auto msg = router_msg.saved_request->dependentMsg(op);
-    router_msg.req = const_cast<mc_msg_t*>(msg.get());
-    /* mcrouter_send will incref req, it's ok to destroy msg after this call */
-    client_->send(&router_msg, 1);
-    p.release();
+    tracker_.onRequest(ctx.session());
+    if (trustKeyDigestHint_) {
+      req.useRoutingKeyDigestHint();
+    }
+
+    /* The callback must be copyable, so the context is passed as a raw
+       pointer and owned by the callback from the moment it's called */
+    auto p = new McServerRequestContext(std::move(ctx));
+    auto cancellation = p->session().cancellation();
+    client_->send(
+      std::move(req), mc_op_t(M),
+      [p] (McReply&& reply) {
+        std::unique_ptr<McServerRequestContext> owned(p);
+        McServerRequestContext::reply(std::move(*owned), std::move(reply));
+      },
+      std::chrono::milliseconds(0), std::move(cancellation));
   }
 
  private:
   McrouterClient* client_;
+  ClientTracker& tracker_;
+  bool trustKeyDigestHint_;
 };
 
-void router_on_reply(mcrouter_msg_t* msg,
-                     void* context) {
-  std::unique_ptr<McServerRequestContext> p(
-    reinterpret_cast<McServerRequestContext*>(msg->context));
-
-  assert(p.get());
-  McServerRequestContext::reply(std::move(*p),
-                                std::move(msg->reply));
-  msg->context = nullptr;
-}
-
-mcrouter_client_callbacks_t const server_callbacks = {
-  router_on_reply,  // on_reply callback
-  nullptr,
-  nullptr
-};
+/* How often the server loop refreshes ClientTracker's connections */
+constexpr std::chrono::seconds kClientStatsInterval{1};
 
 void serverLoop(
   McrouterInstance& router,
   size_t threadId,
   folly::EventBase& evb,
   AsyncMcServerWorker& worker,
-  bool managedMode) {
+  const McrouterStandaloneOptions& standaloneOpts,
+  const HotRestartState* hotRestartState,
+  std::atomic<size_t>& proxiesTakenOver) {
 
+  if (router.opts().thread_arenas) {
+    JemallocArenas::bindThreadToNewArena();
+  }
+
+  /* Replies are delivered by ServerOnRequest's reply callbacks */
   auto routerClient = router.createClient(
-    server_callbacks,
+    {nullptr, nullptr, nullptr},
     &worker,
     0);
   auto proxy = router.getProxy(threadId);
   proxy->attachEventBase(&evb);
+  if (hotRestartState != nullptr) {
+    proxy->destinationMap->takeOver(
+      *hotRestartState, standaloneOpts.hot_restart_warmup_concurrency);
+  }
+  ++proxiesTakenOver;
   // Manually override proxy assignment
   routerClient->setProxy(proxy);
 
-  worker.setOnRequest(ServerOnRequest(routerClient.get()));
+  worker.setOnRequest(ServerOnRequest(routerClient.get(),
+                                     *proxy->clientTracker,
+                                     standaloneOpts.trust_key_digest_hint));
   worker.setOnConnectionAccepted([proxy] () {
       stat_incr(proxy->stats, successful_client_connections_stat, 1);
       stat_incr(proxy->stats, num_clients_stat, 1);
@@ -99,7 +122,7 @@ void serverLoop(
   worker.setOnConnectionClosed([proxy] (facebook::memcache::McServerSession&) {
       stat_decr(proxy->stats, num_clients_stat, 1);
     });
-  if (managedMode) {
+  if (standaloneOpts.managed) {
     worker.setOnShutdownOperation([&router] () {
         if (!shutdownFromChild()) {
           logFailure(&router, failure::Category::kSystemError,
@@ -108,12 +131,131 @@ void serverLoop(
       });
   }
 
+  folly::Optional<AdaptiveReadLimits> readLimits;
+  if (standaloneOpts.adaptive_read_limits) {
+    AdaptiveReadLimits::Options limitsOpts;
+    limitsOpts.maxRequestsPerRead = standaloneOpts.adaptive_max_reqs_per_read;
+    limitsOpts.maxReadsPerEvent = std::min<uint32_t>(
+      standaloneOpts.adaptive_max_reads_per_event,
+      std::numeric_limits<uint16_t>::max());
+    limitsOpts.targetLoopTime = std::chrono::microseconds(
+      standaloneOpts.adaptive_read_target_loop_us);
+    readLimits.emplace(limitsOpts);
+  }
+  auto applyReadLimits = [&] () {
+    worker.setReadLimits(readLimits->requestsPerRead(),
+                         readLimits->readsPerEvent());
+    stat_set_uint64(proxy->stats, server_reqs_per_read_stat,
+                    readLimits->requestsPerRead());
+    stat_set_uint64(proxy->stats, server_reads_per_event_stat,
+                    readLimits->readsPerEvent());
+  };
+  if (readLimits) {
+    applyReadLimits();
+  }
+
   /* TODO(libevent): the only reason this is not simply evb.loop() is
      because we need to call asox stuff on every loop iteration.
      We can clean this up once we convert everything to EventBase */
+  BusyPoller poller(*proxy,
+                    std::chrono::microseconds(proxy->opts.busy_poll_us));
+  auto nextClientStats = std::chrono::steady_clock::now();
   while (worker.isAlive() || worker.writesPending()) {
-    mcrouterLoopOnce(&evb);
+    poller.loopOnce();
+    auto now = std::chrono::steady_clock::now();
+    if (now >= nextClientStats) {
+      proxy->clientTracker->updateConnections(worker);
+      nextClientStats = now + kClientStatsInterval;
+    }
+    if (readLimits &&
+        readLimits->update(
+          std::chrono::microseconds(
+            static_cast<int64_t>(evb.getAvgLoopTime())),
+          stat_get_uint64(proxy->stats, proxy_reqs_waiting_stat))) {
+      applyReadLimits();
+    }
+    if (auto pool = worker.readBufferPool()) {
+      stat_set_uint64(proxy->stats, read_buffer_pool_bytes_stat,
+                      pool->stats().bytesPooled);
+      stat_set_uint64(proxy->stats, read_buffer_pool_borrow_misses_stat,
+                      pool->stats().borrowMisses);
+    }
+    if (auto scheduler = worker.readScheduler()) {
+      auto schedulerStats = scheduler->stats();
+      stat_set_uint64(proxy->stats, server_in_flight_bytes_stat,
+                      schedulerStats.inFlightBytes);
+      stat_set_uint64(proxy->stats, server_sessions_waiting_to_read_stat,
+                      schedulerStats.waitingSessions);
+      stat_set_uint64(proxy->stats, server_read_scheduler_pauses_stat,
+                      schedulerStats.pauses);
+    }
+    stat_set_uint64(proxy->stats, server_reply_writes_stat,
+                    worker.writeStats().writes);
+    stat_set_uint64(proxy->stats, server_replies_written_stat,
+                    worker.writeStats().replies);
+  }
+}
+
+/**
+ * Waits until every proxy connected to the destinations taken over from
+ * the previous process, or the timeout.
+ */
+void waitForTakeOver(McrouterInstance& router,
+                     const std::atomic<size_t>& proxiesTakenOver,
+                     std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  auto numProxies = router.opts().num_proxies;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (proxiesTakenOver.load() == numProxies) {
+      size_t pending = 0;
+      for (size_t i = 0; i < numProxies; ++i) {
+        pending += router.getProxy(i)->destinationMap->warmupPending();
+      }
+      if (pending == 0) {
+        return;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
   }
+  LOG(WARNING) << "Hot restart: destinations not connected in "
+               << timeout.count() << "ms, taking over anyway";
+}
+
+/**
+ * Called after the new process started accepting on our sockets: waits
+ * for clients to disconnect, then shuts the server down.
+ */
+void drainAndShutdown(McrouterInstance& router,
+                      AsyncMcServer& server,
+                      std::chrono::seconds timeout,
+                      const std::atomic<bool>& stop) {
+  LOG(INFO) << "Hot restart: draining client connections";
+  server.stopAccepting();
+
+  auto& stats = hotRestartStats();
+  stats.draining = 1;
+  auto start = std::chrono::steady_clock::now();
+  while (!stop) {
+    uint64_t clients = 0;
+    for (size_t i = 0; i < router.opts().num_proxies; ++i) {
+      clients += stat_get_uint64(router.getProxy(i)->stats, num_clients_stat);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    stats.drainRemaining = clients;
+    stats.drainElapsedMs =
+      std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    if (clients == 0) {
+      break;
+    }
+    if (elapsed >= timeout) {
+      LOG(WARNING) << "Hot restart: " << clients << " clients still connected"
+                   << " after " << timeout.count() << "s, shutting down";
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  stats.draining = 0;
+  server.shutdown();
 }
 
 }  // namespace
@@ -122,7 +264,28 @@ void runServer(const McrouterStandaloneOptions& standaloneOpts,
                McrouterInstance& router) {
   AsyncMcServer::Options opts;
 
-  if (standaloneOpts.listen_sock_fd >= 0) {
+  std::unique_ptr<HotRestartClient> predecessor;
+  std::unique_ptr<HotRestartState> hotRestartState;
+  if (!standaloneOpts.hot_restart_socket.empty()) {
+    predecessor = HotRestartClient::connect(
+      standaloneOpts.hot_restart_socket,
+      std::chrono::milliseconds(standaloneOpts.hot_restart_timeout_ms));
+  }
+
+  if (predecessor) {
+    auto& handoff = predecessor->handoff();
+    opts.inheritedSocketFds = handoff.fds;
+    opts.inheritedSslSocketFds = handoff.sslFds;
+    opts.pemCertPath = router.opts().pem_cert_path;
+    opts.pemKeyPath = router.opts().pem_key_path;
+    opts.pemCaPath = router.opts().pem_ca_path;
+    opts.kernelTls = router.opts().ssl_kernel_tls;
+    hotRestartStats().inheritedSockets =
+      handoff.fds.size() + handoff.sslFds.size();
+    /* the server owns the sockets from now on */
+    handoff.release();
+    hotRestartState = folly::make_unique<HotRestartState>(handoff.state);
+  } else if (standaloneOpts.listen_sock_fd >= 0) {
     opts.existingSocketFd = standaloneOpts.listen_sock_fd;
   } else {
     opts.ports = standaloneOpts.ports;
@@ -130,12 +293,26 @@ void runServer(const McrouterStandaloneOptions& standaloneOpts,
     opts.pemCertPath = router.opts().pem_cert_path;
     opts.pemKeyPath = router.opts().pem_key_path;
     opts.pemCaPath = router.opts().pem_ca_path;
+    opts.kernelTls = router.opts().ssl_kernel_tls;
+    opts.reusePort = standaloneOpts.reuse_port;
   }
 
+  opts.sslHandshakeThreads = router.opts().ssl_handshake_threads;
   opts.numThreads = router.opts().num_proxies;
+  opts.pinThreadsToCpus = standaloneOpts.pin_server_threads;
+  /* Server threads run the proxies in standalone mode, so they follow
+     the proxy thread affinity */
+  if (!router.threadCpus().empty()) {
+    opts.pinThreadsToCpus = true;
+    opts.cpus = router.threadCpus();
+  }
 
   opts.worker.versionString = MCROUTER_PACKAGE_STRING;
   opts.worker.maxInFlight = standaloneOpts.max_client_outstanding_reqs;
+  opts.worker.maxInFlightBytes = standaloneOpts.max_client_outstanding_bytes;
+  opts.worker.workerMaxInFlightBytes =
+    standaloneOpts.server_max_outstanding_bytes;
+  opts.worker.readQuantumBytes = standaloneOpts.server_read_quantum_bytes;
   opts.worker.sendTimeout = std::chrono::milliseconds{
     router.opts().server_timeout_ms};
 
@@ -143,22 +320,75 @@ void runServer(const McrouterStandaloneOptions& standaloneOpts,
      We can make this an option if this needs to be adjusted. */
   opts.worker.maxReadsPerEvent = 1;
   opts.worker.requestsPerRead = standaloneOpts.requests_per_read;
+  opts.worker.readBufferPoolSize = standaloneOpts.read_buffer_pool_size;
+  opts.worker.maxWriteIovs = standaloneOpts.server_max_write_iovs;
+  opts.worker.maxWriteBytes = standaloneOpts.server_max_write_bytes;
+  opts.worker.cancelRequestsOnEof =
+    standaloneOpts.cancel_requests_on_client_eof;
+  opts.worker.prehashBatchKeys = standaloneOpts.prehash_batch_keys;
+  opts.worker.useIoUring = router.opts().io_uring;
+  opts.worker.busyPoll = std::chrono::microseconds(router.opts().busy_poll_us);
+
+  /* Created before any server thread runs, ServiceInfo on every proxy
+     reads all of them */
+  for (size_t i = 0; i < router.opts().num_proxies; ++i) {
+    router.getProxy(i)->clientTracker = folly::make_unique<ClientTracker>(
+      standaloneOpts.top_talkers_sample_rate);
+  }
 
   try {
     LOG(INFO) << "Spawning AsyncMcServer";
 
     AsyncMcServer server(opts);
+    std::atomic<size_t> proxiesTakenOver{0};
+    auto state = hotRestartState.get();
     server.spawn(
-      [&router, &standaloneOpts] (size_t threadId,
-                                  folly::EventBase& evb,
-                                  AsyncMcServerWorker& worker) {
-        serverLoop(router, threadId, evb, worker, standaloneOpts.managed);
+      [&router, &standaloneOpts, state, &proxiesTakenOver] (
+          size_t threadId,
+          folly::EventBase& evb,
+          AsyncMcServerWorker& worker) {
+        serverLoop(router, threadId, evb, worker, standaloneOpts, state,
+                   proxiesTakenOver);
       }
     );
 
     server.installShutdownHandler({SIGINT, SIGTERM});
+
+    auto timeout =
+      std::chrono::milliseconds(standaloneOpts.hot_restart_timeout_ms);
+    if (predecessor) {
+      waitForTakeOver(router, proxiesTakenOver, timeout);
+      if (!predecessor->ready()) {
+        LOG(WARNING) << "Hot restart: previous process went away";
+      }
+      predecessor.reset();
+      LOG(INFO) << "Hot restart: took over from the previous process";
+    }
+
+    std::atomic<bool> stopDrain{false};
+    std::unique_ptr<HotRestartListener> successor;
+    if (!standaloneOpts.hot_restart_socket.empty()) {
+      auto drainTimeout =
+        std::chrono::seconds(standaloneOpts.hot_restart_drain_timeout_s);
+      successor = folly::make_unique<HotRestartListener>(
+        standaloneOpts.hot_restart_socket,
+        [&router, &server, timeout] () {
+          HotRestartHandoff handoff;
+          server.dupListeningSockets(handoff.fds, handoff.sslFds);
+          handoff.state = HotRestartState::snapshot(router, timeout);
+          return handoff;
+        },
+        [&router, &server, drainTimeout, &stopDrain] () {
+          drainAndShutdown(router, server, drainTimeout, stopDrain);
+        });
+    }
+
     server.join();
 
+    /* shut down by a signal in the middle of a drain */
+    stopDrain = true;
+    successor.reset();
+
     LOG(INFO) << "Shutting down";
   } catch (const std::exception& e) {
     LOG(ERROR) << e.what();
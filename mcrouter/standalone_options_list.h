@@ -48,6 +48,45 @@ mcrouter_option_integer(
   "listen-sock-fd", no_short,
   "Listen socket to take over")
 
+mcrouter_option_toggle(
+  reuse_port, false,
+  "reuse-port", no_short,
+  "Every server thread listens on its own SO_REUSEPORT socket for ports and"
+  " ssl-ports, instead of one thread accepting all connections")
+
+mcrouter_option_string(
+  hot_restart_socket, "",
+  "hot-restart-socket", no_short,
+  "Unix socket path for hot restarts. On startup take over the listening"
+  " sockets and destination state of the mcrouter listening at this path,"
+  " if any, then listen at it for the process that will replace this one."
+  " Ignores ports, ssl-ports and listen-sock-fd when a takeover succeeds.")
+
+mcrouter_option_integer(
+  uint32_t, hot_restart_timeout_ms, 5000,
+  "hot-restart-timeout-ms", no_short,
+  "How long a hot restart waits for the previous process to hand over, and"
+  " for destinations to be connected to before the previous process stops"
+  " accepting")
+
+mcrouter_option_integer(
+  uint32_t, hot_restart_drain_timeout_s, 60,
+  "hot-restart-drain-timeout-s", no_short,
+  "After handing over to a new process, wait up to this long for clients"
+  " to disconnect before exiting")
+
+mcrouter_option_integer(
+  size_t, hot_restart_warmup_concurrency, 16,
+  "hot-restart-warmup-concurrency", no_short,
+  "Max connection attempts at a time per proxy to destinations taken over"
+  " in a hot restart")
+
+mcrouter_option_toggle(
+  pin_server_threads, false,
+  "pin-server-threads", no_short,
+  "Pin server thread i to CPU i (modulo number of CPUs). With --reuse-port"
+  " also steer connections to the thread on the CPU receiving them")
+
 mcrouter_option_string(
   pidfile, "",
   "pid-file", 'P',
@@ -78,12 +117,100 @@ mcrouter_option_integer(
   "max-client-outstanding-reqs", no_short,
   "Maximum requests outstanding per client (0 to disable)")
 
+mcrouter_option_integer(
+  size_t, max_client_outstanding_bytes, 0,
+  "max-client-outstanding-bytes", no_short,
+  "Maximum key and value bytes of requests outstanding per client"
+  " (0 to disable)")
+
+mcrouter_option_integer(
+  size_t, server_max_outstanding_bytes, 0,
+  "server-max-outstanding-bytes", no_short,
+  "If non-zero, once outstanding requests of all clients of a server thread"
+  " hold this many key and value bytes, clients take turns reading by"
+  " deficit round robin, so that clients sending large requests are slowed"
+  " down in proportion to the bytes they use")
+
+mcrouter_option_integer(
+  size_t, server_read_quantum_bytes, 64 * 1024,
+  "server-read-quantum-bytes", no_short,
+  "Bytes a client may read per turn with --server-max-outstanding-bytes")
+
 mcrouter_option_integer(
   size_t, requests_per_read, 0,
   "reqs-per-read", no_short,
   "Adjusts server buffer size to process this many requests per read."
   " Smaller values may improve latency.")
 
+mcrouter_option_toggle(
+  adaptive_read_limits, false,
+  "adaptive-read-limits", no_short,
+  "Adjust requests per read (see --reqs-per-read) and reads per event of"
+  " every server thread to its event loop load: lower them when loop"
+  " iterations get slow or requests queue up, raise them when idle.")
+
+mcrouter_option_integer(
+  size_t, adaptive_max_reqs_per_read, 100,
+  "adaptive-max-reqs-per-read", no_short,
+  "Upper bound of requests per read with --adaptive-read-limits")
+
+mcrouter_option_integer(
+  uint32_t, adaptive_max_reads_per_event, 16,
+  "adaptive-max-reads-per-event", no_short,
+  "Upper bound of reads per event with --adaptive-read-limits")
+
+mcrouter_option_integer(
+  uint32_t, adaptive_read_target_loop_us, 200,
+  "adaptive-read-target-loop-us", no_short,
+  "With --adaptive-read-limits, read limits are lowered while the average"
+  " busy time of an event loop iteration is above this")
+
+mcrouter_option_integer(
+  size_t, read_buffer_pool_size, 0,
+  "read-buffer-pool-size", no_short,
+  "If non-zero, client connections share read buffers and only hold one"
+  " while there's unparsed data. Up to this many idle buffers are kept"
+  " per thread for reuse.")
+
+mcrouter_option_integer(
+  size_t, server_max_write_iovs, 0,
+  "server-max-write-iovs", no_short,
+  "Max number of iovecs in one write of replies to a client. Replies"
+  " produced in one event loop iteration are written together until"
+  " this limit is hit. 0 means no limit.")
+
+mcrouter_option_integer(
+  size_t, server_max_write_bytes, 0,
+  "server-max-write-bytes", no_short,
+  "Max number of bytes in one write of replies to a client"
+  " (a single reply is never split). 0 means no limit.")
+
+mcrouter_option_toggle(
+  cancel_requests_on_client_eof, false,
+  "cancel-requests-on-client-eof", no_short,
+  "Drop gets of a client connection that are not sent to a destination yet"
+  " once the client closes the connection, not only on connection errors."
+  " Clients that shut down their end but still read replies get none.")
+
+mcrouter_option_toggle(
+  prehash_batch_keys, false,
+  "prehash-batch-keys", no_short,
+  "Compute the CH3 key digests of an umbrella batch get in one pass before"
+  " routing its keys, instead of one key at a time while routing them.")
+
+mcrouter_option_toggle(
+  trust_key_digest_hint, false,
+  "trust-key-digest-hint", no_short,
+  "Hash requests with the routing key digest sent along by an upstream"
+  " mcrouter (umbrella only) instead of hashing their keys again. Enable"
+  " only if every client is a trusted mcrouter.")
+
+mcrouter_option_integer(
+  size_t, top_talkers_sample_rate, 0,
+  "top-talkers-sample-rate", no_short,
+  "If non-zero, one of every N client requests is attributed to its client"
+  " host for the top_talkers ServiceInfo command")
+
 #ifdef ADDITIONAL_STANDALONE_OPTIONS_FILE
 #include ADDITIONAL_STANDALONE_OPTIONS_FILE
 #endif
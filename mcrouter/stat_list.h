@@ -30,11 +30,82 @@
   /* Total reqs waiting for reply from memcache. */
   STUI(mcc_waiting_replies, 0, 1)
   STAT(destination_batch_size, stat_double, 0, .dbl = 0.0)
+  /* Number of writes to destinations by the number of requests written,
+     over currently open connections (see WriteBatchHistogram). */
+  STUI(destination_write_batches_1, 0, 1)
+  STUI(destination_write_batches_2, 0, 1)
+  STUI(destination_write_batches_4, 0, 1)
+  STUI(destination_write_batches_8, 0, 1)
+  STUI(destination_write_batches_16, 0, 1)
+  STUI(destination_write_batches_32, 0, 1)
+  STUI(destination_write_batches_64, 0, 1)
+  STUI(destination_write_batches_128, 0, 1)
+  /* Requests refused by --target-adaptive-concurrency limits */
+  STUI(destination_concurrency_refused, 0, 1)
+  /* Requests sent with noreply (NoreplyRoute), not waiting for a reply */
+  STUI(destination_noreply_requests, 0, 1)
+  /* Destinations ejected by --outlier-detection-interval-ms */
+  STUI(destination_outlier_ejections, 0, 1)
+  /* Failovers not attempted because --failover-retry-budget-pct was used up */
+  STUI(failover_budget_exhausted, 0, 1)
+  /* Gets not sent to a destination since their client was gone */
+  STUI(destination_cancelled_sends, 0, 1)
+  /* Requests not sent to a destination because their deadline passed */
+  STUI(request_deadline_exceeded, 0, 1)
+  /* Subrequests routes stopped waiting for (e.g. AllMajorityRoute stragglers),
+     the ones cancelled by --max-detached-subrequests and the ones in flight */
+  STUI(subrequests_abandoned, 0, 1)
+  STUI(subrequests_cancelled, 0, 1)
+  STUI(subrequests_detached, 0, 1)
+  /* LazyRoute targets built on first use, and the ones that failed to build */
+  STUI(lazy_routes_built, 0, 1)
+  STUI(lazy_routes_failed, 0, 1)
+  /* NegativeCacheRoute: gets for remembered misses, and the ones found
+     by the target anyway */
+  STUI(negative_cache_hits, 0, 1)
+  STUI(negative_cache_false_positives, 0, 1)
+  /* MissFailoverRoute "speculative": requests sent to the next child before
+     the current one missed, and the ones whose reply wasn't needed */
+  STUI(speculative_lookups, 0, 1)
+  STUI(speculative_lookups_wasted, 0, 1)
+  /* ReplicationQueueRoute: copies waiting for or being sent to remote,
+     copies queued, dropped (queue full), retried and given up on */
+  STUI(replication_queue_depth, 0, 1)
+  STUI(replication_queued, 0, 1)
+  STUI(replication_dropped, 0, 1)
+  STUI(replication_retries, 0, 1)
+  STUI(replication_failed, 0, 1)
   STUI(asynclog_requests, 0, 1)
+  /* Batch writes and dropped records of --asynclog-batch */
+  STUI(asynclog_batch_writes, 0, 1)
+  STUI(asynclog_batch_dropped, 0, 1)
+  /* Value compression of pools with "compression" config: bytes saved by
+     compressing updates, CPU time per codec and values that failed to
+     uncompress */
+  STUI(compression_bytes_saved, 0, 1)
+  STUI(compression_lz4_cpu_us, 0, 1)
+  STUI(compression_zstd_cpu_us, 0, 1)
+  STUI(compression_errors, 0, 1)
   /* Proxy requests we started routing */
   STUI(proxy_reqs_processing, 0, 1)
   /* Proxy requests queued up and not routed yet */
   STUI(proxy_reqs_waiting, 0, 1)
+  /* Queued requests refused to make room for more important ones, and
+     refused after waiting for --proxy-queue-timeout-ms */
+  STUI(proxy_reqs_shed, 0, 1)
+  STUI(proxy_reqs_queue_timeout, 0, 1)
+  /* Queued gets dropped because their client was gone */
+  STUI(proxy_reqs_cancelled, 0, 1)
+  /* Requests over their tenant's quota (--proxy-tenant-quotas), refused
+     or queued as the least important class */
+  STUI(proxy_reqs_over_quota, 0, 1)
+  /* --proxy-key-affinity: requests routed by another proxy, and requests
+     routed locally because the ring to their proxy was full */
+  STUI(proxy_reqs_forwarded, 0, 1)
+  STUI(proxy_reqs_forward_full, 0, 1)
+  /* --proxy-offload-threshold: requests handed over to less loaded proxies
+     (included in proxy_reqs_forwarded) */
+  STUI(proxy_reqs_offloaded, 0, 1)
 //  STUI(bytes_read, 0)
 //  STUI(bytes_written, 0)
 //  STUI(get_hits, 0)
@@ -49,13 +120,97 @@
   STUI(ps_rss, 0, 0)
   STUI(fibers_allocated, 0, 0)
   STUI(fibers_pool_size, 0, 0)
+  /* Free fibers the pools are sized for, and fibers trimmed from the pools
+     (only change if --fibers-pool-resize-period-ms is set) */
+  STUI(fibers_pool_target, 0, 0)
+  STUI(fibers_pool_trimmed, 0, 0)
   STUI(fibers_stack_high_watermark, 0, 0)
+  /* Fibers running a task (allocated minus pooled), and fiber stack bytes
+     per such fiber: the stack cost of a request in flight */
+  STUI(fibers_active, 0, 0)
+  STUI(fibers_stack_bytes_per_active, 0, 0)
+  /* Fiber loops that yielded to other events with fibers still ready to run
+     (see --fibers-max-run-per-loop and --fibers-max-loop-run-time-us) */
+  STUI(fibers_loops_over_budget, 0, 0)
+  /* Fibers ready to run and tasks queued to proxies from other threads,
+     at the time stats are collected (see also 'stats latency') */
+  STUI(fibers_ready, 0, 0)
+  STUI(fibers_remote_tasks_pending, 0, 0)
 //  STUI(failed_client_connections, 0)
   STUI(successful_client_connections, 0, 1)
+  /* SSL handshakes of the process by kind (see SSLHandshakeStats),
+     client are outgoing connections, server are accepted connections */
+  STUI(ssl_client_handshakes_full, 0, 0)
+  STUI(ssl_client_handshakes_resumed, 0, 0)
+  STUI(ssl_server_handshakes_full, 0, 0)
+  STUI(ssl_server_handshakes_resumed, 0, 0)
+  /* SSL connections with record encryption offloaded to the kernel (kTLS) */
+  STUI(ssl_client_kernel_tls, 0, 0)
+  STUI(ssl_server_kernel_tls, 0, 0)
+  /* SSL handshakes run on --ssl-handshake-threads: queued or running now,
+     done, failed, and the total time they waited for a handshake thread
+     and took on it (in microseconds) */
+  STUI(ssl_handshake_pool_pending, 0, 0)
+  STUI(ssl_handshake_pool_completed, 0, 0)
+  STUI(ssl_handshake_pool_failed, 0, 0)
+  STUI(ssl_handshake_pool_queue_us, 0, 0)
+  STUI(ssl_handshake_pool_handshake_us, 0, 0)
+  /* Hot restarts (see --hot-restart-socket): handoffs to new processes,
+     listening sockets taken over from the previous one, and the progress
+     of draining client connections after a handoff */
+  STUI(hot_restart_handoffs, 0, 0)
+  STUI(hot_restart_inherited_sockets, 0, 0)
+  STUI(hot_restart_draining, 0, 0)
+  STUI(hot_restart_drain_remaining_clients, 0, 0)
+  STUI(hot_restart_drain_elapsed_ms, 0, 0)
+  /* Idle client read buffer memory, see --read-buffer-pool-size */
+  STUI(read_buffer_pool_bytes, 0, 1)
+  STUI(read_buffer_pool_borrow_misses, 0, 1)
+  /* Idle target read buffer memory, see --target-read-buffer-pool-size */
+  STUI(target_read_buffer_pool_bytes, 0, 1)
+  STUI(target_read_buffer_pool_borrow_misses, 0, 1)
+  /* Request bytes held by target connections, and requests failed because
+     of --target-max-outstanding-bytes or
+     --proxy-max-outstanding-target-bytes */
+  STUI(target_outstanding_bytes, 0, 1)
+  STUI(target_outstanding_bytes_rejected, 0, 1)
+  /* Read limits of server threads chosen by --adaptive-read-limits,
+     averaged over threads */
+  STUI(server_reqs_per_read, 0, 0)
+  STUI(server_reads_per_event, 0, 0)
+  /* --server-max-outstanding-bytes: key and value bytes of outstanding
+     client requests, clients waiting for their turn to read and the number
+     of times a client was made to wait */
+  STUI(server_in_flight_bytes, 0, 1)
+  STUI(server_sessions_waiting_to_read, 0, 1)
+  STUI(server_read_scheduler_pauses, 0, 1)
+  /* Writes of replies to clients and the number of replies they carried */
+  STUI(server_reply_writes, 0, 1)
+  STUI(server_replies_written, 0, 1)
+  STAT(server_replies_per_write, stat_double, 0, .dbl = 0.0)
+  /* Event loop iterations that found work while spinning instead of going to
+     sleep, and time spent spinning (see --busy-poll-us) */
+  STUI(busy_poll_wakeups_avoided, 0, 1)
+  STUI(busy_poll_spin_time_us, 0, 1)
   STAT(duration_us, stat_double, 0, .dbl = 0.0)
 #undef GROUP
 #define GROUP ods_stats | detailed_stats | count_stats
   STUI(rate_limited_log_count, 0, 1)
+  /* Value bytes copied (coalesced) for requests sent to destinations */
+  STUI(value_bytes_copied, 0, 1)
+  /* Shadow requests not sent due to --max-shadow-pending-bytes */
+  STUI(shadow_requests_over_limit, 0, 1)
+  /* TKO probes sent, and the ones skipped since the pool is mostly dead
+     and sampled destinations probe for it (see
+     --pool-probe-sample-threshold-pct) */
+  STUI(tko_probes_sent, 0, 1)
+  STUI(tko_probes_skipped, 0, 1)
+  /* Requests replied to without routing since all of their route handles
+     were known dead (see --skip-dead-routes) */
+  STUI(dead_route_replies, 0, 1)
+  /* Requests routed without a fiber since their route answers right away
+     (see McrouterRouteHandleIf::routesInline()) */
+  STUI(inline_routed_requests, 0, 1)
 #undef GROUP
 #define GROUP ods_stats | mcproxy_stats | cmd_all_stats | \
   cmd_in_stats | count_stats
@@ -347,6 +502,17 @@
   STUI(mc_msg_num_outstanding, 0, 0)
 #endif
   STUI(proxy_request_num_outstanding, 0, 1)
+  /* Process wide bytes by MemoryTag, see MemoryAccounting */
+  STUI(memory_config_bytes, 0, 0)
+  STUI(memory_destinations_bytes, 0, 0)
+  STUI(memory_read_buffers_bytes, 0, 0)
+  STUI(memory_write_buffers_bytes, 0, 0)
+  STUI(memory_fiber_stacks_bytes, 0, 0)
+  STUI(memory_asynclog_bytes, 0, 0)
+  /* Proxy thread jemalloc arenas, see --thread-arenas */
+  STUI(memory_thread_arenas_allocated_bytes, 0, 0)
+  STUI(memory_thread_arenas_active_bytes, 0, 0)
+  STUI(memory_thread_arenas_dirty_bytes, 0, 0)
 #undef GROUP
 #define GROUP memory_stats
   STUI(mcrouter_queue_entry_num_outstanding, 0, 1)
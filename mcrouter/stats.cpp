@@ -16,14 +16,23 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <limits>
+
 #include <folly/Conv.h>
+#include <folly/Demangle.h>
 #include <folly/json.h>
 #include <folly/Range.h>
 
 #include "mcrouter/config.h"
 #include "mcrouter/lib/fbi/cpp/util.h"
-#include "mcrouter/lib/fbi/timer.h"
+#include "mcrouter/lib/JemallocArenas.h"
 #include "mcrouter/lib/McReply.h"
+#include "mcrouter/lib/MemoryAccounting.h"
+#include "mcrouter/lib/network/HotRestart.h"
+#include "mcrouter/lib/network/ReadBufferPool.h"
+#include "mcrouter/lib/network/SSLHandshakePool.h"
+#include "mcrouter/lib/network/SSLSessionCache.h"
 #include "mcrouter/lib/StatsReply.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/proxy.h"
@@ -108,13 +117,15 @@ struct AggregatedDestinationStats {
   // destination maintains its own window).
   // See AsyncMcClient::getBatchingStat() for more details.
   std::pair<uint64_t, uint64_t> batches{0, 0};
+  // Number of writes by batch size, see WriteBatchHistogram.
+  WriteBatchHistogram writeBatches{};
 };
 
 int get_num_bins_used(const McrouterInstance* router) {
-  if (router->opts().num_proxies > 0) {
+  if (router->numProxies() > 0) {
     const proxy_t* anyProxy = router->getProxy(0);
     if (anyProxy) {
-      return anyProxy->num_bins_used;
+      return __atomic_load_n(&anyProxy->num_bins_used, __ATOMIC_RELAXED);
     }
   }
   return 0;
@@ -123,19 +134,29 @@ int get_num_bins_used(const McrouterInstance* router) {
 double stats_rate_value(proxy_t* proxy, int idx) {
   const stat_t* stat = &proxy->stats[idx];
   double rate = 0;
+  int num_bins_used = __atomic_load_n(&proxy->num_bins_used, __ATOMIC_RELAXED);
 
-  if (proxy->num_bins_used != 0) {
+  if (num_bins_used != 0) {
     if (stat->aggregate) {
       rate = stats_aggregate_rate_value(proxy->router, idx);
     } else {
-      rate = (double)proxy->stats_num_within_window[idx] /
-        (proxy->num_bins_used * MOVING_AVERAGE_BIN_SIZE_IN_SECOND);
+      rate = (double)__atomic_load_n(&proxy->stats_num_within_window[idx],
+                                     __ATOMIC_RELAXED) /
+        (num_bins_used * MOVING_AVERAGE_BIN_SIZE_IN_SECOND);
     }
   }
 
   return rate;
 }
 
+/**
+ * Relaxed load of a numeric stat that may be concurrently updated
+ * by its owner proxy.
+ */
+uint64_t stat_load_bits(const stat_t* stats, int idx) {
+  return __atomic_load_n(&stats[idx].data.uint64, __ATOMIC_RELAXED);
+}
+
 }  // anonymous namespace
 
 // This is a subset of what's in proc(5).
@@ -154,8 +175,9 @@ double stats_aggregate_rate_value(const McrouterInstance* router, int idx) {
 
   if (num_bins_used != 0) {
     uint64_t num = 0;
-    for (size_t i = 0; i < router->opts().num_proxies; ++i) {
-      num += router->getProxy(i)->stats_num_within_window[idx];
+    for (size_t i = 0; i < router->numProxies(); ++i) {
+      num += __atomic_load_n(
+        &router->getProxy(i)->stats_num_within_window[idx], __ATOMIC_RELAXED);
     }
     rate = (double)num / (num_bins_used * MOVING_AVERAGE_BIN_SIZE_IN_SECOND);
   }
@@ -244,7 +266,7 @@ void init_stats(stat_t* stats) {
 }
 
 uint64_t stat_get_config_age(const stat_t* stats, uint64_t now) {
-  uint64_t lct = stats[config_last_success_stat].data.uint64;
+  uint64_t lct = stat_load_bits(stats, config_last_success_stat);
   return now - lct;
 }
 
@@ -310,10 +332,10 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
   init_stats(stats);
 
   uint64_t config_last_success = 0;
-  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+  for (size_t i = 0; i < router->numProxies(); ++i) {
     auto proxy = router->getProxy(i);
     config_last_success = std::max(config_last_success,
-      proxy->stats[config_last_success_stat].data.uint64);
+      stat_load_bits(proxy->stats, config_last_success_stat));
   }
   AggregatedDestinationStats destStats;
   router->pclientOwner().foreach_shared_synchronized(
@@ -324,6 +346,10 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
         auto batch = it->getBatchingStat();
         destStats.batches.first += batch.first;
         destStats.batches.second += batch.second;
+        auto writeBatches = it->getWriteBatchHistogram();
+        for (size_t i = 0; i < writeBatches.size(); ++i) {
+          destStats.writeBatches[i] += writeBatches[i];
+        }
       }
     });
 
@@ -335,6 +361,51 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
     avgBatchSize = destStats.batches.first / (double)destStats.batches.second;
   }
   stats[destination_batch_size_stat].data.dbl = avgBatchSize;
+  static_assert(destination_write_batches_128_stat -
+                destination_write_batches_1_stat + 1 ==
+                std::tuple_size<WriteBatchHistogram>::value,
+                "destination_write_batches stats don't match the histogram");
+  for (size_t i = 0; i < destStats.writeBatches.size(); ++i) {
+    stat_set_uint64(stats, static_cast<stat_name_t>(
+                      destination_write_batches_1_stat + i),
+                    destStats.writeBatches[i]);
+  }
+
+  const auto& clientHandshakes = clientSSLHandshakeStats();
+  stat_set_uint64(stats, ssl_client_handshakes_full_stat,
+                  clientHandshakes.full);
+  stat_set_uint64(stats, ssl_client_handshakes_resumed_stat,
+                  clientHandshakes.resumed);
+  const auto& serverHandshakes = serverSSLHandshakeStats();
+  stat_set_uint64(stats, ssl_server_handshakes_full_stat,
+                  serverHandshakes.full);
+  stat_set_uint64(stats, ssl_server_handshakes_resumed_stat,
+                  serverHandshakes.resumed);
+  stat_set_uint64(stats, ssl_client_kernel_tls_stat,
+                  clientHandshakes.kernelTls);
+  stat_set_uint64(stats, ssl_server_kernel_tls_stat,
+                  serverHandshakes.kernelTls);
+  const auto& pooledHandshakes = sslHandshakePoolStats();
+  stat_set_uint64(stats, ssl_handshake_pool_pending_stat,
+                  pooledHandshakes.pending);
+  stat_set_uint64(stats, ssl_handshake_pool_completed_stat,
+                  pooledHandshakes.completed);
+  stat_set_uint64(stats, ssl_handshake_pool_failed_stat,
+                  pooledHandshakes.failed);
+  stat_set_uint64(stats, ssl_handshake_pool_queue_us_stat,
+                  pooledHandshakes.queueUs);
+  stat_set_uint64(stats, ssl_handshake_pool_handshake_us_stat,
+                  pooledHandshakes.handshakeUs);
+
+  const auto& hotRestart = hotRestartStats();
+  stat_set_uint64(stats, hot_restart_handoffs_stat, hotRestart.handoffs);
+  stat_set_uint64(stats, hot_restart_inherited_sockets_stat,
+                  hotRestart.inheritedSockets);
+  stat_set_uint64(stats, hot_restart_draining_stat, hotRestart.draining);
+  stat_set_uint64(stats, hot_restart_drain_remaining_clients_stat,
+                  hotRestart.drainRemaining);
+  stat_set_uint64(stats, hot_restart_drain_elapsed_ms_stat,
+                  hotRestart.drainElapsedMs);
 
   stats[commandargs_stat].data.string = gStandaloneArgs;
 
@@ -370,23 +441,80 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
   stats[ps_rss_stat].data.uint64 = ps_data.rss;
   stats[ps_vsize_stat].data.uint64 = ps_data.vsize;
 
+  auto memory = MemoryAccounting::totals();
+  auto memoryStat = [&memory](MemoryTag tag) {
+    return static_cast<uint64_t>(
+      std::max<int64_t>(0, memory[static_cast<size_t>(tag)]));
+  };
+  stats[memory_config_bytes_stat].data.uint64 =
+    memoryStat(MemoryTag::kConfig);
+  stats[memory_destinations_bytes_stat].data.uint64 =
+    memoryStat(MemoryTag::kDestinations);
+  stats[memory_read_buffers_bytes_stat].data.uint64 =
+    memoryStat(MemoryTag::kReadBuffers);
+  stats[memory_write_buffers_bytes_stat].data.uint64 =
+    memoryStat(MemoryTag::kWriteBuffers);
+  stats[memory_fiber_stacks_bytes_stat].data.uint64 =
+    memoryStat(MemoryTag::kFiberStacks);
+  stats[memory_asynclog_bytes_stat].data.uint64 =
+    memoryStat(MemoryTag::kAsynclog);
+
+  auto arenas = JemallocArenas::stats();
+  stats[memory_thread_arenas_allocated_bytes_stat].data.uint64 =
+    arenas.allocated;
+  stats[memory_thread_arenas_active_bytes_stat].data.uint64 = arenas.active;
+  stats[memory_thread_arenas_dirty_bytes_stat].data.uint64 = arenas.dirty;
+
   stats[fibers_allocated_stat].data.uint64 = 0;
   stats[fibers_pool_size_stat].data.uint64 = 0;
+  stats[fibers_pool_target_stat].data.uint64 = 0;
+  stats[fibers_pool_trimmed_stat].data.uint64 = 0;
   stats[fibers_stack_high_watermark_stat].data.uint64 = 0;
-  for (size_t i = 0; i < router->opts().num_proxies; ++i) {
+  stats[fibers_active_stat].data.uint64 = 0;
+  stats[fibers_loops_over_budget_stat].data.uint64 = 0;
+  stats[fibers_ready_stat].data.uint64 = 0;
+  stats[fibers_remote_tasks_pending_stat].data.uint64 = 0;
+  for (size_t i = 0; i < router->numProxies(); ++i) {
     auto pr = router->getProxy(i);
     stats[fibers_allocated_stat].data.uint64 +=
       pr->fiberManager.fibersAllocated();
     stats[fibers_pool_size_stat].data.uint64 +=
       pr->fiberManager.fibersPoolSize();
+    stats[fibers_pool_target_stat].data.uint64 +=
+      pr->fiberManager.fibersPoolTarget();
+    stats[fibers_pool_trimmed_stat].data.uint64 +=
+      pr->fiberManager.fibersPoolTrimmed();
     stats[fibers_stack_high_watermark_stat].data.uint64 =
       std::max(stats[fibers_stack_high_watermark_stat].data.uint64,
                pr->fiberManager.stackHighWatermark());
+    stats[fibers_active_stat].data.uint64 +=
+      pr->fiberManager.fibersAllocated() - pr->fiberManager.fibersPoolSize();
+    stats[fibers_loops_over_budget_stat].data.uint64 +=
+      pr->fiberManager.loopsOverBudget();
+    stats[fibers_ready_stat].data.uint64 += pr->fiberManager.readyFibers();
+    stats[fibers_remote_tasks_pending_stat].data.uint64 +=
+      pr->fiberManager.remoteTasksPending();
     stats[duration_us_stat].data.dbl += pr->durationUs.value();
+    if (pr->targetReadBuffers) {
+      /* Summed with the other per-proxy stats below */
+      stat_set_uint64(pr->stats, target_read_buffer_pool_bytes_stat,
+                      pr->targetReadBuffers->stats().bytesPooled);
+      stat_set_uint64(pr->stats, target_read_buffer_pool_borrow_misses_stat,
+                      pr->targetReadBuffers->stats().borrowMisses);
+    }
+    stat_set_uint64(pr->stats, proxy_request_num_outstanding_stat,
+                    counter_get(&pr->requestContextsOutstanding));
+    stat_set_uint64(pr->stats, target_outstanding_bytes_stat,
+                    pr->targetOutstandingBytes.bytes);
+    stat_set_uint64(pr->stats, target_outstanding_bytes_rejected_stat,
+                    pr->targetOutstandingBytes.rejected);
   }
-  if (router->opts().num_proxies > 0) {
-    stats[duration_us_stat].data.dbl /= router->opts().num_proxies;
+  if (router->numProxies() > 0) {
+    stats[duration_us_stat].data.dbl /= router->numProxies();
   }
+  stats[fibers_stack_bytes_per_active_stat].data.uint64 =
+    stats[memory_fiber_stacks_bytes_stat].data.uint64 /
+    std::max<uint64_t>(stats[fibers_active_stat].data.uint64, 1);
 #ifndef FBCODE_OPT_BUILD
   stats[mc_msg_num_outstanding_stat].data.uint64 =
     mc_msg_num_outstanding();
@@ -394,50 +522,64 @@ void prepare_stats(McrouterInstance* router, stat_t* stats) {
 
   for (int i = 0; i < num_stats; i++) {
     if (stats[i].aggregate && !(stats[i].group & rate_stats)) {
-      for (size_t j = 0; j < router->opts().num_proxies; ++j) {
+      for (size_t j = 0; j < router->numProxies(); ++j) {
         auto pr = router->getProxy(j);
+        auto bits = stat_load_bits(pr->stats, i);
         if (stats[i].type == stat_uint64) {
-          stats[i].data.uint64 += pr->stats[i].data.uint64;
+          stats[i].data.uint64 += bits;
         } else if (stats[i].type == stat_int64) {
-          stats[i].data.int64 += pr->stats[i].data.int64;
+          stats[i].data.int64 += static_cast<int64_t>(bits);
         } else if (stats[i].type == stat_double) {
-          stats[i].data.dbl += pr->stats[i].data.dbl;
+          double value;
+          static_assert(sizeof(value) == sizeof(bits), "double is not 8 bytes");
+          memcpy(&value, &bits, sizeof(value));
+          stats[i].data.dbl += value;
         } else {
           LOG(FATAL) << "you can't aggregate non-numerical stats!";
         }
       }
     }
   }
+
+  if (router->numProxies() > 0) {
+    uint64_t reqsPerRead = 0;
+    uint64_t readsPerEvent = 0;
+    for (size_t i = 0; i < router->numProxies(); ++i) {
+      auto pr = router->getProxy(i);
+      reqsPerRead += stat_get_uint64(pr->stats, server_reqs_per_read_stat);
+      readsPerEvent += stat_get_uint64(pr->stats, server_reads_per_event_stat);
+    }
+    stat_set_uint64(stats, server_reqs_per_read_stat,
+                    reqsPerRead / router->numProxies());
+    stat_set_uint64(stats, server_reads_per_event_stat,
+                    readsPerEvent / router->numProxies());
+  }
+
+  auto serverWrites = stats[server_reply_writes_stat].data.uint64;
+  if (serverWrites != 0) {
+    stats[server_replies_per_write_stat].data.dbl =
+      stats[server_replies_written_stat].data.uint64 / (double)serverWrites;
+  }
 }
 
 void stat_incr(stat_t* stats, stat_name_t stat_num, int64_t amount) {
-  stats[stat_num].data.uint64 += amount;
+  __atomic_fetch_add(&stats[stat_num].data.uint64, amount, __ATOMIC_RELAXED);
 }
 
 void stat_decr(stat_t* stats, stat_name_t stat_num, int64_t amount) {
   stat_incr(stats, stat_num, -amount);
 }
 
-// Thread-safe increment of the given counter
-void stat_incr_safe(stat_t* stats, stat_name_t stat_name) {
-  __sync_fetch_and_add(&stats[stat_name].data.uint64, 1);
-}
-
-void stat_decr_safe(stat_t* stats, stat_name_t stat_name) {
-  __sync_fetch_and_add(&stats[stat_name].data.uint64, -1);
-}
-
 void stat_set_uint64(stat_t* stats,
                      stat_name_t stat_num,
                      uint64_t value) {
   stat_t* stat = &stats[stat_num];
   FBI_ASSERT(stat->type == stat_uint64);
-  stat->data.uint64 = value;
+  __atomic_store_n(&stat->data.uint64, value, __ATOMIC_RELAXED);
 }
 
 uint64_t stat_get_uint64(stat_t* stats, stat_name_t stat_num) {
-  stat_t* stat = &stats[stat_num];
-  return stat->data.uint64;
+  return stat_load_bits(stats, stat_num);
 }
 
 static stat_group_t stat_parse_group_str(folly::StringPiece str) {
@@ -465,6 +607,10 @@ static stat_group_t stat_parse_group_str(folly::StringPiece str) {
     return count_stats;
   } else if (str == "outlier") {
     return outlier_stats;
+  } else if (str == "latency") {
+    return latency_stats;
+  } else if (str == "fiber_stack") {
+    return fiber_stack_stats;
   } else if (str.empty()) {
     return mcproxy_stats;
   } else {
@@ -472,12 +618,66 @@ static stat_group_t stat_parse_group_str(folly::StringPiece str) {
   }
 }
 
+/**
+ * Adds per-server stats of up to `limit` destinations (host:port),
+ * starting from startKey. If there are more, the last stat is
+ * "servers_next_page <key>".
+ */
+static void add_server_stats(proxy_t* proxy, StatsReply& reply,
+                             const std::string& startKey, size_t limit) {
+  std::unordered_map<std::string, ServerStat> serverStats;
+  auto nextKey = proxy->router->pclientOwner().foreach_shared_synchronized(
+    startKey, limit,
+    [&serverStats](const std::string& key, ProxyClientShared& shared) {
+      for (auto pdstn : shared.getDestinations()) {
+        auto& stat = serverStats[pdstn->pdstnKey];
+        for (size_t i = 0; i < mc_nres; ++i) {
+          stat.results[i] += pdstn->stats().results[i];
+        }
+        ++stat.states[(size_t) pdstn->state()];
+
+        if (pdstn->stats().avgLatency.hasValue()) {
+          stat.sumLatencies += pdstn->stats().avgLatency.value();
+          ++stat.cntLatencies;
+        }
+        stat.pendingRequestsCount += pdstn->getPendingRequestCount();
+        stat.inflightRequestsCount += pdstn->getInflightRequestCount();
+      }
+    });
+  for (const auto& it : serverStats) {
+    reply.addStat(it.first, it.second.toString());
+  }
+  if (!nextKey.empty()) {
+    reply.addStat("servers_next_page", nextKey);
+  }
+}
+
+/**
+ * Handles 'stats servers <limit> [<start>]': one page of per-server stats,
+ * so that instances with many destinations don't have to build (and
+ * hold the destinations lock for) the whole list at once.
+ */
+static McReply servers_page_reply(proxy_t* proxy, folly::StringPiece args) {
+  auto limitStr = args.split_step(' ');
+  size_t limit;
+  try {
+    limit = folly::to<size_t>(limitStr);
+  } catch (const std::exception& e) {
+    return McReply(mc_res_client_error, "bad stats servers page size");
+  }
+  if (limit == 0) {
+    return McReply(mc_res_client_error, "bad stats servers page size");
+  }
+
+  StatsReply reply;
+  add_server_stats(proxy, reply, args.str(), limit);
+  return reply.getMcReply();
+}
+
 /**
  * @param proxy_t proxy
  */
 McReply stats_reply(proxy_t* proxy, folly::StringPiece group_str) {
-  std::lock_guard<std::mutex> guard(proxy->stats_lock);
-
   StatsReply reply;
 
   if (group_str == "version") {
@@ -485,8 +685,12 @@ McReply stats_reply(proxy_t* proxy, folly::StringPiece group_str) {
     return reply.getMcReply();
   }
 
-  auto groups = stat_parse_group_str(group_str);
-  if (groups == unknown_stats) {
+  auto args = group_str;
+  auto groups = stat_parse_group_str(args.split_step(' '));
+  if (groups == server_stats && !args.empty()) {
+    return servers_page_reply(proxy, args);
+  }
+  if (groups == unknown_stats || !args.empty()) {
     return McReply(mc_res_client_error, "bad stats command");
   }
 
@@ -506,29 +710,36 @@ McReply stats_reply(proxy_t* proxy, folly::StringPiece group_str) {
   }
 
   if (groups & server_stats) {
-    std::unordered_map<std::string, ServerStat> serverStats;
-    proxy->router->pclientOwner().foreach_shared_synchronized(
-      [&serverStats](const std::string& key, ProxyClientShared& shared) {
-        for (auto pdstn : shared.getDestinations()) {
-          auto& stat = serverStats[pdstn->pdstnKey];
-          for (size_t i = 0; i < mc_nres; ++i) {
-            stat.results[i] += pdstn->stats().results[i];
-          }
-          ++stat.states[(size_t) pdstn->state()];
-
-          if (pdstn->stats().avgLatency.hasValue()) {
-            stat.sumLatencies += pdstn->stats().avgLatency.value();
-            ++stat.cntLatencies;
-          }
-          stat.pendingRequestsCount += pdstn->getPendingRequestCount();
-          stat.inflightRequestsCount += pdstn->getInflightRequestCount();
-        }
-      });
-    for (const auto& it : serverStats) {
+    add_server_stats(proxy, reply, std::string(),
+                     std::numeric_limits<size_t>::max());
+  }
+
+  if (groups & latency_stats) {
+    for (int op = 0; op < mc_nops; ++op) {
+      auto hist = stats_aggregate_op_latency(proxy->router,
+                                             static_cast<mc_op_t>(op));
+      if (hist.count() > 0) {
+        reply.addStat(
+          folly::to<std::string>("duration_us_",
+                                 mc_op_to_string(static_cast<mc_op_t>(op))),
+          hist.toString());
+      }
+    }
+    for (const auto& it : stats_aggregate_loop_latency(proxy->router)) {
+      reply.addStat(it.first, it.second.toString());
+    }
+    for (const auto& it :
+         stats_aggregate_destination_latency(proxy->router)) {
       reply.addStat(it.first, it.second.toString());
     }
   }
 
+  if (groups & fiber_stack_stats) {
+    for (const auto& it : stats_aggregate_fiber_stack_usage(proxy->router)) {
+      reply.addStat("fibers_stack_used_" + it.first, it.second.toString());
+    }
+  }
+
   if (groups & suspect_server_stats) {
     auto suspectServers = proxy->router->getSuspectServers();
     for (const auto& it : suspectServers) {
@@ -541,6 +752,220 @@ McReply stats_reply(proxy_t* proxy, folly::StringPiece group_str) {
   return reply.getMcReply();
 }
 
+LatencyHistogram stats_aggregate_op_latency(const McrouterInstance* router,
+                                            mc_op_t op) {
+  LatencyHistogram hist;
+  for (size_t i = 0; i < router->numProxies(); ++i) {
+    hist.merge(router->getProxy(i)->durationUsByOp[op]);
+  }
+  return hist;
+}
+
+LatencyHistogram stats_aggregate_queue_latency(const McrouterInstance* router,
+                                               size_t priority) {
+  LatencyHistogram hist;
+  for (size_t i = 0; i < router->numProxies(); ++i) {
+    hist.merge(router->getProxy(i)->queueTimeUsByClass[priority]);
+  }
+  return hist;
+}
+
+namespace {
+
+struct ProxyHistogram {
+  const char* name;
+  LatencyHistogram proxy_t::* hist;
+};
+
+const ProxyHistogram kLoopHistograms[] = {
+  {"loop_lag_us", &proxy_t::loopLagUs},
+  {"request_queue_lag_us", &proxy_t::requestQueueLagUs},
+  {"fibers_ready_per_loop", &proxy_t::fibersReadyPerLoop},
+  {"fiber_loop_run_us", &proxy_t::fiberLoopRunUs},
+  {"replication_lag_us", &proxy_t::replicationLagUs},
+};
+
+}  // anonymous namespace
+
+std::vector<std::pair<std::string, LatencyHistogram>>
+stats_aggregate_loop_latency(const McrouterInstance* router) {
+  std::vector<std::pair<std::string, LatencyHistogram>> result;
+  for (const auto& it : kLoopHistograms) {
+    LatencyHistogram hist;
+    for (size_t i = 0; i < router->numProxies(); ++i) {
+      hist.merge(router->getProxy(i)->*it.hist);
+    }
+    result.emplace_back(it.name, hist);
+  }
+  return result;
+}
+
+std::unordered_map<std::string, LatencyHistogram>
+stats_aggregate_destination_latency(McrouterInstance* router) {
+  std::unordered_map<std::string, LatencyHistogram> result;
+  router->pclientOwner().foreach_shared_synchronized(
+    [&result](const std::string& key, ProxyClientShared& shared) {
+      for (const auto& pdstn : shared.getDestinations()) {
+        result[pdstn->pdstnKey].merge(pdstn->stats().latencyUs);
+      }
+    });
+  return result;
+}
+
+std::unordered_map<std::string, LatencyHistogram>
+stats_aggregate_destination_connect_latency(McrouterInstance* router) {
+  std::unordered_map<std::string, LatencyHistogram> result;
+  router->pclientOwner().foreach_shared_synchronized(
+    [&result](const std::string& key, ProxyClientShared& shared) {
+      for (const auto& pdstn : shared.getDestinations()) {
+        result[pdstn->pdstnKey].merge(pdstn->stats().connectUs);
+      }
+    });
+  return result;
+}
+
+std::string shortRouteName(const char* mangledName) {
+  if (mangledName == nullptr) {
+    return "unknown";
+  }
+  auto name = folly::demangle(mangledName).toStdString();
+  static const std::string kHandle = "McrouterRouteHandle<";
+  auto from = name.find(kHandle);
+  from = from == std::string::npos ? 0 : from + kHandle.size();
+  auto end = name.find('<', from);
+  if (end == std::string::npos) {
+    end = name.size();
+  }
+  auto begin = name.rfind("::", end);
+  begin = begin == std::string::npos || begin < from ? from : begin + 2;
+  return name.substr(begin, end - begin);
+}
+
+std::unordered_map<std::string, LatencyHistogram>
+stats_aggregate_fiber_stack_usage(McrouterInstance* router) {
+  std::unordered_map<std::string, LatencyHistogram> result;
+  for (size_t i = 0; i < router->numProxies(); ++i) {
+    auto proxy = router->getProxy(i);
+    std::lock_guard<std::mutex> lock(proxy->stackUsageLock);
+    for (const auto& it : proxy->stackUsageByRoute) {
+      result[shortRouteName(it.first)].merge(it.second);
+    }
+  }
+  return result;
+}
+
+namespace {
+
+std::string openMetricsLabel(folly::StringPiece value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+  for (auto c : value) {
+    if (c == '\\' || c == '"') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (c == '\n') {
+      escaped.append("\\n");
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+/**
+ * Appends cumulative buckets of hist, skipping empty ones.
+ * The '# TYPE' line must already be written.
+ */
+void appendOpenMetricsHistogram(std::string& out, folly::StringPiece name,
+                                folly::StringPiece label,
+                                folly::StringPiece labelValue,
+                                const LatencyHistogram& hist) {
+  auto labels = folly::to<std::string>(label, "=\"",
+                                       openMetricsLabel(labelValue), "\"");
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < LatencyHistogram::kNumBuckets; ++i) {
+    auto n = hist.bucketCount(i);
+    if (n == 0) {
+      continue;
+    }
+    cumulative += n;
+    folly::toAppend(name, "_bucket{", labels, ",le=\"",
+                    LatencyHistogram::bucketUpperBound(i), "\"} ",
+                    cumulative, "\n", &out);
+  }
+  folly::toAppend(name, "_bucket{", labels, ",le=\"+Inf\"} ", cumulative,
+                  "\n", &out);
+  folly::toAppend(name, "_count{", labels, "} ", cumulative, "\n", &out);
+}
+
+}  // anonymous namespace
+
+std::string stats_openmetrics(McrouterInstance* router) {
+  std::string out;
+  stat_t stats[num_stats];
+  prepare_stats(router, stats);
+
+  for (size_t i = 0; i < num_stats; ++i) {
+    const auto& stat = stats[i];
+    double value;
+    if (stat.group & rate_stats) {
+      /* Summed over all proxies, like the stats written to disk */
+      value = stats_aggregate_rate_value(router, i);
+    } else if (stat.type == stat_uint64) {
+      value = stat.data.uint64;
+    } else if (stat.type == stat_int64) {
+      value = stat.data.int64;
+    } else if (stat.type == stat_double) {
+      value = stat.data.dbl;
+    } else {
+      /* Strings have no place in OpenMetrics */
+      continue;
+    }
+    folly::toAppend("# TYPE mcrouter_", stat.name, " gauge\n",
+                    "mcrouter_", stat.name, " ", value, "\n", &out);
+  }
+
+  out.append("# TYPE mcrouter_duration_us histogram\n");
+  for (int op = 0; op < mc_nops; ++op) {
+    auto hist = stats_aggregate_op_latency(router, static_cast<mc_op_t>(op));
+    if (hist.count() > 0) {
+      appendOpenMetricsHistogram(out, "mcrouter_duration_us", "op",
+                                 mc_op_to_string(static_cast<mc_op_t>(op)),
+                                 hist);
+    }
+  }
+
+  out.append("# TYPE mcrouter_queue_time_us histogram\n");
+  for (size_t i = 0; i < RequestPriorities::kNumClasses; ++i) {
+    auto hist = stats_aggregate_queue_latency(router, i);
+    if (hist.count() > 0) {
+      appendOpenMetricsHistogram(out, "mcrouter_queue_time_us", "class",
+                                 folly::to<std::string>(i), hist);
+    }
+  }
+
+  for (const auto& it : kLoopHistograms) {
+    auto name = folly::to<std::string>("mcrouter_", it.name);
+    folly::toAppend("# TYPE ", name, " histogram\n", &out);
+    for (size_t i = 0; i < router->numProxies(); ++i) {
+      const auto& hist = router->getProxy(i)->*it.hist;
+      if (hist.count() > 0) {
+        appendOpenMetricsHistogram(out, name, "proxy",
+                                   folly::to<std::string>(i), hist);
+      }
+    }
+  }
+
+  out.append("# TYPE mcrouter_destination_latency_us histogram\n");
+  for (const auto& it : stats_aggregate_destination_latency(router)) {
+    appendOpenMetricsHistogram(out, "mcrouter_destination_latency_us",
+                               "destination", it.first, it.second);
+  }
+
+  out.append("# EOF\n");
+  return out;
+}
+
 void set_standalone_args(folly::StringPiece args) {
   assert(gStandaloneArgs == nullptr);
   gStandaloneArgs = new char[args.size() + 1];
@@ -11,9 +11,14 @@
 
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <folly/Range.h>
 
+#include "mcrouter/LatencyHistogram.h"
+#include "mcrouter/lib/mc/msg.h"
+
 namespace facebook { namespace memcache {
 
 class McReply;
@@ -70,6 +75,8 @@ enum stat_group_t {
   server_stats         =    0x10000,
   memory_stats         =    0x20000,
   suspect_server_stats =    0x40000,
+  latency_stats        =    0x80000,
+  fiber_stack_stats    =   0x100000,
   unknown_stats        = 0x10000000,
 };
 
@@ -93,8 +100,6 @@ struct stat_t {
 void init_stats(stat_t* stats);
 void stat_incr(stat_t*, stat_name_t, int64_t);
 void stat_decr(stat_t*, stat_name_t, int64_t);
-void stat_incr_safe(stat_t*, stat_name_t);
-void stat_decr_safe(stat_t*, stat_name_t);
 
 /**
  * Current aggregation of rate of stats[idx] (which must be an aggregated
@@ -106,6 +111,67 @@ void stat_set_uint64(stat_t*, stat_name_t, uint64_t);
 uint64_t stat_get_uint64(stat_t*, stat_name_t);
 uint64_t stat_get_config_age(const stat_t* stats, uint64_t now);
 McReply stats_reply(proxy_t*, folly::StringPiece);
+
+/**
+ * Request duration histogram for the given operation,
+ * merged across all proxies of the router.
+ */
+LatencyHistogram stats_aggregate_op_latency(const McrouterInstance* router,
+                                            mc_op_t op);
+
+/**
+ * Histogram of time requests of the given priority class spent in proxy
+ * queues, merged across all proxies of the router.
+ */
+LatencyHistogram stats_aggregate_queue_latency(const McrouterInstance* router,
+                                               size_t priority);
+
+/**
+ * Proxy thread saturation histograms by name: loop_lag_us,
+ * request_queue_lag_us, fibers_ready_per_loop and fiber_loop_run_us
+ * (see proxy_t::loopLagUs), plus replication_lag_us, merged across all
+ * proxies of the router.
+ */
+std::vector<std::pair<std::string, LatencyHistogram>>
+stats_aggregate_loop_latency(const McrouterInstance* router);
+
+/**
+ * Latency histograms of all destinations (keyed by pdstnKey),
+ * merged across all proxies of the router.
+ */
+std::unordered_map<std::string, LatencyHistogram>
+stats_aggregate_destination_latency(McrouterInstance* router);
+
+/**
+ * Connect time histograms of all destinations (keyed by pdstnKey),
+ * merged across all proxies of the router.
+ */
+std::unordered_map<std::string, LatencyHistogram>
+stats_aggregate_destination_connect_latency(McrouterInstance* router);
+
+/**
+ * "facebook::memcache::AllSyncRoute<...>" -> "AllSyncRoute", also for
+ * route handles: "...::McrouterRouteHandle<...::AllSyncRoute<...> >"
+ *
+ * @param mangledName  typeid(Route).name() or typeid of a route handle,
+ *                     may be nullptr
+ */
+std::string shortRouteName(const char* mangledName);
+
+/**
+ * Sampled fiber stack usage histograms (in bytes), keyed by route handle
+ * name, merged across all proxies of the router.
+ * See --fibers-stack-sample-rate.
+ */
+std::unordered_map<std::string, LatencyHistogram>
+stats_aggregate_fiber_stack_usage(McrouterInstance* router);
+
+/**
+ * All numeric stats and the request duration, queue time and destination
+ * latency histograms of the router in OpenMetrics text format.
+ * Doesn't touch the proxy threads, see --stats-export-port.
+ */
+std::string stats_openmetrics(McrouterInstance* router);
 void prepare_stats(McrouterInstance* router, stat_t* stats);
 
 void set_standalone_args(folly::StringPiece args);
@@ -485,7 +485,7 @@ def create_listen_socket():
 class Mcrouter(MCProcess):
     def __init__(self, config, port=None, default_route=None, extra_args=None,
                  base_dir=None, substitute_config_ports=None,
-                 substitute_port_map=None, replace_map=None):
+                 substitute_port_map=None, replace_map=None, binary=None):
         if base_dir is None:
             base_dir = BaseDirectory('mcrouter')
         self.base_dir = base_dir
@@ -511,7 +511,9 @@ class Mcrouter(MCProcess):
                 config_file.write(replaced_config)
 
         self.config = config
-        args = [McrouterGlobals.InstallDir + '/mcrouter/mcrouter', '-d',
+        if binary is None:
+            binary = McrouterGlobals.InstallDir + '/mcrouter/mcrouter'
+        args = [binary, '-d',
                 '-f', config,
                 '-L', self.log,
                 '-a', self.async_spool]
@@ -576,9 +578,11 @@ class McrouterClient(MCProcess):
         MCProcess.__init__(self, None, str(port))
 
 class Memcached(MCProcess):
-    def __init__(self, port=None):
+    def __init__(self, port=None, extra_args=None):
         args = [McrouterGlobals.InstallDir +
                     '/mcrouter/lib/network/mock_mc_server']
+        if extra_args:
+            args.extend(extra_args)
         listen_sock = None
         if port is None:
             listen_sock = create_listen_socket()
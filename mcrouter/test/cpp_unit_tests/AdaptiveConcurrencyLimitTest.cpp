@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/AdaptiveConcurrencyLimit.h"
+
+using facebook::memcache::mcrouter::AdaptiveConcurrencyLimit;
+
+TEST(AdaptiveConcurrencyLimit, growsWhileHealthy) {
+  AdaptiveConcurrencyLimit limit(4, 200);
+  auto initial = limit.limit();
+  for (int i = 0; i < 100; ++i) {
+    limit.onSample(100, limit.limit());
+  }
+  EXPECT_EQ(100, limit.baselineUs());
+  EXPECT_GT(limit.limit(), initial);
+  for (int i = 0; i < 10000; ++i) {
+    limit.onSample(100, limit.limit());
+  }
+  EXPECT_EQ(200, limit.limit());
+}
+
+TEST(AdaptiveConcurrencyLimit, idleDoesntGrow) {
+  AdaptiveConcurrencyLimit limit(4, 200);
+  auto initial = limit.limit();
+  for (int i = 0; i < 100; ++i) {
+    limit.onSample(100, 1);
+  }
+  EXPECT_EQ(initial, limit.limit());
+}
+
+TEST(AdaptiveConcurrencyLimit, shrinksOnQueueing) {
+  AdaptiveConcurrencyLimit limit(4, 200);
+  for (int i = 0; i < 1000; ++i) {
+    limit.onSample(100, limit.limit());
+  }
+  auto healthy = limit.limit();
+  /* Latency 10x the baseline */
+  for (int i = 0; i < 100; ++i) {
+    limit.onSample(1000, limit.limit());
+  }
+  EXPECT_LT(limit.limit(), healthy / 2);
+  EXPECT_GE(limit.limit(), 4);
+}
+
+TEST(AdaptiveConcurrencyLimit, drops) {
+  AdaptiveConcurrencyLimit limit(4, 200);
+  auto initial = limit.limit();
+  limit.onDrop();
+  EXPECT_LT(limit.limit(), initial);
+  for (int i = 0; i < 100; ++i) {
+    limit.onDrop();
+  }
+  EXPECT_EQ(4, limit.limit());
+}
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/AdaptiveTimeout.h"
+
+using facebook::memcache::mcrouter::AdaptiveTimeout;
+using facebook::memcache::mcrouter::AdaptiveTimeoutSettings;
+
+using std::chrono::milliseconds;
+
+namespace {
+
+AdaptiveTimeoutSettings settings(uint32_t pct, int64_t minMs, int64_t maxMs) {
+  AdaptiveTimeoutSettings result;
+  result.pct = pct;
+  result.min = milliseconds(minMs);
+  result.max = milliseconds(maxMs);
+  return result;
+}
+
+void sample(AdaptiveTimeout& timeout, int64_t latencyUs, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    timeout.onSample(latencyUs);
+  }
+}
+
+}  // anonymous namespace
+
+TEST(AdaptiveTimeout, staticUntilFirstWindow) {
+  AdaptiveTimeout timeout;
+  sample(timeout, 2000, AdaptiveTimeout::kWindowSamples - 1);
+  EXPECT_EQ(0, timeout.p99Us());
+  EXPECT_EQ(milliseconds(1000),
+            timeout.timeout(settings(300, 5, 0), milliseconds(1000)));
+
+  sample(timeout, 2000, 1);
+  EXPECT_GE(timeout.p99Us(), 2000);
+  EXPECT_LE(timeout.p99Us(), 2000 * 9 / 8);
+  auto adapted = timeout.timeout(settings(300, 5, 0), milliseconds(1000));
+  EXPECT_GE(adapted, milliseconds(6));
+  EXPECT_LE(adapted, milliseconds(7));
+  /* disabled */
+  EXPECT_EQ(milliseconds(1000),
+            timeout.timeout(settings(0, 5, 0), milliseconds(1000)));
+}
+
+TEST(AdaptiveTimeout, clamped) {
+  AdaptiveTimeout timeout;
+  sample(timeout, 100, AdaptiveTimeout::kWindowSamples);
+  EXPECT_EQ(milliseconds(5),
+            timeout.timeout(settings(300, 5, 0), milliseconds(1000)));
+
+  sample(timeout, 500000, AdaptiveTimeout::kWindowSamples);
+  /* never above the static timeout, unless max says so */
+  EXPECT_EQ(milliseconds(1000),
+            timeout.timeout(settings(300, 5, 0), milliseconds(1000)));
+  EXPECT_EQ(milliseconds(800),
+            timeout.timeout(settings(300, 5, 800), milliseconds(1000)));
+  /* min above max */
+  EXPECT_EQ(milliseconds(10),
+            timeout.timeout(settings(300, 50, 10), milliseconds(10)));
+}
+
+TEST(AdaptiveTimeout, followsRecentWindow) {
+  AdaptiveTimeout timeout;
+  sample(timeout, 50000, AdaptiveTimeout::kWindowSamples);
+  auto slow = timeout.timeout(settings(200, 1, 0), milliseconds(1000));
+  sample(timeout, 1000, AdaptiveTimeout::kWindowSamples);
+  auto fast = timeout.timeout(settings(200, 1, 0), milliseconds(1000));
+  EXPECT_LT(fast, slow);
+  EXPECT_LE(fast, milliseconds(3));
+}
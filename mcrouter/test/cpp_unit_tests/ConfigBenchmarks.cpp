@@ -0,0 +1,305 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/**
+ * Cost of building and swapping in a config, by phase, on a synthetic
+ * config of --pools pools with --hosts hosts each, spread over --prefixes
+ * routing prefixes, with --macro-depth nested macros per route and
+ * shadows / shard splits on some of the pools. Building the pools is also
+ * measured alone, on one and on --pool-threads threads. Prints peak RSS at
+ * the end.
+ */
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/dynamic.h>
+#include <folly/json.h>
+#include <folly/Memory.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/lib/config/ConfigPreprocessor.h"
+#include "mcrouter/lib/config/JsonParser.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/options.h"
+#include "mcrouter/PoolFactory.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyConfig.h"
+#include "mcrouter/ProxyConfigBuilder.h"
+#include "mcrouter/routes/McImportResolver.h"
+
+DEFINE_int32(pools, 100, "Number of pools");
+DEFINE_int32(hosts, 20, "Hosts per pool");
+DEFINE_int32(prefixes, 20, "Number of routing prefixes");
+DEFINE_int32(macro_depth, 10, "Nested macro calls per pool route");
+DEFINE_int32(pool_threads, 4, "Threads to build pools with");
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+/**
+ * Pools pool_0..N with distinct hosts. Every pool has a key prefix policy
+ * in one of the routing prefixes: a quarter of them with shadows, a quarter
+ * with shard splits, the rest through route_<depth>(pool), a macro that
+ * expands through depth other macros into a PoolRoute.
+ */
+std::string generateConfig(folly::StringPiece defaultRoute) {
+  folly::dynamic pools = folly::dynamic::object;
+  for (int p = 0; p < FLAGS_pools; ++p) {
+    folly::dynamic servers = {};
+    for (int h = 0; h < FLAGS_hosts; ++h) {
+      servers.push_back(
+        folly::to<std::string>("127.0.0.1:", 10000 + p * FLAGS_hosts + h));
+    }
+    pools[folly::to<std::string>("pool_", p)] =
+      folly::dynamic::object("servers", std::move(servers));
+  }
+  folly::dynamic shadowServers = {};
+  shadowServers.push_back("127.0.0.1:9999");
+  pools["shadow"] = folly::dynamic::object("servers", shadowServers);
+
+  folly::dynamic macros = folly::dynamic::object;
+  macros["route_0"] = folly::dynamic::object
+    ("type", "macroDef")
+    ("params", folly::dynamic{"pool"})
+    ("result", folly::dynamic::object("type", "PoolRoute")("pool", "%pool%"));
+  for (int d = 1; d <= FLAGS_macro_depth; ++d) {
+    macros[folly::to<std::string>("route_", d)] = folly::dynamic::object
+      ("type", "macroDef")
+      ("params", folly::dynamic{"pool"})
+      ("result", folly::to<std::string>("@route_", d - 1, "(%pool%)"));
+  }
+
+  folly::dynamic shadows = {};
+  shadows.push_back(folly::dynamic::object
+    ("target", "PoolRoute|shadow")
+    ("index_range", folly::dynamic{0, 1})
+    ("key_fraction_range", folly::dynamic{0.0, 0.1}));
+
+  std::vector<folly::dynamic> policies(std::max(1, FLAGS_prefixes),
+                                       folly::dynamic(folly::dynamic::object));
+  for (int p = 0; p < FLAGS_pools; ++p) {
+    auto pool = folly::to<std::string>("pool_", p);
+    folly::dynamic route = nullptr;
+    switch (p % 4) {
+      case 1:
+        route = folly::dynamic::object("type", "PoolRoute")("pool", pool)
+          ("shadows", shadows);
+        break;
+      case 2:
+        route = folly::dynamic::object("type", "PoolRoute")("pool", pool)
+          ("shard_splits", folly::dynamic::object("1", 3)("2", 10));
+        break;
+      default:
+        route = folly::to<std::string>("@route_", FLAGS_macro_depth, "(",
+                                       pool, ")");
+        break;
+    }
+    policies[p % policies.size()][folly::to<std::string>("p", p, ":")] =
+      std::move(route);
+  }
+
+  folly::dynamic routes = {};
+  for (size_t i = 0; i < policies.size(); ++i) {
+    folly::dynamic aliases = {};
+    aliases.push_back(
+      folly::to<std::string>("/region", i, "/cluster", i, "/"));
+    if (i == 0) {
+      aliases.push_back(defaultRoute.str());
+    }
+    routes.push_back(folly::dynamic::object
+      ("aliases", std::move(aliases))
+      ("route", folly::dynamic::object
+        ("type", "PrefixSelectorRoute")
+        ("policies", std::move(policies[i]))
+        ("wildcard", "NullRoute")));
+  }
+
+  return folly::toJson(folly::dynamic::object
+    ("macros", std::move(macros))
+    ("pools", std::move(pools))
+    ("routes", std::move(routes))).toStdString();
+}
+
+struct Fixture {
+  McrouterOptions opts;
+  std::string config;
+  McrouterInstance* router{nullptr};
+
+  Fixture() : opts(defaultTestOptions()) {
+    opts.num_proxies = 1;
+    config = generateConfig(opts.default_route.str());
+    opts.config_str = config;
+    router = McrouterInstance::init("config_benchmark", opts);
+    CHECK(router != nullptr) << "can't configure with the synthetic config";
+  }
+
+  proxy_t* proxy() const {
+    return router->getProxy(0);
+  }
+
+  std::unique_ptr<ProxyConfigBuilder> builder() const {
+    return folly::make_unique<ProxyConfigBuilder>(opts, &router->configApi(),
+                                                  config);
+  }
+};
+
+std::unique_ptr<Fixture> fixture;
+
+long peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+}  // anonymous namespace
+
+BENCHMARK(Config_parseJson, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    auto json = folly::parseJson(fixture->config);
+    folly::doNotOptimizeAway(json);
+  }
+}
+
+/* What the preprocessor used to do with configs and imports */
+BENCHMARK_RELATIVE(Config_stripCommentsAndParseJson, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    auto json = folly::parseJson(folly::json::stripComments(fixture->config));
+    folly::doNotOptimizeAway(json);
+  }
+}
+
+BENCHMARK_RELATIVE(Config_parseJsonWithComments, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    auto json = parseJsonWithComments(fixture->config);
+    folly::doNotOptimizeAway(json);
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(Config_preprocess, iters) {
+  McImportResolver importResolver(&fixture->router->configApi());
+  for (size_t i = 0; i < iters; ++i) {
+    auto json = ConfigPreprocessor::getConfigWithoutMacros(
+      fixture->config, importResolver, {}, /* nestedLimit */ 250);
+    folly::doNotOptimizeAway(json);
+  }
+}
+
+/* Preprocessing and pools */
+BENCHMARK(Config_builder, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    auto builder = fixture->builder();
+    folly::doNotOptimizeAway(builder);
+  }
+}
+
+BENCHMARK(Config_buildPools, iters) {
+  folly::dynamic json = nullptr;
+  BENCHMARK_SUSPEND {
+    json = fixture->builder()->preprocessedConfig();
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    PoolFactory factory(json, fixture->router->configApi(), fixture->opts);
+    folly::doNotOptimizeAway(factory.clients().size());
+  }
+}
+
+BENCHMARK_RELATIVE(Config_buildPools_threads, iters) {
+  folly::dynamic json = nullptr;
+  auto opts = fixture->opts;
+  BENCHMARK_SUSPEND {
+    json = fixture->builder()->preprocessedConfig();
+    opts.config_pool_threads = FLAGS_pool_threads;
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    PoolFactory factory(json, fixture->router->configApi(), opts);
+    folly::doNotOptimizeAway(factory.clients().size());
+  }
+}
+
+/* Route handles (McRouteHandleProvider) and destinations */
+BENCHMARK(Config_buildProxyConfig, iters) {
+  std::unique_ptr<ProxyConfigBuilder> builder;
+  BENCHMARK_SUSPEND {
+    builder = fixture->builder();
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    auto config = builder->buildConfig(fixture->proxy());
+    folly::doNotOptimizeAway(config);
+  }
+}
+
+/* Same, reusing the route handles of an identical previous config */
+BENCHMARK(Config_buildProxyConfig_unchanged, iters) {
+  std::unique_ptr<ProxyConfigBuilder> builder;
+  std::shared_ptr<ProxyConfig> previous;
+  BENCHMARK_SUSPEND {
+    builder = fixture->builder();
+    previous = builder->buildConfig(fixture->proxy());
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    auto config = builder->buildConfig(fixture->proxy(), previous.get());
+    folly::doNotOptimizeAway(config);
+  }
+}
+
+BENCHMARK(Config_swap, iters) {
+  std::unique_ptr<ProxyConfigBuilder> builder;
+  BENCHMARK_SUSPEND {
+    builder = fixture->builder();
+  }
+  for (size_t i = 0; i < iters; ++i) {
+    std::shared_ptr<ProxyConfig> config;
+    BENCHMARK_SUSPEND {
+      config = builder->buildConfig(fixture->proxy());
+    }
+    proxy_config_swap(fixture->proxy(), std::move(config));
+  }
+}
+
+/* All of the above, as on a reload */
+BENCHMARK(Config_reconfigure, iters) {
+  for (size_t i = 0; i < iters; ++i) {
+    CHECK(fixture->router->configure(fixture->config));
+  }
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  auto startRssKb = peakRssKb();
+  fixture = folly::make_unique<Fixture>();
+  printf("config: %zu bytes, %d pools x %d hosts, %d prefixes, "
+         "macro depth %d\n",
+         fixture->config.size(), FLAGS_pools, FLAGS_hosts, FLAGS_prefixes,
+         FLAGS_macro_depth);
+  printf("peak RSS after the first configure: %ld KB (+%ld KB)\n",
+         peakRssKb(), peakRssKb() - startRssKb);
+
+  folly::runBenchmarks();
+
+  printf("peak RSS: %ld KB (+%ld KB)\n", peakRssKb(),
+         peakRssKb() - startRssKb);
+  fixture.reset();
+  McrouterInstance::freeAllMcrouters();
+  return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/ConfigEpochs.h"
+
+using facebook::memcache::mcrouter::ConfigEpochs;
+
+TEST(ConfigEpochs, pinAndReclaim) {
+  ConfigEpochs<int> epochs;
+  auto first = std::make_shared<const int>(1);
+  std::weak_ptr<const int> firstWeak(first);
+  epochs.update(std::move(first));
+
+  const int* config = nullptr;
+  auto e1 = epochs.pin(config);
+  EXPECT_EQ(1, *config);
+
+  epochs.update(std::make_shared<const int>(2));
+  EXPECT_EQ(2, *epochs.current());
+  /* Still pinned by the request */
+  EXPECT_EQ(2, epochs.numEpochs());
+  EXPECT_FALSE(firstWeak.expired());
+  EXPECT_EQ(1, *config);
+
+  auto e2 = epochs.pin(config);
+  EXPECT_EQ(2, *config);
+
+  epochs.unpin(e1);
+  EXPECT_TRUE(firstWeak.expired());
+  EXPECT_EQ(1, epochs.numEpochs());
+
+  epochs.unpin(e2);
+  /* Current config stays */
+  EXPECT_EQ(1, epochs.numEpochs());
+  EXPECT_EQ(2, *epochs.current());
+}
+
+TEST(ConfigEpochs, olderEpochsFirst) {
+  ConfigEpochs<int> epochs;
+  epochs.update(std::make_shared<const int>(1));
+  const int* config = nullptr;
+  auto e1 = epochs.pin(config);
+
+  auto second = std::make_shared<const int>(2);
+  std::weak_ptr<const int> secondWeak(second);
+  epochs.update(std::move(second));
+  auto e2 = epochs.pin(config);
+  epochs.update(std::make_shared<const int>(3));
+
+  /* Not reclaimed while an older epoch is pinned */
+  epochs.unpin(e2);
+  EXPECT_FALSE(secondWeak.expired());
+  EXPECT_EQ(3, epochs.numEpochs());
+
+  epochs.unpin(e1);
+  EXPECT_TRUE(secondWeak.expired());
+  EXPECT_EQ(1, epochs.numEpochs());
+  EXPECT_EQ(3, *epochs.current());
+}
@@ -0,0 +1,53 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/ConfigValidator.h"
+#include "mcrouter/options.h"
+#include "mcrouter/test/cpp_unit_tests/mcrouter_cpp_tests.h"
+
+using namespace facebook::memcache::mcrouter;
+
+TEST(ConfigValidator, validatesFlavorsInParallel) {
+  auto valid = defaultTestOptions();
+  valid.config_file = kMemcacheConfig;
+
+  auto invalid = defaultTestOptions();
+  invalid.config_str = R"({"route": {"type": "NoSuchRoute"}})";
+
+  auto unreadable = defaultTestOptions();
+  unreadable.config_file = "/nonexistent/config.json";
+
+  std::vector<std::pair<std::string, McrouterOptions>> flavors = {
+    { "valid", valid },
+    { "invalid", invalid },
+    { "unreadable", unreadable },
+    { "valid_again", valid },
+  };
+  auto results = validateConfigs(flavors, 2);
+  ASSERT_EQ(4, results.size());
+
+  EXPECT_EQ("valid", results[0].name);
+  EXPECT_TRUE(results[0].valid);
+  EXPECT_TRUE(results[0].error.empty());
+  EXPECT_GT(results[0].buildTime.count(), 0);
+
+  EXPECT_EQ("invalid", results[1].name);
+  EXPECT_FALSE(results[1].valid);
+  EXPECT_NE(std::string::npos, results[1].error.find("NoSuchRoute"));
+
+  EXPECT_FALSE(results[2].valid);
+  EXPECT_TRUE(results[3].valid);
+}
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/HotKeyTracker.h"
+
+using facebook::memcache::mcrouter::HotKeyTracker;
+using facebook::memcache::mcrouter::SpaceSaving;
+
+TEST(SpaceSaving, findsHeavyHitters) {
+  SpaceSaving summary(20);
+  /* Two keys with 10% share each, in a long tail of unique keys */
+  for (int i = 0; i < 10000; ++i) {
+    if (i % 10 == 0) {
+      summary.add("hot1");
+    } else if (i % 10 == 5) {
+      summary.add("hot2");
+    } else {
+      summary.add(folly::to<std::string>("cold", i));
+    }
+  }
+
+  EXPECT_EQ(10000, summary.total());
+  auto top = summary.top(2);
+  ASSERT_EQ(2, top.size());
+  EXPECT_TRUE(top[0].key == "hot1" || top[0].key == "hot2");
+  EXPECT_TRUE(top[1].key == "hot1" || top[1].key == "hot2");
+  for (const auto& item : top) {
+    /* Estimates bound the true count from both sides */
+    EXPECT_GE(item.count, 1000);
+    EXPECT_LE(item.count - item.error, 1000);
+  }
+  EXPECT_EQ(0, summary.estimate("cold1"));
+  EXPECT_EQ(20, summary.top(100).size());
+}
+
+TEST(SpaceSaving, decay) {
+  SpaceSaving summary(4);
+  for (uint64_t i = 0; i < SpaceSaving::kDecaySamples - 1; ++i) {
+    summary.add("old");
+  }
+  summary.add("new");
+  /* Halved on the last sample */
+  EXPECT_EQ(SpaceSaving::kDecaySamples / 2, summary.total());
+  EXPECT_EQ((SpaceSaving::kDecaySamples - 1) / 2, summary.estimate("old"));
+  EXPECT_EQ(0, summary.estimate("new"));
+}
+
+TEST(HotKeyTracker, sampling) {
+  HotKeyTracker tracker(10, 8);
+  for (int i = 0; i < 1000; ++i) {
+    tracker.onRequest(i % 2 ? "a" : "b", i % 4 ? "/r/c/" : "");
+  }
+  /* Every 10th request is sampled, so only "a" is seen */
+  auto keys = tracker.topKeys(10);
+  ASSERT_EQ(1, keys.size());
+  EXPECT_EQ("a", keys[0].key);
+  EXPECT_EQ(100, keys[0].count);
+  EXPECT_TRUE(tracker.isHot("a", 0.5));
+  EXPECT_FALSE(tracker.isHot("b", 0.01));
+
+  auto prefixes = tracker.topPrefixes(10);
+  ASSERT_EQ(1, prefixes.size());
+  EXPECT_EQ("/r/c/", prefixes[0].key);
+  EXPECT_EQ(100, prefixes[0].count);
+}
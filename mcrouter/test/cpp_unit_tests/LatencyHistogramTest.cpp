@@ -0,0 +1,69 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/LatencyHistogram.h"
+
+using facebook::memcache::mcrouter::LatencyHistogram;
+
+TEST(LatencyHistogram, bucketBounds) {
+  for (uint64_t v = 0; v < (1 << 16); ++v) {
+    auto idx = LatencyHistogram::bucketIndex(v);
+    ASSERT_LT(idx, LatencyHistogram::kNumBuckets);
+    auto upper = LatencyHistogram::bucketUpperBound(idx);
+    EXPECT_LE(v, upper);
+    // Relative error is bounded by the sub bucket width.
+    EXPECT_LE(upper - v, v / LatencyHistogram::kSubBuckets);
+    if (idx > 0) {
+      EXPECT_GT(v, LatencyHistogram::bucketUpperBound(idx - 1));
+    }
+  }
+  EXPECT_EQ(LatencyHistogram::kNumBuckets - 1,
+            LatencyHistogram::bucketIndex(LatencyHistogram::kMaxValue));
+  EXPECT_EQ(LatencyHistogram::kNumBuckets - 1,
+            LatencyHistogram::bucketIndex(1ULL << 40));
+  EXPECT_EQ(LatencyHistogram::kMaxValue,
+            LatencyHistogram::bucketUpperBound(
+              LatencyHistogram::kNumBuckets - 1));
+}
+
+TEST(LatencyHistogram, quantiles) {
+  LatencyHistogram h;
+  EXPECT_EQ(0, h.count());
+  EXPECT_EQ(0, h.quantile(0.5));
+
+  for (uint64_t v = 1; v <= 1000; ++v) {
+    h.insertSample(v);
+  }
+  EXPECT_EQ(1000, h.count());
+
+  auto p50 = h.quantile(0.5);
+  EXPECT_GE(p50, 500);
+  EXPECT_LE(p50, 500 + 500 / LatencyHistogram::kSubBuckets);
+  auto p99 = h.quantile(0.99);
+  EXPECT_GE(p99, 990);
+  EXPECT_LE(p99, 990 + 990 / LatencyHistogram::kSubBuckets);
+  EXPECT_EQ(1, h.quantile(0));
+  EXPECT_GE(h.quantile(1), 1000);
+}
+
+TEST(LatencyHistogram, merge) {
+  LatencyHistogram a;
+  LatencyHistogram b;
+  for (int i = 0; i < 99; ++i) {
+    a.insertSample(10);
+  }
+  b.insertSample(100000);
+
+  a.merge(b);
+  EXPECT_EQ(100, a.count());
+  EXPECT_EQ(10, a.quantile(0.5));
+  EXPECT_GE(a.quantile(0.999), 100000);
+}
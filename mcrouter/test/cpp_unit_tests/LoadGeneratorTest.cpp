@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/LoadGenerator.h"
+
+using namespace facebook::memcache::mcrouter;
+
+TEST(LoadGenerator, keyDistributions) {
+  std::mt19937_64 rng(0);
+
+  KeyDistribution uniform("uniform", 10);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_LT(uniform(rng), 10);
+  }
+
+  KeyDistribution zipf("zipf:1", 1000);
+  size_t first = 0;
+  for (int i = 0; i < 10000; ++i) {
+    auto key = zipf(rng);
+    EXPECT_LT(key, 1000);
+    first += key == 0;
+  }
+  // 1 / H(1000) ~ 13% of the picks
+  EXPECT_GT(first, 1000);
+  EXPECT_LT(first, 1700);
+
+  KeyDistribution hotset("hotset:0.01:0.9", 1000);
+  size_t hot = 0;
+  for (int i = 0; i < 10000; ++i) {
+    hot += hotset(rng) < 10;
+  }
+  EXPECT_GT(hot, 8500);
+  EXPECT_LT(hot, 9500);
+
+  EXPECT_THROW(KeyDistribution("zipf", 10), std::invalid_argument);
+  EXPECT_THROW(KeyDistribution("hotset:2:0.5", 10), std::invalid_argument);
+  EXPECT_THROW(KeyDistribution("uniform", 0), std::invalid_argument);
+}
+
+TEST(LoadGenerator, valueSizes) {
+  std::mt19937_64 rng(0);
+
+  ValueSizeDistribution fixed("100");
+  EXPECT_EQ(100, fixed(rng));
+
+  ValueSizeDistribution uniform("uniform:10:20");
+  for (int i = 0; i < 1000; ++i) {
+    auto size = uniform(rng);
+    EXPECT_GE(size, 10);
+    EXPECT_LE(size, 20);
+  }
+
+  ValueSizeDistribution lognormal("lognormal:1000:2");
+  std::vector<size_t> sizes;
+  for (int i = 0; i < 1001; ++i) {
+    sizes.push_back(lognormal(rng));
+    EXPECT_LE(sizes.back(), ValueSizeDistribution::kMaxValueSize);
+  }
+  std::nth_element(sizes.begin(), sizes.begin() + 500, sizes.end());
+  EXPECT_GT(sizes[500], 700);
+  EXPECT_LT(sizes[500], 1400);
+
+  EXPECT_THROW(ValueSizeDistribution("uniform:20:10"), std::invalid_argument);
+  EXPECT_THROW(ValueSizeDistribution("2000000"), std::invalid_argument);
+  EXPECT_THROW(ValueSizeDistribution("big"), std::invalid_argument);
+}
+
+TEST(LoadGenerator, operationMix) {
+  std::mt19937_64 rng(0);
+
+  OperationMix mix("get:3,set:1,delete:0");
+  EXPECT_EQ(std::vector<mc_op_t>({mc_op_get, mc_op_set, mc_op_delete}),
+            mix.operations());
+  size_t gets = 0;
+  for (int i = 0; i < 10000; ++i) {
+    auto op = mix(rng);
+    EXPECT_NE(mc_op_delete, op);
+    gets += op == mc_op_get;
+  }
+  EXPECT_GT(gets, 7000);
+  EXPECT_LT(gets, 8000);
+
+  EXPECT_THROW(OperationMix("get:0"), std::invalid_argument);
+  EXPECT_THROW(OperationMix("incr:1"), std::invalid_argument);
+  EXPECT_THROW(OperationMix("get"), std::invalid_argument);
+}
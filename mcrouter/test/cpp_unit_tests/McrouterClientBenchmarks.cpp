@@ -0,0 +1,137 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <semaphore.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+
+#include "mcrouter/config.h"
+#include "mcrouter/McrouterClient.h"
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/options.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+void onReply(mcrouter_msg_t* routerReq, void* context) {
+  sem_post(static_cast<sem_t*>(context));
+}
+
+/**
+ * Sends iters gets to DevNullRoute through an in-process mcrouter, waiting
+ * for every reply before sending the next request.
+ */
+void runRoundTrip(size_t numProxies, size_t iters) {
+  McrouterInstance* router;
+  McrouterClient::Pointer client;
+  sem_t replied;
+  McMsgRef msg;
+
+  BENCHMARK_SUSPEND {
+    auto opts = defaultTestOptions();
+    opts.config_str = R"({"route": "DevNullRoute"})";
+    opts.num_proxies = numProxies;
+    router = McrouterInstance::init(
+      folly::to<std::string>("benchmark_round_trip_", numProxies), opts);
+    CHECK(router != nullptr);
+    sem_init(&replied, 0, 0);
+    client = router->createClient(
+      (mcrouter_client_callbacks_t){onReply, nullptr, nullptr},
+      &replied,
+      0);
+    msg = createMcMsgRef("someprefix:somekey:1234567890");
+    msg->op = mc_op_get;
+  }
+
+  mcrouter_msg_t req;
+  req.req = const_cast<mc_msg_t*>(msg.get());
+  req.context = nullptr;
+  for (size_t i = 0; i < iters; ++i) {
+    req.reply = McReply(mc_res_unknown);
+    client->send(&req, 1);
+    sem_wait(&replied);
+  }
+
+  BENCHMARK_SUSPEND {
+    client.reset();
+    sem_destroy(&replied);
+  }
+}
+
+/* mcrouter_client_stats_t before it was split into per thread blocks */
+struct PackedClientStats {
+  uint32_t nreq;
+  uint32_t op_count[mc_nops];
+  uint32_t op_key_bytes[mc_nops];
+  uint32_t op_value_bytes[mc_nops];
+  uint32_t ntmo;
+};
+
+/**
+ * Bumps the counters a request touches from a sender and a proxy thread
+ * at the same time, which is what happens in a loaded client.
+ */
+template <class SendCounter, class ReplyCounter>
+void runCounters(size_t iters, SendCounter* send, ReplyCounter* reply) {
+  std::atomic<bool> start{false};
+  std::thread proxyThread([&]() {
+    while (!start) {
+    }
+    for (size_t i = 0; i < iters; ++i) {
+      __sync_fetch_and_add(reply, 1);
+    }
+  });
+  start = true;
+  for (size_t i = 0; i < iters; ++i) {
+    __sync_fetch_and_add(send, 1);
+  }
+  proxyThread.join();
+}
+
+}  // anonymous namespace
+
+BENCHMARK(McrouterClient_devNullRoundTrip, iters) {
+  runRoundTrip(1, iters);
+}
+
+BENCHMARK(McrouterClient_devNullRoundTrip_4proxies, iters) {
+  runRoundTrip(4, iters);
+}
+
+BENCHMARK(ClientStats_packed, iters) {
+  PackedClientStats stats;
+  BENCHMARK_SUSPEND {
+    memset(&stats, 0, sizeof(stats));
+  }
+  runCounters(iters, &stats.op_count[mc_op_get],
+              &stats.op_value_bytes[mc_op_get]);
+}
+
+BENCHMARK_RELATIVE(ClientStats_perThreadBlocks, iters) {
+  mcrouter_client_stats_t stats;
+  BENCHMARK_SUSPEND {
+    memset(&stats, 0, sizeof(stats));
+  }
+  runCounters(iters, &stats.send.op_count[mc_op_get],
+              &stats.reply.op_value_bytes[mc_op_get]);
+}
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  McrouterInstance::freeAllMcrouters();
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <poll.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/McrouterCompletionQueue.h"
+
+using facebook::memcache::McReply;
+using facebook::memcache::mcrouter::McrouterCompletionQueue;
+using facebook::memcache::mcrouter::mcrouter_completion_t;
+
+namespace {
+
+mcrouter_completion_t makeCompletion(uintptr_t id) {
+  mcrouter_completion_t completion;
+  completion.reply = McReply(mc_res_found);
+  completion.context = reinterpret_cast<void*>(id);
+  return completion;
+}
+
+bool readable(int fd) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  return ::poll(&pfd, 1, 0) == 1;
+}
+
+}  // anonymous namespace
+
+TEST(McrouterCompletionQueue, notifiesOncePerBatch) {
+  McrouterCompletionQueue queue(16);
+  EXPECT_FALSE(readable(queue.fd()));
+
+  for (uintptr_t i = 1; i <= 3; ++i) {
+    queue.push(makeCompletion(i));
+  }
+  ASSERT_TRUE(readable(queue.fd()));
+  uint64_t val = 0;
+  ASSERT_EQ(sizeof(val), read(queue.fd(), &val, sizeof(val)));
+  /* Only the first push of the batch wrote to the eventfd */
+  EXPECT_EQ(1, val);
+
+  mcrouter_completion_t out[4];
+  ASSERT_EQ(3, queue.poll(out, 4));
+  for (uintptr_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(reinterpret_cast<void*>(i + 1), out[i].context);
+    EXPECT_EQ(mc_res_found, out[i].reply.result());
+  }
+
+  /* The queue ran empty, so the next push notifies again */
+  EXPECT_FALSE(readable(queue.fd()));
+  queue.push(makeCompletion(4));
+  EXPECT_TRUE(readable(queue.fd()));
+  ASSERT_EQ(1, queue.poll(out, 4));
+  EXPECT_FALSE(readable(queue.fd()));
+}
+
+TEST(McrouterCompletionQueue, overflow) {
+  McrouterCompletionQueue queue(4);
+  for (uintptr_t i = 1; i <= 10; ++i) {
+    queue.push(makeCompletion(i));
+  }
+
+  mcrouter_completion_t out[3];
+  uintptr_t next = 1;
+  size_t n;
+  while ((n = queue.poll(out, 3)) > 0) {
+    for (size_t i = 0; i < n; ++i) {
+      EXPECT_EQ(reinterpret_cast<void*>(next++), out[i].context);
+    }
+  }
+  EXPECT_EQ(11, next);
+
+  /* Back to the ring */
+  queue.push(makeCompletion(11));
+  ASSERT_EQ(1, queue.poll(out, 3));
+  EXPECT_EQ(reinterpret_cast<void*>(11), out[0].context);
+}
+
+TEST(McrouterCompletionQueue, producerThread) {
+  const uintptr_t kNumCompletions = 100000;
+  McrouterCompletionQueue queue(64);
+
+  std::thread producer([&queue, kNumCompletions]() {
+    for (uintptr_t i = 1; i <= kNumCompletions; ++i) {
+      queue.push(makeCompletion(i));
+    }
+  });
+
+  mcrouter_completion_t out[16];
+  uintptr_t next = 1;
+  while (next <= kNumCompletions) {
+    auto n = queue.poll(out, 16);
+    for (size_t i = 0; i < n; ++i) {
+      ASSERT_EQ(reinterpret_cast<void*>(next++), out[i].context);
+    }
+    if (n < 16 && next <= kNumCompletions) {
+      struct pollfd pfd = {queue.fd(), POLLIN, 0};
+      ASSERT_EQ(1, ::poll(&pfd, 1, 10000));
+    }
+  }
+
+  producer.join();
+  EXPECT_EQ(0, queue.poll(out, 16));
+}
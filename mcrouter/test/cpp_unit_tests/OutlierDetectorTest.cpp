@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/OutlierDetector.h"
+
+using facebook::memcache::mcrouter::OutlierDetector;
+
+namespace {
+
+OutlierDetector::Options testOptions() {
+  OutlierDetector::Options options;
+  options.intervalUs = 1000;
+  options.minRequests = 10;
+  options.maxEjectedFraction = 0.2;
+  options.ejectionUs = 10000;
+  return options;
+}
+
+/**
+ * Sends 20 requests to each destination over one interval,
+ * destination i gets latency latencies[i] and errors if errors[i].
+ *
+ * @return number of ejected destinations
+ */
+size_t runInterval(OutlierDetector& detector, int64_t& now,
+                   const std::vector<int64_t>& latencies,
+                   const std::vector<bool>& errors) {
+  size_t ejected = 0;
+  for (int i = 0; i < 20; ++i) {
+    for (size_t d = 0; d < detector.size(); ++d) {
+      if (!detector.isEjected(d, now)) {
+        ejected += detector.onReply(d, errors[d], latencies[d], now);
+      }
+    }
+    now += 50;
+  }
+  return ejected;
+}
+
+}  // anonymous namespace
+
+TEST(OutlierDetector, healthyPool) {
+  OutlierDetector detector(5, testOptions());
+  int64_t now = 1;
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(0, runInterval(detector, now, {100, 120, 90, 110, 100},
+                             {false, false, false, false, false}));
+  }
+  EXPECT_EQ(0, detector.numEjected());
+}
+
+TEST(OutlierDetector, slowDestination) {
+  OutlierDetector detector(5, testOptions());
+  int64_t now = 1;
+  runInterval(detector, now, {100, 100, 5000, 100, 100},
+              {false, false, false, false, false});
+  EXPECT_EQ(1, runInterval(detector, now, {100, 100, 5000, 100, 100},
+                           {false, false, false, false, false}));
+  EXPECT_TRUE(detector.isEjected(2, now));
+  EXPECT_FALSE(detector.isEjected(0, now));
+
+  /* Back after the ejection time */
+  now += 10000;
+  EXPECT_FALSE(detector.isEjected(2, now));
+  EXPECT_EQ(0, detector.numEjected());
+}
+
+TEST(OutlierDetector, errorRate) {
+  OutlierDetector detector(5, testOptions());
+  int64_t now = 1;
+  runInterval(detector, now, {100, 100, 100, 100, 100},
+              {false, true, false, false, false});
+  runInterval(detector, now, {100, 100, 100, 100, 100},
+              {false, true, false, false, false});
+  EXPECT_EQ(1, detector.numEjected());
+  EXPECT_TRUE(detector.isEjected(1, now));
+}
+
+TEST(OutlierDetector, maxEjected) {
+  /* 20% of 5 destinations: only one can be ejected */
+  OutlierDetector detector(5, testOptions());
+  int64_t now = 1;
+  for (int i = 0; i < 5; ++i) {
+    runInterval(detector, now, {100, 100, 100, 5000, 5000},
+                {false, false, false, false, false});
+  }
+  EXPECT_EQ(1, detector.numEjected());
+  EXPECT_TRUE(detector.isEjected(3, now) || detector.isEjected(4, now));
+}
+
+TEST(OutlierDetector, smallPool) {
+  /* 20% of 3 destinations rounds down to 0, still one can be ejected */
+  OutlierDetector detector(3, testOptions());
+  int64_t now = 1;
+  for (int i = 0; i < 5; ++i) {
+    runInterval(detector, now, {100, 5000, 100}, {false, false, false});
+  }
+  EXPECT_EQ(1, detector.numEjected());
+  EXPECT_TRUE(detector.isEjected(1, now));
+}
+
+TEST(OutlierDetector, noEjections) {
+  auto options = testOptions();
+  options.maxEjectedFraction = 0;
+  OutlierDetector detector(3, options);
+  int64_t now = 1;
+  for (int i = 0; i < 5; ++i) {
+    runInterval(detector, now, {100, 5000, 100}, {false, false, false});
+  }
+  EXPECT_EQ(0, detector.numEjected());
+}
+
+TEST(OutlierDetector, tooFewPeers) {
+  OutlierDetector detector(2, testOptions());
+  int64_t now = 1;
+  for (int i = 0; i < 5; ++i) {
+    runInterval(detector, now, {100, 5000}, {false, true});
+  }
+  EXPECT_EQ(0, detector.numEjected());
+}
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <gtest/gtest.h>
+
+#include "mcrouter/PoolTkoTracker.h"
+
+using facebook::memcache::mcrouter::PoolTkoTracker;
+
+TEST(PoolTkoTracker, mostlyDead) {
+  PoolTkoTracker tracker("pool", 50, 25);
+  tracker.updateSize(10);
+
+  size_t sampled = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    sampled += tracker.onTko();
+  }
+  EXPECT_FALSE(tracker.mostlyDead());
+  sampled += tracker.onTko();
+  EXPECT_TRUE(tracker.mostlyDead());
+  for (size_t i = 0; i < 3; ++i) {
+    sampled += tracker.onTko();
+  }
+  /* Every 4th, starting with the first one */
+  EXPECT_EQ(2, sampled);
+  EXPECT_EQ(8, tracker.tkoCount());
+
+  EXPECT_EQ(0, tracker.recoveries());
+  tracker.onTkoEnd(/* recovered= */ true);
+  EXPECT_EQ(1, tracker.recoveries());
+  tracker.onTkoEnd(/* recovered= */ false);
+  EXPECT_EQ(1, tracker.recoveries());
+  EXPECT_EQ(6, tracker.tkoCount());
+
+  for (size_t i = 0; i < 2; ++i) {
+    tracker.onTkoEnd(/* recovered= */ true);
+  }
+  EXPECT_FALSE(tracker.mostlyDead());
+  EXPECT_EQ(3, tracker.recoveries());
+}
+
+TEST(PoolTkoTracker, disabled) {
+  PoolTkoTracker tracker("pool", 0, 10);
+  tracker.updateSize(1);
+  EXPECT_TRUE(tracker.onTko());
+  EXPECT_FALSE(tracker.mostlyDead());
+
+  PoolTkoTracker empty("empty", 50, 10);
+  EXPECT_FALSE(empty.mostlyDead());
+}
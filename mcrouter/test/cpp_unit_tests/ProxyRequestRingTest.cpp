@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/async/EventBase.h>
+
+#include "mcrouter/ProxyRequestRing.h"
+
+using facebook::memcache::mcrouter::ProxyRequestRing;
+
+namespace {
+
+const size_t kNumProducers = 4;
+const uint64_t kNumEntries = 100000;
+
+struct State {
+  std::vector<uint64_t> last;
+  size_t numReady{0};
+  size_t numSwept{0};
+};
+
+void onReady(asox_queue_t q, asox_queue_entry_t* entry, void* arg) {
+  auto& state = *reinterpret_cast<State*>(arg);
+  auto value = reinterpret_cast<uint64_t>(entry->data);
+  /* Entries of every producer must come in order */
+  EXPECT_EQ(state.last[entry->type] + 1, value);
+  state.last[entry->type] = value;
+  ++state.numReady;
+}
+
+void onSweep(asox_queue_t q, asox_queue_entry_t* entry, void* arg) {
+  ++reinterpret_cast<State*>(arg)->numSwept;
+}
+
+const asox_queue_callbacks_t kCallbacks = {onReady, onSweep};
+
+asox_queue_entry_t makeEntry(int producer, uint64_t value) {
+  asox_queue_entry_t entry;
+  entry.type = producer;
+  entry.data = reinterpret_cast<void*>(value);
+  entry.nbytes = 0;
+  entry.priority = 0;
+  return entry;
+}
+
+}  // anonymous namespace
+
+TEST(ProxyRequestRing, multiProducer) {
+  folly::EventBase evb;
+  State state;
+  state.last.resize(kNumProducers);
+  ProxyRequestRing ring(evb, 64, 16, 0, &kCallbacks, &state);
+  EXPECT_EQ(64, ring.capacity());
+
+  std::vector<std::thread> producers;
+  for (size_t p = 0; p < kNumProducers; ++p) {
+    producers.emplace_back([&ring, p]() {
+      uint64_t value = 1;
+      while (value <= kNumEntries) {
+        asox_queue_entry_t entries[7];
+        size_t n = 0;
+        for (; n < value % 7 + 1 && value <= kNumEntries; ++n, ++value) {
+          entries[n] = makeEntry(p, value);
+        }
+        ring.enqueue(entries, n);
+      }
+    });
+  }
+
+  while (state.numReady < kNumProducers * kNumEntries) {
+    evb.loopOnce();
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_EQ(0, state.numSwept);
+}
+
+TEST(ProxyRequestRing, fullOnConsumerThread) {
+  folly::EventBase evb;
+  State state;
+  state.last.resize(1);
+  {
+    ProxyRequestRing ring(evb, 16, 16, 0, &kCallbacks, &state);
+    std::vector<asox_queue_entry_t> entries;
+    for (uint64_t i = 1; i <= 100; ++i) {
+      entries.push_back(makeEntry(0, i));
+    }
+    /* Must not deadlock: the consumer drains the ring itself */
+    ring.enqueue(entries.data(), entries.size());
+    EXPECT_GE(state.numReady, 100 - ring.capacity());
+  }
+  EXPECT_EQ(100, state.numReady + state.numSwept);
+}
+
+TEST(ProxyRequestRing, tryEnqueue) {
+  folly::EventBase evb;
+  State state;
+  state.last.resize(1);
+  {
+    ProxyRequestRing ring(evb, 4, 16, 0, &kCallbacks, &state);
+    for (uint64_t i = 1; i <= 4; ++i) {
+      EXPECT_TRUE(ring.tryEnqueue(makeEntry(0, i)));
+    }
+    /* Full, nothing is drained */
+    EXPECT_FALSE(ring.tryEnqueue(makeEntry(0, 5)));
+    EXPECT_EQ(0, state.numReady);
+
+    evb.loopOnce();
+    EXPECT_EQ(4, state.numReady);
+    EXPECT_TRUE(ring.tryEnqueue(makeEntry(0, 5)));
+  }
+  EXPECT_EQ(1, state.numSwept);
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/RequestArena.h"
+
+using facebook::memcache::mcrouter::RequestArena;
+using facebook::memcache::mcrouter::RequestArenaAllocator;
+using facebook::memcache::mcrouter::RequestArenaPool;
+
+TEST(RequestArena, reuseBlocks) {
+  RequestArenaPool pool;
+  auto arena = RequestArena::create(pool);
+  std::vector<void*> ptrs;
+  for (size_t i = 0; i < 100; ++i) {
+    ptrs.push_back(arena->allocate(100));
+  }
+  EXPECT_EQ(0, pool.numFreeBlocks());
+  for (auto p : ptrs) {
+    arena->deallocate(p, 100);
+  }
+  EXPECT_EQ(0, pool.numFreeBlocks());
+  arena->decref();
+  auto numBlocks = pool.numFreeBlocks();
+  EXPECT_GT(numBlocks, 1);
+
+  arena = RequestArena::create(pool);
+  EXPECT_EQ(numBlocks - 1, pool.numFreeBlocks());
+  arena->decref();
+  EXPECT_EQ(numBlocks, pool.numFreeBlocks());
+}
+
+TEST(RequestArena, maxFreeBlocks) {
+  RequestArenaPool pool(2);
+  auto arena = RequestArena::create(pool);
+  for (size_t i = 0; i < 100; ++i) {
+    arena->allocate(100);
+  }
+  for (size_t i = 0; i < 100; ++i) {
+    arena->deallocate(nullptr, 100);
+  }
+  arena->decref();
+  EXPECT_EQ(2, pool.numFreeBlocks());
+}
+
+TEST(RequestArena, outlivesOwner) {
+  RequestArenaPool pool;
+  auto arena = RequestArena::create(pool);
+  auto big = std::allocate_shared<std::vector<char>>(
+    RequestArenaAllocator<std::vector<char>>(*arena), 10, 'a');
+  auto str = std::allocate_shared<std::string>(
+    RequestArenaAllocator<std::string>(*arena), "test");
+  std::shared_ptr<char> huge(
+    static_cast<char*>(arena->allocate(RequestArena::kMaxAllocSize + 1)),
+    [arena](char* p) {
+      arena->deallocate(p, RequestArena::kMaxAllocSize + 1);
+    });
+  arena->decref();
+
+  EXPECT_EQ(0, pool.numFreeBlocks());
+  EXPECT_EQ(10, big->size());
+  EXPECT_EQ("test", *str);
+  big.reset();
+  str.reset();
+  EXPECT_EQ(0, pool.numFreeBlocks());
+  huge.reset();
+  EXPECT_EQ(1, pool.numFreeBlocks());
+}
@@ -0,0 +1,40 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/RequestPriorities.h"
+
+using facebook::memcache::mcrouter::RequestPriorities;
+
+TEST(RequestPriorities, longestPrefix) {
+  RequestPriorities priorities("/a/b/:3,/a/b/crit:0,batch:2", 1);
+  EXPECT_EQ(3, priorities.classOf("/a/b/key"));
+  EXPECT_EQ(0, priorities.classOf("/a/b/critical"));
+  EXPECT_EQ(2, priorities.classOf("batch:job"));
+  EXPECT_EQ(1, priorities.classOf("/c/d/key"));
+  EXPECT_EQ(1, priorities.classOf(""));
+}
+
+TEST(RequestPriorities, prefixWithColon) {
+  RequestPriorities priorities("user:profile:0", 2);
+  EXPECT_EQ(0, priorities.classOf("user:profile:123"));
+  EXPECT_EQ(2, priorities.classOf("user:123"));
+}
+
+TEST(RequestPriorities, invalid) {
+  EXPECT_THROW(RequestPriorities("abc", 0), std::invalid_argument);
+  EXPECT_THROW(RequestPriorities(":1", 0), std::invalid_argument);
+  EXPECT_THROW(RequestPriorities("a:x", 0), std::invalid_argument);
+  EXPECT_THROW(RequestPriorities("a:4", 0), std::invalid_argument);
+  EXPECT_THROW(RequestPriorities("a:1", 4), std::invalid_argument);
+  EXPECT_NO_THROW(RequestPriorities("", 3));
+}
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/McrouterInstance.h"
+#include "mcrouter/options.h"
+#include "mcrouter/proxy.h"
+#include "mcrouter/ProxyMcRequest.h"
+#include "mcrouter/RequestStatsBuffer.h"
+#include "mcrouter/RttOutlierTracker.h"
+#include "mcrouter/stats.h"
+#include "mcrouter/test/cpp_unit_tests/mcrouter_cpp_tests.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+RequestStatsBuffer::Record makeRecord(mc_op_t op, RequestClass reqClass,
+                                      uint8_t errors, bool outlier) {
+  RequestStatsBuffer::Record record;
+  record.durationUs = 100;
+  record.op = op;
+  record.requestClass = static_cast<uint8_t>(reqClass);
+  record.errors = errors;
+  record.outlier = outlier;
+  record.errorsOnly = false;
+  return record;
+}
+
+}  // anonymous namespace
+
+TEST(RequestStatsBuffer, foldsAtEndOfLoop) {
+  McrouterOptions opts = defaultTestOptions();
+  opts.config_file = kMemcacheConfig;
+  folly::EventBase eventBase;
+  auto router = McrouterInstance::init("test_request_stats_buffer", opts);
+  auto proxy = folly::make_unique<proxy_t>(router, &eventBase, opts);
+  auto& buffer = *proxy->requestStats;
+
+  for (int i = 0; i < 3; ++i) {
+    buffer.append(makeRecord(mc_op_get, RequestClass::NORMAL, 0, i == 0));
+  }
+  buffer.append(makeRecord(mc_op_get, RequestClass::SHADOW,
+                           RequestStatsBuffer::kError |
+                           RequestStatsBuffer::kTko, false));
+  auto refused = makeRecord(mc_op_unknown, RequestClass::NORMAL,
+                            RequestStatsBuffer::kTko, false);
+  refused.errorsOnly = true;
+  buffer.append(refused);
+
+  /* nothing is accounted before the loop iteration ends */
+  EXPECT_EQ(0, stat_get_uint64(proxy->stats, cmd_get_out_all_count_stat));
+  eventBase.loopOnce(EVLOOP_NONBLOCK);
+
+  EXPECT_EQ(3, stat_get_uint64(proxy->stats, cmd_get_out_count_stat));
+  EXPECT_EQ(1, stat_get_uint64(proxy->stats, cmd_get_out_shadow_count_stat));
+  EXPECT_EQ(4, stat_get_uint64(proxy->stats, cmd_get_out_all_count_stat));
+  EXPECT_EQ(1, stat_get_uint64(proxy->stats, cmd_get_outlier_count_stat));
+  EXPECT_EQ(1, stat_get_uint64(proxy->stats, result_error_shadow_count_stat));
+  EXPECT_EQ(0, stat_get_uint64(proxy->stats, result_error_count_stat));
+  EXPECT_EQ(1, stat_get_uint64(proxy->stats, result_tko_count_stat));
+  EXPECT_EQ(2, stat_get_uint64(proxy->stats, result_tko_all_count_stat));
+  EXPECT_EQ(4, proxy->durationUsByOp[mc_op_get].count());
+
+  /* a full buffer is folded right away */
+  for (size_t i = 0; i <= RequestStatsBuffer::kCapacity; ++i) {
+    buffer.append(makeRecord(mc_op_set, RequestClass::FAILOVER, 0, false));
+  }
+  EXPECT_EQ(RequestStatsBuffer::kCapacity,
+            stat_get_uint64(proxy->stats, cmd_set_out_failover_count_stat));
+  eventBase.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(RequestStatsBuffer::kCapacity + 1,
+            stat_get_uint64(proxy->stats, cmd_set_out_failover_count_stat));
+
+  // should be disposed before event_base
+  proxy.reset();
+}
+
+TEST(RttOutlierTracker, keepsLatest) {
+  RttOutlierTracker tracker(2);
+  tracker.add("key1", "host:1", mc_op_get, 10);
+  tracker.add(std::string(100, 'k'), "host:2", mc_op_set, 20);
+  tracker.add("key3", "host:3", mc_op_delete, 30);
+
+  auto outliers = tracker.outliers();
+  ASSERT_EQ(2, outliers.size());
+  /* oldest first, long keys are cut */
+  EXPECT_EQ(std::string(RttOutlierTracker::kMaxKeyPrefix, 'k'),
+            outliers[0].keyPrefix);
+  EXPECT_EQ("host:2", outliers[0].destination);
+  EXPECT_EQ(mc_op_set, outliers[0].op);
+  EXPECT_EQ(20, outliers[0].durationUs);
+  EXPECT_EQ("key3", outliers[1].keyPrefix);
+  EXPECT_EQ(30, outliers[1].durationUs);
+}
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/RequestTracer.h"
+
+using facebook::memcache::mcrouter::RequestTracer;
+using facebook::memcache::mcrouter::Span;
+using facebook::memcache::mcrouter::SpanKind;
+using facebook::memcache::mcrouter::SpanRing;
+
+namespace {
+
+Span makeSpan(uint64_t traceId) {
+  Span span;
+  span.traceId = traceId;
+  span.startUs = traceId;
+  span.endUs = traceId + 1;
+  span.name = nullptr;
+  span.kind = SpanKind::kRoute;
+  span.detail[0] = '\0';
+  return span;
+}
+
+}  // anonymous namespace
+
+TEST(SpanRing, pushDrain) {
+  SpanRing ring(6);
+  EXPECT_EQ(8, ring.capacity());
+
+  std::vector<Span> out;
+  EXPECT_EQ(0, ring.drain(out));
+
+  /* Wrap around a few times */
+  uint64_t next = 1;
+  for (int round = 0; round < 5; ++round) {
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_TRUE(ring.push(makeSpan(next + i)));
+    }
+    out.clear();
+    ASSERT_EQ(5, ring.drain(out));
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(next + i, out[i].traceId);
+    }
+    next += 5;
+  }
+  EXPECT_EQ(0, ring.dropped());
+}
+
+TEST(SpanRing, dropsWhenFull) {
+  SpanRing ring(4);
+  for (uint64_t i = 1; i <= 4; ++i) {
+    EXPECT_TRUE(ring.push(makeSpan(i)));
+  }
+  EXPECT_FALSE(ring.push(makeSpan(5)));
+  EXPECT_EQ(1, ring.dropped());
+
+  std::vector<Span> out;
+  ASSERT_EQ(4, ring.drain(out));
+  EXPECT_EQ(4, out.back().traceId);
+  EXPECT_TRUE(ring.push(makeSpan(6)));
+}
+
+TEST(SpanRing, concurrentConsumer) {
+  const uint64_t kSpans = 20000;
+  SpanRing ring(64);
+
+  std::thread producer([&ring, kSpans]() {
+    for (uint64_t i = 1; i <= kSpans; ++i) {
+      while (!ring.push(makeSpan(i))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::vector<Span> out;
+  uint64_t expected = 1;
+  while (expected <= kSpans) {
+    out.clear();
+    if (ring.drain(out) == 0) {
+      std::this_thread::yield();
+    }
+    for (const auto& span : out) {
+      ASSERT_EQ(expected, span.traceId);
+      ASSERT_EQ(expected + 1, span.endUs);
+      ++expected;
+    }
+  }
+  producer.join();
+}
+
+TEST(RequestTracer, sampling) {
+  RequestTracer tracer(4, 16);
+  std::vector<uint64_t> ids;
+  for (int i = 0; i < 12; ++i) {
+    auto id = tracer.sample();
+    if (id != 0) {
+      ids.push_back(id);
+    } else {
+      EXPECT_NE(3, i % 4);
+    }
+  }
+  ASSERT_EQ(3, ids.size());
+  EXPECT_NE(ids[0], ids[1]);
+  EXPECT_NE(ids[1], ids[2]);
+}
+
+TEST(RequestTracer, record) {
+  RequestTracer tracer(1, 16);
+  auto id = tracer.sample();
+  ASSERT_NE(0, id);
+
+  std::string longDetail(100, 'x');
+  tracer.record(id, SpanKind::kDestination, nullptr, longDetail, 10, 25);
+  tracer.record(id, SpanKind::kRequest, "name", "", 5, 30);
+
+  std::vector<Span> out;
+  ASSERT_EQ(2, tracer.ring().drain(out));
+  EXPECT_EQ(id, out[0].traceId);
+  EXPECT_EQ(SpanKind::kDestination, out[0].kind);
+  EXPECT_EQ(std::string(Span::kMaxDetailLength, 'x'), out[0].detail);
+  EXPECT_EQ(10, out[0].startUs);
+  EXPECT_EQ(25, out[0].endUs);
+  EXPECT_EQ(SpanKind::kRequest, out[1].kind);
+  EXPECT_STREQ("name", out[1].name);
+  EXPECT_STREQ("", out[1].detail);
+}
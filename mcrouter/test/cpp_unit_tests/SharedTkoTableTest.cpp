@@ -0,0 +1,129 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <folly/experimental/TestUtil.h>
+
+#include "mcrouter/SharedTkoTable.h"
+
+using facebook::memcache::mcrouter::SharedTkoTable;
+using folly::test::TemporaryFile;
+
+namespace {
+
+/**
+ * Runs f in a child process.
+ *
+ * @return exit status of the child
+ */
+template <class F>
+int inChild(F&& f) {
+  auto pid = fork();
+  if (pid == 0) {
+    _exit(f());
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WEXITSTATUS(status);
+}
+
+}  // anonymous namespace
+
+TEST(SharedTkoTable, sameEntry) {
+  TemporaryFile f("shared_tko_test");
+  auto a = SharedTkoTable::open(f.path().string());
+  ASSERT_TRUE(a != nullptr);
+
+  auto entry = a->entry("[127.0.0.1]:11211");
+  ASSERT_TRUE(static_cast<bool>(entry));
+  EXPECT_EQ(entry, a->entry("[127.0.0.1]:11211"));
+  EXPECT_NE(entry, a->entry("[127.0.0.1]:11212"));
+
+  entry.mark(true);
+  auto other = a->entry("[127.0.0.1]:11211");
+  EXPECT_TRUE(other.markedHere());
+  EXPECT_TRUE(other.isHard());
+  /* Our own TKO */
+  EXPECT_FALSE(other.markedElsewhere());
+
+  other.unmark();
+  EXPECT_FALSE(entry.markedHere());
+  EXPECT_FALSE(entry.isHard());
+}
+
+TEST(SharedTkoTable, otherProcess) {
+  TemporaryFile f("shared_tko_test");
+  auto table = SharedTkoTable::open(f.path().string());
+  ASSERT_TRUE(table != nullptr);
+  auto entry = table->entry("[127.0.0.1]:11211");
+  ASSERT_TRUE(static_cast<bool>(entry));
+
+  /* Live owner: the child sees the TKO and can't take it over or clear it */
+  entry.mark(false);
+  EXPECT_EQ(0, inChild([&]() {
+    auto child = SharedTkoTable::open(f.path().string());
+    auto e = child->entry("[127.0.0.1]:11211");
+    e.mark(true);
+    e.unmark();
+    return e.markedElsewhere() && !e.isHard() ? 0 : 1;
+  }));
+  EXPECT_TRUE(entry.markedHere());
+  entry.unmark();
+
+  /* The owner exited: its slot was released and the TKO is cleared */
+  EXPECT_EQ(0, inChild([&]() {
+    SharedTkoTable::open(f.path().string())->entry(
+      "[127.0.0.1]:11211").mark(true);
+    return 0;
+  }));
+  EXPECT_TRUE(entry.isHard());
+  EXPECT_FALSE(entry.markedElsewhere());
+  EXPECT_FALSE(entry.isHard());
+}
+
+TEST(SharedTkoTable, staleHeartbeat) {
+  TemporaryFile f("shared_tko_test");
+  auto table = SharedTkoTable::open(f.path().string(),
+                                    std::chrono::milliseconds(1));
+  ASSERT_TRUE(table != nullptr);
+  auto entry = table->entry("[127.0.0.1]:11211");
+  auto other = table->entry("[127.0.0.1]:11212");
+
+  /* The owner dies without releasing its slot */
+  EXPECT_EQ(0, inChild([&]() {
+    auto child = SharedTkoTable::open(f.path().string()).release();
+    child->entry("[127.0.0.1]:11211").mark(true);
+    child->entry("[127.0.0.1]:11212").mark(true);
+    return 0;
+  }));
+  EXPECT_TRUE(entry.markedElsewhere());
+
+  /* Until its heartbeat is older than the owner timeout */
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  table->heartbeat();
+  EXPECT_FALSE(entry.markedElsewhere());
+  EXPECT_FALSE(entry.isHard());
+
+  /* The stale slot is reused with a new generation, so the TKOs of the
+     previous process don't come back to life with the new heartbeat */
+  auto reused = SharedTkoTable::open(f.path().string(),
+                                     std::chrono::milliseconds(10));
+  ASSERT_TRUE(reused != nullptr);
+  EXPECT_TRUE(other.isHard());
+  EXPECT_FALSE(other.markedElsewhere());
+  EXPECT_FALSE(other.isHard());
+}
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/lib/ProfileStage.h"
+#include "mcrouter/StageProfiler.h"
+
+using facebook::memcache::ProfileStage;
+using facebook::memcache::ProfileStageScope;
+using facebook::memcache::threadProfileSlot;
+using facebook::memcache::mcrouter::ProfileRouteScope;
+using facebook::memcache::mcrouter::StageProfiler;
+
+namespace {
+
+const char kOuter[] = "Outer";
+const char kInner[] = "Inner";
+
+uint64_t samplesOf(const StageProfiler& profiler,
+                   std::vector<const char*> routes,
+                   ProfileStage stage) {
+  for (const auto& entry : profiler.entries()) {
+    if (entry.routes == routes && entry.stage == stage) {
+      return entry.samples;
+    }
+  }
+  return 0;
+}
+
+}  // anonymous namespace
+
+TEST(StageProfiler, routesAndStages) {
+  StageProfiler profiler;
+  threadProfileSlot() = &profiler.slot();
+
+  profiler.sample();
+  {
+    ProfileStageScope parse(ProfileStage::kParse);
+    profiler.sample();
+  }
+  {
+    ProfileRouteScope outer(&profiler, kOuter);
+    profiler.sample();
+    {
+      ProfileRouteScope inner(&profiler, kInner);
+      profiler.sample();
+      profiler.sample();
+      ProfileStageScope serialize(ProfileStage::kSerialize);
+      profiler.sample();
+    }
+    profiler.sample();
+  }
+  {
+    /* Same path again shares the node */
+    ProfileRouteScope outer(&profiler, kOuter);
+    ProfileRouteScope inner(&profiler, kInner);
+    profiler.sample();
+  }
+  profiler.sample();
+  threadProfileSlot() = nullptr;
+
+  EXPECT_EQ(2, samplesOf(profiler, {}, ProfileStage::kOther));
+  EXPECT_EQ(1, samplesOf(profiler, {}, ProfileStage::kParse));
+  EXPECT_EQ(2, samplesOf(profiler, {kOuter}, ProfileStage::kRoute));
+  EXPECT_EQ(3, samplesOf(profiler, {kOuter, kInner}, ProfileStage::kRoute));
+  EXPECT_EQ(1,
+            samplesOf(profiler, {kOuter, kInner}, ProfileStage::kSerialize));
+  EXPECT_EQ(5, profiler.entries().size());
+}
+
+TEST(StageProfiler, noProfiler) {
+  StageProfiler profiler;
+  {
+    /* Not registered for this thread */
+    ProfileStageScope parse(ProfileStage::kParse);
+    ProfileRouteScope route(nullptr, kOuter);
+    profiler.sample();
+  }
+  EXPECT_EQ(1, samplesOf(profiler, {}, ProfileStage::kOther));
+  EXPECT_EQ(1, profiler.entries().size());
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/stats.h"
+#include "mcrouter/StatsDelta.h"
+
+using namespace facebook::memcache::mcrouter;
+
+namespace {
+
+std::vector<stat_t> makeStats() {
+  std::vector<stat_t> stats(3);
+  stats[0].type = stat_uint64;
+  stats[0].data.uint64 = 1;
+  stats[1].type = stat_double;
+  stats[1].data.dbl = 0.5;
+  stats[2].type = stat_string;
+  stats[2].data.string = nullptr;
+  return stats;
+}
+
+}  // anonymous namespace
+
+TEST(StatsDelta, checkpoints) {
+  StatsDelta delta(3);
+  auto stats = makeStats();
+  std::vector<size_t> changed;
+
+  EXPECT_TRUE(delta.update(stats, changed));
+  EXPECT_EQ(std::vector<size_t>({0, 1}), changed);
+
+  EXPECT_FALSE(delta.update(stats, changed));
+  EXPECT_TRUE(changed.empty());
+  EXPECT_FALSE(delta.update(stats, changed));
+  EXPECT_TRUE(changed.empty());
+
+  /* Checkpoints report unchanged stats too */
+  EXPECT_TRUE(delta.update(stats, changed));
+  EXPECT_EQ(std::vector<size_t>({0, 1}), changed);
+}
+
+TEST(StatsDelta, onlyChanged) {
+  StatsDelta delta(100);
+  auto stats = makeStats();
+  std::vector<size_t> changed;
+  delta.update(stats, changed);
+
+  stats[0].data.uint64 = 2;
+  EXPECT_FALSE(delta.update(stats, changed));
+  EXPECT_EQ(std::vector<size_t>({0}), changed);
+
+  stats[1].data.dbl = 0.25;
+  EXPECT_FALSE(delta.update(stats, changed));
+  EXPECT_EQ(std::vector<size_t>({1}), changed);
+
+  EXPECT_FALSE(delta.update(stats, changed));
+  EXPECT_TRUE(changed.empty());
+}
+
+TEST(StatsDelta, sizeChange) {
+  StatsDelta delta(100);
+  auto stats = makeStats();
+  std::vector<size_t> changed;
+  delta.update(stats, changed);
+
+  stats.resize(1);
+  EXPECT_TRUE(delta.update(stats, changed));
+  EXPECT_EQ(std::vector<size_t>({0}), changed);
+}
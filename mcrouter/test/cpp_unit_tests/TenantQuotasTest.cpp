@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/TenantQuotas.h"
+
+using facebook::memcache::mcrouter::TenantQuotas;
+
+TEST(TenantQuotas, longestPrefix) {
+  TenantQuotas quotas("/a/b/:10:0:0,/a/b/batch:1:0:0,user:profile:0:0:5");
+  ASSERT_NE(nullptr, quotas.tenantOf("/a/b/key"));
+  EXPECT_EQ("/a/b/", quotas.tenantOf("/a/b/key")->prefix);
+  EXPECT_EQ("/a/b/batch", quotas.tenantOf("/a/b/batch1")->prefix);
+  EXPECT_EQ("user:profile", quotas.tenantOf("user:profile:1")->prefix);
+  EXPECT_EQ(5, quotas.tenantOf("user:profile:1")->maxInflight);
+  EXPECT_EQ(nullptr, quotas.tenantOf("/a/c/key"));
+}
+
+TEST(TenantQuotas, inflight) {
+  TenantQuotas quotas("t:0:0:2");
+  auto& tenant = *quotas.tenantOf("t1");
+  EXPECT_EQ(TenantQuotas::Verdict::kAdmitted, TenantQuotas::admit(tenant, 1));
+  EXPECT_EQ(TenantQuotas::Verdict::kAdmitted, TenantQuotas::admit(tenant, 1));
+  EXPECT_EQ(TenantQuotas::Verdict::kOverInflight,
+            TenantQuotas::admit(tenant, 1));
+  TenantQuotas::release(tenant);
+  EXPECT_EQ(TenantQuotas::Verdict::kAdmitted, TenantQuotas::admit(tenant, 1));
+  EXPECT_EQ(3, tenant.admitted.load());
+  EXPECT_EQ(1, tenant.overInflight.load());
+}
+
+TEST(TenantQuotas, rates) {
+  /* a second worth of burst, far more than the test takes to refill */
+  TenantQuotas quotas("r:2:0:0,b:0:100:1");
+  auto& requests = *quotas.tenantOf("r1");
+  EXPECT_EQ(TenantQuotas::Verdict::kAdmitted,
+            TenantQuotas::admit(requests, 1000));
+  EXPECT_EQ(TenantQuotas::Verdict::kAdmitted,
+            TenantQuotas::admit(requests, 1000));
+  EXPECT_EQ(TenantQuotas::Verdict::kOverRequests,
+            TenantQuotas::admit(requests, 1000));
+
+  auto& bytes = *quotas.tenantOf("b1");
+  EXPECT_EQ(TenantQuotas::Verdict::kAdmitted, TenantQuotas::admit(bytes, 60));
+  TenantQuotas::release(bytes);
+  EXPECT_EQ(TenantQuotas::Verdict::kOverBytes, TenantQuotas::admit(bytes, 60));
+  /* refused requests don't stay inflight */
+  EXPECT_EQ(0, bytes.inflight.load());
+}
+
+TEST(TenantQuotas, invalid) {
+  EXPECT_THROW(TenantQuotas("abc"), std::invalid_argument);
+  EXPECT_THROW(TenantQuotas("a:1:2"), std::invalid_argument);
+  EXPECT_THROW(TenantQuotas(":1:2:3"), std::invalid_argument);
+  EXPECT_THROW(TenantQuotas("a:x:0:0"), std::invalid_argument);
+  EXPECT_THROW(TenantQuotas("a:-1:0:0"), std::invalid_argument);
+  EXPECT_NO_THROW(TenantQuotas(""));
+}
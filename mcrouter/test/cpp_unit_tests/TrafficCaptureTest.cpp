@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/Conv.h>
+#include <folly/experimental/TestUtil.h>
+
+#include "mcrouter/lib/McMsgRef.h"
+#include "mcrouter/TrafficCapture.h"
+#include "mcrouter/TrafficCaptureFormat.h"
+#include "mcrouter/TrafficReplayer.h"
+
+using namespace facebook::memcache;
+using namespace facebook::memcache::mcrouter;
+
+using folly::test::TemporaryFile;
+
+namespace {
+
+McMsgRef testMsg(mc_op_t op, folly::StringPiece key, size_t valueSize = 0) {
+  auto msg = createMcMsgRef(key, std::string(valueSize, 'x'));
+  msg->op = op;
+  msg->flags = 17;
+  msg->exptime = 3600;
+  return McMsgRef(std::move(msg));
+}
+
+}  // anonymous namespace
+
+TEST(TrafficCaptureFormat, roundTrip) {
+  TrafficCaptureRecord in;
+  in.timestampUs = 1289416829836123;
+  in.op = mc_op_set;
+  in.valueSize = 1000;
+  in.flags = 0x100000001;
+  in.exptime = 60;
+  in.routingPrefix = "/region/cluster/";
+  in.key = "foo";
+
+  std::string data;
+  TrafficCaptureFormat::appendRecord(data, in);
+  in.op = mc_op_get;
+  in.key = "bar";
+  TrafficCaptureFormat::appendRecord(data, in);
+
+  folly::StringPiece range(data);
+  TrafficCaptureRecord out;
+  ASSERT_TRUE(TrafficCaptureFormat::parseRecord(range, out));
+  EXPECT_EQ(1289416829836123, out.timestampUs);
+  EXPECT_EQ(mc_op_set, out.op);
+  EXPECT_EQ(1000, out.valueSize);
+  EXPECT_EQ(0x100000001, out.flags);
+  EXPECT_EQ(60, out.exptime);
+  EXPECT_EQ("/region/cluster/", out.routingPrefix);
+  EXPECT_EQ("foo", out.key);
+  ASSERT_TRUE(TrafficCaptureFormat::parseRecord(range, out));
+  EXPECT_EQ(mc_op_get, out.op);
+  EXPECT_EQ("bar", out.key);
+  EXPECT_FALSE(TrafficCaptureFormat::parseRecord(range, out));
+}
+
+TEST(TrafficCaptureFormat, truncated) {
+  TrafficCaptureRecord in;
+  in.key = "foo";
+  std::string data;
+  TrafficCaptureFormat::appendRecord(data, in);
+  data.resize(data.size() - 1);
+
+  folly::StringPiece range(data);
+  TrafficCaptureRecord out;
+  EXPECT_THROW(TrafficCaptureFormat::parseRecord(range, out),
+               std::runtime_error);
+}
+
+TEST(TrafficCaptureFormat, longKeyIsTruncated) {
+  TrafficCaptureRecord in;
+  std::string key(1000, 'k');
+  in.key = key;
+  std::string data;
+  TrafficCaptureFormat::appendRecord(data, in);
+  EXPECT_LE(data.size(), TrafficCaptureFormat::kMaxRecordSize);
+
+  folly::StringPiece range(data);
+  TrafficCaptureRecord out;
+  ASSERT_TRUE(TrafficCaptureFormat::parseRecord(range, out));
+  EXPECT_EQ(255, out.key.size());
+}
+
+TEST(TrafficCapture, captureAndRead) {
+  TemporaryFile f("traffic_capture_test");
+  {
+    TrafficCapture capture(f.path().string(), 0, 1);
+    capture.add(testMsg(mc_op_set, "/a/b/foo", 100));
+    capture.add(testMsg(mc_op_get, "/a/b/foo"));
+    capture.add(testMsg(mc_op_delete, "bar"));
+    EXPECT_EQ(3, capture.records());
+  }
+
+  auto requests = TrafficReplayer::readCapture(f.path().string());
+  ASSERT_EQ(3, requests.size());
+  EXPECT_EQ(mc_op_set, requests[0].op);
+  EXPECT_EQ("/a/b/foo", requests[0].key);
+  EXPECT_EQ(100, requests[0].valueSize);
+  EXPECT_EQ(17, requests[0].flags);
+  EXPECT_EQ(3600, requests[0].exptime);
+  EXPECT_EQ(mc_op_get, requests[1].op);
+  EXPECT_EQ(0, requests[1].valueSize);
+  EXPECT_EQ(mc_op_delete, requests[2].op);
+  EXPECT_EQ("bar", requests[2].key);
+  EXPECT_LE(requests[0].timestampUs, requests[1].timestampUs);
+  EXPECT_LE(requests[1].timestampUs, requests[2].timestampUs);
+}
+
+TEST(TrafficCapture, ringKeepsNewest) {
+  TemporaryFile f("traffic_capture_test");
+  const size_t kRequests = 100000;
+  {
+    /* Smallest file: kNumSegments * kMinSegmentSize, ~1MB */
+    TrafficCapture capture(f.path().string(), 0, 1);
+    for (size_t i = 0; i < kRequests; ++i) {
+      capture.add(testMsg(mc_op_get, folly::to<std::string>("key:", i)));
+    }
+  }
+
+  auto requests = TrafficReplayer::readCapture(f.path().string());
+  ASSERT_FALSE(requests.empty());
+  ASSERT_LT(requests.size(), kRequests);
+  /* Whole segments were dropped from the front, the rest is in order */
+  auto first = kRequests - requests.size();
+  for (size_t i = 0; i < requests.size(); ++i) {
+    ASSERT_EQ(folly::to<std::string>("key:", first + i), requests[i].key);
+  }
+}
+
+TEST(TrafficCapture, sampledByKey) {
+  TemporaryFile f("traffic_capture_test");
+  {
+    TrafficCapture capture(f.path().string(), 0, 10);
+    for (size_t i = 0; i < 1000; ++i) {
+      auto key = folly::to<std::string>("key:", i);
+      capture.add(testMsg(mc_op_get, key));
+      capture.add(testMsg(mc_op_delete, key));
+    }
+    EXPECT_GT(capture.records(), 0);
+    EXPECT_LT(capture.records(), 500);
+  }
+
+  /* Both requests to every sampled key */
+  auto requests = TrafficReplayer::readCapture(f.path().string());
+  ASSERT_EQ(0, requests.size() % 2);
+  for (size_t i = 0; i < requests.size(); i += 2) {
+    EXPECT_EQ(mc_op_get, requests[i].op);
+    EXPECT_EQ(mc_op_delete, requests[i + 1].op);
+    EXPECT_EQ(requests[i].key, requests[i + 1].key);
+  }
+}
+
+TEST(TrafficCapture, badFile) {
+  TemporaryFile f("traffic_capture_test");
+  EXPECT_THROW(TrafficReplayer::readCapture(f.path().string()),
+               std::runtime_error);
+}
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <folly/dynamic.h>
+#include <folly/io/IOBuf.h>
+#include <folly/Memory.h>
+
+#include "mcrouter/lib/mc/msg.h"
+#include "mcrouter/routes/ValueCompressor.h"
+
+using facebook::memcache::mcrouter::ValueCompressor;
+
+namespace {
+
+std::unique_ptr<ValueCompressor> makeCompressor(const folly::dynamic& json) {
+  try {
+    return folly::make_unique<ValueCompressor>(json);
+  } catch (const std::logic_error& e) {
+    LOG(WARNING) << e.what() << ", skipping";
+    return nullptr;
+  }
+}
+
+std::string toString(const folly::IOBuf& buf) {
+  auto copy = buf.clone();
+  copy->coalesce();
+  return std::string(reinterpret_cast<const char*>(copy->data()),
+                     copy->length());
+}
+
+}  // anonymous namespace
+
+TEST(ValueCompressor, config) {
+  auto compressor = makeCompressor(
+    folly::dynamic::object("codec", "lz4")("threshold", 10));
+  if (!compressor) {
+    return;
+  }
+  EXPECT_EQ(ValueCompressor::Codec::LZ4, compressor->codec());
+  EXPECT_EQ(10, compressor->threshold());
+
+  EXPECT_THROW(ValueCompressor("gzip"), std::logic_error);
+  EXPECT_THROW(ValueCompressor(folly::dynamic::object("threshold", 10)),
+               std::logic_error);
+  EXPECT_THROW(
+    ValueCompressor(folly::dynamic::object("codec", "lz4")("threshold", -1)),
+    std::logic_error);
+}
+
+TEST(ValueCompressor, roundTrip) {
+  for (const char* codec : { "lz4", "zstd" }) {
+    auto compressor = makeCompressor(codec);
+    if (!compressor) {
+      continue;
+    }
+
+    /* Chained value */
+    auto value = folly::IOBuf::copyBuffer(std::string(1000, 'a'));
+    value->prependChain(folly::IOBuf::copyBuffer(std::string(1000, 'b')));
+    auto compressed = compressor->compress(*value);
+    ASSERT_TRUE(compressed.hasValue()) << codec;
+    EXPECT_LT(compressed->computeChainDataLength(), 2000);
+
+    auto flags = ValueCompressor::codecFlag(compressor->codec());
+    EXPECT_TRUE(ValueCompressor::isCompressed(flags));
+    EXPECT_EQ(compressor->codec(), ValueCompressor::flagsCodec(flags));
+    auto uncompressed = compressor->uncompress(*compressed, flags);
+    EXPECT_EQ(std::string(1000, 'a') + std::string(1000, 'b'),
+              toString(uncompressed));
+  }
+}
+
+TEST(ValueCompressor, incompressible) {
+  auto compressor = makeCompressor("lz4");
+  if (!compressor) {
+    return;
+  }
+  auto value = folly::IOBuf::copyBuffer("abc");
+  EXPECT_FALSE(compressor->compress(*value).hasValue());
+}
+
+TEST(ValueCompressor, corrupted) {
+  auto compressor = makeCompressor("lz4");
+  if (!compressor) {
+    return;
+  }
+  /* Truncated length */
+  auto value = folly::IOBuf::copyBuffer("\xff\xff");
+  EXPECT_ANY_THROW(
+    compressor->uncompress(*value, MC_MSG_FLAG_LZ4_COMPRESSED));
+  /* Length is too large */
+  value = folly::IOBuf::copyBuffer("\xff\xff\xff\xff\xff\xff\x01");
+  EXPECT_ANY_THROW(
+    compressor->uncompress(*value, MC_MSG_FLAG_LZ4_COMPRESSED));
+}
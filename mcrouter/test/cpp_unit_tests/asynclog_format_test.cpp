@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <folly/json.h>
+
+#include "mcrouter/AsynclogFormat.h"
+
+using facebook::memcache::mcrouter::AsynclogFormat;
+using facebook::memcache::mcrouter::AsynclogRecord;
+
+namespace {
+
+AsynclogRecord testRecord(folly::StringPiece key) {
+  AsynclogRecord record;
+  record.timestampMs = 1289416829836;
+  record.host = "10.0.0.1";
+  record.port = 11302;
+  record.pool = "pool_name";
+  record.key = key;
+  return record;
+}
+
+}  // anonymous namespace
+
+TEST(AsynclogFormat, binaryRoundTrip) {
+  std::string data;
+  AsynclogFormat::appendHeader(data, "flavor");
+  AsynclogFormat::appendRecord(data, testRecord("foo"));
+  AsynclogFormat::appendRecord(data, testRecord("bar"));
+  EXPECT_TRUE(AsynclogFormat::isBinary(data));
+
+  folly::StringPiece sp(data);
+  EXPECT_EQ("flavor", AsynclogFormat::parseHeader(sp));
+
+  AsynclogRecord record;
+  ASSERT_TRUE(AsynclogFormat::parseRecord(sp, record));
+  EXPECT_EQ(1289416829836, record.timestampMs);
+  EXPECT_EQ("10.0.0.1", record.host);
+  EXPECT_EQ(11302, record.port);
+  EXPECT_EQ("pool_name", record.pool);
+  EXPECT_EQ("foo", record.key);
+
+  ASSERT_TRUE(AsynclogFormat::parseRecord(sp, record));
+  EXPECT_EQ("bar", record.key);
+
+  EXPECT_FALSE(AsynclogFormat::parseRecord(sp, record));
+  EXPECT_TRUE(sp.empty());
+}
+
+TEST(AsynclogFormat, truncatedRecord) {
+  std::string data;
+  AsynclogFormat::appendRecord(data, testRecord("foo"));
+  auto fullSize = data.size();
+  AsynclogFormat::appendRecord(data, testRecord("bar"));
+  data.resize(data.size() - 1);
+
+  folly::StringPiece sp(data);
+  AsynclogRecord record;
+  ASSERT_TRUE(AsynclogFormat::parseRecord(sp, record));
+  EXPECT_EQ("foo", record.key);
+  EXPECT_FALSE(AsynclogFormat::parseRecord(sp, record));
+  EXPECT_EQ(fullSize - 1, sp.size());
+}
+
+TEST(AsynclogFormat, malformed) {
+  folly::StringPiece text("[\"AS1.0\", 1.0, \"C\", []]\n");
+  EXPECT_FALSE(AsynclogFormat::isBinary(text));
+  EXPECT_THROW(AsynclogFormat::parseHeader(text), std::runtime_error);
+
+  /* Record size covers the fields, but field sizes don't match */
+  std::string data;
+  AsynclogFormat::appendRecord(data, testRecord("foo"));
+  data[data.size() - 5] = 10;
+  folly::StringPiece sp(data);
+  AsynclogRecord record;
+  EXPECT_THROW(AsynclogFormat::parseRecord(sp, record), std::runtime_error);
+}
+
+TEST(AsynclogFormat, jsonLine) {
+  auto record = testRecord("foo");
+
+  auto v1 = AsynclogFormat::jsonLine(record, "flavor", false);
+  ASSERT_EQ('\n', v1.back());
+  auto json = folly::parseJson(v1);
+  EXPECT_EQ("AS1.0", json[0].asString());
+  EXPECT_DOUBLE_EQ(1289416829.836, json[1].asDouble());
+  EXPECT_EQ("C", json[2].asString());
+  EXPECT_EQ("10.0.0.1", json[3][0].asString());
+  EXPECT_EQ(11302, json[3][1].asInt());
+  EXPECT_EQ("delete foo\r\n", json[3][2].asString());
+
+  auto v2 = AsynclogFormat::jsonLine(record, "flavor", true);
+  json = folly::parseJson(v2);
+  EXPECT_EQ("AS2.0", json[0].asString());
+  EXPECT_EQ("flavor", json[3]["f"].asString());
+  EXPECT_EQ("[10.0.0.1]:11302", json[3]["h"].asString());
+  EXPECT_EQ("pool_name", json[3]["p"].asString());
+  EXPECT_EQ("foo", json[3]["k"].asString());
+}
@@ -12,6 +12,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <thread>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include <folly/experimental/TestUtil.h>
@@ -263,3 +266,43 @@ TEST(awriter, invalid_fd) {
 
   EXPECT_EQ(testCounter.failure, num_entries);
 }
+
+// Test that functions queued from several threads, before and after
+// the writer started, all run and in the order each thread queued them.
+TEST(awriter, order) {
+  const int num_threads = 4;
+  const int num_entries = 1000;
+  std::vector<std::vector<int>> seen(num_threads);
+  AtomicCounter done;
+
+  auto w = folly::make_unique<AsyncWriter>(0);
+  auto produce = [&](int t) {
+    for (int i = 0; i < num_entries; i++) {
+      EXPECT_TRUE(w->run([&seen, &done, t, i]() {
+        seen[t].push_back(i);
+        done.notify(1);
+      }));
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.emplace_back(produce, 0);
+  threads.back().join();
+  EXPECT_TRUE(w->start("awriter:test"));
+  for (int t = 1; t < num_threads; t++) {
+    threads.emplace_back(produce, t);
+  }
+  for (int t = 1; t < num_threads; t++) {
+    threads[t].join();
+  }
+
+  done.wait([](int v) { return v >= num_threads * num_entries; });
+  w->stop();
+
+  for (int t = 0; t < num_threads; t++) {
+    ASSERT_EQ(num_entries, seen[t].size());
+    for (int i = 0; i < num_entries; i++) {
+      EXPECT_EQ(i, seen[t][i]);
+    }
+  }
+}
@@ -11,13 +11,16 @@
 
 #include <gtest/gtest.h>
 
+#include <folly/dynamic.h>
 #include <folly/experimental/TestUtil.h>
 #include <folly/FileUtil.h>
 
 #include "mcrouter/ConfigApi.h"
+#include "mcrouter/lib/fbi/cpp/util.h"
 #include "mcrouter/options.h"
 
 using facebook::memcache::McrouterOptions;
+using facebook::memcache::Md5Hash;
 using facebook::memcache::mcrouter::ConfigApi;
 using facebook::memcache::mcrouter::ConfigType;
 using folly::test::TemporaryFile;
@@ -85,3 +88,26 @@ TEST(ConfigApi, file_change) {
 
   api.stopObserving(getpid());
 }
+
+TEST(ConfigApi, compressed_config_str) {
+  McrouterOptions opts;
+  ConfigApi api(opts);
+  EXPECT_FALSE(api.hasConfigStr());
+
+  std::string config = "{\"pools\": {";
+  for (int i = 0; i < 1000; ++i) {
+    config += "\"pool" + std::to_string(i) +
+      "\": {\"servers\": [\"localhost:5000\"]}, ";
+  }
+  config += "}}";
+
+  auto bytes = api.compressConfigStr(config);
+  EXPECT_TRUE(api.hasConfigStr());
+  EXPECT_LE(bytes, config.size());
+
+  std::string buf;
+  EXPECT_TRUE(api.getConfigFile(buf));
+  EXPECT_EQ(config, buf);
+  EXPECT_EQ(Md5Hash(config),
+            api.getConfigSourcesInfo()["mcrouter_config"].asString());
+}
@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <string>
+#include <unordered_map>
+
+#include <gtest/gtest.h>
+
+#include <folly/experimental/TestUtil.h>
+#include <folly/json.h>
+
+#include "mcrouter/ConfigSnapshot.h"
+#include "mcrouter/lib/config/ImportResolverIf.h"
+
+using facebook::memcache::ImportResolverIf;
+using facebook::memcache::mcrouter::ConfigSnapshot;
+using folly::dynamic;
+using folly::test::TemporaryDirectory;
+
+namespace {
+
+class MapImportResolver : public ImportResolverIf {
+ public:
+  std::unordered_map<std::string, std::string> files;
+
+  std::string import(folly::StringPiece path) override {
+    auto it = files.find(path.str());
+    if (it == files.end()) {
+      throw std::runtime_error("Can not read " + path.str());
+    }
+    return it->second;
+  }
+};
+
+}  // anonymous namespace
+
+TEST(ConfigSnapshot, serialize) {
+  auto json = folly::parseJson(R"({
+    "a": [ null, true, false, 0, -1, 1, 300, -300, 1.5, "" ],
+    "b": { "c": "d", "e": [ [], {} ] },
+    "f": 9223372036854775807,
+    "g": -9223372036854775807
+  })");
+  auto data = ConfigSnapshot::serialize(json);
+  folly::StringPiece sp(data);
+  EXPECT_EQ(json, ConfigSnapshot::deserialize(sp));
+  EXPECT_TRUE(sp.empty());
+
+  folly::StringPiece truncated(data.data(), data.size() - 1);
+  EXPECT_THROW(ConfigSnapshot::deserialize(truncated), std::runtime_error);
+}
+
+TEST(ConfigSnapshot, loadSave) {
+  TemporaryDirectory dir("config_snapshot_test");
+  auto path = (dir.path() / "snapshot").string();
+  std::unordered_map<std::string, dynamic> globals = { { "g", "value" } };
+  auto config = folly::parseJson(R"({ "route": "PoolRoute|A" })");
+
+  MapImportResolver resolver;
+  resolver.files["imported"] = "{}";
+
+  ConfigSnapshot snapshot(path, "config", globals);
+  EXPECT_FALSE(snapshot.load(resolver).hasValue());
+
+  ConfigSnapshot::RecordingImportResolver recorder(resolver);
+  recorder.import("imported");
+  EXPECT_TRUE(snapshot.save(config, recorder.imports()));
+
+  auto loaded = snapshot.load(resolver);
+  ASSERT_TRUE(loaded.hasValue());
+  EXPECT_EQ(config, *loaded);
+
+  // any change of inputs invalidates the snapshot
+  EXPECT_FALSE(ConfigSnapshot(path, "config2", globals)
+                 .load(resolver).hasValue());
+  EXPECT_FALSE(ConfigSnapshot(path, "config", { { "g", "other" } })
+                 .load(resolver).hasValue());
+  resolver.files["imported"] = "{ }";
+  EXPECT_FALSE(snapshot.load(resolver).hasValue());
+  resolver.files.clear();
+  EXPECT_FALSE(snapshot.load(resolver).hasValue());
+}
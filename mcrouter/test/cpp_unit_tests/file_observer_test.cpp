@@ -37,7 +37,7 @@ TEST(FileObserver, sanity) {
 
   PeriodicTaskScheduler ts;
   int counter = 0;
-  FileObserver::startObserving(path, ts, 100, 500,
+  FileObserver::startObserving(path, ts, 500,
                                [&counter, &cv] (std::string) {
                                   counter++;
                                   cv.notify_all();
@@ -64,17 +64,52 @@ TEST(FileObserver, sanity) {
   ts.shutdownAllTasks();
 }
 
+TEST(FileObserver, same_contents) {
+  folly::test::TemporaryFile config("file_observer_test");
+  std::string path(config.path().string());
+  std::mutex mut;
+  std::condition_variable cv;
+
+  ASSERT_TRUE(folly::writeFile(std::string("a"), path.data()));
+
+  PeriodicTaskScheduler ts;
+  int counter = 0;
+  FileObserver::startObserving(path, ts, 100,
+                               [&counter, &cv] (std::string) {
+                                  counter++;
+                                  cv.notify_all();
+                               });
+  EXPECT_EQ(counter, 1);
+
+  /* Rewriting the same contents doesn't trigger an update */
+  ASSERT_TRUE(folly::writeFile(std::string("a"), path.data()));
+  {
+    std::unique_lock<std::mutex> lock(mut);
+    cv.wait_for(lock, std::chrono::seconds(1));
+  }
+  EXPECT_EQ(counter, 1);
+
+  ASSERT_TRUE(folly::writeFile(std::string("b"), path.data()));
+  {
+    std::unique_lock<std::mutex> lock(mut);
+    cv.wait_for(lock, std::chrono::seconds(5));
+  }
+  EXPECT_EQ(counter, 2);
+
+  ts.shutdownAllTasks();
+}
+
 TEST(FileObserver, on_error_callback) {
   PeriodicTaskScheduler ts;
   int successCounter1 = 0, errorCounter1 = 0;
   FileObserver::startObserving(
-    BOGUS_CONFIG, ts, 100, 500,
+    BOGUS_CONFIG, ts, 500,
     [&successCounter1] (std::string) { successCounter1++; },
     [&errorCounter1] () { errorCounter1++; });
 
   int successCounter2 = 0, errorCounter2 = 0;
   FileObserver::startObserving(
-    "", ts, 100, 500,
+    "", ts, 500,
     [&successCounter2] (std::string) { successCounter2++; },
     [&errorCounter2] () { errorCounter2++; });
 
@@ -10,6 +10,8 @@
 #include <stdio.h>
 
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include <gflags/gflags.h>
 #include <gtest/gtest.h>
@@ -23,6 +25,7 @@
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/ProxyThread.h"
+#include "mcrouter/stats.h"
 #include "mcrouter/lib/network/test/TestUtil.h"
 #include "mcrouter/test/cpp_unit_tests/mcrouter_test_client.h"
 #include "mcrouter/test/cpp_unit_tests/MemcacheLocal.h"
@@ -31,6 +34,8 @@ using namespace facebook::memcache::mcrouter;
 using namespace facebook::memcache::test;
 using namespace folly;
 
+using facebook::memcache::McReply;
+using facebook::memcache::McRequest;
 using facebook::memcache::McrouterOptions;
 
 /*
@@ -201,6 +206,244 @@ TEST(libmcrouter, premature_disconnect) {
   }
 }
 
+namespace {
+
+struct SameThreadState {
+  std::thread::id threadId;
+  int replies{0};
+  bool wrongThread{false};
+};
+
+void on_same_thread_reply(mcrouter_msg_t* router_req, void* context) {
+  auto& state = *reinterpret_cast<SameThreadState*>(context);
+  if (std::this_thread::get_id() != state.threadId) {
+    state.wrongThread = true;
+  }
+  ++state.replies;
+}
+
+}  // anonymous namespace
+
+TEST(libmcrouter, same_thread) {
+  auto opts = defaultTestOptions();
+  opts.config_str = configString;
+  opts.num_proxies = 1;
+
+  /* Must outlive the instance, which is destroyed at exit */
+  auto& evb = *new folly::EventBase();
+  auto router = McrouterInstance::init("test_same_thread", opts, {&evb});
+  ASSERT_TRUE(router != nullptr);
+
+  SameThreadState state;
+  state.threadId = std::this_thread::get_id();
+  auto client = router->createSameThreadClient(
+    {on_same_thread_reply, nullptr, nullptr}, &state, 0);
+  EXPECT_EQ(&evb, client->getBase());
+
+  const char key[] = "same_thread_key";
+  mc_msg_t* mc_msg = mc_msg_new(sizeof(key));
+  mc_msg->key.str = (char*) &mc_msg[1];
+  strcpy(mc_msg->key.str, key);
+  mc_msg->key.len = strlen(key);
+  mc_msg->op = mc_op_get;
+  mcrouter_msg_t router_msg;
+  router_msg.req = mc_msg;
+  EXPECT_EQ(1, client->send(&router_msg, 1));
+  mc_msg_decref(mc_msg);
+
+  for (size_t i = 0; state.replies == 0 && i < 1000; ++i) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(1, state.replies);
+  EXPECT_FALSE(state.wrongThread);
+
+  /* Other threads can't create same-thread clients */
+  std::thread([router]() {
+    EXPECT_THROW(router->createSameThreadClient(
+                   {on_same_thread_reply, nullptr, nullptr}, nullptr, 0),
+                 std::runtime_error);
+  }).join();
+
+  /* Let the proxy process the disconnect */
+  client.reset();
+  for (size_t i = 0; i < 10; ++i) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+  }
+}
+
+TEST(libmcrouter, send_mc_request) {
+  auto opts = defaultTestOptions();
+  opts.config_str = configString;
+  opts.num_proxies = 1;
+
+  /* Must outlive the instance, which is destroyed at exit */
+  auto& evb = *new folly::EventBase();
+  auto router = McrouterInstance::init("test_send_mc_request", opts, {&evb});
+  ASSERT_TRUE(router != nullptr);
+
+  int onReplyCalls = 0;
+  auto client = router->createSameThreadClient(
+    {[](mcrouter_msg_t*, void* context) {
+        ++*reinterpret_cast<int*>(context);
+      }, nullptr, nullptr},
+    &onReplyCalls, 0);
+
+  int replies = 0;
+  mc_res_t result = mc_res_unknown;
+  EXPECT_TRUE(client->send(McRequest("send_mc_request_key"), mc_op_get,
+                           [&](McReply&& reply) {
+                             ++replies;
+                             result = reply.result();
+                           }));
+
+  for (size_t i = 0; replies == 0 && i < 1000; ++i) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(1, replies);
+  EXPECT_NE(mc_res_unknown, result);
+  /* The callback gets the reply instead of on_reply */
+  EXPECT_EQ(0, onReplyCalls);
+  EXPECT_EQ(1, client->peekStats()["get_count"]);
+
+  client.reset();
+  for (size_t i = 0; i < 10; ++i) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+  }
+}
+
+TEST(libmcrouter, negative_cache_stats) {
+  auto opts = defaultTestOptions();
+  opts.config_str =
+    R"({"route": {"type": "NegativeCacheRoute", "target": "NullRoute"}})";
+  opts.num_proxies = 1;
+
+  /* Must outlive the instance, which is destroyed at exit */
+  auto& evb = *new folly::EventBase();
+  auto router = McrouterInstance::init("test_negative_cache_stats", opts,
+                                       {&evb});
+  ASSERT_TRUE(router != nullptr);
+
+  auto client = router->createSameThreadClient(
+    {[](mcrouter_msg_t*, void*) {}, nullptr, nullptr}, nullptr, 0);
+
+  /* The first miss is remembered, the second get is a hit */
+  int replies = 0;
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_TRUE(client->send(McRequest("negative_cache_key"), mc_op_get,
+                             [&](McReply&&) { ++replies; }));
+    for (size_t j = 0; replies == i && j < 1000; ++j) {
+      evb.loopOnce(EVLOOP_NONBLOCK);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  EXPECT_EQ(2, replies);
+  /* Counted by the proxy overload of negativeCacheEvent(), found by ADL */
+  EXPECT_EQ(1, stat_get_uint64(router->getProxy(0)->stats,
+                               negative_cache_hits_stat));
+
+  client.reset();
+  for (size_t i = 0; i < 10; ++i) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+  }
+}
+
+TEST(libmcrouter, share_destinations) {
+  auto opts = defaultTestOptions();
+  opts.config_str = configString;
+  opts.num_proxies = 1;
+  opts.share_destinations_across_instances = true;
+
+  /* Must outlive the instances, which are destroyed at exit */
+  auto& evb = *new folly::EventBase();
+  auto router1 = McrouterInstance::init("test_share_destinations1", opts,
+                                        {&evb});
+  ASSERT_TRUE(router1 != nullptr);
+  auto router2 = McrouterInstance::init("test_share_destinations2", opts,
+                                        {&evb});
+  ASSERT_TRUE(router2 != nullptr);
+
+  /* The destination is created (and owned) by the first instance only */
+  EXPECT_EQ(1, stat_get_uint64(router1->getProxy(0)->stats,
+                               num_servers_new_stat));
+  EXPECT_EQ(0, stat_get_uint64(router2->getProxy(0)->stats,
+                               num_servers_new_stat));
+
+  SameThreadState state;
+  state.threadId = std::this_thread::get_id();
+  auto client = router2->createSameThreadClient(
+    {on_same_thread_reply, nullptr, nullptr}, &state, 0);
+
+  const char key[] = "share_destinations_key";
+  mc_msg_t* mc_msg = mc_msg_new(sizeof(key));
+  mc_msg->key.str = (char*) &mc_msg[1];
+  strcpy(mc_msg->key.str, key);
+  mc_msg->key.len = strlen(key);
+  mc_msg->op = mc_op_get;
+  mcrouter_msg_t router_msg;
+  router_msg.req = mc_msg;
+  EXPECT_EQ(1, client->send(&router_msg, 1));
+  mc_msg_decref(mc_msg);
+
+  for (size_t i = 0; state.replies == 0 && i < 1000; ++i) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(1, state.replies);
+  EXPECT_EQ(1, stat_get_uint64(router1->getProxy(0)->stats,
+                               num_servers_up_stat));
+
+  client.reset();
+  for (size_t i = 0; i < 10; ++i) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+  }
+}
+
+TEST(libmcrouter, resize_proxies) {
+  auto opts = defaultTestOptions();
+  opts.config_str = configString;
+  opts.num_proxies = 1;
+  opts.max_proxies = 3;
+
+  auto router = McrouterInstance::init("test_resize_proxies", opts);
+  ASSERT_TRUE(router != nullptr);
+  EXPECT_EQ(1, router->numProxies());
+
+  EXPECT_FALSE(router->resizeProxies(0));
+  EXPECT_FALSE(router->resizeProxies(4));
+  ASSERT_TRUE(router->resizeProxies(3));
+  EXPECT_EQ(3, router->numProxies());
+  EXPECT_EQ(3, router->numActiveProxies());
+  for (size_t i = 0; i < 3; ++i) {
+    /* new proxies start with the current config */
+    ASSERT_TRUE(router->getProxy(i) != nullptr);
+    EXPECT_TRUE(router->getProxy(i)->getConfig() != nullptr);
+  }
+  EXPECT_TRUE(router->getProxy(3) == nullptr);
+
+  /* round robin moved on to the proxies drained below */
+  std::vector<McrouterClient::Pointer> clients;
+  for (size_t i = 0; i < 2; ++i) {
+    clients.push_back(router->createClient({on_reply, nullptr, nullptr},
+                                           nullptr, 0));
+  }
+
+  /* drained proxies keep running and stay configured */
+  ASSERT_TRUE(router->resizeProxies(1));
+  EXPECT_EQ(3, router->numProxies());
+  EXPECT_EQ(1, router->numActiveProxies());
+  clients.push_back(router->createClient({on_reply, nullptr, nullptr},
+                                         nullptr, 0));
+  EXPECT_TRUE(router->getProxy(2)->getConfig() != nullptr);
+
+  /* and are the first ones reactivated */
+  ASSERT_TRUE(router->resizeProxies(2));
+  EXPECT_EQ(3, router->numProxies());
+  EXPECT_EQ(2, router->numActiveProxies());
+  clients.clear();
+}
+
 TEST(libmcrouter, invalid_pools) {
   auto opts = defaultTestOptions();
   std::string configStr;
@@ -8,20 +8,28 @@
  *
  */
 #include <string>
+#include <vector>
 
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include <folly/Conv.h>
 #include <folly/io/async/EventBase.h>
 #include <folly/json.h>
 #include <folly/Memory.h>
 
+#include "mcrouter/ClientPool.h"
 #include "mcrouter/lib/config/RouteHandleFactory.h"
+#include "mcrouter/lib/McOperation.h"
+#include "mcrouter/lib/McRequest.h"
 #include "mcrouter/McrouterInstance.h"
 #include "mcrouter/options.h"
 #include "mcrouter/PoolFactory.h"
+#include "mcrouter/ProxyClientCommon.h"
 #include "mcrouter/proxy.h"
 #include "mcrouter/routes/McRouteHandleProvider.h"
+#include "mcrouter/routes/ShardSplitter.h"
+#include "mcrouter/SharedConfigObjects.h"
 #include "mcrouter/test/cpp_unit_tests/mcrouter_cpp_tests.h"
 
 using namespace facebook::memcache;
@@ -48,6 +56,12 @@ static const std::string kPoolRoute =
    "hash": { "hash_func": "Crc32" }
  })";
 
+static const std::string kLazyRoute =
+ R"({
+   "type": "LazyRoute",
+   "target": "NullRoute"
+ })";
+
 static std::shared_ptr<McrouterRouteHandleIf>
 getRoute(const folly::dynamic& d) {
   McrouterOptions opts = defaultTestOptions();
@@ -56,7 +70,9 @@ getRoute(const folly::dynamic& d) {
   auto router = McrouterInstance::init("test_get_route", opts);
   auto proxy = folly::make_unique<proxy_t>(router, &eventBase, opts);
   PoolFactory pf(folly::dynamic::object(), router->configApi(), opts);
-  McRouteHandleProvider provider(proxy.get(), *proxy->destinationMap, pf);
+  SharedConfigObjects sharedObjects;
+  McRouteHandleProvider provider(proxy.get(), *proxy->destinationMap, pf,
+                                 sharedObjects);
   RouteHandleFactory<McrouterRouteHandleIf> factory(provider);
   auto res = factory.create(d);
 
@@ -94,3 +110,143 @@ TEST(McRouteHandleProvider, pool_route) {
   EXPECT_TRUE(rh != nullptr);
   EXPECT_EQ(rh->routeName(), "asynclog:mock");
 }
+
+TEST(McRouteHandleProvider, lazy_route) {
+  McrouterOptions opts = defaultTestOptions();
+  opts.config_file = kMemcacheConfig;
+  folly::EventBase eventBase;
+  auto router = McrouterInstance::init("test_lazy_route", opts);
+  auto proxy = folly::make_unique<proxy_t>(router, &eventBase, opts);
+  PoolFactory pf(folly::dynamic::object(), router->configApi(), opts);
+  SharedConfigObjects sharedObjects;
+  McRouteHandleProvider provider(proxy.get(), *proxy->destinationMap, pf,
+                                 sharedObjects);
+  RouteHandleFactory<McrouterRouteHandleIf> factory(provider);
+  auto rh = factory.create(parseJsonString(kLazyRoute));
+  auto rh2 = factory.create(parseJsonString(kLazyRoute));
+  auto lazySubtrees = provider.releaseLazySubtrees(factory);
+  ASSERT_TRUE(lazySubtrees != nullptr);
+  EXPECT_EQ("lazy", rh->routeName());
+
+  McRequest req("key");
+  EXPECT_TRUE(rh->couldRouteTo(req, McOperation<mc_op_get>()).empty());
+  auto reply = rh->route(req, McOperation<mc_op_get>());
+  EXPECT_EQ(mc_res_notfound, reply.result());
+  auto targets = rh->couldRouteTo(req, McOperation<mc_op_get>());
+  ASSERT_EQ(1, targets.size());
+  EXPECT_EQ("null", targets[0]->routeName());
+
+  /* targets can't be built once the config is gone */
+  lazySubtrees.reset();
+  EXPECT_TRUE(rh2->route(req, McOperation<mc_op_get>()).isError());
+
+  // should be disposed before event_base
+  proxy.reset();
+}
+
+TEST(PoolFactory, parallelBuild) {
+  McrouterOptions opts = defaultTestOptions();
+  opts.config_file = kMemcacheConfig;
+  auto router = McrouterInstance::init("test_pool_factory", opts);
+
+  folly::dynamic pools = folly::dynamic::object;
+  for (int p = 0; p < 50; ++p) {
+    folly::dynamic servers = {};
+    for (int h = 0; h < 3; ++h) {
+      servers.push_back(folly::to<std::string>("127.0.0.1:", p * 3 + h + 1));
+    }
+    pools[folly::to<std::string>("pool", p)] =
+      folly::dynamic::object("servers", std::move(servers));
+  }
+  auto config = folly::dynamic::object("pools", pools);
+
+  auto clients = [](const PoolFactory& factory) {
+    std::vector<std::string> aps;
+    for (const auto& client : factory.clients()) {
+      aps.push_back(client->ap.toString());
+    }
+    return aps;
+  };
+  PoolFactory sequential(config, router->configApi(), opts);
+  opts.config_pool_threads = 4;
+  PoolFactory parallel(config, router->configApi(), opts);
+  EXPECT_EQ(150, parallel.clients().size());
+  EXPECT_EQ(clients(sequential), clients(parallel));
+  EXPECT_EQ(3, parallel.findPool("pool7")->getClients().size());
+
+  /* the error is the one of the first invalid pool, as without threads */
+  config["pools"]["pool3"] = folly::dynamic::object("servers", 1);
+  config["pools"]["pool42"] = folly::dynamic::object("servers", 2);
+  std::string expected;
+  opts.config_pool_threads = 1;
+  try {
+    PoolFactory factory(config, router->configApi(), opts);
+  } catch (const std::logic_error& e) {
+    expected = e.what();
+  }
+  ASSERT_FALSE(expected.empty());
+  opts.config_pool_threads = 4;
+  for (int i = 0; i < 10; ++i) {
+    try {
+      PoolFactory factory(config, router->configApi(), opts);
+      FAIL() << "No exception thrown";
+    } catch (const std::logic_error& e) {
+      EXPECT_EQ(expected, e.what());
+    }
+  }
+}
+
+TEST(PoolFactory, sharedSettingsAndKeys) {
+  McrouterOptions opts = defaultTestOptions();
+  opts.config_file = kMemcacheConfig;
+  auto router = McrouterInstance::init("test_pool_factory", opts);
+
+  auto config = parseJsonString(R"({
+    "pools": {
+      "A": { "servers": [ "127.0.0.1:1", "127.0.0.1:2" ],
+             "server_timeout": 123 },
+      "B": { "servers": [ "127.0.0.1:1" ] }
+    }
+  })");
+  PoolFactory factory(config, router->configApi(), opts);
+  auto a = factory.findPool("A");
+  auto b = factory.findPool("B");
+  ASSERT_EQ(2, a->getClients().size());
+  ASSERT_EQ(1, b->getClients().size());
+
+  const auto& a0 = *a->getClients()[0];
+  const auto& a1 = *a->getClients()[1];
+  const auto& b0 = *b->getClients()[0];
+  EXPECT_EQ(&a->getSettings(), &a0.settings);
+  EXPECT_EQ(&a0.settings, &a1.settings);
+  EXPECT_EQ(123, a1.settings.server_timeout.count());
+  EXPECT_EQ(1, a1.indexInPool);
+
+  /* same host and port, different timeouts */
+  EXPECT_EQ(&a0.destination_key, &b0.destination_key);
+  EXPECT_EQ(&a0.proxyDestinationKey(false), &b0.proxyDestinationKey(false));
+  EXPECT_NE(a0.proxyDestinationKey(true), b0.proxyDestinationKey(true));
+  EXPECT_NE(a0.destination_key, a1.destination_key);
+
+  EXPECT_GT(factory.clientBytesSaved(), 0);
+  EXPECT_GT(ProxyClientCommon::internedKeyBytes(), 0);
+}
+
+TEST(SharedConfigObjectsTest, sanity) {
+  SharedConfigObjects objects;
+  auto get = [&objects](const folly::dynamic& json) {
+    return objects.get<const ShardSplitter>(json, [&json]() {
+      return std::make_shared<const ShardSplitter>(json);
+    });
+  };
+
+  auto splitter1 = get(parseJsonString(R"({"a": 2, "b": 3})"));
+  auto splitter2 = get(parseJsonString(R"({"b": 3, "a": 2})"));
+  auto splitter3 = get(parseJsonString(R"({"a": 2, "b": 4})"));
+  EXPECT_EQ(splitter1, splitter2);
+  EXPECT_NE(splitter1, splitter3);
+
+  auto it = splitter3->getShardSplits().find("b");
+  ASSERT_TRUE(it != splitter3->getShardSplits().end());
+  EXPECT_EQ(4, it->second);
+}
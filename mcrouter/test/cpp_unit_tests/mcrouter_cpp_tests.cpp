@@ -172,6 +172,51 @@ TEST(mcrouter, disconnect_callback) {
   EXPECT_EQ(0, sem_wait(&sem_disconnect));
 }
 
+TEST(mcrouter, try_send_credits) {
+  auto opts = defaultTestOptions();
+  opts.config_str = R"({"route": "NullRoute"})";
+  auto router = McrouterInstance::init("test_try_send_credits", opts);
+  ASSERT_FALSE(router == nullptr);
+
+  std::atomic<size_t> sendReady{0};
+  auto client = router->createClient(
+    (mcrouter_client_callbacks_t){on_reply, nullptr, nullptr},
+    nullptr,
+    2);
+  client->setSendReadyCallback([&sendReady]() {
+    ++sendReady;
+    gCv.notify_one();
+  });
+
+  auto msg = new_get_req("test_key_try_send");
+  vector<mcrouter_msg_t> reqs(5);
+  for (auto& req : reqs) {
+    req.req = const_cast<mc_msg_t*>(msg.get());
+    req.reply = McReply(mc_res_unknown);
+    req.context = &req;
+  }
+
+  gReplies = 0;
+  /* Only two fit under the limit */
+  size_t sent = client->trySend(reqs.data(), reqs.size());
+  EXPECT_EQ(2, sent);
+  while (sent < reqs.size()) {
+    std::unique_lock<std::mutex> lk(gMutex);
+    gCv.wait(lk, [&sendReady]() { return sendReady > 0; });
+    --sendReady;
+    lk.unlock();
+    auto n = client->trySend(reqs.data() + sent, reqs.size() - sent);
+    EXPECT_LE(n, 2);
+    sent += n;
+  }
+
+  std::unique_lock<std::mutex> lk(gMutex);
+  gCv.wait(lk, []() { return gReplies == 5; });
+  for (const auto& req : reqs) {
+    EXPECT_EQ(mc_res_notfound, req.reply.result());
+  }
+}
+
 TEST(mcrouter, fork) {
   const char persistence_id[] = "fork";
   auto opts = defaultTestOptions();
@@ -0,0 +1,30 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mcrouter/ThreadUtil.h"
+
+using facebook::memcache::mcrouter::parseCpuList;
+
+TEST(ThreadUtil, parseCpuList) {
+  EXPECT_EQ(std::vector<int>(), parseCpuList(""));
+  EXPECT_EQ(std::vector<int>({ 3 }), parseCpuList("3\n"));
+  EXPECT_EQ(std::vector<int>({ 0, 1, 2, 3, 8, 10, 11 }),
+            parseCpuList("0-3,8,10-11"));
+  // sorted and deduplicated
+  EXPECT_EQ(std::vector<int>({ 1, 2, 3 }), parseCpuList("3, 1-2, 2"));
+
+  EXPECT_THROW(parseCpuList("a"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("3-1"), std::invalid_argument);
+  EXPECT_THROW(parseCpuList("-1"), std::invalid_argument);
+}
@@ -0,0 +1,220 @@
+# Copyright (c) 2015, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+"""
+A/B comparison of two mcrouter binaries under the same load.
+
+    python -m mcrouter.test.loadgen_ab --binary-a OLD --binary-b NEW \\
+        [--config CONFIG] [--runs N] [--max-regression-pct P] \\
+        [-- LOADGEN_ARGS...]
+
+Starts a mock_mc_server in benchmark mode and both mcrouters with the same
+config (every distinct port in CONFIG is replaced by the mock server), then
+runs mcrouter_loadgen against A and B in turns (ABBA order, to cancel out
+drift of the machine), a fresh mcrouter for every run.
+
+Every run gives throughput, CPU per request (ps_user_time_sec and
+ps_system_time_sec of mcrouter over the requests it got) and latency
+percentiles. They are compared by Welch's t-test: the JSON report on stdout
+has per binary means and, per metric, the mean change of B relative to A
+with its 95% confidence interval. A metric regressed if the whole interval
+is worse than --max-regression-pct, in which case the exit code is 1.
+"""
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import argparse
+import json
+import math
+import subprocess
+import sys
+
+from mcrouter.test.config import McrouterGlobals
+from mcrouter.test.MCProcess import Memcached, Mcrouter
+
+DEFAULT_CONFIG = 'mcrouter/test/mcrouter_test_basic_1_1_1.json'
+
+# Metric name -> True if higher is better
+METRICS = [
+    ('qps', True),
+    ('cpu_us_per_request', False),
+    ('latency_p50_us', False),
+    ('latency_p90_us', False),
+    ('latency_p99_us', False),
+    ('latency_p999_us', False),
+]
+
+# Two-sided 95% critical values of Student's t by degrees of freedom
+T_95 = [
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+]
+
+
+def t_95(df):
+    if df < 1:
+        return float('inf')
+    if df > len(T_95):
+        return 1.96
+    return T_95[int(math.floor(df)) - 1]
+
+
+def mean_and_variance(samples):
+    mean = sum(samples) / len(samples)
+    if len(samples) < 2:
+        return mean, 0.0
+    var = sum((x - mean) ** 2 for x in samples) / (len(samples) - 1)
+    return mean, var
+
+
+def compare(a, b, higher_is_better, max_regression_pct):
+    """
+    Welch's t-test of the difference of means b - a, as percent of a.
+    """
+    mean_a, var_a = mean_and_variance(a)
+    mean_b, var_b = mean_and_variance(b)
+    se2_a = var_a / len(a)
+    se2_b = var_b / len(b)
+    se = math.sqrt(se2_a + se2_b)
+    if se > 0:
+        # Welch-Satterthwaite; a non-zero variance implies 2+ samples
+        df = (se2_a + se2_b) ** 2 / (
+            (se2_a ** 2 / (len(a) - 1) if se2_a else 0) +
+            (se2_b ** 2 / (len(b) - 1) if se2_b else 0))
+    else:
+        df = float('inf')
+    half_width = t_95(df) * se
+    delta = mean_b - mean_a
+    scale = 100.0 / mean_a if mean_a else 0.0
+
+    low = (delta - half_width) * scale
+    high = (delta + half_width) * scale
+    # Positive "worse" is a regression, whatever the direction of the metric
+    if higher_is_better:
+        worse_low = -high
+    else:
+        worse_low = low
+    return {
+        'a_mean': mean_a,
+        'b_mean': mean_b,
+        'delta_pct': delta * scale,
+        'ci_95_pct': [low, high],
+        'significant': low > 0 or high < 0,
+        'regression': worse_low > max_regression_pct,
+    }
+
+
+class Run(object):
+    def __init__(self, binary, config, mock_port, extra_args):
+        self.mcrouter = Mcrouter(config, binary=binary, extra_args=extra_args,
+                                 substitute_config_ports=[mock_port])
+        self.mcrouter.ensure_connected()
+
+    def cpu_and_requests(self):
+        stats = self.mcrouter.stats('all')
+        cpu = (float(stats['ps_user_time_sec']) +
+               float(stats['ps_system_time_sec']))
+        requests = sum(int(stats.get(name, 0)) for name in
+                       ('cmd_get_count', 'cmd_set_count',
+                        'cmd_delete_count'))
+        return cpu, requests
+
+    def measure(self, loadgen, loadgen_args):
+        cpu_before, requests_before = self.cpu_and_requests()
+        out = subprocess.check_output(
+            [loadgen, '--json'] + loadgen_args +
+            ['localhost:{}'.format(self.mcrouter.getport())])
+        cpu_after, requests_after = self.cpu_and_requests()
+        self.mcrouter.terminate()
+
+        results = json.loads(out.decode('utf-8'))
+        latency = results['latency_us']['all']
+        requests = requests_after - requests_before
+        return {
+            'qps': results['qps'],
+            'cpu_us_per_request': (1e6 * (cpu_after - cpu_before) /
+                                   max(requests, 1)),
+            'latency_p50_us': latency['p50'],
+            'latency_p90_us': latency['p90'],
+            'latency_p99_us': latency['p99'],
+            'latency_p999_us': latency['p999'],
+        }
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compares two mcrouter binaries under the same load')
+    parser.add_argument('--binary-a', required=True,
+                        help='baseline mcrouter binary')
+    parser.add_argument('--binary-b', required=True,
+                        help='candidate mcrouter binary')
+    parser.add_argument('--config', default=DEFAULT_CONFIG,
+                        help='mcrouter config, its ports are replaced '
+                             'by the mock server')
+    parser.add_argument('--runs', type=int, default=6,
+                        help='runs per binary (6)')
+    parser.add_argument('--mcrouter-args', default='',
+                        help='extra mcrouter arguments, space separated')
+    parser.add_argument('--server-threads', type=int, default=4,
+                        help='mock_mc_server threads (4)')
+    parser.add_argument('--loadgen',
+                        default=McrouterGlobals.InstallDir +
+                        '/mcrouter/mcrouter_loadgen')
+    parser.add_argument('--max-regression-pct', type=float, default=1.0,
+                        help='allowed worsening of any metric, in percent '
+                             'of A (1.0)')
+    parser.add_argument('loadgen_args', nargs=argparse.REMAINDER,
+                        help='passed to mcrouter_loadgen, after --')
+    args = parser.parse_args()
+    if args.runs < 2:
+        parser.error('--runs must be at least 2')
+
+    loadgen_args = args.loadgen_args
+    if loadgen_args and loadgen_args[0] == '--':
+        loadgen_args = loadgen_args[1:]
+    mcrouter_args = args.mcrouter_args.split()
+
+    server = Memcached(extra_args=['-T', str(args.server_threads)])
+    server.ensure_connected()
+
+    binaries = {'a': args.binary_a, 'b': args.binary_b}
+    samples = {'a': [], 'b': []}
+    for i in range(args.runs):
+        order = ['a', 'b'] if i % 2 == 0 else ['b', 'a']
+        for name in order:
+            run = Run(binaries[name], args.config, server.getport(),
+                      mcrouter_args)
+            samples[name].append(run.measure(args.loadgen, loadgen_args))
+    server.terminate()
+
+    report = {
+        'binary_a': args.binary_a,
+        'binary_b': args.binary_b,
+        'runs': args.runs,
+        'max_regression_pct': args.max_regression_pct,
+        'samples': samples,
+        'metrics': {},
+    }
+    regression = False
+    for metric, higher_is_better in METRICS:
+        result = compare([s[metric] for s in samples['a']],
+                         [s[metric] for s in samples['b']],
+                         higher_is_better, args.max_regression_pct)
+        report['metrics'][metric] = result
+        regression = regression or result['regression']
+    report['regression'] = regression
+
+    print(json.dumps(report, indent=2, sort_keys=True))
+    return 1 if regression else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,43 @@
+# Copyright (c) 2015, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+from mcrouter.test.MCProcess import McrouterClient, Memcached
+from mcrouter.test.McrouterTestCase import McrouterTestCase
+
+class TestProxyKeyAffinity(McrouterTestCase):
+    config = './mcrouter/test/mcrouter_test_basic_1_1_1.json'
+    extra_args = ['--num-proxies', '4', '--proxy-key-affinity']
+
+    def setUp(self):
+        self.mc = self.add_server(Memcached())
+        self.mcrouter = self.add_mcrouter(self.config,
+                                          extra_args=self.extra_args)
+
+    def test_proxy_key_affinity(self):
+        # connections are spread over proxies, so most requests
+        # have to be forwarded to the proxy owning the key
+        clients = [self.mcrouter]
+        for _ in range(3):
+            client = McrouterClient(self.mcrouter.port)
+            client.connect()
+            clients.append(client)
+
+        for i in range(100):
+            key = 'affinity_key{}'.format(i)
+            writer = clients[i % len(clients)]
+            reader = clients[(i + 1) % len(clients)]
+            self.assertTrue(writer.set(key, 'value{}'.format(i)))
+            self.assertEqual(reader.get(key), 'value{}'.format(i))
+            self.assertEqual(self.mc.get(key), 'value{}'.format(i))
+
+        stats = self.mcrouter.stats()
+        self.assertGreater(int(stats['proxy_reqs_forwarded']), 0)
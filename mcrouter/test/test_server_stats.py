@@ -41,3 +41,29 @@ class TestServerStatsOutstandingRequests(McrouterTestCase):
             self.assertEqual('inflight_reqs', inflight_reqs[0])
             self.assertEqual(1, num_outstanding_reqs)
         self.assertEqual(1, num_stats)
+
+class TestServerStatsPaging(McrouterTestCase):
+    config = './mcrouter/test/test_server_stats_paging.json'
+
+    def setUp(self):
+        for _ in range(3):
+            self.add_server(SleepServer())
+        self.mcrouter = self.add_mcrouter(self.config)
+
+    def test_server_stats_paging(self):
+        all_servers = self.mcrouter.stats('servers')
+        self.assertEqual(3, len(all_servers))
+
+        paged = {}
+        page = self.mcrouter.stats('servers 2')
+        self.assertIn('servers_next_page', page)
+        next_page = page.pop('servers_next_page')
+        self.assertEqual(2, len(page))
+        paged.update(page)
+
+        page = self.mcrouter.stats('servers 2 ' + next_page)
+        self.assertNotIn('servers_next_page', page)
+        self.assertEqual(1, len(page))
+        paged.update(page)
+
+        self.assertEqual(sorted(all_servers.keys()), sorted(paged.keys()))
@@ -0,0 +1,61 @@
+# Copyright (c) 2015, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import socket
+import time
+
+from mcrouter.test.McrouterTestCase import McrouterTestCase
+
+def free_port():
+    s = socket.socket(socket.AF_INET6, socket.SOCK_STREAM)
+    s.bind(('::', 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+class TestStatsExport(McrouterTestCase):
+    config = './mcrouter/test/mcrouter_test_basic_1_1_1.json'
+
+    def setUp(self):
+        self.export_port = free_port()
+        self.mcrouter = self.add_mcrouter(
+            self.config,
+            extra_args=['--stats-export-port', str(self.export_port),
+                        '--stats-export-interval-ms', '100'])
+
+    def scrape(self):
+        s = socket.create_connection(('localhost', self.export_port))
+        s.sendall(b'GET /metrics HTTP/1.0\r\n\r\n')
+        data = b''
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            data += chunk
+        s.close()
+        header, body = data.decode('utf-8').split('\r\n\r\n', 1)
+        return header, body
+
+    def test_stats_export(self):
+        self.mcrouter.get('key')
+        time.sleep(0.5)
+
+        header, body = self.scrape()
+        self.assertTrue(header.startswith('HTTP/1.0 200 OK'))
+        self.assertIn('application/openmetrics-text', header)
+        self.assertTrue(body.endswith('# EOF\n'))
+        self.assertIn('# TYPE mcrouter_uptime gauge\n', body)
+        self.assertIn('# TYPE mcrouter_duration_us histogram\n', body)
+        self.assertIn('# TYPE mcrouter_fibers_ready gauge\n', body)
+        self.assertIn('mcrouter_request_queue_lag_us_count{proxy="0"}', body)
+        self.assertIn('mcrouter_fiber_loop_run_us_count{proxy="0"}', body)
+        self.assertNotIn('mcrouter_version', body)
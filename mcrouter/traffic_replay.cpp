@@ -0,0 +1,175 @@
+/*
+ *  Copyright (c) 2015, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+/**
+ * Replays traffic captured with --traffic-capture-file, see TrafficReplayer.
+ *
+ *   mcrouter_traffic_replay [OPTIONS] HOST:PORT FILE...
+ *   mcrouter_traffic_replay --print FILE...
+ *
+ * FILEs are usually the capture files of all proxies of one mcrouter.
+ */
+
+#include <getopt.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <folly/Conv.h>
+
+#include "mcrouter/TrafficReplayer.h"
+
+using facebook::memcache::mcrouter::TrafficReplayer;
+
+namespace {
+
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [OPTIONS] HOST:PORT FILE...\n"
+          "       %s --print FILE...\n"
+          "\n"
+          "Options:\n"
+          "  --speed X            replay X times faster than captured (1)\n"
+          "  --connections N      (1)\n"
+          "  --protocol P         ascii or umbrella (ascii)\n"
+          "  --max-in-flight N    requests in flight, later ones wait\n"
+          "                       (10000)\n"
+          "  --timeout-ms N       timeout of one request (1000)\n"
+          "  --print              print the captured requests instead, one\n"
+          "                       per line\n",
+          argv0, argv0);
+}
+
+void print(const std::vector<std::string>& files) {
+  for (const auto& file : files) {
+    for (const auto& req : TrafficReplayer::readCapture(file)) {
+      printf("%" PRIu64 " %s %s flags=%" PRIu64 " exptime=%u value=%u\n",
+             req.timestampUs, mc_op_to_string(req.op), req.key.c_str(),
+             req.flags, req.exptime, req.valueSize);
+    }
+  }
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  enum {
+    kSpeed = 256,
+    kConnections,
+    kProtocol,
+    kMaxInFlight,
+    kTimeoutMs,
+    kPrint,
+    kHelp,
+  };
+  static const struct option longOptions[] = {
+    {"speed", required_argument, nullptr, kSpeed},
+    {"connections", required_argument, nullptr, kConnections},
+    {"protocol", required_argument, nullptr, kProtocol},
+    {"max-in-flight", required_argument, nullptr, kMaxInFlight},
+    {"timeout-ms", required_argument, nullptr, kTimeoutMs},
+    {"print", no_argument, nullptr, kPrint},
+    {"help", no_argument, nullptr, kHelp},
+    {nullptr, 0, nullptr, 0},
+  };
+
+  TrafficReplayer::Options opts;
+  bool printOnly = false;
+  try {
+    int c;
+    while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+      switch (c) {
+        case kSpeed:
+          opts.speed = folly::to<double>(optarg);
+          if (opts.speed <= 0) {
+            fprintf(stderr, "speed must be positive\n");
+            return 1;
+          }
+          break;
+        case kConnections:
+          opts.connections = folly::to<size_t>(optarg);
+          break;
+        case kProtocol:
+          opts.protocol = mc_string_to_protocol(optarg);
+          if (opts.protocol != mc_ascii_protocol &&
+              opts.protocol != mc_umbrella_protocol) {
+            fprintf(stderr, "unknown protocol %s\n", optarg);
+            return 1;
+          }
+          break;
+        case kMaxInFlight:
+          opts.maxInFlight = folly::to<size_t>(optarg);
+          break;
+        case kTimeoutMs:
+          opts.timeout = std::chrono::milliseconds(folly::to<int64_t>(optarg));
+          break;
+        case kPrint:
+          printOnly = true;
+          break;
+        case kHelp:
+          usage(argv[0]);
+          return 0;
+        default:
+          usage(argv[0]);
+          return 1;
+      }
+    }
+  } catch (const std::exception& e) {
+    fprintf(stderr, "invalid option value: %s\n", e.what());
+    return 1;
+  }
+
+  if (printOnly) {
+    if (optind == argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    try {
+      print(std::vector<std::string>(argv + optind, argv + argc));
+    } catch (const std::exception& e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+    return 0;
+  }
+
+  if (optind + 2 > argc) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::string hostPort(argv[optind]);
+  auto colon = hostPort.rfind(':');
+  if (colon == std::string::npos) {
+    usage(argv[0]);
+    return 1;
+  }
+  try {
+    opts.host = hostPort.substr(0, colon);
+    opts.port = folly::to<uint16_t>(hostPort.substr(colon + 1));
+  } catch (const std::exception& e) {
+    fprintf(stderr, "invalid port: %s\n", e.what());
+    return 1;
+  }
+
+  try {
+    TrafficReplayer replayer(std::move(opts),
+      std::vector<std::string>(argv + optind + 1, argv + argc));
+    fprintf(stderr, "replaying %zu requests\n", replayer.requests());
+    auto results = replayer.run();
+    fputs(results.toString().c_str(), stdout);
+  } catch (const std::exception& e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}